@@ -52,6 +52,28 @@ Locator::encode(char buf[encoded_max]) noexcept
   return len;
 }
 
+uint32_t
+Locator::encode(const Locator* locators, size_t count, char* buf) noexcept
+{
+  char* pos = buf;
+  for (size_t i = 0; i < count; i++) {
+    pos += Locator(locators[i]).encode(pos) + 1;
+  }
+  return pos - buf;
+}
+
+// '0' - '9', 'A' - 'Z' and 'a' - 'z' are the digits 0 - 61.
+const int8_t Locator::global_class_index_digit_values[128] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+  25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, -1, -1, -1, -1, -1,
+  -1, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50,
+  51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1,
+};
+
 static char getDigit(uint32_t num) {
   assert(num >= 0 && num < Locator::global_class_index_digits_base);
   if (num < 10) {
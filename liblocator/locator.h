@@ -8,6 +8,7 @@
  */
 
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
 namespace facebook {
@@ -153,6 +154,24 @@ class Locator {
 
   static inline Locator decodeBackward(const char* endpos) noexcept;
 
+  // Batch versions of encode and decodeBackward, for tools that handle many
+  // locators at once.
+  //
+  // encode writes the locator strings of locators[0], ..., locators[count - 1]
+  // one after the other, each with its terminating NUL, into buf, which must
+  // have room for count * encoded_max bytes. Returns the number of bytes
+  // written.
+  static uint32_t encode(const Locator* locators,
+                         size_t count,
+                         char* buf) noexcept;
+
+  // decodeBackward calls f(i, locator) with the locator that ends at
+  // endpos[i], for each i below count.
+  template <typename F>
+  static inline void decodeBackward(const char* const* endpos,
+                                    size_t count,
+                                    F f);
+
   // We use a base-62 encoding for global class indices.
   constexpr static const uint32_t global_class_index_digits_base = 62;
   // Encoded global class indices are of the form "LX/000000;" with at most
@@ -162,6 +181,8 @@ class Locator {
   static void encodeGlobalClassIndex(
       uint32_t globalClassIndex, size_t digits, char buf[encoded_global_class_index_max]) noexcept;
   constexpr static const uint32_t invalid_global_class_index = 0xFFFFFFFF;
+  // The value of each ASCII character as a base-62 digit, or -1.
+  static const int8_t global_class_index_digit_values[128];
       static inline uint32_t decodeGlobalClassIndex(
           const char* descriptor) noexcept;
 
@@ -187,6 +208,13 @@ Locator::decodeBackward(const char* endpos) noexcept
   return Locator(str, dex, cls);
 }
 
+template <typename F>
+void Locator::decodeBackward(const char* const* endpos, size_t count, F f) {
+  for (size_t i = 0; i < count; i++) {
+    f(i, decodeBackward(endpos[i]));
+  }
+}
+
 uint32_t Locator::decodeGlobalClassIndex(const char* descriptor) noexcept {
   // strip away array
   while (*descriptor == '[')
@@ -199,17 +227,13 @@ uint32_t Locator::decodeGlobalClassIndex(const char* descriptor) noexcept {
   descriptor += 3;
 
   uint64_t value = 0;
-  char c = *(descriptor++);
+  uint8_t c = *(descriptor++);
   while (true) {
-    if (c >= '0' && c <= '9') {
-      value += c - '0';
-    } else if (c >= 'A' && c <= 'Z') {
-      value += c - 'A' + 10;
-    } else if (c >= 'a' && c <= 'z') {
-      value += c - 'a' + 10 + 26;
-    } else {
+    int8_t digit = c < 128 ? global_class_index_digit_values[c] : -1;
+    if (digit < 0) {
       return invalid_global_class_index;
     }
+    value += digit;
 
     c = *(descriptor++);
     if (c == ';') {
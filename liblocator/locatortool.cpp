@@ -1,8 +1,10 @@
 // Copyright 2004-present Facebook. All Rights Reserved.
 
+#include <chrono>
 #include <iostream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 
 #include <locator.h>
 
@@ -13,12 +15,15 @@ void print_usage() {
   cout << "Usage:" << endl;
   cout << "  locatortool d" << endl;
   cout << "  locatortool e [-h|--hex] <class_num> <dex_num> <store_num>" << endl;
+  cout << "  locatortool b [<count>]" << endl;
   cout << endl;
   cout << endl;
   cout << "  Commands:" << endl;
-  cout << "    d              Decode a (raw, not hex) locator string from stdin." << endl;
+  cout << "    d              Decode the (raw, not hex) locator strings from stdin," << endl;
+  cout << "                   separated by whitespace." << endl;
   cout << "    e              Encode a value" << endl;
   cout << "      -h | --hex   Print a hexdump of the locator instead of the raw string" << endl;
+  cout << "    b              Time the encoding and decoding of <count> locators" << endl;
   cout << endl;
 }
 
@@ -36,12 +41,61 @@ int main(int argc, char* argv[]) {
   try {
     switch (*argv[1]) {
       case 'd': {
+        vector<string> locator_strs;
         string locator_str;
-        cin >> locator_str;
-        Locator locator = Locator::decodeBackward(locator_str.c_str() + locator_str.size());
-        cout << "class: " << locator.clsnr << endl;
-        cout << "dex  : " << locator.dexnr << endl;
-        cout << "store: " << locator.strnr << endl;
+        while (cin >> locator_str) {
+          // Decoding stops at the byte before the locator.
+          locator_strs.push_back(string(1, '\0') + locator_str);
+        }
+        vector<const char*> endpos;
+        for (const auto& str : locator_strs) {
+          endpos.push_back(str.c_str() + str.size());
+        }
+        Locator::decodeBackward(
+            endpos.data(), endpos.size(), [](size_t, const Locator& locator) {
+              cout << "class: " << locator.clsnr << "\n";
+              cout << "dex  : " << locator.dexnr << "\n";
+              cout << "store: " << locator.strnr << "\n";
+            });
+        cout << flush;
+        break;
+      }
+      case 'b': {
+        size_t count = args.size() > 2 ? stoul(args[2]) : 10000000;
+        vector<Locator> locators;
+        locators.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+          locators.push_back(Locator::make(i % 4, 1 + i % 32, i % 100000));
+        }
+        // Each locator string is preceded by a byte, as in the string table,
+        // where decoding stops.
+        vector<char> buf(count * (Locator::encoded_max + 1));
+        vector<const char*> endpos(count);
+        auto start = chrono::steady_clock::now();
+        char* pos = buf.data();
+        for (size_t i = 0; i < count; i++) {
+          *pos++ = '\0';
+          pos += locators[i].encode(pos);
+          endpos[i] = pos++;
+        }
+        auto encoded = chrono::steady_clock::now();
+        size_t mismatches = 0;
+        Locator::decodeBackward(
+            endpos.data(), count, [&](size_t i, const Locator& locator) {
+              mismatches += locator.clsnr != locators[i].clsnr ||
+                            locator.dexnr != locators[i].dexnr ||
+                            locator.strnr != locators[i].strnr;
+            });
+        auto decoded = chrono::steady_clock::now();
+        using ms = chrono::duration<double, milli>;
+        cout << "encoded " << count << " locators in "
+             << ms(encoded - start).count() << " ms" << endl;
+        cout << "decoded " << count << " locators in "
+             << ms(decoded - encoded).count() << " ms" << endl;
+        if (mismatches != 0) {
+          cout << mismatches << " locators didn't round-trip" << endl;
+          return 1;
+        }
         break;
       }
       case 'e': {
@@ -0,0 +1,833 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "BinarySerialization.h"
+#include "ConstantAbstractDomain.h"
+#include "Debug.h"
+#include "DexClass.h"
+#include "FiniteAbstractDomain.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+#include "PatriciaTreeMapAbstractPartition.h"
+#include "PowersetAbstractDomain.h"
+#include "ReducedProductAbstractDomain.h"
+#include "S_Expression.h"
+#include "Show.h"
+
+/*
+ * Serialization of abstract values, so that analysis results can be cached
+ * between runs or compared across builds. Each supported domain comes with two
+ * encodings:
+ *
+ *   - write() / read() use the compact binary format of BinarySerialization.h.
+ *     The abstract value kind is emitted as one byte, followed by the contents
+ *     of the value, if any. Callers are expected to put a header in front of
+ *     the data with binary_serialization::write_header().
+ *
+ *   - to_s_expr() / from_s_expr() produce a human-readable S-expression, meant
+ *     for debugging. Top and Bottom are the symbols `top` and `bottom`, and the
+ *     elements of sets and bindings of maps are sorted by their text, so that
+ *     the output of two runs can be diffed.
+ *
+ * The supported domains are ConstantAbstractDomain, FiniteAbstractDomain, the
+ * powerset domains (HashedSetAbstractDomain, PatriciaTreeSetAbstractDomain,
+ * etc.), PatriciaTreeMapAbstractEnvironment, PatriciaTreeMapAbstractPartition
+ * and ReducedProductAbstractDomain, which covers SignedConstantDomain. The
+ * derived class of a reduced product must be constructible from a tuple of
+ * its components.
+ *
+ * The elements of these domains can be integers, enums, strings, or pointers
+ * to DexString, DexType, DexFieldRef, DexField, DexMethodRef and DexMethod.
+ * The latter are encoded by name, which means that the fields and methods must
+ * exist when the data is read back.
+ */
+
+namespace domain_serialization {
+
+namespace impl {
+
+template <typename T>
+struct DexNaming {
+  static constexpr bool supported = false;
+};
+
+template <>
+struct DexNaming<DexString> {
+  static constexpr bool supported = true;
+  static std::string name(const DexString* s) { return s->str(); }
+  static DexString* lookup(const std::string& name) {
+    return DexString::make_string(name);
+  }
+};
+
+template <>
+struct DexNaming<DexType> {
+  static constexpr bool supported = true;
+  static std::string name(const DexType* type) { return show(type); }
+  static DexType* lookup(const std::string& name) {
+    return DexType::make_type(name.c_str());
+  }
+};
+
+template <>
+struct DexNaming<DexFieldRef> {
+  static constexpr bool supported = true;
+  static std::string name(const DexFieldRef* field) { return show(field); }
+  static DexFieldRef* lookup(const std::string& name) {
+    auto field = DexField::get_field(name);
+    always_assert_log(field != nullptr, "Unknown field %s", name.c_str());
+    return field;
+  }
+};
+
+template <>
+struct DexNaming<DexField> {
+  static constexpr bool supported = true;
+  static std::string name(const DexField* field) { return show(field); }
+  static DexField* lookup(const std::string& name) {
+    auto field = DexNaming<DexFieldRef>::lookup(name);
+    always_assert_log(field->is_def(), "Undefined field %s", name.c_str());
+    return static_cast<DexField*>(field);
+  }
+};
+
+template <>
+struct DexNaming<DexMethodRef> {
+  static constexpr bool supported = true;
+  static std::string name(const DexMethodRef* method) { return show(method); }
+  static DexMethodRef* lookup(const std::string& name) {
+    auto method = DexMethod::get_method(name);
+    always_assert_log(method != nullptr, "Unknown method %s", name.c_str());
+    return method;
+  }
+};
+
+template <>
+struct DexNaming<DexMethod> {
+  static constexpr bool supported = true;
+  static std::string name(const DexMethod* method) { return show(method); }
+  static DexMethod* lookup(const std::string& name) {
+    auto method = DexNaming<DexMethodRef>::lookup(name);
+    always_assert_log(method->is_def(), "Undefined method %s", name.c_str());
+    return static_cast<DexMethod*>(method);
+  }
+};
+
+template <typename T>
+using EnableIfNumeric =
+    std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value>;
+
+template <typename T>
+using EnableIfDex =
+    std::enable_if_t<DexNaming<std::remove_const_t<T>>::supported>;
+
+template <typename T>
+using Numeric = std::conditional_t<std::is_enum<T>::value,
+                                   std::underlying_type<T>,
+                                   std::common_type<T>>;
+
+/*
+ * Encodings of the elements of the domains.
+ */
+
+template <typename T, typename = EnableIfNumeric<T>>
+void write_element(std::ostream& os, const T& value) {
+  binary_serialization::write(
+      os, static_cast<typename Numeric<T>::type>(value));
+}
+
+template <typename T, typename = EnableIfNumeric<T>>
+void read_element(std::istream& is, T* value) {
+  *value =
+      static_cast<T>(binary_serialization::read<typename Numeric<T>::type>(is));
+}
+
+// Integers that fit are printed as such, the others as strings.
+template <typename T, typename = EnableIfNumeric<T>>
+sparta::s_expr element_to_s_expr(const T& value) {
+  using N = typename Numeric<T>::type;
+  auto n = static_cast<N>(value);
+  if (n <= static_cast<N>(std::numeric_limits<int32_t>::max()) &&
+      (std::is_unsigned<N>::value ||
+       static_cast<int64_t>(n) >= std::numeric_limits<int32_t>::min())) {
+    return sparta::s_expr(static_cast<int32_t>(n));
+  }
+  return sparta::s_expr(std::to_string(n));
+}
+
+template <typename T, typename = EnableIfNumeric<T>>
+void element_from_s_expr(const sparta::s_expr& e, T* value) {
+  using N = typename Numeric<T>::type;
+  if (e.is_int32()) {
+    *value = static_cast<T>(static_cast<N>(e.get_int32()));
+    return;
+  }
+  always_assert_log(e.is_string(), "Expected a number, got %s",
+                    e.str().c_str());
+  *value = static_cast<T>(static_cast<N>(
+      std::is_unsigned<N>::value ? std::stoull(e.get_string())
+                                 : std::stoll(e.get_string())));
+}
+
+inline void write_element(std::ostream& os, const std::string& value) {
+  binary_serialization::write(os, value);
+}
+
+inline void read_element(std::istream& is, std::string* value) {
+  *value = binary_serialization::read_string(is);
+}
+
+inline sparta::s_expr element_to_s_expr(const std::string& value) {
+  return sparta::s_expr(value);
+}
+
+inline void element_from_s_expr(const sparta::s_expr& e, std::string* value) {
+  always_assert_log(e.is_string(), "Expected a string, got %s",
+                    e.str().c_str());
+  *value = e.get_string();
+}
+
+template <typename T, typename = EnableIfDex<T>>
+void write_element(std::ostream& os, T* value) {
+  binary_serialization::write(
+      os, DexNaming<std::remove_const_t<T>>::name(value));
+}
+
+template <typename T, typename = EnableIfDex<T>>
+void read_element(std::istream& is, T** value) {
+  *value = DexNaming<std::remove_const_t<T>>::lookup(
+      binary_serialization::read_string(is));
+}
+
+template <typename T, typename = EnableIfDex<T>>
+sparta::s_expr element_to_s_expr(T* value) {
+  return sparta::s_expr(DexNaming<std::remove_const_t<T>>::name(value));
+}
+
+template <typename T, typename = EnableIfDex<T>>
+void element_from_s_expr(const sparta::s_expr& e, T** value) {
+  always_assert_log(e.is_string(), "Expected a name, got %s", e.str().c_str());
+  *value = DexNaming<std::remove_const_t<T>>::lookup(e.get_string());
+}
+
+template <typename Domain>
+void write_kind(std::ostream& os, const Domain& domain) {
+  auto kind = domain.is_bottom()
+                  ? sparta::AbstractValueKind::Bottom
+                  : (domain.is_top() ? sparta::AbstractValueKind::Top
+                                     : sparta::AbstractValueKind::Value);
+  binary_serialization::write(os, static_cast<uint8_t>(kind));
+}
+
+// Reads the abstract value kind. If it is Bottom or Top, the domain is set
+// accordingly and there is nothing more to read.
+template <typename Domain>
+bool read_kind(std::istream& is, Domain* domain) {
+  auto kind = static_cast<sparta::AbstractValueKind>(
+      binary_serialization::read<uint8_t>(is));
+  if (kind == sparta::AbstractValueKind::Bottom) {
+    domain->set_to_bottom();
+    return false;
+  }
+  if (kind == sparta::AbstractValueKind::Top) {
+    domain->set_to_top();
+    return false;
+  }
+  always_assert_log(kind == sparta::AbstractValueKind::Value,
+                    "Invalid abstract value kind %u",
+                    static_cast<uint8_t>(kind));
+  return true;
+}
+
+// Returns the S-expression for Top or Bottom, or nil for the other values.
+template <typename Domain>
+sparta::s_expr kind_to_s_expr(const Domain& domain) {
+  if (domain.is_bottom()) {
+    return sparta::s_expr("bottom");
+  }
+  if (domain.is_top()) {
+    return sparta::s_expr("top");
+  }
+  return sparta::s_expr();
+}
+
+// Handles the symbols `top` and `bottom`, and otherwise checks that `e` is a
+// list whose head is `tag`.
+template <typename Domain>
+bool kind_from_s_expr(const sparta::s_expr& e,
+                      const std::string& tag,
+                      Domain* domain) {
+  if (e.is_string() && e.get_string() == "bottom") {
+    domain->set_to_bottom();
+    return false;
+  }
+  if (e.is_string() && e.get_string() == "top") {
+    domain->set_to_top();
+    return false;
+  }
+  always_assert_log(e.is_list() && e.size() >= 1 && e[0].is_string() &&
+                        e[0].get_string() == tag,
+                    "Expected a %s, got %s", tag.c_str(), e.str().c_str());
+  return true;
+}
+
+inline void sort_s_exprs(std::vector<sparta::s_expr>* exprs) {
+  std::sort(exprs->begin(), exprs->end(),
+            [](const sparta::s_expr& e1, const sparta::s_expr& e2) {
+              return e1.str() < e2.str();
+            });
+}
+
+} // namespace impl
+
+/*
+ * The overloads are all declared upfront, so that the ones for the domains
+ * that contain other domains can find each other.
+ */
+
+template <typename Constant>
+void write(std::ostream& os,
+           const sparta::ConstantAbstractDomain<Constant>& domain);
+template <typename Constant>
+void read(std::istream& is, sparta::ConstantAbstractDomain<Constant>* domain);
+template <typename Constant>
+sparta::s_expr to_s_expr(
+    const sparta::ConstantAbstractDomain<Constant>& domain);
+template <typename Constant>
+void from_s_expr(const sparta::s_expr& e,
+                 sparta::ConstantAbstractDomain<Constant>* domain);
+
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+void write(
+    std::ostream& os,
+    const sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>&
+        domain);
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+void read(
+    std::istream& is,
+    sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>* domain);
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+sparta::s_expr to_s_expr(
+    const sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>&
+        domain);
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>* domain);
+
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+void write(std::ostream& os,
+           const sparta::PowersetAbstractDomain<Element,
+                                                Powerset,
+                                                Snapshot,
+                                                Derived>& domain);
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+void read(std::istream& is,
+          sparta::PowersetAbstractDomain<Element, Powerset, Snapshot, Derived>*
+              domain);
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+sparta::s_expr to_s_expr(
+    const sparta::
+        PowersetAbstractDomain<Element, Powerset, Snapshot, Derived>& domain);
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::PowersetAbstractDomain<Element, Powerset, Snapshot, Derived>*
+        domain);
+
+template <typename Variable, typename Domain>
+void write(
+    std::ostream& os,
+    const sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>& env);
+template <typename Variable, typename Domain>
+void read(std::istream& is,
+          sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>* env);
+template <typename Variable, typename Domain>
+sparta::s_expr to_s_expr(
+    const sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>& env);
+template <typename Variable, typename Domain>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>* env);
+
+template <typename Label, typename Domain>
+void write(
+    std::ostream& os,
+    const sparta::PatriciaTreeMapAbstractPartition<Label, Domain>& partition);
+template <typename Label, typename Domain>
+void read(std::istream& is,
+          sparta::PatriciaTreeMapAbstractPartition<Label, Domain>* partition);
+template <typename Label, typename Domain>
+sparta::s_expr to_s_expr(
+    const sparta::PatriciaTreeMapAbstractPartition<Label, Domain>& partition);
+template <typename Label, typename Domain>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::PatriciaTreeMapAbstractPartition<Label, Domain>* partition);
+
+template <typename Derived, typename... Domains>
+void write(
+    std::ostream& os,
+    const sparta::ReducedProductAbstractDomain<Derived, Domains...>& product);
+template <typename Derived, typename... Domains>
+void read(std::istream& is,
+          sparta::ReducedProductAbstractDomain<Derived, Domains...>* product);
+template <typename Derived, typename... Domains>
+sparta::s_expr to_s_expr(
+    const sparta::ReducedProductAbstractDomain<Derived, Domains...>& product);
+template <typename Derived, typename... Domains>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::ReducedProductAbstractDomain<Derived, Domains...>* product);
+
+/*
+ * ConstantAbstractDomain: (constant <element>)
+ */
+
+template <typename Constant>
+void write(std::ostream& os,
+           const sparta::ConstantAbstractDomain<Constant>& domain) {
+  impl::write_kind(os, domain);
+  if (domain.is_value()) {
+    impl::write_element(os, *domain.get_constant());
+  }
+}
+
+template <typename Constant>
+void read(std::istream& is, sparta::ConstantAbstractDomain<Constant>* domain) {
+  if (impl::read_kind(is, domain)) {
+    Constant constant;
+    impl::read_element(is, &constant);
+    *domain = sparta::ConstantAbstractDomain<Constant>(constant);
+  }
+}
+
+template <typename Constant>
+sparta::s_expr to_s_expr(
+    const sparta::ConstantAbstractDomain<Constant>& domain) {
+  if (!domain.is_value()) {
+    return impl::kind_to_s_expr(domain);
+  }
+  return sparta::s_expr({sparta::s_expr("constant"),
+                         impl::element_to_s_expr(*domain.get_constant())});
+}
+
+template <typename Constant>
+void from_s_expr(const sparta::s_expr& e,
+                 sparta::ConstantAbstractDomain<Constant>* domain) {
+  if (impl::kind_from_s_expr(e, "constant", domain)) {
+    always_assert_log(e.size() == 2, "Malformed constant %s", e.str().c_str());
+    Constant constant;
+    impl::element_from_s_expr(e[1], &constant);
+    *domain = sparta::ConstantAbstractDomain<Constant>(constant);
+  }
+}
+
+/*
+ * FiniteAbstractDomain: (element <element>)
+ *
+ * Top and Bottom are elements of the lattice, so they are not special-cased.
+ */
+
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+void write(
+    std::ostream& os,
+    const sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>&
+        domain) {
+  impl::write_element(os, domain.element());
+}
+
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+void read(
+    std::istream& is,
+    sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>* domain) {
+  Element element;
+  impl::read_element(is, &element);
+  using Domain =
+      sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>;
+  *domain = Domain(element);
+}
+
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+sparta::s_expr to_s_expr(
+    const sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>&
+        domain) {
+  return sparta::s_expr({sparta::s_expr("element"),
+                         impl::element_to_s_expr(domain.element())});
+}
+
+template <typename Element,
+          typename Lattice,
+          typename Encoding,
+          Lattice* lattice>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>* domain) {
+  always_assert_log(e.is_list() && e.size() == 2 && e[0].is_string() &&
+                        e[0].get_string() == "element",
+                    "Expected an element, got %s", e.str().c_str());
+  Element element;
+  impl::element_from_s_expr(e[1], &element);
+  using Domain =
+      sparta::FiniteAbstractDomain<Element, Lattice, Encoding, lattice>;
+  *domain = Domain(element);
+}
+
+/*
+ * Powerset domains: (set <element>...)
+ */
+
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+void write(std::ostream& os,
+           const sparta::PowersetAbstractDomain<Element,
+                                                Powerset,
+                                                Snapshot,
+                                                Derived>& domain) {
+  impl::write_kind(os, domain);
+  if (domain.is_value()) {
+    const auto& elements = domain.elements();
+    binary_serialization::write<uint32_t>(os, domain.size());
+    for (const auto& element : elements) {
+      impl::write_element(os, element);
+    }
+  }
+}
+
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+void read(std::istream& is,
+          sparta::PowersetAbstractDomain<Element, Powerset, Snapshot, Derived>*
+              domain) {
+  if (impl::read_kind(is, domain)) {
+    Derived set;
+    auto size = binary_serialization::read<uint32_t>(is);
+    for (uint32_t i = 0; i < size; ++i) {
+      Element element;
+      impl::read_element(is, &element);
+      set.add(element);
+    }
+    *static_cast<Derived*>(domain) = set;
+  }
+}
+
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+sparta::s_expr to_s_expr(
+    const sparta::
+        PowersetAbstractDomain<Element, Powerset, Snapshot, Derived>& domain) {
+  if (!domain.is_value()) {
+    return impl::kind_to_s_expr(domain);
+  }
+  std::vector<sparta::s_expr> elements;
+  for (const auto& element : domain.elements()) {
+    elements.push_back(impl::element_to_s_expr(element));
+  }
+  impl::sort_s_exprs(&elements);
+  elements.insert(elements.begin(), sparta::s_expr("set"));
+  return sparta::s_expr(elements);
+}
+
+template <typename Element,
+          typename Powerset,
+          typename Snapshot,
+          typename Derived>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::PowersetAbstractDomain<Element, Powerset, Snapshot, Derived>*
+        domain) {
+  if (impl::kind_from_s_expr(e, "set", domain)) {
+    Derived set;
+    for (size_t i = 1; i < e.size(); ++i) {
+      Element element;
+      impl::element_from_s_expr(e[i], &element);
+      set.add(element);
+    }
+    *static_cast<Derived*>(domain) = set;
+  }
+}
+
+/*
+ * Map domains: (environment (<key> <value>)...) and (partition ...)
+ */
+
+namespace impl {
+
+template <typename Map>
+void write_bindings(std::ostream& os, const Map& bindings) {
+  binary_serialization::write<uint32_t>(os, bindings.size());
+  for (const auto& binding : bindings) {
+    write_element(os, binding.first);
+    write(os, binding.second);
+  }
+}
+
+template <typename Key, typename Value, typename Map>
+void read_bindings(std::istream& is, Map* map) {
+  auto size = binary_serialization::read<uint32_t>(is);
+  for (uint32_t i = 0; i < size; ++i) {
+    Key key;
+    read_element(is, &key);
+    Value value;
+    read(is, &value);
+    map->set(key, value);
+  }
+}
+
+template <typename Map>
+sparta::s_expr bindings_to_s_expr(const std::string& tag, const Map& bindings) {
+  std::vector<sparta::s_expr> exprs;
+  for (const auto& binding : bindings) {
+    exprs.push_back(sparta::s_expr(
+        {element_to_s_expr(binding.first), to_s_expr(binding.second)}));
+  }
+  sort_s_exprs(&exprs);
+  exprs.insert(exprs.begin(), sparta::s_expr(tag));
+  return sparta::s_expr(exprs);
+}
+
+template <typename Key, typename Value, typename Map>
+void bindings_from_s_expr(const sparta::s_expr& e, Map* map) {
+  for (size_t i = 1; i < e.size(); ++i) {
+    const auto& binding = e[i];
+    always_assert_log(binding.is_list() && binding.size() == 2,
+                      "Malformed binding %s", binding.str().c_str());
+    Key key;
+    element_from_s_expr(binding[0], &key);
+    Value value;
+    from_s_expr(binding[1], &value);
+    map->set(key, value);
+  }
+}
+
+} // namespace impl
+
+template <typename Variable, typename Domain>
+void write(
+    std::ostream& os,
+    const sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>& env) {
+  impl::write_kind(os, env);
+  if (env.is_value()) {
+    impl::write_bindings(os, env.bindings());
+  }
+}
+
+template <typename Variable, typename Domain>
+void read(std::istream& is,
+          sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>* env) {
+  if (impl::read_kind(is, env)) {
+    env->set_to_top();
+    impl::read_bindings<Variable, Domain>(is, env);
+  }
+}
+
+template <typename Variable, typename Domain>
+sparta::s_expr to_s_expr(
+    const sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>& env) {
+  if (!env.is_value()) {
+    return impl::kind_to_s_expr(env);
+  }
+  return impl::bindings_to_s_expr("environment", env.bindings());
+}
+
+template <typename Variable, typename Domain>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>* env) {
+  if (impl::kind_from_s_expr(e, "environment", env)) {
+    env->set_to_top();
+    impl::bindings_from_s_expr<Variable, Domain>(e, env);
+  }
+}
+
+template <typename Label, typename Domain>
+void write(
+    std::ostream& os,
+    const sparta::PatriciaTreeMapAbstractPartition<Label, Domain>& partition) {
+  impl::write_kind(os, partition);
+  if (!partition.is_top() && !partition.is_bottom()) {
+    impl::write_bindings(os, partition.bindings());
+  }
+}
+
+template <typename Label, typename Domain>
+void read(std::istream& is,
+          sparta::PatriciaTreeMapAbstractPartition<Label, Domain>* partition) {
+  if (impl::read_kind(is, partition)) {
+    partition->set_to_bottom();
+    impl::read_bindings<Label, Domain>(is, partition);
+  }
+}
+
+template <typename Label, typename Domain>
+sparta::s_expr to_s_expr(
+    const sparta::PatriciaTreeMapAbstractPartition<Label, Domain>& partition) {
+  if (partition.is_top() || partition.is_bottom()) {
+    return impl::kind_to_s_expr(partition);
+  }
+  return impl::bindings_to_s_expr("partition", partition.bindings());
+}
+
+template <typename Label, typename Domain>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::PatriciaTreeMapAbstractPartition<Label, Domain>* partition) {
+  if (impl::kind_from_s_expr(e, "partition", partition)) {
+    partition->set_to_bottom();
+    impl::bindings_from_s_expr<Label, Domain>(e, partition);
+  }
+}
+
+/*
+ * ReducedProductAbstractDomain: (product <component>...)
+ *
+ * Only Bottom is special-cased, since the reduction may not preserve the
+ * components of the other values. Reading back goes through the reduction
+ * again.
+ */
+
+namespace impl {
+
+template <typename Derived, typename... Domains, size_t... Indices>
+void write_components(
+    std::ostream& os,
+    const sparta::ReducedProductAbstractDomain<Derived, Domains...>& product,
+    std::index_sequence<Indices...>) {
+  (void)std::initializer_list<int>{
+      (write(os, product.template get<Indices>()), 0)...};
+}
+
+template <typename... Domains, size_t... Indices>
+void read_components(std::istream& is,
+                     std::tuple<Domains...>* components,
+                     std::index_sequence<Indices...>) {
+  (void)std::initializer_list<int>{
+      (read(is, &std::get<Indices>(*components)), 0)...};
+}
+
+template <typename Derived, typename... Domains, size_t... Indices>
+std::vector<sparta::s_expr> components_to_s_exprs(
+    const sparta::ReducedProductAbstractDomain<Derived, Domains...>& product,
+    std::index_sequence<Indices...>) {
+  return {sparta::s_expr("product"),
+          to_s_expr(product.template get<Indices>())...};
+}
+
+template <typename... Domains, size_t... Indices>
+void components_from_s_expr(const sparta::s_expr& e,
+                            std::tuple<Domains...>* components,
+                            std::index_sequence<Indices...>) {
+  (void)std::initializer_list<int>{
+      (from_s_expr(e[Indices + 1], &std::get<Indices>(*components)), 0)...};
+}
+
+} // namespace impl
+
+template <typename Derived, typename... Domains>
+void write(
+    std::ostream& os,
+    const sparta::ReducedProductAbstractDomain<Derived, Domains...>& product) {
+  impl::write_kind(os, product);
+  if (!product.is_bottom()) {
+    impl::write_components(os, product, std::index_sequence_for<Domains...>());
+  }
+}
+
+template <typename Derived, typename... Domains>
+void read(std::istream& is,
+          sparta::ReducedProductAbstractDomain<Derived, Domains...>* product) {
+  auto kind = static_cast<sparta::AbstractValueKind>(
+      binary_serialization::read<uint8_t>(is));
+  if (kind == sparta::AbstractValueKind::Bottom) {
+    product->set_to_bottom();
+    return;
+  }
+  std::tuple<Domains...> components;
+  impl::read_components(is, &components, std::index_sequence_for<Domains...>());
+  *static_cast<Derived*>(product) = Derived(components);
+}
+
+template <typename Derived, typename... Domains>
+sparta::s_expr to_s_expr(
+    const sparta::ReducedProductAbstractDomain<Derived, Domains...>& product) {
+  if (product.is_bottom()) {
+    return impl::kind_to_s_expr(product);
+  }
+  return sparta::s_expr(impl::components_to_s_exprs(
+      product, std::index_sequence_for<Domains...>()));
+}
+
+template <typename Derived, typename... Domains>
+void from_s_expr(
+    const sparta::s_expr& e,
+    sparta::ReducedProductAbstractDomain<Derived, Domains...>* product) {
+  if (e.is_string() && e.get_string() == "bottom") {
+    product->set_to_bottom();
+    return;
+  }
+  always_assert_log(e.is_list() && e.size() == sizeof...(Domains) + 1 &&
+                        e[0].is_string() && e[0].get_string() == "product",
+                    "Expected a product, got %s", e.str().c_str());
+  std::tuple<Domains...> components;
+  impl::components_from_s_expr(
+      e, &components, std::index_sequence_for<Domains...>());
+  *static_cast<Derived*>(product) = Derived(components);
+}
+
+} // namespace domain_serialization
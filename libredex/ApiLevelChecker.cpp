@@ -39,8 +39,18 @@ void LevelChecker::init(int32_t min_level, const Scope& scope) {
             "unused (okay) or been deleted (not okay)\n");
   }
 
-  walk::parallel::classes(scope, init_class);
-  walk::parallel::methods(scope, init_method);
+  // The methods of a class take its level, so they are done in the same
+  // task. Inner classes share the parsing of the names of their outer classes.
+  OuterClasses outer_classes;
+  walk::parallel::classes(scope, [&outer_classes](DexClass* cls) {
+    init_class(cls, &outer_classes);
+    for (auto* method : cls->get_dmethods()) {
+      init_method(method);
+    }
+    for (auto* method : cls->get_vmethods()) {
+      init_method(method);
+    }
+  });
 }
 
 int32_t LevelChecker::get_method_level(DexMethod* method) {
@@ -62,8 +72,15 @@ int32_t LevelChecker::get_method_level(DexMethod* method) {
   return method_level;
 }
 
-void LevelChecker::init_class(DexClass* clazz) {
-  for (DexClass* cls = clazz; cls != nullptr; cls = get_outer_class(cls)) {
+void LevelChecker::init_class(DexClass* clazz, OuterClasses* outer_classes) {
+  auto outer_class = [outer_classes](const DexClass* cls) {
+    if (outer_classes == nullptr) {
+      return get_outer_class(cls);
+    }
+    return outer_classes->get_or_create(
+        cls, [cls] { return get_outer_class(cls); });
+  };
+  for (DexClass* cls = clazz; cls != nullptr; cls = outer_class(cls)) {
     int32_t class_level = get_level(cls);
     if (class_level != -1) {
       clazz->rstate.set_api_level(class_level);
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "DexAnnotation.h"
 #include "DexClass.h"
 
@@ -91,8 +92,12 @@ class LevelChecker {
   }
 
  private:
+  // The outer class of each class that `init` has looked at.
+  using OuterClasses = ConcurrentMap<const DexClass*, DexClass*>;
+
   static DexClass* get_outer_class(const DexClass* cls);
-  static void init_class(DexClass* clazz);
+  static void init_class(DexClass* clazz,
+                         OuterClasses* outer_classes = nullptr);
   static void init_method(DexMethod* method);
 
   /**
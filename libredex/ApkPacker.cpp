@@ -0,0 +1,361 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ApkPacker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "JarLoader.h"
+#include "WorkQueue.h"
+
+namespace {
+
+constexpr uint16_t kCompMethodStored = 0;
+constexpr uint16_t kCompMethodDeflate = 8;
+// The sizes of the entries are in the local file headers we write.
+constexpr uint16_t kFlagDataDescriptor = 0x8;
+constexpr uint16_t kVersion = 20;
+constexpr size_t kPageSize = 4096;
+constexpr uint32_t kLFileSignature = 0x04034b50;
+constexpr uint32_t kCDFileSignature = 0x02014b50;
+constexpr uint32_t kCDirEndSignature = 0x06054b50;
+constexpr size_t kLFileSize = 30;
+
+struct OutputEntry {
+  std::string name;
+  // The entry of the original APK with the same name, if any.
+  const ZipEntry* original{nullptr};
+  // The extracted file.
+  std::string path;
+
+  uint16_t flags{0};
+  uint16_t comp_method{kCompMethodDeflate};
+  uint16_t mod_time{0};
+  uint16_t mod_date{0};
+  uint32_t crc32{0};
+  uint32_t comp_size{0};
+  uint32_t ucomp_size{0};
+  uint32_t external_attr{0};
+  // Either the raw bytes of the original entry, or `encoded`.
+  const uint8_t* data{nullptr};
+  std::vector<uint8_t> encoded;
+  uint32_t offset{0};
+};
+
+void put16(std::vector<uint8_t>* out, uint16_t v) {
+  out->push_back(v & 0xff);
+  out->push_back(v >> 8);
+}
+
+void put32(std::vector<uint8_t>* out, uint32_t v) {
+  put16(out, v & 0xffff);
+  put16(out, v >> 16);
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void to_dos_time(std::time_t t, uint16_t* dos_time, uint16_t* dos_date) {
+  struct tm tm;
+  localtime_r(&t, &tm);
+  if (tm.tm_year < 80) {
+    // Zip can't represent dates before 1980.
+    *dos_time = 0;
+    *dos_date = (1 << 5) | 1;
+    return;
+  }
+  *dos_time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+  *dos_date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+}
+
+bool read_file(const std::string& path, std::vector<uint8_t>* contents) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  contents->assign(std::istreambuf_iterator<char>(in),
+                   std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+bool deflate_raw(const std::vector<uint8_t>& in, std::vector<uint8_t>* out) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  out->resize(deflateBound(&stream, in.size()));
+  stream.next_in = const_cast<Bytef*>(in.data());
+  stream.avail_in = in.size();
+  stream.next_out = out->data();
+  stream.avail_out = out->size();
+  int err = deflate(&stream, Z_FINISH);
+  out->resize(stream.total_out);
+  deflateEnd(&stream);
+  return err == Z_STREAM_END;
+}
+
+/*
+ * Fills in `entry` from its extracted file, reusing the original entry if
+ * the file didn't change.
+ */
+bool encode_entry(OutputEntry* entry) {
+  std::vector<uint8_t> contents;
+  if (!read_file(entry->path, &contents)) {
+    fprintf(stderr, "error: cannot read %s\n", entry->path.c_str());
+    return false;
+  }
+  if (contents.size() > UINT32_MAX) {
+    fprintf(stderr, "error: %s is too large for a zip\n", entry->path.c_str());
+    return false;
+  }
+  auto crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, contents.data(), contents.size());
+  entry->crc32 = crc;
+  entry->ucomp_size = contents.size();
+
+  const auto* original = entry->original;
+  if (original != nullptr) {
+    entry->external_attr = original->external_attr;
+    entry->flags = original->flags & ~kFlagDataDescriptor;
+    if (original->crc32 == entry->crc32 &&
+        original->ucomp_size == entry->ucomp_size &&
+        (original->comp_method == kCompMethodStored ||
+         original->comp_method == kCompMethodDeflate)) {
+      entry->comp_method = original->comp_method;
+      entry->mod_time = original->mod_time;
+      entry->mod_date = original->mod_date;
+      entry->comp_size = original->comp_size;
+      entry->data = original->data;
+      return true;
+    }
+    if (original->comp_method == kCompMethodStored) {
+      entry->comp_method = kCompMethodStored;
+    }
+  }
+
+  to_dos_time(boost::filesystem::last_write_time(entry->path),
+              &entry->mod_time, &entry->mod_date);
+  if (entry->comp_method == kCompMethodDeflate) {
+    if (!deflate_raw(contents, &entry->encoded)) {
+      fprintf(stderr, "error: cannot deflate %s\n", entry->path.c_str());
+      return false;
+    }
+  } else {
+    entry->encoded = std::move(contents);
+  }
+  entry->comp_size = entry->encoded.size();
+  entry->data = entry->encoded.data();
+  return true;
+}
+
+} // namespace
+
+bool ApkPacker::pack(const std::string& original_apk,
+                     const std::string& extracted_dir,
+                     const std::string& output_apk,
+                     const Options& options,
+                     Stats* stats) {
+  namespace fs = boost::filesystem;
+
+  boost::iostreams::mapped_file original_file;
+  std::vector<ZipEntry> original_entries;
+  if (!original_apk.empty()) {
+    try {
+      original_file.open(original_apk,
+                         boost::iostreams::mapped_file::readonly);
+    } catch (const std::exception&) {
+      fprintf(stderr, "error: cannot open apk: %s\n", original_apk.c_str());
+      return false;
+    }
+    auto mapping =
+        reinterpret_cast<const uint8_t*>(original_file.const_data());
+    if (!get_zip_entries(mapping, original_file.size(), &original_entries)) {
+      fprintf(stderr, "error: cannot process apk: %s\n", original_apk.c_str());
+      return false;
+    }
+  }
+
+  // The extracted files, by their name in the APK.
+  std::unordered_map<std::string, std::string> files;
+  const auto root = fs::path(extracted_dir);
+  for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+    if (!fs::is_regular_file(it->status())) {
+      continue;
+    }
+    auto name = it->path().string().substr(root.string().size() + 1);
+    std::replace(name.begin(), name.end(), '\\', '/');
+    files.emplace(name, it->path().string());
+  }
+
+  std::vector<OutputEntry> entries;
+  entries.reserve(files.size());
+  for (const auto& original : original_entries) {
+    auto it = files.find(original.name);
+    if (it == files.end()) {
+      continue;
+    }
+    entries.emplace_back();
+    entries.back().name = original.name;
+    entries.back().original = &original;
+    entries.back().path = it->second;
+    files.erase(it);
+  }
+  std::vector<std::string> new_names;
+  for (const auto& p : files) {
+    new_names.push_back(p.first);
+  }
+  std::sort(new_names.begin(), new_names.end());
+  for (const auto& name : new_names) {
+    entries.emplace_back();
+    entries.back().name = name;
+    entries.back().path = files.at(name);
+  }
+  if (entries.size() > UINT16_MAX) {
+    fprintf(stderr, "error: too many entries for a zip without zip64\n");
+    return false;
+  }
+
+  std::atomic<bool> failed{false};
+  auto wq = workqueue_foreach<OutputEntry*>([&](OutputEntry* entry) {
+    if (!failed.load(std::memory_order_relaxed) && !encode_entry(entry)) {
+      failed = true;
+    }
+  });
+  for (auto& entry : entries) {
+    wq.add_item(&entry);
+  }
+  wq.run_all();
+  if (failed) {
+    return false;
+  }
+
+  FILE* out = fopen(output_apk.c_str(), "wb");
+  if (out == nullptr) {
+    fprintf(stderr, "error: cannot write %s\n", output_apk.c_str());
+    return false;
+  }
+  bool write_failed = false;
+  uint64_t offset = 0;
+  auto write = [&](const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, out) != size) {
+      write_failed = true;
+    }
+    offset += size;
+  };
+
+  std::vector<uint8_t> header;
+  for (auto& entry : entries) {
+    if (offset > UINT32_MAX) {
+      break;
+    }
+    entry.offset = offset;
+    // Pad the extra field so that the data of stored entries is aligned.
+    size_t padding = 0;
+    if (entry.comp_method == kCompMethodStored) {
+      size_t alignment = options.alignment;
+      if (options.page_align_libs && ends_with(entry.name, ".so")) {
+        alignment = kPageSize;
+      }
+      if (alignment > 1) {
+        auto data_offset = offset + kLFileSize + entry.name.size();
+        padding = (alignment - data_offset % alignment) % alignment;
+      }
+    }
+    header.clear();
+    put32(&header, kLFileSignature);
+    put16(&header, kVersion);
+    put16(&header, entry.flags);
+    put16(&header, entry.comp_method);
+    put16(&header, entry.mod_time);
+    put16(&header, entry.mod_date);
+    put32(&header, entry.crc32);
+    put32(&header, entry.comp_size);
+    put32(&header, entry.ucomp_size);
+    put16(&header, entry.name.size());
+    put16(&header, padding);
+    header.insert(header.end(), entry.name.begin(), entry.name.end());
+    header.resize(header.size() + padding, 0);
+    write(header.data(), header.size());
+    write(entry.data, entry.comp_size);
+
+    if (entry.data != entry.encoded.data()) {
+      stats->copied_entries++;
+    } else if (entry.comp_method == kCompMethodStored) {
+      stats->stored_entries++;
+    } else {
+      stats->compressed_entries++;
+    }
+    // The encoded bytes aren't needed past this point.
+    std::vector<uint8_t>().swap(entry.encoded);
+  }
+
+  auto cdir_offset = offset;
+  for (const auto& entry : entries) {
+    header.clear();
+    put32(&header, kCDFileSignature);
+    put16(&header, kVersion); // version made by
+    put16(&header, kVersion); // version needed to extract
+    put16(&header, entry.flags);
+    put16(&header, entry.comp_method);
+    put16(&header, entry.mod_time);
+    put16(&header, entry.mod_date);
+    put32(&header, entry.crc32);
+    put32(&header, entry.comp_size);
+    put32(&header, entry.ucomp_size);
+    put16(&header, entry.name.size());
+    put16(&header, 0); // extra field length
+    put16(&header, 0); // comment length
+    put16(&header, 0); // disk number
+    put16(&header, 0); // internal attributes
+    put32(&header, entry.external_attr);
+    put32(&header, entry.offset);
+    header.insert(header.end(), entry.name.begin(), entry.name.end());
+    write(header.data(), header.size());
+  }
+  auto cdir_size = offset - cdir_offset;
+
+  header.clear();
+  put32(&header, kCDirEndSignature);
+  put16(&header, 0); // this disk
+  put16(&header, 0); // disk of the central directory
+  put16(&header, entries.size());
+  put16(&header, entries.size());
+  put32(&header, cdir_size);
+  put32(&header, cdir_offset);
+  put16(&header, 0); // comment length
+  write(header.data(), header.size());
+
+  if (fclose(out) != 0) {
+    write_failed = true;
+  }
+  if (write_failed) {
+    fprintf(stderr, "error: cannot write %s\n", output_apk.c_str());
+    return false;
+  }
+  if (cdir_offset > UINT32_MAX) {
+    fprintf(stderr, "error: %s is too large for a zip without zip64\n",
+            output_apk.c_str());
+    return false;
+  }
+  return true;
+}
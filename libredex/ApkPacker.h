@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Writes an APK from the directory its files were extracted to, once redex is
+ * done rewriting some of them. This takes the place of zipping the directory
+ * and running zipalign on the result:
+ *
+ * - Files whose contents didn't change from the original APK are copied raw,
+ *   with the bytes that are already compressed there.
+ * - The other files are compressed the way their entry in the original APK
+ *   was, or deflated if they are new, in parallel.
+ * - Entries are aligned as they are written, the way `zipalign [-p] 4` aligns
+ *   them: the data of each stored entry starts at a multiple of `alignment`,
+ *   or of the page size for stored .so files if `page_align_libs`.
+ *
+ * Entries keep their order in the original APK, and new files follow them in
+ * path order. Entries of the original APK that are no longer in the directory,
+ * like the signature files that are removed before resigning, are dropped.
+ */
+class ApkPacker {
+ public:
+  struct Options {
+    size_t alignment{4};
+    bool page_align_libs{false};
+  };
+
+  struct Stats {
+    size_t copied_entries{0};
+    size_t compressed_entries{0};
+    size_t stored_entries{0};
+  };
+
+  /*
+   * `original_apk` may be empty, in which case all files are new. Returns
+   * false, after printing why, if the APK can't be written.
+   */
+  static bool pack(const std::string& original_apk,
+                   const std::string& extracted_dir,
+                   const std::string& output_apk,
+                   const Options& options,
+                   Stats* stats);
+};
@@ -5,10 +5,14 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#pragma once
+
 #include <boost/bimap/bimap.hpp>
 #include <boost/bimap/unordered_set_of.hpp>
+#include <istream>
 #include <limits>
 #include <ostream>
+#include <string>
 #include <type_traits>
 
 #include "Debug.h"
@@ -25,6 +29,28 @@ std::enable_if_t<std::is_integral<V>::value> write(std::ostream& os,
   os.write((const char*)&value, sizeof(value));
 }
 
+inline void write(std::ostream& os, const std::string& value) {
+  always_assert(value.size() <= std::numeric_limits<uint32_t>::max());
+  write<uint32_t>(os, value.size());
+  os.write(value.data(), value.size());
+}
+
+template <class V>
+std::enable_if_t<std::is_integral<V>::value, V> read(std::istream& is) {
+  V value;
+  is.read((char*)&value, sizeof(value));
+  always_assert_log(is.good(), "Unexpected end of binary input");
+  return value;
+}
+
+inline std::string read_string(std::istream& is) {
+  auto size = read<uint32_t>(is);
+  std::string value(size, '\0');
+  is.read(&value[0], size);
+  always_assert_log(is.good(), "Unexpected end of binary input");
+  return value;
+}
+
 /*
  * Serialize an array by emitting its length first, followed by the elements
  * in the array.
@@ -48,6 +74,15 @@ inline void write_header(std::ostream& os, uint32_t version) {
   write(os, version);
 }
 
+/*
+ * Check the header written by write_header() and return its version.
+ */
+inline uint32_t read_header(std::istream& is) {
+  auto magic = read<uint32_t>(is);
+  always_assert_log(magic == 0xfaceb000, "Bad magic number %x", magic);
+  return read<uint32_t>(is);
+}
+
 /*
  * Serialize a graph as an adjacency list. For a graph with N nodes, we will
  * emit N lines of the form
@@ -14,12 +14,14 @@ namespace {
 
 using namespace call_graph;
 
-class SingleCalleeStrategy final : public BuildStrategy {
+class SingleCalleeStrategy : public BuildStrategy {
  public:
-  SingleCalleeStrategy(const Scope& scope) : m_scope(scope) {
-    auto non_virtual_vec = devirtualize(scope);
-    m_non_virtual.insert(non_virtual_vec.begin(), non_virtual_vec.end());
-  }
+  SingleCalleeStrategy(const Scope& scope,
+                       const std::unordered_set<DexMethod*>& non_virtual,
+                       MethodRefCache& resolved_refs)
+      : m_scope(scope),
+        m_non_virtual(non_virtual),
+        m_resolved_refs(resolved_refs) {}
 
   CallSites get_callsites(const DexMethod* method) const override {
     CallSites callsites;
@@ -60,16 +62,66 @@ class SingleCalleeStrategy final : public BuildStrategy {
   }
 
   const Scope& m_scope;
-  std::unordered_set<DexMethod*> m_non_virtual;
-  mutable MethodRefCache m_resolved_refs;
+  const std::unordered_set<DexMethod*>& m_non_virtual;
+  MethodRefCache& m_resolved_refs;
 };
 
+std::unordered_set<DexMethod*> non_virtual_methods(const Scope& scope) {
+  auto non_virtual_vec = devirtualize(scope);
+  return std::unordered_set<DexMethod*>(non_virtual_vec.begin(),
+                                        non_virtual_vec.end());
+}
+
 } // namespace
 
 namespace call_graph {
 
 Graph single_callee_graph(const Scope& scope) {
-  return Graph(SingleCalleeStrategy(scope));
+  auto non_virtual = non_virtual_methods(scope);
+  MethodRefCache resolved_refs;
+  return Graph(SingleCalleeStrategy(scope, non_virtual, resolved_refs));
+}
+
+class CachedSingleCalleeStrategy final : public SingleCalleeStrategy {
+ public:
+  CachedSingleCalleeStrategy(const Scope& scope, SingleCalleeGraphCache* cache)
+      : SingleCalleeStrategy(
+            scope, cache->m_non_virtual, cache->m_resolved_refs),
+        m_cache(cache) {}
+
+  CallSites get_callsites(const DexMethod* method) const override {
+    auto& callsites = m_cache->m_callsites;
+    auto it = callsites.find(method);
+    if (it == callsites.end()) {
+      it = callsites
+               .emplace(method, SingleCalleeStrategy::get_callsites(method))
+               .first;
+    }
+    return it->second;
+  }
+
+ private:
+  SingleCalleeGraphCache* m_cache;
+};
+
+Graph SingleCalleeGraphCache::get(const Scope& scope) {
+  if (!m_valid) {
+    m_non_virtual = non_virtual_methods(scope);
+    m_valid = true;
+  }
+  return Graph(CachedSingleCalleeStrategy(scope, this));
+}
+
+void SingleCalleeGraphCache::mark_dirty(const DexMethod* method) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_callsites.erase(method);
+}
+
+void SingleCalleeGraphCache::invalidate() {
+  m_valid = false;
+  m_non_virtual.clear();
+  m_resolved_refs.clear();
+  m_callsites.clear();
 }
 
 Edge::Edge(DexMethod* caller, DexMethod* callee, IRList::iterator invoke_it)
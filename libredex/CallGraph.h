@@ -8,7 +8,9 @@
 #pragma once
 
 #include <boost/functional/hash.hpp>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "DexClass.h"
 #include "IRCode.h"
@@ -130,6 +132,35 @@ class Graph final {
   std::unordered_map<DexMethod*, Node, boost::hash<Node>> m_nodes;
 };
 
+/*
+ * Keeps the call sites that single_callee_graph() resolves for each method
+ * across requests, so that the graph of a later pass only re-resolves the
+ * invokes of the methods whose code changed in between. Those methods must be
+ * marked dirty. Anything that changes the class hierarchy, which methods
+ * exist, or which methods are virtual requires a full invalidate().
+ *
+ * The PassManager owns one, and invalidates it after every pass that isn't
+ * call-graph aware (see Pass::is_call_graph_aware()).
+ */
+class SingleCalleeGraphCache {
+ public:
+  Graph get(const Scope& scope);
+
+  // Safe to call concurrently.
+  void mark_dirty(const DexMethod* method);
+
+  void invalidate();
+
+ private:
+  friend class CachedSingleCalleeStrategy;
+
+  bool m_valid{false};
+  std::unordered_set<DexMethod*> m_non_virtual;
+  MethodRefCache m_resolved_refs;
+  std::unordered_map<const DexMethod*, CallSites> m_callsites;
+  std::mutex m_lock;
+};
+
 // A static-method-only API for use with the monotonic fixpoint iterator.
 class GraphInterface {
  public:
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ClassHashes.h"
+
+#include <fstream>
+
+#include "DexAnnotation.h"
+#include "IRCode.h"
+#include "Show.h"
+#include "WorkQueue.h"
+
+namespace {
+
+constexpr const char* HEADER = "redex class hashes v1";
+
+std::string show_members(const DexClass* cls) {
+  std::string s;
+  s += show(cls->get_type()) + " " + std::to_string(cls->get_access()) + " " +
+       show(cls->get_super_class()) + " " + show(cls->get_interfaces()) + "\n";
+  if (cls->get_anno_set() != nullptr) {
+    s += show(cls->get_anno_set()) + "\n";
+  }
+  auto show_field = [&](DexField* field) {
+    s += show(field) + " " + std::to_string(field->get_access());
+    if (field->get_static_value() != nullptr) {
+      s += " = " + show(field->get_static_value());
+    }
+    if (field->get_anno_set() != nullptr) {
+      s += " " + show(field->get_anno_set());
+    }
+    s += "\n";
+  };
+  for (auto field : cls->get_sfields()) {
+    show_field(field);
+  }
+  for (auto field : cls->get_ifields()) {
+    show_field(field);
+  }
+  auto show_method = [&](DexMethod* method) {
+    s += show(method) + " " + std::to_string(method->get_access()) + "\n";
+    if (method->get_anno_set() != nullptr) {
+      s += show(method->get_anno_set()) + "\n";
+    }
+    auto code = method->get_code();
+    if (code != nullptr) {
+      s += show(code);
+    }
+  };
+  for (auto method : cls->get_dmethods()) {
+    show_method(method);
+  }
+  for (auto method : cls->get_vmethods()) {
+    show_method(method);
+  }
+  return s;
+}
+
+} // namespace
+
+namespace class_hashes {
+
+uint64_t hash_string(const std::string& s) {
+  // 64-bit FNV-1a, which unlike std::hash is the same from one build of
+  // redex to the next.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : s) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+ClassHashes compute(const Scope& scope) {
+  std::vector<uint64_t> hashes(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    hashes[i] = hash_string(show_members(scope[i]));
+  });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  ClassHashes result;
+  for (size_t i = 0; i < scope.size(); ++i) {
+    result.emplace(show(scope[i]->get_type()), hashes[i]);
+  }
+  return result;
+}
+
+Diff diff(const ClassHashes& before, const ClassHashes& after) {
+  Diff diff;
+  for (const auto& p : after) {
+    auto it = before.find(p.first);
+    if (it == before.end()) {
+      diff.added.push_back(p.first);
+    } else if (it->second != p.second) {
+      diff.changed.push_back(p.first);
+    } else {
+      diff.unchanged++;
+    }
+  }
+  for (const auto& p : before) {
+    if (!after.count(p.first)) {
+      diff.removed.push_back(p.first);
+    }
+  }
+  return diff;
+}
+
+bool read(const std::string& path,
+          uint64_t* config_hash,
+          ClassHashes* hashes) {
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line) || line != HEADER || !(in >> *config_hash)) {
+    return false;
+  }
+  std::string name;
+  uint64_t hash;
+  while (in >> name >> hash) {
+    hashes->emplace(name, hash);
+  }
+  return in.eof();
+}
+
+void write(const std::string& path,
+           uint64_t config_hash,
+           const ClassHashes& hashes) {
+  std::ofstream out(path);
+  out << HEADER << "\n" << config_hash << "\n";
+  for (const auto& p : hashes) {
+    out << p.first << " " << p.second << "\n";
+  }
+}
+
+} // namespace class_hashes
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DexClass.h"
+
+/*
+ * Content hashes of the input classes of an app, to tell which of them changed
+ * from one build to the next. The hash of a class covers its access flags,
+ * hierarchy, annotations, fields with their static values, and methods with
+ * their code, so two builds that hash a class the same saw the same class.
+ * Unlike CodeFingerprint, the hashes are of names rather than of the identity
+ * of references, so that they can be compared across runs.
+ */
+namespace class_hashes {
+
+// By class name, sorted so that the file they are written to is stable.
+using ClassHashes = std::map<std::string, uint64_t>;
+
+uint64_t hash_string(const std::string& s);
+
+/*
+ * Hashes the classes of `scope` in parallel. This balloons their code.
+ */
+ClassHashes compute(const Scope& scope);
+
+struct Diff {
+  std::vector<std::string> added;
+  std::vector<std::string> removed;
+  std::vector<std::string> changed;
+  size_t unchanged{0};
+};
+
+Diff diff(const ClassHashes& before, const ClassHashes& after);
+
+/*
+ * The hashes are written with the hash of the configuration they were
+ * computed under, since a change of configuration counts as a change of
+ * every class.
+ * `read` returns false if there is no such file, or it isn't one of ours.
+ */
+bool read(const std::string& path,
+          uint64_t* config_hash,
+          ClassHashes* hashes);
+
+void write(const std::string& path,
+           uint64_t config_hash,
+           const ClassHashes& hashes);
+
+} // namespace class_hashes
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "DexClass.h"
+#include "IdMap.h"
 #include <set>
 #include <unordered_map>
 
@@ -16,8 +17,10 @@ using TypeSet = std::set<const DexType*, dextypes_comparator>;
 /**
  * DexType parent to children relationship
  * (child to parent is in DexClass)
+ *
+ * Nearly every type of the scope is a key, so this is indexed by dense id.
  */
-using ClassHierarchy = std::unordered_map<const DexType*, TypeSet>;
+using ClassHierarchy = IdMap<const DexType*, TypeSet>;
 
 /**
  * Given a scope it builds all the parent-children relationship known.
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CodeFingerprint.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+
+namespace {
+
+/*
+ * Feeds every value into two independently mixed 64-bit lanes.
+ */
+class Hasher {
+ public:
+  void add(uint64_t value) {
+    m_low ^= mix(value + 0x9e3779b97f4a7c15ULL + (m_low << 6) + (m_low >> 2));
+    m_high = (m_high ^ mix(value ^ 0xc2b2ae3d27d4eb4fULL)) * 0x100000001b3ULL;
+  }
+
+  void add_pointer(const void* ptr) {
+    add(reinterpret_cast<uintptr_t>(ptr));
+  }
+
+  CodeFingerprint result() const { return CodeFingerprint{m_low, m_high}; }
+
+ private:
+  // The finalizer of splitmix64.
+  static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t m_low{0};
+  uint64_t m_high{0xcbf29ce484222325ULL};
+};
+
+/*
+ * Hashes instructions with their registers renumbered in order of first
+ * appearance.
+ */
+class InstructionHasher {
+ public:
+  explicit InstructionHasher(Hasher* hasher) : m_hasher(hasher) {}
+
+  void add(const IRInstruction* insn) {
+    m_hasher->add(insn->opcode());
+    m_hasher->add(insn->srcs_size());
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      add_reg(insn->src(i));
+    }
+    if (insn->dests_size() > 0) {
+      add_reg(insn->dest());
+    }
+    if (insn->has_literal()) {
+      m_hasher->add(insn->get_literal());
+    }
+    if (insn->has_type()) {
+      m_hasher->add_pointer(insn->get_type());
+    } else if (insn->has_field()) {
+      m_hasher->add_pointer(insn->get_field());
+    } else if (insn->has_method()) {
+      m_hasher->add_pointer(insn->get_method());
+    } else if (insn->has_string()) {
+      m_hasher->add_pointer(insn->get_string());
+    } else if (insn->has_data()) {
+      auto data = insn->get_data();
+      m_hasher->add(data->data_size());
+      for (size_t i = 0; i < data->data_size(); ++i) {
+        m_hasher->add(data->data()[i]);
+      }
+    }
+  }
+
+ private:
+  void add_reg(uint16_t reg) {
+    if (reg >= m_canonical.size()) {
+      m_canonical.resize(reg + 1, NONE);
+    }
+    auto& canonical = m_canonical[reg];
+    if (canonical == NONE) {
+      canonical = m_next++;
+    }
+    m_hasher->add(canonical);
+  }
+
+  static constexpr uint32_t NONE = static_cast<uint32_t>(-1);
+
+  Hasher* m_hasher;
+  std::vector<uint32_t> m_canonical;
+  uint32_t m_next{0};
+};
+
+constexpr uint32_t InstructionHasher::NONE;
+
+void add_ir_list(const IRCode& code, Hasher* hasher) {
+  InstructionHasher insns(hasher);
+  for (const auto& mie : code) {
+    switch (mie.type) {
+    case MFLOW_OPCODE:
+      hasher->add(mie.type);
+      insns.add(mie.insn);
+      break;
+    case MFLOW_TRY:
+      hasher->add(mie.type);
+      hasher->add(mie.tentry->type);
+      break;
+    case MFLOW_CATCH:
+      hasher->add(mie.type);
+      hasher->add_pointer(mie.centry->catch_type);
+      break;
+    case MFLOW_TARGET:
+      hasher->add(mie.type);
+      hasher->add(mie.target->type);
+      if (mie.target->type == BRANCH_MULTI) {
+        hasher->add(mie.target->case_key);
+      }
+      break;
+    default:
+      // Debug info and positions are not part of the structure.
+      break;
+    }
+  }
+}
+
+void add_cfg(const cfg::ControlFlowGraph& cfg, Hasher* hasher) {
+  // Block ids aren't part of the structure either, so blocks are referred to
+  // by their position in the block order.
+  auto blocks = cfg.blocks();
+  std::unordered_map<const cfg::Block*, size_t> positions;
+  for (auto* block : blocks) {
+    positions.emplace(block, positions.size());
+  }
+  hasher->add(positions.at(cfg.entry_block()));
+  InstructionHasher insns(hasher);
+  for (auto* block : blocks) {
+    hasher->add(block->num_opcodes());
+    for (const auto& mie : InstructionIterable(block)) {
+      insns.add(mie.insn);
+    }
+    for (const auto* edge : block->succs()) {
+      hasher->add(edge->type());
+      hasher->add(positions.at(edge->target()));
+      if (edge->case_key()) {
+        hasher->add(*edge->case_key());
+      }
+      if (edge->throw_info() != nullptr) {
+        hasher->add_pointer(edge->throw_info()->catch_type);
+        hasher->add(edge->throw_info()->index);
+      }
+    }
+  }
+}
+
+} // namespace
+
+namespace code_fingerprint {
+
+CodeFingerprint compute(const IRCode& code) {
+  Hasher hasher;
+  if (code.editable_cfg_built()) {
+    add_cfg(code.cfg(), &hasher);
+  } else {
+    add_ir_list(code, &hasher);
+  }
+  return hasher.result();
+}
+
+} // namespace code_fingerprint
+
+CodeFingerprint CodeFingerprintCache::get(const IRCode* code) {
+  CodeFingerprint fingerprint;
+  m_fingerprints.update(
+      code, [&](const IRCode*, CodeFingerprint& cached, bool exists) {
+        if (!exists) {
+          cached = code_fingerprint::compute(*code);
+        }
+        fingerprint = cached;
+      });
+  return fingerprint;
+}
@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "ConcurrentContainers.h"
+
+class IRCode;
+
+/*
+ * A 128-bit structural hash of a method body, meant for bucketing candidates
+ * before an exact comparison such as IRCode::structural_equals().
+ *
+ * Registers are renumbered in order of first appearance, so code that only
+ * differs in register naming gets the same fingerprint. Debug info and
+ * positions are ignored. Branch targets and try regions are hashed by kind
+ * but not by position, so structurally equal code always gets equal
+ * fingerprints, while the converse only holds with high probability.
+ *
+ * References to types, fields, methods and strings are hashed by identity,
+ * so fingerprints are only comparable within a single run.
+ */
+struct CodeFingerprint {
+  uint64_t low{0};
+  uint64_t high{0};
+
+  bool operator==(const CodeFingerprint& other) const {
+    return low == other.low && high == other.high;
+  }
+
+  bool operator!=(const CodeFingerprint& other) const {
+    return !(*this == other);
+  }
+};
+
+inline size_t hash_value(const CodeFingerprint& fingerprint) {
+  return fingerprint.low;
+}
+
+namespace std {
+
+template <>
+struct hash<CodeFingerprint> {
+  size_t operator()(const CodeFingerprint& fingerprint) const {
+    return hash_value(fingerprint);
+  }
+};
+
+} // namespace std
+
+namespace code_fingerprint {
+
+/*
+ * Uses the editable CFG of `code` if it is built, and its IRList otherwise.
+ * The same code gets different fingerprints in the two forms.
+ */
+CodeFingerprint compute(const IRCode& code);
+
+} // namespace code_fingerprint
+
+/*
+ * Remembers the fingerprints of the code it has seen. An IRCode can be edited
+ * in place through its instructions without it noticing, so the cache doesn't
+ * live on IRCode; it is meant to be held for the duration of a phase that
+ * doesn't change the code it looks at, like grouping dedup candidates.
+ *
+ * This is always thread-safe.
+ */
+class CodeFingerprintCache {
+ public:
+  CodeFingerprint get(const IRCode* code);
+
+ private:
+  ConcurrentMap<const IRCode*, CodeFingerprint> m_fingerprints;
+};
@@ -0,0 +1,617 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CompactIRList.h"
+
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+
+#include "BinarySerialization.h"
+#include "Debug.h"
+#include "DexDebugInstruction.h"
+#include "DexPosition.h"
+#include "Show.h"
+
+namespace {
+
+void write_varint(std::vector<uint8_t>* out, uint64_t v) {
+  while (v >= 0x80) {
+    out->push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(v));
+}
+
+uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+/*
+ * An entry as read back from the encoding. Entries that refer to other
+ * entries do so by index, which the caller resolves.
+ */
+struct DecodedEntry {
+  MethodItemType type;
+  IRInstruction* insn{nullptr};
+  TryEntryType try_type{TRY_START};
+  BranchTargetType branch_type{BRANCH_SIMPLE};
+  int32_t case_key{0};
+  DexType* catch_type{nullptr};
+  // The catch_start of a try, the next catch of a catch (plus one, zero
+  // being none), or the source of a branch target.
+  uint32_t entry_index{0};
+};
+
+namespace bs = binary_serialization;
+
+enum class RefKind : uint8_t { STRING, TYPE, FIELD, METHOD };
+
+// Strings and types may be absent, e.g. from a debug instruction.
+void write_string(std::ostream& os, const DexString* str) {
+  bs::write<uint8_t>(os, str != nullptr);
+  if (str != nullptr) {
+    bs::write(os, str->str());
+  }
+}
+
+DexString* read_string(std::istream& is) {
+  if (bs::read<uint8_t>(is) == 0) {
+    return nullptr;
+  }
+  return DexString::make_string(bs::read_string(is));
+}
+
+void write_type(std::ostream& os, const DexType* type) {
+  write_string(os, type == nullptr ? nullptr : type->get_name());
+}
+
+DexType* read_type(std::istream& is) {
+  auto name = read_string(is);
+  return name == nullptr ? nullptr : DexType::make_type(name);
+}
+
+void write_debug(std::ostream& os, const DexDebugInstruction& dbgop) {
+  bs::write<uint8_t>(os, dbgop.opcode());
+  bs::write<uint32_t>(os, dbgop.uvalue());
+  switch (dbgop.opcode()) {
+  case DBG_START_LOCAL:
+  case DBG_START_LOCAL_EXTENDED: {
+    const auto& start = static_cast<const DexDebugOpcodeStartLocal&>(dbgop);
+    write_string(os, start.name());
+    write_type(os, start.type());
+    write_string(os, start.sig());
+    break;
+  }
+  case DBG_SET_FILE:
+    write_string(os, static_cast<const DexDebugOpcodeSetFile&>(dbgop).file());
+    break;
+  default:
+    break;
+  }
+}
+
+std::unique_ptr<DexDebugInstruction> read_debug(std::istream& is) {
+  auto op = static_cast<DexDebugItemOpcode>(bs::read<uint8_t>(is));
+  auto uvalue = bs::read<uint32_t>(is);
+  switch (op) {
+  case DBG_START_LOCAL:
+  case DBG_START_LOCAL_EXTENDED: {
+    auto name = read_string(is);
+    auto type = read_type(is);
+    auto sig = read_string(is);
+    return std::make_unique<DexDebugOpcodeStartLocal>(uvalue, name, type, sig);
+  }
+  case DBG_SET_FILE:
+    return std::make_unique<DexDebugOpcodeSetFile>(read_string(is));
+  case DBG_ADVANCE_LINE:
+    return std::make_unique<DexDebugInstruction>(op,
+                                                 static_cast<int32_t>(uvalue));
+  default:
+    return std::make_unique<DexDebugInstruction>(op, uvalue);
+  }
+}
+
+} // namespace
+
+class CompactIRList::Reader {
+ public:
+  explicit Reader(const CompactIRList& list)
+      : m_list(list), m_ptr(list.m_bytes.data()) {}
+
+  // Reads the next entry. The caller owns the instruction, if any.
+  void read_entry(DecodedEntry* entry) {
+    entry->type = static_cast<MethodItemType>(read());
+    switch (entry->type) {
+    case MFLOW_OPCODE:
+      entry->insn = read_instruction();
+      break;
+    case MFLOW_TRY:
+      entry->try_type = static_cast<TryEntryType>(read());
+      entry->entry_index = read();
+      break;
+    case MFLOW_CATCH: {
+      auto ref = read();
+      entry->catch_type =
+          ref == 0 ? nullptr : static_cast<DexType*>(m_list.m_refs[ref - 1]);
+      entry->entry_index = read();
+      break;
+    }
+    case MFLOW_TARGET:
+      entry->branch_type = static_cast<BranchTargetType>(read());
+      entry->entry_index = read();
+      if (entry->branch_type == BRANCH_MULTI) {
+        entry->case_key = static_cast<int32_t>(unzigzag(read()));
+      }
+      break;
+    case MFLOW_DEBUG:
+    case MFLOW_POSITION:
+    case MFLOW_FALLTHROUGH:
+      // Debug instructions and positions are taken from their tables in
+      // order.
+      break;
+    case MFLOW_DEX_OPCODE:
+      not_reached();
+    }
+  }
+
+ private:
+  uint64_t read() {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+      uint8_t byte = *m_ptr++;
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return v;
+      }
+    }
+  }
+
+  IRInstruction* read_instruction() {
+    auto insn = new IRInstruction(static_cast<IROpcode>(read()));
+    if (insn->dests_size()) {
+      insn->set_dest(read());
+    }
+    auto srcs_size = read();
+    insn->set_arg_word_count(srcs_size);
+    for (size_t i = 0; i < srcs_size; ++i) {
+      insn->set_src(i, read());
+    }
+    switch (opcode::ref(insn->opcode())) {
+    case opcode::Ref::None:
+      break;
+    case opcode::Ref::Literal:
+      insn->set_literal(unzigzag(read()));
+      break;
+    case opcode::Ref::String:
+      insn->set_string(static_cast<DexString*>(m_list.m_refs[read()]));
+      break;
+    case opcode::Ref::Type:
+      insn->set_type(static_cast<DexType*>(m_list.m_refs[read()]));
+      break;
+    case opcode::Ref::Field:
+      insn->set_field(static_cast<DexFieldRef*>(m_list.m_refs[read()]));
+      break;
+    case opcode::Ref::Method:
+      insn->set_method(static_cast<DexMethodRef*>(m_list.m_refs[read()]));
+      break;
+    case opcode::Ref::Data:
+      insn->set_data(m_list.m_data[m_data_index++]);
+      break;
+    }
+    return insn;
+  }
+
+  const CompactIRList& m_list;
+  const uint8_t* m_ptr;
+  size_t m_data_index{0};
+};
+
+bool CompactIRList::can_compact(const IRList& ir_list) {
+  for (const auto& mie : ir_list) {
+    if (mie.type == MFLOW_DEX_OPCODE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CompactIRList::CompactIRList(IRList* ir_list) {
+  std::unordered_map<const MethodItemEntry*, uint32_t> entry_indices;
+  for (const auto& mie : *ir_list) {
+    entry_indices.emplace(&mie, m_num_entries++);
+  }
+  std::unordered_map<void*, uint32_t> ref_indices;
+  auto ref_index = [&](void* ref) {
+    auto it = ref_indices.emplace(ref, m_refs.size()).first;
+    if (it->second == m_refs.size()) {
+      m_refs.push_back(ref);
+    }
+    return it->second;
+  };
+  auto write_ref = [&](void* ref) { write_varint(&m_bytes, ref_index(ref)); };
+
+  for (auto& mie : *ir_list) {
+    m_bytes.push_back(mie.type);
+    switch (mie.type) {
+    case MFLOW_OPCODE: {
+      auto insn = mie.insn;
+      write_varint(&m_bytes, insn->opcode());
+      if (insn->dests_size()) {
+        write_varint(&m_bytes, insn->dest());
+      }
+      write_varint(&m_bytes, insn->srcs_size());
+      for (auto src : insn->srcs()) {
+        write_varint(&m_bytes, src);
+      }
+      switch (opcode::ref(insn->opcode())) {
+      case opcode::Ref::None:
+        break;
+      case opcode::Ref::Literal:
+        write_varint(&m_bytes, zigzag(insn->get_literal()));
+        break;
+      case opcode::Ref::String:
+        write_ref(insn->get_string());
+        break;
+      case opcode::Ref::Type:
+        write_ref(insn->get_type());
+        break;
+      case opcode::Ref::Field:
+        write_ref(insn->get_field());
+        break;
+      case opcode::Ref::Method:
+        write_ref(insn->get_method());
+        break;
+      case opcode::Ref::Data:
+        m_data.push_back(insn->get_data());
+        break;
+      }
+      delete insn;
+      break;
+    }
+    case MFLOW_TRY:
+      write_varint(&m_bytes, mie.tentry->type);
+      write_varint(&m_bytes, entry_indices.at(mie.tentry->catch_start));
+      break;
+    case MFLOW_CATCH:
+      // Zero is for catch-alls, so the index is off by one.
+      write_varint(&m_bytes,
+                   mie.centry->catch_type == nullptr
+                       ? 0
+                       : ref_index(mie.centry->catch_type) + 1);
+      write_varint(&m_bytes,
+                   mie.centry->next == nullptr
+                       ? 0
+                       : entry_indices.at(mie.centry->next) + 1);
+      break;
+    case MFLOW_TARGET:
+      write_varint(&m_bytes, mie.target->type);
+      write_varint(&m_bytes, entry_indices.at(mie.target->src));
+      if (mie.target->type == BRANCH_MULTI) {
+        write_varint(&m_bytes, zigzag(mie.target->case_key));
+      }
+      break;
+    case MFLOW_DEBUG:
+      m_debug.push_back(std::move(mie.dbgop));
+      break;
+    case MFLOW_POSITION:
+      m_positions.push_back(std::move(mie.pos));
+      break;
+    case MFLOW_FALLTHROUGH:
+      break;
+    case MFLOW_DEX_OPCODE:
+      always_assert_log(false, "Can't compact dex instructions");
+    }
+  }
+  ir_list->clear_and_dispose();
+  m_bytes.shrink_to_fit();
+  m_refs.shrink_to_fit();
+}
+
+void CompactIRList::expand(IRList* ir_list) {
+  std::vector<MethodItemEntry*> entries(m_num_entries);
+  // The tries are made once the catches they point to exist.
+  std::vector<std::pair<uint32_t, DecodedEntry>> tries;
+  std::vector<std::pair<CatchEntry*, uint32_t>> catch_nexts;
+  std::vector<std::pair<BranchTarget*, uint32_t>> target_srcs;
+  Reader reader(*this);
+  auto debug_it = m_debug.begin();
+  auto position_it = m_positions.begin();
+  for (uint32_t i = 0; i < m_num_entries; ++i) {
+    DecodedEntry entry;
+    reader.read_entry(&entry);
+    switch (entry.type) {
+    case MFLOW_OPCODE:
+      entries[i] = new MethodItemEntry(entry.insn);
+      break;
+    case MFLOW_TRY:
+      tries.emplace_back(i, entry);
+      break;
+    case MFLOW_CATCH:
+      entries[i] = new MethodItemEntry(entry.catch_type);
+      if (entry.entry_index != 0) {
+        catch_nexts.emplace_back(entries[i]->centry, entry.entry_index - 1);
+      }
+      break;
+    case MFLOW_TARGET: {
+      auto target = new BranchTarget();
+      target->type = entry.branch_type;
+      target->case_key = entry.case_key;
+      target_srcs.emplace_back(target, entry.entry_index);
+      entries[i] = new MethodItemEntry(target);
+      break;
+    }
+    case MFLOW_DEBUG:
+      entries[i] = new MethodItemEntry(std::move(*debug_it++));
+      break;
+    case MFLOW_POSITION:
+      entries[i] = new MethodItemEntry(std::move(*position_it++));
+      break;
+    case MFLOW_FALLTHROUGH:
+      entries[i] = new MethodItemEntry();
+      break;
+    case MFLOW_DEX_OPCODE:
+      not_reached();
+    }
+  }
+  for (const auto& p : tries) {
+    entries[p.first] = new MethodItemEntry(p.second.try_type,
+                                           entries[p.second.entry_index]);
+  }
+  for (const auto& p : catch_nexts) {
+    p.first->next = entries[p.second];
+  }
+  for (const auto& p : target_srcs) {
+    p.first->src = entries[p.second];
+  }
+  for (auto mie : entries) {
+    ir_list->push_back(*mie);
+  }
+
+  m_bytes.clear();
+  m_num_entries = 0;
+  m_refs.clear();
+  m_data.clear();
+  m_debug.clear();
+  m_positions.clear();
+}
+
+template <typename Visitor>
+void CompactIRList::for_each_entry(Visitor visitor) const {
+  Reader reader(*this);
+  auto debug_it = m_debug.begin();
+  for (uint32_t i = 0; i < m_num_entries; ++i) {
+    DecodedEntry entry;
+    reader.read_entry(&entry);
+    std::unique_ptr<IRInstruction> insn(entry.insn);
+    const DexDebugInstruction* dbgop =
+        entry.type == MFLOW_DEBUG ? (debug_it++)->get() : nullptr;
+    visitor(entry, dbgop);
+  }
+}
+
+void CompactIRList::gather_catch_types(std::vector<DexType*>& ltype) const {
+  for_each_entry([&](const DecodedEntry& entry, const DexDebugInstruction*) {
+    if (entry.type == MFLOW_CATCH && entry.catch_type != nullptr) {
+      ltype.push_back(entry.catch_type);
+    }
+  });
+}
+
+void CompactIRList::gather_strings(std::vector<DexString*>& lstring) const {
+  for_each_entry(
+      [&](const DecodedEntry& entry, const DexDebugInstruction* dbgop) {
+        if (entry.insn != nullptr) {
+          entry.insn->gather_strings(lstring);
+        } else if (dbgop != nullptr) {
+          dbgop->gather_strings(lstring);
+        }
+      });
+}
+
+void CompactIRList::gather_types(std::vector<DexType*>& ltype) const {
+  for_each_entry(
+      [&](const DecodedEntry& entry, const DexDebugInstruction* dbgop) {
+        if (entry.insn != nullptr) {
+          entry.insn->gather_types(ltype);
+        } else if (dbgop != nullptr) {
+          dbgop->gather_types(ltype);
+        } else if (entry.type == MFLOW_CATCH && entry.catch_type != nullptr) {
+          ltype.push_back(entry.catch_type);
+        }
+      });
+}
+
+void CompactIRList::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  for_each_entry(
+      [&](const DecodedEntry& entry, const DexDebugInstruction* dbgop) {
+        if (entry.insn != nullptr) {
+          entry.insn->gather_fields(lfield);
+        } else if (dbgop != nullptr) {
+          dbgop->gather_fields(lfield);
+        }
+      });
+}
+
+void CompactIRList::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  for_each_entry(
+      [&](const DecodedEntry& entry, const DexDebugInstruction* dbgop) {
+        if (entry.insn != nullptr) {
+          entry.insn->gather_methods(lmethod);
+        } else if (dbgop != nullptr) {
+          dbgop->gather_methods(lmethod);
+        }
+      });
+}
+
+size_t CompactIRList::size_in_bytes() const {
+  return sizeof(*this) + m_bytes.capacity() +
+         m_refs.capacity() * sizeof(void*) +
+         m_data.capacity() * sizeof(DexOpcodeData*) +
+         m_debug.capacity() * sizeof(m_debug[0]) +
+         m_positions.capacity() * sizeof(m_positions[0]);
+}
+
+void CompactIRList::serialize(std::ostream& os) const {
+  // The table doesn't say what its entries are, the entries referring to
+  // them do.
+  std::unordered_map<const void*, RefKind> kinds;
+  for_each_entry([&](const DecodedEntry& entry, const DexDebugInstruction*) {
+    auto insn = entry.insn;
+    if (entry.type == MFLOW_CATCH && entry.catch_type != nullptr) {
+      kinds[entry.catch_type] = RefKind::TYPE;
+    } else if (insn == nullptr) {
+      return;
+    } else if (insn->has_string()) {
+      kinds[insn->get_string()] = RefKind::STRING;
+    } else if (insn->has_type()) {
+      kinds[insn->get_type()] = RefKind::TYPE;
+    } else if (insn->has_field()) {
+      kinds[insn->get_field()] = RefKind::FIELD;
+    } else if (insn->has_method()) {
+      kinds[insn->get_method()] = RefKind::METHOD;
+    }
+  });
+
+  bs::write<uint32_t>(os, m_num_entries);
+  bs::write(os, std::string(m_bytes.begin(), m_bytes.end()));
+  bs::write<uint32_t>(os, m_refs.size());
+  for (auto ref : m_refs) {
+    auto kind = kinds.at(ref);
+    bs::write<uint8_t>(os, static_cast<uint8_t>(kind));
+    switch (kind) {
+    case RefKind::STRING:
+      bs::write(os, static_cast<const DexString*>(ref)->str());
+      break;
+    case RefKind::TYPE:
+      bs::write(os, static_cast<const DexType*>(ref)->get_name()->str());
+      break;
+    case RefKind::FIELD:
+      bs::write(os, show(static_cast<const DexFieldRef*>(ref)));
+      break;
+    case RefKind::METHOD:
+      bs::write(os, show(static_cast<const DexMethodRef*>(ref)));
+      break;
+    }
+  }
+
+  bs::write<uint32_t>(os, m_data.size());
+  for (auto data : m_data) {
+    bs::write<uint16_t>(os, data->opcode());
+    bs::write<uint16_t>(os, data->data_size());
+    for (size_t i = 0; i < data->data_size(); ++i) {
+      bs::write<uint16_t>(os, data->data()[i]);
+    }
+  }
+
+  bs::write<uint32_t>(os, m_debug.size());
+  for (const auto& dbgop : m_debug) {
+    write_debug(os, *dbgop);
+  }
+
+  // Parents are written by index. The parents that aren't in the list, e.g.
+  // those of the callsites of inlined code, are written after its positions.
+  std::vector<const DexPosition*> positions;
+  std::unordered_map<const DexPosition*, uint32_t> position_indices;
+  for (const auto& pos : m_positions) {
+    position_indices.emplace(pos.get(), positions.size());
+    positions.push_back(pos.get());
+  }
+  for (size_t i = 0; i < positions.size(); ++i) {
+    auto parent = positions[i]->parent;
+    if (parent != nullptr &&
+        position_indices.emplace(parent, positions.size()).second) {
+      positions.push_back(parent);
+    }
+  }
+  bs::write<uint32_t>(os, m_positions.size());
+  bs::write<uint32_t>(os, positions.size());
+  for (auto pos : positions) {
+    write_string(os, pos->method);
+    write_string(os, pos->file);
+    bs::write<uint32_t>(os, pos->line);
+    uint32_t parent = DexPositionTable::NO_PARENT;
+    if (pos->parent != nullptr) {
+      parent = position_indices.at(pos->parent);
+    }
+    bs::write(os, parent);
+  }
+}
+
+std::unique_ptr<CompactIRList> CompactIRList::deserialize(std::istream& is) {
+  std::unique_ptr<CompactIRList> list(new CompactIRList());
+  list->m_num_entries = bs::read<uint32_t>(is);
+  auto bytes = bs::read_string(is);
+  list->m_bytes.assign(bytes.begin(), bytes.end());
+
+  auto num_refs = bs::read<uint32_t>(is);
+  list->m_refs.reserve(num_refs);
+  for (uint32_t i = 0; i < num_refs; ++i) {
+    auto kind = static_cast<RefKind>(bs::read<uint8_t>(is));
+    auto name = bs::read_string(is);
+    switch (kind) {
+    case RefKind::STRING:
+      list->m_refs.push_back(DexString::make_string(name));
+      break;
+    case RefKind::TYPE:
+      list->m_refs.push_back(DexType::make_type(name.c_str()));
+      break;
+    case RefKind::FIELD:
+      list->m_refs.push_back(DexField::make_field(name));
+      break;
+    case RefKind::METHOD:
+      list->m_refs.push_back(DexMethod::make_method(name));
+      break;
+    }
+  }
+
+  // Like the payloads of code loaded from a dex, these aren't freed with the
+  // instructions that refer to them.
+  auto num_data = bs::read<uint32_t>(is);
+  for (uint32_t i = 0; i < num_data; ++i) {
+    std::vector<uint16_t> opcodes{bs::read<uint16_t>(is)};
+    auto size = bs::read<uint16_t>(is);
+    for (uint16_t j = 0; j < size; ++j) {
+      opcodes.push_back(bs::read<uint16_t>(is));
+    }
+    list->m_data.push_back(new DexOpcodeData(opcodes));
+  }
+
+  auto num_debug = bs::read<uint32_t>(is);
+  for (uint32_t i = 0; i < num_debug; ++i) {
+    list->m_debug.push_back(read_debug(is));
+  }
+
+  auto num_owned = bs::read<uint32_t>(is);
+  auto num_positions = bs::read<uint32_t>(is);
+  std::vector<DexPosition*> positions;
+  std::vector<uint32_t> parents;
+  for (uint32_t i = 0; i < num_positions; ++i) {
+    auto method = read_string(is);
+    auto file = read_string(is);
+    auto pos = new DexPosition(bs::read<uint32_t>(is));
+    pos->method = method;
+    pos->file = file;
+    positions.push_back(pos);
+    parents.push_back(bs::read<uint32_t>(is));
+  }
+  for (uint32_t i = 0; i < num_positions; ++i) {
+    if (parents[i] != DexPositionTable::NO_PARENT) {
+      positions[i]->parent = positions.at(parents[i]);
+    }
+  }
+  // The parents from outside the list may outlive it, so they are never
+  // freed.
+  for (uint32_t i = 0; i < num_owned; ++i) {
+    list->m_positions.emplace_back(positions[i]);
+  }
+  return list;
+}
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include "IRList.h"
+
+/*
+ * A compact encoding of the entries of an IRList, for code that passes have
+ * stopped looking at.
+ *
+ * Entries are written one after the other as varints: the entry type, then
+ * the opcode, registers and literal of an instruction, or the index of the
+ * entry that a try, catch or branch target refers to. Strings, types, fields
+ * and methods are kept once each in a table and referred to by their index
+ * in it. The data payloads, debug instructions and positions are kept as they
+ * are, so that pointers to them (e.g. the parent of a position) stay valid.
+ *
+ * Compacting deletes the IRInstructions and MethodItemEntries of the list, so
+ * nothing may hold on to them.
+ */
+class CompactIRList {
+ public:
+  // Whether all the entries of `ir_list` can be encoded. Dex instructions
+  // can't.
+  static bool can_compact(const IRList& ir_list);
+
+  // Takes all the entries out of `ir_list`, leaving it empty.
+  explicit CompactIRList(IRList* ir_list);
+
+  CompactIRList(const CompactIRList&) = delete;
+  CompactIRList& operator=(const CompactIRList&) = delete;
+
+  // Appends the decoded entries to `ir_list`. This object is left empty.
+  void expand(IRList* ir_list);
+
+  /*
+   * Same as the IRList methods of the same names, without decoding more than
+   * one instruction at a time.
+   */
+  void gather_catch_types(std::vector<DexType*>& ltype) const;
+  void gather_strings(std::vector<DexString*>& lstring) const;
+  void gather_types(std::vector<DexType*>& ltype) const;
+  void gather_fields(std::vector<DexFieldRef*>& lfield) const;
+  void gather_methods(std::vector<DexMethodRef*>& lmethod) const;
+
+  // The number of bytes taken by the encoding and its tables.
+  size_t size_in_bytes() const;
+
+  /*
+   * Writes the encoding and its tables for deserialize() to read back, in
+   * this process or another one. The entities of one process mean nothing
+   * to another, so the table holds their names and deserialize() makes them
+   * again.
+   */
+  void serialize(std::ostream& os) const;
+  static std::unique_ptr<CompactIRList> deserialize(std::istream& is);
+
+ private:
+  class Reader;
+
+  CompactIRList() = default;
+
+  template <typename Visitor>
+  void for_each_entry(Visitor visitor) const;
+
+  std::vector<uint8_t> m_bytes;
+  uint32_t m_num_entries{0};
+  std::vector<void*> m_refs;
+  std::vector<DexOpcodeData*> m_data;
+  std::vector<std::unique_ptr<DexDebugInstruction>> m_debug;
+  std::vector<std::unique_ptr<DexPosition>> m_positions;
+};
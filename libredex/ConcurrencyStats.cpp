@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ConcurrencyStats.h"
+
+#include <array>
+
+#include "Debug.h"
+#include "MemoryAccounting.h"
+
+namespace concurrency_stats {
+
+#ifdef REDEX_CONCURRENCY_STATS
+
+namespace {
+
+using memory_accounting::StripedCounter;
+
+const char* counter_name(Counter counter) {
+  switch (counter) {
+  case Counter::ContainerLocks:
+    return "container_locks";
+  case Counter::ContainerContentions:
+    return "container_contentions";
+  case Counter::TasksExecuted:
+    return "tasks_executed";
+  case Counter::TasksStolen:
+    return "tasks_stolen";
+  case Counter::WorkerIdleMicros:
+    return "worker_idle_us";
+  case Counter::NumCounters:
+    break;
+  }
+  not_reached();
+}
+
+std::array<StripedCounter, static_cast<size_t>(Counter::NumCounters)>&
+counters() {
+  static std::array<StripedCounter, static_cast<size_t>(Counter::NumCounters)>
+      counters;
+  return counters;
+}
+
+std::array<StripedCounter, NUM_LATENCY_BUCKETS>& latency_buckets() {
+  static std::array<StripedCounter, NUM_LATENCY_BUCKETS> buckets;
+  return buckets;
+}
+
+// Counters only ever go up, so zeroing one is taking back what it holds.
+void clear(StripedCounter& counter) { counter.add(-counter.get()); }
+
+} // namespace
+
+void add(Counter counter, uint64_t n) {
+  counters()[static_cast<size_t>(counter)].add(n);
+}
+
+void record_task_latency(std::chrono::steady_clock::duration latency) {
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency)
+                .count();
+  size_t bucket = 0;
+  while (bucket + 1 < NUM_LATENCY_BUCKETS && us >= (int64_t(1) << bucket)) {
+    ++bucket;
+  }
+  latency_buckets()[bucket].add(1);
+}
+
+std::map<std::string, uint64_t> take_report() {
+  std::map<std::string, uint64_t> report;
+  for (size_t i = 0; i < counters().size(); ++i) {
+    if (auto n = counters()[i].get()) {
+      report[counter_name(static_cast<Counter>(i))] = n;
+    }
+  }
+  for (size_t i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+    if (auto n = latency_buckets()[i].get()) {
+      report[i + 1 < NUM_LATENCY_BUCKETS
+                 ? "task_latency_us_lt_" + std::to_string(1 << i)
+                 : "task_latency_us_longer"] = n;
+    }
+  }
+  return report;
+}
+
+void reset() {
+  for (auto& counter : counters()) {
+    clear(counter);
+  }
+  for (auto& bucket : latency_buckets()) {
+    clear(bucket);
+  }
+}
+
+#else
+
+std::map<std::string, uint64_t> take_report() { return {}; }
+
+void reset() {}
+
+#endif
+
+} // namespace concurrency_stats
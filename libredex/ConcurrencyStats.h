@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/*
+ * Counters that tell whether a parallel pass waits on locks or on work: the
+ * lock acquisitions and contentions of the ConcurrentContainers, and the
+ * tasks, steals, idle time and task latencies of the WorkQueues.
+ *
+ * Recording costs an atomic add or a clock read per event, so the counters
+ * are only compiled in with -DREDEX_CONCURRENCY_STATS. Without it, ENABLED is
+ * false, the recording functions are empty and the reports are too.
+ */
+namespace concurrency_stats {
+
+#ifdef REDEX_CONCURRENCY_STATS
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+enum class Counter : size_t {
+  ContainerLocks,
+  ContainerContentions,
+  TasksExecuted,
+  TasksStolen,
+  WorkerIdleMicros,
+  NumCounters,
+};
+
+/*
+ * Task latencies are counted in buckets of powers of two: bucket i holds the
+ * tasks that took less than 2^i microseconds, and the last one everything
+ * longer.
+ */
+constexpr size_t NUM_LATENCY_BUCKETS = 24;
+
+#ifdef REDEX_CONCURRENCY_STATS
+void add(Counter counter, uint64_t n = 1);
+void record_task_latency(std::chrono::steady_clock::duration latency);
+#else
+inline void add(Counter, uint64_t = 1) {}
+inline void record_task_latency(std::chrono::steady_clock::duration) {}
+#endif
+
+/*
+ * What was recorded since the last reset(), by name, e.g.
+ * "container_contentions" or "task_latency_us_lt_64". Counters and buckets
+ * that are zero are left out.
+ */
+std::map<std::string, uint64_t> take_report();
+
+void reset();
+
+/*
+ * What one worker of a WorkQueue does in a run. flush() adds it to the
+ * counters once the run is over, so that the worker doesn't touch shared
+ * counters for every task.
+ */
+class WorkerStats {
+ public:
+#ifdef REDEX_CONCURRENCY_STATS
+  void on_task_start(bool stolen) {
+    auto now = std::chrono::steady_clock::now();
+    end_idle(now);
+    ++m_tasks;
+    m_steals += stolen;
+    m_task_start = now;
+  }
+
+  void on_task_end() {
+    record_task_latency(std::chrono::steady_clock::now() - m_task_start);
+  }
+
+  // When the worker found no task to run.
+  void on_idle() {
+    if (!m_idle) {
+      m_idle = true;
+      m_idle_start = std::chrono::steady_clock::now();
+    }
+  }
+
+  void flush() {
+    end_idle(std::chrono::steady_clock::now());
+    add(Counter::TasksExecuted, m_tasks);
+    add(Counter::TasksStolen, m_steals);
+    add(Counter::WorkerIdleMicros,
+        std::chrono::duration_cast<std::chrono::microseconds>(m_idle_time)
+            .count());
+    m_tasks = 0;
+    m_steals = 0;
+    m_idle_time = {};
+  }
+
+ private:
+  void end_idle(std::chrono::steady_clock::time_point now) {
+    if (m_idle) {
+      m_idle = false;
+      m_idle_time += now - m_idle_start;
+    }
+  }
+
+  uint64_t m_tasks{0};
+  uint64_t m_steals{0};
+  bool m_idle{false};
+  std::chrono::steady_clock::time_point m_idle_start;
+  std::chrono::steady_clock::duration m_idle_time{};
+  std::chrono::steady_clock::time_point m_task_start;
+#else
+  void on_task_start(bool) {}
+  void on_task_end() {}
+  void on_idle() {}
+  void flush() {}
+#endif
+};
+
+// The counts of the lock of one slot of a ConcurrentContainer.
+struct SlotStats {
+  std::atomic<uint64_t> acquisitions{0};
+  std::atomic<uint64_t> contentions{0};
+};
+
+} // namespace concurrency_stats
@@ -7,23 +7,45 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 
 #include <boost/thread.hpp>
 
+#include "ConcurrencyStats.h"
 #include "Debug.h"
 
 // Forward declaration.
 namespace cc_impl {
 
-template <typename Container, size_t n_slots>
+template <typename Container>
 class ConcurrentContainerIterator;
 
+/*
+ * A slot count suitable for a container that `num_threads` threads hammer
+ * concurrently: the smallest prime in a fixed table that gives each thread a
+ * handful of slots, and never fewer than the default of 31.
+ */
+inline size_t slot_count_for_threads(size_t num_threads) {
+  static const size_t primes[] = {31, 61, 127, 251, 509, 1021, 2039, 4093};
+  for (size_t p : primes) {
+    if (p >= 4 * num_threads) {
+      return p;
+    }
+  }
+  return primes[sizeof(primes) / sizeof(primes[0]) - 1];
+}
+
 } // namespace cc_impl
 
 /*
@@ -32,11 +54,14 @@ class ConcurrentContainerIterator;
  * (unordered_map/unordered_set) arranged in slots. Whenever a thread performs a
  * concurrent operation on an element, the slot uniquely determined by the hash
  * code of the element is locked and the corresponding operation is performed on
- * the underlying STL container. This is a very simple design, which offers
- * reasonable performance in practice. A high number of slots may help reduce
- * thread contention at the expense of a larger memory footprint. It is advised
- * to use a prime number for `n_slots`, so as to ensure a more even spread of
- * elements across slots.
+ * the underlying STL container. Lookups take the slot's lock in shared mode, so
+ * they only wait on writers to the same slot. This is a very simple design,
+ * which offers reasonable performance in practice. A high number of slots may
+ * help reduce thread contention at the expense of a larger memory footprint.
+ * The template parameter `n_slots` is only the default; a different count can
+ * be passed to the constructor, e.g. one computed with
+ * cc_impl::slot_count_for_threads(). It is advised to use a prime number of
+ * slots, so as to ensure a more even spread of elements across slots.
  *
  * There are two major modes in which a concurrent container is thread-safe:
  *  - Read only: multiple threads access the contents of the container but do
@@ -45,16 +70,18 @@ class ConcurrentContainerIterator;
  *    not otherwise attempt to access any element.
  * The few operations that are thread-safe regardless of the access mode are
  * documented as such.
+ *
+ * Built with REDEX_CONCURRENCY_STATS, the container counts the acquisitions
+ * of the lock of each slot, and the contentions: the times it wasn't free.
  */
 template <typename Container, typename Key, typename Hash, size_t n_slots>
 class ConcurrentContainer {
  public:
   static_assert(n_slots > 0, "The concurrent container has no slots");
 
-  using iterator = cc_impl::ConcurrentContainerIterator<Container, n_slots>;
+  using iterator = cc_impl::ConcurrentContainerIterator<Container>;
 
-  using const_iterator =
-      cc_impl::ConcurrentContainerIterator<const Container, n_slots>;
+  using const_iterator = cc_impl::ConcurrentContainerIterator<const Container>;
 
   virtual ~ConcurrentContainer() {}
 
@@ -63,57 +90,61 @@ class ConcurrentContainer {
    * modified will result in undefined behavior.
    */
 
-  iterator begin() { return iterator(&m_slots[0], 0, m_slots[0].begin()); }
+  iterator begin() {
+    return iterator(m_slots.get(), m_slot_count, 0, m_slots[0].begin());
+  }
 
-  iterator end() { return iterator(&m_slots[0]); }
+  iterator end() { return iterator(m_slots.get(), m_slot_count); }
 
   const_iterator begin() const {
-    return const_iterator(&m_slots[0], 0, m_slots[0].begin());
+    return const_iterator(m_slots.get(), m_slot_count, 0, m_slots[0].begin());
   }
 
-  const_iterator end() const { return const_iterator(&m_slots[0]); }
+  const_iterator end() const {
+    return const_iterator(m_slots.get(), m_slot_count);
+  }
 
   const_iterator cbegin() const { return begin(); }
 
   const_iterator cend() const { return end(); }
 
   iterator find(const Key& key) {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = get_slot(key);
     const auto& it = m_slots[slot].find(key);
     if (it == m_slots[slot].end()) {
       return end();
     }
-    return iterator(&m_slots[0], slot, it);
+    return iterator(m_slots.get(), m_slot_count, slot, it);
   }
 
   const_iterator find(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = get_slot(key);
     const auto& it = m_slots[slot].find(key);
     if (it == m_slots[slot].end()) {
       return end();
     }
-    return const_iterator(&m_slots[0], slot, it);
+    return const_iterator(m_slots.get(), m_slot_count, slot, it);
   }
 
   size_t size() const {
     size_t s = 0;
-    for (size_t slot = 0; slot < n_slots; ++slot) {
+    for (size_t slot = 0; slot < m_slot_count; ++slot) {
       s += m_slots[slot].size();
     }
     return s;
   }
 
   void reserve(size_t capacity) {
-    size_t slot_capacity = capacity / n_slots;
+    size_t slot_capacity = capacity / m_slot_count;
     if (slot_capacity > 0) {
-      for (size_t i = 0; i < n_slots; ++i) {
+      for (size_t i = 0; i < m_slot_count; ++i) {
         m_slots[i].reserve(slot_capacity);
       }
     }
   }
 
   void clear() {
-    for (size_t slot = 0; slot < n_slots; ++slot) {
+    for (size_t slot = 0; slot < m_slot_count; ++slot) {
       m_slots[slot].clear();
     }
   }
@@ -122,13 +153,13 @@ class ConcurrentContainer {
    * This operation is always thread-safe.
    */
   size_t count(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(m_locks[slot]);
+    size_t slot = get_slot(key);
+    auto lock = shared_lock_slot(slot);
     return m_slots[slot].count(key);
   }
 
   size_t count_unsafe(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = get_slot(key);
     return m_slots[slot].count(key);
   }
 
@@ -136,8 +167,8 @@ class ConcurrentContainer {
    * This operation is always thread-safe.
    */
   size_t erase(const Key& key) {
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(m_locks[slot]);
+    size_t slot = get_slot(key);
+    auto lock = lock_slot(slot);
     return m_slots[slot].erase(key);
   }
 
@@ -145,35 +176,83 @@ class ConcurrentContainer {
    * This operation is not thread-safe.
    */
   size_t bucket_size(size_t i) const {
-    always_assert(i < n_slots);
+    always_assert(i < m_slot_count);
     return m_slots[i].size();
   }
 
+  size_t slot_count() const { return m_slot_count; }
+
+#ifdef REDEX_CONCURRENCY_STATS
+  const concurrency_stats::SlotStats& slot_stats(size_t slot) const {
+    return m_slot_stats[slot];
+  }
+#endif
+
  protected:
   // Only derived classes may be instantiated or copied.
-  ConcurrentContainer() = default;
-
-  ConcurrentContainer(const ConcurrentContainer& container) {
-    for (size_t i = 0; i < n_slots; ++i) {
+  explicit ConcurrentContainer(size_t slot_count = n_slots)
+      : m_slot_count(slot_count),
+        m_locks(new boost::shared_mutex[slot_count]),
+#ifdef REDEX_CONCURRENCY_STATS
+        m_slot_stats(new concurrency_stats::SlotStats[slot_count]),
+#endif
+        m_slots(new Container[slot_count]) {
+    always_assert_log(slot_count > 0, "The concurrent container has no slots");
+  }
+
+  ConcurrentContainer(const ConcurrentContainer& container)
+      : ConcurrentContainer(container.m_slot_count) {
+    for (size_t i = 0; i < m_slot_count; ++i) {
       m_slots[i] = container.m_slots[i];
     }
   }
 
-  ConcurrentContainer(ConcurrentContainer&& container) {
-    for (size_t i = 0; i < n_slots; ++i) {
+  // The moved-from container is left empty but usable.
+  ConcurrentContainer(ConcurrentContainer&& container)
+      : ConcurrentContainer(container.m_slot_count) {
+    for (size_t i = 0; i < m_slot_count; ++i) {
       m_slots[i] = std::move(container.m_slots[i]);
     }
   }
 
+  size_t get_slot(const Key& key) const { return Hash()(key) % m_slot_count; }
+
   Container& get_container(size_t slot) { return m_slots[slot]; }
 
   const Container& get_container(size_t slot) const { return m_slots[slot]; }
 
-  boost::mutex& get_lock(size_t slot) const { return m_locks[slot]; }
+  boost::shared_lock<boost::shared_mutex> shared_lock_slot(size_t slot) const {
+    return take_lock<boost::shared_lock<boost::shared_mutex>>(slot);
+  }
+
+  boost::unique_lock<boost::shared_mutex> lock_slot(size_t slot) const {
+    return take_lock<boost::unique_lock<boost::shared_mutex>>(slot);
+  }
 
  private:
-  mutable boost::mutex m_locks[n_slots];
-  Container m_slots[n_slots];
+  template <typename Lock>
+  Lock take_lock(size_t slot) const {
+#ifdef REDEX_CONCURRENCY_STATS
+    Lock lock(m_locks[slot], boost::try_to_lock);
+    ++m_slot_stats[slot].acquisitions;
+    concurrency_stats::add(concurrency_stats::Counter::ContainerLocks);
+    if (!lock.owns_lock()) {
+      ++m_slot_stats[slot].contentions;
+      concurrency_stats::add(concurrency_stats::Counter::ContainerContentions);
+      lock.lock();
+    }
+    return lock;
+#else
+    return Lock(m_locks[slot]);
+#endif
+  }
+
+  const size_t m_slot_count;
+  std::unique_ptr<boost::shared_mutex[]> m_locks;
+#ifdef REDEX_CONCURRENCY_STATS
+  std::unique_ptr<concurrency_stats::SlotStats[]> m_slot_stats;
+#endif
+  std::unique_ptr<Container[]> m_slots;
 };
 
 template <typename MapContainer,
@@ -186,6 +265,9 @@ class ConcurrentMapContainer
  public:
   ConcurrentMapContainer() = default;
 
+  explicit ConcurrentMapContainer(size_t slot_count)
+      : ConcurrentContainer<MapContainer, Key, Hash, n_slots>(slot_count) {}
+
   ConcurrentMapContainer(const ConcurrentMapContainer& container)
       : ConcurrentContainer<MapContainer, Key, Hash, n_slots>(container) {}
 
@@ -206,19 +288,19 @@ class ConcurrentMapContainer
    * `find()` or `at_unsafe()` to avoid the copy.
    */
   Value at(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(key);
+    auto lock = this->shared_lock_slot(slot);
     return this->get_container(slot).at(key);
   }
 
   const Value& at_unsafe(const Key& key) const {
-    size_t slot = Hash()(key) % n_slots;
+    size_t slot = this->get_slot(key);
     return this->get_container(slot).at(key);
   }
 
-  Value get(const Key& key, Value default_value) {
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+  Value get(const Key& key, Value default_value) const {
+    size_t slot = this->get_slot(key);
+    auto lock = this->shared_lock_slot(slot);
     const auto& map = this->get_container(slot);
     const auto& it = map.find(key);
     if (it == map.end()) {
@@ -237,8 +319,8 @@ class ConcurrentMapContainer
    * thread-safe.
    */
   bool insert(const std::pair<Key, Value>& entry) {
-    size_t slot = Hash()(entry.first) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(entry.first);
+    auto lock = this->lock_slot(slot);
     auto& map = this->get_container(slot);
     return map.insert(entry).second;
   }
@@ -266,8 +348,8 @@ class ConcurrentMapContainer
    * This operation is always thread-safe.
    */
   void insert_or_assign(const std::pair<Key, Value>& entry) {
-    size_t slot = Hash()(entry.first) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(entry.first);
+    auto lock = this->lock_slot(slot);
     auto& map = this->get_container(slot);
     map[entry.first] = entry.second;
   }
@@ -278,12 +360,38 @@ class ConcurrentMapContainer
   template <typename... Args>
   bool emplace(Args&&... args) {
     std::pair<Key, Value> entry(std::forward<Args>(args)...);
-    size_t slot = Hash()(entry.first) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(entry.first);
+    auto lock = this->lock_slot(slot);
     auto& map = this->get_container(slot);
     return map.emplace(std::move(entry)).second;
   }
 
+  /*
+   * Returns the value of `key`, calling `creator()` to make it if there is
+   * none. Only the slot of `key` is locked, and only in shared mode when the
+   * entry exists. `creator` runs under the slot's exclusive lock, at most
+   * once per key, so it must not use this map.
+   * This operation is always thread-safe.
+   */
+  template <typename Creator>
+  Value get_or_create(const Key& key, Creator creator) {
+    size_t slot = this->get_slot(key);
+    auto& map = this->get_container(slot);
+    {
+      auto lock = this->shared_lock_slot(slot);
+      auto it = map.find(key);
+      if (it != map.end()) {
+        return it->second;
+      }
+    }
+    auto lock = this->lock_slot(slot);
+    auto it = map.find(key);
+    if (it != map.end()) {
+      return it->second;
+    }
+    return map.emplace(key, creator()).first->second;
+  }
+
   /*
    * This operation atomically modifies an entry in the map. If the entry
    * doesn't exist, it is created. The third argument of the updater function is
@@ -291,8 +399,8 @@ class ConcurrentMapContainer
    */
   void update(const Key& key,
               const std::function<void(const Key&, Value&, bool)>& updater) {
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(key);
+    auto lock = this->lock_slot(slot);
     auto& map = this->get_container(slot);
     auto it = map.find(key);
     if (it == map.end()) {
@@ -327,6 +435,12 @@ class ConcurrentSet final
  public:
   ConcurrentSet() = default;
 
+  explicit ConcurrentSet(size_t slot_count)
+      : ConcurrentContainer<std::unordered_set<Key, Hash, Equal>,
+                            Key,
+                            Hash,
+                            n_slots>(slot_count) {}
+
   ConcurrentSet(const ConcurrentSet& set)
       : ConcurrentContainer<std::unordered_set<Key, Hash, Equal>,
                             Key,
@@ -344,8 +458,8 @@ class ConcurrentSet final
    * This operation is always thread-safe.
    */
   bool insert(const Key& key) {
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(key);
+    auto lock = this->lock_slot(slot);
     auto& set = this->get_container(slot);
     return set.insert(key).second;
   }
@@ -365,16 +479,310 @@ class ConcurrentSet final
   template <typename... Args>
   bool emplace(Args&&... args) {
     Key key(std::forward<Args>(args)...);
-    size_t slot = Hash()(key) % n_slots;
-    boost::lock_guard<boost::mutex> lock(this->get_lock(slot));
+    size_t slot = this->get_slot(key);
+    auto lock = this->lock_slot(slot);
     auto& set = this->get_container(slot);
     return set.emplace(std::move(key)).second;
   }
 };
 
+/*
+ * A fixed-size set of integers in [0, size()) that threads can update
+ * without locks. Each insertion is a single atomic fetch_or. Operations are
+ * sequentially consistent, like the locks of the other containers, so
+ * callers can rely on the same orderings.
+ */
+class ConcurrentBitmap final {
+ public:
+  explicit ConcurrentBitmap(size_t size)
+      : m_size(size), m_words(new std::atomic<uint64_t>[num_words(size)]) {
+    for (size_t i = 0; i < num_words(size); ++i) {
+      m_words[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  size_t size() const { return m_size; }
+
+  /*
+   * Returns true if `i` was not in the set yet.
+   */
+  bool insert(size_t i) {
+    redex_assert(i < m_size);
+    uint64_t mask = uint64_t(1) << (i % 64);
+    return !(m_words[i / 64].fetch_or(mask) & mask);
+  }
+
+  bool contains(size_t i) const {
+    redex_assert(i < m_size);
+    uint64_t mask = uint64_t(1) << (i % 64);
+    return m_words[i / 64].load() & mask;
+  }
+
+ private:
+  static size_t num_words(size_t size) { return (size + 63) / 64; }
+
+  size_t m_size;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+};
+
+/*
+ * A concurrent map for tables that only ever grow, such as the interning
+ * tables in RedexContext. Entries are never erased or moved once inserted, so
+ * lookups are lock-free: they traverse a bucket array that writers only ever
+ * publish atomically. Insertions lock one of the map's slots, chosen by hash as
+ * in ConcurrentContainer.
+ *
+ * When a slot's bucket array fills up, a bigger one is built and published in
+ * its place. The old array stays valid for readers that are still traversing
+ * it, and it is kept until the map is destroyed, which costs less than twice
+ * the memory of the final bucket arrays.
+ *
+ * Iteration is only safe when the map is not being modified concurrently.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class InsertOnlyConcurrentMap {
+  using Entry = std::pair<const Key, Value>;
+
+  struct Link {
+    Entry* entry;
+    size_t hash;
+    Link* next;
+  };
+
+  struct Table {
+    explicit Table(size_t n_buckets)
+        : mask(n_buckets - 1), buckets(new std::atomic<Link*>[n_buckets]) {
+      for (size_t i = 0; i < n_buckets; ++i) {
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    template <typename K>
+    Link* find(size_t hash, const K& key) const {
+      for (Link* link = buckets[hash & mask].load(std::memory_order_acquire);
+           link != nullptr;
+           link = link->next) {
+        if (link->hash == hash && Equal()(link->entry->first, key)) {
+          return link;
+        }
+      }
+      return nullptr;
+    }
+
+    // Only called with the slot's lock held.
+    void add(Entry* entry, size_t hash) {
+      auto& bucket = buckets[hash & mask];
+      links.push_back(
+          Link{entry, hash, bucket.load(std::memory_order_relaxed)});
+      bucket.store(&links.back(), std::memory_order_release);
+    }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<Link*>[]> buckets;
+    // One link per entry. A deque, so that links don't move as it grows.
+    std::deque<Link> links;
+  };
+
+  struct Slot {
+    Slot() : table(nullptr) {
+      tables.emplace_back(std::make_unique<Table>(8));
+      table.store(tables.back().get(), std::memory_order_relaxed);
+    }
+
+    std::mutex lock;
+    std::atomic<Table*> table;
+    std::vector<std::unique_ptr<Table>> tables;
+  };
+
+ public:
+  explicit InsertOnlyConcurrentMap(size_t slot_count = 31)
+      : m_slot_count(slot_count), m_slots(new Slot[slot_count]) {
+    always_assert_log(slot_count > 0, "The concurrent container has no slots");
+  }
+
+  InsertOnlyConcurrentMap(const InsertOnlyConcurrentMap&) = delete;
+  InsertOnlyConcurrentMap& operator=(const InsertOnlyConcurrentMap&) = delete;
+
+  ~InsertOnlyConcurrentMap() {
+    for (size_t i = 0; i < m_slot_count; ++i) {
+      for (auto& link : current_table(i)->links) {
+        delete link.entry;
+      }
+    }
+  }
+
+  class const_iterator {
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = Entry;
+    using pointer = const Entry*;
+    using reference = const Entry&;
+    using iterator_category = std::forward_iterator_tag;
+
+    const_iterator(const InsertOnlyConcurrentMap* map, size_t slot)
+        : m_map(map), m_slot(slot), m_index(0) {
+      skip_empty_slots();
+    }
+
+    const_iterator& operator++() {
+      ++m_index;
+      skip_empty_slots();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return m_map == other.m_map && m_slot == other.m_slot &&
+             m_index == other.m_index;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+    reference operator*() const { return *links()[m_index].entry; }
+
+    pointer operator->() const { return links()[m_index].entry; }
+
+   private:
+    const std::deque<Link>& links() const {
+      return m_map->current_table(m_slot)->links;
+    }
+
+    void skip_empty_slots() {
+      while (m_slot < m_map->m_slot_count && m_index == links().size()) {
+        ++m_slot;
+        m_index = 0;
+      }
+    }
+
+    const InsertOnlyConcurrentMap* m_map;
+    size_t m_slot;
+    size_t m_index;
+  };
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+
+  const_iterator end() const { return const_iterator(this, m_slot_count); }
+
+  /*
+   * This operation is not thread-safe.
+   */
+  size_t size() const {
+    size_t s = 0;
+    for (size_t i = 0; i < m_slot_count; ++i) {
+      s += current_table(i)->links.size();
+    }
+    return s;
+  }
+
+  /*
+   * This operation is always thread-safe and lock-free.
+   */
+  size_t count(const Key& key) const { return find_link(key) != nullptr; }
+
+  /*
+   * This operation is always thread-safe and lock-free. Unlike
+   * ConcurrentMap::at(), it can return a reference, since entries never move.
+   */
+  const Value& at(const Key& key) const {
+    auto link = find_link(key);
+    if (link == nullptr) {
+      throw std::out_of_range("InsertOnlyConcurrentMap::at");
+    }
+    return link->entry->second;
+  }
+
+  /*
+   * This operation is always thread-safe and lock-free.
+   */
+  Value get(const Key& key, Value default_value) const {
+    auto link = find_link(key);
+    return link == nullptr ? default_value : link->entry->second;
+  }
+
+  /*
+   * Heterogeneous lookup, for maps whose Hash and Equal are transparent: the
+   * key may be of any type that they both accept, so that callers don't have
+   * to build a Key just to probe the map.
+   *
+   * This operation is always thread-safe and lock-free.
+   */
+  template <typename K,
+            typename H = Hash,
+            typename = typename H::is_transparent>
+  Value get(const K& key, Value default_value) const {
+    auto link = find_link(key);
+    return link == nullptr ? default_value : link->entry->second;
+  }
+
+  /*
+   * The Boolean return value denotes whether the insertion took place.
+   * This operation is always thread-safe.
+   */
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    std::unique_ptr<Entry> entry(new Entry(std::forward<Args>(args)...));
+    size_t hash = Hash()(entry->first);
+    Slot& slot = m_slots[hash % m_slot_count];
+    std::lock_guard<std::mutex> lock(slot.lock);
+    Table* table = slot.table.load(std::memory_order_relaxed);
+    if (table->find(hash, entry->first) != nullptr) {
+      return false;
+    }
+    if (table->links.size() > table->mask) {
+      table = grow(slot, table);
+    }
+    table->add(entry.release(), hash);
+    return true;
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  bool insert(const std::pair<Key, Value>& entry) {
+    return emplace(entry.first, entry.second);
+  }
+
+ private:
+  template <typename K>
+  Link* find_link(const K& key) const {
+    size_t hash = Hash()(key);
+    const Slot& slot = m_slots[hash % m_slot_count];
+    return slot.table.load(std::memory_order_acquire)->find(hash, key);
+  }
+
+  const Table* current_table(size_t i) const {
+    return m_slots[i].table.load(std::memory_order_acquire);
+  }
+
+  // Only called with the slot's lock held.
+  static Table* grow(Slot& slot, const Table* old_table) {
+    auto table = std::make_unique<Table>(2 * (old_table->mask + 1));
+    for (const auto& link : old_table->links) {
+      table->add(link.entry, link.hash);
+    }
+    Table* result = table.get();
+    slot.tables.emplace_back(std::move(table));
+    slot.table.store(result, std::memory_order_release);
+    return result;
+  }
+
+  const size_t m_slot_count;
+  std::unique_ptr<Slot[]> m_slots;
+};
+
 namespace cc_impl {
 
-template <typename Container, size_t n_slots>
+template <typename Container>
 class ConcurrentContainerIterator final {
  public:
   using base_iterator = std::conditional_t<std::is_const<Container>::value,
@@ -386,22 +794,24 @@ class ConcurrentContainerIterator final {
   using reference = typename base_iterator::reference;
   using iterator_category = std::forward_iterator_tag;
 
-  explicit ConcurrentContainerIterator(Container* slots)
+  ConcurrentContainerIterator(Container* slots, size_t n_slots)
       : m_slots(slots),
+        m_n_slots(n_slots),
         m_slot(n_slots - 1),
         m_position(m_slots[n_slots - 1].end()) {
     skip_empty_slots();
   }
 
   ConcurrentContainerIterator(Container* slots,
+                              size_t n_slots,
                               size_t slot,
                               const base_iterator& position)
-      : m_slots(slots), m_slot(slot), m_position(position) {
+      : m_slots(slots), m_n_slots(n_slots), m_slot(slot), m_position(position) {
     skip_empty_slots();
   }
 
   ConcurrentContainerIterator& operator++() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_n_slots - 1].end());
     ++m_position;
     skip_empty_slots();
     return *this;
@@ -423,33 +833,34 @@ class ConcurrentContainerIterator final {
   }
 
   reference operator*() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_n_slots - 1].end());
     return *m_position;
   }
 
   pointer operator->() {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_n_slots - 1].end());
     return m_position.operator->();
   }
 
   const reference operator*() const {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_n_slots - 1].end());
     return *m_position;
   }
 
   const pointer operator->() const {
-    always_assert(m_position != m_slots[n_slots - 1].end());
+    always_assert(m_position != m_slots[m_n_slots - 1].end());
     return m_position.operator->();
   }
 
  private:
   void skip_empty_slots() {
-    while (m_position == m_slots[m_slot].end() && m_slot < n_slots - 1) {
+    while (m_position == m_slots[m_slot].end() && m_slot < m_n_slots - 1) {
       m_position = m_slots[++m_slot].begin();
     }
   }
 
   Container* m_slots;
+  size_t m_n_slots;
   size_t m_slot;
   base_iterator m_position;
 };
@@ -14,6 +14,7 @@
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "Walkers.h"
 
 void JsonWrapper::get(const char* name, int64_t dflt, int64_t& param) const {
   param = m_config.get(name, (Json::Int64)dflt).asInt();
@@ -323,6 +324,8 @@ void ConfigFiles::load_inliner_config(inliner::InlinerConfig* inliner_config) {
          true,
          inliner_config->enforce_method_size_limit);
   jw.get("use_cfg_inliner", false, inliner_config->use_cfg_inliner);
+  jw.get("parallel", false, inliner_config->parallel);
+  jw.get("max_register_pressure", 0, inliner_config->max_register_pressure);
   jw.get("multiple_callers", false, inliner_config->multiple_callers);
   jw.get("inline_small_non_deletables",
          false,
@@ -359,4 +362,25 @@ void ConfigFiles::load_inliner_config(inliner::InlinerConfig* inliner_config) {
 void ConfigFiles::load(const Scope& scope) {
   get_inliner_config();
   m_inliner_config->populate(scope);
+
+  m_coldstart_types.clear();
+  for (const auto& name : get_coldstart_classes()) {
+    auto type = DexType::get_type(name.c_str());
+    if (type != nullptr) {
+      m_coldstart_types.push_back(type);
+    }
+  }
+  m_method_weights.clear();
+  if (!m_method_to_weight.empty()) {
+    walk::methods(scope, [&](DexMethod* method) {
+      const auto& name = method->get_fully_deobfuscated_name();
+      if (name.empty()) {
+        return;
+      }
+      auto it = m_method_to_weight.find(name);
+      if (it != m_method_to_weight.end()) {
+        m_method_weights.emplace(method, it->second);
+      }
+    });
+  }
 }
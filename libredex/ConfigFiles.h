@@ -113,6 +113,21 @@ struct ConfigFiles {
     return m_method_to_weight;
   }
 
+  /**
+   * The coldstart classes and the profiled methods, resolved by load() to the
+   * types and methods they name, so that lookups and sorting need not go
+   * through their names. Names that don't resolve, like the InterDex
+   * markers, are left out.
+   */
+  const std::vector<DexType*>& get_coldstart_types() const {
+    return m_coldstart_types;
+  }
+
+  const std::unordered_map<const DexMethodRef*, unsigned int>&
+  get_method_weights() const {
+    return m_method_weights;
+  }
+
   const std::unordered_set<std::string>&
   get_method_sorting_whitelisted_substrings() const {
     return m_method_sorting_whitelisted_substrings;
@@ -193,6 +208,8 @@ struct ConfigFiles {
   std::vector<std::string> m_coldstart_methods;
   std::unordered_map<std::string, std::vector<std::string> > m_class_lists;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
+  std::vector<DexType*> m_coldstart_types;
+  std::unordered_map<const DexMethodRef*, unsigned int> m_method_weights;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
   std::string m_printseeds; // Filename to dump computed seeds.
 
@@ -9,6 +9,7 @@
 
 #include <boost/dynamic_bitset.hpp>
 #include <boost/numeric/conversion/cast.hpp>
+#include <algorithm>
 #include <iterator>
 #include <stack>
 #include <utility>
@@ -245,7 +246,8 @@ Block::Block(const Block& b, MethodItemEntryCloner* cloner)
     : m_id(b.m_id),
       m_preds(b.m_preds),
       m_succs(b.m_succs),
-      m_parent(b.m_parent) {
+      m_parent(b.m_parent),
+      m_cold(b.m_cold) {
 
   // only for editable, don't worry about m_begin and m_end
   always_assert(m_parent->editable());
@@ -1212,7 +1214,24 @@ std::vector<Block*> ControlFlowGraph::order() {
   block_to_chain.reserve(m_blocks.size());
 
   build_chains(&chains, &block_to_chain);
-  const auto& result = wto_chains(block_to_chain);
+  auto result = wto_chains(block_to_chain);
+
+  // Move the cold chains to the end, keeping the relative order of the
+  // chains on both sides. The entry block always comes first.
+  if (std::any_of(result.begin(), result.end(),
+                  [](const Block* b) { return b->is_cold(); })) {
+    std::unordered_map<const Chain*, bool> cold_chains;
+    for (const auto& chain : chains) {
+      cold_chains.emplace(
+          chain.get(),
+          std::all_of(chain->begin(), chain->end(), [this](const Block* b) {
+            return b->is_cold() && b != entry_block();
+          }));
+    }
+    std::stable_partition(result.begin(), result.end(), [&](Block* b) {
+      return !cold_chains.at(block_to_chain.at(b));
+    });
+  }
 
   always_assert_log(result.size() == m_blocks.size(),
                     "result has %lu blocks, m_blocks has %lu", result.size(),
@@ -2175,80 +2194,17 @@ std::vector<Block*> postorder_sort(const std::vector<Block*>& cfg) {
   return postorder;
 }
 
-Block* ControlFlowGraph::idom_intersect(
-    const std::unordered_map<Block*, DominatorInfo>& postorder_dominator,
-    Block* block1,
-    Block* block2) const {
-  auto finger1 = block1;
-  auto finger2 = block2;
-  while (finger1 != finger2) {
-    while (postorder_dominator.at(finger1).postorder <
-           postorder_dominator.at(finger2).postorder) {
-      finger1 = postorder_dominator.at(finger1).dom;
-    }
-    while (postorder_dominator.at(finger2).postorder <
-           postorder_dominator.at(finger1).postorder) {
-      finger2 = postorder_dominator.at(finger2).dom;
-    }
-  }
-  return finger1;
+std::shared_ptr<const DominatorTree> ControlFlowGraph::dominators() const {
+  return m_dominator_caches[0].get(m_edges_version, m_entry_block, [this]() {
+    return std::make_shared<const DominatorTree>(*this);
+  });
 }
 
-// Finding immediate dominator for each blocks in ControlFlowGraph.
-// Theory from:
-//    K. D. Cooper et.al. A Simple, Fast Dominance Algorithm.
-std::unordered_map<Block*, DominatorInfo>
-ControlFlowGraph::immediate_dominators() const {
-  // Get postorder of blocks and create map of block to postorder number.
-  std::unordered_map<Block*, DominatorInfo> postorder_dominator;
-  auto postorder_blocks = postorder_sort(blocks());
-  for (size_t i = 0; i < postorder_blocks.size(); ++i) {
-    postorder_dominator[postorder_blocks[i]].postorder = i;
-  }
-
-  // Initialize immediate dominators. Having value as nullptr means it has
-  // not been processed yet.
-  for (Block* block : blocks()) {
-    if (block->preds().empty()) {
-      // Entry block's immediate dominator is itself.
-      postorder_dominator[block].dom = block;
-    } else {
-      postorder_dominator[block].dom = nullptr;
-    }
-  }
-
-  bool changed = true;
-  while (changed) {
-    changed = false;
-    // Traverse block in reverse postorder.
-    for (auto rit = postorder_blocks.rbegin(); rit != postorder_blocks.rend();
-         ++rit) {
-      Block* ordered_block = *rit;
-      if (ordered_block->preds().empty()) {
-        continue;
-      }
-      Block* new_idom = nullptr;
-      // Pick one random processed block as starting point.
-      for (auto& pred : ordered_block->preds()) {
-        if (postorder_dominator[pred->src()].dom != nullptr) {
-          new_idom = pred->src();
-          break;
-        }
-      }
-      always_assert(new_idom != nullptr);
-      for (auto& pred : ordered_block->preds()) {
-        if (pred->src() != new_idom &&
-            postorder_dominator[pred->src()].dom != nullptr) {
-          new_idom = idom_intersect(postorder_dominator, new_idom, pred->src());
-        }
-      }
-      if (postorder_dominator[ordered_block].dom != new_idom) {
-        postorder_dominator[ordered_block].dom = new_idom;
-        changed = true;
-      }
-    }
-  }
-  return postorder_dominator;
+std::shared_ptr<const DominatorTree> ControlFlowGraph::post_dominators()
+    const {
+  return m_dominator_caches[1].get(m_edges_version, m_exit_block, [this]() {
+    return std::make_shared<const DominatorTree>(*this, /* post */ true);
+  });
 }
 
 ControlFlowGraph::EdgeSet ControlFlowGraph::remove_succ_edges(Block* b,
@@ -15,7 +15,10 @@
 #include <utility>
 #include <vector>
 
+#include "Dominators.h"
 #include "IRCode.h"
+#include "MemoryAccounting.h"
+#include "WeakTopologicalOrdering.h"
 
 /**
  * A Control Flow Graph is a directed graph of Basic Blocks.
@@ -191,7 +194,8 @@ using ConstInstructionIterable = InstructionIterableImpl</* is_const */ true>;
 
 // A piece of "straight-line" code. Targets are only at the beginning of a block
 // and branches (throws, gotos, switches, etc) are only at the end of a block.
-class Block final {
+class Block final
+    : private memory_accounting::Counted<memory_accounting::Entity::CfgBlock> {
  public:
   explicit Block(ControlFlowGraph* parent, BlockId id)
       : m_id(id), m_parent(parent) {}
@@ -228,6 +232,11 @@ class Block final {
 
   bool same_try(const Block* other) const;
 
+  // Whether a profile shows that this block is rarely executed. order() moves
+  // the chains of blocks that are all cold after the other ones.
+  bool is_cold() const { return m_cold; }
+  void set_cold(bool cold) { m_cold = cold; }
+
   void remove_insn(const InstructionIterator& it);
   void remove_insn(const ir_list::InstructionIterator& it);
   void remove_insn(const IRList::iterator& it);
@@ -326,11 +335,8 @@ class Block final {
 
   // the graph that this block belongs to
   ControlFlowGraph* m_parent = nullptr;
-};
 
-struct DominatorInfo {
-  Block* dom;
-  size_t postorder;
+  bool m_cold{false};
 };
 
 class ControlFlowGraph {
@@ -408,6 +414,7 @@ class ControlFlowGraph {
   }
 
   void add_edge(Edge* e) {
+    invalidate_edge_caches();
     m_edges.insert(e);
     e->src()->m_succs.emplace_back(e);
     e->target()->m_preds.emplace_back(e);
@@ -620,14 +627,14 @@ class ControlFlowGraph {
    */
   std::ostream& write_dot_format(std::ostream&) const;
 
-  // Find a common dominator block that is closest to both block.
-  Block* idom_intersect(
-      const std::unordered_map<Block*, DominatorInfo>& postorder_dominator,
-      Block* block1,
-      Block* block2) const;
+  // The dominator tree of this CFG, computed on first use and kept until an
+  // edge is added, removed or redirected, or the entry block changes. The
+  // returned tree stays valid for its holders after that, but is stale.
+  std::shared_ptr<const DominatorTree> dominators() const;
 
-  // Finding immediate dominator for each blocks in ControlFlowGraph.
-  std::unordered_map<Block*, DominatorInfo> immediate_dominators() const;
+  // Like dominators(), but for the post-dominator tree, which is rooted at
+  // the exit block. See `calculate_exit_block()`.
+  std::shared_ptr<const DominatorTree> post_dominators() const;
 
   // Do writes to this CFG propagate back to IR and Dex code?
   bool editable() const { return m_editable; }
@@ -701,7 +708,20 @@ class ControlFlowGraph {
   // choose an order of blocks for output
   std::vector<Block*> order();
 
+  // The weak topological orderings of this CFG (backwards = false) and of its
+  // reverse, kept across the fixpoint iterators that run on it. They are
+  // dropped whenever an edge is added, removed or redirected.
+  sparta::WtoCache<Block*>* wto_cache(bool backwards) const {
+    return &m_wto_caches[backwards ? 1 : 0];
+  }
+
  private:
+  void invalidate_edge_caches() {
+    m_wto_caches[0].invalidate();
+    m_wto_caches[1].invalidate();
+    ++m_edges_version;
+  }
+
   using BranchToTargets =
       std::unordered_map<MethodItemEntry*, std::vector<Block*>>;
   using TryEnds = std::vector<std::pair<TryEntry*, Block*>>;
@@ -818,6 +838,7 @@ class ControlFlowGraph {
                          Block* target,
                          EdgePredicate predicate,
                          bool cleanup = true) {
+    invalidate_edge_caches();
     auto& forward_edges = source->m_succs;
     EdgeSet to_remove;
     forward_edges.erase(
@@ -850,6 +871,7 @@ class ControlFlowGraph {
   EdgeSet remove_pred_edge_if(Block* block,
                               EdgePredicate predicate,
                               bool cleanup = true) {
+    invalidate_edge_caches();
     auto& reverse_edges = block->m_preds;
 
     std::vector<Block*> source_blocks;
@@ -886,6 +908,7 @@ class ControlFlowGraph {
   EdgeSet remove_succ_edge_if(Block* block,
                               EdgePredicate predicate,
                               bool cleanup = true) {
+    invalidate_edge_caches();
     auto& forward_edges = block->m_succs;
 
     std::vector<Block*> target_blocks;
@@ -950,6 +973,10 @@ class ControlFlowGraph {
   Block* m_entry_block{nullptr};
   Block* m_exit_block{nullptr};
   bool m_editable{true};
+  mutable sparta::WtoCache<Block*> m_wto_caches[2];
+  // Bumped whenever the edges change, which makes the dominator trees stale.
+  uint64_t m_edges_version{0};
+  mutable DominatorTreeCache m_dominator_caches[2];
 };
 
 // A static-method-only API for use with the monotonic fixpoint iterator.
@@ -973,6 +1000,10 @@ class GraphInterface {
   }
   static NodeId source(const Graph&, const EdgeId& e) { return e->src(); }
   static NodeId target(const Graph&, const EdgeId& e) { return e->target(); }
+  static sparta::WtoCache<NodeId>* wto_cache(const Graph& graph,
+                                             bool backwards) {
+    return graph.wto_cache(backwards);
+  }
 };
 
 template <bool is_const>
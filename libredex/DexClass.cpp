@@ -29,6 +29,18 @@
 #include <unordered_map>
 
 
+const std::string& DexString::materialize() const {
+  auto fresh = new std::string(m_data, m_size);
+  const std::string* expected = nullptr;
+  if (m_storage.compare_exchange_strong(expected, fresh,
+                                        std::memory_order_acq_rel)) {
+    return *fresh;
+  }
+  // Another thread got there first.
+  delete fresh;
+  return *expected;
+}
+
 uint32_t DexString::length() const {
   if (is_simple()) {
     return size();
@@ -99,6 +111,7 @@ static std::vector<DexDebugEntry> eval_debug_instructions(
     DexDebugItem* dbg,
     std::vector<std::unique_ptr<DexDebugInstruction>>& insns,
     uint32_t absolute_line) {
+  const auto& loaded = RedexContext::loaded_debug_info();
   std::vector<DexDebugEntry> entries;
   uint32_t pc = 0;
   for (auto& opcode : insns) {
@@ -111,7 +124,12 @@ static std::vector<DexDebugEntry> eval_debug_instructions(
     case DBG_END_LOCAL:
     case DBG_RESTART_LOCAL:
     case DBG_START_LOCAL:
-    case DBG_START_LOCAL_EXTENDED:
+    case DBG_START_LOCAL_EXTENDED: {
+      if (loaded.locals) {
+        entries.emplace_back(pc, std::move(opcode));
+      }
+      break;
+    }
     case DBG_SET_FILE:
     case DBG_END_SEQUENCE:
     case DBG_SET_PROLOGUE_END:
@@ -127,7 +145,9 @@ static std::vector<DexDebugEntry> eval_debug_instructions(
       uint8_t adjustment = op - DBG_FIRST_SPECIAL;
       absolute_line += DBG_LINE_BASE + (adjustment % DBG_LINE_RANGE);
       pc += adjustment / DBG_LINE_RANGE;
-      entries.emplace_back(pc, std::make_unique<DexPosition>(absolute_line));
+      if (loaded.positions) {
+        entries.emplace_back(pc, std::make_unique<DexPosition>(absolute_line));
+      }
       break;
     }
     }
@@ -136,6 +156,16 @@ static std::vector<DexDebugEntry> eval_debug_instructions(
 }
 
 DexDebugItem::DexDebugItem(DexIdx* idx, uint32_t offset) {
+  if (RedexContext::lazy_debug_info()) {
+    m_idx = idx;
+    m_offset = offset;
+    m_pending = true;
+    return;
+  }
+  decode(idx, offset);
+}
+
+void DexDebugItem::decode(DexIdx* idx, uint32_t offset) {
   const uint8_t* encdata = idx->get_uleb_data(offset);
   uint32_t line_start = read_uleb128(&encdata);
   uint32_t paramcount = read_uleb128(&encdata);
@@ -152,7 +182,39 @@ DexDebugItem::DexDebugItem(DexIdx* idx, uint32_t offset) {
   m_dbg_entries = eval_debug_instructions(this, insns, line_start);
 }
 
+namespace {
+
+// Striped so that we don't need a mutex in every DexDebugItem.
+constexpr size_t kDebugDecodeLockCount = 64;
+std::mutex s_debug_decode_locks[kDebugDecodeLockCount];
+
+} // namespace
+
+void DexDebugItem::ensure_decoded() const {
+  if (!m_pending.load(std::memory_order_acquire)) {
+    return;
+  }
+  auto& lock = s_debug_decode_locks[std::hash<const DexDebugItem*>()(this) %
+                                    kDebugDecodeLockCount];
+  std::lock_guard<std::mutex> guard(lock);
+  if (!m_pending.load(std::memory_order_relaxed)) {
+    // Someone else got here first.
+    return;
+  }
+  auto self = const_cast<DexDebugItem*>(this);
+  self->decode(m_idx, m_offset);
+  if (m_bind_method != nullptr) {
+    for (auto& entry : self->m_dbg_entries) {
+      if (entry.type == DexDebugEntryType::Position) {
+        entry.pos->bind(m_bind_method, m_bind_file);
+      }
+    }
+  }
+  self->m_pending.store(false, std::memory_order_release);
+}
+
 uint32_t DexDebugItem::get_line_start() const {
+  ensure_decoded();
   for (auto& entry : m_dbg_entries) {
     switch (entry.type) {
     case DexDebugEntryType::Position: {
@@ -165,8 +227,9 @@ uint32_t DexDebugItem::get_line_start() const {
   return 0;
 }
 
-DexDebugItem::DexDebugItem(const DexDebugItem& that)
-    : m_param_names(that.m_param_names) {
+DexDebugItem::DexDebugItem(const DexDebugItem& that) {
+  that.ensure_decoded();
+  m_param_names = that.m_param_names;
   std::unordered_map<DexPosition*, DexPosition*> pos_map;
   for (auto& entry : that.m_dbg_entries) {
     switch (entry.type) {
@@ -186,7 +249,9 @@ DexDebugItem::DexDebugItem(const DexDebugItem& that)
 
 std::unique_ptr<DexDebugItem> DexDebugItem::get_dex_debug(DexIdx* idx,
                                                           uint32_t offset) {
-  if (offset == 0) return nullptr;
+  if (offset == 0 || !RedexContext::loaded_debug_info().debug_items) {
+    return nullptr;
+  }
   return std::unique_ptr<DexDebugItem>(new DexDebugItem(idx, offset));
 }
 
@@ -296,6 +361,13 @@ int DexDebugItem::encode(
 
 void DexDebugItem::bind_positions(DexMethod* method, DexString* file) {
   auto* method_str = DexString::make_string(show(method));
+  if (m_pending.load(std::memory_order_acquire)) {
+    // Only done while loading, before anyone else can see this item. The
+    // name is taken now since the method may be renamed before we decode.
+    m_bind_method = method_str;
+    m_bind_file = file;
+    return;
+  }
   for (auto& entry : m_dbg_entries) {
     switch (entry.type) {
     case DexDebugEntryType::Position:
@@ -308,12 +380,14 @@ void DexDebugItem::bind_positions(DexMethod* method, DexString* file) {
 }
 
 void DexDebugItem::gather_types(std::vector<DexType*>& ltype) const {
+  ensure_decoded();
   for (auto& entry : m_dbg_entries) {
     entry.gather_types(ltype);
   }
 }
 
 void DexDebugItem::gather_strings(std::vector<DexString*>& lstring) const {
+  ensure_decoded();
   for (auto p : m_param_names) {
     if (p) lstring.push_back(p);
   }
@@ -394,6 +468,38 @@ std::unique_ptr<DexCode> DexCode::get_dex_code(DexIdx* idx, uint32_t offset) {
   return dc;
 }
 
+void DexCode::gather_types(std::vector<DexType*>& ltype) const {
+  for (auto const& insn : *m_insns) {
+    insn->gather_types(ltype);
+  }
+  for (auto const& dextry : m_tries) {
+    for (auto const& catz : dextry->m_catches) {
+      if (catz.first != nullptr) {
+        ltype.push_back(catz.first);
+      }
+    }
+  }
+}
+
+void DexCode::gather_strings(std::vector<DexString*>& lstring) const {
+  for (auto const& insn : *m_insns) {
+    insn->gather_strings(lstring);
+  }
+  if (m_dbg) m_dbg->gather_strings(lstring);
+}
+
+void DexCode::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  for (auto const& insn : *m_insns) {
+    insn->gather_fields(lfield);
+  }
+}
+
+void DexCode::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  for (auto const& insn : *m_insns) {
+    insn->gather_methods(lmethod);
+  }
+}
+
 int DexCode::encode(DexOutputIdx* dodx, uint32_t* output) {
   dex_code_item* code = (dex_code_item*)output;
   code->registers_size = m_registers_size;
@@ -512,21 +618,85 @@ std::string DexMethod::get_fully_deobfuscated_name() const {
 }
 
 void DexMethod::set_code(std::unique_ptr<IRCode> code) {
+  if (m_balloon_deferred.exchange(false)) {
+    m_dex_code.reset();
+  }
+  m_code_compact = false;
   m_code = std::move(code);
+  auto epoch = RedexContext::code_epoch();
+  if (epoch != 0) {
+    m_code_epoch.store(epoch, std::memory_order_relaxed);
+  }
 }
 
 void DexMethod::balloon() {
+  m_balloon_deferred = false;
   redex_assert(m_code == nullptr);
   m_code = std::make_unique<IRCode>(this);
   m_dex_code.reset();
 }
 
 void DexMethod::sync() {
+  if (m_balloon_deferred.exchange(false)) {
+    // Never ballooned, so the DexCode we loaded is still accurate.
+    return;
+  }
   redex_assert(m_dex_code == nullptr);
+  if (m_code_compact.exchange(false)) {
+    m_code->expand();
+  }
   m_dex_code = m_code->sync(this);
   m_code.reset();
 }
 
+void DexMethod::defer_balloon() {
+  redex_assert(m_code == nullptr && m_dex_code != nullptr);
+  m_balloon_deferred = true;
+}
+
+namespace {
+
+// Striped so that we don't need a mutex in every DexMethod.
+constexpr size_t kBalloonLockCount = 64;
+std::mutex s_balloon_locks[kBalloonLockCount];
+
+} // namespace
+
+void DexMethod::balloon_deferred() {
+  auto& lock = s_balloon_locks[std::hash<const DexMethod*>()(this) %
+                               kBalloonLockCount];
+  std::lock_guard<std::mutex> guard(lock);
+  if (!m_balloon_deferred.load(std::memory_order_relaxed)) {
+    // Someone else got here first.
+    return;
+  }
+  m_code = std::make_unique<IRCode>(this);
+  m_dex_code.reset();
+  m_balloon_deferred.store(false, std::memory_order_release);
+}
+
+bool DexMethod::compact_code() {
+  if (is_balloon_deferred() || is_code_compact() || m_code == nullptr ||
+      !m_code->can_compact()) {
+    return false;
+  }
+  m_code->compact();
+  m_code_compact.store(true, std::memory_order_release);
+  return true;
+}
+
+void DexMethod::expand_code() {
+  auto& lock = s_balloon_locks[std::hash<const DexMethod*>()(this) %
+                               kBalloonLockCount];
+  std::lock_guard<std::mutex> guard(lock);
+  if (!m_code_compact.load(std::memory_order_relaxed)) {
+    // Someone else got here first.
+    return;
+  }
+  m_code->expand();
+  m_code_compact.store(false, std::memory_order_release);
+}
+
 size_t hash_value(const DexMethodSpec& r) {
   size_t seed = boost::hash<DexType*>()(r.cls);
   boost::hash_combine(seed, r.name);
@@ -575,11 +745,12 @@ DexMethodRef* DexMethod::make_method(const std::string& full_descriptor) {
   auto mdt = dex_member_refs::parse_method(full_descriptor);
   auto cls = DexType::make_type(mdt.cls.c_str());
   auto name = DexString::make_string(mdt.name);
-  std::deque<DexType*> args;
+  std::vector<DexType*> args;
+  args.reserve(mdt.args.size());
   for (auto& arg_str : mdt.args) {
     args.push_back(DexType::make_type(arg_str.c_str()));
   }
-  auto dtl = DexTypeList::make_type_list(std::move(args));
+  auto dtl = DexTypeList::make_type_list(args);
   auto rtype = DexType::make_type(mdt.rtype.c_str());
   return DexMethod::make_method(cls, name, DexProto::make_proto(rtype, dtl));
 }
@@ -636,6 +807,7 @@ void DexClass::remove_method(const DexMethod* m) {
     meths.erase(it);
   }
   redex_assert(erased);
+  g_redex->invalidate_resolutions();
 }
 
 void DexMethod::become_virtual() {
@@ -646,12 +818,14 @@ void DexMethod::become_virtual() {
   m_virtual = true;
   auto& vmethods = cls->get_vmethods();
   insert_sorted(vmethods, this, compare_dexmethods);
+  g_redex->invalidate_resolutions();
 }
 
 void DexMethod::make_concrete(DexAccessFlags access,
                               std::unique_ptr<DexCode> dc,
                               bool is_virtual) {
   m_access = access;
+  m_balloon_deferred = false;
   m_dex_code = std::move(dc);
   m_concrete = true;
   m_virtual = is_virtual;
@@ -661,6 +835,10 @@ void DexMethod::make_concrete(DexAccessFlags access,
                               std::unique_ptr<IRCode> dc,
                               bool is_virtual) {
   m_access = access;
+  if (m_balloon_deferred.exchange(false)) {
+    m_dex_code.reset();
+  }
+  m_code_compact = false;
   m_code = std::move(dc);
   m_concrete = true;
   m_virtual = is_virtual;
@@ -673,6 +851,10 @@ void DexMethod::make_concrete(DexAccessFlags access, bool is_virtual) {
 void DexMethod::make_non_concrete() {
   m_access = static_cast<DexAccessFlags>(0);
   m_concrete = false;
+  if (m_balloon_deferred.exchange(false)) {
+    m_dex_code.reset();
+  }
+  m_code_compact = false;
   m_code.reset();
   m_virtual = false;
   m_param_anno.clear();
@@ -762,7 +944,10 @@ void DexClass::load_class_data_item(DexIdx* idx,
   }
 }
 
-std::unique_ptr<IRCode> DexMethod::release_code() { return std::move(m_code); }
+std::unique_ptr<IRCode> DexMethod::release_code() {
+  get_code();
+  return std::move(m_code);
+}
 
 void DexClass::add_method(DexMethod* m) {
   always_assert_log(m->is_concrete() || m->is_external(),
@@ -774,6 +959,7 @@ void DexClass::add_method(DexMethod* m) {
   } else {
     insert_sorted(m_dmethods, m, compare_dexmethods);
   }
+  g_redex->invalidate_resolutions();
 }
 
 void DexClass::add_field(DexField* f) {
@@ -787,6 +973,7 @@ void DexClass::add_field(DexField* f) {
   } else {
     insert_sorted(m_ifields, f, compare_dexfields);
   }
+  g_redex->invalidate_resolutions();
 }
 
 void DexClass::remove_field(const DexField* f) {
@@ -799,6 +986,7 @@ void DexClass::remove_field(const DexField* f) {
     fields.erase(it);
   }
   redex_assert(erase);
+  g_redex->invalidate_resolutions();
 }
 
 void DexClass::sort_fields() {
@@ -1037,6 +1225,7 @@ DexClass::DexClass(DexIdx* idx,
       m_anno(nullptr),
       m_external(false),
       m_perf_sensitive(false),
+      m_dense_id(g_redex->make_class_id()),
       m_location(location) {
   load_class_annotations(idx, cdef->annotations_off);
   auto deva = std::unique_ptr<DexEncodedValueArray>(
@@ -1192,7 +1381,7 @@ void DexField::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
 
 void DexMethod::gather_types(std::vector<DexType*>& ltype) const {
   // We handle m_spec.cls and proto in the first-layer gather.
-  if (m_code) m_code->gather_types(ltype);
+  gather_code_types(ltype);
   if (m_anno) m_anno->gather_types(ltype);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1206,7 +1395,9 @@ void DexMethod::gather_types(std::vector<DexType*>& ltype) const {
 void DexMethod::gather_strings(std::vector<DexString*>& lstring,
                                bool exclude_loads) const {
   // We handle m_name and proto in the first-layer gather.
-  if (m_code && !exclude_loads) m_code->gather_strings(lstring);
+  if (!exclude_loads) {
+    gather_code_strings(lstring);
+  }
   if (m_anno) m_anno->gather_strings(lstring);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1218,7 +1409,7 @@ void DexMethod::gather_strings(std::vector<DexString*>& lstring,
 }
 
 void DexMethod::gather_fields(std::vector<DexFieldRef*>& lfield) const {
-  if (m_code) m_code->gather_fields(lfield);
+  gather_code_fields(lfield);
   if (m_anno) m_anno->gather_fields(lfield);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1230,7 +1421,7 @@ void DexMethod::gather_fields(std::vector<DexFieldRef*>& lfield) const {
 }
 
 void DexMethod::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
-  if (m_code) m_code->gather_methods(lmethod);
+  gather_code_methods(lmethod);
   if (m_anno) m_anno->gather_methods(lmethod);
   auto param_anno = get_param_anno();
   if (param_anno) {
@@ -1241,6 +1432,27 @@ void DexMethod::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
   }
 }
 
+void DexMethod::gather_code_types(std::vector<DexType*>& ltype) const {
+  if (m_code) m_code->gather_types(ltype);
+  else if (is_balloon_deferred()) m_dex_code->gather_types(ltype);
+}
+
+void DexMethod::gather_code_fields(std::vector<DexFieldRef*>& lfield) const {
+  if (m_code) m_code->gather_fields(lfield);
+  else if (is_balloon_deferred()) m_dex_code->gather_fields(lfield);
+}
+
+void DexMethod::gather_code_methods(
+    std::vector<DexMethodRef*>& lmethod) const {
+  if (m_code) m_code->gather_methods(lmethod);
+  else if (is_balloon_deferred()) m_dex_code->gather_methods(lmethod);
+}
+
+void DexMethod::gather_code_strings(std::vector<DexString*>& lstring) const {
+  if (m_code) m_code->gather_strings(lstring);
+  else if (is_balloon_deferred()) m_dex_code->gather_strings(lstring);
+}
+
 void DexMethodRef::gather_types_shallow(std::vector<DexType*>& ltype) const {
   ltype.push_back(m_spec.cls);
   m_spec.proto->gather_types(ltype);
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
@@ -62,16 +63,49 @@ using Scope = std::vector<DexClass*>;
 class DexString {
   friend struct RedexContext;
 
-  std::string m_storage;
+  // Either points into m_storage, or, for strings loaded with zero-copy
+  // string storage enabled, straight at the MUTF-8 bytes of a mapped input
+  // dex. Those mappings live as long as the RedexContext.
+  const char* m_data;
+  uint32_t m_size;
   uint32_t m_utfsize;
+  // Lazily allocated for mapped strings the first time str() is called.
+  mutable std::atomic<const std::string*> m_storage;
+  // hash_bytes64() of the contents, which RedexContext interns strings by.
+  uint64_t m_hash;
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
-  DexString(std::string nstr, uint32_t utfsize) :
-    m_storage(std::move(nstr)), m_utfsize(utfsize) {
-  }
+  DexString(std::string nstr, uint32_t utfsize, uint64_t hash)
+      : m_size(static_cast<uint32_t>(nstr.size())),
+        m_utfsize(utfsize),
+        m_storage(new std::string(std::move(nstr))),
+        m_hash(hash) {
+    m_data = m_storage.load(std::memory_order_relaxed)->c_str();
+  }
+
+  // Does not copy `mapped`, which must be NUL-terminated and outlive this
+  // DexString.
+  DexString(const char* mapped,
+            uint32_t size,
+            uint32_t utfsize,
+            uint64_t hash)
+      : m_data(mapped),
+        m_size(size),
+        m_utfsize(utfsize),
+        m_storage(nullptr),
+        m_hash(hash) {}
+
+  const std::string& materialize() const;
 
  public:
-  uint32_t size() const { return static_cast<uint32_t>(m_storage.size()); }
+  ~DexString() { delete m_storage.load(std::memory_order_relaxed); }
+
+  uint32_t size() const { return m_size; }
+
+  // A hash of the contents, computed once when the string is created. Equal
+  // strings are the same DexString, so this is only needed to hash them in a
+  // way that doesn't depend on their addresses.
+  uint64_t hash() const { return m_hash; }
 
   // UTF-aware length
   uint32_t length() const;
@@ -110,8 +144,11 @@ class DexString {
     return size() == m_utfsize;
   }
 
-  const char* c_str() const { return m_storage.c_str(); }
-  const std::string& str() const { return m_storage; }
+  const char* c_str() const { return m_data; }
+  const std::string& str() const {
+    auto storage = m_storage.load(std::memory_order_acquire);
+    return storage != nullptr ? *storage : materialize();
+  }
 
   uint32_t get_entry_size() const {
     uint32_t len = uleb128_encoding_size(m_utfsize);
@@ -173,13 +210,18 @@ class DexType {
   friend struct RedexContext;
 
   DexString* m_name;
+  uint32_t m_dense_id;
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   DexType(DexString* dstring) {
     m_name = dstring;
+    m_dense_id = g_redex->make_type_id();
   }
 
  public:
+  // See RedexContext::make_type_id().
+  uint32_t get_dense_id() const { return m_dense_id; }
+
   // DexType retrieval/creation
 
   // If the DexType exists, return it, otherwise create it and return it.
@@ -255,6 +297,7 @@ class DexFieldRef {
   DexFieldSpec m_spec;
   bool m_concrete;
   bool m_external;
+  uint32_t m_dense_id;
 
   ~DexFieldRef() {}
   DexFieldRef(DexType* container, DexString* name, DexType* type) {
@@ -263,12 +306,15 @@ class DexFieldRef {
     m_spec.type = type;
     m_concrete = false;
     m_external = false;
+    m_dense_id = g_redex->make_field_id();
   }
 
  public:
    bool is_concrete() const { return m_concrete; }
    bool is_external() const { return m_external; }
    bool is_def() const { return is_concrete() || is_external(); }
+   // See RedexContext::make_field_id().
+   uint32_t get_dense_id() const { return m_dense_id; }
 
    DexType* get_class() const { return m_spec.cls; }
    DexString* get_name() const { return m_spec.name; }
@@ -425,6 +471,29 @@ struct dexfields_comparator {
   }
 };
 
+/*
+ * A contiguous run of types, which doesn't own them. Type lists can be looked
+ * up by span, so that callers that build their lists in a buffer, like the dex
+ * loader, don't have to copy them into a deque unless the list is new.
+ */
+class DexTypeSpan {
+ public:
+  DexTypeSpan(DexType* const* data, size_t size) : m_data(data), m_size(size) {}
+
+  template <typename Container,
+            typename = decltype(std::declval<const Container&>().data())>
+  DexTypeSpan(const Container& types)
+      : m_data(types.data()), m_size(types.size()) {}
+
+  DexType* const* begin() const { return m_data; }
+  DexType* const* end() const { return m_data + m_size; }
+  size_t size() const { return m_size; }
+
+ private:
+  DexType* const* m_data;
+  size_t m_size;
+};
+
 class DexTypeList {
   friend struct RedexContext;
 
@@ -449,6 +518,15 @@ class DexTypeList {
     return g_redex->get_type_list(std::move(p));
   }
 
+  // As above, but only copies the types if the list doesn't exist yet.
+  static DexTypeList* make_type_list(DexTypeSpan types) {
+    return g_redex->make_type_list(types);
+  }
+
+  static DexTypeList* get_type_list(DexTypeSpan types) {
+    return g_redex->get_type_list(types);
+  }
+
  public:
   const std::deque<DexType*>& get_type_list() const { return m_list; }
 
@@ -603,7 +681,17 @@ struct DexDebugEntry final {
 class DexDebugItem {
   std::vector<DexString*> m_param_names;
   std::vector<DexDebugEntry> m_dbg_entries;
+  // With RedexContext::lazy_debug_info(), the debug program is only decoded
+  // from the (retained) input dex the first time it is needed.
+  DexIdx* m_idx{nullptr};
+  uint32_t m_offset{0};
+  std::atomic<bool> m_pending{false};
+  // The binding requested before the debug program was decoded.
+  DexString* m_bind_method{nullptr};
+  DexString* m_bind_file{nullptr};
   DexDebugItem(DexIdx* idx, uint32_t offset);
+  void decode(DexIdx* idx, uint32_t offset);
+  void ensure_decoded() const;
 
  public:
   DexDebugItem() = default;
@@ -612,14 +700,27 @@ class DexDebugItem {
                                                      uint32_t offset);
 
  public:
-  std::vector<DexDebugEntry>& get_entries() { return m_dbg_entries; }
+  std::vector<DexDebugEntry>& get_entries() {
+    ensure_decoded();
+    return m_dbg_entries;
+  }
   void set_entries(std::vector<DexDebugEntry> dbg_entries) {
+    ensure_decoded();
     m_dbg_entries.swap(dbg_entries);
   }
   uint32_t get_line_start() const;
-  std::vector<DexString*>& get_param_names() { return m_param_names; }
-  void remove_parameter_names() { m_param_names.clear(); };
+  std::vector<DexString*>& get_param_names() {
+    ensure_decoded();
+    return m_param_names;
+  }
+  void remove_parameter_names() {
+    ensure_decoded();
+    m_param_names.clear();
+  };
   void bind_positions(DexMethod* method, DexString* file);
+  bool is_decoded() const {
+    return !m_pending.load(std::memory_order_acquire);
+  }
 
   /* Returns number of bytes encoded, *output has no alignment requirements */
   static int encode(
@@ -633,6 +734,7 @@ class DexDebugItem {
              uint8_t* output,
              uint32_t line_start,
              const std::vector<std::unique_ptr<DexDebugInstruction>>& dbgops) {
+    ensure_decoded();
     return DexDebugItem::encode(dodx, output, line_start, m_param_names,
                                 dbgops);
   }
@@ -734,6 +836,11 @@ class DexCode {
   void set_ins_size(uint16_t sz) { m_ins_size = sz; }
   void set_outs_size(uint16_t sz) { m_outs_size = sz; }
 
+  void gather_types(std::vector<DexType*>& ltype) const;
+  void gather_strings(std::vector<DexString*>& lstring) const;
+  void gather_fields(std::vector<DexFieldRef*>& lfield) const;
+  void gather_methods(std::vector<DexMethodRef*>& lmethod) const;
+
   /*
    * Returns number of bytes in encoded output, passed in
    * pointer must be aligned.  Does not encode debugitem,
@@ -773,18 +880,22 @@ class DexMethodRef {
   DexMethodSpec m_spec;
   bool m_concrete;
   bool m_external;
+  uint32_t m_dense_id;
 
   ~DexMethodRef() {}
   DexMethodRef(DexType* type, DexString* name, DexProto* proto) :
        m_spec(type, name, proto) {
     m_concrete = false;
     m_external = false;
+    m_dense_id = g_redex->make_method_id();
   }
 
  public:
    bool is_concrete() const { return m_concrete; }
    bool is_external() const { return m_external; }
    bool is_def() const { return is_concrete() || is_external(); }
+   // See RedexContext::make_method_id().
+   uint32_t get_dense_id() const { return m_dense_id; }
 
    DexType* get_class() const { return m_spec.cls; }
    DexString* get_name() const { return m_spec.name; }
@@ -814,6 +925,13 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* m_anno;
   std::unique_ptr<DexCode> m_dex_code;
   std::unique_ptr<IRCode> m_code;
+  // Set while m_dex_code is waiting to be ballooned by the first get_code().
+  std::atomic<bool> m_balloon_deferred{false};
+  // Set while m_code is compact, waiting to be expanded by get_code().
+  std::atomic<bool> m_code_compact{false};
+  // The code epoch of the last get_code() or set_code(); see
+  // RedexContext::code_epoch().
+  std::atomic<uint16_t> m_code_epoch{0};
   DexAccessFlags m_access;
   bool m_virtual;
   ParamAnnotations m_param_anno;
@@ -929,8 +1047,21 @@ class DexMethod : public DexMethodRef {
   DexAnnotationSet* get_anno_set() { return m_anno; }
   const DexCode* get_dex_code() const { return m_dex_code.get(); }
   DexCode* get_dex_code() { return m_dex_code.get(); }
-  IRCode* get_code() { return m_code.get(); }
-  const IRCode* get_code() const { return m_code.get(); }
+  IRCode* get_code() {
+    if (m_balloon_deferred.load(std::memory_order_acquire)) {
+      balloon_deferred();
+    } else if (m_code_compact.load(std::memory_order_acquire)) {
+      expand_code();
+    }
+    auto epoch = RedexContext::code_epoch();
+    if (epoch != 0 && m_code_epoch.load(std::memory_order_relaxed) != epoch) {
+      m_code_epoch.store(epoch, std::memory_order_relaxed);
+    }
+    return m_code.get();
+  }
+  const IRCode* get_code() const {
+    return const_cast<DexMethod*>(this)->get_code();
+  }
   std::unique_ptr<IRCode> release_code();
   bool is_virtual() const { return m_virtual; }
   DexAccessFlags get_access() const {
@@ -1016,6 +1147,16 @@ class DexMethod : public DexMethodRef {
   void gather_strings(std::vector<DexString*>& lstring,
                       bool exclude_loads = false) const;
 
+  /*
+   * The gather_*() functions above without the annotations, i.e. what the
+   * code refers to. Like them, these neither expand compact code nor count as
+   * asking for the code.
+   */
+  void gather_code_types(std::vector<DexType*>& ltype) const;
+  void gather_code_fields(std::vector<DexFieldRef*>& lfield) const;
+  void gather_code_methods(std::vector<DexMethodRef*>& lmethod) const;
+  void gather_code_strings(std::vector<DexString*>& lstring) const;
+
   /*
    * DexCode <-> IRCode conversion methods.
    *
@@ -1027,6 +1168,35 @@ class DexMethod : public DexMethodRef {
    */
   void balloon();
   void sync();
+
+  /*
+   * Lazy ballooning: defer_balloon() keeps the DexCode as loaded, and the first
+   * call to get_code() (from any thread) balloons it. If nothing ever asks for
+   * the IRCode, sync() leaves the original DexCode in place to be written out
+   * as is.
+   */
+  void defer_balloon();
+  bool is_balloon_deferred() const {
+    return m_balloon_deferred.load(std::memory_order_acquire);
+  }
+
+  /*
+   * Makes the IRCode compact (see IRCode::compact()) until the next call to
+   * get_code(). Returns false if the method has no code that can be made
+   * compact. Must not be called while other threads may use the code.
+   */
+  bool compact_code();
+  bool is_code_compact() const {
+    return m_code_compact.load(std::memory_order_acquire);
+  }
+  // The code epoch in which get_code() or set_code() was last called.
+  uint16_t get_code_epoch() const {
+    return m_code_epoch.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void balloon_deferred();
+  void expand_code();
 };
 
 using dexcode_to_offset = std::unordered_map<DexCode*, uint32_t>;
@@ -1041,6 +1211,7 @@ class DexClass {
   DexAnnotationSet* m_anno;
   bool m_external;
   bool m_perf_sensitive;
+  uint32_t m_dense_id;
   std::string m_deobfuscated_name;
   const std::string m_location; // TODO: string interning
   std::vector<DexField*> m_sfields;
@@ -1048,7 +1219,8 @@ class DexClass {
   std::vector<DexMethod*> m_dmethods;
   std::vector<DexMethod*> m_vmethods;
 
-  DexClass(const std::string& location) : m_location(location){};
+  DexClass(const std::string& location)
+      : m_dense_id(g_redex->make_class_id()), m_location(location){};
   void load_class_annotations(DexIdx* idx, uint32_t anno_off);
   void load_class_data_item(DexIdx* idx,
                             uint32_t cdi_off,
@@ -1061,6 +1233,9 @@ class DexClass {
   DexClass(DexIdx* idx, const dex_class_def* cdef, const std::string& location);
 
  public:
+  // See RedexContext::make_class_id().
+  uint32_t get_dense_id() const { return m_dense_id; }
+
   const std::vector<DexMethod*>& get_dmethods() const { return m_dmethods; }
   std::vector<DexMethod*>& get_dmethods() {
     always_assert_log(!m_external,
@@ -1156,12 +1331,14 @@ class DexClass {
     always_assert_log(
         !m_external, "Unexpected external class %s\n", SHOW(m_self));
     m_super_class = super_class;
+    g_redex->invalidate_resolutions();
   }
 
   void set_interfaces(DexTypeList* intfs) {
     always_assert_log(!m_external,
         "Unexpected external class %s\n", SHOW(m_self));
     m_interfaces = intfs;
+    g_redex->invalidate_resolutions();
   }
 
   void clear_annotations() {
@@ -1256,31 +1433,32 @@ inline unsigned int get_method_weight_override(
   return 0;
 }
 
-/* Order based on method profile data */
+inline unsigned int get_method_weight(
+    const DexMethodRef* mref,
+    const std::unordered_map<const DexMethodRef*, unsigned int>*
+        method_weights) {
+  auto it = method_weights->find(mref);
+  return it == method_weights->end() ? 0 : it->second;
+}
+
+/*
+ * Order based on method profile data. The weights are looked up by method,
+ * so they should be resolved from the profile -- and the whitelisted
+ * substrings -- before sorting rather than per comparison.
+ */
 inline bool compare_dexmethods_profiled(
-    DexMethodRef* a,
-    DexMethodRef* b,
-    std::unordered_map<std::string, unsigned int>* method_to_weight,
-    std::unordered_set<std::string>* whitelisted_substrings) {
+    const DexMethodRef* a,
+    const DexMethodRef* b,
+    const std::unordered_map<const DexMethodRef*, unsigned int>*
+        method_weights) {
   if (a == nullptr) {
     return b != nullptr;
   } else if (b == nullptr) {
     return false;
   }
 
-  unsigned int weight_a = get_method_weight_if_available(a, method_to_weight);
-  unsigned int weight_b = get_method_weight_if_available(b, method_to_weight);
-
-  // For methods not included in the profiled methods file, move them to the top
-  // section anyway if they match one of the whitelisted substrings.
-  if (weight_a == 0) {
-    weight_a = get_method_weight_override(a, whitelisted_substrings);
-  }
-
-  if (weight_b == 0) {
-    weight_b = get_method_weight_override(b, whitelisted_substrings);
-  }
-
+  unsigned int weight_a = get_method_weight(a, method_weights);
+  unsigned int weight_b = get_method_weight(b, method_weights);
   if (weight_a == weight_b) {
     return compare_dexmethods(a, b);
   }
@@ -1289,18 +1467,15 @@ inline bool compare_dexmethods_profiled(
 }
 
 struct dexmethods_profiled_comparator {
-  std::unordered_map<std::string, unsigned int>* method_to_weight;
-  std::unordered_set<std::string>* whitelisted_substrings;
-
-  dexmethods_profiled_comparator(
-      std::unordered_map<std::string, unsigned int>* method_to_weight_val,
-      std::unordered_set<std::string>* whitelisted_substrings_val)
-      : method_to_weight(method_to_weight_val),
-        whitelisted_substrings(whitelisted_substrings_val) {}
-
-  bool operator()(DexMethodRef* a, DexMethodRef* b) const {
-    return compare_dexmethods_profiled(a, b, method_to_weight,
-                                       whitelisted_substrings);
+  const std::unordered_map<const DexMethodRef*, unsigned int>* method_weights;
+
+  explicit dexmethods_profiled_comparator(
+      const std::unordered_map<const DexMethodRef*, unsigned int>*
+          method_weights_val)
+      : method_weights(method_weights_val) {}
+
+  bool operator()(const DexMethodRef* a, const DexMethodRef* b) const {
+    return compare_dexmethods_profiled(a, b, method_weights);
   }
 };
 
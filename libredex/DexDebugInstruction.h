@@ -11,6 +11,7 @@
 
 #include "DexDefs.h"
 #include "Gatherable.h"
+#include "MemoryAccounting.h"
 #include "Util.h"
 
 class DexIdx;
@@ -18,7 +19,10 @@ class DexOutputIdx;
 class DexString;
 class DexType;
 
-class DexDebugInstruction : public Gatherable {
+class DexDebugInstruction
+    : public Gatherable,
+      private memory_accounting::Counted<
+          memory_accounting::Entity::DexDebugInstruction> {
  private:
   union {
     uint32_t m_uvalue;
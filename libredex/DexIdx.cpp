@@ -7,7 +7,9 @@
 
 #include "DexIdx.h"
 
+#include <array>
 #include <sstream>
+#include <vector>
 
 #include "DexClass.h"
 
@@ -45,6 +47,9 @@ DexString* DexIdx::get_stringidx_fromdex(uint32_t stridx) {
   const uint8_t* dstr = m_dexbase + stroff;
   /* Strip off uleb128 size encoding */
   int utfsize = read_uleb128(&dstr);
+  if (RedexContext::zero_copy_strings()) {
+    return g_redex->make_mapped_string((const char*)dstr, utfsize);
+  }
   return DexString::make_string((const char*)dstr, utfsize);
 }
 
@@ -81,14 +86,22 @@ DexProto* DexIdx::get_protoidx_fromdex(uint32_t pidx) {
 
 DexTypeList* DexIdx::get_type_list(uint32_t offset) {
   if (offset == 0) {
-    return DexTypeList::make_type_list({});
+    return DexTypeList::make_type_list(DexTypeSpan(nullptr, 0));
   }
   const uint32_t* tlp = get_uint_data(offset);
   uint32_t size = *tlp++;
   const uint16_t* typep = (const uint16_t*)tlp;
-  std::deque<DexType*> tlist;
+  // Most lists are short enough to be looked up from the stack, and only get
+  // copied to the heap when they are new.
+  std::array<DexType*, 16> inline_types;
+  std::vector<DexType*> heap_types;
+  DexType** types = inline_types.data();
+  if (size > inline_types.size()) {
+    heap_types.resize(size);
+    types = heap_types.data();
+  }
   for (uint32_t i = 0; i < size; i++) {
-    tlist.push_back(get_typeidx(typep[i]));
+    types[i] = get_typeidx(typep[i]);
   }
-  return DexTypeList::make_type_list(std::move(tlist));
+  return DexTypeList::make_type_list(DexTypeSpan(types, size));
 }
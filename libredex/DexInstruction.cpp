@@ -7,6 +7,8 @@
 
 #include "DexInstruction.h"
 
+#include <array>
+
 #include "Debug.h"
 #include "DexIdx.h"
 #include "DexOutput.h"
@@ -738,13 +740,125 @@ void DexInstruction::encode(DexOutputIdx* dodx, uint16_t*& insns) {
 
 uint16_t DexInstruction::size() const { return m_count + 1; }
 
+namespace {
+
+/*
+ * How make_instruction decodes the code units that follow the opcode unit of
+ * an instruction.
+ */
+enum class Operands : uint8_t {
+  UNKNOWN,
+  // A nop, or the header of a switch or array payload.
+  NOP_OR_PAYLOAD,
+  // Registers, literals and offsets, which are kept as they are.
+  PLAIN,
+  STRING,
+  STRING_JUMBO,
+  TYPE,
+  FIELD,
+  METHOD,
+};
+
+struct DecodeEntry {
+  Operands operands{Operands::UNKNOWN};
+  // The number of code units after the opcode unit.
+  uint8_t units{0};
+};
+
+uint8_t operand_units(OpcodeFormat fmt) {
+  switch (fmt) {
+  case FMT_f10x:
+  case FMT_f12x:
+  case FMT_f12x_2:
+  case FMT_f11n:
+  case FMT_f11x_d:
+  case FMT_f11x_s:
+  case FMT_f10t:
+    return 0;
+  case FMT_f20t:
+  case FMT_f22x:
+  case FMT_f21t:
+  case FMT_f21s:
+  case FMT_f21h:
+  case FMT_f21c_d:
+  case FMT_f21c_s:
+  case FMT_f23x_d:
+  case FMT_f23x_s:
+  case FMT_f22b:
+  case FMT_f22t:
+  case FMT_f22s:
+  case FMT_f22c_d:
+  case FMT_f22c_s:
+    return 1;
+  case FMT_f30t:
+  case FMT_f32x:
+  case FMT_f31i:
+  case FMT_f31t:
+  case FMT_f31c:
+  case FMT_f35c:
+  case FMT_f3rc:
+    return 2;
+  case FMT_f51l:
+    return 4;
+  default:
+    always_assert_log(false, "Unexpected format %d", fmt);
+    not_reached();
+  }
+}
+
+DecodeEntry decode_entry(DexOpcode op, OpcodeFormat fmt) {
+  DecodeEntry entry;
+  entry.units = operand_units(fmt);
+  if (op == DOPCODE_NOP) {
+    entry.operands = Operands::NOP_OR_PAYLOAD;
+    return entry;
+  }
+  switch (opcode::ref(opcode::from_dex_opcode(op))) {
+  case opcode::Ref::String:
+    entry.operands =
+        entry.units == 2 ? Operands::STRING_JUMBO : Operands::STRING;
+    break;
+  case opcode::Ref::Type:
+    entry.operands = Operands::TYPE;
+    break;
+  case opcode::Ref::Field:
+    entry.operands = Operands::FIELD;
+    break;
+  case opcode::Ref::Method:
+    entry.operands = Operands::METHOD;
+    break;
+  default:
+    entry.operands = Operands::PLAIN;
+    break;
+  }
+  return entry;
+}
+
+/*
+ * Indexed by the low byte of the opcode unit. The quickened opcodes are
+ * left UNKNOWN, like the unused ones.
+ */
+std::array<DecodeEntry, 256> make_decode_table() {
+  std::array<DecodeEntry, 256> table;
+#define OP(op, code, fmt, ...) \
+  table[code] = decode_entry(DOPCODE_##op, FMT_##fmt);
+  DOPS
+#undef OP
+  return table;
+}
+
+} // namespace
+
 DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
                                                  const uint16_t** insns_ptr) {
+  static const std::array<DecodeEntry, 256> decode_table = make_decode_table();
   auto& insns = *insns_ptr;
+  const uint16_t* start = insns;
   auto fopcode = static_cast<DexOpcode>(*insns++);
   DexOpcode opcode = static_cast<DexOpcode>(fopcode & 0xff);
-  switch (opcode) {
-  case DOPCODE_NOP: {
+  const auto& entry = decode_table[opcode];
+  switch (entry.operands) {
+  case Operands::NOP_OR_PAYLOAD: {
     if (fopcode == FOPCODE_PACKED_SWITCH) {
       int count = (*insns--) * 2 + 4;
       insns += count;
@@ -760,273 +874,49 @@ DexInstruction* DexInstruction::make_instruction(DexIdx* idx,
       insns += count - 2;
       return new DexOpcodeData(insns - count, count - 1);
     }
-  }
-  /* Format 10, fall through for NOP */
-  case DOPCODE_MOVE:
-  case DOPCODE_MOVE_WIDE:
-  case DOPCODE_MOVE_OBJECT:
-  case DOPCODE_MOVE_RESULT:
-  case DOPCODE_MOVE_RESULT_WIDE:
-  case DOPCODE_MOVE_RESULT_OBJECT:
-  case DOPCODE_MOVE_EXCEPTION:
-  case DOPCODE_RETURN_VOID:
-  case DOPCODE_RETURN:
-  case DOPCODE_RETURN_WIDE:
-  case DOPCODE_RETURN_OBJECT:
-  case DOPCODE_CONST_4:
-  case DOPCODE_MONITOR_ENTER:
-  case DOPCODE_MONITOR_EXIT:
-  case DOPCODE_THROW:
-  case DOPCODE_GOTO:
-  case DOPCODE_NEG_INT:
-  case DOPCODE_NOT_INT:
-  case DOPCODE_NEG_LONG:
-  case DOPCODE_NOT_LONG:
-  case DOPCODE_NEG_FLOAT:
-  case DOPCODE_NEG_DOUBLE:
-  case DOPCODE_INT_TO_LONG:
-  case DOPCODE_INT_TO_FLOAT:
-  case DOPCODE_INT_TO_DOUBLE:
-  case DOPCODE_LONG_TO_INT:
-  case DOPCODE_LONG_TO_FLOAT:
-  case DOPCODE_LONG_TO_DOUBLE:
-  case DOPCODE_FLOAT_TO_INT:
-  case DOPCODE_FLOAT_TO_LONG:
-  case DOPCODE_FLOAT_TO_DOUBLE:
-  case DOPCODE_DOUBLE_TO_INT:
-  case DOPCODE_DOUBLE_TO_LONG:
-  case DOPCODE_DOUBLE_TO_FLOAT:
-  case DOPCODE_INT_TO_BYTE:
-  case DOPCODE_INT_TO_CHAR:
-  case DOPCODE_INT_TO_SHORT:
-  case DOPCODE_ADD_INT_2ADDR:
-  case DOPCODE_SUB_INT_2ADDR:
-  case DOPCODE_MUL_INT_2ADDR:
-  case DOPCODE_DIV_INT_2ADDR:
-  case DOPCODE_REM_INT_2ADDR:
-  case DOPCODE_AND_INT_2ADDR:
-  case DOPCODE_OR_INT_2ADDR:
-  case DOPCODE_XOR_INT_2ADDR:
-  case DOPCODE_SHL_INT_2ADDR:
-  case DOPCODE_SHR_INT_2ADDR:
-  case DOPCODE_USHR_INT_2ADDR:
-  case DOPCODE_ADD_LONG_2ADDR:
-  case DOPCODE_SUB_LONG_2ADDR:
-  case DOPCODE_MUL_LONG_2ADDR:
-  case DOPCODE_DIV_LONG_2ADDR:
-  case DOPCODE_REM_LONG_2ADDR:
-  case DOPCODE_AND_LONG_2ADDR:
-  case DOPCODE_OR_LONG_2ADDR:
-  case DOPCODE_XOR_LONG_2ADDR:
-  case DOPCODE_SHL_LONG_2ADDR:
-  case DOPCODE_SHR_LONG_2ADDR:
-  case DOPCODE_USHR_LONG_2ADDR:
-  case DOPCODE_ADD_FLOAT_2ADDR:
-  case DOPCODE_SUB_FLOAT_2ADDR:
-  case DOPCODE_MUL_FLOAT_2ADDR:
-  case DOPCODE_DIV_FLOAT_2ADDR:
-  case DOPCODE_REM_FLOAT_2ADDR:
-  case DOPCODE_ADD_DOUBLE_2ADDR:
-  case DOPCODE_SUB_DOUBLE_2ADDR:
-  case DOPCODE_MUL_DOUBLE_2ADDR:
-  case DOPCODE_DIV_DOUBLE_2ADDR:
-  case DOPCODE_REM_DOUBLE_2ADDR:
-  case DOPCODE_ARRAY_LENGTH:
     return new DexInstruction(fopcode);
-  /* Format 20 */
-  case DOPCODE_MOVE_FROM16:
-  case DOPCODE_MOVE_WIDE_FROM16:
-  case DOPCODE_MOVE_OBJECT_FROM16:
-  case DOPCODE_CONST_16:
-  case DOPCODE_CONST_HIGH16:
-  case DOPCODE_CONST_WIDE_16:
-  case DOPCODE_CONST_WIDE_HIGH16:
-  case DOPCODE_GOTO_16:
-  case DOPCODE_CMPL_FLOAT:
-  case DOPCODE_CMPG_FLOAT:
-  case DOPCODE_CMPL_DOUBLE:
-  case DOPCODE_CMPG_DOUBLE:
-  case DOPCODE_CMP_LONG:
-  case DOPCODE_IF_EQ:
-  case DOPCODE_IF_NE:
-  case DOPCODE_IF_LT:
-  case DOPCODE_IF_GE:
-  case DOPCODE_IF_GT:
-  case DOPCODE_IF_LE:
-  case DOPCODE_IF_EQZ:
-  case DOPCODE_IF_NEZ:
-  case DOPCODE_IF_LTZ:
-  case DOPCODE_IF_GEZ:
-  case DOPCODE_IF_GTZ:
-  case DOPCODE_IF_LEZ:
-  case DOPCODE_AGET:
-  case DOPCODE_AGET_WIDE:
-  case DOPCODE_AGET_OBJECT:
-  case DOPCODE_AGET_BOOLEAN:
-  case DOPCODE_AGET_BYTE:
-  case DOPCODE_AGET_CHAR:
-  case DOPCODE_AGET_SHORT:
-  case DOPCODE_APUT:
-  case DOPCODE_APUT_WIDE:
-  case DOPCODE_APUT_OBJECT:
-  case DOPCODE_APUT_BOOLEAN:
-  case DOPCODE_APUT_BYTE:
-  case DOPCODE_APUT_CHAR:
-  case DOPCODE_APUT_SHORT:
-  case DOPCODE_ADD_INT:
-  case DOPCODE_SUB_INT:
-  case DOPCODE_MUL_INT:
-  case DOPCODE_DIV_INT:
-  case DOPCODE_REM_INT:
-  case DOPCODE_AND_INT:
-  case DOPCODE_OR_INT:
-  case DOPCODE_XOR_INT:
-  case DOPCODE_SHL_INT:
-  case DOPCODE_SHR_INT:
-  case DOPCODE_USHR_INT:
-  case DOPCODE_ADD_LONG:
-  case DOPCODE_SUB_LONG:
-  case DOPCODE_MUL_LONG:
-  case DOPCODE_DIV_LONG:
-  case DOPCODE_REM_LONG:
-  case DOPCODE_AND_LONG:
-  case DOPCODE_OR_LONG:
-  case DOPCODE_XOR_LONG:
-  case DOPCODE_SHL_LONG:
-  case DOPCODE_SHR_LONG:
-  case DOPCODE_USHR_LONG:
-  case DOPCODE_ADD_FLOAT:
-  case DOPCODE_SUB_FLOAT:
-  case DOPCODE_MUL_FLOAT:
-  case DOPCODE_DIV_FLOAT:
-  case DOPCODE_REM_FLOAT:
-  case DOPCODE_ADD_DOUBLE:
-  case DOPCODE_SUB_DOUBLE:
-  case DOPCODE_MUL_DOUBLE:
-  case DOPCODE_DIV_DOUBLE:
-  case DOPCODE_REM_DOUBLE:
-  case DOPCODE_ADD_INT_LIT16:
-  case DOPCODE_RSUB_INT:
-  case DOPCODE_MUL_INT_LIT16:
-  case DOPCODE_DIV_INT_LIT16:
-  case DOPCODE_REM_INT_LIT16:
-  case DOPCODE_AND_INT_LIT16:
-  case DOPCODE_OR_INT_LIT16:
-  case DOPCODE_XOR_INT_LIT16:
-  case DOPCODE_ADD_INT_LIT8:
-  case DOPCODE_RSUB_INT_LIT8:
-  case DOPCODE_MUL_INT_LIT8:
-  case DOPCODE_DIV_INT_LIT8:
-  case DOPCODE_REM_INT_LIT8:
-  case DOPCODE_AND_INT_LIT8:
-  case DOPCODE_OR_INT_LIT8:
-  case DOPCODE_XOR_INT_LIT8:
-  case DOPCODE_SHL_INT_LIT8:
-  case DOPCODE_SHR_INT_LIT8:
-  case DOPCODE_USHR_INT_LIT8: {
-    uint16_t arg = *insns++;
-    return new DexInstruction(fopcode, arg);
-  }
-
-  /* Format 30 */
-  case DOPCODE_MOVE_16:
-  case DOPCODE_MOVE_WIDE_16:
-  case DOPCODE_MOVE_OBJECT_16:
-  case DOPCODE_CONST:
-  case DOPCODE_CONST_WIDE_32:
-  case DOPCODE_FILL_ARRAY_DATA:
-  case DOPCODE_GOTO_32:
-  case DOPCODE_PACKED_SWITCH:
-  case DOPCODE_SPARSE_SWITCH: {
-    insns += 2;
-    return new DexInstruction(insns - 3, 2);
-  }
-  /* Format 50 */
-  case DOPCODE_CONST_WIDE: {
-    insns += 4;
-    return new DexInstruction(insns - 5, 4);
-  }
-  /* Field ref: */
-  case DOPCODE_IGET:
-  case DOPCODE_IGET_WIDE:
-  case DOPCODE_IGET_OBJECT:
-  case DOPCODE_IGET_BOOLEAN:
-  case DOPCODE_IGET_BYTE:
-  case DOPCODE_IGET_CHAR:
-  case DOPCODE_IGET_SHORT:
-  case DOPCODE_IPUT:
-  case DOPCODE_IPUT_WIDE:
-  case DOPCODE_IPUT_OBJECT:
-  case DOPCODE_IPUT_BOOLEAN:
-  case DOPCODE_IPUT_BYTE:
-  case DOPCODE_IPUT_CHAR:
-  case DOPCODE_IPUT_SHORT:
-  case DOPCODE_SGET:
-  case DOPCODE_SGET_WIDE:
-  case DOPCODE_SGET_OBJECT:
-  case DOPCODE_SGET_BOOLEAN:
-  case DOPCODE_SGET_BYTE:
-  case DOPCODE_SGET_CHAR:
-  case DOPCODE_SGET_SHORT:
-  case DOPCODE_SPUT:
-  case DOPCODE_SPUT_WIDE:
-  case DOPCODE_SPUT_OBJECT:
-  case DOPCODE_SPUT_BOOLEAN:
-  case DOPCODE_SPUT_BYTE:
-  case DOPCODE_SPUT_CHAR:
-  case DOPCODE_SPUT_SHORT: {
-    uint16_t fidx = *insns++;
-    DexFieldRef* field = idx->get_fieldidx(fidx);
-    return new DexOpcodeField(fopcode, field);
   }
-  /* MethodRef: */
-  case DOPCODE_INVOKE_VIRTUAL:
-  case DOPCODE_INVOKE_SUPER:
-  case DOPCODE_INVOKE_DIRECT:
-  case DOPCODE_INVOKE_STATIC:
-  case DOPCODE_INVOKE_INTERFACE:
-  case DOPCODE_INVOKE_VIRTUAL_RANGE:
-  case DOPCODE_INVOKE_SUPER_RANGE:
-  case DOPCODE_INVOKE_DIRECT_RANGE:
-  case DOPCODE_INVOKE_STATIC_RANGE:
-  case DOPCODE_INVOKE_INTERFACE_RANGE: {
-    uint16_t midx = *insns++;
-    uint16_t arg = *insns++;
-    DexMethodRef* meth = idx->get_methodidx(midx);
-    return new DexOpcodeMethod(fopcode, meth, arg);
+  case Operands::PLAIN: {
+    insns += entry.units;
+    return new DexInstruction(start, entry.units);
   }
-  /* StringRef: */
-  case DOPCODE_CONST_STRING: {
+  case Operands::STRING: {
     uint16_t sidx = *insns++;
     DexString* str = idx->get_stringidx(sidx);
     return new DexOpcodeString(fopcode, str);
   }
-  case DOPCODE_CONST_STRING_JUMBO: {
+  case Operands::STRING_JUMBO: {
     uint32_t sidx = *insns++;
     sidx |= (*insns++) << 16;
     DexString* str = idx->get_stringidx(sidx);
     return new DexOpcodeString(fopcode, str);
   }
-  case DOPCODE_CONST_CLASS:
-  case DOPCODE_CHECK_CAST:
-  case DOPCODE_INSTANCE_OF:
-  case DOPCODE_NEW_INSTANCE:
-  case DOPCODE_NEW_ARRAY: {
+  case Operands::TYPE: {
     uint16_t tidx = *insns++;
     DexType* type = idx->get_typeidx(tidx);
+    if (entry.units == 2) {
+      // filled-new-array and its range form also have an argument unit.
+      uint16_t arg = *insns++;
+      return new DexOpcodeType(fopcode, type, arg);
+    }
     return new DexOpcodeType(fopcode, type);
   }
-  case DOPCODE_FILLED_NEW_ARRAY:
-  case DOPCODE_FILLED_NEW_ARRAY_RANGE: {
-    uint16_t tidx = *insns++;
+  case Operands::FIELD: {
+    uint16_t fidx = *insns++;
+    DexFieldRef* field = idx->get_fieldidx(fidx);
+    return new DexOpcodeField(fopcode, field);
+  }
+  case Operands::METHOD: {
+    uint16_t midx = *insns++;
     uint16_t arg = *insns++;
-    DexType* type = idx->get_typeidx(tidx);
-    return new DexOpcodeType(fopcode, type, arg);
+    DexMethodRef* meth = idx->get_methodidx(midx);
+    return new DexOpcodeMethod(fopcode, meth, arg);
   }
-  default:
-    fprintf(stderr, "Unknown opcode %02x\n", opcode);
-    return nullptr;
+  case Operands::UNKNOWN:
+    break;
   }
+  fprintf(stderr, "Unknown opcode %02x\n", opcode);
+  return nullptr;
 }
 
 DexInstruction* DexInstruction::make_instruction(DexOpcode op) {
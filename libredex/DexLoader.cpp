@@ -24,19 +24,61 @@ class DexLoader {
   const dex_class_def* m_class_defs;
   DexClasses* m_classes;
   boost::iostreams::mapped_file m_file;
+  // The dex, either in m_file or in a buffer that m_owner keeps valid.
+  const char* m_data{nullptr};
+  size_t m_size{0};
+  std::shared_ptr<const void> m_owner;
   std::string m_dex_location;
+  // Strings loaded from the file may point into it; see
+  // RedexContext::zero_copy_strings().
+  bool m_retain_file{false};
+  // Debug items may still decode from the file through m_idx; see
+  // RedexContext::lazy_debug_info().
+  bool m_retain_idx{false};
 
  public:
   explicit DexLoader(const char* location)
-      : m_idx(nullptr), m_dex_location(location) {}
+      : m_idx(nullptr), m_classes(nullptr), m_dex_location(location) {}
+  explicit DexLoader(const DexBuffer& buffer)
+      : m_idx(nullptr),
+        m_classes(nullptr),
+        m_data(reinterpret_cast<const char*>(buffer.data)),
+        m_size(buffer.size),
+        m_owner(buffer.owner),
+        m_dex_location(buffer.location) {}
   ~DexLoader() {
-    if (m_idx) delete m_idx;
-    if (m_file.is_open()) m_file.close();
+    if (m_idx) {
+      if (m_retain_idx) {
+        g_redex->retain_mapped_file(std::shared_ptr<DexIdx>(m_idx));
+      } else {
+        delete m_idx;
+      }
+    }
+    if (m_owner && m_retain_file) {
+      g_redex->retain_mapped_file(m_owner);
+    }
+    if (m_file.is_open()) {
+      if (m_retain_file) {
+        // Copies of a mapped_file share the underlying mapping.
+        g_redex->retain_mapped_file(
+            std::make_shared<boost::iostreams::mapped_file>(m_file));
+      } else {
+        m_file.close();
+      }
+    }
   }
   const dex_header* get_dex_header(const char* location);
   DexClasses load_dex(const char* location,
                       dex_stats_t* stats,
                       bool support_dex_v37);
+  /*
+   * Maps the dex and sizes `classes` to hold its class_defs, without loading
+   * any of them. Returns nullptr if the dex has no classes.
+   */
+  const dex_header* open_dex(const char* location,
+                             bool support_dex_v37,
+                             DexClasses* classes);
+  size_t num_classes() const { return m_classes ? m_classes->size() : 0; }
   void load_dex_class(int num);
   void gather_input_stats(dex_stats_t* stats, const dex_header* dh);
 };
@@ -179,7 +221,7 @@ void DexLoader::gather_input_stats(dex_stats_t* stats, const dex_header* dh) {
   stats->num_type_lists += type_lists.size();
 
   const dex_map_list* map_list =
-      reinterpret_cast<const dex_map_list*>(m_file.const_data() + dh->map_off);
+      reinterpret_cast<const dex_map_list*>(m_data + dh->map_off);
   for (uint32_t i = 0; i < map_list->size; i++) {
     const auto& item = map_list->items[i];
     if (item.type != TYPE_DEBUG_INFO_ITEM) {
@@ -266,57 +308,94 @@ const dex_header* DexLoader::get_dex_header(const char* location) {
     fprintf(stderr, "error: cannot create memory-mapped file: %s\n", location);
     exit(EXIT_FAILURE);
   }
-  return reinterpret_cast<const dex_header*>(m_file.const_data());
+  m_data = m_file.const_data();
+  m_size = m_file.size();
+  return reinterpret_cast<const dex_header*>(m_data);
 }
 
-DexClasses DexLoader::load_dex(const char* location,
-                               dex_stats_t* stats,
-                               bool support_dex_v37) {
-  auto dh = get_dex_header(location);
-  validate_dex_header(dh, m_file.size(), support_dex_v37);
+const dex_header* DexLoader::open_dex(const char* location,
+                                     bool support_dex_v37,
+                                     DexClasses* classes) {
+  auto dh = m_owner ? reinterpret_cast<const dex_header*>(m_data)
+                    : get_dex_header(location);
+  validate_dex_header(dh, m_size, support_dex_v37);
   if (dh->class_defs_size == 0) {
-    return DexClasses(0);
+    return nullptr;
   }
   m_idx = new DexIdx(dh);
+  m_retain_idx = RedexContext::lazy_debug_info();
+  m_retain_file = RedexContext::zero_copy_strings() || m_retain_idx;
   auto off = (uint64_t)dh->class_defs_off;
   auto limit = off + dh->class_defs_size * sizeof(dex_class_def);
-  always_assert_log(off < m_file.size(), "class_defs_off out of range");
-  always_assert_log(limit <= m_file.size(), "invalid class_defs_size");
-  m_class_defs =
-      reinterpret_cast<const dex_class_def*>(m_file.const_data() + off);
-  DexClasses classes(dh->class_defs_size);
-  m_classes = &classes;
+  always_assert_log(off < m_size, "class_defs_off out of range");
+  always_assert_log(limit <= m_size, "invalid class_defs_size");
+  m_class_defs = reinterpret_cast<const dex_class_def*>(m_data + off);
+  classes->resize(dh->class_defs_size);
+  m_classes = classes;
+  return dh;
+}
 
-  auto lwork = new class_load_work[dh->class_defs_size];
+/*
+ * Loads the classes of all the given (opened) dexes on a single work queue,
+ * so that the tail of one dex overlaps with the next. Each class goes into
+ * the slot of its class_def, so the result doesn't depend on scheduling.
+ */
+static void load_dex_classes(const std::vector<DexLoader*>& loaders) {
+  size_t total = 0;
+  for (auto* dl : loaders) {
+    total += dl->num_classes();
+  }
+  std::vector<class_load_work> lwork;
+  lwork.reserve(total);
+  for (auto* dl : loaders) {
+    for (size_t i = 0; i < dl->num_classes(); i++) {
+      lwork.push_back(class_load_work{dl, static_cast<int>(i)});
+    }
+  }
   auto wq =
       workqueue_mapreduce<class_load_work*, std::vector<std::exception_ptr>>(
         class_work, exc_reducer);
-  for (uint32_t i = 0; i < dh->class_defs_size; i++) {
-    lwork[i].dl = this;
-    lwork[i].num = i;
-    wq.add_item(&lwork[i]);
+  for (auto& work : lwork) {
+    wq.add_item(&work);
   }
   const auto exceptions = wq.run_all();
-  delete[] lwork;
 
   if (!exceptions.empty()) {
     // At least one of the workers raised an exception
     aggregate_exception ae(exceptions);
     throw ae;
   }
+}
 
+DexClasses DexLoader::load_dex(const char* location,
+                               dex_stats_t* stats,
+                               bool support_dex_v37) {
+  DexClasses classes;
+  auto dh = open_dex(location, support_dex_v37, &classes);
+  if (dh == nullptr) {
+    return classes;
+  }
+  load_dex_classes({this});
   gather_input_stats(stats, dh);
-
   return classes;
 }
 
 static void mt_balloon(DexMethod* method) { method->balloon(); }
 
 static void balloon_all(const Scope& scope) {
+  if (RedexContext::lazy_balloon()) {
+    walk::methods(scope, [](DexMethod* m) {
+      if (m->get_dex_code()) {
+        m->defer_balloon();
+      }
+    });
+    return;
+  }
   auto wq = workqueue_foreach<DexMethod*>(mt_balloon);
+  // The first touch of the IR decides which NUMA node it lives on.
   walk::methods(scope, [&](DexMethod* m) {
     if (m->get_dex_code()) {
-      wq.add_item(m);
+      wq.add_item(m, walk::numa_node(m->get_class()));
     }
   });
   wq.run_all();
@@ -342,6 +421,76 @@ DexClasses load_classes_from_dex(const char* location,
   return classes;
 }
 
+/*
+ * Loads the classes of all the dexes of `loaders` on one work queue, see
+ * load_classes_from_dexes.
+ */
+static DexClassesVector load_all_dexes(
+    const std::vector<std::unique_ptr<DexLoader>>& loaders,
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon,
+    bool support_dex_v37) {
+  std::vector<const dex_header*> headers;
+  DexClassesVector result(loaders.size());
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    TRACE(MAIN, 1, "Loading classes from dex from %s\n", locations[i].c_str());
+    headers.push_back(loaders[i]->open_dex(
+        locations[i].c_str(), support_dex_v37, &result[i]));
+  }
+
+  std::vector<DexLoader*> to_load;
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    if (headers[i] != nullptr) {
+      to_load.push_back(loaders[i].get());
+    }
+  }
+  load_dex_classes(to_load);
+
+  stats->clear();
+  stats->resize(loaders.size());
+  for (size_t i = 0; i < loaders.size(); ++i) {
+    if (headers[i] != nullptr) {
+      loaders[i]->gather_input_stats(&stats->at(i), headers[i]);
+    }
+  }
+
+  if (balloon) {
+    Scope all_classes;
+    for (const auto& classes : result) {
+      all_classes.insert(all_classes.end(), classes.begin(), classes.end());
+    }
+    balloon_all(all_classes);
+  }
+  return result;
+}
+
+DexClassesVector load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon,
+    bool support_dex_v37) {
+  std::vector<std::unique_ptr<DexLoader>> loaders;
+  for (const auto& location : locations) {
+    loaders.emplace_back(std::make_unique<DexLoader>(location.c_str()));
+  }
+  return load_all_dexes(loaders, locations, stats, balloon, support_dex_v37);
+}
+
+DexClassesVector load_classes_from_dex_buffers(
+    const std::vector<DexBuffer>& dexes,
+    std::vector<dex_stats_t>* stats,
+    bool balloon,
+    bool support_dex_v37) {
+  std::vector<std::unique_ptr<DexLoader>> loaders;
+  std::vector<std::string> locations;
+  for (const auto& dex : dexes) {
+    loaders.emplace_back(std::make_unique<DexLoader>(dex));
+    locations.push_back(dex.location);
+  }
+  return load_all_dexes(loaders, locations, stats, balloon, support_dex_v37);
+}
+
 const std::string load_dex_magic_from_dex(const char* location) {
   DexLoader dl(location);
   auto dh = dl.get_dex_header(location);
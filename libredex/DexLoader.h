@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include "DexClass.h"
 #include "DexIdx.h"
 #include "DexDefs.h"
@@ -19,5 +21,39 @@ DexClasses load_classes_from_dex(const char* location,
                                  dex_stats_t* stats,
                                  bool balloon = true,
                                  bool support_dex_v37 = false);
+
+/*
+ * Loads a list of dexes, scheduling the classes of all of them on one work
+ * queue rather than one dex at a time. Returns the classes of each dex in the
+ * order of `locations`, each in class_def order, exactly as calling
+ * load_classes_from_dex on each location in turn would. `stats` receives one
+ * entry per location.
+ */
+DexClassesVector load_classes_from_dexes(
+    const std::vector<std::string>& locations,
+    std::vector<dex_stats_t>* stats,
+    bool balloon = true,
+    bool support_dex_v37 = false);
+
+/*
+ * A dex that is already in memory, e.g. an entry of an APK (see ApkDexes).
+ * `owner` keeps `data` valid; it is retained by g_redex if the loaded strings
+ * point into `data`.
+ */
+struct DexBuffer {
+  std::string location;
+  const uint8_t* data;
+  size_t size;
+  std::shared_ptr<const void> owner;
+};
+
+/*
+ * Like load_classes_from_dexes, for dexes that are already in memory.
+ */
+DexClassesVector load_classes_from_dex_buffers(
+    const std::vector<DexBuffer>& dexes,
+    std::vector<dex_stats_t>* stats,
+    bool balloon = true,
+    bool support_dex_v37 = false);
 const std::string load_dex_magic_from_dex(const char* location);
 void balloon_for_test(const Scope& scope);
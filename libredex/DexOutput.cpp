@@ -13,10 +13,16 @@
 #include <functional>
 #include <list>
 #include <memory>
+#include <sstream>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unordered_set>
 
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #ifdef _MSC_VER
 // TODO: Rewrite open/write/close with C/C++ standards. But it works for now.
 #include <io.h>
@@ -31,6 +37,7 @@
 #endif
 
 #include "Debug.h"
+#include "Adler32.h"
 #include "DexClass.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
@@ -42,9 +49,10 @@
 #include "Trace.h"
 #include "Walkers.h"
 #include "WorkQueue.h"
+#include "mmap.h"
 
 /*
- * For adler32...
+ * For adler32_combine...
  */
 #include <zlib.h>
 
@@ -81,8 +89,52 @@ class CustomSort {
     }
 };
 
-GatheredTypes::GatheredTypes(DexClasses* classes)
-  : m_classes(classes)
+namespace {
+
+// Below this many elements, sorting or gathering is not worth spreading across
+// threads.
+constexpr size_t MIN_PARALLEL_WORK = 4096;
+
+/*
+ * Sorts each of num_threads slices of vec in parallel, then merges adjacent
+ * slices pairwise, also in parallel. Since all the orders used here are strict
+ * total orders over distinct elements, the result is the same as std::sort's.
+ */
+template <class T, class Compare>
+void parallel_sort(std::vector<T>& vec, Compare cmp, size_t num_threads) {
+  if (num_threads <= 1 || vec.size() < MIN_PARALLEL_WORK) {
+    std::sort(vec.begin(), vec.end(), cmp);
+    return;
+  }
+  size_t chunk_size = (vec.size() + num_threads - 1) / num_threads;
+  auto chunk_begin = [&](size_t i) {
+    return vec.begin() + std::min(i * chunk_size, vec.size());
+  };
+  auto sort_wq = workqueue_foreach<size_t>(
+      [&](size_t i) { std::sort(chunk_begin(i), chunk_begin(i + 1), cmp); },
+      num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    sort_wq.add_item(i);
+  }
+  sort_wq.run_all();
+  for (size_t width = 1; width < num_threads; width *= 2) {
+    auto merge_wq = workqueue_foreach<size_t>(
+        [&](size_t i) {
+          std::inplace_merge(chunk_begin(i), chunk_begin(i + width),
+                             chunk_begin(i + 2 * width), cmp);
+        },
+        num_threads);
+    for (size_t i = 0; i + width < num_threads; i += 2 * width) {
+      merge_wq.add_item(i);
+    }
+    merge_wq.run_all();
+  }
+}
+
+} // namespace
+
+GatheredTypes::GatheredTypes(DexClasses* classes, size_t num_threads)
+  : m_classes(classes), m_num_threads(num_threads)
 {
   // ensure that the string id table contains the empty string, which is used
   // for the DexPosition mapping
@@ -116,6 +168,17 @@ std::vector<DexString*> GatheredTypes::keep_cls_strings_together_emitlist() {
         compare_dexstrings));
 }
 
+std::vector<DexString*> GatheredTypes::get_coldstart_dexstring_emitlist() {
+  // The strings that coldstart doesn't touch follow in class load order.
+  auto order = m_coldstart_strings;
+  auto num_coldstart = order.size();
+  for (const auto& it : m_cls_load_strings) {
+    order.emplace(it.first, num_coldstart + it.second);
+  }
+  return get_dexstring_emitlist(
+      CustomSort<DexString, cmp_dstring>(order, compare_dexstrings));
+}
+
 std::vector<DexMethod*> GatheredTypes::get_dexmethod_emitlist() {
   std::vector<DexMethod*> methlist;
   for (auto cls : *m_classes) {
@@ -150,11 +213,32 @@ void GatheredTypes::sort_dexmethod_emitlist_cls_order(
 
 void GatheredTypes::sort_dexmethod_emitlist_profiled_order(
     std::vector<DexMethod*>& lmeth) {
-  std::stable_sort(
-      lmeth.begin(),
-      lmeth.end(),
-      dexmethods_profiled_comparator(&m_method_to_weight,
-                                     &m_method_sorting_whitelisted_substrings));
+  // Weigh every method once: by the profile as resolved by ConfigFiles, by
+  // name if it wasn't resolved, and then by the whitelisted substrings.
+  std::unordered_map<const DexMethodRef*, unsigned int> weights;
+  for (auto* method : lmeth) {
+    auto it = m_method_weights.find(method);
+    unsigned int weight = it != m_method_weights.end()
+                              ? it->second
+                              : get_method_weight_if_available(
+                                    method, &m_method_to_weight);
+    if (weight == 0) {
+      weight = get_method_weight_override(
+          method, &m_method_sorting_whitelisted_substrings);
+    }
+    if (weight != 0) {
+      weights.emplace(method, weight);
+    }
+  }
+  std::stable_sort(lmeth.begin(), lmeth.end(),
+                   dexmethods_profiled_comparator(&weights));
+}
+
+void GatheredTypes::sort_dexmethod_emitlist_coldstart_order(
+    std::vector<DexMethod*>& lmeth) {
+  std::stable_partition(lmeth.begin(), lmeth.end(), [this](DexMethod* m) {
+    return is_coldstart(m);
+  });
 }
 
 void GatheredTypes::sort_dexmethod_emitlist_clinit_order(
@@ -169,6 +253,84 @@ void GatheredTypes::sort_dexmethod_emitlist_clinit_order(
                    });
 }
 
+void GatheredTypes::set_coldstart(
+    const std::vector<DexType*>& coldstart_types,
+    const std::unordered_map<const DexMethodRef*, unsigned int>&
+        method_weights) {
+  m_coldstart_classes.clear();
+  m_coldstart_methods.clear();
+  m_coldstart_strings.clear();
+  std::unordered_set<const DexClass*> classes(m_classes->begin(),
+                                              m_classes->end());
+  auto for_each_method = [](const DexClass* cls,
+                            const std::function<void(DexMethod*)>& f) {
+    for (auto* m : cls->get_dmethods()) {
+      f(m);
+    }
+    for (auto* m : cls->get_vmethods()) {
+      f(m);
+    }
+  };
+  for (auto* cls : *m_classes) {
+    for_each_method(cls, [&](DexMethod* m) {
+      auto it = method_weights.find(m);
+      if (it != method_weights.end() && it->second != 0) {
+        m_coldstart_methods.insert(m);
+      }
+    });
+  }
+
+  unsigned int index = 0;
+  auto add_strings = [&](DexMethod* m) {
+    std::vector<DexString*> method_strings;
+    m->gather_strings(method_strings);
+    for (auto* s : method_strings) {
+      if (!m_coldstart_strings.count(s)) {
+        m_coldstart_strings.emplace(s, index++);
+      }
+    }
+  };
+  // Like in build_cls_load_map, the components of each class come first, and
+  // the strings of the methods that it runs then.
+  for (auto* type : coldstart_types) {
+    auto* cls = type_class(type);
+    if (cls == nullptr || !classes.count(cls) ||
+        m_coldstart_classes.count(cls)) {
+      continue;
+    }
+    m_coldstart_classes.insert(cls);
+    std::vector<DexType*> cls_types;
+    cls->gather_types(cls_types);
+    for (auto* t : cls_types) {
+      if (!m_coldstart_strings.count(t->get_name())) {
+        m_coldstart_strings.emplace(t->get_name(), index++);
+      }
+    }
+    for_each_method(cls, [&](DexMethod* m) {
+      if (is_clinit(m)) {
+        m_coldstart_methods.insert(m);
+      }
+      if (m_coldstart_methods.count(m)) {
+        add_strings(m);
+      }
+    });
+  }
+  for (auto* cls : *m_classes) {
+    if (m_coldstart_classes.count(cls)) {
+      continue;
+    }
+    for_each_method(cls, [&](DexMethod* m) {
+      if (m_coldstart_methods.count(m)) {
+        add_strings(m);
+      }
+    });
+  }
+  TRACE(CUSTOMSORT, 1,
+        "coldstart touches %lu classes, %lu methods and %lu strings\n",
+        m_coldstart_classes.size(), m_coldstart_methods.size(),
+        m_coldstart_strings.size());
+}
+
 DexOutputIdx* GatheredTypes::get_dodx(const uint8_t* base) {
   /*
    * These are symbol table indices.  Symbols which are used
@@ -189,43 +351,23 @@ DexOutputIdx* GatheredTypes::get_dodx(const uint8_t* base) {
 }
 
 dexstring_to_idx* GatheredTypes::get_string_index(cmp_dstring cmp) {
-  std::sort(m_lstring.begin(), m_lstring.end(), cmp);
-  dexstring_to_idx* sidx = new dexstring_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_lstring.begin(); it != m_lstring.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
-  }
-  return sidx;
+  parallel_sort(m_lstring, cmp, m_num_threads);
+  return new dexstring_to_idx(m_lstring);
 }
 
 dextype_to_idx* GatheredTypes::get_type_index(cmp_dtype cmp) {
-  std::sort(m_ltype.begin(), m_ltype.end(), cmp);
-  dextype_to_idx* sidx = new dextype_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_ltype.begin(); it != m_ltype.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
-  }
-  return sidx;
+  parallel_sort(m_ltype, cmp, m_num_threads);
+  return new dextype_to_idx(m_ltype);
 }
 
 dexfield_to_idx* GatheredTypes::get_field_index(cmp_dfield cmp) {
-  std::sort(m_lfield.begin(), m_lfield.end(), cmp);
-  dexfield_to_idx* sidx = new dexfield_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_lfield.begin(); it != m_lfield.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
-  }
-  return sidx;
+  parallel_sort(m_lfield, cmp, m_num_threads);
+  return new dexfield_to_idx(m_lfield);
 }
 
 dexmethod_to_idx* GatheredTypes::get_method_index(cmp_dmethod cmp) {
-  std::sort(m_lmethod.begin(), m_lmethod.end(), cmp);
-  dexmethod_to_idx* sidx = new dexmethod_to_idx();
-  uint32_t idx = 0;
-  for (auto it = m_lmethod.begin(); it != m_lmethod.end(); it++) {
-    sidx->insert(std::make_pair(*it, idx++));
-  }
-  return sidx;
+  parallel_sort(m_lmethod, cmp, m_num_threads);
+  return new dexmethod_to_idx(m_lmethod);
 }
 
 dexproto_to_idx* GatheredTypes::get_proto_index(cmp_dproto cmp) {
@@ -235,13 +377,8 @@ dexproto_to_idx* GatheredTypes::get_proto_index(cmp_dproto cmp) {
   }
   std::sort(protos.begin(), protos.end());
   protos.erase(std::unique(protos.begin(), protos.end()), protos.end());
-  std::sort(protos.begin(), protos.end(), cmp);
-  dexproto_to_idx* sidx = new dexproto_to_idx();
-  uint32_t idx = 0;
-  for (auto const& proto : protos) {
-    sidx->insert(std::make_pair(proto, idx++));
-  }
-  return sidx;
+  parallel_sort(protos, cmp, m_num_threads);
+  return new dexproto_to_idx(protos);
 }
 
 void GatheredTypes::build_cls_load_map() {
@@ -327,7 +464,51 @@ void GatheredTypes::build_method_map() {
 }
 
 void GatheredTypes::gather_components() {
-  ::gather_components(m_lstring, m_ltype, m_lfield, m_lmethod, *m_classes);
+  size_t num_slices = m_classes->size() < MIN_PARALLEL_WORK
+                          ? 1
+                          : std::min(m_num_threads, m_classes->size());
+  if (num_slices <= 1) {
+    ::gather_components(m_lstring, m_ltype, m_lfield, m_lmethod, *m_classes);
+    return;
+  }
+  // The components of a union of classes are the union of their components,
+  // so each slice of the classes can be gathered on its own.
+  struct Components {
+    std::vector<DexString*> lstring;
+    std::vector<DexType*> ltype;
+    std::vector<DexFieldRef*> lfield;
+    std::vector<DexMethodRef*> lmethod;
+  };
+  std::vector<Components> slices(num_slices);
+  size_t slice_size = (m_classes->size() + num_slices - 1) / num_slices;
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        auto begin = std::min(i * slice_size, m_classes->size());
+        auto end = std::min(begin + slice_size, m_classes->size());
+        DexClasses classes(m_classes->begin() + begin,
+                           m_classes->begin() + end);
+        auto& slice = slices[i];
+        ::gather_components(slice.lstring, slice.ltype, slice.lfield,
+                            slice.lmethod, classes);
+      },
+      num_slices);
+  for (size_t i = 0; i < num_slices; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  auto merge = [](std::vector<Components>& slices, auto member, auto& out) {
+    for (auto& slice : slices) {
+      auto& elements = slice.*member;
+      out.insert(out.end(), elements.begin(), elements.end());
+      elements = {};
+    }
+    sort_unique(out);
+  };
+  merge(slices, &Components::lstring, m_lstring);
+  merge(slices, &Components::ltype, m_ltype);
+  merge(slices, &Components::lfield, m_lfield);
+  merge(slices, &Components::lmethod, m_lmethod);
 }
 
 constexpr uint32_t k_max_dex_size = 16 * 1024 * 1024;
@@ -352,14 +533,22 @@ DexOutput::DexOutput(
     const std::string& method_mapping_filename,
     const std::string& class_mapping_filename,
     const std::string& pg_mapping_filename,
-    const std::string& bytecode_offset_filename)
+    const std::string& bytecode_offset_filename,
+    size_t num_threads,
+    bool mmap_output)
     : m_config_files(config_files) {
   m_classes = classes;
   m_iodi_metadata = iodi_metadata;
-  m_output = (uint8_t*)malloc(k_max_dex_size);
-  memset(m_output, 0, k_max_dex_size);
+  if (mmap_output) {
+    map_output(path);
+  } else {
+    // calloc hands out untouched zero pages for allocations this large, so
+    // only the part of the buffer that is actually emitted gets committed.
+    m_output = (uint8_t*)calloc(k_max_dex_size, 1);
+    always_assert(m_output != nullptr);
+  }
   m_offset = 0;
-  m_gtypes = new GatheredTypes(classes);
+  m_gtypes = new GatheredTypes(classes, num_threads);
   dodx = m_gtypes->get_dodx(m_output);
   m_filename = path;
   m_pos_mapper = pos_mapper;
@@ -371,6 +560,7 @@ DexOutput::DexOutput(
   m_bytecode_offset_filename = bytecode_offset_filename;
   m_store_number = store_number;
   m_dex_number = dex_number;
+  m_num_threads = num_threads;
   m_locator_index = locator_index;
   m_emit_name_based_locators = emit_name_based_locators;
   m_normal_primary_dex = normal_primary_dex;
@@ -380,7 +570,37 @@ DexOutput::DexOutput(
 DexOutput::~DexOutput() {
   delete m_gtypes;
   delete dodx;
-  free(m_output);
+  if (m_output_fd != -1) {
+    m_mapped_output.reset();
+    close(m_output_fd);
+  } else {
+    free(m_output);
+  }
+}
+
+void DexOutput::map_output(const char* path) {
+#ifdef _MSC_VER
+  always_assert_log(false, "Mapped dex output is not supported on Windows");
+#else
+  m_output_fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0660);
+  always_assert_log(m_output_fd != -1, "Could not open %s: %s", path,
+                    strerror(errno));
+  // The file is sparse until sections get emitted into it; write() truncates
+  // it to the final size. Since the pages are backed by the file rather than
+  // by anonymous memory, the kernel can write them back and reclaim them
+  // while other dexes are being emitted.
+  always_assert_log(ftruncate(m_output_fd, k_max_dex_size) == 0,
+                    "Could not size %s: %s", path, strerror(errno));
+  std::string error;
+  m_mapped_output.reset(MappedFile::mmap_file(k_max_dex_size,
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_SHARED,
+                                              m_output_fd,
+                                              path,
+                                              &error));
+  always_assert_log(m_mapped_output != nullptr, "Could not map %s", path);
+  m_output = m_mapped_output->begin();
+#endif
 }
 
 void DexOutput::insert_map_item(uint16_t maptype,
@@ -395,12 +615,13 @@ void DexOutput::insert_map_item(uint16_t maptype,
 }
 
 void DexOutput::emit_locator(Locator locator) {
-  char buf[Locator::encoded_max];
-  size_t locator_length = locator.encode(buf);
+  // Locators are shorter than 128 bytes, so their length takes one byte, and
+  // they are encoded in place right after it.
+  static_assert(Locator::encoded_max < 128, "Locator length must fit a byte");
+  size_t locator_length =
+      locator.encode(reinterpret_cast<char*>(m_output + m_offset + 1));
   write_uleb128(m_output + m_offset, (uint32_t) locator_length);
-  m_offset += uleb128_encoding_size((uint32_t) locator_length);
-  memcpy(m_output + m_offset, buf, locator_length + 1);
-  m_offset += locator_length + 1;
+  m_offset += 1 + locator_length + 1;
 }
 
 std::unique_ptr<Locator>
@@ -468,6 +689,9 @@ void DexOutput::generate_string_data(SortMode mode) {
   } else if (mode == SortMode::CLASS_STRINGS) {
     TRACE(CUSTOMSORT, 2, "using class names pack for string pool sorting\n");
     string_order = m_gtypes->keep_cls_strings_together_emitlist();
+  } else if (mode == SortMode::COLDSTART_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using coldstart order for string pool sorting\n");
+    string_order = m_gtypes->get_coldstart_dexstring_emitlist();
   } else {
     TRACE(CUSTOMSORT, 2, "using default string pool sorting\n");
     string_order = m_gtypes->get_dexstring_emitlist();
@@ -479,9 +703,13 @@ void DexOutput::generate_string_data(SortMode mode) {
 
   // If we're generating locator strings, we need to include them in
   // the total count of strings in this section.
+  // The locators are looked up once, and emitted in the loop below.
   size_t locators = 0;
+  std::vector<std::unique_ptr<Locator>> string_locators;
+  string_locators.reserve(string_order.size());
   for (DexString* str : string_order) {
-    if (locator_for_descriptor(type_names, str)) {
+    string_locators.push_back(locator_for_descriptor(type_names, str));
+    if (string_locators.back()) {
       ++locators;
     }
   }
@@ -494,9 +722,10 @@ void DexOutput::generate_string_data(SortMode mode) {
   size_t nrstr = string_order.size() + locators;
 
   insert_map_item(TYPE_STRING_DATA_ITEM, (uint32_t)nrstr, m_offset);
-  for (DexString* str : string_order) {
+  for (size_t i = 0; i < string_order.size(); i++) {
+    DexString* str = string_order[i];
     // Emit lookup acceleration string if requested
-    std::unique_ptr<Locator> locator = locator_for_descriptor(type_names, str);
+    const auto& locator = string_locators[i];
     if (locator) {
       unsigned orig_offset = m_offset;
       emit_locator(*locator);
@@ -517,6 +746,9 @@ void DexOutput::generate_string_data(SortMode mode) {
     TRACE(CUSTOMSORT, 3, "str emit %s\n", SHOW(str));
     stringids[idx].offset = m_offset;
     str->encode(m_output + m_offset);
+    if (m_gtypes->is_coldstart(str)) {
+      touch_coldstart_pages(m_offset, str->get_entry_size());
+    }
     m_offset += str->get_entry_size();
     m_stats.num_strings++;
   }
@@ -692,6 +924,10 @@ void DexOutput::generate_class_data() {
   for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
     m_stats.num_classes++;
     DexClass* clz = m_classes->at(i);
+    if (m_gtypes->is_coldstart(clz)) {
+      touch_coldstart_pages(hdr.class_defs_off + i * sizeof(dex_class_def),
+                            sizeof(dex_class_def));
+    }
     cdefs[i].typeidx = dodx->typeidx(clz->get_type());
     cdefs[i].access_flags = clz->get_access();
     cdefs[i].super_idx = dodx->typeidx(clz->get_super_class());
@@ -728,7 +964,7 @@ void DexOutput::generate_class_data() {
   }
 }
 
-void DexOutput::generate_class_data_items() {
+void DexOutput::generate_class_data_items(SortMode mode) {
   /*
    * First generate a dexcode_to_offset needed for the encoding
    * of class_data_items
@@ -739,30 +975,77 @@ void DexOutput::generate_class_data_items() {
     uint32_t offset = (uint32_t)(((uint8_t*)it.code_item) - m_output);
     dco[it.code] = offset;
   }
-  for (uint32_t i = 0; i < hdr.class_defs_size; i++) {
-    DexClass* clz = m_classes->at(i);
+  // Unlike the class_defs, which have to list superclasses first, the class
+  // data items may come in any order.
+  std::vector<DexClass*> classes(m_classes->begin(), m_classes->end());
+  if (mode == SortMode::COLDSTART_ORDER) {
+    TRACE(CUSTOMSORT, 2, "using coldstart order for class data sorting\n");
+    std::stable_partition(
+        classes.begin(), classes.end(),
+        [this](DexClass* clz) { return m_gtypes->is_coldstart(clz); });
+  }
+  for (DexClass* clz : classes) {
     if (!clz->has_class_data()) continue;
     /* No alignment constraints for this data */
     int size = clz->encode(dodx, dco, m_output + m_offset);
     m_cdi_offsets[clz] = m_offset;
+    if (m_gtypes->is_coldstart(clz)) {
+      touch_coldstart_pages(m_offset, size);
+    }
     m_offset += size;
   }
   insert_map_item(TYPE_CLASS_DATA_ITEM, (uint32_t) m_cdi_offsets.size(), cdi_start);
 }
 
+void DexOutput::touch_coldstart_pages(uint32_t offset, uint32_t size) {
+  constexpr uint32_t kPageSize = 4096;
+  if (size == 0) {
+    return;
+  }
+  for (auto page = offset / kPageSize; page <= (offset + size - 1) / kPageSize;
+       ++page) {
+    m_coldstart_pages.insert(page);
+  }
+}
+
+/*
+ * An upper bound on the number of bytes DexCode::encode will write for code.
+ */
+static size_t code_item_size_bound(const DexCode* code) {
+  size_t insns_size = 0;
+  for (auto const& opc : code->get_instructions()) {
+    insns_size += opc->size();
+  }
+  // Instructions are padded to 4 bytes if there are tries. The handler list
+  // starts with its uleb128 size, then each handler is a sleb128 count
+  // followed by a uleb128 type index and address per catch.
+  size_t size = sizeof(dex_code_item) + (insns_size + 1) * sizeof(uint16_t);
+  const auto& tries = code->get_tries();
+  if (!tries.empty()) {
+    size += tries.size() * sizeof(dex_tries_item) + 5;
+    for (const auto& dextry : tries) {
+      size += 5 + dextry->m_catches.size() * 10;
+    }
+  }
+  return size;
+}
+
 static void sync_all(const Scope& scope) {
   constexpr bool serial = false; // for debugging
   auto wq = workqueue_foreach<DexMethod*>([](DexMethod* m){m->sync();});
-  walk::code(scope,
-            [](DexMethod*) { return true; },
-            [&](DexMethod* m, IRCode&) {
-              if (serial) {
-                TRACE(MTRANS, 2, "Syncing %s\n", SHOW(m));
-                m->sync();
-              } else {
-                wq.add_item(m);
-              }
-            });
+  // Walk methods rather than code, so that methods whose ballooning was
+  // deferred and never happened keep their original DexCode.
+  walk::methods(scope, [&](DexMethod* m) {
+    if (!m->is_balloon_deferred() && m->get_code() == nullptr) {
+      return;
+    }
+    if (serial) {
+      TRACE(MTRANS, 2, "Syncing %s\n", SHOW(m));
+      m->sync();
+    } else {
+      wq.add_item(m);
+    }
+  });
   wq.run_all();
 }
 
@@ -797,6 +1080,11 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
               "sorting <clinit> sections before all other bytecode");
         m_gtypes->sort_dexmethod_emitlist_clinit_order(lmeth);
         break;
+      case SortMode::COLDSTART_ORDER:
+        TRACE(CUSTOMSORT, 2,
+              "sorting coldstart bytecode before all other bytecode\n");
+        m_gtypes->sort_dexmethod_emitlist_coldstart_order(lmeth);
+        break;
 
       case SortMode::CLASS_STRINGS:
         TRACE(CUSTOMSORT, 2,
@@ -808,22 +1096,71 @@ void DexOutput::generate_code_items(const std::vector<SortMode>& mode) {
         break;
       }
   }
+  std::vector<DexMethod*> code_meths;
   for (DexMethod* meth : lmeth) {
     if (meth->get_access() & (ACC_ABSTRACT | ACC_NATIVE)) {
       // There is no code item for ABSTRACT or NATIVE methods.
       continue;
     }
-    TRACE(CUSTOMSORT, 3, "method emit %s %s\n", SHOW(meth->get_class()), SHOW(meth));
-    DexCode* code = meth->get_dex_code();
     always_assert_log(
-        meth->is_concrete() && code != nullptr,
+        meth->is_concrete() && meth->get_dex_code() != nullptr,
         "Undefined method in generate_code_items()\n\t prototype: %s\n", SHOW(meth));
+    code_meths.push_back(meth);
+  }
+
+  // Encoding is independent across methods, so each slice of the methods is
+  // encoded in parallel into an arena of its own. The code items are then
+  // laid out sequentially by copying them out of the arenas.
+  struct EncodedCode {
+    uint32_t arena_offset;
+    int size;
+  };
+  size_t num_slices = code_meths.size() < MIN_PARALLEL_WORK
+                          ? 1
+                          : std::min(m_num_threads, code_meths.size());
+  size_t slice_size = (code_meths.size() + num_slices - 1) / num_slices;
+  std::vector<std::vector<uint8_t>> arenas(num_slices);
+  std::vector<EncodedCode> encoded(code_meths.size());
+  auto encode_slice = [&](size_t i) {
+    auto begin = std::min(i * slice_size, code_meths.size());
+    auto end = std::min(begin + slice_size, code_meths.size());
+    auto& arena = arenas[i];
+    for (auto j = begin; j < end; ++j) {
+      DexCode* code = code_meths[j]->get_dex_code();
+      auto arena_offset = (arena.size() + 3) & ~3;
+      auto bound = code_item_size_bound(code);
+      arena.resize(arena_offset + bound);
+      auto size = code->encode(dodx, (uint32_t*)(arena.data() + arena_offset));
+      always_assert((size_t)size <= bound);
+      arena.resize(arena_offset + size);
+      encoded[j] = EncodedCode{(uint32_t)arena_offset, size};
+    }
+  };
+  if (num_slices == 1) {
+    encode_slice(0);
+  } else {
+    auto wq = workqueue_foreach<size_t>(encode_slice, num_slices);
+    for (size_t i = 0; i < num_slices; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+
+  for (size_t j = 0; j < code_meths.size(); ++j) {
+    DexMethod* meth = code_meths[j];
+    TRACE(CUSTOMSORT, 3, "method emit %s %s\n", SHOW(meth->get_class()), SHOW(meth));
+    DexCode* code = meth->get_dex_code();
     align_output();
-    int size = code->encode(dodx, (uint32_t*)(m_output + m_offset));
+    int size = encoded[j].size;
     check_method_instruction_size_limit(m_config_files, size, SHOW(meth));
+    memcpy(m_output + m_offset,
+           arenas[j / slice_size].data() + encoded[j].arena_offset, size);
     m_method_bytecode_offsets.emplace_back(meth->get_name()->c_str(), m_offset);
     m_code_item_emits.emplace_back(meth, code,
                                    (dex_code_item*)(m_output + m_offset));
+    if (m_gtypes->is_coldstart(meth)) {
+      touch_coldstart_pages(m_offset, size);
+    }
     m_offset += size;
     m_stats.num_instructions += code->get_instructions().size();
   }
@@ -881,6 +1218,109 @@ void DexOutput::generate_static_values() {
   }
 }
 
+namespace {
+
+/*
+ * A 128-bit hash of the encoding of an item. It is wide enough that two
+ * distinct items essentially never share one, so the contents of items only
+ * need to be compared when their hashes are the same.
+ */
+struct ContentHash {
+  uint64_t lo;
+  uint64_t hi;
+
+  bool operator==(const ContentHash& that) const {
+    return lo == that.lo && hi == that.hi;
+  }
+};
+
+struct ContentHashHasher {
+  size_t operator()(const ContentHash& hash) const { return hash.lo; }
+};
+
+inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// Hashes data in the manner of MurmurHash3_x64_128.
+ContentHash hash_content(const uint8_t* data, size_t size) {
+  constexpr uint64_t c1 = 0x87c37b91114253d5ULL;
+  constexpr uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+  auto mix = [&](uint64_t k1, uint64_t k2) {
+    h1 ^= rotl64(k1 * c1, 31) * c2;
+    h1 = (rotl64(h1, 27) + h2) * 5 + 0x52dce729;
+    h2 ^= rotl64(k2 * c2, 33) * c1;
+    h2 = (rotl64(h2, 31) + h1) * 5 + 0x38495ab5;
+  };
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    uint64_t k[2];
+    memcpy(k, data + i, 16);
+    mix(k[0], k[1]);
+  }
+  if (i < size) {
+    uint64_t k[2] = {0, 0};
+    memcpy(k, data + i, size - i);
+    mix(k[0], k[1]);
+  }
+  h1 ^= size;
+  h2 ^= size;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+  return ContentHash{h1, h2};
+}
+
+/*
+ * Tracks the items of a section that have been emitted, so that items with
+ * the same contents can share a single copy. Rather than keeping the contents
+ * of every item around, items are compared against their copy in the output.
+ */
+class EmittedItems {
+ public:
+  explicit EmittedItems(const uint8_t* output) : m_output(output) {}
+
+  // Returns the offset of an emitted item with the given contents. If there
+  // is none, records that the contents are emitted at offset and returns
+  // offset; they must be written there before the next call.
+  uint32_t find_or_insert(const void* data, size_t size, uint32_t offset) {
+    auto hash = hash_content(static_cast<const uint8_t*>(data), size);
+    auto range = m_items.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      const auto& item = it->second;
+      if (item.size == size &&
+          memcmp(m_output + item.offset, data, size) == 0) {
+        return item.offset;
+      }
+    }
+    m_items.emplace(hash, Item{offset, size});
+    return offset;
+  }
+
+ private:
+  struct Item {
+    uint32_t offset;
+    size_t size;
+  };
+
+  const uint8_t* m_output;
+  std::unordered_multimap<ContentHash, Item, ContentHashHasher> m_items;
+};
+
+} // namespace
+
 static bool annotation_cmp(const DexAnnotationDirectory* a,
                            const DexAnnotationDirectory* b) {
   return (a->viz_score() < b->viz_score());
@@ -890,18 +1330,17 @@ void DexOutput::unique_annotations(annomap_t& annomap,
                                    std::vector<DexAnnotation*>& annolist) {
   int annocnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint8_t>, uint32_t> annotation_byte_offsets;
+  EmittedItems emitted(m_output);
   for (auto anno : annolist) {
     if (annomap.count(anno)) continue;
     std::vector<uint8_t> annotation_bytes;
     anno->vencode(dodx, annotation_bytes);
-    if (annotation_byte_offsets.count(annotation_bytes)) {
-      annomap[anno] = annotation_byte_offsets[annotation_bytes];
+    auto offset = emitted.find_or_insert(
+        annotation_bytes.data(), annotation_bytes.size(), m_offset);
+    annomap[anno] = offset;
+    if (offset != m_offset) {
       continue;
     }
-    /* Insert new annotation in tracking structs */
-    annotation_byte_offsets[annotation_bytes] = m_offset;
-    annomap[anno] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* annoout = (uint8_t*)(m_output + m_offset);
     memcpy(annoout, &annotation_bytes[0], annotation_bytes.size());
@@ -919,18 +1358,17 @@ void DexOutput::unique_asets(annomap_t& annomap,
                              std::vector<DexAnnotationSet*>& asetlist) {
   int asetcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> aset_offsets;
+  EmittedItems emitted(m_output);
   for (auto aset : asetlist) {
     if (asetmap.count(aset)) continue;
     std::vector<uint32_t> aset_bytes;
     aset->vencode(dodx, aset_bytes, annomap);
-    if (aset_offsets.count(aset_bytes)) {
-      asetmap[aset] = aset_offsets[aset_bytes];
+    auto offset = emitted.find_or_insert(
+        aset_bytes.data(), aset_bytes.size() * sizeof(uint32_t), m_offset);
+    asetmap[aset] = offset;
+    if (offset != m_offset) {
       continue;
     }
-    /* Insert new aset in tracking structs */
-    aset_offsets[aset_bytes] = m_offset;
-    asetmap[aset] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* asetout = (uint8_t*)(m_output + m_offset);
     memcpy(asetout, &aset_bytes[0], aset_bytes.size() * sizeof(uint32_t));
@@ -947,7 +1385,7 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                              std::vector<ParamAnnotations*>& xreflist) {
   int xrefcnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> xref_offsets;
+  EmittedItems emitted(m_output);
   for (auto xref : xreflist) {
     if (xrefmap.count(xref)) continue;
     std::vector<uint32_t> xref_bytes;
@@ -958,13 +1396,12 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                         "Uninitialized aset %p '%s'", das, SHOW(das));
       xref_bytes.push_back(asetmap[das]);
     }
-    if (xref_offsets.count(xref_bytes)) {
-      xrefmap[xref] = xref_offsets[xref_bytes];
+    auto offset = emitted.find_or_insert(
+        xref_bytes.data(), xref_bytes.size() * sizeof(uint32_t), m_offset);
+    xrefmap[xref] = offset;
+    if (offset != m_offset) {
       continue;
     }
-    /* Insert new xref in tracking structs */
-    xref_offsets[xref_bytes] = m_offset;
-    xrefmap[xref] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* xrefout = (uint8_t*)(m_output + m_offset);
     memcpy(xrefout, &xref_bytes[0], xref_bytes.size() * sizeof(uint32_t));
@@ -982,18 +1419,17 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
                              std::vector<DexAnnotationDirectory*>& adirlist) {
   int adircnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint32_t>, uint32_t> adir_offsets;
+  EmittedItems emitted(m_output);
   for (auto adir : adirlist) {
     if (adirmap.count(adir)) continue;
     std::vector<uint32_t> adir_bytes;
     adir->vencode(dodx, adir_bytes, xrefmap, asetmap);
-    if (adir_offsets.count(adir_bytes)) {
-      adirmap[adir] = adir_offsets[adir_bytes];
+    auto offset = emitted.find_or_insert(
+        adir_bytes.data(), adir_bytes.size() * sizeof(uint32_t), m_offset);
+    adirmap[adir] = offset;
+    if (offset != m_offset) {
       continue;
     }
-    /* Insert new adir in tracking structs */
-    adir_offsets[adir_bytes] = m_offset;
-    adirmap[adir] = m_offset;
     /* Not a dupe, encode... */
     uint8_t* adirout = (uint8_t*)(m_output + m_offset);
     memcpy(adirout, &adir_bytes[0], adir_bytes.size() * sizeof(uint32_t));
@@ -1114,6 +1550,24 @@ int emit_debug_info(
              : 0;
 }
 
+// Debug programs are often identical across methods, e.g. for small methods
+// without any positions. If the program just emitted at offset has already
+// been emitted, points the code item at the existing copy and drops the new
+// one. Returns the size the program adds to the output.
+int share_debug_info(EmittedItems* emitted,
+                     dex_code_item* dci,
+                     uint8_t* output,
+                     uint32_t offset,
+                     int size) {
+  auto existing = emitted->find_or_insert(output + offset, size, offset);
+  if (existing == offset) {
+    return size;
+  }
+  dci->debug_info_off = existing;
+  memset(output + offset, 0, size);
+  return 0;
+}
+
 // Returns a DexDebugInstruction corresponding to emitting a line entry
 // with the given address offset and line offset. Asserts if invalid arguments.
 inline std::unique_ptr<DexDebugInstruction> create_line_entry(int8_t line,
@@ -1547,6 +2001,7 @@ uint32_t emit_instruction_offset_debug_info(
     }
   }
   // 3)
+  EmittedItems emitted(output);
   auto size_offset_end = param_size_to_oset.end();
   for (auto& it : code_items) {
     DexCode* dc = it.code;
@@ -1578,9 +2033,13 @@ uint32_t emit_instruction_offset_debug_info(
                         SHOW(method), code_size);
       dci->debug_info_off = offset_it->second;
     } else {
-      offset += emit_debug_info_for_metadata(
+      auto size = emit_debug_info_for_metadata(
           dodx, method_to_debug_meta.at(method), output, offset, true);
-      *dbgcount += 1;
+      size = share_debug_info(&emitted, dci, output, offset, size);
+      if (size > 0) {
+        offset += size;
+        *dbgcount += 1;
+      }
     }
   }
   // Return how much data we've encoded
@@ -1613,15 +2072,21 @@ void DexOutput::generate_debug_items() {
               "[IODI] WARNING: Not using IODI because no iodi metadata file was"
               " specified.\n");
     }
+    EmittedItems emitted(m_output);
     for (auto& it : m_code_item_emits) {
       DexCode* dc = it.code;
       dex_code_item* dci = it.code_item;
       auto dbg = dc->get_debug_item();
       if (dbg == nullptr) continue;
-      dbgcount++;
-      m_offset +=
+      auto size =
           emit_debug_info(dodx, emit_positions, dbg, dc, dci, m_pos_mapper,
                           m_output, m_offset, m_code_debug_lines);
+      if (emit_positions) {
+        size = share_debug_info(&emitted, dci, m_output, m_offset, size);
+        if (size == 0) continue;
+      }
+      dbgcount++;
+      m_offset += size;
     }
   }
   if (emit_positions) {
@@ -1730,39 +2195,100 @@ void DexOutput::init_header_offsets(const std::string& dex_magic) {
 void DexOutput::finalize_header() {
   hdr.data_size = m_offset - hdr.data_off;
   hdr.file_size = m_offset;
-  int skip;
-  skip = sizeof(hdr.magic) + sizeof(hdr.checksum) + sizeof(hdr.signature);
   memcpy(m_output, &hdr, sizeof(hdr));
+  // The signature covers everything after it, and the checksum everything
+  // after the checksum, including the signature. Compute both in a single
+  // pass over the dex, of which only a chunk at a time needs to be resident,
+  // and fold the signature into the checksum once it is known. The sections
+  // can't be hashed as they are emitted, since the id tables at the front and
+  // the debug info offsets of the code items are only filled in afterwards.
+  size_t body_off =
+      sizeof(hdr.magic) + sizeof(hdr.checksum) + sizeof(hdr.signature);
+  constexpr size_t k_chunk_size = 1 << 16;
   Sha1Context context;
   sha1_init(&context);
-  sha1_update(&context, m_output + skip, hdr.file_size - skip);
+  uint32_t body_adler = 1;
+  for (size_t off = body_off; off < hdr.file_size; off += k_chunk_size) {
+    auto size = std::min<size_t>(k_chunk_size, hdr.file_size - off);
+    sha1_update(&context, m_output + off, size);
+    body_adler = adler32_update(body_adler, m_output + off, size);
+  }
   sha1_final(hdr.signature, &context);
-  memcpy(m_output, &hdr, sizeof(hdr));
-  uint32_t adler = (uint32_t)adler32(0L, Z_NULL, 0);
-  skip = sizeof(hdr.magic) + sizeof(hdr.checksum);
-  adler = (uint32_t) adler32(adler, (const Bytef*)(m_output + skip), hdr.file_size - skip);
-  hdr.checksum = adler;
+  uLong adler = adler32_update(1, hdr.signature, sizeof(hdr.signature));
+  adler = adler32_combine(adler, body_adler, hdr.file_size - body_off);
+  hdr.checksum = (uint32_t)adler;
   memcpy(m_output, &hdr, sizeof(hdr));
 }
 
 namespace {
 
+/*
+ * Formats the items [0, size) of a symbol file and appends them to the file.
+ * Consecutive items are formatted in parallel chunks, each appended straight
+ * into a string buffer of its own, and the chunks are then written out in
+ * order.
+ */
+template <class Format>
+void append_formatted(const std::string& filename,
+                      size_t size,
+                      size_t num_threads,
+                      const Format& format) {
+  size_t num_chunks = size < MIN_PARALLEL_WORK
+                          ? 1
+                          : std::max<size_t>(1, std::min(num_threads, size));
+  size_t chunk_size = (size + num_chunks - 1) / num_chunks;
+  std::vector<std::string> chunks(num_chunks);
+  auto format_chunk = [&](size_t i) {
+    auto& out = chunks[i];
+    auto end = std::min(size, (i + 1) * chunk_size);
+    for (auto j = i * chunk_size; j < end; ++j) {
+      format(j, out);
+    }
+  };
+  if (num_chunks == 1) {
+    format_chunk(0);
+  } else {
+    auto wq = workqueue_foreach<size_t>(format_chunk, num_chunks);
+    for (size_t i = 0; i < num_chunks; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+
+  FILE* fd = fopen(filename.c_str(), "a");
+  assert_log(fd, "Can't open symbol file %s: %s\n",
+             filename.c_str(),
+             strerror(errno));
+  for (const auto& chunk : chunks) {
+    fwrite(chunk.data(), 1, chunk.size(), fd);
+  }
+  fclose(fd);
+}
+
 void write_method_mapping(
   const std::string& filename,
   const DexOutputIdx* dodx,
   const DexClasses* classes,
   uint8_t* dex_signature,
-  std::unordered_map<DexMethod*, uint64_t>* method_to_id
+  std::unordered_map<DexMethod*, uint64_t>* method_to_id,
+  size_t num_threads
 ) {
   if (filename.empty()) return;
-  FILE* fd = fopen(filename.c_str(), "a");
-  assert_log(fd, "Can't open method mapping file %s: %s\n",
-             filename.c_str(),
-             strerror(errno));
   std::unordered_set<DexClass*> classes_in_dex(classes->begin(), classes->end());
-  for (auto& it : dodx->method_to_idx()) {
-    auto method = it.first;
-    auto idx = it.second;
+  std::vector<std::pair<DexMethodRef*, uint32_t>> methods(
+      dodx->method_to_idx().begin(), dodx->method_to_idx().end());
+  // The ids of the methods that get one, recorded per method so that the
+  // chunks don't need to synchronize.
+  std::vector<DexMethod*> id_methods(methods.size(), nullptr);
+  //
+  // Turns out, the checksum can change on-device. (damn you dexopt)
+  // The signature, however, is never recomputed. Let's log the top 4 bytes,
+  // in little-endian (since that's faster to compute on-device).
+  //
+  uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
+  auto format = [&](size_t i, std::string& out) {
+    auto method = methods[i].first;
+    auto idx = methods[i].second;
 
     // Types (and methods) internal to our app have a cached deobfuscated name
     // that comes from the proguard map.  If we don't have one, it's a
@@ -1772,15 +2298,8 @@ void write_method_mapping(
     if (classes_in_dex.count(cls) == 0) {
       // We only want to emit IDs for the methods that are defined in this dex,
       // and not for references to methods in other dexes.
-      continue;
+      return;
     }
-    auto deobf_class = [&] {
-      if (cls) {
-        auto deobname = cls->get_deobfuscated_name();
-        if (!deobname.empty()) return deobname;
-      }
-      return show(typecls);
-    }();
 
     // Some method refs aren't "concrete" (e.g., referring to a method defined
     // by a superclass via a subclass).  We only know how to deobfuscate
@@ -1795,75 +2314,80 @@ void write_method_mapping(
     }();
 
     // Consult the cached method names, or just give it back verbatim.
-    auto deobf_method = [&] {
-      if (resolved_method->is_def()) {
-        auto deobfname =
-            static_cast<DexMethod*>(resolved_method)->get_deobfuscated_name();
-        if (!deobfname.empty()) return deobfname;
-      }
-      return show(resolved_method);
-    }();
+    const std::string* deobf_method = nullptr;
+    if (resolved_method->is_def()) {
+      deobf_method =
+          &static_cast<DexMethod*>(resolved_method)->get_deobfuscated_name();
+    }
+    std::string shown_method;
+    if (deobf_method == nullptr || deobf_method->empty()) {
+      shown_method.clear();
+      show_to(shown_method, resolved_method);
+      deobf_method = &shown_method;
+    }
 
     // Format is <cls>.<name>:(<args>)<ret>
     // We only want the name here.
-    auto begin = deobf_method.find('.') + 1;
-    auto end = deobf_method.rfind(':');
-    auto deobf_method_name = deobf_method.substr(begin, end-begin);
+    auto begin = deobf_method->find('.') + 1;
+    auto end = deobf_method->rfind(':');
 
-    //
-    // Turns out, the checksum can change on-device. (damn you dexopt)
-    // The signature, however, is never recomputed. Let's log the top 4 bytes,
-    // in little-endian (since that's faster to compute on-device).
-    //
-    uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
-
-    if (method_to_id != nullptr) {
-      if (resolved_method == method) {
-        // Not recording it if method reference is not referring to
-        // concrete method, otherwise will have key overlapped.
-        auto dexmethod = static_cast<DexMethod*>(resolved_method);
-        (*method_to_id)[dexmethod] =
-            ((uint64_t)idx << 32) | (uint64_t)signature;
-      }
+    if (resolved_method == method) {
+      // Not recording it if method reference is not referring to
+      // concrete method, otherwise will have key overlapped.
+      id_methods[i] = static_cast<DexMethod*>(resolved_method);
     }
 
-    fprintf(fd, "%u %u %s %s\n",
-            idx,
-            signature,
-            deobf_method_name.c_str(),
-            deobf_class.c_str());
+    out += std::to_string(idx);
+    out += ' ';
+    out += std::to_string(signature);
+    out += ' ';
+    out.append(*deobf_method, begin, end - begin);
+    out += ' ';
+    if (cls && !cls->get_deobfuscated_name().empty()) {
+      out += cls->get_deobfuscated_name();
+    } else {
+      show_to(out, typecls);
+    }
+    out += '\n';
+  };
+  append_formatted(filename, methods.size(), num_threads, format);
+  if (method_to_id != nullptr) {
+    for (size_t i = 0; i < methods.size(); ++i) {
+      if (id_methods[i] != nullptr) {
+        (*method_to_id)[id_methods[i]] =
+            ((uint64_t)methods[i].second << 32) | (uint64_t)signature;
+      }
+    }
   }
-  fclose(fd);
 }
 
 void write_class_mapping(
   const std::string& filename,
   DexClasses* classes,
   const size_t class_defs_size,
-  uint8_t* dex_signature
+  uint8_t* dex_signature,
+  size_t num_threads
 ) {
   if (filename.empty()) return;
-  FILE* fd = fopen(filename.c_str(), "a");
-
-  for (uint32_t idx = 0; idx < class_defs_size; idx++) {
 
+  //
+  // See write_method_mapping above for why checksum is insufficient.
+  //
+  uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
+  auto format = [&](size_t idx, std::string& out) {
     DexClass* cls = classes->at(idx);
-    auto deobf_class = [&] {
-      if (cls) {
-        auto deobname = cls->get_deobfuscated_name();
-        if (!deobname.empty()) return deobname;
-      }
-      return show(cls);
-    }();
-
-    //
-    // See write_method_mapping above for why checksum is insufficient.
-    //
-    uint32_t signature = *reinterpret_cast<uint32_t*>(dex_signature);
-    fprintf(fd, "%u %u %s\n", idx, signature, deobf_class.c_str());
-  }
-
-  fclose(fd);
+    out += std::to_string(idx);
+    out += ' ';
+    out += std::to_string(signature);
+    out += ' ';
+    if (cls && !cls->get_deobfuscated_name().empty()) {
+      out += cls->get_deobfuscated_name();
+    } else {
+      show_to(out, cls);
+    }
+    out += '\n';
+  };
+  append_formatted(filename, class_defs_size, num_threads, format);
 }
 
 const char* deobf_primitive(char type) {
@@ -1892,151 +2416,162 @@ const char* deobf_primitive(char type) {
   }
 }
 
-void write_pg_mapping(const std::string& filename, DexClasses* classes) {
+// Appends an internal name like "Ljava/lang/String;" in the external format,
+// "java.lang.String".
+void append_external(std::string& out, const char* internal_name, size_t size) {
+  auto start = out.size();
+  out.append(internal_name + 1, size - 2);
+  std::replace(out.begin() + start, out.end(), '/', '.');
+}
+
+void write_pg_mapping(const std::string& filename,
+                      DexClasses* classes,
+                      size_t num_threads) {
   if (filename.empty()) return;
 
-  auto deobf_class = [&](DexClass* cls) {
-    if (cls) {
-      auto deobname = cls->get_deobfuscated_name();
-      if (!deobname.empty()) return deobname;
+  // Everything below appends to the chunk being formatted, so that writing
+  // a member doesn't need temporary strings.
+  auto deobf_class = [&](std::string& out, DexClass* cls) {
+    const auto& deobname = cls->get_deobfuscated_name();
+    if (!deobname.empty()) {
+      append_external(out, deobname.c_str(), deobname.size());
+    } else {
+      auto name = cls->get_type()->get_name();
+      append_external(out, name->c_str(), name->size());
     }
-    return show(cls);
   };
 
-  auto deobf_type = [&](DexType* type) {
-    if (type) {
-      if (is_array(type)) {
-        auto* type_str = type->c_str();
-        int dim = 0;
-        while (type_str[dim] == '[') {
-          dim++;
-        }
-        DexType* inner_type = DexType::get_type(&type_str[dim]);
-        DexClass* inner_cls = inner_type ? type_class(inner_type) : nullptr;
-        std::string result;
-        if (inner_cls) {
-          result = JavaNameUtil::internal_to_external(deobf_class(inner_cls));
-        } else if (inner_type && is_primitive(inner_type)) {
-          result = deobf_primitive(type_str[dim]);
-        } else {
-          result = JavaNameUtil::internal_to_external(&type_str[dim]);
-        }
-        for (int i = 0 ; i < dim ; ++i) {
-          result = result + "[]";
-        }
-        return result;
+  auto deobf_type = [&](std::string& out, DexType* type) {
+    if (!type) {
+      return;
+    }
+    auto* type_str = type->c_str();
+    int dim = 0;
+    while (type_str[dim] == '[') {
+      dim++;
+    }
+    if (type_str[dim] != 'L') {
+      // The element type of an array of primitives need not exist as a
+      // DexType of its own.
+      out += deobf_primitive(type_str[dim]);
+    } else {
+      DexType* inner_type =
+          dim == 0 ? type : DexType::get_type(&type_str[dim]);
+      DexClass* inner_cls = inner_type ? type_class(inner_type) : nullptr;
+      if (inner_cls) {
+        deobf_class(out, inner_cls);
       } else {
-        DexClass* cls = type_class(type);
-        if (cls) {
-          return JavaNameUtil::internal_to_external(deobf_class(cls));
-        } else if (is_primitive(type)) {
-          return std::string(deobf_primitive(type->c_str()[0]));
-        } else {
-          return JavaNameUtil::internal_to_external(type->c_str());
-        }
+        append_external(out, &type_str[dim], type->get_name()->size() - dim);
       }
     }
-    return show(type);
+    for (int i = 0 ; i < dim ; ++i) {
+      out += "[]";
+    }
   };
 
-  auto deobf_meth = [&](DexMethod* method) {
-    if (method) {
-      // Example: 672:672:boolean customShouldDelayInitMessage(android.os.Handler,android.os.Message)
-      auto* proto = method->get_proto();
-      std::ostringstream ss;
-      auto* code = method->get_dex_code();
-      auto* dbg = code ? code->get_debug_item() : nullptr;
-      if (dbg) {
-        uint32_t line_start = code->get_debug_item()->get_line_start();
-        uint32_t line_end = line_start;
-        for (auto& entry : dbg->get_entries()) {
-          if (entry.type == DexDebugEntryType::Position) {
-            if (entry.pos->line > line_end) {
-              line_end = entry.pos->line;
-            }
+  auto deobf_meth = [&](std::string& out, DexMethod* method) {
+    // Example: 672:672:boolean shouldDelay(android.os.Handler,int)
+    auto* proto = method->get_proto();
+    auto* code = method->get_dex_code();
+    auto* dbg = code ? code->get_debug_item() : nullptr;
+    if (dbg) {
+      uint32_t line_start = code->get_debug_item()->get_line_start();
+      uint32_t line_end = line_start;
+      for (auto& entry : dbg->get_entries()) {
+        if (entry.type == DexDebugEntryType::Position) {
+          if (entry.pos->line > line_end) {
+            line_end = entry.pos->line;
           }
         }
-        // Treat anything bigger than 2^31 as 0
-        if (line_start > static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
-          line_start = 0;
-        }
-        if (line_end > static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
-          line_end = 0;
-        }
-        ss << line_start << ":" << line_end << ":";
       }
-      auto* rtype = proto->get_rtype();
-      auto rtype_str = deobf_type(rtype);
-      ss << rtype_str;
-      ss << " " << method->get_simple_deobfuscated_name() << "(";
-      auto args = proto->get_args()->get_type_list();
-      for (auto iter = args.begin() ; iter != args.end() ; ++iter) {
-        auto* atype = *iter;
-        auto atype_str = deobf_type(atype);
-        ss << atype_str;
-        if (iter + 1 != args.end()) {
-          ss << ",";
-        }
+      // Treat anything bigger than 2^31 as 0
+      auto max_line =
+          static_cast<uint32_t>(std::numeric_limits<int32_t>::max());
+      if (line_start > max_line) {
+        line_start = 0;
       }
-      ss << ")";
-      return ss.str();
+      if (line_end > max_line) {
+        line_end = 0;
+      }
+      out += std::to_string(line_start);
+      out += ':';
+      out += std::to_string(line_end);
+      out += ':';
     }
-    return show(method);
-  };
-
-  auto deobf_field = [&](DexField* field) {
-    if (field) {
-      std::ostringstream ss;
-      ss << deobf_type(field->get_type())
-      << " "
-      << field->get_simple_deobfuscated_name();
-      return ss.str();
+    deobf_type(out, proto->get_rtype());
+    out += ' ';
+    out += method->get_simple_deobfuscated_name();
+    out += '(';
+    auto& args = proto->get_args()->get_type_list();
+    for (auto iter = args.begin() ; iter != args.end() ; ++iter) {
+      deobf_type(out, *iter);
+      if (iter + 1 != args.end()) {
+        out += ',';
+      }
     }
-    return show(field);
+    out += ')';
   };
 
-  std::ofstream ofs(filename.c_str(), std::ofstream::out | std::ofstream::app);
+  auto deobf_field = [&](std::string& out, DexField* field) {
+    deobf_type(out, field->get_type());
+    out += ' ';
+    out += field->get_simple_deobfuscated_name();
+  };
 
-  for (auto cls : *classes) {
-    auto deobf_cls = deobf_class(cls);
-    ofs << JavaNameUtil::internal_to_external(deobf_cls) << " -> "
-        << JavaNameUtil::internal_to_external(cls->get_type()->c_str())
-        << ":" << std::endl;
+  auto format = [&](size_t i, std::string& out) {
+    auto cls = classes->at(i);
+    deobf_class(out, cls);
+    out += " -> ";
+    auto name = cls->get_type()->get_name();
+    append_external(out, name->c_str(), name->size());
+    out += ":\n";
     for (auto field : cls->get_ifields()) {
-      auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      out += "    ";
+      deobf_field(out, field);
+      out += " -> ";
+      out += field->c_str();
+      out += '\n';
     }
     for (auto field : cls->get_sfields()) {
-      auto deobf = deobf_field(field);
-      ofs << "    " << deobf << " -> " << field->c_str() << std::endl;
+      out += "    ";
+      deobf_field(out, field);
+      out += " -> ";
+      out += field->c_str();
+      out += '\n';
     }
     for (auto meth : cls->get_dmethods()) {
-      auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      out += "    ";
+      deobf_meth(out, meth);
+      out += " -> ";
+      out += meth->c_str();
+      out += '\n';
     }
     for (auto meth : cls->get_vmethods()) {
-      auto deobf = deobf_meth(meth);
-      ofs << "    " << deobf << " -> " << meth->c_str() << std::endl;
+      out += "    ";
+      deobf_meth(out, meth);
+      out += " -> ";
+      out += meth->c_str();
+      out += '\n';
     }
-  }
+  };
+  append_formatted(filename, classes->size(), num_threads, format);
 }
 
 void write_bytecode_offset_mapping(
   const std::string& filename,
-  const std::vector<std::pair<std::string, uint32_t>>& method_offsets
+  const std::vector<std::pair<std::string, uint32_t>>& method_offsets,
+  size_t num_threads
 ) {
   if (filename.empty()) { return; }
 
-  auto fd = fopen(filename.c_str(), "a");
-  assert_log(fd, "Can't open bytecode offset file %s: %s\n",
-             filename.c_str(),
-             strerror(errno));
-
-  for (const auto& item : method_offsets) {
-    fprintf(fd, "%u %s\n", item.second, item.first.c_str());
-  }
-
-  fclose(fd);
+  append_formatted(filename, method_offsets.size(), num_threads,
+                   [&](size_t i, std::string& out) {
+                     const auto& item = method_offsets[i];
+                     out += std::to_string(item.second);
+                     out += ' ';
+                     out += item.first;
+                     out += '\n';
+                   });
 }
 
 } // namespace
@@ -2047,20 +2582,24 @@ void DexOutput::write_symbol_files() {
     dodx,
     m_classes,
     hdr.signature,
-    m_method_to_id
+    m_method_to_id,
+    m_num_threads
   );
   write_class_mapping(
     m_class_mapping_filename,
     m_classes,
     hdr.class_defs_size,
-    hdr.signature
+    hdr.signature,
+    m_num_threads
   );
   write_pg_mapping(
     m_pg_mapping_filename,
-    m_classes
+    m_classes,
+    m_num_threads
   );
   write_bytecode_offset_mapping(m_bytecode_offset_filename,
-                                m_method_bytecode_offsets);
+                                m_method_bytecode_offsets,
+                                m_num_threads);
 }
 
 void GatheredTypes::set_method_sorting_whitelisted_substrings(
@@ -2073,6 +2612,12 @@ void GatheredTypes::set_method_to_weight(
   m_method_to_weight = method_to_weight;
 }
 
+void GatheredTypes::set_method_weights(
+    const std::unordered_map<const DexMethodRef*, unsigned int>&
+        method_weights) {
+  m_method_weights = method_weights;
+}
+
 void DexOutput::prepare(SortMode string_mode,
                         const std::vector<SortMode>& code_mode,
                         const ConfigFiles& conf,
@@ -2081,30 +2626,67 @@ void DexOutput::prepare(SortMode string_mode,
   if (std::find(code_mode.begin(), code_mode.end(),
                 SortMode::METHOD_PROFILED_ORDER) != code_mode.end()) {
     m_gtypes->set_method_to_weight(conf.get_method_to_weight());
+    m_gtypes->set_method_weights(conf.get_method_weights());
     m_gtypes->set_method_sorting_whitelisted_substrings(
         conf.get_method_sorting_whitelisted_substrings());
   }
 
+  m_gtypes->set_coldstart(conf.get_coldstart_types(),
+                          conf.get_method_weights());
+
   fix_jumbos(m_classes, dodx);
   init_header_offsets(dex_magic);
   generate_static_values();
   generate_typelist_data();
   generate_string_data(string_mode);
   generate_code_items(code_mode);
-  generate_class_data_items();
+  // The class data items of the classes hold the offsets of the code items,
+  // so they follow them into coldstart order.
+  generate_class_data_items(
+      std::find(code_mode.begin(), code_mode.end(),
+                SortMode::COLDSTART_ORDER) != code_mode.end()
+          ? SortMode::COLDSTART_ORDER
+          : SortMode::DEFAULT);
   generate_type_data();
   generate_proto_data();
   generate_field_data();
   generate_method_data();
   generate_class_data();
   generate_annotations();
-  generate_debug_items();
+  // The code of this dex is final now, so the IODI callers can be found here
+  // instead of in a walk over all the dexes once they're written. Only
+  // recording them has to happen in order.
+  IODIMetadata::CallSites iodi_call_sites;
+  if (m_iodi_metadata) {
+    for (const auto& it : m_code_item_emits) {
+      m_iodi_metadata->find_callers(it.method, *it.code, &iodi_call_sites);
+    }
+  }
+  run_in_order(&DexEmissionOrder::debug_items, [&] {
+    if (m_iodi_metadata) {
+      m_iodi_metadata->add_callers(iodi_call_sites);
+    }
+    generate_debug_items();
+  });
   generate_map();
   align_output();
   finalize_header();
+  m_stats.num_coldstart_pages = m_coldstart_pages.size();
 }
 
 void DexOutput::write() {
+  if (m_mapped_output != nullptr) {
+    // Everything has already been emitted in place; all that's left is to
+    // cut the file down to the size of the dex.
+    m_mapped_output.reset();
+    m_output = nullptr;
+    always_assert_log(ftruncate(m_output_fd, m_offset) == 0,
+                      "Error writing dex %s: %s", m_filename, strerror(errno));
+    m_stats.num_bytes = m_offset;
+    run_in_order(&DexEmissionOrder::symbol_files,
+                 [this] { write_symbol_files(); });
+    return;
+  }
   struct stat st;
   int fd = open(m_filename, O_CREAT | O_TRUNC | O_WRONLY, 0660);
   if (fd == -1) {
@@ -2117,7 +2699,8 @@ void DexOutput::write() {
   }
   close(fd);
 
-  write_symbol_files();
+  run_in_order(&DexEmissionOrder::symbol_files,
+               [this] { write_symbol_files(); });
 }
 
 class UniqueReferences {
@@ -2137,6 +2720,11 @@ class UniqueReferences {
 UniqueReferences s_unique_references;
 
 void DexOutput::metrics() {
+  run_in_order(&DexEmissionOrder::metrics,
+               [this] { unique_reference_metrics(); });
+}
+
+void DexOutput::unique_reference_metrics() {
   if (s_unique_references.dexes++ == 1 && !m_normal_primary_dex) {
     // clear out info from first (primary) dex
     s_unique_references.strings.clear();
@@ -2194,6 +2782,8 @@ static SortMode make_sort_bytecode(const std::string& sort_bytecode) {
     return SortMode::CLINIT_FIRST;
   } else if (sort_bytecode == "method_profiled_order") {
     return SortMode::METHOD_PROFILED_ORDER;
+  } else if (sort_bytecode == "coldstart_order") {
+    return SortMode::COLDSTART_ORDER;
   } else {
     return SortMode::DEFAULT;
   }
@@ -2226,7 +2816,20 @@ dex_stats_t write_classes_to_dex(
     std::unordered_map<DexMethod*, uint64_t>* method_to_id,
     std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
     IODIMetadata* iodi_metadata,
-    const std::string& dex_magic) {
+    const std::string& dex_magic,
+    DexEmissionOrder* emission_order,
+    size_t emission_ticket) {
+  // However this dex ends, it mustn't hold up the ones emitted after it.
+  struct Abandon {
+    DexEmissionOrder* order;
+    size_t ticket;
+    ~Abandon() {
+      if (order != nullptr) {
+        order->abandon(ticket);
+      }
+    }
+  } abandon{emission_order, emission_ticket};
+
   const JsonWrapper& json_cfg = conf.get_json_config();
   auto method_mapping_filename =
       conf.metafile(json_cfg.get("method_mapping", std::string()));
@@ -2244,6 +2847,8 @@ dex_stats_t write_classes_to_dex(
     string_sort_mode = SortMode::CLASS_STRINGS;
   } else if (sort_strings == "class_order") {
     string_sort_mode = SortMode::CLASS_ORDER;
+  } else if (sort_strings == "coldstart_order") {
+    string_sort_mode = SortMode::COLDSTART_ORDER;
   }
 
   auto interdex_config = json_cfg.get("InterDexPass", Json::Value());
@@ -2265,23 +2870,30 @@ dex_stats_t write_classes_to_dex(
 
   TRACE(OPUT, 2, "[write_classes_to_dex][filename] %s\n", filename.c_str());
 
-  DexOutput dout = DexOutput(filename.c_str(),
-                             classes,
-                             locator_index,
-                             emit_name_based_locators,
-                             normal_primary_dex,
-                             store_number,
-                             dex_number,
-                             debug_info_kind,
-                             iodi_metadata,
-                             conf,
-                             pos_mapper,
-                             method_to_id,
-                             code_debug_lines,
-                             method_mapping_filename,
-                             class_mapping_filename,
-                             pg_mapping_filename,
-                             bytecode_offset_filename);
+  DexOutput dout(filename.c_str(),
+                 classes,
+                 locator_index,
+                 emit_name_based_locators,
+                 normal_primary_dex,
+                 store_number,
+                 dex_number,
+                 debug_info_kind,
+                 iodi_metadata,
+                 conf,
+                 pos_mapper,
+                 method_to_id,
+                 code_debug_lines,
+                 method_mapping_filename,
+                 class_mapping_filename,
+                 pg_mapping_filename,
+                 bytecode_offset_filename,
+                 // Dexes emitted concurrently already keep all the threads
+                 // busy.
+                 emission_order == nullptr
+                     ? walk::parallel::default_num_threads()
+                     : 1,
+                 json_cfg.get("mmap_dex_output", false));
+  dout.set_emission_order(emission_order, emission_ticket);
 
   dout.prepare(string_sort_mode, code_sort_mode, conf, dex_magic);
   dout.write();
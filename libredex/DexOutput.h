@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "ConfigFiles.h"
@@ -14,16 +17,17 @@
 #include "DexUtil.h"
 #include "Trace.h"
 #include "Pass.h"
+#include "PointerIndexMap.h"
 #include "ProguardMap.h"
 
 #include <locator.h>
 using facebook::Locator;
 
-typedef std::unordered_map<DexString*, uint32_t> dexstring_to_idx;
-typedef std::unordered_map<DexType*, uint16_t> dextype_to_idx;
-typedef std::unordered_map<DexProto*, uint32_t> dexproto_to_idx;
-typedef std::unordered_map<DexFieldRef*, uint32_t> dexfield_to_idx;
-typedef std::unordered_map<DexMethodRef*, uint32_t> dexmethod_to_idx;
+typedef PointerIndexMap<DexString*, uint32_t> dexstring_to_idx;
+typedef PointerIndexMap<DexType*, uint16_t> dextype_to_idx;
+typedef PointerIndexMap<DexProto*, uint32_t> dexproto_to_idx;
+typedef PointerIndexMap<DexFieldRef*, uint32_t> dexfield_to_idx;
+typedef PointerIndexMap<DexMethodRef*, uint32_t> dexmethod_to_idx;
 
 using LocatorIndex = std::unordered_map<DexString*, Locator>;
 LocatorIndex make_locator_index(DexStoresVector& stores,
@@ -34,6 +38,7 @@ enum class SortMode {
   CLASS_STRINGS,
   CLINIT_FIRST,
   METHOD_PROFILED_ORDER,
+  COLDSTART_ORDER,
   DEFAULT
 };
 
@@ -93,6 +98,79 @@ class DexOutputIdx {
 };
 
 class IODIMetadata;
+class MappedFile;
+
+/*
+ * A turnstile that runs a stage of work for each ticket 0, 1, 2, ... strictly
+ * in ticket order, whichever thread happens to get there first.
+ */
+class OrderedStage {
+ public:
+  template <typename Fn>
+  void run(size_t ticket, const Fn& fn) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [&] { return m_next_ticket == ticket; });
+    }
+    // Advance even if fn throws, or everyone behind us would wait forever.
+    struct Advance {
+      OrderedStage* stage;
+      ~Advance() {
+        {
+          std::lock_guard<std::mutex> lock(stage->m_mutex);
+          ++stage->m_next_ticket;
+        }
+        stage->m_cv.notify_all();
+      }
+    } advance{this};
+    fn();
+  }
+
+  /*
+   * Let `ticket` through without running anything, unless it has passed
+   * already.
+   */
+  void skip(size_t ticket) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [&] { return m_next_ticket >= ticket; });
+      if (m_next_ticket > ticket) {
+        return;
+      }
+      ++m_next_ticket;
+    }
+    m_cv.notify_all();
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  size_t m_next_ticket{0};
+};
+
+/*
+ * Several dexes can be emitted concurrently, but some of the state they
+ * update is shared: the PositionMapper hands out line numbers in the order
+ * positions are seen, IODIMetadata and the method-id / debug-line maps are
+ * plain containers, and the symbol files are appended to. Emitting every dex
+ * with the same DexEmissionOrder (and its serial position as the ticket) runs
+ * those stages in serial order, so the output is identical to a serial run.
+ *
+ * Tickets must be handed out to threads in increasing order; a thread holding
+ * ticket n may block until tickets < n have passed each stage. A dex that
+ * fails part way must still pass the stages it didn't get to, see abandon().
+ */
+struct DexEmissionOrder {
+  OrderedStage debug_items;
+  OrderedStage symbol_files;
+  OrderedStage metrics;
+
+  void abandon(size_t ticket) {
+    debug_items.skip(ticket);
+    symbol_files.skip(ticket);
+    metrics.skip(ticket);
+  }
+};
 
 dex_stats_t write_classes_to_dex(
     std::string filename,
@@ -106,7 +184,9 @@ dex_stats_t write_classes_to_dex(
     std::unordered_map<DexMethod*, uint64_t>* method_to_id,
     std::unordered_map<DexCode*, std::vector<DebugLineItem>>* code_debug_lines,
     IODIMetadata* iodi_metadata,
-    const std::string& dex_magic);
+    const std::string& dex_magic,
+    DexEmissionOrder* emission_order = nullptr,
+    size_t emission_ticket = 0);
 
 typedef bool (*cmp_dstring)(const DexString*, const DexString*);
 typedef bool (*cmp_dtype)(const DexType*, const DexType*);
@@ -150,11 +230,19 @@ class GatheredTypes {
   std::vector<DexFieldRef*> m_lfield;
   std::vector<DexMethodRef*> m_lmethod;
   DexClasses* m_classes;
+  // The number of threads used to gather and sort the components.
+  size_t m_num_threads;
   std::unordered_map<const DexString*, unsigned int> m_cls_load_strings;
   std::unordered_map<const DexString*, unsigned int> m_cls_strings;
   std::unordered_map<const DexMethod*, unsigned int> m_methods_in_cls_order;
   std::unordered_map<std::string, unsigned int> m_method_to_weight;
+  std::unordered_map<const DexMethodRef*, unsigned int> m_method_weights;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
+  // What coldstart touches of this dex, with the strings in the order that
+  // it's expected to touch them.
+  std::unordered_set<const DexClass*> m_coldstart_classes;
+  std::unordered_set<const DexMethod*> m_coldstart_methods;
+  std::unordered_map<const DexString*, unsigned int> m_coldstart_strings;
 
   void gather_components();
   dexstring_to_idx* get_string_index(cmp_dstring cmp = compare_dexstrings);
@@ -168,12 +256,13 @@ class GatheredTypes {
   void build_method_map();
 
  public:
-  GatheredTypes(DexClasses* classes);
+  GatheredTypes(DexClasses* classes, size_t num_threads = 1);
   DexOutputIdx* get_dodx(const uint8_t* base);
   template <class T = decltype(compare_dexstrings)>
   std::vector<DexString*> get_dexstring_emitlist(T cmp = compare_dexstrings);
   std::vector<DexString*> get_cls_order_dexstring_emitlist();
   std::vector<DexString*> keep_cls_strings_together_emitlist();
+  std::vector<DexString*> get_coldstart_dexstring_emitlist();
   std::vector<DexMethod*> get_dexmethod_emitlist();
 
   void gather_class(int num);
@@ -182,10 +271,33 @@ class GatheredTypes {
   void sort_dexmethod_emitlist_cls_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_clinit_order(std::vector<DexMethod*>& lmeth);
   void sort_dexmethod_emitlist_profiled_order(std::vector<DexMethod*>& lmeth);
+  void sort_dexmethod_emitlist_coldstart_order(std::vector<DexMethod*>& lmeth);
   void set_method_sorting_whitelisted_substrings(
       const std::unordered_set<std::string>& whitelisted_substrings);
   void set_method_to_weight(
       const std::unordered_map<std::string, unsigned int>& method_to_weight);
+  void set_method_weights(
+      const std::unordered_map<const DexMethodRef*, unsigned int>&
+          method_weights);
+
+  /*
+   * Coldstart touches the classes of this dex in `coldstart_types`, their
+   * <clinit>s and the methods with a profiled weight, and the type names and
+   * strings that these refer to.
+   */
+  void set_coldstart(
+      const std::vector<DexType*>& coldstart_types,
+      const std::unordered_map<const DexMethodRef*, unsigned int>&
+          method_weights);
+  bool is_coldstart(const DexClass* cls) const {
+    return m_coldstart_classes.count(cls);
+  }
+  bool is_coldstart(const DexMethod* method) const {
+    return m_coldstart_methods.count(method);
+  }
+  bool is_coldstart(const DexString* str) const {
+    return m_coldstart_strings.count(str);
+  }
 
   std::unordered_set<DexString*> index_type_names();
 };
@@ -227,10 +339,15 @@ class DexOutput {
   DexOutputIdx* dodx;
   GatheredTypes* m_gtypes;
   uint8_t* m_output;
+  // Only set when emitting directly into the mapped output file, until it
+  // is written.
+  std::unique_ptr<MappedFile> m_mapped_output;
+  int m_output_fd{-1};
   uint32_t m_offset;
   const char* m_filename;
   size_t m_store_number;
   size_t m_dex_number;
+  size_t m_num_threads;
   DebugInfoKind m_debug_info_kind;
   IODIMetadata* m_iodi_metadata;
   PositionMapper* m_pos_mapper;
@@ -245,6 +362,8 @@ class DexOutput {
   std::vector<std::pair<std::string, uint32_t>> m_method_bytecode_offsets;
   std::unordered_map<DexClass*, uint32_t> m_cdi_offsets;
   std::unordered_map<DexClass*, uint32_t> m_static_values;
+  // The pages of the output that hold what coldstart touches.
+  std::unordered_set<uint32_t> m_coldstart_pages;
   dex_header hdr;
   std::vector<dex_map_item> m_map_items;
   LocatorIndex* m_locator_index;
@@ -252,6 +371,17 @@ class DexOutput {
   bool m_normal_primary_dex;
   const ConfigFiles& m_config_files;
   std::unordered_set<std::string> m_method_sorting_whitelisted_substrings;
+  DexEmissionOrder* m_emission_order{nullptr};
+  size_t m_emission_ticket{0};
+
+  template <typename Fn>
+  void run_in_order(OrderedStage DexEmissionOrder::*stage, const Fn& fn) {
+    if (m_emission_order == nullptr) {
+      fn();
+    } else {
+      (m_emission_order->*stage).run(m_emission_ticket, fn);
+    }
+  }
 
   void insert_map_item(uint16_t typeidx, uint32_t size, uint32_t offset);
   void generate_string_data(SortMode mode = SortMode::DEFAULT);
@@ -260,7 +390,7 @@ class DexOutput {
   void generate_field_data();
   void generate_method_data();
   void generate_class_data();
-  void generate_class_data_items();
+  void generate_class_data_items(SortMode mode = SortMode::DEFAULT);
 
   // Sort code according to a sequence of sorting modes, ordered by precedence.
   // e.g. passing {SortMode::CLINIT_FIRST, SortMode::CLASS_ORDER} means that
@@ -287,7 +417,10 @@ class DexOutput {
   void finalize_header();
   void init_header_offsets(const std::string& dex_magic);
   void write_symbol_files();
+  void unique_reference_metrics();
   void align_output() { m_offset = (m_offset + 3) & ~3; }
+  void touch_coldstart_pages(uint32_t offset, uint32_t size);
+  void map_output(const char* path);
   void emit_locator(Locator locator);
   void emit_name_based_locators();
   std::unique_ptr<Locator> locator_for_descriptor(
@@ -311,8 +444,18 @@ class DexOutput {
             const std::string& method_mapping_path,
             const std::string& class_mapping_path,
             const std::string& pg_mapping_path,
-            const std::string& bytecode_offset_path);
+            const std::string& bytecode_offset_path,
+            size_t num_threads = 1,
+            bool mmap_output = false);
   ~DexOutput();
+  /*
+   * Opt in to running concurrently with other DexOutputs that share the same
+   * DexEmissionOrder. Must be called before prepare().
+   */
+  void set_emission_order(DexEmissionOrder* order, size_t ticket) {
+    m_emission_order = order;
+    m_emission_ticket = ticket;
+  }
   void prepare(SortMode string_mode,
                const std::vector<SortMode>& code_mode,
                const ConfigFiles& conf,
@@ -7,6 +7,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <boost/functional/hash.hpp>
 #include <json/json.h>
 
 #include "DexClass.h"
@@ -30,38 +31,118 @@ bool DexPosition::operator==(const DexPosition& that) const {
            *parent == *that.parent));
 }
 
+uint32_t DexPositionTable::intern(const Entry& entry) {
+  auto it = m_ids.find(entry);
+  if (it != m_ids.end()) {
+    return it->second;
+  }
+  uint32_t id = m_entries.size();
+  m_entries.push_back(entry);
+  m_ids.emplace(entry, id);
+  return id;
+}
+
+size_t DexPositionTable::EntryHash::operator()(const Entry& entry) const {
+  size_t seed = 0;
+  boost::hash_combine(seed, entry.method);
+  boost::hash_combine(seed, entry.file);
+  boost::hash_combine(seed, entry.line);
+  boost::hash_combine(seed, entry.parent);
+  return seed;
+}
+
 void RealPositionMapper::register_position(DexPosition* pos) {
-  m_pos_line_map[pos] = -1;
+  m_registered.emplace(pos);
+}
+
+uint32_t RealPositionMapper::intern(const DexPosition* pos) {
+  auto it = m_pos_ids.find(pos);
+  if (it != m_pos_ids.end()) {
+    return it->second;
+  }
+  auto parent = DexPositionTable::NO_PARENT;
+  if (pos->parent != nullptr) {
+    if (m_registered.count(pos->parent)) {
+      parent = intern(pos->parent);
+    } else {
+      std::cerr << "Parent position " << show(pos->parent) << " of "
+                << show(pos) << " was not registered" << std::endl;
+    }
+  }
+  auto id = m_table.intern({pos->method, pos->file, pos->line, parent});
+  m_pos_ids.emplace(pos, id);
+  return id;
 }
 
 uint32_t RealPositionMapper::get_line(DexPosition* pos) {
-  return m_pos_line_map.at(pos) + 1;
+  return intern(pos) + 1;
 }
 
 uint32_t RealPositionMapper::position_to_line(DexPosition* pos) {
-  auto idx = m_positions.size();
-  m_positions.emplace_back(pos);
-  m_pos_line_map[pos] = idx;
   return get_line(pos);
 }
 
 void RealPositionMapper::write_map() {
+  if (m_filename_v2 == "" && m_filename_v3 == "") {
+    return;
+  }
+  std::vector<std::string> string_pool;
+  std::vector<PositionMapItem> positions;
+  build_map(&string_pool, &positions);
   if (m_filename_v2 != "") {
-    write_map_v2();
+    write_map_v2(string_pool, positions);
+  }
+  if (m_filename_v3 != "") {
+    write_map_v3(string_pool, positions);
   }
 }
 
-void RealPositionMapper::write_map_v2() {
-  // to ensure that the line numbers in the Dex are as compact as possible,
-  // we put the emitted positions at the start of the list and rest at the end
-  for (auto item : m_pos_line_map) {
-    auto line = item.second;
-    if (line == -1) {
-      auto idx = m_positions.size();
-      m_positions.emplace_back(item.first);
-      m_pos_line_map[item.first] = idx;
+void RealPositionMapper::build_map(std::vector<std::string>* string_pool,
+                                   std::vector<PositionMapItem>* positions) {
+  // Only positions that were emitted, and their parents, are in the table;
+  // nothing in the dexes refers to the others.
+  std::unordered_map<std::string, uint32_t> string_ids;
+
+  auto id_of_string = [&](const std::string& s) -> uint32_t {
+    auto it = string_ids.find(s);
+    if (it == string_ids.end()) {
+      it = string_ids.emplace(s, string_pool->size()).first;
+      string_pool->push_back(s);
+    }
+    return it->second;
+  };
+
+  // Consecutive entries tend to come from the same method.
+  const DexString* last_method = nullptr;
+  uint32_t class_id = 0;
+  uint32_t method_id = 0;
+  positions->reserve(m_table.size());
+  for (const auto& entry : m_table.entries()) {
+    uint32_t parent_line =
+        entry.parent == DexPositionTable::NO_PARENT ? 0 : entry.parent + 1;
+    if (entry.method != last_method) {
+      // of the form "class_name.method_name:(arg_types)return_type"
+      const auto& full_method_name = entry.method->str();
+      // strip out the args and return type
+      auto qualified_method_name =
+          full_method_name.substr(0, full_method_name.find(":"));
+      auto class_name = JavaNameUtil::internal_to_external(
+          qualified_method_name.substr(0, qualified_method_name.rfind(".")));
+      auto method_name =
+          qualified_method_name.substr(qualified_method_name.rfind(".") + 1);
+      class_id = id_of_string(class_name);
+      method_id = id_of_string(method_name);
+      last_method = entry.method;
     }
+    auto file_id = id_of_string(entry.file->c_str());
+    positions->push_back(
+        PositionMapItem{class_id, method_id, file_id, entry.line, parent_line});
   }
+}
+
+void RealPositionMapper::write_map_v2(
+    const std::vector<std::string>& string_pool,
+    const std::vector<PositionMapItem>& positions) {
   /*
    * Map file layout:
    * 0xfaceb000 (magic number)
@@ -75,45 +156,6 @@ void RealPositionMapper::write_map_v2() {
    * string_length (4 bytes)
    * char[string_length]
    */
-  std::ostringstream pos_out;
-  std::unordered_map<std::string, uint32_t> string_ids;
-  std::vector<std::string> string_pool;
-
-  auto id_of_string = [&](const std::string& s) -> uint32_t {
-    if (string_ids.find(s) == string_ids.end()) {
-      string_ids[s] = string_pool.size();
-      string_pool.push_back(s);
-    }
-    return string_ids.at(s);
-  };
-
-  for (auto pos : m_positions) {
-    uint32_t parent_line = 0;
-    try {
-      parent_line = pos->parent == nullptr ? 0 : get_line(pos->parent);
-    } catch (std::out_of_range& e) {
-      std::cerr << "Parent position " << show(pos->parent) << " of "
-                << show(pos) << " was not registered" << std::endl;
-    }
-    // of the form "class_name.method_name:(arg_types)return_type"
-    const auto& full_method_name = pos->method->str();
-    // strip out the args and return type
-    auto qualified_method_name =
-        full_method_name.substr(0, full_method_name.find(":"));
-    auto class_name = JavaNameUtil::internal_to_external(
-        qualified_method_name.substr(0, qualified_method_name.rfind(".")));
-    auto method_name =
-        qualified_method_name.substr(qualified_method_name.rfind(".") + 1);
-    auto class_id = id_of_string(class_name);
-    auto method_id = id_of_string(method_name);
-    auto file_id = id_of_string(pos->file->c_str());
-    pos_out.write((const char*)&class_id, sizeof(class_id));
-    pos_out.write((const char*)&method_id, sizeof(method_id));
-    pos_out.write((const char*)&file_id, sizeof(file_id));
-    pos_out.write((const char*)&pos->line, sizeof(pos->line));
-    pos_out.write((const char*)&parent_line, sizeof(parent_line));
-  }
-
   std::ofstream ofs(m_filename_v2.c_str(),
                     std::ofstream::out | std::ofstream::trunc);
   uint32_t magic = 0xfaceb000; // serves as endianess check
@@ -122,24 +164,72 @@ void RealPositionMapper::write_map_v2() {
   ofs.write((const char*)&version, sizeof(version));
   uint32_t spool_count = string_pool.size();
   ofs.write((const char*)&spool_count, sizeof(spool_count));
-  for (auto s : string_pool) {
+  for (const auto& s : string_pool) {
     uint32_t ssize = s.size();
     ofs.write((const char*)&ssize, sizeof(ssize));
     ofs << s;
   }
-  uint32_t pos_count = m_positions.size();
+  uint32_t pos_count = positions.size();
+  ofs.write((const char*)&pos_count, sizeof(pos_count));
+  ofs.write((const char*)positions.data(),
+            positions.size() * sizeof(PositionMapItem));
+}
+
+void RealPositionMapper::write_map_v3(
+    const std::vector<std::string>& string_pool,
+    const std::vector<PositionMapItem>& positions) {
+  /*
+   * Map file layout, made to be used in place from a mapping of the file:
+   * 0xfaceb000 (magic number)
+   * version (4 bytes)
+   * string_pool_size (4 bytes)
+   * positions_size (4 bytes)
+   * string_offsets[string_pool_size + 1] (4 bytes each)
+   * positions[positions_size]
+   * string data
+   *
+   * String i spans [string_offsets[i], string_offsets[i + 1]), as offsets
+   * from the start of the file. Every field before the string data is 4-byte
+   * aligned.
+   */
+  uint32_t spool_count = string_pool.size();
+  uint32_t pos_count = positions.size();
+  std::vector<uint32_t> string_offsets;
+  string_offsets.reserve(spool_count + 1);
+  uint32_t offset = sizeof(uint32_t) * (4 + spool_count + 1) +
+                    pos_count * sizeof(PositionMapItem);
+  for (const auto& s : string_pool) {
+    string_offsets.push_back(offset);
+    offset += s.size();
+  }
+  string_offsets.push_back(offset);
+
+  std::ofstream ofs(m_filename_v3.c_str(),
+                    std::ofstream::out | std::ofstream::trunc);
+  uint32_t magic = 0xfaceb000; // serves as endianess check
+  ofs.write((const char*)&magic, sizeof(magic));
+  uint32_t version = 3;
+  ofs.write((const char*)&version, sizeof(version));
+  ofs.write((const char*)&spool_count, sizeof(spool_count));
   ofs.write((const char*)&pos_count, sizeof(pos_count));
-  ofs << pos_out.str();
+  ofs.write((const char*)string_offsets.data(),
+            string_offsets.size() * sizeof(uint32_t));
+  ofs.write((const char*)positions.data(),
+            positions.size() * sizeof(PositionMapItem));
+  for (const auto& s : string_pool) {
+    ofs << s;
+  }
 }
 
-PositionMapper* PositionMapper::make(const std::string& map_filename_v2) {
-  if (map_filename_v2 == "") {
+PositionMapper* PositionMapper::make(const std::string& map_filename_v2,
+                                     const std::string& map_filename_v3) {
+  if (map_filename_v2 == "" && map_filename_v3 == "") {
     // If no path is provided for the map, just pass the original line numbers
     // through to the output. This does mean that the line numbers will be
     // incorrect for inlined code.
     return new NoopPositionMapper();
   } else {
-    return new RealPositionMapper(map_filename_v2);
+    return new RealPositionMapper(map_filename_v2, map_filename_v3);
   }
 }
 
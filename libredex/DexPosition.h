@@ -8,16 +8,21 @@
 #pragma once
 
 #include <cstdint>
+#include <limits>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "MemoryAccounting.h"
+
 class DexClass;
 class DexMethod;
 class DexString;
 class DexDebugItem;
 
-struct DexPosition final {
+struct DexPosition final
+    : memory_accounting::Counted<memory_accounting::Entity::DexPosition> {
   DexString* method{nullptr};
   DexString* file{nullptr};
   uint32_t line;
@@ -38,7 +43,45 @@ class PositionMapper {
   virtual uint32_t position_to_line(DexPosition*) = 0;
   virtual void register_position(DexPosition* pos) = 0;
   virtual void write_map() = 0;
-  static PositionMapper* make(const std::string& map_filename_v2);
+  static PositionMapper* make(const std::string& map_filename_v2,
+                              const std::string& map_filename_v3 = "");
+};
+
+/*
+ * Positions interned by value. Positions with the same method, file, line and
+ * parent share one entry, named by its index in a dense array. Since a
+ * parent is itself referred to by its index, equal entries have structurally
+ * equal parent chains, just like DexPosition::operator==.
+ */
+class DexPositionTable {
+ public:
+  static constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+  struct Entry {
+    const DexString* method;
+    const DexString* file;
+    uint32_t line;
+    uint32_t parent; // index of the parent's entry, or NO_PARENT
+
+    bool operator==(const Entry& that) const {
+      return method == that.method && file == that.file &&
+             line == that.line && parent == that.parent;
+    }
+  };
+
+  // Returns the index of the entry equal to `entry`, adding it if needed.
+  uint32_t intern(const Entry& entry);
+
+  const std::vector<Entry>& entries() const { return m_entries; }
+  size_t size() const { return m_entries.size(); }
+
+ private:
+  struct EntryHash {
+    size_t operator()(const Entry& entry) const;
+  };
+
+  std::vector<Entry> m_entries;
+  std::unordered_map<Entry, uint32_t, EntryHash> m_ids;
 };
 
 /*
@@ -47,17 +90,42 @@ class PositionMapper {
  * PositionMapper produces a text file with this data, and the line numbers in
  * the Dex debug info indicate the line in this text file at which the real
  * position can be found.
+ *
+ * Positions are interned into a DexPositionTable, so identical positions --
+ * e.g. those of a callee that was inlined at the same callsite in several
+ * copies -- share one line of the map.
  */
+/*
+ * A position as written to the line map: ids into the string pool of the
+ * map, and the line of the parent position, or 0 if there is none.
+ */
+struct PositionMapItem {
+  uint32_t class_id;
+  uint32_t method_id;
+  uint32_t file_id;
+  uint32_t line;
+  uint32_t parent;
+};
+
 class RealPositionMapper : public PositionMapper {
   std::string m_filename_v2;
-  std::vector<DexPosition*> m_positions;
-  std::unordered_map<DexPosition*, int64_t> m_pos_line_map;
+  std::string m_filename_v3;
+  std::unordered_set<const DexPosition*> m_registered;
+  std::unordered_map<const DexPosition*, uint32_t> m_pos_ids;
+  DexPositionTable m_table;
  protected:
   uint32_t get_line(DexPosition*);
-  void write_map_v2();
+  uint32_t intern(const DexPosition*);
+  void build_map(std::vector<std::string>* string_pool,
+                 std::vector<PositionMapItem>* positions);
+  void write_map_v2(const std::vector<std::string>& string_pool,
+                    const std::vector<PositionMapItem>& positions);
+  void write_map_v3(const std::vector<std::string>& string_pool,
+                    const std::vector<PositionMapItem>& positions);
  public:
-  RealPositionMapper(const std::string& filename_v2)
-      : m_filename_v2(filename_v2) {}
+  RealPositionMapper(const std::string& filename_v2,
+                     const std::string& filename_v3 = "")
+      : m_filename_v2(filename_v2), m_filename_v3(filename_v3) {}
   DexString* get_source_file(const DexClass*) override;
   uint32_t position_to_line(DexPosition*) override;
   void register_position(DexPosition* pos) override;
@@ -4,6 +4,7 @@
  * This source code is licensed under the MIT license found in the
  * LICENSE file in the root directory of this source tree.
  */
+#include <atomic>
 #include <json/json.h>
 #include <iostream>
 #include <fstream>
@@ -25,7 +26,13 @@ bool DexStore::is_root_store() const {
   return m_metadata.get_id() == ROOT_STORE_NAME;
 }
 
+size_t DexStore::next_version() {
+  static std::atomic<size_t> s_version{0};
+  return ++s_version;
+}
+
 std::vector<DexClasses>& DexStore::get_dexen() {
+  mark_changed();
   return m_dexen;
 }
 
@@ -38,6 +45,7 @@ std::vector<std::string> DexStore::get_dependencies() const {
 }
 
 void DexStore::remove_classes(const DexClasses& classes) {
+  mark_changed();
   std::unordered_set<DexClass*> to_remove(classes.begin(), classes.end());
   for (auto& dex_classes : m_dexen) {
     dex_classes.erase(std::remove_if(dex_classes.begin(),
@@ -50,6 +58,7 @@ void DexStore::remove_classes(const DexClasses& classes) {
 }
 
 void DexStore::add_classes(DexClasses classes) {
+  mark_changed();
   m_dexen.push_back(std::move(classes));
 }
 
@@ -67,30 +76,37 @@ void DexMetadata::parse(const std::string& path) {
 }
 
 XStoreRefs::XStoreRefs(const DexStoresVector& stores) {
-  m_xstores.push_back(std::unordered_set<const DexType*>());
+  auto add_classes = [&](const DexClasses& classes, size_t store_idx) {
+    for (const auto& cls : classes) {
+      m_type_to_store.emplace(cls->get_type(), store_idx);
+    }
+  };
   m_stores.push_back(&stores[0]);
-  for (const auto& cls : stores[0].get_dexen()[0]) {
-    m_xstores.back().insert(cls->get_type());
-  }
+  add_classes(stores[0].get_dexen()[0], 0);
   m_root_stores = 1;
   if (stores[0].get_dexen().size() > 1) {
     m_root_stores++;
-    m_xstores.push_back(std::unordered_set<const DexType*>());
     m_stores.push_back(&stores[0]);
     for (size_t i = 1; i < stores[0].get_dexen().size(); i++) {
-      for (const auto& cls : stores[0].get_dexen()[i]) {
-        m_xstores.back().insert(cls->get_type());
-      }
+      add_classes(stores[0].get_dexen()[i], 1);
     }
   }
   for (size_t i = 1; i < stores.size(); i++) {
-    m_xstores.push_back(std::unordered_set<const DexType*>());
     m_stores.push_back(&stores[i]);
     for (const auto& classes : stores[i].get_dexen()) {
-      for (const auto& cls : classes) {
-        m_xstores.back().insert(cls->get_type());
-      }
+      add_classes(classes, m_stores.size() - 1);
+    }
+  }
+
+  size_t num_stores = m_stores.size();
+  m_illegal_stores.reserve(num_stores);
+  for (size_t store_idx = 0; store_idx < num_stores; store_idx++) {
+    boost::dynamic_bitset<> illegal(num_stores + 1);
+    for (size_t other_idx = 0; other_idx < num_stores; other_idx++) {
+      illegal[other_idx] = illegal_ref_between_stores(store_idx, other_idx);
     }
+    illegal.set(num_stores);
+    m_illegal_stores.push_back(std::move(illegal));
   }
 }
 
@@ -7,10 +7,13 @@
 
 #pragma once
 
+#include <boost/dynamic_bitset.hpp>
 #include <cstdlib>
 #include <cstring>
-#include <vector>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
 #include "DexClass.h"
 
 class DexStore;
@@ -37,6 +40,9 @@ class DexStore {
   DexMetadata m_metadata;
   std::string dex_magic = "";
   bool m_generated = false;
+  size_t m_version{next_version()};
+
+  static size_t next_version();
 
  public:
   DexStore(const DexMetadata metadata) :
@@ -58,6 +64,17 @@ class DexStore {
 
   void remove_classes(const DexClasses& classes);
   void add_classes(DexClasses classes);
+
+  /*
+   * Changes whenever classes may have been added to or removed from the
+   * store, or moved between its dexes: with add_classes(), remove_classes()
+   * and every call of the non-const get_dexen(), whose callers may edit the
+   * dexes. Versions are unique across stores. Code that holds on to the
+   * dexes and edits them after the scope was built again has to call
+   * mark_changed() itself.
+   */
+  size_t get_version() const { return m_version; }
+  void mark_changed() { m_version = next_version(); }
 };
 
 class DexStoreClassesIterator : public std::iterator<std::input_iterator_tag, DexClasses> {
@@ -69,16 +86,28 @@ class DexStoreClassesIterator : public std::iterator<std::input_iterator_tag, De
   store_iterator m_current_store;
   classes_iterator m_current_classes;
 
+  // The dexes of a store, without marking it changed.
+  static std::vector<DexClasses>& dexen_of(DexStore& store) {
+    return const_cast<std::vector<DexClasses>&>(
+        static_cast<const DexStore&>(store).get_dexen());
+  }
+
 public:
+  // The dexes can be edited through the iterator, so this marks every store
+  // changed; the const overload doesn't.
   DexStoreClassesIterator(std::vector<DexStore>& stores) :
     m_stores(stores),
     m_current_store(stores.begin()),
-    m_current_classes(m_current_store->get_dexen().begin()) { }
+    m_current_classes(dexen_of(*m_current_store).begin()) {
+    for (auto& store : stores) {
+      store.mark_changed();
+    }
+  }
 
   DexStoreClassesIterator(const std::vector<DexStore>& stores) :
     m_stores(const_cast<std::vector<DexStore>&>(stores)),
     m_current_store(m_stores.begin()),
-    m_current_classes(m_current_store->get_dexen().begin()) { }
+    m_current_classes(dexen_of(*m_current_store).begin()) { }
 
   DexStoreClassesIterator(std::vector<DexStore>& stores, store_iterator current_store, classes_iterator current_classes) :
     m_stores(stores),
@@ -88,20 +117,23 @@ public:
   DexStoreClassesIterator& operator++() {
     ++m_current_classes;
     while (m_current_store != m_stores.end() &&
-           m_current_classes != m_stores.back().get_dexen().end() &&
-           m_current_classes == m_current_store->get_dexen().end()) {
+           m_current_classes != dexen_of(m_stores.back()).end() &&
+           m_current_classes == dexen_of(*m_current_store).end()) {
       ++m_current_store;
-      m_current_classes = m_current_store->get_dexen().begin();
+      m_current_classes = dexen_of(*m_current_store).begin();
     }
     return *this;
   }
 
-  DexStoreClassesIterator begin() const { return DexStoreClassesIterator(m_stores); };
+  DexStoreClassesIterator begin() const {
+    return DexStoreClassesIterator(
+        m_stores, m_stores.begin(), dexen_of(m_stores.front()).begin());
+  };
   DexStoreClassesIterator end() const {
     return DexStoreClassesIterator(
       m_stores,
       m_stores.end(),
-      m_stores.back().get_dexen().end());
+      dexen_of(m_stores.back()).end());
   };
 
   bool operator==(const DexStoreClassesIterator& rhs) { return m_current_classes == rhs.m_current_classes; }
@@ -118,14 +150,13 @@ public:
 class XStoreRefs {
  private:
   /**
-   * Set of classes in each logical store. A primary DEX goes in its own
-   * bucket (first element in the array).
+   * The store of each class. A primary DEX goes in its own bucket (index 0).
+   * A class defined in several stores belongs to the first one.
    */
-  std::vector<std::unordered_set<const DexType*>> m_xstores;
+  std::unordered_map<const DexType*, size_t> m_type_to_store;
 
   /**
-   * Pointers to original stores in the same order as used to populate
-   * m_xstores
+   * Pointers to original stores, by store idx.
    */
   std::vector<const DexStore*> m_stores;
 
@@ -134,6 +165,18 @@ class XStoreRefs {
    */
   size_t m_root_stores;
 
+  /**
+   * For each store, the stores that its code may not refer to, as a bitset
+   * over store idxs. The extra last bit stands for classes that are no longer
+   * in any store, which no store may refer to.
+   */
+  std::vector<boost::dynamic_bitset<>> m_illegal_stores;
+
+  size_t get_store_idx_or_none(const DexType* type) const {
+    auto it = m_type_to_store.find(type);
+    return it == m_type_to_store.end() ? m_stores.size() : it->second;
+  }
+
  public:
   explicit XStoreRefs(const DexStoresVector& stores);
 
@@ -143,10 +186,10 @@ class XStoreRefs {
    * api.
    */
   size_t get_store_idx(const DexType* type) const {
-    for (size_t store_idx = 0; store_idx < m_xstores.size(); store_idx++) {
-      if (m_xstores[store_idx].count(type) > 0) return store_idx;
-    }
-    always_assert_log(false, "type %s not in the current APK", SHOW(type));
+    auto it = m_type_to_store.find(type);
+    always_assert_log(it != m_type_to_store.end(),
+                      "type %s not in the current APK", SHOW(type));
+    return it->second;
   }
 
   const DexStore* get_store(size_t idx) const { return m_stores[idx]; }
@@ -176,15 +219,38 @@ class XStoreRefs {
     if (type_class_internal(type) == nullptr) return false;
     // Temporary HACK: optimizations may leave references to dead classes and
     // if we just call get_store_idx() - as we should - the assert will fire...
-    size_t type_store_idx = 0;
-    for (; type_store_idx < m_xstores.size(); type_store_idx++) {
-      if (m_xstores[type_store_idx].count(type) > 0) break;
-    }
-    if ((store_idx >= m_xstores.size()) ||
-        (type_store_idx >= m_xstores.size())) {
+    size_t type_store_idx = get_store_idx_or_none(type);
+    if (store_idx >= m_stores.size()) {
       return type_store_idx > store_idx;
     }
-    return illegal_ref_between_stores(store_idx, type_store_idx);
+    return m_illegal_stores[store_idx].test(type_store_idx);
+  }
+
+  /**
+   * An empty set of referenced stores, for add_ref() and illegal_refs().
+   */
+  boost::dynamic_bitset<> make_refs() const {
+    return boost::dynamic_bitset<>(m_stores.size() + 1);
+  }
+
+  /**
+   * Add the store of 'type' to the stores referenced by some code, unless the
+   * type is defined outside of the APK.
+   */
+  void add_ref(const DexType* type, boost::dynamic_bitset<>* refs) const {
+    if (type_class_internal(type) != nullptr) {
+      refs->set(get_store_idx_or_none(type));
+    }
+  }
+
+  /**
+   * Whether code in the DexStore identified by 'store_idx' can't make all of
+   * the references in 'refs'. Same as illegal_ref() on each referenced type,
+   * but a single bitset intersection.
+   */
+  bool illegal_refs(size_t store_idx,
+                    const boost::dynamic_bitset<>& refs) const {
+    return m_illegal_stores[store_idx].intersects(refs);
   }
 
   bool illegal_ref_between_stores(size_t caller_store_idx,
@@ -6,6 +6,7 @@
  */
 
 #include "DexUtil.h"
+#include "WorkQueue.h"
 
 using TypeSet = std::set<const DexType*, dextypes_comparator>;
 
@@ -26,3 +27,21 @@ std::unordered_set<const DexType*> get_non_root_store_types(
     const DexStoresVector& stores,
     const TypeSet& types,
     bool include_primary_dex);
+
+/*
+ * Calls `fn(store_idx, store)` on each store, in parallel, a task per store.
+ * A store may only refer to its own classes and to those of the stores it
+ * depends on, so work that only changes the store it is given can run on all
+ * the module stores of an app at once, rather than one store after the other.
+ */
+template <class Stores, class StoreFn>
+void parallel_for_each_store(Stores& stores, StoreFn fn) {
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t store_idx) { fn(store_idx, stores[store_idx]); },
+      std::max<size_t>(1, std::min<size_t>(stores.size(),
+                                           workqueue_num_threads())));
+  for (size_t store_idx = 0; store_idx < stores.size(); ++store_idx) {
+    wq.add_item(store_idx);
+  }
+  wq.run_all();
+}
@@ -386,7 +386,45 @@ bool passes_args_through(IRInstruction* insn,
 }
 
 Scope build_class_scope(const DexStoresVector& stores) {
-  return build_class_scope(DexStoreClassesIterator(stores));
+  size_t size = 0;
+  for (const auto& store : stores) {
+    for (const auto& dex : store.get_dexen()) {
+      size += dex.size();
+    }
+  }
+  Scope scope;
+  scope.reserve(size);
+  for (const auto& store : stores) {
+    for (const auto& dex : store.get_dexen()) {
+      scope.insert(scope.end(), dex.begin(), dex.end());
+    }
+  }
+  return scope;
+}
+
+const Scope& get_class_scope(const DexStoresVector& stores) {
+  struct Cache {
+    // The address and version of each store the scope was built from.
+    std::vector<std::pair<const DexStore*, size_t>> stores;
+    Scope scope;
+  };
+  thread_local Cache cache;
+
+  bool valid = cache.stores.size() == stores.size();
+  for (size_t i = 0; valid && i < stores.size(); ++i) {
+    valid = cache.stores[i].first == &stores[i] &&
+            cache.stores[i].second == stores[i].get_version();
+  }
+  if (valid) {
+    return cache.scope;
+  }
+
+  cache.stores.clear();
+  for (const auto& store : stores) {
+    cache.stores.emplace_back(&store, store.get_version());
+  }
+  cache.scope = build_class_scope(stores);
+  return cache.scope;
 }
 
 void post_dexen_changes(const Scope& v, DexStoresVector& stores) {
@@ -446,13 +484,18 @@ void load_root_dexen(DexStore& store,
   // Sort all discovered dex files
   std::sort(dexen.begin(), dexen.end(), dex_comparator);
   // Load all discovered dex files
+  std::vector<std::string> dex_paths;
   for (const auto& dex : dexen) {
     if (verbose) {
       TRACE(MAIN, 1, "Loading %s\n", dex.string().c_str());
     }
-    // N.B. throaway stats for now
-    DexClasses classes =
-        load_classes_from_dex(dex.string().c_str(), balloon, support_dex_v37);
+    dex_paths.push_back(dex.string());
+  }
+  // N.B. throaway stats for now
+  std::vector<dex_stats_t> stats;
+  auto dex_classes =
+      load_classes_from_dexes(dex_paths, &stats, balloon, support_dex_v37);
+  for (auto& classes : dex_classes) {
     store.add_classes(std::move(classes));
   }
 }
@@ -514,6 +557,7 @@ dex_stats_t&
   lhs.field_refs_total_size += rhs.field_refs_total_size;
   lhs.num_dbg_items += rhs.num_dbg_items;
   lhs.dbg_total_size += rhs.dbg_total_size;
+  lhs.num_coldstart_pages += rhs.num_coldstart_pages;
   return lhs;
 }
 
@@ -370,6 +370,16 @@ Scope build_class_scope(const T& dexen) {
 };
 Scope build_class_scope(const DexStoresVector& stores);
 
+/**
+ * The same scope as build_class_scope(stores), kept from one call to the
+ * next until the version of a store changes (see DexStore::get_version()).
+ * The reference is to a cache of the calling thread, which the next call on
+ * that thread may rebuild: don't hold on to it across code that changes the
+ * stores. The PassManager marks the stores changed after each pass, so a
+ * pass can rely on it until it edits the dexes itself.
+ */
+const Scope& get_class_scope(const DexStoresVector& stores);
+
 /**
  * Posts the changes made to the Scope& object to the
  * Dexes.
@@ -485,6 +495,9 @@ struct dex_stats_t {
 
   int num_dbg_items = 0;
   int dbg_total_size = 0;
+
+  // How many pages of the dex coldstart is expected to touch.
+  int num_coldstart_pages = 0;
 };
 
 dex_stats_t&
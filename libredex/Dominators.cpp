@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Dominators.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "ControlFlow.h"
+#include "Debug.h"
+
+namespace cfg {
+
+constexpr uint32_t DominatorTree::NONE;
+
+namespace {
+
+// The edges along which the tree is built, and the ones going back towards
+// the root; for post-dominators, these are the edges of the reverse graph.
+const std::vector<Edge*>& forward_edges(const Block* block, bool post) {
+  return post ? block->preds() : block->succs();
+}
+
+const std::vector<Edge*>& backward_edges(const Block* block, bool post) {
+  return post ? block->succs() : block->preds();
+}
+
+Block* forward_block(const Edge* edge, bool post) {
+  return post ? edge->src() : edge->target();
+}
+
+Block* backward_block(const Edge* edge, bool post) {
+  return post ? edge->target() : edge->src();
+}
+
+} // namespace
+
+DominatorTree::DominatorTree(const ControlFlowGraph& cfg, bool post) {
+  const Block* root = post ? cfg.exit_block() : cfg.entry_block();
+  always_assert_log(root != nullptr,
+                    post ? "Post-dominators need an exit block, see "
+                           "calculate_exit_block()"
+                         : "Dominators need an entry block");
+
+  // Number the reachable blocks in preorder, and remember the parent of each
+  // of them in the depth-first spanning tree.
+  std::vector<uint32_t> parents;
+  auto discover = [&](const Block* block, uint32_t parent) {
+    auto id = block->id();
+    if (id >= m_indices.size()) {
+      m_indices.resize(std::max(id + 1, 2 * m_indices.size()), NONE);
+    }
+    if (m_indices[id] != NONE) {
+      return false;
+    }
+    m_indices[id] = m_blocks.size();
+    m_blocks.push_back(const_cast<Block*>(block));
+    parents.push_back(parent);
+    return true;
+  };
+  std::vector<std::pair<const Block*, size_t>> stack;
+  discover(root, 0);
+  stack.emplace_back(root, 0);
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    const auto& edges = forward_edges(top.first, post);
+    if (top.second == edges.size()) {
+      stack.pop_back();
+      continue;
+    }
+    const Block* next = forward_block(edges[top.second++], post);
+    if (discover(next, m_indices[top.first->id()])) {
+      stack.emplace_back(next, 0);
+    }
+  }
+  uint32_t n = m_blocks.size();
+
+  // Compute the semidominators in reverse preorder, with a path-compressed
+  // forest of the blocks processed so far for the evaluations.
+  std::vector<uint32_t> semi(n);
+  std::iota(semi.begin(), semi.end(), 0);
+  std::vector<uint32_t> labels(semi);
+  std::vector<uint32_t> ancestors(n, NONE);
+  std::vector<uint32_t> path;
+  auto eval = [&](uint32_t v) {
+    if (ancestors[v] == NONE) {
+      return v;
+    }
+    path.clear();
+    for (auto u = v; ancestors[ancestors[u]] != NONE; u = ancestors[u]) {
+      path.push_back(u);
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+      auto u = *it;
+      auto a = ancestors[u];
+      if (semi[labels[a]] < semi[labels[u]]) {
+        labels[u] = labels[a];
+      }
+      ancestors[u] = ancestors[a];
+    }
+    return labels[v];
+  };
+  for (uint32_t i = n - 1; i > 0; --i) {
+    for (const Edge* e : backward_edges(m_blocks[i], post)) {
+      auto v = index(backward_block(e, post));
+      if (v == NONE) {
+        continue;
+      }
+      semi[i] = std::min(semi[i], semi[eval(v)]);
+    }
+    ancestors[i] = parents[i];
+  }
+
+  // The immediate dominator of a block is the nearest common ancestor of its
+  // parent and its semidominator in the dominator tree.
+  m_idoms = std::move(parents);
+  for (uint32_t i = 1; i < n; ++i) {
+    auto idom = m_idoms[i];
+    while (idom > semi[i]) {
+      idom = m_idoms[idom];
+    }
+    m_idoms[i] = idom;
+  }
+
+  // Immediate dominators are visited before the blocks they dominate, so the
+  // blocks can be laid out in a preorder of the tree in a single pass once
+  // the subtree sizes are known.
+  m_tree_size.assign(n, 1);
+  for (uint32_t i = n - 1; i > 0; --i) {
+    m_tree_size[m_idoms[i]] += m_tree_size[i];
+  }
+  m_tree_in.assign(n, 0);
+  std::vector<uint32_t> next_child(n, 1);
+  for (uint32_t i = 1; i < n; ++i) {
+    auto& slot = next_child[m_idoms[i]];
+    m_tree_in[i] = slot;
+    slot += m_tree_size[i];
+    next_child[i] = m_tree_in[i] + 1;
+  }
+
+  // Dominance frontiers, from:
+  //    K. D. Cooper et.al. A Simple, Fast Dominance Algorithm.
+  // A block is in the frontier of every block on the tree path from each of
+  // its predecessors up to its immediate dominator, exclusive. The root has
+  // no immediate dominator, so the path goes all the way up for it.
+  std::vector<std::pair<uint32_t, uint32_t>> frontier_pairs;
+  std::vector<uint32_t> last_added(n, NONE);
+  for (uint32_t b = 0; b < n; ++b) {
+    auto stop = b == 0 ? NONE : m_idoms[b];
+    for (const Edge* e : backward_edges(m_blocks[b], post)) {
+      auto runner = index(backward_block(e, post));
+      while (runner != NONE && runner != stop) {
+        if (last_added[runner] == b) {
+          // The rest of the path was already walked from another predecessor.
+          break;
+        }
+        last_added[runner] = b;
+        frontier_pairs.emplace_back(runner, b);
+        runner = runner == 0 ? NONE : m_idoms[runner];
+      }
+    }
+  }
+  m_frontier_offsets.assign(n + 1, 0);
+  for (const auto& pair : frontier_pairs) {
+    ++m_frontier_offsets[pair.first + 1];
+  }
+  std::partial_sum(m_frontier_offsets.begin(), m_frontier_offsets.end(),
+                   m_frontier_offsets.begin());
+  m_frontiers.resize(frontier_pairs.size());
+  std::vector<uint32_t> next_frontier(m_frontier_offsets.begin(),
+                                      m_frontier_offsets.end() - 1);
+  for (const auto& pair : frontier_pairs) {
+    m_frontiers[next_frontier[pair.first]++] = m_blocks[pair.second];
+  }
+}
+
+uint32_t DominatorTree::index(const Block* block) const {
+  auto id = block->id();
+  return id < m_indices.size() ? m_indices[id] : NONE;
+}
+
+uint32_t DominatorTree::checked_index(const Block* block) const {
+  auto i = index(block);
+  always_assert_log(i != NONE, "B%zu is not reachable from B%zu", block->id(),
+                    root()->id());
+  return i;
+}
+
+Block* DominatorTree::common_dominator(const Block* a, const Block* b) const {
+  // Immediate dominators are numbered before the blocks they dominate, so
+  // moving up from the block with the larger number meets at the closest
+  // common dominator.
+  auto ia = checked_index(a);
+  auto ib = checked_index(b);
+  while (ia != ib) {
+    if (ia > ib) {
+      ia = m_idoms[ia];
+    } else {
+      ib = m_idoms[ib];
+    }
+  }
+  return m_blocks[ia];
+}
+
+} // namespace cfg
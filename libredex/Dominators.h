@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/range/iterator_range.hpp>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cfg {
+
+class Block;
+class ControlFlowGraph;
+
+/*
+ * The dominator tree of a ControlFlowGraph, or its post-dominator tree if
+ * `post` is true, in which case the graph must have an exit block (see
+ * ControlFlowGraph::calculate_exit_block()).
+ *
+ * The tree is computed with the semi-NCA algorithm from:
+ *    L. Georgiadis. Linear-Time Algorithms for Dominators and Related
+ *    Problems. PhD thesis, Princeton University, 2005.
+ * It keeps the semidominator pass of Lengauer-Tarjan, but derives the
+ * immediate dominators with a nearest common ancestor search, which is
+ * simpler and usually faster in practice. Unlike the iterative algorithm, it
+ * doesn't need several passes over loops.
+ *
+ * Only the blocks reachable from the root (the entry block, or the exit block
+ * on the reverse graph) are part of the tree. The tree refers to the blocks
+ * of the graph, but doesn't follow its changes; use
+ * ControlFlowGraph::dominators() to get an up-to-date one.
+ */
+class DominatorTree final {
+ public:
+  using Blocks = boost::iterator_range<Block* const*>;
+
+  explicit DominatorTree(const ControlFlowGraph& cfg, bool post = false);
+
+  Block* root() const { return m_blocks[0]; }
+
+  bool is_reachable(const Block* block) const {
+    return index(block) != NONE;
+  }
+
+  // The immediate dominator of a reachable block. The root is its own
+  // immediate dominator.
+  Block* idom(const Block* block) const {
+    return m_blocks[m_idoms[checked_index(block)]];
+  }
+
+  // Whether every path from the root to `b` goes through `a`. A block
+  // dominates itself.
+  bool dominates(const Block* a, const Block* b) const {
+    auto ia = checked_index(a);
+    auto ib = checked_index(b);
+    return m_tree_in[ia] <= m_tree_in[ib] &&
+           m_tree_in[ib] < m_tree_in[ia] + m_tree_size[ia];
+  }
+
+  bool strictly_dominates(const Block* a, const Block* b) const {
+    return a != b && dominates(a, b);
+  }
+
+  // The closest block that dominates both `a` and `b`.
+  Block* common_dominator(const Block* a, const Block* b) const;
+
+  // The blocks where the dominance of `block` stops: the blocks that have a
+  // predecessor dominated by `block`, without being strictly dominated by it.
+  Blocks frontier(const Block* block) const {
+    auto i = checked_index(block);
+    return Blocks(m_frontiers.data() + m_frontier_offsets[i],
+                  m_frontiers.data() + m_frontier_offsets[i + 1]);
+  }
+
+ private:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  uint32_t index(const Block* block) const;
+  uint32_t checked_index(const Block* block) const;
+
+  // The reachable blocks in preorder of the depth-first search from the root,
+  // which is how they are numbered.
+  std::vector<Block*> m_blocks;
+  // Indexed by BlockId.
+  std::vector<uint32_t> m_indices;
+  std::vector<uint32_t> m_idoms;
+  // The preorder number of every block in the tree itself, and the size of
+  // its subtree, so that the blocks it dominates are the ones numbered in
+  // [m_tree_in[i], m_tree_in[i] + m_tree_size[i]).
+  std::vector<uint32_t> m_tree_in;
+  std::vector<uint32_t> m_tree_size;
+  std::vector<uint32_t> m_frontier_offsets;
+  std::vector<Block*> m_frontiers;
+};
+
+/*
+ * Keeps the last DominatorTree computed for a graph, along with the version
+ * of the graph's edges and the root it was computed for.
+ */
+class DominatorTreeCache final {
+ public:
+  DominatorTreeCache() = default;
+
+  // Like WtoCache, a copy of a graph starts with an empty cache.
+  DominatorTreeCache(const DominatorTreeCache&) {}
+
+  DominatorTreeCache& operator=(const DominatorTreeCache&) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tree = nullptr;
+    return *this;
+  }
+
+  template <typename Builder>
+  std::shared_ptr<const DominatorTree> get(uint64_t version,
+                                           const Block* root,
+                                           Builder build) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tree == nullptr || m_version != version || m_root != root) {
+      m_tree = build();
+      m_version = version;
+      m_root = root;
+    }
+    return m_tree;
+  }
+
+ private:
+  std::mutex m_mutex;
+  uint64_t m_version{0};
+  const Block* m_root{nullptr};
+  std::shared_ptr<const DominatorTree> m_tree;
+};
+
+} // namespace cfg
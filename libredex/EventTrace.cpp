@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "EventTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace event_trace {
+
+namespace {
+
+struct Event {
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  const char* category;
+  char name[Span::kMaxNameLength + 1];
+};
+
+/*
+ * The spans of one thread. Only the thread appends to it; the buffers
+ * outlive their threads so that the spans of finished workers are written
+ * too.
+ */
+struct Buffer {
+  explicit Buffer(size_t capacity, size_t tid) : events(capacity), tid(tid) {}
+
+  std::vector<Event> events;
+  std::atomic<size_t> num_recorded{0};
+  size_t tid;
+};
+
+std::chrono::steady_clock::time_point s_epoch;
+size_t s_events_per_thread;
+uint64_t s_min_duration_ns;
+
+std::mutex s_buffers_lock;
+std::vector<std::unique_ptr<Buffer>> s_buffers;
+
+thread_local Buffer* t_buffer{nullptr};
+thread_local const char* t_current_span{nullptr};
+
+Buffer& thread_buffer() {
+  if (t_buffer == nullptr) {
+    std::lock_guard<std::mutex> guard(s_buffers_lock);
+    s_buffers.emplace_back(
+        std::make_unique<Buffer>(s_events_per_thread, s_buffers.size()));
+    t_buffer = s_buffers.back().get();
+  }
+  return *t_buffer;
+}
+
+void write_escaped(FILE* out, const char* str) {
+  for (; *str != '\0'; ++str) {
+    auto c = static_cast<unsigned char>(*str);
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+}
+
+} // namespace
+
+namespace detail {
+
+std::atomic<bool> s_enabled{false};
+
+uint64_t now() {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - s_epoch)
+                .count();
+  // Zero is taken to mean that a span isn't recorded.
+  return std::max<uint64_t>(1, ns);
+}
+
+} // namespace detail
+
+void enable(size_t events_per_thread, uint64_t min_duration_us) {
+  if (is_enabled()) {
+    return;
+  }
+  s_epoch = std::chrono::steady_clock::now();
+  s_events_per_thread = std::max<size_t>(1, events_per_thread);
+  s_min_duration_ns = min_duration_us * 1000;
+  detail::s_enabled.store(true, std::memory_order_release);
+}
+
+const char* current_span() { return t_current_span; }
+
+void Span::start(const char* category, const char* name) {
+  m_category = category;
+  strncpy(m_name, name, kMaxNameLength);
+  m_name[kMaxNameLength] = '\0';
+  m_parent = t_current_span;
+  t_current_span = m_name;
+  m_start_ns = detail::now();
+}
+
+void Span::end() {
+  auto duration_ns = detail::now() - m_start_ns;
+  t_current_span = m_parent;
+  if (duration_ns < s_min_duration_ns) {
+    return;
+  }
+  auto& buffer = thread_buffer();
+  auto n = buffer.num_recorded.load(std::memory_order_relaxed);
+  auto& event = buffer.events[n % buffer.events.size()];
+  event.start_ns = m_start_ns;
+  event.duration_ns = duration_ns;
+  event.category = m_category;
+  memcpy(event.name, m_name, sizeof(m_name));
+  buffer.num_recorded.store(n + 1, std::memory_order_release);
+}
+
+bool write_chrome_trace(const std::string& path) {
+  FILE* out = fopen(path.c_str(), "w");
+  if (out == nullptr) {
+    return false;
+  }
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  const char* sep = "\n";
+  std::lock_guard<std::mutex> guard(s_buffers_lock);
+  for (const auto& buffer : s_buffers) {
+    auto n = buffer->num_recorded.load(std::memory_order_acquire);
+    auto size = buffer->events.size();
+    // The ring only keeps the last spans of the thread.
+    auto dropped = n > size ? n - size : 0;
+    fprintf(out,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%zu,"
+            "\"args\":{\"name\":\"thread %zu\",\"dropped_spans\":%zu}}",
+            sep, buffer->tid, buffer->tid, dropped);
+    sep = ",\n";
+    for (auto i = dropped; i < n; ++i) {
+      const auto& event = buffer->events[i % size];
+      fprintf(out, ",\n{\"name\":\"");
+      write_escaped(out, event.name);
+      fprintf(out, "\",\"cat\":\"");
+      write_escaped(out, event.category);
+      fprintf(out,
+              "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,"
+              "\"tid\":%zu}",
+              event.start_ns / 1000.0, event.duration_ns / 1000.0,
+              buffer->tid);
+    }
+  }
+  fprintf(out, "\n]}\n");
+  return fclose(out) == 0;
+}
+
+} // namespace event_trace
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Spans of time -- passes, timers, parallel walks and the time each worker
+ * spends in them -- recorded for all threads and written out in the Chrome
+ * trace format, which chrome://tracing and Perfetto load.
+ *
+ * Unlike TRACE, this is there in release builds too. Until enable() is
+ * called a span costs one relaxed load. After that, each thread appends
+ * its spans to a ring buffer of its own without taking a lock, and the ring
+ * keeps only the last spans of the thread if there are too many.
+ */
+namespace event_trace {
+
+namespace detail {
+extern std::atomic<bool> s_enabled;
+// Nanoseconds since enable().
+uint64_t now();
+} // namespace detail
+
+/*
+ * Starts recording. Each thread keeps its last `events_per_thread` spans;
+ * spans shorter than `min_duration_us` are dropped as they end, so that
+ * fine-grained spans don't push the long ones out of the ring.
+ */
+void enable(size_t events_per_thread = 1 << 16, uint64_t min_duration_us = 0);
+
+inline bool is_enabled() {
+  return detail::s_enabled.load(std::memory_order_relaxed);
+}
+
+/*
+ * Writes the spans of all threads to `path`. Spans that haven't ended yet
+ * are left out; no span may end while this runs.
+ */
+bool write_chrome_trace(const std::string& path);
+
+/*
+ * The name of the innermost span of the calling thread, or nullptr. Workers
+ * name their spans after the one that started them.
+ */
+const char* current_span();
+
+class Span {
+ public:
+  // `category` has to outlive the span; a string literal, say.
+  Span(const char* category, const char* name) {
+    if (is_enabled()) {
+      start(category, name);
+    }
+  }
+  Span(const char* category, const std::string& name)
+      : Span(category, name.c_str()) {}
+  ~Span() {
+    if (m_start_ns != 0) {
+      end();
+    }
+  }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  static constexpr size_t kMaxNameLength = 63;
+
+ private:
+  void start(const char* category, const char* name);
+  void end();
+
+  const char* m_category{nullptr};
+  const char* m_parent{nullptr};
+  uint64_t m_start_ns{0};
+  char m_name[kMaxNameLength + 1];
+};
+
+} // namespace event_trace
@@ -7,6 +7,9 @@
 
 #include "FieldOpTracker.h"
 
+#include <atomic>
+#include <memory>
+
 #include "Resolver.h"
 #include "Walkers.h"
 
@@ -18,26 +21,60 @@ bool is_own_init(DexField* field, const DexMethod* method) {
 }
 
 FieldStatsMap analyze(const Scope& scope) {
-  FieldStatsMap field_stats;
-  // Gather the read/write counts.
-  walk::opcodes(scope, [&](const DexMethod* method, const IRInstruction* insn) {
-    auto op = insn->opcode();
-    if (!insn->has_field()) {
-      return;
-    }
-    auto field = resolve_field(insn->get_field());
-    if (field == nullptr) {
-      return;
-    }
-    if (is_sget(op) || is_iget(op)) {
-      ++field_stats[field].reads;
-      if (!is_own_init(field, method)) {
-        ++field_stats[field].reads_outside_init;
+  // The counts are gathered in a table over the dense field ids, so that the
+  // threads only ever touch their own fields' slots.
+  struct Counts {
+    std::atomic<DexField*> field{nullptr};
+    std::atomic<size_t> reads{0};
+    std::atomic<size_t> reads_outside_init{0};
+    std::atomic<size_t> writes{0};
+    std::atomic<size_t> writes_outside_init{0};
+  };
+  auto num_fields = g_redex->num_field_ids();
+  std::unique_ptr<Counts[]> counts(new Counts[num_fields]);
+
+  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (!insn->has_field()) {
+        continue;
+      }
+      auto field = resolve_field(insn->get_field());
+      if (field == nullptr) {
+        continue;
+      }
+      auto op = insn->opcode();
+      always_assert(field->get_dense_id() < num_fields);
+      auto& field_counts = counts[field->get_dense_id()];
+      if (is_sget(op) || is_iget(op)) {
+        field_counts.field = field;
+        ++field_counts.reads;
+        if (!is_own_init(field, method)) {
+          ++field_counts.reads_outside_init;
+        }
+      } else if (is_sput(op) || is_iput(op)) {
+        field_counts.field = field;
+        ++field_counts.writes;
+        if (!is_own_init(field, method)) {
+          ++field_counts.writes_outside_init;
+        }
       }
-    } else if (is_sput(op) || is_iput(op)) {
-      ++field_stats[field].writes;
     }
   });
+
+  FieldStatsMap field_stats;
+  for (size_t id = 0; id < num_fields; ++id) {
+    const auto& field_counts = counts[id];
+    auto field = field_counts.field.load();
+    if (field == nullptr) {
+      continue;
+    }
+    auto& stats = field_stats[field];
+    stats.reads = field_counts.reads;
+    stats.reads_outside_init = field_counts.reads_outside_init;
+    stats.writes = field_counts.writes;
+    stats.writes_outside_init = field_counts.writes_outside_init;
+  }
   return field_stats;
 }
 
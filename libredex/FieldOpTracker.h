@@ -8,8 +8,7 @@
 #pragma once
 
 #include "DexClass.h"
-
-#include <unordered_map>
+#include "IdMap.h"
 
 namespace field_op_tracker {
 
@@ -21,10 +20,17 @@ struct FieldStats {
   size_t reads_outside_init{0};
   // Number of instructions which write a field in the entire program.
   size_t writes{0};
+  // Number of instructions which write this field outside of a <clinit> or
+  // <init>.
+  size_t writes_outside_init{0};
 };
 
-using FieldStatsMap = std::unordered_map<DexField*, FieldStats>;
+using FieldStatsMap = IdMap<DexField*, FieldStats>;
 
+/*
+ * Counts the reads and writes of the fields of the program, in one parallel
+ * sweep over its code. Only the fields that are read or written have stats.
+ */
 FieldStatsMap analyze(const Scope& scope);
 
 }
@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/*
+ * A pool allocator for objects of a single size, meant to back the
+ * class-specific operator new / delete of the IR's node types.
+ *
+ * Each thread carves nodes out of 64KiB chunks and keeps a private free list,
+ * so allocation is a pointer bump or a pop without any locking in the common
+ * case, and nodes created together (say, while ballooning a method) end up
+ * next to each other in memory. Nodes may be freed by any thread; they go to
+ * that thread's free list. When a thread exits, its free list is donated to a
+ * shared list from which other threads refill.
+ *
+ * Chunks are never returned to the system. IR nodes are freed individually
+ * and move freely between methods, so there is no point at which a whole
+ * chunk is known to be dead; freed nodes are recycled instead.
+ */
+template <size_t NodeSize, size_t NodeAlign = alignof(std::max_align_t)>
+class FixedSizeAllocator {
+  union FreeNode {
+    FreeNode* next;
+    alignas(NodeAlign) char storage[NodeSize];
+  };
+
+  static constexpr size_t NODES_PER_CHUNK =
+      std::max<size_t>(1, (64 * 1024) / sizeof(FreeNode));
+
+ public:
+  static void* allocate() {
+    auto& cache = local_cache();
+    if (cache.free == nullptr) {
+      cache.free = shared_pool().take_all();
+    }
+    if (cache.free != nullptr) {
+      FreeNode* node = cache.free;
+      cache.free = node->next;
+      return node;
+    }
+    if (cache.bump == cache.bump_end) {
+      cache.bump = shared_pool().new_chunk();
+      cache.bump_end = cache.bump + NODES_PER_CHUNK;
+    }
+    return cache.bump++;
+  }
+
+  static void deallocate(void* ptr) {
+    auto& cache = local_cache();
+    auto node = static_cast<FreeNode*>(ptr);
+    node->next = cache.free;
+    cache.free = node;
+  }
+
+ private:
+  class SharedPool {
+   public:
+    FreeNode* new_chunk() {
+      std::unique_ptr<FreeNode[]> chunk(new FreeNode[NODES_PER_CHUNK]);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_chunks.emplace_back(std::move(chunk));
+      return m_chunks.back().get();
+    }
+
+    FreeNode* take_all() {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      FreeNode* result = m_free;
+      m_free = nullptr;
+      return result;
+    }
+
+    void give(FreeNode* head, FreeNode* tail) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      tail->next = m_free;
+      m_free = head;
+    }
+
+   private:
+    std::mutex m_mutex;
+    FreeNode* m_free{nullptr};
+    std::vector<std::unique_ptr<FreeNode[]>> m_chunks;
+  };
+
+  struct LocalCache {
+    FreeNode* free{nullptr};
+    FreeNode* bump{nullptr};
+    FreeNode* bump_end{nullptr};
+
+    ~LocalCache() {
+      // Hand back the unused part of the current chunk along with the free
+      // list, so the memory isn't lost with the thread.
+      for (; bump != bump_end; ++bump) {
+        bump->next = free;
+        free = bump;
+      }
+      if (free == nullptr) {
+        return;
+      }
+      FreeNode* tail = free;
+      while (tail->next != nullptr) {
+        tail = tail->next;
+      }
+      shared_pool().give(free, tail);
+    }
+  };
+
+  static SharedPool& shared_pool() {
+    // Leaked on purpose: thread-local caches may still be returning nodes to
+    // it during static destruction.
+    static auto* pool = new SharedPool();
+    return *pool;
+  }
+
+  static LocalCache& local_cache() {
+    static thread_local LocalCache cache;
+    return cache;
+  }
+};
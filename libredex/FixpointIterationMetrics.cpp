@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FixpointIterationMetrics.h"
+
+#include <algorithm>
+
+#include "DexClass.h"
+#include "PassManager.h"
+#include "Show.h"
+#include "Trace.h"
+
+void FixpointIterationMetrics::add(
+    const DexMethod* method,
+    const sparta::MonotonicFixpointIteratorStats& stats) {
+  size_t bucket = 0;
+  while (bucket < NUM_BUCKETS - 1 &&
+         (uint32_t(1) << bucket) < stats.max_iterations) {
+    ++bucket;
+  }
+  ++m_histogram[bucket];
+  m_analyzed_nodes += stats.analyzed_nodes;
+  if (stats.exhausted_sccs > 0) {
+    ++m_budget_exceeded;
+    TRACE(PM, 1, "%s ran out of fixpoint iteration budget in %lu SCC(s)\n",
+          SHOW(method), stats.exhausted_sccs);
+  }
+  add_worst(stats.max_iterations, method);
+}
+
+void FixpointIterationMetrics::add_worst(uint32_t iterations,
+                                         const DexMethod* method) {
+  if (m_worst_methods.size() == NUM_WORST_METHODS &&
+      iterations <= m_worst_methods.back().first) {
+    return;
+  }
+  auto pos = std::upper_bound(
+      m_worst_methods.begin(), m_worst_methods.end(), iterations,
+      [](uint32_t i, const std::pair<uint32_t, const DexMethod*>& entry) {
+        return i > entry.first;
+      });
+  m_worst_methods.emplace(pos, iterations, method);
+  if (m_worst_methods.size() > NUM_WORST_METHODS) {
+    m_worst_methods.pop_back();
+  }
+}
+
+FixpointIterationMetrics FixpointIterationMetrics::operator+(
+    const FixpointIterationMetrics& that) const {
+  FixpointIterationMetrics result = *this;
+  for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+    result.m_histogram[i] += that.m_histogram[i];
+  }
+  result.m_analyzed_nodes += that.m_analyzed_nodes;
+  result.m_budget_exceeded += that.m_budget_exceeded;
+  for (const auto& entry : that.m_worst_methods) {
+    result.add_worst(entry.first, entry.second);
+  }
+  return result;
+}
+
+void FixpointIterationMetrics::report(const std::string& prefix,
+                                      PassManager& mgr) const {
+  mgr.set_metric(prefix + "_analyzed_nodes", m_analyzed_nodes);
+  for (size_t i = 0; i < NUM_BUCKETS - 1; ++i) {
+    mgr.set_metric(prefix + "_iterations_le_" + std::to_string(1 << i),
+                   m_histogram[i]);
+  }
+  mgr.set_metric(
+      prefix + "_iterations_gt_" + std::to_string(1 << (NUM_BUCKETS - 2)),
+      m_histogram[NUM_BUCKETS - 1]);
+  mgr.set_metric(prefix + "_max_iterations",
+                 m_worst_methods.empty() ? 0 : m_worst_methods.front().first);
+  mgr.set_metric(prefix + "_budget_exceeded", m_budget_exceeded);
+  if (traceEnabled(PM, 2)) {
+    for (const auto& entry : m_worst_methods) {
+      TRACE(PM, 2, "%s: %u fixpoint iterations in %s\n", prefix.c_str(),
+            entry.first, SHOW(entry.second));
+    }
+  }
+}
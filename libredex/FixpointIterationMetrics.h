@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MonotonicFixpointIterator.h"
+
+class DexMethod;
+class PassManager;
+
+/*
+ * Sums up the iteration statistics of an intraprocedural fixpoint iterator
+ * over all the methods a pass analyzes, and reports them as metrics of the
+ * pass:
+ *
+ *   <prefix>_analyzed_nodes       node transformer applications;
+ *   <prefix>_iterations_le_<n>    methods whose slowest SCC needed at most n
+ *                                 iterations (n = 1, 2, 4, ..., 64);
+ *   <prefix>_iterations_gt_64     the other methods;
+ *   <prefix>_max_iterations       the largest count over all methods;
+ *   <prefix>_budget_exceeded      methods that had an SCC set to Top because
+ *                                 it ran out of iteration budget.
+ *
+ * The slowest methods and the ones that exceeded the budget are traced.
+ *
+ * It is meant to be the output of walk::parallel::reduce_methods, hence the
+ * value semantics and operator+.
+ */
+class FixpointIterationMetrics {
+ public:
+  void add(const DexMethod* method,
+           const sparta::MonotonicFixpointIteratorStats& stats);
+
+  FixpointIterationMetrics operator+(
+      const FixpointIterationMetrics& that) const;
+
+  void report(const std::string& prefix, PassManager& mgr) const;
+
+ private:
+  // Buckets for 1, 2, 4, ..., 64 and more iterations.
+  static constexpr size_t NUM_BUCKETS = 8;
+  static constexpr size_t NUM_WORST_METHODS = 10;
+
+  void add_worst(uint32_t iterations, const DexMethod* method);
+
+  std::array<size_t, NUM_BUCKETS> m_histogram{};
+  size_t m_analyzed_nodes{0};
+  size_t m_budget_exceeded{0};
+  // The methods that needed the most iterations, slowest first.
+  std::vector<std::pair<uint32_t, const DexMethod*>> m_worst_methods;
+};
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FlatCFG.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace cfg {
+
+constexpr uint32_t FlatCFG::NONE;
+
+FlatCFG::FlatCFG(const ControlFlowGraph& cfg) {
+  const Block* entry = cfg.entry_block();
+  always_assert(entry != nullptr);
+
+  // Number the reachable blocks in postorder with an iterative DFS, then
+  // reverse the numbering.
+  std::vector<bool> visited;
+  auto visit = [&visited](const Block* block) {
+    auto id = block->id();
+    if (id >= visited.size()) {
+      visited.resize(std::max(id + 1, 2 * visited.size()), false);
+    }
+    bool was_visited = visited[id];
+    visited[id] = true;
+    return !was_visited;
+  };
+  std::vector<std::pair<const Block*, size_t>> stack;
+  visit(entry);
+  stack.emplace_back(entry, 0);
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    const auto& succs = top.first->succs();
+    if (top.second < succs.size()) {
+      const Block* next = succs[top.second++]->target();
+      if (visit(next)) {
+        stack.emplace_back(next, 0);
+      }
+      continue;
+    }
+    m_blocks.push_back(const_cast<Block*>(top.first));
+    stack.pop_back();
+  }
+  std::reverse(m_blocks.begin(), m_blocks.end());
+
+  m_nodes.assign(visited.size(), NONE);
+  for (NodeId n = 0; n < m_blocks.size(); ++n) {
+    m_nodes[m_blocks[n]->id()] = n;
+  }
+  if (cfg.exit_block() != nullptr) {
+    m_exit = node(cfg.exit_block());
+  }
+
+  // Every successor edge of a reachable block ends at a reachable block, so
+  // numbering the successor edges numbers all the edges of the view.
+  size_t num_blocks = m_blocks.size();
+  m_succ_offsets.reserve(num_blocks + 1);
+  m_insn_offsets.reserve(num_blocks + 1);
+  std::vector<uint32_t> num_preds(num_blocks, 0);
+  for (NodeId n = 0; n < num_blocks; ++n) {
+    const Block* block = m_blocks[n];
+    m_succ_offsets.push_back(m_edges.size());
+    for (Edge* e : block->succs()) {
+      NodeId target = m_nodes[e->target()->id()];
+      m_succ_edges.push_back(m_edges.size());
+      m_edges.push_back(e);
+      m_edge_srcs.push_back(n);
+      m_edge_targets.push_back(target);
+      ++num_preds[target];
+    }
+    m_insn_offsets.push_back(m_insns.size());
+    for (const auto& mie : *block) {
+      if (mie.type == MFLOW_OPCODE) {
+        m_insns.push_back(mie.insn);
+      }
+    }
+  }
+  m_succ_offsets.push_back(m_edges.size());
+  m_insn_offsets.push_back(m_insns.size());
+
+  // Lay out the predecessor edges with a counting sort by target. Edges are
+  // visited in order of their source, so the predecessors of a block keep the
+  // relative order of their sources, not the one of Block::preds().
+  m_pred_offsets.resize(num_blocks + 1, 0);
+  for (NodeId n = 0; n < num_blocks; ++n) {
+    m_pred_offsets[n + 1] = m_pred_offsets[n] + num_preds[n];
+  }
+  m_pred_edges.resize(m_edges.size());
+  std::vector<uint32_t> next(m_pred_offsets.begin(), m_pred_offsets.end() - 1);
+  for (EdgeId e = 0; e < m_edges.size(); ++e) {
+    m_pred_edges[next[m_edge_targets[e]]++] = e;
+  }
+}
+
+} // namespace cfg
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/range/iterator_range.hpp>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "Debug.h"
+#include "WeakTopologicalOrdering.h"
+
+namespace cfg {
+
+/*
+ * An immutable, index-based snapshot of a ControlFlowGraph, for analyses that
+ * only read the graph.
+ *
+ * The blocks reachable from the entry block are numbered densely in reverse
+ * postorder, so the entry block is always 0. Edges are numbered by their
+ * source block. The predecessors and successors of every block, as well as
+ * its instructions, are contiguous slices of a few shared arrays, which
+ * avoids chasing the pointers of the editable representation.
+ *
+ * The view refers to the Blocks, Edges and instructions of the original
+ * graph, which must outlive it and must not be modified while it's in use.
+ */
+class FlatCFG final {
+ public:
+  using NodeId = uint32_t;
+  using EdgeId = uint32_t;
+  using Ids = boost::iterator_range<const uint32_t*>;
+  using Instructions = boost::iterator_range<IRInstruction* const*>;
+
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  explicit FlatCFG(const ControlFlowGraph& cfg);
+
+  size_t num_blocks() const { return m_blocks.size(); }
+  size_t num_edges() const { return m_edges.size(); }
+
+  NodeId entry() const { return 0; }
+
+  // The exit block of the original graph, if it has one and it's reachable.
+  bool has_exit() const { return m_exit != NONE; }
+  NodeId exit() const {
+    always_assert(has_exit());
+    return m_exit;
+  }
+
+  // The edges into and out of a block. Successors keep the order of the
+  // original graph; predecessors are sorted by source.
+  Ids preds(NodeId node) const {
+    return slice(m_pred_offsets, m_pred_edges, node);
+  }
+  Ids succs(NodeId node) const {
+    return slice(m_succ_offsets, m_succ_edges, node);
+  }
+
+  NodeId src(EdgeId edge) const { return m_edge_srcs[edge]; }
+  NodeId target(EdgeId edge) const { return m_edge_targets[edge]; }
+
+  // The instructions of a block, without any other MethodItemEntries.
+  Instructions instructions(NodeId node) const {
+    return Instructions(m_insns.data() + m_insn_offsets[node],
+                        m_insns.data() + m_insn_offsets[node + 1]);
+  }
+
+  Block* block(NodeId node) const { return m_blocks[node]; }
+  Edge* edge(EdgeId edge) const { return m_edges[edge]; }
+
+  // The index of a block of the original graph, or NONE if it's unreachable.
+  NodeId node(const Block* block) const {
+    auto id = block->id();
+    return id < m_nodes.size() ? m_nodes[id] : NONE;
+  }
+
+  sparta::WtoCache<NodeId>* wto_cache(bool backwards) const {
+    return &m_wto_caches[backwards];
+  }
+
+ private:
+  static Ids slice(const std::vector<uint32_t>& offsets,
+                   const std::vector<uint32_t>& ids,
+                   NodeId node) {
+    return Ids(ids.data() + offsets[node], ids.data() + offsets[node + 1]);
+  }
+
+  std::vector<Block*> m_blocks;
+  // Indexed by BlockId.
+  std::vector<NodeId> m_nodes;
+  NodeId m_exit{NONE};
+
+  std::vector<Edge*> m_edges;
+  std::vector<NodeId> m_edge_srcs;
+  std::vector<NodeId> m_edge_targets;
+
+  // m_*_offsets[n] and m_*_offsets[n + 1] delimit the slice of block n.
+  std::vector<uint32_t> m_pred_offsets;
+  std::vector<EdgeId> m_pred_edges;
+  std::vector<uint32_t> m_succ_offsets;
+  std::vector<EdgeId> m_succ_edges;
+  std::vector<uint32_t> m_insn_offsets;
+  std::vector<IRInstruction*> m_insns;
+
+  mutable sparta::WtoCache<NodeId> m_wto_caches[2];
+};
+
+// A static-method-only API for use with the monotonic fixpoint iterator.
+class FlatGraphInterface {
+
+ public:
+  using Graph = FlatCFG;
+  using NodeId = FlatCFG::NodeId;
+  using EdgeId = FlatCFG::EdgeId;
+  static NodeId entry(const Graph& graph) { return graph.entry(); }
+  static NodeId exit(const Graph& graph) { return graph.exit(); }
+  static FlatCFG::Ids predecessors(const Graph& graph, const NodeId& n) {
+    return graph.preds(n);
+  }
+  static FlatCFG::Ids successors(const Graph& graph, const NodeId& n) {
+    return graph.succs(n);
+  }
+  static NodeId source(const Graph& graph, const EdgeId& e) {
+    return graph.src(e);
+  }
+  static NodeId target(const Graph& graph, const EdgeId& e) {
+    return graph.target(e);
+  }
+  static sparta::WtoCache<NodeId>* wto_cache(const Graph& graph,
+                                             bool backwards) {
+    return graph.wto_cache(backwards);
+  }
+};
+
+} // namespace cfg
@@ -13,10 +13,6 @@
 #include "IRCode.h"
 #include "Resolver.h"
 #include "Trace.h"
-#include "Walkers.h"
-
-#include <boost/thread/locks.hpp>
-#include <boost/thread/shared_mutex.hpp>
 
 IODIMetadata::Entry::~Entry() {
   if (m_duplicate) {
@@ -98,7 +94,6 @@ void IODIMetadata::mark_methods(DexStoresVector& scope) {
   for (auto& store : scope) {
     for (auto& classes : store.get_dexen()) {
       for (auto& cls : classes) {
-        m_scope.push_back(cls);
         auto pretty_prefix = pretty_prefix_for_cls(cls);
         // First we need to mark all entries...
         for (DexMethod* m : cls->get_dmethods()) {
@@ -110,6 +105,25 @@ void IODIMetadata::mark_methods(DexStoresVector& scope) {
       }
     }
   }
+
+  // Now that the duplicates are known, set up the exact set of methods we
+  // care about the callers of (any entry that doesn't have any duplicates we
+  // don't care about). The callers are found while the dexes are emitted.
+  //
+  // For now we're only supporting this form of symbolication for direct/static
+  // methods only.
+  for (auto& it : m_entries) {
+    if (it.second.is_duplicate()) {
+      for (auto& meth_it : it.second.get_caller_map()) {
+        // If we're only supporting direct methods then skip any virtual meth
+        // as we don't care about it since it'll emit normal debug info.
+        if (meth_it.first->is_virtual()) {
+          continue;
+        }
+        m_caller_lists[meth_it.first] = &meth_it.second;
+      }
+    }
+  }
 }
 
 void IODIMetadata::mark_method_huge(const DexMethod* method, uint32_t size) {
@@ -162,154 +176,65 @@ bool IODIMetadata::can_safely_use_iodi(const DexMethod* method) const {
   return !iter->second.is_duplicate();
 }
 
-namespace {
-// This class marks all callers to the callees specified in the CallerMap. That
-// is CallerMap specifies what callees we want to know the callers about and
-// then CallerMarker will go through and mark any possible caller of said
-// callees.
-struct CallerMarker {
-  using CallerList = std::vector<IODIMetadata::Entry::Caller>;
-  // This is the same as Entry::CallerMap but with pointers to the caller
-  // lists instead.
-  using CallerMap = std::unordered_map<const DexMethod*, CallerList*>;
-
-  CallerMarker(CallerMap& caller_map) : caller_map(caller_map) {}
-
-  boost::shared_mutex resolver_cache_mutex;
-  MethodRefCache resolver_cache;
-
-  std::mutex caller_map_mutex;
-  CallerMap& caller_map;
-
-  void mark_callers(Scope& scope) {
-    // This is safe to do in parallel because the data members mutated have
-    // mutexes.
-    walk::parallel::methods(
-        scope, [&](DexMethod* method) { this->mark_caller(method); });
+void IODIMetadata::find_callers(const DexMethod* caller,
+                                const DexCode& code,
+                                CallSites* call_sites) const {
+  if (m_caller_lists.empty()) {
+    return;
   }
-
-  void mark_caller(const DexMethod* caller) {
-    // Pretty standard algo: walk all the insns looking for referenced methods.
-    // Resolve the referenced method if possible and insert in caller_map if
-    // necessary.
-    auto code = caller->get_dex_code();
-    if (!code) {
-      return;
+  // Pretty standard algo: walk all the insns looking for referenced methods.
+  // Resolve the referenced method if possible and record the call if it's to
+  // one of the methods we care about.
+  uint32_t pc = 0;
+  for (const DexInstruction* insn : code.get_instructions()) {
+    if (!insn->has_method()) {
+      pc += insn->size();
+      continue;
     }
-    uint32_t pc = 0;
-    const auto& insns = code->get_instructions();
-    for (const DexInstruction* insn : insns) {
-      if (!insn->has_method()) {
-        pc += insn->size();
-        continue;
-      }
-      const DexOpcodeMethod* minsn = static_cast<const DexOpcodeMethod*>(insn);
-      const DexMethodRef* method = minsn->get_method();
-      DexOpcode opcode = minsn->opcode();
-      MethodSearch search;
-      bool is_super = false;
-      switch (opcode) {
-      case DOPCODE_INVOKE_VIRTUAL:
-      case DOPCODE_INVOKE_VIRTUAL_RANGE:
-        search = MethodSearch::Virtual;
-        break;
-      case DOPCODE_INVOKE_SUPER:
-      case DOPCODE_INVOKE_SUPER_RANGE:
-        if (auto cls = type_class(method->get_class())) {
-          // https://source.android.com/devices/tech/dalvik/dalvik-bytecode:
-          //
-          // In Dex files version 037 or later, if the method_id refers to an
-          // interface method, invoke-super is used to invoke the most specific,
-          // non-overridden version of that method defined on that interface.
-          search = is_interface(cls) ? MethodSearch::Interface
-                                     : MethodSearch::Virtual;
-        } else {
-          search = MethodSearch::Any;
-        }
-        is_super = true;
-        break;
-      case DOPCODE_INVOKE_INTERFACE:
-      case DOPCODE_INVOKE_INTERFACE_RANGE:
-        search = MethodSearch::Interface;
-        break;
-      case DOPCODE_INVOKE_DIRECT:
-      case DOPCODE_INVOKE_DIRECT_RANGE:
-        search = MethodSearch::Direct;
-        break;
-      case DOPCODE_INVOKE_STATIC:
-      case DOPCODE_INVOKE_STATIC_RANGE:
-        search = MethodSearch::Static;
-        break;
-      default:
-        always_assert_log(false, "Unexpected opcode with method");
-        break;
-      }
-      DexMethod* callee = nullptr;
-      DexMethodRef* unresolved_method = const_cast<DexMethodRef*>(method);
-      if (unresolved_method->is_def()) {
-        callee = static_cast<DexMethod*>(unresolved_method);
-      } else {
-        {
-          boost::shared_lock<boost::shared_mutex> locker(resolver_cache_mutex);
-          auto it = resolver_cache.find(unresolved_method);
-          if (it != resolver_cache.end()) {
-            callee = it->second;
-          }
-        }
-        if (callee == nullptr) {
-          callee = resolve_method(unresolved_method, search);
-          {
-            boost::unique_lock<boost::shared_mutex> locker(
-                resolver_cache_mutex);
-            resolver_cache[unresolved_method] =
-                callee ?: reinterpret_cast<DexMethod*>(1);
-          }
-        }
-        // We cache 1 if we failed to resolve the method so we don't try to
-        // re-resolve it.
-        if (reinterpret_cast<uintptr_t>(callee) == 1) {
-          callee = nullptr;
-        }
-      }
-      if (search == MethodSearch::Direct || search == MethodSearch::Static) {
-        auto iter = caller_map.find(callee);
-        if (iter != caller_map.end()) {
-          TRACE(IODI, 5, "[IODI] Adding %p, %u to callsite vec for %p\n",
-                caller, pc, callee);
-          std::lock_guard<std::mutex> locker(caller_map_mutex);
-          iter->second->emplace_back(caller, pc);
-        }
-      }
+    const DexOpcodeMethod* minsn = static_cast<const DexOpcodeMethod*>(insn);
+    DexMethodRef* method = minsn->get_method();
+    DexOpcode opcode = minsn->opcode();
+    MethodSearch search;
+    switch (opcode) {
+    case DOPCODE_INVOKE_VIRTUAL:
+    case DOPCODE_INVOKE_VIRTUAL_RANGE:
+    case DOPCODE_INVOKE_SUPER:
+    case DOPCODE_INVOKE_SUPER_RANGE:
+    case DOPCODE_INVOKE_INTERFACE:
+    case DOPCODE_INVOKE_INTERFACE_RANGE:
+      // Only direct and static callees are tracked.
       pc += minsn->size();
+      continue;
+    case DOPCODE_INVOKE_DIRECT:
+    case DOPCODE_INVOKE_DIRECT_RANGE:
+      search = MethodSearch::Direct;
+      break;
+    case DOPCODE_INVOKE_STATIC:
+    case DOPCODE_INVOKE_STATIC_RANGE:
+      search = MethodSearch::Static;
+      break;
+    default:
+      always_assert_log(false, "Unexpected opcode with method");
+      break;
     }
-  }
-};
-} // namespace
-
-void IODIMetadata::mark_callers() {
-  // CallerMap sets up the exact set of DexMethods that we care about
-  // (any entry that doesn't have any duplicates we don't care about, so
-  // it won't get a slot in this map). It points to the vector of callers
-  // corresponding to the given DexMethod.
-  //
-  // For now we're only supporting this form of symbolication for direct/static
-  // methods only.
-  CallerMarker::CallerMap caller_map;
-  for (auto& it : m_entries) {
-    if (it.second.is_duplicate()) {
-      for (auto& meth_it : it.second.get_caller_map()) {
-        // If we're only supporting direct methods then skip any virtual meth
-        // as we don't care about it since it'll emit normal debug info.
-        if (meth_it.first->is_virtual()) {
-          continue;
-        }
-        caller_map[meth_it.first] = &meth_it.second;
-      }
+    // resolve_method memoizes its results in the RedexContext, so there's no
+    // need for a cache of our own.
+    const DexMethod* callee = method->is_def()
+                                  ? static_cast<const DexMethod*>(method)
+                                  : resolve_method(method, search);
+    if (m_caller_lists.count(callee)) {
+      TRACE(IODI, 5, "[IODI] Adding %p, %u to callsite vec for %p\n", caller,
+            pc, callee);
+      call_sites->emplace_back(callee, Entry::Caller(caller, pc));
     }
+    pc += minsn->size();
   }
+}
 
-  CallerMarker marker(caller_map);
-  marker.mark_callers(m_scope);
+void IODIMetadata::add_callers(const CallSites& call_sites) {
+  for (const auto& call_site : call_sites) {
+    m_caller_lists.at(call_site.first)->push_back(call_site.second);
+  }
 }
 
 void IODIMetadata::write(
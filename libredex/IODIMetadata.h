@@ -94,18 +94,22 @@ class IODIMetadata {
       always_assert(!is_duplicate());
       return m_data.method;
     }
-
-    friend struct CallerMarker;
   };
   using EntryMap = std::unordered_map<std::string, Entry>;
   using MethodToPrettyMap = std::unordered_map<const DexMethod*, std::string>;
+  // Call sites of methods whose external name has duplicates, as pairs of
+  // callee and caller.
+  using CallSites = std::vector<std::pair<const DexMethod*, Entry::Caller>>;
 
  private:
   EntryMap m_entries;
   // This exists for can_safely_use_iodi
   MethodToPrettyMap m_pretty_map;
   std::unordered_set<const DexMethod*> m_huge_methods;
-  Scope m_scope;
+  // The methods we want to know the callers of, pointing to their caller
+  // lists in m_entries.
+  std::unordered_map<const DexMethod*, std::vector<Entry::Caller>*>
+      m_caller_lists;
   bool m_enable_overloaded_methods;
 
   // Internal helper:
@@ -126,6 +130,18 @@ class IODIMetadata {
   // called after the last pass and before anything starts to get lowered.
   void mark_methods(DexStoresVector& scope);
 
+  // Appends the calls in `code` to methods whose callers we want to know to
+  // `call_sites`. This must be called after mark_methods, once `code` is
+  // final, i.e. while its dex is being emitted. It only reads the metadata, so
+  // dexes can be scanned concurrently.
+  void find_callers(const DexMethod* caller,
+                    const DexCode& code,
+                    CallSites* call_sites) const;
+
+  // Records the call sites found by find_callers. Not thread-safe; call sites
+  // should be added in dex order to get a deterministic output.
+  void add_callers(const CallSites& call_sites);
+
   // This is called while lowering to dex to note that a method has been
   // determined to be too big for a given dex.
   void mark_method_huge(const DexMethod* method, uint32_t size);
@@ -133,10 +149,6 @@ class IODIMetadata {
   // Returns whether we can symbolicate using IODI for the given method.
   bool can_safely_use_iodi(const DexMethod* method) const;
 
-  // This must be called after all Scopes have been marked above with
-  // mark_methods.
-  void mark_callers();
-
   // Write to disk, pretty usual. Does nothing if filename len is 0.
   void write(const std::string& iodi_metadata_filename,
              const std::unordered_map<DexMethod*, uint64_t>& method_to_id);
@@ -17,7 +17,7 @@ using namespace sparta;
 
 namespace {
 
-#define OP(OP, KIND, STR) {OPCODE_##OP, STR},
+#define OP(OP, KIND, STR, ...) {OPCODE_##OP, STR},
 std::unordered_map<IROpcode, std::string, boost::hash<IROpcode>>
     opcode_to_string_table = {
         OPS
@@ -30,7 +30,7 @@ std::unordered_map<IROpcode, std::string, boost::hash<IROpcode>>
 };
 #undef OP
 
-#define OP(OP, KIND, STR) {STR, OPCODE_##OP},
+#define OP(OP, KIND, STR, ...) {STR, OPCODE_##OP},
 std::unordered_map<std::string, IROpcode> string_to_opcode_table = {
     OPS
     {"load-param", IOPCODE_LOAD_PARAM},
@@ -16,6 +16,8 @@
 #include <limits>
 #include <list>
 
+#include "BinarySerialization.h"
+#include "CompactIRList.h"
 #include "ControlFlow.h"
 #include "Debug.h"
 #include "DexClass.h"
@@ -422,6 +424,8 @@ void translate_dex_to_ir(
 
     insn->normalize_registers();
 
+    // Nothing refers to the DexInstruction once it has been translated.
+    delete dex_insn;
     it->type = MFLOW_OPCODE;
     it->insn = insn;
     if (move_result_pseudo != nullptr) {
@@ -448,9 +452,6 @@ void balloon(DexMethod* method, IRList* ir_list) {
       // and debug entries that are adjacent to them can find the right
       // address.
       mei = new MethodItemEntry();
-      if (dex_opcode::is_fopcode(insn->opcode())) {
-        entry_to_data.emplace(mei, static_cast<DexOpcodeData*>(insn));
-      }
     } else {
       mei = new MethodItemEntry(insn);
     }
@@ -458,6 +459,11 @@ void balloon(DexMethod* method, IRList* ir_list) {
     bm.insert(EntryAddrBiMap::relation(mei, addr));
     TRACE(MTRANS, 5, "%08x: %s[mei %p]\n", addr, SHOW(insn), mei);
     addr += insn->size();
+    if (dex_opcode::is_fopcode(insn->opcode())) {
+      entry_to_data.emplace(mei, static_cast<DexOpcodeData*>(insn));
+    } else if (insn->opcode() == DOPCODE_NOP) {
+      delete insn;
+    }
   }
   bm.insert(EntryAddrBiMap::relation(&*ir_list->end(), addr));
 
@@ -592,6 +598,7 @@ IRCode::IRCode(DexMethod* method, size_t temp_regs)
 }
 
 IRCode::IRCode(const IRCode& code) {
+  always_assert(!code.is_compact());
   IRList* old_ir_list = code.m_ir_list;
   m_ir_list = deep_copy_ir_list(old_ir_list);
   m_registers_size = code.m_registers_size;
@@ -630,6 +637,79 @@ bool IRCode::editable_cfg_built() const {
   return m_cfg != nullptr && m_cfg->editable();
 }
 
+void IRCode::gather_catch_types(std::vector<DexType*>& ltype) const {
+  if (m_compact) {
+    m_compact->gather_catch_types(ltype);
+  } else {
+    m_ir_list->gather_catch_types(ltype);
+  }
+  if (m_dbg) m_dbg->gather_types(ltype);
+}
+
+void IRCode::gather_strings(std::vector<DexString*>& lstring) const {
+  if (m_compact) {
+    m_compact->gather_strings(lstring);
+  } else {
+    m_ir_list->gather_strings(lstring);
+  }
+  if (m_dbg) m_dbg->gather_strings(lstring);
+}
+
+void IRCode::gather_types(std::vector<DexType*>& ltype) const {
+  if (m_compact) {
+    m_compact->gather_types(ltype);
+  } else {
+    m_ir_list->gather_types(ltype);
+  }
+}
+
+void IRCode::gather_fields(std::vector<DexFieldRef*>& lfield) const {
+  if (m_compact) {
+    m_compact->gather_fields(lfield);
+  } else {
+    m_ir_list->gather_fields(lfield);
+  }
+}
+
+void IRCode::gather_methods(std::vector<DexMethodRef*>& lmethod) const {
+  if (m_compact) {
+    m_compact->gather_methods(lmethod);
+  } else {
+    m_ir_list->gather_methods(lmethod);
+  }
+}
+
+bool IRCode::can_compact() const {
+  return m_cfg == nullptr && m_compact == nullptr &&
+         CompactIRList::can_compact(*m_ir_list);
+}
+
+void IRCode::compact() {
+  always_assert(can_compact());
+  // The cached environments point at the instructions.
+  m_type_inference_cache.reset();
+  m_compact = std::make_unique<CompactIRList>(m_ir_list);
+}
+
+void IRCode::expand() {
+  always_assert(m_compact != nullptr);
+  m_compact->expand(m_ir_list);
+  m_compact.reset();
+}
+
+void IRCode::serialize(std::ostream& os) const {
+  always_assert(m_compact != nullptr);
+  binary_serialization::write<uint16_t>(os, m_registers_size);
+  m_compact->serialize(os);
+}
+
+std::unique_ptr<IRCode> IRCode::deserialize(std::istream& is) {
+  auto code = std::make_unique<IRCode>();
+  code->m_registers_size = binary_serialization::read<uint16_t>(is);
+  code->m_compact = CompactIRList::deserialize(is);
+  return code;
+}
+
 namespace {
 
 using RegMap = transform::RegMap;
@@ -8,6 +8,8 @@
 #pragma once
 
 #include <atomic>
+#include <iosfwd>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <unordered_map>
@@ -18,10 +20,16 @@
 #include "IRInstruction.h"
 #include "IRList.h"
 
+class CompactIRList;
+
 namespace cfg {
 class ControlFlowGraph;
 }
 
+namespace type_inference {
+struct CachedTypeEnvironments;
+}
+
 // TODO(jezng): IRCode currently contains too many methods that shouldn't
 // belong there... I'm going to move them out soon
 class IRCode {
@@ -41,11 +49,17 @@ class IRCode {
 
   IRList* m_ir_list;
   std::unique_ptr<cfg::ControlFlowGraph> m_cfg;
+  // See type_inference::get_type_environments(). Not carried over by the copy
+  // constructor.
+  std::shared_ptr<type_inference::CachedTypeEnvironments>
+      m_type_inference_cache;
 
   uint16_t m_registers_size{0};
   // TODO(jezng): we shouldn't be storing / exposing the DexDebugItem... just
   // exposing the param names should be enough
   std::unique_ptr<DexDebugItem> m_dbg;
+  // Holds the entries while the code is compact, with m_ir_list left empty.
+  std::unique_ptr<CompactIRList> m_compact;
 
   IRList::iterator main_block() { return m_ir_list->main_block(); }
   IRList::iterator make_if_block(IRList::iterator cur,
@@ -130,23 +144,34 @@ class IRCode {
     return std::move(m_dbg);
   }
 
-  void gather_catch_types(std::vector<DexType*>& ltype) const {
-    m_ir_list->gather_catch_types(ltype);
-    if (m_dbg) m_dbg->gather_types(ltype);
-  }
-  void gather_strings(std::vector<DexString*>& lstring) const {
-    m_ir_list->gather_strings(lstring);
-    if (m_dbg) m_dbg->gather_strings(lstring);
-  }
-  void gather_types(std::vector<DexType*>& ltype) const {
-    m_ir_list->gather_types(ltype);
-  }
-  void gather_fields(std::vector<DexFieldRef*>& lfield) const {
-    m_ir_list->gather_fields(lfield);
-  }
-  void gather_methods(std::vector<DexMethodRef*>& lmethod) const {
-    m_ir_list->gather_methods(lmethod);
-  }
+  // These work on compact code too, without expanding it.
+  void gather_catch_types(std::vector<DexType*>& ltype) const;
+  void gather_strings(std::vector<DexString*>& lstring) const;
+  void gather_types(std::vector<DexType*>& ltype) const;
+  void gather_fields(std::vector<DexFieldRef*>& lfield) const;
+  void gather_methods(std::vector<DexMethodRef*>& lmethod) const;
+
+  /*
+   * Compact code keeps its instructions in a CompactIRList, which takes a
+   * fraction of the memory of the IRList, until expand() puts them back.
+   * Nothing but the gather methods above may look at compact code, and
+   * nothing may hold on to the instructions of code that gets compacted.
+   *
+   * DexMethod::compact_code() and DexMethod::get_code() take care of this
+   * for the code of methods.
+   */
+  bool can_compact() const;
+  void compact();
+  void expand();
+  bool is_compact() const { return m_compact != nullptr; }
+
+  /*
+   * Writes the registers size and entries of compact code for deserialize()
+   * to read back, e.g. in another process. The debug item isn't written.
+   * The code that deserialize() returns is compact.
+   */
+  void serialize(std::ostream& os) const;
+  static std::unique_ptr<IRCode> deserialize(std::istream& is);
 
   /* Return the control flow graph of this method as a vector of blocks. */
   cfg::ControlFlowGraph& cfg() { return *m_cfg; }
@@ -167,6 +192,11 @@ class IRCode {
 
   bool editable_cfg_built() const;
 
+  std::shared_ptr<type_inference::CachedTypeEnvironments>&
+  type_inference_cache() {
+    return m_type_inference_cache;
+  }
+
   /* Generate DexCode from IRCode */
   std::unique_ptr<DexCode> sync(const DexMethod*);
 
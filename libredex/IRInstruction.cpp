@@ -7,8 +7,12 @@
 
 #include "IRInstruction.h"
 
+#include <algorithm>
+
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "FixedSizeAllocator.h"
+#include "MemoryAccounting.h"
 
 DexOpcode convert_2to3addr(DexOpcode op) {
   always_assert(op >= DOPCODE_ADD_INT_2ADDR && op <= DOPCODE_REM_DOUBLE_2ADDR);
@@ -22,8 +26,79 @@ DexOpcode convert_3to2addr(DexOpcode op) {
   return (DexOpcode)(op + offset);
 }
 
+using IRInstructionAllocator =
+    FixedSizeAllocator<sizeof(IRInstruction), alignof(IRInstruction)>;
+
+void* IRInstruction::operator new(size_t size) {
+  always_assert(size == sizeof(IRInstruction));
+  memory_accounting::on_create(memory_accounting::Entity::IRInstruction);
+  return IRInstructionAllocator::allocate();
+}
+
+void IRInstruction::operator delete(void* ptr, size_t /* size */) {
+  memory_accounting::on_destroy(memory_accounting::Entity::IRInstruction);
+  IRInstructionAllocator::deallocate(ptr);
+}
+
 IRInstruction::IRInstruction(IROpcode op) : m_opcode(op) {
-  m_srcs.resize(opcode_impl::min_srcs_size(op));
+  set_arg_word_count(opcode_impl::min_srcs_size(op));
+}
+
+IRInstruction::IRInstruction(const IRInstruction& that)
+    : m_opcode(that.m_opcode), m_dest(that.m_dest), m_literal(that.m_literal) {
+  set_arg_word_count(that.m_num_srcs);
+  std::copy(that.srcs().begin(), that.srcs().end(), srcs_data());
+}
+
+IRInstruction& IRInstruction::operator=(const IRInstruction& that) {
+  if (this != &that) {
+    m_opcode = that.m_opcode;
+    m_dest = that.m_dest;
+    m_literal = that.m_literal;
+    set_arg_word_count(that.m_num_srcs);
+    std::copy(that.srcs().begin(), that.srcs().end(), srcs_data());
+  }
+  return *this;
+}
+
+IRInstruction::~IRInstruction() {
+  if (srcs_on_heap()) {
+    delete[] m_heap_srcs;
+  }
+}
+
+IRInstruction* IRInstruction::set_arg_word_count(uint16_t count) {
+  if (count == m_num_srcs) {
+    return this;
+  }
+  bool was_on_heap = srcs_on_heap();
+  if (!was_on_heap && count <= MAX_NUM_INLINE_SRCS) {
+    if (count > m_num_srcs) {
+      std::fill(m_inline_srcs + m_num_srcs, m_inline_srcs + count, 0);
+    }
+    m_num_srcs = count;
+    return this;
+  }
+  // The inline sources share their storage with the heap pointer, so move
+  // them out of the way first.
+  uint16_t old_srcs[MAX_NUM_INLINE_SRCS];
+  uint16_t* old_data = was_on_heap ? m_heap_srcs : old_srcs;
+  if (!was_on_heap) {
+    std::copy(m_inline_srcs, m_inline_srcs + m_num_srcs, old_srcs);
+  }
+  size_t kept = std::min(m_num_srcs, count);
+  uint16_t* data =
+      count <= MAX_NUM_INLINE_SRCS ? m_inline_srcs : new uint16_t[count];
+  std::copy(old_data, old_data + kept, data);
+  std::fill(data + kept, data + count, 0);
+  if (was_on_heap) {
+    delete[] old_data;
+  }
+  if (count > MAX_NUM_INLINE_SRCS) {
+    m_heap_srcs = data;
+  }
+  m_num_srcs = count;
+  return this;
 }
 
 // Structural equality of opcodes except branches offsets are ignored
@@ -31,7 +106,8 @@ IRInstruction::IRInstruction(IROpcode op) : m_opcode(op) {
 bool IRInstruction::operator==(const IRInstruction& that) const {
   return m_opcode == that.m_opcode &&
     m_string == that.m_string && // just test one member of the union
-    m_srcs == that.m_srcs &&
+    m_num_srcs == that.m_num_srcs &&
+    std::equal(srcs().begin(), srcs().end(), that.srcs().begin()) &&
     m_dest == that.m_dest &&
     m_literal == that.m_literal;
 }
@@ -209,7 +285,8 @@ void IRInstruction::denormalize_registers() {
       }
     }
     if (has_wide) {
-      m_srcs = srcs;
+      set_arg_word_count(srcs.size());
+      std::copy(srcs.begin(), srcs.end(), srcs_data());
     }
   }
 }
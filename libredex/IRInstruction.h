@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <boost/range/iterator_range.hpp>
+
 #include "DexInstruction.h"
 #include "Show.h"
 
@@ -107,7 +109,21 @@
  */
 class IRInstruction final {
  public:
+  // Instructions with at most this many sources keep them inline; only wider
+  // invokes and filled-new-arrays allocate them on the heap.
+  static constexpr size_t MAX_NUM_INLINE_SRCS = 5;
+
+  using SrcsRange = boost::iterator_range<const uint16_t*>;
+
   explicit IRInstruction(IROpcode op);
+  IRInstruction(const IRInstruction&);
+  IRInstruction& operator=(const IRInstruction&);
+  ~IRInstruction();
+
+  // Instructions come from a FixedSizeAllocator pool rather than the general
+  // heap; see FixedSizeAllocator.h.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
 
   /*
    * Ensures that wide registers only have their first register referenced
@@ -151,7 +167,7 @@ class IRInstruction final {
    */
   size_t dests_size() const { return opcode_impl::dests_size(m_opcode); }
 
-  size_t srcs_size() const { return m_srcs.size(); }
+  size_t srcs_size() const { return m_num_srcs; }
 
   bool has_move_result_pseudo() const {
     return opcode_impl::has_move_result_pseudo(m_opcode);
@@ -194,9 +210,18 @@ class IRInstruction final {
     always_assert_log(dests_size(), "No dest for %s", SHOW(m_opcode));
     return m_dest;
   }
-  uint16_t src(size_t i) const { return m_srcs.at(i); }
-  const std::vector<uint16_t>& srcs() const { return m_srcs; }
-  uint16_t arg_word_count() const { return m_srcs.size(); }
+  uint16_t src(size_t i) const {
+    always_assert_log(i < m_num_srcs, "No src %lu in %s", i, SHOW(m_opcode));
+    return srcs_data()[i];
+  }
+  // The range is invalidated by set_arg_word_count.
+  SrcsRange srcs() const {
+    return SrcsRange(srcs_data(), srcs_data() + m_num_srcs);
+  }
+  std::vector<uint16_t> srcs_vec() const {
+    return std::vector<uint16_t>(srcs().begin(), srcs().end());
+  }
+  uint16_t arg_word_count() const { return m_num_srcs; }
 
   /*
    * Setters for logical parts of the instruction.
@@ -211,13 +236,12 @@ class IRInstruction final {
     return this;
   }
   IRInstruction* set_src(size_t i, uint16_t vreg) {
-    m_srcs.at(i) = vreg;
-    return this;
-  }
-  IRInstruction* set_arg_word_count(uint16_t count) {
-    m_srcs.resize(count);
+    always_assert_log(i < m_num_srcs, "No src %lu in %s", i, SHOW(m_opcode));
+    srcs_data()[i] = vreg;
     return this;
   }
+  // Like std::vector::resize, new sources are v0.
+  IRInstruction* set_arg_word_count(uint16_t count);
 
   int64_t get_literal() const {
     always_assert(has_literal());
@@ -313,9 +337,21 @@ class IRInstruction final {
   uint64_t hash() const;
 
  private:
+  bool srcs_on_heap() const { return m_num_srcs > MAX_NUM_INLINE_SRCS; }
+  const uint16_t* srcs_data() const {
+    return srcs_on_heap() ? m_heap_srcs : m_inline_srcs;
+  }
+  uint16_t* srcs_data() {
+    return srcs_on_heap() ? m_heap_srcs : m_inline_srcs;
+  }
+
   IROpcode m_opcode;
-  std::vector<uint16_t> m_srcs;
+  uint16_t m_num_srcs{0};
   uint16_t m_dest{0};
+  union {
+    uint16_t m_inline_srcs[MAX_NUM_INLINE_SRCS];
+    uint16_t* m_heap_srcs;
+  };
   union {
     // Zero-initialize this union with the uint64_t member instead of a
     // pointer-type member so that it works properly even on 32-bit machines
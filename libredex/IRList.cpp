@@ -11,6 +11,8 @@
 #include <iterator>
 
 #include "DexUtil.h"
+#include "FixedSizeAllocator.h"
+#include "MemoryAccounting.h"
 #include "IRInstruction.h"
 
 MethodItemEntry::MethodItemEntry(const MethodItemEntry& that)
@@ -42,6 +44,26 @@ MethodItemEntry::MethodItemEntry(const MethodItemEntry& that)
   }
 }
 
+using MethodItemEntryAllocator =
+    FixedSizeAllocator<sizeof(MethodItemEntry), alignof(MethodItemEntry)>;
+
+void* MethodItemEntry::operator new(size_t size) {
+  memory_accounting::on_create(memory_accounting::Entity::MethodItemEntry);
+  if (size != sizeof(MethodItemEntry)) {
+    return ::operator new(size);
+  }
+  return MethodItemEntryAllocator::allocate();
+}
+
+void MethodItemEntry::operator delete(void* ptr, size_t size) {
+  memory_accounting::on_destroy(memory_accounting::Entity::MethodItemEntry);
+  if (size != sizeof(MethodItemEntry)) {
+    ::operator delete(ptr);
+    return;
+  }
+  MethodItemEntryAllocator::deallocate(ptr);
+}
+
 MethodItemEntry::~MethodItemEntry() {
   switch (type) {
     case MFLOW_TRY:
@@ -149,6 +149,11 @@ struct MethodItemEntry {
   MethodItemEntry() : type(MFLOW_FALLTHROUGH) {}
   ~MethodItemEntry();
 
+  // Entries come from a FixedSizeAllocator pool rather than the general heap;
+  // see FixedSizeAllocator.h.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   /*
    * This should only ever be used by the instruction lowering step. Do NOT use
    * it in passes!
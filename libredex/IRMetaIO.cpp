@@ -48,26 +48,13 @@ DexField* find_field(const DexClass* cls, const std::string& name) {
 }
 
 DexMethod* find_method(const DexClass* cls, const std::string& name_and_proto) {
-  int colon = name_and_proto.find(':');
-  const DexString* method_name =
-      DexString::make_string(name_and_proto.substr(0, colon));
-  std::string proto =
-      name_and_proto.substr(colon + 1, name_and_proto.length() - colon - 1);
-  auto result = std::find_if(
-      cls->get_dmethods().begin(), cls->get_dmethods().end(),
-      [&](const DexMethod* m) {
-        return m->get_name() == method_name && show(m->get_proto()) == proto;
-      });
-  if (result != cls->get_dmethods().end()) {
-    return *result;
-  }
-  auto result2 = std::find_if(
-      cls->get_vmethods().begin(), cls->get_vmethods().end(),
-      [&](const DexMethod* m) {
-        return m->get_name() == method_name && show(m->get_proto()) == proto;
-      });
-  redex_assert(result2 != cls->get_vmethods().end());
-  return *result2;
+  // A hash lookup rather than a scan over the class's methods, which would
+  // have to show() every proto.
+  auto method = DexMethod::get_method(std::string(cls->c_str()) + "." +
+                                      name_and_proto);
+  redex_assert(method != nullptr && method->is_def() &&
+               method->get_class() == cls->get_type());
+  return static_cast<DexMethod*>(method);
 }
 
 /**
@@ -83,9 +70,21 @@ void serialize_name_and_rstate(const T* obj, std::ofstream& ostrm) {
   ir_meta_io::IRMetaIO::serialize_rstate(obj->rstate, ostrm);
 }
 
+/*
+ * Reads a uleb128 through a uint8_t pointer of its own. Casting the address of
+ * the char pointer to a uint8_t** breaks strict aliasing, and optimized builds
+ * then go on reading at the old position.
+ */
+uint32_t read_size(const char** _ptr) {
+  auto ptr = reinterpret_cast<const uint8_t*>(*_ptr);
+  uint32_t size = read_uleb128(&ptr);
+  *_ptr = reinterpret_cast<const char*>(ptr);
+  return size;
+}
+
 template <typename T>
 void deserialize_name_and_rstate(const char** _ptr, T* obj) {
-  int utfsize = read_uleb128((const uint8_t**)_ptr);
+  int utfsize = read_size(_ptr);
   if (utfsize) {
     obj->set_deobfuscated_name(std::string(*_ptr));
   } else {
@@ -169,31 +168,31 @@ void serialize_class_data(const Scope& classes, std::ofstream& ostrm) {
 void deserialize_class_data(std::ifstream& istrm, uint32_t data_size) {
   auto data = std::make_unique<char[]>(data_size);
   istrm.read((char*)data.get(), data_size);
-  char* ptr = data.get();
+  const char* ptr = data.get();
   DexClass* cls = nullptr;
   while (ptr - data.get() < data_size) {
     BlockType btype = (BlockType)*ptr++;
     always_assert(btype >= 0 && btype < BlockType::EndOfBlock);
-    int utfsize = read_uleb128((const uint8_t**)&ptr);
+    int utfsize = read_size(&ptr);
     switch (btype) {
     case BlockType::ClassBlock: {
       DexType* type = DexType::get_type(ptr, utfsize);
       cls = type_class(type);
       always_assert(cls != nullptr);
       ptr += utfsize + 1;
-      deserialize_name_and_rstate((const char**)&ptr, cls);
+      deserialize_name_and_rstate(&ptr, cls);
       break;
     }
     case BlockType::FieldBlock: {
       DexField* field = find_field(cls, std::string(ptr, utfsize));
       ptr += utfsize + 1;
-      deserialize_name_and_rstate((const char**)&ptr, field);
+      deserialize_name_and_rstate(&ptr, field);
       break;
     }
     case BlockType::MethodBlock: {
       DexMethod* method = find_method(cls, std::string(ptr, utfsize));
       ptr += utfsize + 1;
-      deserialize_name_and_rstate((const char**)&ptr, method);
+      deserialize_name_and_rstate(&ptr, method);
       break;
     }
     default: { always_assert(false); }
@@ -15,24 +15,6 @@
 
 namespace opcode {
 
-Ref ref(IROpcode opcode) {
-  switch (opcode) {
-#define OP(op, ref, ...) \
-  case OPCODE_##op:      \
-    return ref;
-    OPS
-#undef OP
-  case IOPCODE_LOAD_PARAM:
-  case IOPCODE_LOAD_PARAM_OBJECT:
-  case IOPCODE_LOAD_PARAM_WIDE:
-  case IOPCODE_MOVE_RESULT_PSEUDO:
-  case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
-  case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
-    return Ref::None;
-  }
-  always_assert_log(false, "Unexpected opcode 0x%x", opcode);
-}
-
 IROpcode from_dex_opcode(DexOpcode op) {
   switch (op) {
   case DOPCODE_NOP:
@@ -849,93 +831,6 @@ DexOpcode range_version(IROpcode op) {
   }
 }
 
-bool has_variable_srcs_size(IROpcode op) {
-  switch (op) {
-  case OPCODE_INVOKE_VIRTUAL:
-  case OPCODE_INVOKE_DIRECT:
-  case OPCODE_INVOKE_SUPER:
-  case OPCODE_INVOKE_STATIC:
-  case OPCODE_INVOKE_INTERFACE:
-  case OPCODE_FILLED_NEW_ARRAY:
-    return true;
-  default:
-    return false;
-  }
-}
-
-bool may_throw(IROpcode op) {
-  switch (op) {
-  case OPCODE_CONST_STRING:
-  case OPCODE_CONST_CLASS:
-  case OPCODE_MONITOR_ENTER:
-  case OPCODE_MONITOR_EXIT:
-  case OPCODE_CHECK_CAST:
-  case OPCODE_INSTANCE_OF:
-  case OPCODE_ARRAY_LENGTH:
-  case OPCODE_NEW_INSTANCE:
-  case OPCODE_NEW_ARRAY:
-  case OPCODE_FILLED_NEW_ARRAY:
-  case OPCODE_AGET:
-  case OPCODE_AGET_WIDE:
-  case OPCODE_AGET_OBJECT:
-  case OPCODE_AGET_BOOLEAN:
-  case OPCODE_AGET_BYTE:
-  case OPCODE_AGET_CHAR:
-  case OPCODE_AGET_SHORT:
-  case OPCODE_APUT:
-  case OPCODE_APUT_WIDE:
-  case OPCODE_APUT_OBJECT:
-  case OPCODE_APUT_BOOLEAN:
-  case OPCODE_APUT_BYTE:
-  case OPCODE_APUT_CHAR:
-  case OPCODE_APUT_SHORT:
-  case OPCODE_IGET:
-  case OPCODE_IGET_WIDE:
-  case OPCODE_IGET_OBJECT:
-  case OPCODE_IGET_BOOLEAN:
-  case OPCODE_IGET_BYTE:
-  case OPCODE_IGET_CHAR:
-  case OPCODE_IGET_SHORT:
-  case OPCODE_IPUT:
-  case OPCODE_IPUT_WIDE:
-  case OPCODE_IPUT_OBJECT:
-  case OPCODE_IPUT_BOOLEAN:
-  case OPCODE_IPUT_BYTE:
-  case OPCODE_IPUT_CHAR:
-  case OPCODE_IPUT_SHORT:
-  case OPCODE_SGET:
-  case OPCODE_SGET_WIDE:
-  case OPCODE_SGET_OBJECT:
-  case OPCODE_SGET_BOOLEAN:
-  case OPCODE_SGET_BYTE:
-  case OPCODE_SGET_CHAR:
-  case OPCODE_SGET_SHORT:
-  case OPCODE_SPUT:
-  case OPCODE_SPUT_WIDE:
-  case OPCODE_SPUT_OBJECT:
-  case OPCODE_SPUT_BOOLEAN:
-  case OPCODE_SPUT_BYTE:
-  case OPCODE_SPUT_CHAR:
-  case OPCODE_SPUT_SHORT:
-  case OPCODE_INVOKE_VIRTUAL:
-  case OPCODE_INVOKE_SUPER:
-  case OPCODE_INVOKE_DIRECT:
-  case OPCODE_INVOKE_STATIC:
-  case OPCODE_INVOKE_INTERFACE:
-  case OPCODE_DIV_INT:
-  case OPCODE_REM_INT:
-  case OPCODE_DIV_LONG:
-  case OPCODE_REM_LONG:
-  case OPCODE_DIV_INT_LIT16:
-  case OPCODE_REM_INT_LIT16:
-  case OPCODE_DIV_INT_LIT8:
-  case OPCODE_REM_INT_LIT8:
-    return true;
-  default:
-    return false;
-  }
-}
-
 Branchingness branchingness(IROpcode op) {
   if (may_throw(op)) {
     return BRANCH_THROW;
@@ -972,34 +867,6 @@ Branchingness branchingness(IROpcode op) {
   }
 }
 
-bool has_range_form(IROpcode op) {
-  switch (op) {
-  case OPCODE_INVOKE_DIRECT:
-  case OPCODE_INVOKE_STATIC:
-  case OPCODE_INVOKE_SUPER:
-  case OPCODE_INVOKE_VIRTUAL:
-  case OPCODE_INVOKE_INTERFACE:
-  case OPCODE_FILLED_NEW_ARRAY:
-    return true;
-  default:
-    return false;
-  }
-}
-
-bool is_internal(IROpcode op) {
-  switch (op) {
-  case IOPCODE_LOAD_PARAM:
-  case IOPCODE_LOAD_PARAM_OBJECT:
-  case IOPCODE_LOAD_PARAM_WIDE:
-  case IOPCODE_MOVE_RESULT_PSEUDO:
-  case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
-  case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
-    return true;
-  default:
-    return false;
-  }
-}
-
 bool is_load_param(IROpcode op) {
   return op >= IOPCODE_LOAD_PARAM && op <= IOPCODE_LOAD_PARAM_WIDE;
 }
@@ -1017,28 +884,6 @@ bool is_move_result_or_move_result_pseudo(IROpcode op) {
   return is_move_result(op) || is_move_result_pseudo(op);
 }
 
-bool is_commutative(IROpcode opcode) {
-  switch (opcode) {
-  case OPCODE_AND_INT:
-  case OPCODE_AND_LONG:
-  case OPCODE_OR_INT:
-  case OPCODE_OR_LONG:
-  case OPCODE_XOR_INT:
-  case OPCODE_XOR_LONG:
-  case OPCODE_ADD_INT:
-  case OPCODE_ADD_LONG:
-  case OPCODE_ADD_FLOAT:
-  case OPCODE_ADD_DOUBLE:
-  case OPCODE_MUL_INT:
-  case OPCODE_MUL_LONG:
-  case OPCODE_MUL_FLOAT:
-  case OPCODE_MUL_DOUBLE:
-    return true;
-  default:
-    return false;
-  }
-}
-
 IROpcode load_param_to_move(IROpcode op) {
   switch (op) {
   case IOPCODE_LOAD_PARAM:
@@ -1176,62 +1021,6 @@ unsigned min_srcs_size(IROpcode op) {
   }
 }
 
-bool dest_is_wide(IROpcode op) {
-  switch (op) {
-  case OPCODE_MOVE_WIDE:
-  case OPCODE_MOVE_RESULT_WIDE:
-
-  case OPCODE_CONST_WIDE:
-
-  case OPCODE_AGET_WIDE:
-  case OPCODE_IGET_WIDE:
-  case OPCODE_SGET_WIDE:
-
-  case OPCODE_NEG_LONG:
-  case OPCODE_NOT_LONG:
-  case OPCODE_NEG_DOUBLE:
-  case OPCODE_INT_TO_LONG:
-  case OPCODE_INT_TO_DOUBLE:
-  case OPCODE_LONG_TO_DOUBLE:
-  case OPCODE_FLOAT_TO_LONG:
-  case OPCODE_FLOAT_TO_DOUBLE:
-  case OPCODE_DOUBLE_TO_LONG:
-
-  case OPCODE_ADD_LONG:
-  case OPCODE_SUB_LONG:
-  case OPCODE_MUL_LONG:
-  case OPCODE_DIV_LONG:
-  case OPCODE_REM_LONG:
-  case OPCODE_AND_LONG:
-  case OPCODE_OR_LONG:
-  case OPCODE_XOR_LONG:
-  case OPCODE_SHL_LONG:
-  case OPCODE_SHR_LONG:
-  case OPCODE_USHR_LONG:
-  case OPCODE_ADD_DOUBLE:
-  case OPCODE_SUB_DOUBLE:
-  case OPCODE_MUL_DOUBLE:
-  case OPCODE_DIV_DOUBLE:
-  case OPCODE_REM_DOUBLE:
-    return true;
-
-  case IOPCODE_LOAD_PARAM:
-  case IOPCODE_LOAD_PARAM_OBJECT:
-    return false;
-  case IOPCODE_LOAD_PARAM_WIDE:
-    return true;
-
-  case IOPCODE_MOVE_RESULT_PSEUDO:
-  case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
-    return false;
-  case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
-    return true;
-
-  default:
-    return false;
-  }
-}
-
 bool dest_is_object(IROpcode op) {
   switch (op) {
   case OPCODE_NOP:
@@ -28,174 +28,186 @@ enum class Ref {
   Data,
 };
 
+// Properties of an opcode that are looked up in a table generated from OPS
+// rather than computed with a switch. HAS_RANGE opcodes have a /range form
+// and take a variable number of sources.
+enum Traits : uint8_t {
+  NO_TRAITS = 0,
+  MAY_THROW = 1 << 0,
+  HAS_RANGE = 1 << 1,
+  COMMUTATIVE = 1 << 2,
+  DEST_WIDE = 1 << 3,
+  INTERNAL = 1 << 4,
+};
+
 } // namespace opcode
 
 #define OPS \
-  OP(NOP               , Ref::None, "nop") \
-  OP(MOVE              , Ref::None, "move") \
-  OP(MOVE_WIDE         , Ref::None, "move-wide") \
-  OP(MOVE_OBJECT       , Ref::None, "move-object") \
-  OP(MOVE_RESULT       , Ref::None, "move-result") \
-  OP(MOVE_RESULT_WIDE  , Ref::None, "move-result-wide") \
-  OP(MOVE_RESULT_OBJECT, Ref::None, "move-result-object") \
-  OP(MOVE_EXCEPTION    , Ref::None, "move-exception") \
-  OP(RETURN_VOID       , Ref::None, "return-void") \
-  OP(RETURN            , Ref::None, "return") \
-  OP(RETURN_WIDE       , Ref::None, "return-wide") \
-  OP(RETURN_OBJECT     , Ref::None, "return-object") \
-  OP(CONST             , Ref::Literal, "const") \
-  OP(CONST_WIDE        , Ref::Literal, "const-wide") \
-  OP(CONST_STRING      , Ref::String, "const-string") \
-  OP(CONST_CLASS       , Ref::Type, "const-class") \
-  OP(MONITOR_ENTER     , Ref::None, "monitor-enter") \
-  OP(MONITOR_EXIT      , Ref::None, "monitor-exit") \
-  OP(CHECK_CAST        , Ref::Type, "check-cast") \
-  OP(INSTANCE_OF       , Ref::Type, "instance-of") \
-  OP(ARRAY_LENGTH      , Ref::None, "array-length") \
-  OP(NEW_INSTANCE      , Ref::Type, "new-instance") \
-  OP(NEW_ARRAY         , Ref::Type, "new-array") \
-  OP(FILLED_NEW_ARRAY  , Ref::Type, "filled-new-array") \
-  OP(FILL_ARRAY_DATA   , Ref::Data, "fill-array-data") \
-  OP(THROW             , Ref::None, "throw") \
-  OP(GOTO              , Ref::None, "goto") \
-  OP(PACKED_SWITCH     , Ref::None, "packed-switch") \
-  OP(SPARSE_SWITCH     , Ref::None, "sparse-switch") \
-  OP(CMPL_FLOAT        , Ref::None, "cmpl-float") \
-  OP(CMPG_FLOAT        , Ref::None, "cmpg-float") \
-  OP(CMPL_DOUBLE       , Ref::None, "cmpl-double") \
-  OP(CMPG_DOUBLE       , Ref::None, "cmpg-double") \
-  OP(CMP_LONG          , Ref::None, "cmp-long") \
-  OP(IF_EQ             , Ref::None, "if-eq") \
-  OP(IF_NE             , Ref::None, "if-ne") \
-  OP(IF_LT             , Ref::None, "if-lt") \
-  OP(IF_GE             , Ref::None, "if-ge") \
-  OP(IF_GT             , Ref::None, "if-gt") \
-  OP(IF_LE             , Ref::None, "if-le") \
-  OP(IF_EQZ            , Ref::None, "if-eqz") \
-  OP(IF_NEZ            , Ref::None, "if-nez") \
-  OP(IF_LTZ            , Ref::None, "if-ltz") \
-  OP(IF_GEZ            , Ref::None, "if-gez") \
-  OP(IF_GTZ            , Ref::None, "if-gtz") \
-  OP(IF_LEZ            , Ref::None, "if-lez") \
-  OP(AGET              , Ref::None, "aget") \
-  OP(AGET_WIDE         , Ref::None, "aget-wide") \
-  OP(AGET_OBJECT       , Ref::None, "aget-object") \
-  OP(AGET_BOOLEAN      , Ref::None, "aget-boolean") \
-  OP(AGET_BYTE         , Ref::None, "aget-byte") \
-  OP(AGET_CHAR         , Ref::None, "aget-char") \
-  OP(AGET_SHORT        , Ref::None, "aget-short") \
-  OP(APUT              , Ref::None, "aput") \
-  OP(APUT_WIDE         , Ref::None, "aput-wide") \
-  OP(APUT_OBJECT       , Ref::None, "aput-object") \
-  OP(APUT_BOOLEAN      , Ref::None, "aput-boolean") \
-  OP(APUT_BYTE         , Ref::None, "aput-byte") \
-  OP(APUT_CHAR         , Ref::None, "aput-char") \
-  OP(APUT_SHORT        , Ref::None, "aput-short") \
-  OP(IGET              , Ref::Field, "iget") \
-  OP(IGET_WIDE         , Ref::Field, "iget-wide") \
-  OP(IGET_OBJECT       , Ref::Field, "iget-object") \
-  OP(IGET_BOOLEAN      , Ref::Field, "iget-boolean") \
-  OP(IGET_BYTE         , Ref::Field, "iget-byte") \
-  OP(IGET_CHAR         , Ref::Field, "iget-char") \
-  OP(IGET_SHORT        , Ref::Field, "iget-short") \
-  OP(IPUT              , Ref::Field, "iput") \
-  OP(IPUT_WIDE         , Ref::Field, "iput-wide") \
-  OP(IPUT_OBJECT       , Ref::Field, "iput-object") \
-  OP(IPUT_BOOLEAN      , Ref::Field, "iput-boolean") \
-  OP(IPUT_BYTE         , Ref::Field, "iput-byte") \
-  OP(IPUT_CHAR         , Ref::Field, "iput-char") \
-  OP(IPUT_SHORT        , Ref::Field, "iput-short") \
-  OP(SGET              , Ref::Field, "sget") \
-  OP(SGET_WIDE         , Ref::Field, "sget-wide") \
-  OP(SGET_OBJECT       , Ref::Field, "sget-object") \
-  OP(SGET_BOOLEAN      , Ref::Field, "sget-boolean") \
-  OP(SGET_BYTE         , Ref::Field, "sget-byte") \
-  OP(SGET_CHAR         , Ref::Field, "sget-char") \
-  OP(SGET_SHORT        , Ref::Field, "sget-short") \
-  OP(SPUT              , Ref::Field, "sput") \
-  OP(SPUT_WIDE         , Ref::Field, "sput-wide") \
-  OP(SPUT_OBJECT       , Ref::Field, "sput-object") \
-  OP(SPUT_BOOLEAN      , Ref::Field, "sput-boolean") \
-  OP(SPUT_BYTE         , Ref::Field, "sput-byte") \
-  OP(SPUT_CHAR         , Ref::Field, "sput-char") \
-  OP(SPUT_SHORT        , Ref::Field, "sput-short") \
-  OP(INVOKE_VIRTUAL    , Ref::Method, "invoke-virtual") \
-  OP(INVOKE_SUPER      , Ref::Method, "invoke-super") \
-  OP(INVOKE_DIRECT     , Ref::Method, "invoke-direct") \
-  OP(INVOKE_STATIC     , Ref::Method, "invoke-static") \
-  OP(INVOKE_INTERFACE  , Ref::Method, "invoke-interface") \
-  OP(NEG_INT           , Ref::None, "neg-int") \
-  OP(NOT_INT           , Ref::None, "not-int") \
-  OP(NEG_LONG          , Ref::None, "neg-long") \
-  OP(NOT_LONG          , Ref::None, "not-long") \
-  OP(NEG_FLOAT         , Ref::None, "neg-float") \
-  OP(NEG_DOUBLE        , Ref::None, "neg-double") \
-  OP(INT_TO_LONG       , Ref::None, "int-to-long") \
-  OP(INT_TO_FLOAT      , Ref::None, "int-to-float") \
-  OP(INT_TO_DOUBLE     , Ref::None, "int-to-double") \
-  OP(LONG_TO_INT       , Ref::None, "long-to-int") \
-  OP(LONG_TO_FLOAT     , Ref::None, "long-to-float") \
-  OP(LONG_TO_DOUBLE    , Ref::None, "long-to-double") \
-  OP(FLOAT_TO_INT      , Ref::None, "float-to-int") \
-  OP(FLOAT_TO_LONG     , Ref::None, "float-to-long") \
-  OP(FLOAT_TO_DOUBLE   , Ref::None, "float-to-double") \
-  OP(DOUBLE_TO_INT     , Ref::None, "double-to-int") \
-  OP(DOUBLE_TO_LONG    , Ref::None, "double-to-long") \
-  OP(DOUBLE_TO_FLOAT   , Ref::None, "double-to-float") \
-  OP(INT_TO_BYTE       , Ref::None, "int-to-byte") \
-  OP(INT_TO_CHAR       , Ref::None, "int-to-char") \
-  OP(INT_TO_SHORT      , Ref::None, "int-to-short") \
-  OP(ADD_INT           , Ref::None, "add-int") \
-  OP(SUB_INT           , Ref::None, "sub-int") \
-  OP(MUL_INT           , Ref::None, "mul-int") \
-  OP(DIV_INT           , Ref::None, "div-int") \
-  OP(REM_INT           , Ref::None, "rem-int") \
-  OP(AND_INT           , Ref::None, "and-int") \
-  OP(OR_INT            , Ref::None, "or-int") \
-  OP(XOR_INT           , Ref::None, "xor-int") \
-  OP(SHL_INT           , Ref::None, "shl-int") \
-  OP(SHR_INT           , Ref::None, "shr-int") \
-  OP(USHR_INT          , Ref::None, "ushr-int") \
-  OP(ADD_LONG          , Ref::None, "add-long") \
-  OP(SUB_LONG          , Ref::None, "sub-long") \
-  OP(MUL_LONG          , Ref::None, "mul-long") \
-  OP(DIV_LONG          , Ref::None, "div-long") \
-  OP(REM_LONG          , Ref::None, "rem-long") \
-  OP(AND_LONG          , Ref::None, "and-long") \
-  OP(OR_LONG           , Ref::None, "or-long") \
-  OP(XOR_LONG          , Ref::None, "xor-long") \
-  OP(SHL_LONG          , Ref::None, "shl-long") \
-  OP(SHR_LONG          , Ref::None, "shr-long") \
-  OP(USHR_LONG         , Ref::None, "ushr-long") \
-  OP(ADD_FLOAT         , Ref::None, "add-float") \
-  OP(SUB_FLOAT         , Ref::None, "sub-float") \
-  OP(MUL_FLOAT         , Ref::None, "mul-float") \
-  OP(DIV_FLOAT         , Ref::None, "div-float") \
-  OP(REM_FLOAT         , Ref::None, "rem-float") \
-  OP(ADD_DOUBLE        , Ref::None, "add-double") \
-  OP(SUB_DOUBLE        , Ref::None, "sub-double") \
-  OP(MUL_DOUBLE        , Ref::None, "mul-double") \
-  OP(DIV_DOUBLE        , Ref::None, "div-double") \
-  OP(REM_DOUBLE        , Ref::None, "rem-double") \
-  OP(ADD_INT_LIT16     , Ref::Literal, "add-int/lit16") \
-  OP(RSUB_INT          , Ref::Literal, "rsub-int") \
-  OP(MUL_INT_LIT16     , Ref::Literal, "mul-int/lit16") \
-  OP(DIV_INT_LIT16     , Ref::Literal, "div-int/lit16") \
-  OP(REM_INT_LIT16     , Ref::Literal, "rem-int/lit16") \
-  OP(AND_INT_LIT16     , Ref::Literal, "and-int/lit16") \
-  OP(OR_INT_LIT16      , Ref::Literal, "or-int/lit16") \
-  OP(XOR_INT_LIT16     , Ref::Literal, "xor-int/lit16") \
-  OP(ADD_INT_LIT8      , Ref::Literal, "add-int/lit8") \
-  OP(RSUB_INT_LIT8     , Ref::Literal, "rsub-int/lit8") \
-  OP(MUL_INT_LIT8      , Ref::Literal, "mul-int/lit8") \
-  OP(DIV_INT_LIT8      , Ref::Literal, "div-int/lit8") \
-  OP(REM_INT_LIT8      , Ref::Literal, "rem-int/lit8") \
-  OP(AND_INT_LIT8      , Ref::Literal, "and-int/lit8") \
-  OP(OR_INT_LIT8       , Ref::Literal, "or-int/lit8") \
-  OP(XOR_INT_LIT8      , Ref::Literal, "xor-int/lit8") \
-  OP(SHL_INT_LIT8      , Ref::Literal, "shl-int/lit8") \
-  OP(SHR_INT_LIT8      , Ref::Literal, "shr-int/lit8") \
-  OP(USHR_INT_LIT8     , Ref::Literal, "ushr-int/lit8")
+  OP(NOP               , Ref::None, "nop", NO_TRAITS) \
+  OP(MOVE              , Ref::None, "move", NO_TRAITS) \
+  OP(MOVE_WIDE         , Ref::None, "move-wide", DEST_WIDE) \
+  OP(MOVE_OBJECT       , Ref::None, "move-object", NO_TRAITS) \
+  OP(MOVE_RESULT       , Ref::None, "move-result", NO_TRAITS) \
+  OP(MOVE_RESULT_WIDE  , Ref::None, "move-result-wide", DEST_WIDE) \
+  OP(MOVE_RESULT_OBJECT, Ref::None, "move-result-object", NO_TRAITS) \
+  OP(MOVE_EXCEPTION    , Ref::None, "move-exception", NO_TRAITS) \
+  OP(RETURN_VOID       , Ref::None, "return-void", NO_TRAITS) \
+  OP(RETURN            , Ref::None, "return", NO_TRAITS) \
+  OP(RETURN_WIDE       , Ref::None, "return-wide", NO_TRAITS) \
+  OP(RETURN_OBJECT     , Ref::None, "return-object", NO_TRAITS) \
+  OP(CONST             , Ref::Literal, "const", NO_TRAITS) \
+  OP(CONST_WIDE        , Ref::Literal, "const-wide", DEST_WIDE) \
+  OP(CONST_STRING      , Ref::String, "const-string", MAY_THROW) \
+  OP(CONST_CLASS       , Ref::Type, "const-class", MAY_THROW) \
+  OP(MONITOR_ENTER     , Ref::None, "monitor-enter", MAY_THROW) \
+  OP(MONITOR_EXIT      , Ref::None, "monitor-exit", MAY_THROW) \
+  OP(CHECK_CAST        , Ref::Type, "check-cast", MAY_THROW) \
+  OP(INSTANCE_OF       , Ref::Type, "instance-of", MAY_THROW) \
+  OP(ARRAY_LENGTH      , Ref::None, "array-length", MAY_THROW) \
+  OP(NEW_INSTANCE      , Ref::Type, "new-instance", MAY_THROW) \
+  OP(NEW_ARRAY         , Ref::Type, "new-array", MAY_THROW) \
+  OP(FILLED_NEW_ARRAY  , Ref::Type, "filled-new-array", MAY_THROW | HAS_RANGE) \
+  OP(FILL_ARRAY_DATA   , Ref::Data, "fill-array-data", NO_TRAITS) \
+  OP(THROW             , Ref::None, "throw", NO_TRAITS) \
+  OP(GOTO              , Ref::None, "goto", NO_TRAITS) \
+  OP(PACKED_SWITCH     , Ref::None, "packed-switch", NO_TRAITS) \
+  OP(SPARSE_SWITCH     , Ref::None, "sparse-switch", NO_TRAITS) \
+  OP(CMPL_FLOAT        , Ref::None, "cmpl-float", NO_TRAITS) \
+  OP(CMPG_FLOAT        , Ref::None, "cmpg-float", NO_TRAITS) \
+  OP(CMPL_DOUBLE       , Ref::None, "cmpl-double", NO_TRAITS) \
+  OP(CMPG_DOUBLE       , Ref::None, "cmpg-double", NO_TRAITS) \
+  OP(CMP_LONG          , Ref::None, "cmp-long", NO_TRAITS) \
+  OP(IF_EQ             , Ref::None, "if-eq", NO_TRAITS) \
+  OP(IF_NE             , Ref::None, "if-ne", NO_TRAITS) \
+  OP(IF_LT             , Ref::None, "if-lt", NO_TRAITS) \
+  OP(IF_GE             , Ref::None, "if-ge", NO_TRAITS) \
+  OP(IF_GT             , Ref::None, "if-gt", NO_TRAITS) \
+  OP(IF_LE             , Ref::None, "if-le", NO_TRAITS) \
+  OP(IF_EQZ            , Ref::None, "if-eqz", NO_TRAITS) \
+  OP(IF_NEZ            , Ref::None, "if-nez", NO_TRAITS) \
+  OP(IF_LTZ            , Ref::None, "if-ltz", NO_TRAITS) \
+  OP(IF_GEZ            , Ref::None, "if-gez", NO_TRAITS) \
+  OP(IF_GTZ            , Ref::None, "if-gtz", NO_TRAITS) \
+  OP(IF_LEZ            , Ref::None, "if-lez", NO_TRAITS) \
+  OP(AGET              , Ref::None, "aget", MAY_THROW) \
+  OP(AGET_WIDE         , Ref::None, "aget-wide", MAY_THROW | DEST_WIDE) \
+  OP(AGET_OBJECT       , Ref::None, "aget-object", MAY_THROW) \
+  OP(AGET_BOOLEAN      , Ref::None, "aget-boolean", MAY_THROW) \
+  OP(AGET_BYTE         , Ref::None, "aget-byte", MAY_THROW) \
+  OP(AGET_CHAR         , Ref::None, "aget-char", MAY_THROW) \
+  OP(AGET_SHORT        , Ref::None, "aget-short", MAY_THROW) \
+  OP(APUT              , Ref::None, "aput", MAY_THROW) \
+  OP(APUT_WIDE         , Ref::None, "aput-wide", MAY_THROW) \
+  OP(APUT_OBJECT       , Ref::None, "aput-object", MAY_THROW) \
+  OP(APUT_BOOLEAN      , Ref::None, "aput-boolean", MAY_THROW) \
+  OP(APUT_BYTE         , Ref::None, "aput-byte", MAY_THROW) \
+  OP(APUT_CHAR         , Ref::None, "aput-char", MAY_THROW) \
+  OP(APUT_SHORT        , Ref::None, "aput-short", MAY_THROW) \
+  OP(IGET              , Ref::Field, "iget", MAY_THROW) \
+  OP(IGET_WIDE         , Ref::Field, "iget-wide", MAY_THROW | DEST_WIDE) \
+  OP(IGET_OBJECT       , Ref::Field, "iget-object", MAY_THROW) \
+  OP(IGET_BOOLEAN      , Ref::Field, "iget-boolean", MAY_THROW) \
+  OP(IGET_BYTE         , Ref::Field, "iget-byte", MAY_THROW) \
+  OP(IGET_CHAR         , Ref::Field, "iget-char", MAY_THROW) \
+  OP(IGET_SHORT        , Ref::Field, "iget-short", MAY_THROW) \
+  OP(IPUT              , Ref::Field, "iput", MAY_THROW) \
+  OP(IPUT_WIDE         , Ref::Field, "iput-wide", MAY_THROW) \
+  OP(IPUT_OBJECT       , Ref::Field, "iput-object", MAY_THROW) \
+  OP(IPUT_BOOLEAN      , Ref::Field, "iput-boolean", MAY_THROW) \
+  OP(IPUT_BYTE         , Ref::Field, "iput-byte", MAY_THROW) \
+  OP(IPUT_CHAR         , Ref::Field, "iput-char", MAY_THROW) \
+  OP(IPUT_SHORT        , Ref::Field, "iput-short", MAY_THROW) \
+  OP(SGET              , Ref::Field, "sget", MAY_THROW) \
+  OP(SGET_WIDE         , Ref::Field, "sget-wide", MAY_THROW | DEST_WIDE) \
+  OP(SGET_OBJECT       , Ref::Field, "sget-object", MAY_THROW) \
+  OP(SGET_BOOLEAN      , Ref::Field, "sget-boolean", MAY_THROW) \
+  OP(SGET_BYTE         , Ref::Field, "sget-byte", MAY_THROW) \
+  OP(SGET_CHAR         , Ref::Field, "sget-char", MAY_THROW) \
+  OP(SGET_SHORT        , Ref::Field, "sget-short", MAY_THROW) \
+  OP(SPUT              , Ref::Field, "sput", MAY_THROW) \
+  OP(SPUT_WIDE         , Ref::Field, "sput-wide", MAY_THROW) \
+  OP(SPUT_OBJECT       , Ref::Field, "sput-object", MAY_THROW) \
+  OP(SPUT_BOOLEAN      , Ref::Field, "sput-boolean", MAY_THROW) \
+  OP(SPUT_BYTE         , Ref::Field, "sput-byte", MAY_THROW) \
+  OP(SPUT_CHAR         , Ref::Field, "sput-char", MAY_THROW) \
+  OP(SPUT_SHORT        , Ref::Field, "sput-short", MAY_THROW) \
+  OP(INVOKE_VIRTUAL    , Ref::Method, "invoke-virtual", MAY_THROW | HAS_RANGE) \
+  OP(INVOKE_SUPER      , Ref::Method, "invoke-super", MAY_THROW | HAS_RANGE) \
+  OP(INVOKE_DIRECT     , Ref::Method, "invoke-direct", MAY_THROW | HAS_RANGE) \
+  OP(INVOKE_STATIC     , Ref::Method, "invoke-static", MAY_THROW | HAS_RANGE) \
+  OP(INVOKE_INTERFACE  , Ref::Method, "invoke-interface", MAY_THROW | HAS_RANGE) \
+  OP(NEG_INT           , Ref::None, "neg-int", NO_TRAITS) \
+  OP(NOT_INT           , Ref::None, "not-int", NO_TRAITS) \
+  OP(NEG_LONG          , Ref::None, "neg-long", DEST_WIDE) \
+  OP(NOT_LONG          , Ref::None, "not-long", DEST_WIDE) \
+  OP(NEG_FLOAT         , Ref::None, "neg-float", NO_TRAITS) \
+  OP(NEG_DOUBLE        , Ref::None, "neg-double", DEST_WIDE) \
+  OP(INT_TO_LONG       , Ref::None, "int-to-long", DEST_WIDE) \
+  OP(INT_TO_FLOAT      , Ref::None, "int-to-float", NO_TRAITS) \
+  OP(INT_TO_DOUBLE     , Ref::None, "int-to-double", DEST_WIDE) \
+  OP(LONG_TO_INT       , Ref::None, "long-to-int", NO_TRAITS) \
+  OP(LONG_TO_FLOAT     , Ref::None, "long-to-float", NO_TRAITS) \
+  OP(LONG_TO_DOUBLE    , Ref::None, "long-to-double", DEST_WIDE) \
+  OP(FLOAT_TO_INT      , Ref::None, "float-to-int", NO_TRAITS) \
+  OP(FLOAT_TO_LONG     , Ref::None, "float-to-long", DEST_WIDE) \
+  OP(FLOAT_TO_DOUBLE   , Ref::None, "float-to-double", DEST_WIDE) \
+  OP(DOUBLE_TO_INT     , Ref::None, "double-to-int", NO_TRAITS) \
+  OP(DOUBLE_TO_LONG    , Ref::None, "double-to-long", DEST_WIDE) \
+  OP(DOUBLE_TO_FLOAT   , Ref::None, "double-to-float", NO_TRAITS) \
+  OP(INT_TO_BYTE       , Ref::None, "int-to-byte", NO_TRAITS) \
+  OP(INT_TO_CHAR       , Ref::None, "int-to-char", NO_TRAITS) \
+  OP(INT_TO_SHORT      , Ref::None, "int-to-short", NO_TRAITS) \
+  OP(ADD_INT           , Ref::None, "add-int", COMMUTATIVE) \
+  OP(SUB_INT           , Ref::None, "sub-int", NO_TRAITS) \
+  OP(MUL_INT           , Ref::None, "mul-int", COMMUTATIVE) \
+  OP(DIV_INT           , Ref::None, "div-int", MAY_THROW) \
+  OP(REM_INT           , Ref::None, "rem-int", MAY_THROW) \
+  OP(AND_INT           , Ref::None, "and-int", COMMUTATIVE) \
+  OP(OR_INT            , Ref::None, "or-int", COMMUTATIVE) \
+  OP(XOR_INT           , Ref::None, "xor-int", COMMUTATIVE) \
+  OP(SHL_INT           , Ref::None, "shl-int", NO_TRAITS) \
+  OP(SHR_INT           , Ref::None, "shr-int", NO_TRAITS) \
+  OP(USHR_INT          , Ref::None, "ushr-int", NO_TRAITS) \
+  OP(ADD_LONG          , Ref::None, "add-long", COMMUTATIVE | DEST_WIDE) \
+  OP(SUB_LONG          , Ref::None, "sub-long", DEST_WIDE) \
+  OP(MUL_LONG          , Ref::None, "mul-long", COMMUTATIVE | DEST_WIDE) \
+  OP(DIV_LONG          , Ref::None, "div-long", MAY_THROW | DEST_WIDE) \
+  OP(REM_LONG          , Ref::None, "rem-long", MAY_THROW | DEST_WIDE) \
+  OP(AND_LONG          , Ref::None, "and-long", COMMUTATIVE | DEST_WIDE) \
+  OP(OR_LONG           , Ref::None, "or-long", COMMUTATIVE | DEST_WIDE) \
+  OP(XOR_LONG          , Ref::None, "xor-long", COMMUTATIVE | DEST_WIDE) \
+  OP(SHL_LONG          , Ref::None, "shl-long", DEST_WIDE) \
+  OP(SHR_LONG          , Ref::None, "shr-long", DEST_WIDE) \
+  OP(USHR_LONG         , Ref::None, "ushr-long", DEST_WIDE) \
+  OP(ADD_FLOAT         , Ref::None, "add-float", COMMUTATIVE) \
+  OP(SUB_FLOAT         , Ref::None, "sub-float", NO_TRAITS) \
+  OP(MUL_FLOAT         , Ref::None, "mul-float", COMMUTATIVE) \
+  OP(DIV_FLOAT         , Ref::None, "div-float", NO_TRAITS) \
+  OP(REM_FLOAT         , Ref::None, "rem-float", NO_TRAITS) \
+  OP(ADD_DOUBLE        , Ref::None, "add-double", COMMUTATIVE | DEST_WIDE) \
+  OP(SUB_DOUBLE        , Ref::None, "sub-double", DEST_WIDE) \
+  OP(MUL_DOUBLE        , Ref::None, "mul-double", COMMUTATIVE | DEST_WIDE) \
+  OP(DIV_DOUBLE        , Ref::None, "div-double", DEST_WIDE) \
+  OP(REM_DOUBLE        , Ref::None, "rem-double", DEST_WIDE) \
+  OP(ADD_INT_LIT16     , Ref::Literal, "add-int/lit16", NO_TRAITS) \
+  OP(RSUB_INT          , Ref::Literal, "rsub-int", NO_TRAITS) \
+  OP(MUL_INT_LIT16     , Ref::Literal, "mul-int/lit16", NO_TRAITS) \
+  OP(DIV_INT_LIT16     , Ref::Literal, "div-int/lit16", MAY_THROW) \
+  OP(REM_INT_LIT16     , Ref::Literal, "rem-int/lit16", MAY_THROW) \
+  OP(AND_INT_LIT16     , Ref::Literal, "and-int/lit16", NO_TRAITS) \
+  OP(OR_INT_LIT16      , Ref::Literal, "or-int/lit16", NO_TRAITS) \
+  OP(XOR_INT_LIT16     , Ref::Literal, "xor-int/lit16", NO_TRAITS) \
+  OP(ADD_INT_LIT8      , Ref::Literal, "add-int/lit8", NO_TRAITS) \
+  OP(RSUB_INT_LIT8     , Ref::Literal, "rsub-int/lit8", NO_TRAITS) \
+  OP(MUL_INT_LIT8      , Ref::Literal, "mul-int/lit8", NO_TRAITS) \
+  OP(DIV_INT_LIT8      , Ref::Literal, "div-int/lit8", MAY_THROW) \
+  OP(REM_INT_LIT8      , Ref::Literal, "rem-int/lit8", MAY_THROW) \
+  OP(AND_INT_LIT8      , Ref::Literal, "and-int/lit8", NO_TRAITS) \
+  OP(OR_INT_LIT8       , Ref::Literal, "or-int/lit8", NO_TRAITS) \
+  OP(XOR_INT_LIT8      , Ref::Literal, "xor-int/lit8", NO_TRAITS) \
+  OP(SHL_INT_LIT8      , Ref::Literal, "shl-int/lit8", NO_TRAITS) \
+  OP(SHR_INT_LIT8      , Ref::Literal, "shr-int/lit8", NO_TRAITS) \
+  OP(USHR_INT_LIT8     , Ref::Literal, "ushr-int/lit8", NO_TRAITS)
 
 enum IROpcode : uint16_t {
 #define OP(op, code, ...) OPCODE_##op,
@@ -216,7 +228,45 @@ using bit_width_t = uint8_t;
 
 namespace opcode {
 
-Ref ref(IROpcode);
+namespace detail {
+
+// Both tables are indexed by IROpcode, with the internal opcodes last.
+constexpr Ref ref_table[] = {
+#define OP(op, ref, str, traits) ref,
+    OPS
+#undef OP
+    Ref::None, // IOPCODE_LOAD_PARAM
+    Ref::None, // IOPCODE_LOAD_PARAM_OBJECT
+    Ref::None, // IOPCODE_LOAD_PARAM_WIDE
+    Ref::None, // IOPCODE_MOVE_RESULT_PSEUDO
+    Ref::None, // IOPCODE_MOVE_RESULT_PSEUDO_OBJECT
+    Ref::None, // IOPCODE_MOVE_RESULT_PSEUDO_WIDE
+};
+
+constexpr uint8_t traits_table[] = {
+#define OP(op, ref, str, traits) static_cast<uint8_t>(traits),
+    OPS
+#undef OP
+    INTERNAL, // IOPCODE_LOAD_PARAM
+    INTERNAL, // IOPCODE_LOAD_PARAM_OBJECT
+    INTERNAL | DEST_WIDE, // IOPCODE_LOAD_PARAM_WIDE
+    INTERNAL, // IOPCODE_MOVE_RESULT_PSEUDO
+    INTERNAL, // IOPCODE_MOVE_RESULT_PSEUDO_OBJECT
+    INTERNAL | DEST_WIDE, // IOPCODE_MOVE_RESULT_PSEUDO_WIDE
+};
+
+static_assert(sizeof(traits_table) == IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1,
+              "Every IROpcode needs an entry in the traits table");
+static_assert(sizeof(ref_table) / sizeof(Ref) == sizeof(traits_table),
+              "Every IROpcode needs an entry in the ref table");
+
+inline bool has_trait(IROpcode op, uint8_t trait) {
+  return (traits_table[op] & trait) != 0;
+}
+
+} // namespace detail
+
+inline Ref ref(IROpcode op) { return detail::ref_table[op]; }
 
 /*
  * 2addr and non-2addr DexOpcode pairs will get mapped to the same IROpcode.
@@ -239,21 +289,29 @@ IROpcode from_dex_opcode(DexOpcode);
  */
 DexOpcode to_dex_opcode(IROpcode);
 
-bool may_throw(IROpcode);
+inline bool may_throw(IROpcode op) {
+  return detail::has_trait(op, MAY_THROW);
+}
 
 inline bool can_throw(IROpcode op) {
   return may_throw(op) || op == OPCODE_THROW;
 }
 
 // if an IROpcode can be translated to a DexOpcode of /range format
-bool has_range_form(IROpcode);
+inline bool has_range_form(IROpcode op) {
+  return detail::has_trait(op, HAS_RANGE);
+}
 
 DexOpcode range_version(IROpcode);
 
-bool has_variable_srcs_size(IROpcode op);
+inline bool has_variable_srcs_size(IROpcode op) {
+  return detail::has_trait(op, HAS_RANGE);
+}
 
 // Internal opcodes cannot be mapped to a corresponding DexOpcode.
-bool is_internal(IROpcode);
+inline bool is_internal(IROpcode op) {
+  return detail::has_trait(op, INTERNAL);
+}
 
 bool is_load_param(IROpcode);
 
@@ -263,7 +321,9 @@ bool is_move_result_or_move_result_pseudo(IROpcode op);
 
 bool is_move(IROpcode);
 
-bool is_commutative(IROpcode opcode);
+inline bool is_commutative(IROpcode op) {
+  return detail::has_trait(op, COMMUTATIVE);
+}
 
 IROpcode load_param_to_move(IROpcode);
 
@@ -302,7 +362,9 @@ bool has_move_result_pseudo(IROpcode);
 // encode that separately. So this just returns the minimum.
 unsigned min_srcs_size(IROpcode);
 
-bool dest_is_wide(IROpcode);
+inline bool dest_is_wide(IROpcode op) {
+  return opcode::detail::has_trait(op, opcode::DEST_WIDE);
+}
 
 bool dest_is_object(IROpcode);
 
@@ -321,21 +321,21 @@ void IRTypeChecker::run() {
     return;
   }
 
-  // We then infer types for all the registers used in the method.
+  // We then infer types for all the registers used in the method, reusing
+  // the result of an earlier inference if the code hasn't changed since.
   code->build_cfg(/* editable */ false);
-  const cfg::ControlFlowGraph& cfg = code->cfg();
-  m_type_inference = std::make_unique<TypeInference>(cfg);
-  m_type_inference->run(m_dex_method);
+  m_type_envs = type_inference::get_type_environments(m_dex_method);
 
   // Finally, we use the inferred types to type-check each instruction in the
   // method. We stop at the first type error encountered.
-  auto& type_envs = m_type_inference->get_type_environments();
+  const auto& type_envs = *m_type_envs;
   for (const MethodItemEntry& mie : InstructionIterable(code)) {
     IRInstruction* insn = mie.insn;
     try {
       auto it = type_envs.find(insn);
       always_assert(it != type_envs.end());
-      check_instruction(insn, &it->second);
+      TypeEnvironment env = it->second;
+      check_instruction(insn, &env);
     } catch (const TypeCheckingException& e) {
       m_good = false;
       std::ostringstream out;
@@ -351,7 +351,7 @@ void IRTypeChecker::run() {
 
   if (traceEnabled(TYPE, 5)) {
     std::ostringstream out;
-    m_type_inference->print(out);
+    out << *this;
     TRACE(TYPE, 5, "%s\n", out.str().c_str());
   }
 }
@@ -889,7 +889,7 @@ void IRTypeChecker::check_instruction(IRInstruction* insn,
 
 IRType IRTypeChecker::get_type(IRInstruction* insn, uint16_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->get_type_environments();
+  const auto& type_envs = *m_type_envs;
   auto it = type_envs.find(insn);
   if (it == type_envs.end()) {
     // The instruction doesn't belong to this method. We treat this as
@@ -902,7 +902,7 @@ IRType IRTypeChecker::get_type(IRInstruction* insn, uint16_t reg) const {
 const DexType* IRTypeChecker::get_dex_type(IRInstruction* insn,
                                            uint16_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->get_type_environments();
+  const auto& type_envs = *m_type_envs;
   auto it = type_envs.find(insn);
   if (it == type_envs.end()) {
     // The instruction doesn't belong to this method. We treat this as
@@ -913,6 +913,12 @@ const DexType* IRTypeChecker::get_dex_type(IRInstruction* insn,
 }
 
 std::ostream& operator<<(std::ostream& output, const IRTypeChecker& checker) {
-  checker.m_type_inference->print(output);
+  // Only the type environments are kept around, so printing the fixpoint
+  // means recomputing it.
+  auto code = checker.m_dex_method->get_code();
+  code->build_cfg(/* editable */ false);
+  TypeInference inference(code->cfg());
+  inference.run(checker.m_dex_method);
+  inference.print(output);
   return output;
 }
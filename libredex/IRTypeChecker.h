@@ -129,7 +129,7 @@ class IRTypeChecker final {
   bool m_check_no_overwrite_this;
   bool m_good;
   std::string m_what;
-  std::unique_ptr<type_inference::TypeInference> m_type_inference;
+  std::shared_ptr<const type_inference::TypeEnvironments> m_type_envs;
 
   friend std::ostream& operator<<(std::ostream&, const IRTypeChecker&);
 };
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+ * A map from DexTypes, DexClasses, field refs or method refs to values,
+ * stored in a flat vector indexed by the keys' dense ids (see
+ * RedexContext::make_type_id() and friends). Lookups are an array access
+ * instead of hashing a pointer and chasing a bucket.
+ *
+ * The vector grows to the largest id inserted, so an IdMap is best used for
+ * side tables that cover a good part of all the keys of that kind. It
+ * iterates in id order, i.e. in creation order of the keys.
+ *
+ * The interface is a subset of std::unordered_map's. Like a std::vector, it
+ * is not thread-safe, and insertions invalidate iterators and references.
+ */
+template <class Key, class Value>
+class IdMap {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+
+  template <class Map, class T>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    Iterator(Map* map, size_t index) : m_map(map), m_index(index) {
+      skip_empty();
+    }
+
+    reference operator*() const { return m_map->m_slots[m_index]; }
+    pointer operator->() const { return &m_map->m_slots[m_index]; }
+
+    Iterator& operator++() {
+      ++m_index;
+      skip_empty();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator result = *this;
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator& that) const {
+      return m_index == that.m_index;
+    }
+    bool operator!=(const Iterator& that) const { return !(*this == that); }
+
+   private:
+    friend class IdMap;
+
+    void skip_empty() {
+      while (m_index < m_map->m_slots.size() &&
+             m_map->m_slots[m_index].first == nullptr) {
+        ++m_index;
+      }
+    }
+
+    Map* m_map;
+    size_t m_index;
+  };
+
+  using iterator = Iterator<IdMap, value_type>;
+  using const_iterator = Iterator<const IdMap, const value_type>;
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, m_slots.size()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, m_slots.size()); }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  Value& operator[](Key key) {
+    auto id = key->get_dense_id();
+    if (id >= m_slots.size()) {
+      m_slots.resize(id + 1);
+    }
+    auto& slot = m_slots[id];
+    if (slot.first == nullptr) {
+      slot.first = key;
+      ++m_size;
+    }
+    return slot.second;
+  }
+
+  size_t count(Key key) const { return contains(key) ? 1 : 0; }
+
+  iterator find(Key key) {
+    return contains(key) ? iterator(this, key->get_dense_id()) : end();
+  }
+
+  const_iterator find(Key key) const {
+    return contains(key) ? const_iterator(this, key->get_dense_id()) : end();
+  }
+
+  const Value& at(Key key) const {
+    if (!contains(key)) {
+      throw std::out_of_range("IdMap::at");
+    }
+    return m_slots[key->get_dense_id()].second;
+  }
+
+  Value& at(Key key) {
+    return const_cast<Value&>(static_cast<const IdMap*>(this)->at(key));
+  }
+
+  size_t erase(Key key) {
+    if (!contains(key)) {
+      return 0;
+    }
+    m_slots[key->get_dense_id()] = value_type();
+    --m_size;
+    return 1;
+  }
+
+  iterator erase(iterator pos) {
+    m_slots[pos.m_index] = value_type();
+    --m_size;
+    return ++pos;
+  }
+
+  void clear() {
+    m_slots.clear();
+    m_size = 0;
+  }
+
+ private:
+  bool contains(Key key) const {
+    auto id = key->get_dense_id();
+    return id < m_slots.size() && m_slots[id].first != nullptr;
+  }
+
+  std::vector<value_type> m_slots;
+  size_t m_size{0};
+};
@@ -13,12 +13,14 @@
 #include "DexUtil.h"
 #include "EditableCfgAdapter.h"
 #include "IRInstruction.h"
+#include "Liveness.h"
 #include "Mutators.h"
 #include "OptData.h"
 #include "Resolver.h"
 #include "Transform.h"
 #include "UnknownVirtuals.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 using namespace opt_metadata;
 
@@ -55,6 +57,50 @@ DEBUG_ONLY bool method_breakup(
  */
 constexpr uint64_t HARD_MAX_INSTRUCTION_SIZE = 1L << 32;
 
+size_t registers_size(const IRCode* code) {
+  return code->editable_cfg_built() ? code->cfg().get_registers_size()
+                                    : code->get_registers_size();
+}
+
+/*
+ * The largest number of registers live at once in the code. Liveness needs
+ * the exit block of the CFG, which calculate_exit_block may add to it, so this
+ * runs on a copy and leaves the code alone.
+ */
+size_t max_live(const IRCode* code) {
+  cfg::ControlFlowGraph copy_cfg;
+  std::unique_ptr<IRCode> copy;
+  cfg::ControlFlowGraph* cfg;
+  if (code->editable_cfg_built()) {
+    code->cfg().deep_copy(&copy_cfg);
+    cfg = &copy_cfg;
+  } else {
+    copy = std::make_unique<IRCode>(*code);
+    copy->build_cfg(/* editable */ false);
+    cfg = &copy->cfg();
+  }
+  cfg->calculate_exit_block();
+  LivenessFixpointIterator liveness(*cfg);
+  liveness.run(LivenessDomain(cfg->get_registers_size()));
+
+  size_t max = 0;
+  for (auto block : cfg->blocks()) {
+    auto live = liveness.get_live_out_vars_at(block);
+    if (live.is_bottom()) {
+      continue;
+    }
+    max = std::max(max, live.size());
+    for (auto it = block->rbegin(); it != block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      liveness.analyze_instruction(it->insn, &live);
+      max = std::max(max, live.size());
+    }
+  }
+  return max;
+}
+
 /*
  * Some versions of ART (5.0.0 - 5.0.2) will fail to verify a method if it
  * is too large. See https://code.google.com/p/android/issues/detail?id=66655.
@@ -127,6 +173,10 @@ MultiMethodInliner::MultiMethodInliner(
 }
 
 void MultiMethodInliner::inline_methods() {
+  if (m_config.parallel) {
+    inline_methods_by_scc_level();
+    return;
+  }
   // we want to inline bottom up, so as a first step we identify all the
   // top level callers, then we recurse into all inlinable callees until we
   // hit a leaf and we start inlining from there
@@ -142,6 +192,190 @@ void MultiMethodInliner::inline_methods() {
   }
 }
 
+namespace {
+
+/*
+ * Tarjan's algorithm, run iteratively since call chains can be very deep.
+ * Only nodes reachable from `roots` are visited. Components are returned
+ * callees-first, i.e. in reverse topological order of the condensed graph.
+ */
+template <typename Successors>
+std::vector<std::vector<DexMethod*>> strongly_connected_components(
+    const std::vector<DexMethod*>& roots, const Successors& successors) {
+  struct NodeState {
+    size_t index;
+    size_t lowlink;
+    bool on_stack;
+  };
+  std::vector<std::vector<DexMethod*>> components;
+  std::unordered_map<DexMethod*, NodeState> states;
+  std::vector<DexMethod*> stack;
+  // (node, index of the next successor to explore)
+  std::vector<std::pair<DexMethod*, size_t>> dfs;
+  size_t next_index = 0;
+
+  auto visit = [&](DexMethod* node) {
+    states[node] = NodeState{next_index, next_index, true};
+    ++next_index;
+    stack.push_back(node);
+    dfs.emplace_back(node, 0);
+  };
+
+  for (auto root : roots) {
+    if (states.count(root)) {
+      continue;
+    }
+    visit(root);
+    while (!dfs.empty()) {
+      DexMethod* node = dfs.back().first;
+      const auto* succs = successors(node);
+      if (succs != nullptr && dfs.back().second < succs->size()) {
+        DexMethod* succ = (*succs)[dfs.back().second++];
+        auto it = states.find(succ);
+        if (it == states.end()) {
+          visit(succ);
+        } else if (it->second.on_stack) {
+          auto& state = states.at(node);
+          state.lowlink = std::min(state.lowlink, it->second.index);
+        }
+        continue;
+      }
+      dfs.pop_back();
+      const auto& state = states.at(node);
+      if (!dfs.empty()) {
+        auto& parent = states.at(dfs.back().first);
+        parent.lowlink = std::min(parent.lowlink, state.lowlink);
+      }
+      if (state.lowlink == state.index) {
+        components.emplace_back();
+        auto& component = components.back();
+        DexMethod* member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          states.at(member).on_stack = false;
+          component.push_back(member);
+        } while (member != node);
+      }
+    }
+  }
+  return components;
+}
+
+} // namespace
+
+void MultiMethodInliner::inline_methods_by_scc_level() {
+  // Like the serial walk, start from the top level callers and only look at
+  // what is reachable from them.
+  std::vector<DexMethod*> roots;
+  for (auto& it : caller_callee) {
+    if (callee_caller.find(it.first) == callee_caller.end()) {
+      roots.push_back(it.first);
+    }
+  }
+  auto components = strongly_connected_components(
+      roots, [&](DexMethod* caller) -> const std::vector<DexMethod*>* {
+        auto it = caller_callee.find(caller);
+        return it == caller_callee.end() ? nullptr : &it->second;
+      });
+
+  // Components come out callees-first, so the levels of everything a
+  // component calls are known by the time we get to it.
+  std::unordered_map<DexMethod*, size_t> component_of;
+  std::vector<size_t> component_level(components.size(), 0);
+  std::vector<std::vector<DexMethod*>> levels;
+  for (size_t c = 0; c < components.size(); ++c) {
+    for (auto member : components[c]) {
+      component_of.emplace(member, c);
+    }
+    size_t level = 0;
+    for (auto member : components[c]) {
+      auto callees_it = caller_callee.find(member);
+      if (callees_it == caller_callee.end()) {
+        continue;
+      }
+      for (auto callee : callees_it->second) {
+        // Leaf callees don't hold anything up.
+        auto callee_component = component_of.find(callee);
+        if (callee_component != component_of.end() &&
+            callee_component->second != c && caller_callee.count(callee)) {
+          level =
+              std::max(level, component_level[callee_component->second] + 1);
+        }
+      }
+    }
+    component_level[c] = level;
+    if (levels.size() <= level) {
+      levels.resize(level + 1);
+    }
+    for (auto member : components[c]) {
+      if (caller_callee.count(member)) {
+        levels[level].push_back(member);
+      }
+    }
+  }
+  TRACE(INLINE, 2, "Inlining %u callers in %u levels\n", component_of.size(),
+        levels.size());
+
+  // Inlining into concurrent callers would otherwise race on building and
+  // tearing down the CFGs of shared callees.
+  std::vector<IRCode*> built_cfgs;
+  if (m_config.use_cfg_inliner) {
+    std::unordered_set<IRCode*> codes;
+    for (auto& it : caller_callee) {
+      if (!component_of.count(it.first)) {
+        continue;
+      }
+      codes.insert(it.first->get_code());
+      for (auto callee : it.second) {
+        codes.insert(callee->get_code());
+      }
+    }
+    for (auto code : codes) {
+      if (code != nullptr && !code->editable_cfg_built()) {
+        built_cfgs.push_back(code);
+      }
+    }
+    auto wq = workqueue_foreach<IRCode*>(
+        [](IRCode* code) { code->build_cfg(/* editable */ true); });
+    for (auto code : built_cfgs) {
+      wq.add_item(code);
+    }
+    wq.run_all();
+  }
+
+  for (const auto& level_callers : levels) {
+    if (level_callers.empty()) {
+      continue;
+    }
+    auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* caller) {
+      TraceContext context(caller->get_deobfuscated_name());
+      auto component = component_of.at(caller);
+      std::vector<DexMethod*> nonrecursive_callees;
+      for (auto callee : caller_callee.at(caller)) {
+        auto callee_component = component_of.find(callee);
+        if (callee_component != component_of.end() &&
+            callee_component->second == component) {
+          info.recursive++;
+          continue;
+        }
+        if (should_inline(caller, callee)) {
+          nonrecursive_callees.push_back(callee);
+        }
+      }
+      inline_callees(caller, nonrecursive_callees);
+    });
+    for (auto caller : level_callers) {
+      wq.add_item(caller);
+    }
+    wq.run_all();
+  }
+
+  for (auto code : built_cfgs) {
+    code->clear_cfg();
+  }
+}
+
 void MultiMethodInliner::caller_inline(
     DexMethod* caller,
     const std::vector<DexMethod*>& callees,
@@ -252,10 +486,17 @@ void MultiMethodInliner::inline_inlinables(
     }
   }
 
+  // When inlining in parallel, the callers already keep all threads busy.
+  if (!m_config.parallel) {
+    summarize_callees(caller_method, inlinables);
+  }
+
   // attempt to inline all inlinable candidates
   size_t estimated_insn_size = caller->editable_cfg_built()
                                    ? caller->cfg().sum_opcode_sizes()
                                    : caller->sum_opcode_sizes();
+  bool inlined_any = false;
+  boost::optional<size_t> caller_max_live;
   for (auto inlinable : inlinables) {
     auto callee_method = inlinable.first;
     auto callee = callee_method->get_code();
@@ -265,6 +506,11 @@ void MultiMethodInliner::inline_inlinables(
                       estimated_insn_size)) {
       continue;
     }
+    if (too_much_register_pressure(caller_method, callee_method,
+                                   &caller_max_live)) {
+      log_nopt(INL_REGISTER_PRESSURE, caller_method, callsite->insn);
+      continue;
+    }
 
     TRACE(MMINL, 4, "inline %s (%d) in %s (%d)\n", SHOW(callee),
           caller->get_registers_size(), SHOW(caller),
@@ -288,12 +534,27 @@ void MultiMethodInliner::inline_inlinables(
     estimated_insn_size += callee->editable_cfg_built()
                                ? callee->cfg().sum_opcode_sizes()
                                : callee->sum_opcode_sizes();
+    if (caller_max_live) {
+      // The inlined registers are renamed past the caller's, so they may
+      // all be live on top of what already was.
+      *caller_max_live += get_max_live(callee_method);
+    }
 
     TRACE(MMINL, 6, "checking visibility usage of members in %s\n",
           SHOW(callee));
-    change_visibility(callee_method, caller_method->get_class());
+    {
+      std::lock_guard<std::mutex> lock(m_inlined_mutex);
+      change_visibility(callee_method, caller_method->get_class());
+      inlined.insert(callee_method);
+    }
     info.calls_inlined++;
-    inlined.insert(callee_method);
+    inlined_any = true;
+  }
+
+  if (inlined_any) {
+    // The caller now makes the references of its inlined callees.
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    m_callee_summaries.erase(caller_method);
   }
 
   for (IRCode* code : need_deconstruct) {
@@ -301,6 +562,90 @@ void MultiMethodInliner::inline_inlinables(
   }
 }
 
+void MultiMethodInliner::summarize_callees(
+    const DexMethod* caller,
+    const std::vector<std::pair<DexMethod*, IRList::iterator>>& inlinables) {
+  std::vector<const DexMethod*> callees;
+  {
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    std::unordered_set<const DexMethod*> seen;
+    for (const auto& inlinable : inlinables) {
+      auto callee = inlinable.first;
+      if (!m_callee_summaries.count(callee) && seen.insert(callee).second) {
+        callees.push_back(callee);
+      }
+    }
+  }
+  if (callees.size() < 2) {
+    return;
+  }
+
+  bool caller_blacklisted =
+      m_config.get_caller_black_list().count(caller->get_class());
+  auto wq = workqueue_foreach<const DexMethod*>([&](const DexMethod* callee) {
+    const auto& summary = get_callee_summary(callee);
+    // Only scan the opcodes if is_inlinable gets that far, as the scan marks
+    // methods to be made static.
+    if (caller_blacklisted || summary.blacklisted || summary.external_catch ||
+        xstores.illegal_refs(xstores.get_store_idx(callee->get_class()),
+                             summary.referenced_stores)) {
+      return;
+    }
+    get_opcode_verdict(caller, callee);
+  });
+  for (auto callee : callees) {
+    wq.add_item(callee);
+  }
+  wq.run_all();
+}
+
+MultiMethodInliner::CalleeSummary& MultiMethodInliner::get_callee_summary(
+    const DexMethod* callee) {
+  {
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    auto it = m_callee_summaries.find(callee);
+    if (it != m_callee_summaries.end()) {
+      return it->second;
+    }
+  }
+
+  CalleeSummary summary;
+  const IRCode* code = callee->get_code();
+  auto refs = xstores.make_refs();
+  editable_cfg_adapter::iterate(code, [&](const MethodItemEntry& mie) {
+    auto insn = mie.insn;
+    if (insn->has_type()) {
+      xstores.add_ref(insn->get_type(), &refs);
+    } else if (insn->has_method()) {
+      auto meth = insn->get_method();
+      xstores.add_ref(meth->get_class(), &refs);
+      auto proto = meth->get_proto();
+      xstores.add_ref(proto->get_rtype(), &refs);
+      auto args = proto->get_args();
+      if (args != nullptr) {
+        for (const auto& arg : args->get_type_list()) {
+          xstores.add_ref(arg, &refs);
+        }
+      }
+    } else if (insn->has_field()) {
+      auto field = insn->get_field();
+      xstores.add_ref(field->get_class(), &refs);
+      xstores.add_ref(field->get_type(), &refs);
+    }
+    return editable_cfg_adapter::LOOP_CONTINUE;
+  });
+  summary.referenced_stores = std::move(refs);
+  summary.code_size = code->editable_cfg_built()
+                          ? code->cfg().sum_opcode_sizes()
+                          : code->sum_opcode_sizes();
+  summary.blacklisted = is_blacklisted(callee);
+  summary.external_catch = has_external_catch(callee);
+
+  std::lock_guard<std::mutex> lock(m_cache_mutex);
+  // Another thread may have summarized the callee in the meantime.
+  return m_callee_summaries.emplace(callee, std::move(summary)).first->second;
+}
+
 /**
  * Defines the set of rules that determine whether a function is inlinable.
  */
@@ -313,7 +658,8 @@ bool MultiMethodInliner::is_inlinable(DexMethod* caller,
     log_nopt(INL_CROSS_STORE_REFS, caller, insn);
     return false;
   }
-  if (is_blacklisted(callee)) {
+  const auto& summary = get_callee_summary(callee);
+  if (summary.blacklisted) {
     log_nopt(INL_BLACKLISTED_CALLEE, callee);
     return false;
   }
@@ -321,7 +667,7 @@ bool MultiMethodInliner::is_inlinable(DexMethod* caller,
     log_nopt(INL_BLACKLISTED_CALLER, caller);
     return false;
   }
-  if (has_external_catch(callee)) {
+  if (summary.external_catch) {
     log_nopt(INL_EXTERN_CATCH, callee);
     return false;
   }
@@ -386,9 +732,7 @@ bool MultiMethodInliner::is_estimate_over_max(uint64_t estimated_caller_size,
   // INSTRUCTION_BUFFER is added because the final method size is often larger
   // than our estimate -- during the sync phase, we may have to pick larger
   // branch opcodes to encode large jumps.
-  const IRCode* code = callee->get_code();
-  auto callee_size = code->editable_cfg_built() ? code->cfg().sum_opcode_sizes()
-                                                : code->sum_opcode_sizes();
+  auto callee_size = get_callee_summary(callee).code_size;
   if (estimated_caller_size + callee_size > max - INSTRUCTION_BUFFER) {
     info.caller_too_large++;
     return true;
@@ -420,6 +764,43 @@ bool MultiMethodInliner::caller_too_large(DexType* caller_type,
   return false;
 }
 
+bool MultiMethodInliner::too_much_register_pressure(
+    const DexMethod* caller,
+    const DexMethod* callee,
+    boost::optional<size_t>* caller_max_live) {
+  auto limit = m_config.max_register_pressure;
+  if (limit == 0 || callee->rstate.force_inline()) {
+    return false;
+  }
+  if (registers_size(caller->get_code()) +
+          registers_size(callee->get_code()) <=
+      limit) {
+    return false;
+  }
+  if (!*caller_max_live) {
+    *caller_max_live = max_live(caller->get_code());
+  }
+  if (**caller_max_live + get_max_live(callee) <= limit) {
+    return false;
+  }
+  info.register_pressure++;
+  return true;
+}
+
+size_t MultiMethodInliner::get_max_live(const DexMethod* callee) {
+  auto& summary = get_callee_summary(callee);
+  {
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    if (summary.max_live) {
+      return *summary.max_live;
+    }
+  }
+  auto result = max_live(callee->get_code());
+  std::lock_guard<std::mutex> lock(m_cache_mutex);
+  summary.max_live = result;
+  return result;
+}
+
 bool MultiMethodInliner::should_inline(const DexMethod* caller,
                                        const DexMethod* callee) const {
   if (callee->rstate.force_inline()) {
@@ -454,13 +835,18 @@ bool MultiMethodInliner::too_many_callers(const DexMethod* callee) const {
   auto caller_count = callers.size();
   always_assert(caller_count > 0);
 
-  auto opcode_counts_it = m_opcode_counts.find(callee);
   size_t code_size;
-  if (opcode_counts_it != m_opcode_counts.end()) {
-    code_size = opcode_counts_it->second;
-  } else {
-    m_opcode_counts[callee] = code_size =
-        count_important_opcodes(callee->get_code());
+  {
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    auto opcode_counts_it = m_opcode_counts.find(callee);
+    if (opcode_counts_it != m_opcode_counts.end()) {
+      code_size = opcode_counts_it->second;
+    } else {
+      lock.unlock();
+      code_size = count_important_opcodes(callee->get_code());
+      lock.lock();
+      m_opcode_counts.emplace(callee, code_size);
+    }
   }
 
   if (!can_delete(callee)) {
@@ -475,6 +861,7 @@ bool MultiMethodInliner::too_many_callers(const DexMethod* callee) const {
     return false;
   }
 
+  std::unique_lock<std::mutex> lock(m_cache_mutex);
   auto callers_in_same_class_it = m_callers_in_same_class.find(callee);
   bool have_all_callers_same_class;
   if (callers_in_same_class_it != m_callers_in_same_class.end()) {
@@ -490,6 +877,7 @@ bool MultiMethodInliner::too_many_callers(const DexMethod* callee) const {
     }
     m_callers_in_same_class.emplace(callee, have_all_callers_same_class);
   }
+  lock.unlock();
 
   unsigned long locality_advantage = have_all_callers_same_class ? 2 : 0;
   if (m_config.multiple_callers) {
@@ -541,44 +929,60 @@ bool MultiMethodInliner::has_external_catch(const DexMethod* callee) {
 bool MultiMethodInliner::cannot_inline_opcodes(const DexMethod* caller,
                                                const DexMethod* callee,
                                                const IRInstruction* invk_insn) {
+  auto verdict = get_opcode_verdict(caller, callee);
+  if (verdict.reason) {
+    log_nopt(*verdict.reason, caller, invk_insn);
+  }
+  return verdict.cannot_inline;
+}
+
+MultiMethodInliner::CalleeSummary::OpcodeVerdict
+MultiMethodInliner::get_opcode_verdict(const DexMethod* caller,
+                                       const DexMethod* callee) {
+  auto& summary = get_callee_summary(callee);
+  bool same_class = caller->get_class() == callee->get_class();
+  auto& cached = same_class ? summary.same_class_verdict
+                            : summary.other_class_verdict;
+  {
+    std::lock_guard<std::mutex> lock(m_cache_mutex);
+    if (cached) {
+      return *cached;
+    }
+  }
+
   int ret_count = 0;
-  bool can_inline = true;
+  CalleeSummary::OpcodeVerdict verdict;
+  auto reject = [&](boost::optional<NoptReason> reason) {
+    verdict.cannot_inline = true;
+    verdict.reason = reason;
+    return editable_cfg_adapter::LOOP_BREAK;
+  };
   editable_cfg_adapter::iterate(
       callee->get_code(), [&](const MethodItemEntry& mie) {
         auto insn = mie.insn;
         if (create_vmethod(insn, callee, caller)) {
-          log_nopt(INL_CREATE_VMETH, caller, invk_insn);
-          can_inline = false;
-          return editable_cfg_adapter::LOOP_BREAK;
+          return reject(INL_CREATE_VMETH);
         }
         // if the caller and callee are in the same class, we don't have to
         // worry about invoke supers, or unknown virtuals -- private / protected
         // methods will remain accessible
-        if (caller->get_class() != callee->get_class()) {
+        if (!same_class) {
           if (nonrelocatable_invoke_super(insn)) {
-            log_nopt(INL_HAS_INVOKE_SUPER, caller, invk_insn);
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(INL_HAS_INVOKE_SUPER);
           }
           if (unknown_virtual(insn)) {
-            log_nopt(INL_UNKNOWN_VIRTUAL, caller, invk_insn);
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(INL_UNKNOWN_VIRTUAL);
           }
           if (unknown_field(insn)) {
-            log_nopt(INL_UNKNOWN_FIELD, caller, invk_insn);
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(INL_UNKNOWN_FIELD);
           }
           if (check_android_os_version(insn)) {
-            can_inline = false;
-            return editable_cfg_adapter::LOOP_BREAK;
+            return reject(boost::none);
           }
         }
         if (!m_config.throws_inline && insn->opcode() == OPCODE_THROW) {
           info.throws++;
-          can_inline = false;
-          return editable_cfg_adapter::LOOP_BREAK;
+          return reject(boost::none);
         }
         if (is_return(insn->opcode())) {
           ++ret_count;
@@ -595,9 +999,12 @@ bool MultiMethodInliner::cannot_inline_opcodes(const DexMethod* caller,
   if (ret_count > 1 && !m_config.use_cfg_inliner) {
     info.multi_ret++;
     log_nopt(INL_MULTIPLE_RETURNS, callee);
-    can_inline = false;
+    verdict.cannot_inline = true;
   }
-  return !can_inline;
+
+  std::lock_guard<std::mutex> lock(m_cache_mutex);
+  cached = verdict;
+  return verdict;
 }
 
 /**
@@ -631,6 +1038,7 @@ bool MultiMethodInliner::create_vmethod(IRInstruction* insn,
       return false;
     }
     if (!is_native(method) && !has_keep(method)) {
+      std::lock_guard<std::mutex> lock(m_inlined_mutex);
       m_make_static.insert(method);
     } else {
       info.need_vmethod++;
@@ -737,52 +1145,12 @@ bool MultiMethodInliner::check_android_os_version(IRInstruction* insn) {
 
 bool MultiMethodInliner::cross_store_reference(const DexMethod* callee) {
   size_t store_idx = xstores.get_store_idx(callee->get_class());
-  bool has_cross_store_ref = false;
-  editable_cfg_adapter::iterate(
-      callee->get_code(), [&](const MethodItemEntry& mie) {
-        auto insn = mie.insn;
-        if (insn->has_type()) {
-          if (xstores.illegal_ref(store_idx, insn->get_type())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-        } else if (insn->has_method()) {
-          auto meth = insn->get_method();
-          if (xstores.illegal_ref(store_idx, meth->get_class())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-          auto proto = meth->get_proto();
-          if (xstores.illegal_ref(store_idx, proto->get_rtype())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-          auto args = proto->get_args();
-          if (args == nullptr) {
-            return editable_cfg_adapter::LOOP_CONTINUE;
-          }
-          for (const auto& arg : args->get_type_list()) {
-            if (xstores.illegal_ref(store_idx, arg)) {
-              info.cross_store++;
-              has_cross_store_ref = true;
-              return editable_cfg_adapter::LOOP_BREAK;
-            }
-          }
-        } else if (insn->has_field()) {
-          auto field = insn->get_field();
-          if (xstores.illegal_ref(store_idx, field->get_class()) ||
-              xstores.illegal_ref(store_idx, field->get_type())) {
-            info.cross_store++;
-            has_cross_store_ref = true;
-            return editable_cfg_adapter::LOOP_BREAK;
-          }
-        }
-        return editable_cfg_adapter::LOOP_CONTINUE;
-      });
-  return has_cross_store_ref;
+  if (xstores.illegal_refs(store_idx,
+                           get_callee_summary(callee).referenced_stores)) {
+    info.cross_store++;
+    return true;
+  }
+  return false;
 }
 
 void MultiMethodInliner::invoke_direct_to_static() {
@@ -7,14 +7,19 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <set>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 #include "DexClass.h"
 #include "DexStore.h"
 #include "IRCode.h"
+#include "OptDataDefs.h"
 #include "PatriciaTreeSet.h"
 #include "Resolver.h"
 
@@ -121,6 +126,19 @@ class MultiMethodInliner {
                      sparta::PatriciaTreeSet<DexMethod*> call_stack,
                      std::unordered_set<DexMethod*>* visited);
 
+  /**
+   * Parallel alternative to the recursive caller_inline() walk, used when
+   * InlinerConfig::parallel is set.
+   *
+   * The strongly connected components of the caller -> callee graph are
+   * assigned levels, leaves first: a component's level is one more than the
+   * highest level among the components it calls into. All callers in a level
+   * only read code from lower levels, which is final by then, so they are
+   * inlined concurrently, one level at a time. Calls within a component are
+   * recursive and are never inlined.
+   */
+  void inline_methods_by_scc_level();
+
   void inline_inlinables(
       DexMethod* caller,
       const std::vector<std::pair<DexMethod*, IRList::iterator>>& inlinables);
@@ -197,7 +215,8 @@ class MultiMethodInliner {
 
   /**
    * Return true if a caller is in a DEX in a store and any opcode in callee
-   * refers to a DexMember in a different store .
+   * refers to a DexMember in a different store. The stores the callee refers
+   * to are computed once, so each check is a bitset intersection.
    */
   bool cross_store_reference(const DexMethod* context);
 
@@ -217,6 +236,19 @@ class MultiMethodInliner {
                         size_t estimated_caller_size,
                         const DexMethod* callee);
 
+  /**
+   * Return true if inlining the callee could leave more registers live at
+   * once in the caller than InlinerConfig::max_register_pressure. The
+   * inlined registers are renamed past the caller's, so the register counts
+   * of both add up to a bound that is checked first; past it, the largest
+   * numbers of registers live at once in each are added instead.
+   * `caller_max_live` caches the caller's for the inlining step it is in,
+   * and grows by the callee's with every call site that is inlined.
+   */
+  bool too_much_register_pressure(const DexMethod* caller,
+                                  const DexMethod* callee,
+                                  boost::optional<size_t>* caller_max_live);
+
   /**
    * Return whether the callee should be inlined into the caller. This differs
    * from is_inlinable in that the former is concerned with whether inlining is
@@ -263,6 +295,13 @@ class MultiMethodInliner {
    */
   std::unordered_set<DexMethod*> inlined;
 
+  /**
+   * Guards `inlined`, `m_make_static` and the visibility changes made to
+   * members referenced by inlined code, all of which are shared between
+   * callers when inlining in parallel.
+   */
+  std::mutex m_inlined_mutex;
+
   //
   // Maps from callee to callers and reverse map from caller to callees.
   // Those are used to perform bottom up inlining.
@@ -280,29 +319,94 @@ class MultiMethodInliner {
   // Cache of whether all callers of a callee are in the same class.
   mutable std::unordered_map<const DexMethod*, bool> m_callers_in_same_class;
 
+  /**
+   * What the legality and size checks of is_inlinable find in a callee's
+   * code, which is the same at each of its call sites.
+   */
+  struct CalleeSummary {
+    // Whether the opcodes of the callee keep it out of callers of the same
+    // class, or of other classes, and the reason to log at each call site.
+    struct OpcodeVerdict {
+      bool cannot_inline{false};
+      boost::optional<NoptReason> reason;
+    };
+
+    // The stores that the callee's code refers to, as a bitset over
+    // XStoreRefs store idxs.
+    boost::dynamic_bitset<> referenced_stores;
+    size_t code_size{0};
+    bool blacklisted{false};
+    bool external_catch{false};
+    // Computed on first use: scanning the opcodes for callers of another
+    // class marks the private methods it calls to be made static.
+    boost::optional<OpcodeVerdict> same_class_verdict;
+    boost::optional<OpcodeVerdict> other_class_verdict;
+    // The largest number of registers live at once, computed on first use.
+    boost::optional<size_t> max_live;
+  };
+
+  // Cache of the summary of each callee. Dropped when the method gets callees
+  // inlined, which is the only time its code changes while inlining.
+  mutable std::unordered_map<const DexMethod*, CalleeSummary>
+      m_callee_summaries;
+
+  // Guards the caches above.
+  mutable std::mutex m_cache_mutex;
+
+  /**
+   * Return the cached summary of the callee, computing all but its opcode
+   * verdicts if it isn't cached yet. The summary stays valid until the callee
+   * gets callees inlined.
+   */
+  CalleeSummary& get_callee_summary(const DexMethod* callee);
+
+  /**
+   * Return the verdict on the opcodes of the callee for callers of the class
+   * of `caller`, scanning them for those that are difficult or impossible to
+   * inline if it isn't cached yet.
+   */
+  CalleeSummary::OpcodeVerdict get_opcode_verdict(const DexMethod* caller,
+                                                  const DexMethod* callee);
+
+  /**
+   * Return the largest number of registers live at once in the callee,
+   * running liveness on a copy of its code if it isn't cached yet.
+   */
+  size_t get_max_live(const DexMethod* callee);
+
+  /**
+   * Summarize the callees of `inlinables` that aren't summarized yet in
+   * parallel, as far as the caller will check them.
+   */
+  void summarize_callees(
+      const DexMethod* caller,
+      const std::vector<std::pair<DexMethod*, IRList::iterator>>& inlinables);
+
  private:
   /**
-   * Info about inlining.
+   * Info about inlining. Counters are atomic as they are bumped from every
+   * thread when inlining in parallel.
    */
   struct InliningInfo {
-    size_t calls_inlined{0};
-    size_t recursive{0};
-    size_t not_found{0};
-    size_t blacklisted{0};
-    size_t throws{0};
-    size_t multi_ret{0};
-    size_t need_vmethod{0};
-    size_t invoke_super{0};
-    size_t write_over_ins{0};
-    size_t escaped_virtual{0};
-    size_t known_public_methods{0};
-    size_t unresolved_methods{0};
-    size_t non_pub_virtual{0};
-    size_t escaped_field{0};
-    size_t non_pub_field{0};
-    size_t non_pub_ctor{0};
-    size_t cross_store{0};
-    size_t caller_too_large{0};
+    std::atomic<size_t> calls_inlined{0};
+    std::atomic<size_t> recursive{0};
+    std::atomic<size_t> not_found{0};
+    std::atomic<size_t> blacklisted{0};
+    std::atomic<size_t> throws{0};
+    std::atomic<size_t> multi_ret{0};
+    std::atomic<size_t> need_vmethod{0};
+    std::atomic<size_t> invoke_super{0};
+    std::atomic<size_t> write_over_ins{0};
+    std::atomic<size_t> escaped_virtual{0};
+    std::atomic<size_t> known_public_methods{0};
+    std::atomic<size_t> unresolved_methods{0};
+    std::atomic<size_t> non_pub_virtual{0};
+    std::atomic<size_t> escaped_field{0};
+    std::atomic<size_t> non_pub_field{0};
+    std::atomic<size_t> non_pub_ctor{0};
+    std::atomic<size_t> cross_store{0};
+    std::atomic<size_t> caller_too_large{0};
+    std::atomic<size_t> register_pressure{0};
   };
   InliningInfo info;
 
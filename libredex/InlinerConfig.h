@@ -22,6 +22,12 @@ struct InlinerConfig {
   bool multiple_callers{false};
   bool inline_small_non_deletables{false};
   bool use_cfg_inliner{false};
+  // Inline level by level over the call graph's SCCs, in parallel.
+  bool parallel{false};
+  // Don't inline where the registers live in the caller and in the callee
+  // may add up to more than this, as the register allocator would then spill
+  // and emit range moves. 0 means no limit.
+  size_t max_register_pressure{0};
   std::unordered_set<DexType*> whitelist_no_method_limit;
   // We will populate the information to rstate of classes and methods.
   std::unordered_set<DexType*> m_no_inline_annos;
@@ -409,6 +409,20 @@ static void lower_simple_instruction(DexMethod*,
   }
 }
 
+bool is_short_const_load(const IRInstruction* insn) {
+  auto literal = insn->get_literal();
+  switch (insn->opcode()) {
+  case OPCODE_CONST:
+    return signed_int_fits<16>(literal) ||
+           signed_int_fits_high16<32>(literal);
+  case OPCODE_CONST_WIDE:
+    return signed_int_fits<16>(literal) ||
+           signed_int_fits_high16<64>(literal);
+  default:
+    not_reached();
+  }
+}
+
 Stats lower(DexMethod* method, bool lower_with_cfg) {
   Stats stats;
   auto* code = method->get_code();
@@ -460,7 +474,9 @@ Stats run(DexStoresVector& stores, bool lower_with_cfg) {
       scope,
       [lower_with_cfg](DexMethod* m) {
         Stats stats;
-        if (m->get_code() == nullptr) {
+        // A method that was never ballooned still has its DexCode, which is
+        // already in lowered form.
+        if (m->is_balloon_deferred() || m->get_code() == nullptr) {
           return stats;
         }
         stats.accumulate(lower(m, lower_with_cfg));
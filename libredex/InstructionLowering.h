@@ -36,6 +36,13 @@ Stats lower(DexMethod*, bool lower_with_cfg = false);
 
 Stats run(DexStoresVector&, bool lower_with_cfg = false);
 
+/*
+ * Whether the const or const-wide `insn` lowers to at most two code units
+ * (const/4, const/16, const/high16 or their wide forms) whatever its dest, so
+ * that loading it again is no larger than a move/from16 of its value.
+ */
+bool is_short_const_load(const IRInstruction* insn);
+
 namespace impl {
 
 DexOpcode select_move_opcode(const IRInstruction* insn);
@@ -7,7 +7,10 @@
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 #include <vector>
 #include <zlib.h>
 
@@ -23,6 +26,7 @@
 #include "JarLoader.h"
 #include "Trace.h"
 #include "Util.h"
+#include "WorkQueue.h"
 
 /******************
  * Begin Class Loading code.
@@ -287,9 +291,9 @@ static DexTypeList *extract_arguments(const char* &buf) {
   buf++;
   if (*buf == ')') {
     buf++;
-    return DexTypeList::make_type_list({});
+    return DexTypeList::make_type_list(DexTypeSpan(nullptr, 0));
   }
-  std::deque<DexType*> args;
+  std::vector<DexType*> args;
   while(*buf != ')') {
     DexType *dtype = parse_type(buf);
     if (dtype == nullptr)
@@ -301,7 +305,7 @@ static DexTypeList *extract_arguments(const char* &buf) {
     args.push_back(dtype);
   }
   buf++;
-  return DexTypeList::make_type_list(std::move(args));
+  return DexTypeList::make_type_list(args);
 }
 
 static DexMethod *make_dexmethod(std::vector<cp_entry> &cpool,
@@ -368,8 +372,14 @@ void read_dup_class_whitelist(const JsonWrapper& json_cfg) {
   TRACE(MAIN, 1, "}\n");
 }
 
+/*
+ * Parses a single class file. On success, `*parsed` is set to the new class,
+ * or to nullptr if the class had already been loaded from elsewhere.
+ *
+ * This may be called concurrently for different class files.
+ */
 static bool parse_class(uint8_t* buffer,
-                        Scope* classes,
+                        DexClass** parsed,
                         attribute_hook_t attr_hook,
                         const std::string& jar_location = "") {
   uint32_t magic = read32(buffer);
@@ -397,6 +407,7 @@ static bool parse_class(uint8_t* buffer,
   uint16_t super = read16(buffer);
   uint16_t ifcount = read16(buffer);
   DexType *self = make_dextype_from_cref(cpool, clazz);
+  *parsed = nullptr;
   DexClass* cls = type_class(self);
   if (cls) {
     // We are seeing duplicate classes when parsing jar file
@@ -498,9 +509,13 @@ static bool parse_class(uint8_t* buffer,
     }
   }
   DexClass *dc = cc.create();
-  if (classes != nullptr) {
-    classes->emplace_back(dc);
+  if (type_class(self) != dc) {
+    // Another thread published a class with the same name first; it was
+    // reported as a duplicate by publish_class. Treat this one as if we had
+    // seen the duplicate up front.
+    return true;
   }
+  *parsed = dc;
   //#define DEBUG_PRINT
 #ifdef DEBUG_PRINT
   fprintf(stderr, "DexClass constructed from jar:\n%s\n", SHOW(dc));
@@ -545,8 +560,15 @@ bool load_class_file(const std::string& filename, Scope* classes) {
   buf->pubseekpos(0, ifs.in);
   auto buffer = std::make_unique<char[]>(size);
   buf->sgetn(buffer.get(), size);
-  return parse_class(reinterpret_cast<uint8_t*>(buffer.get()), classes,
-                     /* attr_hook */ nullptr);
+  DexClass* parsed;
+  if (!parse_class(reinterpret_cast<uint8_t*>(buffer.get()), &parsed,
+                   /* attr_hook */ nullptr)) {
+    return false;
+  }
+  if (parsed != nullptr && classes != nullptr) {
+    classes->emplace_back(parsed);
+  }
+  return true;
 }
 
 /******************
@@ -560,6 +582,7 @@ static const int kSignatureSize = 4;
 /* CDFile
  * Central directory file header entry structures.
  */
+static const uint16_t kCompMethodStored (0);
 static const uint16_t kCompMethodDeflate (8);
 static const uint8_t kCDFile[] = {'P', 'K', 0x01, 0x02};
 
@@ -722,19 +745,18 @@ static int jar_uncompress(Bytef *dest, uLongf *destLen, const Bytef *source,
   return err;
 }
 
-static bool decompress_class(jar_entry &file, const uint8_t *mapping,
-                             uint8_t *outbuffer, ssize_t bufsize) {
-  if (file.cd_entry.comp_method != kCompMethodDeflate) {
-    fprintf(stderr, "Unknown compression method %d, Bailing\n",
-            file.cd_entry.comp_method);
-    return false;
-  }
+/*
+ * The data of `file` in the jar, after its local file header, which is
+ * checked against the central directory. nullptr if they don't match.
+ */
+static const uint8_t* find_entry_data(jar_entry& file,
+                                      const uint8_t* mapping,
+                                      pk_lfile& pkf) {
   const uint8_t *lfile = mapping + file.cd_entry.disk_offset;
   if (memcmp(lfile, kLFile, kSignatureSize) != 0) {
     fprintf(stderr, "Invalid local file entry, bailing\n");
-    return false;
+    return nullptr;
   }
-  pk_lfile pkf;
   memcpy(&pkf, lfile, sizeof(pk_lfile));
   if (pkf.comp_size == 0 && pkf.ucomp_size == 0 &&
      pkf.comp_size != file.cd_entry.comp_size &&
@@ -752,10 +774,25 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
             "Bailing %d %d %d %d, %d %d %d %d extra %d\n",
             pkf.fname_len, pkf.comp_size, pkf.ucomp_size, pkf.comp_method,
             file.cd_entry.fname_len, file.cd_entry.comp_size, file.cd_entry.ucomp_size, file.cd_entry.comp_method, pkf.extra_len);
-    return false;
+    return nullptr;
   }
   lfile += pkf.fname_len;
   lfile += pkf.extra_len;
+  return lfile;
+}
+
+static bool decompress_class(jar_entry &file, const uint8_t *mapping,
+                             uint8_t *outbuffer, ssize_t bufsize) {
+  if (file.cd_entry.comp_method != kCompMethodDeflate) {
+    fprintf(stderr, "Unknown compression method %d, Bailing\n",
+            file.cd_entry.comp_method);
+    return false;
+  }
+  pk_lfile pkf;
+  const uint8_t* lfile = find_entry_data(file, mapping, pkf);
+  if (lfile == nullptr) {
+    return false;
+  }
   uLongf dlen = bufsize;
   int zlibrv = jar_uncompress(outbuffer, &dlen, lfile, pkf.comp_size);
   if (zlibrv != Z_OK) {
@@ -771,16 +808,22 @@ static bool decompress_class(jar_entry &file, const uint8_t *mapping,
 
 static const int kStartBufferSize = 128 * 1024;
 
+/*
+ * Inflating and parsing the class files of a jar is independent per entry,
+ * so it is spread over a WorkQueue. The resulting classes are appended to
+ * `classes` in central directory order, as they would be when loading
+ * serially.
+ */
 static bool process_jar_entries(const char* location,
                                 std::vector<jar_entry>& files,
                                 const uint8_t* mapping,
                                 Scope* classes,
                                 attribute_hook_t attr_hook) {
-  ssize_t bufsize = kStartBufferSize;
-  uint8_t *outbuffer = (uint8_t*)malloc(bufsize);
   static char classEndString[] = ".class";
   static size_t classEndStringLen = strlen(classEndString);
   init_basic_types();
+
+  std::vector<jar_entry*> class_files;
   for (auto &file : files) {
     if (file.cd_entry.ucomp_size == 0)
       continue;
@@ -792,26 +835,63 @@ static bool process_jar_entries(const char* location,
       (file.cd_entry.fname_len - classEndStringLen);
     if (memcmp(endcomp, classEndString, classEndStringLen) != 0)
       continue;
+    class_files.push_back(&file);
+  }
 
-    // Resize output if necessary.
-    if (bufsize < file.cd_entry.ucomp_size) {
-      while(bufsize < file.cd_entry.ucomp_size)
-        bufsize *= 2;
-      free(outbuffer);
-      outbuffer = (uint8_t*)malloc(bufsize);
-    }
+  // The hook is supplied by the caller and need not be thread-safe.
+  attribute_hook_t locked_attr_hook = nullptr;
+  std::mutex attr_hook_mutex;
+  if (attr_hook != nullptr) {
+    locked_attr_hook = [&](boost::variant<DexField*, DexMethod*> field_or_method,
+                           const char* attribute_name,
+                           uint8_t* attribute_pointer) {
+      std::lock_guard<std::mutex> lock(attr_hook_mutex);
+      attr_hook(field_or_method, attribute_name, attribute_pointer);
+    };
+  }
 
-    if (!decompress_class(file, mapping, outbuffer, bufsize)) {
-      free(outbuffer);
-      return false;
-    }
+  std::vector<DexClass*> parsed(class_files.size(), nullptr);
+  std::atomic<bool> failed{false};
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        if (failed.load(std::memory_order_relaxed)) {
+          return;
+        }
+        // Each worker reuses one output buffer across the entries it handles.
+        thread_local std::vector<uint8_t> outbuffer;
+        auto& file = *class_files[i];
+        size_t bufsize = std::max<size_t>(outbuffer.size(), kStartBufferSize);
+        while (bufsize < file.cd_entry.ucomp_size) {
+          bufsize *= 2;
+        }
+        if (outbuffer.size() < bufsize) {
+          outbuffer.resize(bufsize);
+        }
+        if (!decompress_class(file, mapping, outbuffer.data(),
+                              outbuffer.size()) ||
+            !parse_class(outbuffer.data(), &parsed[i], locked_attr_hook,
+                         location)) {
+          failed = true;
+        }
+      },
+      std::max(1u,
+               std::min(boost::thread::hardware_concurrency(),
+                        static_cast<unsigned int>(class_files.size()))));
+  for (size_t i = 0; i < class_files.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  if (failed) {
+    return false;
+  }
 
-    if (!parse_class(outbuffer, classes, attr_hook, location)) {
-      free(outbuffer);
-      return false;
+  if (classes != nullptr) {
+    for (auto* cls : parsed) {
+      if (cls != nullptr) {
+        classes->emplace_back(cls);
+      }
     }
   }
-  free(outbuffer);
   return true;
 }
 
@@ -853,6 +933,155 @@ bool load_jar_file(const char* location,
   return true;
 }
 
+/*
+ * The N of classesN.dex, counting classes.dex as 1, or 0 if `name` is not a
+ * dex at the root of an APK.
+ */
+static size_t get_dex_number(const std::string& name) {
+  static const std::string prefix = "classes";
+  static const std::string suffix = ".dex";
+  if (name.size() < prefix.size() + suffix.size() ||
+      name.compare(0, prefix.size(), prefix) != 0 ||
+      name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+    return 0;
+  }
+  auto number = name.substr(prefix.size(),
+                            name.size() - prefix.size() - suffix.size());
+  if (number.empty()) {
+    return 1;
+  }
+  if (number[0] == '0' ||
+      !std::all_of(number.begin(), number.end(), ::isdigit)) {
+    return 0;
+  }
+  return std::stoul(number);
+}
+
+bool get_zip_entries(const uint8_t* mapping,
+                     size_t size,
+                     std::vector<ZipEntry>* entries) {
+  pk_cdir_end pce;
+  std::vector<jar_entry> files;
+  if (!find_central_directory(mapping, size, pce) ||
+      !validate_pce(pce, size) || !get_jar_entries(mapping, pce, files)) {
+    return false;
+  }
+  entries->clear();
+  entries->reserve(files.size());
+  for (auto& file : files) {
+    pk_lfile pkf;
+    auto data = find_entry_data(file, mapping, pkf);
+    if (data == nullptr || data + pkf.comp_size > mapping + size) {
+      fprintf(stderr, "Invalid entry %s, bailing\n", file.filename);
+      return false;
+    }
+    ZipEntry entry;
+    entry.name = reinterpret_cast<const char*>(file.filename);
+    entry.flags = file.cd_entry.flags;
+    entry.comp_method = file.cd_entry.comp_method;
+    entry.mod_time = file.cd_entry.mod_time;
+    entry.mod_date = file.cd_entry.mod_date;
+    entry.crc32 = file.cd_entry.crc32;
+    entry.comp_size = file.cd_entry.comp_size;
+    entry.ucomp_size = file.cd_entry.ucomp_size;
+    entry.external_attr = file.cd_entry.external_attr;
+    entry.data = data;
+    entries->push_back(std::move(entry));
+  }
+  return true;
+}
+
+std::shared_ptr<ApkDexes> ApkDexes::open(const char* location) {
+  std::shared_ptr<ApkDexes> apk(new ApkDexes());
+  try {
+    apk->m_file.open(location, boost::iostreams::mapped_file::readonly);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "error: cannot open apk: %s\n", location);
+    return nullptr;
+  }
+  auto mapping = reinterpret_cast<const uint8_t*>(apk->m_file.const_data());
+  std::vector<ZipEntry> entries;
+  if (!get_zip_entries(mapping, apk->m_file.size(), &entries)) {
+    fprintf(stderr, "error: cannot process apk: %s\n", location);
+    return nullptr;
+  }
+
+  std::vector<std::pair<size_t, const ZipEntry*>> dex_entries;
+  for (const auto& entry : entries) {
+    auto number = get_dex_number(entry.name);
+    if (number != 0) {
+      dex_entries.emplace_back(number, &entry);
+    }
+  }
+  std::sort(dex_entries.begin(), dex_entries.end());
+
+  // Stored entries are used in place. The dex loader reads its structures
+  // straight from the data, so it has to be 4-byte aligned, as zipalign
+  // leaves it. Other stored entries are copied, and deflated ones inflated,
+  // each into an arena of its own.
+  apk->m_dexes.resize(dex_entries.size());
+  apk->m_arenas.resize(dex_entries.size());
+  std::vector<size_t> to_inflate;
+  for (size_t i = 0; i < dex_entries.size(); ++i) {
+    const auto& entry = *dex_entries[i].second;
+    auto& dex = apk->m_dexes[i];
+    dex.location = std::string(location) + "!/" + entry.name;
+    dex.size = entry.ucomp_size;
+    if (entry.comp_method == kCompMethodStored) {
+      if (reinterpret_cast<uintptr_t>(entry.data) % 4 == 0) {
+        dex.data = entry.data;
+      } else {
+        apk->m_arenas[i].reset(new uint8_t[dex.size]);
+        memcpy(apk->m_arenas[i].get(), entry.data, dex.size);
+        dex.data = apk->m_arenas[i].get();
+      }
+    } else if (entry.comp_method == kCompMethodDeflate) {
+      to_inflate.push_back(i);
+    } else {
+      fprintf(stderr, "Unknown compression method %d, Bailing\n",
+              entry.comp_method);
+      return nullptr;
+    }
+  }
+
+  std::atomic<bool> failed{false};
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) {
+        const auto& entry = *dex_entries[i].second;
+        auto& dex = apk->m_dexes[i];
+        apk->m_arenas[i].reset(new uint8_t[dex.size]);
+        uLongf dlen = dex.size;
+        int zlibrv = jar_uncompress(apk->m_arenas[i].get(), &dlen, entry.data,
+                                    entry.comp_size);
+        if (zlibrv != Z_OK || dlen != dex.size) {
+          fprintf(stderr, "error: cannot inflate %s in apk: %s\n",
+                  entry.name.c_str(), location);
+          failed = true;
+          return;
+        }
+        dex.data = apk->m_arenas[i].get();
+      },
+      std::max(1u,
+               std::min(boost::thread::hardware_concurrency(),
+                        static_cast<unsigned int>(to_inflate.size()))));
+  for (auto i : to_inflate) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  if (failed) {
+    return nullptr;
+  }
+  return apk;
+}
+
+std::vector<DexBuffer> ApkDexes::get_dexes() const {
+  auto dexes = m_dexes;
+  for (auto& dex : dexes) {
+    dex.owner = shared_from_this();
+  }
+  return dexes;
+}
+
 //#define LOCAL_MAIN
 #ifdef LOCAL_MAIN
 int main(int argc, char *argv[]) {
@@ -12,9 +12,15 @@ class DexMethod;
 
 #include "boost/variant.hpp"
 
+#include <boost/iostreams/device/mapped_file.hpp>
+
 #include "ConfigFiles.h"
+#include "DexLoader.h"
 
 #include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace JarLoaderUtil {
 uint32_t read32(uint8_t*& buffer);
@@ -33,3 +39,52 @@ bool load_jar_file(const char* location,
 void read_dup_class_whitelist(const JsonWrapper& json_cfg);
 
 bool load_class_file(const std::string& filename, Scope* classes = nullptr);
+
+/*
+ * An entry of a zip file, as listed in its central directory. `data` points to
+ * its bytes, compressed with `comp_method`, in the mapping of the zip.
+ */
+struct ZipEntry {
+  std::string name;
+  uint16_t flags;
+  uint16_t comp_method;
+  uint16_t mod_time;
+  uint16_t mod_date;
+  uint32_t crc32;
+  uint32_t comp_size;
+  uint32_t ucomp_size;
+  uint32_t external_attr;
+  const uint8_t* data;
+};
+
+/*
+ * Lists the entries of the zip file mapped at `mapping`, in central directory
+ * order. Returns false if it isn't a zip that we can read.
+ */
+bool get_zip_entries(const uint8_t* mapping,
+                     size_t size,
+                     std::vector<ZipEntry>* entries);
+
+/*
+ * The classes*.dex files of an APK, read straight from its zip entries rather
+ * than from an extracted copy, in classes.dex, classes2.dex, ... order. Stored
+ * entries are used in place in the mapping of the APK; deflated ones are
+ * inflated in parallel. The DexBuffers hold on to this object.
+ */
+class ApkDexes : public std::enable_shared_from_this<ApkDexes> {
+ public:
+  /*
+   * Returns nullptr if `location` isn't a zip that we can read.
+   */
+  static std::shared_ptr<ApkDexes> open(const char* location);
+
+  std::vector<DexBuffer> get_dexes() const;
+
+ private:
+  ApkDexes() = default;
+
+  boost::iostreams::mapped_file m_file;
+  std::vector<std::unique_ptr<uint8_t[]>> m_arenas;
+  // Without their owner, which is this object.
+  std::vector<DexBuffer> m_dexes;
+};
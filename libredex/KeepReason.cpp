@@ -7,12 +7,24 @@
 
 #include "KeepReason.h"
 
+#include "FixedSizeAllocator.h"
 #include "ProguardPrintConfiguration.h"
 #include "RedexContext.h"
 #include "Show.h"
 
 namespace keep_reason {
 
+using ReasonAllocator = FixedSizeAllocator<sizeof(Reason), alignof(Reason)>;
+
+void* Reason::operator new(size_t size) {
+  always_assert(size == sizeof(Reason));
+  return ReasonAllocator::allocate();
+}
+
+void Reason::operator delete(void* ptr, size_t /* size */) {
+  ReasonAllocator::deallocate(ptr);
+}
+
 std::ostream& operator<<(std::ostream& os, const Reason& reason) {
   switch (reason.type) {
   case KEEP_RULE:
@@ -57,6 +57,11 @@ struct Reason {
     always_assert(type == REFLECTION);
   }
 
+  // Reasons are interned in RedexContext and live as long as it does, so they
+  // come from a FixedSizeAllocator pool; see FixedSizeAllocator.h.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   friend bool operator==(const Reason&, const Reason&);
 
   friend std::ostream& operator<<(std::ostream&, const Reason&);
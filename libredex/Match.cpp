@@ -47,7 +47,8 @@ match_t<IRInstruction> return_void() {
     [](const IRInstruction* insn) {
       auto opcode = insn->opcode();
       return opcode == OPCODE_RETURN_VOID;
-    }
+    },
+    OpcodeSet{OPCODE_RETURN_VOID}
   };
 }
 
@@ -82,7 +83,8 @@ match_t<IRInstruction> const_string() {
     [](const IRInstruction* insn) {
       auto opcode = insn->opcode();
       return opcode == OPCODE_CONST_STRING;
-    }
+    },
+    OpcodeSet{OPCODE_CONST_STRING}
   };
 }
 
@@ -90,7 +92,8 @@ match_t<IRInstruction> move_result_pseudo() {
   return {
     [](const IRInstruction* insn) {
       return opcode::is_move_result_pseudo(insn->opcode());
-    }
+    },
+    MOVE_RESULT_PSEUDO_OPCODES
   };
 }
 
@@ -104,7 +107,8 @@ match_t<IRInstruction> throwex() {
     [](const IRInstruction* insn) {
       auto opcode = insn->opcode();
       return opcode == OPCODE_THROW;
-    }
+    },
+    OpcodeSet{OPCODE_THROW}
   };
 }
 
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <initializer_list>
 #include <type_traits>
 #include <vector>
 
@@ -59,6 +61,81 @@ inline bool has_code(const DexMethodRef* meth) {
 
 namespace m {
 
+/**
+ * A set of IROpcodes as a bitmask. Every match_t carries the set of opcodes
+ * that an instruction may have for the match to succeed, which the
+ * combinators below work out as they are composed. Matching a pattern tests
+ * the opcode of each instruction against that set first, so that the nested
+ * predicates only run on instructions that have a chance to match.
+ *
+ * Matches on anything other than IRInstructions leave the set full.
+ */
+class OpcodeSet {
+ public:
+  static constexpr size_t NUM_OPCODES = IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1;
+
+  // The empty set.
+  constexpr OpcodeSet() : m_words{0, 0, 0, 0} {}
+
+  constexpr OpcodeSet(std::initializer_list<IROpcode> opcodes)
+      : m_words{0, 0, 0, 0} {
+    for (auto op : opcodes) {
+      m_words[op / 64] |= uint64_t(1) << (op % 64);
+    }
+  }
+
+  static constexpr OpcodeSet all() {
+    OpcodeSet set;
+    for (size_t op = 0; op < NUM_OPCODES; ++op) {
+      set.m_words[op / 64] |= uint64_t(1) << (op % 64);
+    }
+    return set;
+  }
+
+  constexpr bool contains(IROpcode op) const {
+    return m_words[op / 64] & (uint64_t(1) << (op % 64));
+  }
+
+  constexpr OpcodeSet operator|(const OpcodeSet& that) const {
+    OpcodeSet set;
+    for (size_t i = 0; i < NUM_WORDS; ++i) {
+      set.m_words[i] = m_words[i] | that.m_words[i];
+    }
+    return set;
+  }
+
+  constexpr OpcodeSet operator&(const OpcodeSet& that) const {
+    OpcodeSet set;
+    for (size_t i = 0; i < NUM_WORDS; ++i) {
+      set.m_words[i] = m_words[i] & that.m_words[i];
+    }
+    return set;
+  }
+
+  constexpr bool operator==(const OpcodeSet& that) const {
+    for (size_t i = 0; i < NUM_WORDS; ++i) {
+      if (m_words[i] != that.m_words[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static constexpr size_t NUM_WORDS = 4;
+  static_assert(NUM_OPCODES <= NUM_WORDS * 64, "Too many opcodes");
+
+  uint64_t m_words[NUM_WORDS];
+};
+
+constexpr OpcodeSet ANY_OPCODE = OpcodeSet::all();
+constexpr OpcodeSet INVOKE_OPCODES{OPCODE_INVOKE_VIRTUAL, OPCODE_INVOKE_SUPER,
+                                   OPCODE_INVOKE_DIRECT, OPCODE_INVOKE_STATIC,
+                                   OPCODE_INVOKE_INTERFACE};
+constexpr OpcodeSet MOVE_RESULT_PSEUDO_OPCODES{
+    IOPCODE_MOVE_RESULT_PSEUDO, IOPCODE_MOVE_RESULT_PSEUDO_OBJECT,
+    IOPCODE_MOVE_RESULT_PSEUDO_WIDE};
+
 // N.B. recursive template for matching opcode pattern against insn sequence
 template<typename T, typename N>
 struct insns_matcher {
@@ -67,8 +144,9 @@ struct insns_matcher {
     const std::vector<IRInstruction*>& insns,
     const T& t) {
     const auto& insn = insns.at(at);
-    typename std::tuple_element<N::value, T>::type insn_match = std::get<N::value>(t);
-    return insn_match.matches(insn) &&
+    const auto& insn_match = std::get<N::value>(t);
+    return insn_match.opcodes.contains(insn->opcode()) &&
+        insn_match.matches(insn) &&
         insns_matcher<T, std::integral_constant<size_t, N::value+1> >::matches_at(at+1, insns, t);
   }
 };
@@ -117,6 +195,7 @@ struct match_t;
 template <typename T, typename P>
 struct match_t<T, P, 0> {
   bool (*fn)(const T*);
+  OpcodeSet opcodes = ANY_OPCODE;
   bool matches(const T* t) const {
     return fn(t);
   }
@@ -128,6 +207,7 @@ struct match_t<T, P, 1> {
   using P0_t = typename std::tuple_element<0, P>::type;
   bool (*fn)(const T*, const P0_t& p0);
   P0_t p0;
+  OpcodeSet opcodes = ANY_OPCODE;
   bool matches(const T* t) const {
     return fn(t, p0);
   }
@@ -141,6 +221,7 @@ struct match_t<T, P, 2> {
   bool (*fn)(const T*, const P0_t& p0, const P1_t& p1);
   P0_t p0;
   P1_t p1;
+  OpcodeSet opcodes = ANY_OPCODE;
   bool matches(const T* t) const {
     return fn(t, p0, p1);
   }
@@ -164,7 +245,8 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1> > >
     [](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
       return p0.matches(t) || p1.matches(t); },
     p0,
-    p1 };
+    p1,
+    p0.opcodes | p1.opcodes };
 }
 
 /** Match two subordinate matches whose logical and is true */
@@ -175,7 +257,8 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1> > >
     [](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
       return p0.matches(t) && p1.matches(t); },
     p0,
-    p1 };
+    p1,
+    p0.opcodes & p1.opcodes };
 }
 
 /** Match two subordinate matches whose logical xor is true */
@@ -186,7 +269,8 @@ match_t<T, std::tuple<match_t<T, P0>, match_t<T, P1> > >
     [](const T* t, const match_t<T, P0>& p0, const match_t<T, P1>& p1) {
       return p0.matches(t) ^ p1.matches(t); },
     p0,
-    p1 };
+    p1,
+    p0.opcodes | p1.opcodes };
 }
 
 /** Match any T (always matches) */
@@ -281,7 +365,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    OpcodeSet{OPCODE_NEW_INSTANCE} & p.opcodes
   };
 }
 
@@ -304,7 +389,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    OpcodeSet{OPCODE_INVOKE_DIRECT} & p.opcodes
   };
 }
 
@@ -324,7 +410,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    OpcodeSet{OPCODE_INVOKE_STATIC} & p.opcodes
   };
 }
 
@@ -344,7 +431,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
         return false;
       }
     },
-    p
+    p,
+    OpcodeSet{OPCODE_INVOKE_VIRTUAL} & p.opcodes
   };
 }
 
@@ -359,7 +447,8 @@ match_t<IRInstruction, std::tuple<match_t<IRInstruction, P> > >
     [](const IRInstruction* insn, const match_t<IRInstruction, P>& p) {
       return is_invoke(insn->opcode()) && p.matches(insn);
     },
-    p
+    p,
+    INVOKE_OPCODES & p.opcodes
   };
 }
 
@@ -379,7 +468,8 @@ inline match_t<IRInstruction, std::tuple<IROpcode>> is_opcode(IROpcode opcode) {
   return {[](const IRInstruction* insn, const IROpcode& opcode) {
             return insn->opcode() == opcode;
           },
-          opcode};
+          opcode,
+          OpcodeSet{opcode}};
 }
 
 /** Matchers that map from IRInstruction -> other types */
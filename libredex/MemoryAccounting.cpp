@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MemoryAccounting.h"
+
+#include "ControlFlow.h"
+#include "DexDebugInstruction.h"
+#include "DexPosition.h"
+#include "IRInstruction.h"
+#include "IRList.h"
+#include "RedexContext.h"
+
+namespace memory_accounting {
+
+namespace {
+
+struct EntityInfo {
+  const char* name;
+  size_t size;
+};
+
+EntityInfo entity_info(Entity entity) {
+  switch (entity) {
+  case Entity::IRInstruction:
+    return {"IRInstruction", sizeof(IRInstruction)};
+  case Entity::MethodItemEntry:
+    return {"MethodItemEntry", sizeof(MethodItemEntry)};
+  case Entity::DexPosition:
+    return {"DexPosition", sizeof(DexPosition)};
+  case Entity::DexDebugInstruction:
+    // Subclasses add a pointer or two; a lower bound is good enough here.
+    return {"DexDebugInstruction", sizeof(DexDebugInstruction)};
+  case Entity::CfgBlock:
+    return {"cfg::Block", sizeof(cfg::Block)};
+  case Entity::NumEntities:
+    break;
+  }
+  not_reached();
+}
+
+} // namespace
+
+size_t StripedCounter::stripe() {
+  static std::atomic<size_t> next_stripe{0};
+  static thread_local size_t stripe =
+      next_stripe.fetch_add(1, std::memory_order_relaxed) % NUM_STRIPES;
+  return stripe;
+}
+
+StripedCounter& live_counter(Entity entity) {
+  static std::array<StripedCounter, static_cast<size_t>(Entity::NumEntities)>
+      counters;
+  return counters[static_cast<size_t>(entity)];
+}
+
+Report take_report() {
+  Report report;
+  g_redex->add_interned_usage(&report);
+  for (size_t i = 0; i < static_cast<size_t>(Entity::NumEntities); ++i) {
+    auto entity = static_cast<Entity>(i);
+    auto info = entity_info(entity);
+    auto count = static_cast<uint64_t>(live_counter(entity).get());
+    report[info.name] += Usage{count, count * info.size};
+  }
+  return report;
+}
+
+Json::Value to_json(const Report& report) {
+  Json::Value result(Json::objectValue);
+  uint64_t total_bytes = 0;
+  for (const auto& pair : report) {
+    Json::Value usage;
+    usage["count"] = Json::UInt64(pair.second.count);
+    usage["bytes"] = Json::UInt64(pair.second.bytes);
+    result[pair.first] = usage;
+    total_bytes += pair.second.bytes;
+  }
+  result["total_bytes"] = Json::UInt64(total_bytes);
+  return result;
+}
+
+} // namespace memory_accounting
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <json/json.h>
+#include <map>
+#include <string>
+
+/*
+ * Live counts and approximate footprints of the IR's most numerous entities,
+ * so that we can tell what is using the memory of a large run.
+ *
+ * Interned entities (strings, types, protos, method refs and methods) are
+ * counted by walking RedexContext's tables when a report is taken. Everything
+ * else is counted as it is created and destroyed. Bytes are sizeof() times
+ * the count, plus the characters of heap-allocated strings; memory that the
+ * objects own indirectly (vectors of registers, edge lists, ...) is not
+ * included.
+ */
+namespace memory_accounting {
+
+enum class Entity : size_t {
+  IRInstruction,
+  MethodItemEntry,
+  DexPosition,
+  DexDebugInstruction,
+  CfgBlock,
+  NumEntities,
+};
+
+/*
+ * A counter for values that many threads update at once but that are rarely
+ * read. Each thread works on one of several cache lines; reads sum them up.
+ */
+class StripedCounter {
+ public:
+  void add(int64_t delta) {
+    m_stripes[stripe()].value.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  int64_t get() const {
+    int64_t sum = 0;
+    for (const auto& s : m_stripes) {
+      sum += s.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  static constexpr size_t NUM_STRIPES = 16;
+
+  struct alignas(64) Stripe {
+    std::atomic<int64_t> value{0};
+  };
+
+  static size_t stripe();
+
+  std::array<Stripe, NUM_STRIPES> m_stripes;
+};
+
+StripedCounter& live_counter(Entity entity);
+
+inline void on_create(Entity entity) { live_counter(entity).add(1); }
+inline void on_destroy(Entity entity) { live_counter(entity).add(-1); }
+
+/*
+ * Derive from this (it adds no storage) to have the instances of a class
+ * counted.
+ */
+template <Entity E>
+class Counted {
+ protected:
+  Counted() { on_create(E); }
+  Counted(const Counted&) { on_create(E); }
+  Counted& operator=(const Counted&) = default;
+  ~Counted() { on_destroy(E); }
+};
+
+struct Usage {
+  uint64_t count{0};
+  uint64_t bytes{0};
+
+  Usage& operator+=(const Usage& other) {
+    count += other.count;
+    bytes += other.bytes;
+    return *this;
+  }
+};
+
+// Keyed by entity name, e.g. "DexString" or "cfg::Block".
+using Report = std::map<std::string, Usage>;
+
+/*
+ * Takes a report of the current usage. Walks the interned tables of g_redex,
+ * so avoid calling it while other threads are creating entities.
+ */
+Report take_report();
+
+Json::Value to_json(const Report& report);
+
+} // namespace memory_accounting
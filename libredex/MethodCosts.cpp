@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MethodCosts.h"
+
+#include <algorithm>
+
+#include "ConcurrentContainers.h"
+#include "ControlFlow.h"
+#include "DexClass.h"
+#include "IRCode.h"
+#include "Show.h"
+
+namespace method_costs {
+
+namespace {
+
+using Millis = std::chrono::duration<double, std::milli>;
+
+ConcurrentMap<const DexMethod*, MethodCost>& costs() {
+  static ConcurrentMap<const DexMethod*, MethodCost> costs;
+  return costs;
+}
+
+thread_local bool t_timing{false};
+
+} // namespace
+
+std::atomic<bool> ScopedTimer::s_enabled{false};
+
+void set_enabled(bool enabled) {
+  ScopedTimer::s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void ScopedTimer::start(const DexMethod* method) {
+  if (t_timing) {
+    return;
+  }
+  t_timing = true;
+  m_method = method;
+  m_start = std::chrono::steady_clock::now();
+}
+
+void ScopedTimer::stop() {
+  Millis elapsed = std::chrono::steady_clock::now() - m_start;
+  t_timing = false;
+  size_t instructions = 0;
+  size_t blocks = 0;
+  auto code = m_method->is_code_compact() || m_method->is_balloon_deferred()
+                  ? nullptr
+                  : m_method->get_code();
+  if (code != nullptr) {
+    if (code->editable_cfg_built()) {
+      instructions = code->cfg().num_opcodes();
+      blocks = code->cfg().num_blocks();
+    } else {
+      instructions = code->count_opcodes();
+    }
+  }
+  costs().update(m_method, [&](const DexMethod* method, MethodCost& cost,
+                               bool exists) {
+    if (!exists) {
+      cost.method = show(method);
+      cost.millis = 0;
+    }
+    cost.millis += elapsed.count();
+    cost.instructions = instructions;
+    cost.blocks = blocks;
+  });
+}
+
+Report take_report(size_t n) {
+  Report report;
+  report.reserve(costs().size());
+  for (auto& pair : costs()) {
+    report.push_back(std::move(pair.second));
+  }
+  costs().clear();
+  n = std::min(n, report.size());
+  std::partial_sort(report.begin(), report.begin() + n, report.end(),
+                    [](const MethodCost& a, const MethodCost& b) {
+                      return a.millis > b.millis;
+                    });
+  report.resize(n);
+  return report;
+}
+
+Json::Value to_json(const Report& report) {
+  Json::Value result(Json::arrayValue);
+  for (const auto& cost : report) {
+    Json::Value entry;
+    entry["method"] = cost.method;
+    entry["ms"] = cost.millis;
+    entry["instructions"] = Json::UInt64(cost.instructions);
+    entry["blocks"] = Json::UInt64(cost.blocks);
+    result.append(entry);
+  }
+  return result;
+}
+
+} // namespace method_costs
@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <json/json.h>
+#include <string>
+#include <vector>
+
+class DexMethod;
+
+/*
+ * How long a pass spent on each method, so that when a pass slows down we can
+ * tell which methods are responsible.
+ *
+ * This is off unless enabled. The method walks of walk:: and walk::parallel::
+ * time each call of their walker with a ScopedTimer; code that hands out
+ * methods to a WorkQueue of its own can do the same. A timer that starts while
+ * another one runs on the same thread, e.g. for a walk over the callees of the
+ * method being walked, counts towards the outer one.
+ */
+namespace method_costs {
+
+void set_enabled(bool enabled);
+
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(const DexMethod* method) {
+    if (s_enabled.load(std::memory_order_relaxed)) {
+      start(method);
+    }
+  }
+
+  ~ScopedTimer() {
+    if (m_method != nullptr) {
+      stop();
+    }
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  void start(const DexMethod* method);
+  void stop();
+
+  // Null unless this is the outermost timer of its thread.
+  const DexMethod* m_method{nullptr};
+  std::chrono::steady_clock::time_point m_start;
+
+  static std::atomic<bool> s_enabled;
+
+  friend void set_enabled(bool enabled);
+};
+
+struct MethodCost {
+  std::string method;
+  double millis;
+  // The size of the method's code when it was last timed. Blocks are only
+  // counted when the code had an editable CFG, and zero otherwise.
+  size_t instructions;
+  size_t blocks;
+};
+
+// Slowest first.
+using Report = std::vector<MethodCost>;
+
+/*
+ * Returns the `n` methods that took the longest since the previous report,
+ * and starts over. Must not be called while methods are being timed.
+ */
+Report take_report(size_t n);
+
+Json::Value to_json(const Report& report);
+
+} // namespace method_costs
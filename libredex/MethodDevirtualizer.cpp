@@ -11,6 +11,9 @@
 #include "Resolver.h"
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
+
+namespace mog = method_override_graph;
 
 namespace {
 
@@ -50,11 +53,14 @@ void patch_call_site(DexMethod* callee,
   method_inst->set_method(callee);
 }
 
+/*
+ * Rewrites the calls to all the `targets` in a single walk over the code. A
+ * target maps to whether its calls drop their `this` argument.
+ */
 void fix_call_sites(const std::vector<DexClass*>& scope,
-                    const std::unordered_set<DexMethod*>& target_methods,
-                    DevirtualizerMetrics& metrics,
-                    bool drop_this = false) {
-  const auto fixer = [&target_methods, drop_this](DexMethod* m) -> CallCounter {
+                    const std::unordered_map<DexMethod*, bool>& targets,
+                    DevirtualizerMetrics& metrics) {
+  const auto fixer = [&targets](DexMethod* m) -> CallCounter {
     CallCounter call_counter;
     IRCode* code = m->get_code();
     if (code == nullptr) {
@@ -63,20 +69,23 @@ void fix_call_sites(const std::vector<DexClass*>& scope,
 
     for (const MethodItemEntry& mie : InstructionIterable(code)) {
       IRInstruction* insn = mie.insn;
-      if (!insn->has_method()) {
+      // The targets aren't static yet, so no invoke-static can call them.
+      if (!is_invoke(insn->opcode()) || is_invoke_static(insn->opcode())) {
         continue;
       }
 
-      MethodSearch type = drop_this ? MethodSearch::Any : MethodSearch::Virtual;
-      auto method = resolve_method(insn->get_method(), type);
-      if (method == nullptr || !target_methods.count(method)) {
+      auto method = resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (method == nullptr) {
+        continue;
+      }
+      auto it = targets.find(method);
+      if (it == targets.end()) {
         continue;
       }
 
-      always_assert(drop_this || !is_invoke_static(insn->opcode()));
       patch_call_site(method, insn, call_counter);
 
-      if (drop_this) {
+      if (it->second) {
         auto nargs = insn->arg_word_count();
         for (uint16_t i = 0; i < nargs - 1; i++) {
           insn->set_src(i, insn->src(i + 1));
@@ -90,24 +99,16 @@ void fix_call_sites(const std::vector<DexClass*>& scope,
 
   CallCounter call_counter =
       walk::parallel::reduce_methods<CallCounter, Scope>(
-          scope,
-          fixer,
-          [](CallCounter a, CallCounter b) -> CallCounter {
-            a.virtuals += b.virtuals;
-            a.supers += b.supers;
-            a.directs += b.directs;
-            return a;
-          });
+          scope, fixer, CallCounter::plus);
 
   metrics.num_virtual_calls += call_counter.virtuals;
   metrics.num_super_calls += call_counter.supers;
   metrics.num_direct_calls += call_counter.directs;
 }
 
-void make_methods_static(const std::unordered_set<DexMethod*>& methods,
-                         bool keep_this) {
-  // TODO" Change callers to pass this as a sorted vector or an ordered set.
-  std::vector<DexMethod*> meth_list(methods.begin(), methods.end());
+void make_methods_static(std::vector<DexMethod*> meth_list, bool keep_this) {
+  // Changing the methods of a class isn't thread-safe, and sorting keeps the
+  // order of the methods in their classes deterministic.
   std::sort(meth_list.begin(), meth_list.end(), compare_dexmethods);
 
   for (auto* method : meth_list) {
@@ -140,161 +141,186 @@ bool uses_this(const DexMethod* method) {
   return false;
 }
 
-std::vector<DexMethod*> get_devirtualizable_vmethods(
-    const std::vector<DexClass*>& scope,
-    const std::vector<DexClass*>& targets) {
-  std::vector<DexMethod*> ret;
-  auto vmethods = devirtualize(scope);
-  auto targets_set =
-      std::unordered_set<DexClass*>(targets.begin(), targets.end());
-  for (auto m : vmethods) {
-    auto cls = type_class(m->get_class());
-    if (targets_set.count(cls) > 0) {
-      ret.push_back(m);
-    }
-  }
-  return ret;
+std::unique_ptr<const mog::Graph> build_override_graph(const Scope& scope) {
+  // The graph only sees the overrides of the methods of java.lang.Object if
+  // it has a class, which it may not have without any jars.
+  get_vmethods(get_object_type());
+  return mog::build_graph(scope);
 }
 
-std::vector<DexMethod*> get_devirtualizable_vmethods(
-    const std::vector<DexClass*>& scope,
-    const std::vector<DexMethod*>& targets) {
-  ClassHierarchy class_hierarchy = build_type_hierarchy(scope);
-  auto signature_map = build_signature_map(class_hierarchy);
-
-  std::vector<DexMethod*> res;
-  for (const auto m : targets) {
-    always_assert(!is_static(m) && !is_private(m) && !is_any_init(m));
-    if (can_devirtualize(signature_map, m)) {
-      res.push_back(m);
+/*
+ * Whether the types that `cls` extends and implements are all known, so that
+ * the override graph has all the methods that its methods might override.
+ */
+bool has_known_supertypes(const DexClass* cls) {
+  for (auto* intf : cls->get_interfaces()->get_type_list()) {
+    auto intf_cls = type_class(intf);
+    if (intf_cls == nullptr || !has_known_supertypes(intf_cls)) {
+      return false;
     }
   }
-
-  return res;
+  auto super = cls->get_super_class();
+  if (super == nullptr) {
+    return true;
+  }
+  auto super_cls = type_class(super);
+  return super_cls != nullptr && has_known_supertypes(super_cls);
 }
 
-std::vector<DexMethod*> get_devirtualizable_dmethods(
-    const std::vector<DexClass*>& scope,
-    const std::vector<DexClass*>& targets) {
-  std::vector<DexMethod*> ret;
-  auto targets_set =
-      std::unordered_set<DexClass*>(targets.begin(), targets.end());
-  for (auto cls : scope) {
-    if (targets_set.count(cls) == 0) {
-      continue;
-    }
-    for (auto m : cls->get_dmethods()) {
-      if (is_any_init(m) || is_static(m)) {
-        continue;
-      }
-      ret.push_back(m);
+/*
+ * The methods that override or implement another method.
+ */
+std::unordered_set<const DexMethod*> get_overriding_methods(
+    const mog::Graph& graph) {
+  std::unordered_set<const DexMethod*> overriding;
+  for (auto* method : graph.methods()) {
+    for (auto* child : graph.get_node(method).children) {
+      overriding.insert(child);
     }
   }
-  return ret;
+  return overriding;
+}
+
+/*
+ * A virtual method can become static if every call to it resolves to it: it
+ * neither overrides nor implements another method, and none overrides it.
+ */
+bool can_devirtualize(const mog::Graph& graph,
+                      const std::unordered_set<const DexMethod*>& overriding,
+                      const DexMethod* method) {
+  auto cls = type_class(method->get_class());
+  return method->is_concrete() && cls != nullptr && !is_interface(cls) &&
+         graph.get_node(method).children.empty() &&
+         !overriding.count(method) && has_known_supertypes(cls);
 }
 
 } // namespace
 
 void MethodDevirtualizer::verify_and_split(
-    const std::vector<DexMethod*>& candidates,
-    std::unordered_set<DexMethod*>& using_this,
-    std::unordered_set<DexMethod*>& not_using_this) {
-  for (const auto m : candidates) {
-    if (!m_config.ignore_keep && has_keep(m)) {
-      TRACE(VIRT, 2, "failed to devirt method %s: keep\n", SHOW(m));
-      continue;
-    }
-    if (m->is_external() || is_abstract(m) || is_native(m)) {
-      TRACE(VIRT,
-            2,
-            "failed to devirt method %s: external %d, abstract %d, native %d\n",
-            SHOW(m),
-            m->is_external(),
-            is_abstract(m),
-            is_native(m));
-      continue;
-    }
-    if (uses_this(m)) {
+    DexMethod* m,
+    bool allow_using_this,
+    bool allow_not_using_this,
+    ConcurrentSet<DexMethod*>& using_this,
+    ConcurrentSet<DexMethod*>& not_using_this) {
+  if (!allow_using_this && !allow_not_using_this) {
+    return;
+  }
+  if (!m_config.ignore_keep && has_keep(m)) {
+    TRACE(VIRT, 2, "failed to devirt method %s: keep\n", SHOW(m));
+    return;
+  }
+  if (m->is_external() || is_abstract(m) || is_native(m)) {
+    TRACE(VIRT,
+          2,
+          "failed to devirt method %s: external %d, abstract %d, native %d\n",
+          SHOW(m),
+          m->is_external(),
+          is_abstract(m),
+          is_native(m));
+    return;
+  }
+  if (uses_this(m)) {
+    if (allow_using_this) {
       using_this.insert(m);
-    } else {
-      not_using_this.insert(m);
     }
+  } else if (allow_not_using_this) {
+    not_using_this.insert(m);
   }
 }
 
-void MethodDevirtualizer::staticize_methods_not_using_this(
+void MethodDevirtualizer::staticize_methods(
     const std::vector<DexClass*>& scope,
-    const std::unordered_set<DexMethod*>& methods) {
-  fix_call_sites(scope, methods, m_metrics, true /* drop_this */);
-  make_methods_static(methods, false);
-  TRACE(VIRT, 1, "Staticized %lu methods not using this\n", methods.size());
-  m_metrics.num_methods_not_using_this += methods.size();
-}
-
-void MethodDevirtualizer::staticize_methods_using_this(
-    const std::vector<DexClass*>& scope,
-    const std::unordered_set<DexMethod*>& methods) {
-  fix_call_sites(scope, methods, m_metrics, false /* drop_this */);
-  make_methods_static(methods, true);
-  TRACE(VIRT, 1, "Staticized %lu methods using this\n", methods.size());
-  m_metrics.num_methods_using_this += methods.size();
+    const ConcurrentSet<DexMethod*>& using_this,
+    const ConcurrentSet<DexMethod*>& not_using_this) {
+  std::unordered_map<DexMethod*, bool> drop_this;
+  for (auto* m : using_this) {
+    drop_this.emplace(m, false);
+  }
+  for (auto* m : not_using_this) {
+    drop_this.emplace(m, true);
+  }
+  fix_call_sites(scope, drop_this, m_metrics);
+  make_methods_static({using_this.begin(), using_this.end()}, true);
+  make_methods_static({not_using_this.begin(), not_using_this.end()}, false);
+  TRACE(VIRT, 1, "Staticized %lu methods using this, %lu not using this\n",
+        using_this.size(), not_using_this.size());
+  m_metrics.num_methods_using_this += using_this.size();
+  m_metrics.num_methods_not_using_this += not_using_this.size();
 }
 
 DevirtualizerMetrics MethodDevirtualizer::devirtualize_methods(
-    const Scope& scope, const std::vector<DexClass*>& target_classes) {
+    const Scope& scope,
+    const std::vector<DexClass*>& target_classes,
+    const mog::Graph* override_graph) {
   reset_metrics();
-  auto vmethods = get_devirtualizable_vmethods(scope, target_classes);
-  std::unordered_set<DexMethod*> using_this, not_using_this;
-  verify_and_split(vmethods, using_this, not_using_this);
-  TRACE(VIRT,
-        2,
-        " VIRT to devirt vmethods using this %lu, not using this %lu\n",
-        using_this.size(),
-        not_using_this.size());
-
-  if (m_config.vmethods_not_using_this) {
-    staticize_methods_not_using_this(scope, not_using_this);
-  }
-
-  if (m_config.vmethods_using_this) {
-    staticize_methods_using_this(scope, using_this);
+  std::unique_ptr<const mog::Graph> owned_graph;
+  if (override_graph == nullptr) {
+    owned_graph = build_override_graph(scope);
+    override_graph = owned_graph.get();
   }
-
-  auto dmethods = get_devirtualizable_dmethods(scope, target_classes);
-  using_this.clear();
-  not_using_this.clear();
-  verify_and_split(dmethods, using_this, not_using_this);
+  auto overriding = get_overriding_methods(*override_graph);
+
+  // All the candidates are decided before any of them changes, so that the
+  // calls to all of them get rewritten in one walk.
+  ConcurrentSet<DexMethod*> using_this, not_using_this;
+  walk::parallel::classes(target_classes, [&](DexClass* cls) {
+    for (auto* m : cls->get_vmethods()) {
+      if (can_devirtualize(*override_graph, overriding, m)) {
+        verify_and_split(m,
+                         m_config.vmethods_using_this,
+                         m_config.vmethods_not_using_this,
+                         using_this,
+                         not_using_this);
+      }
+    }
+    for (auto* m : cls->get_dmethods()) {
+      if (!is_any_init(m) && !is_static(m)) {
+        verify_and_split(m,
+                         m_config.dmethods_using_this,
+                         m_config.dmethods_not_using_this,
+                         using_this,
+                         not_using_this);
+      }
+    }
+  });
   TRACE(VIRT,
         2,
-        " VIRT to devirt dmethods using this %lu, not using this %lu\n",
+        " VIRT to devirt methods using this %lu, not using this %lu\n",
         using_this.size(),
         not_using_this.size());
 
-  if (m_config.dmethods_not_using_this) {
-    staticize_methods_not_using_this(scope, not_using_this);
-  }
-
-  if (m_config.dmethods_using_this) {
-    staticize_methods_using_this(scope, using_this);
-  }
-
+  staticize_methods(scope, using_this, not_using_this);
   return m_metrics;
 }
 
 DevirtualizerMetrics MethodDevirtualizer::devirtualize_vmethods(
-    const Scope& scope, const std::vector<DexMethod*>& methods) {
+    const Scope& scope,
+    const std::vector<DexMethod*>& methods,
+    const mog::Graph* override_graph) {
   reset_metrics();
-  const auto candidates = get_devirtualizable_vmethods(scope, methods);
-  std::unordered_set<DexMethod*> using_this, not_using_this;
-  verify_and_split(candidates, using_this, not_using_this);
-
-  if (m_config.vmethods_using_this) {
-    staticize_methods_using_this(scope, using_this);
+  std::unique_ptr<const mog::Graph> owned_graph;
+  if (override_graph == nullptr) {
+    owned_graph = build_override_graph(scope);
+    override_graph = owned_graph.get();
   }
+  auto overriding = get_overriding_methods(*override_graph);
 
-  if (m_config.vmethods_not_using_this) {
-    staticize_methods_not_using_this(scope, not_using_this);
+  ConcurrentSet<DexMethod*> using_this, not_using_this;
+  auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* m) {
+    always_assert(!is_static(m) && !is_private(m) && !is_any_init(m));
+    if (can_devirtualize(*override_graph, overriding, m)) {
+      verify_and_split(m,
+                       m_config.vmethods_using_this,
+                       m_config.vmethods_not_using_this,
+                       using_this,
+                       not_using_this);
+    }
+  });
+  for (auto* m : methods) {
+    wq.add_item(m);
   }
+  wq.run_all();
 
+  staticize_methods(scope, using_this, not_using_this);
   return m_metrics;
 }
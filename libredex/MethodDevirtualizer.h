@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
+#include "MethodOverrideGraph.h"
 #include "Pass.h"
 
 struct DevirtualizerConfigs {
@@ -52,16 +54,27 @@ class MethodDevirtualizer {
                 ignore_keep};
   }
 
-  DevirtualizerMetrics devirtualize_methods(const Scope& scope) {
-    return devirtualize_methods(scope, scope);
+  /*
+   * The override graph must have been built from `scope`, once
+   * java.lang.Object had a class (see get_vmethods()). Without one, a graph
+   * is built for the call.
+   */
+  DevirtualizerMetrics devirtualize_methods(
+      const Scope& scope,
+      const method_override_graph::Graph* override_graph = nullptr) {
+    return devirtualize_methods(scope, scope, override_graph);
   }
 
   DevirtualizerMetrics devirtualize_methods(
-      const Scope& scope, const std::vector<DexClass*>& target_classes);
+      const Scope& scope,
+      const std::vector<DexClass*>& target_classes,
+      const method_override_graph::Graph* override_graph = nullptr);
 
   // Assuming vmethods.
   DevirtualizerMetrics devirtualize_vmethods(
-      const Scope& scope, const std::vector<DexMethod*>& methods);
+      const Scope& scope,
+      const std::vector<DexMethod*>& methods,
+      const method_override_graph::Graph* override_graph = nullptr);
 
  private:
   DevirtualizerConfigs m_config;
@@ -69,15 +82,15 @@ class MethodDevirtualizer {
 
   void reset_metrics() { m_metrics = DevirtualizerMetrics(); }
 
-  void staticize_methods_using_this(
-      const std::vector<DexClass*>& scope,
-      const std::unordered_set<DexMethod*>& methods);
-
-  void staticize_methods_not_using_this(
-      const std::vector<DexClass*>& scope,
-      const std::unordered_set<DexMethod*>& methods);
+  // Rewrites the calls to all the methods first, and then staticizes them.
+  void staticize_methods(const std::vector<DexClass*>& scope,
+                         const ConcurrentSet<DexMethod*>& using_this,
+                         const ConcurrentSet<DexMethod*>& not_using_this);
 
-  void verify_and_split(const std::vector<DexMethod*>& candidates,
-                        std::unordered_set<DexMethod*>& using_this,
-                        std::unordered_set<DexMethod*>& not_using_this);
+  // Safe to call concurrently.
+  void verify_and_split(DexMethod* m,
+                        bool allow_using_this,
+                        bool allow_not_using_this,
+                        ConcurrentSet<DexMethod*>& using_this,
+                        ConcurrentSet<DexMethod*>& not_using_this);
 };
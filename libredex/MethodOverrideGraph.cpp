@@ -7,13 +7,15 @@
 
 #include "MethodOverrideGraph.h"
 
-#include <boost/range/adaptor/map.hpp>
+#include <algorithm>
 
 #include "BinarySerialization.h"
 #include "PatriciaTreeMap.h"
 #include "PatriciaTreeSet.h"
 #include "Timer.h"
+#include "Trace.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 using namespace method_override_graph;
 
@@ -43,8 +45,6 @@ struct ClassSignatureMap {
   SignatureMap unimplemented;
 };
 
-using ClassSignatureMaps = ConcurrentMap<const DexClass*, ClassSignatureMap>;
-
 using InterfaceSignatureMaps = ConcurrentMap<const DexClass*, SignatureMap>;
 
 void update_signature_map(const DexMethod* method,
@@ -76,32 +76,81 @@ class GraphBuilder {
   explicit GraphBuilder(const Scope& scope) : m_scope(scope) {}
 
   std::unique_ptr<Graph> run() {
-    m_graph = std::make_unique<Graph>();
+    // An interface can extend several others, so their signature maps are
+    // memoized as they are computed.
     walk::parallel::classes(m_scope, [&](const DexClass* cls) {
       if (is_interface(cls)) {
         analyze_interface(cls);
-      } else {
-        analyze_non_interface(cls);
       }
     });
-    return std::move(m_graph);
-  }
 
- private:
-  ClassSignatureMap analyze_non_interface(const DexClass* cls) {
-    always_assert(!is_interface(cls));
-    if (m_class_signature_maps.count(cls) != 0) {
-      return m_class_signature_maps.at(cls);
+    // Classes only have a single superclass, so their signature maps are
+    // handed down the class hierarchy instead, with each subtree analyzed in
+    // parallel once its root is done.
+    build_class_hierarchy();
+    using Task = std::pair<const DexClass*, ClassSignatureMap>;
+    using State = WorkerState<Task>;
+    WorkQueue<Task> wq(
+        [&](State* state, Task task) {
+          auto class_signatures =
+              analyze_non_interface(task.first, std::move(task.second));
+          auto it = m_subclasses.find(task.first);
+          if (it != m_subclasses.end()) {
+            for (auto* subclass : it->second) {
+              state->push_task(Task(subclass, class_signatures));
+            }
+          }
+          return nullptr;
+        },
+        [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+        [](unsigned int) { return nullptr; },
+        walk::parallel::default_num_threads());
+    for (auto* cls : m_roots) {
+      wq.add_item(Task(cls, ClassSignatureMap()));
     }
+    wq.run_all();
+
+    return std::make_unique<Graph>(m_edges);
+  }
 
-    // Initialize the signature maps from those of the superclass.
-    ClassSignatureMap class_signatures;
-    if (cls->get_super_class() != nullptr) {
-      auto super_cls = type_class(cls->get_super_class());
-      if (super_cls != nullptr) {
-        class_signatures = analyze_non_interface(super_cls);
+ private:
+  /*
+   * Links every class in scope to its superclass, including the external
+   * classes it inherits from, which have no superclass in scope themselves.
+   */
+  void build_class_hierarchy() {
+    std::unordered_set<const DexClass*> visited;
+    for (const DexClass* cls : m_scope) {
+      if (is_interface(cls)) {
+        continue;
+      }
+      while (visited.emplace(cls).second) {
+        auto super_cls = cls->get_super_class() == nullptr
+                             ? nullptr
+                             : type_class(cls->get_super_class());
+        if (super_cls == nullptr) {
+          m_roots.push_back(cls);
+          break;
+        }
+        m_subclasses[super_cls].push_back(cls);
+        cls = super_cls;
       }
     }
+  }
+
+  void add_edge(const DexMethod* overridden, const DexMethod* overriding) {
+    m_edges.update(overridden,
+                   [&](const DexMethod*,
+                       std::vector<const DexMethod*>& children,
+                       bool /* exists */) { children.push_back(overriding); });
+  }
+
+  /*
+   * `class_signatures` starts out as the signature maps of the superclass.
+   */
+  ClassSignatureMap analyze_non_interface(const DexClass* cls,
+                                          ClassSignatureMap class_signatures) {
+    always_assert(!is_interface(cls));
 
     // Add all methods from the interfaces that the current class directly
     // implements to the set of unimplemented methods.
@@ -113,7 +162,7 @@ class GraphBuilder {
       auto overridden_set = class_signatures.implemented.at(method->get_name())
                                 .at(method->get_proto());
       for (auto overridden : overridden_set) {
-        m_graph->add_edge(overridden, method);
+        add_edge(overridden, method);
       }
       // Replace the overridden methods by the overriding ones.
       update_signature_map(
@@ -132,7 +181,7 @@ class GraphBuilder {
             class_signatures.unimplemented.at(implementation->get_name())
                 .at(implementation->get_proto());
         for (auto unimplemented : unimplemented_set) {
-          m_graph->add_edge(unimplemented, implementation);
+          add_edge(unimplemented, implementation);
         }
         // Remove the method from the set of unimplemented interface methods.
         update_signature_map(
@@ -140,7 +189,6 @@ class GraphBuilder {
       }
     }
 
-    m_class_signature_maps.emplace(cls, class_signatures);
     return class_signatures;
   }
 
@@ -172,7 +220,7 @@ class GraphBuilder {
       // to find them. This design reduces the number of edges necessary for
       // building the graph.
       for (auto overridden : overridden_set) {
-        m_graph->add_edge(overridden, method);
+        add_edge(overridden, method);
       }
       update_signature_map(method, MethodSet{method}, &interface_signatures);
     }
@@ -193,9 +241,11 @@ class GraphBuilder {
     return super_interface_signatures;
   }
 
-  std::unique_ptr<Graph> m_graph;
-  ClassSignatureMaps m_class_signature_maps;
+  OverrideEdges m_edges;
   InterfaceSignatureMaps m_interface_signature_maps;
+  std::unordered_map<const DexClass*, std::vector<const DexClass*>>
+      m_subclasses;
+  std::vector<const DexClass*> m_roots;
   const Scope& m_scope;
 };
 
@@ -203,21 +253,34 @@ class GraphBuilder {
 
 namespace method_override_graph {
 
-Node Graph::empty_node;
-
-const Node& Graph::get_node(const DexMethod* method) const {
-  auto it = m_nodes.find(method);
-  if (it == m_nodes.end()) {
-    return empty_node;
+Graph::Graph(const OverrideEdges& edges) {
+  m_methods.reserve(edges.size());
+  for (const auto& pair : edges) {
+    m_methods.push_back(pair.first);
+  }
+  // Sorting keeps the ids, and thus the dumps, deterministic.
+  std::sort(m_methods.begin(), m_methods.end(), compare_dexmethods);
+  m_ids.reserve(m_methods.size());
+  m_offsets.reserve(m_methods.size() + 1);
+  for (auto* method : m_methods) {
+    m_ids.emplace(method, m_ids.size());
+    auto children = edges.at(method);
+    std::sort(children.begin(), children.end(), compare_dexmethods);
+    children.erase(std::unique(children.begin(), children.end()),
+                   children.end());
+    m_children.insert(m_children.end(), children.begin(), children.end());
+    m_offsets.push_back(m_children.size());
   }
-  return it->second;
 }
 
-void Graph::add_edge(const DexMethod* overridden, const DexMethod* overriding) {
-  m_nodes.update(overridden,
-                 [&](const DexMethod*, Node& node, bool /* exists */) {
-                   node.children.insert(overriding);
-                 });
+Node Graph::get_node(const DexMethod* method) const {
+  auto it = m_ids.find(method);
+  if (it == m_ids.end()) {
+    return Node();
+  }
+  auto* children = m_children.data();
+  return Node{Node::Methods(children + m_offsets[it->second],
+                            children + m_offsets[it->second + 1])};
 }
 
 void Graph::dump(std::ostream& os) const {
@@ -230,12 +293,10 @@ void Graph::dump(std::ostream& os) const {
         os << s;
       },
       [&](const DexMethod* method) -> std::vector<const DexMethod*> {
-        const auto& node = get_node(method);
-        std::vector<const DexMethod*> succs(node.children.begin(),
-                                            node.children.end());
-        return succs;
+        auto children = get_node(method).children;
+        return std::vector<const DexMethod*>(children.begin(), children.end());
       });
-  gw.write(os, boost::adaptors::keys(m_nodes));
+  gw.write(os, m_methods);
 }
 
 std::unique_ptr<const Graph> build_graph(const Scope& scope) {
@@ -243,12 +304,42 @@ std::unique_ptr<const Graph> build_graph(const Scope& scope) {
   return GraphBuilder(scope).run();
 }
 
+std::shared_ptr<const Graph> GraphCache::get(const Scope& scope) {
+  std::vector<uintptr_t> snapshot;
+  auto add = [&snapshot](const void* ptr) {
+    snapshot.push_back(reinterpret_cast<uintptr_t>(ptr));
+  };
+  for (const auto* cls : scope) {
+    add(cls);
+    snapshot.push_back(is_interface(cls));
+    add(cls->get_super_class());
+    add(cls->get_interfaces());
+    snapshot.push_back(cls->get_vmethods().size());
+    for (const auto* vmeth : cls->get_vmethods()) {
+      add(vmeth);
+      add(vmeth->get_name());
+      add(vmeth->get_proto());
+    }
+  }
+  if (m_graph == nullptr || snapshot != m_snapshot) {
+    TRACE(VIRT, 2, "Rebuilding the shared method override graph\n");
+    m_graph = build_graph(scope);
+    m_snapshot = std::move(snapshot);
+  }
+  return m_graph;
+}
+
+void GraphCache::invalidate() {
+  m_snapshot.clear();
+  m_graph.reset();
+}
+
 std::unordered_set<const DexMethod*> get_overriding_methods(
     const Graph& graph, const DexMethod* method) {
   std::unordered_set<const DexMethod*> overrides;
   std::unordered_set<const DexMethod*> visited;
-  std::function<void(const DexMethod*, const Node&)> visit =
-      [&](const DexMethod* current, const Node& node) {
+  std::function<void(const DexMethod*, Node)> visit =
+      [&](const DexMethod* current, Node node) {
         if (visited.count(current)) {
           return;
         }
@@ -7,6 +7,12 @@
 
 #pragma once
 
+#include <boost/range/iterator_range.hpp>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexStore.h"
@@ -34,25 +40,62 @@ std::unique_ptr<const Graph> build_graph(const Scope&);
 
 /*
  * The `children` edges point to the overriders / implementors of the current
- * Node's method.
+ * Node's method. They are a view into the Graph the Node came from.
  */
 struct Node {
-  std::unordered_set<const DexMethod*> children;
+  using Methods = boost::iterator_range<const DexMethod* const*>;
+
+  Methods children;
 };
 
+/*
+ * Maps each overridden method to the methods that directly override it.
+ */
+using OverrideEdges =
+    ConcurrentMap<const DexMethod*, std::vector<const DexMethod*>>;
+
+/*
+ * The edges are stored in compressed sparse row form: every method that is
+ * overridden gets a dense id, and the children of the method with id `i` are
+ * m_children[m_offsets[i]] up to m_children[m_offsets[i + 1]].
+ */
 class Graph {
  public:
-  const Node& get_node(const DexMethod* method) const;
+  Graph() = default;
+
+  // Duplicate edges are dropped.
+  explicit Graph(const OverrideEdges& edges);
 
-  const ConcurrentMap<const DexMethod*, Node>& nodes() const { return m_nodes; }
+  Node get_node(const DexMethod* method) const;
 
-  void add_edge(const DexMethod* overridden, const DexMethod* overriding);
+  // The methods that have at least one child, ordered by their ids.
+  const std::vector<const DexMethod*>& methods() const { return m_methods; }
 
   void dump(std::ostream&) const;
 
  private:
-  static Node empty_node;
-  ConcurrentMap<const DexMethod*, Node> m_nodes;
+  std::unordered_map<const DexMethod*, uint32_t> m_ids;
+  std::vector<const DexMethod*> m_methods;
+  std::vector<uint32_t> m_offsets{0};
+  std::vector<const DexMethod*> m_children;
+};
+
+/*
+ * Shares a Graph between passes. get() rebuilds the graph only if a class in
+ * the scope, its super class, its interfaces or its virtual methods changed
+ * since the graph was built, like SignatureMapCache does for SignatureMaps.
+ * The PassManager owns one, see PassManager::method_override_graph_cache().
+ */
+class GraphCache {
+ public:
+  std::shared_ptr<const Graph> get(const Scope& scope);
+
+  void invalidate();
+
+ private:
+  // What the cached graph was built from, see get().
+  std::vector<uintptr_t> m_snapshot;
+  std::shared_ptr<const Graph> m_graph;
 };
 
 } // namespace method_override_graph
@@ -127,11 +127,11 @@ void log_nopt(NoptReason nopt, const DexClass* cls) {
   OptDataMapper::get_instance().log_nopt(nopt, cls);
 }
 
-InsnOptData::InsnOptData(const DexMethod* method, const IRInstruction* insn)
-    : m_method(method) {
-  m_insn_orig = SHOW(insn);
-  m_has_line_num = get_line_num(method, insn, &m_line_num);
-}
+InsnOptData::InsnOptData(const LogRecord& record)
+    : m_method(record.method),
+      m_insn_orig(record.insn_orig),
+      m_has_line_num(record.has_line_num),
+      m_line_num(record.line_num) {}
 
 MethodOptData::MethodOptData(const DexMethod* method) : m_method(method) {
   m_method_orig = SHOW(method);
@@ -139,11 +139,11 @@ MethodOptData::MethodOptData(const DexMethod* method) : m_method(method) {
 }
 
 std::shared_ptr<InsnOptData> MethodOptData::get_insn_opt_data(
-    const IRInstruction* insn) {
-  const auto& kv_pair = m_insn_opt_map.find(insn);
+    const LogRecord& record) {
+  const auto& kv_pair = m_insn_opt_map.find(record.insn);
   if (kv_pair == m_insn_opt_map.end()) {
-    auto insn_opt_data = std::make_shared<InsnOptData>(m_method, insn);
-    m_insn_opt_map.emplace(insn, insn_opt_data);
+    auto insn_opt_data = std::make_shared<InsnOptData>(record);
+    m_insn_opt_map.emplace(record.insn, insn_opt_data);
     return insn_opt_data;
   }
   return kv_pair->second;
@@ -181,76 +181,125 @@ std::shared_ptr<ClassOptData> OptDataMapper::get_cls_opt_data(
   return kv_pair->second;
 }
 
+namespace {
+
+thread_local std::vector<LogRecord>* t_buffer{nullptr};
+
+LogRecord make_record(bool is_opt,
+                      int reason,
+                      const DexMethod* method,
+                      const IRInstruction* insn) {
+  always_assert_log(method != nullptr, "Can't log null method\n");
+  LogRecord record;
+  record.is_opt = is_opt;
+  record.reason = reason;
+  record.method = method;
+  if (insn != nullptr) {
+    record.insn = insn;
+    record.insn_orig = SHOW(insn);
+    record.has_line_num = get_line_num(method, insn, &record.line_num);
+  }
+  return record;
+}
+
+LogRecord make_record(bool is_opt, int reason, const DexClass* cls) {
+  always_assert_log(cls != nullptr, "Can't log null class\n");
+  LogRecord record;
+  record.is_opt = is_opt;
+  record.reason = reason;
+  record.cls = cls;
+  return record;
+}
+
+} // namespace
+
+std::vector<LogRecord>& OptDataMapper::thread_buffer() {
+  if (t_buffer == nullptr) {
+    std::lock_guard<std::mutex> guard(m_buffers_lock);
+    m_buffers.emplace_back(std::make_unique<std::vector<LogRecord>>());
+    t_buffer = m_buffers.back().get();
+  }
+  return *t_buffer;
+}
+
+void OptDataMapper::merge_buffers() {
+  std::lock_guard<std::mutex> guard(m_buffers_lock);
+  for (auto& buffer : m_buffers) {
+    for (const auto& record : *buffer) {
+      std::vector<OptReason>* opts;
+      std::vector<NoptReason>* nopts;
+      if (record.cls != nullptr) {
+        auto cls_opt_data = get_cls_opt_data(record.cls->get_type());
+        opts = &cls_opt_data->m_opts;
+        nopts = &cls_opt_data->m_nopts;
+      } else {
+        auto cls_opt_data = get_cls_opt_data(record.method->get_class());
+        auto meth_opt_data = cls_opt_data->get_meth_opt_data(record.method);
+        if (record.insn != nullptr) {
+          auto insn_opt_data = meth_opt_data->get_insn_opt_data(record);
+          opts = &insn_opt_data->m_opts;
+          nopts = &insn_opt_data->m_nopts;
+        } else {
+          opts = &meth_opt_data->m_opts;
+          nopts = &meth_opt_data->m_nopts;
+        }
+      }
+      if (record.is_opt) {
+        opts->emplace_back(static_cast<OptReason>(record.reason));
+      } else {
+        nopts->emplace_back(static_cast<NoptReason>(record.reason));
+      }
+    }
+    buffer->clear();
+  }
+}
+
 void OptDataMapper::log_opt(OptReason opt,
                             const DexMethod* method,
                             const IRInstruction* insn) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
-  always_assert_log(method != nullptr, "Can't log null method\n");
   always_assert_log(insn != nullptr, "Can't log null instruction\n");
-  auto cls_opt_data = get_cls_opt_data(method->get_class());
-  auto meth_opt_data = cls_opt_data->get_meth_opt_data(method);
-  auto insn_opt_data = meth_opt_data->get_insn_opt_data(insn);
-  insn_opt_data->m_opts.emplace_back(opt);
+  thread_buffer().push_back(make_record(true, opt, method, insn));
 }
 
 void OptDataMapper::log_nopt(NoptReason nopt,
                              const DexMethod* method,
                              const IRInstruction* insn) {
-   if (!m_logs_enabled) {
-     return;
-   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
-  always_assert_log(method != nullptr, "Can't log null method\n");
+  if (!m_logs_enabled) {
+    return;
+  }
   always_assert_log(insn != nullptr, "Can't log null instruction\n");
-  auto cls_opt_data = get_cls_opt_data(method->get_class());
-  auto meth_opt_data = cls_opt_data->get_meth_opt_data(method);
-  auto insn_opt_data = meth_opt_data->get_insn_opt_data(insn);
-  insn_opt_data->m_nopts.emplace_back(nopt);
+  thread_buffer().push_back(make_record(false, nopt, method, insn));
 }
 
 void OptDataMapper::log_opt(OptReason opt, const DexMethod* method) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
-  always_assert_log(method != nullptr, "Can't log null method\n");
-  auto cls_opt_data = get_cls_opt_data(method->get_class());
-  auto meth_opt_data = cls_opt_data->get_meth_opt_data(method);
-  meth_opt_data->m_opts.emplace_back(opt);
+  thread_buffer().push_back(make_record(true, opt, method, nullptr));
 }
 
 void OptDataMapper::log_nopt(NoptReason nopt, const DexMethod* method) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
-  always_assert_log(method != nullptr, "Can't log null method\n");
-  auto cls_opt_data = get_cls_opt_data(method->get_class());
-  auto meth_opt_data = cls_opt_data->get_meth_opt_data(method);
-  meth_opt_data->m_nopts.emplace_back(nopt);
+  thread_buffer().push_back(make_record(false, nopt, method, nullptr));
 }
 
 void OptDataMapper::log_opt(OptReason opt, const DexClass* cls) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
-  always_assert_log(cls != nullptr, "Can't log null class\n");
-  auto cls_opt_data = get_cls_opt_data(cls->get_type());
-  cls_opt_data->m_opts.emplace_back(opt);
+  thread_buffer().push_back(make_record(true, opt, cls));
 }
 
 void OptDataMapper::log_nopt(NoptReason nopt, const DexClass* cls) {
   if (!m_logs_enabled) {
     return;
   }
-  std::lock_guard<std::mutex> guard(s_opt_log_mutex);
-  always_assert_log(cls != nullptr, "Can't log null class\n");
-  auto cls_opt_data = get_cls_opt_data(cls->get_type());
-  cls_opt_data->m_nopts.emplace_back(nopt);
+  thread_buffer().push_back(make_record(false, nopt, cls));
 }
 
 Json::Value OptDataMapper::serialize_sql() {
@@ -265,6 +314,7 @@ Json::Value OptDataMapper::serialize_sql() {
   constexpr const char* CLASSES = "classes";
   constexpr const char* OPT_MESSAGES = "opt_messages";
   constexpr const char* NOPT_MESSAGES = "nopt_messages";
+  merge_buffers();
   Json::Value top;
 
   Json::Value opt_msg_arr;
@@ -453,7 +503,9 @@ void OptDataMapper::init_nopt_messages() {
       {INL_MULTIPLE_RETURNS,
        "Didn''t inline: callee has multiple return points"},
       {INL_TOO_MANY_CALLERS,
-       "Didn''t inline: this method has too many callers"}};
+       "Didn''t inline: this method has too many callers"},
+      {INL_REGISTER_PRESSURE,
+       "Didn''t inline: too many registers would be live in the caller"}};
   m_nopt_msg_map = std::move(nopt_msg_map);
 }
 
@@ -468,6 +520,4 @@ void OptDataMapper::verify_nopt(NoptReason reason) {
                     "Message not found for reason %s\n",
                     reason);
 }
-
-std::mutex OptDataMapper::s_opt_log_mutex;
 } // namespace opt_metadata
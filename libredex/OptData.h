@@ -12,6 +12,7 @@
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "DexClass.h"
 #include "IRInstruction.h"
@@ -62,6 +63,23 @@ void log_nopt(NoptReason opt, const DexMethod* method);
 void log_opt(OptReason opt, const DexClass* cls);
 void log_nopt(NoptReason opt, const DexClass* cls);
 
+/**
+ * One logged decision. Decisions go into a buffer of the logging thread, and
+ * are only sorted into per-class/method/insn data when serializing.
+ */
+struct LogRecord {
+  bool is_opt;
+  int reason;
+  const DexClass* cls{nullptr};
+  const DexMethod* method{nullptr};
+  const IRInstruction* insn{nullptr};
+  // Instructions may be gone by the time we serialize (e.g. an inlined
+  // callsite), so insn-level decisions describe theirs when logged.
+  std::string insn_orig;
+  bool has_line_num{false};
+  size_t line_num{0};
+};
+
 /**
  * Stores per-insn optimization data.
  */
@@ -70,7 +88,7 @@ class InsnOptData {
   friend class OptDataMapper;
 
  public:
-  InsnOptData(const DexMethod* method, const IRInstruction* insn);
+  explicit InsnOptData(const LogRecord& record);
 
  private:
   const DexMethod* m_method;
@@ -91,7 +109,7 @@ class MethodOptData {
 
  public:
   MethodOptData(const DexMethod* method);
-  std::shared_ptr<InsnOptData> get_insn_opt_data(const IRInstruction* insn);
+  std::shared_ptr<InsnOptData> get_insn_opt_data(const LogRecord& record);
 
  private:
   const DexMethod* m_method;
@@ -130,8 +148,6 @@ class ClassOptData {
  */
 class OptDataMapper {
  public:
-  static std::mutex s_opt_log_mutex;
-
   static OptDataMapper& get_instance() {
     static OptDataMapper instance;
     return instance;
@@ -146,6 +162,7 @@ class OptDataMapper {
 
   /**
    * Records the given opt and attributes it to the given class/method/insn.
+   * These only append to a buffer of the calling thread.
    */
   void log_opt(OptReason opt,
                const DexMethod* method,
@@ -176,6 +193,10 @@ class OptDataMapper {
 
  private:
   bool m_logs_enabled{false};
+  // The buffers of all the threads that logged something. They outlive their
+  // threads, and are only read once the logging is over.
+  std::mutex m_buffers_lock;
+  std::vector<std::unique_ptr<std::vector<LogRecord>>> m_buffers;
   std::unordered_map<const DexClass*, std::shared_ptr<ClassOptData>>
       m_cls_opt_map;
   std::unordered_map<int /*OptReason*/, std::string> m_opt_msg_map;
@@ -192,6 +213,17 @@ class OptDataMapper {
    */
   std::shared_ptr<ClassOptData> get_cls_opt_data(DexType* cls_type);
 
+  /**
+   * Returns the buffer the calling thread logs to.
+   */
+  std::vector<LogRecord>& thread_buffer();
+
+  /**
+   * Sorts the records of all the thread buffers, in the order they were
+   * logged per thread, into m_cls_opt_map. Empties the buffers.
+   */
+  void merge_buffers();
+
   /**
    * For the table {msg_type}_messages, append each row as an entry to arr.
    */
@@ -33,6 +33,51 @@ class Pass {
 
   virtual void configure_pass(const JsonWrapper&) {}
 
+  /**
+   * A CFG-aware pass accepts methods whose code already has an editable CFG
+   * built, and leaves the CFG of the methods it touches in place instead of
+   * calling clear_cfg() on them. The PassManager linearizes the code before
+   * any pass that isn't CFG-aware runs, and before the output phase; with
+   * "keep_cfg_across_passes" set, consecutive CFG-aware passes share the
+   * same CFGs rather than rebuilding them.
+   */
+  virtual bool is_cfg_aware() const { return false; }
+
+  /**
+   * A call-graph-aware pass marks every method whose code it changes dirty in
+   * PassManager::call_graph_cache(), and doesn't change the class hierarchy.
+   * The PassManager drops the whole cached call graph after any other pass.
+   */
+  virtual bool is_call_graph_aware() const { return false; }
+
+  /**
+   * The parts of the program that a pass reads and writes, as Effect bits.
+   * With "parallel_passes" set, the PassManager runs neighbouring passes at
+   * the same time when none of them writes what another one reads or writes.
+   * Metrics and files of the pass's own don't count, but anything else that
+   * is shared -- the call graph cache, stdout -- is only covered by OTHER.
+   * Everything is claimed by default, which never runs alongside anything.
+   *
+   * With "check_pass_effects" set, which it is by default in debug builds,
+   * the PassManager asserts that a pass that doesn't declare writing CODE or
+   * HIERARCHY left them alone.
+   */
+  enum Effect : uint32_t {
+    NOTHING = 0,
+    // The code of methods.
+    CODE = 1 << 0,
+    // Classes and their members: which exist, their names, flags, supers and
+    // interfaces, and the stores and dexes they are in.
+    HIERARCHY = 1 << 1,
+    // The resources, the manifest and the other files of the APK.
+    RESOURCES = 1 << 2,
+    // Anything else.
+    OTHER = 1 << 3,
+    ALL = CODE | HIERARCHY | RESOURCES | OTHER,
+  };
+  virtual uint32_t reads() const { return ALL; }
+  virtual uint32_t writes() const { return ALL; }
+
   /**
    * All passes' eval_pass are run, and then all passes' run_pass are run. This allows each
    * pass to evaluate its rules in terms of the original input, without other passes changing
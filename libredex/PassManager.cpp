@@ -8,29 +8,42 @@
 #include "PassManager.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/thread.hpp>
 #include <cstdio>
+#include <exception>
+#include <fstream>
 #include <unordered_set>
 
 #include "ApiLevelChecker.h"
 #include "ApkManager.h"
+#include "CallGraph.h"
 #include "CommandProfiling.h"
+#include "ConcurrencyStats.h"
 #include "ConfigFiles.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
 #include "DexUtil.h"
+#include "EventTrace.h"
 #include "IRCode.h"
 #include "IRTypeChecker.h"
 #include "InstructionLowering.h"
 #include "JemallocUtil.h"
+#include "MethodCosts.h"
+#include "MethodOverrideGraph.h"
 #include "OptData.h"
+#include "PatriciaTreeSet.h"
 #include "PrintSeeds.h"
 #include "ProguardPrintConfiguration.h"
 #include "ProguardReporting.h"
 #include "ReachableClasses.h"
+#include "SamplingProfiler.h"
 #include "Timer.h"
+#include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -42,6 +55,230 @@ std::string get_apk_dir(const Json::Value& config) {
   return apkdir;
 }
 
+/*
+ * A hash of everything in a method that IRTypeChecker looks at, other than
+ * the class hierarchy: the method's signature, the instruction stream and the
+ * signatures of referenced members (which passes may change in place). Used to
+ * skip re-checking methods that a pass did not touch.
+ *
+ * Returns boost::none if the method can't be fingerprinted and must always be
+ * checked.
+ */
+boost::optional<size_t> type_checker_fingerprint(const DexMethod* method) {
+  if (method->is_balloon_deferred() || method->is_code_compact()) {
+    // Don't force ballooning or expanding just to hash the code.
+    return boost::none;
+  }
+  const IRCode* code = method->get_code();
+  if (code == nullptr || code->editable_cfg_built()) {
+    return boost::none;
+  }
+  size_t seed = 0;
+  boost::hash_combine(seed, method->get_proto());
+  boost::hash_combine(seed, method->get_access());
+  boost::hash_combine(seed, code->get_registers_size());
+  for (const auto& mie : *code) {
+    boost::hash_combine(seed, static_cast<int>(mie.type));
+    switch (mie.type) {
+    case MFLOW_OPCODE: {
+      auto insn = mie.insn;
+      boost::hash_combine(seed, insn->hash());
+      if (insn->has_method()) {
+        boost::hash_combine(seed, insn->get_method()->get_proto());
+        boost::hash_combine(seed, insn->get_method()->get_class());
+      } else if (insn->has_field()) {
+        boost::hash_combine(seed, insn->get_field()->get_type());
+        boost::hash_combine(seed, insn->get_field()->get_class());
+      }
+      break;
+    }
+    case MFLOW_TRY:
+      boost::hash_combine(seed, static_cast<int>(mie.tentry->type));
+      boost::hash_combine(seed, mie.tentry->catch_start);
+      break;
+    case MFLOW_CATCH:
+      boost::hash_combine(seed, mie.centry->catch_type);
+      boost::hash_combine(seed, mie.centry->next);
+      break;
+    case MFLOW_TARGET:
+      boost::hash_combine(seed, static_cast<int>(mie.target->type));
+      boost::hash_combine(seed, mie.target->src);
+      if (mie.target->type == BRANCH_MULTI) {
+        boost::hash_combine(seed, mie.target->case_key);
+      }
+      break;
+    default:
+      // Debug info and positions don't matter to the type checker.
+      break;
+    }
+  }
+  return seed;
+}
+
+void record_fingerprints(const Scope& scope,
+                         ConcurrentMap<const DexMethod*, size_t>* out) {
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    auto fingerprint = type_checker_fingerprint(method);
+    if (fingerprint) {
+      out->emplace(method, *fingerprint);
+    }
+  });
+}
+
+/*
+ * Methods that are new, or whose code we can't fingerprint, count as changed.
+ */
+size_t count_changed_methods(
+    const Scope& scope,
+    const ConcurrentMap<const DexMethod*, size_t>& before) {
+  std::atomic<size_t> changed{0};
+  walk::parallel::methods(scope, [&](DexMethod* method) {
+    if (method->is_balloon_deferred() || method->is_code_compact() ||
+        method->get_code() == nullptr) {
+      return;
+    }
+    auto fingerprint = type_checker_fingerprint(method);
+    if (!fingerprint || before.get(method, ~*fingerprint) != *fingerprint) {
+      ++changed;
+    }
+  });
+  return changed;
+}
+
+void write_pass_profile(const std::string& path,
+                        const std::vector<PassManager::PassInfo>& pass_info) {
+  Json::Value passes(Json::arrayValue);
+  for (const auto& info : pass_info) {
+    Json::Value pass;
+    pass["name"] = info.name;
+    pass["order"] = Json::UInt64(info.order);
+    pass["repeat"] = Json::UInt64(info.repeat);
+    pass["eval"] = info.eval_profile.to_json();
+    pass["run"] = info.run_profile.to_json();
+    passes.append(pass);
+  }
+  Json::Value profile;
+  profile["passes"] = passes;
+  std::ofstream out(path);
+  Json::StyledStreamWriter writer;
+  writer.write(out, profile);
+}
+
+/*
+ * Whether two passes can run at the same time: neither may write what the
+ * other one reads or writes.
+ */
+bool independent(const Pass* a, const Pass* b) {
+  return (a->writes() & (b->reads() | b->writes())) == 0 &&
+         (b->writes() & (a->reads() | a->writes())) == 0;
+}
+
+size_t hierarchy_fingerprint(const Scope& scope) {
+  size_t seed = 0;
+  auto hash_members = [&seed](const auto& members) {
+    boost::hash_combine(seed, members.size());
+    for (auto member : members) {
+      boost::hash_combine(seed, member);
+      boost::hash_combine(seed, member->get_name());
+      boost::hash_combine(seed, member->get_access());
+    }
+  };
+  for (auto cls : scope) {
+    boost::hash_combine(seed, cls);
+    boost::hash_combine(seed, cls->get_name());
+    boost::hash_combine(seed, cls->get_access());
+    boost::hash_combine(seed, cls->get_super_class());
+    for (auto intf : cls->get_interfaces()->get_type_list()) {
+      boost::hash_combine(seed, intf);
+    }
+    hash_members(cls->get_dmethods());
+    hash_members(cls->get_vmethods());
+    hash_members(cls->get_ifields());
+    hash_members(cls->get_sfields());
+  }
+  return seed;
+}
+
+/*
+ * What check_pass_effects compares before and after passes that declare
+ * they don't write CODE or HIERARCHY.
+ */
+struct EffectsSnapshot {
+  std::string passes;
+  uint32_t writes;
+  ConcurrentMap<const DexMethod*, size_t> code;
+  size_t hierarchy{0};
+};
+
+std::unique_ptr<EffectsSnapshot> snapshot_effects(
+    const DexStoresVector& stores, const std::string& passes, uint32_t writes) {
+  if ((writes & Pass::CODE) && (writes & Pass::HIERARCHY)) {
+    return nullptr;
+  }
+  auto snapshot = std::make_unique<EffectsSnapshot>();
+  snapshot->passes = passes;
+  snapshot->writes = writes;
+  const auto& scope = get_class_scope(stores);
+  if (!(writes & Pass::CODE)) {
+    record_fingerprints(scope, &snapshot->code);
+  }
+  if (!(writes & Pass::HIERARCHY)) {
+    snapshot->hierarchy = hierarchy_fingerprint(scope);
+  }
+  return snapshot;
+}
+
+void verify_effects(const DexStoresVector& stores,
+                    const EffectsSnapshot& snapshot) {
+  const auto& scope = get_class_scope(stores);
+  if (!(snapshot.writes & Pass::HIERARCHY)) {
+    always_assert_log(hierarchy_fingerprint(scope) == snapshot.hierarchy,
+                      "%s changed the class hierarchy, but doesn't declare "
+                      "writing it\n",
+                      snapshot.passes.c_str());
+  }
+  if (!(snapshot.writes & Pass::CODE)) {
+    // Only methods that had a fingerprint before count: reading the code of
+    // a method may balloon it, which is no change.
+    std::atomic<size_t> changed{0};
+    walk::parallel::methods(scope, [&](DexMethod* method) {
+      if (snapshot.code.count(method) == 0) {
+        return;
+      }
+      auto fingerprint = type_checker_fingerprint(method);
+      if (!fingerprint || *fingerprint != snapshot.code.get(method, 0)) {
+        ++changed;
+      }
+    });
+    always_assert_log(changed == 0,
+                      "%s changed the code of %zu methods, but doesn't "
+                      "declare writing code\n",
+                      snapshot.passes.c_str(), changed.load());
+  }
+}
+
+/*
+ * Passes may have kept the dexes of the stores from get_dexen() and edited
+ * them later, which the versions of the stores don't see.
+ */
+void mark_stores_changed(DexStoresVector& stores) {
+  for (auto& store : stores) {
+    store.mark_changed();
+  }
+}
+
+// The pass that the current thread runs, while passes run at the same time.
+thread_local PassManager::PassInfo* t_current_pass_info = nullptr;
+
+// The shard of the registered metrics the current thread counts into.
+size_t metric_shard() {
+  static std::atomic<size_t> next_shard{0};
+  thread_local size_t shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) %
+      PassManager::kMetricShards;
+  return shard;
+}
+
 } // namespace
 
 std::unique_ptr<redex::ProguardConfiguration> empty_pg_config() {
@@ -63,7 +300,12 @@ PassManager::PassManager(
       m_current_pass_info(nullptr),
       m_pg_config(std::move(pg_config)),
       m_redex_options(options),
-      m_testing_mode(false) {
+      m_testing_mode(false),
+      m_call_graph_cache(
+          std::make_unique<call_graph::SingleCalleeGraphCache>()),
+      m_signature_map_cache(std::make_unique<SignatureMapCache>()),
+      m_method_override_graph_cache(
+          std::make_unique<method_override_graph::GraphCache>()) {
   init(config);
   if (getenv("PROFILE_COMMAND") && getenv("PROFILE_PASS")) {
     // Resolve the pass in the constructor so that any typos / references to
@@ -79,8 +321,29 @@ PassManager::PassManager(
     fprintf(stderr, "Will run jemalloc profiler for %s\n",
             m_malloc_profile_pass->name().c_str());
   }
+  if (getenv("SAMPLE_PROFILE_PASSES")) {
+    // A comma-separated list of the passes to sample, each run of which
+    // writes its stacks to <pass name>#<run>.folded in the meta directory.
+    std::string names = getenv("SAMPLE_PROFILE_PASSES");
+    size_t begin = 0;
+    while (begin <= names.size()) {
+      auto end = std::min(names.find(',', begin), names.size());
+      auto pass = find_pass(names.substr(begin, end - begin));
+      always_assert_log(pass != nullptr, "No pass %s to sample",
+                        names.substr(begin, end - begin).c_str());
+      m_sampled_passes.insert(pass);
+      fprintf(stderr, "Will run sampling profiler for %s\n",
+              pass->name().c_str());
+      begin = end + 1;
+    }
+    if (getenv("SAMPLE_PROFILE_HZ")) {
+      m_sample_hz = std::stoul(getenv("SAMPLE_PROFILE_HZ"));
+    }
+  }
 }
 
+PassManager::~PassManager() = default;
+
 void PassManager::init(const Json::Value& config) {
   if (config["redex"].isMember("passes")) {
     auto passes_from_config = config["redex"]["passes"];
@@ -114,12 +377,31 @@ void PassManager::init(const Json::Value& config) {
   }
 }
 
-void PassManager::run_type_checker(const Scope& scope,
-                                   bool verify_moves,
-                                   bool check_no_overwrite_this) {
-  TRACE(PM, 1, "Running IRTypeChecker...\n");
+void PassManager::run_type_checker(
+    const Scope& scope,
+    bool verify_moves,
+    bool check_no_overwrite_this,
+    ConcurrentMap<const DexMethod*, size_t>* fingerprints) {
+  TRACE(PM, 1, "Running IRTypeChecker%s...\n",
+        fingerprints ? " on changed methods" : "");
   Timer t("IRTypeChecker");
-  walk::parallel::methods(scope, [=](DexMethod* dex_method) {
+  std::atomic<size_t> num_skipped{0};
+  walk::parallel::methods(scope, [&](DexMethod* dex_method) {
+    if (dex_method->is_balloon_deferred()) {
+      // Still the code we loaded; no pass has looked at it, let alone
+      // changed it.
+      ++num_skipped;
+      return;
+    }
+    boost::optional<size_t> fingerprint;
+    if (fingerprints != nullptr) {
+      fingerprint = type_checker_fingerprint(dex_method);
+      if (fingerprint &&
+          fingerprints->get(dex_method, ~*fingerprint) == *fingerprint) {
+        ++num_skipped;
+        return;
+      }
+    }
     IRTypeChecker checker(dex_method);
     if (verify_moves) {
       checker.verify_moves();
@@ -135,7 +417,12 @@ void PassManager::run_type_checker(const Scope& scope,
       fprintf(stderr, "Code:\n%s\n", SHOW(dex_method->get_code()));
       exit(EXIT_FAILURE);
     }
+    if (fingerprint) {
+      fingerprints->insert_or_assign(std::make_pair(dex_method, *fingerprint));
+    }
   });
+  TRACE(PM, 1, "IRTypeChecker skipped %lu unchanged methods\n",
+        num_skipped.load());
 }
 
 void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
@@ -181,13 +468,44 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
   // Load configurations regarding the scope.
   conf.load(scope);
 
+  const std::string pass_profile_output =
+      conf.get_json_config().get("pass_profile_output", std::string());
+  bool profile_passes = !pass_profile_output.empty();
+  bool account_memory = conf.get_json_config().get("memory_accounting", false);
+  // How many of the methods that each pass spent the most time on to report.
+  // Zero turns the timing off.
+  size_t slowest_methods_per_pass = 0;
+  conf.get_json_config().get("slowest_methods_per_pass", 0,
+                             slowest_methods_per_pass);
+  method_costs::set_enabled(slowest_methods_per_pass > 0);
+  bool release_memory_after_passes =
+      conf.get_json_config().get("release_memory_after_passes", false);
+  auto release_memory_after = [&](PassInfo& pass_info) {
+    if (!release_memory_after_passes) {
+      return;
+    }
+    pass_info.released_bytes = release_memory();
+    if (pass_info.released_bytes) {
+      TRACE(PM, 1, "Released %lu bytes after %s\n",
+            static_cast<unsigned long>(*pass_info.released_bytes),
+            pass_info.name.c_str());
+    }
+  };
+  if (conf.get_json_config().get("patricia_tree_hash_consing", false)) {
+    sparta::PatriciaTreeHashConsing::enable();
+  }
+
   // TODO(fengliu) : Remove Pass::eval_pass API
   for (size_t i = 0; i < m_activated_passes.size(); ++i) {
     Pass* pass = m_activated_passes[i];
     TRACE(PM, 1, "Evaluating %s...\n", pass->name().c_str());
     Timer t(pass->name() + " (eval)");
     m_current_pass_info = &m_pass_info[i];
-    pass->eval_pass(stores, conf, *this);
+    {
+      ScopedPhaseProfile phase_prof(
+          profile_passes ? &m_pass_info[i].eval_profile : nullptr);
+      pass->eval_pass(stores, conf, *this);
+    }
     m_current_pass_info = nullptr;
   }
 
@@ -199,52 +517,309 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
   bool verify_moves = type_checker_args.get("verify_moves", false).asBool();
   bool check_no_overwrite_this =
       type_checker_args.get("check_no_overwrite_this", false).asBool();
+  // Only re-check the methods whose code changed since they were last
+  // checked. Changes to the class hierarchy alone go unnoticed, which is why
+  // the final check before output is a full one unless told otherwise.
+  bool incremental = type_checker_args.get("incremental", false).asBool();
+  bool full_final_check =
+      type_checker_args.get("full_final_check", true).asBool();
+  ConcurrentMap<const DexMethod*, size_t> type_checked_fingerprints;
   std::unordered_set<std::string> trigger_passes;
 
   for (auto& trigger_pass : type_checker_args["run_after_passes"]) {
     trigger_passes.insert(trigger_pass.asString());
   }
 
+  // CFG-aware passes leave the CFGs they build in place. Unless they are kept
+  // for the next CFG-aware pass, they are linearized right after the pass.
+  bool keep_cfg_across_passes =
+      conf.get_json_config().get("keep_cfg_across_passes", false);
+  bool cfgs_built = false;
+  auto clear_cfgs = [&]() {
+    if (!cfgs_built) {
+      return;
+    }
+    Timer t("Linearizing CFGs");
+    walk::parallel::methods(get_class_scope(stores), [](DexMethod* method) {
+      // Deferred and compact code has no CFG, and looking at it would
+      // balloon or expand it.
+      if (method->is_balloon_deferred() || method->is_code_compact()) {
+        return;
+      }
+      auto code = method->get_code();
+      if (code != nullptr) {
+        code->clear_cfg();
+      }
+    });
+    cfgs_built = false;
+  };
+
+  // The code of methods that no pass has asked for in this many passes is
+  // made compact until a pass asks for it again. Zero turns this off.
+  size_t compact_code_after = 0;
+  conf.get_json_config().get("compact_code_after_passes", 0,
+                             compact_code_after);
+  // RemoveUnreachablePass reuses what it gathered from code that no pass has
+  // asked for since its previous run, which the code epochs tell too.
+  bool incremental_reachability =
+      conf.get_json_config().get("incremental_reachability", false);
+  auto start_code_epoch = [&](size_t pass_order) {
+    if (compact_code_after > 0 || incremental_reachability) {
+      RedexContext::set_code_epoch(pass_order + 1);
+    }
+  };
+  auto compact_cold_code = [&](size_t pass_order) {
+    if (compact_code_after == 0) {
+      return;
+    }
+    // What runs between passes doesn't count as asking for the code.
+    RedexContext::set_code_epoch(0);
+    Timer t("Compacting cold code");
+    std::atomic<size_t> compacted{0};
+    walk::parallel::methods(get_class_scope(stores), [&](DexMethod* method) {
+      if (method->get_code_epoch() + compact_code_after <= pass_order + 1 &&
+          method->compact_code()) {
+        ++compacted;
+      }
+    });
+    TRACE(PM, 1, "Compacted the code of %lu methods\n", compacted.load());
+  };
+
+  // Neighbouring passes that declare they don't write what the others read
+  // or write run at the same time, unless something has to happen right
+  // after one of them.
+  bool parallel_passes = conf.get_json_config().get("parallel_passes", false);
+#ifdef NDEBUG
+  bool check_effects_by_default = false;
+#else
+  bool check_effects_by_default = true;
+#endif
+  bool check_effects = conf.get_json_config().get("check_pass_effects",
+                                                  check_effects_by_default);
+  auto can_run_concurrently = [&](const Pass* pass) {
+    return parallel_passes && !profile_passes && !account_memory &&
+           slowest_methods_per_pass == 0 &&
+           !run_after_each_pass && trigger_passes.count(pass->name()) == 0 &&
+           !pass->is_cfg_aware() &&
+           !(m_profiler_info && m_profiler_info->pass == pass) &&
+           m_malloc_profile_pass != pass && m_sampled_passes.count(pass) == 0;
+  };
+
   for (size_t i = 0; i < m_activated_passes.size(); ++i) {
     Pass* pass = m_activated_passes[i];
+    size_t group_end = i + 1;
+    if (can_run_concurrently(pass)) {
+      while (group_end < m_activated_passes.size() &&
+             can_run_concurrently(m_activated_passes[group_end]) &&
+             std::all_of(m_activated_passes.begin() + i,
+                         m_activated_passes.begin() + group_end,
+                         [&](const Pass* other) {
+                           return independent(
+                               other, m_activated_passes[group_end]);
+                         })) {
+        ++group_end;
+      }
+    }
+    if (group_end > i + 1) {
+      clear_cfgs();
+      std::string names;
+      uint32_t writes = Pass::NOTHING;
+      for (size_t j = i; j < group_end; ++j) {
+        names += (j == i ? "" : " + ") + m_activated_passes[j]->name();
+        writes |= m_activated_passes[j]->writes();
+      }
+      auto effects =
+          check_effects ? snapshot_effects(stores, names, writes) : nullptr;
+      start_code_epoch(group_end - 1);
+      run_passes_concurrently(i, group_end, stores, conf);
+      RedexContext::set_code_epoch(0);
+      mark_stores_changed(stores);
+      if (effects) {
+        verify_effects(stores, *effects);
+      }
+      compact_cold_code(group_end - 1);
+      release_memory_after(m_pass_info[group_end - 1]);
+      i = group_end - 1;
+      continue;
+    }
+
     TRACE(PM, 1, "Running %s...\n", pass->name().c_str());
+    if (!pass->is_cfg_aware()) {
+      clear_cfgs();
+    }
+    auto effects = check_effects
+                       ? snapshot_effects(stores, pass->name(), pass->writes())
+                       : nullptr;
     Timer t(pass->name() + " (run)");
     m_current_pass_info = &m_pass_info[i];
 
+    ConcurrentMap<const DexMethod*, size_t> fingerprints_before;
+    if (profile_passes) {
+      record_fingerprints(get_class_scope(stores), &fingerprints_before);
+    }
     {
+      ScopedPhaseProfile phase_prof(
+          profile_passes ? &m_pass_info[i].run_profile : nullptr);
       ScopedCommandProfiling cmd_prof(
           m_profiler_info && m_profiler_info->pass == pass
               ? boost::make_optional(m_profiler_info->command)
               : boost::none);
       jemalloc_util::ScopedProfiling malloc_prof(m_malloc_profile_pass == pass);
+      sampling_profiler::ScopedSampling sampling(
+          m_sampled_passes.count(pass)
+              ? boost::make_optional(
+                    conf.metafile(m_pass_info[i].name + ".folded"))
+              : boost::none,
+          m_sample_hz);
+      event_trace::Span span("pass", m_pass_info[i].name);
+      start_code_epoch(i);
+      concurrency_stats::reset();
+      if (slowest_methods_per_pass > 0) {
+        // Drop what was timed outside of the passes.
+        method_costs::take_report(0);
+      }
       pass->run_pass(stores, conf, *this);
+      if (slowest_methods_per_pass > 0) {
+        m_pass_info[i].slowest_methods =
+            method_costs::take_report(slowest_methods_per_pass);
+      }
+      flush_registered_metrics(&m_pass_info[i]);
+      RedexContext::set_code_epoch(0);
+      // Empty unless built with REDEX_CONCURRENCY_STATS.
+      for (const auto& pair : concurrency_stats::take_report()) {
+        set_metric("concurrency." + pair.first, pair.second);
+      }
+    }
+    mark_stores_changed(stores);
+    if (effects) {
+      verify_effects(stores, *effects);
+    }
+    // Passes may edit member lists in place through the non-const getters,
+    // which doesn't invalidate memoized resolutions by itself.
+    g_redex->invalidate_resolutions();
+    if (!pass->is_call_graph_aware()) {
+      m_call_graph_cache->invalidate();
     }
+    if (pass->is_cfg_aware()) {
+      cfgs_built = true;
+      if (!keep_cfg_across_passes) {
+        clear_cfgs();
+      }
+    }
+    if (profile_passes) {
+      m_pass_info[i].run_profile.methods_touched =
+          count_changed_methods(get_class_scope(stores), fingerprints_before);
+    }
+    if (account_memory) {
+      m_pass_info[i].memory_after = memory_accounting::take_report();
+    }
+    release_memory_after(m_pass_info[i]);
 
     if (run_after_each_pass || trigger_passes.count(pass->name()) > 0) {
-      scope = build_class_scope(it);
       // It's OK to overwrite the `this` register if we are not yet at the
       // output phase -- the register allocator can fix it up later.
-      run_type_checker(scope, verify_moves,
-                       /* check_no_overwrite_this */ false);
+      run_type_checker(get_class_scope(stores), verify_moves,
+                       /* check_no_overwrite_this */ false,
+                       incremental ? &type_checked_fingerprints : nullptr);
     }
+    compact_cold_code(i);
     m_current_pass_info = nullptr;
   }
 
+  clear_cfgs();
+
   // Always run the type checker before generating the optimized dex code.
-  scope = build_class_scope(it);
-  run_type_checker(scope, verify_moves,
-                   get_redex_options().no_overwrite_this());
+  // The checks after each pass never look at check_no_overwrite_this, so a
+  // skipped method may still fail it.
+  bool final_incremental = incremental && !full_final_check &&
+                           !get_redex_options().no_overwrite_this();
+  run_type_checker(get_class_scope(stores), verify_moves,
+                   get_redex_options().no_overwrite_this(),
+                   final_incremental ? &type_checked_fingerprints : nullptr);
+
+  if (profile_passes) {
+    write_pass_profile(conf.metafile(pass_profile_output), m_pass_info);
+  }
 
   if (!conf.get_printseeds().empty()) {
     Timer t("Writing outgoing classes to file " + conf.get_printseeds() +
             ".outgoing");
-    // Recompute the scope.
-    scope = build_class_scope(it);
     std::ofstream outgoing(conf.get_printseeds() + ".outgoing");
-    redex::print_classes(outgoing, conf.get_proguard_map(), scope);
+    redex::print_classes(outgoing, conf.get_proguard_map(),
+                         get_class_scope(stores));
   }
 }
 
+void PassManager::run_passes_concurrently(size_t begin,
+                                          size_t end,
+                                          DexStoresVector& stores,
+                                          ConfigFiles& conf) {
+  std::string names;
+  for (size_t i = begin; i < end; ++i) {
+    names += (i == begin ? "" : " + ") + m_activated_passes[i]->name();
+  }
+  TRACE(PM, 1, "Running %s at the same time...\n", names.c_str());
+  Timer t(names + " (run)");
+
+  // Load what ConfigFiles loads lazily up front, so that the passes don't
+  // race to do it.
+  conf.get_coldstart_classes();
+  conf.get_coldstart_methods();
+  conf.ensure_class_lists_loaded();
+  conf.get_inliner_config();
+
+  std::vector<std::exception_ptr> errors(end - begin);
+  std::vector<boost::thread> threads;
+  for (size_t i = begin; i < end; ++i) {
+    boost::thread::attributes attrs;
+    attrs.set_stack_size(8 * 1024 * 1024);
+    threads.emplace_back(attrs, [&, i] {
+      t_current_pass_info = &m_pass_info[i];
+      event_trace::Span span("pass", m_pass_info[i].name);
+      try {
+        m_activated_passes[i]->run_pass(stores, conf, *this);
+        flush_registered_metrics(&m_pass_info[i]);
+      } catch (...) {
+        errors[i - begin] = std::current_exception();
+      }
+      t_current_pass_info = nullptr;
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  g_redex->invalidate_resolutions();
+  for (size_t i = begin; i < end; ++i) {
+    if (!m_activated_passes[i]->is_call_graph_aware()) {
+      m_call_graph_cache->invalidate();
+      break;
+    }
+  }
+}
+
+boost::optional<uint64_t> PassManager::release_memory() {
+  auto resident_before = jemalloc_util::get_resident_bytes();
+  if (!resident_before) {
+    return boost::none;
+  }
+  Timer t("Releasing memory");
+  jemalloc_util::flush_thread_cache();
+  // When the pool is busy, e.g. with the work of a pass that runs at the
+  // same time, its threads keep their caches.
+  workqueue_impl::ThreadPool::get().try_run_on_each_thread(
+      [] { jemalloc_util::flush_thread_cache(); });
+  jemalloc_util::purge_arenas();
+  auto resident_after = jemalloc_util::get_resident_bytes();
+  return *resident_before > *resident_after ? *resident_before - *resident_after
+                                            : 0;
+}
+
 void PassManager::activate_pass(const char* name, const Json::Value& conf) {
   std::string name_str(name);
 
@@ -272,18 +847,65 @@ Pass* PassManager::find_pass(const std::string& pass_name) const {
   return pass_it != m_activated_passes.end() ? *pass_it : nullptr;
 }
 
+PassManager::PassInfo* PassManager::current_pass_info() const {
+  return t_current_pass_info != nullptr ? t_current_pass_info
+                                        : m_current_pass_info;
+}
+
+const PassManager::PassInfo* PassManager::get_current_pass_info() const {
+  return current_pass_info();
+}
+
 void PassManager::incr_metric(const std::string& key, int value) {
-  always_assert_log(m_current_pass_info != nullptr, "No current pass!");
-  (m_current_pass_info->metrics)[key] += value;
+  auto pass_info = current_pass_info();
+  always_assert_log(pass_info != nullptr, "No current pass!");
+  (pass_info->metrics)[key] += value;
 }
 
 void PassManager::set_metric(const std::string& key, int value) {
-  always_assert_log(m_current_pass_info != nullptr, "No current pass!");
-  (m_current_pass_info->metrics)[key] = value;
+  auto pass_info = current_pass_info();
+  always_assert_log(pass_info != nullptr, "No current pass!");
+  (pass_info->metrics)[key] = value;
 }
 
 int PassManager::get_metric(const std::string& key) {
-  return (m_current_pass_info->metrics)[key];
+  auto pass_info = current_pass_info();
+  int value = (pass_info->metrics)[key];
+  for (const auto& counter : pass_info->registered_metrics) {
+    if (counter->key == key) {
+      value += counter->sum();
+    }
+  }
+  return value;
+}
+
+PassManager::Metric PassManager::register_metric(const std::string& key) {
+  auto pass_info = current_pass_info();
+  always_assert_log(pass_info != nullptr, "No current pass!");
+  auto counter = std::make_unique<MetricCounter>();
+  counter->key = key;
+  pass_info->registered_metrics.push_back(std::move(counter));
+  return Metric(pass_info->registered_metrics.back().get());
+}
+
+void PassManager::flush_registered_metrics(PassInfo* pass_info) {
+  for (const auto& counter : pass_info->registered_metrics) {
+    (pass_info->metrics)[counter->key] += counter->sum();
+  }
+  pass_info->registered_metrics.clear();
+}
+
+int64_t PassManager::MetricCounter::sum() const {
+  int64_t total = 0;
+  for (const auto& shard : shards) {
+    total += shard.value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void PassManager::Metric::incr(int64_t value) const {
+  m_counter->shards[metric_shard()].value.fetch_add(value,
+                                                   std::memory_order_relaxed);
 }
 
 const std::vector<PassManager::PassInfo>& PassManager::get_pass_info() const {
@@ -8,17 +8,33 @@
 #pragma once
 
 #include "ApkManager.h"
+#include "ConcurrentContainers.h"
+#include "MemoryAccounting.h"
+#include "MethodCosts.h"
 #include "Pass.h"
+#include "PassProfile.h"
 #include "ProguardConfiguration.h"
 #include "RedexOptions.h"
 
+#include <array>
+#include <atomic>
 #include <boost/optional.hpp>
 #include <json/json.h>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+namespace call_graph {
+class SingleCalleeGraphCache;
+} // namespace call_graph
+class SignatureMapCache;
+namespace method_override_graph {
+class GraphCache;
+} // namespace method_override_graph
+
 class PassManager {
  public:
   PassManager(const std::vector<Pass*>& passes,
@@ -30,6 +46,42 @@ class PassManager {
               const Json::Value& config = Json::Value(Json::objectValue),
               const RedexOptions& options = RedexOptions{});
 
+  ~PassManager();
+
+  /*
+   * The storage of a registered metric: one counter per shard, each on a
+   * cache line of its own, so that threads counting into different shards
+   * don't contend.
+   */
+  static constexpr size_t kMetricShards = 32;
+  struct MetricCounter {
+    struct Shard {
+      std::atomic<int64_t> value{0};
+      char padding[64 - sizeof(std::atomic<int64_t>)];
+    };
+    std::string key;
+    std::array<Shard, kMetricShards> shards;
+
+    int64_t sum() const;
+  };
+
+  /*
+   * A metric of a pass that may be incremented from any thread, e.g. from
+   * inside walk::parallel, without a lock or an allocation: every thread
+   * counts into its own shard, and the shards are summed into the metrics of
+   * the pass when it ends. Get one from register_metric() before starting
+   * the parallel work; it is valid until the pass ends.
+   */
+  class Metric {
+   public:
+    void incr(int64_t value = 1) const;
+
+   private:
+    friend class PassManager;
+    explicit Metric(MetricCounter* counter) : m_counter(counter) {}
+    MetricCounter* m_counter;
+  };
+
   struct PassInfo {
     const Pass* pass;
     size_t order; // zero-based
@@ -37,13 +89,30 @@ class PassManager {
     size_t total_repeat;
     std::string name;
     std::unordered_map<std::string, int> metrics;
+    // Registered while the pass runs, and added to `metrics` when it ends.
+    std::vector<std::unique_ptr<MetricCounter>> registered_metrics;
     JsonWrapper config;
+    // Only filled in when "pass_profile_output" is configured.
+    PhaseProfile eval_profile;
+    PhaseProfile run_profile;
+    // Usage by IR entity type after the pass ran. Only filled in when
+    // "memory_accounting" is set.
+    boost::optional<memory_accounting::Report> memory_after;
+    // The methods that the pass spent the most time on. Only filled in when
+    // "slowest_methods_per_pass" is set.
+    method_costs::Report slowest_methods;
+    // Memory given back to the OS right after the pass, or after the group of
+    // passes it ran at the same time with and was the last of. Only filled
+    // in when "release_memory_after_passes" is set and we run on jemalloc.
+    boost::optional<uint64_t> released_bytes;
   };
 
   void run_passes(DexStoresVector&, ConfigFiles&);
   void incr_metric(const std::string& key, int value);
   void set_metric(const std::string& key, int value);
   int get_metric(const std::string& key);
+  // Not thread-safe itself: call it from the thread that runs the pass.
+  Metric register_metric(const std::string& key);
   const std::vector<PassManager::PassInfo>& get_pass_info() const;
   const RedexOptions& get_redex_options() const { return m_redex_options; }
 
@@ -59,7 +128,7 @@ class PassManager {
   // do not use ProGuard configuration keep rules.
   void set_testing_mode() { m_testing_mode = true; }
 
-  const PassInfo* get_current_pass_info() const { return m_current_pass_info; }
+  const PassInfo* get_current_pass_info() const;
 
   ApkManager& apk_manager() { return m_apk_mgr; }
 
@@ -67,16 +136,72 @@ class PassManager {
 
   bool regalloc_has_run() { return m_regalloc_has_run; }
 
+  /*
+   * The single-callee call graph, shared by the passes that need it. See
+   * Pass::is_call_graph_aware() for when it stays valid across passes.
+   */
+  call_graph::SingleCalleeGraphCache& call_graph_cache() {
+    return *m_call_graph_cache;
+  }
+
+  /*
+   * The virtual scopes' SignatureMap, shared by the passes that opt into it.
+   * It is rebuilt when the class hierarchy it was built from changes.
+   */
+  SignatureMapCache& signature_map_cache() { return *m_signature_map_cache; }
+
+  /*
+   * The method override graph, shared by the passes that opt into it in the
+   * same way.
+   */
+  method_override_graph::GraphCache& method_override_graph_cache() {
+    return *m_method_override_graph_cache;
+  }
+
+  /*
+   * Gives the memory that has been freed, but that the allocator still holds
+   * on to, back to the OS: the caches of this thread and of the worker
+   * threads are flushed and the free pages purged. A pass that frees a lot
+   * of transient state halfway through may call this itself. Returns the
+   * drop in resident bytes, or boost::none if we don't run on jemalloc.
+   */
+  static boost::optional<uint64_t> release_memory();
+
  private:
   void activate_pass(const char* name, const Json::Value& cfg);
 
   Pass* find_pass(const std::string& pass_name) const;
 
+  /*
+   * The pass that the calling thread runs: passes that run at the same time
+   * each have their own.
+   */
+  PassInfo* current_pass_info() const;
+
+  // Adds the registered metrics of the pass to its metrics.
+  static void flush_registered_metrics(PassInfo* pass_info);
+
+  /*
+   * Runs the passes in [begin, end) of m_activated_passes at the same time,
+   * each on a thread of its own. See Pass::reads() for when that's allowed.
+   */
+  void run_passes_concurrently(size_t begin,
+                               size_t end,
+                               DexStoresVector& stores,
+                               ConfigFiles& conf);
+
   void init(const Json::Value& config);
 
-  static void run_type_checker(const Scope& scope,
-                               bool verify_moves,
-                               bool check_no_overwrite_this);
+  /*
+   * If `fingerprints` is non-null, methods whose fingerprint matches the one
+   * recorded there by a previous check are skipped, and the fingerprints of
+   * checked methods are recorded.
+   */
+  static void run_type_checker(
+      const Scope& scope,
+      bool verify_moves,
+      bool check_no_overwrite_this,
+      ConcurrentMap<const DexMethod*, size_t>* fingerprints = nullptr);
 
   ApkManager m_apk_mgr;
   std::vector<Pass*> m_registered_passes;
@@ -90,6 +215,10 @@ class PassManager {
   const RedexOptions m_redex_options;
   bool m_testing_mode{false};
   bool m_regalloc_has_run{false};
+  std::unique_ptr<call_graph::SingleCalleeGraphCache> m_call_graph_cache;
+  std::unique_ptr<SignatureMapCache> m_signature_map_cache;
+  std::unique_ptr<method_override_graph::GraphCache>
+      m_method_override_graph_cache;
 
   struct ProfilerInfo {
     std::string command;
@@ -100,4 +229,6 @@ class PassManager {
 
   boost::optional<ProfilerInfo> m_profiler_info;
   Pass* m_malloc_profile_pass{nullptr};
+  std::unordered_set<const Pass*> m_sampled_passes;
+  unsigned int m_sample_hz{997};
 };
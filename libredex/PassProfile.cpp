@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PassProfile.h"
+
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+
+#include "JemallocUtil.h"
+
+namespace {
+
+double to_seconds(const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+void get_cpu_times(double* user_s, double* sys_s) {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  *user_s = to_seconds(usage.ru_utime);
+  *sys_s = to_seconds(usage.ru_stime);
+}
+
+/*
+ * Reads a "<field>: <n> kB" line from /proc/self/status. Returns 0 if it isn't
+ * there, e.g. when not on Linux.
+ */
+uint64_t read_proc_status_bytes(const std::string& field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size(), field) == 0 &&
+        line.size() > field.size() && line[field.size()] == ':') {
+      return std::stoull(line.substr(field.size() + 1)) * 1024;
+    }
+  }
+  return 0;
+}
+
+bool reset_peak_rss() {
+  // Writing "5" resets the VmHWM counter (Linux 4.0+).
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  return clear_refs.good();
+}
+
+uint64_t get_peak_rss_bytes() {
+  uint64_t hwm = read_proc_status_bytes("VmHWM");
+  if (hwm != 0) {
+    return hwm;
+  }
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+} // namespace
+
+Json::Value PhaseProfile::to_json() const {
+  Json::Value result;
+  result["wall_s"] = wall_s;
+  result["user_s"] = user_s;
+  result["sys_s"] = sys_s;
+  result["peak_rss_bytes"] = Json::UInt64(peak_rss_bytes);
+  result["end_rss_bytes"] = Json::UInt64(end_rss_bytes);
+  if (jemalloc_allocated_bytes) {
+    result["jemalloc_allocated_bytes"] =
+        Json::UInt64(*jemalloc_allocated_bytes);
+  }
+  if (methods_touched) {
+    result["methods_touched"] = Json::UInt64(*methods_touched);
+  }
+  return result;
+}
+
+ScopedPhaseProfile::ScopedPhaseProfile(PhaseProfile* profile)
+    : m_profile(profile) {
+  if (m_profile == nullptr) {
+    return;
+  }
+  reset_peak_rss();
+  get_cpu_times(&m_start_user_s, &m_start_sys_s);
+  m_start = std::chrono::steady_clock::now();
+}
+
+ScopedPhaseProfile::~ScopedPhaseProfile() {
+  if (m_profile == nullptr) {
+    return;
+  }
+  auto end = std::chrono::steady_clock::now();
+  double user_s, sys_s;
+  get_cpu_times(&user_s, &sys_s);
+  m_profile->wall_s = std::chrono::duration<double>(end - m_start).count();
+  m_profile->user_s = user_s - m_start_user_s;
+  m_profile->sys_s = sys_s - m_start_sys_s;
+  m_profile->peak_rss_bytes = get_peak_rss_bytes();
+  m_profile->end_rss_bytes = read_proc_status_bytes("VmRSS");
+  m_profile->jemalloc_allocated_bytes = jemalloc_util::get_allocated_bytes();
+}
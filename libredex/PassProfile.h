@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstdint>
+#include <json/json.h>
+
+/*
+ * Resource usage of one phase (eval or run) of a pass, for the structured
+ * profile that PassManager writes when "pass_profile_output" is set.
+ */
+struct PhaseProfile {
+  double wall_s{0};
+  // Summed over all threads; (user_s + sys_s) / wall_s is the effective
+  // parallelism of the phase.
+  double user_s{0};
+  double sys_s{0};
+  // High-water mark of the resident set since the phase started, where the
+  // kernel lets us reset it (Linux's /proc/self/clear_refs). Otherwise, the
+  // high-water mark of the whole process so far.
+  uint64_t peak_rss_bytes{0};
+  uint64_t end_rss_bytes{0};
+  // Only available when running on jemalloc.
+  boost::optional<uint64_t> jemalloc_allocated_bytes;
+  // Number of methods whose code differs after the phase. Only computed for
+  // the run phase.
+  boost::optional<size_t> methods_touched;
+
+  Json::Value to_json() const;
+};
+
+/*
+ * Fills in everything in a PhaseProfile but methods_touched over its
+ * lifetime. Does nothing if `profile` is null.
+ */
+class ScopedPhaseProfile final {
+ public:
+  explicit ScopedPhaseProfile(PhaseProfile* profile);
+  ~ScopedPhaseProfile();
+
+ private:
+  PhaseProfile* m_profile;
+  std::chrono::steady_clock::time_point m_start;
+  double m_start_user_s{0};
+  double m_start_sys_s{0};
+};
@@ -92,8 +92,9 @@
  * code.
  */
 
-// Forward declaration.
+// Forward declarations.
 class PointsToSemantics;
+class PointsToSolver;
 
 /*
  * A points-to variable denotes a set of abstract object instances. It is
@@ -132,6 +133,7 @@ class PointsToVariable final {
   int32_t m_id;
 
   friend class PointsToMethodSemantics;
+  friend class PointsToSolver;
   friend size_t hash_value(const PointsToVariable&);
   friend bool operator==(const PointsToVariable&, const PointsToVariable&);
   friend bool operator<(const PointsToVariable&, const PointsToVariable&);
@@ -0,0 +1,1071 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointsToSolver.h"
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "DexUtil.h"
+#include "MethodOverrideGraph.h"
+#include "ReachableClasses.h"
+#include "Resolver.h"
+#include "Trace.h"
+#include "WorkQueue.h"
+
+namespace {
+
+using NodeId = uint32_t;
+using ObjectId = PointsToSolver::ObjectId;
+using ObjectSet = PointsToSolver::ObjectSet;
+
+constexpr NodeId kNoNode = std::numeric_limits<NodeId>::max();
+
+// The owner of the nodes that don't belong to a single method.
+constexpr uint32_t kGlobal = std::numeric_limits<uint32_t>::max();
+
+/*
+ * Whether an object of type `type` may pass a cast to `cast_type`. Only false
+ * when all the supertypes of `type` are known and none of them is
+ * `cast_type`.
+ */
+bool may_cast(const DexType* type, const DexType* cast_type) {
+  if (type == cast_type) {
+    return true;
+  }
+  if (type == get_object_type()) {
+    return false;
+  }
+  const DexClass* cls = type_class(type);
+  if (cls == nullptr) {
+    return true;
+  }
+  if (cls->get_super_class() != nullptr &&
+      may_cast(cls->get_super_class(), cast_type)) {
+    return true;
+  }
+  for (const DexType* intf : cls->get_interfaces()->get_type_list()) {
+    if (may_cast(intf, cast_type)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Whether a supertype of `type` that is outside of the scope, or that we
+ * know nothing about, may declare a virtual method `name` of type `proto`.
+ */
+bool declared_outside(const DexType* type,
+                      const DexString* name,
+                      const DexProto* proto) {
+  const DexClass* cls = type_class(type);
+  if (type == get_object_type()) {
+    // Whether or not the SDK is loaded, these are the methods of
+    // java.lang.Object that can be overridden.
+    const auto& str = name->str();
+    return str == "clone" || str == "equals" || str == "finalize" ||
+           str == "hashCode" || str == "toString";
+  }
+  if (cls == nullptr) {
+    return true;
+  }
+  if (cls->is_external()) {
+    for (const DexMethod* method : cls->get_vmethods()) {
+      if (method->get_name() == name && method->get_proto() == proto) {
+        return true;
+      }
+    }
+  }
+  if (cls->get_super_class() != nullptr &&
+      declared_outside(cls->get_super_class(), name, proto)) {
+    return true;
+  }
+  for (const DexType* intf : cls->get_interfaces()->get_type_list()) {
+    if (declared_outside(intf, name, proto)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+class PointsToSolver::Impl {
+ public:
+  Impl(const Scope& scope,
+       PointsToSemantics& semantics,
+       const std::unordered_set<const DexMethodRef*>& entry_points);
+
+  ObjectSet get_points_to_set(const DexMethodRef* method,
+                              PointsToVariable v) const;
+
+  const Object& get_object(ObjectId id) const { return m_objects.at(id); }
+
+  boost::optional<std::unordered_set<const DexMethod*>> get_callees(
+      const DexMethodRef* caller, const DexMethodRef* callee) const;
+
+  bool may_escape(ObjectId id) const { return m_escapes.at(id); }
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  struct Method {
+    const PointsToMethodSemantics* semantics;
+    NodeId first_variable;
+    size_t num_variables;
+    NodeId this_node;
+    NodeId return_node;
+    NodeId first_param;
+    size_t num_params;
+    // The indices of the calls it makes in m_calls.
+    std::vector<uint32_t> calls;
+  };
+
+  enum ConstraintKind { LOAD, STORE, CAST, GET_CLASS, CALL };
+
+  /*
+   * What is done with each new object `o` of the node that the constraint is
+   * attached to: for a load, o.field flows into `node`; for a store, `node`
+   * flows into o.field; a cast passes o on to `node` if it may be of `type`;
+   * getClass() puts the class object in `node`; a call dispatches on o.
+   */
+  struct Constraint {
+    ConstraintKind kind;
+    NodeId node;
+    // nullptr stands for the elements of an array.
+    const DexFieldRef* field;
+    const DexType* type;
+    uint32_t call;
+  };
+
+  struct Call {
+    PointsToOperationKind kind;
+    DexMethodRef* callee;
+    NodeId instance;
+    std::vector<std::pair<size_t, NodeId>> args;
+    NodeId dest;
+    // The methods it has been bound to so far.
+    std::unordered_set<const DexMethodRef*> targets;
+    // Whether it may reach a method that we can't name.
+    bool open{false};
+  };
+
+  struct Node {
+    ObjectSet pts;
+    // What has been sent along the copy edges, and what the constraints have
+    // seen, so that each round only deals with what is new.
+    ObjectSet propagated;
+    ObjectSet processed;
+    std::vector<NodeId> succs;
+    std::vector<Constraint> constraints;
+    uint32_t owner;
+  };
+
+  // What the constraints of a node ask for. These are applied in between
+  // rounds, since they create nodes and edges.
+  struct Requests {
+    std::vector<std::tuple<ObjectId, const DexFieldRef*, NodeId>> loads;
+    std::vector<std::tuple<NodeId, ObjectId, const DexFieldRef*>> stores;
+    std::vector<std::pair<NodeId, ObjectId>> objects;
+    // The call, the method it dispatches to and whether the call is open.
+    std::vector<std::tuple<uint32_t, const DexMethodRef*, bool>> targets;
+  };
+
+  NodeId new_node(uint32_t owner);
+
+  ObjectId new_object(ObjectKind kind,
+                      const DexType* type,
+                      const DexMethodRef* method,
+                      uint32_t owner);
+
+  ObjectId opaque_object(const DexType* type);
+
+  NodeId find(NodeId node);
+
+  NodeId find(NodeId node) const;
+
+  NodeId variable_node(const Method& method, PointsToVariable v) const;
+
+  NodeId static_field_node(DexFieldRef* field);
+
+  NodeId field_node(ObjectId object, const DexFieldRef* field);
+
+  bool add_edge(NodeId from, NodeId to);
+
+  bool add_object(NodeId node, ObjectId object);
+
+  void add_constraint(NodeId node, const Constraint& constraint);
+
+  void add_method(const PointsToMethodSemantics* semantics);
+
+  void generate_constraints(uint32_t method_id);
+
+  void add_entry_point(const Method& method);
+
+  void bind(uint32_t call_id, const DexMethodRef* target, bool open);
+
+  void solve();
+
+  std::vector<NodeId> collapse_cycles();
+
+  void merge(const std::vector<NodeId>& component, NodeId rep);
+
+  void propagate(const std::vector<NodeId>& order);
+
+  bool process_constraints();
+
+  void process(NodeId node, Requests* requests);
+
+  void dispatch(uint32_t call_id, ObjectId object, Requests* requests) const;
+
+  void compute_escapes();
+
+  std::vector<Method> m_methods;
+  std::unordered_map<const DexMethodRef*, uint32_t> m_method_ids;
+  std::vector<Call> m_calls;
+
+  std::vector<Node> m_nodes;
+  // Union-find over the nodes: a collapsed cycle is represented by one of
+  // its nodes.
+  std::vector<NodeId> m_parent;
+  // The copy edges between representatives, to add each one only once.
+  std::unordered_set<uint64_t> m_edges;
+  // Everything that flows into this node leaves the program.
+  NodeId m_external_node;
+  std::unordered_map<const DexFieldRef*, NodeId> m_static_field_nodes;
+  std::unordered_map<std::pair<ObjectId, const DexFieldRef*>,
+                     NodeId,
+                     boost::hash<std::pair<ObjectId, const DexFieldRef*>>>
+      m_field_nodes;
+
+  std::vector<Object> m_objects;
+  // The method that allocates each object, or kGlobal.
+  std::vector<uint32_t> m_object_owners;
+  // The nodes of the fields of each object.
+  std::vector<std::vector<NodeId>> m_object_fields;
+  std::unordered_map<const DexType*, ObjectId> m_opaque_objects;
+  ObjectId m_string_object;
+  ObjectId m_class_object;
+  std::vector<bool> m_escapes;
+
+  std::unique_ptr<const method_override_graph::Graph> m_override_graph;
+  Stats m_stats;
+};
+
+PointsToSolver::Impl::Impl(
+    const Scope& scope,
+    PointsToSemantics& semantics,
+    const std::unordered_set<const DexMethodRef*>& entry_points)
+    : m_override_graph(method_override_graph::build_graph(scope)) {
+  m_external_node = new_node(kGlobal);
+  m_string_object =
+      new_object(PTS_STRING, get_string_type(), nullptr, kGlobal);
+  m_class_object = new_object(PTS_CLASS, get_class_type(), nullptr, kGlobal);
+
+  // The methods are numbered in a fixed order, so that the nodes and objects
+  // are the same from one run to the next.
+  std::vector<const PointsToMethodSemantics*> all_semantics;
+  for (const auto& entry : semantics) {
+    all_semantics.push_back(&entry.second);
+  }
+  std::sort(all_semantics.begin(), all_semantics.end(),
+            [](const PointsToMethodSemantics* a,
+               const PointsToMethodSemantics* b) {
+              return compare_dexmethods(a->get_method(), b->get_method());
+            });
+  for (const auto* method_semantics : all_semantics) {
+    add_method(method_semantics);
+  }
+  for (uint32_t i = 0; i < m_methods.size(); ++i) {
+    generate_constraints(i);
+  }
+  for (const DexMethodRef* method : entry_points) {
+    auto it = m_method_ids.find(method);
+    if (it != m_method_ids.end()) {
+      add_entry_point(m_methods[it->second]);
+    }
+  }
+
+  solve();
+  compute_escapes();
+
+  m_stats.methods = m_methods.size();
+  m_stats.nodes = m_nodes.size();
+  m_stats.objects = m_objects.size();
+  TRACE(PTA, 1,
+        "Solved the points-to equations of %lu methods in %lu rounds: %lu "
+        "nodes (%lu collapsed), %lu objects, %lu call edges\n",
+        m_stats.methods, m_stats.rounds, m_stats.nodes,
+        m_stats.collapsed_nodes, m_stats.objects, m_stats.call_edges);
+}
+
+NodeId PointsToSolver::Impl::new_node(uint32_t owner) {
+  NodeId id = m_nodes.size();
+  m_nodes.emplace_back();
+  m_nodes.back().owner = owner;
+  m_parent.push_back(id);
+  return id;
+}
+
+ObjectId PointsToSolver::Impl::new_object(ObjectKind kind,
+                                          const DexType* type,
+                                          const DexMethodRef* method,
+                                          uint32_t owner) {
+  ObjectId id = m_objects.size();
+  m_objects.push_back(Object{kind, type, method});
+  m_object_owners.push_back(owner);
+  m_object_fields.emplace_back();
+  return id;
+}
+
+ObjectId PointsToSolver::Impl::opaque_object(const DexType* type) {
+  auto it = m_opaque_objects.find(type);
+  if (it != m_opaque_objects.end()) {
+    return it->second;
+  }
+  ObjectId id = new_object(PTS_OPAQUE, type, nullptr, kGlobal);
+  m_opaque_objects.emplace(type, id);
+  return id;
+}
+
+NodeId PointsToSolver::Impl::find(NodeId node) {
+  while (m_parent[node] != node) {
+    m_parent[node] = m_parent[m_parent[node]];
+    node = m_parent[node];
+  }
+  return node;
+}
+
+NodeId PointsToSolver::Impl::find(NodeId node) const {
+  while (m_parent[node] != node) {
+    node = m_parent[node];
+  }
+  return node;
+}
+
+NodeId PointsToSolver::Impl::variable_node(const Method& method,
+                                           PointsToVariable v) const {
+  if (v == PointsToVariable::null_variable()) {
+    return kNoNode;
+  }
+  if (v == PointsToVariable::this_variable()) {
+    return method.this_node;
+  }
+  size_t id = variable_id(v);
+  always_assert(id < method.num_variables);
+  return method.first_variable + id;
+}
+
+NodeId PointsToSolver::Impl::static_field_node(DexFieldRef* field) {
+  DexField* def = resolve_field(field, FieldSearch::Static);
+  const DexFieldRef* key = def != nullptr ? def : field;
+  auto it = m_static_field_nodes.find(key);
+  if (it != m_static_field_nodes.end()) {
+    return it->second;
+  }
+  NodeId node = new_node(kGlobal);
+  m_static_field_nodes.emplace(key, node);
+  // Code outside of the program may write to the fields it defines.
+  if ((def == nullptr || def->is_external()) && is_object(field->get_type())) {
+    add_object(node, opaque_object(field->get_type()));
+  }
+  return node;
+}
+
+NodeId PointsToSolver::Impl::field_node(ObjectId object,
+                                        const DexFieldRef* field) {
+  auto key = std::make_pair(object, field);
+  auto it = m_field_nodes.find(key);
+  if (it != m_field_nodes.end()) {
+    return it->second;
+  }
+  NodeId node = new_node(m_object_owners[object]);
+  m_field_nodes.emplace(key, node);
+  m_object_fields[object].push_back(node);
+  const Object& obj = m_objects[object];
+  if (obj.kind != PTS_ALLOCATION) {
+    // The fields of objects from outside of the program hold objects from
+    // outside of the program.
+    const DexType* type = field != nullptr ? field->get_type()
+                          : is_array(obj.type)
+                              ? get_array_component_type(obj.type)
+                              : get_object_type();
+    if (is_object(type)) {
+      add_object(node, opaque_object(type));
+    }
+  }
+  return node;
+}
+
+bool PointsToSolver::Impl::add_edge(NodeId from, NodeId to) {
+  if (from == kNoNode || to == kNoNode) {
+    return false;
+  }
+  from = find(from);
+  to = find(to);
+  if (from == to ||
+      !m_edges.insert(static_cast<uint64_t>(from) << 32 | to).second) {
+    return false;
+  }
+  m_nodes[from].succs.push_back(to);
+  // The target gets everything at once; the propagation only sends what is
+  // new from here on.
+  auto& to_node = m_nodes[to];
+  auto before = to_node.pts;
+  to_node.pts.union_with(m_nodes[from].pts);
+  return !to_node.pts.equals(before);
+}
+
+bool PointsToSolver::Impl::add_object(NodeId node, ObjectId object) {
+  if (node == kNoNode) {
+    return false;
+  }
+  auto& pts = m_nodes[find(node)].pts;
+  if (pts.contains(object)) {
+    return false;
+  }
+  pts.insert(object);
+  return true;
+}
+
+void PointsToSolver::Impl::add_constraint(NodeId node,
+                                          const Constraint& constraint) {
+  if (node != kNoNode) {
+    m_nodes[find(node)].constraints.push_back(constraint);
+  }
+}
+
+void PointsToSolver::Impl::add_method(
+    const PointsToMethodSemantics* semantics) {
+  int32_t max_id = -1;
+  auto see = [&max_id](PointsToVariable v) {
+    max_id = std::max(max_id, variable_id(v));
+  };
+  for (const auto& action : semantics->get_points_to_actions()) {
+    const auto& op = action.operation();
+    if (op.is_load()) {
+      see(action.dest());
+    } else if (op.is_get_class() || op.is_check_cast()) {
+      see(action.dest());
+      see(action.src());
+    } else if (op.is_get()) {
+      see(action.dest());
+      if (!op.is_sget()) {
+        see(action.instance());
+      }
+    } else if (op.is_put()) {
+      see(action.rhs());
+      if (!op.is_sput()) {
+        see(action.lhs());
+      }
+    } else if (op.is_invoke()) {
+      if (action.has_dest()) {
+        see(action.dest());
+      }
+      if (!op.is_static_call()) {
+        see(action.instance());
+      }
+      for (const auto& arg : action.get_arguments()) {
+        see(arg.second);
+      }
+    } else if (op.is_return()) {
+      see(action.src());
+    } else if (op.is_disjunction()) {
+      see(action.dest());
+      for (const auto& arg : action.get_arguments()) {
+        see(arg.second);
+      }
+    }
+  }
+
+  uint32_t id = m_methods.size();
+  Method method;
+  method.semantics = semantics;
+  method.num_variables = max_id + 1;
+  method.first_variable = m_nodes.size();
+  for (size_t i = 0; i < method.num_variables; ++i) {
+    new_node(id);
+  }
+  method.this_node = new_node(id);
+  method.return_node = new_node(id);
+  method.num_params = semantics->get_method()->get_proto()->get_args()->size();
+  method.first_param = m_nodes.size();
+  for (size_t i = 0; i < method.num_params; ++i) {
+    new_node(id);
+  }
+  m_methods.push_back(std::move(method));
+  m_method_ids.emplace(semantics->get_method(), id);
+}
+
+void PointsToSolver::Impl::generate_constraints(uint32_t method_id) {
+  const Method& method = m_methods[method_id];
+  auto node = [&](PointsToVariable v) { return variable_node(method, v); };
+  for (const auto& action : method.semantics->get_points_to_actions()) {
+    const auto& op = action.operation();
+    switch (op.kind) {
+    case PTS_CONST_STRING: {
+      add_object(node(action.dest()), m_string_object);
+      break;
+    }
+    case PTS_CONST_CLASS: {
+      add_object(node(action.dest()), m_class_object);
+      break;
+    }
+    case PTS_GET_EXCEPTION: {
+      add_object(node(action.dest()), opaque_object(get_throwable_type()));
+      break;
+    }
+    case PTS_NEW_OBJECT: {
+      add_object(node(action.dest()),
+                 new_object(PTS_ALLOCATION, op.dex_type,
+                            method.semantics->get_method(), method_id));
+      break;
+    }
+    case PTS_LOAD_PARAM: {
+      if (op.parameter < method.num_params) {
+        add_edge(method.first_param + op.parameter, node(action.dest()));
+      }
+      break;
+    }
+    case PTS_GET_CLASS: {
+      add_constraint(node(action.src()),
+                     {GET_CLASS, node(action.dest()), nullptr, nullptr, 0});
+      break;
+    }
+    case PTS_CHECK_CAST: {
+      add_constraint(node(action.src()),
+                     {CAST, node(action.dest()), nullptr, op.dex_type, 0});
+      break;
+    }
+    case PTS_IGET: {
+      DexField* def = resolve_field(op.dex_field, FieldSearch::Instance);
+      add_constraint(node(action.instance()),
+                     {LOAD, node(action.dest()),
+                      def != nullptr ? def : op.dex_field, nullptr, 0});
+      break;
+    }
+    case PTS_IGET_SPECIAL: {
+      add_constraint(node(action.instance()),
+                     {LOAD, node(action.dest()), nullptr, nullptr, 0});
+      break;
+    }
+    case PTS_SGET: {
+      add_edge(static_field_node(op.dex_field), node(action.dest()));
+      break;
+    }
+    case PTS_IPUT: {
+      DexField* def = resolve_field(op.dex_field, FieldSearch::Instance);
+      add_constraint(node(action.lhs()),
+                     {STORE, node(action.rhs()),
+                      def != nullptr ? def : op.dex_field, nullptr, 0});
+      break;
+    }
+    case PTS_IPUT_SPECIAL: {
+      add_constraint(node(action.lhs()),
+                     {STORE, node(action.rhs()), nullptr, nullptr, 0});
+      break;
+    }
+    case PTS_SPUT: {
+      add_edge(node(action.rhs()), static_field_node(op.dex_field));
+      break;
+    }
+    case PTS_INVOKE_VIRTUAL:
+    case PTS_INVOKE_SUPER:
+    case PTS_INVOKE_DIRECT:
+    case PTS_INVOKE_INTERFACE:
+    case PTS_INVOKE_STATIC: {
+      uint32_t call_id = m_calls.size();
+      m_calls.emplace_back();
+      Call& call = m_calls.back();
+      call.kind = op.kind;
+      call.callee = op.dex_method;
+      call.instance =
+          op.is_static_call() ? kNoNode : node(action.instance());
+      for (const auto& arg : action.get_arguments()) {
+        call.args.emplace_back(arg.first, node(arg.second));
+      }
+      call.dest = action.has_dest() ? node(action.dest()) : kNoNode;
+      m_methods[method_id].calls.push_back(call_id);
+      if (op.kind == PTS_INVOKE_VIRTUAL || op.kind == PTS_INVOKE_INTERFACE) {
+        add_constraint(call.instance, {CALL, kNoNode, nullptr, nullptr,
+                                       call_id});
+        break;
+      }
+      // The other calls have a single target, known from the start.
+      MethodSearch search = op.kind == PTS_INVOKE_STATIC
+                                ? MethodSearch::Static
+                                : op.kind == PTS_INVOKE_DIRECT
+                                      ? MethodSearch::Direct
+                                      : MethodSearch::Virtual;
+      DexMethod* target = resolve_method(op.dex_method, search);
+      if (target != nullptr) {
+        bind(call_id, target, /* open */ false);
+      } else {
+        bind(call_id, op.dex_method, /* open */ true);
+      }
+      break;
+    }
+    case PTS_RETURN: {
+      add_edge(node(action.src()), method.return_node);
+      break;
+    }
+    case PTS_DISJUNCTION: {
+      for (const auto& arg : action.get_arguments()) {
+        add_edge(node(arg.second), node(action.dest()));
+      }
+      break;
+    }
+    }
+  }
+}
+
+void PointsToSolver::Impl::add_entry_point(const Method& method) {
+  const DexMethodRef* ref = method.semantics->get_method();
+  if (ref->is_def() && !is_static(static_cast<const DexMethod*>(ref))) {
+    add_object(method.this_node, opaque_object(ref->get_class()));
+  }
+  const auto& args = ref->get_proto()->get_args()->get_type_list();
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (is_object(args[i])) {
+      add_object(method.first_param + i, opaque_object(args[i]));
+    }
+  }
+  add_edge(method.return_node, m_external_node);
+}
+
+void PointsToSolver::Impl::bind(uint32_t call_id,
+                                const DexMethodRef* target,
+                                bool open) {
+  Call& call = m_calls[call_id];
+  call.open |= open;
+  if (!call.targets.insert(target).second) {
+    return;
+  }
+  ++m_stats.call_edges;
+  auto it = m_method_ids.find(target);
+  const Method* callee = it != m_method_ids.end() ? &m_methods[it->second]
+                                                  : nullptr;
+  if (callee != nullptr && (callee->semantics->kind() == PTS_APK ||
+                            callee->semantics->kind() == PTS_STUB)) {
+    for (const auto& arg : call.args) {
+      if (arg.first < callee->num_params) {
+        add_edge(arg.second, callee->first_param + arg.first);
+      }
+    }
+    add_edge(call.instance, callee->this_node);
+    add_edge(callee->return_node, call.dest);
+    return;
+  }
+  // The code of the callee is outside of the program: whatever it is given
+  // leaves the program, and what it returns comes from outside.
+  for (const auto& arg : call.args) {
+    add_edge(arg.second, m_external_node);
+  }
+  add_edge(call.instance, m_external_node);
+  if (call.dest != kNoNode) {
+    add_object(call.dest,
+               opaque_object(call.callee->get_proto()->get_rtype()));
+  }
+}
+
+void PointsToSolver::Impl::solve() {
+  while (true) {
+    ++m_stats.rounds;
+    auto order = collapse_cycles();
+    propagate(order);
+    if (!process_constraints()) {
+      break;
+    }
+  }
+}
+
+/*
+ * Collapses the cycles of copy edges with Tarjan's algorithm, and returns
+ * the representatives in topological order.
+ */
+std::vector<NodeId> PointsToSolver::Impl::collapse_cycles() {
+  for (NodeId v = 0; v < m_nodes.size(); ++v) {
+    if (m_parent[v] != v) {
+      continue;
+    }
+    auto& succs = m_nodes[v].succs;
+    for (auto& w : succs) {
+      w = find(w);
+    }
+    std::sort(succs.begin(), succs.end());
+    succs.erase(std::unique(succs.begin(), succs.end()), succs.end());
+    succs.erase(std::remove(succs.begin(), succs.end(), v), succs.end());
+  }
+
+  constexpr uint32_t kUnvisited = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> index(m_nodes.size(), kUnvisited);
+  std::vector<uint32_t> lowlink(m_nodes.size(), 0);
+  std::vector<bool> on_stack(m_nodes.size(), false);
+  std::vector<NodeId> stack;
+  // The nodes being visited, with the next of their successors to look at.
+  std::vector<std::pair<NodeId, size_t>> visits;
+  std::vector<NodeId> order;
+  uint32_t next_index = 0;
+  auto visit = [&](NodeId v) {
+    index[v] = lowlink[v] = next_index++;
+    stack.push_back(v);
+    on_stack[v] = true;
+    visits.emplace_back(v, 0);
+  };
+  for (NodeId root = 0; root < m_nodes.size(); ++root) {
+    if (m_parent[root] != root || index[root] != kUnvisited) {
+      continue;
+    }
+    visit(root);
+    while (!visits.empty()) {
+      NodeId v = visits.back().first;
+      size_t i = visits.back().second;
+      const auto& succs = m_nodes[v].succs;
+      if (i < succs.size()) {
+        ++visits.back().second;
+        NodeId w = succs[i];
+        if (index[w] == kUnvisited) {
+          visit(w);
+        } else if (on_stack[w]) {
+          lowlink[v] = std::min(lowlink[v], index[w]);
+        }
+        continue;
+      }
+      visits.pop_back();
+      if (!visits.empty()) {
+        NodeId u = visits.back().first;
+        lowlink[u] = std::min(lowlink[u], lowlink[v]);
+      }
+      if (lowlink[v] == index[v]) {
+        std::vector<NodeId> component;
+        NodeId w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          on_stack[w] = false;
+          component.push_back(w);
+        } while (w != v);
+        if (component.size() > 1) {
+          merge(component, v);
+        }
+        order.push_back(v);
+      }
+    }
+  }
+  // Tarjan's algorithm finds the components in reverse topological order.
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+void PointsToSolver::Impl::merge(const std::vector<NodeId>& component,
+                                 NodeId rep) {
+  auto& rep_node = m_nodes[rep];
+  for (NodeId v : component) {
+    if (v == rep) {
+      continue;
+    }
+    auto& node = m_nodes[v];
+    rep_node.pts.union_with(node.pts);
+    // Only what all the nodes have done is done for the merged node.
+    rep_node.propagated.intersection_with(node.propagated);
+    rep_node.processed.intersection_with(node.processed);
+    rep_node.succs.insert(rep_node.succs.end(), node.succs.begin(),
+                          node.succs.end());
+    rep_node.constraints.insert(rep_node.constraints.end(),
+                                node.constraints.begin(),
+                                node.constraints.end());
+    if (node.owner != rep_node.owner) {
+      rep_node.owner = kGlobal;
+    }
+    node = Node();
+    m_parent[v] = rep;
+    ++m_stats.collapsed_nodes;
+  }
+}
+
+void PointsToSolver::Impl::propagate(const std::vector<NodeId>& order) {
+  for (NodeId v : order) {
+    auto& node = m_nodes[v];
+    if (node.propagated.equals(node.pts)) {
+      continue;
+    }
+    auto delta = node.pts.get_difference_with(node.propagated);
+    for (NodeId w : node.succs) {
+      w = find(w);
+      if (w != v) {
+        m_nodes[w].pts.union_with(delta);
+      }
+    }
+    node.propagated = node.pts;
+  }
+}
+
+bool PointsToSolver::Impl::process_constraints() {
+  std::vector<NodeId> worklist;
+  for (NodeId v = 0; v < m_nodes.size(); ++v) {
+    const auto& node = m_nodes[v];
+    if (m_parent[v] == v && !node.constraints.empty() &&
+        !node.processed.equals(node.pts)) {
+      worklist.push_back(v);
+    }
+  }
+  if (worklist.empty()) {
+    return false;
+  }
+  // Each node only updates its own state, and reads what doesn't change
+  // until the requests are applied.
+  std::vector<Requests> requests(worklist.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t i) { process(worklist[i], &requests[i]); });
+  for (size_t i = 0; i < worklist.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  for (const auto& request : requests) {
+    for (const auto& load : request.loads) {
+      add_edge(field_node(std::get<0>(load), std::get<1>(load)),
+               std::get<2>(load));
+    }
+    for (const auto& store : request.stores) {
+      add_edge(std::get<0>(store),
+               field_node(std::get<1>(store), std::get<2>(store)));
+    }
+    for (const auto& object : request.objects) {
+      add_object(object.first, object.second);
+    }
+    for (const auto& target : request.targets) {
+      bind(std::get<0>(target), std::get<1>(target), std::get<2>(target));
+    }
+  }
+  return true;
+}
+
+void PointsToSolver::Impl::process(NodeId v, Requests* requests) {
+  auto& node = m_nodes[v];
+  auto delta = node.pts.get_difference_with(node.processed);
+  node.processed = node.pts;
+  for (const auto& constraint : node.constraints) {
+    switch (constraint.kind) {
+    case LOAD: {
+      for (ObjectId o : delta) {
+        requests->loads.emplace_back(o, constraint.field, constraint.node);
+      }
+      break;
+    }
+    case STORE: {
+      for (ObjectId o : delta) {
+        requests->stores.emplace_back(constraint.node, o, constraint.field);
+      }
+      break;
+    }
+    case CAST: {
+      for (ObjectId o : delta) {
+        const Object& object = m_objects[o];
+        if (object.kind == PTS_OPAQUE ||
+            may_cast(object.type, constraint.type)) {
+          requests->objects.emplace_back(constraint.node, o);
+        }
+      }
+      break;
+    }
+    case GET_CLASS: {
+      requests->objects.emplace_back(constraint.node, m_class_object);
+      break;
+    }
+    case CALL: {
+      for (ObjectId o : delta) {
+        dispatch(constraint.call, o, requests);
+      }
+      break;
+    }
+    }
+  }
+}
+
+void PointsToSolver::Impl::dispatch(uint32_t call_id,
+                                    ObjectId o,
+                                    Requests* requests) const {
+  const Call& call = m_calls[call_id];
+  const Object& object = m_objects[o];
+  if (object.kind == PTS_OPAQUE) {
+    // Any override of the callee may be called, as well as methods outside
+    // of the program.
+    DexMethod* base = resolve_method(call.callee,
+                                     call.kind == PTS_INVOKE_INTERFACE
+                                         ? MethodSearch::Interface
+                                         : MethodSearch::Virtual);
+    if (base == nullptr) {
+      requests->targets.emplace_back(call_id, call.callee, true);
+      return;
+    }
+    requests->targets.emplace_back(call_id, base, true);
+    for (const DexMethod* method :
+         method_override_graph::get_overriding_methods(*m_override_graph,
+                                                       base)) {
+      requests->targets.emplace_back(call_id, method, true);
+    }
+    return;
+  }
+  const DexClass* cls = type_class(object.type);
+  DexMethod* target =
+      cls == nullptr ? nullptr
+                     : resolve_method(cls, call.callee->get_name(),
+                                      call.callee->get_proto(),
+                                      MethodSearch::Virtual);
+  if (target != nullptr) {
+    requests->targets.emplace_back(call_id, target, false);
+  } else {
+    requests->targets.emplace_back(call_id, call.callee, true);
+  }
+}
+
+void PointsToSolver::Impl::compute_escapes() {
+  m_escapes.assign(m_objects.size(), false);
+  std::vector<ObjectId> worklist;
+  auto escape = [&](ObjectId o) {
+    if (!m_escapes[o]) {
+      m_escapes[o] = true;
+      worklist.push_back(o);
+    }
+  };
+  for (ObjectId o = 0; o < m_objects.size(); ++o) {
+    // Throwing isn't part of the semantics: any exception may be caught
+    // elsewhere.
+    if (m_objects[o].kind != PTS_ALLOCATION ||
+        may_cast(m_objects[o].type, get_throwable_type())) {
+      escape(o);
+    }
+  }
+  for (NodeId v = 0; v < m_nodes.size(); ++v) {
+    if (m_parent[v] != v) {
+      continue;
+    }
+    const auto& node = m_nodes[v];
+    for (ObjectId o : node.pts) {
+      if (m_object_owners[o] != node.owner) {
+        escape(o);
+      }
+    }
+  }
+  // What the fields of an escaping object point to escapes with it.
+  while (!worklist.empty()) {
+    ObjectId o = worklist.back();
+    worklist.pop_back();
+    for (NodeId field : m_object_fields[o]) {
+      for (ObjectId p : m_nodes[find(field)].pts) {
+        escape(p);
+      }
+    }
+  }
+}
+
+ObjectSet PointsToSolver::Impl::get_points_to_set(const DexMethodRef* method,
+                                                  PointsToVariable v) const {
+  auto it = m_method_ids.find(method);
+  if (it == m_method_ids.end()) {
+    return ObjectSet();
+  }
+  NodeId node = variable_node(m_methods[it->second], v);
+  return node == kNoNode ? ObjectSet() : m_nodes[find(node)].pts;
+}
+
+boost::optional<std::unordered_set<const DexMethod*>>
+PointsToSolver::Impl::get_callees(const DexMethodRef* caller,
+                                  const DexMethodRef* callee) const {
+  auto it = m_method_ids.find(caller);
+  if (it == m_method_ids.end()) {
+    return boost::none;
+  }
+  std::unordered_set<const DexMethod*> callees;
+  for (uint32_t call_id : m_methods[it->second].calls) {
+    const Call& call = m_calls[call_id];
+    if (call.callee != callee) {
+      continue;
+    }
+    if (call.open) {
+      return boost::none;
+    }
+    for (const DexMethodRef* target : call.targets) {
+      always_assert(target->is_def());
+      callees.insert(static_cast<const DexMethod*>(target));
+    }
+  }
+  return callees;
+}
+
+PointsToSolver::PointsToSolver(
+    const Scope& scope,
+    PointsToSemantics& semantics,
+    const std::unordered_set<const DexMethodRef*>& entry_points)
+    : m_impl(std::make_unique<Impl>(scope, semantics, entry_points)) {}
+
+PointsToSolver::~PointsToSolver() {}
+
+std::unordered_set<const DexMethodRef*> PointsToSolver::default_entry_points(
+    const Scope& scope) {
+  std::unordered_set<const DexMethodRef*> entry_points;
+  for (const DexClass* cls : scope) {
+    for (DexMethod* method : cls->get_dmethods()) {
+      if (root(method) || !can_rename(method)) {
+        entry_points.insert(method);
+      }
+    }
+    for (DexMethod* method : cls->get_vmethods()) {
+      if (root(method) || !can_rename(method)) {
+        entry_points.insert(method);
+        continue;
+      }
+      // Code outside of the scope may call the method through a type that it
+      // knows.
+      bool overrides_external = false;
+      if (cls->get_super_class() != nullptr) {
+        overrides_external = declared_outside(
+            cls->get_super_class(), method->get_name(), method->get_proto());
+      }
+      for (const DexType* intf : cls->get_interfaces()->get_type_list()) {
+        overrides_external =
+            overrides_external ||
+            declared_outside(intf, method->get_name(), method->get_proto());
+      }
+      if (overrides_external) {
+        entry_points.insert(method);
+      }
+    }
+  }
+  return entry_points;
+}
+
+PointsToSolver::ObjectSet PointsToSolver::get_points_to_set(
+    const DexMethodRef* method, PointsToVariable v) const {
+  return m_impl->get_points_to_set(method, v);
+}
+
+const PointsToSolver::Object& PointsToSolver::get_object(ObjectId id) const {
+  return m_impl->get_object(id);
+}
+
+boost::optional<std::unordered_set<const DexMethod*>>
+PointsToSolver::get_callees(const DexMethodRef* caller,
+                            const DexMethodRef* callee) const {
+  return m_impl->get_callees(caller, callee);
+}
+
+bool PointsToSolver::may_escape(ObjectId id) const {
+  return m_impl->may_escape(id);
+}
+
+const PointsToSolver::Stats& PointsToSolver::get_stats() const {
+  return m_impl->get_stats();
+}
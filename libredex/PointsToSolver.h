@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+
+#include <boost/optional.hpp>
+
+#include "DexClass.h"
+#include "PatriciaTreeSet.h"
+#include "PointsToSemantics.h"
+
+/*
+ * A whole-program solver for the points-to equations of PointsToSemantics.
+ *
+ * The analysis is inclusion-based (Andersen-style), flow- and
+ * context-insensitive, and field-sensitive: each abstract object has a
+ * points-to set per field, and one for the elements of arrays. Virtual calls
+ * are resolved on the fly from the dynamic types of the objects that reach
+ * their receiver, so that the call graph is only as large as the points-to
+ * sets require.
+ *
+ * Abstract objects are allocation sites (one per PTS_NEW_OBJECT), a single
+ * object for all string constants, a single java.lang.Class object, and one
+ * opaque object per declared type for everything that comes from outside the
+ * program: the parameters of entry points, the values returned by external
+ * methods, caught exceptions and the fields of external objects. The dynamic
+ * type of an opaque object may be any subtype of its declared type, which
+ * makes the calls it reaches open-ended.
+ *
+ * The equations are turned into a constraint graph whose copy edges are
+ * solved by wave propagation:
+ *
+ *   A. Hardekopf and C. Lin. The Ant and the Grasshopper: Fast and Accurate
+ *   Pointer Analysis for Millions of Lines of Code. PLDI 2007.
+ *
+ *   F. Pereira and D. Berlin. Wave Propagation and Deep Propagation for
+ *   Pointer Analysis. CGO 2009.
+ *
+ * Each round collapses the strongly connected components of the copy edges
+ * (online cycle elimination), propagates the objects that each node hasn't
+ * sent yet along the copy edges in topological order (difference
+ * propagation), and then hands the new objects of each node to its loads,
+ * stores and calls in parallel. The edges that these add are applied in
+ * between rounds, until nothing changes.
+ *
+ * Points-to sets are Patricia-tree sets over dense object ids, which makes
+ * the unions and differences of the propagation cheap and lets the nodes of a
+ * collapsed cycle share their set.
+ */
+class PointsToSolver final {
+ public:
+  using ObjectId = uint32_t;
+  using ObjectSet = sparta::PatriciaTreeSet<ObjectId>;
+
+  enum ObjectKind {
+    // Created by a PTS_NEW_OBJECT action of a method of the program.
+    PTS_ALLOCATION,
+    // All string constants.
+    PTS_STRING,
+    // All java.lang.Class objects.
+    PTS_CLASS,
+    // Comes from outside the program; of any subtype of its type.
+    PTS_OPAQUE,
+  };
+
+  struct Object {
+    ObjectKind kind;
+    const DexType* type;
+    // The method that allocates the object, for PTS_ALLOCATION objects.
+    const DexMethodRef* method;
+  };
+
+  struct Stats {
+    size_t methods{0};
+    size_t nodes{0};
+    size_t objects{0};
+    size_t rounds{0};
+    size_t collapsed_nodes{0};
+    size_t call_edges{0};
+  };
+
+  PointsToSolver() = delete;
+
+  PointsToSolver(const PointsToSolver& other) = delete;
+
+  PointsToSolver& operator=(const PointsToSolver& other) = delete;
+
+  /*
+   * Solves the equations of all the methods in `semantics`, which were
+   * generated for `scope`. The parameters of the methods in `entry_points` may
+   * hold objects from outside the program, and what they return may leave it.
+   */
+  PointsToSolver(const Scope& scope,
+                 PointsToSemantics& semantics,
+                 const std::unordered_set<const DexMethodRef*>& entry_points);
+
+  ~PointsToSolver();
+
+  /*
+   * The methods of `scope` that code outside of it may call: the ones kept by
+   * ProGuard rules or that can't be renamed, and the virtual methods that
+   * override or implement a method of a class outside of the scope.
+   */
+  static std::unordered_set<const DexMethodRef*> default_entry_points(
+      const Scope& scope);
+
+  /*
+   * The objects that variable `v` of `method` may point to.
+   */
+  ObjectSet get_points_to_set(const DexMethodRef* method,
+                              PointsToVariable v) const;
+
+  const Object& get_object(ObjectId id) const;
+
+  /*
+   * The methods that the calls to `callee` in `caller` may dispatch to. Empty
+   * if no object reaches their receiver, and boost::none if some receiver may
+   * be an object from outside the program, or of a type whose implementation
+   * of `callee` isn't known.
+   */
+  boost::optional<std::unordered_set<const DexMethod*>> get_callees(
+      const DexMethodRef* caller, const DexMethodRef* callee) const;
+
+  /*
+   * Whether the object may be seen by another method than the one that
+   * allocates it, i.e., whether it is passed to or returned to another
+   * method, stored in a static field or in an object that escapes, or thrown.
+   * Always true for objects that don't come from an allocation.
+   */
+  bool may_escape(ObjectId id) const;
+
+  const Stats& get_stats() const;
+
+ private:
+  class Impl;
+
+  static int32_t variable_id(PointsToVariable v) { return v.m_id; }
+
+  std::unique_ptr<Impl> m_impl;
+};
@@ -7,6 +7,11 @@
 
 #include "ProguardMap.h"
 
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <iterator>
+
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "Timer.h"
@@ -120,6 +125,40 @@ bool literal(const char*& p, char s) {
   return false;
 }
 
+// Parses a class line, like "com.foo.Bar -> A:", into the descriptors of the
+// class before and after obfuscation.
+bool parse_class_names(const std::string& line,
+                       std::string* cls,
+                       std::string* new_cls) {
+  std::string classname;
+  std::string newname;
+  auto p = line.c_str();
+  if (!id(p, classname)) return false;
+  if (!literal(p, " -> ")) return false;
+  if (!id(p, newname)) return false;
+  *cls = convert_type(classname);
+  *new_cls = convert_type(newname);
+  return true;
+}
+
+// Only class lines start with neither whitespace nor a comment.
+bool maybe_class_line(const char* p, const char* end) {
+  return p < end && !isspace(*p) && *p != '#';
+}
+
+template <typename LineFn>
+void for_each_line(const char* begin, const char* end, LineFn fn) {
+  while (begin < end) {
+    auto eol =
+        static_cast<const char*>(memchr(begin, '\n', end - begin));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    fn(begin, eol);
+    begin = eol + 1;
+  }
+}
+
 bool comment(const std::string& line) {
   auto p = line.c_str();
   whitespace(p);
@@ -153,15 +192,41 @@ bool is_maybe_proguard_generated_member(const std::string& s) {
 }
 } // namespace
 
+struct ProguardMap::Members {
+  // (unobfuscated, obfuscated) pairs, in the order of the map.
+  std::vector<std::pair<std::string, std::string>> fields;
+  std::vector<std::pair<std::string, std::string>> methods;
+  std::vector<std::pair<std::string, std::unique_ptr<ProguardLineRange>>>
+      lines;
+  std::unordered_set<std::string> coalesced_interfaces;
+};
+
 ProguardMap::ProguardMap(const std::string& filename) {
   if (!filename.empty()) {
     Timer t("Parsing proguard map");
-    std::ifstream fp(filename);
-    always_assert_log(fp, "Can't open proguard map: %s\n", filename.c_str());
-    parse_proguard_map(fp);
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(filename, ec);
+    always_assert_log(!ec, "Can't open proguard map: %s\n", filename.c_str());
+    if (size == 0) {
+      return;
+    }
+    boost::iostreams::mapped_file_source file;
+    try {
+      file.open(filename);
+    } catch (const std::exception&) {
+      always_assert_log(false, "Can't open proguard map: %s\n",
+                        filename.c_str());
+    }
+    parse_proguard_map(file.data(), file.data() + file.size());
   }
 }
 
+ProguardMap::ProguardMap(std::istream& is) {
+  std::string contents((std::istreambuf_iterator<char>(is)),
+                       std::istreambuf_iterator<char>());
+  parse_proguard_map(contents.data(), contents.data() + contents.size());
+}
+
 std::string ProguardMap::translate_class(const std::string& cls) const {
   return find_or_same(cls, m_classMap);
 }
@@ -218,48 +283,146 @@ ProguardLineRangeVector& ProguardMap::method_lines(
   return m_obfMethodLinesMap.at(pg_impl::lines_key(obfuscated_method));
 }
 
-void ProguardMap::parse_proguard_map(std::istream& fp) {
-  std::string line;
-  while (std::getline(fp, line)) {
-    parse_class(line);
+/*
+ * The classes are parsed first, since the members refer to them with their
+ * obfuscated names. Then the map is cut into chunks at class lines, whose
+ * members are parsed in parallel, and merged in the order of the map, so
+ * that later mappings win as they would parsing it line by line.
+ */
+void ProguardMap::parse_proguard_map(const char* begin, const char* end) {
+  parse_classes(begin, end);
+
+  constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+  size_t num_chunks =
+      std::max<size_t>(1,
+                       std::min<size_t>(workqueue_num_threads() * 4,
+                                        (end - begin) / MIN_CHUNK_SIZE));
+  size_t chunk_size = (end - begin) / num_chunks + 1;
+  std::vector<const char*> bounds{begin};
+  while (end - bounds.back() > (ptrdiff_t)chunk_size) {
+    auto p = bounds.back() + chunk_size;
+    do {
+      auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+      p = eol == nullptr ? end : eol + 1;
+    } while (p < end && !maybe_class_line(p, end));
+    if (p == end) {
+      break;
+    }
+    bounds.push_back(p);
   }
-  fp.clear();
-  fp.seekg(0);
-  assert_log(!fp.fail(), "Can't use ProguardMap with non-seekable stream");
-  while (std::getline(fp, line)) {
-    if (parse_class(line)) {
-      continue;
+  bounds.push_back(end);
+
+  std::vector<Members> chunks(bounds.size() - 1);
+  auto parse_wq = workqueue_foreach<size_t>([&](size_t i) {
+    parse_members(bounds[i], bounds[i + 1], &chunks[i]);
+  });
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    parse_wq.add_item(i);
+  }
+  parse_wq.run_all();
+
+  // Each map is filled on its own thread.
+  size_t num_fields = 0;
+  size_t num_methods = 0;
+  for (const auto& chunk : chunks) {
+    num_fields += chunk.fields.size();
+    num_methods += chunk.methods.size();
+  }
+  std::vector<std::function<void()>> merges{
+      [&] {
+        m_fieldMap.reserve(num_fields);
+        for (const auto& chunk : chunks) {
+          for (const auto& p : chunk.fields) {
+            m_fieldMap[p.first] = p.second;
+          }
+        }
+      },
+      [&] {
+        m_obfFieldMap.reserve(num_fields);
+        for (const auto& chunk : chunks) {
+          for (const auto& p : chunk.fields) {
+            m_obfFieldMap[p.second] = p.first;
+          }
+        }
+      },
+      [&] {
+        m_methodMap.reserve(num_methods);
+        for (const auto& chunk : chunks) {
+          for (const auto& p : chunk.methods) {
+            m_methodMap[p.first] = p.second;
+          }
+        }
+      },
+      [&] {
+        m_obfMethodMap.reserve(num_methods);
+        for (const auto& chunk : chunks) {
+          for (const auto& p : chunk.methods) {
+            m_obfMethodMap[p.second] = p.first;
+          }
+        }
+      },
+      [&] {
+        for (auto& chunk : chunks) {
+          for (auto& p : chunk.lines) {
+            m_obfMethodLinesMap[p.first].push_back(std::move(p.second));
+          }
+        }
+      },
+      [&] {
+        for (const auto& chunk : chunks) {
+          m_pg_coalesced_interfaces.insert(chunk.coalesced_interfaces.begin(),
+                                           chunk.coalesced_interfaces.end());
+        }
+      }};
+  auto merge_wq = workqueue_foreach<size_t>(
+      [&](size_t i) { merges[i](); }, merges.size());
+  for (size_t i = 0; i < merges.size(); ++i) {
+    merge_wq.add_item(i);
+  }
+  merge_wq.run_all();
+}
+
+void ProguardMap::parse_classes(const char* begin, const char* end) {
+  std::string cls;
+  std::string new_cls;
+  for_each_line(begin, end, [&](const char* line, const char* eol) {
+    if (maybe_class_line(line, eol) &&
+        parse_class_names(std::string(line, eol), &cls, &new_cls)) {
+      m_classMap[cls] = new_cls;
+      m_obfClassMap[new_cls] = cls;
     }
-    if (parse_field(line)) {
-      continue;
+  });
+}
+
+void ProguardMap::parse_members(const char* begin,
+                                const char* end,
+                                Members* members) const {
+  std::string cls;
+  std::string new_cls;
+  for_each_line(begin, end, [&](const char* b, const char* e) {
+    std::string line(b, e);
+    if (parse_class_names(line, &cls, &new_cls)) {
+      return;
     }
-    if (parse_method(line)) {
-      continue;
+    if (parse_field(line, cls, new_cls, members)) {
+      return;
+    }
+    if (parse_method(line, cls, new_cls, members)) {
+      return;
     }
     if (comment(line)) {
-      continue;
+      return;
     }
     always_assert_log(false,
                       "Bogus line encountered in proguard map: %s\n",
                       line.c_str());
-  }
-}
-
-bool ProguardMap::parse_class(const std::string& line) {
-  std::string classname;
-  std::string newname;
-  auto p = line.c_str();
-  if (!id(p, classname)) return false;
-  if (!literal(p, " -> ")) return false;
-  if (!id(p, newname)) return false;
-  m_currClass = convert_type(classname);
-  m_currNewClass = convert_type(newname);
-  m_classMap[m_currClass] = m_currNewClass;
-  m_obfClassMap[m_currNewClass] = m_currClass;
-  return true;
+  });
 }
 
-bool ProguardMap::parse_field(const std::string& line) {
+bool ProguardMap::parse_field(const std::string& line,
+                              const std::string& cls,
+                              const std::string& new_cls,
+                              Members* members) const {
   std::string type;
   std::string fieldname;
   std::string newname;
@@ -274,25 +437,27 @@ bool ProguardMap::parse_field(const std::string& line) {
 
   auto ctype = convert_type(type);
   auto xtype = translate_type(ctype, *this);
-  auto pgnew = convert_field(m_currNewClass, xtype, newname);
-  auto pgold = convert_field(m_currClass, ctype, fieldname);
+  auto pgnew = convert_field(new_cls, xtype, newname);
+  auto pgold = convert_field(cls, ctype, fieldname);
   // Record interfaces that are coalesced by Proguard.
   if (ctype[0] == 'L' && is_maybe_proguard_generated_member(fieldname)) {
     fprintf(stderr,
             "Type '%s' is touched by Proguard in '%s'\n",
             ctype.c_str(),
             pgold.c_str());
-    m_pg_coalesced_interfaces.insert(ctype);
+    members->coalesced_interfaces.insert(ctype);
   }
-  m_fieldMap[pgold] = pgnew;
-  m_obfFieldMap[pgnew] = pgold;
+  members->fields.emplace_back(std::move(pgold), std::move(pgnew));
   return true;
 }
 
-bool ProguardMap::parse_method(const std::string& line) {
+bool ProguardMap::parse_method(const std::string& line,
+                               const std::string& cls,
+                               const std::string& new_cls,
+                               Members* members) const {
   std::string type;
   std::string methodname;
-  std::string classname = m_currClass;
+  std::string classname = cls;
   std::string old_args;
   std::string new_args;
   std::string newname;
@@ -333,11 +498,10 @@ bool ProguardMap::parse_method(const std::string& line) {
   auto old_rtype = convert_type(type);
   auto new_rtype = translate_type(old_rtype, *this);
   auto pgold = convert_method(classname, old_rtype, methodname, old_args);
-  auto pgnew = convert_method(m_currNewClass, new_rtype, newname, new_args);
-  m_methodMap[pgold] = pgnew;
-  m_obfMethodMap[pgnew] = pgold;
+  auto pgnew = convert_method(new_cls, new_rtype, newname, new_args);
   lines->original_name = pgold;
-  m_obfMethodLinesMap[pg_impl::lines_key(pgnew)].push_back(std::move(lines));
+  members->lines.emplace_back(pg_impl::lines_key(pgnew), std::move(lines));
+  members->methods.emplace_back(std::move(pgold), std::move(pgnew));
   return true;
 }
 
@@ -47,9 +47,7 @@ struct ProguardMap {
   /**
    * Construct map from a given stream.
    */
-  explicit ProguardMap(std::istream& is) {
-    parse_proguard_map(is);
-  }
+  explicit ProguardMap(std::istream& is);
 
   /**
    * Translate un-obfuscated class name to obfuscated name.
@@ -107,11 +105,22 @@ struct ProguardMap {
   }
 
  private:
-  void parse_proguard_map(std::istream& fp);
-
-  bool parse_class(const std::string& line);
-  bool parse_field(const std::string& line);
-  bool parse_method(const std::string& line);
+  // The members of one or more classes of the map.
+  struct Members;
+
+  void parse_proguard_map(const char* begin, const char* end);
+
+  void parse_classes(const char* begin, const char* end);
+  void parse_members(const char* begin, const char* end, Members* members)
+      const;
+  bool parse_field(const std::string& line,
+                   const std::string& cls,
+                   const std::string& new_cls,
+                   Members* members) const;
+  bool parse_method(const std::string& line,
+                    const std::string& cls,
+                    const std::string& new_cls,
+                    Members* members) const;
 
  private:
   // Unobfuscated to obfuscated maps
@@ -127,9 +136,6 @@ struct ProguardMap {
 
   // Interfaces that are (most likely) coalesced by Proguard.
   std::unordered_set<std::string> m_pg_coalesced_interfaces;
-
-  std::string m_currClass;
-  std::string m_currNewClass;
 };
 
 /**
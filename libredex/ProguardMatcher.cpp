@@ -6,8 +6,11 @@
  */
 
 #include <algorithm>
+#include <boost/optional.hpp>
 #include <boost/regex.hpp>
+#include <cctype>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
 #include "ClassHierarchy.h"
@@ -28,26 +31,195 @@ using namespace redex;
 namespace {
 
 using RegexMap = std::unordered_map<std::string, boost::regex>;
+using proguard_parser::WildcardMatcher;
 
-std::unique_ptr<boost::regex> make_rx(const std::string& s,
-                                      bool convert = true) {
+/*
+ * Matches against a type pattern, with the shared DFA when the pattern is
+ * within the wildcard grammar and with boost::regex otherwise.
+ */
+class TypeMatcher {
+ public:
+  explicit TypeMatcher(const std::string& wildcard)
+      : m_dfa(WildcardMatcher::for_type(wildcard)) {
+    if (m_dfa == nullptr) {
+      m_rx = std::make_unique<boost::regex>(
+          proguard_parser::form_type_regex(wildcard));
+    }
+  }
+
+  bool matches(const char* s) const {
+    return m_dfa ? m_dfa->matches(s) : boost::regex_match(s, *m_rx);
+  }
+
+  bool matches(const std::string& s) const {
+    return m_dfa ? m_dfa->matches(s) : boost::regex_match(s, *m_rx);
+  }
+
+ private:
+  const WildcardMatcher* m_dfa;
+  std::unique_ptr<boost::regex> m_rx;
+};
+
+/*
+ * Matches the "name:descriptor" part of a member's deobfuscated name against
+ * a member specification. Either points to a shared DFA or to a regex owned
+ * by the RegexMap of the KeepRuleMatcher that made it.
+ */
+class MemberMatcher {
+ public:
+  explicit MemberMatcher(const WildcardMatcher* dfa) : m_dfa(dfa) {}
+  explicit MemberMatcher(const boost::regex* rx) : m_rx(rx) {}
+
+  bool matches(const char* begin, const char* end) const {
+    return m_dfa ? m_dfa->matches(begin, end)
+                 : boost::regex_match(begin, end, *m_rx);
+  }
+
+ private:
+  const WildcardMatcher* m_dfa{nullptr};
+  const boost::regex* m_rx{nullptr};
+};
+
+std::unique_ptr<TypeMatcher> make_rx(const std::string& s,
+                                     bool convert = true) {
   if (s.empty()) return nullptr;
   auto wc = convert ? proguard_parser::convert_wildcard_type(s) : s;
-  auto rx = proguard_parser::form_type_regex(wc);
-  return std::make_unique<boost::regex>(rx);
+  return std::make_unique<TypeMatcher>(wc);
 }
 
-bool match_annotation_rx(const DexClass* cls, const boost::regex& annorx) {
+bool match_annotation_rx(const DexClass* cls, const TypeMatcher& annorx) {
   const auto* annos = cls->get_anno_set();
   if (!annos) return false;
   for (const auto& anno : annos->get_annotations()) {
-    if (boost::regex_match(anno->type()->c_str(), annorx)) {
+    if (annorx.matches(anno->type()->c_str())) {
       return true;
     }
   }
   return false;
 }
 
+/*
+ * Necessary conditions on a deobfuscated class name, read off the literal
+ * parts of a wildcard class pattern. They are much cheaper to check than the
+ * pattern's regex, which only needs to run on names that pass them.
+ *
+ * For a pattern with a single wildcard, such as the common "com.foo.**", the
+ * conditions are also sufficient and the regex can be skipped altogether.
+ */
+class ClassNameFilter {
+ public:
+  // Returns none for patterns we don't understand well enough to filter.
+  static boost::optional<ClassNameFilter> make(std::string descriptor) {
+    if (descriptor == "L*;") {
+      // form_type_regex treats this one as L**;
+      descriptor = "L**;";
+    }
+    ClassNameFilter filter;
+    std::vector<std::string> literals;
+    std::vector<std::string> wildcards;
+    bool starts_with_literal = false;
+    bool ends_with_literal = false;
+    for (size_t i = 0; i < descriptor.size();) {
+      char ch = descriptor[i];
+      if (ch == '*' || ch == '?') {
+        size_t j = i + 1;
+        if (ch == '*') {
+          while (j < descriptor.size() && descriptor[j] == '*') {
+            ++j;
+          }
+          if (j - i > 2) {
+            // *** matches arbitrary types.
+            return boost::none;
+          }
+        }
+        wildcards.emplace_back(descriptor.substr(i, j - i));
+        ends_with_literal = false;
+        i = j;
+        continue;
+      }
+      if (!isalnum(static_cast<unsigned char>(ch)) && ch != '_' && ch != '$' && ch != '/' && ch != ';' &&
+          ch != '-') {
+        // Anything that isn't a plain literal in the regex: %, ..., !, etc.
+        return boost::none;
+      }
+      if (i == 0) {
+        starts_with_literal = true;
+      }
+      if (!ends_with_literal) {
+        literals.emplace_back();
+      }
+      literals.back() += ch;
+      ends_with_literal = true;
+      ++i;
+    }
+    auto first_infix = literals.begin();
+    auto last_infix = literals.end();
+    if (starts_with_literal) {
+      filter.m_prefix = *first_infix++;
+    }
+    if (ends_with_literal && first_infix != last_infix) {
+      filter.m_suffix = *--last_infix;
+    }
+    for (auto it = first_infix; it != last_infix; ++it) {
+      if (it->size() > filter.m_infix.size()) {
+        filter.m_infix = *it;
+      }
+    }
+    if (wildcards.empty()) {
+      filter.m_exact = true;
+    } else if (wildcards.size() == 1) {
+      filter.m_exact = true;
+      filter.m_wildcard = wildcards[0];
+    }
+    return filter;
+  }
+
+  // The literal text every matching name starts with.
+  const std::string& prefix() const { return m_prefix; }
+
+  // True if the name may match; for exact filters, if it does match.
+  bool may_match(const std::string& name) const {
+    if (name.size() < m_prefix.size() + m_suffix.size() ||
+        name.compare(0, m_prefix.size(), m_prefix) != 0 ||
+        name.compare(name.size() - m_suffix.size(), m_suffix.size(),
+                     m_suffix) != 0) {
+      return false;
+    }
+    if (m_wildcard.empty() && m_exact) {
+      return name.size() == m_prefix.size();
+    }
+    size_t begin = m_prefix.size();
+    size_t end = name.size() - m_suffix.size();
+    if (!m_infix.empty()) {
+      auto pos = name.find(m_infix, begin);
+      if (pos == std::string::npos || pos + m_infix.size() > end) {
+        return false;
+      }
+    }
+    if (!m_exact) {
+      return true;
+    }
+    // Check the part covered by the single wildcard, mirroring the regexes
+    // built by form_type_regex.
+    for (size_t i = begin; i < end; ++i) {
+      if (name[i] == '[' || (name[i] == '/' && m_wildcard != "**")) {
+        return false;
+      }
+    }
+    return m_wildcard != "?" || end - begin == 1;
+  }
+
+  // True if may_match() alone decides the match.
+  bool is_exact() const { return m_exact; }
+
+ private:
+  std::string m_prefix;
+  std::string m_suffix;
+  std::string m_infix;
+  std::string m_wildcard;
+  bool m_exact{false};
+};
+
 /**
  * Helper class that holds the conditions for a class-level match on a keep
  * rule.
@@ -60,7 +232,16 @@ struct ClassMatcher {
         m_cls(make_rx(ks.class_spec.className)),
         m_anno(make_rx(ks.class_spec.annotationType, false)),
         m_extends(make_rx(ks.class_spec.extendsClassName)),
-        m_extends_anno(make_rx(ks.class_spec.extendsAnnotationType, false)) {}
+        m_extends_anno(make_rx(ks.class_spec.extendsAnnotationType, false)) {
+    if (!m_class_name.empty()) {
+      m_name_filter = ClassNameFilter::make(
+          proguard_parser::convert_wildcard_type(m_class_name));
+    }
+  }
+
+  const boost::optional<ClassNameFilter>& name_filter() const {
+    return m_name_filter;
+  }
 
   bool match(const DexClass* cls) {
     // Check for class name match
@@ -84,7 +265,15 @@ struct ClassMatcher {
  private:
   bool match_name(const DexClass* cls) const {
     const auto& deob_name = cls->get_deobfuscated_name();
-    return boost::regex_match(deob_name, *m_cls);
+    if (m_name_filter) {
+      if (!m_name_filter->may_match(deob_name)) {
+        return false;
+      }
+      if (m_name_filter->is_exact()) {
+        return true;
+      }
+    }
+    return m_cls->matches(deob_name);
   }
 
   bool match_access(const DexClass* cls) const {
@@ -111,7 +300,7 @@ struct ClassMatcher {
       }
     }
     const auto& deob_name = cls->get_deobfuscated_name();
-    return boost::regex_match(deob_name, *m_extends);
+    return m_extends->matches(deob_name);
   }
 
   bool search_interfaces(const DexClass* cls) {
@@ -161,10 +350,11 @@ struct ClassMatcher {
   DexAccessFlags setFlags_;
   DexAccessFlags unsetFlags_;
   std::string m_class_name;
-  std::unique_ptr<boost::regex> m_cls;
-  std::unique_ptr<boost::regex> m_anno;
-  std::unique_ptr<boost::regex> m_extends;
-  std::unique_ptr<boost::regex> m_extends_anno;
+  std::unique_ptr<TypeMatcher> m_cls;
+  boost::optional<ClassNameFilter> m_name_filter;
+  std::unique_ptr<TypeMatcher> m_anno;
+  std::unique_ptr<TypeMatcher> m_extends;
+  std::unique_ptr<TypeMatcher> m_extends_anno;
 
   std::unordered_map<const DexClass*, bool> m_extends_result_cache;
 };
@@ -226,7 +416,7 @@ class KeepRuleMatcher {
 
   bool any_method_matches(const DexClass* cls,
                           const MemberSpecification& method_keep,
-                          const boost::regex& method_regex);
+                          const MemberMatcher& method_matcher);
 
   // Check that each method keep matches at least one method in :cls.
   bool all_method_keeps_match(
@@ -257,33 +447,37 @@ class KeepRuleMatcher {
   void keep_fields(bool apply_modifiers,
                    const Container& fields,
                    const redex::MemberSpecification& fieldSpecification,
-                   const boost::regex& fieldname_regex);
+                   const MemberMatcher& field_matcher);
 
   template <class Container>
   void keep_methods(bool apply_modifiers,
                     const redex::MemberSpecification& methodSpecification,
                     const Container& methods,
-                    const boost::regex& method_regex);
+                    const MemberMatcher& method_matcher);
 
   bool field_level_match(const redex::MemberSpecification& fieldSpecification,
                          const DexField* field,
-                         const boost::regex& fieldname_regex);
+                         const MemberMatcher& field_matcher);
 
   bool method_level_match(const redex::MemberSpecification& methodSpecification,
                           const DexMethod* method,
-                          const boost::regex& method_regex);
+                          const MemberMatcher& method_matcher);
 
   template <class DexMember>
   bool has_annotation(const DexMember* member,
                       const std::string& annotation) const;
 
-  boost::regex register_matcher(const std::string& regex) const {
+  const boost::regex& register_matcher(const std::string& regex) const {
     if (!m_regex_map.count(regex)) {
       m_regex_map.emplace(regex, boost::regex{regex});
     }
     return m_regex_map.at(regex);
   }
 
+  MemberMatcher field_matcher(const MemberSpecification& field_spec) const;
+
+  MemberMatcher method_matcher(const MemberSpecification& method_spec) const;
+
  private:
   RuleType m_rule_type;
   const KeepSpec& m_keep_rule;
@@ -303,6 +497,8 @@ class ProguardMatcher {
     // may, for instance, forbid renaming of all classes that inherit from a
     // given external class.
     build_extends_or_implements_hierarchy(m_external_classes, &m_hierarchy);
+    m_classes_by_name = sort_by_deobfuscated_name(m_classes);
+    m_external_classes_by_name = sort_by_deobfuscated_name(m_external_classes);
   }
 
   void process_proguard_rules(const ProguardConfiguration& pg_config);
@@ -314,11 +510,37 @@ class ProguardMatcher {
 
   DexClass* find_single_class(const std::string& descriptor) const;
 
+  const KeepRuleMatchStats& stats() const { return m_stats; }
+
  private:
+  struct ClassMatches {
+    std::vector<DexClass*> classes;
+    // The number of classes that were tested to find them.
+    size_t candidates{0};
+  };
+
+  ClassMatches match_classes(const KeepSpec& keep_rule,
+                             bool process_external) const;
+
+  static std::vector<DexClass*> sort_by_deobfuscated_name(const Scope& scope);
+
+  // The classes whose deobfuscated names start with `prefix`. Together these
+  // sorted arrays act as a package trie for rules with a literal prefix.
+  static std::pair<std::vector<DexClass*>::const_iterator,
+                   std::vector<DexClass*>::const_iterator>
+  classes_with_prefix(const std::vector<DexClass*>& sorted,
+                      const std::string& prefix);
+
   const ProguardMap& m_pg_map;
   const Scope& m_classes;
   const Scope& m_external_classes;
+  std::vector<DexClass*> m_classes_by_name;
+  std::vector<DexClass*> m_external_classes_by_name;
   ClassHierarchy m_hierarchy;
+  // The classes matched by the class-level part of the rules processed so far,
+  // by class_match_key.
+  std::unordered_map<std::string, ClassMatches> m_class_matches;
+  KeepRuleMatchStats m_stats;
 };
 
 // Updates a class, field or method to add keep modifiers.
@@ -376,36 +598,46 @@ bool KeepRuleMatcher::has_annotation(const DexMember* member,
                                      const std::string& annotation) const {
   auto annos = member->get_anno_set();
   if (annos != nullptr) {
-    auto annotation_regex = proguard_parser::form_type_regex(annotation);
-    const boost::regex& annotation_matcher = register_matcher(annotation_regex);
-    for (const auto& anno : annos->get_annotations()) {
-      if (boost::regex_match(anno->type()->c_str(), annotation_matcher)) {
-        return true;
+    auto match = [&](const auto& matches) {
+      for (const auto& anno : annos->get_annotations()) {
+        if (matches(anno->type()->c_str())) {
+          return true;
+        }
       }
+      return false;
+    };
+    const auto* dfa = WildcardMatcher::for_type(annotation);
+    if (dfa != nullptr) {
+      return match([&](const char* s) { return dfa->matches(s); });
     }
+    auto annotation_regex = proguard_parser::form_type_regex(annotation);
+    const boost::regex& annotation_matcher = register_matcher(annotation_regex);
+    return match([&](const char* s) {
+      return boost::regex_match(s, annotation_matcher);
+    });
   }
   return false;
 }
 
-// From a fully qualified descriptor for a field, exract just the
+// From a fully qualified descriptor for a field, find just the
 // name of the field which occurs between the ;. and : characters.
-std::string extract_field_name(std::string qualified_fieldname) {
+const char* field_name_start(const std::string& qualified_fieldname) {
   auto p = qualified_fieldname.find(";.");
   if (p == std::string::npos) {
-    return qualified_fieldname;
+    return qualified_fieldname.c_str();
   }
-  return qualified_fieldname.substr(p + 2);
+  return qualified_fieldname.c_str() + p + 2;
 }
 
-std::string extract_method_name_and_type(std::string qualified_fieldname) {
-  auto p = qualified_fieldname.find(";.");
-  return qualified_fieldname.substr(p + 2);
+const char* method_name_and_type_start(const std::string& qualified_name) {
+  auto p = qualified_name.find(";.");
+  return qualified_name.c_str() + p + 2;
 }
 
 bool KeepRuleMatcher::field_level_match(
     const redex::MemberSpecification& fieldSpecification,
     const DexField* field,
-    const boost::regex& fieldname_regex) {
+    const MemberMatcher& field_matcher) {
   // Check for annotation guards.
   if (!(fieldSpecification.annotationType.empty())) {
     if (!has_annotation(field, fieldSpecification.annotationType)) {
@@ -418,9 +650,10 @@ bool KeepRuleMatcher::field_level_match(
                       field->get_access())) {
     return false;
   }
-  // Match field name against regex.
-  auto dequalified_name = extract_field_name(field->get_deobfuscated_name());
-  return boost::regex_match(dequalified_name, fieldname_regex);
+  // Match field name against the pattern.
+  const auto& qualified_name = field->get_deobfuscated_name();
+  return field_matcher.matches(field_name_start(qualified_name),
+                               qualified_name.c_str() + qualified_name.size());
 }
 
 template <class Container>
@@ -428,9 +661,9 @@ void KeepRuleMatcher::keep_fields(
     bool apply_modifiers,
     const Container& fields,
     const redex::MemberSpecification& fieldSpecification,
-    const boost::regex& fieldname_regex) {
+    const MemberMatcher& field_matcher) {
   for (DexField* field : fields) {
-    if (!field_level_match(fieldSpecification, field, fieldname_regex)) {
+    if (!field_level_match(fieldSpecification, field, field_matcher)) {
       continue;
     }
     if (apply_modifiers) {
@@ -449,11 +682,20 @@ std::string field_regex(const MemberSpecification& field_spec) {
   return ss.str();
 }
 
+MemberMatcher KeepRuleMatcher::field_matcher(
+    const MemberSpecification& field_spec) const {
+  const auto* dfa =
+      WildcardMatcher::for_member(field_spec.name, field_spec.descriptor);
+  if (dfa != nullptr) {
+    return MemberMatcher(dfa);
+  }
+  return MemberMatcher(&register_matcher(field_regex(field_spec)));
+}
+
 void KeepRuleMatcher::apply_field_keeps(const DexClass* cls,
                                         bool apply_modifiers) {
   for (const auto& field_spec : m_keep_rule.class_spec.fieldSpecifications) {
-    auto fieldname_regex = field_regex(field_spec);
-    const boost::regex& matcher = register_matcher(fieldname_regex);
+    auto matcher = field_matcher(field_spec);
     keep_fields(apply_modifiers, cls->get_ifields(), field_spec, matcher);
     keep_fields(apply_modifiers, cls->get_sfields(), field_spec, matcher);
   }
@@ -462,7 +704,7 @@ void KeepRuleMatcher::apply_field_keeps(const DexClass* cls,
 bool KeepRuleMatcher::method_level_match(
     const redex::MemberSpecification& methodSpecification,
     const DexMethod* method,
-    const boost::regex& method_regex) {
+    const MemberMatcher& method_matcher) {
   // Check to see if the method match is guarded by an annotation match.
   if (!(methodSpecification.annotationType.empty())) {
     if (!has_annotation(method, methodSpecification.annotationType)) {
@@ -474,9 +716,10 @@ bool KeepRuleMatcher::method_level_match(
                       method->get_access())) {
     return false;
   }
-  auto dequalified_name =
-      extract_method_name_and_type(method->get_deobfuscated_name());
-  return boost::regex_match(dequalified_name.c_str(), method_regex);
+  const auto& qualified_name = method->get_deobfuscated_name();
+  return method_matcher.matches(
+      method_name_and_type_start(qualified_name),
+      qualified_name.c_str() + qualified_name.size());
 }
 
 void keep_clinits(DexClass* cls) {
@@ -500,9 +743,9 @@ void KeepRuleMatcher::keep_methods(
     bool apply_modifiers,
     const redex::MemberSpecification& methodSpecification,
     const Container& methods,
-    const boost::regex& method_regex) {
+    const MemberMatcher& method_matcher) {
   for (DexMethod* method : methods) {
-    if (method_level_match(methodSpecification, method, method_regex)) {
+    if (method_level_match(methodSpecification, method, method_matcher)) {
       if (apply_modifiers) {
         apply_keep_modifiers(m_keep_rule, method);
       }
@@ -521,16 +764,23 @@ std::string method_regex(const MemberSpecification& method_spec) {
   return qualified_method_regex;
 }
 
+MemberMatcher KeepRuleMatcher::method_matcher(
+    const MemberSpecification& method_spec) const {
+  const auto* dfa =
+      WildcardMatcher::for_member(method_spec.name, method_spec.descriptor);
+  if (dfa != nullptr) {
+    return MemberMatcher(dfa);
+  }
+  return MemberMatcher(&register_matcher(method_regex(method_spec)));
+}
+
 void KeepRuleMatcher::apply_method_keeps(const DexClass* cls,
                                          bool apply_modifiers) {
   auto methodSpecifications = m_keep_rule.class_spec.methodSpecifications;
   for (auto& method_spec : methodSpecifications) {
-    auto qualified_method_regex = method_regex(method_spec);
-    const boost::regex& method_regex = register_matcher(qualified_method_regex);
-    keep_methods(apply_modifiers, method_spec, cls->get_vmethods(),
-                 method_regex);
-    keep_methods(apply_modifiers, method_spec, cls->get_dmethods(),
-                 method_regex);
+    auto matcher = method_matcher(method_spec);
+    keep_methods(apply_modifiers, method_spec, cls->get_vmethods(), matcher);
+    keep_methods(apply_modifiers, method_spec, cls->get_dmethods(), matcher);
   }
 }
 
@@ -543,11 +793,87 @@ bool classname_contains_wildcard(const std::string& classname) {
   return false;
 }
 
+// Whether the classes a rule applies to can be found without looking at the
+// whole scope.
+bool has_literal_class(const KeepSpec& keep_rule) {
+  const auto& class_spec = keep_rule.class_spec;
+  return !classname_contains_wildcard(class_spec.className) ||
+         (!class_spec.extendsClassName.empty() &&
+          !classname_contains_wildcard(class_spec.extendsClassName));
+}
+
+// Identifies the part of a class specification that ClassMatcher looks at,
+// i.e. everything but the member specifications.
+std::string class_match_key(const ClassSpecification& class_spec,
+                            bool process_external) {
+  std::ostringstream ss;
+  ss << process_external << ' ' << uint32_t(class_spec.setAccessFlags) << ' '
+     << uint32_t(class_spec.unsetAccessFlags) << '\n'
+     << class_spec.annotationType << '\n'
+     << class_spec.className << '\n'
+     << class_spec.extendsAnnotationType << '\n'
+     << class_spec.extendsClassName << '\n';
+  return ss.str();
+}
+
+std::string member_key(const MemberSpecification& member_spec) {
+  std::ostringstream ss;
+  ss << uint32_t(member_spec.requiredSetAccessFlags) << ' '
+     << uint32_t(member_spec.requiredUnsetAccessFlags) << '\t'
+     << member_spec.annotationType << '\t' << member_spec.name << '\t'
+     << member_spec.descriptor << '\n';
+  return ss.str();
+}
+
+// Two rules with the same key have the same effect: the member specifications
+// are applied independently of each other, so their order doesn't matter.
+std::string canonical_rule_key(const KeepSpec& keep_rule) {
+  std::ostringstream ss;
+  ss << keep_rule.includedescriptorclasses << keep_rule.allowshrinking
+     << keep_rule.allowoptimization << keep_rule.allowobfuscation
+     << keep_rule.mark_classes << keep_rule.mark_conditionally
+     << class_match_key(keep_rule.class_spec, false);
+  const auto& class_spec = keep_rule.class_spec;
+  for (const auto* member_specs : {&class_spec.fieldSpecifications,
+                                   &class_spec.methodSpecifications}) {
+    std::vector<std::string> keys;
+    for (const auto& member_spec : *member_specs) {
+      keys.push_back(member_key(member_spec));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    ss << keys.size() << '\n';
+    for (const auto& key : keys) {
+      ss << key;
+    }
+  }
+  return ss.str();
+}
+
+// Gives a rule that was not matched the counts of the equivalent rule that was,
+// for the configuration printed with the seeds.
+void copy_counts(const KeepSpec& from, const KeepSpec& to) {
+  to.count = from.count;
+  auto copy_member_counts = [](const std::vector<MemberSpecification>& from,
+                               const std::vector<MemberSpecification>& to) {
+    for (const auto& member_spec : to) {
+      auto it = std::find(from.begin(), from.end(), member_spec);
+      if (it != from.end()) {
+        member_spec.count = it->count;
+      }
+    }
+  };
+  copy_member_counts(from.class_spec.fieldSpecifications,
+                     to.class_spec.fieldSpecifications);
+  copy_member_counts(from.class_spec.methodSpecifications,
+                     to.class_spec.methodSpecifications);
+}
+
 bool KeepRuleMatcher::any_method_matches(const DexClass* cls,
                                          const MemberSpecification& method_keep,
-                                         const boost::regex& method_regex) {
+                                         const MemberMatcher& method_matcher) {
   auto match = [&](const DexMethod* method) {
-    return method_level_match(method_keep, method, method_regex);
+    return method_level_match(method_keep, method, method_matcher);
   };
   return std::any_of(cls->get_vmethods().begin(), cls->get_vmethods().end(),
                      match) ||
@@ -561,17 +887,14 @@ bool KeepRuleMatcher::all_method_keeps_match(
   return std::all_of(method_keeps.begin(),
                      method_keeps.end(),
                      [&](const MemberSpecification& method_keep) {
-                       auto qualified_method_regex = method_regex(method_keep);
-                       const boost::regex& matcher =
-                           register_matcher(qualified_method_regex);
-                       return any_method_matches(cls, method_keep, matcher);
+                       return any_method_matches(cls, method_keep,
+                                                 method_matcher(method_keep));
                      });
 }
 
 bool KeepRuleMatcher::any_field_matches(const DexClass* cls,
                                         const MemberSpecification& field_keep) {
-  auto fieldtype_regex = field_regex(field_keep);
-  const boost::regex& matcher = register_matcher(fieldtype_regex);
+  auto matcher = field_matcher(field_keep);
   auto match = [&](const DexField* field) {
     return field_level_match(field_keep, field, matcher);
   };
@@ -736,76 +1059,192 @@ DexClass* ProguardMatcher::find_single_class(
   return type_class(typ);
 }
 
-void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
-                                   RuleType rule_type,
-                                   bool process_external) {
-  Timer t("Process keep for " + to_string(rule_type));
+std::vector<DexClass*> ProguardMatcher::sort_by_deobfuscated_name(
+    const Scope& scope) {
+  std::vector<DexClass*> sorted;
+  sorted.reserve(scope.size());
+  for (auto* cls : scope) {
+    if (cls != nullptr) {
+      sorted.push_back(cls);
+    }
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const DexClass* a, const DexClass* b) {
+              return a->get_deobfuscated_name() < b->get_deobfuscated_name();
+            });
+  return sorted;
+}
+
+std::pair<std::vector<DexClass*>::const_iterator,
+          std::vector<DexClass*>::const_iterator>
+ProguardMatcher::classes_with_prefix(const std::vector<DexClass*>& sorted,
+                                     const std::string& prefix) {
+  auto begin = std::lower_bound(
+      sorted.begin(), sorted.end(), prefix,
+      [](const DexClass* cls, const std::string& p) {
+        return cls->get_deobfuscated_name() < p;
+      });
+  auto end = std::find_if(begin, sorted.end(), [&](const DexClass* cls) {
+    return cls->get_deobfuscated_name().compare(0, prefix.size(), prefix) != 0;
+  });
+  return {begin, end};
+}
 
-  auto process_single_keep = [rule_type, process_external](
-                                 ClassMatcher& class_match,
-                                 const KeepSpec& keep_rule, DexClass* cls,
-                                 RegexMap& regex_map) {
+ProguardMatcher::ClassMatches ProguardMatcher::match_classes(
+    const KeepSpec& keep_rule, bool process_external) const {
+  ClassMatches matches;
+  ClassMatcher class_match(keep_rule);
+  auto test = [&](DexClass* cls) {
     // Skip external classes.
     if (cls == nullptr || (!process_external && cls->is_external())) {
       return;
     }
+    matches.candidates++;
     if (class_match.match(cls)) {
-      KeepRuleMatcher rule_matcher(rule_type, keep_rule, regex_map);
-      rule_matcher.keep_processor(cls);
+      matches.classes.push_back(cls);
     }
   };
 
-  // We only parallelize if keep_rule needs to be applied to all classes.
-  auto wq = workqueue_foreach<const KeepSpec*>([&](const KeepSpec* keep_rule) {
-    RegexMap regex_map;
-    ClassMatcher class_match(*keep_rule);
-
-    for (const auto& cls : m_classes) {
-      process_single_keep(class_match, *keep_rule, cls, regex_map);
+  // These cases are very fast.
+  const auto& className = keep_rule.class_spec.className;
+  if (!classname_contains_wildcard(className)) {
+    test(find_single_class(className));
+    return matches;
+  }
+  const auto& extendsClassName = keep_rule.class_spec.extendsClassName;
+  if (extendsClassName != "" &&
+      !classname_contains_wildcard(extendsClassName)) {
+    DexClass* super = find_single_class(extendsClassName);
+    if (super != nullptr) {
+      TypeSet children;
+      get_all_children(m_hierarchy, super->get_type(), children);
+      test(super);
+      for (auto const* type : children) {
+        test(type_class(type));
+      }
     }
+    return matches;
+  }
+
+  // With a literal prefix, only look at the classes in that package (or
+  // with that name prefix); the name filter then rejects most of the
+  // remaining non-matches before any regex runs.
+  const auto& filter = class_match.name_filter();
+  if (filter && !filter->prefix().empty()) {
+    auto range = classes_with_prefix(m_classes_by_name, filter->prefix());
+    std::for_each(range.first, range.second, test);
     if (process_external) {
-      for (const auto& cls : m_external_classes) {
-        process_single_keep(class_match, *keep_rule, cls, regex_map);
-      }
+      range =
+          classes_with_prefix(m_external_classes_by_name, filter->prefix());
+      std::for_each(range.first, range.second, test);
     }
-  });
+    return matches;
+  }
 
-  RegexMap regex_map;
-  for (const auto& keep_rule_ptr : keep_rules) {
-    const auto& keep_rule = *keep_rule_ptr;
-    ClassMatcher class_match(keep_rule);
-
-    // This case is very fast. Just process it immediately in the main thread.
-    const auto& className = keep_rule.class_spec.className;
-    if (!classname_contains_wildcard(className)) {
-      DexClass* cls = find_single_class(className);
-      process_single_keep(class_match, keep_rule, cls, regex_map);
+  for (const auto& cls : m_classes) {
+    test(cls);
+  }
+  if (process_external) {
+    for (const auto& cls : m_external_classes) {
+      test(cls);
+    }
+  }
+  return matches;
+}
+
+void ProguardMatcher::process_keep(const KeepSpecSet& keep_rules,
+                                   RuleType rule_type,
+                                   bool process_external) {
+  Timer t("Process keep for " + to_string(rule_type));
+
+  // Only match one of the rules that have the same effect.
+  std::vector<const KeepSpec*> rules;
+  std::vector<std::pair<const KeepSpec*, const KeepSpec*>> duplicates;
+  std::unordered_map<std::string, const KeepSpec*> rules_by_key;
+  for (const auto* keep_rule : keep_rules) {
+    auto p = rules_by_key.emplace(canonical_rule_key(*keep_rule), keep_rule);
+    if (!p.second) {
+      duplicates.emplace_back(p.first->second, keep_rule);
       continue;
     }
+    rules.push_back(keep_rule);
+  }
+  m_stats.duplicate_rules += duplicates.size();
 
-    // This is also very fast. Process it in the main thread, too.
-    const auto& extendsClassName = keep_rule.class_spec.extendsClassName;
-    if (extendsClassName != "" &&
-        !classname_contains_wildcard(extendsClassName)) {
-      DexClass* super = find_single_class(extendsClassName);
-      if (super != nullptr) {
-        TypeSet children;
-        get_all_children(m_hierarchy, super->get_type(), children);
-        process_single_keep(class_match, keep_rule, super, regex_map);
-        for (auto const* type : children) {
-          process_single_keep(class_match, keep_rule, type_class(type),
-                              regex_map);
-        }
+  auto apply_rule = [rule_type](const KeepSpec& keep_rule,
+                                const ClassMatches& matches,
+                                RegexMap& regex_map) {
+    for (auto* cls : matches.classes) {
+      KeepRuleMatcher rule_matcher(rule_type, keep_rule, regex_map);
+      rule_matcher.keep_processor(cls);
+    }
+  };
+
+  // Rules whose classes are quickly found are processed immediately in the
+  // main thread. The others are processed in parallel, grouped by their
+  // class-level match so that each group only matches the scope once.
+  std::vector<std::string> slow_keys;
+  std::unordered_map<std::string, std::vector<const KeepSpec*>> slow_rules;
+  RegexMap regex_map;
+  for (const auto* keep_rule : rules) {
+    auto key = class_match_key(keep_rule->class_spec, process_external);
+    if (!has_literal_class(*keep_rule)) {
+      TRACE(PGR, 2, "Slow rule: %s\n", show_keep(*keep_rule).c_str());
+      auto& group = slow_rules[key];
+      if (group.empty()) {
+        slow_keys.push_back(key);
       }
+      group.push_back(keep_rule);
       continue;
     }
-
-    TRACE(PGR, 2, "Slow rule: %s\n", show_keep(keep_rule).c_str());
-    // Otherwise, it might take a longer time. Add to the work queue.
-    wq.add_item(&keep_rule);
+    auto it = m_class_matches.find(key);
+    if (it == m_class_matches.end()) {
+      it = m_class_matches
+               .emplace(key, match_classes(*keep_rule, process_external))
+               .first;
+      m_stats.class_matches++;
+    } else {
+      m_stats.cached_class_matches++;
+      m_stats.classes_not_retested += it->second.candidates;
+    }
+    apply_rule(*keep_rule, it->second, regex_map);
   }
 
+  std::vector<ClassMatches> slow_matches(slow_keys.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    const auto& group = slow_rules.at(slow_keys[i]);
+    // The cache is only written to after the work queue is done.
+    auto it = m_class_matches.find(slow_keys[i]);
+    const ClassMatches* matches = &slow_matches[i];
+    if (it != m_class_matches.end()) {
+      matches = &it->second;
+    } else {
+      slow_matches[i] = match_classes(*group.front(), process_external);
+    }
+    RegexMap regex_map;
+    for (const auto* keep_rule : group) {
+      apply_rule(*keep_rule, *matches, regex_map);
+    }
+  });
+  for (size_t i = 0; i < slow_keys.size(); ++i) {
+    wq.add_item(i);
+  }
   wq.run_all();
+
+  for (size_t i = 0; i < slow_keys.size(); ++i) {
+    auto group_size = slow_rules.at(slow_keys[i]).size();
+    auto p = m_class_matches.emplace(slow_keys[i], std::move(slow_matches[i]));
+    if (p.second) {
+      m_stats.class_matches++;
+      group_size--;
+    }
+    m_stats.cached_class_matches += group_size;
+    m_stats.classes_not_retested += group_size * p.first->second.candidates;
+  }
+
+  for (const auto& p : duplicates) {
+    copy_counts(*p.first, *p.second);
+  }
 }
 
 void ProguardMatcher::process_proguard_rules(
@@ -817,6 +1256,11 @@ void ProguardMatcher::process_proguard_rules(
   process_keep(pg_config.assumenosideeffects_rules,
                RuleType::ASSUME_NO_SIDE_EFFECTS,
                /* process_external = */ true);
+  TRACE(PGR, 1,
+        "Keep rules: %zu duplicates skipped, %zu class-level matches, %zu "
+        "reused, %zu class tests saved\n",
+        m_stats.duplicate_rules, m_stats.class_matches,
+        m_stats.cached_class_matches, m_stats.classes_not_retested);
 }
 
 void ProguardMatcher::mark_all_annotation_classes_as_keep() {
@@ -840,16 +1284,18 @@ void ProguardMatcher::mark_all_annotation_classes_as_keep() {
 
 namespace redex {
 
-void process_proguard_rules(const ProguardMap& pg_map,
-                            const Scope& classes,
-                            const Scope& external_classes,
-                            const ProguardConfiguration& pg_config,
-                            bool keep_all_annotation_classes) {
+KeepRuleMatchStats process_proguard_rules(
+    const ProguardMap& pg_map,
+    const Scope& classes,
+    const Scope& external_classes,
+    const ProguardConfiguration& pg_config,
+    bool keep_all_annotation_classes) {
   ProguardMatcher pg_matcher(pg_map, classes, external_classes);
   pg_matcher.process_proguard_rules(pg_config);
   if (keep_all_annotation_classes) {
     pg_matcher.mark_all_annotation_classes_as_keep();
   }
+  return pg_matcher.stats();
 }
 
 } // namespace redex
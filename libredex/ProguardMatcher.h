@@ -15,9 +15,22 @@ namespace redex {
 
 using Scope = std::vector<DexClass*>;
 
-void process_proguard_rules(const ProguardMap& pg_map,
-                            const Scope& classes,
-                            const Scope& external_classes,
-                            const ProguardConfiguration& pg_config,
-                            bool keep_all_annotation_classes);
+struct KeepRuleMatchStats {
+  // Rules that were not matched because an equivalent rule, with the same
+  // member specifications in another order, was.
+  size_t duplicate_rules{0};
+  // Class-level matches that were computed, and that were reused by rules with
+  // the same class specification.
+  size_t class_matches{0};
+  size_t cached_class_matches{0};
+  // The classes that the reused matches didn't have to test again.
+  size_t classes_not_retested{0};
+};
+
+KeepRuleMatchStats process_proguard_rules(
+    const ProguardMap& pg_map,
+    const Scope& classes,
+    const Scope& external_classes,
+    const ProguardConfiguration& pg_config,
+    bool keep_all_annotation_classes);
 } // namespace redex
@@ -12,6 +12,7 @@
 #include "ProguardMap.h"
 #include "ProguardParser.h"
 #include "ProguardRegex.h"
+#include "WorkQueue.h"
 
 namespace redex {
 namespace proguard_parser {
@@ -973,13 +974,12 @@ void parse(std::vector<unique_ptr<Token>>::iterator it,
   }
 }
 
-void parse(istream& config,
+void parse(std::vector<unique_ptr<Token>>* tokens,
            ProguardConfiguration* pg_config,
            const std::string& filename) {
-  std::vector<unique_ptr<Token>> tokens = lex(config);
   bool ok = true;
   // Check for bad tokens.
-  for (auto& tok : tokens) {
+  for (auto& tok : *tokens) {
     if (tok->type == token::unknownToken) {
       std::string spelling =
           static_cast<UnknownToken*>(tok.get())->token_string;
@@ -989,7 +989,7 @@ void parse(istream& config,
   }
   unsigned int parse_errors = 0;
   if (ok) {
-    parse(tokens.begin(), tokens.end(), pg_config, &parse_errors, filename);
+    parse(tokens->begin(), tokens->end(), pg_config, &parse_errors, filename);
   }
 
   if (parse_errors == 0) {
@@ -1000,28 +1000,87 @@ void parse(istream& config,
   }
 }
 
-void parse_file(const std::string& filename, ProguardConfiguration* pg_config) {
+void parse(istream& config,
+           ProguardConfiguration* pg_config,
+           const std::string& filename) {
+  std::vector<unique_ptr<Token>> tokens = lex(config);
+  parse(&tokens, pg_config, filename);
+}
+
+struct LexedFile {
+  bool opened{false};
+  // Whether the file was only found under the -basedirectory.
+  bool in_basedirectory{false};
+  std::vector<unique_ptr<Token>> tokens;
+};
+
+LexedFile lex_file(const std::string& filename,
+                   const std::string& basedirectory) {
+  LexedFile lexed;
   ifstream config(filename);
   // First try relative path.
   if (!config.is_open()) {
     // Try with -basedirectory
-    config.open(pg_config->basedirectory + "/" + filename);
+    config.open(basedirectory + "/" + filename);
     if (!config.is_open()) {
-      cerr << "ERROR: Failed to open ProGuard configuration file " << filename
-           << endl;
-      exit(1);
+      return lexed;
     }
+    lexed.in_basedirectory = true;
   }
+  lexed.opened = true;
+  lexed.tokens = lex(config);
+  return lexed;
+}
 
-  parse(config, pg_config, filename);
-  // Parse the included files.
-  for (const auto& included_filename : pg_config->includes) {
-    if (pg_config->already_included.find(included_filename) !=
-        pg_config->already_included.end()) {
-      continue;
+void parse_lexed_file(const std::string& filename,
+                      LexedFile* lexed,
+                      ProguardConfiguration* pg_config) {
+  if (!lexed->opened) {
+    cerr << "ERROR: Failed to open ProGuard configuration file " << filename
+         << endl;
+    exit(1);
+  }
+  parse(&lexed->tokens, pg_config, filename);
+}
+
+void parse_file(const std::string& filename, ProguardConfiguration* pg_config) {
+  auto root = lex_file(filename, pg_config->basedirectory);
+  parse_lexed_file(filename, &root, pg_config);
+
+  // The included files are parsed in the order they are included in, which is
+  // breadth first, since the files that a file includes go at the end of the
+  // list. All the files that are known at one point are lexed in parallel, and
+  // then parsed in order into the configuration.
+  size_t next = 0;
+  while (next < pg_config->includes.size()) {
+    std::vector<std::string> batch;
+    for (; next < pg_config->includes.size(); ++next) {
+      const auto& included_filename = pg_config->includes[next];
+      if (pg_config->already_included.emplace(included_filename).second) {
+        batch.push_back(included_filename);
+      }
+    }
+    const auto basedirectory = pg_config->basedirectory;
+    std::vector<LexedFile> lexed(batch.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      lexed[i] = lex_file(batch[i], basedirectory);
+    });
+    for (size_t i = 0; i < batch.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      // A file of the batch may have changed the -basedirectory that the
+      // files after it are looked up in.
+      if (pg_config->basedirectory != basedirectory &&
+          (!lexed[i].opened || lexed[i].in_basedirectory)) {
+        lexed[i] = lex_file(batch[i], pg_config->basedirectory);
+      }
+      parse_lexed_file(batch[i], &lexed[i], pg_config);
+      // Free the tokens as we go.
+      lexed[i] = LexedFile();
     }
-    pg_config->already_included.emplace(included_filename);
-    parse_file(included_filename, pg_config);
   }
 }
 
@@ -5,8 +5,13 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <bitset>
 #include <cstring>
+#include <map>
+#include <memory>
 
+#include "ConcurrentContainers.h"
 #include "ProguardRegex.h"
 #include "ProguardMap.h"
 
@@ -172,5 +177,307 @@ std::string convert_wildcard_type(std::string typ) {
   return wildcard_descriptor;
 }
 
+namespace {
+
+using CharSet = std::bitset<256>;
+
+CharSet chars_of(const char* chars) {
+  CharSet set;
+  for (const char* c = chars; *c; ++c) {
+    set.set(static_cast<uint8_t>(*c));
+  }
+  return set;
+}
+
+CharSet any_char() { return CharSet().set(); }
+
+CharSet any_char_except(const char* chars) { return ~chars_of(chars); }
+
+// Characters that form_*_regex pass through unescaped but that mean something
+// to boost::regex. We don't try to reproduce their effect.
+bool is_regex_metachar(char ch) {
+  return strchr("^+{}|\\]", ch) != nullptr;
+}
+
+} // namespace
+
+/*
+ * Thompson-constructs an NFA for a pattern, following the translation done by
+ * form_member_regex / form_type_regex construct by construct, and then turns
+ * it into a DFA by subset construction.
+ */
+class WildcardMatcherBuilder {
+ public:
+  WildcardMatcherBuilder() { m_frag = empty(); }
+
+  bool add_member_name(const std::string& name) {
+    if (name.empty()) {
+      append(star(set(any_char())));
+      return true;
+    }
+    for (char ch : name) {
+      if (ch == '*') {
+        append(star(set(any_char())));
+      } else if (ch == '?' || ch == '.') {
+        append(set(any_char()));
+      } else if (ch == '$' || ch == '(' || ch == ')' || ch == '[' ||
+                 is_regex_metachar(ch)) {
+        return false;
+      } else {
+        add_literal(ch);
+      }
+    }
+    return true;
+  }
+
+  bool add_type(std::string pattern) {
+    if (pattern.empty()) {
+      append(star(set(any_char())));
+      return true;
+    }
+    if (pattern == "L*;") {
+      pattern = "L**;";
+    }
+    for (size_t i = 0; i < pattern.size(); i++) {
+      const char ch = pattern[i];
+      if (ch == '%') {
+        append(set(chars_of("BSIJZFDCV")));
+      } else if (ch == '?') {
+        append(set(any_char_except("/[")));
+      } else if (ch == '*') {
+        if (i + 2 < pattern.size() && pattern[i + 1] == '*' &&
+            pattern[i + 2] == '*') {
+          append(one_type("BSIJZFDCV"));
+          i += 2;
+        } else if (i + 1 < pattern.size() && pattern[i + 1] == '*') {
+          append(star(set(any_char_except("["))));
+          i++;
+        } else {
+          append(star(set(any_char_except("/["))));
+        }
+      } else if (ch == '.') {
+        if (i + 2 < pattern.size() && pattern[i + 1] == '.' &&
+            pattern[i + 2] == '.') {
+          append(star(one_type("BSIJZFDC")));
+          i += 2;
+        } else {
+          // An unescaped . in the regex.
+          append(set(any_char()));
+        }
+      } else if (is_regex_metachar(ch)) {
+        return false;
+      } else {
+        add_literal(ch);
+      }
+    }
+    return true;
+  }
+
+  void add_literal(char ch) {
+    CharSet chars;
+    chars.set(static_cast<uint8_t>(ch));
+    append(set(chars));
+  }
+
+  /*
+   * Returns nullptr if the DFA would be unreasonably large.
+   */
+  std::unique_ptr<WildcardMatcher> build() const {
+    constexpr size_t kMaxStates = 4096;
+    std::unique_ptr<WildcardMatcher> dfa(new WildcardMatcher());
+
+    // Bytes that belong to exactly the same sets behave the same.
+    std::map<std::vector<bool>, uint8_t> signatures;
+    std::vector<uint8_t> representatives;
+    for (size_t b = 0; b < 256; ++b) {
+      std::vector<bool> signature(m_sets.size());
+      for (size_t i = 0; i < m_sets.size(); ++i) {
+        signature[i] = m_sets[i].test(b);
+      }
+      auto it = signatures.find(signature);
+      if (it == signatures.end()) {
+        it = signatures.emplace(signature, representatives.size()).first;
+        representatives.push_back(b);
+      }
+      dfa->m_byte_class[b] = it->second;
+    }
+    dfa->m_num_classes = representatives.size();
+
+    std::map<std::vector<uint32_t>, uint32_t> ids;
+    std::vector<std::vector<uint32_t>> subsets;
+    auto intern = [&](std::vector<uint32_t> subset) {
+      auto it = ids.find(subset);
+      if (it != ids.end()) {
+        return it->second;
+      }
+      uint32_t id = subsets.size();
+      ids.emplace(subset, id);
+      subsets.push_back(std::move(subset));
+      return id;
+    };
+    intern({}); // kDeadState
+    dfa->m_start = intern(closure({m_frag.start}));
+    for (uint32_t id = 0; id < subsets.size(); ++id) {
+      if (subsets.size() > kMaxStates) {
+        return nullptr;
+      }
+      for (uint8_t b : representatives) {
+        std::vector<uint32_t> moved;
+        for (uint32_t n : subsets[id]) {
+          const auto& state = m_states[n];
+          if (state.set >= 0 && m_sets[state.set].test(b)) {
+            moved.push_back(state.next);
+          }
+        }
+        uint32_t next = intern(closure(std::move(moved)));
+        dfa->m_transitions.push_back(next);
+      }
+    }
+    for (const auto& subset : subsets) {
+      dfa->m_accepting.push_back(
+          std::binary_search(subset.begin(), subset.end(), m_frag.end));
+    }
+    return dfa;
+  }
+
+ private:
+  struct Frag {
+    uint32_t start;
+    uint32_t end;
+  };
+
+  struct NfaState {
+    int set{-1}; // index into m_sets of the one labelled edge, if any
+    uint32_t next{0};
+    std::vector<uint32_t> eps;
+  };
+
+  uint32_t new_state() {
+    m_states.emplace_back();
+    return m_states.size() - 1;
+  }
+
+  Frag empty() {
+    auto s = new_state();
+    return {s, s};
+  }
+
+  Frag set(const CharSet& chars) {
+    auto s = new_state();
+    auto e = new_state();
+    auto it = std::find(m_sets.begin(), m_sets.end(), chars);
+    if (it == m_sets.end()) {
+      it = m_sets.insert(m_sets.end(), chars);
+    }
+    m_states[s].set = it - m_sets.begin();
+    m_states[s].next = e;
+    return {s, e};
+  }
+
+  Frag concat(Frag a, Frag b) {
+    m_states[a.end].eps.push_back(b.start);
+    return {a.start, b.end};
+  }
+
+  Frag alt(Frag a, Frag b) {
+    auto s = new_state();
+    auto e = new_state();
+    m_states[s].eps = {a.start, b.start};
+    m_states[a.end].eps.push_back(e);
+    m_states[b.end].eps.push_back(e);
+    return {s, e};
+  }
+
+  Frag star(Frag a) {
+    auto s = new_state();
+    auto e = new_state();
+    m_states[s].eps = {a.start, e};
+    m_states[a.end].eps.push_back(a.start);
+    m_states[a.end].eps.push_back(e);
+    return {s, e};
+  }
+
+  // \[*(?:<prims>|L.*;)
+  Frag one_type(const char* prims) {
+    auto class_type =
+        concat(concat(set(chars_of("L")), star(set(any_char()))),
+               set(chars_of(";")));
+    return concat(star(set(chars_of("["))),
+                  alt(set(chars_of(prims)), class_type));
+  }
+
+  void append(Frag f) { m_frag = concat(m_frag, f); }
+
+  std::vector<uint32_t> closure(std::vector<uint32_t> states) const {
+    std::vector<bool> seen(m_states.size());
+    std::vector<uint32_t> stack;
+    for (auto s : states) {
+      if (!seen[s]) {
+        seen[s] = true;
+        stack.push_back(s);
+      }
+    }
+    std::vector<uint32_t> result;
+    while (!stack.empty()) {
+      auto s = stack.back();
+      stack.pop_back();
+      result.push_back(s);
+      for (auto t : m_states[s].eps) {
+        if (!seen[t]) {
+          seen[t] = true;
+          stack.push_back(t);
+        }
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  std::vector<NfaState> m_states;
+  std::vector<CharSet> m_sets;
+  Frag m_frag;
+};
+
+namespace {
+
+using MatcherCache =
+    InsertOnlyConcurrentMap<std::string, std::unique_ptr<WildcardMatcher>>;
+
+template <typename Compile>
+const WildcardMatcher* get_or_compile(const std::string& key,
+                                      const Compile& compile) {
+  // Leaked on purpose; matchers are handed out for the life of the process.
+  static auto* cache = new MatcherCache();
+  if (!cache->count(key)) {
+    // If another thread wins the race, its matcher is the one we return.
+    cache->emplace(key, compile());
+  }
+  return cache->at(key).get();
+}
+
+} // namespace
+
+const WildcardMatcher* WildcardMatcher::for_type(const std::string& pattern) {
+  return get_or_compile("T" + pattern, [&] {
+    WildcardMatcherBuilder builder;
+    return builder.add_type(pattern) ? builder.build() : nullptr;
+  });
+}
+
+const WildcardMatcher* WildcardMatcher::for_member(
+    const std::string& name, const std::string& descriptor) {
+  std::string key = "M" + name;
+  key += '\0';
+  key += descriptor;
+  return get_or_compile(key, [&] {
+    WildcardMatcherBuilder builder;
+    if (!builder.add_member_name(name)) {
+      return std::unique_ptr<WildcardMatcher>();
+    }
+    builder.add_literal(':');
+    return builder.add_type(descriptor) ? builder.build() : nullptr;
+  });
+}
+
 } // namespace proguard_parser
 } // namespace redex
@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
 
 namespace redex {
 namespace proguard_parser {
@@ -16,5 +20,57 @@ std::string form_member_regex(std::string proguard_regex);
 std::string form_type_regex(std::string proguard_regex);
 std::string convert_wildcard_type(std::string typ);
 
+/*
+ * A DFA for a ProGuard wildcard pattern. It accepts exactly the strings that
+ * boost::regex_match accepts for the regex strings built above, but runs in
+ * linear time without allocating or copying the subject.
+ *
+ * Matchers are compiled once per distinct pattern and shared; the accessors
+ * are thread-safe, and the returned pointers stay valid for the life of the
+ * process. They return nullptr for patterns that use syntax outside the
+ * wildcard grammar (e.g. stray regex metacharacters in member names), in
+ * which case callers have to fall back to boost::regex.
+ */
+class WildcardMatcher {
+ public:
+  // Same language as form_type_regex(pattern).
+  static const WildcardMatcher* for_type(const std::string& pattern);
+
+  // Same language as form_member_regex(name) + "\\:" +
+  // form_type_regex(descriptor), i.e. "name:descriptor" strings.
+  static const WildcardMatcher* for_member(const std::string& name,
+                                           const std::string& descriptor);
+
+  bool matches(const char* begin, const char* end) const {
+    uint32_t state = m_start;
+    for (const char* p = begin; p != end; ++p) {
+      state = m_transitions[state * m_num_classes +
+                            m_byte_class[static_cast<uint8_t>(*p)]];
+      if (state == kDeadState) {
+        return false;
+      }
+    }
+    return m_accepting[state];
+  }
+  bool matches(const char* s) const { return matches(s, s + strlen(s)); }
+  bool matches(const std::string& s) const {
+    return matches(s.data(), s.data() + s.size());
+  }
+
+  size_t num_states() const { return m_accepting.size(); }
+
+ private:
+  friend class WildcardMatcherBuilder;
+  WildcardMatcher() = default;
+
+  static constexpr uint32_t kDeadState = 0;
+
+  std::array<uint8_t, 256> m_byte_class;
+  uint32_t m_num_classes{0};
+  uint32_t m_start{0};
+  std::vector<uint32_t> m_transitions;
+  std::vector<bool> m_accepting;
+};
+
 } // namespace proguard_parser
 } // namespace redex
@@ -180,8 +180,7 @@ void RootSetMarker::record_is_seed(Seed* seed) {
  */
 void RootSetMarker::mark_external_method_overriders() {
   std::unordered_set<const DexMethod*> visited;
-  for (auto& pair : m_method_override_graph.nodes()) {
-    auto method = pair.first;
+  for (auto* method : m_method_override_graph.methods()) {
     if (!method->is_external() || visited.count(method)) {
       continue;
     }
@@ -243,10 +242,9 @@ void TransitiveClosureMarker::push(const Parent* parent, const DexClass* cls) {
     return;
   }
   record_reachability(parent, cls);
-  if (m_reachable_objects->marked(cls)) {
+  if (!m_reachable_objects->mark(cls)) {
     return;
   }
-  m_reachable_objects->mark(cls);
   m_worker_state->push_task(ReachableObject(cls));
 }
 
@@ -257,13 +255,12 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, field);
-  if (m_reachable_objects->marked(field)) {
+  if (!m_reachable_objects->mark(field)) {
     return;
   }
   if (field->is_def()) {
     gather_and_push(static_cast<const DexField*>(field));
   }
-  m_reachable_objects->mark(field);
   m_worker_state->push_task(ReachableObject(field));
 }
 
@@ -274,10 +271,9 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, method);
-  if (m_reachable_objects->marked(method)) {
+  if (!m_reachable_objects->mark(method)) {
     return;
   }
-  m_reachable_objects->mark(method);
   m_worker_state->push_task(ReachableObject(method));
 }
 
@@ -312,7 +308,51 @@ References TransitiveClosureMarker::gather(const DexAnnotation* anno) const {
 }
 
 References TransitiveClosureMarker::gather(const DexMethod* method) const {
-  return generic_gather(method);
+  if (m_code_refs_cache == nullptr) {
+    return generic_gather(method);
+  }
+  auto refs = m_code_refs_cache->get(method);
+  auto gather_anno_set = [&refs](const DexAnnotationSet* anno_set) {
+    anno_set->gather_strings(refs.strings);
+    anno_set->gather_types(refs.types);
+    anno_set->gather_fields(refs.fields);
+    anno_set->gather_methods(refs.methods);
+  };
+  if (auto anno_set = method->get_anno_set()) {
+    gather_anno_set(anno_set);
+  }
+  if (auto param_anno = method->get_param_anno()) {
+    for (const auto& pair : *param_anno) {
+      gather_anno_set(pair.second);
+    }
+  }
+  return refs;
+}
+
+static References gather_code(const DexMethod* method) {
+  References refs;
+  method->gather_code_strings(refs.strings);
+  method->gather_code_types(refs.types);
+  method->gather_code_fields(refs.fields);
+  method->gather_code_methods(refs.methods);
+  return refs;
+}
+
+References CodeReferencesCache::get(const DexMethod* method) {
+  auto epoch = RedexContext::code_epoch();
+  if (epoch == 0) {
+    return gather_code(method);
+  }
+  auto id = method->get_dense_id();
+  auto entry = m_entries.get(id, Entry());
+  // Code asked for in the epoch of the gathering may have changed after it.
+  if (entry.refs && method->get_code_epoch() < entry.epoch) {
+    ++m_num_reused;
+    return *entry.refs;
+  }
+  auto refs = std::make_shared<const References>(gather_code(method));
+  m_entries.insert_or_assign(std::make_pair(id, Entry{epoch, refs}));
+  return *refs;
 }
 
 References TransitiveClosureMarker::gather(const DexField* field) const {
@@ -496,7 +536,8 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
     int* num_ignore_check_strings,
     bool record_reachability,
     bool should_mark_all_as_seed,
-    std::unique_ptr<const mog::Graph>* out_method_override_graph) {
+    std::unique_ptr<const mog::Graph>* out_method_override_graph,
+    CodeReferencesCache* code_refs_cache) {
   Timer t("Marking");
   auto scope = build_class_scope(stores);
   auto reachable_objects = std::make_unique<ReachableObjects>();
@@ -521,7 +562,8 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
       [&](MarkWorkerState* worker_state, const ReachableObject& obj) {
         TransitiveClosureMarker transitive_closure_marker(
             ignore_sets, *method_override_graph, record_reachability,
-            &cond_marked, reachable_objects.get(), worker_state);
+            &cond_marked, reachable_objects.get(), worker_state,
+            code_refs_cache);
         transitive_closure_marker.visit(obj);
         return nullptr;
       },
@@ -88,15 +88,64 @@ using ReachableObjectSet =
 using ReachableObjectGraph =
     ConcurrentMap<ReachableObject, ReachableObjectSet, ReachableObjectHash>;
 
+/*
+ * A set of classes, field refs or method refs. Those that already existed
+ * when the set was created -- nearly all of them during marking -- live in a
+ * bitmap indexed by their dense id, so that insertions and lookups are single
+ * atomic operations. Any created later go to a ConcurrentSet.
+ */
+template <class T>
+class MarkedSet {
+ public:
+  explicit MarkedSet(size_t num_ids) : m_bitmap(num_ids) {}
+
+  // Returns true if `obj` was not in the set yet.
+  bool insert(const T* obj) {
+    auto id = obj->get_dense_id();
+    if (id < m_bitmap.size()) {
+      return m_bitmap.insert(id);
+    }
+    return m_overflow.insert(obj);
+  }
+
+  bool count(const T* obj) const {
+    auto id = obj->get_dense_id();
+    if (id < m_bitmap.size()) {
+      return m_bitmap.contains(id);
+    }
+    return m_overflow.count(obj);
+  }
+
+  bool count_unsafe(const T* obj) const {
+    auto id = obj->get_dense_id();
+    if (id < m_bitmap.size()) {
+      return m_bitmap.contains(id);
+    }
+    return m_overflow.count_unsafe(obj);
+  }
+
+ private:
+  ConcurrentBitmap m_bitmap;
+  ConcurrentSet<const T*> m_overflow;
+};
+
 class ReachableObjects {
  public:
+  ReachableObjects()
+      : m_marked_classes(g_redex->num_class_ids()),
+        m_marked_fields(g_redex->num_field_ids()),
+        m_marked_methods(g_redex->num_method_ids()) {}
+
   const ReachableObjectGraph& retainers_of() const { return m_retainers_of; }
 
-  void mark(const DexClass* cls) { m_marked_classes.insert(cls); }
+  // The mark() functions return true if the object was not marked yet.
+  bool mark(const DexClass* cls) { return m_marked_classes.insert(cls); }
 
-  void mark(const DexMethodRef* method) { m_marked_methods.insert(method); }
+  bool mark(const DexMethodRef* method) {
+    return m_marked_methods.insert(method);
+  }
 
-  void mark(const DexFieldRef* field) { m_marked_fields.insert(field); }
+  bool mark(const DexFieldRef* field) { return m_marked_fields.insert(field); }
 
   bool marked(const DexClass* cls) const { return m_marked_classes.count(cls); }
 
@@ -134,9 +183,9 @@ class ReachableObjects {
 
   void record_reachability(const DexMethodRef* member, const DexClass* cls);
 
-  ConcurrentSet<const DexClass*> m_marked_classes;
-  ConcurrentSet<const DexFieldRef*> m_marked_fields;
-  ConcurrentSet<const DexMethodRef*> m_marked_methods;
+  MarkedSet<DexClass> m_marked_classes;
+  MarkedSet<DexFieldRef> m_marked_fields;
+  MarkedSet<DexMethodRef> m_marked_methods;
   ReachableObjectGraph m_retainers_of;
 
   friend class RootSetMarker;
@@ -155,6 +204,32 @@ struct References {
   std::vector<DexMethodRef*> methods;
 };
 
+/*
+ * What the code of each method refers to, kept from one marking to the next
+ * so that a method is only gathered again once a pass has asked for its code
+ * since, as the code epochs tell (see RedexContext::code_epoch()). Without
+ * code epochs nothing is kept. The annotations of a method can change
+ * without its code, so they are not part of this.
+ */
+class CodeReferencesCache {
+ public:
+  References get(const DexMethod* method);
+
+  // How many of the get() calls found what they asked for.
+  size_t num_reused() const { return m_num_reused; }
+
+ private:
+  struct Entry {
+    // The code epoch in which the references were gathered.
+    uint16_t epoch{0};
+    std::shared_ptr<const References> refs;
+  };
+
+  // By the dense id of the method, which isn't reused by others.
+  ConcurrentMap<uint32_t, Entry> m_entries;
+  std::atomic<size_t> m_num_reused{0};
+};
+
 struct Stats {
   int num_ignore_check_strings;
 };
@@ -237,13 +312,15 @@ class TransitiveClosureMarker {
       bool record_reachability,
       ConditionallyMarked* cond_marked,
       ReachableObjects* reachable_objects,
-      MarkWorkerState* worker_state)
+      MarkWorkerState* worker_state,
+      CodeReferencesCache* code_refs_cache = nullptr)
       : m_ignore_sets(ignore_sets),
         m_method_override_graph(method_override_graph),
         m_record_reachability(record_reachability),
         m_cond_marked(cond_marked),
         m_reachable_objects(reachable_objects),
-        m_worker_state(worker_state) {}
+        m_worker_state(worker_state),
+        m_code_refs_cache(code_refs_cache) {}
 
   virtual ~TransitiveClosureMarker() = default;
 
@@ -301,6 +378,7 @@ class TransitiveClosureMarker {
   ConditionallyMarked* m_cond_marked;
   ReachableObjects* m_reachable_objects;
   MarkWorkerState* m_worker_state;
+  CodeReferencesCache* m_code_refs_cache;
 };
 
 std::unique_ptr<ReachableObjects> compute_reachable_objects(
@@ -310,7 +388,8 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
     bool record_reachability = false,
     bool should_mark_all_as_seed = false,
     std::unique_ptr<const method_override_graph::Graph>*
-        out_method_override_graph = nullptr);
+        out_method_override_graph = nullptr,
+    CodeReferencesCache* code_refs_cache = nullptr);
 
 void sweep(DexStoresVector& stores,
            const ReachableObjects& reachables,
@@ -9,6 +9,7 @@
 
 #include <chrono>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <unordered_set>
@@ -108,7 +109,7 @@ void analyze_reflection(const Scope& scope) {
 
   const std::unordered_map<std::string,
                            std::unordered_map<std::string, ReflectionType>>
-      refls = {
+      refl_names = {
           {JAVA_LANG_CLASS,
            {
                {"getField", GET_FIELD},
@@ -134,6 +135,25 @@ void analyze_reflection(const Scope& scope) {
            }},
       };
 
+  // Every invoke of the app is matched against these, so they are keyed by
+  // their interned class and name rather than by strings. APIs that nothing
+  // references aren't interned and can't be called.
+  std::unordered_map<const DexType*,
+                     std::unordered_map<const DexString*, ReflectionType>>
+      refls;
+  for (const auto& cls_entry : refl_names) {
+    auto type = DexType::get_type(cls_entry.first);
+    if (type == nullptr) {
+      continue;
+    }
+    for (const auto& method_entry : cls_entry.second) {
+      auto name = DexString::get_string(method_entry.first);
+      if (name != nullptr) {
+        refls[type].emplace(name, method_entry.second);
+      }
+    }
+  }
+
   auto dex_string_lookup = [](const ReflectionAnalysis& analysis,
                               ReflectionType refl_type,
                               IRInstruction* insn) {
@@ -158,15 +178,12 @@ void analyze_reflection(const Scope& scope) {
       }
 
       // See if it matches something in refls
-      auto& method_name = insn->get_method()->get_name()->str();
-      auto& method_class_name =
-          insn->get_method()->get_class()->get_name()->str();
-      auto method_map = refls.find(method_class_name);
+      auto method_map = refls.find(insn->get_method()->get_class());
       if (method_map == refls.end()) {
         continue;
       }
 
-      auto refl_entry = method_map->second.find(method_name);
+      auto refl_entry = method_map->second.find(insn->get_method()->get_name());
       if (refl_entry == method_map->second.end()) {
         continue;
       }
@@ -192,7 +209,8 @@ void analyze_reflection(const Scope& scope) {
 
       TRACE(PGR, 4, "SRA ANALYZE: %s: type:%d %s.%s cls: %d %s %s str: %s\n",
             insn->get_method()->get_name()->str().c_str(), refl_type,
-            method_class_name.c_str(), method_name.c_str(), arg_cls->obj_kind,
+            SHOW(insn->get_method()->get_class()),
+            SHOW(insn->get_method()->get_name()), arg_cls->obj_kind,
             SHOW(arg_cls->dex_type), SHOW(arg_cls->dex_string),
             SHOW(arg_str_value));
 
@@ -823,3 +841,25 @@ std::string ReferencedState::str() const {
   s << m_keep_count;
   return s.str();
 }
+
+namespace {
+
+// Striped so that we don't need a mutex in every ReferencedState.
+constexpr size_t kKeepReasonLockCount = 64;
+std::mutex s_keep_reason_locks[kKeepReasonLockCount];
+
+} // namespace
+
+void ReferencedState::add_keep_reason(const keep_reason::Reason* reason) {
+  always_assert(RedexContext::record_keep_reasons());
+  // Drop the low bits, which are the same for all aligned addresses.
+  auto& lock = s_keep_reason_locks[(reinterpret_cast<uintptr_t>(this) >> 4) %
+                                   kKeepReasonLockCount];
+  std::lock_guard<std::mutex> guard(lock);
+  auto reasons = m_keep_reasons.load(std::memory_order_relaxed);
+  if (reasons == nullptr) {
+    reasons = new keep_reason::ReasonPtrSet();
+    m_keep_reasons.store(reasons, std::memory_order_release);
+  }
+  reasons->emplace(reason);
+}
@@ -7,6 +7,7 @@
 
 #include "RedexContext.h"
 
+#include <algorithm>
 #include <exception>
 #include <mutex>
 #include <regex>
@@ -14,16 +15,31 @@
 
 #include "Debug.h"
 #include "DexClass.h"
+#include "StringHash.h"
 
 RedexContext* g_redex;
 
-RedexContext::RedexContext() {}
+namespace {
+
+// The member tables see the most traffic from parallel passes, so give them
+// enough slots to keep contention down on machines with many cores.
+size_t hot_table_slots() {
+  return cc_impl::slot_count_for_threads(boost::thread::hardware_concurrency());
+}
+
+} // namespace
+
+RedexContext::RedexContext()
+    : s_string_table(hot_table_slots()),
+      s_type_map(hot_table_slots()),
+      s_field_map(hot_table_slots()),
+      s_typelist_map(hot_table_slots()),
+      s_proto_map(hot_table_slots()),
+      s_method_map(hot_table_slots()) {}
 
 RedexContext::~RedexContext() {
   // Delete DexStrings.
-  for (auto const& p : s_string_map) {
-    delete p.second;
-  }
+  s_string_table.for_each([](DexString* str) { delete str; });
   // Delete DexTypes.  NB: This table intentionally contains aliases (multiple
   // DexStrings map to the same DexType), so we have to dedup the set of types
   // before deleting to avoid double-frees.
@@ -84,25 +100,160 @@ static StoredValue* try_insert(Key key,
   return container->at(key);
 }
 
+RedexContext::StringTable::Cells::Cells(size_t capacity)
+    : mask(capacity - 1), slots(new std::atomic<DexString*>[capacity]) {
+  for (size_t i = 0; i < capacity; ++i) {
+    slots[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+RedexContext::StringTable::StringTable(size_t n_shards)
+    : m_n_shards(n_shards), m_shards(new Shard[n_shards]) {
+  always_assert(n_shards > 0);
+  for (size_t i = 0; i < n_shards; ++i) {
+    auto& shard = m_shards[i];
+    shard.generations.emplace_back(std::make_unique<Cells>(64));
+    shard.cells.store(shard.generations.back().get(),
+                      std::memory_order_relaxed);
+  }
+}
+
+RedexContext::StringTable::Shard& RedexContext::StringTable::shard_for(
+    uint64_t hash) const {
+  // The low bits of the hash pick the cell within the shard.
+  return m_shards[(hash >> 40) % m_n_shards];
+}
+
+DexString* RedexContext::StringTable::probe(const Cells& cells,
+                                            const char* data,
+                                            uint32_t size,
+                                            uint64_t hash) {
+  for (size_t i = hash & cells.mask;; i = (i + 1) & cells.mask) {
+    auto str = cells.slots[i].load(std::memory_order_acquire);
+    if (str == nullptr) {
+      return nullptr;
+    }
+    if (str->hash() == hash && str->size() == size &&
+        memcmp(str->c_str(), data, size) == 0) {
+      return str;
+    }
+  }
+}
+
+void RedexContext::StringTable::place(Cells* cells, DexString* str) {
+  size_t i = str->hash() & cells->mask;
+  while (cells->slots[i].load(std::memory_order_relaxed) != nullptr) {
+    i = (i + 1) & cells->mask;
+  }
+  cells->slots[i].store(str, std::memory_order_release);
+}
+
+DexString* RedexContext::StringTable::find(const char* data,
+                                           uint32_t size,
+                                           uint64_t hash) const {
+  const Shard& shard = shard_for(hash);
+  return probe(*shard.cells.load(std::memory_order_acquire), data, size, hash);
+}
+
+DexString* RedexContext::StringTable::insert(DexString* str) {
+  Shard& shard = shard_for(str->hash());
+  std::lock_guard<std::mutex> lock(shard.lock);
+  Cells* cells = shard.cells.load(std::memory_order_relaxed);
+  auto existing = probe(*cells, str->c_str(), str->size(), str->hash());
+  if (existing != nullptr) {
+    delete str;
+    return existing;
+  }
+  // Keep the load factor under 1/2, so that probe sequences stay short.
+  if ((shard.size + 1) * 2 > cells->mask + 1) {
+    auto bigger = std::make_unique<Cells>(2 * (cells->mask + 1));
+    for (size_t i = 0; i <= cells->mask; ++i) {
+      auto old = cells->slots[i].load(std::memory_order_relaxed);
+      if (old != nullptr) {
+        place(bigger.get(), old);
+      }
+    }
+    cells = bigger.get();
+    shard.generations.emplace_back(std::move(bigger));
+    shard.cells.store(cells, std::memory_order_release);
+  }
+  place(cells, str);
+  ++shard.size;
+  return str;
+}
+
 DexString* RedexContext::make_string(const char* nstr, uint32_t utfsize) {
   always_assert(nstr != nullptr);
-  auto rv = s_string_map.get(nstr, nullptr);
+  auto size = static_cast<uint32_t>(strlen(nstr));
+  auto hash = hash_bytes64(nstr, size);
+  auto rv = s_string_table.find(nstr, size, hash);
   if (rv != nullptr) {
     return rv;
   }
-  // Note that DexStrings are keyed by the c_str() of the underlying
-  // std::string. The c_str is valid until a the string is destroyed, or until a
-  // non-const function is called on the string (but note the std::string itself
-  // is const)
-  auto dexstring = new DexString(nstr, utfsize);
-  return try_insert(dexstring->c_str(), dexstring, &s_string_map);
+  return s_string_table.insert(
+      new DexString(std::string(nstr, size), utfsize, hash));
+}
+
+DexString* RedexContext::make_mapped_string(const char* nstr,
+                                            uint32_t utfsize) {
+  always_assert(nstr != nullptr);
+  auto size = static_cast<uint32_t>(strlen(nstr));
+  auto hash = hash_bytes64(nstr, size);
+  auto rv = s_string_table.find(nstr, size, hash);
+  if (rv != nullptr) {
+    return rv;
+  }
+  return s_string_table.insert(new DexString(nstr, size, utfsize, hash));
+}
+
+void RedexContext::retain_mapped_file(std::shared_ptr<const void> file) {
+  std::lock_guard<std::mutex> lock(m_mapped_files_mutex);
+  m_mapped_files.emplace_back(std::move(file));
+}
+
+void RedexContext::add_interned_usage(memory_accounting::Report* report) {
+  using memory_accounting::Usage;
+  Usage strings;
+  s_string_table.for_each([&strings](const DexString* str) {
+    strings.count++;
+    strings.bytes += sizeof(DexString);
+    auto storage = str->m_storage.load(std::memory_order_relaxed);
+    if (storage != nullptr) {
+      strings.bytes += sizeof(std::string) + storage->capacity();
+    }
+  });
+  (*report)["DexString"] += strings;
+
+  // The type table also holds aliases.
+  std::unordered_set<const DexType*> types;
+  for (const auto& p : s_type_map) {
+    types.emplace(p.second);
+  }
+  (*report)["DexType"] += Usage{types.size(), types.size() * sizeof(DexType)};
+
+  uint64_t protos = s_proto_map.size();
+  (*report)["DexProto"] += Usage{protos, protos * sizeof(DexProto)};
+
+  // Every method ref is allocated as a DexMethod, definition or not.
+  uint64_t refs = 0;
+  uint64_t defs = 0;
+  for (const auto& it : s_method_map) {
+    if (it.second->is_def()) {
+      defs++;
+    } else {
+      refs++;
+    }
+  }
+  (*report)["DexMethodRef"] += Usage{refs, refs * sizeof(DexMethod)};
+  (*report)["DexMethod"] += Usage{defs, defs * sizeof(DexMethod)};
 }
 
 DexString* RedexContext::get_string(const char* nstr, uint32_t utfsize) {
   if (nstr == nullptr) {
     return nullptr;
   }
-  return s_string_map.get(nstr, nullptr);
+  auto size = static_cast<uint32_t>(strlen(nstr));
+  return s_string_table.find(nstr, size, hash_bytes64(nstr, size));
 }
 
 DexType* RedexContext::make_type(const DexString* dstring) {
@@ -144,14 +295,11 @@ DexFieldRef* RedexContext::make_field(const DexType* container,
   DexFieldSpec r(const_cast<DexType*>(container),
                  const_cast<DexString*>(name),
                  const_cast<DexType*>(type));
-  auto rv = s_field_map.get(r, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  auto field = new DexField(const_cast<DexType*>(container),
-                            const_cast<DexString*>(name),
-                            const_cast<DexType*>(type));
-  return try_insert<DexField, DexFieldRef>(r, field, &s_field_map);
+  // Made under the lock of its slot, so that threads racing to make the same
+  // field don't each allocate one, and take a dense id, just to drop it.
+  return s_field_map.get_or_create(r, [&]() -> DexFieldRef* {
+    return new DexField(r.cls, r.name, r.type);
+  });
 }
 
 DexFieldRef* RedexContext::get_field(const DexType* container,
@@ -175,6 +323,7 @@ void RedexContext::mutate_field(DexFieldRef* field,
                                 bool rename_on_collision,
                                 bool update_deobfuscated_name) {
   std::lock_guard<std::mutex> lock(s_field_lock);
+  invalidate_resolutions();
   DexFieldSpec& r = field->m_spec;
   s_field_map.erase(r);
   r.cls = ref.cls != nullptr ? ref.cls : field->m_spec.cls;
@@ -201,17 +350,59 @@ void RedexContext::mutate_field(DexFieldRef* field,
   }
 }
 
+keep_reason::Reason* RedexContext::intern_keep_reason(
+    const keep_reason::Reason& reason) {
+  auto rv = s_keep_reasons.get(reason, nullptr);
+  if (rv != nullptr) {
+    return rv;
+  }
+  return try_insert(reason, new keep_reason::Reason(reason), &s_keep_reasons);
+}
+
+size_t RedexContext::TypeListHash::operator()(
+    const std::deque<DexType*>* types) const {
+  return boost::hash_range(types->begin(), types->end());
+}
+
+size_t RedexContext::TypeListHash::operator()(const DexTypeSpan& types) const {
+  return boost::hash_range(types.begin(), types.end());
+}
+
+bool RedexContext::TypeListEqual::operator()(
+    const std::deque<DexType*>* a, const std::deque<DexType*>* b) const {
+  return *a == *b;
+}
+
+bool RedexContext::TypeListEqual::operator()(const std::deque<DexType*>* a,
+                                             const DexTypeSpan& b) const {
+  return a->size() == b.size() && std::equal(b.begin(), b.end(), a->begin());
+}
+
 DexTypeList* RedexContext::make_type_list(std::deque<DexType*>&& p) {
-  auto rv = s_typelist_map.get(p, nullptr);
+  auto rv = s_typelist_map.get(&p, nullptr);
   if (rv != nullptr) {
     return rv;
   }
   auto typelist = new DexTypeList(std::move(p));
-  return try_insert(typelist->m_list, typelist, &s_typelist_map);
+  return try_insert(&typelist->m_list, typelist, &s_typelist_map);
 }
 
 DexTypeList* RedexContext::get_type_list(std::deque<DexType*>&& p) {
-  return s_typelist_map.get(p, nullptr);
+  return s_typelist_map.get(&p, nullptr);
+}
+
+DexTypeList* RedexContext::make_type_list(const DexTypeSpan& types) {
+  auto rv = s_typelist_map.get(types, nullptr);
+  if (rv != nullptr) {
+    return rv;
+  }
+  auto typelist =
+      new DexTypeList(std::deque<DexType*>(types.begin(), types.end()));
+  return try_insert(&typelist->m_list, typelist, &s_typelist_map);
+}
+
+DexTypeList* RedexContext::get_type_list(const DexTypeSpan& types) {
+  return s_typelist_map.get(types, nullptr);
 }
 
 DexProto* RedexContext::make_proto(const DexType* rtype,
@@ -249,12 +440,10 @@ DexMethodRef* RedexContext::make_method(const DexType* type_,
   auto proto = const_cast<DexProto*>(proto_);
   always_assert(type != nullptr && name != nullptr && proto != nullptr);
   DexMethodSpec r(type, name, proto);
-  auto rv = s_method_map.get(r, nullptr);
-  if (rv != nullptr) {
-    return rv;
-  }
-  return try_insert<DexMethod, DexMethodRef, DexMethod::Deleter>(
-      r, new DexMethod(type, name, proto), &s_method_map);
+  // See make_field().
+  return s_method_map.get_or_create(r, [&]() -> DexMethodRef* {
+    return new DexMethod(type, name, proto);
+  });
 }
 
 DexMethodRef* RedexContext::get_method(const DexType* type,
@@ -277,6 +466,7 @@ void RedexContext::mutate_method(DexMethodRef* method,
                                  bool rename_on_collision,
                                  bool update_deobfuscated_name) {
   std::lock_guard<std::mutex> lock(s_method_lock);
+  invalidate_resolutions();
   DexMethodSpec old_spec = method->m_spec;
   s_method_map.erase(method->m_spec);
 
@@ -369,6 +559,7 @@ void RedexContext::mutate_method(DexMethodRef* method,
 
 void RedexContext::publish_class(DexClass* cls) {
   std::lock_guard<std::mutex> l(m_type_system_mutex);
+  invalidate_resolutions();
   const DexType* type = cls->get_type();
   if (m_type_to_class.find(type) != end(m_type_to_class)) {
     const auto& prev_loc = m_type_to_class[type]->get_location();
@@ -8,12 +8,14 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <boost/functional/hash.hpp>
 #include <cstring>
 #include <deque>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <unordered_map>
@@ -22,13 +24,17 @@
 #include "ConcurrentContainers.h"
 #include "DexMemberRefs.h"
 #include "KeepReason.h"
+#include "MemoryAccounting.h"
 
 class DexDebugInstruction;
 class DexString;
 class DexType;
+class DexField;
 class DexFieldRef;
 class DexTypeList;
+class DexTypeSpan;
 class DexProto;
+class DexMethod;
 class DexMethodRef;
 class DexClass;
 struct DexFieldSpec;
@@ -38,12 +44,39 @@ struct RedexContext;
 
 extern RedexContext* g_redex;
 
+/*
+ * Which parts of the debug info of the input dexes the loader keeps. What the
+ * output is known not to contain can be dropped while decoding, so that it is
+ * neither decoded nor carried through every pass as DexPositions and
+ * MFLOW_DEBUG entries.
+ */
+struct LoadedDebugInfo {
+  // When false, code is loaded without any DexDebugItem.
+  bool debug_items{true};
+  bool positions{true};
+  // DBG_START_LOCAL{,_EXTENDED}, DBG_END_LOCAL and DBG_RESTART_LOCAL.
+  bool locals{true};
+};
+
 struct RedexContext {
   RedexContext();
   ~RedexContext();
 
   DexString* make_string(const char* nstr, uint32_t utfsize);
   DexString* get_string(const char* nstr, uint32_t utfsize);
+  /*
+   * Like make_string, but a newly created DexString refers to `nstr` instead
+   * of copying it. `nstr` must be NUL-terminated and stay valid for the
+   * lifetime of this context, e.g. by living in a file passed to
+   * retain_mapped_file().
+   */
+  DexString* make_mapped_string(const char* nstr, uint32_t utfsize);
+  /*
+   * Keep an input mapping alive (and its address stable) until this context
+   * is destroyed. Also takes whatever owns a dex read from memory, see
+   * DexBuffer.
+   */
+  void retain_mapped_file(std::shared_ptr<const void> file);
 
   DexType* make_type(const DexString* dstring);
   DexType* get_type(const DexString* dstring);
@@ -76,6 +109,8 @@ struct RedexContext {
 
   DexTypeList* make_type_list(std::deque<DexType*>&& p);
   DexTypeList* get_type_list(std::deque<DexType*>&& p);
+  DexTypeList* make_type_list(const DexTypeSpan& types);
+  DexTypeList* get_type_list(const DexTypeSpan& types);
 
   DexProto* make_proto(const DexType* rtype,
                        const DexTypeList* args,
@@ -107,6 +142,49 @@ struct RedexContext {
     }
   }
 
+  /*
+   * Types, classes, field refs and method refs are numbered densely as they
+   * are created, so that analyses can keep per-object state in flat arrays
+   * indexed by get_dense_id() (see IdMap and ConcurrentBitmap). Numbers are
+   * never reused, and the num_*_ids() counts bound every id handed out so
+   * far.
+   */
+  uint32_t make_type_id() { return m_num_type_ids.fetch_add(1); }
+  uint32_t make_class_id() { return m_num_class_ids.fetch_add(1); }
+  uint32_t make_field_id() { return m_num_field_ids.fetch_add(1); }
+  uint32_t make_method_id() { return m_num_method_ids.fetch_add(1); }
+  uint32_t num_type_ids() const { return m_num_type_ids.load(); }
+  uint32_t num_class_ids() const { return m_num_class_ids.load(); }
+  uint32_t num_field_ids() const { return m_num_field_ids.load(); }
+  uint32_t num_method_ids() const { return m_num_method_ids.load(); }
+
+  /*
+   * The resolvers in Resolver.h memoize their results here. Each entry is
+   * keyed by the reference and the kind of search, and remembers the
+   * resolution epoch it was computed in; it is ignored once the epoch has
+   * moved on. The epoch moves on whenever a class's super class, interfaces or
+   * member lists change, or a member is renamed or moved.
+   */
+  template <class Ref, class Def>
+  using ResolutionCache =
+      ConcurrentMap<std::pair<const Ref*, uint8_t>,
+                    std::pair<Def*, size_t>,
+                    boost::hash<std::pair<const Ref*, uint8_t>>>;
+  ResolutionCache<DexMethodRef, DexMethod>& method_resolutions() {
+    return m_method_resolutions;
+  }
+  ResolutionCache<DexFieldRef, DexField>& field_resolutions() {
+    return m_field_resolutions;
+  }
+  size_t resolution_epoch() const { return m_resolution_epoch.load(); }
+  void invalidate_resolutions() { m_resolution_epoch.fetch_add(1); }
+
+  /*
+   * Adds the number and approximate size of the interned strings, types,
+   * protos, method refs and methods to `report`. Walks the whole tables.
+   */
+  void add_interned_usage(memory_accounting::Report* report);
+
   /*
    * This returns true if we want to preserve keep reasons for better
    * diagnostics.
@@ -116,63 +194,137 @@ struct RedexContext {
     g_redex->m_record_keep_reasons = v;
   }
 
+  /*
+   * When set, strings loaded from input dexes point directly into the mapped
+   * files rather than being copied onto the heap. The mappings stay open
+   * until the context is destroyed.
+   */
+  static bool zero_copy_strings() { return g_redex->m_zero_copy_strings; }
+  static void set_zero_copy_strings(bool v) {
+    g_redex->m_zero_copy_strings = v;
+  }
+
+  /*
+   * When set, loading a dex only marks its methods for ballooning; each
+   * method's IRCode is built the first time it is asked for. See
+   * DexMethod::defer_balloon().
+   */
+  static bool lazy_balloon() { return g_redex->m_lazy_balloon; }
+  static void set_lazy_balloon(bool v) { g_redex->m_lazy_balloon = v; }
+
+  /*
+   * When set, debug programs are decoded from the input dexes the first time
+   * they are used rather than while loading. Like zero_copy_strings(), this
+   * keeps the mappings (and their DexIdx) open until the context is
+   * destroyed.
+   */
+  static bool lazy_debug_info() { return g_redex->m_lazy_debug_info; }
+  static void set_lazy_debug_info(bool v) {
+    g_redex->m_lazy_debug_info = v;
+  }
+
+  /*
+   * What the loader keeps of the debug programs of the input dexes. See
+   * redex::debug_info_to_load() for how it follows from the config.
+   */
+  static const LoadedDebugInfo& loaded_debug_info() {
+    return g_redex->m_loaded_debug_info;
+  }
+  static void set_loaded_debug_info(const LoadedDebugInfo& v) {
+    g_redex->m_loaded_debug_info = v;
+  }
+
+  /*
+   * DexMethod::get_code() and set_code() record the current code epoch in
+   * the method, so that the PassManager can tell which methods no pass has
+   * asked for in a while, and reachability which code may have changed since
+   * it last looked. Zero means that accesses aren't recorded.
+   */
+  static uint16_t code_epoch() {
+    return g_redex->m_code_epoch.load(std::memory_order_relaxed);
+  }
+  static void set_code_epoch(uint16_t epoch) {
+    g_redex->m_code_epoch.store(epoch, std::memory_order_relaxed);
+  }
+
   template <class... Args>
   static keep_reason::Reason* make_keep_reason(Args&&... args) {
-    auto to_insert =
-        std::make_unique<keep_reason::Reason>(std::forward<Args>(args)...);
-    if (g_redex->s_keep_reasons.emplace(to_insert.get(), to_insert.get())) {
-      return to_insert.release();
-    }
-    return g_redex->s_keep_reasons.at(to_insert.get());
+    return g_redex->intern_keep_reason(
+        keep_reason::Reason(std::forward<Args>(args)...));
   }
 
  private:
-  struct Strcmp;
-  struct TruncatedStringHash;
-
-  // We use this instead of an unordered_map-based ConcurrentMap because
-  // hashing is expensive on large strings -- it has to hash the entire key to
-  // find its bucket. An std::map (i.e. a tree) performs better with large keys
-  // in a sparse keyset because it only needs to find the first character that
-  // differs between keys when traversing the tree, meaning that it usually
-  // doesn't need to examine the entire key for insertions.
-  //
-  // We still need to do hashing in order to shard the keys across the
-  // individually-locked std::maps, but it suffices to hash a substring for this
-  // purpose.
-  template <typename Value, size_t n_slots = 31>
-  using ConcurrentLargeStringMap =
-      ConcurrentMapContainer<std::map<const char*, Value, Strcmp>,
-                             const char*,
-                             Value,
-                             TruncatedStringHash,
-                             n_slots>;
-
-  struct Strcmp {
-    bool operator()(const char* a, const char* b) const {
-      return strcmp(a, b) < 0;
-    }
-  };
+  keep_reason::Reason* intern_keep_reason(const keep_reason::Reason& reason);
 
-  // Hash an 8-byte subsequence of a given string, offset by 32 bytes from the
-  // start. Dex files tend to contain many strings with the same prefixes,
-  // because every class / method under a given package will share the same
-  // prefix. The offset ensures that we have more unique subsequences to hash.
-  //
-  // XXX(jezng): 32 was picked fairly arbitrarily; testing showed that it was
-  // definitely better than 0, but I did not test any numbers in between.
-  struct TruncatedStringHash {
-    size_t operator()(const char* s) {
-      constexpr size_t hash_prefix_len = 8;
-      constexpr size_t offset = 32;
-      size_t len = strnlen(s, offset + hash_prefix_len);
-      size_t start = std::max<int64_t>(0, int64_t(len - hash_prefix_len));
-      return boost::hash_range(s + start, s + len);
+  /*
+   * The interning table of DexStrings. Every DexString computes a 64-bit hash
+   * of its contents once, when it's created, so the table can use open
+   * addressing on those hashes, and a lookup usually takes a single string
+   * comparison. The strings are spread over independently locked shards.
+   *
+   * Strings are never removed, so lookups are lock-free. When the array of a
+   * shard fills up, a bigger one is published in its place, and the old one is
+   * kept for the readers that may still be probing it, until the table is
+   * destroyed. A lookup that misses a string inserted concurrently is fine:
+   * insertions check again under the lock.
+   */
+  class StringTable {
+   public:
+    explicit StringTable(size_t n_shards);
+
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    DexString* find(const char* data, uint32_t size, uint64_t hash) const;
+
+    // Returns the interned string equal to `str`, which is `str` itself
+    // unless another thread got there first, in which case `str` is deleted.
+    DexString* insert(DexString* str);
+
+    // Not thread-safe.
+    template <typename F>
+    void for_each(F f) const {
+      for (size_t i = 0; i < m_n_shards; ++i) {
+        const Cells& cells = *m_shards[i].cells.load();
+        for (size_t j = 0; j <= cells.mask; ++j) {
+          auto str = cells.slots[j].load(std::memory_order_relaxed);
+          if (str != nullptr) {
+            f(str);
+          }
+        }
+      }
     }
+
+   private:
+    struct Cells {
+      explicit Cells(size_t capacity);
+      size_t mask;
+      std::unique_ptr<std::atomic<DexString*>[]> slots;
+    };
+
+    struct Shard {
+      std::mutex lock;
+      std::atomic<Cells*> cells{nullptr};
+      size_t size{0};
+      // All the arrays this shard ever had, the current one last.
+      std::vector<std::unique_ptr<Cells>> generations;
+    };
+
+    Shard& shard_for(uint64_t hash) const;
+
+    static DexString* probe(const Cells& cells,
+                            const char* data,
+                            uint32_t size,
+                            uint64_t hash);
+
+    static void place(Cells* cells, DexString* str);
+
+    const size_t m_n_shards;
+    std::unique_ptr<Shard[]> m_shards;
   };
 
   // DexString
-  ConcurrentLargeStringMap<DexString*> s_string_map;
+  StringTable s_string_table;
 
   // DexType
   ConcurrentMap<const DexString*, DexType*> s_type_map;
@@ -181,15 +333,31 @@ struct RedexContext {
   ConcurrentMap<DexFieldSpec, DexFieldRef*> s_field_map;
   std::mutex s_field_lock;
 
-  // DexTypeList
-  ConcurrentMap<std::deque<DexType*>,
-                DexTypeList*,
-                boost::hash<std::deque<DexType*>>>
+  // DexTypeList. Type lists and protos are never erased, so their tables can
+  // use lock-free lookups. The type lists are keyed on their own storage, and
+  // can also be looked up by DexTypeSpan.
+  struct TypeListHash {
+    using is_transparent = void;
+    size_t operator()(const std::deque<DexType*>* types) const;
+    size_t operator()(const DexTypeSpan& types) const;
+  };
+  struct TypeListEqual {
+    using is_transparent = void;
+    bool operator()(const std::deque<DexType*>* a,
+                    const std::deque<DexType*>* b) const;
+    bool operator()(const std::deque<DexType*>* a,
+                    const DexTypeSpan& b) const;
+  };
+  InsertOnlyConcurrentMap<const std::deque<DexType*>*,
+                          DexTypeList*,
+                          TypeListHash,
+                          TypeListEqual>
       s_typelist_map;
 
   // DexProto
   using ProtoKey = std::pair<const DexType*, const DexTypeList*>;
-  ConcurrentMap<ProtoKey, DexProto*, boost::hash<ProtoKey>> s_proto_map;
+  InsertOnlyConcurrentMap<ProtoKey, DexProto*, boost::hash<ProtoKey>>
+      s_proto_map;
 
   // DexMethod
   ConcurrentMap<DexMethodSpec, DexMethodRef*> s_method_map;
@@ -201,13 +369,31 @@ struct RedexContext {
 
   const std::vector<const DexType*> m_empty_types;
 
-  ConcurrentMap<keep_reason::Reason*,
-                keep_reason::Reason*,
-                keep_reason::ReasonPtrHash,
-                keep_reason::ReasonPtrEqual>
+  // Keep reasons are never erased either. Most of them repeat (the same keep
+  // rule or config option keeps many members), so lookups are the hot path.
+  InsertOnlyConcurrentMap<keep_reason::Reason,
+                          keep_reason::Reason*,
+                          boost::hash<keep_reason::Reason>>
       s_keep_reasons;
 
   bool m_record_keep_reasons{false};
+
+  std::atomic<uint32_t> m_num_type_ids{0};
+  std::atomic<uint32_t> m_num_class_ids{0};
+  std::atomic<uint32_t> m_num_field_ids{0};
+  std::atomic<uint32_t> m_num_method_ids{0};
+
+  ResolutionCache<DexMethodRef, DexMethod> m_method_resolutions;
+  ResolutionCache<DexFieldRef, DexField> m_field_resolutions;
+  std::atomic<size_t> m_resolution_epoch{0};
+
+  bool m_zero_copy_strings{false};
+  bool m_lazy_balloon{false};
+  bool m_lazy_debug_info{false};
+  LoadedDebugInfo m_loaded_debug_info;
+  std::atomic<uint16_t> m_code_epoch{0};
+  std::mutex m_mapped_files_mutex;
+  std::vector<std::shared_ptr<const void>> m_mapped_files;
 };
 
 // One or more exceptions
@@ -13,6 +13,9 @@ void RedexOptions::serialize(Json::Value& entry_data) const {
   options["is_art_build"] = is_art_build;
   options["instrument_pass_enabled"] = instrument_pass_enabled;
   options["min_sdk"] = min_sdk;
+  options["num_threads"] = num_threads;
+  options["pin_worker_threads"] = pin_worker_threads;
+  options["numa_aware_threads"] = numa_aware_threads;
 }
 
 void RedexOptions::deserialize(const Json::Value& entry_data) {
@@ -21,6 +24,9 @@ void RedexOptions::deserialize(const Json::Value& entry_data) {
   is_art_build = options_data["is_art_build"].asBool();
   instrument_pass_enabled = options_data["instrument_pass_enabled"].asBool();
   min_sdk = options_data["min_sdk"].asInt();
+  num_threads = options_data["num_threads"].asUInt();
+  pin_worker_threads = options_data["pin_worker_threads"].asBool();
+  numa_aware_threads = options_data["numa_aware_threads"].asBool();
 }
 
 Architecture parse_architecture(const std::string& s) {
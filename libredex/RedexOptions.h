@@ -23,6 +23,13 @@ class RedexOptions {
   bool instrument_pass_enabled{false};
   int32_t min_sdk{0};
   Architecture arch{Architecture::UNKNOWN};
+  // Number of threads that WorkQueues use by default; 0 for one per core.
+  unsigned int num_threads{0};
+  // Pin each thread of the WorkQueue pool to a core.
+  bool pin_worker_threads{false};
+  // Spread the threads of the WorkQueue pool over the NUMA nodes, and give
+  // each class to the threads of one node.
+  bool numa_aware_threads{false};
 
   /*
    * Overwriting the `this` register breaks the verifier before Android M and
@@ -14,6 +14,7 @@
 #include <boost/regex.hpp>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <fstream>
 #include <map>
@@ -47,6 +48,7 @@
 
 #include "Debug.h"
 #include "StringUtil.h"
+#include "WorkQueue.h"
 
 constexpr size_t MIN_CLASSNAME_LENGTH = 10;
 constexpr size_t MAX_CLASSNAME_LENGTH = 500;
@@ -57,6 +59,65 @@ using path_t = boost::filesystem::path;
 using dir_iterator = boost::filesystem::directory_iterator;
 using rdir_iterator = boost::filesystem::recursive_directory_iterator;
 
+namespace {
+
+unsigned int num_threads() {
+  return std::max(1u, boost::thread::hardware_concurrency());
+}
+
+/*
+ * Calls `f` with the contents of the file, mapped read-only. Returns false,
+ * without calling `f`, for files that can't be mapped, which includes empty
+ * ones.
+ */
+template <typename F>
+bool with_mapped_file(const std::string& path, F f) {
+  int file_descriptor;
+  size_t length;
+  void* data;
+  try {
+    data = map_file(path.c_str(), &file_descriptor, &length);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  f(static_cast<const char*>(data), length);
+  unmap_and_close(file_descriptor, data, length);
+  return true;
+}
+
+/*
+ * A file mapped for reading and writing, so that the edits made in place go
+ * straight to the file. Throws if the file can't be mapped, which includes
+ * empty ones.
+ */
+class WritableMappedFile {
+ public:
+  explicit WritableMappedFile(const std::string& path) {
+    try {
+      m_data = map_file(path.c_str(), &m_file_descriptor, &m_length,
+                        /* mode_write */ true);
+    } catch (const std::runtime_error&) {
+      fprintf(stderr, "Unable to read file: %s\n", path.c_str());
+      throw std::runtime_error("Unable to read file: " + path);
+    }
+  }
+
+  ~WritableMappedFile() {
+    unmap_and_close(m_file_descriptor, m_data, m_length);
+  }
+
+  char* data() const { return static_cast<char*>(m_data); }
+
+  size_t size() const { return m_length; }
+
+ private:
+  int m_file_descriptor;
+  size_t m_length;
+  void* m_data;
+};
+
+} // namespace
+
 std::string convert_from_string16(const android::String16& string16) {
   android::String8 string8(string16);
   std::string converted(string8.string());
@@ -136,73 +197,148 @@ std::string dotname_to_dexname(const std::string& classname) {
   return dexname;
 }
 
-void extract_by_pattern(
-    const std::string& string_to_search,
-    boost::regex regex,
-    std::unordered_set<std::string>& result) {
+/*
+ * Returns the name of the asset that a `registerAsset(...)` call registers,
+ * given the text between its parentheses.
+ */
+boost::optional<std::string> registered_asset_name(
+    const std::string& registration) {
+  static boost::regex name_regex("name:\\\"(.+?)\\\"");
+  static boost::regex location_regex("httpServerLocation:\\\"/assets/(.+?)\\\"");
+  static boost::regex special_char_regex("[^a-z0-9_]");
   boost::smatch m;
-  std::string s = string_to_search;
-  while (boost::regex_search (s, m, regex)) {
-    if (m.size() > 1) {
-        result.insert(m[1].str());
-    }
-    s = m.suffix().str();
+  if (!boost::regex_search (registration, m, location_regex) || m.size() == 0) {
+    return boost::none;
   }
+  std::ostringstream asset_path;
+  asset_path << m[1].str() << '/'; // location
+  if (!boost::regex_search (registration, m, name_regex) || m.size() == 0) {
+    return boost::none;
+  }
+  asset_path << m[1].str(); // name
+  std::string full_path = asset_path.str();
+  boost::replace_all(full_path, "/", "_");;
+  boost::algorithm::to_lower(full_path);
+
+  std::ostringstream stripped_asset_path;
+  std::ostream_iterator<char, char> oi(stripped_asset_path);
+  boost::regex_replace(oi, full_path.begin(), full_path.end(),
+    special_char_regex, "", boost::match_default | boost::format_all);
+  return stripped_asset_path.str();
 }
 
-void extract_js_sounds(
-    const std::string& file_contents,
-    std::unordered_set<std::string>& result) {
-  static boost::regex sound_regex("\"([^\\\"]+)\\.(m4a|ogg)\"");
-  extract_by_pattern(file_contents, sound_regex, result);
+bool has_prefix_at(const char* data, size_t size, size_t pos,
+                   const char* prefix, size_t prefix_len) {
+  return size - pos >= prefix_len && !memcmp(data + pos, prefix, prefix_len);
 }
 
-void extract_js_uris(
-    const std::string& file_contents,
-    std::unordered_set<std::string>& result) {
-  static boost::regex uri_regex("\\buri:\\s*\"([^\\\"]+)\"");
-  extract_by_pattern(file_contents, uri_regex, result);
+bool is_word_char(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
 }
 
-void extract_js_asset_registrations(
-    const std::string& file_contents,
-    std::unordered_set<std::string>& result) {
-  static boost::regex register_regex("registerAsset\\((.+?)\\)");
-  static boost::regex name_regex("name:\\\"(.+?)\\\"");
-  static boost::regex location_regex("httpServerLocation:\\\"/assets/(.+?)\\\"");
-  static boost::regex special_char_regex("[^a-z0-9_]");
+/*
+ * Finds the resources that a JS bundle refers to, in one pass over its bytes:
+ * - sounds, as quoted strings that end in .m4a or .ogg, without the extension
+ * - the strings of `uri: "..."` properties
+ * - the assets that `registerAsset(...)` calls register
+ * Each kind is matched as a regex search that resumes after each match would,
+ * so matches of one kind don't overlap. The patterns start with different
+ * characters, which is all the scan has to look at until one of them starts.
+ */
+std::unordered_set<std::string> extract_js_resources(const char* data,
+                                                     size_t size) {
+  static const char URI[] = "uri:";
+  static const size_t URI_LEN = sizeof(URI) - 1;
+  static const char REGISTER_ASSET[] = "registerAsset(";
+  static const size_t REGISTER_ASSET_LEN = sizeof(REGISTER_ASSET) - 1;
+  static const size_t EXTENSION_LEN = 4;
+
+  std::unordered_set<std::string> result;
   std::unordered_set<std::string> registrations;
-  extract_by_pattern(file_contents, register_regex, registrations);
-  for (std::string registration : registrations) {
-    boost::smatch m;
-    if (!boost::regex_search (registration, m, location_regex) || m.size() == 0) {
-      continue;
+  // The quote that would open a sound, if any.
+  const char* open_quote = nullptr;
+  // Where the next uri and registration may start.
+  size_t uri_start = 0;
+  size_t registration_start = 0;
+  for (size_t i = 0; i < size; ++i) {
+    switch (data[i]) {
+    case '"': {
+      if (open_quote == nullptr) {
+        open_quote = data + i;
+        break;
+      }
+      const char* begin = open_quote + 1;
+      size_t len = data + i - begin;
+      if (len > EXTENSION_LEN &&
+          (!memcmp(data + i - EXTENSION_LEN, ".m4a", EXTENSION_LEN) ||
+           !memcmp(data + i - EXTENSION_LEN, ".ogg", EXTENSION_LEN))) {
+        result.emplace(begin, len - EXTENSION_LEN);
+        // The closing quote can't open another sound.
+        open_quote = nullptr;
+      } else {
+        open_quote = data + i;
+      }
+      break;
     }
-    std::ostringstream asset_path;
-    asset_path << m[1].str() << '/'; // location
-    if (!boost::regex_search (registration, m, name_regex) || m.size() == 0) {
-      continue;
+    case 'u': {
+      if (i < uri_start || !has_prefix_at(data, size, i, URI, URI_LEN) ||
+          (i > 0 && is_word_char(data[i - 1]))) {
+        break;
+      }
+      size_t pos = i + URI_LEN;
+      while (pos < size &&
+             std::isspace(static_cast<unsigned char>(data[pos]))) {
+        ++pos;
+      }
+      if (pos == size || data[pos] != '"') {
+        break;
+      }
+      auto begin = data + pos + 1;
+      auto end = static_cast<const char*>(
+          memchr(begin, '"', data + size - begin));
+      if (end == nullptr || end == begin) {
+        break;
+      }
+      result.emplace(begin, end - begin);
+      uri_start = end + 1 - data;
+      break;
     }
-    asset_path << m[1].str(); // name
-    std::string full_path = asset_path.str();
-    boost::replace_all(full_path, "/", "_");;
-    boost::algorithm::to_lower(full_path);
-
-    std::ostringstream stripped_asset_path;
-    std::ostream_iterator<char, char> oi(stripped_asset_path);
-    boost::regex_replace(oi, full_path.begin(), full_path.end(),
-      special_char_regex, "", boost::match_default | boost::format_all);
+    case 'r': {
+      if (i < registration_start ||
+          !has_prefix_at(data, size, i, REGISTER_ASSET, REGISTER_ASSET_LEN)) {
+        break;
+      }
+      // The registration is at least one character long.
+      auto begin = data + i + REGISTER_ASSET_LEN;
+      if (begin + 1 >= data + size) {
+        break;
+      }
+      auto end = static_cast<const char*>(
+          memchr(begin + 1, ')', data + size - begin - 1));
+      if (end == nullptr) {
+        registration_start = size;
+        break;
+      }
+      registrations.emplace(begin, end - begin);
+      registration_start = end + 1 - data;
+      break;
+    }
+    default:
+      break;
+    }
+  }
 
-    result.emplace(stripped_asset_path.str());
+  for (const auto& registration : registrations) {
+    auto name = registered_asset_name(registration);
+    if (name) {
+      result.emplace(std::move(*name));
+    }
   }
+  return result;
 }
 
 std::unordered_set<std::string> extract_js_resources(const std::string& file_contents) {
-  std::unordered_set<std::string> result;
-  extract_js_sounds(file_contents, result);
-  extract_js_uris(file_contents, result);
-  extract_js_asset_registrations(file_contents, result);
-  return result;
+  return extract_js_resources(file_contents.data(), file_contents.size());
 }
 
 std::unordered_set<uint32_t> extract_xml_reference_attributes(
@@ -429,13 +565,14 @@ std::string read_attribute_name_at_idx(const android::ResXMLTree& parser,
 }
 
 void extract_classes_from_layout(
-    const std::string& layout_contents,
+    const char* layout_data,
+    size_t layout_size,
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
 
   android::ResXMLTree parser;
-  parser.setTo(layout_contents.data(), layout_contents.size());
+  parser.setTo(layout_data, layout_size);
 
   android::String16 name("name");
   android::String16 klazz("class");
@@ -496,57 +633,156 @@ void extract_classes_from_layout(
            type != android::ResXMLParser::END_DOCUMENT);
 }
 
+namespace {
+
 /*
- * Returns all strings that look like java class names from a native library.
- *
- * Return values will be formatted the way that the dex spec formats class names:
- *
- *   "Ljava/lang/String;"
- *
+ * Little-endian reads of the fields of ELF headers, which may be unaligned in
+ * the file.
  */
-std::unordered_set<std::string> extract_classes_from_native_lib(const std::string& lib_contents) {
-  std::unordered_set<std::string> classes;
-  char buffer[MAX_CLASSNAME_LENGTH + 2]; // +2 for the trailing ";\0"
-  const char* inptr = lib_contents.data();
-  char* outptr = buffer;
-  const char* end = inptr + lib_contents.size();
+template <typename T>
+T read_elf_field(const char* data, size_t offset) {
+  T value;
+  memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
 
-  size_t length = 0;
+constexpr uint32_t ELF_SHT_PROGBITS = 1;
+constexpr uint32_t ELF_SHT_STRTAB = 3;
+constexpr uint64_t ELF_SHF_EXECINSTR = 0x4;
 
+/*
+ * Calls `f` with the data and the size of each section of a little-endian ELF
+ * file that may hold strings, i.e. string tables and data that isn't code.
+ * Returns false, without calling `f`, if the file isn't such an ELF file or
+ * its section headers can't be read.
+ */
+template <typename F>
+bool for_each_string_section(const char* data, size_t size, F f) {
+  constexpr size_t EI_CLASS = 4;
+  constexpr size_t EI_DATA = 5;
+  if (size < 64 || memcmp(data, "\177ELF", 4) != 0 ||
+      data[EI_DATA] != 1 /* ELFDATA2LSB */) {
+    return false;
+  }
+  bool is_64 = data[EI_CLASS] == 2;
+  if (!is_64 && data[EI_CLASS] != 1) {
+    return false;
+  }
+  uint64_t shoff = is_64 ? read_elf_field<uint64_t>(data, 0x28)
+                         : read_elf_field<uint32_t>(data, 0x20);
+  uint16_t shentsize = read_elf_field<uint16_t>(data, is_64 ? 0x3a : 0x2e);
+  uint16_t shnum = read_elf_field<uint16_t>(data, is_64 ? 0x3c : 0x30);
+  if (shnum == 0 || shentsize < (is_64 ? 0x28 : 0x18) || shoff > size ||
+      (size - shoff) / shentsize < shnum) {
+    return false;
+  }
+  for (uint16_t i = 0; i < shnum; i++) {
+    const char* header = data + shoff + i * shentsize;
+    auto type = read_elf_field<uint32_t>(header, 4);
+    uint64_t flags = is_64 ? read_elf_field<uint64_t>(header, 0x08)
+                           : read_elf_field<uint32_t>(header, 0x08);
+    uint64_t offset = is_64 ? read_elf_field<uint64_t>(header, 0x18)
+                            : read_elf_field<uint32_t>(header, 0x10);
+    uint64_t section_size = is_64 ? read_elf_field<uint64_t>(header, 0x20)
+                                  : read_elf_field<uint32_t>(header, 0x14);
+    if ((type != ELF_SHT_PROGBITS && type != ELF_SHT_STRTAB) ||
+        (flags & ELF_SHF_EXECINSTR) || offset > size) {
+      continue;
+    }
+    f(data + offset, std::min<uint64_t>(section_size, size - offset));
+  }
+  return true;
+}
+
+// Which bytes may be part of a class name, and which may start one.
+struct ClassNameChars {
+  bool part[256] = {};
+  bool start[256] = {};
+
+  ClassNameChars() {
+    for (int c = 0; c < 256; c++) {
+      part[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9') || c == '/' || c == '_' || c == '$';
+      start[c] = (c >= 'a' && c <= 'z') || c == 'L';
+    }
+  }
+};
+
+const ClassNameChars& class_name_chars() {
+  static const ClassNameChars chars;
+  return chars;
+}
+
+void extract_classes_from_native_data(
+    const char* data,
+    size_t size,
+    std::unordered_set<std::string>& classes) {
+  const auto& chars = class_name_chars();
+  auto byte = [](const char* p) { return static_cast<unsigned char>(*p); };
+  const char* inptr = data;
+  const char* end = data + size;
+  std::string name;
   while (inptr < end) {
-    outptr = buffer;
-    length = 0;
+    // Most of a library is code and binary data, so skip ahead to the next
+    // byte that may start a name first.
+    if (!chars.start[byte(inptr)]) {
+      inptr++;
+      continue;
+    }
     // All classnames start with a package, which starts with a lowercase
     // letter. Some of them are preceded by an 'L' and followed by a ';' in
     // native libraries while others are not.
-    if ((*inptr >= 'a' && *inptr <= 'z') || *inptr == 'L') {
-
-      if (*inptr != 'L') {
-        *outptr++ = 'L';
-        length++;
-      }
-
-      while (( // This loop is safe since lib_contents.data() ends with a \0
-                 (*inptr >= 'a' && *inptr <= 'z') ||
-                 (*inptr >= 'A' && *inptr <= 'Z') ||
-                 (*inptr >= '0' && *inptr <= '9') ||
-                 *inptr == '/' || *inptr == '_' || *inptr == '$')
-             && length < MAX_CLASSNAME_LENGTH) {
-
-        *outptr++ = *inptr++;
-        length++;
-      }
-      if (length >= MIN_CLASSNAME_LENGTH) {
-        *outptr++ = ';';
-        *outptr = '\0';
-        classes.insert(std::string(buffer));
-      }
+    name.clear();
+    if (*inptr != 'L') {
+      name += 'L';
+    }
+    const char* begin = inptr;
+    size_t length = name.size();
+    while (inptr < end && chars.part[byte(inptr)] &&
+           length < MAX_CLASSNAME_LENGTH) {
+      inptr++;
+      length++;
+    }
+    if (length >= MIN_CLASSNAME_LENGTH) {
+      name.append(begin, inptr);
+      name += ';';
+      classes.insert(name);
     }
     inptr++;
   }
+}
+
+} // namespace
+
+/*
+ * Returns all strings that look like java class names from a native library.
+ * Only the sections that may hold strings are scanned in ELF files, and all
+ * of the contents in anything else.
+ *
+ * Return values will be formatted the way that the dex spec formats class names:
+ *
+ *   "Ljava/lang/String;"
+ *
+ */
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const char* data, size_t size) {
+  std::unordered_set<std::string> classes;
+  bool is_elf =
+      for_each_string_section(data, size, [&](const char* section, size_t n) {
+        extract_classes_from_native_data(section, n, classes);
+      });
+  if (!is_elf) {
+    extract_classes_from_native_data(data, size, classes);
+  }
   return classes;
 }
 
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const std::string& lib_contents) {
+  return extract_classes_from_native_lib(lib_contents.data(),
+                                         lib_contents.size());
+}
+
 /*
  * Reads an entire file into a std::string. Returns an empty string if
  * anything went wrong (e.g. file not found).
@@ -622,25 +858,40 @@ std::unordered_set<std::string> get_files_by_suffix(
     const std::string& suffix) {
   std::unordered_set<std::string> files;
   path_t dir(directory);
+  if (!exists(dir) || !is_directory(dir)) {
+    return files;
+  }
 
-  if (exists(dir) && is_directory(dir)) {
-    for (auto it = dir_iterator(dir); it != dir_iterator(); ++it) {
-      auto const& entry = *it;
-      path_t entry_path = entry.path();
-
-      if (is_regular_file(entry_path) &&
-          ends_with(entry_path.string().c_str(), suffix.c_str())) {
-        files.emplace(entry_path.string());
-      }
-
-      if (is_directory(entry_path)) {
-        std::unordered_set<std::string> sub_files = get_files_by_suffix(
-          entry_path.string(),
-          suffix);
-
-        files.insert(sub_files.begin(), sub_files.end());
-      }
-    }
+  // Each directory is listed by one thread, which queues the subdirectories
+  // it finds for the others. Each thread gathers its own files.
+  auto threads = num_threads();
+  std::vector<std::vector<std::string>> thread_files(threads);
+  using State = WorkerState<std::string>;
+  WorkQueue<std::string> wq(
+      [&](State* state, const std::string& dir_name) {
+        auto& found = thread_files[state->worker_id()];
+        for (auto it = dir_iterator(path_t(dir_name)); it != dir_iterator();
+             ++it) {
+          path_t entry_path = it->path();
+          if (is_regular_file(entry_path) &&
+              ends_with(entry_path.string().c_str(), suffix.c_str())) {
+            found.push_back(entry_path.string());
+          }
+          if (is_directory(entry_path)) {
+            state->push_task(entry_path.string());
+          }
+        }
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      threads);
+  wq.add_item(directory);
+  wq.run_all();
+
+  for (auto& found : thread_files) {
+    files.insert(std::make_move_iterator(found.begin()),
+                 std::make_move_iterator(found.end()));
   }
   return files;
 }
@@ -655,11 +906,11 @@ std::unordered_set<std::string> get_js_files(const std::string& directory) {
 
 std::unordered_set<std::string> get_candidate_js_resources_from_bundle(
     const std::string& filename) {
-  std::string file_contents = read_entire_file(filename);
   std::unordered_set<std::string> js_candidate_resources;
-  if (file_contents.size()) {
-    js_candidate_resources = extract_js_resources(file_contents);
-  } else {
+  bool mapped = with_mapped_file(filename, [&](const char* data, size_t size) {
+    js_candidate_resources = extract_js_resources(data, size);
+  });
+  if (!mapped) {
     fprintf(stderr, "Unable to read file: %s\n", filename.data());
   }
   return js_candidate_resources;
@@ -818,12 +1069,10 @@ int inline_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, android::Res_value>& id_to_inline_value) {
   int num_values_inlined = 0;
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
-
+  // Values have a fixed size, so the parser edits the mapped file in place.
+  WritableMappedFile file(filename);
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file.data(), file.size());
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -852,7 +1101,6 @@ int inline_xml_reference_attributes(
             android::Res_value new_value = p->second;
             parser.setAttribute(i, new_value);
             ++num_values_inlined;
-            made_change = true;
           }
         }
       }
@@ -860,10 +1108,6 @@ int inline_xml_reference_attributes(
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
-  }
-
   return num_values_inlined;
 }
 
@@ -873,12 +1117,10 @@ void remap_xml_reference_attributes(
   if (is_raw_resource(filename)) {
     return;
   }
-  std::string file_contents = read_entire_file(filename);
-  ensure_file_contents(file_contents, filename);
-  bool made_change = false;
-
+  // Ids have a fixed size, so the parser edits the mapped file in place.
+  WritableMappedFile file(filename);
   android::ResXMLTree parser;
-  parser.setTo(file_contents.data(), file_contents.size());
+  parser.setTo(file.data(), file.size());
   if (parser.getError() != android::NO_ERROR) {
     throw std::runtime_error("Unable to read file: " + filename);
   }
@@ -890,7 +1132,6 @@ void remap_xml_reference_attributes(
     auto id_search = kept_to_remapped_ids.find(resourceIds[i]);
     if (id_search != kept_to_remapped_ids.end()) {
       resourceIds[i] = id_search->second;
-      made_change = true;
     }
   }
 
@@ -909,7 +1150,6 @@ void remap_xml_reference_attributes(
             uint32_t new_value = kept_to_remapped_ids.at(outValue.data);
             if (new_value != outValue.data) {
               parser.setAttributeData(i, new_value);
-              made_change = true;
             }
           }
         }
@@ -917,9 +1157,30 @@ void remap_xml_reference_attributes(
     }
   } while (type != android::ResXMLParser::BAD_DOCUMENT &&
            type != android::ResXMLParser::END_DOCUMENT);
+}
+
+void remap_arsc_reference_values(
+    const std::string& arsc_path,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids) {
+  // Without a copy of the data, the table edits the mapped file.
+  WritableMappedFile file(arsc_path);
+  android::ResTable table;
+  if (table.add(file.data(), file.size(), -1, /* copyData */ false) !=
+      android::NO_ERROR) {
+    throw std::runtime_error("Unable to read file: " + arsc_path);
+  }
 
-  if (made_change) {
-    write_entire_file(filename, file_contents);
+  // The map is sorted, so the ids line up with their sorted originals.
+  android::SortedVector<uint32_t> original_ids;
+  android::Vector<uint32_t> new_ids;
+  for (const auto& pair : kept_to_remapped_ids) {
+    original_ids.add(pair.first);
+    new_ids.add(pair.second);
+  }
+  android::SortedVector<uint32_t> res_ids;
+  table.getResourceIds(&res_ids);
+  for (size_t i = 0; i < res_ids.size(); ++i) {
+    table.remapReferenceValuesForResource(res_ids[i], original_ids, new_ids);
   }
 }
 
@@ -955,12 +1216,10 @@ void collect_layout_classes_and_attributes_for_file(
     const std::unordered_set<std::string>& attributes_to_read,
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
-  std::string contents = read_entire_file(file_path);
-  extract_classes_from_layout(
-    contents,
-    attributes_to_read,
-    out_classes,
-    out_attributes);
+  with_mapped_file(file_path, [&](const char* data, size_t size) {
+    extract_classes_from_layout(
+        data, size, attributes_to_read, out_classes, out_attributes);
+  });
 }
 
 void collect_layout_classes_and_attributes(
@@ -969,12 +1228,36 @@ void collect_layout_classes_and_attributes(
     std::unordered_set<std::string>& out_classes,
     std::unordered_multimap<std::string, std::string>& out_attributes) {
   std::vector<std::string> files = find_layout_files(apk_directory);
-  for (auto layout_file : files) {
-    collect_layout_classes_and_attributes_for_file(
-      layout_file,
-      attributes_to_read,
-      out_classes,
-      out_attributes);
+
+  // Layouts are parsed in parallel, into results of each thread that are
+  // merged at the end.
+  struct LayoutResults {
+    std::unordered_set<std::string> classes;
+    std::unordered_multimap<std::string, std::string> attributes;
+  };
+  auto threads = num_threads();
+  std::vector<LayoutResults> thread_results(threads);
+  using State = WorkerState<const std::string*>;
+  WorkQueue<const std::string*> wq(
+      [&](State* state, const std::string* layout_file) {
+        auto& results = thread_results[state->worker_id()];
+        collect_layout_classes_and_attributes_for_file(
+            *layout_file, attributes_to_read, results.classes,
+            results.attributes);
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      threads);
+  for (const auto& layout_file : files) {
+    wq.add_item(&layout_file);
+  }
+  wq.run_all();
+
+  for (auto& results : thread_results) {
+    out_classes.insert(results.classes.begin(), results.classes.end());
+    out_attributes.insert(results.attributes.begin(),
+                          results.attributes.end());
   }
 }
 
@@ -1031,11 +1314,31 @@ std::vector<std::string> find_native_library_files(const std::string& apk_direct
  */
 std::unordered_set<std::string> get_native_classes(const std::string& apk_directory) {
   std::vector<std::string> native_libs = find_native_library_files(apk_directory);
+  // Libraries are scanned in parallel, into sets of each thread that are
+  // merged at the end.
+  auto threads = num_threads();
+  std::vector<std::unordered_set<std::string>> thread_classes(threads);
+  using State = WorkerState<const std::string*>;
+  WorkQueue<const std::string*> wq(
+      [&](State* state, const std::string* native_lib) {
+        auto& classes = thread_classes[state->worker_id()];
+        with_mapped_file(*native_lib, [&](const char* data, size_t size) {
+          auto lib_classes = extract_classes_from_native_lib(data, size);
+          classes.insert(lib_classes.begin(), lib_classes.end());
+        });
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      threads);
+  for (const auto& native_lib : native_libs) {
+    wq.add_item(&native_lib);
+  }
+  wq.run_all();
+
   std::unordered_set<std::string> all_classes;
-  for (auto native_lib : native_libs) {
-    std::string contents = read_entire_file(native_lib);
-    std::unordered_set<std::string> classes_from_layout = extract_classes_from_native_lib(contents);
-    all_classes.insert(classes_from_layout.begin(), classes_from_layout.end());
+  for (auto& classes : thread_classes) {
+    all_classes.insert(classes.begin(), classes.end());
   }
   return all_classes;
 }
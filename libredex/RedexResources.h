@@ -102,11 +102,19 @@ int inline_xml_reference_attributes(
 void remap_xml_reference_attributes(
     const std::string& filename,
     const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
+// Remaps the reference and attribute values of all resources in the given
+// resources.arsc, along with the parents and keys of their bags. Ids have a
+// fixed size, so the file is edited in place through a mapping instead of
+// being serialized again, as are the XML files above.
+void remap_arsc_reference_values(
+    const std::string& arsc_path,
+    const std::map<uint32_t, uint32_t>& kept_to_remapped_ids);
 
 // Iterates through all layouts in the given directory. Adds all class names to
 // the output set, and allows for any specified attribute values to be returned
 // as well. Attribute names should specify their namespace, if any (so
-// android:onClick instead of just onClick)
+// android:onClick instead of just onClick). The layouts are mapped and parsed
+// in parallel.
 void collect_layout_classes_and_attributes(
     const std::string& apk_directory,
     const std::unordered_set<std::string>& attributes_to_read,
@@ -82,14 +82,16 @@ class ReferencedState {
   // The number of keep rules that touch this class.
   std::atomic<unsigned int> m_keep_count{0};
 
-  std::mutex m_keep_reasons_mtx;
-  keep_reason::ReasonPtrSet m_keep_reasons;
+  // Only allocated once a keep reason is recorded, so that members don't pay
+  // for it unless record_keep_reasons() is set.
+  std::atomic<keep_reason::ReasonPtrSet*> m_keep_reasons{nullptr};
 
   // IR serialization class
   friend class ir_meta_io::IRMetaIO;
 
  public:
   ReferencedState() = default;
+  ~ReferencedState() { delete m_keep_reasons.load(); }
 
   // std::atomic requires an explicitly user-defined assignment operator.
   ReferencedState& operator=(const ReferencedState& other) {
@@ -224,7 +226,9 @@ class ReferencedState {
   }
 
   const keep_reason::ReasonPtrSet& keep_reasons() const {
-    return m_keep_reasons;
+    static const keep_reason::ReasonPtrSet empty;
+    auto reasons = m_keep_reasons.load(std::memory_order_acquire);
+    return reasons == nullptr ? empty : *reasons;
   }
 
   void set_keep_name() { inner_struct.m_keep_name = true; }
@@ -283,9 +287,5 @@ class ReferencedState {
   void set_dont_inline() { inner_struct.m_dont_inline = true; }
 
  private:
-  void add_keep_reason(const keep_reason::Reason* reason) {
-    always_assert(RedexContext::record_keep_reasons());
-    std::lock_guard<std::mutex> lock(m_keep_reasons_mtx);
-    m_keep_reasons.emplace(reason);
-  }
+  void add_keep_reason(const keep_reason::Reason* reason);
 };
@@ -97,6 +97,60 @@ DexMethod* resolve_method_ref(
   return nullptr;
 }
 
+namespace {
+
+/*
+ * Looks `ref` up in `cache`, and calls `resolve` on a miss. Only successful
+ * resolutions are recorded. The epoch is read before resolving, so a result
+ * that raced with a change to the hierarchy is never considered fresh.
+ */
+template <class Ref, class Def, class Resolve>
+Def* resolve_cached(RedexContext::ResolutionCache<Ref, Def>& cache,
+                    Ref* ref,
+                    uint8_t search,
+                    const Resolve& resolve) {
+  auto epoch = g_redex->resolution_epoch();
+  auto key = std::make_pair(const_cast<const Ref*>(ref), search);
+  auto cached = cache.get(key, std::make_pair(nullptr, size_t(0)));
+  if (cached.first != nullptr && cached.second == epoch) {
+    return cached.first;
+  }
+  Def* def = resolve();
+  if (def != nullptr) {
+    cache.update(key, [&](const std::pair<const Ref*, uint8_t>&,
+                          std::pair<Def*, size_t>& entry,
+                          bool /* exists */) {
+      if (entry.first == nullptr || entry.second <= epoch) {
+        entry = std::make_pair(def, epoch);
+      }
+    });
+  }
+  return def;
+}
+
+} // namespace
+
+DexMethod* resolve_method_ref_cached(DexMethodRef* method,
+                                     MethodSearch search) {
+  return resolve_cached(
+      g_redex->method_resolutions(), method, static_cast<uint8_t>(search),
+      [&]() -> DexMethod* {
+        auto cls = type_class(method->get_class());
+        if (cls == nullptr) return nullptr;
+        return resolve_method_ref(
+            cls, method->get_name(), method->get_proto(), search);
+      });
+}
+
+DexField* resolve_field_ref_cached(DexFieldRef* field, FieldSearch search) {
+  return resolve_cached(
+      g_redex->field_resolutions(), field, static_cast<uint8_t>(search),
+      [&]() {
+        return resolve_field(
+            field->get_class(), field->get_name(), field->get_type(), search);
+      });
+}
+
 DexField* resolve_field(
     const DexType* owner,
     const DexString* name,
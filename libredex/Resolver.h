@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRInstruction.h"
@@ -16,6 +17,8 @@
 
 
 using MethodRefCache = std::unordered_map<DexMethodRef*, DexMethod*>;
+// For resolvers that are shared between threads.
+using ConcurrentMethodRefCache = ConcurrentMap<DexMethodRef*, DexMethod*>;
 using MethodSet = std::unordered_set<DexMethod*>;
 
 /**
@@ -117,16 +120,22 @@ DexMethod* resolve_method_ref(
     const DexProto* proto,
     MethodSearch search);
 
+/**
+ * Resolve a method ref to its definition like resolve_method_ref(), and
+ * memoize the result in the RedexContext (see
+ * RedexContext::method_resolutions()). Safe to call concurrently.
+ */
+DexMethod* resolve_method_ref_cached(DexMethodRef* method, MethodSearch search);
+
 /**
  * Resolve a method to its definition.
  * If the method is already a definition return itself.
  * If the type the method belongs to is unknown return nullptr.
+ * Results are memoized globally, so callers don't need a cache of their own.
  */
 inline DexMethod* resolve_method(DexMethodRef* method, MethodSearch search) {
   if (method->is_def()) return static_cast<DexMethod*>(method);
-  auto cls = type_class(method->get_class());
-  if (cls == nullptr) return nullptr;
-  return resolve_method_ref(cls, method->get_name(), method->get_proto(), search);
+  return resolve_method_ref_cached(method, search);
 }
 
 /**
@@ -153,6 +162,24 @@ inline DexMethod* resolve_method(
   return mdef;
 }
 
+/**
+ * Same as above, but safe to call concurrently on the same cache.
+ */
+inline DexMethod* resolve_method(DexMethodRef* method,
+                                 MethodSearch search,
+                                 ConcurrentMethodRefCache& ref_cache) {
+  if (method->is_def()) return static_cast<DexMethod*>(method);
+  auto def = ref_cache.get(method, nullptr);
+  if (def != nullptr) {
+    return def;
+  }
+  auto mdef = resolve_method(method, search);
+  if (mdef != nullptr) {
+    ref_cache.emplace(method, mdef);
+  }
+  return mdef;
+}
+
 /**
  * Given a scope defined by DexClass, a name and a proto look for the vmethod
  * on the top ancestor. Essentially finds where the method was introduced.
@@ -187,6 +214,12 @@ DexField* resolve_field(
   const DexType*,
   FieldSearch = FieldSearch::Any);
 
+/**
+ * Same as resolve_field() on the field's owner, name and type, memoized in the
+ * RedexContext like resolve_method_ref_cached().
+ */
+DexField* resolve_field_ref_cached(DexFieldRef* field, FieldSearch search);
+
 /**
  * Given a field, search its class hierarchy for the definition.
  * If the field is a definition already the field is returned otherwise a
@@ -197,6 +230,5 @@ inline DexField* resolve_field(
   if (field->is_def()) {
     return static_cast<DexField*>(field);
   }
-  return resolve_field(
-      field->get_class(), field->get_name(), field->get_type(), search);
+  return resolve_field_ref_cached(field, search);
 }
@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SSA.h"
+
+#include <algorithm>
+
+#include "Debug.h"
+#include "IRInstruction.h"
+
+namespace ssa {
+
+namespace {
+
+// The registers `insn` reads, in the order of SSAForm::uses().
+template <class F>
+void for_each_read(const IRInstruction* insn, Register result, F f) {
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    f(insn->src(i));
+    if (insn->src_is_wide(i)) {
+      f(insn->src(i) + 1);
+    }
+  }
+  if (opcode::is_move_result_or_move_result_pseudo(insn->opcode())) {
+    f(result);
+    if (insn->dest_is_wide()) {
+      f(result + 1);
+    }
+  }
+}
+
+// The registers `insn` writes, in increasing order.
+template <class F>
+void for_each_write(const IRInstruction* insn, Register result, F f) {
+  if (insn->dests_size()) {
+    f(insn->dest());
+    if (insn->dest_is_wide()) {
+      f(insn->dest() + 1);
+    }
+  }
+  if (insn->has_move_result()) {
+    f(result);
+    f(result + 1);
+  }
+}
+
+} // namespace
+
+SSAForm::SSAForm(const cfg::ControlFlowGraph& cfg)
+    : m_dominators(cfg.dominators()) {
+  size_t max_block_id = 0;
+  Register num_code_registers = 0;
+  for (auto* block : cfg.blocks()) {
+    max_block_id = std::max(max_block_id, block->id());
+    if (!m_dominators->is_reachable(block)) {
+      continue;
+    }
+    m_blocks.push_back(block);
+    for (const auto& mie : InstructionIterable(block)) {
+      // The result register isn't known yet, but it's past all of these.
+      auto note = [&](Register reg) {
+        num_code_registers = std::max(num_code_registers, reg + 1);
+      };
+      for (size_t i = 0; i < mie.insn->srcs_size(); ++i) {
+        note(mie.insn->src(i) + (mie.insn->src_is_wide(i) ? 1 : 0));
+      }
+      if (mie.insn->dests_size()) {
+        note(mie.insn->dest() + (mie.insn->dest_is_wide() ? 1 : 0));
+      }
+    }
+  }
+  m_num_registers = num_code_registers + 2;
+  m_phis.resize(max_block_id + 1);
+
+  for (Register reg = 0; reg < m_num_registers; ++reg) {
+    m_definitions.push_back({Definition::ENTRY, reg, nullptr, nullptr, 0});
+  }
+
+  std::vector<std::vector<cfg::Block*>> def_blocks(m_num_registers);
+  std::vector<size_t> written_in(m_num_registers, 0);
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    auto* block = m_blocks[i];
+    for (const auto& mie : InstructionIterable(block)) {
+      for_each_write(mie.insn, result_register(), [&](Register reg) {
+        if (written_in[reg] != i + 1) {
+          written_in[reg] = i + 1;
+          def_blocks[reg].push_back(block);
+        }
+      });
+    }
+  }
+  place_phis(def_blocks);
+  rename(this, [](cfg::Block*, const IRList::iterator&,
+                  const std::vector<ValueId>&) {},
+         [](Register, ValueId, ValueId) {});
+}
+
+void SSAForm::place_phis(
+    const std::vector<std::vector<cfg::Block*>>& def_blocks) {
+  // Marked with the register + 1 being placed, so that they needn't be
+  // cleared in between.
+  std::vector<Register> has_phi(m_phis.size(), 0);
+  std::vector<Register> queued(m_phis.size(), 0);
+  std::vector<cfg::Block*> work;
+  for (Register reg = 0; reg < m_num_registers; ++reg) {
+    work = def_blocks[reg];
+    for (auto* block : work) {
+      queued[block->id()] = reg + 1;
+    }
+    while (!work.empty()) {
+      auto* block = work.back();
+      work.pop_back();
+      for (auto* frontier : m_dominators->frontier(block)) {
+        auto id = frontier->id();
+        if (has_phi[id] == reg + 1) {
+          continue;
+        }
+        has_phi[id] = reg + 1;
+        m_definitions.push_back({Definition::PHI, reg, nullptr, frontier,
+                                 static_cast<uint32_t>(m_phis[id].size())});
+        m_phis[id].push_back(
+            {reg, static_cast<ValueId>(m_definitions.size() - 1), {}});
+        // The phi writes the register too.
+        if (queued[id] != reg + 1) {
+          queued[id] = reg + 1;
+          work.push_back(frontier);
+        }
+      }
+    }
+  }
+}
+
+void SSAForm::rename(SSAForm* build,
+                     const OnInsn& on_insn,
+                     const OnSet& on_set) const {
+  std::vector<std::vector<cfg::Block*>> children(m_phis.size());
+  auto* root = m_dominators->root();
+  for (auto* block : m_blocks) {
+    if (block != root) {
+      children[m_dominators->idom(block)->id()].push_back(block);
+    }
+  }
+
+  std::vector<ValueId> values(m_num_registers);
+  for (Register reg = 0; reg < m_num_registers; ++reg) {
+    values[reg] = reg;
+    on_set(reg, NO_VALUE, reg);
+  }
+  // What each set() overwrote, to be restored when leaving the subtree.
+  std::vector<std::pair<Register, ValueId>> undo;
+  auto set = [&](Register reg, ValueId value) {
+    undo.emplace_back(reg, values[reg]);
+    on_set(reg, values[reg], value);
+    values[reg] = value;
+  };
+
+  auto visit = [&](cfg::Block* block) {
+    for (const auto& phi : m_phis[block->id()]) {
+      set(phi.reg, phi.value);
+    }
+    auto ii = InstructionIterable(block);
+    for (auto it = ii.begin(); it != ii.end(); ++it) {
+      const auto* insn = it->insn;
+      if (build != nullptr) {
+        std::vector<ValueId> uses;
+        for_each_read(insn, result_register(),
+                      [&](Register reg) { uses.push_back(values[reg]); });
+        if (!uses.empty()) {
+          build->m_uses.emplace(insn, std::move(uses));
+        }
+      }
+      on_insn(block, it.unwrap(), values);
+      ValueId value = NO_VALUE;
+      if (build != nullptr) {
+        value = m_definitions.size();
+      } else {
+        auto def_it = m_defs.find(insn);
+        if (def_it != m_defs.end()) {
+          value = def_it->second;
+        }
+      }
+      ValueId first = value;
+      for_each_write(insn, result_register(), [&](Register reg) {
+        if (build != nullptr) {
+          build->m_definitions.push_back(
+              {Definition::INSN, reg, insn, block, 0});
+        }
+        set(reg, value++);
+      });
+      if (build != nullptr && value != first) {
+        build->m_defs.emplace(insn, first);
+      }
+    }
+    if (build == nullptr) {
+      return;
+    }
+    for (const auto* edge : block->succs()) {
+      auto* succ = edge->target();
+      if (!m_dominators->is_reachable(succ)) {
+        continue;
+      }
+      for (auto& phi : build->m_phis[succ->id()]) {
+        // Several edges may come from the same block, like the cases of a
+        // switch.
+        if (!phi.operands.empty() && phi.operands.back().first == block) {
+          continue;
+        }
+        phi.operands.emplace_back(block, values[phi.reg]);
+      }
+    }
+  };
+
+  // The block, where its changes start in `undo`, and how many of its
+  // children have been visited.
+  struct Frame {
+    cfg::Block* block;
+    size_t undo_size;
+    size_t next_child;
+  };
+  std::vector<Frame> stack;
+  stack.push_back({root, undo.size(), 0});
+  visit(root);
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    const auto& kids = children[top.block->id()];
+    if (top.next_child < kids.size()) {
+      auto* child = kids[top.next_child++];
+      stack.push_back({child, undo.size(), 0});
+      visit(child);
+      continue;
+    }
+    while (undo.size() > top.undo_size) {
+      auto& entry = undo.back();
+      on_set(entry.first, values[entry.first], entry.second);
+      values[entry.first] = entry.second;
+      undo.pop_back();
+    }
+    stack.pop_back();
+  }
+}
+
+const std::vector<SSAForm::Phi>& SSAForm::phis(const cfg::Block* block) const {
+  static const std::vector<Phi> none;
+  return block->id() < m_phis.size() ? m_phis[block->id()] : none;
+}
+
+const std::vector<ValueId>& SSAForm::uses(const IRInstruction* insn) const {
+  static const std::vector<ValueId> none;
+  auto it = m_uses.find(insn);
+  return it == m_uses.end() ? none : it->second;
+}
+
+ValueId SSAForm::def(const IRInstruction* insn) const {
+  auto it = m_defs.find(insn);
+  return it == m_defs.end() ? NO_VALUE : it->second;
+}
+
+void SSAForm::walk(const OnInsn& on_insn, const OnSet& on_set) const {
+  rename(nullptr, on_insn, on_set);
+}
+
+} // namespace ssa
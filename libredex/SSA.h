@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "ControlFlow.h"
+
+namespace ssa {
+
+using ValueId = uint32_t;
+using Register = uint32_t;
+
+constexpr ValueId NO_VALUE = std::numeric_limits<ValueId>::max();
+
+/*
+ * The static single assignment form of the registers of a ControlFlowGraph.
+ * It is kept beside the code rather than in it: the code keeps its
+ * registers, and every definition of a register gets a value of its own.
+ *
+ * - The values 0 to num_registers() - 1 are what the registers hold on entry.
+ * - A phi merges the values a register holds at the end of the predecessors
+ *   of a block. Phis are placed at the iterated dominance frontiers of the
+ *   blocks that write the register. The form isn't pruned by liveness, so
+ *   that it also knows what the dead registers hold; copy propagation asks
+ *   about them.
+ * - Every register an instruction writes gets a new value. A wide register
+ *   pair gets one value per half.
+ *
+ * Invokes and the instructions with a move-result(-pseudo) write the result
+ * register pair, numbered right after the registers of the code, which
+ * move-result(-pseudo) then reads.
+ *
+ * The values flow along every edge as the predecessor ends, like the
+ * fixpoint iterators see them; within a try region a block ends at every
+ * instruction that may throw.
+ *
+ * Only the blocks reachable from the entry block are part of the form. As
+ * the code keeps its registers and phis stay on the side, there is no
+ * translation out of SSA: a transformation that only replaces a source
+ * register with another register holding the same value at that point
+ * leaves the code correct as it is.
+ */
+class SSAForm final {
+ public:
+  explicit SSAForm(const cfg::ControlFlowGraph& cfg);
+
+  // The registers of the code, and then the result register pair.
+  size_t num_registers() const { return m_num_registers; }
+
+  Register result_register() const { return m_num_registers - 2; }
+
+  size_t num_values() const { return m_definitions.size(); }
+
+  struct Phi {
+    Register reg;
+    ValueId value;
+    // One per reachable predecessor.
+    std::vector<std::pair<cfg::Block*, ValueId>> operands;
+  };
+
+  const std::vector<Phi>& phis(const cfg::Block* block) const;
+
+  struct Definition {
+    enum Kind : uint8_t { ENTRY, PHI, INSN };
+    Kind kind;
+    Register reg;
+    // The instruction of an INSN value.
+    const IRInstruction* insn;
+    // The block of a PHI or INSN value.
+    cfg::Block* block;
+    // Where the phi of a PHI value is in phis(block).
+    uint32_t index;
+  };
+
+  const Definition& definition(ValueId value) const {
+    return m_definitions[value];
+  }
+
+  const Phi& phi(ValueId value) const {
+    const auto& def = m_definitions[value];
+    return m_phis[def.block->id()][def.index];
+  }
+
+  // The values of the registers `insn` reads, in the order of its sources,
+  // with the upper half of a wide source right after its lower half. A
+  // move-result(-pseudo) reads the result register (pair).
+  const std::vector<ValueId>& uses(const IRInstruction* insn) const;
+
+  // The value `insn` defines in the first register it writes, or NO_VALUE.
+  // The upper half of a wide register pair gets the next value.
+  ValueId def(const IRInstruction* insn) const;
+
+  /*
+   * Replays the renaming of the registers: visits the reachable blocks in a
+   * preorder of the dominator tree, calling `on_insn` before each
+   * instruction with the values every register holds there, and `on_set`
+   * whenever a register takes a value -- first for the entry values, and
+   * when the walk leaves a subtree, for the values it restores.
+   */
+  using OnInsn = std::function<void(
+      cfg::Block*, const IRList::iterator&, const std::vector<ValueId>&)>;
+  using OnSet = std::function<void(Register, ValueId old, ValueId value)>;
+  void walk(const OnInsn& on_insn, const OnSet& on_set) const;
+
+ private:
+  void place_phis(const std::vector<std::vector<cfg::Block*>>& def_blocks);
+
+  // Numbers the values along the way when `build` is this form.
+  void rename(SSAForm* build, const OnInsn& on_insn, const OnSet& on_set) const;
+
+  size_t m_num_registers{0};
+  std::shared_ptr<const cfg::DominatorTree> m_dominators;
+  // The reachable blocks, in the order of the graph.
+  std::vector<cfg::Block*> m_blocks;
+  // Indexed by BlockId.
+  std::vector<std::vector<Phi>> m_phis;
+  std::vector<Definition> m_definitions;
+  std::unordered_map<const IRInstruction*, std::vector<ValueId>> m_uses;
+  std::unordered_map<const IRInstruction*, ValueId> m_defs;
+};
+
+} // namespace ssa
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SummaryCache.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+#include "ControlFlow.h"
+#include "IRCode.h"
+#include "Sha1.h"
+#include "Show.h"
+
+namespace {
+
+/*
+ * A textual form of the code that doesn't depend on anything that varies
+ * between builds of the same input, like pointer values. Branch targets and
+ * try regions are written in terms of the positions of the entries they refer
+ * to.
+ */
+void append_code(const IRCode& code, std::string* out) {
+  std::ostringstream ss;
+  if (code.editable_cfg_built()) {
+    ss << show(code.cfg());
+    out->append(ss.str());
+    return;
+  }
+  std::unordered_map<const MethodItemEntry*, size_t> index;
+  for (const auto& mie : code) {
+    index.emplace(&mie, index.size());
+  }
+  auto index_of = [&](const MethodItemEntry* mie) -> int64_t {
+    auto it = index.find(mie);
+    return it == index.end() ? -1 : int64_t(it->second);
+  };
+  for (const auto& mie : code) {
+    switch (mie.type) {
+    case MFLOW_OPCODE:
+      ss << show(mie.insn);
+      break;
+    case MFLOW_TRY:
+      ss << "try " << mie.tentry->type << " "
+         << index_of(mie.tentry->catch_start);
+      break;
+    case MFLOW_CATCH:
+      ss << "catch " << show(mie.centry->catch_type) << " "
+         << index_of(mie.centry->next);
+      break;
+    case MFLOW_TARGET:
+      ss << "target " << mie.target->type << " " << index_of(mie.target->src);
+      if (mie.target->type == BRANCH_MULTI) {
+        ss << " " << mie.target->case_key;
+      }
+      break;
+    default:
+      // Debug info and positions don't affect any analysis.
+      continue;
+    }
+    ss << "\n";
+  }
+  out->append(ss.str());
+}
+
+} // namespace
+
+SummaryCache::KeyBuilder::KeyBuilder(const std::string& ns) : m_data(ns) {
+  m_data.push_back('\n');
+}
+
+SummaryCache::KeyBuilder& SummaryCache::KeyBuilder::add_method(
+    const DexMethod* method) {
+  m_data.append(show(method));
+  m_data.push_back('\n');
+  m_data.append(std::to_string(method->get_access()));
+  m_data.push_back('\n');
+  if (method->get_code() != nullptr) {
+    append_code(*method->get_code(), &m_data);
+  }
+  return *this;
+}
+
+SummaryCache::KeyBuilder& SummaryCache::KeyBuilder::add(
+    const std::string& data) {
+  m_data.append(data);
+  m_data.push_back('\n');
+  return *this;
+}
+
+SummaryCache::KeyBuilder& SummaryCache::KeyBuilder::add(
+    const sparta::s_expr& expr) {
+  std::ostringstream ss;
+  ss << expr;
+  return add(ss.str());
+}
+
+std::string SummaryCache::KeyBuilder::build() {
+  Sha1Context context;
+  sha1_init(&context);
+  sha1_update(&context,
+              reinterpret_cast<const unsigned char*>(m_data.data()),
+              static_cast<unsigned int>(m_data.size()));
+  unsigned char digest[20];
+  sha1_final(digest, &context);
+  static const char* hex = "0123456789abcdef";
+  std::string result;
+  for (auto byte : digest) {
+    result.push_back(hex[byte >> 4]);
+    result.push_back(hex[byte & 0xf]);
+  }
+  return result;
+}
+
+size_t SummaryCache::load(const std::string& path) {
+  std::ifstream input(path);
+  if (!input) {
+    return 0;
+  }
+  sparta::s_expr_istream s_expr_input(input);
+  size_t load_count{0};
+  while (s_expr_input.good()) {
+    sparta::s_expr expr;
+    s_expr_input >> expr;
+    if (s_expr_input.eoi()) {
+      break;
+    }
+    always_assert_log(!s_expr_input.fail(), "%s\n",
+                      s_expr_input.what().c_str());
+    always_assert(expr.size() == 3);
+    m_entries.insert_or_assign(
+        std::make_pair(expr[0].str() + ":" + expr[1].str(), expr[2]));
+    ++load_count;
+  }
+  return load_count;
+}
+
+void SummaryCache::save(const std::string& path) const {
+  // Sort the entries so the output is deterministic.
+  std::map<std::string, sparta::s_expr> sorted;
+  for (const auto& pair : m_entries) {
+    if (m_used.count_unsafe(pair.first) != 0) {
+      sorted.emplace(pair);
+    }
+  }
+  std::ofstream output(path);
+  for (const auto& pair : sorted) {
+    auto sep = pair.first.find(':');
+    output << sparta::s_expr({sparta::s_expr(pair.first.substr(0, sep)),
+                              sparta::s_expr(pair.first.substr(sep + 1)),
+                              pair.second})
+           << std::endl;
+  }
+}
+
+boost::optional<sparta::s_expr> SummaryCache::get(
+    const std::string& ns, const std::string& key) const {
+  auto full_key = ns + ":" + key;
+  // Entries are never erased, so the entry can't vanish between these calls.
+  if (m_entries.count(full_key) == 0) {
+    ++m_misses;
+    return boost::none;
+  }
+  ++m_hits;
+  m_used.insert(full_key);
+  return m_entries.at(full_key);
+}
+
+void SummaryCache::put(const std::string& ns,
+                       const std::string& key,
+                       const sparta::s_expr& summary) {
+  auto full_key = ns + ":" + key;
+  m_entries.insert_or_assign(std::make_pair(full_key, summary));
+  m_used.insert(full_key);
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <boost/optional.hpp>
+#include <string>
+
+#include "ConcurrentContainers.h"
+#include "DexClass.h"
+#include "S_Expression.h"
+
+/*
+ * A persistent, content-addressed cache of per-method analysis summaries.
+ *
+ * Summaries are stored under a SHA1 key of everything the analysis of a method
+ * depends on: the method's signature and code, plus whatever the analysis
+ * consumed from its callees (typically their summaries). Since callee
+ * summaries feed into their callers' keys, a change in one method's summary
+ * invalidates its callers transitively, while a change that doesn't alter a
+ * summary stops propagating right there. Keys don't involve any pointers, so
+ * they stay valid across builds, making it possible to reuse the summaries of
+ * unchanged code in incremental builds.
+ *
+ * Entries are namespaced by analysis. The cache is written out as one
+ * s-expression per line: (namespace key summary).
+ */
+class SummaryCache {
+ public:
+  class KeyBuilder {
+   public:
+    explicit KeyBuilder(const std::string& ns);
+
+    // Feeds the signature and code of `method`. Its CFG, if built, is used to
+    // capture the control flow; debug info and positions are ignored.
+    KeyBuilder& add_method(const DexMethod* method);
+
+    KeyBuilder& add(const std::string& data);
+
+    KeyBuilder& add(const sparta::s_expr& expr);
+
+    // Hex-encoded SHA1 of everything fed in so far.
+    std::string build();
+
+   private:
+    std::string m_data;
+  };
+
+  /*
+   * Loads entries from `path`, if it exists. Returns the number loaded.
+   */
+  size_t load(const std::string& path);
+
+  /*
+   * Writes out the entries that were looked up or added since loading, so
+   * that summaries of code that no longer exists don't accumulate.
+   */
+  void save(const std::string& path) const;
+
+  /*
+   * These operations are always thread-safe.
+   */
+  boost::optional<sparta::s_expr> get(const std::string& ns,
+                                      const std::string& key) const;
+
+  void put(const std::string& ns,
+           const std::string& key,
+           const sparta::s_expr& summary);
+
+  size_t hits() const { return m_hits; }
+  size_t misses() const { return m_misses; }
+
+ private:
+  // (namespace + ':' + key) -> summary
+  ConcurrentMap<std::string, sparta::s_expr> m_entries;
+  mutable ConcurrentSet<std::string> m_used;
+  mutable std::atomic<size_t> m_hits{0};
+  mutable std::atomic<size_t> m_misses{0};
+};
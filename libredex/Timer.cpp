@@ -14,7 +14,9 @@ std::mutex Timer::s_lock;
 Timer::times_t Timer::s_times;
 
 Timer::Timer(const std::string& msg)
-    : m_msg(msg), m_start(std::chrono::high_resolution_clock::now()) {
+    : m_msg(msg),
+      m_start(std::chrono::high_resolution_clock::now()),
+      m_span("timer", msg) {
   ++s_indent;
 }
 
@@ -13,6 +13,8 @@
 #include <utility>
 #include <vector>
 
+#include "EventTrace.h"
+
 struct Timer {
   Timer(const std::string& msg);
   ~Timer();
@@ -27,4 +29,5 @@ struct Timer {
   static unsigned s_indent;
   std::string m_msg;
   std::chrono::high_resolution_clock::time_point m_start;
+  event_trace::Span m_span;
 };
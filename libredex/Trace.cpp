@@ -83,7 +83,9 @@ struct Tracer {
         return;
       }
     }
-    std::lock_guard<std::mutex> guard(TraceContext::s_trace_mutex);
+    // Format the line before taking the lock, so that threads only wait for
+    // each other to write.
+    std::string line;
     if (m_show_timestamps) {
       auto t = std::time(nullptr);
       struct tm local_tm;
@@ -94,15 +96,26 @@ struct Tracer {
 #endif
       std::array<char, 40> buf;
       std::strftime(buf.data(), sizeof(buf), "%c", &local_tm);
-      fprintf(m_file, "[%s]", buf.data());
+      line += "[" + std::string(buf.data()) + "]";
       if (!m_show_tracemodule) {
-        fprintf(m_file, " ");
+        line += " ";
       }
     }
     if (m_show_tracemodule) {
-      fprintf(m_file, "[%s:%d] ", m_module_id_name_map[module].c_str(), level);
+      line += "[" + m_module_id_name_map.at(module) + ":" +
+              std::to_string(level) + "] ";
+    }
+    va_list ap_size;
+    va_copy(ap_size, ap);
+    int size = vsnprintf(nullptr, 0, fmt, ap_size);
+    va_end(ap_size);
+    if (size > 0) {
+      auto prefix = line.size();
+      line.resize(prefix + size);
+      vsnprintf(&line[prefix], size + 1, fmt, ap);
     }
-    vfprintf(m_file, fmt, ap);
+    std::lock_guard<std::mutex> guard(TraceContext::s_trace_mutex);
+    fwrite(line.data(), 1, line.size(), m_file);
     fflush(m_file);
   }
 
@@ -23,6 +23,7 @@
   TM(BPH)                \
   TM(BRIDGE)             \
   TM(BUILDERS)           \
+  TM(CALLGRAPH)          \
   TM(CFG)                \
   TM(CFP)                \
   TM(CLP_GQL)            \
@@ -49,12 +50,14 @@
   TM(IDEX)               \
   TM(INLINE)             \
   TM(GETTER)             \
+  TM(GVN_PRE)            \
   TM(INL)                \
   TM(INLRES)             \
   TM(INSTRUMENT)         \
   TM(INTF)               \
   TM(BLD_PATTERN)        \
   TM(LIB)                \
+  TM(LICM)               \
   TM(LOC)                \
   TM(MAGIC_FIELDS)       \
   TM(MAIN)               \
@@ -90,6 +93,7 @@
   TM(RMUF)               \
   TM(RM_INTF)            \
   TM(RP)                 \
+  TM(SCALAR_REPL)        \
   TM(SDIS)               \
   TM(SHORTEN)            \
   TM(SINK)               \
@@ -7,6 +7,7 @@
 
 #include "TypeInference.h"
 
+#include <boost/functional/hash.hpp>
 #include <ostream>
 #include <sstream>
 
@@ -84,38 +85,33 @@ std::ostream& operator<<(std::ostream& output, const IRType& type) {
 
 namespace type_inference {
 
-TypeLattice type_lattice(
-    {BOTTOM, ZERO, CONST, CONST1, CONST2, REFERENCE, INT, FLOAT, LONG1, LONG2,
-     DOUBLE1, DOUBLE2, SCALAR, SCALAR1, SCALAR2, TOP},
-    {{BOTTOM, ZERO},    {BOTTOM, CONST1},   {BOTTOM, CONST2},
-     {ZERO, REFERENCE}, {ZERO, CONST},      {CONST, INT},
-     {CONST, FLOAT},    {CONST1, LONG1},    {CONST1, DOUBLE1},
-     {CONST2, LONG2},   {CONST2, DOUBLE2},  {INT, SCALAR},
-     {FLOAT, SCALAR},   {LONG1, SCALAR1},   {DOUBLE1, SCALAR1},
-     {LONG2, SCALAR2},  {DOUBLE2, SCALAR2}, {REFERENCE, TOP},
-     {SCALAR, TOP},     {SCALAR1, TOP},     {SCALAR2, TOP}});
-
-void set_type(TypeEnvironment* state, register_t reg, const TypeDomain& type) {
+template <class Environment>
+void set_type(Environment* state, register_t reg, const TypeDomain& type) {
   state->set_type(reg, type);
 }
 
-void set_integer(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_integer(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(INT));
 }
 
-void set_float(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_float(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(FLOAT));
 }
 
-void set_scalar(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_scalar(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(SCALAR));
 }
 
-void set_reference(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_reference(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(REFERENCE));
 }
 
-void set_reference(TypeEnvironment* state,
+template <class Environment>
+void set_reference(Environment* state,
                    register_t reg,
                    const boost::optional<const DexType*>& dex_type_opt) {
   state->set_type(reg, TypeDomain(REFERENCE));
@@ -124,17 +120,20 @@ void set_reference(TypeEnvironment* state,
   state->set_concrete_type(reg, dex_type);
 }
 
-void set_long(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_long(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(LONG1));
   state->set_type(reg + 1, TypeDomain(LONG2));
 }
 
-void set_double(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_double(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(DOUBLE1));
   state->set_type(reg + 1, TypeDomain(DOUBLE2));
 }
 
-void set_wide_scalar(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void set_wide_scalar(Environment* state, register_t reg) {
   state->set_type(reg, TypeDomain(SCALAR1));
   state->set_type(reg + 1, TypeDomain(SCALAR2));
 }
@@ -142,7 +141,8 @@ void set_wide_scalar(TypeEnvironment* state, register_t reg) {
 // This is used for the operand of a comparison operation with zero. The
 // complexity here is that this operation may be performed on either an
 // integer or a reference.
-void refine_comparable_with_zero(TypeEnvironment* state, register_t reg) {
+template <class Environment>
+void refine_comparable_with_zero(Environment* state, register_t reg) {
   if (state->is_bottom()) {
     // There's nothing to do for unreachable code.
     return;
@@ -165,7 +165,8 @@ void refine_comparable_with_zero(TypeEnvironment* state, register_t reg) {
 // This is used for the operands of a comparison operation between two
 // registers. The complexity here is that this operation may be performed on
 // either two integers or two references.
-void refine_comparable(TypeEnvironment* state,
+template <class Environment>
+void refine_comparable(Environment* state,
                        register_t reg1,
                        register_t reg2) {
   if (state->is_bottom()) {
@@ -190,10 +191,12 @@ void refine_comparable(TypeEnvironment* state,
   }
 }
 
-TypeDomain TypeInference::refine_type(const TypeDomain& type,
-                                      IRType expected,
-                                      IRType const_type,
-                                      IRType scalar_type) const {
+template <class Environment>
+TypeDomain TypeInferenceImpl<Environment>::refine_type(
+    const TypeDomain& type,
+    IRType expected,
+    IRType const_type,
+    IRType scalar_type) const {
   auto refined_type = type.meet(TypeDomain(expected));
   // If constants are not considered polymorphic (the default behavior of the
   // Android verifier), we lift the constant to the type expected in the given
@@ -205,19 +208,21 @@ TypeDomain TypeInference::refine_type(const TypeDomain& type,
   return refined_type;
 }
 
-void TypeInference::refine_type(TypeEnvironment* state,
-                                register_t reg,
-                                IRType expected) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_type(Environment* state,
+                                                 register_t reg,
+                                                 IRType expected) const {
   state->update_type(reg, [this, expected](const TypeDomain& type) {
     return refine_type(
         type, expected, /* const_type */ CONST, /* scalar_type */ SCALAR);
   });
 }
 
-void TypeInference::refine_wide_type(TypeEnvironment* state,
-                                     register_t reg,
-                                     IRType expected1,
-                                     IRType expected2) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_wide_type(Environment* state,
+                                                      register_t reg,
+                                                      IRType expected1,
+                                                      IRType expected2) const {
   state->update_type(reg, [this, expected1](const TypeDomain& type) {
     return refine_type(type,
                        expected1,
@@ -232,59 +237,70 @@ void TypeInference::refine_wide_type(TypeEnvironment* state,
   });
 }
 
-void TypeInference::refine_reference(TypeEnvironment* state,
-                                     register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_reference(Environment* state,
+                                                      register_t reg) const {
   refine_type(state,
               reg,
               /* expected */ REFERENCE);
 }
 
-void TypeInference::refine_scalar(TypeEnvironment* state,
-                                  register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_scalar(Environment* state,
+                                                   register_t reg) const {
   refine_type(state,
               reg,
               /* expected */ SCALAR);
 }
 
-void TypeInference::refine_integer(TypeEnvironment* state,
-                                   register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_integer(Environment* state,
+                                                    register_t reg) const {
   refine_type(state, reg, /* expected */ INT);
 }
 
-void TypeInference::refine_float(TypeEnvironment* state, register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_float(Environment* state,
+                                                  register_t reg) const {
   refine_type(state, reg, /* expected */ FLOAT);
 }
 
-void TypeInference::refine_wide_scalar(TypeEnvironment* state,
-                                       register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_wide_scalar(Environment* state,
+                                                        register_t reg) const {
   refine_wide_type(
       state, reg, /* expected1 */ SCALAR1, /* expected2 */ SCALAR2);
 }
 
-void TypeInference::refine_long(TypeEnvironment* state, register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_long(Environment* state,
+                                                 register_t reg) const {
   refine_wide_type(state, reg, /* expected1 */ LONG1, /* expected2 */ LONG2);
 }
 
-void TypeInference::refine_double(TypeEnvironment* state,
-                                  register_t reg) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::refine_double(Environment* state,
+                                                   register_t reg) const {
   refine_wide_type(
       state, reg, /* expected1 */ DOUBLE1, /* expected2 */ DOUBLE2);
 }
 
-void TypeInference::run(DexMethod* dex_method) {
+template <class Environment>
+void TypeInferenceImpl<Environment>::run(DexMethod* dex_method) {
   run(is_static(dex_method), dex_method->get_class(),
       dex_method->get_proto()->get_args());
 }
 
-void TypeInference::run(bool is_static,
-                        DexType* declaring_type,
-                        DexTypeList* args) {
+template <class Environment>
+void TypeInferenceImpl<Environment>::run(bool is_static,
+                                         DexType* declaring_type,
+                                         DexTypeList* args) {
   // We need to compute the initial environment by assigning the parameter
   // registers their correct types derived from the method's signature. The
   // IOPCODE_LOAD_PARAM_* instructions are pseudo-operations that are used to
   // specify the formal parameters of the method. They must be interpreted
   // separately.
-  auto init_state = TypeEnvironment::top();
+  auto init_state = Environment::top();
   const auto& signature = args->get_type_list();
   auto sig_it = signature.begin();
   bool first_param = true;
@@ -334,7 +350,7 @@ void TypeInference::run(bool is_static,
     }
   }
 done:
-  MonotonicFixpointIterator::run(init_state);
+  ir_analyzer::BaseIRAnalyzer<Environment>::run(init_state);
   populate_type_environments();
 }
 
@@ -343,8 +359,9 @@ done:
 //
 // Similarly, the various refine_* functions are used to refine the
 // type of a register depending on the context (e.g., from SCALAR to INT).
-void TypeInference::analyze_instruction(IRInstruction* insn,
-                                        TypeEnvironment* current_state) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::analyze_instruction(
+    IRInstruction* insn, Environment* current_state) const {
   switch (insn->opcode()) {
   case IOPCODE_LOAD_PARAM:
   case IOPCODE_LOAD_PARAM_OBJECT:
@@ -974,7 +991,8 @@ void TypeInference::analyze_instruction(IRInstruction* insn,
   }
 }
 
-void TypeInference::print(std::ostream& output) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::print(std::ostream& output) const {
   for (cfg::Block* block : m_cfg.blocks()) {
     for (auto& mie : InstructionIterable(block)) {
       IRInstruction* insn = mie.insn;
@@ -985,7 +1003,8 @@ void TypeInference::print(std::ostream& output) const {
   }
 }
 
-void TypeInference::traceState(TypeEnvironment* state) const {
+template <class Environment>
+void TypeInferenceImpl<Environment>::traceState(Environment* state) const {
   if (!traceEnabled(TYPE, 9)) {
     return;
   }
@@ -994,12 +1013,13 @@ void TypeInference::traceState(TypeEnvironment* state) const {
   TRACE(TYPE, 9, "%s\n", out.str().c_str());
 }
 
-void TypeInference::populate_type_environments() {
+template <class Environment>
+void TypeInferenceImpl<Environment>::populate_type_environments() {
   // We reserve enough space for the map in order to avoid repeated rehashing
   // during the computation.
   m_type_envs.reserve(m_cfg.blocks().size() * 16);
   for (cfg::Block* block : m_cfg.blocks()) {
-    TypeEnvironment current_state = get_entry_state_at(block);
+    Environment current_state = this->get_entry_state_at(block);
     for (auto& mie : InstructionIterable(block)) {
       IRInstruction* insn = mie.insn;
       m_type_envs.emplace(insn, current_state);
@@ -1008,4 +1028,67 @@ void TypeInference::populate_type_environments() {
   }
 }
 
+template class TypeInferenceImpl<TypeEnvironment>;
+template class TypeInferenceImpl<ArrayTypeEnvironment>;
+
+namespace {
+
+/*
+ * Identifies the inputs of a TypeInference run on `method`. Instructions are
+ * hashed both by address, since the results are keyed by IRInstruction*, and by
+ * content, since passes edit instructions in place.
+ */
+size_t type_inference_stamp(const DexMethod* method,
+                            const cfg::ControlFlowGraph& cfg) {
+  size_t seed = 0;
+  boost::hash_combine(seed, is_static(method));
+  boost::hash_combine(seed, method->get_class());
+  boost::hash_combine(seed, method->get_proto());
+  for (const cfg::Block* block : cfg.blocks()) {
+    boost::hash_combine(seed, block->id());
+    for (const auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      boost::hash_combine(seed, insn);
+      boost::hash_combine(seed, insn->hash());
+      if (insn->has_method()) {
+        boost::hash_combine(seed, insn->get_method()->get_proto());
+      } else if (insn->has_field()) {
+        boost::hash_combine(seed, insn->get_field()->get_type());
+      }
+    }
+    for (const cfg::Edge* edge : block->succs()) {
+      boost::hash_combine(seed, static_cast<int>(edge->type()));
+      boost::hash_combine(seed, edge->target()->id());
+      if (edge->case_key()) {
+        boost::hash_combine(seed, *edge->case_key());
+      }
+      if (edge->throw_info() != nullptr) {
+        boost::hash_combine(seed, edge->throw_info()->catch_type);
+        boost::hash_combine(seed, edge->throw_info()->index);
+      }
+    }
+  }
+  return seed;
+}
+
+} // namespace
+
+std::shared_ptr<const TypeEnvironments> get_type_environments(
+    DexMethod* method) {
+  auto code = method->get_code();
+  const auto& cfg = code->cfg();
+  auto stamp = type_inference_stamp(method, cfg);
+  auto& cache = code->type_inference_cache();
+  if (cache != nullptr && cache->stamp == stamp) {
+    return cache->type_envs;
+  }
+  TypeInference inference(cfg);
+  inference.run(method);
+  auto type_envs = std::make_shared<const TypeEnvironments>(
+      std::move(inference.get_type_environments()));
+  cache = std::make_shared<CachedTypeEnvironments>(
+      CachedTypeEnvironments{stamp, type_envs});
+  return type_envs;
+}
+
 } // namespace type_inference
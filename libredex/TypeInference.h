@@ -8,13 +8,17 @@
 #pragma once
 
 #include <boost/optional/optional_io.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <ostream>
 
+#include "AbstractDomain.h"
 #include "BaseIRAnalyzer.h"
 #include "DexTypeDomain.h"
-#include "FiniteAbstractDomain.h"
 #include "PatriciaTreeMapAbstractEnvironment.h"
 #include "ReducedProductAbstractDomain.h"
+#include "RegisterArrayEnvironment.h"
 
 /*
  * This is the implementation of a type checker for the IR that aims at
@@ -99,7 +103,7 @@
  * control-flow graph.
  */
 
-enum IRType {
+enum IRType : uint8_t {
   BOTTOM,
   ZERO,
   CONST,
@@ -124,73 +128,229 @@ namespace type_inference {
 
 using std::placeholders::_1;
 
-using TypeLattice = sparta::BitVectorLattice<IRType, 16, std::hash<int>>;
+namespace impl {
 
-extern TypeLattice type_lattice;
+constexpr size_t TYPE_COUNT = TOP + 1;
 
-using TypeDomain = sparta::FiniteAbstractDomain<IRType,
-                                                TypeLattice,
-                                                TypeLattice::Encoding,
-                                                &type_lattice>;
+// The Hasse diagram of the type lattice: each type is immediately less than
+// the one it's paired with.
+constexpr IRType TYPE_HASSE_DIAGRAM[][2] = {
+    {BOTTOM, ZERO},    {BOTTOM, CONST1},   {BOTTOM, CONST2},
+    {ZERO, REFERENCE}, {ZERO, CONST},      {CONST, INT},
+    {CONST, FLOAT},    {CONST1, LONG1},    {CONST1, DOUBLE1},
+    {CONST2, LONG2},   {CONST2, DOUBLE2},  {INT, SCALAR},
+    {FLOAT, SCALAR},   {LONG1, SCALAR1},   {DOUBLE1, SCALAR1},
+    {LONG2, SCALAR2},  {DOUBLE2, SCALAR2}, {REFERENCE, TOP},
+    {SCALAR, TOP},     {SCALAR1, TOP},     {SCALAR2, TOP}};
 
-using register_t = ir_analyzer::register_t;
-using namespace ir_analyzer;
+/*
+ * The order, Join and Meet of all pairs of types, computed at compile time
+ * from the Hasse diagram, so that the operations of TypeDomain are lookups in
+ * a few hundred bytes of constant tables.
+ */
+struct TypeLattice {
+  constexpr TypeLattice() {
+    for (size_t i = 0; i < TYPE_COUNT; ++i) {
+      leq[i][i] = true;
+    }
+    for (const auto& edge : TYPE_HASSE_DIAGRAM) {
+      leq[edge[0]][edge[1]] = true;
+    }
+    // Warshall's algorithm.
+    for (size_t k = 0; k < TYPE_COUNT; ++k) {
+      for (size_t i = 0; i < TYPE_COUNT; ++i) {
+        for (size_t j = 0; j < TYPE_COUNT; ++j) {
+          leq[i][j] = leq[i][j] || (leq[i][k] && leq[k][j]);
+        }
+      }
+    }
+    for (size_t x = 0; x < TYPE_COUNT; ++x) {
+      for (size_t y = 0; y < TYPE_COUNT; ++y) {
+        // In a lattice, the least of the upper bounds is less than all the
+        // others, so keeping the lesser of any two of them finds it.
+        size_t lub = TOP;
+        size_t glb = BOTTOM;
+        for (size_t z = 0; z < TYPE_COUNT; ++z) {
+          if (leq[x][z] && leq[y][z] && leq[z][lub]) {
+            lub = z;
+          }
+          if (leq[z][x] && leq[z][y] && leq[glb][z]) {
+            glb = z;
+          }
+        }
+        join[x][y] = static_cast<IRType>(lub);
+        meet[x][y] = static_cast<IRType>(glb);
+      }
+    }
+  }
+
+  // Checks that the Hasse diagram does describe a lattice, i.e., that the
+  // Join and Meet computed above are the least upper and greatest lower
+  // bounds.
+  constexpr bool is_lattice() const {
+    for (size_t x = 0; x < TYPE_COUNT; ++x) {
+      for (size_t y = 0; y < TYPE_COUNT; ++y) {
+        for (size_t z = 0; z < TYPE_COUNT; ++z) {
+          if ((leq[x][z] && leq[y][z]) != leq[join[x][y]][z] ||
+              (leq[z][x] && leq[z][y]) != leq[z][meet[x][y]]) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
 
-using BasicTypeEnvironment =
-    sparta::PatriciaTreeMapAbstractEnvironment<register_t, TypeDomain>;
+  bool leq[TYPE_COUNT][TYPE_COUNT]{};
+  IRType join[TYPE_COUNT][TYPE_COUNT]{};
+  IRType meet[TYPE_COUNT][TYPE_COUNT]{};
+};
+
+constexpr TypeLattice TYPE_LATTICE{};
 
-using DexTypeEnvironment =
-    sparta::PatriciaTreeMapAbstractEnvironment<register_t, DexTypeDomain>;
+static_assert(TYPE_LATTICE.is_lattice(), "The IRType order isn't a lattice");
 
-class TypeEnvironment final
-    : public sparta::ReducedProductAbstractDomain<TypeEnvironment,
-                                                  BasicTypeEnvironment,
-                                                  DexTypeEnvironment> {
+} // namespace impl
+
+/*
+ * An element of the type lattice, stored as a single byte. This is not a
+ * sparta::FiniteAbstractDomain, whose bit-vector encoding takes a hash table
+ * lookup to decode: the type checker reads the type of every register used by
+ * every instruction.
+ */
+class TypeDomain final : public sparta::AbstractDomain<TypeDomain> {
  public:
-  using ReducedProductAbstractDomain::ReducedProductAbstractDomain;
+  /*
+   * A default constructor is required in the AbstractDomain specification.
+   */
+  TypeDomain() : m_type(TOP) {}
+
+  explicit TypeDomain(IRType type) : m_type(type) {}
+
+  IRType element() const { return m_type; }
+
+  bool is_bottom() const override { return m_type == BOTTOM; }
+
+  bool is_top() const override { return m_type == TOP; }
+
+  bool leq(const TypeDomain& other) const override {
+    return impl::TYPE_LATTICE.leq[m_type][other.m_type];
+  }
+
+  bool equals(const TypeDomain& other) const override {
+    return m_type == other.m_type;
+  }
+
+  void set_to_bottom() override { m_type = BOTTOM; }
+
+  void set_to_top() override { m_type = TOP; }
+
+  void join_with(const TypeDomain& other) override {
+    m_type = impl::TYPE_LATTICE.join[m_type][other.m_type];
+  }
+
+  void widen_with(const TypeDomain& other) override { join_with(other); }
+
+  void meet_with(const TypeDomain& other) override {
+    m_type = impl::TYPE_LATTICE.meet[m_type][other.m_type];
+  }
+
+  void narrow_with(const TypeDomain& other) override { meet_with(other); }
+
+  static TypeDomain bottom() { return TypeDomain(BOTTOM); }
+
+  static TypeDomain top() { return TypeDomain(TOP); }
+
+ private:
+  IRType m_type;
+};
+
+inline std::ostream& operator<<(std::ostream& output, const TypeDomain& type) {
+  return output << type.element();
+}
+
+using register_t = ir_analyzer::register_t;
+using namespace ir_analyzer;
+
+/*
+ * The register environments are a template parameter, so that the analysis
+ * can run on either sparta::PatriciaTreeMapAbstractEnvironment, the default,
+ * or sparta::RegisterArrayEnvironment, which is cheaper on methods where most
+ * registers hold a value.
+ */
+template <template <typename, typename> class RegisterEnvironment>
+class TypeEnvironmentImpl final
+    : public sparta::ReducedProductAbstractDomain<
+          TypeEnvironmentImpl<RegisterEnvironment>,
+          RegisterEnvironment<register_t, TypeDomain>,
+          RegisterEnvironment<register_t, DexTypeDomain>> {
+ public:
+  using BasicTypeEnvironment = RegisterEnvironment<register_t, TypeDomain>;
+  using DexTypeEnvironment = RegisterEnvironment<register_t, DexTypeDomain>;
+  using Base =
+      sparta::ReducedProductAbstractDomain<TypeEnvironmentImpl,
+                                           BasicTypeEnvironment,
+                                           DexTypeEnvironment>;
+  using typename Base::ReducedProductAbstractDomain;
 
   static void reduce_product(
       std::tuple<BasicTypeEnvironment, DexTypeEnvironment>& /* product */) {}
 
-  TypeDomain get_type(register_t reg) const { return get<0>().get(reg); }
+  TypeDomain get_type(register_t reg) const {
+    return Base::template get<0>().get(reg);
+  }
 
   void set_type(register_t reg, const TypeDomain type) {
-    apply<0>([=](auto env) { env->set(reg, type); }, true);
+    Base::template apply<0>([=](auto env) { env->set(reg, type); }, true);
   }
 
   void update_type(
       register_t reg,
       const std::function<TypeDomain(const TypeDomain&)>& operation) {
-    apply<0>([=](auto env) { env->update(reg, operation); }, true);
+    Base::template apply<0>([=](auto env) { env->update(reg, operation); },
+                            true);
   }
 
   boost::optional<const DexType*> get_dex_type(register_t reg) const {
-    return get<1>().get(reg).get_dex_type();
+    return Base::template get<1>().get(reg).get_dex_type();
   }
 
   void set_concrete_type(register_t reg, const DexTypeDomain& dex_type) {
-    apply<1>([=](auto env) { env->set(reg, dex_type); }, true);
+    Base::template apply<1>([=](auto env) { env->set(reg, dex_type); }, true);
   }
 };
 
-class TypeInference final
-    : public ir_analyzer::BaseIRAnalyzer<TypeEnvironment> {
+using TypeEnvironment =
+    TypeEnvironmentImpl<sparta::PatriciaTreeMapAbstractEnvironment>;
+
+using ArrayTypeEnvironment =
+    TypeEnvironmentImpl<sparta::RegisterArrayEnvironment>;
+
+using BasicTypeEnvironment = TypeEnvironment::BasicTypeEnvironment;
+
+using DexTypeEnvironment = TypeEnvironment::DexTypeEnvironment;
+
+// Explicitly instantiated for TypeEnvironment and ArrayTypeEnvironment in
+// TypeInference.cpp.
+template <class Environment>
+class TypeInferenceImpl final
+    : public ir_analyzer::BaseIRAnalyzer<Environment> {
  public:
-  TypeInference(const cfg::ControlFlowGraph& cfg)
-      : ir_analyzer::BaseIRAnalyzer<TypeEnvironment>(cfg), m_cfg(cfg) {}
+  TypeInferenceImpl(const cfg::ControlFlowGraph& cfg)
+      : ir_analyzer::BaseIRAnalyzer<Environment>(cfg), m_cfg(cfg) {}
 
   void run(DexMethod* dex_method);
 
   void run(bool is_static, DexType* declaring_type, DexTypeList* args);
 
   void analyze_instruction(IRInstruction* insn,
-                           TypeEnvironment* current_state) const override;
+                           Environment* current_state) const override;
 
   void print(std::ostream& output) const;
 
-  void traceState(TypeEnvironment* state) const;
+  void traceState(Environment* state) const;
 
-  std::unordered_map<IRInstruction*, TypeEnvironment>& get_type_environments() {
+  std::unordered_map<IRInstruction*, Environment>& get_type_environments() {
     return m_type_envs;
   }
 
@@ -198,26 +358,50 @@ class TypeInference final
   void populate_type_environments();
 
   const cfg::ControlFlowGraph& m_cfg;
-  std::unordered_map<IRInstruction*, TypeEnvironment> m_type_envs;
+  std::unordered_map<IRInstruction*, Environment> m_type_envs;
 
   TypeDomain refine_type(const TypeDomain& type,
                          IRType expected,
                          IRType const_type,
                          IRType scalar_type) const;
-  void refine_type(TypeEnvironment* state,
-                   register_t reg,
-                   IRType expected) const;
-  void refine_wide_type(TypeEnvironment* state,
+  void refine_type(Environment* state, register_t reg, IRType expected) const;
+  void refine_wide_type(Environment* state,
                         register_t reg,
                         IRType expected1,
                         IRType expected2) const;
-  void refine_reference(TypeEnvironment* state, register_t reg) const;
-  void refine_scalar(TypeEnvironment* state, register_t reg) const;
-  void refine_integer(TypeEnvironment* state, register_t reg) const;
-  void refine_float(TypeEnvironment* state, register_t reg) const;
-  void refine_wide_scalar(TypeEnvironment* state, register_t reg) const;
-  void refine_long(TypeEnvironment* state, register_t reg) const;
-  void refine_double(TypeEnvironment* state, register_t reg) const;
+  void refine_reference(Environment* state, register_t reg) const;
+  void refine_scalar(Environment* state, register_t reg) const;
+  void refine_integer(Environment* state, register_t reg) const;
+  void refine_float(Environment* state, register_t reg) const;
+  void refine_wide_scalar(Environment* state, register_t reg) const;
+  void refine_long(Environment* state, register_t reg) const;
+  void refine_double(Environment* state, register_t reg) const;
+};
+
+using TypeInference = TypeInferenceImpl<TypeEnvironment>;
+
+using TypeEnvironments = std::unordered_map<IRInstruction*, TypeEnvironment>;
+
+/*
+ * The type environments of `method`, as computed by TypeInference::run().
+ *
+ * The result is stored on the method's IRCode, so callers that run one after
+ * the other on the same code (the IRTypeChecker, RemoveRedundantCheckCasts,
+ * ...) share a single fixpoint computation. A stored result is only reused if
+ * the method's signature and the CFG -- blocks, edges and instructions, both by
+ * identity and by content -- are unchanged, so mutating the code in any way
+ * invalidates it.
+ *
+ * Requires the method's CFG to be built. Not thread-safe for concurrent calls
+ * on the same method.
+ */
+std::shared_ptr<const TypeEnvironments> get_type_environments(
+    DexMethod* method);
+
+// Stored on IRCode by get_type_environments().
+struct CachedTypeEnvironments {
+  size_t stamp;
+  std::shared_ptr<const TypeEnvironments> type_envs;
 };
 
 } // namespace type_inference
@@ -7,6 +7,8 @@
 
 #include "TypeSystem.h"
 
+#include <algorithm>
+
 #include "DexUtil.h"
 #include "Timer.h"
 #include "Resolver.h"
@@ -15,9 +17,12 @@ namespace {
 
 void make_instanceof_table(
     InstanceOfTable& instance_of_table,
+    TypeIntervals& intervals,
+    uint32_t& next_number,
     const ClassHierarchy& hierarchy,
     const DexType* type,
     size_t depth = 1) {
+  auto number = next_number++;
   auto& parent_chain = instance_of_table[type];
   const auto cls = type_class(type);
   if (cls != nullptr) {
@@ -34,10 +39,29 @@ void make_instanceof_table(
   always_assert(parent_chain.size() == depth);
 
   const auto& children = hierarchy.find(type);
-  if (children == hierarchy.end()) return;
-  for (const auto& child : children->second) {
-    make_instanceof_table(instance_of_table, hierarchy, child, depth + 1);
+  if (children != hierarchy.end()) {
+    for (const auto& child : children->second) {
+      make_instanceof_table(instance_of_table, intervals, next_number,
+                            hierarchy, child, depth + 1);
+    }
+  }
+  intervals[type] = TypeInterval{number, next_number - 1};
+}
+
+/**
+ * Turns a set of pre-order numbers into sorted runs of consecutive numbers.
+ */
+std::vector<TypeInterval> make_runs(std::vector<uint32_t> numbers) {
+  std::sort(numbers.begin(), numbers.end());
+  std::vector<TypeInterval> runs;
+  for (auto number : numbers) {
+    if (!runs.empty() && runs.back().last + 1 == number) {
+      runs.back().last = number;
+    } else {
+      runs.push_back(TypeInterval{number, number});
+    }
   }
+  return runs;
 }
 
 void load_interface_children(ClassHierarchy& children, const DexClass* intf) {
@@ -182,12 +206,47 @@ void TypeSystem::make_instanceof_interfaces_table() {
     no_parents.emplace_back(parent);
   }
   no_parents.emplace_back(get_object_type());
+  uint32_t next_number = 0;
   for (const auto& root : no_parents) {
-    make_instanceof_table(m_instanceof_table, hierarchy, root);
+    make_instanceof_table(
+        m_instanceof_table, m_intervals, next_number, hierarchy, root);
   }
   for (const auto& root : no_parents) {
     make_interfaces_table(root);
   }
+
+  for (const auto& intf_it : m_class_scopes.get_interface_map()) {
+    std::vector<uint32_t> numbers;
+    for (const auto* implementor : intf_it.second) {
+      auto interval = m_intervals.find(implementor);
+      if (interval != m_intervals.end()) {
+        numbers.push_back(interval->second.first);
+      }
+    }
+    if (!numbers.empty()) {
+      m_implementor_runs[intf_it.first] = make_runs(std::move(numbers));
+    }
+  }
+}
+
+bool TypeSystem::implements(const DexType* cls, const DexType* intf) const {
+  const auto& interval = m_intervals.find(cls);
+  if (interval == m_intervals.end()) {
+    // Not in the class hierarchy, so not numbered.
+    const auto& implementors = m_class_scopes.get_interface_map().find(intf);
+    if (implementors == m_class_scopes.get_interface_map().end()) {
+      return false;
+    }
+    return implementors->second.count(cls) > 0;
+  }
+  const auto& runs_it = m_implementor_runs.find(intf);
+  if (runs_it == m_implementor_runs.end()) return false;
+  const auto& runs = runs_it->second;
+  auto number = interval->second.first;
+  auto run = std::upper_bound(
+      runs.begin(), runs.end(), number,
+      [](uint32_t n, const TypeInterval& r) { return n < r.first; });
+  return run != runs.begin() && std::prev(run)->last >= number;
 }
 
 void TypeSystem::make_interfaces_table(const DexType* type) {
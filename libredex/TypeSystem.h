@@ -17,6 +17,17 @@ using TypeVector = std::vector<const DexType*>;
 using InstanceOfTable = std::unordered_map<const DexType*, TypeVector>;
 using TypeToTypeSet = std::unordered_map<const DexType*, TypeSet>;
 
+/**
+ * A class's number in a pre-order walk of the class hierarchy, and the last
+ * number in its subtree. A class is a subclass of another exactly when its
+ * number falls in the other's interval.
+ */
+struct TypeInterval {
+  uint32_t first{0};
+  uint32_t last{0};
+};
+using TypeIntervals = IdMap<const DexType*, TypeInterval>;
+
 /**
  * TypeSystem
  * A class that computes information and caches on the current known state
@@ -35,6 +46,10 @@ class TypeSystem {
   ClassHierarchy m_intf_children;
   InstanceOfTable m_instanceof_table;
   TypeToTypeSet m_interfaces;
+  TypeIntervals m_intervals;
+  // For each interface, the pre-order numbers of its implementors as sorted,
+  // disjoint runs. Implementors come in whole subtrees, so there are few runs.
+  IdMap<const DexType*, std::vector<TypeInterval>> m_implementor_runs;
 
  public:
   explicit TypeSystem(const Scope& scope);
@@ -100,18 +115,17 @@ class TypeSystem {
   /**
    * Return true if child is a subclass or equal to parent.
    * The type must be a class (not an interface).
+   * This is two integer comparisons on the types' TypeIntervals.
    */
   bool is_subtype(const DexType* parent, const DexType* child) const {
-    const auto& parent_it = m_instanceof_table.find(parent);
-    const auto& child_it = m_instanceof_table.find(child);
-    if (parent_it == m_instanceof_table.end() ||
-        child_it == m_instanceof_table.end()) {
+    const auto& parent_it = m_intervals.find(parent);
+    const auto& child_it = m_intervals.find(child);
+    if (parent_it == m_intervals.end() || child_it == m_intervals.end()) {
       return false;
     }
-    const auto& p_chain = parent_it->second;
-    const auto& c_chain = child_it->second;
-    if (p_chain.size() > c_chain.size()) return false;
-    return c_chain.at(p_chain.size() - 1) == parent;
+    const auto& p_interval = parent_it->second;
+    auto c_number = child_it->second.first;
+    return p_interval.first <= c_number && c_number <= p_interval.last;
   }
 
   /**
@@ -119,11 +133,7 @@ class TypeSystem {
    * The interface may be implemented via some parent of the class
    * or an interface DAG.
    */
-  bool implements(const DexType* cls, const DexType* intf) const {
-    const auto& implementors = m_class_scopes.get_interface_map().find(intf);
-    if (implementors == m_class_scopes.get_interface_map().end()) return false;
-    return implementors->second.count(cls) > 0;
-  }
+  bool implements(const DexType* cls, const DexType* intf) const;
 
   /**
    * Return all classes that implement an interface.
@@ -12,6 +12,7 @@
 #include "ReachableClasses.h"
 #include "Timer.h"
 #include "Trace.h"
+#include "WorkQueue.h"
 
 #include <map>
 #include <set>
@@ -645,7 +646,8 @@ void load_methods(const DexType* type, SignatureMap& sig_map) {
  */
 bool build_signature_map(const ClassHierarchy& hierarchy,
                          const DexType* type,
-                         SignatureMap& sig_map) {
+                         SignatureMap& sig_map,
+                         bool parallel_children = false) {
   always_assert_log(sig_map.size() == 0,
                     "intf_methods and children_methods are out params");
   const TypeSet& children = hierarchy.at(type);
@@ -661,16 +663,42 @@ bool build_signature_map(const ClassHierarchy& hierarchy,
   // recurse through every child to collect all methods
   // and interface methods under type
   bool escape_up = false;
-  for (const auto& child : children) {
-    SignatureMap child_sig_map;
-    escape_up =
-        build_signature_map(hierarchy, child, child_sig_map) || escape_up;
-    TRACE(VIRT,
-          3,
-          "* Merging sig map of %s with child %s\n",
-          SHOW(type),
-          SHOW(child));
-    merge(base_sigs, intf_sig_map, sig_map, child_sig_map);
+  if (parallel_children && children.size() > 1) {
+    // The children's subtrees are independent; only the merges, which must
+    // happen in order, touch sig_map.
+    std::vector<const DexType*> child_types(children.begin(), children.end());
+    std::vector<SignatureMap> child_sig_maps(child_types.size());
+    std::unique_ptr<bool[]> child_escapes(new bool[child_types.size()]());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      child_escapes[i] =
+          build_signature_map(hierarchy, child_types[i], child_sig_maps[i]);
+    });
+    for (size_t i = 0; i < child_types.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    for (size_t i = 0; i < child_types.size(); ++i) {
+      escape_up = child_escapes[i] || escape_up;
+      TRACE(VIRT,
+            3,
+            "* Merging sig map of %s with child %s\n",
+            SHOW(type),
+            SHOW(child_types[i]));
+      merge(base_sigs, intf_sig_map, sig_map, child_sig_maps[i]);
+      SignatureMap().swap(child_sig_maps[i]);
+    }
+  } else {
+    for (const auto& child : children) {
+      SignatureMap child_sig_map;
+      escape_up =
+          build_signature_map(hierarchy, child, child_sig_map) || escape_up;
+      TRACE(VIRT,
+            3,
+            "* Merging sig map of %s with child %s\n",
+            SHOW(type),
+            SHOW(child));
+      merge(base_sigs, intf_sig_map, sig_map, child_sig_map);
+    }
   }
 
   TRACE(VIRT, 3, "* Marking methods at %s\n", SHOW(type));
@@ -767,14 +795,65 @@ void get_root_scopes(const SignatureMap& sig_map,
   get_rooted_interface_scope(sig_map, type, type_class(type), cls_scopes);
 }
 
+/**
+ * Records, in hierarchy order, everything a SignatureMap is built from.
+ */
+void snapshot_hierarchy(const ClassHierarchy& hierarchy,
+                        const DexType* type,
+                        std::vector<uintptr_t>* snapshot) {
+  auto add = [snapshot](const void* ptr) {
+    snapshot->push_back(reinterpret_cast<uintptr_t>(ptr));
+  };
+  add(type);
+  const DexClass* cls = type_class(type);
+  if (cls != nullptr) {
+    // Whether a class is an interface changes how scopes merge.
+    snapshot->push_back(is_interface(cls));
+    add(cls->get_super_class());
+    add(cls->get_interfaces());
+    snapshot->push_back(cls->get_vmethods().size());
+    for (const auto* vmeth : cls->get_vmethods()) {
+      add(vmeth);
+      add(vmeth->get_name());
+      add(vmeth->get_proto());
+    }
+  }
+  const auto& children = hierarchy.at(type);
+  snapshot->push_back(children.size());
+  for (const auto* child : children) {
+    snapshot_hierarchy(hierarchy, child, snapshot);
+  }
+}
+
 } // namespace
 
 SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy) {
   SignatureMap signature_map;
-  build_signature_map(class_hierarchy, get_object_type(), signature_map);
+  build_signature_map(class_hierarchy,
+                      get_object_type(),
+                      signature_map,
+                      /* parallel_children */ true);
   return signature_map;
 }
 
+std::shared_ptr<const SignatureMap> SignatureMapCache::get(
+    const ClassHierarchy& hierarchy) {
+  std::vector<uintptr_t> snapshot;
+  snapshot_hierarchy(hierarchy, get_object_type(), &snapshot);
+  if (m_sig_map == nullptr || snapshot != m_snapshot) {
+    TRACE(VIRT, 2, "Rebuilding the shared signature map\n");
+    m_sig_map = std::make_shared<const SignatureMap>(
+        build_signature_map(hierarchy));
+    m_snapshot = std::move(snapshot);
+  }
+  return m_sig_map;
+}
+
+void SignatureMapCache::invalidate() {
+  m_snapshot.clear();
+  m_sig_map.reset();
+}
+
 const std::vector<DexMethod*>& get_vmethods(const DexType* type) {
   const DexClass* cls = type_class(type);
   if (cls == nullptr) {
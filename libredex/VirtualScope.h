@@ -11,9 +11,10 @@
 #include "DexUtil.h"
 #include "ClassHierarchy.h"
 #include "Timer.h"
-#include <vector>
 #include <map>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 
 /**
@@ -195,9 +196,31 @@ using SignatureMap =
 /**
  * Given a ClassHierarchy walk the java.lang.Object hierarchy building
  * all VirtualScope known.
+ * The subtrees rooted at the direct children of java.lang.Object are built
+ * in parallel and merged in order, so the result doesn't depend on the
+ * number of threads.
  */
 SignatureMap build_signature_map(const ClassHierarchy& class_hierarchy);
 
+/**
+ * Shares a SignatureMap between passes. get() rebuilds the map only if a
+ * class in the hierarchy, its super class, its interfaces or its virtual
+ * methods changed since the map was built. Checking that is a single walk of
+ * the hierarchy, which is much cheaper than building the map.
+ * The PassManager owns one, see PassManager::signature_map_cache().
+ */
+class SignatureMapCache {
+ public:
+  std::shared_ptr<const SignatureMap> get(const ClassHierarchy& hierarchy);
+
+  void invalidate();
+
+ private:
+  // What the cached map was built from, see get().
+  std::vector<uintptr_t> m_snapshot;
+  std::shared_ptr<const SignatureMap> m_sig_map;
+};
+
 /**
  * Given a DexMethod return the scope the method is in.
  */
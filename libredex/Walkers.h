@@ -8,7 +8,9 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <functional>
+#include <numeric>
 #include <thread>
 #include <vector>
 
@@ -16,8 +18,10 @@
 #include "DexAnnotation.h"
 #include "DexClass.h"
 #include "EditableCfgAdapter.h"
+#include "EventTrace.h"
 #include "IRCode.h"
 #include "Match.h"
+#include "MethodCosts.h"
 #include "WorkQueue.h"
 
 /**
@@ -209,6 +213,15 @@ class walk {
         method, *method.get_code(), predicate, walker);
   }
 
+  /**
+   * The NUMA node whose workers the parallel walks give the class of type
+   * `cls` to. Ballooning does the same, so that the code of a class is
+   * allocated on the node that later works on it.
+   */
+  static size_t numa_node(const DexType* cls) {
+    return cls->get_dense_id() % workqueue_num_numa_nodes();
+  }
+
  private:
   /* The iterate_* methods take a single dexclass and call the walker on the
    * elements requested. The reason that these are done on a class level is so
@@ -218,10 +231,12 @@ class walk {
   static void iterate_methods(const DexClass* cls, MethodWalkerFn walker) {
     for (auto dmethod : cls->get_dmethods()) {
       TraceContext context(dmethod->get_deobfuscated_name());
+      method_costs::ScopedTimer timer(dmethod);
       walker(dmethod);
     }
     for (auto vmethod : cls->get_vmethods()) {
       TraceContext context(vmethod->get_deobfuscated_name());
+      method_costs::ScopedTimer timer(vmethod);
       walker(vmethod);
     }
   }
@@ -365,6 +380,9 @@ class walk {
    * sequential counterparts.
    * The unit of parallelization is a DexClass. The reason is that we don't want
    * to create too many tasks on the WorkQueue, paying the overhead for each.
+   * The *_by_cost methods are the exception: they make a task of each method,
+   * for walks where a few big classes would otherwise hold up the rest.
+   * Either way, the tasks of a class go to workers on its numa_node().
    */
   class parallel {
    public:
@@ -381,7 +399,7 @@ class walk {
       auto wq = workqueue_foreach<DexClass*>( // over-parallelized maybe
           [&walker](DexClass* cls) { walker(cls); },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::classes", wq, classes);
     }
 
     /**
@@ -394,12 +412,14 @@ class walk {
       auto wq = workqueue_foreach<DexClass*>(
           [&walker](DexClass* cls) { walk::iterate_methods(cls, walker); },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::methods", wq, classes);
     }
 
     /**
      * Call `walker` on all methods in `classes` in parallel. Then combine the
-     * Output with `reducer` function.
+     * Output with `reducer` function, which either returns the combination of
+     * two outputs or folds the second into the first in place, as in
+     * void(Output&, Output&&).
      */
     template <class Output,
               class Classes,
@@ -410,26 +430,59 @@ class walk {
                                  OutputReducerFn reducer,
                                  const Output& init = Output(),
                                  size_t num_threads = default_num_threads()) {
-      auto wq = WorkQueue<DexClass*, std::nullptr_t, Output>(
-          [&](WorkerState<DexClass*, std::nullptr_t, Output>* state,
+      auto wq = make_workqueue<DexClass*, std::nullptr_t, Output>(
+          [&](WorkerState<DexClass*, std::nullptr_t, Output>*,
               DexClass* cls) {
             Output out = init;
             for (auto dmethod : cls->get_dmethods()) {
               TraceContext context(dmethod->get_deobfuscated_name());
-              out = reducer(out, walker(dmethod));
+              method_costs::ScopedTimer timer(dmethod);
+              workqueue_impl::reduce_into(reducer, out, walker(dmethod));
             }
             for (auto vmethod : cls->get_vmethods()) {
               TraceContext context(vmethod->get_deobfuscated_name());
-              out = reducer(out, walker(vmethod));
+              method_costs::ScopedTimer timer(vmethod);
+              workqueue_impl::reduce_into(reducer, out, walker(vmethod));
             }
             return out;
           },
-          reducer,
+          [&reducer](Output& acc, Output&& out) {
+            workqueue_impl::reduce_into(reducer, acc, std::move(out));
+          },
           [](unsigned int) { return nullptr; },
           num_threads);
 
+      event_trace::Span span("walk", "walk::parallel::reduce_methods");
       for (const auto& cls : classes) {
-        wq.add_item(cls);
+        wq.add_item(cls, numa_node(cls->get_type()));
+      };
+      return wq.run_all();
+    }
+
+    /**
+     * Same as `reduce_methods()`, with `walker` called once on each class,
+     * for walks that look at the fields and methods of a class together.
+     */
+    template <class Output,
+              class Classes,
+              class ClassWalkerFn = Output(DexClass*),
+              class OutputReducerFn = Output(Output, Output)>
+    Output static reduce_classes(const Classes& classes,
+                                 ClassWalkerFn walker,
+                                 OutputReducerFn reducer,
+                                 size_t num_threads = default_num_threads()) {
+      auto wq = make_workqueue<DexClass*, std::nullptr_t, Output>(
+          [&](WorkerState<DexClass*, std::nullptr_t, Output>*,
+              DexClass* cls) { return walker(cls); },
+          [&reducer](Output& acc, Output&& out) {
+            workqueue_impl::reduce_into(reducer, acc, std::move(out));
+          },
+          [](unsigned int) { return nullptr; },
+          num_threads);
+
+      event_trace::Span span("walk", "walk::parallel::reduce_classes");
+      for (const auto& cls : classes) {
+        wq.add_item(cls, numa_node(cls->get_type()));
       };
       return wq.run_all();
     }
@@ -444,7 +497,7 @@ class walk {
       auto wq = workqueue_foreach<DexClass*>(
           [&walker](DexClass* cls) { walk::iterate_fields(cls, walker); },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::fields", wq, classes);
     }
 
     /**
@@ -461,7 +514,7 @@ class walk {
             walk::iterate_code(cls, filter, walker);
           },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::code", wq, classes);
     }
 
     /**
@@ -474,6 +527,77 @@ class walk {
       walk::parallel::code(classes, all_methods, walker, num_threads);
     }
 
+    /**
+     * Same as `methods()`, but with each method as a task of its own, handed
+     * out by descending size of its code, so that a class with a huge method
+     * or with very many methods doesn't leave one thread running long after
+     * the others are done. Only for walkers that share no state between the
+     * methods of a class.
+     */
+    template <class Classes>
+    static void methods_by_cost(const Classes& classes,
+                                MethodWalkerFn walker,
+                                size_t num_threads = default_num_threads()) {
+      reduce_by_cost<std::nullptr_t>(
+          "walk::parallel::methods_by_cost", classes, all_methods,
+          [&walker](DexMethod* m) {
+            walker(m);
+            return nullptr;
+          },
+          [](std::nullptr_t, std::nullptr_t) { return nullptr; }, nullptr,
+          num_threads);
+    }
+
+    /**
+     * Same as `code()`, scheduled per method like `methods_by_cost()`.
+     */
+    template <class Classes>
+    static void code_by_cost(const Classes& classes,
+                             MethodFilterFn filter,
+                             CodeWalkerFn walker,
+                             size_t num_threads = default_num_threads()) {
+      reduce_by_cost<std::nullptr_t>(
+          "walk::parallel::code_by_cost", classes,
+          [&filter](DexMethod* m) {
+            return m->get_code() != nullptr && filter(m);
+          },
+          [&walker](DexMethod* m) {
+            walker(m, *m->get_code());
+            return nullptr;
+          },
+          [](std::nullptr_t, std::nullptr_t) { return nullptr; }, nullptr,
+          num_threads);
+    }
+
+    /**
+     * Same as `code_by_cost()` but with a filter that accepts all methods
+     */
+    template <class Classes>
+    static void code_by_cost(const Classes& classes,
+                             CodeWalkerFn walker,
+                             size_t num_threads = default_num_threads()) {
+      walk::parallel::code_by_cost(classes, all_methods, walker, num_threads);
+    }
+
+    /**
+     * Same as `reduce_methods()`, scheduled per method like
+     * `methods_by_cost()`.
+     */
+    template <class Output,
+              class Classes,
+              class MethodWalkerFn = Output(DexMethod*),
+              class OutputReducerFn = Output(Output, Output)>
+    Output static reduce_methods_by_cost(
+        const Classes& classes,
+        MethodWalkerFn walker,
+        OutputReducerFn reducer,
+        const Output& init = Output(),
+        size_t num_threads = default_num_threads()) {
+      return reduce_by_cost<Output>("walk::parallel::reduce_methods_by_cost",
+                                    classes, all_methods, walker, reducer,
+                                    init, num_threads);
+    }
+
     /**
      * Call `walker` on all opcodes (of methods approved by `filter`) in
      * `classes` in parallel.
@@ -488,7 +612,7 @@ class walk {
             walk::iterate_opcodes(cls, filter, walker);
           },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::opcodes", wq, classes);
     }
 
     /**
@@ -511,7 +635,7 @@ class walk {
       auto wq = workqueue_foreach<DexClass*>(
           [&walker](DexClass* cls) { walk::iterate_annotations(cls, walker); },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::annotations", wq, classes);
     }
 
     /**
@@ -533,7 +657,7 @@ class walk {
             walk::iterate_matching(cls, predicate, walker);
           },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::matching_opcodes", wq, classes);
     }
 
     /**
@@ -554,25 +678,103 @@ class walk {
             walk::iterate_matching_block(cls, predicate, walker);
           },
           num_threads);
-      run_all(wq, classes);
+      run_all("walk::parallel::matching_opcodes_in_block", wq, classes);
     }
 
     /**
      * This code usually runs on a processor with Hyperthreading, where the
      * number of physical cores is half the number of logical cores. Setting
      * num_threads to that number often gets us good results, so that's the
-     * default.
+     * default unless the RedexOptions set one.
      */
     static unsigned int default_num_threads() {
       unsigned int threads = std::thread::hardware_concurrency() / 2;
-      return std::max(1u, threads);
+      return workqueue_num_threads(std::max(1u, threads));
     }
 
    private:
+    /*
+     * Runs `walker` on each method of `classes` that `filter` approves as a
+     * task of its own, most code first, and reduces the results. How long
+     * each thread was busy is traced, to show how well the work was spread.
+     */
+    template <class Output, class Classes, class Walker, class Reducer>
+    static Output reduce_by_cost(const char* walk_name,
+                                 const Classes& classes,
+                                 MethodFilterFn filter,
+                                 const Walker& walker,
+                                 const Reducer& reducer,
+                                 const Output& init,
+                                 size_t num_threads) {
+      event_trace::Span span("walk", walk_name);
+      std::vector<std::pair<size_t, DexMethod*>> tasks;
+      for (const auto& cls : classes) {
+        for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+          for (auto method : *methods) {
+            if (filter(method)) {
+              auto code = method->get_code();
+              tasks.emplace_back(code ? code->sum_opcode_sizes() : 0, method);
+            }
+          }
+        }
+      }
+      // Each worker runs the tasks it was handed last first, and steals the
+      // ones that others were handed first. Adding the cheapest tasks first
+      // thus starts with the most expensive ones and leaves the cheap ones to
+      // fill in the gaps at the end.
+      std::stable_sort(tasks.begin(), tasks.end(),
+                       [](const std::pair<size_t, DexMethod*>& a,
+                          const std::pair<size_t, DexMethod*>& b) {
+                         return a.first < b.first;
+                       });
+
+      using Busy = std::chrono::duration<double, std::milli>;
+      using State = WorkerState<DexMethod*, Busy*, Output>;
+      std::vector<Busy> busy(num_threads, Busy::zero());
+      auto wq = make_workqueue<DexMethod*, Busy*, Output>(
+          [&walker](State* state, DexMethod* method) {
+            auto start = std::chrono::steady_clock::now();
+            Output out;
+            {
+              TraceContext context(method->get_deobfuscated_name());
+              method_costs::ScopedTimer timer(method);
+              out = walker(method);
+            }
+            *state->get_data() += std::chrono::steady_clock::now() - start;
+            return out;
+          },
+          [&reducer](Output& acc, Output&& out) {
+            workqueue_impl::reduce_into(reducer, acc, std::move(out));
+          },
+          [&busy](unsigned int i) { return &busy[i]; },
+          num_threads);
+      for (const auto& task : tasks) {
+        wq.add_item(task.second, numa_node(task.second->get_class()));
+      }
+      Output out = init;
+      workqueue_impl::reduce_into(reducer, out, wq.run_all());
+
+      // The straggler metric: how much longer the busiest thread ran than
+      // the average one.
+      auto busiest = std::max_element(busy.begin(), busy.end())->count();
+      auto mean = std::accumulate(busy.begin(), busy.end(), Busy::zero())
+                      .count() /
+                  busy.size();
+      TRACE(TIME, 2,
+            "%s: %zu methods on %zu threads, busiest thread %.1lfms, mean "
+            "%.1lfms (%.2lfx)\n",
+            walk_name, tasks.size(), num_threads, busiest, mean,
+            mean > 0 ? busiest / mean : 1.0);
+      return out;
+    }
+
     template <class WQ, class Classes>
-    static void run_all(WQ& wq, const Classes& classes) {
+    static void run_all(const char* walk_name,
+                        WQ& wq,
+                        const Classes& classes) {
+      event_trace::Span span("walk", walk_name);
       for (const auto& cls : classes) {
-        wq.add_item(cls);
+        wq.add_item(cls, numa_node(cls->get_type()));
       };
       wq.run_all();
     }
@@ -7,16 +7,32 @@
 
 #pragma once
 
+#include "ConcurrencyStats.h"
 #include "Debug.h"
+#include "EventTrace.h"
+#include "WorkStealingDeque.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/optional/optional.hpp>
-#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
 #include <numeric>
-#include <queue>
 #include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace workqueue_impl {
 
@@ -38,15 +54,329 @@ inline std::vector<int> create_permutation(int num, unsigned int thread_idx) {
   return attempts;
 }
 
+/*
+ * Parses a list of CPUs or nodes as the kernel writes them, e.g. "0-3,8-11".
+ */
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    int first, last;
+    auto n = sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (n < 1) {
+      continue;
+    }
+    for (int cpu = first; cpu <= (n == 2 ? last : first); ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+/*
+ * The CPUs of each NUMA node of the machine, or nothing if that can't be
+ * told.
+ */
+inline std::vector<std::vector<int>> read_numa_nodes() {
+  std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+  const std::string sysfs = "/sys/devices/system/node/";
+  std::ifstream online(sysfs + "online");
+  std::string list;
+  if (!std::getline(online, list)) {
+    return nodes;
+  }
+  for (auto node : parse_cpu_list(list)) {
+    std::ifstream cpulist(sysfs + "node" + std::to_string(node) + "/cpulist");
+    std::string cpus;
+    if (std::getline(cpulist, cpus) && !parse_cpu_list(cpus).empty()) {
+      nodes.push_back(parse_cpu_list(cpus));
+    }
+  }
+#endif
+  return nodes;
+}
+
+/*
+ * WorkStealingDeque can only hold small trivially-copyable values. Those (in
+ * practice, the pointers that almost every pass feeds its WorkQueue) are
+ * stored inline; anything else is boxed on the heap.
+ */
+template <class Input, class Enable = void>
+struct TaskSlot {
+  using type = Input*;
+  static type wrap(Input task) { return new Input(std::move(task)); }
+  static Input unwrap(type slot) {
+    std::unique_ptr<Input> boxed(slot);
+    return std::move(*boxed);
+  }
+  static void discard(type slot) { delete slot; }
+};
+
+template <class Input>
+struct TaskSlot<
+    Input,
+    typename std::enable_if<std::is_trivially_copyable<Input>::value &&
+                            std::is_default_constructible<Input>::value &&
+                            sizeof(Input) <= sizeof(void*)>::type> {
+  using type = Input;
+  static type wrap(Input task) { return task; }
+  static Input unwrap(type slot) { return slot; }
+  static void discard(type) {}
+};
+
+/*
+ * Folds `value` into `acc` with `reducer`, which either updates the
+ * accumulator in place -- void(Output&, Output&&) -- or returns the
+ * combination of its arguments. Neither form copies the accumulator: a
+ * reducer that takes it by value gets it moved in.
+ */
+// Only the accumulator decides the type of the output, so that mappers may
+// return anything that converts to it.
+template <class T>
+using Value = typename std::remove_reference<T>::type;
+
+template <class Reducer, class Output>
+auto combine(Reducer& reducer, Output& acc, Value<Output>&& value, int)
+    -> decltype(reducer(std::move(acc), std::move(value))) {
+  return reducer(std::move(acc), std::move(value));
+}
+
+template <class Reducer, class Output>
+auto combine(Reducer& reducer, Output& acc, Value<Output>&& value, long)
+    -> decltype(reducer(acc, std::move(value))) {
+  return reducer(acc, std::move(value));
+}
+
+template <class Reducer, class Output>
+using ReducerResult = decltype(std::declval<Reducer&>()(
+    std::declval<Output&>(), std::declval<Output&&>()));
+
+template <class Reducer, class Output>
+typename std::enable_if<
+    std::is_void<ReducerResult<Reducer, Output>>::value>::type
+reduce_into(Reducer& reducer, Output& acc, Value<Output>&& value) {
+  reducer(acc, std::move(value));
+}
+
+template <class Reducer, class Output>
+typename std::enable_if<
+    !std::is_void<ReducerResult<Reducer, Output>>::value>::type
+reduce_into(Reducer& reducer, Output& acc, Value<Output>&& value) {
+  acc = combine(reducer, acc, std::move(value), 0);
+}
+
+/*
+ * The process-wide pool of threads that WorkQueue::run_all hands its workers
+ * to, so that the many small WorkQueues of a run don't each pay for creating
+ * and joining threads with 8MB stacks. Threads are created on first use, the
+ * pool grows to the largest number of workers asked for, and they idle
+ * between jobs until the process exits. The pool is never destroyed, so that
+ * nothing has to join threads at exit.
+ *
+ * When NUMA-aware, thread i runs on node i % num_numa_nodes(), so that the
+ * memory it touches first gets allocated there. WorkQueue::add_item() can
+ * then send a task to the node whose memory it works on.
+ */
+class ThreadPool {
+ public:
+  static ThreadPool& get() { return *instance(); }
+
+  /*
+   * For the child of a fork(), which only has the thread that forked and so
+   * none of the pool's: gives it a pool of its own, configured like the
+   * parent's. The parent's is leaked, as its threads can't be joined.
+   */
+  static void reset_after_fork() {
+    const auto* parent = instance();
+    auto* pool = new ThreadPool();
+    pool->m_num_threads = parent->m_num_threads.load();
+    pool->m_pin_threads = parent->m_pin_threads;
+    pool->m_numa_nodes = parent->m_numa_nodes;
+    pool->m_num_numa_nodes = parent->m_num_numa_nodes.load();
+    instance() = pool;
+  }
+
+  void configure(unsigned int num_threads, bool pin_threads, bool numa_aware) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_num_threads = num_threads;
+    m_pin_threads = pin_threads;
+    m_numa_nodes.clear();
+    if (numa_aware) {
+      m_numa_nodes = read_numa_nodes();
+    }
+    m_num_numa_nodes = std::max<size_t>(1, m_numa_nodes.size());
+  }
+
+  unsigned int num_threads() const { return m_num_threads; }
+
+  // 1 unless the pool is NUMA-aware on a machine with several nodes.
+  size_t num_numa_nodes() const { return m_num_numa_nodes; }
+
+  /*
+   * Runs job(0) ... job(n - 1), each on its own thread of the pool, and
+   * returns once they have all finished. Returns false without running
+   * anything when the pool is busy with another job -- a WorkQueue run from a
+   * task of another WorkQueue, or from another thread -- in which case the
+   * caller has to bring threads of its own.
+   */
+  bool try_run(size_t n, const std::function<void(size_t)>& job) {
+    if (m_busy.exchange(true, std::memory_order_acquire)) {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_threads.size() < n) {
+      size_t idx = m_threads.size();
+      boost::thread::attributes attrs;
+      attrs.set_stack_size(8 * 1024 * 1024);
+      m_threads.emplace_back(attrs, [this, idx, seen = m_generation] {
+        work(idx, seen);
+      });
+      if (m_pin_threads || m_num_numa_nodes > 1) {
+        pin(m_threads.back(), idx);
+      }
+    }
+    m_job = &job;
+    m_job_size = n;
+    m_num_running = n;
+    ++m_generation;
+    m_work_cv.notify_all();
+    m_done_cv.wait(lock, [this] { return m_num_running == 0; });
+    m_job = nullptr;
+    lock.unlock();
+    m_busy.store(false, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Runs job() once on each of the threads that the pool has started so far,
+   * for what has to be done on every thread, such as flushing thread-local
+   * caches. Returns false when the pool is busy, like try_run.
+   */
+  bool try_run_on_each_thread(const std::function<void()>& job) {
+    size_t n;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      n = m_threads.size();
+    }
+    return n == 0 || try_run(n, [&job](size_t) { job(); });
+  }
+
+ private:
+  ThreadPool() = default;
+
+  static ThreadPool*& instance() {
+    static ThreadPool* pool = new ThreadPool();
+    return pool;
+  }
+
+  void work(size_t idx, uint64_t seen) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_work_cv.wait(lock, [&] { return m_generation != seen; });
+      seen = m_generation;
+      // Threads beyond what the job asked for sit this one out.
+      if (idx >= m_job_size) {
+        continue;
+      }
+      auto job = m_job;
+      lock.unlock();
+      (*job)(idx);
+      lock.lock();
+      if (--m_num_running == 0) {
+        m_done_cv.notify_one();
+      }
+    }
+  }
+
+  // Pins the thread to a core, or to the cores of its node, or both.
+  void pin(boost::thread& thread, size_t idx) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (m_num_numa_nodes > 1) {
+      const auto& node_cpus = m_numa_nodes[idx % m_num_numa_nodes];
+      if (m_pin_threads) {
+        CPU_SET(node_cpus[(idx / m_num_numa_nodes) % node_cpus.size()], &cpus);
+      } else {
+        for (auto cpu : node_cpus) {
+          CPU_SET(cpu, &cpus);
+        }
+      }
+    } else {
+      auto num_cpus = std::max(1u, boost::thread::hardware_concurrency());
+      CPU_SET(idx % num_cpus, &cpus);
+    }
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#endif
+  }
+
+  std::atomic<bool> m_busy{false};
+  std::mutex m_mutex;
+  std::condition_variable m_work_cv;
+  std::condition_variable m_done_cv;
+  std::vector<boost::thread> m_threads;
+  const std::function<void(size_t)>* m_job{nullptr};
+  size_t m_job_size{0};
+  size_t m_num_running{0};
+  uint64_t m_generation{0};
+  std::atomic<unsigned int> m_num_threads{0};
+  bool m_pin_threads{false};
+  std::vector<std::vector<int>> m_numa_nodes;
+  std::atomic<size_t> m_num_numa_nodes{1};
+};
+
 } // namespace workqueue_impl
 
+/*
+ * Sets up the threads that WorkQueues run on: `num_threads` is how many
+ * workers they use unless told otherwise (0 for one per core),
+ * `pin_threads` pins each thread of the pool to a core, and `numa_aware`
+ * spreads them over the NUMA nodes (see ThreadPool). Meant to be called once,
+ * up front, from the RedexOptions.
+ */
+inline void configure_workqueue_threads(unsigned int num_threads,
+                                        bool pin_threads,
+                                        bool numa_aware = false) {
+  workqueue_impl::ThreadPool::get().configure(
+      num_threads, pin_threads, numa_aware);
+}
+
+// The number of NUMA nodes that workers are spread over; usually 1.
+inline size_t workqueue_num_numa_nodes() {
+  return workqueue_impl::ThreadPool::get().num_numa_nodes();
+}
+
+/*
+ * The number of threads set by configure_workqueue_threads(), or `fallback`
+ * if there is none.
+ */
+inline unsigned int workqueue_num_threads(
+    unsigned int fallback =
+        std::max(1u, boost::thread::hardware_concurrency())) {
+  auto num_threads = workqueue_impl::ThreadPool::get().num_threads();
+  return num_threads != 0 ? num_threads : fallback;
+}
+
+template <class Input, class Data, class Output, class Mapper, class Reducer>
+class WorkQueue;
+
 template <class Input,
           class Data = std::nullptr_t,
           class Output = std::nullptr_t>
 class WorkerState {
+  using Slot = workqueue_impl::TaskSlot<Input>;
+
  public:
   WorkerState(size_t id, const Data& initial) : m_id(id), m_data(initial) {}
 
+  ~WorkerState() {
+    while (auto slot = m_queue.pop()) {
+      Slot::discard(*slot);
+    }
+  }
+
   Data& get_data() {
     return m_data;
   }
@@ -55,10 +385,14 @@ class WorkerState {
    * Add more items to the queue of the currently-running worker. When a
    * WorkQueue is running, this should be used instead of WorkQueue::add_item()
    * as the latter is not thread-safe.
+   *
+   * Only the worker that owns this state may call this: the deque is
+   * single-producer. That's always the case for the state handed to the
+   * mapper.
    */
   void push_task(Input task) {
-    boost::lock_guard<boost::mutex> guard(m_queue_mtx);
-    m_queue.push(task);
+    ++m_num_pushed;
+    m_queue.push(Slot::wrap(std::move(task)));
   }
 
   size_t worker_id() const {
@@ -66,54 +400,93 @@ class WorkerState {
   }
 
  private:
+  // Owner side: most recently pushed task first, for locality.
   boost::optional<Input> pop_task() {
-    boost::lock_guard<boost::mutex> guard(m_queue_mtx);
-    if (!m_queue.empty()) {
-      auto task = std::move(m_queue.front());
-      m_queue.pop();
-      return task;
+    if (auto slot = m_queue.pop()) {
+      return Slot::unwrap(*slot);
+    }
+    return boost::none;
+  }
+
+  // Thief side: oldest task first, which tends to be the biggest chunk of
+  // remaining work.
+  boost::optional<Input> steal_task() {
+    if (auto slot = m_queue.steal()) {
+      return Slot::unwrap(*slot);
     }
     return boost::none;
   }
 
   size_t m_id;
-  std::queue<Input> m_queue;
-  boost::mutex m_queue_mtx;
+  WorkStealingDeque<typename Slot::type> m_queue;
+  // Number of tasks pushed by the task currently being consumed.
+  size_t m_num_pushed{0};
   Data m_data;
   Output m_result;
 
-  template <class, class, class>
+  template <class, class, class, class, class>
   friend class WorkQueue;
 };
 
+/*
+ * The mapper and reducer are std::functions unless given as template
+ * arguments, which make_workqueue() deduces from lambdas so that they can be
+ * inlined. The reducer either returns the combination of two outputs or
+ * folds the second into the first in place -- void(Output&, Output&&) --
+ * which saves rebuilding big outputs like maps of stats on every merge.
+ */
 template <class Input,
           class Data = std::nullptr_t,
-          class Output = std::nullptr_t>
+          class Output = std::nullptr_t,
+          class Mapper = std::function<Output(WorkerState<Input, Data, Output>*,
+                                              Input)>,
+          class Reducer = std::function<Output(Output, Output)>>
 class WorkQueue {
  private:
-  using Mapper =
-      std::function<Output(WorkerState<Input, Data, Output>*, Input)>;
   Mapper m_mapper;
-  std::function<Output(Output, Output)> m_reducer;
+  Reducer m_reducer;
 
   std::vector<std::unique_ptr<WorkerState<Input, Data, Output>>> m_states;
 
   const size_t m_num_threads{1};
   size_t m_insert_idx{0};
+  std::vector<size_t> m_node_insert_idx;
+  size_t m_num_added{0};
 
-  void consume(WorkerState<Input, Data, Output>* state, Input task) {
-    state->m_result = m_reducer(state->m_result, m_mapper(state, task));
+  /*
+   * `num_pending` counts the tasks that have been queued but have not finished
+   * running.
+   */
+  void consume(WorkerState<Input, Data, Output>* state,
+               Input task,
+               std::atomic<int64_t>& num_pending) {
+    state->m_num_pushed = 0;
+    workqueue_impl::reduce_into(
+        m_reducer, state->m_result, m_mapper(state, std::move(task)));
+    // Account for the finished task and whatever it pushed in one go; chains
+    // of tasks that each push a single successor don't touch the counter.
+    auto delta = static_cast<int64_t>(state->m_num_pushed) - 1;
+    if (delta != 0) {
+      num_pending.fetch_add(delta, std::memory_order_acq_rel);
+    }
   }
 
  public:
   WorkQueue(
       Mapper mapper,
-      std::function<Output(Output, Output)> reducer,
+      Reducer reducer,
       std::function<Data(unsigned int /* thread index*/)> data_initializer,
       unsigned int num_threads);
 
   void add_item(Input task);
 
+  /*
+   * Queues `task` for a worker on NUMA node `node` (modulo the number of
+   * nodes), which is where it runs unless another worker steals it. The same
+   * as add_item(task) when the pool isn't NUMA-aware.
+   */
+  void add_item(Input task, size_t node);
+
   void set_mapper(Mapper mapper) {
     m_mapper = mapper;
   }
@@ -123,18 +496,21 @@ class WorkQueue {
   }
 
   /**
-   * Spawn threads and evaluate function.  This method blocks.
+   * Run the workers on the threads of the pool -- or on threads of their
+   * own if the pool is busy -- and evaluate function.  This method blocks.
    */
   Output run_all(const Output& init_output = Output());
 };
 
-template <class Input, class Data, class Output>
-WorkQueue<Input, Data, Output>::WorkQueue(
-    WorkQueue::Mapper mapper,
-    std::function<Output(Output, Output)> reducer,
+template <class Input, class Data, class Output, class Mapper, class Reducer>
+WorkQueue<Input, Data, Output, Mapper, Reducer>::WorkQueue(
+    Mapper mapper,
+    Reducer reducer,
     std::function<Data(unsigned int /* thread index*/)> data_initializer,
     unsigned int num_threads)
-    : m_mapper(mapper), m_reducer(reducer), m_num_threads(num_threads) {
+    : m_mapper(std::move(mapper)),
+      m_reducer(std::move(reducer)),
+      m_num_threads(num_threads) {
   always_assert(num_threads >= 1);
   for (unsigned int i = 0; i < m_num_threads; ++i) {
     m_states.emplace_back(std::make_unique<WorkerState<Input, Data, Output>>(
@@ -142,6 +518,25 @@ WorkQueue<Input, Data, Output>::WorkQueue(
   }
 }
 
+/**
+ * Creates a work queue whose mapper and reducer keep the types of the given
+ * lambdas.
+ */
+template <class Input,
+          class Data = std::nullptr_t,
+          class Output = std::nullptr_t,
+          class Mapper,
+          class Reducer>
+WorkQueue<Input, Data, Output, Mapper, Reducer> make_workqueue(
+    Mapper mapper,
+    Reducer reducer,
+    std::function<Data(unsigned int /* thread index*/)> data_initializer,
+    unsigned int num_threads) {
+  return WorkQueue<Input, Data, Output, Mapper, Reducer>(
+      std::move(mapper), std::move(reducer), std::move(data_initializer),
+      num_threads);
+}
+
 /**
  * Creates a new work queue that doesn't return a value.  This is for
  * jobs that only have side-effects.
@@ -149,8 +544,7 @@ WorkQueue<Input, Data, Output>::WorkQueue(
 template <class Input>
 WorkQueue<Input, std::nullptr_t /* Data */, std::nullptr_t /*Output*/>
 workqueue_foreach(const std::function<void(Input)>& func,
-                  unsigned int num_threads =
-                      std::max(1u, boost::thread::hardware_concurrency())) {
+                  unsigned int num_threads = workqueue_num_threads()) {
   using Data = std::nullptr_t;
   using Output = std::nullptr_t;
   return WorkQueue<Input, Data, Output>(
@@ -171,8 +565,7 @@ template <class Input, class Output>
 WorkQueue<Input, std::nullptr_t /* Data */, Output> workqueue_mapreduce(
     const std::function<Output(Input)>& mapper,
     const std::function<Output(Output, Output)>& reducer,
-    unsigned int num_threads =
-        std::max(1u, boost::thread::hardware_concurrency())) {
+    unsigned int num_threads = workqueue_num_threads()) {
   using Data = std::nullptr_t;
   return WorkQueue<Input, std::nullptr_t, Output>(
       [mapper](WorkerState<Input, Data, Output>*, Input a) -> Output {
@@ -183,54 +576,111 @@ WorkQueue<Input, std::nullptr_t /* Data */, Output> workqueue_mapreduce(
       num_threads);
 }
 
-template <class Input, class Data, class Output>
-void WorkQueue<Input, Data, Output>::add_item(Input task) {
+template <class Input, class Data, class Output, class Mapper, class Reducer>
+void WorkQueue<Input, Data, Output, Mapper, Reducer>::add_item(Input task) {
   m_insert_idx = (m_insert_idx + 1) % m_num_threads;
-  m_states[m_insert_idx]->m_queue.push(task);
+  m_states[m_insert_idx]->m_queue.push(
+      workqueue_impl::TaskSlot<Input>::wrap(std::move(task)));
+  ++m_num_added;
+}
+
+template <class Input, class Data, class Output, class Mapper, class Reducer>
+void WorkQueue<Input, Data, Output, Mapper, Reducer>::add_item(Input task,
+                                                               size_t node) {
+  auto num_nodes = workqueue_num_numa_nodes();
+  node %= num_nodes;
+  if (num_nodes == 1 || node >= m_num_threads) {
+    add_item(std::move(task));
+    return;
+  }
+  // Workers node, node + num_nodes, node + 2 * num_nodes... run on the node.
+  size_t num_workers = (m_num_threads - node + num_nodes - 1) / num_nodes;
+  m_node_insert_idx.resize(num_nodes);
+  auto& idx = m_node_insert_idx[node];
+  idx = (idx + 1) % num_workers;
+  m_states[node + idx * num_nodes]->m_queue.push(
+      workqueue_impl::TaskSlot<Input>::wrap(std::move(task)));
+  ++m_num_added;
 }
 
 /*
- * Each worker thread pulls from its own queue first, and then once finished
- * looks randomly at other queues to try and steal work.
+ * Each worker thread pops from the bottom of its own deque first, and then
+ * once that is empty steals from the top of the other workers' deques in a
+ * random order, those on its own NUMA node first. Workers keep trying to
+ * steal until every queued task -- including ones pushed while running -- has
+ * finished.
  */
-template <class Input, class Data, class Output>
-Output WorkQueue<Input, Data, Output>::run_all(const Output& init_output) {
-  std::vector<boost::thread> all_threads;
+template <class Input, class Data, class Output, class Mapper, class Reducer>
+Output WorkQueue<Input, Data, Output, Mapper, Reducer>::run_all(
+    const Output& init_output) {
+  // Workers only give up once this drops to zero, so that tasks pushed late
+  // by one worker still get stolen by the others.
+  std::atomic<int64_t> num_pending{static_cast<int64_t>(m_num_added)};
+  m_num_added = 0;
+  auto num_nodes = workqueue_num_numa_nodes();
   auto worker = [&](WorkerState<Input, Data, Output>* state, size_t state_idx) {
     state->m_result = init_output;
     auto attempts =
         workqueue_impl::create_permutation(m_num_threads, state_idx);
+    if (num_nodes > 1) {
+      std::stable_partition(attempts.begin() + 1, attempts.end(), [&](int i) {
+        return i % num_nodes == state_idx % num_nodes;
+      });
+    }
+    size_t idle_rounds = 0;
+    concurrency_stats::WorkerStats stats;
     while (true) {
-      auto have_task = false;
-      for (auto idx : attempts) {
-        auto other_state = m_states[idx].get();
-        auto task = other_state->pop_task();
-        if (task) {
-          have_task = true;
-          consume(state, *task);
-          break;
-        }
+      auto task = state->pop_task();
+      bool stolen = !task;
+      for (size_t i = 1; !task && i < attempts.size(); ++i) {
+        task = m_states[attempts[i]]->steal_task();
+      }
+      if (task) {
+        idle_rounds = 0;
+        stats.on_task_start(stolen);
+        consume(state, std::move(*task), num_pending);
+        stats.on_task_end();
+        continue;
       }
-      if (!have_task) {
+      if (num_pending.load(std::memory_order_acquire) == 0) {
+        stats.flush();
         return;
       }
+      stats.on_idle();
+      // Some other worker is still running a task that may push more work.
+      // Back off so that we don't burn a core while waiting for it.
+      if (++idle_rounds < 64) {
+        boost::this_thread::yield();
+      } else {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(
+            std::min<size_t>(1000, idle_rounds)));
+      }
     }
   };
 
-  for (size_t i = 0; i < m_num_threads; ++i) {
-    boost::thread::attributes attrs;
-    attrs.set_stack_size(8 * 1024 * 1024);
-    all_threads.emplace_back(attrs,
-                             boost::bind<void>(worker, m_states[i].get(), i));
-  }
-
-  for (auto& thread : all_threads) {
-    thread.join();
+  // In the event trace, the time of each worker shows up under the name of
+  // the span that runs the queue.
+  const char* span_name = event_trace::current_span();
+  auto run_worker = [&](size_t i) {
+    event_trace::Span span("worker", span_name ? span_name : "WorkQueue");
+    worker(m_states[i].get(), i);
+  };
+  if (!workqueue_impl::ThreadPool::get().try_run(m_num_threads, run_worker)) {
+    std::vector<boost::thread> all_threads;
+    for (size_t i = 0; i < m_num_threads; ++i) {
+      boost::thread::attributes attrs;
+      attrs.set_stack_size(8 * 1024 * 1024);
+      all_threads.emplace_back(attrs, boost::bind<void>(run_worker, i));
+    }
+    for (auto& thread : all_threads) {
+      thread.join();
+    }
   }
 
   Output result = init_output;
   for (auto& thread_state : m_states) {
-    result = m_reducer(result, thread_state->m_result);
+    workqueue_impl::reduce_into(
+        m_reducer, result, std::move(thread_state->m_result));
   }
   return result;
 }
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <boost/optional/optional.hpp>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+ * A Chase-Lev work-stealing deque, following the C11 formulation in
+ *
+ *   N. M. Lê, A. Pop, A. Cohen, F. Zappa Nardelli. "Correct and Efficient
+ *   Work-Stealing for Weak Memory Models". PPoPP 2013.
+ *
+ * A single owner thread pushes and pops at the bottom (LIFO), while any number
+ * of thief threads steal from the top (FIFO). Neither side takes a lock; the
+ * only contended operation is the CAS on `m_top` when the deque holds a single
+ * element or when two thieves race.
+ *
+ * Elements are held in std::atomic slots, so T must be trivially copyable and
+ * small enough for the atomics to be lock-free. WorkQueue boxes anything else.
+ *
+ * Arrays that have been outgrown are kept alive until the deque is destroyed,
+ * since a thief may still be reading from them.
+ */
+template <class T>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "WorkStealingDeque elements must be trivially copyable");
+
+ public:
+  explicit WorkStealingDeque(size_t log_initial_capacity = 5)
+      : m_top(0), m_bottom(0) {
+    m_arrays.emplace_back(
+        std::make_unique<Array>(int64_t(1) << log_initial_capacity));
+    m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  /*
+   * Owner only.
+   */
+  void push(T item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    Array* a = m_array.load(std::memory_order_relaxed);
+    if (b - t > a->capacity() - 1) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /*
+   * Owner only. Takes the most recently pushed item.
+   */
+  boost::optional<T> pop() {
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array* a = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      // Empty.
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return boost::none;
+    }
+    T item = a->get(b);
+    if (t == b) {
+      // Last element; race against thieves for it.
+      bool won = m_top.compare_exchange_strong(t, t + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed);
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      if (!won) {
+        return boost::none;
+      }
+    }
+    return item;
+  }
+
+  /*
+   * Any thread. Takes the least recently pushed item. A boost::none result
+   * may be spurious if another thread won a race for the same element.
+   */
+  boost::optional<T> steal() {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return boost::none;
+    }
+    Array* a = m_array.load(std::memory_order_acquire);
+    T item = a->get(t);
+    if (!m_top.compare_exchange_strong(t, t + 1,
+                                       std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return boost::none;
+    }
+    return item;
+  }
+
+  /*
+   * Approximate; only exact when no other thread is operating on the deque.
+   */
+  size_t size() const {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+  }
+
+  bool empty() const { return size() == 0; }
+
+ private:
+  class Array {
+   public:
+    explicit Array(int64_t capacity)
+        : m_mask(capacity - 1),
+          m_slots(new std::atomic<T>[static_cast<size_t>(capacity)]) {}
+
+    int64_t capacity() const { return m_mask + 1; }
+
+    T get(int64_t i) const {
+      return m_slots[i & m_mask].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, T item) {
+      m_slots[i & m_mask].store(item, std::memory_order_relaxed);
+    }
+
+   private:
+    int64_t m_mask;
+    std::unique_ptr<std::atomic<T>[]> m_slots;
+  };
+
+  Array* grow(Array* old, int64_t t, int64_t b) {
+    auto bigger = std::make_unique<Array>(old->capacity() * 2);
+    for (int64_t i = t; i < b; ++i) {
+      bigger->put(i, old->get(i));
+    }
+    Array* result = bigger.get();
+    m_arrays.emplace_back(std::move(bigger));
+    m_array.store(result, std::memory_order_release);
+    return result;
+  }
+
+  // Keep the indices on separate cache lines; the owner hammers m_bottom
+  // while thieves hammer m_top. (Padding rather than alignas, since we can't
+  // rely on over-aligned operator new in C++14.)
+  static constexpr size_t CACHE_LINE = 64;
+  std::atomic<int64_t> m_top;
+  char m_pad0[CACHE_LINE - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> m_bottom;
+  char m_pad1[CACHE_LINE - sizeof(std::atomic<int64_t>)];
+  std::atomic<Array*> m_array;
+  // Owner only.
+  std::vector<std::unique_ptr<Array>> m_arrays;
+};
@@ -38,7 +38,10 @@ AnnoKill::AnnoKill(Scope& scope,
                    const std::unordered_map<std::string, std::vector<std::string>>& class_hierarchy_keep_annos,
                    const std::unordered_map<std::string, std::vector<std::string>>& annotated_keep_annos
                    )
-  : m_scope(scope), m_only_force_kill(only_force_kill), m_kill_bad_signatures(kill_bad_signatures) {
+  : m_scope(scope),
+    m_only_force_kill(only_force_kill),
+    m_kill_bad_signatures(kill_bad_signatures),
+    m_signature_type(DexType::get_type("Ldalvik/annotation/Signature;")) {
   // Load annotations that should not be deleted.
   TRACE(ANNO, 2, "Keep annotations count %d\n", keep.size());
   for (const auto& anno_name : keep) {
@@ -109,8 +112,12 @@ AnnoKill::AnnoKill(Scope& scope,
   }
 }
 
-AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
-  AnnoKill::AnnoSet all_annos;
+ConcurrentBitmap AnnoKill::get_referenced_annos() {
+  // The dense ids of all annotation types.
+  ConcurrentBitmap all_annos(g_redex->num_type_ids());
+  auto is_anno = [&](const DexType* type) {
+    return all_annos.contains(type->get_dense_id());
+  };
 
   // all used annotations
   auto annos_in_aset = [&](DexAnnotationSet* aset) {
@@ -118,43 +125,51 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
       return;
     }
     for (const auto& anno : aset->get_annotations()) {
-      all_annos.insert(anno->type());
+      all_annos.insert(anno->type()->get_dense_id());
     }
   };
 
-  for (const auto& cls : m_scope) {
+  walk::parallel::classes(m_scope, [&](DexClass* cls) {
     // all annotations referenced in classes
     annos_in_aset(cls->get_anno_set());
 
     // all classes marked as annotation
     if (is_annotation(cls)) {
-      all_annos.insert(cls->get_type());
+      all_annos.insert(cls->get_type()->get_dense_id());
     }
-  }
 
-  // all annotations in methods
-  walk::methods(m_scope, [&](DexMethod* method) {
-    annos_in_aset(method->get_anno_set());
-    auto param_annos = method->get_param_anno();
-    if (!param_annos) {
-      return;
+    // all annotations in methods
+    for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto* method : *methods) {
+        annos_in_aset(method->get_anno_set());
+        auto param_annos = method->get_param_anno();
+        if (!param_annos) {
+          continue;
+        }
+        for (auto pa : *param_annos) {
+          annos_in_aset(pa.second);
+        }
+      }
     }
-    for (auto pa : *param_annos) {
-      annos_in_aset(pa.second);
+    // all annotations in fields
+    for (auto* fields : {&cls->get_sfields(), &cls->get_ifields()}) {
+      for (auto* field : *fields) {
+        annos_in_aset(field->get_anno_set());
+      }
     }
   });
-  // all annotations in fields
-  walk::fields(m_scope,
-              [&](DexField* field) { annos_in_aset(field->get_anno_set()); });
 
-  AnnoKill::AnnoSet referenced_annos;
+  ConcurrentBitmap referenced_annos(g_redex->num_type_ids());
+  auto mark_referenced = [&](const DexType* type) {
+    referenced_annos.insert(type->get_dense_id());
+  };
 
   // mark an annotation as "unremovable" if a field is typed with that
   // annotation
-  walk::fields(m_scope, [&](DexField* field) {
+  walk::parallel::fields(m_scope, [&](DexField* field) {
     // don't look at fields defined on the annotation itself
     const auto field_cls_type = field->get_class();
-    if (all_annos.count(field_cls_type) > 0) {
+    if (is_anno(field_cls_type)) {
       return;
     }
 
@@ -164,23 +179,23 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
     }
 
     auto ftype = field->get_type();
-    if (all_annos.count(ftype) > 0) {
+    if (is_anno(ftype)) {
       TRACE(ANNO,
             3,
             "Field typed with an annotation type %s.%s:%s\n",
             SHOW(field->get_class()),
             SHOW(field->get_name()),
             SHOW(ftype));
-      referenced_annos.insert(ftype);
+      mark_referenced(ftype);
     }
   });
 
   // mark an annotation as "unremovable" if a method signature contains a type
   // with that annotation
-  walk::methods(m_scope, [&](DexMethod* meth) {
+  walk::parallel::methods(m_scope, [&](DexMethod* meth) {
     // don't look at methods defined on the annotation itself
     const auto meth_cls_type = meth->get_class();
-    if (all_annos.count(meth_cls_type) > 0) {
+    if (is_anno(meth_cls_type)) {
       return;
     }
 
@@ -190,14 +205,14 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
     }
 
     const auto& has_anno = [&](DexType* type) {
-      if (all_annos.count(type) > 0) {
+      if (is_anno(type)) {
         TRACE(ANNO,
               3,
               "Method contains annotation type in signature %s.%s:%s\n",
               SHOW(meth->get_class()),
               SHOW(meth->get_name()),
               SHOW(meth->get_proto()));
-        referenced_annos.insert(type);
+        mark_referenced(type);
       }
     };
 
@@ -210,13 +225,13 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
 
   // mark an annotation as "unremovable" if any opcode references the annotation
   // type
-  walk::opcodes(
+  walk::parallel::opcodes(
       m_scope,
       [](DexMethod*) { return true; },
       [&](DexMethod* meth, IRInstruction* insn) {
         // don't look at methods defined on the annotation itself
         const auto meth_cls_type = meth->get_class();
-        if (all_annos.count(meth_cls_type) > 0) {
+        if (is_anno(meth_cls_type)) {
           return;
         }
         const auto meth_cls = type_class(meth_cls_type);
@@ -226,8 +241,8 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
 
         if (insn->has_type()) {
           auto type = insn->get_type();
-          if (all_annos.count(type) > 0) {
-            referenced_annos.insert(type);
+          if (is_anno(type)) {
+            mark_referenced(type);
             TRACE(ANNO,
                   3,
                   "Annotation referenced in type opcode\n\t%s.%s:%s - %s\n",
@@ -246,14 +261,14 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
 
           bool referenced = false;
           auto owner = field->get_class();
-          if (all_annos.count(owner) > 0) {
+          if (is_anno(owner)) {
             referenced = true;
-            referenced_annos.insert(owner);
+            mark_referenced(owner);
           }
           auto type = field->get_type();
-          if (all_annos.count(type) > 0) {
+          if (is_anno(type)) {
             referenced = true;
-            referenced_annos.insert(type);
+            mark_referenced(type);
           }
           if (referenced) {
             TRACE(ANNO,
@@ -271,21 +286,21 @@ AnnoKill::AnnoSet AnnoKill::get_referenced_annos() {
 
           bool referenced = false;
           auto owner = method->get_class();
-          if (all_annos.count(owner) > 0) {
+          if (is_anno(owner)) {
             referenced = true;
-            referenced_annos.insert(owner);
+            mark_referenced(owner);
           }
           auto proto = method->get_proto();
           auto rtype = proto->get_rtype();
-          if (all_annos.count(rtype) > 0) {
+          if (is_anno(rtype)) {
             referenced = true;
-            referenced_annos.insert(rtype);
+            mark_referenced(rtype);
           }
           auto arg_list = proto->get_args();
           for (const auto& arg : arg_list->get_type_list()) {
-            if (all_annos.count(arg) > 0) {
+            if (is_anno(arg)) {
               referenced = true;
-              referenced_annos.insert(arg);
+              mark_referenced(arg);
             }
           }
           if (referenced) {
@@ -329,30 +344,32 @@ AnnoKill::AnnoSet AnnoKill::get_removable_annotation_instances() {
   return bannotations;
 }
 
-void AnnoKill::count_annotation(const DexAnnotation* da) {
-  std::string annoName(da->type()->get_name()->c_str());
+void AnnoKill::count_annotation(const DexAnnotation* da, Sweep* sweep) const {
   if (da->system_visible()) {
-    m_system_anno_map[annoName]++;
-    m_stats.visibility_system_count++;
+    sweep->system_annos[da->type()]++;
+    sweep->stats.visibility_system_count++;
   } else if (da->runtime_visible()) {
-    m_runtime_anno_map[annoName]++;
-    m_stats.visibility_runtime_count++;
+    sweep->runtime_annos[da->type()]++;
+    sweep->stats.visibility_runtime_count++;
   } else if (da->build_visible()) {
-    m_build_anno_map[annoName]++;
-    m_stats.visibility_build_count++;
+    sweep->build_annos[da->type()]++;
+    sweep->stats.visibility_build_count++;
   }
 }
 
-void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
-                            const AnnoKill::AnnoSet& referenced_annos,
-                            const std::unordered_set<const DexType*>& keep_annos) {
-  m_stats.annotations += aset->size();
+void AnnoKill::cleanup_aset(
+    DexAnnotationSet* aset,
+    const std::unordered_set<const DexType*>& keep_annos,
+    Sweep* sweep) const {
+  auto& stats = sweep->stats;
+  stats.annotations += aset->size();
   auto& annos = aset->get_annotations();
   auto fn = [&](DexAnnotation* da) {
     auto anno_type = da->type();
-    count_annotation(da);
+    auto flags = get_anno_flags(anno_type);
+    count_annotation(da, sweep);
 
-    if (referenced_annos.count(anno_type) > 0) {
+    if (flags & REFERENCED) {
       TRACE(ANNO,
             3,
             "Annotation type %s with type referenced in "
@@ -369,7 +386,7 @@ void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
       return false;
     }
 
-    if (m_keep.count(anno_type) > 0) {
+    if (flags & KEEP) {
       TRACE(ANNO,
             3,
             "Blacklisted annotation type %s, "
@@ -379,40 +396,40 @@ void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
       return false;
     }
 
-    if (m_kill.count(anno_type) > 0) {
+    if (flags & KILL) {
       TRACE(ANNO,
             3,
             "Annotation instance (type: %s) marked for removal, "
             "annotation: %s\n",
             SHOW(anno_type),
             SHOW(da));
-      m_stats.annotations_killed++;
+      stats.annotations_killed++;
       delete da;
       return true;
     }
 
-    if (m_force_kill.count(anno_type) > 0) {
+    if (flags & FORCE_KILL) {
       TRACE(ANNO,
             3,
             "Annotation instance (type: %s) marked for forced removal, "
             "annotation: %s\n",
             SHOW(anno_type),
             SHOW(da));
-      m_stats.annotations_killed++;
+      stats.annotations_killed++;
       delete da;
       return true;
     }
 
     if (!m_only_force_kill && !da->system_visible()) {
       TRACE(ANNO, 3, "Killing annotation instance %s\n", SHOW(da));
-      m_stats.annotations_killed++;
+      stats.annotations_killed++;
       delete da;
       return true;
     }
 
-    if (anno_type == DexType::get_type("Ldalvik/annotation/Signature;")) {
+    if (anno_type == m_signature_type) {
       if (should_kill_bad_signature(da)) {
-        m_stats.signatures_killed++;
+        stats.signatures_killed++;
         delete da;
         return true;
       }
@@ -423,7 +440,7 @@ void AnnoKill::cleanup_aset(DexAnnotationSet* aset,
   annos.erase(std::remove_if(annos.begin(), annos.end(), fn), annos.end());
 }
 
-bool AnnoKill::should_kill_bad_signature(DexAnnotation* da) {
+bool AnnoKill::should_kill_bad_signature(DexAnnotation* da) const {
   if (!m_kill_bad_signatures) return false;
   TRACE(ANNO, 3, "Examining @Signature instance %s\n", SHOW(da));
   auto elems = da->anno_elems();
@@ -498,49 +515,98 @@ bool AnnoKill::should_kill_bad_signature(DexAnnotation* da) {
   return false;
 }
 
-std::unordered_set<const DexType*> AnnoKill::build_anno_keep(DexAnnotationSet* aset) {
+AnnoKill::AnnoKillStats& AnnoKill::AnnoKillStats::operator+=(
+    const AnnoKillStats& other) {
+  annotations += other.annotations;
+  annotations_killed += other.annotations_killed;
+  class_asets += other.class_asets;
+  class_asets_cleared += other.class_asets_cleared;
+  method_asets += other.method_asets;
+  method_asets_cleared += other.method_asets_cleared;
+  method_param_asets += other.method_param_asets;
+  method_param_asets_cleared += other.method_param_asets_cleared;
+  field_asets += other.field_asets;
+  field_asets_cleared += other.field_asets_cleared;
+  visibility_build_count += other.visibility_build_count;
+  visibility_runtime_count += other.visibility_runtime_count;
+  visibility_system_count += other.visibility_system_count;
+  signatures_killed += other.signatures_killed;
+  return *this;
+}
+
+AnnoKill::Sweep& AnnoKill::Sweep::operator+=(const Sweep& other) {
+  auto merge = [](const std::unordered_map<const DexType*, size_t>& from,
+                  std::unordered_map<const DexType*, size_t>& into) {
+    for (const auto& p : from) {
+      into[p.first] += p.second;
+    }
+  };
+  stats += other.stats;
+  merge(other.build_annos, build_annos);
+  merge(other.runtime_annos, runtime_annos);
+  merge(other.system_annos, system_annos);
+  return *this;
+}
+
+std::unordered_set<const DexType*> AnnoKill::build_anno_keep(
+    DexAnnotationSet* aset) const {
   std::unordered_set<const DexType*> keep_list;
   for (const auto& anno : aset->get_annotations()) {
-    auto& keeps = m_annotated_keep_annos[anno->type()];
-    keep_list.insert(keeps.begin(), keeps.end());
+    auto it = m_annotated_keep_annos.find(anno->type());
+    if (it != m_annotated_keep_annos.end()) {
+      keep_list.insert(it->second.begin(), it->second.end());
+    }
   }
   return keep_list;
 }
 
-bool AnnoKill::kill_annotations() {
-  const auto& referenced_annos = get_referenced_annos();
-  if (!m_only_force_kill) {
-    m_kill = get_removable_annotation_instances();
+void AnnoKill::build_anno_flags(const ConcurrentBitmap& referenced_annos) {
+  m_anno_flags.assign(g_redex->num_type_ids(), 0);
+  for (size_t id = 0; id < referenced_annos.size(); ++id) {
+    if (referenced_annos.contains(id)) {
+      m_anno_flags[id] |= REFERENCED;
+    }
+  }
+  for (auto* type : m_keep) {
+    m_anno_flags[type->get_dense_id()] |= KEEP;
+  }
+  for (auto* type : m_kill) {
+    m_anno_flags[type->get_dense_id()] |= KILL;
+  }
+  for (auto* type : m_force_kill) {
+    m_anno_flags[type->get_dense_id()] |= FORCE_KILL;
   }
+}
 
-  for (auto clazz : m_scope) {
-    DexAnnotationSet* aset = clazz->get_anno_set();
-    if (!aset) {
-      continue;
-    }
+void AnnoKill::sweep_class(DexClass* clazz, Sweep* sweep) const {
+  auto& stats = sweep->stats;
+  DexAnnotationSet* aset = clazz->get_anno_set();
+  if (aset) {
     auto keep_list = build_anno_keep(aset);
-    auto& class_hier_keep_list = m_anno_class_hierarchy_keep[clazz->get_type()];
-    keep_list.insert(class_hier_keep_list.begin(), class_hier_keep_list.end());
+    auto it = m_anno_class_hierarchy_keep.find(clazz->get_type());
+    if (it != m_anno_class_hierarchy_keep.end()) {
+      keep_list.insert(it->second.begin(), it->second.end());
+    }
 
-    m_stats.class_asets++;
-    cleanup_aset(aset, referenced_annos, keep_list);
+    stats.class_asets++;
+    cleanup_aset(aset, keep_list, sweep);
     if (aset->size() == 0) {
       TRACE(ANNO,
             3,
             "Clearing annotation for class %s\n",
             SHOW(clazz->get_type()));
       clazz->clear_annotations();
-      m_stats.class_asets_cleared++;
+      stats.class_asets_cleared++;
     }
   }
 
-  walk::methods(m_scope, [&](DexMethod* method) {
+  auto sweep_method = [&](DexMethod* method) {
     // Method annotations
     auto method_aset = method->get_anno_set();
     if (method_aset) {
-      m_stats.method_asets++;
+      stats.method_asets++;
       auto keep_list = build_anno_keep(method_aset);
-      cleanup_aset(method_aset, referenced_annos, keep_list);
+      cleanup_aset(method_aset, keep_list, sweep);
       if (method_aset->size() == 0) {
         TRACE(ANNO,
               3,
@@ -549,14 +615,14 @@ bool AnnoKill::kill_annotations() {
               SHOW(method->get_name()),
               SHOW(method->get_proto()));
         method->clear_annotations();
-        m_stats.method_asets_cleared++;
+        stats.method_asets_cleared++;
       }
     }
 
     // Parameter annotations.
     auto param_annos = method->get_param_anno();
     if (param_annos) {
-      m_stats.method_param_asets += param_annos->size();
+      stats.method_param_asets += param_annos->size();
       bool clear_pas = true;
       for (auto pa : *param_annos) {
         auto param_aset = pa.second;
@@ -564,7 +630,7 @@ bool AnnoKill::kill_annotations() {
           continue;
         }
         auto keep_list = build_anno_keep(param_aset);
-        cleanup_aset(param_aset, referenced_annos, keep_list);
+        cleanup_aset(param_aset, keep_list, sweep);
         if (param_aset->size() == 0) {
           continue;
         }
@@ -577,23 +643,23 @@ bool AnnoKill::kill_annotations() {
               SHOW(method->get_class()),
               SHOW(method->get_name()),
               SHOW(method->get_proto()));
-        m_stats.method_param_asets_cleared += param_annos->size();
+        stats.method_param_asets_cleared += param_annos->size();
         for (auto pa : *param_annos) {
           delete pa.second;
         }
         param_annos->clear();
       }
     }
-  });
+  };
 
-  walk::fields(m_scope, [&](DexField* field) {
+  auto sweep_field = [&](DexField* field) {
     DexAnnotationSet* aset = field->get_anno_set();
     if (!aset) {
       return;
     }
-    m_stats.field_asets++;
+    stats.field_asets++;
     auto keep_list = build_anno_keep(aset);
-    cleanup_aset(aset, referenced_annos, keep_list);
+    cleanup_aset(aset, keep_list, sweep);
     if (aset->size() == 0) {
       TRACE(ANNO,
             3,
@@ -602,9 +668,40 @@ bool AnnoKill::kill_annotations() {
             SHOW(field->get_name()),
             SHOW(field->get_type()));
       field->clear_annotations();
-      m_stats.field_asets_cleared++;
+      stats.field_asets_cleared++;
     }
-  });
+  };
+
+  for (auto* methods : {&clazz->get_dmethods(), &clazz->get_vmethods()}) {
+    for (auto* method : *methods) {
+      sweep_method(method);
+    }
+  }
+  for (auto* fields : {&clazz->get_sfields(), &clazz->get_ifields()}) {
+    for (auto* field : *fields) {
+      sweep_field(field);
+    }
+  }
+}
+
+bool AnnoKill::kill_annotations() {
+  const auto& referenced_annos = get_referenced_annos();
+  if (!m_only_force_kill) {
+    m_kill = get_removable_annotation_instances();
+  }
+  build_anno_flags(referenced_annos);
+
+  // The annotation sets of a class, its methods and its fields are only
+  // ever touched by the thread that sweeps the class.
+  auto sweep = walk::parallel::reduce_classes<Sweep>(
+      m_scope,
+      [&](DexClass* cls) {
+        Sweep class_sweep;
+        sweep_class(cls, &class_sweep);
+        return class_sweep;
+      },
+      [](Sweep& acc, Sweep&& other) { acc += other; });
+  m_stats = sweep.stats;
 
   bool classes_removed = false;
   // We're done removing annotation instances, go ahead and remove annotation
@@ -616,10 +713,8 @@ bool AnnoKill::kill_annotations() {
                                    return false;
                                  }
                                  auto type = cls->get_type();
-                                 if (referenced_annos.count(type)) {
-                                   return false;
-                                 }
-                                 if (m_keep.count(type)) {
+                                 auto flags = get_anno_flags(type);
+                                 if (flags & (REFERENCED | KEEP)) {
                                    return false;
                                  }
                                  TRACE(ANNO,
@@ -631,16 +726,22 @@ bool AnnoKill::kill_annotations() {
                                }),
                 m_scope.end());
 
-  for (const auto& p : m_build_anno_map) {
-    TRACE(ANNO, 3, "Build anno: %lu, %s\n", p.second, p.first.c_str());
-  }
-
-  for (const auto& p : m_runtime_anno_map) {
-    TRACE(ANNO, 3, "Runtime anno: %lu, %s\n", p.second, p.first.c_str());
-  }
-
-  for (const auto& p : m_system_anno_map) {
-    TRACE(ANNO, 3, "System anno: %lu, %s\n", p.second, p.first.c_str());
+  if (traceEnabled(ANNO, 3)) {
+    auto trace_counts =
+        [](const char* kind,
+           const std::unordered_map<const DexType*, size_t>& counts) {
+          std::map<std::string, size_t> by_name;
+          for (const auto& p : counts) {
+            by_name[p.first->get_name()->str()] = p.second;
+          }
+          for (const auto& p : by_name) {
+            TRACE(ANNO, 3, "%s anno: %lu, %s\n", kind, p.second,
+                  p.first.c_str());
+          }
+        };
+    trace_counts("Build", sweep.build_annos);
+    trace_counts("Runtime", sweep.runtime_annos);
+    trace_counts("System", sweep.system_annos);
   }
 
   return classes_removed;
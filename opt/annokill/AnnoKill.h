@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "Pass.h"
 
 #include <map>
@@ -20,22 +21,22 @@ class AnnoKill {
   using AnnoNames = std::vector<std::string>;
 
   struct AnnoKillStats {
-    size_t annotations;
-    size_t annotations_killed;
-    size_t class_asets;
-    size_t class_asets_cleared;
-    size_t method_asets;
-    size_t method_asets_cleared;
-    size_t method_param_asets;
-    size_t method_param_asets_cleared;
-    size_t field_asets;
-    size_t field_asets_cleared;
-    size_t visibility_build_count;
-    size_t visibility_runtime_count;
-    size_t visibility_system_count;
-    size_t signatures_killed;
-
-    AnnoKillStats() { memset(this, 0, sizeof(AnnoKillStats)); }
+    size_t annotations{0};
+    size_t annotations_killed{0};
+    size_t class_asets{0};
+    size_t class_asets_cleared{0};
+    size_t method_asets{0};
+    size_t method_asets_cleared{0};
+    size_t method_param_asets{0};
+    size_t method_param_asets_cleared{0};
+    size_t field_asets{0};
+    size_t field_asets_cleared{0};
+    size_t visibility_build_count{0};
+    size_t visibility_runtime_count{0};
+    size_t visibility_system_count{0};
+    size_t signatures_killed{0};
+
+    AnnoKillStats& operator+=(const AnnoKillStats& other);
   };
 
   AnnoKill(Scope& scope,
@@ -49,25 +50,54 @@ class AnnoKill {
            );
 
   bool kill_annotations();
-  std::unordered_set<const DexType*> build_anno_keep(DexAnnotationSet* aset);
-  bool should_kill_bad_signature(DexAnnotation* da);
+  std::unordered_set<const DexType*> build_anno_keep(
+      DexAnnotationSet* aset) const;
+  bool should_kill_bad_signature(DexAnnotation* da) const;
   AnnoKillStats get_stats() const { return m_stats; }
 
  private:
+  // What sweeping the annotation sets of some classes did. Each thread of the
+  // sweep fills its own, and they are merged at the end.
+  struct Sweep {
+    AnnoKillStats stats;
+    // The number of annotations of each type, by visibility.
+    std::unordered_map<const DexType*, size_t> build_annos;
+    std::unordered_map<const DexType*, size_t> runtime_annos;
+    std::unordered_map<const DexType*, size_t> system_annos;
+
+    Sweep& operator+=(const Sweep& other);
+  };
+
+  // What the sweep does with the instances of an annotation type, as flags
+  // of m_anno_flags.
+  enum AnnoFlags : uint8_t {
+    REFERENCED = 1 << 0,
+    KEEP = 1 << 1,
+    KILL = 1 << 2,
+    FORCE_KILL = 1 << 3,
+  };
+
   // Gets the set of all annotations referenced in code
   // either by the use of SomeClass.class, as a parameter of a method
-  // call or if the annotation is a field of a class.
-  AnnoSet get_referenced_annos();
+  // call or if the annotation is a field of a class. The set holds the dense
+  // ids of the annotation types.
+  ConcurrentBitmap get_referenced_annos();
 
   // Retrieves the list of annotation instances that match the given set
   // of annotation types to be removed.
   AnnoSet get_removable_annotation_instances();
 
-  void cleanup_aset(
-    DexAnnotationSet* aset,
-    const AnnoSet& referenced_annos,
-    const std::unordered_set<const DexType*>& keep_annos = std::unordered_set<const DexType*>{});
-  void count_annotation(const DexAnnotation* da);
+  void build_anno_flags(const ConcurrentBitmap& referenced_annos);
+  uint8_t get_anno_flags(const DexType* type) const {
+    auto id = type->get_dense_id();
+    return id < m_anno_flags.size() ? m_anno_flags[id] : 0;
+  }
+
+  void sweep_class(DexClass* cls, Sweep* sweep) const;
+  void cleanup_aset(DexAnnotationSet* aset,
+                    const std::unordered_set<const DexType*>& keep_annos,
+                    Sweep* sweep) const;
+  void count_annotation(const DexAnnotation* da, Sweep* sweep) const;
 
   Scope& m_scope;
   bool m_only_force_kill;
@@ -76,10 +106,11 @@ class AnnoKill {
   AnnoSet m_force_kill;
   AnnoSet m_keep;
   AnnoKillStats m_stats;
+  DexType* m_signature_type;
 
-  std::map<std::string, size_t> m_build_anno_map;
-  std::map<std::string, size_t> m_runtime_anno_map;
-  std::map<std::string, size_t> m_system_anno_map;
+  // The AnnoFlags of each annotation type, indexed by dense id, so that
+  // deciding the fate of an annotation takes a single lookup.
+  std::vector<uint8_t> m_anno_flags;
   std::unordered_map<const DexType*, std::unordered_set<const DexType*>> m_anno_class_hierarchy_keep;
   std::unordered_map<const DexType*, std::unordered_set<const DexType*>> m_annotated_keep_annos;
 };
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BasicBlockLayout.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Show.h"
+#include "Walkers.h"
+
+namespace {
+
+constexpr const char* METRIC_METHODS_LAID_OUT = "num_methods_laid_out";
+constexpr const char* METRIC_COLD_BLOCKS = "num_cold_blocks";
+constexpr const char* METRIC_INVERTED_BRANCHES = "num_inverted_branches";
+
+} // namespace
+
+bool BasicBlockLayoutPass::is_traced(IROpcode op) {
+  return !opcode::is_internal(op) && !opcode::is_move(op) &&
+         !is_move_result(op) && op != OPCODE_MOVE_EXCEPTION;
+}
+
+BasicBlockLayoutPass::MethodProfiles BasicBlockLayoutPass::load_profiles(
+    const std::string& index_file_name, const std::string& profile_file_name) {
+  std::ifstream index_file(index_file_name);
+  assert_log(index_file, "Can't open basic block index file: %s\n",
+             index_file_name.c_str());
+  std::unordered_map<std::string, std::string> id_to_name;
+  MethodProfiles profiles;
+  std::string line;
+  while (std::getline(index_file, line)) {
+    // The method name doesn't contain commas, but split around it anyway.
+    auto first = line.find(',');
+    auto last = line.rfind(',');
+    if (first == std::string::npos || first == last) {
+      continue;
+    }
+    auto name = line.substr(first + 1, last - first - 1);
+    profiles[name].num_blocks = std::stoul(line.substr(last + 1));
+    id_to_name.emplace(line.substr(0, first), std::move(name));
+  }
+
+  std::ifstream profile_file(profile_file_name);
+  assert_log(profile_file, "Can't open basic block profile file: %s\n",
+             profile_file_name.c_str());
+  size_t count = 0;
+  while (std::getline(profile_file, line)) {
+    auto first = line.find(',');
+    auto last = line.rfind(',');
+    if (first == std::string::npos || first == last) {
+      continue;
+    }
+    auto it = id_to_name.find(line.substr(0, first));
+    if (it == id_to_name.end()) {
+      continue;
+    }
+    auto block_id = std::stoul(line.substr(first + 1, last - first - 1));
+    auto hits = std::stoull(line.substr(last + 1));
+    profiles.at(it->second).block_hits[block_id] += hits;
+    count++;
+  }
+  TRACE(BBPROFILE, 2, "Loaded %zu block profiles of %zu methods\n", count,
+        profiles.size());
+  return profiles;
+}
+
+boost::optional<BasicBlockLayoutPass::InstructionHits>
+BasicBlockLayoutPass::get_instruction_hits(const MethodProfile& profile,
+                                           IRCode* code) {
+  // The profile refers to the blocks of the non-editable CFG, which keep the
+  // instructions of the editable one, gotos aside.
+  InstructionHits insn_hits;
+  code->build_cfg(/* editable */ false);
+  auto blocks = code->cfg().blocks();
+  if (blocks.size() != profile.num_blocks) {
+    TRACE(BBPROFILE, 3, "Profile has %zu blocks, code has %zu\n",
+          profile.num_blocks, blocks.size());
+    code->clear_cfg();
+    return boost::none;
+  }
+  for (auto block : blocks) {
+    auto it = profile.block_hits.find(block->id());
+    auto hits = it == profile.block_hits.end() ? 0 : it->second;
+    for (const auto& mie : InstructionIterable(block)) {
+      if (mie.insn->opcode() != OPCODE_GOTO) {
+        insn_hits.emplace(mie.insn, hits);
+      }
+    }
+  }
+  code->clear_cfg();
+  return insn_hits;
+}
+
+BasicBlockLayoutPass::Stats BasicBlockLayoutPass::apply_profile(
+    const MethodProfile& profile, IRCode* code) {
+  Stats stats;
+  if (profile.block_hits.empty()) {
+    return stats;
+  }
+  auto insn_hits = get_instruction_hits(profile, code);
+  if (!insn_hits) {
+    return stats;
+  }
+
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  std::unordered_map<const cfg::Block*, uint64_t> block_hits;
+  for (auto block : cfg.blocks()) {
+    uint64_t hits = 0;
+    bool traced = false;
+    for (const auto& mie : InstructionIterable(block)) {
+      auto it = insn_hits->find(mie.insn);
+      if (it != insn_hits->end()) {
+        hits = std::max(hits, it->second);
+      }
+      traced = traced || is_traced(mie.insn->opcode());
+    }
+    // Blocks without a profile are neither hot nor cold; they usually only
+    // move a result or an exception to where a hotter block needs it.
+    block_hits.emplace(block, traced ? hits : 1);
+    if (traced && hits == 0 && block != cfg.entry_block()) {
+      block->set_cold(true);
+      stats.cold_blocks++;
+    }
+  }
+
+  // Make the target that ran more often fall through.
+  for (auto block : cfg.blocks()) {
+    if (block->branchingness() != opcode::BRANCH_IF) {
+      continue;
+    }
+    auto goto_edge = cfg.get_succ_edge_of_type(block, cfg::EDGE_GOTO);
+    auto branch_edge = cfg.get_succ_edge_of_type(block, cfg::EDGE_BRANCH);
+    auto goto_target = goto_edge->target();
+    auto branch_target = branch_edge->target();
+    if (block_hits.at(branch_target) <= block_hits.at(goto_target)) {
+      continue;
+    }
+    auto insn = block->get_last_insn()->insn;
+    insn->set_opcode(opcode::invert_conditional_branch(insn->opcode()));
+    cfg.set_edge_target(branch_edge, goto_target);
+    cfg.set_edge_target(goto_edge, branch_target);
+    stats.inverted_branches++;
+  }
+
+  code->clear_cfg();
+  stats.methods_laid_out++;
+  return stats;
+}
+
+void BasicBlockLayoutPass::run_pass(DexStoresVector& stores,
+                                    ConfigFiles& /* conf */,
+                                    PassManager& mgr) {
+  if (m_index_file_name.empty() || m_profile_file_name.empty()) {
+    TRACE(BBPROFILE, 1, "No basic block profile given\n");
+    return;
+  }
+  const auto profiles =
+      load_profiles(m_index_file_name, m_profile_file_name);
+
+  const auto scope = build_class_scope(stores);
+  const auto stats = walk::parallel::reduce_methods_by_cost<Stats>(
+      scope,
+      [&](DexMethod* method) {
+        auto code = method->get_code();
+        if (code == nullptr) {
+          return Stats();
+        }
+        auto it = profiles.find(show(method));
+        if (it == profiles.end()) {
+          return Stats();
+        }
+        return apply_profile(it->second, code);
+      },
+      [](Stats a, Stats b) {
+        a.methods_laid_out += b.methods_laid_out;
+        a.cold_blocks += b.cold_blocks;
+        a.inverted_branches += b.inverted_branches;
+        return a;
+      });
+  mgr.incr_metric(METRIC_METHODS_LAID_OUT, stats.methods_laid_out);
+  mgr.incr_metric(METRIC_COLD_BLOCKS, stats.cold_blocks);
+  mgr.incr_metric(METRIC_INVERTED_BRANCHES, stats.inverted_branches);
+}
+
+static BasicBlockLayoutPass s_pass;
@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include <boost/optional.hpp>
+
+#include "ControlFlow.h"
+#include "Pass.h"
+
+class IRCode;
+
+/*
+ * Lays out the blocks of methods after a basic block profile that was
+ * collected with the basic block tracing of InstrumentPass.
+ *
+ * The profile is given by two files:
+ * - the index file that InstrumentPass wrote, with lines of
+ *     <method id>,<method name>,<number of blocks>
+ * - the profile itself, with lines of
+ *     <method id>,<block id>,<hits>
+ *   where the hits of a block are how many traced runs of the method ran it.
+ * Blocks are identified by their id in the non-editable CFG of the method as
+ * it was instrumented, so this pass has to run at the same point of the pass
+ * list as InstrumentPass did in the instrumented build. The layout is lost
+ * when another pass re-linearizes the code, so that should be late.
+ */
+class BasicBlockLayoutPass : public Pass {
+ public:
+  BasicBlockLayoutPass() : Pass("BasicBlockLayoutPass") {}
+
+  void configure_pass(const JsonWrapper& jw) override {
+    jw.get("index_file_name", "", m_index_file_name);
+    jw.get("profile_file_name", "", m_profile_file_name);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  struct MethodProfile {
+    size_t num_blocks{0};
+    std::unordered_map<cfg::BlockId, uint64_t> block_hits;
+  };
+
+  // Keyed by show(method).
+  using MethodProfiles = std::unordered_map<std::string, MethodProfile>;
+
+  using InstructionHits = std::unordered_map<const IRInstruction*, uint64_t>;
+
+  static MethodProfiles load_profiles(const std::string& index_file_name,
+                                      const std::string& profile_file_name);
+
+  /*
+   * How many traced runs ran each instruction of `code`, gotos aside, or none
+   * if the blocks of `code` don't match the profile. Leaves `code` without a
+   * CFG.
+   */
+  static boost::optional<InstructionHits> get_instruction_hits(
+      const MethodProfile& profile, IRCode* code);
+
+  /*
+   * Whether InstrumentPass traces a block with this instruction in it; blocks
+   * with nothing else have no profile.
+   */
+  static bool is_traced(IROpcode op);
+
+  struct Stats {
+    size_t methods_laid_out{0};
+    size_t cold_blocks{0};
+    size_t inverted_branches{0};
+  };
+
+  /*
+   * Moves the blocks that never ran after the others, and inverts the
+   * conditional branches whose target ran more often than their fallthrough.
+   * Does nothing if the method never ran, or if its blocks don't match the
+   * profile.
+   */
+  static Stats apply_profile(const MethodProfile& profile, IRCode* code);
+
+ private:
+  std::string m_index_file_name;
+  std::string m_profile_file_name;
+};
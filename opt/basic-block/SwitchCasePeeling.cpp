@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SwitchCasePeeling.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Show.h"
+#include "Walkers.h"
+
+namespace {
+
+constexpr const char* METRIC_PROFILED_SWITCHES =
+    "num_profiled_sparse_switches";
+constexpr const char* METRIC_PEELED_CASES = "num_peeled_cases";
+
+// Whether instruction lowering will turn a switch with these cases into a
+// sparse-switch rather than a packed one.
+bool is_sparse(const std::vector<cfg::Edge*>& case_edges) {
+  int64_t min_key = std::numeric_limits<int64_t>::max();
+  int64_t max_key = std::numeric_limits<int64_t>::min();
+  for (auto e : case_edges) {
+    min_key = std::min<int64_t>(min_key, *e->case_key());
+    max_key = std::max<int64_t>(max_key, *e->case_key());
+  }
+  return (max_key - min_key + 1) / 2 > (int64_t)case_edges.size();
+}
+
+// Moves the case of `edge` out of its switch, into an if-eq in front of it.
+void peel_case(cfg::ControlFlowGraph& cfg, cfg::Edge* edge) {
+  auto switch_block = edge->src();
+  auto switch_insn = switch_block->get_last_insn()->insn;
+  auto key = *edge->case_key();
+
+  // The if goes at the end of the block that leads to the switch.
+  cfg::Block* head;
+  MethodItemEntry* last_before_switch = nullptr;
+  for (auto& mie : InstructionIterable(switch_block)) {
+    if (mie.insn != switch_insn) {
+      last_before_switch = &mie;
+    }
+  }
+  if (last_before_switch != nullptr) {
+    head = switch_block;
+    switch_block = cfg.split_block(
+        head->to_cfg_instruction_iterator(*last_before_switch));
+  } else {
+    head = cfg.create_block();
+    std::vector<cfg::Edge*> preds(switch_block->preds().begin(),
+                                  switch_block->preds().end());
+    for (auto e : preds) {
+      cfg.set_edge_target(e, head);
+    }
+  }
+
+  IRInstruction* branch;
+  if (key == 0) {
+    branch = new IRInstruction(OPCODE_IF_EQZ);
+    branch->set_src(0, switch_insn->src(0));
+  } else {
+    auto key_reg = cfg.allocate_temp();
+    auto load = new IRInstruction(OPCODE_CONST);
+    load->set_literal(key)->set_dest(key_reg);
+    head->push_back(load);
+    branch = new IRInstruction(OPCODE_IF_EQ);
+    branch->set_src(0, switch_insn->src(0))->set_src(1, key_reg);
+  }
+  auto target = edge->target();
+  cfg.delete_edge(edge);
+  cfg.create_branch(head, branch, switch_block, target);
+}
+
+} // namespace
+
+SwitchCasePeelingPass::Stats SwitchCasePeelingPass::peel_cases(
+    const BasicBlockLayoutPass::MethodProfile& profile,
+    size_t min_num_cases,
+    IRCode* code) {
+  Stats stats;
+  if (profile.block_hits.empty()) {
+    return stats;
+  }
+  auto insn_hits = BasicBlockLayoutPass::get_instruction_hits(profile, code);
+  if (!insn_hits) {
+    return stats;
+  }
+
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  std::unordered_map<const cfg::Block*, uint64_t> block_hits;
+  std::vector<cfg::Block*> switches;
+  for (auto block : cfg.blocks()) {
+    uint64_t hits = 0;
+    for (const auto& mie : InstructionIterable(block)) {
+      auto it = insn_hits->find(mie.insn);
+      if (it != insn_hits->end() &&
+          BasicBlockLayoutPass::is_traced(mie.insn->opcode())) {
+        hits = std::max(hits, it->second);
+      }
+    }
+    block_hits.emplace(block, hits);
+    if (block->branchingness() == opcode::BRANCH_SWITCH) {
+      switches.push_back(block);
+    }
+  }
+
+  for (auto block : switches) {
+    auto case_edges = cfg.get_succ_edges_of_type(block, cfg::EDGE_BRANCH);
+    if (case_edges.size() < std::max<size_t>(min_num_cases, 2) ||
+        !is_sparse(case_edges)) {
+      continue;
+    }
+    stats.switches++;
+    std::unordered_map<const cfg::Block*, size_t> num_keys;
+    for (auto e : case_edges) {
+      num_keys[e->target()]++;
+    }
+    auto default_edge = cfg.get_succ_edge_of_type(block, cfg::EDGE_GOTO);
+    uint64_t total_hits =
+        default_edge == nullptr ? 0 : block_hits.at(default_edge->target());
+    cfg::Edge* hottest = nullptr;
+    uint64_t hottest_hits = 0;
+    for (auto e : case_edges) {
+      auto target = e->target();
+      auto hits = block_hits.at(target);
+      total_hits += hits;
+      if (hits <= hottest_hits || num_keys.at(target) != 1 ||
+          target->preds().size() != 1) {
+        continue;
+      }
+      hottest = e;
+      hottest_hits = hits;
+    }
+    if (hottest == nullptr || hottest_hits <= total_hits - hottest_hits) {
+      continue;
+    }
+    TRACE(BBPROFILE, 4, "Peeling case %d of %s\n", *hottest->case_key(),
+          SHOW(block->get_last_insn()->insn));
+    peel_case(cfg, hottest);
+    stats.peeled_cases++;
+  }
+
+  code->clear_cfg();
+  return stats;
+}
+
+void SwitchCasePeelingPass::run_pass(DexStoresVector& stores,
+                                     ConfigFiles& /* conf */,
+                                     PassManager& mgr) {
+  if (m_index_file_name.empty() || m_profile_file_name.empty()) {
+    TRACE(BBPROFILE, 1, "No basic block profile given\n");
+    return;
+  }
+  const auto profiles = BasicBlockLayoutPass::load_profiles(
+      m_index_file_name, m_profile_file_name);
+
+  const auto scope = build_class_scope(stores);
+  const auto stats = walk::parallel::reduce_methods_by_cost<Stats>(
+      scope,
+      [&](DexMethod* method) {
+        auto code = method->get_code();
+        if (code == nullptr) {
+          return Stats();
+        }
+        auto it = profiles.find(show(method));
+        if (it == profiles.end()) {
+          return Stats();
+        }
+        return peel_cases(it->second, m_min_num_cases, code);
+      },
+      [](Stats a, Stats b) {
+        a.switches += b.switches;
+        a.peeled_cases += b.peeled_cases;
+        return a;
+      });
+  mgr.incr_metric(METRIC_PROFILED_SWITCHES, stats.switches);
+  mgr.incr_metric(METRIC_PEELED_CASES, stats.peeled_cases);
+}
+
+static SwitchCasePeelingPass s_pass;
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "BasicBlockLayout.h"
+#include "Pass.h"
+
+class IRCode;
+
+/*
+ * Peels the case that dominates a sparse switch, after the same basic block
+ * profile as BasicBlockLayoutPass, into an if-eq in front of the switch:
+ *
+ *   sparse-switch v0 {1 -> :a, 1000 -> :b, ...}
+ *
+ * becomes
+ *
+ *   const v1 1000
+ *   if-eq v0 v1 :b
+ *   sparse-switch v0 {1 -> :a, ...}
+ *
+ * ART compiles a sparse-switch into a comparison per key, so the hot case of a
+ * large string-hash or enum switch otherwise pays for all the keys before its
+ * own. A case dominates when its block ran more often than the other cases
+ * together; only cases whose block the switch alone leads to, under a single
+ * key, are considered. The keys of a sparse-switch are sorted in the dex, so
+ * peeling is the only reordering there is to do.
+ *
+ * Like BasicBlockLayoutPass, this has to run at the same point of the pass
+ * list as InstrumentPass did in the instrumented build.
+ */
+class SwitchCasePeelingPass : public Pass {
+ public:
+  SwitchCasePeelingPass() : Pass("SwitchCasePeelingPass") {}
+
+  void configure_pass(const JsonWrapper& jw) override {
+    jw.get("index_file_name", "", m_index_file_name);
+    jw.get("profile_file_name", "", m_profile_file_name);
+    jw.get("min_num_cases", 4, m_min_num_cases);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  struct Stats {
+    size_t switches{0};
+    size_t peeled_cases{0};
+  };
+
+  /*
+   * Peels the dominant case of each sparse switch of `code` with at least
+   * `min_num_cases` cases. Does nothing if the blocks of `code` don't match
+   * the profile.
+   */
+  static Stats peel_cases(const BasicBlockLayoutPass::MethodProfile& profile,
+                          size_t min_num_cases,
+                          IRCode* code);
+
+ private:
+  std::string m_index_file_name;
+  std::string m_profile_file_name;
+  size_t m_min_num_cases;
+};
@@ -14,6 +14,7 @@
 #include "DexAccess.h"
 #include "DexClass.h"
 #include "DexUtil.h"
+#include "EditableCfgAdapter.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "Resolver.h"
@@ -40,7 +41,9 @@ constexpr const char* METRIC_BAD_METHOD_INSTRUCTIONS =
 constexpr const char* METRIC_ILLEGAL_CROSS_STORE_REFS =
     "illegal_cross_store_refs";
 
-bool class_contains(const DexField* field) {
+// For the members of classes that are not in scope, which are not in the
+// bitmaps.
+bool class_lists(const DexField* field) {
   const auto& cls = type_class(field->get_class());
   if (cls == nullptr) return true;
   for (const auto& cls_field : cls->get_ifields()) {
@@ -52,7 +55,7 @@ bool class_contains(const DexField* field) {
   return false;
 }
 
-bool class_contains(const DexMethod* method) {
+bool class_lists(const DexMethod* method) {
   const auto& cls = type_class(method->get_class());
   if (cls == nullptr) return true;
   for (const auto& cls_meth : cls->get_vmethods()) {
@@ -87,20 +90,127 @@ size_t illegal_elements(const MethodInsns& method_to_insns,
   return num_illegal_cross_store_refs;
 }
 
+template <class T>
+void merge_into(std::vector<T>& into, std::vector<T>&& from) {
+  if (into.empty()) {
+    into = std::move(from);
+  } else {
+    into.insert(into.end(), from.begin(), from.end());
+  }
+}
+
+template <class Key, class Value, class Compare>
+void merge_into(std::map<Key, Value, Compare>& into,
+                std::map<Key, Value, Compare>&& from) {
+  for (auto& pair : from) {
+    merge_into(into[pair.first], std::move(pair.second));
+  }
+}
+
+template <class Map, class Compare>
+void sort_values(Map& map, Compare compare) {
+  for (auto& pair : map) {
+    std::sort(pair.second.begin(), pair.second.end(), compare);
+  }
+}
+
 } // namespace
 
+void Breadcrumbs::Violations::merge(Violations&& other) {
+  merge_into(bad_fields, std::move(other.bad_fields));
+  merge_into(bad_methods, std::move(other.bad_methods));
+  merge_into(bad_type_insns, std::move(other.bad_type_insns));
+  merge_into(bad_field_insns, std::move(other.bad_field_insns));
+  merge_into(bad_meth_insns, std::move(other.bad_meth_insns));
+  merge_into(illegal_field, std::move(other.illegal_field));
+  merge_into(bad_fields_refs, std::move(other.bad_fields_refs));
+  merge_into(illegal_type, std::move(other.illegal_type));
+  merge_into(illegal_field_type, std::move(other.illegal_field_type));
+  merge_into(illegal_field_cls, std::move(other.illegal_field_cls));
+  merge_into(illegal_method_call, std::move(other.illegal_method_call));
+}
+
+void Breadcrumbs::Violations::sort() {
+  sort_values(bad_fields, dexfields_comparator());
+  sort_values(bad_methods, dexmethods_comparator());
+  sort_values(illegal_field, dexfields_comparator());
+  sort_values(bad_fields_refs, dexfields_comparator());
+}
+
 Breadcrumbs::Breadcrumbs(const Scope& scope, DexStoresVector& stores, bool reject_illegal_refs_root_store)
     : m_scope(scope),
+      m_scope_types(g_redex->num_type_ids()),
+      m_scope_fields(g_redex->num_field_ids()),
+      m_scope_methods(g_redex->num_method_ids()),
       m_xstores(stores),
       m_reject_illegal_refs_root_store(reject_illegal_refs_root_store) {
-  m_classes.insert(scope.begin(), scope.end());
+  for (const auto* cls : scope) {
+    m_scope_types.insert(cls->get_type()->get_dense_id());
+    for (const auto* field : cls->get_ifields()) {
+      m_scope_fields.insert(field->get_dense_id());
+    }
+    for (const auto* field : cls->get_sfields()) {
+      m_scope_fields.insert(field->get_dense_id());
+    }
+    for (const auto* method : cls->get_dmethods()) {
+      m_scope_methods.insert(method->get_dense_id());
+    }
+    for (const auto* method : cls->get_vmethods()) {
+      m_scope_methods.insert(method->get_dense_id());
+    }
+  }
   m_multiple_root_store_dexes = stores[0].get_dexen().size() > 1;
 }
 
+// Checks the fields, methods and instructions of all classes in a single
+// parallel sweep.
 void Breadcrumbs::check_breadcrumbs() {
-  check_fields();
-  check_methods();
-  check_opcodes();
+  auto violations = walk::parallel::reduce_classes<Violations>(
+      m_scope,
+      [this](const DexClass* cls) {
+        Violations violations;
+        check_class(cls, violations);
+        return violations;
+      },
+      [](Violations& acc, Violations&& violations) {
+        acc.merge(std::move(violations));
+      });
+  // Workers add to the entries of deleted types in any order.
+  violations.sort();
+  m_violations.merge(std::move(violations));
+}
+
+void Breadcrumbs::check_class(const DexClass* cls, Violations& violations) {
+  for (const auto* field : cls->get_sfields()) {
+    check_field_def(field, violations);
+  }
+  for (const auto* field : cls->get_ifields()) {
+    check_field_def(field, violations);
+  }
+  std::vector<DexMethod*> methods(cls->get_dmethods().begin(),
+                                  cls->get_dmethods().end());
+  methods.insert(methods.end(), cls->get_vmethods().begin(),
+                 cls->get_vmethods().end());
+  for (const auto* method : methods) {
+    check_method_def(method, violations);
+  }
+  for (auto* method : methods) {
+    auto* code = method->get_code();
+    if (code == nullptr) {
+      continue;
+    }
+    editable_cfg_adapter::iterate(code, [&](MethodItemEntry& mie) {
+      auto* insn = mie.insn;
+      if (insn->has_type()) {
+        check_type_opcode(method, insn, violations);
+      } else if (insn->has_field()) {
+        check_field_opcode(method, insn, violations);
+      } else if (insn->has_method()) {
+        check_method_opcode(method, insn, violations);
+      }
+      return editable_cfg_adapter::LOOP_CONTINUE;
+    });
+  }
 }
 
 void Breadcrumbs::report_deleted_types(bool report_only, PassManager& mgr) {
@@ -109,25 +219,26 @@ void Breadcrumbs::report_deleted_types(bool report_only, PassManager& mgr) {
   size_t bad_type_insns_count = 0;
   size_t bad_field_insns_count = 0;
   size_t bad_meths_insns_count = 0;
-  if (m_bad_fields.size() > 0 || m_bad_methods.size() > 0 ||
-      m_bad_type_insns.size() > 0 || m_bad_field_insns.size() > 0 ||
-      m_bad_meth_insns.size() > 0) {
+  const auto& v = m_violations;
+  if (v.bad_fields.size() > 0 || v.bad_methods.size() > 0 ||
+      v.bad_type_insns.size() > 0 || v.bad_field_insns.size() > 0 ||
+      v.bad_meth_insns.size() > 0) {
     std::ostringstream ss;
-    for (const auto& bad_field : m_bad_fields) {
+    for (const auto& bad_field : m_violations.bad_fields) {
       for (const auto& field : bad_field.second) {
         bad_fields_count++;
         ss << "Reference to deleted type " << SHOW(bad_field.first)
            << " in field " << SHOW(field) << std::endl;
       }
     }
-    for (const auto& bad_meth : m_bad_methods) {
+    for (const auto& bad_meth : m_violations.bad_methods) {
       for (const auto& meth : bad_meth.second) {
         bad_methods_count++;
         ss << "Reference to deleted type " << SHOW(bad_meth.first)
            << " in method " << SHOW(meth) << std::endl;
       }
     }
-    for (const auto& bad_insns : m_bad_type_insns) {
+    for (const auto& bad_insns : m_violations.bad_type_insns) {
       for (const auto& insns : bad_insns.second) {
         for (const auto& insn : insns.second) {
           bad_type_insns_count++;
@@ -137,7 +248,7 @@ void Breadcrumbs::report_deleted_types(bool report_only, PassManager& mgr) {
         }
       }
     }
-    for (const auto& bad_insns : m_bad_field_insns) {
+    for (const auto& bad_insns : m_violations.bad_field_insns) {
       for (const auto& insns : bad_insns.second) {
         for (const auto& insn : insns.second) {
           bad_field_insns_count++;
@@ -147,7 +258,7 @@ void Breadcrumbs::report_deleted_types(bool report_only, PassManager& mgr) {
         }
       }
     }
-    for (const auto& bad_insns : m_bad_meth_insns) {
+    for (const auto& bad_insns : m_violations.bad_meth_insns) {
       for (const auto& insns : bad_insns.second) {
         for (const auto& insn : insns.second) {
           bad_meths_insns_count++;
@@ -182,7 +293,7 @@ void Breadcrumbs::report_deleted_types(bool report_only, PassManager& mgr) {
 
 std::string Breadcrumbs::get_methods_with_bad_refs() {
   std::ostringstream ss;
-  for (const auto& class_meth : m_bad_methods) {
+  for (const auto& class_meth : m_violations.bad_methods) {
     const auto type = class_meth.first;
     const auto& methods = class_meth.second;
     ss << "Bad methods in class " << type->get_name()->c_str() << std::endl;
@@ -191,7 +302,7 @@ std::string Breadcrumbs::get_methods_with_bad_refs() {
     }
     ss << std::endl;
   }
-  for (const auto& meth_field : m_bad_fields_refs) {
+  for (const auto& meth_field : m_violations.bad_fields_refs) {
     const auto type = meth_field.first->get_class();
     const auto method = meth_field.first;
     const auto& fields = meth_field.second;
@@ -207,9 +318,17 @@ std::string Breadcrumbs::get_methods_with_bad_refs() {
 
 void Breadcrumbs::report_illegal_refs(bool fail_if_illegal_refs,
                                       PassManager& mgr) {
+  const auto& v = m_violations;
+  if (v.illegal_field.empty() && v.illegal_type.empty() &&
+      v.illegal_field_type.empty() && v.illegal_field_cls.empty() &&
+      v.illegal_method_call.empty()) {
+    mgr.set_metric(METRIC_ILLEGAL_CROSS_STORE_REFS, 0);
+    TRACE(BRCR, 1, "No illegal cross store references\n");
+    return;
+  }
   size_t num_illegal_fields = 0;
   std::ostringstream ss;
-  for (const auto& pair : m_illegal_field) {
+  for (const auto& pair : m_violations.illegal_field) {
     const auto type = pair.first;
     const auto& fields = pair.second;
     num_illegal_fields += fields.size();
@@ -223,13 +342,13 @@ void Breadcrumbs::report_illegal_refs(bool fail_if_illegal_refs,
   }
 
   size_t num_illegal_type_refs =
-      illegal_elements(m_illegal_type, "type refs", ss);
+      illegal_elements(m_violations.illegal_type, "type refs", ss);
   size_t num_illegal_field_type_refs =
-      illegal_elements(m_illegal_field_type, "field type refs", ss);
+      illegal_elements(m_violations.illegal_field_type, "field type refs", ss);
   size_t num_illegal_field_cls =
-      illegal_elements(m_illegal_field_cls, "field class refs", ss);
+      illegal_elements(m_violations.illegal_field_cls, "field class refs", ss);
   size_t num_illegal_method_calls =
-      illegal_elements(m_illegal_method_call, "method call", ss);
+      illegal_elements(m_violations.illegal_method_call, "method call", ss);
 
   size_t num_illegal_cross_store_refs =
       num_illegal_fields + num_illegal_type_refs + num_illegal_field_cls +
@@ -257,6 +376,11 @@ void Breadcrumbs::report_illegal_refs(bool fail_if_illegal_refs,
 }
 
 bool Breadcrumbs::has_illegal_access(const DexMethod* input_method) {
+  return has_illegal_access(input_method, m_violations);
+}
+
+bool Breadcrumbs::has_illegal_access(const DexMethod* input_method,
+                                     Violations& violations) {
   bool result = false;
   if (input_method->get_code() == nullptr) {
     return false;
@@ -266,7 +390,7 @@ bool Breadcrumbs::has_illegal_access(const DexMethod* input_method) {
     if (insn->has_field()) {
       auto res_field = resolve_field(insn->get_field());
       if (res_field != nullptr) {
-        if (!check_field_accessibility(input_method, res_field)) {
+        if (!check_field_accessibility(input_method, res_field, violations)) {
           result = true;
         }
       } else if (referenced_field_is_deleted(insn->get_field())) {
@@ -277,7 +401,7 @@ bool Breadcrumbs::has_illegal_access(const DexMethod* input_method) {
       auto res_method =
           resolve_method(insn->get_method(), opcode_to_search(insn));
       if (res_method != nullptr) {
-        if (!check_method_accessibility(input_method, res_method)) {
+        if (!check_method_accessibility(input_method, res_method, violations)) {
           result = true;
         }
       } else if (referenced_method_is_deleted(insn->get_method())) {
@@ -291,8 +415,7 @@ bool Breadcrumbs::has_illegal_access(const DexMethod* input_method) {
 bool Breadcrumbs::is_illegal_cross_store(const DexType* caller,
                                          const DexType* callee) {
   // Skip deleted types, as we don't know the store for those.
-  if (m_classes.count(type_class(caller)) == 0 ||
-      m_classes.count(type_class(callee)) == 0) {
+  if (!is_in_scope(caller) || !is_in_scope(callee)) {
     return false;
   }
 
@@ -308,11 +431,29 @@ bool Breadcrumbs::is_illegal_cross_store(const DexType* caller,
                                               callee_store_idx);
 }
 
+bool Breadcrumbs::is_in_scope(const DexType* type) const {
+  // Types made after the bitmap are not in scope.
+  auto id = type->get_dense_id();
+  return id < m_scope_types.size() && m_scope_types.contains(id);
+}
+
+bool Breadcrumbs::class_contains(const DexField* field) const {
+  if (!is_in_scope(field->get_class())) return class_lists(field);
+  auto id = field->get_dense_id();
+  return id < m_scope_fields.size() && m_scope_fields.contains(id);
+}
+
+bool Breadcrumbs::class_contains(const DexMethod* method) const {
+  if (!is_in_scope(method->get_class())) return class_lists(method);
+  auto id = method->get_dense_id();
+  return id < m_scope_methods.size() && m_scope_methods.contains(id);
+}
+
 const DexType* Breadcrumbs::check_type(const DexType* type) {
+  if (is_in_scope(type)) return nullptr;
   const auto& cls = type_class(type);
   if (cls == nullptr) return nullptr;
   if (cls->is_external()) return nullptr;
-  if (m_classes.count(cls) > 0) return nullptr;
   return type;
 }
 
@@ -329,45 +470,38 @@ const DexType* Breadcrumbs::check_method(const DexMethodRef* method) {
   return nullptr;
 }
 
-void Breadcrumbs::bad_type(const DexType* type,
-                           const DexMethod* method,
-                           const IRInstruction* insn) {
-  m_bad_type_insns[type][method].emplace_back(insn);
-}
-
 // verify that all field definitions are of a type not deleted
-void Breadcrumbs::check_fields() {
-  walk::fields(m_scope, [&](DexField* field) {
-    const auto& type = check_type(field->get_type());
-    if (type == nullptr) {
-      const auto cls = field->get_class();
-      const auto field_type = field->get_type();
-      if (is_illegal_cross_store(cls, field_type)) {
-        m_illegal_field[cls].emplace_back(field);
-      }
-      return;
+void Breadcrumbs::check_field_def(const DexField* field,
+                                  Violations& violations) {
+  const auto& type = check_type(field->get_type());
+  if (type == nullptr) {
+    const auto cls = field->get_class();
+    const auto field_type = field->get_type();
+    if (is_illegal_cross_store(cls, field_type)) {
+      violations.illegal_field[cls].emplace_back(field);
     }
-    m_bad_fields[type].emplace_back(field);
-  });
+    return;
+  }
+  violations.bad_fields[type].emplace_back(field);
 }
 
 // verify that all method definitions use not deleted types in their sig
-void Breadcrumbs::check_methods() {
-  walk::methods(m_scope, [&](DexMethod* method) {
-    const auto& type = check_method(method);
-    if (type == nullptr) return;
-    m_bad_methods[type].emplace_back(method);
-    has_illegal_access(method);
-  });
+void Breadcrumbs::check_method_def(const DexMethod* method,
+                                   Violations& violations) {
+  const auto& type = check_method(method);
+  if (type == nullptr) return;
+  violations.bad_methods[type].emplace_back(method);
+  has_illegal_access(method, violations);
 }
 
 /* verify that all method instructions that access fields are valid */
 bool Breadcrumbs::check_field_accessibility(const DexMethod* method,
-                                            const DexField* res_field) {
+                                            const DexField* res_field,
+                                            Violations& violations) {
   const auto field_class = res_field->get_class();
   const auto method_class = method->get_class();
   if (field_class != method_class && is_private(res_field)) {
-    m_bad_fields_refs[method].emplace_back(res_field);
+    violations.bad_fields_refs[method].emplace_back(res_field);
     return false;
   }
   return true;
@@ -383,11 +517,13 @@ bool Breadcrumbs::referenced_method_is_deleted(DexMethodRef* method) {
 
 /* verify that all method instructions that access methods are valid */
 bool Breadcrumbs::check_method_accessibility(
-    const DexMethod* method, const DexMethod* res_called_method) {
+    const DexMethod* method,
+    const DexMethod* res_called_method,
+    Violations& violations) {
   const auto called_method_class = res_called_method->get_class();
   const auto method_class = method->get_class();
   if (called_method_class != method_class && is_private(res_called_method)) {
-    m_bad_methods[method_class].emplace_back(res_called_method);
+    violations.bad_methods[method_class].emplace_back(res_called_method);
     return false;
   }
   return true;
@@ -395,41 +531,43 @@ bool Breadcrumbs::check_method_accessibility(
 
 // verify that all opcodes are to non deleted references
 void Breadcrumbs::check_type_opcode(const DexMethod* method,
-                                    IRInstruction* insn) {
+                                    IRInstruction* insn,
+                                    Violations& violations) {
   const DexType* type = insn->get_type();
   type = check_type(type);
   if (type != nullptr) {
-    bad_type(type, method, insn);
+    violations.bad_type_insns[type][method].emplace_back(insn);
   } else {
     const auto cls = method->get_class();
     if (is_illegal_cross_store(cls, insn->get_type())) {
-      m_illegal_type[method].emplace_back(insn);
+      violations.illegal_type[method].emplace_back(insn);
     }
   }
 }
 
 void Breadcrumbs::check_field_opcode(const DexMethod* method,
-                                     IRInstruction* insn) {
+                                     IRInstruction* insn,
+                                     Violations& violations) {
   auto field = insn->get_field();
   const DexType* type = check_type(field->get_class());
   if (type != nullptr) {
-    bad_type(type, method, insn);
+    violations.bad_type_insns[type][method].emplace_back(insn);
     return;
   }
 
   auto cls = method->get_class();
   if (is_illegal_cross_store(cls, field->get_class())) {
-    m_illegal_field_type[method].emplace_back(insn);
+    violations.illegal_field_type[method].emplace_back(insn);
   }
 
   type = check_type(field->get_type());
   if (type != nullptr) {
-    bad_type(type, method, insn);
+    violations.bad_type_insns[type][method].emplace_back(insn);
     return;
   }
 
   if (is_illegal_cross_store(cls, field->get_type())) {
-    m_illegal_field_cls[method].emplace_back(insn);
+    violations.illegal_field_cls[method].emplace_back(insn);
   }
 
   auto res_field = resolve_field(field);
@@ -438,7 +576,7 @@ void Breadcrumbs::check_field_opcode(const DexMethod* method,
     if (field != res_field) {
       type = check_type(field->get_class());
       if (type != nullptr) {
-        bad_type(type, method, insn);
+        violations.bad_type_insns[type][method].emplace_back(insn);
         return;
       }
     }
@@ -446,23 +584,24 @@ void Breadcrumbs::check_field_opcode(const DexMethod* method,
     // the class of the field is around but the field may have
     // been deleted so let's verify the field exists on the class
     if (referenced_field_is_deleted(field)) {
-      m_bad_field_insns[static_cast<DexField*>(field)][method].emplace_back(
-          insn);
+      violations.bad_field_insns[static_cast<DexField*>(field)][method]
+          .emplace_back(insn);
       return;
     }
   }
 }
 
 void Breadcrumbs::check_method_opcode(const DexMethod* method,
-                                      IRInstruction* insn) {
+                                      IRInstruction* insn,
+                                      Violations& violations) {
   const auto& meth = insn->get_method();
   const DexType* type = check_method(meth);
   if (type != nullptr) {
-    bad_type(type, method, insn);
+    violations.bad_type_insns[type][method].emplace_back(insn);
     return;
   }
   if (is_illegal_cross_store(method->get_class(), meth->get_class())) {
-    m_illegal_method_call[method].emplace_back(insn);
+    violations.illegal_method_call[method].emplace_back(insn);
   }
 
   DexMethod* res_meth = resolve_method(meth, opcode_to_search(insn));
@@ -471,7 +610,7 @@ void Breadcrumbs::check_method_opcode(const DexMethod* method,
     if (res_meth != meth) {
       type = check_type(res_meth->get_class());
       if (type != nullptr) {
-        bad_type(type, method, insn);
+        violations.bad_type_insns[type][method].emplace_back(insn);
         return;
       }
     }
@@ -479,31 +618,13 @@ void Breadcrumbs::check_method_opcode(const DexMethod* method,
     // the class of the method is around but the method may have
     // been deleted so let's verify the method exists on the class
     if (referenced_method_is_deleted(meth)) {
-      m_bad_meth_insns[static_cast<DexMethod*>(meth)][method].emplace_back(
-          insn);
+      violations.bad_meth_insns[static_cast<DexMethod*>(meth)][method]
+          .emplace_back(insn);
       return;
     }
   }
 }
 
-void Breadcrumbs::check_opcodes() {
-  walk::opcodes(m_scope,
-                [](DexMethod*) { return true; },
-                [&](DexMethod* method, IRInstruction* insn) {
-                  if (insn->has_type()) {
-                    check_type_opcode(method, insn);
-                    return;
-                  }
-                  if (insn->has_field()) {
-                    check_field_opcode(method, insn);
-                    return;
-                  }
-                  if (insn->has_method()) {
-                    check_method_opcode(method, insn);
-                  }
-                });
-}
-
 void CheckBreadcrumbsPass::run_pass(DexStoresVector& stores,
                                     ConfigFiles& /* conf */,
                                     PassManager& mgr) {
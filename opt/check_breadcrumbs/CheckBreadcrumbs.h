@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "ConcurrentContainers.h"
 #include "Pass.h"
 
 /**
@@ -27,6 +28,9 @@ class CheckBreadcrumbsPass : public Pass {
            reject_illegal_refs_root_store);
   }
 
+  uint32_t reads() const override { return CODE | HIERARCHY; }
+  uint32_t writes() const override { return NOTHING; }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
  private:
@@ -55,41 +59,67 @@ class Breadcrumbs {
   bool has_illegal_access(const DexMethod* input_method);
 
  private:
+  /*
+   * What the checks find. Each worker of check_breadcrumbs() fills its own,
+   * and they are merged once all classes have been checked.
+   */
+  struct Violations {
+    std::map<const DexType*, Fields, dextypes_comparator> bad_fields;
+    std::map<const DexType*, Methods, dextypes_comparator> bad_methods;
+    std::map<const DexType*, MethodInsns, dextypes_comparator> bad_type_insns;
+    std::map<const DexField*, MethodInsns, dexfields_comparator>
+        bad_field_insns;
+    std::map<const DexMethod*, MethodInsns, dexmethods_comparator>
+        bad_meth_insns;
+    std::map<const DexType*, Fields, dextypes_comparator> illegal_field;
+    std::map<const DexMethod*, Fields, dexmethods_comparator> bad_fields_refs;
+    MethodInsns illegal_type;
+    MethodInsns illegal_field_type;
+    MethodInsns illegal_field_cls;
+    MethodInsns illegal_method_call;
+
+    void merge(Violations&& other);
+    // Puts the fields and methods that several classes add to in order.
+    void sort();
+  };
+
   const Scope& m_scope;
-  std::unordered_set<const DexClass*> m_classes;
-  std::map<const DexType*, Fields, dextypes_comparator> m_bad_fields;
-  std::map<const DexType*, Methods, dextypes_comparator> m_bad_methods;
-  std::map<const DexType*, MethodInsns, dextypes_comparator> m_bad_type_insns;
-  std::map<const DexField*, MethodInsns, dexfields_comparator>
-      m_bad_field_insns;
-  std::map<const DexMethod*, MethodInsns, dexmethods_comparator>
-      m_bad_meth_insns;
-  std::map<const DexType*, Fields, dextypes_comparator> m_illegal_field;
-  std::map<const DexMethod*, Fields, dexmethods_comparator> m_bad_fields_refs;
-  MethodInsns m_illegal_type;
-  MethodInsns m_illegal_field_type;
-  MethodInsns m_illegal_field_cls;
-  MethodInsns m_illegal_method_call;
+  // The dense ids of the types of the classes in scope and of their fields
+  // and methods, so that the checks don't hash.
+  ConcurrentBitmap m_scope_types;
+  ConcurrentBitmap m_scope_fields;
+  ConcurrentBitmap m_scope_methods;
+  Violations m_violations;
   XStoreRefs m_xstores;
   bool m_multiple_root_store_dexes;
   bool m_reject_illegal_refs_root_store;
 
+  bool is_in_scope(const DexType* type) const;
+  bool class_contains(const DexField* field) const;
+  bool class_contains(const DexMethod* method) const;
   bool is_illegal_cross_store(const DexType* caller, const DexType* callee);
   const DexType* check_type(const DexType* type);
   const DexType* check_method(const DexMethodRef* method);
-  void bad_type(const DexType* type,
-                const DexMethod* method,
-                const IRInstruction* insn);
-  void check_fields();
-  void check_methods();
+  void check_class(const DexClass* cls, Violations& violations);
+  void check_field_def(const DexField* field, Violations& violations);
+  void check_method_def(const DexMethod* method, Violations& violations);
+  bool has_illegal_access(const DexMethod* input_method,
+                          Violations& violations);
   bool referenced_field_is_deleted(DexFieldRef* field);
   bool referenced_method_is_deleted(DexMethodRef* method);
   bool check_field_accessibility(const DexMethod* method,
-                                 const DexField* res_field);
+                                 const DexField* res_field,
+                                 Violations& violations);
   bool check_method_accessibility(const DexMethod* method,
-                                  const DexMethod* res_called_method);
-  void check_type_opcode(const DexMethod* method, IRInstruction* insn);
-  void check_field_opcode(const DexMethod* method, IRInstruction* insn);
-  void check_method_opcode(const DexMethod* method, IRInstruction* insn);
-  void check_opcodes();
+                                  const DexMethod* res_called_method,
+                                  Violations& violations);
+  void check_type_opcode(const DexMethod* method,
+                         IRInstruction* insn,
+                         Violations& violations);
+  void check_field_opcode(const DexMethod* method,
+                          IRInstruction* insn,
+                          Violations& violations);
+  void check_method_opcode(const DexMethod* method,
+                           IRInstruction* insn,
+                           Violations& violations);
 };
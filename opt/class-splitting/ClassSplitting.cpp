@@ -17,6 +17,12 @@
  * Each class is filled with up to a configurable number of methods; only when
  * a class is full, another one is created. Separate classes are created for
  * distinct required api levels.
+ *
+ * Optionally, the special classes are instead emitted after all other
+ * classes, i.e. in the dexes that are not loaded at startup. Then the
+ * cold-start dexes only keep the references to the relocated methods, so
+ * loading and verifying their classes touches fewer bytes; only a call into
+ * cold code loads the dex with its target class.
  */
 
 #include "ClassSplitting.h"
@@ -50,8 +56,10 @@ struct ClassSplittingStats {
 class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
  public:
   ClassSplittingInterDexPlugin(size_t target_class_size_threshold,
+                               bool relocate_to_leftover_dexes,
                                PassManager& mgr)
       : m_target_class_size_threshold(target_class_size_threshold),
+        m_relocate_to_leftover_dexes(relocate_to_leftover_dexes),
         m_mgr(mgr) {}
 
   void configure(const Scope& scope, ConfigFiles& conf) override {
@@ -214,14 +222,38 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
 
     TRACE(CS, 2,
           "[class splitting] Relocated {%zu} methods to {%zu} target classes "
-          "in this dex.\n",
-          relocated_methods, target_classes.size());
+          "%s.\n",
+          relocated_methods, target_classes.size(),
+          m_relocate_to_leftover_dexes ? "from this dex" : "in this dex");
 
-    m_target_classes.clear();
     m_split_classes.clear();
+    if (m_relocate_to_leftover_dexes) {
+      // The target classes keep filling up across dexes, as they all end up
+      // together at the end.
+      for (DexClass* target_cls : target_classes) {
+        if (m_leftover_target_classes_set.insert(target_cls).second) {
+          m_leftover_target_classes.push_back(target_cls);
+        }
+      }
+      return {};
+    }
+    m_target_classes.clear();
     return target_classes;
   }
 
+  bool additional_classes_rewrite_code() override {
+    // Methods are only relocated in cleanup.
+    return false;
+  }
+
+  DexClasses leftover_classes() override {
+    TRACE(CS, 2,
+          "[class splitting] Emitting {%zu} target classes after all other "
+          "classes.\n",
+          m_leftover_target_classes.size());
+    return m_leftover_target_classes;
+  }
+
   void cleanup(const std::vector<DexClass*>& scope) override {
     // Here we do the actual relocation.
     for (auto& p : m_methods_to_relocate) {
@@ -240,6 +272,8 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
     m_target_classes.clear();
     m_split_classes.clear();
     m_methods_to_relocate.clear();
+    m_leftover_target_classes.clear();
+    m_leftover_target_classes_set.clear();
   }
 
  private:
@@ -267,6 +301,10 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
   std::unordered_map<int32_t, TargetClassInfo> m_target_classes;
   size_t m_next_target_class_index{0};
   size_t m_target_class_size_threshold;
+  bool m_relocate_to_leftover_dexes;
+  // Only used when relocating to leftover dexes.
+  DexClasses m_leftover_target_classes;
+  std::unordered_set<const DexClass*> m_leftover_target_classes_set;
   std::unordered_map<const DexClass*, SplitClass> m_split_classes;
   std::vector<std::pair<DexMethod*, DexClass*>> m_methods_to_relocate;
   ClassSplittingStats m_stats;
@@ -294,6 +332,7 @@ class ClassSplittingInterDexPlugin : public interdex::InterDexPassPlugin {
 void ClassSplittingPass::configure_pass(const JsonWrapper& jw) {
   jw.get("relocated_methods_per_target_class", 64,
          m_relocated_methods_per_target_class);
+  jw.get("relocate_to_leftover_dexes", false, m_relocate_to_leftover_dexes);
 }
 
 void ClassSplittingPass::run_pass(DexStoresVector&,
@@ -305,7 +344,8 @@ void ClassSplittingPass::run_pass(DexStoresVector&,
   std::function<interdex::InterDexPassPlugin*()> fn =
       [this, &mgr]() -> interdex::InterDexPassPlugin* {
     return new ClassSplittingInterDexPlugin(
-        m_relocated_methods_per_target_class, mgr);
+        m_relocated_methods_per_target_class, m_relocate_to_leftover_dexes,
+        mgr);
   };
   registry->register_plugin("CLASS_SPLITTING_PLUGIN", std::move(fn));
 }
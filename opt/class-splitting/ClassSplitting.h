@@ -18,4 +18,5 @@ class ClassSplittingPass : public Pass {
 
  private:
   size_t m_relocated_methods_per_target_class;
+  bool m_relocate_to_leftover_dexes;
 };
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CheckElimination.h"
+
+#include <chrono>
+
+#include "CheckAnalysis.h"
+#include "DexClass.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Walkers.h"
+
+using namespace constant_propagation;
+
+namespace {
+
+using CheckAnalyzer = InstructionAnalyzerCombiner<LocalArrayAnalyzer,
+                                                  HeapEscapeAnalyzer,
+                                                  PrimitiveAnalyzer>;
+
+struct Stats {
+  size_t methods_analyzed{0};
+  size_t branches_removed{0};
+  size_t null_checks_removed{0};
+  size_t range_checks_removed{0};
+  // Summed over all the methods, whichever thread analyzed them.
+  uint64_t analysis_us{0};
+  uint64_t transform_us{0};
+
+  Stats operator+(const Stats& that) const {
+    Stats result;
+    result.methods_analyzed = methods_analyzed + that.methods_analyzed;
+    result.branches_removed = branches_removed + that.branches_removed;
+    result.null_checks_removed = null_checks_removed + that.null_checks_removed;
+    result.range_checks_removed =
+        range_checks_removed + that.range_checks_removed;
+    result.analysis_us = analysis_us + that.analysis_us;
+    result.transform_us = transform_us + that.transform_us;
+    return result;
+  }
+};
+
+uint64_t microseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// The receiver of an instance method is never null.
+CheckEnvironment initial_env(const DexMethod* method, IRCode* code) {
+  CheckEnvironment env{ConstantEnvironment()};
+  if (!is_static(method)) {
+    auto params = code->get_param_instructions();
+    auto this_insn = InstructionIterable(params).begin()->insn;
+    env.set_nullness(this_insn->dest(),
+                     nullness::Domain(nullness::Nullness::NOT_NULL));
+  }
+  return env;
+}
+
+/*
+ * Replaces the branches that can only go one way with a goto, or removes
+ * them, like Transform::eliminate_dead_branch does. Each one is counted by
+ * the facts that were needed to decide it.
+ */
+void fold_checks(const intraprocedural::CheckFixpointIterator& fp_iter,
+                 IRCode* code,
+                 Stats* stats) {
+  std::vector<IRInstruction*> always_taken;
+  std::vector<IRList::iterator> never_taken;
+  for (auto* block : code->cfg().blocks()) {
+    auto last_insn_it = block->get_last_insn();
+    if (last_insn_it == block->end() ||
+        !is_conditional_branch(last_insn_it->insn->opcode()) ||
+        block->succs().size() != 2) {
+      continue;
+    }
+    auto env = fp_iter.get_exit_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    for (auto* edge : block->succs()) {
+      auto infeasible = [&](intraprocedural::CheckFacts facts) {
+        return intraprocedural::refine_check_edge(edge, env, facts)
+            .is_bottom();
+      };
+      if (!infeasible(intraprocedural::CheckFacts::INTERVALS)) {
+        continue;
+      }
+      if (infeasible(intraprocedural::CheckFacts::CONSTANTS)) {
+        ++stats->branches_removed;
+      } else if (infeasible(intraprocedural::CheckFacts::NULLNESS)) {
+        ++stats->null_checks_removed;
+      } else {
+        ++stats->range_checks_removed;
+      }
+      TRACE(CONSTP, 2, "Removing check %s in block %d\n",
+            SHOW(last_insn_it->insn), block->id());
+      if (edge->type() == cfg::EDGE_GOTO) {
+        always_taken.push_back(last_insn_it->insn);
+      } else {
+        never_taken.push_back(last_insn_it);
+      }
+      // At least one of the successors of a reachable block is reachable.
+      break;
+    }
+  }
+  for (auto* insn : always_taken) {
+    code->replace_branch(insn, new IRInstruction(OPCODE_GOTO));
+  }
+  for (auto it : never_taken) {
+    code->remove_opcode(it);
+  }
+}
+
+} // namespace
+
+void CheckEliminationPass::run_pass(DexStoresVector& stores,
+                                    ConfigFiles&,
+                                    PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+
+  auto stats = walk::parallel::reduce_methods<Stats>(
+      scope,
+      [&](DexMethod* method) {
+        Stats stats;
+        auto code = method->get_code();
+        if (code == nullptr) {
+          return stats;
+        }
+        auto start = std::chrono::steady_clock::now();
+        code->build_cfg(/* editable */ false);
+        intraprocedural::CheckFixpointIterator fp_iter(code->cfg(),
+                                                       CheckAnalyzer());
+        fp_iter.run(initial_env(method, code));
+        stats.analysis_us = microseconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        fold_checks(fp_iter, code, &stats);
+        stats.transform_us = microseconds_since(start);
+        stats.methods_analyzed = 1;
+        return stats;
+      },
+      [](Stats a, Stats b) { return a + b; });
+
+  mgr.incr_metric("num_methods_analyzed", stats.methods_analyzed);
+  mgr.incr_metric("num_branch_propagated", stats.branches_removed);
+  mgr.incr_metric("num_null_checks_removed", stats.null_checks_removed);
+  mgr.incr_metric("num_range_checks_removed", stats.range_checks_removed);
+  mgr.incr_metric("analysis_time_ms", stats.analysis_us / 1000);
+  mgr.incr_metric("transform_time_ms", stats.transform_us / 1000);
+
+  TRACE(CONSTP, 1,
+        "Removed %d null checks and %d range checks in %d methods "
+        "(analysis: %dms, transform: %dms)\n",
+        stats.null_checks_removed, stats.range_checks_removed,
+        stats.methods_analyzed, stats.analysis_us / 1000,
+        stats.transform_us / 1000);
+}
+
+static CheckEliminationPass s_pass;
@@ -0,0 +1,26 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "Pass.h"
+
+/*
+ * Removes the branches that only check what the nullness and interval
+ * analysis of CheckAnalysis.h already proves: null checks of values that were
+ * just allocated or dereferenced, and comparisons of an index against the
+ * bounds it is known to be within. The branches that the constants alone
+ * decide go too, as ConstantPropagationPass would remove them.
+ *
+ * The code that becomes unreachable is left for LocalDcePass.
+ */
+class CheckEliminationPass : public Pass {
+ public:
+  CheckEliminationPass() : Pass("CheckEliminationPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+};
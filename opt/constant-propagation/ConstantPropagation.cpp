@@ -17,6 +17,7 @@ void ConstantPropagationPass::configure_pass(const JsonWrapper& jw) {
   jw.get("replace_moves_with_consts",
          false,
          m_config.transform.replace_moves_with_consts);
+  jw.get("sparse", false, m_config.sparse);
 }
 
 void ConstantPropagationPass::run_pass(DexStoresVector& stores,
@@ -37,10 +38,16 @@ void ConstantPropagationPass::run_pass(DexStoresVector& stores,
         auto& cfg = code.cfg();
 
         TRACE(CONSTP, 5, "CFG: %s\n", SHOW(cfg));
+        constant_propagation::Transform tf(m_config.transform);
+        if (m_config.sparse) {
+          intraprocedural::SparseFixpointIterator fp_iter(
+              cfg, ConstantPrimitiveAnalyzer());
+          fp_iter.run(ConstantEnvironment());
+          return tf.apply(fp_iter, WholeProgramState(), &code);
+        }
         intraprocedural::FixpointIterator fp_iter(cfg,
                                                   ConstantPrimitiveAnalyzer());
         fp_iter.run(ConstantEnvironment());
-        constant_propagation::Transform tf(m_config.transform);
         return tf.apply(fp_iter, WholeProgramState(), &code);
       },
 
@@ -15,6 +15,8 @@ class ConstantPropagationPass : public Pass {
  public:
   struct Config {
     constant_propagation::Transform::Config transform;
+    // Use the sparse analysis, which scales better on very large methods.
+    bool sparse{false};
   };
 
   ConstantPropagationPass() : Pass("ConstantPropagationPass") {}
@@ -71,6 +71,7 @@ void Transform::eliminate_redundant_put(const ConstantEnvironment& env,
       // This field must already hold this value. We don't need to write to it
       // again.
       m_deletes.push_back(it);
+      ++m_stats.redundant_puts_removed;
     }
     break;
   }
@@ -141,8 +142,9 @@ void Transform::simplify_instruction(const ConstantEnvironment& env,
  * whether it is dead (i.e. whether the branch always taken or never taken).
  * If it is, we can replace it with either a nop or a goto.
  */
+template <class Analysis>
 void Transform::eliminate_dead_branch(
-    const intraprocedural::FixpointIterator& intra_cp,
+    const Analysis& intra_cp,
     const ConstantEnvironment& env,
     cfg::Block* block) {
   auto insn_it = block->get_last_insn();
@@ -192,10 +194,10 @@ void Transform::apply_changes(IRCode* code) {
   }
 }
 
-Transform::Stats Transform::apply(
-    const intraprocedural::FixpointIterator& intra_cp,
-    const WholeProgramState& wps,
-    IRCode* code) {
+template <class Analysis>
+Transform::Stats Transform::apply_impl(const Analysis& intra_cp,
+                                       const WholeProgramState& wps,
+                                       IRCode* code) {
   auto& cfg = code->cfg();
   for (const auto& block : cfg.blocks()) {
     auto env = intra_cp.get_entry_state_at(block);
@@ -215,4 +217,18 @@ Transform::Stats Transform::apply(
   return m_stats;
 }
 
+Transform::Stats Transform::apply(
+    const intraprocedural::FixpointIterator& intra_cp,
+    const WholeProgramState& wps,
+    IRCode* code) {
+  return apply_impl(intra_cp, wps, code);
+}
+
+Transform::Stats Transform::apply(
+    const intraprocedural::SparseFixpointIterator& intra_cp,
+    const WholeProgramState& wps,
+    IRCode* code) {
+  return apply_impl(intra_cp, wps, code);
+}
+
 } // namespace constant_propagation
@@ -31,11 +31,14 @@ class Transform final {
   struct Stats {
     size_t branches_removed{0};
     size_t materialized_consts{0};
+    size_t redundant_puts_removed{0};
     Stats operator+(const Stats& that) const {
       Stats result;
       result.branches_removed = branches_removed + that.branches_removed;
       result.materialized_consts =
           materialized_consts + that.materialized_consts;
+      result.redundant_puts_removed =
+          redundant_puts_removed + that.redundant_puts_removed;
       return result;
     }
   };
@@ -46,6 +49,10 @@ class Transform final {
               const WholeProgramState&,
               IRCode*);
 
+  Stats apply(const intraprocedural::SparseFixpointIterator&,
+              const WholeProgramState&,
+              IRCode*);
+
  private:
   /*
    * The methods in this class queue up their transformations. After they are
@@ -64,7 +71,11 @@ class Transform final {
                                const WholeProgramState& wps,
                                IRList::iterator);
 
-  void eliminate_dead_branch(const intraprocedural::FixpointIterator&,
+  template <class Analysis>
+  Stats apply_impl(const Analysis&, const WholeProgramState&, IRCode*);
+
+  template <class Analysis>
+  void eliminate_dead_branch(const Analysis&,
                              const ConstantEnvironment&,
                              cfg::Block*);
 
@@ -73,8 +73,11 @@ std::unique_ptr<intraprocedural::FixpointIterator> analyze_procedure(
  *      Large Embedded C Programs.
  *      https://ntrs.nasa.gov/search.jsp?R=20040081118
  */
-std::unique_ptr<FixpointIterator> PassImpl::analyze(const Scope& scope) {
-  call_graph::Graph cg = call_graph::single_callee_graph(scope);
+std::unique_ptr<FixpointIterator> PassImpl::analyze(
+    const Scope& scope, call_graph::SingleCalleeGraphCache* call_graph_cache) {
+  call_graph::Graph cg = call_graph_cache != nullptr
+                             ? call_graph_cache->get(scope)
+                             : call_graph::single_callee_graph(scope);
   // Rebuild all CFGs here -- this should be more efficient than doing them
   // within FixpointIterator::analyze_node(), since that can get called
   // multiple times for a given method
@@ -83,9 +86,17 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(const Scope& scope) {
     code.cfg().calculate_exit_block();
   });
   auto fp_iter = std::make_unique<FixpointIterator>(cg, analyze_procedure);
+  auto run_fixpoint = [&]() {
+    Domain init{{CURRENT_PARTITION_LABEL, ArgumentDomain()}};
+    if (m_config.parallel_fixpoint) {
+      fp_iter->run_parallel(init, walk::parallel::default_num_threads());
+    } else {
+      fp_iter->run(init);
+    }
+  };
   // Run the bootstrap. All field value and method return values are
   // represented by Top.
-  fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+  run_fixpoint();
   auto non_true_virtuals = devirtualize(scope);
   for (size_t i = 0; i < m_config.max_heap_analysis_iterations; ++i) {
     // Build an approximation of all the field values and method return values.
@@ -98,7 +109,7 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(const Scope& scope) {
     // Use the refined WholeProgramState to propagate more constants via
     // the stack and registers.
     fp_iter->set_whole_program_state(std::move(wps));
-    fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
+    run_fixpoint();
   }
   compute_analysis_stats(fp_iter->get_whole_program_state());
 
@@ -142,7 +153,9 @@ void PassImpl::compute_analysis_stats(const WholeProgramState& wps) {
  * Transform all methods using the information about constant method arguments
  * that analyze() obtained.
  */
-void PassImpl::optimize(const Scope& scope, const FixpointIterator& fp_iter) {
+void PassImpl::optimize(const Scope& scope,
+                        const FixpointIterator& fp_iter,
+                        call_graph::SingleCalleeGraphCache* call_graph_cache) {
   m_transform_stats = walk::parallel::reduce_methods<Transform::Stats>(
       scope,
       [&](DexMethod* method) {
@@ -155,13 +168,23 @@ void PassImpl::optimize(const Scope& scope, const FixpointIterator& fp_iter) {
         if (m_config.create_runtime_asserts) {
           RuntimeAssertTransform rat(m_config.runtime_assert);
           rat.apply(*intra_cp, fp_iter.get_whole_program_state(), method);
+          if (call_graph_cache != nullptr) {
+            call_graph_cache->mark_dirty(method);
+          }
           return Transform::Stats();
         } else {
           Transform::Config config(m_config.transform);
           config.class_under_init =
               is_clinit(method) ? method->get_class() : nullptr;
           Transform tf(config);
-          return tf.apply(*intra_cp, fp_iter.get_whole_program_state(), &code);
+          auto stats =
+              tf.apply(*intra_cp, fp_iter.get_whole_program_state(), &code);
+          if (call_graph_cache != nullptr &&
+              (stats.branches_removed > 0 || stats.materialized_consts > 0 ||
+               stats.redundant_puts_removed > 0)) {
+            call_graph_cache->mark_dirty(method);
+          }
+          return stats;
         }
       },
       [](Transform::Stats a, Transform::Stats b) { // reducer
@@ -169,9 +192,10 @@ void PassImpl::optimize(const Scope& scope, const FixpointIterator& fp_iter) {
       });
 }
 
-void PassImpl::run(Scope& scope) {
-  auto fp_iter = analyze(scope);
-  optimize(scope, *fp_iter);
+void PassImpl::run(Scope& scope,
+                   call_graph::SingleCalleeGraphCache* call_graph_cache) {
+  auto fp_iter = analyze(scope, call_graph_cache);
+  optimize(scope, *fp_iter, call_graph_cache);
 }
 
 void PassImpl::run_pass(DexStoresVector& stores,
@@ -183,9 +207,11 @@ void PassImpl::run_pass(DexStoresVector& stores,
   }
 
   auto scope = build_class_scope(stores);
-  run(scope);
+  run(scope, &mgr.call_graph_cache());
   mgr.incr_metric("branches_removed", m_transform_stats.branches_removed);
   mgr.incr_metric("materialized_consts", m_transform_stats.materialized_consts);
+  mgr.incr_metric("redundant_puts_removed",
+                  m_transform_stats.redundant_puts_removed);
   mgr.incr_metric("constant_fields", m_stats.constant_fields);
   mgr.incr_metric("constant_methods", m_stats.constant_methods);
 }
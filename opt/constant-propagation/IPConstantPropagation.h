@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "CallGraph.h"
 #include "ConstantPropagationRuntimeAssert.h"
 #include "ConstantPropagationTransform.h"
 #include "ConstantPropagationWholeProgramState.h"
@@ -25,6 +26,8 @@ class PassImpl : public Pass {
     // Setting this to zero means that all field values and return values will
     // be treated as Top.
     size_t max_heap_analysis_iterations{0};
+    // Analyze independent parts of the call graph on several threads.
+    bool parallel_fixpoint{false};
 
     Transform::Config transform;
     RuntimeAssertTransform::Config runtime_assert;
@@ -41,6 +44,7 @@ class PassImpl : public Pass {
            m_config.transform.replace_moves_with_consts);
     jw.get("include_virtuals", false, m_config.include_virtuals);
     jw.get("create_runtime_asserts", false, m_config.create_runtime_asserts);
+    jw.get("parallel_fixpoint", false, m_config.parallel_fixpoint);
     int64_t max_heap_analysis_iterations;
     jw.get("max_heap_analysis_iterations", 0, max_heap_analysis_iterations);
     always_assert(max_heap_analysis_iterations >= 0);
@@ -52,22 +56,32 @@ class PassImpl : public Pass {
                 ConfigFiles& conf,
                 PassManager& mgr) override;
 
+  bool is_call_graph_aware() const override { return true; }
+
   /*
    * run_pass() takes a PassManager object, making it awkward to call in unit
    * tests. run() is a more direct way to call this pass. The caller is
    * responsible for picking the right Config settings.
+   *
+   * If `call_graph_cache` is given, the call graph is taken from it, and the
+   * methods this pass changes are marked dirty in it.
    */
-  void run(Scope&);
+  void run(Scope&,
+           call_graph::SingleCalleeGraphCache* call_graph_cache = nullptr);
 
   /*
    * Exposed for testing purposes.
    */
-  std::unique_ptr<FixpointIterator> analyze(const Scope&);
+  std::unique_ptr<FixpointIterator> analyze(
+      const Scope&,
+      call_graph::SingleCalleeGraphCache* call_graph_cache = nullptr);
 
  private:
   void compute_analysis_stats(const WholeProgramState&);
 
-  void optimize(const Scope&, const FixpointIterator&);
+  void optimize(const Scope&,
+                const FixpointIterator&,
+                call_graph::SingleCalleeGraphCache* call_graph_cache);
 
   struct Stats {
     size_t constant_fields{0};
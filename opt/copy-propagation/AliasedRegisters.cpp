@@ -16,6 +16,7 @@
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #endif
+#include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 #include <boost/range/iterator_range.hpp>
 #include <limits>
@@ -42,6 +43,32 @@ using namespace sparta;
 
 namespace aliased_registers {
 
+size_t Value::Hasher::operator()(const Value& value) const {
+  size_t seed = static_cast<size_t>(value.m_kind);
+  switch (value.m_kind) {
+  case Kind::REGISTER:
+    boost::hash_combine(seed, value.m_reg);
+    break;
+  case Kind::CONST_LITERAL:
+  case Kind::CONST_LITERAL_UPPER:
+    boost::hash_combine(seed, value.m_literal);
+    break;
+  case Kind::CONST_STRING:
+    boost::hash_combine(seed, value.m_str);
+    break;
+  case Kind::CONST_TYPE:
+    boost::hash_combine(seed, value.m_type);
+    break;
+  case Kind::STATIC_FINAL:
+  case Kind::STATIC_FINAL_UPPER:
+    boost::hash_combine(seed, value.m_field);
+    break;
+  case Kind::NONE:
+    break;
+  }
+  return seed;
+}
+
 // Move `moving` into the alias group of `group`
 //
 // Create an edge from `moving` to every vertex in the alias group of
@@ -125,6 +125,10 @@ class Value {
 
   bool operator!=(const Value& other) const { return !(*this == other); }
 
+  struct Hasher {
+    size_t operator()(const Value& value) const;
+  };
+
   static const Value& none() {
     static const Value s_none;
     return s_none;
@@ -8,6 +8,8 @@
 #include "CopyPropagationPass.h"
 
 #include <boost/optional.hpp>
+#include <limits>
+#include <set>
 
 #include "AliasedRegisters.h"
 #include "ControlFlow.h"
@@ -18,6 +20,7 @@
 #include "MonotonicFixpointIterator.h"
 #include "PassManager.h"
 #include "Resolver.h"
+#include "SSA.h"
 #include "Walkers.h"
 
 using namespace sparta;
@@ -69,6 +72,135 @@ struct RegisterPair {
   Value upper;
 };
 
+// if the source of `insn` should be tracked by CopyProp, return it
+RegisterPair get_src_value(const IRInstruction* insn,
+                           const CopyPropagationPass::Config& config) {
+  RegisterPair source;
+  auto op = insn->opcode();
+
+  switch (insn->opcode()) {
+  case OPCODE_MOVE:
+  case OPCODE_MOVE_OBJECT:
+    source.lower = Value::create_register(insn->src(0));
+    break;
+  case OPCODE_MOVE_WIDE:
+    if (config.wide_registers) {
+      source.lower = Value::create_register(insn->src(0));
+      source.upper = Value::create_register(insn->src(0) + 1);
+    }
+    break;
+  case OPCODE_MOVE_RESULT:
+  case OPCODE_MOVE_RESULT_OBJECT:
+  case IOPCODE_MOVE_RESULT_PSEUDO:
+  case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
+    source.lower = Value::create_register(RESULT_REGISTER);
+    break;
+  case OPCODE_MOVE_RESULT_WIDE:
+  case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
+    if (config.wide_registers) {
+      source.lower = Value::create_register(RESULT_REGISTER);
+      source.upper = Value::create_register(RESULT_REGISTER + 1);
+    }
+    break;
+  case OPCODE_CONST:
+    if (config.eliminate_const_literals) {
+      source.lower = Value::create_literal(insn->get_literal());
+    }
+    break;
+  case OPCODE_CONST_WIDE:
+    if (config.eliminate_const_literals && config.wide_registers) {
+      source.lower = Value::create_literal(insn->get_literal());
+      source.upper = Value::create_literal_upper(insn->get_literal());
+    }
+    break;
+  case OPCODE_CONST_STRING: {
+    if (config.eliminate_const_strings) {
+      DexString* str = insn->get_string();
+      source.lower = Value{str};
+    }
+    break;
+  }
+  case OPCODE_CONST_CLASS: {
+    if (config.eliminate_const_classes) {
+      DexType* type = insn->get_type();
+      source.lower = Value{type};
+    }
+    break;
+  }
+  case OPCODE_SGET:
+  case OPCODE_SGET_WIDE:
+  case OPCODE_SGET_OBJECT:
+  case OPCODE_SGET_BOOLEAN:
+  case OPCODE_SGET_BYTE:
+  case OPCODE_SGET_CHAR:
+  case OPCODE_SGET_SHORT:
+    if (config.static_finals) {
+      DexField* field = resolve_field(insn->get_field(), FieldSearch::Static);
+      // non-final fields could have been written to since we last made an
+      // alias. Exclude them.
+      if (field != nullptr && is_final(field->get_access())) {
+        if (op != OPCODE_SGET_WIDE) {
+          source.lower = Value::create_field(field);
+        } else if (config.wide_registers) {
+          source.lower = Value::create_field(field);
+          source.upper = Value::create_field_upper(field);
+        }
+      }
+    }
+  default:
+    break;
+  }
+
+  return source;
+}
+
+// return the highest allowed source register for this instruction.
+// `none` means no limit.
+Register get_max_addressable(const IRInstruction* insn,
+                             size_t src_index,
+                             const CopyPropagationPass::Config& config) {
+  IROpcode op = insn->opcode();
+  auto src_bit_width =
+      dex_opcode::src_bit_width(opcode::to_dex_opcode(op), src_index);
+  // 2 ** width - 1
+  Register max_addressable_reg = (1 << src_bit_width) - 1;
+  if (config.regalloc_has_run) {
+    // We have to be careful not to create an instruction like this
+    //
+    //   invoke-virtual v15 Lcom;.foo:(J)V
+    //
+    // because lowering to Dex Instructions would change it to
+    //
+    //   invoke-virtual v15, v16 Lcom;.foo:(J)V
+    //
+    // which is a malformed instruction (v16 is too big).
+    //
+    // Normally, RegAlloc handles this case, but CopyProp can run after
+    // RegAlloc
+    bool upper_is_addressable = is_invoke(op) && insn->src_is_wide(src_index);
+    return max_addressable_reg - (upper_is_addressable ? 1 : 0);
+  }
+  return max_addressable_reg;
+}
+
+// Whether the source registers of `insn` may be replaced with others holding
+// the same values.
+bool may_replace_sources(
+    const IRInstruction* insn,
+    const std::unordered_set<const IRInstruction*>& range_set) {
+  IROpcode op = insn->opcode();
+  return insn->srcs_size() > 0 &&
+         range_set.count(insn) == 0 && // range has to stay in order
+         // we need to make sure the dest and src of check-cast stay
+         // identical, because the dest is simply an alias to the src. See the
+         // comments in IRInstruction.h for details.
+         op != OPCODE_CHECK_CAST &&
+         // The ART verifier checks that monitor-{enter,exit} instructions use
+         // the same register:
+         // http://androidxref.com/6.0.0_r5/xref/art/runtime/verifier/register_line.h#325
+         !is_monitor(op);
+}
+
 class AliasFixpointIterator final
     : public MonotonicFixpointIterator<cfg::GraphInterface, AliasDomain> {
  public:
@@ -106,7 +238,7 @@ class AliasFixpointIterator final
         replace_with_representative(insn, aliases);
       }
 
-      const RegisterPair& src = get_src_value(insn);
+      const RegisterPair& src = get_src_value(insn, m_config);
       const RegisterPair& dst = get_dest_reg(it, iterable.end());
 
       if (!src.lower.is_none() && !dst.lower.is_none()) {
@@ -171,20 +303,11 @@ class AliasFixpointIterator final
   //   invoke-static v0 bar
   void replace_with_representative(IRInstruction* insn,
                                    AliasedRegisters& aliases) const {
-    IROpcode op = insn->opcode();
-    if (insn->srcs_size() > 0 &&
-        m_range_set.count(insn) == 0 && // range has to stay in order
-        // we need to make sure the dest and src of check-cast stay identical,
-        // because the dest is simply an alias to the src. See the comments in
-        // IRInstruction.h for details.
-        op != OPCODE_CHECK_CAST &&
-        // The ART verifier checks that monitor-{enter,exit} instructions use
-        // the same register:
-        // http://androidxref.com/6.0.0_r5/xref/art/runtime/verifier/register_line.h#325
-        !is_monitor(op)) {
+    if (may_replace_sources(insn, m_range_set)) {
       for (size_t i = 0; i < insn->srcs_size(); ++i) {
         Register r = insn->src(i);
-        Register rep = get_rep(r, aliases, get_max_addressable(insn, i));
+        Register rep = get_rep(
+            r, aliases, get_max_addressable(insn, i, m_config));
         if (rep != r) {
           // Make sure the upper half of the wide pair is also aliased.
           if (insn->src_is_wide(i)) {
@@ -215,33 +338,6 @@ class AliasFixpointIterator final
     return orig;
   }
 
-  // return the highest allowed source register for this instruction.
-  // `none` means no limit.
-  Register get_max_addressable(IRInstruction* insn, size_t src_index) const {
-    IROpcode op = insn->opcode();
-    auto src_bit_width =
-        dex_opcode::src_bit_width(opcode::to_dex_opcode(op), src_index);
-    // 2 ** width - 1
-    Register max_addressable_reg = (1 << src_bit_width) - 1;
-    if (m_config.regalloc_has_run) {
-      // We have to be careful not to create an instruction like this
-      //
-      //   invoke-virtual v15 Lcom;.foo:(J)V
-      //
-      // because lowering to Dex Instructions would change it to
-      //
-      //   invoke-virtual v15, v16 Lcom;.foo:(J)V
-      //
-      // which is a malformed instruction (v16 is too big).
-      //
-      // Normally, RegAlloc handles this case, but CopyProp can run after
-      // RegAlloc
-      bool upper_is_addressable = is_invoke(op) && insn->src_is_wide(src_index);
-      return max_addressable_reg - (upper_is_addressable ? 1 : 0);
-    }
-    return max_addressable_reg;
-  }
-
   // if insn has a destination register (including RESULT), return it.
   //
   // ALL destinations must be returned by this method (unlike get_src_value) if
@@ -273,98 +369,209 @@ class AliasFixpointIterator final
     return dest;
   }
 
-  // if the source of `insn` should be tracked by CopyProp, return it
-  RegisterPair get_src_value(IRInstruction* insn) const {
-    RegisterPair source;
-    auto op = insn->opcode();
+  void analyze_node(cfg::Block* const& node,
+                    AliasDomain* current_state) const override {
+    current_state->update([&](AliasedRegisters& aliases) {
+      run_on_block(node, aliases, nullptr);
+    });
+  }
 
-    switch (insn->opcode()) {
-    case OPCODE_MOVE:
-    case OPCODE_MOVE_OBJECT:
-      source.lower = Value::create_register(insn->src(0));
-      break;
-    case OPCODE_MOVE_WIDE:
-      if (m_config.wide_registers) {
-        source.lower = Value::create_register(insn->src(0));
-        source.upper = Value::create_register(insn->src(0) + 1);
+  AliasDomain analyze_edge(
+      const EdgeId&, const AliasDomain& exit_state_at_source) const override {
+    return exit_state_at_source;
+  }
+};
+
+
+// Copy propagation on the SSA form of the code. Every value gets a root: the
+// value it is a copy of, the first value loading the same constant, or itself.
+// Two registers whose values have the same root hold the same thing, wherever
+// the code is. The roots of the phis are found optimistically, so that a
+// value copied around a loop keeps its root, and the whole method takes a
+// pass over the code and its phis instead of a fixpoint over alias graphs.
+class SSACopyPropagation final {
+ public:
+  SSACopyPropagation(const CopyPropagationPass::Config& config,
+                     const std::unordered_set<const IRInstruction*>& range_set,
+                     Stats& stats)
+      : m_config(config), m_range_set(range_set), m_stats(stats) {}
+
+  void run(const cfg::ControlFlowGraph& cfg,
+           std::unordered_set<IRInstruction*>* deletes) {
+    ssa::SSAForm form(cfg);
+    compute_roots(form);
+    apply(form, deletes);
+  }
+
+ private:
+  void compute_roots(const ssa::SSAForm& form) {
+    // The root of a value is unknown until all of its sources are known.
+    constexpr ssa::ValueId TOP = ssa::NO_VALUE;
+    m_roots.assign(form.num_values(), TOP);
+    m_tracked.assign(form.num_values(), false);
+    std::unordered_map<Value, ssa::ValueId, Value::Hasher> constants;
+    // The copies and phis, whose roots are those of other values.
+    std::vector<ssa::ValueId> pending;
+    RegisterPair src;
+    for (ssa::ValueId v = 0; v < form.num_values(); ++v) {
+      const auto& def = form.definition(v);
+      if (def.kind == ssa::SSAForm::Definition::ENTRY) {
+        m_roots[v] = v;
+        continue;
       }
-      break;
-    case OPCODE_MOVE_RESULT:
-    case OPCODE_MOVE_RESULT_OBJECT:
-    case IOPCODE_MOVE_RESULT_PSEUDO:
-    case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
-      source.lower = Value::create_register(RESULT_REGISTER);
-      break;
-    case OPCODE_MOVE_RESULT_WIDE:
-    case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
-      if (m_config.wide_registers) {
-        source.lower = Value::create_register(RESULT_REGISTER);
-        source.upper = Value::create_register(RESULT_REGISTER + 1);
+      if (def.kind == ssa::SSAForm::Definition::PHI) {
+        pending.push_back(v);
+        continue;
       }
-      break;
-    case OPCODE_CONST:
-      if (m_config.eliminate_const_literals) {
-        source.lower = Value::create_literal(insn->get_literal());
+      auto first = form.def(def.insn);
+      if (v == first) {
+        src = get_src_value(def.insn, m_config);
       }
-      break;
-    case OPCODE_CONST_WIDE:
-      if (m_config.eliminate_const_literals && m_config.wide_registers) {
-        source.lower = Value::create_literal(insn->get_literal());
-        source.upper = Value::create_literal_upper(insn->get_literal());
+      const auto& half = v == first ? src.lower : src.upper;
+      if (half.is_none()) {
+        m_roots[v] = v;
+        continue;
       }
-      break;
-    case OPCODE_CONST_STRING: {
-      if (m_config.eliminate_const_strings) {
-        DexString* str = insn->get_string();
-        source.lower = Value{str};
+      m_tracked[v] = true;
+      if (half.is_register()) {
+        pending.push_back(v);
+      } else {
+        m_roots[v] = constants.emplace(half, v).first->second;
       }
-      break;
     }
-    case OPCODE_CONST_CLASS: {
-      if (m_config.eliminate_const_classes) {
-        DexType* type = insn->get_type();
-        source.lower = Value{type};
+
+    auto follow = [&](ssa::ValueId v) {
+      const auto& def = form.definition(v);
+      if (def.kind == ssa::SSAForm::Definition::INSN) {
+        return m_roots[form.uses(def.insn)[v - form.def(def.insn)]];
+      }
+      // Once a phi merges different roots, it stays a root of its own.
+      if (m_roots[v] == v) {
+        return v;
+      }
+      ssa::ValueId root = TOP;
+      for (const auto& operand : form.phi(v).operands) {
+        auto operand_root = m_roots[operand.second];
+        if (operand_root == TOP || operand.second == v) {
+          continue;
+        }
+        if (root != TOP && root != operand_root) {
+          return v;
+        }
+        root = operand_root;
+      }
+      return root;
+    };
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto v : pending) {
+        auto root = follow(v);
+        if (root != m_roots[v]) {
+          m_roots[v] = root;
+          changed = true;
+        }
+      }
+    }
+    for (auto v : pending) {
+      if (m_roots[v] == TOP) {
+        m_roots[v] = v;
       }
-      break;
     }
-    case OPCODE_SGET:
-    case OPCODE_SGET_WIDE:
-    case OPCODE_SGET_OBJECT:
-    case OPCODE_SGET_BOOLEAN:
-    case OPCODE_SGET_BYTE:
-    case OPCODE_SGET_CHAR:
-    case OPCODE_SGET_SHORT:
-      if (m_config.static_finals) {
-        DexField* field = resolve_field(insn->get_field(), FieldSearch::Static);
-        // non-final fields could have been written to since we last made an
-        // alias. Exclude them.
-        if (field != nullptr && is_final(field->get_access())) {
-          if (op != OPCODE_SGET_WIDE) {
-            source.lower = Value::create_field(field);
-          } else if (m_config.wide_registers) {
-            source.lower = Value::create_field(field);
-            source.upper = Value::create_field_upper(field);
+  }
+
+  void apply(const ssa::SSAForm& form,
+             std::unordered_set<IRInstruction*>* deletes) {
+    // The registers that may represent others (the result pair may not),
+    // grouped by the root of their values.
+    auto limit = form.result_register();
+    std::unordered_map<ssa::ValueId, std::set<Register>> holders;
+    // When the register of each value started holding its root, to prefer
+    // the oldest representative like AliasedRegisters does.
+    std::vector<uint32_t> since(form.num_values(), 0);
+    uint32_t clock = 0;
+
+    auto on_set = [&](Register reg, ssa::ValueId old, ssa::ValueId value) {
+      if (reg >= limit) {
+        return;
+      }
+      if (since[value] == 0) {
+        since[value] = old != ssa::NO_VALUE && m_roots[old] == m_roots[value]
+                           ? since[old]
+                           : ++clock;
+      }
+      if (m_config.replace_with_representative) {
+        if (old != ssa::NO_VALUE) {
+          holders[m_roots[old]].erase(reg);
+        }
+        holders[m_roots[value]].insert(reg);
+      }
+    };
+
+    auto on_insn = [&](cfg::Block*, const IRList::iterator& it,
+                       const std::vector<ssa::ValueId>& values) {
+      auto* insn = it->insn;
+      if (m_config.replace_with_representative &&
+          may_replace_sources(insn, m_range_set)) {
+        for (size_t i = 0; i < insn->srcs_size(); ++i) {
+          Register r = insn->src(i);
+          Register rep = r;
+          uint32_t oldest = std::numeric_limits<uint32_t>::max();
+          auto max_addressable = get_max_addressable(insn, i, m_config);
+          for (auto reg : holders[m_roots[values[r]]]) {
+            if (reg > max_addressable) {
+              break;
+            }
+            if (since[values[reg]] < oldest) {
+              rep = reg;
+              oldest = since[values[reg]];
+            }
+          }
+          if (rep == r) {
+            continue;
+          }
+          // Make sure the upper half of the wide pair is the same too.
+          if (insn->src_is_wide(i) &&
+              (rep + 1 >= limit ||
+               m_roots[values[rep + 1]] != m_roots[values[r + 1]])) {
+            continue;
           }
+          insn->set_src(i, rep);
+          m_stats.replaced_sources++;
         }
       }
-    default:
-      break;
-    }
 
-    return source;
-  }
+      // A copy or constant load is a no-op if its destination already holds
+      // the same thing.
+      auto first = form.def(insn);
+      if (first == ssa::NO_VALUE || !m_tracked[first] || !insn->dests_size()) {
+        return;
+      }
+      auto dest = insn->dest();
+      if (m_roots[values[dest]] != m_roots[first] ||
+          (insn->dest_is_wide() &&
+           (!m_tracked[first + 1] ||
+            m_roots[values[dest + 1]] != m_roots[first + 1]))) {
+        return;
+      }
+      if (opcode::is_move_result_pseudo(insn->opcode())) {
+        // WARNING: This assumes that the primary instruction of a
+        // move-result-pseudo has no side effects.
+        deletes->insert(ir_list::primary_instruction_of_move_result_pseudo(it));
+      } else {
+        deletes->insert(insn);
+      }
+    };
 
-  void analyze_node(cfg::Block* const& node,
-                    AliasDomain* current_state) const override {
-    current_state->update([&](AliasedRegisters& aliases) {
-      run_on_block(node, aliases, nullptr);
-    });
+    form.walk(on_insn, on_set);
   }
 
-  AliasDomain analyze_edge(
-      const EdgeId&, const AliasDomain& exit_state_at_source) const override {
-    return exit_state_at_source;
-  }
+  const CopyPropagationPass::Config& m_config;
+  const std::unordered_set<const IRInstruction*>& m_range_set;
+  Stats& m_stats;
+  std::vector<ssa::ValueId> m_roots;
+  // The values of the copies and constant loads.
+  std::vector<bool> m_tracked;
 };
 
 } // namespace
@@ -372,10 +579,12 @@ class AliasFixpointIterator final
 namespace copy_propagation_impl {
 
 Stats Stats::operator+(const Stats& other) {
-  return Stats{moves_eliminated + other.moves_eliminated,
+  Stats result{moves_eliminated + other.moves_eliminated,
                replaced_sources + other.replaced_sources,
                skipped_due_to_too_many_registers +
                    other.skipped_due_to_too_many_registers};
+  result.fixpoint_metrics = fixpoint_metrics + other.fixpoint_metrics;
+  return result;
 }
 
 Stats CopyPropagation::run(Scope scope) {
@@ -453,16 +662,22 @@ Stats CopyPropagation::run(IRCode* code, DexMethod* method) {
 
   std::unordered_set<IRInstruction*> deletes;
   code->build_cfg(/* editable */ false);
-  const auto& blocks = code->cfg().blocks();
-
-  AliasFixpointIterator fixpoint(code->cfg(), m_config, range_set, stats);
-
-  fixpoint.run(AliasDomain());
-  for (auto block : blocks) {
-    AliasDomain domain = fixpoint.get_entry_state_at(block);
-    domain.update([&fixpoint, block, &deletes](AliasedRegisters& aliases) {
-      fixpoint.run_on_block(block, aliases, &deletes);
-    });
+  if (m_config.ssa) {
+    SSACopyPropagation(m_config, range_set, stats).run(code->cfg(), &deletes);
+  } else {
+    const auto& blocks = code->cfg().blocks();
+
+    AliasFixpointIterator fixpoint(code->cfg(), m_config, range_set, stats);
+    fixpoint.set_iteration_budget(m_config.max_fixpoint_iterations);
+
+    fixpoint.run(AliasDomain());
+    stats.fixpoint_metrics.add(method, fixpoint.get_stats());
+    for (auto block : blocks) {
+      AliasDomain domain = fixpoint.get_entry_state_at(block);
+      domain.update([&fixpoint, block, &deletes](AliasedRegisters& aliases) {
+        fixpoint.run_on_block(block, aliases, &deletes);
+      });
+    }
   }
 
   stats.moves_eliminated += deletes.size();
@@ -497,6 +712,7 @@ void CopyPropagationPass::run_pass(DexStoresVector& stores,
                   stats.replaced_sources);
   mgr.incr_metric("methods_skipped_due_to_too_many_registers",
                   stats.skipped_due_to_too_many_registers);
+  stats.fixpoint_metrics.report("fixpoint", mgr);
   TRACE(RME,
         1,
         "%d redundant moves eliminated\n",
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "FixpointIterationMetrics.h"
 #include "Pass.h"
 
 class CopyPropagationPass : public Pass {
@@ -43,6 +44,14 @@ class CopyPropagationPass : public Pass {
     jw.get("static_finals", false, m_config.static_finals);
     jw.get("debug", false, m_config.debug);
     jw.get("max_estimated_registers", 3000, m_config.max_estimated_registers);
+    // Whether to work on the SSA form of the code rather than iterating alias
+    // graphs to a fixpoint. The max_fixpoint_iterations only applies to the
+    // latter.
+    jw.get("ssa", true, m_config.ssa);
+    // Loops that haven't stabilized after this many iterations are given up
+    // on (see MonotonicFixpointIterator::set_iteration_budget). 0 means no
+    // limit.
+    jw.get("max_fixpoint_iterations", 0, m_config.max_fixpoint_iterations);
   }
 
   struct Config {
@@ -53,10 +62,12 @@ class CopyPropagationPass : public Pass {
     bool wide_registers{true};
     bool static_finals{false};
     bool debug{false};
+    bool ssa{true};
 
     // this is set by PassManager, not by JsonWrapper
     bool regalloc_has_run{false};
     size_t max_estimated_registers{3000};
+    size_t max_fixpoint_iterations{0};
   } m_config;
 };
 
@@ -66,6 +77,7 @@ struct Stats {
   size_t moves_eliminated{0};
   size_t replaced_sources{0};
   size_t skipped_due_to_too_many_registers{0};
+  FixpointIterationMetrics fixpoint_metrics;
 
   Stats() = default;
   Stats(size_t elim, size_t replaced, size_t skipped)
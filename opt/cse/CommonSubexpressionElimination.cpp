@@ -87,8 +87,10 @@ namespace {
 constexpr const char* METRIC_RESULTS_CAPTURED = "num_results_captured";
 constexpr const char* METRIC_ELIMINATED_INSTRUCTIONS =
     "num_eliminated_instructions";
+constexpr const char* METRIC_BARRIER_FREE_METHODS = "num_barrier_free_methods";
+
+using namespace cse_impl;
 
-using value_id_t = uint32_t;
 enum ValueIdFlags : value_id_t {
   IS_PRE_STATE_SRC = 0x01,
   IS_BARRIER_SENSITIVE = 0x02,
@@ -102,43 +104,6 @@ using namespace ir_analyzer;
 // used to recover from merged / havoced values.
 const IROpcode IOPCODE_PRE_STATE_SRC = IROpcode(0xFFFF);
 
-struct IRValue {
-  IROpcode opcode;
-  std::vector<value_id_t> srcs;
-  union {
-    // Zero-initialize this union with the uint64_t member instead of a
-    // pointer-type member so that it works properly even on 32-bit machines
-    uint64_t literal{0};
-    const DexString* string;
-    const DexType* type;
-    const DexFieldRef* field;
-    const DexMethodRef* method;
-    const DexOpcodeData* data;
-
-    // By setting positional_insn to the pointer of an instruction, it
-    // effectively makes the "value" unique (as unique as the instruction),
-    // avoiding identifying otherwise structurally equivalent operations, e.g.
-    // two move-exception instructions that really must remain at their existing
-    // position, and cannot be replaced.
-    const IRInstruction* positional_insn;
-  };
-};
-
-struct IRValueHasher {
-  size_t operator()(const IRValue& tv) const {
-    size_t hash = tv.opcode;
-    for (auto src : tv.srcs) {
-      hash = hash * 27 + src;
-    }
-    hash = hash * 27 + (size_t)tv.literal;
-    return hash;
-  }
-};
-
-bool operator==(const IRValue& a, const IRValue& b) {
-  return a.opcode == b.opcode && a.srcs == b.srcs && a.literal == b.literal;
-}
-
 using IRInstructionDomain = sparta::ConstantAbstractDomain<IRInstruction*>;
 using ValueIdDomain = sparta::ConstantAbstractDomain<value_id_t>;
 using DefEnvironment =
@@ -480,48 +445,7 @@ class Analyzer final : public BaseIRAnalyzer<CseEnvironment> {
   }
 
   bool induces_barrier(const IRInstruction* insn) const {
-    switch (insn->opcode()) {
-    case OPCODE_MONITOR_ENTER:
-    case OPCODE_MONITOR_EXIT:
-    case OPCODE_FILL_ARRAY_DATA:
-    case OPCODE_APUT:
-    case OPCODE_APUT_WIDE:
-    case OPCODE_APUT_OBJECT:
-    case OPCODE_APUT_BOOLEAN:
-    case OPCODE_APUT_BYTE:
-    case OPCODE_APUT_CHAR:
-    case OPCODE_APUT_SHORT:
-    case OPCODE_IPUT:
-    case OPCODE_IPUT_WIDE:
-    case OPCODE_IPUT_OBJECT:
-    case OPCODE_IPUT_BOOLEAN:
-    case OPCODE_IPUT_BYTE:
-    case OPCODE_IPUT_CHAR:
-    case OPCODE_IPUT_SHORT:
-    case OPCODE_SPUT:
-    case OPCODE_SPUT_WIDE:
-    case OPCODE_SPUT_OBJECT:
-    case OPCODE_SPUT_BOOLEAN:
-    case OPCODE_SPUT_BYTE:
-    case OPCODE_SPUT_CHAR:
-    case OPCODE_SPUT_SHORT:
-      return true;
-    case OPCODE_INVOKE_VIRTUAL:
-    case OPCODE_INVOKE_SUPER:
-    case OPCODE_INVOKE_DIRECT:
-    case OPCODE_INVOKE_STATIC:
-    case OPCODE_INVOKE_INTERFACE:
-      return m_shared_state->is_invoke_a_barrier(insn);
-    default:
-      if (insn->has_field()) {
-        auto field_ref = insn->get_field();
-        DexField* field = resolve_field(field_ref, is_sfield_op(insn->opcode())
-                                                       ? FieldSearch::Static
-                                                       : FieldSearch::Instance);
-        return field == nullptr || is_volatile(field);
-      }
-      return false;
-    }
+    return m_shared_state->is_barrier(insn);
   }
 
   CommonSubexpressionElimination::SharedState* m_shared_state;
@@ -715,8 +639,153 @@ CommonSubexpressionElimination::SharedState::SharedState() {
   }
 }
 
+namespace {
+
+// Returns the method that the invocation will run, if it is known statically.
+const DexMethod* get_invoke_target(const IRInstruction* insn) {
+  auto method_ref = insn->get_method();
+  switch (insn->opcode()) {
+  case OPCODE_INVOKE_STATIC:
+    return resolve_method(method_ref, MethodSearch::Static);
+  case OPCODE_INVOKE_DIRECT:
+    return resolve_method(method_ref, MethodSearch::Direct);
+  case OPCODE_INVOKE_VIRTUAL: {
+    auto callee = resolve_method(method_ref, MethodSearch::Virtual);
+    if (callee == nullptr || callee->is_external()) {
+      return nullptr;
+    }
+    auto cls = type_class(method_ref->get_class());
+    if (is_final(callee) || (cls != nullptr && is_final(cls))) {
+      return callee;
+    }
+    return nullptr;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+// Whether the code of `method` is all that runs when it is invoked. A static
+// method may also trigger the static initializer of its class.
+bool may_be_barrier_free(const DexMethod* method) {
+  if (method->get_code() == nullptr || is_native(method) ||
+      is_synchronized(method)) {
+    return false;
+  }
+  if (is_static(method)) {
+    auto cls = type_class(method->get_class());
+    return cls != nullptr && cls->get_clinit() == nullptr;
+  }
+  return true;
+}
+
+} // namespace
+
+void CommonSubexpressionElimination::SharedState::init_scope(
+    const Scope& scope) {
+  // First find the methods that have no barriers other than invocations of
+  // other methods in scope, and what those are.
+  ConcurrentMap<const DexMethod*, std::vector<const DexMethod*>> callees;
+  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
+    if (!may_be_barrier_free(method)) {
+      return;
+    }
+    std::vector<const DexMethod*> method_callees;
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (!is_barrier(insn)) {
+        continue;
+      }
+      auto callee =
+          is_invoke(insn->opcode()) ? get_invoke_target(insn) : nullptr;
+      if (callee == nullptr) {
+        return;
+      }
+      method_callees.push_back(callee);
+    }
+    callees.emplace(method, std::move(method_callees));
+  });
+
+  // Then drop the methods that invoke one which isn't barrier-free, until
+  // nothing changes. What remains may invoke each other recursively.
+  std::unordered_set<const DexMethod*> barrier_free;
+  std::unordered_map<const DexMethod*, std::vector<const DexMethod*>> callers;
+  std::vector<const DexMethod*> worklist;
+  for (const auto& p : callees) {
+    barrier_free.insert(p.first);
+  }
+  for (const auto& p : callees) {
+    for (auto callee : p.second) {
+      callers[callee].push_back(p.first);
+      if (!barrier_free.count(callee)) {
+        worklist.push_back(p.first);
+      }
+    }
+  }
+  while (!worklist.empty()) {
+    auto method = worklist.back();
+    worklist.pop_back();
+    if (!barrier_free.erase(method)) {
+      continue;
+    }
+    auto it = callers.find(method);
+    if (it != callers.end()) {
+      worklist.insert(worklist.end(), it->second.begin(), it->second.end());
+    }
+  }
+  m_barrier_free_methods = std::move(barrier_free);
+  TRACE(CSE, 1, "[CSE] %zu barrier-free methods\n",
+        m_barrier_free_methods.size());
+}
+
+bool CommonSubexpressionElimination::SharedState::is_barrier(
+    const IRInstruction* insn) const {
+  switch (insn->opcode()) {
+  case OPCODE_MONITOR_ENTER:
+  case OPCODE_MONITOR_EXIT:
+  case OPCODE_FILL_ARRAY_DATA:
+  case OPCODE_APUT:
+  case OPCODE_APUT_WIDE:
+  case OPCODE_APUT_OBJECT:
+  case OPCODE_APUT_BOOLEAN:
+  case OPCODE_APUT_BYTE:
+  case OPCODE_APUT_CHAR:
+  case OPCODE_APUT_SHORT:
+  case OPCODE_IPUT:
+  case OPCODE_IPUT_WIDE:
+  case OPCODE_IPUT_OBJECT:
+  case OPCODE_IPUT_BOOLEAN:
+  case OPCODE_IPUT_BYTE:
+  case OPCODE_IPUT_CHAR:
+  case OPCODE_IPUT_SHORT:
+  case OPCODE_SPUT:
+  case OPCODE_SPUT_WIDE:
+  case OPCODE_SPUT_OBJECT:
+  case OPCODE_SPUT_BOOLEAN:
+  case OPCODE_SPUT_BYTE:
+  case OPCODE_SPUT_CHAR:
+  case OPCODE_SPUT_SHORT:
+    return true;
+  case OPCODE_INVOKE_VIRTUAL:
+  case OPCODE_INVOKE_SUPER:
+  case OPCODE_INVOKE_DIRECT:
+  case OPCODE_INVOKE_STATIC:
+  case OPCODE_INVOKE_INTERFACE:
+    return is_invoke_a_barrier(insn);
+  default:
+    if (insn->has_field()) {
+      auto field_ref = insn->get_field();
+      DexField* field = resolve_field(field_ref, is_sfield_op(insn->opcode())
+                                                     ? FieldSearch::Static
+                                                     : FieldSearch::Instance);
+      return field == nullptr || is_volatile(field);
+    }
+    return false;
+  }
+}
+
 bool CommonSubexpressionElimination::SharedState::is_invoke_a_barrier(
-    const IRInstruction* insn) {
+    const IRInstruction* insn) const {
   always_assert(is_invoke(insn->opcode()));
   auto method_ref = insn->get_method();
   auto opcode = insn->opcode();
@@ -729,6 +798,12 @@ bool CommonSubexpressionElimination::SharedState::is_invoke_a_barrier(
       m_safe_methods.count(method_ref)) {
     return false;
   }
+  if (!m_barrier_free_methods.empty()) {
+    auto callee = get_invoke_target(insn);
+    if (callee != nullptr && m_barrier_free_methods.count(callee)) {
+      return false;
+    }
+  }
   return true;
 }
 
@@ -906,6 +981,7 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
                                                   PassManager& mgr) {
   const auto scope = build_class_scope(stores);
   auto shared_state = CommonSubexpressionElimination::SharedState();
+  shared_state.init_scope(scope);
 
   const auto stats =
       walk::parallel::reduce_methods<CommonSubexpressionElimination::Stats>(
@@ -952,6 +1028,8 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_RESULTS_CAPTURED, stats.results_captured);
   mgr.incr_metric(METRIC_ELIMINATED_INSTRUCTIONS,
                   stats.instructions_eliminated);
+  mgr.incr_metric(METRIC_BARRIER_FREE_METHODS,
+                  shared_state.barrier_free_methods());
 
   shared_state.cleanup();
 }
@@ -11,6 +11,49 @@
 #include "Pass.h"
 #include "PassManager.h"
 
+namespace cse_impl {
+
+using value_id_t = uint32_t;
+
+struct IRValue {
+  IROpcode opcode;
+  std::vector<value_id_t> srcs;
+  union {
+    // Zero-initialize this union with the uint64_t member instead of a
+    // pointer-type member so that it works properly even on 32-bit machines
+    uint64_t literal{0};
+    const DexString* string;
+    const DexType* type;
+    const DexFieldRef* field;
+    const DexMethodRef* method;
+    const DexOpcodeData* data;
+
+    // By setting positional_insn to the pointer of an instruction, it
+    // effectively makes the "value" unique (as unique as the instruction),
+    // avoiding identifying otherwise structurally equivalent operations, e.g.
+    // two move-exception instructions that really must remain at their existing
+    // position, and cannot be replaced.
+    const IRInstruction* positional_insn;
+  };
+};
+
+struct IRValueHasher {
+  size_t operator()(const IRValue& tv) const {
+    size_t hash = tv.opcode;
+    for (auto src : tv.srcs) {
+      hash = hash * 27 + src;
+    }
+    hash = hash * 27 + (size_t)tv.literal;
+    return hash;
+  }
+};
+
+inline bool operator==(const IRValue& a, const IRValue& b) {
+  return a.opcode == b.opcode && a.srcs == b.srcs && a.literal == b.literal;
+}
+
+} // namespace cse_impl
+
 class CommonSubexpressionElimination {
  public:
   struct Stats {
@@ -36,13 +79,27 @@ class CommonSubexpressionElimination {
   class SharedState {
    public:
     SharedState();
-    bool is_invoke_a_barrier(const IRInstruction* insn);
+
+    /*
+     * Finds the methods in scope that don't contain any barrier, not even
+     * transitively through the methods they invoke. Invoking them is then
+     * not a barrier either. Must be called before the state is shared.
+     */
+    void init_scope(const Scope& scope);
+
+    bool is_barrier(const IRInstruction* insn) const;
+    bool is_invoke_a_barrier(const IRInstruction* insn) const;
     void log_barrier(const Barrier& barrier);
     void cleanup();
 
+    size_t barrier_free_methods() const {
+      return m_barrier_free_methods.size();
+    }
+
    private:
     std::unordered_set<DexMethodRef*> m_safe_methods;
     std::unordered_set<DexType*> m_safe_types;
+    std::unordered_set<const DexMethod*> m_barrier_free_methods;
     std::unique_ptr<ConcurrentMap<Barrier, size_t, BarrierHasher>> m_barriers;
   };
 
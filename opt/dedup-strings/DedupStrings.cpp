@@ -7,6 +7,7 @@
 
 #include "DedupStrings.h"
 
+#include <atomic>
 #include <vector>
 
 #include "ConcurrentContainers.h"
@@ -16,6 +17,7 @@
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 #include "locator.h"
 
 namespace {
@@ -38,6 +40,10 @@ constexpr const char* METRIC_DEXES_WITHOUT_HOST = "num_dexes_without_host";
 constexpr const char* METRIC_EXCLUDED_DUPLICATE_NON_LOAD_STRINGS =
     "num_excluded_duplicate_non_load_strings";
 constexpr const char* METRIC_FACTORY_METHODS = "num_factory_methods";
+constexpr const char* METRIC_REWRITTEN_STRING_LOADS =
+    "num_rewritten_string_loads";
+constexpr const char* METRIC_REWRITTEN_WEIGHTED_STRING_LOADS =
+    "num_rewritten_weighted_string_loads";
 
 } // namespace
 
@@ -58,10 +64,13 @@ void DedupStrings::run(DexStoresVector& stores) {
 
   // Compute set of non-load strings in each dex
   std::unordered_set<const DexString*> non_load_strings[dexen.size()];
+  auto wq = workqueue_foreach<size_t>([&](size_t dexnr) {
+    gather_non_load_strings(dexen[dexnr], &non_load_strings[dexnr]);
+  });
   for (size_t i = 0; i < dexen.size(); i++) {
-    auto& strings = non_load_strings[i];
-    gather_non_load_strings(dexen[i], &strings);
+    wq.add_item(i);
   }
+  wq.run_all();
 
   // For each string, figure out how many times it's loaded per dex
   ConcurrentMap<DexString*, std::unordered_map<size_t, size_t>> occurrences =
@@ -244,22 +253,29 @@ DedupStrings::get_occurrences(
               &perf_sensitive_methods](DexMethod* method, IRCode& code) {
         const auto dexnr = methods_to_dex.at(method);
         const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
+        // Count locally first, so that the shared maps are only updated once
+        // per string of the method.
+        std::unordered_map<DexString*, size_t> loads;
         for (auto& mie : InstructionIterable(code)) {
           const auto insn = mie.insn;
           if (insn->opcode() == OPCODE_CONST_STRING) {
-            const auto str = insn->get_string();
-            if (perf_sensitive) {
-              perf_sensitive_strings.update(
-                  str,
-                  [dexnr](const DexString*,
-                          std::unordered_set<size_t>& s,
-                          bool /* exists */) { s.emplace(dexnr); });
-            } else {
-              occurrences.update(str,
-                                 [dexnr](const DexString*,
-                                         std::unordered_map<size_t, size_t>& m,
-                                         bool /* exists */) { ++m[dexnr]; });
-            }
+            ++loads[insn->get_string()];
+          }
+        }
+        for (const auto& p : loads) {
+          const auto count = p.second;
+          if (perf_sensitive) {
+            perf_sensitive_strings.update(
+                p.first,
+                [dexnr](const DexString*,
+                        std::unordered_set<size_t>& s,
+                        bool /* exists */) { s.emplace(dexnr); });
+          } else {
+            occurrences.update(
+                p.first,
+                [dexnr, count](const DexString*,
+                               std::unordered_map<size_t, size_t>& m,
+                               bool /* exists */) { m[dexnr] += count; });
           }
         }
       });
@@ -516,9 +532,13 @@ void DedupStrings::rewrite_const_string_instructions(
     const std::unordered_map<DexString*, DedupStrings::DedupStringInfo>&
         strings_to_dedup) {
 
+  std::atomic<size_t> rewritten_string_loads{0};
+  std::atomic<size_t> rewritten_weighted_string_loads{0};
   walk::parallel::code(
-      scope, [&methods_to_dex, &strings_to_dedup,
-              &perf_sensitive_methods](DexMethod* method, IRCode& code) {
+      scope, [this, &methods_to_dex, &strings_to_dedup, &perf_sensitive_methods,
+              &rewritten_string_loads,
+              &rewritten_weighted_string_loads](DexMethod* method,
+                                                IRCode& code) {
         if (perf_sensitive_methods.count(method) != 0) {
           // We don't rewrite methods in the primary dex or other perf-sensitive
           // methods.
@@ -530,7 +550,7 @@ void DedupStrings::rewrite_const_string_instructions(
         // First, we collect all const-string instructions that we want to
         // rewrite
         const auto ii = InstructionIterable(code);
-        std::vector<std::pair<IRInstruction*, uint16_t>> const_strings;
+        std::vector<std::pair<IRList::iterator, uint16_t>> const_strings;
         for (auto it = ii.begin(); it != ii.end(); it++) {
           // do we have a sequence of const-string + move-pseudo-result
           // instruction?
@@ -540,7 +560,7 @@ void DedupStrings::rewrite_const_string_instructions(
           }
           auto move_result_pseudo = ir_list::move_result_pseudo_of(it.unwrap());
 
-          const_strings.push_back({insn, move_result_pseudo->dest()});
+          const_strings.push_back({it.unwrap(), move_result_pseudo->dest()});
         }
 
         // Second, we actually rewrite them.
@@ -558,8 +578,9 @@ void DedupStrings::rewrite_const_string_instructions(
         // in catch blocks, if any.
 
         boost::optional<uint32_t> temp_reg;
+        size_t rewritten = 0;
         for (const auto& p : const_strings) {
-          const auto const_string = p.first;
+          const auto const_string = p.first->insn;
           const auto reg = p.second;
 
           const auto it = strings_to_dedup.find(const_string->get_string());
@@ -574,28 +595,37 @@ void DedupStrings::rewrite_const_string_instructions(
           if (!temp_reg) {
             temp_reg = boost::optional<uint32_t>(code.allocate_temp());
           }
-          std::vector<IRInstruction*> replacements;
-
           IRInstruction* const_inst = new IRInstruction(OPCODE_CONST);
           const_inst->set_dest(*temp_reg)->set_literal(info.index);
-          replacements.push_back(const_inst);
+          code.insert_before(p.first, const_inst);
 
           IRInstruction* invoke_inst = new IRInstruction(OPCODE_INVOKE_STATIC);
           always_assert(info.const_string_method != nullptr);
           invoke_inst->set_method(info.const_string_method)
               ->set_arg_word_count(1)
               ->set_src(0, *temp_reg);
-          replacements.push_back(invoke_inst);
+          code.insert_before(p.first, invoke_inst);
 
           IRInstruction* move_result_inst =
               new IRInstruction(OPCODE_MOVE_RESULT_OBJECT);
           move_result_inst->set_dest(reg);
-          replacements.push_back(move_result_inst);
+          code.insert_before(p.first, move_result_inst);
 
-          // TODO: replace_opcode takes linear time!
-          code.replace_opcode(const_string, replacements);
+          code.remove_opcode(p.first);
+          ++rewritten;
+        }
+
+        if (rewritten > 0) {
+          rewritten_string_loads += rewritten;
+          // Methods in the profile run at startup, where each rewritten load
+          // costs an extra invoke.
+          if (get_method_weight_if_available(method, &m_method_to_weight)) {
+            rewritten_weighted_string_loads += rewritten;
+          }
         }
       });
+  m_stats.rewritten_string_loads = rewritten_string_loads;
+  m_stats.rewritten_weighted_string_loads = rewritten_weighted_string_loads;
 }
 
 class DedupStringsInterDexPlugin : public interdex::InterDexPassPlugin {
@@ -673,6 +703,9 @@ void DedupStringsPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_EXCLUDED_DUPLICATE_NON_LOAD_STRINGS,
                   stats.excluded_duplicate_non_load_strings);
   mgr.incr_metric(METRIC_FACTORY_METHODS, stats.factory_methods);
+  mgr.incr_metric(METRIC_REWRITTEN_STRING_LOADS, stats.rewritten_string_loads);
+  mgr.incr_metric(METRIC_REWRITTEN_WEIGHTED_STRING_LOADS,
+                  stats.rewritten_weighted_string_loads);
   TRACE(DS, 1,
         "[dedup strings] duplicate strings: %u, size: %u, loads: %u; "
         "expected size reduction: %u; "
@@ -682,6 +715,10 @@ void DedupStringsPass::run_pass(DexStoresVector& stores,
         stats.duplicate_string_loads, stats.expected_size_reduction,
         stats.dexes_without_host_cls, stats.excluded_duplicate_non_load_strings,
         stats.factory_methods);
+  TRACE(DS, 1,
+        "[dedup strings] rewritten string loads: %u, of which in methods "
+        "with weight: %u\n",
+        stats.rewritten_string_loads, stats.rewritten_weighted_string_loads);
 }
 
 static DedupStringsPass s_pass;
@@ -25,6 +25,12 @@ class DedupStrings {
     size_t expected_size_reduction{0};
     size_t dexes_without_host_cls{0};
     size_t factory_methods{0};
+    // The const-string instructions that became invokes of a factory method,
+    // and those of them in methods that have a weight in the method profile,
+    // i.e. the extra invokes that run at startup. Compare against
+    // expected_size_reduction to tune the cost model.
+    size_t rewritten_string_loads{0};
+    size_t rewritten_weighted_string_loads{0};
   };
 
   DedupStrings(
@@ -7,9 +7,12 @@
 
 #include "DedupBlocksPass.h"
 
+#include <algorithm>
 #include <atomic>
+#include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 #include <iterator>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
@@ -109,11 +112,29 @@ struct BlocksInSameGroup {
   }
 };
 
+// Independent of the order of the successor edges, like same_successors().
+hash_t hash_successors(const cfg::Block* b) {
+  hash_t result = 0;
+  for (const cfg::Edge* e : b->succs()) {
+    hash_t edge_hash = e->target()->id();
+    boost::hash_combine(edge_hash, static_cast<int>(e->type()));
+    if (e->case_key()) {
+      boost::hash_combine(edge_hash, *e->case_key());
+    }
+    result += edge_hash;
+  }
+  boost::hash_combine(result, b->is_catch());
+  return result;
+}
+
+// Blocks only land in the same bucket when their instructions, in order, and
+// their successors agree, so that the buckets of methods with many similar
+// blocks stay small.
 struct BlockHasher {
   hash_t operator()(cfg::Block* b) const {
-    hash_t result = 0;
+    hash_t result = hash_successors(b);
     for (auto& mie : InstructionIterable(b)) {
-      result ^= mie.insn->hash();
+      boost::hash_combine(result, mie.insn->hash());
     }
     return result;
   }
@@ -127,13 +148,7 @@ struct BlockCompare {
 };
 
 struct BlockSuccHasher {
-  hash_t operator()(cfg::Block* b) const {
-    hash_t result = 0;
-    for (const auto& succ : b->succs()) {
-      result ^= succ->target()->id();
-    }
-    return result;
-  }
+  hash_t operator()(cfg::Block* b) const { return hash_successors(b); }
 };
 
 struct InstructionHasher {
@@ -207,7 +222,9 @@ class DedupBlocksImpl {
         return;
       }
 
-      code.build_cfg(/* editable */ true);
+      if (!code.editable_cfg_built()) {
+        code.build_cfg(/* editable */ true);
+      }
       auto& cfg = code.cfg();
 
       if (m_config.split_postfix) {
@@ -221,8 +238,13 @@ class DedupBlocksImpl {
 
       dedup(cfg);
 
-      code.clear_cfg();
+      if (m_config.report_cross_method_duplicates) {
+        fingerprint_blocks(method, cfg);
+      }
     });
+    if (m_config.report_cross_method_duplicates) {
+      report_cross_method_duplicates();
+    }
     report_stats();
   }
 
@@ -252,6 +274,10 @@ class DedupBlocksImpl {
   const char* METRIC_BLOCKS_REMOVED = "blocks_removed";
   const char* METRIC_BLOCKS_SPLIT = "blocks_split";
   const char* METRIC_ELIGIBLE_BLOCKS = "eligible_blocks";
+  const char* METRIC_CROSS_METHOD_DUPLICATE_BLOCKS =
+      "cross_method_duplicate_blocks";
+  const char* METRIC_CROSS_METHOD_DUPLICATE_INSNS =
+      "cross_method_duplicate_insns";
   const std::vector<DexClass*>& m_scope;
   PassManager& m_mgr;
   const DedupBlocksPass::Config& m_config;
@@ -262,8 +288,118 @@ class DedupBlocksImpl {
 
   // map from block size to number of blocks with that size
   std::unordered_map<size_t, size_t> m_dup_sizes;
+  // The blocks of all methods, by the hash of their register-normalized code
+  std::unordered_map<hash_t,
+                     std::vector<std::pair<const DexMethod*, cfg::Block*>>>
+      m_fingerprints;
   std::mutex lock;
 
+  using NormalizedInsns = std::vector<std::unique_ptr<IRInstruction>>;
+
+  // Copies of the instructions of `block`, without the branch, return or
+  // throw that ends it, whose registers are numbered in order of first use.
+  // Blocks of different methods often only differ in their register
+  // allocation.
+  static NormalizedInsns normalize_registers(cfg::Block* block) {
+    NormalizedInsns insns;
+    std::unordered_map<uint16_t, uint16_t> regs;
+    auto normalize = [&regs](uint16_t reg) {
+      return regs.emplace(reg, regs.size()).first->second;
+    };
+    for (auto& mie : InstructionIterable(block)) {
+      auto op = mie.insn->opcode();
+      if (is_branch(op) || is_return(op) || is_throw(op)) {
+        break;
+      }
+      auto insn = std::make_unique<IRInstruction>(*mie.insn);
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        insn->set_src(i, normalize(insn->src(i)));
+      }
+      if (insn->dests_size()) {
+        insn->set_dest(normalize(insn->dest()));
+      }
+      insns.push_back(std::move(insn));
+    }
+    return insns;
+  }
+
+  static bool same_normalized_code(const NormalizedInsns& a,
+                                   const NormalizedInsns& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(),
+                      [](const std::unique_ptr<IRInstruction>& x,
+                         const std::unique_ptr<IRInstruction>& y) {
+                        return *x == *y;
+                      });
+  }
+
+  void fingerprint_blocks(const DexMethod* method,
+                          const cfg::ControlFlowGraph& cfg) {
+    std::vector<std::pair<hash_t, cfg::Block*>> fingerprints;
+    for (cfg::Block* block : cfg.blocks()) {
+      if (!is_eligible(block, /* has_new_instance */ false)) {
+        continue;
+      }
+      auto insns = normalize_registers(block);
+      if (insns.size() < m_config.block_split_min_opcode_count) {
+        continue;
+      }
+      hash_t hash = 0;
+      for (const auto& insn : insns) {
+        boost::hash_combine(hash, insn->hash());
+      }
+      fingerprints.emplace_back(hash, block);
+    }
+    std::lock_guard<std::mutex> guard{lock};
+    for (const auto& pair : fingerprints) {
+      m_fingerprints[pair.first].emplace_back(method, pair.second);
+    }
+  }
+
+  // Counts the blocks that have the same code as a block of another method,
+  // but for one of each group, and their instructions. This only reports
+  // what could be shared: moving them into methods of their own is the
+  // outliner's business, which also weighs the cost of the invokes.
+  void report_cross_method_duplicates() {
+    size_t dup_blocks = 0;
+    size_t dup_insns = 0;
+    for (const auto& bucket : m_fingerprints) {
+      const auto& blocks = bucket.second;
+      if (blocks.size() <= 1) {
+        continue;
+      }
+      // The classes of blocks with the same code within the bucket.
+      std::vector<NormalizedInsns> codes;
+      std::vector<std::unordered_set<const DexMethod*>> methods;
+      std::vector<size_t> sizes;
+      for (const auto& pair : blocks) {
+        auto insns = normalize_registers(pair.second);
+        size_t i = 0;
+        while (i < codes.size() && !same_normalized_code(codes[i], insns)) {
+          ++i;
+        }
+        if (i == codes.size()) {
+          codes.push_back(std::move(insns));
+          methods.emplace_back();
+          sizes.push_back(0);
+        }
+        methods[i].insert(pair.first);
+        ++sizes[i];
+      }
+      for (size_t i = 0; i < codes.size(); ++i) {
+        if (methods[i].size() > 1) {
+          dup_blocks += sizes[i] - 1;
+          dup_insns += (sizes[i] - 1) * codes[i].size();
+        }
+      }
+    }
+    m_mgr.incr_metric(METRIC_CROSS_METHOD_DUPLICATE_BLOCKS, dup_blocks);
+    m_mgr.incr_metric(METRIC_CROSS_METHOD_DUPLICATE_INSNS, dup_insns);
+    TRACE(DEDUP_BLOCKS, 1,
+          "%d blocks with %d instructions duplicate other methods' blocks\n",
+          dup_blocks, dup_insns);
+  }
+
   // Find blocks with the same exact code
   Duplicates collect_duplicates(const cfg::ControlFlowGraph& cfg) {
     const auto& blocks = cfg.blocks();
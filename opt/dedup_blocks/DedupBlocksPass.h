@@ -15,6 +15,8 @@ class DedupBlocksPass : public Pass {
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  bool is_cfg_aware() const override { return true; }
+
   void configure_pass(const JsonWrapper& jw) override {
     std::vector<std::string> method_black_list_names;
     jw.get("method_black_list", {}, method_black_list_names);
@@ -27,6 +29,10 @@ class DedupBlocksPass : public Pass {
            Config::DEFAULT_BLOCK_SPLIT_MIN_OPCODE_COUNT,
            m_config.block_split_min_opcode_count);
     jw.get("split_postfix", true, m_config.split_postfix);
+    // Reports how many blocks have the same code, up to the numbering of
+    // their registers, as blocks of other methods.
+    jw.get("report_cross_method_duplicates", false,
+           m_config.report_cross_method_duplicates);
   }
 
   struct Config {
@@ -34,5 +40,6 @@ class DedupBlocksPass : public Pass {
     static const size_t DEFAULT_BLOCK_SPLIT_MIN_OPCODE_COUNT = 3;
     size_t block_split_min_opcode_count = DEFAULT_BLOCK_SPLIT_MIN_OPCODE_COUNT;
     bool split_postfix = true;
+    bool report_cross_method_duplicates = false;
   } m_config;
 };
@@ -143,10 +143,18 @@ Scope reverse_tsort_by_init_deps(const Scope& scope) {
   return result;
 }
 
+/*
+ * The arrays that a <clinit> builds are tracked until they escape, so that the
+ * values read from them, like their lengths, can be encoded too. Storing an
+ * array into a static field of the class under initialization doesn't make it
+ * escape, but invoking anything does.
+ */
 using CombinedAnalyzer =
     InstructionAnalyzerCombiner<cp::ClinitFieldAnalyzer,
                                 cp::WholeProgramAwareAnalyzer,
                                 cp::StringAnalyzer,
+                                cp::LocalArrayAnalyzer,
+                                cp::HeapEscapeAnalyzer,
                                 cp::PrimitiveAnalyzer>;
 
 using CombinedInitAnalyzer =
@@ -215,6 +223,21 @@ void encode_values(DexClass* cls, FieldEnvironment field_env) {
   }
 }
 
+/*
+ * The static fields of `cls` in `env`, save for the arrays that <clinit> left
+ * in them: other methods don't have them on their heap.
+ */
+FieldEnvironment without_heap_pointers(const DexClass* cls,
+                                       const ConstantEnvironment& env) {
+  auto field_env = env.get_field_environment();
+  for (auto* field : cls->get_sfields()) {
+    if (field_env.get(field).maybe_get<AbstractHeapPointer>()) {
+      field_env.set(field, ConstantValue::top());
+    }
+  }
+  return field_env;
+}
+
 } // namespace
 
 namespace final_inline {
@@ -238,7 +261,8 @@ cp::WholeProgramState analyze_and_simplify_clinits(const Scope& scope) {
       auto& cfg = code->cfg();
       cfg.calculate_exit_block();
       cp::intraprocedural::FixpointIterator intra_cp(
-          cfg, CombinedAnalyzer(cls->get_type(), &wps, nullptr, nullptr));
+          cfg, CombinedAnalyzer(cls->get_type(), &wps, nullptr, nullptr,
+                                nullptr, nullptr));
       intra_cp.run(env);
       env = intra_cp.get_exit_state_at(cfg.exit_block());
 
@@ -260,7 +284,7 @@ cp::WholeProgramState analyze_and_simplify_clinits(const Scope& scope) {
         cls->remove_method(clinit);
       }
     }
-    wps.collect_static_finals(cls, env.get_field_environment());
+    wps.collect_static_finals(cls, without_heap_pointers(cls, env));
   }
   return wps;
 }
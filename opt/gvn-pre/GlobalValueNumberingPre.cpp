@@ -0,0 +1,1125 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * This optimizer pass eliminates fully and partially redundant computations
+ * with GVN-PRE, the value-based partial redundancy elimination of VanDrunen
+ * and Hosking, on the SSA form of the control flow graph.
+ *
+ * Value numbering: every SSA value gets a number. Arithmetic and reads of
+ * fields and arrays are numbered by CSE's IRValue of their opcode, payload
+ * and the numbers of their operands, so that the same computation on the
+ * same values gets the same number wherever it happens. Moves take the
+ * number of their source. Everything else, like the phis, is a leaf with a
+ * number of its own. Reads of the heap also take the state of the heap as
+ * an operand, which is numbered like a value: a barrier, as defined by the
+ * shared state of CSE, starts a new state, and a join of paths in different
+ * states merges them in a new state. Final fields outside of constructors
+ * and array lengths can't change, so their reads don't depend on the state.
+ *
+ * Anticipation: the values each block is sure to compute before the code
+ * leaves it or changes their operands are found backwards from the exits,
+ * translating the values through the phis of the joins: on the edge from a
+ * predecessor, a value computed from a phi is the same computation on the
+ * operand of the phi for that predecessor.
+ *
+ * Insertion: at a join where an anticipated value is available on some of
+ * the edges into it, but not on the others, it is computed on the others,
+ * which makes it available at the join. That's how a computation in a loop
+ * that doesn't depend on the iteration moves into the loop's preheader, and
+ * how a computation after an if that one of its branches already does moves
+ * into the other branch. Only computations that can't throw are inserted:
+ * arithmetic that can't throw, reads of static fields of the method's own
+ * class, which is already initialized, and reads of instance fields of
+ * `this`.
+ *
+ * Elimination: a computation whose value is available, because an earlier
+ * computation that dominates it or the merge at a join computed it, is
+ * replaced by a move from a temp register. Each value that is needed gets a
+ * temp, which every computation of the value, and the edges into the joins
+ * where it merges, write as well. Reads that may throw are eliminated too,
+ * as a read of the same value before didn't throw.
+ *
+ * The moves are usually eliminated by copy-propagation, and local dce removes
+ * what becomes dead; both run on a method's code immediately if anything
+ * changed.
+ *
+ * Notes:
+ * - Reads that may throw are never inserted. A loop that starts with one is
+ *   left to LoopInvariantCodeMotionPass.
+ * - The temps of the merged values are live from the edges into the join to
+ *   their last use, so this may increase register pressure.
+ * - The anticipated values are found in a bounded number of rounds. Cutting
+ *   it short only makes an insertion happen where not every path needs it,
+ *   which is safe for computations that can't throw.
+ */
+
+#include "GlobalValueNumberingPre.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/optional.hpp>
+
+#include "CopyPropagationPass.h"
+#include "DexClass.h"
+#include "Dominators.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "LocalDce.h"
+#include "Resolver.h"
+#include "SSA.h"
+#include "Walkers.h"
+
+using namespace cse_impl;
+
+namespace {
+
+constexpr const char* METRIC_INSTRUCTIONS_ELIMINATED =
+    "num_instructions_eliminated";
+constexpr const char* METRIC_INSTRUCTIONS_INSERTED =
+    "num_instructions_inserted";
+constexpr const char* METRIC_VALUES_MERGED = "num_values_merged";
+
+constexpr value_id_t NO_NUMBER = std::numeric_limits<value_id_t>::max();
+
+constexpr size_t MAX_ANTICIPATION_ROUNDS = 16;
+
+bool is_pure_arithmetic(IROpcode op) {
+  return ((op >= OPCODE_CMPL_FLOAT && op <= OPCODE_CMP_LONG) ||
+          (op >= OPCODE_NEG_INT && op <= OPCODE_USHR_INT_LIT8)) &&
+         !opcode::may_throw(op);
+}
+
+// Orders the operands of a commutative operation, each of which is one
+// number, or two for a wide one.
+void sort_operands(IRValue* value) {
+  auto& srcs = value->srcs;
+  if (!opcode::is_commutative(value->opcode) || srcs.size() % 2 != 0) {
+    return;
+  }
+  auto half = srcs.begin() + srcs.size() / 2;
+  if (*half < srcs[0]) {
+    std::swap_ranges(srcs.begin(), half, half);
+  }
+}
+
+enum Traits : uint8_t {
+  NOT_NUMBERED = 0,
+  NUMBERED = 1 << 0,
+  // Reads memory that a barrier may write.
+  READS_HEAP = 1 << 1,
+  // Can't throw, so it may be computed where the code didn't.
+  INSERTABLE = 1 << 2,
+  // Can't throw when it reads from `this`.
+  INSERTABLE_ON_THIS = 1 << 3,
+};
+
+IROpcode move_for_dest(const IRInstruction* insn) {
+  if (insn->dest_is_wide()) {
+    return OPCODE_MOVE_WIDE;
+  }
+  return opcode_impl::dest_is_object(insn->opcode()) ? OPCODE_MOVE_OBJECT
+                                                : OPCODE_MOVE;
+}
+
+IROpcode move_for_src(const IRInstruction* insn, size_t i) {
+  if (insn->src_is_wide(i)) {
+    return OPCODE_MOVE_WIDE;
+  }
+  auto op = insn->opcode();
+  return i == 0 && (is_iget(op) || is_aget(op) || op == OPCODE_ARRAY_LENGTH)
+             ? OPCODE_MOVE_OBJECT
+             : OPCODE_MOVE;
+}
+
+IROpcode move_result_pseudo_for(IROpcode move) {
+  switch (move) {
+  case OPCODE_MOVE_WIDE:
+    return IOPCODE_MOVE_RESULT_PSEUDO_WIDE;
+  case OPCODE_MOVE_OBJECT:
+    return IOPCODE_MOVE_RESULT_PSEUDO_OBJECT;
+  default:
+    return IOPCODE_MOVE_RESULT_PSEUDO;
+  }
+}
+
+enum class Kind : uint8_t {
+  // Defined by a phi, or an instruction that isn't numbered by its operands,
+  // or held by a register on entry.
+  LEAF,
+  // A state of the heap: on entry, after a barrier, or merged at a join.
+  MEMORY,
+  // The upper half of a wide value.
+  UPPER,
+  // An instruction applied to values, as an IRValue.
+  EXPRESSION,
+};
+
+struct Number {
+  Kind kind;
+  uint8_t traits{NOT_NUMBERED};
+  bool insertable{false};
+  // How to copy the value into its temp; OPCODE_NOP while unknown.
+  IROpcode move{OPCODE_NOP};
+  // The instruction an EXPRESSION is computed with, after replacing its
+  // sources.
+  const IRInstruction* insn{nullptr};
+  // The block of a phi LEAF or of a merged MEMORY state, and where the phi is
+  // in the phis of the block.
+  cfg::Block* block{nullptr};
+  uint32_t phi_index{0};
+  // The opcode and operands of an EXPRESSION or UPPER half.
+  IRValue value;
+};
+
+// Where a number is available from: after `position` in `block`, or from its
+// start for a position of -1.
+struct Def {
+  cfg::Block* block;
+  int32_t position;
+};
+
+// An instruction that writes a number to `dest`, which is copied into the
+// temp of the number after `it` if the number is needed.
+struct Origin {
+  cfg::InstructionIterator it;
+  uint32_t dest;
+  IROpcode move;
+};
+
+// A computation that may be redundant, and where its result is defined.
+struct Candidate {
+  cfg::Block* block;
+  int32_t position;
+  value_id_t number;
+  cfg::InstructionIterator it;
+  cfg::InstructionIterator def_it;
+};
+
+// The code on an edge into a join: the computations of the values that
+// weren't available on it, and then the moves of the values that merge.
+// Each entry belongs to the merge of a value at the join, and is only kept
+// if that value is needed.
+struct Slot {
+  cfg::Block* pred;
+  cfg::Block* block;
+  std::vector<std::pair<value_id_t, value_id_t>> computed;
+  // (merged, source)
+  std::vector<std::pair<value_id_t, value_id_t>> moves;
+  std::unordered_set<value_id_t> move_sources;
+  std::unordered_set<value_id_t> move_targets;
+};
+
+template <class T>
+bool contains(const std::vector<T>& sorted, const T& value) {
+  return std::binary_search(sorted.begin(), sorted.end(), value);
+}
+
+class GvnPre {
+ public:
+  GvnPre(const CommonSubexpressionElimination::SharedState* shared_state,
+         const DexMethod* method,
+         cfg::ControlFlowGraph& cfg,
+         GlobalValueNumberingPre::Stats* stats)
+      : m_shared_state(shared_state),
+        m_method(method),
+        m_cfg(cfg),
+        m_form(cfg),
+        m_dominators(cfg.dominators()),
+        m_stats(stats) {}
+
+  bool run() {
+    compute_reverse_postorder();
+    compute_memory();
+    number_values();
+    compute_anticipated();
+    for (size_t round = 0; round < MAX_ANTICIPATION_ROUNDS && insert();
+         ++round) {
+    }
+    eliminate();
+    return apply();
+  }
+
+ private:
+  value_id_t make_number(Kind kind) {
+    value_id_t number = m_numbers.size();
+    m_numbers.push_back(Number{kind});
+    m_defs.emplace_back();
+    m_origins.emplace_back();
+    m_merges.emplace_back();
+    return number;
+  }
+
+  bool is_insertable(uint8_t traits, const IRValue& value) const {
+    return (traits & INSERTABLE) ||
+           ((traits & INSERTABLE_ON_THIS) && m_this != NO_NUMBER &&
+            value.srcs[0] == m_this);
+  }
+
+  value_id_t number_of(IRValue value,
+                       const IRInstruction* insn,
+                       uint8_t traits,
+                       IROpcode move) {
+    auto it = m_expressions.find(value);
+    if (it != m_expressions.end()) {
+      return it->second;
+    }
+    auto number = make_number(Kind::EXPRESSION);
+    auto& n = m_numbers[number];
+    n.traits = traits;
+    n.insertable = is_insertable(traits, value);
+    n.move = move;
+    n.insn = insn;
+    n.value = value;
+    m_expressions.emplace(std::move(value), number);
+    return number;
+  }
+
+  value_id_t upper_of(value_id_t lower) {
+    IRValue value;
+    value.opcode = OPCODE_MOVE_WIDE;
+    value.srcs.push_back(lower);
+    auto it = m_expressions.find(value);
+    if (it != m_expressions.end()) {
+      return it->second;
+    }
+    auto number = make_number(Kind::UPPER);
+    m_numbers[number].value = value;
+    m_expressions.emplace(std::move(value), number);
+    return number;
+  }
+
+  uint8_t get_traits(const IRInstruction* insn) const {
+    auto op = insn->opcode();
+    if (is_pure_arithmetic(op)) {
+      return NUMBERED | INSERTABLE;
+    }
+    if (op == OPCODE_ARRAY_LENGTH) {
+      return NUMBERED;
+    }
+    if (is_aget(op)) {
+      return NUMBERED | READS_HEAP;
+    }
+    if (!is_iget(op) && !is_sget(op)) {
+      return NOT_NUMBERED;
+    }
+    if (m_shared_state->is_barrier(insn)) {
+      // The field is volatile, or unknown.
+      return NOT_NUMBERED;
+    }
+    auto field = resolve_field(insn->get_field(), is_sget(op)
+                                                      ? FieldSearch::Static
+                                                      : FieldSearch::Instance);
+    uint8_t traits = NUMBERED;
+    // Final fields are only written by the constructors of their class.
+    if (!is_final(field) || is_any_init(m_method)) {
+      traits |= READS_HEAP;
+    }
+    if (!is_sget(op)) {
+      traits |= INSERTABLE_ON_THIS;
+    } else if (field->get_class() == m_method->get_class()) {
+      traits |= INSERTABLE;
+    }
+    return traits;
+  }
+
+  void add_def(value_id_t number, cfg::Block* block, int32_t position) {
+    m_defs[number].push_back(Def{block, position});
+  }
+
+  void compute_reverse_postorder() {
+    size_t num_ids = 0;
+    for (auto block : m_cfg.blocks()) {
+      num_ids = std::max(num_ids, block->id() + 1);
+    }
+    std::vector<bool> visited(num_ids);
+    // The block, and the index of its next successor to visit.
+    std::vector<std::pair<cfg::Block*, size_t>> stack;
+    auto entry = m_cfg.entry_block();
+    visited[entry->id()] = true;
+    stack.emplace_back(entry, 0);
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      const auto& succs = top.first->succs();
+      if (top.second < succs.size()) {
+        auto succ = succs[top.second++]->target();
+        if (!visited[succ->id()]) {
+          visited[succ->id()] = true;
+          stack.emplace_back(succ, 0);
+        }
+        continue;
+      }
+      m_rpo.push_back(top.first);
+      stack.pop_back();
+    }
+    std::reverse(m_rpo.begin(), m_rpo.end());
+
+    m_memory_in.assign(num_ids, NO_NUMBER);
+    m_memory_out.assign(num_ids, NO_NUMBER);
+    m_exp_gen.resize(num_ids);
+    m_tmp_gen.resize(num_ids);
+    m_antic.resize(num_ids);
+  }
+
+  std::vector<cfg::Block*> reachable_preds(const cfg::Block* block) const {
+    std::vector<cfg::Block*> preds;
+    for (auto e : block->preds()) {
+      auto src = e->src();
+      if (m_dominators->is_reachable(src) &&
+          std::find(preds.begin(), preds.end(), src) == preds.end()) {
+        preds.push_back(src);
+      }
+    }
+    return preds;
+  }
+
+  /*
+   * The state of the heap at the start and end of every block. A join only
+   * merges the states of its predecessors if they differ, which is found
+   * optimistically: the predecessors that haven't been reached yet, like
+   * the ends of loops, don't count.
+   */
+  void compute_memory() {
+    std::unordered_map<const cfg::Block*, value_id_t> last_barrier;
+    for (auto block : m_rpo) {
+      for (auto& mie : InstructionIterable(block)) {
+        if (m_shared_state->is_barrier(mie.insn)) {
+          auto state = make_number(Kind::MEMORY);
+          m_barrier_states.emplace(mie.insn, state);
+          last_barrier[block] = state;
+        }
+      }
+    }
+    auto entry = m_cfg.entry_block();
+    auto entry_state = make_number(Kind::MEMORY);
+    std::unordered_map<const cfg::Block*, value_id_t> merges;
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto block : m_rpo) {
+        auto in = block == entry ? entry_state : NO_NUMBER;
+        auto merge_it = merges.find(block);
+        if (merge_it != merges.end()) {
+          in = merge_it->second;
+        } else {
+          for (auto e : block->preds()) {
+            if (!m_dominators->is_reachable(e->src())) {
+              continue;
+            }
+            auto out = m_memory_out[e->src()->id()];
+            if (out == NO_NUMBER || out == in) {
+              continue;
+            }
+            if (in != NO_NUMBER) {
+              in = make_number(Kind::MEMORY);
+              m_numbers[in].block = block;
+              merges.emplace(block, in);
+              break;
+            }
+            in = out;
+          }
+        }
+        auto barrier_it = last_barrier.find(block);
+        auto out = barrier_it == last_barrier.end() ? in : barrier_it->second;
+        if (in != m_memory_in[block->id()] ||
+            out != m_memory_out[block->id()]) {
+          m_memory_in[block->id()] = in;
+          m_memory_out[block->id()] = out;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  void number_values() {
+    m_value_numbers.assign(m_form.num_values(), NO_NUMBER);
+    for (ssa::ValueId v = 0; v < m_form.num_values(); ++v) {
+      const auto& def = m_form.definition(v);
+      if (def.kind == ssa::SSAForm::Definition::ENTRY) {
+        m_value_numbers[v] = make_number(Kind::LEAF);
+      } else if (def.kind == ssa::SSAForm::Definition::PHI) {
+        auto number = make_number(Kind::LEAF);
+        m_numbers[number].block = def.block;
+        m_numbers[number].phi_index = def.index;
+        m_value_numbers[v] = number;
+        // Nothing may come before the move-exception of a catch block, or
+        // the load-params of the entry block, so their phis aren't copied
+        // into temps.
+        if (!def.block->is_catch() && def.block != m_cfg.entry_block()) {
+          add_def(number, def.block, -1);
+        }
+      }
+    }
+
+    // The values of the load-params are copied after the last of them.
+    boost::optional<cfg::InstructionIterator> last_param;
+    auto entry = m_cfg.entry_block();
+    for (auto& mie : InstructionIterable(entry)) {
+      if (opcode::is_load_param(mie.insn->opcode())) {
+        last_param = entry->to_cfg_instruction_iterator(mie);
+      }
+    }
+
+    cfg::Block* current = nullptr;
+    int32_t position = 0;
+    value_id_t memory = NO_NUMBER;
+    m_form.walk(
+        [&](cfg::Block* block, const IRList::iterator& list_it,
+            const std::vector<ssa::ValueId>&) {
+          if (block != current) {
+            current = block;
+            position = 0;
+            memory = m_memory_in[block->id()];
+          }
+          auto it = block->to_cfg_instruction_iterator(list_it);
+          if (opcode::is_load_param(it->insn->opcode())) {
+            number_insn(block, position, it, *last_param, memory);
+          } else {
+            number_insn(block, position, it, it, memory);
+          }
+          auto barrier_it = m_barrier_states.find(it->insn);
+          if (barrier_it != m_barrier_states.end()) {
+            memory = barrier_it->second;
+          }
+          ++position;
+        },
+        [](ssa::Register, ssa::ValueId, ssa::ValueId) {});
+
+    for (auto block : m_rpo) {
+      for (auto* set : {&m_exp_gen[block->id()], &m_tmp_gen[block->id()]}) {
+        std::sort(set->begin(), set->end());
+        set->erase(std::unique(set->begin(), set->end()), set->end());
+      }
+    }
+  }
+
+  void number_insn(cfg::Block* block,
+                   int32_t position,
+                   const cfg::InstructionIterator& it,
+                   const cfg::InstructionIterator& origin_it,
+                   value_id_t memory) {
+    auto insn = it->insn;
+    auto op = insn->opcode();
+    size_t num_defs = insn->dests_size()
+                          ? (insn->dest_is_wide() ? 2 : 1)
+                          : (insn->has_move_result() ? 2 : 0);
+    if (num_defs == 0) {
+      return;
+    }
+    auto first = m_form.def(insn);
+    const auto& uses = m_form.uses(insn);
+    if (opcode::is_move(op) ||
+        opcode::is_move_result_or_move_result_pseudo(op)) {
+      for (size_t i = 0; i < num_defs; ++i) {
+        m_value_numbers[first + i] = m_value_numbers[uses[i]];
+      }
+      if (opcode::is_move_result_or_move_result_pseudo(op)) {
+        // The result is only written to a register of the code here.
+        auto number = m_value_numbers[uses[0]];
+        add_def(number, block, position);
+        m_origins[number].push_back(
+            Origin{it, insn->dest(), move_for_dest(insn)});
+      }
+      return;
+    }
+
+    auto traits = get_traits(insn);
+    value_id_t number;
+    if (traits & NUMBERED) {
+      IRValue value;
+      value.opcode = op;
+      for (auto use : uses) {
+        value.srcs.push_back(m_value_numbers[use]);
+      }
+      sort_operands(&value);
+      if (traits & READS_HEAP) {
+        value.srcs.push_back(memory);
+      }
+      if (insn->has_literal()) {
+        value.literal = insn->get_literal();
+      } else if (insn->has_field()) {
+        value.field = insn->get_field();
+      }
+      auto def_it = insn->has_move_result_pseudo() ? m_cfg.move_result_of(it)
+                                                   : it;
+      number = number_of(std::move(value), insn, traits,
+                         move_for_dest(def_it->insn));
+      m_candidates.push_back(Candidate{block, position, number, it, def_it});
+      if (m_numbers[number].insertable) {
+        m_exp_gen[block->id()].push_back(number);
+      } else {
+        m_tmp_gen[block->id()].push_back(number);
+      }
+    } else {
+      number = make_number(Kind::LEAF);
+      m_tmp_gen[block->id()].push_back(number);
+      if (insn->dests_size()) {
+        m_numbers[number].move = move_for_dest(insn);
+      }
+    }
+    if (insn->dests_size()) {
+      add_def(number, block, position);
+      m_origins[number].push_back(
+          Origin{origin_it, insn->dest(), move_for_dest(insn)});
+    }
+    if (op == IOPCODE_LOAD_PARAM_OBJECT && position == 0 &&
+        !is_static(m_method)) {
+      m_this = number;
+    }
+    m_value_numbers[first] = number;
+    if (num_defs == 2) {
+      m_value_numbers[first + 1] = upper_of(number);
+    }
+  }
+
+  /*
+   * The number of the same computation as `number` on the edge from `pred`
+   * into `block`, which takes the operands of the phis of `block` for that
+   * edge.
+   */
+  value_id_t translate(value_id_t number,
+                       cfg::Block* pred,
+                       cfg::Block* block) {
+    auto& memo = m_translations[std::make_pair(pred->id(), block->id())];
+    auto memo_it = memo.find(number);
+    if (memo_it != memo.end()) {
+      return memo_it->second;
+    }
+    auto result = number;
+    switch (m_numbers[number].kind) {
+    case Kind::LEAF:
+      if (m_numbers[number].block == block) {
+        const auto& phi = m_form.phis(block)[m_numbers[number].phi_index];
+        for (const auto& operand : phi.operands) {
+          if (operand.first == pred) {
+            result = m_value_numbers[operand.second];
+          }
+        }
+      }
+      break;
+    case Kind::MEMORY:
+      if (m_numbers[number].block == block) {
+        result = m_memory_out[pred->id()];
+      }
+      break;
+    case Kind::UPPER: {
+      auto lower = m_numbers[number].value.srcs[0];
+      auto translated = translate(lower, pred, block);
+      if (translated != lower) {
+        result = upper_of(translated);
+      }
+      break;
+    }
+    case Kind::EXPRESSION: {
+      auto value = m_numbers[number].value;
+      bool changed = false;
+      for (auto& src : value.srcs) {
+        auto translated = translate(src, pred, block);
+        changed = changed || translated != src;
+        src = translated;
+      }
+      if (changed) {
+        sort_operands(&value);
+        const auto& n = m_numbers[number];
+        result = number_of(std::move(value), n.insn, n.traits, n.move);
+      }
+      break;
+    }
+    }
+    memo[number] = result;
+    return result;
+  }
+
+  /*
+   * Removes the values whose operands `block` defines, or whose operands
+   * that could be anticipated aren't.
+   */
+  std::vector<value_id_t> clean(const std::vector<value_id_t>& numbers,
+                                const cfg::Block* block) const {
+    const auto& tmp_gen = m_tmp_gen[block->id()];
+    std::vector<value_id_t> kept;
+    for (auto number : numbers) {
+      bool keep = true;
+      for (auto src : m_numbers[number].value.srcs) {
+        if (m_numbers[src].kind == Kind::UPPER) {
+          src = m_numbers[src].value.srcs[0];
+        }
+        if (contains(tmp_gen, src) ||
+            (m_numbers[src].kind == Kind::EXPRESSION &&
+             m_numbers[src].insertable && !contains(kept, src))) {
+          keep = false;
+          break;
+        }
+      }
+      if (keep) {
+        kept.push_back(number);
+      }
+    }
+    return kept;
+  }
+
+  void compute_anticipated() {
+    for (size_t round = 0; round < MAX_ANTICIPATION_ROUNDS; ++round) {
+      bool changed = false;
+      for (auto it = m_rpo.rbegin(); it != m_rpo.rend(); ++it) {
+        auto block = *it;
+        std::vector<value_id_t> out;
+        bool first = true;
+        std::unordered_set<const cfg::Block*> seen;
+        for (auto e : block->succs()) {
+          auto succ = e->target();
+          if (!seen.insert(succ).second) {
+            continue;
+          }
+          std::vector<value_id_t> succ_in;
+          if (reachable_preds(succ).size() > 1) {
+            for (auto number : m_antic[succ->id()]) {
+              auto translated = translate(number, block, succ);
+              if (m_numbers[translated].kind == Kind::EXPRESSION &&
+                  m_numbers[translated].insertable) {
+                succ_in.push_back(translated);
+              }
+            }
+            std::sort(succ_in.begin(), succ_in.end());
+            succ_in.erase(std::unique(succ_in.begin(), succ_in.end()),
+                          succ_in.end());
+          } else {
+            succ_in = m_antic[succ->id()];
+          }
+          if (first) {
+            out = std::move(succ_in);
+            first = false;
+          } else {
+            std::vector<value_id_t> both;
+            std::set_intersection(out.begin(), out.end(), succ_in.begin(),
+                                  succ_in.end(), std::back_inserter(both));
+            out = std::move(both);
+          }
+        }
+        const auto& exp_gen = m_exp_gen[block->id()];
+        std::vector<value_id_t> in;
+        std::set_union(out.begin(), out.end(), exp_gen.begin(), exp_gen.end(),
+                       std::back_inserter(in));
+        in = clean(in, block);
+        if (in != m_antic[block->id()]) {
+          m_antic[block->id()] = std::move(in);
+          changed = true;
+        }
+      }
+      if (!changed) {
+        break;
+      }
+    }
+  }
+
+  bool is_available_at_end(value_id_t number, const cfg::Block* block) const {
+    for (const auto& def : m_defs[number]) {
+      if (m_dominators->dominates(def.block, block)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool is_available_before(value_id_t number,
+                           const cfg::Block* block,
+                           int32_t position) const {
+    for (const auto& def : m_defs[number]) {
+      if (def.block == block ? def.position < position
+                             : m_dominators->dominates(def.block, block)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Slot& slot(cfg::Block* pred, cfg::Block* block) {
+    auto& slot = m_slots[std::make_pair(pred->id(), block->id())];
+    slot.pred = pred;
+    slot.block = block;
+    return slot;
+  }
+
+  bool is_available_on_edge(value_id_t number,
+                            cfg::Block* pred,
+                            cfg::Block* block) {
+    if (is_available_at_end(number, pred)) {
+      return true;
+    }
+    const auto& computed = slot(pred, block).computed;
+    return std::any_of(computed.begin(), computed.end(),
+                       [&](const std::pair<value_id_t, value_id_t>& entry) {
+                         return entry.second == number;
+                       });
+  }
+
+  // Calls `f` with the number and the move of each register the instruction
+  // of an EXPRESSION reads.
+  template <class F>
+  void for_each_operand(value_id_t number, F f) const {
+    const auto& n = m_numbers[number];
+    size_t k = 0;
+    for (size_t i = 0; i < n.insn->srcs_size(); ++i) {
+      f(n.value.srcs[k], move_for_src(n.insn, i));
+      k += n.insn->src_is_wide(i) ? 2 : 1;
+    }
+  }
+
+  /*
+   * Merges the anticipated values of every join that are available on some
+   * of the edges into it, computing them on the others. Returns whether
+   * anything new was merged.
+   */
+  bool insert() {
+    bool changed = false;
+    for (auto block : m_rpo) {
+      if (block == m_cfg.entry_block() || block->is_catch()) {
+        continue;
+      }
+      auto preds = reachable_preds(block);
+      if (preds.size() < 2) {
+        continue;
+      }
+      // The merges of this round may make more values available.
+      auto antic = m_antic[block->id()];
+      for (auto number : antic) {
+        if (is_available_before(number, block, 0)) {
+          continue;
+        }
+        std::vector<value_id_t> translated;
+        std::vector<bool> available;
+        for (auto pred : preds) {
+          translated.push_back(translate(number, pred, block));
+          available.push_back(
+              is_available_on_edge(translated.back(), pred, block));
+        }
+        if (std::find(available.begin(), available.end(), true) ==
+                available.end() ||
+            !can_merge(number, block, preds, translated, available)) {
+          continue;
+        }
+        for (size_t i = 0; i < preds.size(); ++i) {
+          auto& s = slot(preds[i], block);
+          if (!available[i]) {
+            s.computed.emplace_back(number, translated[i]);
+          }
+          if (translated[i] != number) {
+            s.moves.emplace_back(number, translated[i]);
+            s.move_sources.insert(translated[i]);
+            s.move_targets.insert(number);
+          }
+        }
+        add_def(number, block, -1);
+        m_merges[number].push_back(block);
+        TRACE(GVN_PRE, 4, "[GVN-PRE] merging value %u in block %zu\n", number,
+              block->id());
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  bool can_merge(value_id_t number,
+                 cfg::Block* block,
+                 const std::vector<cfg::Block*>& preds,
+                 const std::vector<value_id_t>& translated,
+                 const std::vector<bool>& available) {
+    if (m_numbers[number].move == OPCODE_NOP) {
+      return false;
+    }
+    for (size_t i = 0; i < preds.size(); ++i) {
+      auto pred = preds[i];
+      auto source = translated[i];
+      auto& s = slot(pred, block);
+      // The moves into the join read all their sources before writing any of
+      // their targets.
+      if (s.move_sources.count(number) ||
+          (source != number && s.move_targets.count(source))) {
+        return false;
+      }
+      if (available[i]) {
+        continue;
+      }
+      if (m_numbers[source].kind != Kind::EXPRESSION ||
+          !m_numbers[source].insertable) {
+        return false;
+      }
+      bool operands_available = true;
+      for_each_operand(source, [&](value_id_t operand, IROpcode) {
+        operands_available = operands_available &&
+                             is_available_on_edge(operand, pred, block);
+      });
+      if (!operands_available) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void eliminate() {
+    for (const auto& candidate : m_candidates) {
+      if (is_available_before(candidate.number, candidate.block,
+                              candidate.position)) {
+        m_eliminated.push_back(&candidate);
+      }
+    }
+  }
+
+  // Marks `number` and what its temp is written from as needed.
+  void need(value_id_t number, IROpcode move) {
+    if (m_numbers[number].move == OPCODE_NOP) {
+      m_numbers[number].move = move;
+    }
+    if (!m_needed.insert(number).second) {
+      return;
+    }
+    for (auto block : m_merges[number]) {
+      for (auto pred : reachable_preds(block)) {
+        auto& s = slot(pred, block);
+        for (const auto& entry : s.computed) {
+          if (entry.first != number) {
+            continue;
+          }
+          for_each_operand(entry.second, [&](value_id_t operand,
+                                             IROpcode operand_move) {
+            // An operand computed on the same edge belongs to the merge of
+            // another value.
+            for (const auto& other : s.computed) {
+              if (other.second == operand && other.first != number) {
+                need(other.first, m_numbers[other.first].move);
+              }
+            }
+            need(operand, operand_move);
+          });
+        }
+        for (const auto& move : s.moves) {
+          if (move.first == number) {
+            need(move.second, m_numbers[number].move);
+          }
+        }
+      }
+    }
+  }
+
+  uint32_t temp(value_id_t number) {
+    auto it = m_temps.find(number);
+    if (it != m_temps.end()) {
+      return it->second;
+    }
+    auto reg = m_numbers[number].move == OPCODE_MOVE_WIDE
+                   ? m_cfg.allocate_wide_temp()
+                   : m_cfg.allocate_temp();
+    m_temps.emplace(number, reg);
+    return reg;
+  }
+
+  IRInstruction* make_move(IROpcode move, uint32_t dest, uint32_t src) {
+    auto insn = new IRInstruction(move);
+    insn->set_src(0, src)->set_dest(dest);
+    return insn;
+  }
+
+  bool apply() {
+    std::unordered_set<const IRInstruction*> eliminated_defs;
+    for (auto candidate : m_eliminated) {
+      need(candidate->number, m_numbers[candidate->number].move);
+      eliminated_defs.insert(candidate->def_it->insn);
+    }
+    if (m_eliminated.empty()) {
+      return false;
+    }
+
+    // The code on the edges into the joins, for the needed merges. This
+    // copies the instructions of the eliminated computations, so it goes
+    // first.
+    for (auto& entry : m_slots) {
+      auto& s = entry.second;
+      std::vector<IRInstruction*> insns;
+      for (const auto& computed : s.computed) {
+        if (!m_needed.count(computed.first)) {
+          continue;
+        }
+        auto number = computed.second;
+        auto copy = new IRInstruction(*m_numbers[number].insn);
+        size_t i = 0;
+        for_each_operand(number, [&](value_id_t operand, IROpcode) {
+          copy->set_src(i++, temp(operand));
+        });
+        insns.push_back(copy);
+        if (copy->has_move_result_pseudo()) {
+          auto move_result = new IRInstruction(
+              move_result_pseudo_for(m_numbers[number].move));
+          move_result->set_dest(temp(number));
+          insns.push_back(move_result);
+        } else {
+          copy->set_dest(temp(number));
+        }
+        m_stats->instructions_inserted++;
+      }
+      for (const auto& move : s.moves) {
+        if (m_needed.count(move.first)) {
+          insns.push_back(make_move(m_numbers[move.first].move,
+                                    temp(move.first), temp(move.second)));
+        }
+      }
+      if (insns.empty()) {
+        continue;
+      }
+      const auto& succs = s.pred->succs();
+      if (succs.size() == 1 && succs[0]->type() == cfg::EDGE_GOTO) {
+        s.pred->push_back(insns);
+        continue;
+      }
+      auto edge_block = m_cfg.create_block();
+      auto edges = succs;
+      for (auto e : edges) {
+        if (e->target() == s.block) {
+          m_cfg.set_edge_target(e, edge_block);
+        }
+      }
+      m_cfg.add_edge(edge_block, s.block, cfg::EDGE_GOTO);
+      edge_block->push_back(insns);
+    }
+    for (auto number : m_needed) {
+      m_stats->values_merged += m_merges[number].size();
+    }
+
+    // Every computation of a needed value writes its temp too.
+    for (auto number : m_needed) {
+      const auto& n = m_numbers[number];
+      if (n.kind == Kind::LEAF && n.block != nullptr) {
+        const auto& phi = m_form.phis(n.block)[n.phi_index];
+        n.block->push_front(make_move(n.move, temp(number), phi.reg));
+      }
+      for (const auto& origin : m_origins[number]) {
+        if (!eliminated_defs.count(origin.it->insn)) {
+          m_cfg.insert_after(origin.it,
+                             make_move(origin.move, temp(number),
+                                       origin.dest));
+        }
+      }
+    }
+
+    for (auto candidate : m_eliminated) {
+      auto def_insn = candidate->def_it->insn;
+      TRACE(GVN_PRE, 4, "[GVN-PRE] eliminating %s\n",
+            SHOW(candidate->it->insn));
+      m_cfg.insert_after(candidate->def_it,
+                         make_move(move_for_dest(def_insn), def_insn->dest(),
+                                   temp(candidate->number)));
+      m_cfg.remove_insn(candidate->it);
+    }
+    m_stats->instructions_eliminated += m_eliminated.size();
+    return true;
+  }
+
+  const CommonSubexpressionElimination::SharedState* m_shared_state;
+  const DexMethod* m_method;
+  cfg::ControlFlowGraph& m_cfg;
+  ssa::SSAForm m_form;
+  std::shared_ptr<const cfg::DominatorTree> m_dominators;
+  GlobalValueNumberingPre::Stats* m_stats;
+
+  std::vector<cfg::Block*> m_rpo;
+  std::vector<Number> m_numbers;
+  std::unordered_map<IRValue, value_id_t, IRValueHasher> m_expressions;
+  // The number of every SSA value.
+  std::vector<value_id_t> m_value_numbers;
+  value_id_t m_this{NO_NUMBER};
+  std::unordered_map<const IRInstruction*, value_id_t> m_barrier_states;
+
+  // Indexed by number.
+  std::vector<std::vector<Def>> m_defs;
+  std::vector<std::vector<Origin>> m_origins;
+  // The joins where the value merges.
+  std::vector<std::vector<cfg::Block*>> m_merges;
+
+  // Indexed by block id.
+  std::vector<value_id_t> m_memory_in;
+  std::vector<value_id_t> m_memory_out;
+  // The values a block computes that may be inserted, and the other values
+  // it defines, sorted.
+  std::vector<std::vector<value_id_t>> m_exp_gen;
+  std::vector<std::vector<value_id_t>> m_tmp_gen;
+  // The values anticipated at the start of a block, sorted, which also
+  // orders them after their operands.
+  std::vector<std::vector<value_id_t>> m_antic;
+
+  std::map<std::pair<cfg::BlockId, cfg::BlockId>,
+           std::unordered_map<value_id_t, value_id_t>>
+      m_translations;
+  std::map<std::pair<cfg::BlockId, cfg::BlockId>, Slot> m_slots;
+
+  std::vector<Candidate> m_candidates;
+  std::vector<const Candidate*> m_eliminated;
+  std::unordered_set<value_id_t> m_needed;
+  std::unordered_map<value_id_t, uint32_t> m_temps;
+};
+
+} // namespace
+
+GlobalValueNumberingPre::GlobalValueNumberingPre(
+    const CommonSubexpressionElimination::SharedState* shared_state,
+    const DexMethod* method,
+    cfg::ControlFlowGraph& cfg)
+    : m_shared_state(shared_state), m_method(method), m_cfg(cfg) {}
+
+bool GlobalValueNumberingPre::run() {
+  GvnPre gvn_pre(m_shared_state, m_method, m_cfg, &m_stats);
+  return gvn_pre.run();
+}
+
+void GlobalValueNumberingPrePass::run_pass(DexStoresVector& stores,
+                                           ConfigFiles& /* conf */,
+                                           PassManager& mgr) {
+  const auto scope = build_class_scope(stores);
+  CommonSubexpressionElimination::SharedState shared_state;
+  shared_state.init_scope(scope);
+
+  const auto stats =
+      walk::parallel::reduce_methods<GlobalValueNumberingPre::Stats>(
+          scope,
+          [&](DexMethod* method) {
+            const auto code = method->get_code();
+            if (code == nullptr) {
+              return GlobalValueNumberingPre::Stats();
+            }
+
+            TRACE(GVN_PRE, 3, "[GVN-PRE] processing %s\n", SHOW(method));
+            code->build_cfg(/* editable */ true);
+            GlobalValueNumberingPre gvn_pre(&shared_state, method,
+                                            code->cfg());
+            bool any_changes = gvn_pre.run();
+            code->clear_cfg();
+            if (any_changes) {
+              CopyPropagationPass::Config config;
+              copy_propagation_impl::CopyPropagation copy_propagation(config);
+              copy_propagation.run(code, method);
+
+              std::unordered_set<DexMethodRef*> pure_methods;
+              auto local_dce = LocalDce(pure_methods);
+              local_dce.dce(code);
+            }
+            return gvn_pre.get_stats();
+          },
+          [](GlobalValueNumberingPre::Stats a,
+             GlobalValueNumberingPre::Stats b) {
+            a.instructions_eliminated += b.instructions_eliminated;
+            a.instructions_inserted += b.instructions_inserted;
+            a.values_merged += b.values_merged;
+            return a;
+          });
+  mgr.incr_metric(METRIC_INSTRUCTIONS_ELIMINATED,
+                  stats.instructions_eliminated);
+  mgr.incr_metric(METRIC_INSTRUCTIONS_INSERTED, stats.instructions_inserted);
+  mgr.incr_metric(METRIC_VALUES_MERGED, stats.values_merged);
+}
+
+static GlobalValueNumberingPrePass s_pass;
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "CommonSubexpressionElimination.h"
+#include "ControlFlow.h"
+#include "Pass.h"
+
+class GlobalValueNumberingPre {
+ public:
+  struct Stats {
+    // Computations replaced by a value computed before, on every path or
+    // after insertions on the paths that didn't compute it.
+    size_t instructions_eliminated{0};
+    // Computations inserted on the edges into a join where the value was
+    // only available on some of the paths.
+    size_t instructions_inserted{0};
+    // Values made available at a join by merging what the paths into it
+    // computed.
+    size_t values_merged{0};
+  };
+
+  /*
+   * The shared state of CSE decides which instructions are barriers, which
+   * the values of field and array reads don't survive.
+   */
+  GlobalValueNumberingPre(
+      const CommonSubexpressionElimination::SharedState* shared_state,
+      const DexMethod* method,
+      cfg::ControlFlowGraph& cfg);
+
+  /*
+   * Numbers the values of the code and eliminates the fully and partially
+   * redundant computations. Returns whether anything changed.
+   */
+  bool run();
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  const CommonSubexpressionElimination::SharedState* m_shared_state;
+  const DexMethod* m_method;
+  cfg::ControlFlowGraph& m_cfg;
+  Stats m_stats;
+};
+
+class GlobalValueNumberingPrePass : public Pass {
+ public:
+  GlobalValueNumberingPrePass() : Pass("GlobalValueNumberingPrePass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+};
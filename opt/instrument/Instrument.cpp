@@ -63,6 +63,8 @@ class InstrumentInterDexPlugin : public interdex::InterDexPassPlugin {
     return {};
   }
 
+  bool additional_classes_rewrite_code() override { return false; }
+
   void cleanup(const std::vector<DexClass*>& scope) override {}
 
  private:
@@ -1032,6 +1034,47 @@ void do_simple_method_tracing(DexClass* analysis_cls,
   pm.incr_metric("Excluded", excluded);
 }
 
+std::unordered_set<std::string> get_cold_start_classes(ConfigFiles& cfg) {
+  auto interdex_list = cfg.get_coldstart_classes();
+  std::unordered_set<std::string> cold_start_classes;
+  std::string dex_end_marker0("LDexEndMarker0;");
+  for (auto class_string : interdex_list) {
+    if (class_string == dex_end_marker0) {
+      break;
+    }
+    class_string.back() = '/';
+    cold_start_classes.insert(class_string);
+  }
+  TRACE(INSTRUMENT, 7, "Number of classes: %d\n", cold_start_classes.size());
+  return cold_start_classes;
+}
+
+bool should_instrument_blocks(
+    const DexMethod* method,
+    const InstrumentPass::Options& options,
+    const std::unordered_set<std::string>& cold_start_classes) {
+  // Basic block instrumentation assumes whitelist or set of cold start
+  // classes.
+  if ((!options.whitelist.empty() &&
+       !is_included(method->get_name()->str(), method->get_class()->c_str(),
+                    options.whitelist)) ||
+      (options.only_cold_start_class &&
+       !is_included(method->get_name()->str(), method->get_class()->c_str(),
+                    cold_start_classes))) {
+    return false;
+  }
+
+  // Blacklist has priority over whitelist or cold start list.
+  if (is_included(method->get_name()->str(), method->get_class()->c_str(),
+                  options.blacklist)) {
+    TRACE(INSTRUMENT, 9, "Blacklist: excluded: %s\n", SHOW(method));
+    return false;
+  }
+
+  TRACE(INSTRUMENT, 9, "Whitelist: included: %s\n", SHOW(method));
+  return true;
+}
+
 // A simple bit-vector basic block instrumentation algorithm
 //
 //  Example) Original CFG
@@ -1070,18 +1113,7 @@ void do_basic_block_tracing(DexClass* analysis_cls,
   std::map<int /*id*/, std::pair<std::string, int /*number of BBs*/>>
       method_id_name_map;
   auto scope = build_class_scope(stores);
-
-  auto interdex_list = cfg.get_coldstart_classes();
-  std::unordered_set<std::string> cold_start_classes;
-  std::string dex_end_marker0("LDexEndMarker0;");
-  for (auto class_string : interdex_list) {
-    if (class_string == dex_end_marker0) {
-      break;
-    }
-    class_string.back() = '/';
-    cold_start_classes.insert(class_string);
-  }
-  TRACE(INSTRUMENT, 7, "Number of classes: %d\n", cold_start_classes.size());
+  const auto& cold_start_classes = get_cold_start_classes(cfg);
 
   std::map<size_t /* num_vectors */, int /* count */> bb_vector_stat;
   walk::code(scope, [&](DexMethod* method, IRCode& code) {
@@ -1093,25 +1125,10 @@ void do_basic_block_tracing(DexClass* analysis_cls,
                     [&](const auto& e) { return e.second == method; })) {
       return;
     }
-
-    // Basic block tracing assumes whitelist or set of cold start classes.
-    if ((!options.whitelist.empty() &&
-         !is_included(method->get_name()->str(), method->get_class()->c_str(),
-                      options.whitelist)) ||
-        (options.only_cold_start_class &&
-         !is_included(method->get_name()->str(), method->get_class()->c_str(),
-                      cold_start_classes))) {
-      return;
-    }
-
-    // Blacklist has priority over whitelist or cold start list.
-    if (is_included(method->get_name()->str(), method->get_class()->c_str(),
-                    options.blacklist)) {
-      TRACE(INSTRUMENT, 9, "Blacklist: excluded: %s\n", SHOW(method));
+    if (!should_instrument_blocks(method, options, cold_start_classes)) {
       return;
     }
 
-    TRACE(INSTRUMENT, 9, "Whitelist: included: %s\n", SHOW(method));
     all_methods++;
     method_index = instrument_onBasicBlockBegin(
         &code, method, method_onMethodExit_map, method_index, all_bb_nums,
@@ -1137,6 +1154,319 @@ void do_basic_block_tracing(DexClass* analysis_cls,
         (all_method_inst - 1), all_bb_inst, all_methods, all_bb_nums);
 }
 
+// Edge counting: a lower overhead alternative to basic block tracing.
+//
+// Instead of calling into the analysis class, every counter is an inline
+// increment of an element of the analysis class' int[] sEdgeCounts:
+//
+//   SGET_OBJECT Lcom/foo/Analysis;.sEdgeCounts:[I
+//   MOVE_RESULT_PSEUDO_OBJECT v_counts
+//   CONST v_index, <counter index>
+//   AGET v_counts, v_index
+//   MOVE_RESULT_PSEUDO v_count
+//   ADD_INT_LIT8 v_count, v_count, 1
+//   APUT v_count, v_counts, v_index
+//
+// The increments aren't atomic, so concurrent runs of the same code may lose
+// a few counts, which is fine for a profile.
+//
+// Counters are only placed on the edges that are not in a spanning tree of
+// the CFG (Ball and Larus, "Optimally Profiling and Tracing Programs"). The
+// CFG gets a virtual exit node, with edges from the blocks that return or
+// throw to it, from it to the entry block and from it to every catch block,
+// so that the flow into each block equals the flow out of it. The count of a
+// tree edge then follows from the counted edges around it, which
+// tools/python/edge_counts.py solves for offline, leaves of the tree first.
+// Exceptions thrown by anything but a throw instruction break the flow
+// equations, so the counts of methods that catch such exceptions are
+// approximations.
+//
+// The graph is written to the edge metadata file, with lines of
+//   B,<method id>,<block>,<block id of the basic block profile>
+//   E,<method id>,<source block>,<target block>,<counter index>
+// where the virtual exit node is "x", the counter index of tree edges is -1
+// and a block without instructions has no profile block id (-1). The
+// metadata file itself is the index of basic block tracing, so that the
+// reconstructed block counts are a basic block profile.
+struct CountedEdge {
+  // nullptr stands for the virtual exit node.
+  cfg::Block* src;
+  cfg::Block* target;
+  // nullptr for the edges to and from the virtual exit node.
+  cfg::Edge* edge;
+};
+
+class UnionFind {
+ public:
+  explicit UnionFind(size_t size) : m_parent(size) {
+    for (size_t i = 0; i < size; ++i) {
+      m_parent[i] = i;
+    }
+  }
+
+  size_t find(size_t i) {
+    while (m_parent[i] != i) {
+      m_parent[i] = m_parent[m_parent[i]];
+      i = m_parent[i];
+    }
+    return i;
+  }
+
+  // Returns false if both were already in the same set.
+  bool unite(size_t i, size_t j) {
+    i = find(i);
+    j = find(j);
+    if (i == j) {
+      return false;
+    }
+    m_parent[i] = j;
+    return true;
+  }
+
+ private:
+  std::vector<size_t> m_parent;
+};
+
+std::vector<IRInstruction*> make_edge_counter(DexField* counts_field,
+                                              size_t counter_index,
+                                              uint16_t counts_reg,
+                                              uint16_t index_reg,
+                                              uint16_t count_reg) {
+  return {(new IRInstruction(OPCODE_SGET_OBJECT))->set_field(counts_field),
+          (new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT))
+              ->set_dest(counts_reg),
+          (new IRInstruction(OPCODE_CONST))
+              ->set_literal(counter_index)
+              ->set_dest(index_reg),
+          (new IRInstruction(OPCODE_AGET))
+              ->set_arg_word_count(2)
+              ->set_src(0, counts_reg)
+              ->set_src(1, index_reg),
+          (new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO))->set_dest(count_reg),
+          (new IRInstruction(OPCODE_ADD_INT_LIT8))
+              ->set_literal(1)
+              ->set_src(0, count_reg)
+              ->set_dest(count_reg),
+          (new IRInstruction(OPCODE_APUT))
+              ->set_arg_word_count(3)
+              ->set_src(0, count_reg)
+              ->set_src(1, counts_reg)
+              ->set_src(2, index_reg)};
+}
+
+// Whether code can be added at the beginning of the block.
+bool can_push_front(cfg::Block* block) {
+  auto first = block->get_first_insn();
+  return first == block->end() ||
+         (!block->starts_with_move_result() &&
+          first->insn->opcode() != OPCODE_MOVE_EXCEPTION);
+}
+
+void insert_edge_counter(cfg::ControlFlowGraph& cfg,
+                         const CountedEdge& counted,
+                         const std::vector<IRInstruction*>& counter) {
+  if (counted.target == nullptr) {
+    // Count right before the return or throw.
+    auto block = counted.src;
+    auto last = block->to_cfg_instruction_iterator(block->get_last_insn());
+    cfg.insert_before(last, counter);
+    return;
+  }
+  if (counted.src == nullptr) {
+    // Count when a catch block is entered.
+    auto block = counted.target;
+    auto first = block->get_first_insn();
+    if (first != block->end() &&
+        first->insn->opcode() == OPCODE_MOVE_EXCEPTION) {
+      cfg.insert_after(block->to_cfg_instruction_iterator(first), counter);
+    } else {
+      block->push_front(counter);
+    }
+    return;
+  }
+  auto edge = counted.edge;
+  if (counted.target->preds().size() == 1 && can_push_front(counted.target)) {
+    counted.target->push_front(counter);
+  } else if (counted.src->succs().size() == 1) {
+    // A single goto; the block has no branch and can't throw.
+    counted.src->push_back(counter);
+  } else {
+    // Put the counter on a block of its own along the edge.
+    auto block = cfg.create_block();
+    block->push_back(counter);
+    cfg.set_edge_target(edge, block);
+    cfg.add_edge(block, counted.target, cfg::EDGE_GOTO);
+  }
+}
+
+} // namespace
+
+namespace instrument {
+
+EdgeCountingStats instrument_edges(IRCode* code,
+                                   size_t method_id,
+                                   DexField* counts_field,
+                                   size_t& next_counter_index,
+                                   size_t& num_profile_blocks,
+                                   std::ostream& edge_ofs) {
+  // The blocks of the basic block profile are those of the non-editable CFG.
+  std::unordered_map<const IRInstruction*, cfg::BlockId> profile_block_ids;
+  code->build_cfg(/* editable */ false);
+  num_profile_blocks = code->cfg().blocks().size();
+  for (auto block : code->cfg().blocks()) {
+    for (const auto& mie : InstructionIterable(block)) {
+      profile_block_ids.emplace(mie.insn, block->id());
+    }
+  }
+
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  const auto& blocks = cfg.blocks();
+  std::unordered_map<const cfg::Block*, size_t> node_ids;
+  for (auto block : blocks) {
+    int64_t profile_block_id = -1;
+    auto first = block->get_first_insn();
+    if (first != block->end()) {
+      auto it = profile_block_ids.find(first->insn);
+      if (it != profile_block_ids.end()) {
+        profile_block_id = it->second;
+      }
+    }
+    edge_ofs << "B," << method_id << "," << block->id() << ","
+             << profile_block_id << "\n";
+    node_ids.emplace(block, node_ids.size());
+  }
+  const size_t exit_node = node_ids.size();
+
+  // Edges that can't be counted go first, so that they end up in the tree.
+  // Then, as we don't know which edges are hot, prefer gotos over branches.
+  std::vector<CountedEdge> edges;
+  edges.push_back({nullptr, cfg.entry_block(), nullptr});
+  std::vector<CountedEdge> goto_edges;
+  std::vector<CountedEdge> branch_edges;
+  for (auto block : blocks) {
+    for (auto edge : block->succs()) {
+      if (edge->type() == cfg::EDGE_GOTO) {
+        if (edge->target()->starts_with_move_result()) {
+          edges.push_back({block, edge->target(), edge});
+        } else {
+          goto_edges.push_back({block, edge->target(), edge});
+        }
+      } else if (edge->type() == cfg::EDGE_BRANCH) {
+        branch_edges.push_back({block, edge->target(), edge});
+      }
+    }
+  }
+  const size_t num_uncountable = edges.size();
+  edges.insert(edges.end(), goto_edges.begin(), goto_edges.end());
+  edges.insert(edges.end(), branch_edges.begin(), branch_edges.end());
+  for (auto block : blocks) {
+    auto last = block->get_last_insn();
+    if (last != block->end() && (is_return(last->insn->opcode()) ||
+                                 last->insn->opcode() == OPCODE_THROW)) {
+      edges.push_back({block, nullptr, nullptr});
+    }
+    if (cfg.get_pred_edge_of_type(block, cfg::EDGE_THROW) != nullptr) {
+      edges.push_back({nullptr, block, nullptr});
+    }
+  }
+
+  EdgeCountingStats stats;
+  UnionFind trees(exit_node + 1);
+  const auto counts_reg = cfg.allocate_temp();
+  const auto index_reg = cfg.allocate_temp();
+  const auto count_reg = cfg.allocate_temp();
+  auto node_of = [&](const cfg::Block* block) {
+    return block == nullptr ? exit_node : node_ids.at(block);
+  };
+  auto name_of = [](const cfg::Block* block) {
+    return block == nullptr ? std::string("x") : std::to_string(block->id());
+  };
+  for (size_t i = 0; i < edges.size(); ++i) {
+    const auto& counted = edges[i];
+    int64_t counter_index = -1;
+    if (!trees.unite(node_of(counted.src), node_of(counted.target))) {
+      // Two uncountable edges form a cycle only in unreachable code, which
+      // the editable CFG doesn't have.
+      always_assert(i >= num_uncountable);
+      counter_index = next_counter_index++;
+      insert_edge_counter(cfg, counted,
+                          make_edge_counter(counts_field, counter_index,
+                                            counts_reg, index_reg, count_reg));
+      ++stats.counters;
+    }
+    edge_ofs << "E," << method_id << "," << name_of(counted.src) << ","
+             << name_of(counted.target) << "," << counter_index << "\n";
+  }
+  stats.edges = edges.size();
+
+  code->clear_cfg();
+  return stats;
+}
+
+} // namespace instrument
+
+namespace {
+
+using namespace instrument;
+
+void do_edge_counting(DexClass* analysis_cls,
+                      DexStoresVector& stores,
+                      ConfigFiles& cfg,
+                      PassManager& pm,
+                      const InstrumentPass::Options& options) {
+  DexField* counts_field = nullptr;
+  for (auto field : analysis_cls->get_sfields()) {
+    if (field->get_name()->str() == "sEdgeCounts") {
+      counts_field = field;
+      break;
+    }
+  }
+  if (counts_field == nullptr ||
+      counts_field->get_type() != make_array_type(get_int_type())) {
+    std::cerr << "[InstrumentPass] error: cannot find int[] sEdgeCounts in "
+              << show(analysis_cls) << std::endl;
+    exit(1);
+  }
+
+  std::ofstream edge_ofs(cfg.metafile(options.edge_metadata_file_name),
+                         std::ofstream::out | std::ofstream::trunc);
+  std::map<int /*id*/, std::pair<std::string, int /*number of BBs*/>>
+      method_id_name_map;
+  size_t next_counter_index = 0;
+  EdgeCountingStats all_stats;
+  auto scope = build_class_scope(stores);
+  const auto& cold_start_classes = get_cold_start_classes(cfg);
+  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+    if (method == analysis_cls->get_clinit() ||
+        !should_instrument_blocks(method, options, cold_start_classes)) {
+      return;
+    }
+    const size_t method_id = method_id_name_map.size();
+    size_t num_profile_blocks = 0;
+    const auto stats =
+        instrument_edges(&code, method_id, counts_field, next_counter_index,
+                         num_profile_blocks, edge_ofs);
+    method_id_name_map.emplace(
+        method_id, std::make_pair(show(method), num_profile_blocks));
+    all_stats.edges += stats.edges;
+    all_stats.counters += stats.counters;
+  });
+  patch_array_size(*analysis_cls, "sEdgeCounts", next_counter_index);
+
+  write_basic_block_index_file(cfg.metafile(options.metadata_file_name),
+                               method_id_name_map);
+  TRACE(INSTRUMENT, 2, "Edge file was written to: %s\n",
+        cfg.metafile(options.edge_metadata_file_name).c_str());
+  TRACE(INSTRUMENT, 3,
+        "Instrumented %zu methods with %zu counters for %zu edges\n",
+        method_id_name_map.size(), all_stats.counters, all_stats.edges);
+
+  pm.incr_metric("Instrumented", method_id_name_map.size());
+  pm.incr_metric("EdgeCounters", all_stats.counters);
+  pm.incr_metric("Edges", all_stats.edges);
+}
+
 std::unordered_set<std::string> load_blacklist_file(
     const std::string& file_name) {
   // Assume the file simply enumerates blacklisted names.
@@ -1174,6 +1504,8 @@ void InstrumentPass::configure_pass(const JsonWrapper& jw) {
   jw.get("num_stats_per_method", 1, m_options.num_stats_per_method);
   jw.get("num_shards", 1, m_options.num_shards);
   jw.get("only_cold_start_class", true, m_options.only_cold_start_class);
+  jw.get("edge_metadata_file_name", "instrument-edges.txt",
+         m_options.edge_metadata_file_name);
 
   // Make a small room for additional method refs during InterDex.
   interdex::InterDexRegistry* registry =
@@ -1241,6 +1573,8 @@ void InstrumentPass::run_pass(DexStoresVector& stores,
     do_simple_method_tracing(analysis_cls, stores, cfg, pm, m_options);
   } else if (m_options.instrumentation_strategy == "basic_block_tracing") {
     do_basic_block_tracing(analysis_cls, stores, cfg, pm, m_options);
+  } else if (m_options.instrumentation_strategy == "edge_counting") {
+    do_edge_counting(analysis_cls, stores, cfg, pm, m_options);
   } else {
     std::cerr << "[InstrumentPass] Unknown instrumentation strategy.\n";
   }
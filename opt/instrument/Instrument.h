@@ -9,6 +9,7 @@
 
 #include "PassManager.h"
 
+#include <ostream>
 #include <unordered_set>
 
 class InstrumentPass : public Pass {
@@ -26,6 +27,7 @@ class InstrumentPass : public Pass {
     std::unordered_set<std::string> whitelist;
     std::string blacklist_file_name;
     std::string metadata_file_name;
+    std::string edge_metadata_file_name;
     int64_t num_stats_per_method;
     int64_t num_shards;
     bool only_cold_start_class;
@@ -34,3 +36,25 @@ class InstrumentPass : public Pass {
  private:
   Options m_options;
 };
+
+namespace instrument {
+
+struct EdgeCountingStats {
+  size_t edges{0};
+  size_t counters{0};
+};
+
+/*
+ * Puts the counters of the edge_counting strategy on the edges of `code` that
+ * are not in a spanning tree of its CFG, numbering them from
+ * `next_counter_index` on, and writes the blocks and edges of the CFG to
+ * `edge_ofs` as the lines of the edge metadata file.
+ */
+EdgeCountingStats instrument_edges(IRCode* code,
+                                   size_t method_id,
+                                   DexField* counts_field,
+                                   size_t& next_counter_index,
+                                   size_t& num_profile_blocks,
+                                   std::ostream& edge_ofs);
+
+} // namespace instrument
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <cmath>
 #include <numeric>
 
@@ -67,17 +68,26 @@ uint64_t CrossDexRefMinimizer::ClassInfo::get_priority() const {
   return (primary_priority << 24) | secondary_priority;
 }
 
-void CrossDexRefMinimizer::reprioritize(
-    const std::unordered_map<DexClass*, CrossDexRefMinimizer::ClassInfoDelta>&
-        affected_classes) {
+CrossDexRefMinimizer::ClassInfoDelta& CrossDexRefMinimizer::get_delta(
+    ClassIndex index) {
+  auto& delta = m_deltas.at(index);
+  if (!delta.affected) {
+    delta.affected = true;
+    m_affected_classes.push_back(index);
+  }
+  return delta;
+}
+
+void CrossDexRefMinimizer::reprioritize() {
   TRACE(IDEX, 4, "[dex ordering] Reprioritizing %u classes\n",
-        affected_classes.size());
-  for (auto p : affected_classes) {
+        m_affected_classes.size());
+  for (auto index : m_affected_classes) {
     ++m_stats.reprioritizations;
-    DexClass* affected_class = p.first;
-    CrossDexRefMinimizer::ClassInfoDelta& delta = p.second;
+    CrossDexRefMinimizer::ClassInfoDelta& delta = m_deltas[index];
     CrossDexRefMinimizer::ClassInfo& affected_class_info =
-        m_class_infos.at(affected_class);
+        m_class_infos[index];
+    DexClass* affected_class = affected_class_info.cls;
+    always_assert(affected_class != nullptr);
     affected_class_info.applied_refs_weight += delta.applied_refs_weight;
     for (size_t i = 0; i < INFREQUENT_REFS_COUNT; ++i) {
       affected_class_info.infrequent_refs_weight[i] +=
@@ -97,7 +107,20 @@ void CrossDexRefMinimizer::reprioritize(
             .c_str(),
         format_infrequent_refs_array(delta.infrequent_refs_weight).c_str(),
         affected_class_info.refs.size());
+    delta = CrossDexRefMinimizer::ClassInfoDelta();
+  }
+  m_affected_classes.clear();
+}
+
+CrossDexRefMinimizer::RefIndex CrossDexRefMinimizer::get_ref_index(
+    void* ref) {
+  auto it = m_ref_indices.emplace(ref, m_ref_counts.size()).first;
+  if (it->second == m_ref_counts.size()) {
+    m_ref_counts.push_back(0);
+    m_ref_classes.emplace_back();
+    m_applied_refs.push_back(false);
   }
+  return it->second;
 }
 
 void CrossDexRefMinimizer::gather_refs(DexClass* cls,
@@ -127,7 +150,8 @@ void CrossDexRefMinimizer::ignore(DexClass* cls) {
   // By setting the count to the maximum value here, the class will later appear
   // to have an extremely high frequency and thus get skipped from
   // consideration by insert/add_weight.
-  m_ref_counts[cls->get_type()] = std::numeric_limits<size_t>::max();
+  m_ref_counts[get_ref_index(cls->get_type())] =
+      std::numeric_limits<size_t>::max();
 }
 
 void CrossDexRefMinimizer::sample(DexClass* cls) {
@@ -136,11 +160,11 @@ void CrossDexRefMinimizer::sample(DexClass* cls) {
   std::vector<DexType*> types;
   std::vector<DexString*> strings;
   gather_refs(cls, method_refs, field_refs, types, strings);
-  auto increment = [& ref_counts = m_ref_counts,
-                    &max_ref_count = m_max_ref_count](void* ref) {
-    size_t& count = ref_counts[ref];
-    if (count < std::numeric_limits<size_t>::max() && ++count > max_ref_count) {
-      max_ref_count = count;
+  auto increment = [this](void* ref) {
+    size_t& count = m_ref_counts[get_ref_index(ref)];
+    if (count < std::numeric_limits<size_t>::max() &&
+        ++count > m_max_ref_count) {
+      m_max_ref_count = count;
     }
   };
   for (auto ref : method_refs) {
@@ -158,12 +182,13 @@ void CrossDexRefMinimizer::sample(DexClass* cls) {
 }
 
 void CrossDexRefMinimizer::insert(DexClass* cls) {
-  always_assert(m_class_infos.count(cls) == 0);
+  ClassIndex class_index = m_class_infos.size();
+  auto inserted = m_class_indices.emplace(cls, class_index).second;
+  always_assert(inserted);
   ++m_stats.classes;
-  CrossDexRefMinimizer::ClassInfo& class_info =
-      m_class_infos
-          .insert({cls, CrossDexRefMinimizer::ClassInfo(m_next_index++)})
-          .first->second;
+  m_class_infos.emplace_back(cls, class_index);
+  m_deltas.emplace_back();
+  CrossDexRefMinimizer::ClassInfo& class_info = m_class_infos.back();
 
   // Collect all relevant references that contribute to cross-dex metadata
   // entries.
@@ -181,12 +206,13 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
   uint64_t& refs_weight = class_info.refs_weight;
   uint64_t& seed_weight = class_info.seed_weight;
 
-  auto add_weight = [& ref_counts = m_ref_counts,
+  auto add_weight = [& ref_indices = m_ref_indices,
+                     &ref_counts = m_ref_counts,
                      max_ref_count = m_max_ref_count, &refs, &refs_weight,
                      &seed_weight](void* ref, size_t item_weight,
                                    size_t item_seed_weight) {
-    auto it = ref_counts.find(ref);
-    auto ref_count = it == ref_counts.end() ? 1 : it->second;
+    auto it = ref_indices.find(ref);
+    auto ref_count = it == ref_indices.end() ? 1 : ref_counts[it->second];
     double frequency = ref_count * 1.0 / max_ref_count;
     // We skip reference that...
     // - only ever appear once (those won't help with prioritization), and
@@ -196,7 +222,7 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
     TRACE(IDEX, 6, "[dex ordering] %zu/%zu = %lf %s\n", ref_count,
           max_ref_count, frequency, skipping ? "(skipping)" : "");
     if (!skipping) {
-      refs.emplace_back(ref, item_weight);
+      refs.emplace_back(it->second, item_weight);
       refs_weight += item_weight;
       seed_weight += item_seed_weight;
     }
@@ -219,11 +245,10 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
   for (auto fref : field_refs) {
     add_weight(fref, m_config.field_ref_weight, m_config.field_seed_weight);
   }
+  std::sort(refs.begin(), refs.end());
 
-  std::unordered_map<DexClass*, CrossDexRefMinimizer::ClassInfoDelta>
-      affected_classes;
-  for (const std::pair<void*, uint32_t>& p : refs) {
-    void* ref = p.first;
+  for (const std::pair<RefIndex, uint32_t>& p : refs) {
+    RefIndex ref = p.first;
     uint32_t weight = p.second;
     auto& classes = m_ref_classes[ref];
     size_t frequency = classes.size();
@@ -231,10 +256,10 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
     // infrequent ref. The actual undoing happens later in
     // reprioritize.
     if (frequency > 0 && frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        always_assert(affected_class != cls);
-        affected_classes[affected_class]
-            .infrequent_refs_weight[frequency - 1] -= weight;
+      for (ClassIndex affected_class : classes) {
+        always_assert(affected_class != class_index);
+        get_delta(affected_class).infrequent_refs_weight[frequency - 1] -=
+            weight;
       }
     }
     ++frequency;
@@ -244,17 +269,18 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
     // class_info.get_priority() call, while all other change requests happen
     // later in reprioritize.
     if (frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        affected_classes[affected_class]
-            .infrequent_refs_weight[frequency - 1] += weight;
+      for (ClassIndex affected_class : classes) {
+        get_delta(affected_class).infrequent_refs_weight[frequency - 1] +=
+            weight;
       }
       class_info.infrequent_refs_weight[frequency - 1] += weight;
     }
 
-    // There's an implicit invariant that class_info and the keys of
-    // affected_classes are disjoint, so we are not going to reprioritize
-    // the class that we are adding here.
-    classes.emplace(cls);
+    // There's an implicit invariant that class_info and the affected classes
+    // are disjoint, so we are not going to reprioritize the class that we are
+    // adding here. As classes are indexed in insertion order, appending keeps
+    // the list sorted.
+    classes.push_back(class_index);
   }
   const auto priority = class_info.get_priority();
   m_prioritized_classes.insert(cls, priority);
@@ -264,7 +290,7 @@ void CrossDexRefMinimizer::insert(DexClass* cls) {
         SHOW(cls), priority, class_info.index,
         format_infrequent_refs_array(class_info.infrequent_refs_weight).c_str(),
         refs.size());
-  reprioritize(affected_classes);
+  reprioritize();
 }
 
 bool CrossDexRefMinimizer::empty() const {
@@ -276,49 +302,45 @@ DexClass* CrossDexRefMinimizer::front() const {
 }
 
 DexClass* CrossDexRefMinimizer::worst(bool generated) {
-  auto max_it = m_class_infos.end();
+  const CrossDexRefMinimizer::ClassInfo* max_class_info = nullptr;
   uint64_t max_value = 0;
 
-  for (auto it = m_class_infos.begin(); it != m_class_infos.end(); ++it) {
+  // Classes are visited in insertion order, so among classes with equal
+  // values we prefer the one that was inserted earlier (smaller index) to make
+  // things deterministic.
+  for (const auto& class_info : m_class_infos) {
     // If requested, let's skip generated classes, as they tend to be not stable
     // and may cause drastic build-over-build changes.
-    if (it->first->rstate.is_generated() != generated) {
+    if (class_info.cls == nullptr ||
+        class_info.cls->rstate.is_generated() != generated) {
       continue;
     }
 
-    const CrossDexRefMinimizer::ClassInfo& class_info = it->second;
     uint64_t value = class_info.seed_weight;
 
     // Prefer the largest denominator
-    if (value < max_value) {
+    if (max_class_info != nullptr && value <= max_value) {
       continue;
     }
 
-    // If equal, prefer the class that was inserted earlier (smaller index) to
-    // make things deterministic.
-    if (value == max_value && max_it != m_class_infos.end() &&
-        class_info.index > max_it->second.index) {
-      continue;
-    }
-
-    max_it = it;
+    max_class_info = &class_info;
     max_value = value;
   }
 
-  if (max_it == m_class_infos.end()) {
+  if (max_class_info == nullptr) {
     return nullptr;
   }
 
   TRACE(IDEX, 3,
         "[dex ordering] Picked worst class {%s} with seed %u; "
         "index %u\n",
-        SHOW(max_it->first), max_value, max_it->second.index);
-  m_stats.worst_classes.emplace_back(max_it->first, max_value);
-  return max_it->first;
+        SHOW(max_class_info->cls), max_value, max_class_info->index);
+  m_stats.worst_classes.emplace_back(max_class_info->cls, max_value);
+  return max_class_info->cls;
 }
 
 DexClass* CrossDexRefMinimizer::worst() {
-  always_assert(!m_class_infos.empty());
+  always_assert(!m_class_indices.empty());
   // We prefer to find a class that is not generated. Only when such a class
   // doesn't exist (because all classes are generated), then we pick the worst
   // generated class.
@@ -332,9 +354,10 @@ DexClass* CrossDexRefMinimizer::worst() {
 
 void CrossDexRefMinimizer::erase(DexClass* cls, bool emitted, bool reset) {
   m_prioritized_classes.erase(cls);
-  auto class_info_it = m_class_infos.find(cls);
-  always_assert(class_info_it != m_class_infos.end());
-  const CrossDexRefMinimizer::ClassInfo& class_info = class_info_it->second;
+  auto class_index_it = m_class_indices.find(cls);
+  always_assert(class_index_it != m_class_indices.end());
+  ClassIndex class_index = class_index_it->second;
+  CrossDexRefMinimizer::ClassInfo& class_info = m_class_infos[class_index];
   TRACE(IDEX, 3,
         "[dex ordering] Processing class {%s} with priority %016lx; "
         "index %u; %u applied refs weight, %s infrequent refs weights, %u "
@@ -350,69 +373,74 @@ void CrossDexRefMinimizer::erase(DexClass* cls, bool emitted, bool reset) {
   if (reset) {
     TRACE(IDEX, 3, "[dex ordering] Reset\n");
     ++m_stats.resets;
-    m_applied_refs.clear();
+    std::fill(m_applied_refs.begin(), m_applied_refs.end(), false);
+    m_applied_refs_count = 0;
   }
 
-  std::unordered_map<DexClass*, CrossDexRefMinimizer::ClassInfoDelta>
-      affected_classes;
   const auto& refs = class_info.refs;
-  size_t old_applied_refs = m_applied_refs.size();
-  for (const std::pair<void*, uint32_t>& p : refs) {
-    void* ref = p.first;
+  size_t old_applied_refs = m_applied_refs_count;
+  for (const std::pair<RefIndex, uint32_t>& p : refs) {
+    RefIndex ref = p.first;
     uint32_t weight = p.second;
     auto& classes = m_ref_classes.at(ref);
     size_t frequency = classes.size();
     always_assert(frequency > 0);
-    const auto erased = classes.erase(cls);
-    always_assert(erased);
+    auto class_it = std::lower_bound(classes.begin(), classes.end(),
+                                     class_index);
+    always_assert(class_it != classes.end() && *class_it == class_index);
+    classes.erase(class_it);
     if (frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        affected_classes[affected_class]
-            .infrequent_refs_weight[frequency - 1] -= weight;
+      for (ClassIndex affected_class : classes) {
+        get_delta(affected_class).infrequent_refs_weight[frequency - 1] -=
+            weight;
       }
     }
     --frequency;
     if (frequency > 0 && frequency <= INFREQUENT_REFS_COUNT) {
-      for (DexClass* affected_class : classes) {
-        affected_classes[affected_class]
-            .infrequent_refs_weight[frequency - 1] += weight;
+      for (ClassIndex affected_class : classes) {
+        get_delta(affected_class).infrequent_refs_weight[frequency - 1] +=
+            weight;
       }
     }
 
     if (!emitted) {
       continue;
     }
-    if (m_applied_refs.count(ref) != 0) {
+    if (m_applied_refs[ref]) {
       continue;
     }
-    m_applied_refs.emplace(ref);
-    for (DexClass* affected_class : classes) {
-      affected_classes[affected_class].applied_refs_weight += weight;
+    m_applied_refs[ref] = true;
+    ++m_applied_refs_count;
+    for (ClassIndex affected_class : classes) {
+      get_delta(affected_class).applied_refs_weight += weight;
     }
   }
 
   // Updating m_class_infos and m_prioritized_classes
 
-  m_class_infos.erase(class_info_it);
-  always_assert(m_class_infos.count(cls) == 0);
+  m_class_indices.erase(class_index_it);
+  class_info.cls = nullptr;
+  class_info.refs.clear();
+  class_info.refs.shrink_to_fit();
 
   if (reset) {
     m_prioritized_classes.clear();
-    for (auto it = m_class_infos.begin(); it != m_class_infos.end(); ++it) {
-      DexClass* reset_class = it->first;
-      CrossDexRefMinimizer::ClassInfo& reset_class_info = it->second;
+    for (auto& reset_class_info : m_class_infos) {
+      if (reset_class_info.cls == nullptr) {
+        continue;
+      }
       reset_class_info.applied_refs_weight = 0;
       const auto priority = reset_class_info.get_priority();
-      m_prioritized_classes.insert(reset_class, priority);
+      m_prioritized_classes.insert(reset_class_info.cls, priority);
       always_assert(reset_class_info.applied_refs_weight == 0);
     }
   }
   if (emitted) {
     TRACE(IDEX, 4, "[dex ordering] %u + %u = %u applied refs\n",
-          old_applied_refs, m_applied_refs.size() - old_applied_refs,
-          m_applied_refs.size());
+          old_applied_refs, m_applied_refs_count - old_applied_refs,
+          m_applied_refs_count);
   }
-  reprioritize(affected_classes);
+  reprioritize();
 }
 
 } // namespace interdex
@@ -7,12 +7,12 @@
 
 #pragma once
 
+#include <array>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "DexClass.h"
-#include "MutablePriorityQueue.h"
+#include "RadixPriorityQueue.h"
 
 namespace interdex {
 
@@ -26,7 +26,7 @@ namespace interdex {
 // minimization, but also causes it to use more memory and run slower.
 constexpr size_t INFREQUENT_REFS_COUNT = 6;
 
-using PrioritizedDexClasses = MutablePriorityQueue<DexClass*, uint64_t>;
+using PrioritizedDexClasses = RadixPriorityQueue<DexClass*, uint64_t>;
 struct CrossDexRefMinimizerStats {
   size_t classes{0};
   size_t resets{0};
@@ -77,43 +77,63 @@ struct CrossDexRefMinimizerConfig {
 // overflows. In any case, all of this flows into a heuristic, so it wouldn't
 // be the end of the world if an overflow ever happens.
 class CrossDexRefMinimizer {
+  // All *refs and classes are identified by dense indices, so that the
+  // bookkeeping below is mostly done in vectors rather than hash maps.
+  using RefIndex = uint32_t;
+  using ClassIndex = uint32_t;
+
   PrioritizedDexClasses m_prioritized_classes;
-  std::unordered_set<void*> m_applied_refs;
+  std::vector<bool> m_applied_refs;
+  size_t m_applied_refs_count{0};
   struct ClassInfo {
+    DexClass* cls;
     uint32_t index;
     // This array stores (the weights of) how many of the *refs of this class
     // have only one, two, ... classes left that reference them.
     std::array<uint32_t, INFREQUENT_REFS_COUNT> infrequent_refs_weight;
-    std::vector<std::pair<void*, uint32_t>> refs;
+    // Sorted by ref index.
+    std::vector<std::pair<RefIndex, uint32_t>> refs;
     uint64_t refs_weight;
     uint64_t applied_refs_weight;
     uint64_t seed_weight{0};
-    ClassInfo(uint32_t i)
-        : index(i),
+    ClassInfo(DexClass* c, uint32_t i)
+        : cls(c),
+          index(i),
           infrequent_refs_weight(),
           refs_weight(0),
           applied_refs_weight(0) {}
     uint64_t get_primary_priority_denominator() const;
     uint64_t get_priority() const;
   };
-  std::unordered_map<DexClass*, ClassInfo> m_class_infos;
-  uint32_t m_next_index{0};
-  std::unordered_map<void*, std::unordered_set<DexClass*>> m_ref_classes;
+  // Indexed by ClassIndex; erased classes have a null cls.
+  std::vector<ClassInfo> m_class_infos;
+  std::unordered_map<DexClass*, ClassIndex> m_class_indices;
+  // For each *ref, the sorted indices of the remaining classes that have it.
+  std::vector<std::vector<ClassIndex>> m_ref_classes;
   CrossDexRefMinimizerStats m_stats;
   const CrossDexRefMinimizerConfig m_config;
 
   struct ClassInfoDelta {
     std::array<int32_t, INFREQUENT_REFS_COUNT> infrequent_refs_weight{};
     int64_t applied_refs_weight{0};
+    bool affected{false};
   };
 
-  void reprioritize(
-      const std::unordered_map<DexClass*, ClassInfoDelta>& affected_classes);
+  // Indexed by ClassIndex, along with the list of affected classes, so that
+  // each insertion or erasure only pays for the classes it actually touches.
+  std::vector<ClassInfoDelta> m_deltas;
+  std::vector<ClassIndex> m_affected_classes;
+  ClassInfoDelta& get_delta(ClassIndex index);
+
+  void reprioritize();
   DexClass* worst(bool generated);
 
-  std::unordered_map<void*, size_t> m_ref_counts;
+  std::unordered_map<void*, RefIndex> m_ref_indices;
+  std::vector<size_t> m_ref_counts;
   size_t m_max_ref_count{0};
 
+  RefIndex get_ref_index(void* ref);
+
   void gather_refs(DexClass* cls,
                    std::vector<DexMethodRef*>& method_refs,
                    std::vector<DexFieldRef*>& field_refs,
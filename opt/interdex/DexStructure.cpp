@@ -47,9 +47,10 @@ bool matches_penalty(const char* str, unsigned* penalty) {
   return false;
 }
 
-/**
- * Estimates the linear alloc space consumed by the class at runtime.
- */
+} // namespace
+
+namespace interdex {
+
 unsigned estimate_linear_alloc(const DexClass* clazz) {
   unsigned lasize = 0;
   // VTable guesstimate. Technically we could do better here, but only so much.
@@ -75,35 +76,16 @@ unsigned estimate_linear_alloc(const DexClass* clazz) {
   return lasize;
 }
 
-/**
- * Removes the elements of b from a. Runs in O(size(a)), so it works best if
- * size(a) << size(b).
- */
-template <typename T>
-std::unordered_set<T> set_difference(const std::unordered_set<T>& a,
-                                     const std::unordered_set<T>& b) {
-  std::unordered_set<T> result;
-  for (auto& v : a) {
-    if (!b.count(v)) {
-      result.emplace(v);
-    }
-  }
-  return result;
-}
-
-} // namespace
-
-namespace interdex {
-
 bool DexesStructure::add_class_to_current_dex(const MethodRefs& clazz_mrefs,
                                               const FieldRefs& clazz_frefs,
                                               const TypeRefs& clazz_trefs,
+                                              unsigned laclazz,
                                               DexClass* clazz) {
   always_assert_log(m_classes.count(clazz) == 0,
                     "Can't emit the same class twice!\n", SHOW(clazz));
 
   if (m_current_dex.add_class_if_fits(
-          clazz_mrefs, clazz_frefs, clazz_trefs, m_linear_alloc_limit,
+          clazz_mrefs, clazz_frefs, clazz_trefs, laclazz, m_linear_alloc_limit,
           MAX_METHOD_REFS - m_reserve_mrefs, m_type_refs_limit, clazz)) {
     update_stats(clazz_mrefs, clazz_frefs, clazz);
     m_classes.emplace(clazz);
@@ -116,11 +98,11 @@ bool DexesStructure::add_class_to_current_dex(const MethodRefs& clazz_mrefs,
 void DexesStructure::add_class_no_checks(const MethodRefs& clazz_mrefs,
                                          const FieldRefs& clazz_frefs,
                                          const TypeRefs& clazz_trefs,
+                                         unsigned laclazz,
                                          DexClass* clazz) {
   always_assert_log(m_classes.count(clazz) == 0,
                     "Can't emit the same class twice: %s!\n", SHOW(clazz));
 
-  auto laclazz = estimate_linear_alloc(clazz);
   m_current_dex.add_class_no_checks(clazz_mrefs, clazz_frefs, clazz_trefs,
                                     laclazz, clazz);
   m_classes.emplace(clazz);
@@ -175,12 +157,11 @@ void DexesStructure::update_stats(const MethodRefs& clazz_mrefs,
 bool DexStructure::add_class_if_fits(const MethodRefs& clazz_mrefs,
                                      const FieldRefs& clazz_frefs,
                                      const TypeRefs& clazz_trefs,
+                                     unsigned laclazz,
                                      size_t linear_alloc_limit,
                                      size_t method_refs_limit,
                                      size_t type_refs_limit,
                                      DexClass* clazz) {
-
-  unsigned laclazz = estimate_linear_alloc(clazz);
   if (m_linear_alloc_size + laclazz > linear_alloc_limit) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
@@ -189,31 +170,31 @@ bool DexStructure::add_class_if_fits(const MethodRefs& clazz_mrefs,
     return false;
   }
 
-  auto extra_mrefs = set_difference(clazz_mrefs, m_mrefs);
-  auto extra_frefs = set_difference(clazz_frefs, m_frefs);
-  auto extra_trefs = set_difference(clazz_trefs, m_trefs);
-
-  if (m_mrefs.size() + extra_mrefs.size() >= method_refs_limit) {
+  // Once a limit is hit, the other refs don't need to be looked at.
+  auto num_mrefs = m_mrefs.size() + m_mrefs.count_new(clazz_mrefs);
+  if (num_mrefs >= method_refs_limit) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
           "over the method refs limit: %d >= %d: %s\n",
-          m_mrefs.size() + extra_mrefs.size(), method_refs_limit, SHOW(clazz));
+          num_mrefs, method_refs_limit, SHOW(clazz));
     return false;
   }
 
-  if (m_frefs.size() + extra_frefs.size() >= MAX_FIELD_REFS) {
+  auto num_frefs = m_frefs.size() + m_frefs.count_new(clazz_frefs);
+  if (num_frefs >= MAX_FIELD_REFS) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
           "over the field refs limit: %d >= %d: %s\n",
-          m_frefs.size() + extra_frefs.size(), MAX_FIELD_REFS, SHOW(clazz));
+          num_frefs, MAX_FIELD_REFS, SHOW(clazz));
     return false;
   }
 
-  if (m_trefs.size() + extra_trefs.size() >= type_refs_limit) {
+  auto num_trefs = m_trefs.size() + m_trefs.count_new(clazz_trefs);
+  if (num_trefs >= type_refs_limit) {
     TRACE(IDEX, 6,
           "[warning]: Class won't fit current dex since it will go "
           "over the type refs limit: %d >= %d: %s\n",
-          m_trefs.size() + extra_trefs.size(), type_refs_limit, SHOW(clazz));
+          num_trefs, type_refs_limit, SHOW(clazz));
     return false;
   }
 
@@ -227,9 +208,15 @@ void DexStructure::add_class_no_checks(const MethodRefs& clazz_mrefs,
                                        unsigned laclazz,
                                        DexClass* clazz) {
   TRACE(IDEX, 7, "Adding class: %s\n", SHOW(clazz));
-  m_mrefs.insert(clazz_mrefs.begin(), clazz_mrefs.end());
-  m_frefs.insert(clazz_frefs.begin(), clazz_frefs.end());
-  m_trefs.insert(clazz_trefs.begin(), clazz_trefs.end());
+  for (auto mref : clazz_mrefs) {
+    m_mrefs.insert(mref);
+  }
+  for (auto fref : clazz_frefs) {
+    m_frefs.insert(fref);
+  }
+  for (auto tref : clazz_trefs) {
+    m_trefs.insert(tref);
+  }
   m_linear_alloc_size += laclazz;
   m_classes.push_back(clazz);
 }
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <boost/dynamic_bitset.hpp>
 #include <unordered_set>
 #include <vector>
 
@@ -20,6 +21,71 @@ using MethodRefs = std::unordered_set<DexMethodRef*>;
 using FieldRefs = std::unordered_set<DexFieldRef*>;
 using TypeRefs = std::unordered_set<DexType*>;
 
+/**
+ * Estimates the linear alloc space consumed by the class at runtime.
+ */
+unsigned estimate_linear_alloc(const DexClass* clazz);
+
+/**
+ * The refs of one kind in a dex. Those that already existed when the set was
+ * created live in a bitset indexed by their dense id, so that checking the
+ * refs of a class against the dex doesn't hash them; any created later go to
+ * a hash set.
+ */
+template <class T>
+class DexRefSet {
+ public:
+  explicit DexRefSet(size_t num_ids) : m_bits(num_ids) {}
+
+  size_t size() const { return m_size; }
+
+  bool count(T* ref) const {
+    auto id = ref->get_dense_id();
+    if (id < m_bits.size()) {
+      return m_bits.test(id);
+    }
+    return m_overflow.count(ref);
+  }
+
+  void insert(T* ref) {
+    auto id = ref->get_dense_id();
+    if (id < m_bits.size()) {
+      if (!m_bits.test(id)) {
+        m_bits.set(id);
+        ++m_size;
+      }
+    } else if (m_overflow.insert(ref).second) {
+      ++m_size;
+    }
+  }
+
+  void erase(T* ref) {
+    auto id = ref->get_dense_id();
+    if (id < m_bits.size()) {
+      if (m_bits.test(id)) {
+        m_bits.reset(id);
+        --m_size;
+      }
+    } else {
+      m_size -= m_overflow.erase(ref);
+    }
+  }
+
+  // Counts the refs that are not in the set yet.
+  size_t count_new(const std::unordered_set<T*>& refs) const {
+    size_t result = 0;
+    for (auto ref : refs) {
+      result += !count(ref);
+    }
+    return result;
+  }
+
+ private:
+  boost::dynamic_bitset<> m_bits;
+  std::unordered_set<T*> m_overflow;
+  size_t m_size{0};
+};
+
 struct DexInfo {
   bool primary{false};
   bool mixed_mode{false};
@@ -30,7 +96,11 @@ struct DexInfo {
 
 class DexStructure {
  public:
-  DexStructure() : m_linear_alloc_size(0) {}
+  DexStructure()
+      : m_linear_alloc_size(0),
+        m_trefs(g_redex->num_type_ids()),
+        m_mrefs(g_redex->num_method_ids()),
+        m_frefs(g_redex->num_field_ids()) {}
 
   size_t get_linear_alloc_size() const { return m_linear_alloc_size; }
 
@@ -50,6 +120,7 @@ class DexStructure {
   bool add_class_if_fits(const MethodRefs& clazz_mrefs,
                          const FieldRefs& clazz_frefs,
                          const TypeRefs& clazz_trefs,
+                         unsigned laclazz,
                          size_t linear_alloc_limit,
                          size_t method_refs_limit,
                          size_t type_refs_limit,
@@ -67,9 +138,9 @@ class DexStructure {
 
  private:
   size_t m_linear_alloc_size;
-  TypeRefs m_trefs;
-  MethodRefs m_mrefs;
-  FieldRefs m_frefs;
+  DexRefSet<DexType> m_trefs;
+  DexRefSet<DexMethodRef> m_mrefs;
+  DexRefSet<DexFieldRef> m_frefs;
   std::vector<DexClass*> m_classes;
   std::vector<DexClass*> m_squashed_classes;
 };
@@ -122,11 +193,13 @@ class DexesStructure {
 
   /**
    * Tries to add the class to the current dex. If it can't, it returns false.
-   * Throws if the class already exists in the dexes.
+   * Throws if the class already exists in the dexes. laclazz is the
+   * estimate_linear_alloc() of the class, which callers may have cached.
    */
   bool add_class_to_current_dex(const MethodRefs& clazz_mrefs,
                                 const FieldRefs& clazz_frefs,
                                 const TypeRefs& clazz_trefs,
+                                unsigned laclazz,
                                 DexClass* clazz);
 
   /*
@@ -136,9 +209,11 @@ class DexesStructure {
   void add_class_no_checks(const MethodRefs& clazz_mrefs,
                            const FieldRefs& clazz_frefs,
                            const TypeRefs& clazz_trefs,
+                           unsigned laclazz,
                            DexClass* clazz);
   void add_class_no_checks(DexClass* clazz) {
-    add_class_no_checks(MethodRefs(), FieldRefs(), TypeRefs(), clazz);
+    add_class_no_checks(MethodRefs(), FieldRefs(), TypeRefs(),
+                        estimate_linear_alloc(clazz), clazz);
   }
 
   void squash_empty_last_class(DexClass* clazz) {
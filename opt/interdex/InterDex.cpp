@@ -7,6 +7,7 @@
 
 #include "InterDex.h"
 
+#include <algorithm>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -124,10 +125,29 @@ bool is_canary(DexClass* clazz) {
   return strncmp(cname, CANARY_PREFIX, sizeof(CANARY_PREFIX) - 1) == 0;
 }
 
+template <typename T>
+void sort_unique(std::vector<T>* vec) {
+  std::sort(vec->begin(), vec->end());
+  vec->erase(std::unique(vec->begin(), vec->end()), vec->end());
+}
+
+interdex::ClassRefs gather_class_refs(const DexClass* cls) {
+  interdex::ClassRefs refs;
+  cls->gather_methods(refs.mrefs);
+  cls->gather_fields(refs.frefs);
+  cls->gather_types(refs.trefs);
+  sort_unique(&refs.mrefs);
+  sort_unique(&refs.frefs);
+  sort_unique(&refs.trefs);
+  refs.linear_alloc = interdex::estimate_linear_alloc(cls);
+  return refs;
+}
+
 void gather_refs(
     const std::vector<std::unique_ptr<interdex::InterDexPassPlugin>>& plugins,
     const interdex::DexInfo& dex_info,
     const DexClass* cls,
+    const interdex::ClassRefs* class_refs,
     interdex::MethodRefs* mrefs,
     interdex::FieldRefs* frefs,
     interdex::TypeRefs* trefs,
@@ -136,9 +156,15 @@ void gather_refs(
   std::vector<DexMethodRef*> method_refs;
   std::vector<DexFieldRef*> field_refs;
   std::vector<DexType*> type_refs;
-  cls->gather_methods(method_refs);
-  cls->gather_fields(field_refs);
-  cls->gather_types(type_refs);
+  if (class_refs != nullptr) {
+    method_refs = class_refs->mrefs;
+    field_refs = class_refs->frefs;
+    type_refs = class_refs->trefs;
+  } else {
+    cls->gather_methods(method_refs);
+    cls->gather_fields(field_refs);
+    cls->gather_types(type_refs);
+  }
 
   for (const auto& plugin : plugins) {
     plugin->gather_refs(dex_info, cls, method_refs, field_refs, type_refs,
@@ -204,6 +230,18 @@ void InterDex::add_to_scope(DexClass* cls) {
   }
 }
 
+void InterDex::precompute_class_refs(const Scope& scope) {
+  m_class_refs.clear();
+  for (DexClass* cls : scope) {
+    m_class_refs[cls];
+  }
+  // The map doesn't change shape anymore, so each class can fill in its own
+  // entry concurrently.
+  walk::parallel::classes(scope, [&](DexClass* cls) {
+    m_class_refs.at(cls) = gather_class_refs(cls);
+  });
+}
+
 bool InterDex::should_not_relocate_methods_of_class(const DexClass* clazz) {
   for (const auto& plugin : m_plugins) {
     if (plugin->should_not_relocate_methods_of_class(clazz)) {
@@ -245,12 +283,17 @@ bool InterDex::emit_class(const DexInfo& dex_info,
   MethodRefs clazz_mrefs;
   FieldRefs clazz_frefs;
   TypeRefs clazz_trefs;
-  gather_refs(m_plugins, dex_info, clazz, &clazz_mrefs, &clazz_frefs,
-              &clazz_trefs, erased_classes,
+  auto class_refs_it = m_class_refs.find(clazz);
+  const ClassRefs* class_refs =
+      class_refs_it == m_class_refs.end() ? nullptr : &class_refs_it->second;
+  gather_refs(m_plugins, dex_info, clazz, class_refs, &clazz_mrefs,
+              &clazz_frefs, &clazz_trefs, erased_classes,
               should_not_relocate_methods_of_class(clazz));
 
   bool fits_current_dex = m_dexes_structure.add_class_to_current_dex(
-      clazz_mrefs, clazz_frefs, clazz_trefs, clazz);
+      clazz_mrefs, clazz_frefs, clazz_trefs,
+      class_refs ? class_refs->linear_alloc : estimate_linear_alloc(clazz),
+      clazz);
   if (!fits_current_dex) {
     flush_out_dex(dex_info);
 
@@ -262,12 +305,18 @@ bool InterDex::emit_class(const DexInfo& dex_info,
     clazz_frefs.clear();
     clazz_trefs.clear();
     if (erased_classes) erased_classes->clear();
-    gather_refs(m_plugins, dex_info, clazz, &clazz_mrefs, &clazz_frefs,
-                &clazz_trefs, erased_classes,
+    // Flushing out may have rewritten the class.
+    class_refs_it = m_class_refs.find(clazz);
+    class_refs =
+        class_refs_it == m_class_refs.end() ? nullptr : &class_refs_it->second;
+    gather_refs(m_plugins, dex_info, clazz, class_refs, &clazz_mrefs,
+                &clazz_frefs, &clazz_trefs, erased_classes,
                 should_not_relocate_methods_of_class(clazz));
 
-    m_dexes_structure.add_class_no_checks(clazz_mrefs, clazz_frefs, clazz_trefs,
-                                          clazz);
+    m_dexes_structure.add_class_no_checks(
+        clazz_mrefs, clazz_frefs, clazz_trefs,
+        class_refs ? class_refs->linear_alloc : estimate_linear_alloc(clazz),
+        clazz);
   }
   return true;
 }
@@ -677,6 +726,9 @@ void InterDex::init_cross_dex_ref_minimizer_and_relocate_methods(
         !should_not_relocate_methods_of_class(cls)) {
       std::vector<DexClass*> relocated_classes;
       m_cross_dex_relocator->relocate_methods(cls, relocated_classes);
+      if (!relocated_classes.empty()) {
+        m_class_refs.erase(cls);
+      }
       for (DexClass* relocated_cls : relocated_classes) {
         // Tell all plugins that the new class is now effectively part of the
         // scope.
@@ -780,6 +832,7 @@ void InterDex::cleanup(const Scope& final_scope) {
 
 void InterDex::run() {
   auto scope = build_class_scope(m_dexen);
+  precompute_class_refs(scope);
 
   std::vector<DexType*> interdex_types = get_interdex_types(scope);
 
@@ -904,6 +957,10 @@ void InterDex::flush_out_dex(DexInfo dex_info) {
     classes.insert(classes.end(), squashed_classes.begin(),
                    squashed_classes.end());
     auto add_classes = plugin->additional_classes(m_outdex, classes);
+    if (!add_classes.empty() && plugin->additional_classes_rewrite_code()) {
+      TRACE(IDEX, 3, "IDEX: Plugin-generated classes invalidate class refs\n");
+      m_class_refs.clear();
+    }
     for (auto add_class : add_classes) {
       TRACE(IDEX, 4, "IDEX: Emitting plugin-generated class :: %s\n",
             SHOW(add_class));
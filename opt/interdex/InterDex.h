@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "ApkManager.h"
 #include "CrossDexRefMinimizer.h"
@@ -19,6 +21,17 @@
 
 namespace interdex {
 
+/*
+ * The refs of a class itself, before any plugin adds to them, and its
+ * estimate_linear_alloc(). Each vector is sorted and free of duplicates.
+ */
+struct ClassRefs {
+  std::vector<DexMethodRef*> mrefs;
+  std::vector<DexFieldRef*> frefs;
+  std::vector<DexType*> trefs;
+  unsigned linear_alloc{0};
+};
+
 class InterDex {
  public:
   InterDex(const Scope& original_scope,
@@ -102,6 +115,12 @@ class InterDex {
  private:
   bool should_not_relocate_methods_of_class(const DexClass* clazz);
   void add_to_scope(DexClass* cls);
+
+  /**
+   * Gathers the refs of all classes in parallel, so that emitting them
+   * doesn't have to walk their code one by one.
+   */
+  void precompute_class_refs(const Scope& scope);
   bool should_skip_class_due_to_plugin(DexClass* clazz);
   bool should_skip_class_due_to_mixed_mode(const DexInfo& dex_info,
                                            DexClass* clazz);
@@ -159,6 +178,9 @@ class InterDex {
   const CrossDexRelocatorConfig m_cross_dex_relocator_config;
   const Scope& m_original_scope;
   CrossDexRelocator* m_cross_dex_relocator{nullptr};
+
+  // Refs of the classes that weren't changed since they were gathered.
+  std::unordered_map<const DexClass*, ClassRefs> m_class_refs;
 };
 
 } // namespace interdex
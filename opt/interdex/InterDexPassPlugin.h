@@ -58,6 +58,11 @@ class InterDexPassPlugin {
     return empty;
   }
 
+  // Whether additional_classes may change the code of classes that are yet
+  // to be emitted, e.g. by merging the types they refer to. If so, InterDex
+  // can't reuse the refs it gathered for them up front.
+  virtual bool additional_classes_rewrite_code() { return true; }
+
   // Return classes that should be added at the end. None, by default.
   virtual DexClasses leftover_classes() {
     DexClasses empty;
@@ -0,0 +1,502 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * This optimizer pass hoists loop-invariant computations out of loops, which
+ * is the case of partial redundancy elimination that matters the most at
+ * runtime: a computation in a loop that doesn't depend on the iteration is
+ * redundant on every iteration but the first.
+ *
+ * For every natural loop, innermost loops first, it looks for instructions
+ * whose sources aren't redefined in the loop, or only by other invariant
+ * instructions that dominate them. Some of them can be executed
+ * speculatively, even if the loop wouldn't have executed them:
+ * - arithmetic that can't throw,
+ * - reads of static fields of the method's own class, which is already
+ *   initialized, and
+ * - reads of instance fields of `this`.
+ * Other reads, like array-length, aget, and reads of static fields of other
+ * classes or of fields of other objects, may throw. They are only hoisted
+ * when they are the first thing the loop header does that may throw or has a
+ * side effect, so that they would have thrown at the same point anyway.
+ *
+ * Reads of fields and array elements are only hoisted out of loops that have
+ * no barrier, as defined by the shared state of CSE, so they can't observe a
+ * write in the loop. Final fields outside of constructors and array lengths
+ * can't change, so they don't need that.
+ *
+ * A hoisted instruction computes its result into a temp register in a
+ * preheader block that is inserted before the loop header, and the original
+ * instruction is replaced by a move from the temp. Hoisted instructions that
+ * compute the same value, as identified by CSE's IRValue, share the same
+ * temp. The moves are usually eliminated by copy-propagation, and local dce
+ * removes what becomes dead; both run on a method's code immediately if
+ * anything was hoisted.
+ *
+ * Notes:
+ * - The temps are live throughout the loop, so hoisting may increase register
+ *   pressure.
+ * - Divisions are never hoisted; a loop that guards against a zero divisor
+ *   usually does so in the loop.
+ */
+
+#include "LoopInvariantCodeMotion.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "CopyPropagationPass.h"
+#include "DexClass.h"
+#include "Dominators.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "LocalDce.h"
+#include "Resolver.h"
+#include "Walkers.h"
+
+using namespace cse_impl;
+
+namespace {
+
+constexpr const char* METRIC_LOOPS_HOISTED_FROM = "num_loops_hoisted_from";
+constexpr const char* METRIC_INSTRUCTIONS_HOISTED = "num_instructions_hoisted";
+constexpr const char* METRIC_INSTRUCTIONS_SHARED = "num_instructions_shared";
+
+bool is_hoistable_arithmetic(IROpcode op) {
+  return ((op >= OPCODE_CMPL_FLOAT && op <= OPCODE_CMP_LONG) ||
+          (op >= OPCODE_NEG_INT && op <= OPCODE_USHR_INT_LIT8)) &&
+         !opcode::may_throw(op);
+}
+
+IROpcode move_opcode_for(const IRInstruction* def) {
+  if (def->dest_is_wide()) {
+    return OPCODE_MOVE_WIDE;
+  }
+  return def->opcode() == IOPCODE_MOVE_RESULT_PSEUDO_OBJECT
+             ? OPCODE_MOVE_OBJECT
+             : OPCODE_MOVE;
+}
+
+// An invariant instruction of a loop, and where it defines its result, which
+// is at its move-result-pseudo for field reads.
+struct Invariant {
+  cfg::InstructionIterator it;
+  cfg::InstructionIterator def_it;
+  // The sources to compute the result with in the preheader.
+  std::vector<uint32_t> srcs;
+  uint32_t temp;
+  // Whether another invariant instruction already computes the same value.
+  bool shared;
+};
+
+} // namespace
+
+LoopInvariantCodeMotion::LoopInvariantCodeMotion(
+    const CommonSubexpressionElimination::SharedState* shared_state,
+    const DexMethod* method,
+    cfg::ControlFlowGraph& cfg)
+    : m_shared_state(shared_state), m_method(method), m_cfg(cfg) {
+  if (is_static(method)) {
+    return;
+  }
+  auto params = cfg.get_param_instructions();
+  if (params.empty()) {
+    return;
+  }
+  auto this_reg = params.begin()->insn->dest();
+  for (const auto& mie : cfg::InstructionIterable(cfg)) {
+    auto insn = mie.insn;
+    if (insn->dests_size() && !opcode::is_load_param(insn->opcode()) &&
+        (insn->dest() == this_reg ||
+         (insn->dest_is_wide() && insn->dest() + 1 == this_reg))) {
+      return;
+    }
+  }
+  m_this_reg = this_reg;
+}
+
+std::vector<LoopInvariantCodeMotion::Loop> LoopInvariantCodeMotion::find_loops(
+    const cfg::ControlFlowGraph& cfg) {
+  auto dominators = cfg.dominators();
+  std::vector<Loop> loops;
+  for (auto header : cfg.blocks()) {
+    if (!dominators->is_reachable(header)) {
+      continue;
+    }
+    // A back edge goes to a block that dominates its source. The loop is the
+    // header, and what reaches the sources of its back edges without going
+    // through it.
+    std::unordered_set<cfg::Block*> blocks{header};
+    std::vector<cfg::Block*> worklist;
+    bool has_back_edge = false;
+    for (auto e : header->preds()) {
+      auto src = e->src();
+      if (dominators->is_reachable(src) && dominators->dominates(header, src)) {
+        has_back_edge = true;
+        if (blocks.insert(src).second) {
+          worklist.push_back(src);
+        }
+      }
+    }
+    if (!has_back_edge) {
+      continue;
+    }
+    while (!worklist.empty()) {
+      auto block = worklist.back();
+      worklist.pop_back();
+      for (auto e : block->preds()) {
+        auto src = e->src();
+        if (dominators->is_reachable(src) && blocks.insert(src).second) {
+          worklist.push_back(src);
+        }
+      }
+    }
+    Loop loop{header, std::vector<cfg::Block*>(blocks.begin(), blocks.end())};
+    std::sort(loop.blocks.begin(), loop.blocks.end(),
+              [](const cfg::Block* a, const cfg::Block* b) {
+                return a->id() < b->id();
+              });
+    loops.push_back(std::move(loop));
+  }
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const Loop& a, const Loop& b) {
+                     return a.blocks.size() < b.blocks.size();
+                   });
+  return loops;
+}
+
+bool LoopInvariantCodeMotion::run() {
+  bool changed = false;
+  std::unordered_set<const cfg::Block*> visited_headers;
+  // Hoisting inserts a preheader, so the loops are found again afterwards;
+  // the preheader of an inner loop is then part of the outer ones.
+  for (bool again = true; again;) {
+    again = false;
+    for (const auto& loop : find_loops(m_cfg)) {
+      if (visited_headers.insert(loop.header).second && hoist(loop)) {
+        changed = again = true;
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+uint8_t LoopInvariantCodeMotion::get_hoisting(
+    const IRInstruction* insn) const {
+  auto op = insn->opcode();
+  if (is_hoistable_arithmetic(op)) {
+    return HOISTABLE | SPECULATIVE;
+  }
+  if (op == OPCODE_ARRAY_LENGTH) {
+    return HOISTABLE;
+  }
+  if (is_aget(op)) {
+    return HOISTABLE | READS_HEAP;
+  }
+  if (!is_iget(op) && !is_sget(op)) {
+    return NOT_HOISTABLE;
+  }
+  if (m_shared_state->is_barrier(insn)) {
+    // The field is volatile, or unknown.
+    return NOT_HOISTABLE;
+  }
+  auto field = resolve_field(insn->get_field(), is_sget(op)
+                                                    ? FieldSearch::Static
+                                                    : FieldSearch::Instance);
+  uint8_t hoisting = HOISTABLE;
+  // Final fields are only written by the constructors of their class.
+  if (!is_final(field) || is_any_init(m_method)) {
+    hoisting |= READS_HEAP;
+  }
+  if (is_sget(op) ? field->get_class() == m_method->get_class()
+                  : m_this_reg && insn->src(0) == *m_this_reg) {
+    hoisting |= SPECULATIVE;
+  }
+  return hoisting;
+}
+
+bool LoopInvariantCodeMotion::hoist(const Loop& loop) {
+  auto header = loop.header;
+  if (header == m_cfg.entry_block()) {
+    return false;
+  }
+  std::unordered_set<const cfg::Block*> in_loop(loop.blocks.begin(),
+                                                loop.blocks.end());
+  std::vector<cfg::Edge*> entry_edges;
+  for (auto e : header->preds()) {
+    if (in_loop.count(e->src())) {
+      continue;
+    }
+    // Throw edges can't be redirected to a preheader.
+    if (e->type() != cfg::EDGE_GOTO && e->type() != cfg::EDGE_BRANCH) {
+      return false;
+    }
+    entry_edges.push_back(e);
+  }
+  if (entry_edges.empty()) {
+    return false;
+  }
+
+  // Count the definitions of every register in the loop, and remember the
+  // position of every instruction in its block, to tell whether a definition
+  // dominates a use.
+  std::unordered_map<uint32_t, uint32_t> num_defs;
+  std::unordered_map<const IRInstruction*, uint32_t> positions;
+  std::vector<std::pair<cfg::InstructionIterator, uint8_t>> candidates;
+  bool has_barrier = false;
+  for (auto block : loop.blocks) {
+    uint32_t position = 0;
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      positions.emplace(insn, position++);
+      if (insn->dests_size()) {
+        num_defs[insn->dest()]++;
+        if (insn->dest_is_wide()) {
+          num_defs[insn->dest() + 1]++;
+        }
+      }
+      has_barrier = has_barrier || m_shared_state->is_barrier(insn);
+      auto hoisting = get_hoisting(insn);
+      if (hoisting != NOT_HOISTABLE) {
+        candidates.emplace_back(block->to_cfg_instruction_iterator(mie),
+                                hoisting);
+      }
+    }
+  }
+  if (has_barrier) {
+    candidates.erase(
+        std::remove_if(candidates.begin(), candidates.end(),
+                       [](const std::pair<cfg::InstructionIterator, uint8_t>&
+                              candidate) {
+                         return candidate.second & READS_HEAP;
+                       }),
+        candidates.end());
+  }
+  if (candidates.empty()) {
+    return false;
+  }
+
+  // The instructions of the header that may throw or have a side effect, in
+  // order. An instruction that isn't speculative can only be hoisted if those
+  // before it are hoisted too. That's moot if the header is in a try region.
+  std::vector<const IRInstruction*> header_effects;
+  auto header_throws =
+      m_cfg.get_succ_edge_of_type(header, cfg::EDGE_THROW) != nullptr;
+  if (!header_throws) {
+    for (auto& mie : InstructionIterable(header)) {
+      auto insn = mie.insn;
+      if (opcode::can_throw(insn->opcode()) ||
+          m_shared_state->is_barrier(insn)) {
+        header_effects.push_back(insn);
+      }
+    }
+  }
+  std::unordered_set<const IRInstruction*> hoisted;
+  auto runs_first = [&](const IRInstruction* insn) {
+    for (auto effect : header_effects) {
+      if (effect == insn) {
+        return true;
+      }
+      if (!hoisted.count(effect)) {
+        return false;
+      }
+    }
+    return false;
+  };
+
+  auto dominators = m_cfg.dominators();
+  auto num_defs_of = [&](uint32_t reg) {
+    auto it = num_defs.find(reg);
+    return it == num_defs.end() ? 0 : it->second;
+  };
+  // The invariant instructions, in an order where each one comes after those
+  // it depends on, and which of them defines a register.
+  std::vector<Invariant> invariants;
+  std::unordered_map<uint32_t, size_t> invariant_defs;
+  std::unordered_map<IRValue, uint32_t, IRValueHasher> temps;
+
+  // Gives the register that holds the same value as `reg` does at `user`, but
+  // before the loop, if there is one.
+  auto get_invariant_src =
+      [&](const cfg::InstructionIterator& user, uint32_t reg,
+          bool wide) -> boost::optional<uint32_t> {
+    if (num_defs_of(reg) == 0 && (!wide || num_defs_of(reg + 1) == 0)) {
+      return reg;
+    }
+    auto it = invariant_defs.find(reg);
+    if (it == invariant_defs.end() || num_defs_of(reg) != 1) {
+      return boost::none;
+    }
+    const auto& def = invariants[it->second];
+    auto def_insn = def.def_it->insn;
+    if (def_insn->dest_is_wide() != wide ||
+        (wide && num_defs_of(reg + 1) != 1)) {
+      return boost::none;
+    }
+    // With a single definition in the loop, the value is the invariant one
+    // wherever that definition dominates.
+    auto def_block = def.def_it.block();
+    auto user_block = user.block();
+    bool dominates =
+        def_block == user_block
+            ? positions.at(def_insn) < positions.at(user->insn)
+            : dominators->dominates(def_block, user_block);
+    if (!dominates) {
+      return boost::none;
+    }
+    return def.temp;
+  };
+
+  std::vector<bool> done(candidates.size());
+  for (bool progress = true; progress;) {
+    progress = false;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      if (done[i]) {
+        continue;
+      }
+      const auto& it = candidates[i].first;
+      auto insn = it->insn;
+      if (!(candidates[i].second & SPECULATIVE) && !runs_first(insn)) {
+        continue;
+      }
+      std::vector<uint32_t> srcs;
+      srcs.reserve(insn->srcs_size());
+      for (size_t j = 0; j < insn->srcs_size(); ++j) {
+        auto src = get_invariant_src(it, insn->src(j), insn->src_is_wide(j));
+        if (!src) {
+          break;
+        }
+        srcs.push_back(*src);
+      }
+      if (srcs.size() != insn->srcs_size()) {
+        continue;
+      }
+      done[i] = true;
+      auto def_it =
+          insn->has_move_result_pseudo() ? m_cfg.move_result_of(it) : it;
+      auto def_insn = def_it->insn;
+      if (!positions.count(def_insn)) {
+        // The loop is left before the result is defined.
+        continue;
+      }
+      progress = true;
+      hoisted.insert(insn);
+
+      IRValue value;
+      value.opcode = insn->opcode();
+      value.srcs = srcs;
+      if (opcode::is_commutative(value.opcode)) {
+        std::sort(value.srcs.begin(), value.srcs.end());
+      }
+      if (insn->has_literal()) {
+        value.literal = insn->get_literal();
+      } else if (insn->has_field()) {
+        value.field = insn->get_field();
+      }
+      bool shared = true;
+      auto temp_it = temps.find(value);
+      if (temp_it == temps.end()) {
+        auto temp = def_insn->dest_is_wide() ? m_cfg.allocate_wide_temp()
+                                             : m_cfg.allocate_temp();
+        temp_it = temps.emplace(std::move(value), temp).first;
+        shared = false;
+      }
+      invariant_defs[def_insn->dest()] = invariants.size();
+      invariants.push_back(
+          Invariant{it, def_it, std::move(srcs), temp_it->second, shared});
+    }
+  }
+  if (invariants.empty()) {
+    return false;
+  }
+
+  auto preheader = m_cfg.create_block();
+  for (auto e : entry_edges) {
+    m_cfg.set_edge_target(e, preheader);
+  }
+  m_cfg.add_edge(preheader, header, cfg::EDGE_GOTO);
+
+  for (auto& invariant : invariants) {
+    auto insn = invariant.it->insn;
+    auto def_insn = invariant.def_it->insn;
+    if (!invariant.shared) {
+      auto copy = new IRInstruction(*insn);
+      for (size_t i = 0; i < invariant.srcs.size(); ++i) {
+        copy->set_src(i, invariant.srcs[i]);
+      }
+      if (insn->has_move_result_pseudo()) {
+        auto move_result = new IRInstruction(def_insn->opcode());
+        move_result->set_dest(invariant.temp);
+        preheader->push_back({copy, move_result});
+      } else {
+        copy->set_dest(invariant.temp);
+        preheader->push_back(copy);
+      }
+    } else {
+      m_stats.instructions_shared++;
+    }
+    TRACE(LICM, 4, "[LICM] hoisting %s into v%u\n", SHOW(insn),
+          invariant.temp);
+
+    auto move = new IRInstruction(move_opcode_for(def_insn));
+    move->set_src(0, invariant.temp)->set_dest(def_insn->dest());
+    m_cfg.insert_after(invariant.def_it, move);
+    m_cfg.remove_insn(invariant.it);
+  }
+
+  m_stats.loops_hoisted_from++;
+  m_stats.instructions_hoisted += invariants.size();
+  return true;
+}
+
+void LoopInvariantCodeMotionPass::run_pass(DexStoresVector& stores,
+                                           ConfigFiles& /* conf */,
+                                           PassManager& mgr) {
+  const auto scope = build_class_scope(stores);
+  CommonSubexpressionElimination::SharedState shared_state;
+  shared_state.init_scope(scope);
+
+  const auto stats =
+      walk::parallel::reduce_methods<LoopInvariantCodeMotion::Stats>(
+          scope,
+          [&](DexMethod* method) {
+            const auto code = method->get_code();
+            if (code == nullptr) {
+              return LoopInvariantCodeMotion::Stats();
+            }
+
+            TRACE(LICM, 3, "[LICM] processing %s\n", SHOW(method));
+            code->build_cfg(/* editable */ true);
+            LoopInvariantCodeMotion licm(&shared_state, method, code->cfg());
+            bool any_changes = licm.run();
+            code->clear_cfg();
+            if (any_changes) {
+              CopyPropagationPass::Config config;
+              copy_propagation_impl::CopyPropagation copy_propagation(config);
+              copy_propagation.run(code, method);
+
+              std::unordered_set<DexMethodRef*> pure_methods;
+              auto local_dce = LocalDce(pure_methods);
+              local_dce.dce(code);
+            }
+            return licm.get_stats();
+          },
+          [](LoopInvariantCodeMotion::Stats a,
+             LoopInvariantCodeMotion::Stats b) {
+            a.loops_hoisted_from += b.loops_hoisted_from;
+            a.instructions_hoisted += b.instructions_hoisted;
+            a.instructions_shared += b.instructions_shared;
+            return a;
+          });
+  mgr.incr_metric(METRIC_LOOPS_HOISTED_FROM, stats.loops_hoisted_from);
+  mgr.incr_metric(METRIC_INSTRUCTIONS_HOISTED, stats.instructions_hoisted);
+  mgr.incr_metric(METRIC_INSTRUCTIONS_SHARED, stats.instructions_shared);
+}
+
+static LoopInvariantCodeMotionPass s_pass;
@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/optional.hpp>
+#include <vector>
+
+#include "CommonSubexpressionElimination.h"
+#include "ControlFlow.h"
+#include "Pass.h"
+
+class LoopInvariantCodeMotion {
+ public:
+  struct Stats {
+    size_t loops_hoisted_from{0};
+    size_t instructions_hoisted{0};
+    // Hoisted instructions that computed the same value as another one hoisted
+    // out of the same loop, and share its result.
+    size_t instructions_shared{0};
+  };
+
+  struct Loop {
+    cfg::Block* header;
+    // Including the header, ordered by id.
+    std::vector<cfg::Block*> blocks;
+  };
+
+  /*
+   * The shared state of CSE decides which instructions are barriers; field
+   * reads are only hoisted out of loops without any.
+   */
+  LoopInvariantCodeMotion(
+      const CommonSubexpressionElimination::SharedState* shared_state,
+      const DexMethod* method,
+      cfg::ControlFlowGraph& cfg);
+
+  /*
+   * Hoists the invariant instructions of every loop, innermost loops first.
+   * Returns whether anything was hoisted.
+   */
+  bool run();
+
+  const Stats& get_stats() const { return m_stats; }
+
+  /*
+   * The natural loops of the graph, where the loops that share a header are
+   * merged, sorted by increasing size so that inner loops come first.
+   */
+  static std::vector<Loop> find_loops(const cfg::ControlFlowGraph& cfg);
+
+ private:
+  enum Hoisting : uint8_t {
+    NOT_HOISTABLE = 0,
+    HOISTABLE = 1 << 0,
+    // Can't throw, so it may run even where the loop wouldn't have run it.
+    // Otherwise it's only hoisted if it runs first thing in the loop.
+    SPECULATIVE = 1 << 1,
+    // Reads memory that a barrier in the loop may write.
+    READS_HEAP = 1 << 2,
+  };
+
+  bool hoist(const Loop& loop);
+  uint8_t get_hoisting(const IRInstruction* insn) const;
+
+  const CommonSubexpressionElimination::SharedState* m_shared_state;
+  const DexMethod* m_method;
+  cfg::ControlFlowGraph& m_cfg;
+  // The register holding `this`, if it is never redefined; reading an
+  // instance field of it can't throw.
+  boost::optional<uint32_t> m_this_reg;
+  Stats m_stats;
+};
+
+class LoopInvariantCodeMotionPass : public Pass {
+ public:
+  LoopInvariantCodeMotionPass() : Pass("LoopInvariantCodeMotionPass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+};
@@ -14,14 +14,18 @@
 
 #include <boost/dynamic_bitset.hpp>
 
+#include "CallGraph.h"
 #include "ControlFlow.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
 #include "DexUtil.h"
+#include "LocalPointersAnalysis.h"
 #include "Resolver.h"
+#include "SideEffectSummary.h"
 #include "Transform.h"
+#include "VirtualScope.h"
 #include "Walkers.h"
 
 namespace {
@@ -29,6 +33,7 @@ namespace {
 constexpr const char* METRIC_DEAD_INSTRUCTIONS = "num_dead_instructions";
 constexpr const char* METRIC_UNREACHABLE_INSTRUCTIONS =
     "num_unreachable_instructions";
+constexpr const char* METRIC_PURE_METHODS = "num_pure_methods";
 
 /*
  * These instructions have observable side effects so must always be considered
@@ -139,66 +144,96 @@ void LocalDce::dce(IRCode* code) {
   auto& cfg = code->cfg();
   auto blocks = cfg::postorder_sort(cfg.blocks());
   auto regs = code->get_registers_size();
-  std::unordered_map<cfg::BlockId, boost::dynamic_bitset<>> liveness;
-  for (cfg::Block* b : blocks) {
-    liveness.emplace(b->id(), boost::dynamic_bitset<>(regs + 1));
+  std::unordered_map<cfg::BlockId, size_t> block_indices;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    block_indices.emplace(blocks[i]->id(), i);
   }
-  bool changed;
+  // Resolving the callees is the costly part of telling whether an invoke is
+  // required, so it is done once rather than on every visit of its block.
+  std::unordered_set<const IRInstruction*> pure_invokes;
+  for (const auto& mie : cfg::InstructionIterable(cfg)) {
+    auto insn = mie.insn;
+    if (is_invoke(insn->opcode())) {
+      auto meth = resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (meth != nullptr && is_pure(insn->get_method(), meth)) {
+        pure_invokes.emplace(insn);
+      }
+    }
+  }
+  // The live-in registers of each block of `blocks`, by position.
+  std::vector<boost::dynamic_bitset<>> liveness(
+      blocks.size(), boost::dynamic_bitset<>(regs + 1));
+  boost::dynamic_bitset<> bliveness(regs + 1);
   std::vector<std::pair<cfg::Block*, IRList::iterator>> dead_instructions;
 
   TRACE(DCE, 5, "%s", SHOW(cfg));
 
-  // Iterate liveness analysis to a fixed point.
-  do {
-    changed = false;
-    dead_instructions.clear();
-    for (auto& b : blocks) {
-      auto prev_liveness = liveness.at(b->id());
-      auto& bliveness = liveness.at(b->id());
-      bliveness.reset();
-      TRACE(DCE, 5, "B%lu: %s\n", b->id(), show(bliveness).c_str());
+  // Computes the live-in registers of `b` into `bliveness`, and the dead
+  // instructions of `b` if `dead` isn't null.
+  auto analyze_block = [&](cfg::Block* b, decltype(dead_instructions)* dead) {
+    bliveness.reset();
+    // Compute live-out for this block from its successors.
+    for (auto& s : b->succs()) {
+      TRACE(DCE,
+            5,
+            "  S%lu: %s\n",
+            s->target()->id(),
+            show(liveness[block_indices.at(s->target()->id())]).c_str());
+      bliveness |= liveness[block_indices.at(s->target()->id())];
+    }
 
-      // Compute live-out for this block from its successors.
-      for (auto& s : b->succs()) {
-        if (s->target()->id() == b->id()) {
-          bliveness |= prev_liveness;
-        }
-        TRACE(DCE,
-              5,
-              "  S%lu: %s\n",
-              s->target()->id(),
-              SHOW(liveness.at(s->target()->id())));
-        bliveness |= liveness.at(s->target()->id());
+    // Compute live-in for this block by walking its instruction list in
+    // reverse and applying the liveness rules.
+    for (auto it = b->rbegin(); it != b->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      bool required = is_required(cfg, b, it->insn, pure_invokes, bliveness);
+      if (required) {
+        update_liveness(it->insn, bliveness);
+      } else if (dead != nullptr &&
+                 !opcode::is_move_result_pseudo(it->insn->opcode())) {
+        // move-result-pseudo instructions will be automatically removed
+        // when their primary instruction is deleted.
+        auto forward_it = std::prev(it.base());
+        dead->emplace_back(b, forward_it);
       }
+      TRACE(CFG,
+            5,
+            "%s\n%s\n",
+            show(it->insn).c_str(),
+            show(bliveness).c_str());
+    }
+  };
 
-      // Compute live-in for this block by walking its instruction list in
-      // reverse and applying the liveness rules.
-      for (auto it = b->rbegin(); it != b->rend(); ++it) {
-        if (it->type != MFLOW_OPCODE) {
-          continue;
-        }
-        bool required = is_required(cfg, b, it->insn, bliveness);
-        if (required) {
-          update_liveness(it->insn, bliveness);
-        } else {
-          // move-result-pseudo instructions will be automatically removed
-          // when their primary instruction is deleted.
-          if (!opcode::is_move_result_pseudo(it->insn->opcode())) {
-            auto forward_it = std::prev(it.base());
-            dead_instructions.emplace_back(b, forward_it);
-          }
-        }
-        TRACE(CFG,
-              5,
-              "%s\n%s\n",
-              show(it->insn).c_str(),
-              show(bliveness).c_str());
+  // Iterate liveness analysis to a fixed point. A block only needs another
+  // visit when the liveness of one of its successors changed since its last.
+  boost::dynamic_bitset<> pending(blocks.size());
+  pending.set();
+  while (pending.any()) {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      if (!pending.test(i)) {
+        continue;
+      }
+      pending.reset(i);
+      auto b = blocks[i];
+      TRACE(DCE, 5, "B%lu: %s\n", b->id(), show(liveness[i]).c_str());
+      analyze_block(b, nullptr);
+      if (bliveness == liveness[i]) {
+        continue;
       }
-      if (bliveness != prev_liveness) {
-        changed = true;
+      liveness[i].swap(bliveness);
+      for (auto& p : b->preds()) {
+        auto pred_it = block_indices.find(p->src()->id());
+        if (pred_it != block_indices.end()) {
+          pending.set(pred_it->second);
+        }
       }
     }
-  } while (changed);
+  }
+  for (auto b : blocks) {
+    analyze_block(b, &dead_instructions);
+  }
 
   // Remove dead instructions.
   std::unordered_set<IRInstruction*> seen;
@@ -227,18 +262,15 @@ void LocalDce::dce(IRCode* code) {
  * An instruction is required (i.e., live) if it has side effects or if its
  * destination register is live.
  */
-bool LocalDce::is_required(cfg::ControlFlowGraph& cfg,
-                           cfg::Block* b,
-                           IRInstruction* inst,
-                           const boost::dynamic_bitset<>& bliveness) {
+bool LocalDce::is_required(
+    cfg::ControlFlowGraph& cfg,
+    cfg::Block* b,
+    IRInstruction* inst,
+    const std::unordered_set<const IRInstruction*>& pure_invokes,
+    const boost::dynamic_bitset<>& bliveness) {
   if (has_side_effects(inst->opcode())) {
     if (is_invoke(inst->opcode())) {
-      const auto meth =
-          resolve_method(inst->get_method(), opcode_to_search(inst));
-      if (meth == nullptr) {
-        return true;
-      }
-      if (!is_pure(inst->get_method(), meth)) {
+      if (pure_invokes.count(inst) == 0) {
         return true;
       }
       return bliveness.test(bliveness.size() - 1);
@@ -275,7 +307,8 @@ bool LocalDce::is_pure(DexMethodRef* ref, DexMethod* meth) {
   if (assumenosideeffects(meth)) {
     return true;
   }
-  return m_pure_methods.find(ref) != m_pure_methods.end();
+  return m_pure_methods.find(ref) != m_pure_methods.end() ||
+         m_pure_methods.find(meth) != m_pure_methods.end();
 }
 
 void LocalDcePass::run(IRCode* code) {
@@ -291,8 +324,14 @@ void LocalDcePass::run_pass(DexStoresVector& stores,
           "provided.\n");
     return;
   }
-  const auto& pure_methods = find_pure_methods();
   auto scope = build_class_scope(stores);
+  if (m_pure_methods == nullptr) {
+    m_pure_methods = std::make_unique<std::unordered_set<DexMethodRef*>>(
+        m_use_side_effect_summaries ? derive_pure_methods(scope)
+                                    : find_pure_methods());
+    mgr.set_metric(METRIC_PURE_METHODS, m_pure_methods->size());
+  }
+  const auto& pure_methods = *m_pure_methods;
   auto stats = walk::parallel::reduce_methods<LocalDce::Stats>(
       scope,
       [&](DexMethod* m) {
@@ -331,4 +370,40 @@ std::unordered_set<DexMethodRef*> LocalDcePass::find_pure_methods() {
   return pure_methods;
 }
 
+std::unordered_set<DexMethodRef*> LocalDcePass::derive_pure_methods(
+    const Scope& scope) {
+  auto pure_methods = find_pure_methods();
+  walk::parallel::code(scope, [](const DexMethod*, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+    code.cfg().calculate_exit_block();
+  });
+  auto call_graph = call_graph::single_callee_graph(scope);
+  auto ptrs_fp_iter_map = local_pointers::analyze_scope(scope, call_graph);
+  side_effects::SummaryMap effect_summaries;
+  side_effects::analyze_scope(scope, call_graph, *ptrs_fp_iter_map,
+                              &effect_summaries);
+  ptrs_fp_iter_map.reset();
+  walk::parallel::code(
+      scope, [](const DexMethod*, IRCode& code) { code.clear_cfg(); });
+
+  // The call graph only resolves the calls of virtual methods that nothing
+  // overrides, and neither can we.
+  auto non_virtual_vec = devirtualize(scope);
+  std::unordered_set<const DexMethodRef*> non_virtual(non_virtual_vec.begin(),
+                                                      non_virtual_vec.end());
+  for (const auto& pair : effect_summaries) {
+    const auto& summary = pair.second;
+    if (summary.effects != side_effects::EFF_NONE ||
+        !summary.modified_params.empty() || !pair.first->is_def()) {
+      continue;
+    }
+    auto method = static_cast<const DexMethod*>(pair.first);
+    if (method->is_virtual() && non_virtual.count(method) == 0) {
+      continue;
+    }
+    pure_methods.emplace(const_cast<DexMethod*>(method));
+  }
+  return pure_methods;
+}
+
 static LocalDcePass s_pass;
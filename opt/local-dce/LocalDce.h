@@ -9,6 +9,9 @@
 
 #include "Pass.h"
 
+#include <memory>
+#include <unordered_set>
+
 #include <boost/dynamic_bitset.hpp>
 
 class LocalDce {
@@ -32,10 +35,11 @@ class LocalDce {
    *   An instruction's input registers are live if (a) it has side effects, or
    *   (b) its output registers are live.
    *
-   * - If the liveness of any block changes during a pass, repeat it.  Since
-   *   anything live in one pass is guaranteed to be live in the next, this is
-   *   guaranteed to reach a fixed point and terminate.  Visiting blocks in
-   *   postorder guarantees a minimum number of passes.
+   * - If the liveness of any block changes during a pass, repeat it for the
+   *   predecessors of that block.  Since anything live in one pass is
+   *   guaranteed to be live in the next, this is guaranteed to reach a fixed
+   *   point and terminate.  Visiting blocks in postorder guarantees a minimum
+   *   number of passes.
    *
    * - Catch blocks are handled slightly differently; since any instruction
    *   inside a `try` region can jump to a catch block, we assume that any
@@ -58,6 +62,7 @@ class LocalDce {
   bool is_required(cfg::ControlFlowGraph& cfg,
                    cfg::Block* b,
                    IRInstruction* inst,
+                   const std::unordered_set<const IRInstruction*>& pure_invokes,
                    const boost::dynamic_bitset<>& bliveness);
   bool is_pure(DexMethodRef* ref, DexMethod* meth);
 };
@@ -66,10 +71,29 @@ class LocalDcePass : public Pass {
  public:
   LocalDcePass() : Pass("LocalDcePass") {}
 
+  void configure_pass(const JsonWrapper& jw) override {
+    // Also treats the methods that the side effect analysis of
+    // ObjectSensitiveDcePass finds to be pure as such.
+    jw.get("use_side_effect_summaries", false, m_use_side_effect_summaries);
+  }
+
   static void run(IRCode* code);
 
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
+  /*
+   * The methods of `scope` that have no side effects and that no other method
+   * overrides, along with the ones that find_pure_methods() lists.
+   */
+  static std::unordered_set<DexMethodRef*> derive_pure_methods(
+      const Scope& scope);
+
  private:
   static std::unordered_set<DexMethodRef*> find_pure_methods();
+
+  bool m_use_side_effect_summaries{false};
+  // Derived the first time the pass runs, and kept for its later runs in the
+  // pipeline. Optimizations don't give a method side effects that it didn't
+  // have, and the methods they create are simply not in it.
+  std::unique_ptr<std::unordered_set<DexMethodRef*>> m_pure_methods;
 };
@@ -0,0 +1,477 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PartialInline.h"
+
+#include <algorithm>
+
+#include "CFGInliner.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "PassManager.h"
+#include "Resolver.h"
+#include "Show.h"
+#include "Walkers.h"
+
+namespace {
+
+constexpr const char* METRIC_CALLEES_SPLIT = "num_callees_split";
+constexpr const char* METRIC_CALLS_INLINED = "num_partially_inlined_calls";
+constexpr const char* METRIC_CALLS_OVER_BUDGET = "num_calls_over_budget";
+
+using InstructionHits = BasicBlockLayoutPass::InstructionHits;
+
+// A callee whose fast path can be inlined.
+struct Candidate {
+  // The side of the guard that leads to the rest of the callee.
+  cfg::EdgeType cold_edge;
+  size_t fast_path_size;
+};
+
+using Candidates = std::unordered_map<DexMethod*, Candidate>;
+
+// The calls that ran, by caller.
+using HotCalls =
+    std::unordered_map<DexMethod*,
+                       std::vector<std::pair<IRInstruction*, DexMethod*>>>;
+
+struct Analysis {
+  Candidates candidates;
+  HotCalls hot_calls;
+};
+
+// A candidate that got split.
+struct Split {
+  std::unique_ptr<IRCode> fast_path;
+  size_t fast_path_size;
+  // Whether the fast path only refers to public members of public classes,
+  // so that it can be inlined into any class.
+  bool is_public;
+};
+
+// The instructions that a guard may run before its branch; they have no side
+// effects, so the continuation can run them again.
+bool is_guard_insn(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (is_iget(op) || is_sget(op)) {
+    auto field = resolve_field(insn->get_field(),
+                               is_sget(op) ? FieldSearch::Static
+                                           : FieldSearch::Instance);
+    return field != nullptr && !is_volatile(field);
+  }
+  return is_const(op) || is_move(op) || opcode::is_move_result_pseudo(op) ||
+         op == OPCODE_ARRAY_LENGTH || op == OPCODE_INSTANCE_OF;
+}
+
+uint64_t block_hits(cfg::Block* block, const InstructionHits& insn_hits) {
+  uint64_t hits = 0;
+  for (const auto& mie : InstructionIterable(block)) {
+    auto it = insn_hits.find(mie.insn);
+    if (it != insn_hits.end() &&
+        BasicBlockLayoutPass::is_traced(mie.insn->opcode())) {
+      hits = std::max(hits, it->second);
+    }
+  }
+  return hits;
+}
+
+boost::optional<Candidate> find_fast_path(
+    cfg::ControlFlowGraph& cfg,
+    const InstructionHits& insn_hits,
+    const PartialInlinePass::Config& config) {
+  for (auto block : cfg.blocks()) {
+    if (cfg.get_succ_edge_of_type(block, cfg::EDGE_THROW) != nullptr) {
+      return boost::none;
+    }
+  }
+  auto entry = cfg.entry_block();
+  if (entry->branchingness() != opcode::BRANCH_IF) {
+    return boost::none;
+  }
+
+  // The continuation gets the parameters of the callee, so the guard must
+  // leave them alone.
+  std::unordered_set<uint16_t> params;
+  size_t size = 0;
+  for (const auto& mie : InstructionIterable(entry)) {
+    auto insn = mie.insn;
+    if (opcode::is_load_param(insn->opcode())) {
+      params.insert(insn->dest());
+      continue;
+    }
+    size++;
+    if (is_conditional_branch(insn->opcode())) {
+      continue;
+    }
+    if (!is_guard_insn(insn)) {
+      return boost::none;
+    }
+    if (insn->dests_size() &&
+        (params.count(insn->dest()) ||
+         (insn->dest_is_wide() && params.count(insn->dest() + 1)))) {
+      return boost::none;
+    }
+  }
+
+  auto entry_hits = block_hits(entry, insn_hits);
+  if (entry_hits == 0) {
+    return boost::none;
+  }
+  auto hot = cfg.get_succ_edge_of_type(entry, cfg::EDGE_GOTO);
+  auto cold = cfg.get_succ_edge_of_type(entry, cfg::EDGE_BRANCH);
+  if (block_hits(cold->target(), insn_hits) >
+      block_hits(hot->target(), insn_hits)) {
+    std::swap(hot, cold);
+  }
+  if (block_hits(hot->target(), insn_hits) * 100 <
+      entry_hits * config.min_fast_path_percent) {
+    return boost::none;
+  }
+
+  // Follow the hot side down to its return.
+  std::unordered_set<cfg::Block*> fast_path{entry};
+  auto block = hot->target();
+  while (true) {
+    if (!fast_path.insert(block).second) {
+      return boost::none;
+    }
+    size += block->num_opcodes();
+    auto branchingness = block->branchingness();
+    if (branchingness == opcode::BRANCH_RETURN) {
+      break;
+    }
+    if (branchingness != opcode::BRANCH_GOTO) {
+      return boost::none;
+    }
+    block = block->succs()[0]->target();
+  }
+  if (fast_path.count(cold->target())) {
+    return boost::none;
+  }
+
+  // The call to the continuation, its move-result and the return.
+  size += 3;
+  if (size > config.max_fast_path_size) {
+    return boost::none;
+  }
+  return Candidate{cold->type(), size};
+}
+
+bool has_invoke_super(const IRCode* code) {
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == OPCODE_INVOKE_SUPER) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool is_partially_inlinable(const DexMethod* method) {
+  // The fast path of a synchronized method would run without the lock.
+  if (method->rstate.no_optimizations() || is_native(method) ||
+      is_synchronized(method) || is_init(method) || is_clinit(method)) {
+    return false;
+  }
+  if (is_static(method)) {
+    return true;
+  }
+  // The continuation of a private instance method is static, where an
+  // invoke-super doesn't verify.
+  return !method->is_virtual() && method->get_code() != nullptr &&
+         !has_invoke_super(method->get_code());
+}
+
+// Finds the fast path of `method`, if it is a candidate, and the calls it
+// made that ran.
+Analysis analyze(DexMethod* method,
+                 const BasicBlockLayoutPass::MethodProfile& profile,
+                 const PartialInlinePass::Config& config) {
+  Analysis analysis;
+  auto code = method->get_code();
+  if (profile.block_hits.empty() || method->rstate.no_optimizations()) {
+    return analysis;
+  }
+  auto insn_hits = BasicBlockLayoutPass::get_instruction_hits(profile, code);
+  if (!insn_hits) {
+    return analysis;
+  }
+
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    if (!is_invoke(insn->opcode())) {
+      continue;
+    }
+    auto it = insn_hits->find(insn);
+    if (it == insn_hits->end() || it->second == 0) {
+      continue;
+    }
+    auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+    if (callee == nullptr || callee == method || !callee->is_concrete() ||
+        callee->get_code() == nullptr || !is_partially_inlinable(callee)) {
+      continue;
+    }
+    analysis.hot_calls[method].emplace_back(insn, callee);
+  }
+
+  if (is_partially_inlinable(method)) {
+    code->build_cfg(/* editable */ true);
+    auto candidate = find_fast_path(code->cfg(), *insn_hits, config);
+    code->clear_cfg();
+    if (candidate) {
+      analysis.candidates.emplace(method, *candidate);
+    }
+  }
+  return analysis;
+}
+
+// The successor of the entry block of `cfg` along an edge of `type`.
+cfg::Edge* guard_edge(cfg::ControlFlowGraph& cfg, cfg::EdgeType type) {
+  return cfg.get_succ_edge_of_type(cfg.entry_block(), type);
+}
+
+DexMethod* make_continuation(DexMethod* callee, const Candidate& candidate) {
+  auto code = std::make_unique<IRCode>(*callee->get_code());
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+  auto entry = cfg.entry_block();
+  auto cold_target = guard_edge(cfg, candidate.cold_edge)->target();
+  // Removing the branch leaves the goto edge, so point that to the cold side.
+  cfg.set_edge_target(guard_edge(cfg, cfg::EDGE_GOTO), cold_target);
+  cfg.remove_insn(entry->to_cfg_instruction_iterator(*entry->get_last_insn()));
+  cfg.remove_unreachable_blocks();
+  code->clear_cfg();
+
+  auto type = callee->get_class();
+  auto proto = callee->get_proto();
+  if (!is_static(callee)) {
+    auto args = proto->get_args()->get_type_list();
+    args.push_front(type);
+    proto = DexProto::make_proto(proto->get_rtype(),
+                                 DexTypeList::make_type_list(std::move(args)));
+  }
+  auto name = callee->get_name()->str() + "$cold";
+  for (size_t i = 1; DexMethod::get_method(type, DexString::make_string(name),
+                                           proto) != nullptr;
+       ++i) {
+    name = callee->get_name()->str() + "$cold" + std::to_string(i);
+  }
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method(type, DexString::make_string(name), proto));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, std::move(code),
+                        /* is_virtual */ false);
+  method->set_deobfuscated_name(show(method));
+  type_class(type)->add_method(method);
+  TRACE(MMINL, 3, "Split %s into a fast path and %s\n", SHOW(callee),
+        SHOW(method));
+  return method;
+}
+
+// The fast path of `callee`, with the cold side of its guard replaced by a
+// call to `continuation`.
+std::unique_ptr<IRCode> make_fast_path(DexMethod* callee,
+                                       const Candidate& candidate,
+                                       DexMethod* continuation) {
+  auto code = std::make_unique<IRCode>(*callee->get_code());
+  code->build_cfg(/* editable */ true);
+  auto& cfg = code->cfg();
+
+  auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+  invoke->set_method(continuation);
+  auto params = code->get_param_instructions();
+  invoke->set_arg_word_count(std::distance(params.begin(), params.end()));
+  size_t i = 0;
+  for (const auto& mie : InstructionIterable(params)) {
+    invoke->set_src(i++, mie.insn->dest());
+  }
+  std::vector<IRInstruction*> insns{invoke};
+  auto rtype = callee->get_proto()->get_rtype();
+  if (rtype == get_void_type()) {
+    insns.push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  } else {
+    bool wide = is_wide_type(rtype);
+    auto result = wide ? cfg.allocate_wide_temp() : cfg.allocate_temp();
+    auto move_result = new IRInstruction(
+        wide ? OPCODE_MOVE_RESULT_WIDE
+             : is_primitive(rtype) ? OPCODE_MOVE_RESULT
+                                   : OPCODE_MOVE_RESULT_OBJECT);
+    move_result->set_dest(result);
+    auto ret = new IRInstruction(wide ? OPCODE_RETURN_WIDE
+                                      : is_primitive(rtype)
+                                            ? OPCODE_RETURN
+                                            : OPCODE_RETURN_OBJECT);
+    ret->set_src(0, result);
+    insns.push_back(move_result);
+    insns.push_back(ret);
+  }
+  auto call_block = cfg.create_block();
+  call_block->push_back(insns);
+  cfg.set_edge_target(guard_edge(cfg, candidate.cold_edge), call_block);
+  cfg.remove_unreachable_blocks();
+  return code;
+}
+
+bool is_public_ref(const DexClass* cls) {
+  return cls == nullptr || is_public(cls);
+}
+
+bool is_public_fast_path(const cfg::ControlFlowGraph& cfg,
+                         const DexMethod* callee) {
+  if (!is_public(type_class(callee->get_class()))) {
+    return false;
+  }
+  for (const auto& mie : cfg::ConstInstructionIterable(cfg)) {
+    auto insn = mie.insn;
+    auto op = insn->opcode();
+    if (insn->has_field()) {
+      auto field = resolve_field(insn->get_field());
+      if (field == nullptr || !is_public(field) ||
+          !is_public_ref(type_class(field->get_class()))) {
+        return false;
+      }
+    } else if (insn->has_method()) {
+      if (op == OPCODE_INVOKE_SUPER) {
+        return false;
+      }
+      auto method =
+          resolve_method(insn->get_method(), opcode_to_search(insn));
+      if (method == nullptr || !is_public(method) ||
+          !is_public_ref(type_class(method->get_class()))) {
+        return false;
+      }
+    } else if (insn->has_type()) {
+      if (!is_public_ref(
+              type_class(get_array_type_or_self(insn->get_type())))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+PartialInlinePass::Stats PartialInlinePass::partially_inline(
+    const Scope& scope,
+    const BasicBlockLayoutPass::MethodProfiles& profiles,
+    const Config& config) {
+  auto analysis = walk::parallel::reduce_methods_by_cost<Analysis>(
+      scope,
+      [&](DexMethod* method) {
+        if (method->get_code() == nullptr) {
+          return Analysis();
+        }
+        auto it = profiles.find(show(method));
+        if (it == profiles.end()) {
+          return Analysis();
+        }
+        return analyze(method, it->second, config);
+      },
+      [](Analysis a, Analysis b) {
+        a.candidates.insert(b.candidates.begin(), b.candidates.end());
+        for (auto& p : b.hot_calls) {
+          a.hot_calls.emplace(p.first, std::move(p.second));
+        }
+        return a;
+      });
+
+  // Split the candidates that have hot calls, in a deterministic order since
+  // this adds methods to their classes.
+  std::vector<DexMethod*> callees;
+  for (const auto& p : analysis.hot_calls) {
+    for (const auto& call : p.second) {
+      if (analysis.candidates.count(call.second)) {
+        callees.push_back(call.second);
+      }
+    }
+  }
+  std::sort(callees.begin(), callees.end(), compare_dexmethods);
+  callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+  std::unordered_map<DexMethod*, Split> splits;
+  for (auto callee : callees) {
+    const auto& candidate = analysis.candidates.at(callee);
+    auto continuation = make_continuation(callee, candidate);
+    auto fast_path = make_fast_path(callee, candidate, continuation);
+    bool public_only = is_public_fast_path(fast_path->cfg(), callee);
+    splits.emplace(callee, Split{std::move(fast_path),
+                                 candidate.fast_path_size, public_only});
+  }
+
+  Stats stats;
+  stats.callees_split = splits.size();
+  auto inlined = walk::parallel::reduce_methods_by_cost<Stats>(
+      scope,
+      [&](DexMethod* caller) {
+        Stats stats;
+        auto it = analysis.hot_calls.find(caller);
+        if (it == analysis.hot_calls.end()) {
+          return stats;
+        }
+        auto code = caller->get_code();
+        code->build_cfg(/* editable */ true);
+        auto& cfg = code->cfg();
+        size_t growth = 0;
+        for (const auto& call : it->second) {
+          auto split_it = splits.find(call.second);
+          if (split_it == splits.end()) {
+            continue;
+          }
+          const auto& split = split_it->second;
+          if (!split.is_public &&
+              caller->get_class() != call.second->get_class()) {
+            continue;
+          }
+          if (growth + split.fast_path_size > config.max_caller_growth) {
+            stats.calls_over_budget++;
+            continue;
+          }
+          auto callsite = cfg.find_insn(call.first);
+          if (callsite.is_end()) {
+            continue;
+          }
+          TRACE(MMINL, 4, "Inlining the fast path of %s into %s\n",
+                SHOW(call.second), SHOW(caller));
+          cfg::CFGInliner::inline_cfg(&cfg, callsite, split.fast_path->cfg());
+          growth += split.fast_path_size;
+          stats.calls_inlined++;
+        }
+        code->clear_cfg();
+        return stats;
+      },
+      [](Stats a, Stats b) {
+        a.calls_inlined += b.calls_inlined;
+        a.calls_over_budget += b.calls_over_budget;
+        return a;
+      });
+  stats.calls_inlined = inlined.calls_inlined;
+  stats.calls_over_budget = inlined.calls_over_budget;
+
+  for (auto& p : splits) {
+    p.second.fast_path->clear_cfg();
+  }
+  return stats;
+}
+
+void PartialInlinePass::run_pass(DexStoresVector& stores,
+                                 ConfigFiles& /* conf */,
+                                 PassManager& mgr) {
+  if (m_index_file_name.empty() || m_profile_file_name.empty()) {
+    TRACE(MMINL, 1, "No basic block profile given\n");
+    return;
+  }
+  const auto profiles = BasicBlockLayoutPass::load_profiles(
+      m_index_file_name, m_profile_file_name);
+
+  const auto scope = build_class_scope(stores);
+  const auto stats = partially_inline(scope, profiles, m_config);
+  TRACE(MMINL, 1, "Inlined the fast paths of %zu callees into %zu calls\n",
+        stats.callees_split, stats.calls_inlined);
+  mgr.incr_metric(METRIC_CALLEES_SPLIT, stats.callees_split);
+  mgr.incr_metric(METRIC_CALLS_INLINED, stats.calls_inlined);
+  mgr.incr_metric(METRIC_CALLS_OVER_BUDGET, stats.calls_over_budget);
+}
+
+static PartialInlinePass s_pass;
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "BasicBlockLayout.h"
+#include "DexClass.h"
+#include "Pass.h"
+
+/*
+ * Inlines the fast path of callees that open with a cheap guard, like
+ *
+ *   if (sCache != null) return sCache;
+ *   ... build the cache ...
+ *
+ * into the calls that the basic block profile of BasicBlockLayoutPass shows
+ * to have run. MultiMethodInliner inlines whole callees or nothing, so such
+ * callees keep their invoke on hot paths as soon as their slow part makes them
+ * too big.
+ *
+ * The fast path is the entry block of the callee, which may only read fields
+ * and move values around before its conditional branch, and the blocks that
+ * lead from the side of the branch that ran most often to a return. The other
+ * side becomes a call to a continuation: a public static copy of the callee,
+ * which takes the receiver as its first argument, whose entry block always
+ * goes to the slow side. The callee itself is left alone for the calls that
+ * aren't hot.
+ *
+ * Like BasicBlockLayoutPass, this has to run at the same point of the pass
+ * list as InstrumentPass did in the instrumented build.
+ */
+class PartialInlinePass : public Pass {
+ public:
+  PartialInlinePass() : Pass("PartialInlinePass") {}
+
+  struct Config {
+    // The most instructions that a fast path may have, including the call to
+    // the continuation.
+    size_t max_fast_path_size{16};
+    // The most instructions that fast paths may add to a single caller.
+    size_t max_caller_growth{64};
+    // How often, in percent of its runs, a callee must have taken its fast
+    // path.
+    uint32_t min_fast_path_percent{50};
+  };
+
+  void configure_pass(const JsonWrapper& jw) override {
+    jw.get("index_file_name", "", m_index_file_name);
+    jw.get("profile_file_name", "", m_profile_file_name);
+    jw.get("max_fast_path_size", 16, m_config.max_fast_path_size);
+    jw.get("max_caller_growth", 64, m_config.max_caller_growth);
+    int64_t min_fast_path_percent;
+    jw.get("min_fast_path_percent", 50, min_fast_path_percent);
+    m_config.min_fast_path_percent = min_fast_path_percent;
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+  struct Stats {
+    size_t callees_split{0};
+    size_t calls_inlined{0};
+    size_t calls_over_budget{0};
+  };
+
+  /*
+   * Inlines the fast paths of the profiled callees of `scope` into their hot
+   * calls, adding a continuation to the class of each callee that got
+   * inlined.
+   */
+  static Stats partially_inline(
+      const Scope& scope,
+      const BasicBlockLayoutPass::MethodProfiles& profiles,
+      const Config& config);
+
+ private:
+  std::string m_index_file_name;
+  std::string m_profile_file_name;
+  Config m_config;
+};
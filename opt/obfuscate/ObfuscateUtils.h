@@ -480,13 +480,11 @@ public:
   //void unlock_elements() { mark_all_unrenamable = false; }
 
   inline bool contains_elem(
-      DexType* cls, K sig, DexString* name) {
-    return elements.count(cls) > 0 &&
-      elements[cls].count(sig) > 0 &&
-      elements[cls][sig].count(name) > 0;
+      DexType* cls, K sig, DexString* name) const {
+    return find_wrapper(cls, sig, name) != nullptr;
   }
 
-  inline bool contains_elem(R elem) {
+  inline bool contains_elem(R elem) const {
     return contains_elem(
         elem->get_class(), sig_getter_fn(elem), elem->get_name());
   }
@@ -551,14 +549,23 @@ public:
   }
 
 private:
+  // Returns the wrapper of the given member if there is one, nullptr
+  // otherwise. Doesn't touch the map, so it is safe to call concurrently.
+  DexNameWrapper<T>* find_wrapper(DexType* cls, K sig, DexString* name) const {
+    auto cls_it = elements.find(cls);
+    if (cls_it == elements.end()) return nullptr;
+    auto sig_it = cls_it->second.find(sig);
+    if (sig_it == cls_it->second.end()) return nullptr;
+    auto name_it = sig_it->second.find(name);
+    return name_it != sig_it->second.end() ? name_it->second.get() : nullptr;
+  }
+
   // Returns the def for that class and ref if it exists, nullptr otherwise
-  T find_def(R ref, DexType* cls) {
+  T find_def(R ref, DexType* cls) const {
     if (cls == nullptr) return nullptr;
-    if (contains_elem(cls, sig_getter_fn(ref), ref->get_name())) {
-      DexNameWrapper<T>* wrap =
-        elements[cls][sig_getter_fn(ref)][ref->get_name()].get();
-      if (wrap->is_modified())
-        return wrap->get();
+    auto wrap = find_wrapper(cls, sig_getter_fn(ref), ref->get_name());
+    if (wrap != nullptr && wrap->is_modified()) {
+      return wrap->get();
     }
     return nullptr;
   }
@@ -566,7 +573,7 @@ private:
   /**
    * Look up in the class and all its interfaces.
    */
-  T find_def_in_class_and_intf(R ref, DexClass* cls) {
+  T find_def_in_class_and_intf(R ref, DexClass* cls) const {
     if (cls == nullptr) return nullptr;
     auto found_def = find_def(ref, cls->get_type());
     if (found_def != nullptr) return found_def;
@@ -580,8 +587,9 @@ private:
  public:
   // Does a lookup over the fields we renamed in the dex to see what the
   // reference should be reset with. Returns nullptr if there is no mapping.
-  // Note: we also have to look in superclasses in the case that this is a ref
-  T def_of_ref(R ref) {
+  // Note: we also have to look in superclasses in the case that this is a ref.
+  // This only reads the mapping, so it can be called concurrently.
+  T def_of_ref(R ref) const {
     DexClass* cls = type_class(ref->get_class());
     while (cls && !cls->is_external()) {
       auto found = find_def_in_class_and_intf(ref, cls);
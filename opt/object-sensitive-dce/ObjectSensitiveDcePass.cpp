@@ -11,7 +11,10 @@
 
 #include "ConcurrentContainers.h"
 #include "DexUtil.h"
+#include "FixpointIterationMetrics.h"
 #include "LocalPointersAnalysis.h"
+#include "PointsToSemantics.h"
+#include "PointsToSolver.h"
 #include "SummarySerialization.h"
 #include "Transform.h"
 #include "VirtualScope.h"
@@ -40,11 +43,21 @@ namespace ptrs = local_pointers;
 
 namespace uv = used_vars;
 
+namespace {
+
+struct Stats {
+  size_t removed_instructions{0};
+  FixpointIterationMetrics fixpoint_metrics;
+};
+
+} // namespace
+
 class CallGraphStrategy final : public call_graph::BuildStrategy {
  public:
-  CallGraphStrategy(const Scope& scope)
+  CallGraphStrategy(const Scope& scope, const PointsToSolver* solver)
       : m_scope(scope),
-        m_non_overridden_virtuals(find_non_overridden_virtuals(scope)) {}
+        m_non_overridden_virtuals(find_non_overridden_virtuals(scope)),
+        m_solver(solver) {}
 
   call_graph::CallSites get_callsites(const DexMethod* method) const override {
     call_graph::CallSites callsites;
@@ -58,7 +71,10 @@ class CallGraphStrategy final : public call_graph::BuildStrategy {
         auto callee = resolve_method(insn->get_method(), opcode_to_search(insn),
                                      m_resolved_refs);
         if (callee == nullptr || may_be_overridden(callee)) {
-          continue;
+          callee = resolve_with_points_to(method, insn);
+          if (callee == nullptr) {
+            continue;
+          }
         }
         callsites.emplace_back(callee, code->iterator_to(mie));
       }
@@ -86,8 +102,24 @@ class CallGraphStrategy final : public call_graph::BuildStrategy {
     return method->is_virtual() && m_non_overridden_virtuals.count(method) == 0;
   }
 
+  // The single implementation that the points-to analysis finds for a virtual
+  // call, if any.
+  DexMethod* resolve_with_points_to(const DexMethod* method,
+                                    const IRInstruction* insn) const {
+    if (m_solver == nullptr) {
+      return nullptr;
+    }
+    auto callees = m_solver->get_callees(method, insn->get_method());
+    if (!callees || callees->size() != 1) {
+      return nullptr;
+    }
+    auto callee = const_cast<DexMethod*>(*callees->begin());
+    return callee->get_code() != nullptr ? callee : nullptr;
+  }
+
   const Scope& m_scope;
   std::unordered_set<const DexMethod*> m_non_overridden_virtuals;
+  const PointsToSolver* m_solver;
   mutable MethodRefCache m_resolved_refs;
 };
 
@@ -114,13 +146,25 @@ void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
                                       PassManager& mgr) {
   auto scope = build_class_scope(stores);
 
+  // Narrows down the targets of virtual calls, so that more of them get a
+  // summary. PointsToSemantics builds its own CFGs, hence before ours.
+  std::unique_ptr<PointsToSolver> solver;
+  if (m_use_points_to_analysis) {
+    PointsToSemantics semantics(scope);
+    solver = std::make_unique<PointsToSolver>(
+        scope, semantics, PointsToSolver::default_entry_points(scope));
+    const auto& stats = solver->get_stats();
+    mgr.set_metric("points_to_rounds", stats.rounds);
+    mgr.set_metric("points_to_call_edges", stats.call_edges);
+  }
+
   walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
     code.build_cfg(/* editable */ false);
     // The backwards uv::FixpointIterator analysis will need it later.
     code.cfg().calculate_exit_block();
   });
 
-  auto call_graph = call_graph::Graph(CallGraphStrategy(scope));
+  auto call_graph = call_graph::Graph(CallGraphStrategy(scope, solver.get()));
 
   ptrs::SummaryMap escape_summaries;
   if (m_external_escape_summaries_file) {
@@ -137,25 +181,40 @@ void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
     std::ifstream file_input(*m_external_side_effect_summaries_file);
     summary_serialization::read(file_input, &effect_summaries);
   }
+  std::unique_ptr<SummaryCache> summary_cache;
+  if (m_summary_cache_file) {
+    summary_cache = std::make_unique<SummaryCache>();
+    auto loaded = summary_cache->load(*m_summary_cache_file);
+    TRACE(OSDCE, 1, "Loaded %lu cached summaries\n", loaded);
+  }
   side_effects::analyze_scope(scope, call_graph, *ptrs_fp_iter_map,
-                              &effect_summaries);
+                              &effect_summaries, summary_cache.get(),
+                              &escape_summaries_cmap);
+  if (summary_cache) {
+    summary_cache->save(*m_summary_cache_file);
+    mgr.set_metric("summary_cache_hits", summary_cache->hits());
+    mgr.set_metric("summary_cache_misses", summary_cache->misses());
+  }
 
-  auto removed = walk::parallel::reduce_methods<size_t>(
+  auto stats = walk::parallel::reduce_methods<Stats>(
       scope,
-      [&](DexMethod* method) -> size_t {
+      [&](DexMethod* method) -> Stats {
+        Stats stats;
         if (method->rstate.no_optimizations()) {
-          return 0;
+          return stats;
         }
         auto* code = method->get_code();
         if (code == nullptr) {
-          return 0;
+          return stats;
         }
 
         uv::FixpointIterator used_vars_fp_iter(
             *ptrs_fp_iter_map->find(method)->second,
             build_summary_map(effect_summaries, call_graph, method),
             code->cfg());
+        used_vars_fp_iter.set_iteration_budget(m_max_fixpoint_iterations);
         used_vars_fp_iter.run(uv::UsedVarsSet());
+        stats.fixpoint_metrics.add(method, used_vars_fp_iter.get_stats());
 
         TRACE(OSDCE, 5, "Transforming %s\n", SHOW(method));
         TRACE(OSDCE, 5, "Before:\n%s\n", SHOW(code->cfg()));
@@ -170,10 +229,18 @@ void ObjectSensitiveDcePass::run_pass(DexStoresVector& stores,
         }
         transform::remove_unreachable_blocks(code);
         TRACE(OSDCE, 5, "After:\n%s\n", SHOW(&code));
-        return dead_instructions.size();
+        stats.removed_instructions = dead_instructions.size();
+        return stats;
       },
-      std::plus<size_t>());
-  mgr.set_metric("removed_instructions", removed);
+      [](const Stats& a, const Stats& b) {
+        Stats result;
+        result.removed_instructions =
+            a.removed_instructions + b.removed_instructions;
+        result.fixpoint_metrics = a.fixpoint_metrics + b.fixpoint_metrics;
+        return result;
+      });
+  mgr.set_metric("removed_instructions", stats.removed_instructions);
+  stats.fixpoint_metrics.report("used_vars_fixpoint", mgr);
 }
 
 static ObjectSensitiveDcePass s_pass;
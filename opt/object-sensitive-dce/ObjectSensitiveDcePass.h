@@ -29,6 +29,21 @@ class ObjectSensitiveDcePass final : public Pass {
     if (s != "") {
       m_external_escape_summaries_file = s;
     }
+    // Side effect summaries computed for the app's own code are persisted
+    // here and reused by subsequent builds where the code didn't change.
+    jw.get("summary_cache", "", s);
+    if (s != "") {
+      m_summary_cache_file = s;
+    }
+
+    // Loops of the used-vars analysis that haven't stabilized after this many
+    // iterations are given up on, which keeps their writes alive. 0 means no
+    // limit.
+    jw.get("max_fixpoint_iterations", 0, m_max_fixpoint_iterations);
+
+    // Resolves virtual calls with a whole-program points-to analysis rather
+    // than only the class hierarchy.
+    jw.get("use_points_to_analysis", false, m_use_points_to_analysis);
 
     if (!m_external_escape_summaries_file ||
         !m_external_side_effect_summaries_file) {
@@ -43,4 +58,7 @@ class ObjectSensitiveDcePass final : public Pass {
  private:
   boost::optional<std::string> m_external_side_effect_summaries_file;
   boost::optional<std::string> m_external_escape_summaries_file;
+  boost::optional<std::string> m_summary_cache_file;
+  size_t m_max_fixpoint_iterations{0};
+  bool m_use_points_to_analysis{false};
 };
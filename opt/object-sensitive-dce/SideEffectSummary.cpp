@@ -7,9 +7,9 @@
 
 #include "SideEffectSummary.h"
 
+#include "BottomUpScheduler.h"
 #include "CallGraph.h"
 #include "ConcurrentContainers.h"
-#include "Walkers.h"
 
 using namespace side_effects;
 using namespace sparta;
@@ -173,28 +173,57 @@ class SummaryBuilder final {
   const IRCode* m_code;
 };
 
+struct SummaryCacheContext {
+  SummaryCache* cache;
+  const ptrs::SummaryCMap* escape_summaries;
+};
+
 /*
- * Analyze :method and insert its summary into :summary_cmap. Recursively
- * analyze the callees if necessary. This method is thread-safe.
+ * The side effects of a method are determined by its code and by the side
+ * effect and escape summaries of its callees, which is what the cache key is
+ * made of.
  */
-void analyze_method_recursive(const DexMethod* method,
+std::string summary_cache_key(const DexMethod* method,
                               const call_graph::Graph& call_graph,
-                              const ptrs::FixpointIteratorMap& ptrs_fp_iter_map,
-                              PatriciaTreeSet<const DexMethodRef*> visiting,
-                              SummaryConcurrentMap* summary_cmap) {
-  if (summary_cmap->count(method) != 0 || visiting.contains(method) ||
-      method->get_code() == nullptr) {
+                              const SummaryConcurrentMap& summary_cmap,
+                              const SummaryCacheContext& cache_context) {
+  SummaryCache::KeyBuilder key("side_effects");
+  key.add_method(method);
+  key.add(method->rstate.no_optimizations() ? "no_optimizations" : "");
+  if (call_graph.has_node(method)) {
+    for (const auto& edge : call_graph.node(method).callees()) {
+      auto* callee = edge->callee();
+      key.add(show(callee));
+      if (summary_cmap.count(callee) != 0) {
+        key.add(to_s_expr(summary_cmap.at(callee)));
+      }
+      if (cache_context.escape_summaries->count(callee) != 0) {
+        key.add(to_s_expr(cache_context.escape_summaries->at(callee)));
+      }
+    }
+  }
+  return key.build();
+}
+
+/*
+ * Analyze :method and insert its summary into :summary_cmap. Its callees must
+ * have been analyzed already, except for those in the same SCC of the call
+ * graph. This method is thread-safe.
+ */
+void analyze_method(const DexMethod* method,
+                    const call_graph::Graph& call_graph,
+                    const ptrs::FixpointIteratorMap& ptrs_fp_iter_map,
+                    SummaryConcurrentMap* summary_cmap,
+                    const SummaryCacheContext& cache_context) {
+  if (summary_cmap->count(method) != 0) {
     return;
   }
-  visiting.insert(method);
 
   std::unordered_map<const IRInstruction*, Summary> invoke_to_summary_cmap;
   if (call_graph.has_node(method)) {
     const auto& callee_edges = call_graph.node(method).callees();
     for (const auto& edge : callee_edges) {
       auto* callee = edge->callee();
-      analyze_method_recursive(callee, call_graph, ptrs_fp_iter_map, visiting,
-                               summary_cmap);
       if (summary_cmap->count(callee) != 0) {
         invoke_to_summary_cmap.emplace(edge->invoke_iterator()->insn,
                                        summary_cmap->at(callee));
@@ -202,12 +231,28 @@ void analyze_method_recursive(const DexMethod* method,
     }
   }
 
-  const auto* ptrs_fp_iter = ptrs_fp_iter_map.find(method)->second;
-  auto summary =
-      SummaryBuilder(invoke_to_summary_cmap, *ptrs_fp_iter, method->get_code())
-          .build();
-  if (method->rstate.no_optimizations()) {
-    summary.effects |= EFF_NO_OPTIMIZE;
+  std::string cache_key;
+  boost::optional<s_expr> cached;
+  if (cache_context.cache != nullptr) {
+    cache_key =
+        summary_cache_key(method, call_graph, *summary_cmap, cache_context);
+    cached = cache_context.cache->get("side_effects", cache_key);
+  }
+
+  Summary summary;
+  if (cached) {
+    summary = Summary::from_s_expr(*cached);
+  } else {
+    const auto* ptrs_fp_iter = ptrs_fp_iter_map.find(method)->second;
+    summary = SummaryBuilder(invoke_to_summary_cmap, *ptrs_fp_iter,
+                             method->get_code())
+                  .build();
+    if (method->rstate.no_optimizations()) {
+      summary.effects |= EFF_NO_OPTIMIZE;
+    }
+    if (cache_context.cache != nullptr) {
+      cache_context.cache->put("side_effects", cache_key, to_s_expr(summary));
+    }
   }
   summary_cmap->emplace(method, summary);
 
@@ -240,7 +285,11 @@ void analyze_scope(
     const call_graph::Graph& call_graph,
     const ConcurrentMap<const DexMethodRef*, ptrs::FixpointIterator*>&
         ptrs_fp_iter_map,
-    SummaryMap* summary_map) {
+    SummaryMap* summary_map,
+    SummaryCache* cache,
+    const ptrs::SummaryCMap* escape_summaries) {
+  always_assert(cache == nullptr || escape_summaries != nullptr);
+  SummaryCacheContext cache_context{cache, escape_summaries};
   // This method is special: the bytecode verifier requires that this method
   // be called before a newly-allocated object gets used in any way. We can
   // model this by treating the method as modifying its `this` parameter --
@@ -253,11 +302,11 @@ void analyze_scope(
     summary_cmap.insert(pair);
   }
 
-  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
-    PatriciaTreeSet<const DexMethodRef*> visiting;
-    analyze_method_recursive(method, call_graph, ptrs_fp_iter_map, visiting,
-                             &summary_cmap);
-  });
+  call_graph::parallel_bottom_up(
+      scope, call_graph, [&](const DexMethod* method) {
+        analyze_method(method, call_graph, ptrs_fp_iter_map, &summary_cmap,
+                       cache_context);
+      });
 
   for (auto& pair : summary_cmap) {
     summary_map->insert(pair);
@@ -16,6 +16,7 @@
 #include "LocalPointersAnalysis.h"
 #include "Resolver.h"
 #include "S_Expression.h"
+#include "SummaryCache.h"
 
 /*
  * This analysis identifies the side effects that methods have. A significant
@@ -85,11 +86,19 @@ Summary analyze_code(const InvokeToSummaryMap& invoke_to_summary_cmap,
 
 /*
  * Get the effect summary for all methods in scope.
+ *
+ * If `cache` is given, summaries are looked up there before being computed,
+ * and computed ones are added to it. `escape_summaries` must then be the
+ * summaries that the FixpointIterators were computed with, since they are part
+ * of each cache key.
  */
 void analyze_scope(const Scope& scope,
                    const call_graph::Graph&,
                    const ConcurrentMap<const DexMethodRef*,
                                        local_pointers::FixpointIterator*>&,
-                   SummaryMap* effect_summaries);
+                   SummaryMap* effect_summaries,
+                   SummaryCache* cache = nullptr,
+                   const local_pointers::SummaryCMap* escape_summaries =
+                       nullptr);
 
 } // namespace side_effects
@@ -79,7 +79,12 @@ struct Info {
 };
 
 using Domain = sparta::ConstantAbstractDomain<Info>;
-using Environment = sparta::HashedAbstractEnvironment<reg_t, Domain>;
+// Methods only use a handful of registers, so a flat table suits them best.
+using Environment = sparta::HashedAbstractEnvironment<reg_t,
+                                                      Domain,
+                                                      std::hash<reg_t>,
+                                                      std::equal_to<reg_t>,
+                                                      sparta::FlatHashMap>;
 
 class Iterator final
     : public sparta::MonotonicFixpointIterator<cfg::GraphInterface,
@@ -14,6 +14,7 @@
 #include "OptData.h"
 #include "TypeReference.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 /**
  * We already get a set of candidate enums which are safe to be replaced with
@@ -664,9 +665,24 @@ class EnumTransformer final {
                   DexStoresVector* stores)
       : m_stores(*stores), m_int_objs(0) {
     m_enum_util = std::make_unique<EnumUtil>();
-    for (auto it = candidate_enums.begin(); it != candidate_enums.end(); ++it) {
-      auto enum_cls = type_class(*it);
-      auto enum_attrs = optimize_enums::analyze_enum_clinit(enum_cls);
+    // The <clinit>s are independent of each other, analyze them in parallel.
+    std::vector<DexType*> enum_types(candidate_enums.begin(),
+                                     candidate_enums.end());
+    std::sort(enum_types.begin(), enum_types.end(), compare_dextypes);
+    std::vector<std::unordered_map<const DexField*, EnumAttr>> all_enum_attrs(
+        enum_types.size());
+    auto wq = workqueue_foreach<size_t>([&](size_t i) {
+      all_enum_attrs[i] =
+          optimize_enums::analyze_enum_clinit(type_class(enum_types[i]));
+    });
+    for (size_t i = 0; i < enum_types.size(); ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+
+    for (size_t i = 0; i < enum_types.size(); ++i) {
+      auto enum_cls = type_class(enum_types[i]);
+      auto& enum_attrs = all_enum_attrs[i];
       if (enum_attrs.empty() ||
           enum_cls->get_sfields().size() - 1 != enum_attrs.size()) {
         // Simply ignore enum classes that may contain multiple static fields
@@ -685,7 +701,7 @@ class EnumTransformer final {
       } else {
         m_int_objs = std::max<uint32_t>(m_int_objs, enum_attrs.size());
         m_enum_objs += enum_attrs.size();
-        m_enum_attrs.emplace(*it, enum_attrs);
+        m_enum_attrs.emplace(enum_types[i], std::move(enum_attrs));
         delete_generated_methods(enum_cls);
         opt_metadata::log_opt(ENUM_OPTIMIZED, enum_cls);
       }
@@ -697,8 +713,8 @@ class EnumTransformer final {
 
   void run() {
     auto scope = build_class_scope(m_stores);
-    // Update all the instructions.
-    walk::parallel::code(
+    // Update all the instructions, for all the candidates in one sweep.
+    walk::parallel::code_by_cost(
         scope,
         [&](DexMethod* method) {
           if (m_enum_attrs.count(method->get_class()) &&
@@ -559,7 +559,9 @@ void reject_unsafe_enums(const std::vector<DexClass*>& classes,
     }
   });
 
-  walk::parallel::methods(classes, [&](DexMethod* method) {
+  // One sweep analyzes the methods for all the candidates at once, scheduled
+  // per method so that the methods with the most code don't hold it up.
+  walk::parallel::methods_by_cost(classes, [&](DexMethod* method) {
     // Skip generated enum methods
     if (is_generated_enum_method(method)) {
       return;
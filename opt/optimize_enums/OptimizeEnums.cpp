@@ -309,7 +309,7 @@ class OptimizeEnums {
 
   ConcurrentSet<DexType*> collect_simple_enums() {
     ConcurrentSet<DexType*> enum_set;
-    walk::classes(m_scope, [&](DexClass* cls) {
+    walk::parallel::classes(m_scope, [&](DexClass* cls) {
       if (is_simple_enum(cls)) {
         enum_set.insert(cls->get_type());
       }
@@ -0,0 +1,1260 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "InstructionSequenceOutliner.h"
+
+#include <algorithm>
+#include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ConfigFiles.h"
+#include "Creators.h"
+#include "DexAccess.h"
+#include "DexClass.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "IRInstruction.h"
+#include "InterDexPass.h"
+#include "Liveness.h"
+#include "PassManager.h"
+#include "PluginRegistry.h"
+#include "Resolver.h"
+#include "Show.h"
+#include "Trace.h"
+#include "TypeInference.h"
+#include "WorkQueue.h"
+
+namespace instruction_sequence_outliner {
+
+namespace {
+
+constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+// The start, or one past the end, of the bucket of each symbol.
+void get_buckets(const uint32_t* s,
+                 uint32_t n,
+                 bool ends,
+                 std::vector<uint32_t>* buckets) {
+  std::fill(buckets->begin(), buckets->end(), 0);
+  for (uint32_t i = 0; i < n; i++) {
+    (*buckets)[s[i]]++;
+  }
+  uint32_t sum = 0;
+  for (auto& bucket : *buckets) {
+    sum += bucket;
+    bucket = ends ? sum : sum - bucket;
+  }
+}
+
+// Sorts the L-type suffixes from the sorted LMS suffixes, then the S-type
+// suffixes from the sorted L-type ones.
+void induce(const uint32_t* s,
+            uint32_t* sa,
+            uint32_t n,
+            const std::vector<bool>& stype,
+            std::vector<uint32_t>* buckets) {
+  get_buckets(s, n, /* ends */ false, buckets);
+  for (uint32_t i = 0; i < n; i++) {
+    auto j = sa[i];
+    if (j != EMPTY && j > 0 && !stype[j - 1]) {
+      sa[(*buckets)[s[j - 1]]++] = j - 1;
+    }
+  }
+  get_buckets(s, n, /* ends */ true, buckets);
+  for (uint32_t i = n; i-- > 0;) {
+    auto j = sa[i];
+    if (j != EMPTY && j > 0 && stype[j - 1]) {
+      sa[--(*buckets)[s[j - 1]]] = j - 1;
+    }
+  }
+}
+
+void sais(const uint32_t* s, uint32_t* sa, uint32_t n, uint32_t k) {
+  std::vector<bool> stype(n);
+  stype[n - 1] = true;
+  for (uint32_t i = n - 1; i-- > 0;) {
+    stype[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && stype[i + 1]);
+  }
+  auto is_lms = [&](uint32_t i) { return i > 0 && stype[i] && !stype[i - 1]; };
+  std::vector<uint32_t> buckets(k);
+
+  // Sort the LMS substrings.
+  get_buckets(s, n, /* ends */ true, &buckets);
+  std::fill(sa, sa + n, EMPTY);
+  for (uint32_t i = 1; i < n; i++) {
+    if (is_lms(i)) {
+      sa[--buckets[s[i]]] = i;
+    }
+  }
+  induce(s, sa, n, stype, &buckets);
+  uint32_t n1 = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (is_lms(sa[i])) {
+      sa[n1++] = sa[i];
+    }
+  }
+
+  // Name them by rank, where equal substrings get the same name. No two LMS
+  // positions are adjacent, so the names fit in the upper half of `sa`.
+  std::fill(sa + n1, sa + n, EMPTY);
+  uint32_t name = 0;
+  uint32_t prev = EMPTY;
+  for (uint32_t i = 0; i < n1; i++) {
+    auto pos = sa[i];
+    bool diff = false;
+    for (uint32_t d = 0; d < n; d++) {
+      if (prev == EMPTY || s[pos + d] != s[prev + d] ||
+          stype[pos + d] != stype[prev + d]) {
+        diff = true;
+        break;
+      }
+      if (d > 0 && (is_lms(pos + d) || is_lms(prev + d))) {
+        break;
+      }
+    }
+    if (diff) {
+      name++;
+      prev = pos;
+    }
+    sa[n1 + pos / 2] = name - 1;
+  }
+  uint32_t j = n;
+  for (uint32_t i = n; i > n1; i--) {
+    if (sa[i - 1] != EMPTY) {
+      sa[--j] = sa[i - 1];
+    }
+  }
+
+  // Sort the LMS suffixes, recursing on the string of names unless they are
+  // all distinct.
+  uint32_t* s1 = sa + n - n1;
+  if (name < n1) {
+    sais(s1, sa, n1, name);
+  } else {
+    for (uint32_t i = 0; i < n1; i++) {
+      sa[s1[i]] = i;
+    }
+  }
+
+  // Induce the order of all suffixes from the sorted LMS suffixes.
+  get_buckets(s, n, /* ends */ true, &buckets);
+  j = 0;
+  for (uint32_t i = 1; i < n; i++) {
+    if (is_lms(i)) {
+      s1[j++] = i;
+    }
+  }
+  for (uint32_t i = 0; i < n1; i++) {
+    sa[i] = s1[sa[i]];
+  }
+  std::fill(sa + n1, sa + n, EMPTY);
+  for (uint32_t i = n1; i-- > 0;) {
+    auto pos = sa[i];
+    sa[i] = EMPTY;
+    sa[--buckets[s[pos]]] = pos;
+  }
+  induce(s, sa, n, stype, &buckets);
+}
+
+} // namespace
+
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& text,
+                                         uint32_t alphabet_size) {
+  always_assert(!text.empty() && text.back() == 0);
+  always_assert(text.size() < EMPTY);
+  auto n = static_cast<uint32_t>(text.size());
+  std::vector<uint32_t> sa(n, 0);
+  if (n > 1) {
+    sais(text.data(), sa.data(), n, alphabet_size);
+  }
+  return sa;
+}
+
+std::vector<uint32_t> build_lcp_array(const std::vector<uint32_t>& text,
+                                      const std::vector<uint32_t>& sa) {
+  auto n = static_cast<uint32_t>(text.size());
+  std::vector<uint32_t> rank(n);
+  for (uint32_t i = 0; i < n; i++) {
+    rank[sa[i]] = i;
+  }
+  // Kasai et al.: the common prefix of the next suffix in text order is at
+  // most one shorter.
+  std::vector<uint32_t> lcp(n, 0);
+  uint32_t h = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (rank[i] == 0) {
+      h = 0;
+      continue;
+    }
+    auto j = sa[rank[i] - 1];
+    while (i + h < n && j + h < n && text[i + h] == text[j + h]) {
+      h++;
+    }
+    lcp[rank[i]] = h;
+    if (h > 0) {
+      h--;
+    }
+  }
+  return lcp;
+}
+
+} // namespace instruction_sequence_outliner
+
+namespace {
+
+using namespace instruction_sequence_outliner;
+
+constexpr const char* METRIC_HOT_METHODS = "num_hot_methods";
+constexpr const char* METRIC_CANDIDATES = "num_candidates";
+constexpr const char* METRIC_OUTLINED_METHODS = "num_outlined_methods";
+constexpr const char* METRIC_OUTLINED_SEQUENCES = "num_outlined_sequences";
+constexpr const char* METRIC_OUTLINED_INSTRUCTIONS =
+    "num_outlined_instructions";
+constexpr const char* METRIC_SAVED_CODE_UNITS = "num_saved_code_units";
+
+// What a call site costs, in code units, beyond the invoke penalty.
+constexpr int64_t INVOKE_CODE_UNITS = 3;
+constexpr int64_t MOVE_RESULT_CODE_UNITS = 1;
+// What an outlined method costs beyond its instructions: its return, and its
+// method id, encoded method and code item header.
+constexpr int64_t RETURN_CODE_UNITS = 1;
+constexpr int64_t METHOD_OVERHEAD_CODE_UNITS = 16;
+// The outlined methods are invoked without a range.
+constexpr size_t MAX_ARG_WORDS = 5;
+
+using Config = InstructionSequenceOutlinerPass::Config;
+
+// Whether code in any class may refer to the type.
+bool is_accessible(const DexType* type) {
+  auto element_type = get_array_type_or_self(type);
+  if (is_primitive(element_type)) {
+    return true;
+  }
+  auto cls = type_class(element_type);
+  return cls != nullptr && is_public(cls);
+}
+
+bool is_accessible(DexFieldRef* ref) {
+  auto field = resolve_field(ref);
+  return field != nullptr && is_public(field) &&
+         is_accessible(ref->get_class()) &&
+         is_accessible(field->get_class());
+}
+
+bool is_narrow(const DexType* type) {
+  return type == get_boolean_type() || type == get_byte_type() ||
+         type == get_char_type() || type == get_short_type();
+}
+
+bool is_accessible_method(const IRInstruction* insn) {
+  auto ref = insn->get_method();
+  auto method = resolve_method(ref, opcode_to_search(insn));
+  if (method == nullptr || !is_public(method) ||
+      !is_accessible(ref->get_class()) ||
+      !is_accessible(method->get_class())) {
+    return false;
+  }
+  // An outlined method takes ints, which the verifier won't pass where a
+  // narrower type is expected.
+  for (auto arg : ref->get_proto()->get_args()->get_type_list()) {
+    if (is_narrow(arg)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Whether the instruction may be moved into a static method of another
+ * class. Branches, returns and throws end the sequence, monitors must stay
+ * balanced within their method, and uninitialized objects and the narrow
+ * values that the verifier tells apart from ints can't be passed along.
+ */
+bool can_outline(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  switch (op) {
+  case OPCODE_MOVE:
+  case OPCODE_MOVE_WIDE:
+  case OPCODE_MOVE_OBJECT:
+  case OPCODE_CONST:
+  case OPCODE_CONST_WIDE:
+  case OPCODE_CONST_STRING:
+  case OPCODE_ARRAY_LENGTH:
+  case OPCODE_CMPL_FLOAT:
+  case OPCODE_CMPG_FLOAT:
+  case OPCODE_CMPL_DOUBLE:
+  case OPCODE_CMPG_DOUBLE:
+  case OPCODE_CMP_LONG:
+  case OPCODE_APUT:
+  case OPCODE_APUT_WIDE:
+  case OPCODE_APUT_OBJECT:
+    return true;
+  case OPCODE_CONST_CLASS:
+  case OPCODE_CHECK_CAST:
+  case OPCODE_INSTANCE_OF:
+  case OPCODE_NEW_ARRAY:
+    return is_accessible(insn->get_type());
+  case OPCODE_IPUT:
+  case OPCODE_IPUT_WIDE:
+  case OPCODE_IPUT_OBJECT:
+  case OPCODE_SPUT:
+  case OPCODE_SPUT_WIDE:
+  case OPCODE_SPUT_OBJECT: {
+    // Final fields may only be written by their own class.
+    auto field = resolve_field(insn->get_field());
+    return is_accessible(insn->get_field()) && !is_final(field);
+  }
+  case OPCODE_INVOKE_VIRTUAL:
+  case OPCODE_INVOKE_INTERFACE:
+  case OPCODE_INVOKE_STATIC:
+    return insn->srcs_size() <= MAX_ARG_WORDS && is_accessible_method(insn);
+  default:
+    if (is_aget(op)) {
+      return true;
+    }
+    if (is_iget(op) || is_sget(op)) {
+      return is_accessible(insn->get_field());
+    }
+    // Arithmetic and conversions.
+    return op >= OPCODE_NEG_INT && op <= OPCODE_USHR_INT_LIT8;
+  }
+}
+
+// Whether the verifier types the int that the instruction defines as a plain
+// int, rather than as a boolean, byte, char, short or constant, which the
+// code taking an outlined method's result might need it to be.
+bool defines_plain_int(const IRInstruction* insn) {
+  switch (insn->opcode()) {
+  case OPCODE_ARRAY_LENGTH:
+  case OPCODE_AGET:
+  case OPCODE_IGET:
+  case OPCODE_SGET:
+  case OPCODE_NEG_INT:
+  case OPCODE_NOT_INT:
+  case OPCODE_LONG_TO_INT:
+  case OPCODE_FLOAT_TO_INT:
+  case OPCODE_DOUBLE_TO_INT:
+  case OPCODE_ADD_INT:
+  case OPCODE_SUB_INT:
+  case OPCODE_MUL_INT:
+  case OPCODE_DIV_INT:
+  case OPCODE_REM_INT:
+  case OPCODE_SHL_INT:
+  case OPCODE_SHR_INT:
+  case OPCODE_USHR_INT:
+  case OPCODE_ADD_INT_LIT16:
+  case OPCODE_RSUB_INT:
+  case OPCODE_MUL_INT_LIT16:
+  case OPCODE_DIV_INT_LIT16:
+  case OPCODE_REM_INT_LIT16:
+  case OPCODE_ADD_INT_LIT8:
+  case OPCODE_RSUB_INT_LIT8:
+  case OPCODE_MUL_INT_LIT8:
+  case OPCODE_DIV_INT_LIT8:
+  case OPCODE_REM_INT_LIT8:
+  case OPCODE_SHL_INT_LIT8:
+  case OPCODE_SHR_INT_LIT8:
+  case OPCODE_USHR_INT_LIT8:
+    return true;
+  case OPCODE_INVOKE_VIRTUAL:
+  case OPCODE_INVOKE_INTERFACE:
+  case OPCODE_INVOKE_STATIC:
+    return insn->get_method()->get_proto()->get_rtype() == get_int_type();
+  default:
+    return false;
+  }
+}
+
+uint64_t get_data(const IRInstruction* insn) {
+  if (insn->has_literal()) {
+    return static_cast<uint64_t>(insn->get_literal());
+  } else if (insn->has_string()) {
+    return reinterpret_cast<uint64_t>(insn->get_string());
+  } else if (insn->has_type()) {
+    return reinterpret_cast<uint64_t>(insn->get_type());
+  } else if (insn->has_field()) {
+    return reinterpret_cast<uint64_t>(insn->get_field());
+  } else if (insn->has_method()) {
+    return reinterpret_cast<uint64_t>(insn->get_method());
+  }
+  return 0;
+}
+
+// The type of a parameter or result that holds the register's value, if the
+// outlined method can have one.
+DexType* get_value_type(const type_inference::TypeEnvironment& env,
+                        uint16_t reg,
+                        bool wide) {
+  switch (env.get_type(reg).element()) {
+  case INT:
+    return wide ? nullptr : get_int_type();
+  case FLOAT:
+    return wide ? nullptr : get_float_type();
+  case LONG1:
+    return wide ? get_long_type() : nullptr;
+  case DOUBLE1:
+    return wide ? get_double_type() : nullptr;
+  case REFERENCE: {
+    auto dex_type = env.get_dex_type(reg);
+    if (wide || !dex_type || !is_accessible(*dex_type)) {
+      return nullptr;
+    }
+    return const_cast<DexType*>(*dex_type);
+  }
+  default:
+    return nullptr;
+  }
+}
+
+/*
+ * An instruction of the stream, with the move-result(-pseudo) that takes its
+ * result, if any. Separators have no instruction.
+ */
+struct Item {
+  IRInstruction* insn{nullptr};
+  IRList::iterator it;
+  IRInstruction* result{nullptr};
+  IRList::iterator result_it;
+  cfg::Block* block{nullptr};
+  uint32_t method{0};
+  uint16_t size{0};
+};
+
+struct MethodStream {
+  std::vector<Item> items;
+  // The key of each item, or nothing for separators.
+  std::vector<std::vector<uint64_t>> keys;
+};
+
+/*
+ * The items of the blocks of the method, each followed by a separator. The
+ * registers of an item are keyed by the distance to the previous item of the
+ * block that used them, and the operand they were there, if that is less than
+ * `window` items away. Two sequences of up to `window` items with the same
+ * keys then move values between their registers the same way.
+ */
+MethodStream build_stream(DexMethod* method,
+                          uint32_t method_index,
+                          uint64_t window) {
+  MethodStream stream;
+  auto add_separator = [&]() {
+    stream.items.emplace_back();
+    stream.keys.emplace_back();
+  };
+  auto& cfg = method->get_code()->cfg();
+  for (auto block : cfg.blocks()) {
+    // The position and operand of the last use of each register, with the
+    // half of the wide operand that it was.
+    std::unordered_map<uint32_t, uint64_t> last_uses;
+    uint64_t pos = 0;
+    for (auto it = block->begin(); it != block->end(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      auto insn = it->insn;
+      auto next = std::next(it);
+      while (next != block->end() && next->type != MFLOW_OPCODE) {
+        ++next;
+      }
+      Item item;
+      item.insn = insn;
+      item.it = it;
+      item.block = block;
+      item.method = method_index;
+      bool outlinable = can_outline(insn);
+      if (outlinable && insn->has_move_result()) {
+        if (next == block->end()) {
+          // The result is taken in the next block.
+          outlinable = false;
+        } else if (opcode::is_move_result_or_move_result_pseudo(
+                       next->insn->opcode())) {
+          item.result = next->insn;
+          item.result_it = next;
+        }
+      }
+      pos++;
+      if (!outlinable) {
+        add_separator();
+        continue;
+      }
+
+      std::vector<uint64_t> key{insn->opcode(), get_data(insn)};
+      uint64_t operand = 0;
+      auto add_register = [&](uint32_t reg, bool wide) {
+        for (uint32_t half = 0; half < (wide ? 2u : 1u); half++) {
+          uint64_t code = 0;
+          auto last_use = last_uses.find(reg + half);
+          if (last_use != last_uses.end()) {
+            auto distance = pos - (last_use->second >> 8);
+            if (distance < window) {
+              code = ((distance + 1) << 8) | (last_use->second & 0xff);
+            }
+          }
+          key.push_back(code);
+          last_uses[reg + half] = (pos << 8) | (operand << 1) | half;
+        }
+        operand++;
+      };
+      for (size_t i = 0; i < insn->srcs_size(); i++) {
+        add_register(insn->src(i), insn->src_is_wide(i));
+      }
+      if (insn->dests_size()) {
+        add_register(insn->dest(), insn->dest_is_wide());
+      }
+      item.size = insn->size();
+      if (item.result != nullptr) {
+        key.push_back(item.result->opcode());
+        add_register(item.result->dest(), item.result->dest_is_wide());
+        item.size += item.result->size();
+        it = item.result_it;
+      }
+      stream.items.push_back(item);
+      stream.keys.push_back(std::move(key));
+    }
+    add_separator();
+  }
+  return stream;
+}
+
+/*
+ * An occurrence of a sequence, with its registers numbered by first use. Its
+ * key is the same for all occurrences that one outlined method can replace.
+ */
+struct Occurrence {
+  uint32_t pos;
+  std::vector<uint16_t> regs;
+  std::vector<bool> wide;
+  // Whether the register is read before it is written.
+  std::vector<bool> inputs;
+  std::vector<DexType*> input_types;
+  boost::optional<size_t> output;
+  DexType* output_type{nullptr};
+  std::vector<uint64_t> key;
+};
+
+struct Rewrite {
+  uint32_t pos;
+  uint32_t length;
+  DexMethod* callee;
+  std::vector<uint16_t> args;
+  boost::optional<uint16_t> output;
+};
+
+class DexOutliner {
+ public:
+  DexOutliner(const Config& config, DexClasses* dex, size_t dexnr)
+      : m_config(config), m_dex(dex), m_dexnr(dexnr) {}
+
+  void run(const std::unordered_map<std::string, unsigned int>&
+               method_to_weight);
+
+  const Stats& get_stats() const { return m_stats; }
+
+ private:
+  struct Candidate {
+    uint32_t length;
+    uint32_t lb;
+    uint32_t rb;
+    int64_t estimate;
+  };
+
+  struct Analysis {
+    std::unique_ptr<type_inference::TypeInference> types;
+    std::unique_ptr<LivenessFixpointIterator> liveness;
+  };
+
+  void build_text(std::vector<MethodStream>* streams);
+  std::vector<Candidate> find_candidates(const std::vector<uint32_t>& sa,
+                                         const std::vector<uint32_t>& lcp);
+  int64_t get_benefit(uint32_t pos,
+                      uint32_t length,
+                      size_t count,
+                      bool has_output) const;
+  void analyze_methods(const std::vector<Candidate>& candidates,
+                       const std::vector<uint32_t>& sa);
+  boost::optional<Occurrence> analyze(uint32_t pos, uint32_t length) const;
+  bool outline(const Candidate& candidate, const std::vector<uint32_t>& sa);
+  DexClass* get_host_class();
+  DexMethod* make_outlined_method(const Occurrence& occurrence,
+                                  uint32_t length);
+  void rewrite(size_t method_index, const std::vector<Rewrite>& rewrites);
+
+  const Config& m_config;
+  DexClasses* m_dex;
+  size_t m_dexnr;
+  std::vector<DexMethod*> m_methods;
+  std::vector<Item> m_items;
+  std::vector<uint32_t> m_text;
+  uint32_t m_alphabet_size{0};
+  std::vector<Analysis> m_analyses;
+  std::vector<bool> m_claimed;
+  std::vector<std::vector<Rewrite>> m_rewrites;
+  DexClass* m_host{nullptr};
+  Stats m_stats;
+};
+
+void DexOutliner::run(
+    const std::unordered_map<std::string, unsigned int>& method_to_weight) {
+  auto add_method = [&](DexMethod* method) {
+    if (method->get_code() == nullptr || is_init(method) ||
+        method->rstate.no_optimizations()) {
+      return;
+    }
+    if (get_method_weight_if_available(method, &method_to_weight)) {
+      m_stats.hot_methods++;
+      return;
+    }
+    m_methods.push_back(method);
+  };
+  for (auto cls : *m_dex) {
+    for (auto method : cls->get_dmethods()) {
+      add_method(method);
+    }
+    for (auto method : cls->get_vmethods()) {
+      add_method(method);
+    }
+  }
+  if (m_methods.empty()) {
+    return;
+  }
+
+  std::vector<MethodStream> streams(m_methods.size());
+  auto build_wq = workqueue_foreach<size_t>([&](size_t i) {
+    m_methods[i]->get_code()->build_cfg(/* editable */ false);
+    streams[i] = build_stream(m_methods[i], i, m_config.max_insns_size);
+  });
+  for (size_t i = 0; i < m_methods.size(); i++) {
+    build_wq.add_item(i);
+  }
+  build_wq.run_all();
+  build_text(&streams);
+
+  auto sa = build_suffix_array(m_text, m_alphabet_size);
+  auto lcp = build_lcp_array(m_text, sa);
+  auto candidates = find_candidates(sa, lcp);
+  lcp = std::vector<uint32_t>();
+  m_stats.candidates = candidates.size();
+  TRACE(OUTLINE, 2, "dex %zu: %zu instructions, %zu candidates\n", m_dexnr,
+        m_items.size(), candidates.size());
+
+  analyze_methods(candidates, sa);
+  m_claimed.assign(m_items.size(), false);
+  m_rewrites.resize(m_methods.size());
+  for (const auto& candidate : candidates) {
+    if (m_stats.outlined_methods >= m_config.max_outlined_methods_per_dex) {
+      break;
+    }
+    outline(candidate, sa);
+  }
+  m_analyses.clear();
+
+  auto rewrite_wq = workqueue_foreach<size_t>([&](size_t i) {
+    rewrite(i, m_rewrites[i]);
+    m_methods[i]->get_code()->clear_cfg();
+  });
+  for (size_t i = 0; i < m_methods.size(); i++) {
+    rewrite_wq.add_item(i);
+  }
+  rewrite_wq.run_all();
+}
+
+void DexOutliner::build_text(std::vector<MethodStream>* streams) {
+  std::unordered_map<std::vector<uint64_t>, uint32_t,
+                     boost::hash<std::vector<uint64_t>>>
+      symbols;
+  constexpr uint32_t SEPARATOR = std::numeric_limits<uint32_t>::max();
+  size_t separators = 0;
+  for (auto& stream : *streams) {
+    for (size_t i = 0; i < stream.items.size(); i++) {
+      m_items.push_back(stream.items[i]);
+      if (stream.items[i].insn == nullptr) {
+        m_text.push_back(SEPARATOR);
+        separators++;
+        continue;
+      }
+      // Symbol 0 is the end of the text.
+      auto symbol = static_cast<uint32_t>(symbols.size() + 1);
+      m_text.push_back(
+          symbols.emplace(std::move(stream.keys[i]), symbol).first->second);
+    }
+    stream = MethodStream();
+  }
+  // Each separator is a symbol of its own, so that no repeat spans one.
+  auto next_separator = static_cast<uint32_t>(symbols.size() + 1);
+  for (auto& symbol : m_text) {
+    if (symbol == SEPARATOR) {
+      symbol = next_separator++;
+    }
+  }
+  m_text.push_back(0);
+  m_alphabet_size = next_separator;
+  TRACE(OUTLINE, 3, "%zu symbols, %zu separators\n", symbols.size(),
+        separators);
+}
+
+/*
+ * Each LCP interval is a repeat: its suffixes share a prefix of its LCP
+ * value, and no other suffix does. Repeats longer than the maximum length are
+ * cut to it, which makes them the same as their enclosing repeat if that is
+ * at least as long, so they are left to it.
+ */
+std::vector<DexOutliner::Candidate> DexOutliner::find_candidates(
+    const std::vector<uint32_t>& sa, const std::vector<uint32_t>& lcp) {
+  std::vector<Candidate> candidates;
+  auto max_length = static_cast<uint32_t>(m_config.max_insns_size);
+  auto add_candidate = [&](uint32_t value, uint32_t lb, uint32_t rb,
+                           uint32_t parent_value) {
+    auto length = std::min(value, max_length);
+    if (length < m_config.min_insns_size ||
+        length <= std::min(parent_value, max_length)) {
+      return;
+    }
+    auto estimate = get_benefit(sa[lb], length, rb - lb + 1,
+                                /* has_output */ true);
+    if (estimate > 0) {
+      candidates.push_back({length, lb, rb, estimate});
+    }
+  };
+
+  struct Interval {
+    uint32_t value;
+    uint32_t lb;
+  };
+  std::vector<Interval> stack{{0, 0}};
+  auto n = static_cast<uint32_t>(sa.size());
+  for (uint32_t i = 1; i <= n; i++) {
+    auto value = i < n ? lcp[i] : 0;
+    auto lb = i - 1;
+    while (value < stack.back().value) {
+      auto top = stack.back();
+      stack.pop_back();
+      lb = top.lb;
+      add_candidate(top.value, top.lb, i - 1,
+                    std::max(value, stack.back().value));
+    }
+    if (value > stack.back().value) {
+      stack.push_back({value, lb});
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& a, const Candidate& b) {
+              if (a.estimate != b.estimate) {
+                return a.estimate > b.estimate;
+              }
+              if (a.length != b.length) {
+                return a.length > b.length;
+              }
+              return a.lb < b.lb;
+            });
+  return candidates;
+}
+
+/*
+ * The code units saved by outlining `count` occurrences of the sequence at
+ * `pos`, which may be negative.
+ */
+int64_t DexOutliner::get_benefit(uint32_t pos,
+                                 uint32_t length,
+                                 size_t count,
+                                 bool has_output) const {
+  int64_t size = 0;
+  for (uint32_t i = pos; i < pos + length; i++) {
+    size += m_items[i].size;
+  }
+  int64_t call = INVOKE_CODE_UNITS + m_config.invoke_penalty +
+                 (has_output ? MOVE_RESULT_CODE_UNITS : 0);
+  return static_cast<int64_t>(count) * (size - call) -
+         (size + RETURN_CODE_UNITS + METHOD_OVERHEAD_CODE_UNITS);
+}
+
+void DexOutliner::analyze_methods(const std::vector<Candidate>& candidates,
+                                  const std::vector<uint32_t>& sa) {
+  std::vector<bool> needed(m_methods.size(), false);
+  for (const auto& candidate : candidates) {
+    for (uint32_t i = candidate.lb; i <= candidate.rb; i++) {
+      needed[m_items[sa[i]].method] = true;
+    }
+  }
+  m_analyses.resize(m_methods.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto method = m_methods[i];
+    auto code = method->get_code();
+    auto& cfg = code->cfg();
+    auto& analysis = m_analyses[i];
+    analysis.types = std::make_unique<type_inference::TypeInference>(cfg);
+    analysis.types->run(method);
+    cfg.calculate_exit_block();
+    analysis.liveness = std::make_unique<LivenessFixpointIterator>(cfg);
+    analysis.liveness->run(LivenessDomain(code->get_registers_size()));
+  });
+  for (size_t i = 0; i < m_methods.size(); i++) {
+    if (needed[i]) {
+      wq.add_item(i);
+    }
+  }
+  wq.run_all();
+}
+
+boost::optional<Occurrence> DexOutliner::analyze(uint32_t pos,
+                                                 uint32_t length) const {
+  const auto& first = m_items[pos];
+  const auto& last_item = m_items[pos + length - 1];
+  auto block = first.block;
+  const auto& analysis = m_analyses[first.method];
+  auto& envs = analysis.types->get_type_environments();
+
+  // An instruction that throws to a handler of the method would leave the
+  // handler without the values written before it.
+  bool in_try = false;
+  for (auto edge : block->succs()) {
+    in_try = in_try || edge->type() == cfg::EDGE_THROW;
+  }
+
+  Occurrence occurrence;
+  occurrence.pos = pos;
+  auto& key = occurrence.key;
+  std::unordered_map<uint16_t, size_t> indices;
+  // The instruction that last wrote each register, if any.
+  std::vector<const IRInstruction*> definers;
+  auto add_register = [&](uint16_t reg, bool wide, bool read,
+                          const IRInstruction* definer) {
+    size_t index;
+    auto it = indices.find(reg);
+    if (it != indices.end()) {
+      index = it->second;
+      if (occurrence.wide[index] != wide) {
+        return false;
+      }
+    } else {
+      // Registers must not overlap the halves of wide ones.
+      if (reg > 0) {
+        auto below = indices.find(reg - 1);
+        if (below != indices.end() && occurrence.wide[below->second]) {
+          return false;
+        }
+      }
+      if (wide && indices.count(reg + 1)) {
+        return false;
+      }
+      index = occurrence.regs.size();
+      indices.emplace(reg, index);
+      occurrence.regs.push_back(reg);
+      occurrence.wide.push_back(wide);
+      occurrence.inputs.push_back(read);
+      definers.push_back(nullptr);
+    }
+    key.push_back(index);
+    if (!read) {
+      definers[index] = definer;
+    }
+    return true;
+  };
+  for (uint32_t i = pos; i < pos + length; i++) {
+    auto insn = m_items[i].insn;
+    if (in_try && opcode::may_throw(insn->opcode())) {
+      return boost::none;
+    }
+    key.push_back(insn->opcode());
+    key.push_back(get_data(insn));
+    for (size_t j = 0; j < insn->srcs_size(); j++) {
+      if (!add_register(insn->src(j), insn->src_is_wide(j), true, nullptr)) {
+        return boost::none;
+      }
+    }
+    // An input may be an object that isn't initialized yet, which only a move
+    // could have read.
+    if (insn->opcode() == OPCODE_MOVE_OBJECT &&
+        occurrence.inputs[indices.at(insn->src(0))]) {
+      return boost::none;
+    }
+    if (insn->dests_size() &&
+        !add_register(insn->dest(), insn->dest_is_wide(), false, insn)) {
+      return boost::none;
+    }
+    auto result = m_items[i].result;
+    if (result != nullptr) {
+      key.push_back(result->opcode());
+      if (!add_register(result->dest(), result->dest_is_wide(), false,
+                        insn)) {
+        return boost::none;
+      }
+    }
+  }
+
+  // This may run after register allocation: the invoke only takes arguments
+  // below v16, and the outlined code must still fit the formats of its
+  // instructions.
+  size_t reg_words = 0;
+  for (size_t i = 0; i < occurrence.regs.size(); i++) {
+    auto width = occurrence.wide[i] ? 2 : 1;
+    reg_words += width;
+    if (occurrence.inputs[i] && occurrence.regs[i] + width > 16) {
+      return boost::none;
+    }
+  }
+  if (reg_words > 16) {
+    return boost::none;
+  }
+
+  auto first_env = envs.find(first.insn);
+  if (first_env == envs.end()) {
+    return boost::none;
+  }
+  size_t arg_words = 0;
+  key.push_back(std::numeric_limits<uint64_t>::max());
+  for (size_t i = 0; i < occurrence.regs.size(); i++) {
+    if (!occurrence.inputs[i]) {
+      continue;
+    }
+    auto type = get_value_type(first_env->second, occurrence.regs[i],
+                               occurrence.wide[i]);
+    if (type == nullptr) {
+      return boost::none;
+    }
+    occurrence.input_types.push_back(type);
+    key.push_back(reinterpret_cast<uint64_t>(type));
+    arg_words += occurrence.wide[i] ? 2 : 1;
+  }
+  if (arg_words > MAX_ARG_WORDS) {
+    return boost::none;
+  }
+
+  // The registers live after the last instruction.
+  auto last = last_item.result ? last_item.result : last_item.insn;
+  auto live = analysis.liveness->get_live_out_vars_at(block);
+  for (auto it = block->rbegin(); it != block->rend(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    if (it->insn == last) {
+      break;
+    }
+    analysis.liveness->analyze_instruction(it->insn, &live);
+  }
+  for (size_t i = 0; i < occurrence.regs.size(); i++) {
+    if (definers[i] == nullptr || !live.contains(occurrence.regs[i])) {
+      continue;
+    }
+    if (occurrence.output) {
+      return boost::none;
+    }
+    occurrence.output = i;
+  }
+  key.push_back(std::numeric_limits<uint64_t>::max());
+  if (occurrence.output) {
+    auto index = *occurrence.output;
+    auto last_env = envs.find(last);
+    if (last_env == envs.end()) {
+      return boost::none;
+    }
+    auto env = last_env->second;
+    analysis.types->analyze_instruction(last, &env);
+    auto type =
+        get_value_type(env, occurrence.regs[index], occurrence.wide[index]);
+    if (type == nullptr ||
+        (type == get_int_type() && !defines_plain_int(definers[index]))) {
+      return boost::none;
+    }
+    occurrence.output_type = type;
+    key.push_back(index);
+    key.push_back(reinterpret_cast<uint64_t>(type));
+  }
+  return occurrence;
+}
+
+/*
+ * Outlines the largest group of the candidate's occurrences that agree on
+ * their registers and types, if that pays off.
+ */
+bool DexOutliner::outline(const Candidate& candidate,
+                          const std::vector<uint32_t>& sa) {
+  auto length = candidate.length;
+  std::vector<uint32_t> positions(sa.begin() + candidate.lb,
+                                  sa.begin() + candidate.rb + 1);
+  std::sort(positions.begin(), positions.end());
+  std::vector<uint32_t> free_positions;
+  for (auto pos : positions) {
+    if (!free_positions.empty() && pos < free_positions.back() + length) {
+      continue;
+    }
+    bool claimed = false;
+    for (uint32_t i = pos; i < pos + length && !claimed; i++) {
+      claimed = m_claimed[i];
+    }
+    if (!claimed) {
+      free_positions.push_back(pos);
+    }
+  }
+  if (free_positions.size() < 2 ||
+      get_benefit(free_positions[0], length, free_positions.size(),
+                  /* has_output */ true) <= 0) {
+    return false;
+  }
+
+  std::vector<Occurrence> occurrences;
+  std::unordered_map<std::vector<uint64_t>, std::vector<size_t>,
+                     boost::hash<std::vector<uint64_t>>>
+      groups;
+  const std::vector<size_t>* best = nullptr;
+  for (auto pos : free_positions) {
+    auto occurrence = analyze(pos, length);
+    if (!occurrence) {
+      continue;
+    }
+    occurrences.push_back(std::move(*occurrence));
+    auto& group = groups[occurrences.back().key];
+    group.push_back(occurrences.size() - 1);
+    if (best == nullptr || group.size() > best->size()) {
+      best = &group;
+    }
+  }
+  if (best == nullptr || best->size() < 2) {
+    return false;
+  }
+  const auto& representative = occurrences[best->front()];
+  auto benefit =
+      get_benefit(representative.pos, length, best->size(),
+                  static_cast<bool>(representative.output));
+  if (benefit <= 0) {
+    return false;
+  }
+
+  auto callee = make_outlined_method(representative, length);
+  for (auto index : *best) {
+    const auto& occurrence = occurrences[index];
+    Rewrite rewrite{occurrence.pos, length, callee, {}, boost::none};
+    for (size_t i = 0; i < occurrence.regs.size(); i++) {
+      if (occurrence.inputs[i]) {
+        rewrite.args.push_back(occurrence.regs[i]);
+      }
+    }
+    if (occurrence.output) {
+      rewrite.output = occurrence.regs[*occurrence.output];
+    }
+    for (uint32_t i = occurrence.pos; i < occurrence.pos + length; i++) {
+      m_claimed[i] = true;
+    }
+    m_rewrites[m_items[occurrence.pos].method].push_back(std::move(rewrite));
+  }
+  m_stats.outlined_sequences += best->size();
+  m_stats.outlined_instructions += best->size() * length;
+  m_stats.saved_code_units += benefit;
+  TRACE(OUTLINE, 3, "Outlined %zu occurrences of %u instructions as %s\n",
+        best->size(), length, SHOW(callee));
+  return true;
+}
+
+DexClass* DexOutliner::get_host_class() {
+  if (m_host != nullptr) {
+    return m_host;
+  }
+  auto prefix = "Lredex/$Outlined" + std::to_string(m_dexnr);
+  auto name = prefix + ";";
+  for (size_t i = 1; DexType::get_type(name) != nullptr; i++) {
+    name = prefix + "$" + std::to_string(i) + ";";
+  }
+  ClassCreator cc(DexType::make_type(name.c_str()));
+  cc.set_access(ACC_PUBLIC | ACC_FINAL);
+  cc.set_super(get_object_type());
+  m_host = cc.create();
+  m_host->rstate.set_generated();
+  m_dex->push_back(m_host);
+  return m_host;
+}
+
+DexMethod* DexOutliner::make_outlined_method(const Occurrence& occurrence,
+                                             uint32_t length) {
+  // The parameters come last, in the order of the inputs.
+  std::unordered_map<uint16_t, uint16_t> mapping;
+  uint16_t next_reg = 0;
+  for (size_t i = 0; i < occurrence.regs.size(); i++) {
+    if (!occurrence.inputs[i]) {
+      mapping.emplace(occurrence.regs[i], next_reg);
+      next_reg += occurrence.wide[i] ? 2 : 1;
+    }
+  }
+  auto code = std::make_unique<IRCode>();
+  size_t arg = 0;
+  for (size_t i = 0; i < occurrence.regs.size(); i++) {
+    if (!occurrence.inputs[i]) {
+      continue;
+    }
+    auto type = occurrence.input_types[arg++];
+    auto op = occurrence.wide[i]     ? IOPCODE_LOAD_PARAM_WIDE
+              : !is_primitive(type) ? IOPCODE_LOAD_PARAM_OBJECT
+                                    : IOPCODE_LOAD_PARAM;
+    mapping.emplace(occurrence.regs[i], next_reg);
+    code->push_back((new IRInstruction(op))->set_dest(next_reg));
+    next_reg += occurrence.wide[i] ? 2 : 1;
+  }
+  for (uint32_t i = occurrence.pos; i < occurrence.pos + length; i++) {
+    for (auto insn : {m_items[i].insn, m_items[i].result}) {
+      if (insn == nullptr) {
+        continue;
+      }
+      auto copy = new IRInstruction(*insn);
+      for (size_t j = 0; j < copy->srcs_size(); j++) {
+        copy->set_src(j, mapping.at(copy->src(j)));
+      }
+      if (copy->dests_size()) {
+        copy->set_dest(mapping.at(copy->dest()));
+      }
+      code->push_back(copy);
+    }
+  }
+  DexType* rtype = get_void_type();
+  if (occurrence.output) {
+    auto index = *occurrence.output;
+    rtype = occurrence.output_type;
+    auto op = occurrence.wide[index] ? OPCODE_RETURN_WIDE
+              : is_primitive(rtype)   ? OPCODE_RETURN
+                                      : OPCODE_RETURN_OBJECT;
+    auto reg = mapping.at(occurrence.regs[index]);
+    code->push_back((new IRInstruction(op))->set_src(0, reg));
+  } else {
+    code->push_back(new IRInstruction(OPCODE_RETURN_VOID));
+  }
+  code->set_registers_size(next_reg);
+
+  auto host = get_host_class();
+  std::deque<DexType*> args(occurrence.input_types.begin(),
+                            occurrence.input_types.end());
+  auto proto =
+      DexProto::make_proto(rtype, DexTypeList::make_type_list(std::move(args)));
+  auto name = DexString::make_string("$outlined$" +
+                                     std::to_string(m_stats.outlined_methods));
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method(host->get_type(), name, proto));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, std::move(code),
+                        /* is_virtual */ false);
+  method->set_deobfuscated_name(show(method));
+  host->add_method(method);
+  m_stats.outlined_methods++;
+  return method;
+}
+
+void DexOutliner::rewrite(size_t method_index,
+                          const std::vector<Rewrite>& rewrites) {
+  auto code = m_methods[method_index]->get_code();
+  for (const auto& rewrite : rewrites) {
+    auto first = m_items[rewrite.pos].it;
+    auto invoke = new IRInstruction(OPCODE_INVOKE_STATIC);
+    invoke->set_method(rewrite.callee)->set_arg_word_count(rewrite.args.size());
+    for (size_t i = 0; i < rewrite.args.size(); i++) {
+      invoke->set_src(i, rewrite.args[i]);
+    }
+    code->insert_before(first, invoke);
+    if (rewrite.output) {
+      auto rtype = rewrite.callee->get_proto()->get_rtype();
+      auto op = is_wide_type(rtype)     ? OPCODE_MOVE_RESULT_WIDE
+                : is_primitive(rtype) ? OPCODE_MOVE_RESULT
+                                      : OPCODE_MOVE_RESULT_OBJECT;
+      code->insert_before(first,
+                          (new IRInstruction(op))->set_dest(*rewrite.output));
+    }
+    for (uint32_t i = rewrite.pos; i < rewrite.pos + rewrite.length; i++) {
+      const auto& item = m_items[i];
+      // Removing an instruction removes its move-result-pseudo with it.
+      code->remove_opcode(item.it);
+      if (item.result != nullptr && is_move_result(item.result->opcode())) {
+        code->remove_opcode(item.result_it);
+      }
+    }
+  }
+}
+
+class InstructionSequenceOutlinerInterDexPlugin
+    : public interdex::InterDexPassPlugin {
+ public:
+  explicit InstructionSequenceOutlinerInterDexPlugin(
+      size_t max_outlined_methods)
+      : m_max_outlined_methods(max_outlined_methods) {}
+
+  size_t reserve_mrefs() override {
+    // Each outlined method is a new method ref in its dex.
+    return m_max_outlined_methods;
+  }
+
+ private:
+  size_t m_max_outlined_methods;
+};
+
+} // namespace
+
+namespace instruction_sequence_outliner {
+
+Stats outline_dex(
+    const InstructionSequenceOutlinerPass::Config& config,
+    DexClasses* dex,
+    size_t dexnr,
+    const std::unordered_map<std::string, unsigned int>& method_to_weight) {
+  DexOutliner outliner(config, dex, dexnr);
+  outliner.run(method_to_weight);
+  return outliner.get_stats();
+}
+
+} // namespace instruction_sequence_outliner
+
+void InstructionSequenceOutlinerPass::configure_pass(const JsonWrapper& jw) {
+  jw.get("min_insns_size", 3, m_config.min_insns_size);
+  jw.get("max_insns_size", 16, m_config.max_insns_size);
+  jw.get("invoke_penalty", 1, m_config.invoke_penalty);
+  jw.get("max_outlined_methods_per_dex", 512,
+         m_config.max_outlined_methods_per_dex);
+  // As with the Outliner, the primary dex is left alone unless it's the only
+  // one, as in instrumentation tests.
+  jw.get("outline_primary_dex", false, m_outline_primary_dex);
+  always_assert(m_config.min_insns_size >= 2);
+  always_assert(m_config.max_insns_size >= m_config.min_insns_size);
+
+  interdex::InterDexRegistry* registry =
+      static_cast<interdex::InterDexRegistry*>(
+          PluginRegistry::get().pass_registry(interdex::INTERDEX_PASS_NAME));
+  auto max_outlined_methods = m_config.max_outlined_methods_per_dex;
+  std::function<interdex::InterDexPassPlugin*()> fn =
+      [max_outlined_methods]() -> interdex::InterDexPassPlugin* {
+    return new InstructionSequenceOutlinerInterDexPlugin(max_outlined_methods);
+  };
+  registry->register_plugin("INSTRUCTION_SEQUENCE_OUTLINER_PLUGIN",
+                            std::move(fn));
+}
+
+void InstructionSequenceOutlinerPass::run_pass(DexStoresVector& stores,
+                                               ConfigFiles& conf,
+                                               PassManager& mgr) {
+  always_assert(!stores.empty());
+  auto& dexen = stores[0].get_dexen();
+  Stats stats;
+  for (size_t dexnr = m_outline_primary_dex ? 0 : 1; dexnr < dexen.size();
+       dexnr++) {
+    auto dex_stats = outline_dex(m_config, &dexen[dexnr], dexnr,
+                                 conf.get_method_to_weight());
+    stats.hot_methods += dex_stats.hot_methods;
+    stats.candidates += dex_stats.candidates;
+    stats.outlined_methods += dex_stats.outlined_methods;
+    stats.outlined_sequences += dex_stats.outlined_sequences;
+    stats.outlined_instructions += dex_stats.outlined_instructions;
+    stats.saved_code_units += dex_stats.saved_code_units;
+  }
+  mgr.incr_metric(METRIC_HOT_METHODS, stats.hot_methods);
+  mgr.incr_metric(METRIC_CANDIDATES, stats.candidates);
+  mgr.incr_metric(METRIC_OUTLINED_METHODS, stats.outlined_methods);
+  mgr.incr_metric(METRIC_OUTLINED_SEQUENCES, stats.outlined_sequences);
+  mgr.incr_metric(METRIC_OUTLINED_INSTRUCTIONS, stats.outlined_instructions);
+  mgr.incr_metric(METRIC_SAVED_CODE_UNITS, stats.saved_code_units);
+  TRACE(OUTLINE, 1, "Outlined %zu sequences into %zu methods\n",
+        stats.outlined_sequences, stats.outlined_methods);
+}
+
+static InstructionSequenceOutlinerPass s_pass;
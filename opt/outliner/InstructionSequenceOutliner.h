@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DexClass.h"
+#include "Pass.h"
+
+/*
+ * Moves sequences of instructions that repeat across the methods of a dex into
+ * new static methods, and replaces each occurrence with an invoke.
+ *
+ * The instructions of each dex are turned into a stream of symbols, one per
+ * instruction, where registers are encoded relative to their previous use, so
+ * that the same code on other registers gets the same symbols. Instructions
+ * that can't be outlined -- branches, returns, throws, monitors, constructor
+ * calls, references to non-public members... -- and block ends become symbols
+ * of their own. The repeats are the intervals of the LCP array of the suffix
+ * array of the stream, which is built in linear time.
+ *
+ * A repeat is outlined if it saves code units once the invokes, the return
+ * and the new method are paid for; `invoke_penalty` code units are charged
+ * for each call site, to weigh the runtime cost of the invoke against the
+ * size of the dex. The inputs of an occurrence are its registers that are
+ * read before they are written, and it may have at most one register that is
+ * still live afterwards as its output; all occurrences of an outlined method
+ * agree on their types. Methods of the method profile are hot and left alone.
+ *
+ * The new methods go into one new class per dex, so this runs after InterDex,
+ * which keeps room for them with `max_outlined_methods_per_dex` method refs.
+ */
+class InstructionSequenceOutlinerPass : public Pass {
+ public:
+  InstructionSequenceOutlinerPass()
+      : Pass("InstructionSequenceOutlinerPass") {}
+
+  void configure_pass(const JsonWrapper& jw) override;
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles& conf,
+                PassManager& mgr) override;
+
+  struct Config {
+    size_t min_insns_size{3};
+    size_t max_insns_size{16};
+    size_t invoke_penalty{1};
+    size_t max_outlined_methods_per_dex{512};
+  };
+
+ private:
+  Config m_config;
+  bool m_outline_primary_dex;
+};
+
+namespace instruction_sequence_outliner {
+
+/*
+ * The suffix array of `text`, whose last symbol must be 0 and occur nowhere
+ * else, and whose symbols are all below `alphabet_size`. Built with SA-IS in
+ * time linear in the size of the text.
+ */
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& text,
+                                         uint32_t alphabet_size);
+
+/*
+ * lcp[i] is the length of the longest common prefix of the suffixes at
+ * sa[i - 1] and sa[i], and lcp[0] is 0.
+ */
+std::vector<uint32_t> build_lcp_array(const std::vector<uint32_t>& text,
+                                      const std::vector<uint32_t>& sa);
+
+struct Stats {
+  size_t hot_methods{0};
+  size_t candidates{0};
+  size_t outlined_methods{0};
+  size_t outlined_sequences{0};
+  size_t outlined_instructions{0};
+  int64_t saved_code_units{0};
+};
+
+/*
+ * Outlines the repeats among the methods of one dex, numbered `dexnr`, into a
+ * new class that is added to it.
+ */
+Stats outline_dex(
+    const InstructionSequenceOutlinerPass::Config& config,
+    DexClasses* dex,
+    size_t dexnr,
+    const std::unordered_map<std::string, unsigned int>& method_to_weight);
+
+} // namespace instruction_sequence_outliner
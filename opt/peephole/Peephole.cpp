@@ -8,6 +8,8 @@
 #include "Peephole.h"
 
 #include <algorithm>
+#include <array>
+#include <bitset>
 #include <cmath>
 #include <numeric>
 #include <unordered_map>
@@ -241,6 +243,48 @@ struct DexPattern {
 
 struct Matcher;
 
+constexpr size_t NUM_IR_OPCODES = IOPCODE_MOVE_RESULT_PSEUDO_WIDE + 1;
+
+using OpcodeSet = std::bitset<NUM_IR_OPCODES>;
+
+// What the identifiers of a pattern have been bound to so far. The identifiers
+// are small enums, so this is a flat array that is cheap to reset, unlike a
+// hash map that frees and reallocates its nodes on every failed match.
+template <typename Key, typename Value, size_t N>
+class Bindings {
+ public:
+  bool count(Key key) const { return m_bound.test(index(key)); }
+
+  const Value& at(Key key) const {
+    always_assert(count(key));
+    return m_values[index(key)];
+  }
+
+  // Binds `key` to `value` if it is unbound. Returns whether `key` is now
+  // bound to `value`.
+  bool bind(Key key, Value value) {
+    auto i = index(key);
+    if (m_bound.test(i)) {
+      return m_values[i] == value;
+    }
+    m_bound.set(i);
+    m_values[i] = value;
+    return true;
+  }
+
+  void clear() { m_bound.reset(); }
+
+ private:
+  static size_t index(Key key) {
+    auto i = static_cast<size_t>(key);
+    redex_assert(i < N);
+    return i;
+  }
+
+  std::array<Value, N> m_values;
+  std::bitset<N> m_bound;
+};
+
 struct Pattern {
   const std::string name;
   const std::vector<DexPattern> match;
@@ -261,15 +305,46 @@ struct Pattern {
 struct Matcher {
   const Pattern& pattern;
   size_t match_index;
+  // Never holds more than pattern.match.size() instructions, and is only
+  // cleared on a reset, so it is allocated once.
   std::vector<IRInstruction*> matched_instructions;
+  // The opcodes accepted by each instruction of pattern.match.
+  std::vector<OpcodeSet> match_opcodes;
+
+  Bindings<Register, uint16_t, static_cast<size_t>(Register::E) + 1>
+      matched_regs;
+  Bindings<String,
+           DexString*,
+           static_cast<size_t>(String::Type_A_get_simple_name) + 1>
+      matched_strings;
+  Bindings<Literal,
+           int64_t,
+           static_cast<size_t>(Literal::Mul_Div_To_Shift_Log2) + 1>
+      matched_literals;
+  Bindings<Type, DexType*, static_cast<size_t>(Type::B) + 1> matched_types;
+  Bindings<Field, DexFieldRef*, static_cast<size_t>(Field::B) + 1>
+      matched_fields;
+
+  explicit Matcher(const Pattern& pattern) : pattern(pattern), match_index(0) {
+    matched_instructions.reserve(pattern.match.size());
+    for (const auto& dex_pattern : pattern.match) {
+      OpcodeSet opcodes;
+      for (auto op : dex_pattern.opcodes) {
+        opcodes.set(op);
+      }
+      match_opcodes.push_back(opcodes);
+    }
+  }
 
-  std::unordered_map<Register, uint16_t, EnumClassHash> matched_regs;
-  std::unordered_map<String, DexString*, EnumClassHash> matched_strings;
-  std::unordered_map<Literal, int64_t, EnumClassHash> matched_literals;
-  std::unordered_map<Type, DexType*, EnumClassHash> matched_types;
-  std::unordered_map<Field, DexFieldRef*, EnumClassHash> matched_fields;
-
-  explicit Matcher(const Pattern& pattern) : pattern(pattern), match_index(0) {}
+  // Whether code with the given opcodes may contain a match at all.
+  bool may_match(const OpcodeSet& opcodes) const {
+    for (const auto& step : match_opcodes) {
+      if ((step & opcodes).none()) {
+        return false;
+      }
+    }
+    return true;
+  }
 
   void reset() {
     match_index = 0;
@@ -284,54 +359,35 @@ struct Matcher {
   // It updates the matching state for the given instruction. Returns true if
   // insn matches to the last 'match' pattern.
   bool try_match(IRInstruction* insn) {
+    // A register, literal, type or field that has been observed already must
+    // be the same; a newly observed one is remembered.
     auto match_reg = [&](Register pattern_reg, uint16_t insn_reg) {
-      // This register has been observed already. Check whether they are same.
-      if (matched_regs.find(pattern_reg) != end(matched_regs)) {
-        return matched_regs.at(pattern_reg) == insn_reg;
-      }
-
-      // Newly observed. Remember it.
-      matched_regs.emplace(pattern_reg, insn_reg);
-      return true;
+      return matched_regs.bind(pattern_reg, insn_reg);
     };
 
     auto match_literal = [&](Literal lit_pattern, int64_t insn_literal_val) {
-      if (matched_literals.find(lit_pattern) != end(matched_literals)) {
-        return matched_literals.at(lit_pattern) == insn_literal_val;
-      }
-      matched_literals.emplace(lit_pattern, insn_literal_val);
-      return true;
+      return matched_literals.bind(lit_pattern, insn_literal_val);
     };
 
     auto match_string = [&](String str_pattern, DexString* insn_str) {
       if (str_pattern == String::empty) {
         return (insn_str->is_simple() && insn_str->size() == 0);
       }
-      if (matched_strings.find(str_pattern) != end(matched_strings)) {
-        return matched_strings.at(str_pattern) == insn_str;
-      }
-      matched_strings.emplace(str_pattern, insn_str);
-      return true;
+      return matched_strings.bind(str_pattern, insn_str);
     };
 
     auto match_type = [&](Type type_pattern, DexType* insn_type) {
-      if (matched_types.find(type_pattern) != end(matched_types)) {
-        return matched_types.at(type_pattern) == insn_type;
-      }
-      matched_types.emplace(type_pattern, insn_type);
-      return true;
+      return matched_types.bind(type_pattern, insn_type);
     };
 
     auto match_field = [&](Field field_pattern, DexFieldRef* insn_field) {
-      auto result = matched_fields.emplace(field_pattern, insn_field);
-      bool newly_inserted = result.second;
-      return newly_inserted ? true : result.first->second == insn_field;
+      return matched_fields.bind(field_pattern, insn_field);
     };
 
-    // Does 'insn' match to the given DexPattern?
-    auto match_instruction = [&](const DexPattern& dex_pattern) {
-      if (dex_pattern.opcodes.find(insn->opcode()) ==
-              end(dex_pattern.opcodes) ||
+    // Does 'insn' match to the DexPattern at the given index?
+    auto match_instruction = [&](size_t index) {
+      const DexPattern& dex_pattern = pattern.match[index];
+      if (!match_opcodes[index].test(insn->opcode()) ||
           dex_pattern.srcs.size() != insn->srcs_size() ||
           dex_pattern.dests.size() != insn->dests_size()) {
         return false;
@@ -370,7 +426,7 @@ struct Matcher {
     };
 
     redex_assert(match_index < pattern.match.size());
-    if (!match_instruction(pattern.match[match_index])) {
+    if (!match_instruction(match_index)) {
       // Okay, this is the PG's heuristic. Retry only if the failure occurs on
       // the second opcode of the pattern.
       bool retry = (match_index == 1);
@@ -383,7 +439,7 @@ struct Matcher {
       reset();
       if (retry) {
         redex_assert(match_index == 0);
-        if (!match_instruction(pattern.match[match_index])) {
+        if (!match_instruction(match_index)) {
           return false;
         }
       } else {
@@ -522,13 +578,13 @@ struct Matcher {
       if (replace_info.dests.size() > 0) {
         redex_assert(replace_info.dests.size() == 1);
         const Register dest = replace_info.dests[0];
-        always_assert(matched_regs.find(dest) != end(matched_regs));
+        always_assert(matched_regs.count(dest));
         replace->set_dest(matched_regs.at(dest));
       }
 
       for (size_t i = 0; i < replace_info.srcs.size(); ++i) {
         const Register reg = replace_info.srcs[i];
-        always_assert(matched_regs.find(reg) != end(matched_regs));
+        always_assert(matched_regs.count(reg));
         replace->set_src(i, matched_regs.at(reg));
       }
 
@@ -1639,10 +1695,20 @@ class PeepholeOptimizer {
     auto code = method->get_code();
     code->build_cfg(/* editable */ false);
 
+    // Most patterns need opcodes that the method doesn't have at all, so
+    // they are skipped without looking at any instruction.
+    OpcodeSet opcodes;
+    for (const auto& mie : InstructionIterable(code)) {
+      opcodes.set(mie.insn->opcode());
+    }
+
     // do optimizations one at a time
     // so they can match on the same pattern without interfering
     for (size_t i = 0; i < m_matchers.size(); ++i) {
       auto& matcher = m_matchers[i];
+      if (!matcher.may_match(opcodes)) {
+        continue;
+      }
       std::vector<IRInstruction*> deletes;
       std::vector<std::pair<IRInstruction*, std::vector<IRInstruction*>>>
           inserts;
@@ -1680,6 +1746,11 @@ class PeepholeOptimizer {
       }
 
       for (auto& pair : inserts) {
+        // Removed opcodes are left in the set; that only means a later
+        // pattern may be tried for nothing.
+        for (auto insn : pair.second) {
+          opcodes.set(insn->opcode());
+        }
         std::vector<IRInstruction*> vec{begin(pair.second), end(pair.second)};
         code->insert_after(pair.first, vec);
       }
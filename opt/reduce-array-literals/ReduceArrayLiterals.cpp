@@ -7,11 +7,14 @@
 
 #include "ReduceArrayLiterals.h"
 
+#include <atomic>
 #include <vector>
 
 #include "BaseIRAnalyzer.h"
 #include "ConstantAbstractDomain.h"
 #include "ControlFlow.h"
+#include "DexInstruction.h"
+#include "DexUtil.h"
 #include "HashedSetAbstractDomain.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
@@ -43,6 +46,14 @@ constexpr const char* METRIC_REMAINING_BUGGY_ARRAYS =
     "num_remaining_buggy_arrays";
 constexpr const char* METRIC_REMAINING_BUGGY_ARRAY_ELEMENTS =
     "num_remaining_buggy_array_elements";
+constexpr const char* METRIC_FILLED_ARRAY_DATA_ARRAYS =
+    "num_filled_array_data_arrays";
+constexpr const char* METRIC_FILLED_ARRAY_DATA_ELEMENTS =
+    "num_filled_array_data_elements";
+constexpr const char* METRIC_STARTUP_INSNS_SAVED =
+    "num_startup_fill_array_data_insns_saved";
+constexpr const char* METRIC_STARTUP_BYTES_SAVED =
+    "num_startup_fill_array_data_bytes_saved";
 
 /* A tracked value is...
  * - a 32-bit literal,
@@ -172,6 +183,7 @@ using TrackedDomain =
     sparta::HashedSetAbstractDomain<TrackedValue, TrackedValueHasher>;
 using EscapedArrayDomain =
     sparta::ConstantAbstractDomain<std::vector<IRInstruction*>>;
+using AputLiteralDomain = sparta::ConstantAbstractDomain<int32_t>;
 
 /**
  * For each register that holds a relevant value, keep track of it.
@@ -283,6 +295,16 @@ class Analyzer final : public BaseIRAnalyzer<TrackedDomainEnvironment> {
     case OPCODE_APUT_OBJECT:
     case OPCODE_APUT_BOOLEAN: {
       escape_new_arrays(insn->src(0));
+      const auto value = get_singleton(current_state->get(insn->src(0)));
+      auto aput_literal = value && is_literal(*value)
+                              ? AputLiteralDomain((int32_t)get_literal(*value))
+                              : AputLiteralDomain::top();
+      auto literal_it = m_aput_literals.find(insn);
+      if (literal_it == m_aput_literals.end()) {
+        m_aput_literals.emplace(insn, aput_literal);
+      } else {
+        literal_it->second.join_with(aput_literal);
+      }
       const auto array = get_singleton(current_state->get(insn->src(1)));
       const auto index = get_singleton(current_state->get(insn->src(2)));
       TRACE(RAL, 4, "[RAL]   aput: %d %d\n", array && is_new_array(*array),
@@ -337,11 +359,43 @@ class Analyzer final : public BaseIRAnalyzer<TrackedDomainEnvironment> {
     return result;
   }
 
+  std::unordered_map<IRInstruction*, int32_t> get_aput_literals() {
+    std::unordered_map<IRInstruction*, int32_t> result;
+    for (auto& p : m_aput_literals) {
+      auto constant = p.second.get_constant();
+      if (constant) {
+        result.emplace(p.first, *constant);
+      }
+    }
+    return result;
+  }
+
  private:
   mutable std::unordered_map<IRInstruction*, EscapedArrayDomain>
       m_escaped_arrays;
+  mutable std::unordered_map<IRInstruction*, AputLiteralDomain>
+      m_aput_literals;
 };
 
+// The size in bytes of the elements of a primitive array that fill-array-data
+// can initialize, or 0.
+uint16_t get_element_width(const DexType* element_type) {
+  switch (type_to_datatype(element_type)) {
+  case DataType::Boolean:
+  case DataType::Byte:
+    return 1;
+  case DataType::Char:
+  case DataType::Short:
+    return 2;
+  case DataType::Int:
+  case DataType::Float:
+    return 4;
+  default:
+    // Wide literals aren't tracked.
+    return 0;
+  }
+}
+
 } // namespace
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -349,11 +403,13 @@ class Analyzer final : public BaseIRAnalyzer<TrackedDomainEnvironment> {
 ReduceArrayLiterals::ReduceArrayLiterals(cfg::ControlFlowGraph& cfg,
                                          size_t max_filled_elements,
                                          int32_t min_sdk,
-                                         Architecture arch)
+                                         Architecture arch,
+                                         bool fill_array_data)
     : m_cfg(cfg),
       m_max_filled_elements(max_filled_elements),
       m_min_sdk(min_sdk),
-      m_arch(arch) {
+      m_arch(arch),
+      m_fill_array_data(fill_array_data) {
 
   std::vector<IRInstruction*> new_array_insns;
   for (auto& mie : cfg::InstructionIterable(cfg)) {
@@ -377,6 +433,9 @@ ReduceArrayLiterals::ReduceArrayLiterals(cfg::ControlFlowGraph& cfg,
     }
   }
   always_assert(array_literals.size() == m_array_literals.size());
+  if (m_fill_array_data) {
+    m_aput_literals = analyzer.get_aput_literals();
+  }
 }
 
 void ReduceArrayLiterals::patch() {
@@ -391,6 +450,11 @@ void ReduceArrayLiterals::patch() {
     auto type = new_array_insn->get_type();
     auto element_type = get_array_component_type(type);
 
+    if (m_fill_array_data && is_primitive(element_type) &&
+        patch_fill_array_data(new_array_insn, aput_insns)) {
+      continue;
+    }
+
     if (is_wide_type(element_type)) {
       // TODO: Consider using an annotation-based scheme.
       m_stats.remaining_wide_arrays++;
@@ -596,6 +660,78 @@ size_t ReduceArrayLiterals::patch_new_array_chunk(
   return chunk_size;
 }
 
+/*
+ * Replace the aput instructions of an array literal whose elements are all
+ * constants with
+ *
+ *   fill-array-data overall_dest, <payload>
+ *
+ * in place of the last aput. The constants become dead, unless used elsewhere.
+ */
+bool ReduceArrayLiterals::patch_fill_array_data(
+    IRInstruction* new_array_insn,
+    const std::vector<IRInstruction*>& aput_insns) {
+  auto element_type = get_array_component_type(new_array_insn->get_type());
+  auto width = get_element_width(element_type);
+  if (width == 0) {
+    return false;
+  }
+  std::vector<uint8_t> bytes;
+  bytes.reserve(aput_insns.size() * width + 1);
+  for (auto aput_insn : aput_insns) {
+    auto it = m_aput_literals.find(aput_insn);
+    if (it == m_aput_literals.end()) {
+      return false;
+    }
+    auto value = (uint32_t)it->second;
+    for (size_t i = 0; i < width; i++) {
+      bytes.push_back((uint8_t)(value >> (8 * i)));
+    }
+  }
+  if (bytes.size() % 2 != 0) {
+    bytes.push_back(0);
+  }
+
+  // The payload: ident, element width, element count, then the elements in
+  // little-endian order.
+  uint32_t size = aput_insns.size();
+  std::vector<uint16_t> payload{FOPCODE_FILLED_ARRAY, width,
+                                (uint16_t)(size & 0xffff),
+                                (uint16_t)(size >> 16)};
+  for (size_t i = 0; i < bytes.size(); i += 2) {
+    payload.push_back((uint16_t)(bytes[i] | (bytes[i + 1] << 8)));
+  }
+  auto data = new DexOpcodeData(payload);
+
+  IRInstruction* last_aput_insn = aput_insns.back();
+  IRInstruction* fill_insn = new IRInstruction(OPCODE_FILL_ARRAY_DATA);
+  fill_insn->set_src(0, last_aput_insn->src(1))->set_data(data);
+  TRACE(RAL, 2, "[RAL] %s of %u elements\n", SHOW(fill_insn), size);
+
+  std::unordered_set<IRInstruction*> aput_insns_set(aput_insns.begin(),
+                                                    aput_insns.end());
+  std::vector<cfg::InstructionIterator> aput_insns_iterators;
+  auto iterable = cfg::InstructionIterable(m_cfg);
+  for (auto insn_it = iterable.begin(); insn_it != iterable.end(); ++insn_it) {
+    auto* insn = insn_it->insn;
+    if (insn == last_aput_insn) {
+      m_cfg.insert_before(insn_it, fill_insn);
+    }
+    if (aput_insns_set.count(insn)) {
+      aput_insns_iterators.push_back(insn_it);
+    }
+  }
+  for (auto& it : aput_insns_iterators) {
+    m_cfg.remove_insn(it);
+  }
+
+  m_stats.filled_array_data_arrays++;
+  m_stats.filled_array_data_elements += size;
+  // The fill-array-data instruction takes 3 code units.
+  m_stats.filled_array_data_code_units += 3 + payload.size();
+  return true;
+}
+
 class ReduceArrayLiteralsInterDexPlugin : public interdex::InterDexPassPlugin {
  public:
   size_t reserve_mrefs() override { return 1; }
@@ -610,6 +746,7 @@ void ReduceArrayLiteralsPass::configure_pass(const JsonWrapper& jw) {
   // results in a significant win in terms of instructions count.
   jw.get("max_filled_elements", 77, m_max_filled_elements);
   always_assert(m_max_filled_elements < 0xff);
+  jw.get("fill_array_data", false, m_fill_array_data);
 
   interdex::InterDexRegistry* registry =
       static_cast<interdex::InterDexRegistry*>(
@@ -622,7 +759,7 @@ void ReduceArrayLiteralsPass::configure_pass(const JsonWrapper& jw) {
 }
 
 void ReduceArrayLiteralsPass::run_pass(DexStoresVector& stores,
-                                       ConfigFiles& /* conf */,
+                                       ConfigFiles& conf,
                                        PassManager& mgr) {
   int32_t min_sdk = mgr.get_redex_options().min_sdk;
   Architecture arch = mgr.get_redex_options().arch;
@@ -630,6 +767,12 @@ void ReduceArrayLiteralsPass::run_pass(DexStoresVector& stores,
         architecture_to_string(arch));
 
   const auto scope = build_class_scope(stores);
+  const auto& method_to_weight = conf.get_method_to_weight();
+
+  // What fill-array-data saves in the static initializers and in the methods
+  // that the method profile says run at startup.
+  std::atomic<size_t> startup_insns_saved{0};
+  std::atomic<int64_t> startup_code_units_saved{0};
 
   const auto stats = walk::parallel::reduce_methods<ReduceArrayLiterals::Stats>(
       scope,
@@ -641,10 +784,22 @@ void ReduceArrayLiteralsPass::run_pass(DexStoresVector& stores,
 
         code->build_cfg(/* editable */ true);
         ReduceArrayLiterals ral(code->cfg(), m_max_filled_elements, min_sdk,
-                                arch);
+                                arch, m_fill_array_data);
         ral.patch();
         code->clear_cfg();
-        return ral.get_stats();
+        const auto& method_stats = ral.get_stats();
+        if (method_stats.filled_array_data_arrays > 0 &&
+            (is_clinit(m) ||
+             get_method_weight_if_available(m, &method_to_weight) > 0)) {
+          // One fill-array-data replaces all the aputs, which take 2 code
+          // units each.
+          startup_insns_saved += method_stats.filled_array_data_elements -
+                                 method_stats.filled_array_data_arrays;
+          startup_code_units_saved +=
+              2 * (int64_t)method_stats.filled_array_data_elements -
+              (int64_t)method_stats.filled_array_data_code_units;
+        }
+        return method_stats;
       },
       [](ReduceArrayLiterals::Stats a, ReduceArrayLiterals::Stats b) {
         a.filled_arrays += b.filled_arrays;
@@ -657,6 +812,9 @@ void ReduceArrayLiteralsPass::run_pass(DexStoresVector& stores,
             b.remaining_unimplemented_array_elements;
         a.remaining_buggy_arrays += b.remaining_buggy_arrays;
         a.remaining_buggy_array_elements += b.remaining_buggy_array_elements;
+        a.filled_array_data_arrays += b.filled_array_data_arrays;
+        a.filled_array_data_elements += b.filled_array_data_elements;
+        a.filled_array_data_code_units += b.filled_array_data_code_units;
         return a;
       },
       ReduceArrayLiterals::Stats{},
@@ -674,6 +832,12 @@ void ReduceArrayLiteralsPass::run_pass(DexStoresVector& stores,
   mgr.incr_metric(METRIC_REMAINING_BUGGY_ARRAYS, stats.remaining_buggy_arrays);
   mgr.incr_metric(METRIC_REMAINING_BUGGY_ARRAY_ELEMENTS,
                   stats.remaining_buggy_array_elements);
+  mgr.incr_metric(METRIC_FILLED_ARRAY_DATA_ARRAYS,
+                  stats.filled_array_data_arrays);
+  mgr.incr_metric(METRIC_FILLED_ARRAY_DATA_ELEMENTS,
+                  stats.filled_array_data_elements);
+  mgr.incr_metric(METRIC_STARTUP_INSNS_SAVED, startup_insns_saved);
+  mgr.incr_metric(METRIC_STARTUP_BYTES_SAVED, 2 * startup_code_units_saved);
 }
 
 static ReduceArrayLiteralsPass s_pass;
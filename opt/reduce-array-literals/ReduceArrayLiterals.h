@@ -22,12 +22,23 @@ class ReduceArrayLiterals {
     size_t remaining_unimplemented_array_elements{0};
     size_t remaining_buggy_arrays{0};
     size_t remaining_buggy_array_elements{0};
+    size_t filled_array_data_arrays{0};
+    size_t filled_array_data_elements{0};
+    // Code units of the fill-array-data instructions and their payloads.
+    size_t filled_array_data_code_units{0};
   };
 
+  /*
+   * If `fill_array_data`, primitive array literals of any length whose
+   * elements are all constants are initialized with a single fill-array-data
+   * instruction instead, whose payload instruction lowering appends to the
+   * method.
+   */
   ReduceArrayLiterals(cfg::ControlFlowGraph&,
                       size_t max_filled_elements,
                       int32_t min_sdk,
-                      Architecture arch);
+                      Architecture arch,
+                      bool fill_array_data = false);
 
   const Stats& get_stats() const { return m_stats; }
 
@@ -45,6 +56,8 @@ class ReduceArrayLiterals {
                                boost::optional<uint16_t> chunk_dest,
                                uint16_t overall_dest,
                                std::vector<uint16_t>* temp_regs);
+  bool patch_fill_array_data(IRInstruction* new_array_insn,
+                             const std::vector<IRInstruction*>& aput_insns);
   cfg::ControlFlowGraph& m_cfg;
   size_t m_max_filled_elements;
   int32_t m_min_sdk;
@@ -53,6 +66,9 @@ class ReduceArrayLiterals {
   std::vector<std::pair<IRInstruction*, std::vector<IRInstruction*>>>
       m_array_literals;
   Architecture m_arch;
+  bool m_fill_array_data;
+  // The constant that each aput instruction always stores, if any.
+  std::unordered_map<IRInstruction*, int32_t> m_aput_literals;
 };
 
 class ReduceArrayLiteralsPass : public Pass {
@@ -64,5 +80,6 @@ class ReduceArrayLiteralsPass : public Pass {
 
  private:
   size_t m_max_filled_elements;
+  bool m_fill_array_data;
   bool m_debug;
 };
@@ -15,6 +15,8 @@
 #include "Debug.h"
 #include "DexUtil.h"
 #include "IRCode.h"
+#include "InstructionLowering.h"
+#include "LinearScan.h"
 #include "Show.h"
 #include "Transform.h"
 #include "VirtualRegistersFile.h"
@@ -303,6 +305,47 @@ std::string show(const RegisterTransform& reg_transform) {
   return ss.str();
 }
 
+// A symreg whose only def is a short constant load. Reloading it for a spill
+// takes loading the constant again, which is no larger than a move and
+// doesn't need the symreg to stay live up to the reload.
+struct Rematerializable {
+  IRList::iterator def;
+  // The uses of the symreg that still read it.
+  size_t uses{0};
+  bool rematerialized{false};
+  // The def needs a spill of its own, unless it goes away.
+  bool spill_dest{false};
+};
+
+std::unordered_map<reg_t, Rematerializable> find_rematerializable(
+    IRCode* code) {
+  std::unordered_map<reg_t, Rematerializable> consts;
+  std::unordered_set<reg_t> redefined;
+  std::unordered_map<reg_t, size_t> uses;
+  auto ii = InstructionIterable(code);
+  for (auto it = ii.begin(); it != ii.end(); ++it) {
+    auto* insn = it->insn;
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      ++uses[insn->src(i)];
+    }
+    if (!insn->dests_size() || redefined.count(insn->dest())) {
+      continue;
+    }
+    auto op = insn->opcode();
+    if ((op == OPCODE_CONST || op == OPCODE_CONST_WIDE) &&
+        instruction_lowering::is_short_const_load(insn) &&
+        consts.emplace(insn->dest(), Rematerializable{it.unwrap()}).second) {
+      continue;
+    }
+    consts.erase(insn->dest());
+    redefined.insert(insn->dest());
+  }
+  for (auto& pair : consts) {
+    pair.second.uses = uses[pair.first];
+  }
+  return consts;
+}
+
 } // namespace
 
 void Allocator::Stats::accumulate(const Allocator::Stats& that) {
@@ -313,6 +356,12 @@ void Allocator::Stats::accumulate(const Allocator::Stats& that) {
   split_moves += that.split_moves;
   moves_coalesced += that.moves_coalesced;
   params_spill_early += that.params_spill_early;
+  linear_scan_moves += that.linear_scan_moves;
+  consts_rematerialized += that.consts_rematerialized;
+  consts_removed += that.consts_removed;
+  linear_scan_methods.insert(linear_scan_methods.end(),
+                             that.linear_scan_methods.begin(),
+                             that.linear_scan_methods.end());
 }
 
 static bool has_2addr_form(IROpcode op) {
@@ -637,7 +686,7 @@ void Allocator::select_ranges(const IRCode* code,
     }
 
     reg_t range_base = find_best_range_fit(ig,
-                                           insn->srcs(),
+                                           insn->srcs_vec(),
                                            0,
                                            reg_transform->size,
                                            vreg_files,
@@ -852,7 +901,7 @@ std::unordered_map<reg_t, IRList::iterator> Allocator::find_param_splits(
 
   auto& cfg = code->cfg();
   cfg::Block* start_block = cfg.entry_block();
-  auto postorder_dominator = cfg.immediate_dominators();
+  auto dominators = cfg.dominators();
   for (auto param : params) {
     auto block_uses = find_first_uses(param, start_block);
     // Since this function only gets called for param regs that need to be
@@ -864,7 +913,7 @@ std::unordered_map<reg_t, IRList::iterator> Allocator::find_param_splits(
       // insert a load at its end.
       cfg::Block* idom = block_uses[0];
       for (size_t index = 1; index < block_uses.size(); ++index) {
-        idom = cfg.idom_intersect(postorder_dominator, idom, block_uses[index]);
+        idom = dominators->common_dominator(idom, block_uses[index]);
       }
       TRACE(REG, 5, "Inserting param load of v%u in B%u\n", param, idom->id());
       // We need to check insn before end of block to make sure we didn't
@@ -942,6 +991,11 @@ void Allocator::split_params(const interference::Graph& ig,
  *
  * Param-related symregs are spilled by inserting loads just after the
  * block of parameter instructions.
+ *
+ * Symregs that only hold a short constant are reloaded by loading the constant
+ * again (rematerialization, see [Briggs92], chapter 8) rather than by a move.
+ * Their live ranges then stop at the last use that isn't reloaded, and their
+ * def goes away once every use is.
  */
 void Allocator::spill(const interference::Graph& ig,
                       const SpillPlan& spill_plan,
@@ -949,6 +1003,23 @@ void Allocator::spill(const interference::Graph& ig,
                       IRCode* code) {
   // TODO: account for "close" defs and uses. See [Briggs92], section 8.7
 
+  auto consts = find_rematerializable(code);
+  auto gen_reload = [&](reg_t temp, reg_t src, size_t* spill_moves) {
+    auto const_it = consts.find(src);
+    if (const_it == consts.end()) {
+      ++*spill_moves;
+      return gen_move(ig.get_node(src).type(), temp, src);
+    }
+    auto& remat = const_it->second;
+    --remat.uses;
+    remat.rematerialized = true;
+    ++m_stats.consts_rematerialized;
+    auto* def = remat.def->insn;
+    return (new IRInstruction(def->opcode()))
+        ->set_dest(temp)
+        ->set_literal(def->get_literal());
+  };
+
   auto ii = InstructionIterable(code);
   auto end = ii.end();
   for (auto it = ii.begin(); it != end; ++it) {
@@ -960,12 +1031,11 @@ void Allocator::spill(const interference::Graph& ig,
         auto& to_spill = to_spill_it->second;
         for (auto idx : to_spill) {
           auto src = insn->src(idx);
-          auto& node = ig.get_node(src);
           auto temp = code->allocate_temp();
           insn->set_src(idx, temp);
-          auto mov = gen_move(node.type(), temp, src);
-          ++m_stats.range_spill_moves;
-          code->insert_before(it.unwrap(), mov);
+          code->insert_before(
+              it.unwrap(),
+              gen_reload(temp, src, &m_stats.range_spill_moves));
         }
       }
     } else {
@@ -985,9 +1055,9 @@ void Allocator::spill(const interference::Graph& ig,
             sp_it->second > max_value) {
           auto temp = code->allocate_temp();
           insn->set_src(i, temp);
-          auto mov = gen_move(node.type(), temp, src);
-          ++m_stats.global_spill_moves;
-          code->insert_before(it.unwrap(), mov);
+          code->insert_before(
+              it.unwrap(),
+              gen_reload(temp, src, &m_stats.global_spill_moves));
         }
       }
       if (insn->dests_size()) {
@@ -995,6 +1065,12 @@ void Allocator::spill(const interference::Graph& ig,
         auto sp_it = spill_plan.global_spills.find(dest);
         if (sp_it != spill_plan.global_spills.end() &&
             sp_it->second > max_unsigned_value(dest_bit_width(it.unwrap()))) {
+          auto const_it = consts.find(dest);
+          if (const_it != consts.end()) {
+            // Wait to see whether the def stays.
+            const_it->second.spill_dest = true;
+            continue;
+          }
           auto temp = code->allocate_temp();
           insn->set_dest(temp);
           it.reset(code->insert_after(
@@ -1004,6 +1080,28 @@ void Allocator::spill(const interference::Graph& ig,
       }
     }
   }
+
+  // Sorted, so that the temps are numbered the same way every time.
+  std::vector<reg_t> const_regs;
+  for (const auto& pair : consts) {
+    const_regs.push_back(pair.first);
+  }
+  std::sort(const_regs.begin(), const_regs.end());
+  for (auto dest : const_regs) {
+    auto& remat = consts.at(dest);
+    // Splitting keeps pointers to the instructions it analyzed, so the defs
+    // stay when it follows.
+    if (remat.rematerialized && remat.uses == 0 && !m_config.use_splitting) {
+      code->remove_opcode(remat.def);
+      ++m_stats.consts_removed;
+    } else if (remat.spill_dest) {
+      auto temp = code->allocate_temp();
+      remat.def->insn->set_dest(temp);
+      code->insert_after(remat.def,
+                         gen_move(ig.get_node(dest).type(), dest, temp));
+      ++m_stats.global_spill_moves;
+    }
+  }
 }
 
 /*
@@ -1086,6 +1184,19 @@ void Allocator::allocate(DexMethod* method) {
   }
   bool first{true};
   while (true) {
+    // Coloring scales poorly with the size of the method and each spilling
+    // round costs a full liveness analysis and interference graph build, so
+    // giant or pathological methods get a cheaper allocation instead.
+    if (first ? code->count_opcodes() > m_config.linear_scan_insn_threshold
+              : m_stats.reiteration_count >=
+                    m_config.coloring_iteration_budget) {
+      TRACE(REG, 2, "Falling back to linear scan for %s after %lu rounds\n",
+            SHOW(method), m_stats.reiteration_count);
+      m_stats.linear_scan_moves += linear_scan::allocate(method);
+      m_stats.linear_scan_methods.push_back(method);
+      break;
+    }
+
     SplitCosts split_costs;
     SpillPlan spill_plan;
     SplitPlan split_plan;
@@ -1094,7 +1205,7 @@ void Allocator::allocate(DexMethod* method) {
     auto& cfg = code->cfg();
     cfg.calculate_exit_block();
     LivenessFixpointIterator fixpoint_iter(cfg);
-    fixpoint_iter.run(LivenessDomain());
+    fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
 
     TRACE(REG, 5, "Allocating:\n%s\n", ::SHOW(code->cfg()));
     auto ig =
@@ -1116,7 +1227,7 @@ void Allocator::allocate(DexMethod* method) {
       first = false;
       // After coalesce the live_out and live_in of blocks may change, so run
       // LivenessFixpointIterator again.
-      fixpoint_iter.run(LivenessDomain());
+      fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
       TRACE(REG, 5, "Post-coalesce:\n%s\n", ::SHOW(code->cfg()));
     } else {
       // TODO we should coalesce here too, but we'll need to avoid removing
@@ -1179,6 +1290,9 @@ void Allocator::allocate(DexMethod* method) {
   TRACE(REG, 3, "  Global spills: %lu\n", m_stats.global_spill_moves);
   TRACE(REG, 3, "  splits: %lu\n", m_stats.split_moves);
   TRACE(REG, 3, "Coalesce count: %lu\n", m_stats.moves_coalesced);
+  TRACE(REG, 3, "Constants rematerialized: %lu\n",
+        m_stats.consts_rematerialized);
+  TRACE(REG, 3, "  Constant loads removed: %lu\n", m_stats.consts_removed);
   TRACE(REG, 3, "Params spilled too early: %lu\n", m_stats.params_spill_early);
   TRACE(REG, 3, "Net moves: %ld\n", m_stats.net_moves());
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stack>
+#include <vector>
 
 #include "IRCode.h"
 #include "Interference.h"
@@ -83,6 +84,11 @@ class Allocator {
   struct Config {
     bool no_overwrite_this{false};
     bool use_splitting{false};
+    // Methods with more instructions than this, or that still need spilling
+    // after this many coloring iterations, are handed over to the linear-scan
+    // allocator. See LinearScan.h.
+    size_t linear_scan_insn_threshold{65536};
+    size_t coloring_iteration_budget{50};
   };
 
   struct Stats {
@@ -93,9 +99,16 @@ class Allocator {
     size_t split_moves{0};
     size_t moves_coalesced{0};
     size_t params_spill_early{0};
+    size_t linear_scan_moves{0};
+    // Spilled constants loaded again instead of moved, and the original
+    // loads that went away as a result.
+    size_t consts_rematerialized{0};
+    size_t consts_removed{0};
+    // The methods that were allocated by linear scan instead of coloring.
+    std::vector<const DexMethod*> linear_scan_methods;
     size_t moves_inserted() const {
       return param_spill_moves + range_spill_moves + global_spill_moves +
-             split_moves;
+             split_moves + linear_scan_moves;
     }
     size_t net_moves() const { return moves_inserted() - moves_coalesced; }
     void accumulate(const Stats&);
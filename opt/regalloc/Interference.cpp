@@ -7,6 +7,8 @@
 
 #include "Interference.h"
 
+#include <algorithm>
+
 #include "ControlFlow.h"
 #include "DexUtil.h"
 #include "IRCode.h"
@@ -66,6 +68,32 @@ uint32_t Graph::edge_weight(const Node& u_node, const Node& v_node) const {
                         : 0;
 }
 
+namespace {
+
+void insert_sorted(reg_t reg, std::vector<reg_t>* regs) {
+  if (regs->empty() || regs->back() < reg) {
+    regs->push_back(reg);
+  } else {
+    regs->insert(std::lower_bound(regs->begin(), regs->end(), reg), reg);
+  }
+}
+
+} // namespace
+
+bool Graph::is_adjacent_slow(reg_t u, reg_t v) const {
+  auto u_it = m_nodes.find(u);
+  auto v_it = m_nodes.find(v);
+  if (u == v || u_it == m_nodes.end() || v_it == m_nodes.end()) {
+    return false;
+  }
+  // Search the shorter of the two lists.
+  const auto& u_adj = u_it->second.m_adjacent;
+  const auto& v_adj = v_it->second.m_adjacent;
+  return u_adj.size() <= v_adj.size()
+             ? std::binary_search(u_adj.begin(), u_adj.end(), v)
+             : std::binary_search(v_adj.begin(), v_adj.end(), u);
+}
+
 void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   if (u == v) {
     return;
@@ -73,10 +101,17 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   if (!is_adjacent(u, v)) {
     auto& u_node = m_nodes.at(u);
     auto& v_node = m_nodes.at(v);
-    u_node.m_adjacent.push_back(v);
-    v_node.m_adjacent.push_back(u);
+    insert_sorted(v, &u_node.m_adjacent);
+    insert_sorted(u, &v_node.m_adjacent);
     u_node.m_weight += edge_weight(u_node, v_node);
     v_node.m_weight += edge_weight(v_node, u_node);
+    if (AdjacencyMatrix::covers(u, v)) {
+      m_adj_matrix.insert(u, v);
+    }
+    if (can_coalesce) {
+      m_coalesceable_edges.emplace(u, v);
+    }
+    return;
   }
   // If we have one instruction that creates a coalesceable edge between two
   // nodes s0 and s1, and another that creates a non-coalesceable edge, those
@@ -87,7 +122,9 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   //
   // then the final state of the edge between s0 and s1 must be
   // non-coalesceable.
-  m_adj_matrix[Edge(u, v)] = m_adj_matrix[Edge(u, v)] || !can_coalesce;
+  if (!can_coalesce && !m_coalesceable_edges.empty()) {
+    m_coalesceable_edges.erase(Edge(u, v));
+  }
 }
 
 uint32_t Node::colorable_limit() const {
@@ -83,6 +83,48 @@ inline size_t hash_value(const OrderedPair<T>& pair) {
   return seed;
 }
 
+/*
+ * A triangular bit matrix recording which pairs of registers interfere, so
+ * that adjacency checks don't need to hash anything. Only registers below
+ * MAX_REGS are covered, which bounds the matrix to 16 MiB; the graph falls
+ * back to searching the adjacency lists for the others.
+ */
+class AdjacencyMatrix {
+ public:
+  static constexpr reg_t MAX_REGS = 1 << 14;
+
+  static bool covers(reg_t u, reg_t v) {
+    return u < MAX_REGS && v < MAX_REGS;
+  }
+
+  bool contains(reg_t u, reg_t v) const {
+    if (u == v) {
+      return false;
+    }
+    auto i = index(u, v);
+    return i < m_bits.size() && m_bits[i];
+  }
+
+  void insert(reg_t u, reg_t v) {
+    auto i = index(u, v);
+    if (i >= m_bits.size()) {
+      m_bits.resize(i + 1);
+    }
+    m_bits[i] = true;
+  }
+
+ private:
+  // Row v holds the pairs (u, v) with u < v.
+  static size_t index(reg_t u, reg_t v) {
+    if (u > v) {
+      std::swap(u, v);
+    }
+    return size_t(v) * (v - 1) / 2 + u;
+  }
+
+  std::vector<bool> m_bits;
+};
+
 } // namespace impl
 
 class Node {
@@ -146,6 +188,9 @@ class Node {
    */
   RegisterType type() const { return m_type_domain.element(); }
 
+  /*
+   * The adjacent nodes, in increasing order.
+   */
   const std::vector<reg_t>& adjacent() const { return m_adjacent; }
 
   enum Property {
@@ -192,11 +237,15 @@ class Graph {
   }
 
   bool is_adjacent(reg_t u, reg_t v) const {
-    return m_adj_matrix.find(Edge(u, v)) != m_adj_matrix.end();
+    if (impl::AdjacencyMatrix::covers(u, v)) {
+      return m_adj_matrix.contains(u, v);
+    }
+    return is_adjacent_slow(u, v);
   }
 
   bool is_coalesceable(reg_t u, reg_t v) const {
-    return !is_adjacent(u, v) || !m_adj_matrix.at(Edge(u, v));
+    return !is_adjacent(u, v) || (!m_coalesceable_edges.empty() &&
+                                  m_coalesceable_edges.count(Edge(u, v)));
   }
 
   bool has_containment_edge(reg_t u, reg_t v) const {
@@ -239,10 +288,14 @@ class Graph {
   }
 
  private:
+  bool is_adjacent_slow(reg_t u, reg_t v) const;
+
   std::unordered_map<reg_t, Node> m_nodes;
   using Edge = impl::OrderedPair<reg_t>;
-  std::unordered_map<Edge, bool /* not_coalesceable */, boost::hash<Edge>>
-      m_adj_matrix;
+  impl::AdjacencyMatrix m_adj_matrix;
+  // Only the wide src and dest operands of an instruction can be linked by a
+  // coalesceable edge, so there are few of them.
+  std::unordered_set<Edge, boost::hash<Edge>> m_coalesceable_edges;
   std::unordered_set<ContainmentEdge, boost::hash<ContainmentEdge>>
       m_containment_graph;
   // This map contains the LivenessDomains for all instructions which could
@@ -0,0 +1,274 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "LinearScan.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "Debug.h"
+#include "Interference.h"
+#include "Liveness.h"
+#include "RegisterType.h"
+#include "Show.h"
+
+namespace regalloc {
+
+namespace linear_scan {
+
+namespace {
+
+constexpr uint32_t NO_POSITION = std::numeric_limits<uint32_t>::max();
+
+struct LiveRangeInfo {
+  // The first and last positions at which the live range is live, defined or
+  // used. Two live ranges whose hulls are disjoint never interfere.
+  uint32_t start{NO_POSITION};
+  uint32_t end{0};
+  uint8_t width{1};
+  bool is_param{false};
+  RegisterTypeDomain type{RegisterType::UNKNOWN};
+  reg_t home{0};
+
+  void extend(uint32_t pos) {
+    start = std::min(start, pos);
+    end = std::max(end, pos);
+  }
+};
+
+uint8_t src_width(const IRInstruction* insn, size_t i) {
+  return insn->src_is_wide(i) ? 2 : 1;
+}
+
+uint8_t dest_width(const IRInstruction* insn) {
+  return insn->dest_is_wide() ? 2 : 1;
+}
+
+/*
+ * The number of scratch registers the instruction may need if none of its
+ * operands can be encoded directly.
+ */
+size_t scratch_words(const IRInstruction* insn) {
+  size_t words{0};
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    words += src_width(insn, i);
+  }
+  if (insn->dests_size() && !opcode::has_range_form(insn->opcode())) {
+    words += dest_width(insn);
+  }
+  return words;
+}
+
+void note_operands(const IRInstruction* insn,
+                   uint32_t pos,
+                   std::vector<LiveRangeInfo>* ranges) {
+  if (insn->dests_size()) {
+    auto& info = ranges->at(insn->dest());
+    info.extend(pos);
+    info.width = std::max(info.width, dest_width(insn));
+    info.type.meet_with(RegisterTypeDomain(dest_reg_type(insn)));
+    if (opcode::is_load_param(insn->opcode())) {
+      info.is_param = true;
+    }
+  }
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    auto& info = ranges->at(insn->src(i));
+    info.extend(pos);
+    info.width = std::max(info.width, src_width(insn, i));
+    info.type.meet_with(RegisterTypeDomain(src_reg_type(insn, i)));
+  }
+}
+
+/*
+ * Compute the hull of every live range, along with the number of scratch
+ * registers to reserve.
+ */
+size_t compute_live_ranges(IRCode* code, std::vector<LiveRangeInfo>* ranges) {
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  LivenessFixpointIterator fixpoint_iter(cfg);
+  fixpoint_iter.run(LivenessDomain(code->get_registers_size()));
+
+  size_t scratch_size{0};
+  uint32_t block_start{0};
+  for (cfg::Block* block : cfg.blocks()) {
+    auto ii = InstructionIterable(block);
+    uint32_t pos = block_start + std::distance(ii.begin(), ii.end());
+    block_start = pos;
+    LivenessDomain live_out = fixpoint_iter.get_live_out_vars_at(block);
+    for (auto it = block->rbegin(); it != block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      --pos;
+      auto insn = it->insn;
+      for (auto reg : live_out.elements()) {
+        ranges->at(reg).extend(pos);
+      }
+      // The lowering of check-cast may write the dest of its
+      // move-result-pseudo before the check-cast itself. See the comment on
+      // GraphBuilder::build.
+      if (insn->opcode() == OPCODE_CHECK_CAST) {
+        ranges->at(std::prev(it)->insn->dest()).extend(pos);
+      }
+      note_operands(insn, pos, ranges);
+      scratch_size = std::max(scratch_size, scratch_words(insn));
+      fixpoint_iter.analyze_instruction(insn, &live_out);
+    }
+  }
+  return scratch_size;
+}
+
+/*
+ * Give a home to every live range. Returns the size of the frame.
+ */
+size_t assign_homes(IRCode* code,
+                    size_t scratch_size,
+                    std::vector<LiveRangeInfo>* ranges) {
+  std::vector<reg_t> order;
+  for (size_t reg = 0; reg < ranges->size(); ++reg) {
+    const auto& info = ranges->at(reg);
+    if (info.start == NO_POSITION) {
+      continue;
+    }
+    always_assert_log(!info.type.is_bottom(),
+                      "Type violation of v%lu in code:\n%s\n",
+                      reg,
+                      SHOW(code));
+    if (!info.is_param) {
+      order.push_back(reg);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&](reg_t r1, reg_t r2) {
+    return ranges->at(r1).start < ranges->at(r2).start ||
+           (ranges->at(r1).start == ranges->at(r2).start && r1 < r2);
+  });
+
+  // For each register above the scratch ones, the first position at which it
+  // is free again.
+  std::vector<uint32_t> free_from;
+  auto is_free = [&](size_t r, uint32_t pos) {
+    return r >= free_from.size() || free_from[r] <= pos;
+  };
+  for (auto reg : order) {
+    auto& info = ranges->at(reg);
+    size_t r = 0;
+    while (!is_free(r, info.start) ||
+           (info.width == 2 && !is_free(r + 1, info.start))) {
+      ++r;
+    }
+    if (free_from.size() < r + info.width) {
+      free_from.resize(r + info.width, 0);
+    }
+    for (size_t i = 0; i < info.width; ++i) {
+      free_from[r + i] = info.end + 1;
+    }
+    info.home = scratch_size + r;
+  }
+
+  // The parameters must be in the last registers of the frame.
+  size_t frame_size = scratch_size + free_from.size();
+  for (const auto& mie : InstructionIterable(code->get_param_instructions())) {
+    auto& info = ranges->at(mie.insn->dest());
+    info.home = frame_size;
+    frame_size += info.width;
+  }
+  always_assert_log(frame_size <= std::numeric_limits<reg_t>::max(),
+                    "Frame of %lu registers is too large",
+                    frame_size);
+  return frame_size;
+}
+
+} // namespace
+
+size_t allocate(DexMethod* method) {
+  auto code = method->get_code();
+  std::vector<LiveRangeInfo> ranges(code->get_registers_size());
+  auto scratch_size = compute_live_ranges(code, &ranges);
+  auto frame_size = assign_homes(code, scratch_size, &ranges);
+
+  std::vector<IRList::iterator> positions;
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type == MFLOW_OPCODE) {
+      positions.push_back(it);
+    }
+  }
+
+  size_t moves{0};
+  for (auto it : positions) {
+    auto insn = it->insn;
+    auto op = insn->opcode();
+    if (opcode::is_load_param(op)) {
+      insn->set_dest(ranges.at(insn->dest()).home);
+      continue;
+    }
+    reg_t next_scratch{0};
+    auto use_scratch = [&](reg_t reg) {
+      auto scratch = next_scratch;
+      next_scratch += ranges.at(reg).width;
+      ++moves;
+      return scratch;
+    };
+
+    auto src_fits = [&](size_t i) {
+      const auto& info = ranges.at(insn->src(i));
+      return info.home <=
+             interference::max_value_for_src(insn, i, info.width == 2);
+    };
+
+    // Arguments that can't all be encoded in the non-range form are copied
+    // to consecutive scratch registers, which allows the range form.
+    bool copy_all_srcs{false};
+    if (opcode::has_range_form(op)) {
+      size_t words{0};
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        words += src_width(insn, i);
+        copy_all_srcs |= !src_fits(i);
+      }
+      copy_all_srcs |= words > dex_opcode::NON_RANGE_MAX;
+    }
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      auto src = insn->src(i);
+      const auto& info = ranges.at(src);
+      if (copy_all_srcs || !src_fits(i)) {
+        auto scratch = use_scratch(src);
+        code->insert_before(it, gen_move(info.type.element(), scratch,
+                                         info.home));
+        insn->set_src(i, scratch);
+      } else {
+        insn->set_src(i, info.home);
+      }
+    }
+    if (insn->dests_size()) {
+      auto dest = insn->dest();
+      const auto& info = ranges.at(dest);
+      auto max_dest = max_unsigned_value(interference::dest_bit_width(it));
+      if (info.home > max_dest) {
+        auto scratch = use_scratch(dest);
+        code->insert_after(it, gen_move(info.type.element(), info.home,
+                                        scratch));
+        insn->set_dest(scratch);
+      } else {
+        insn->set_dest(info.home);
+      }
+    }
+  }
+
+  code->set_registers_size(frame_size);
+  // Since we have inserted instructions, we need to rebuild the CFG to ensure
+  // that block boundaries remain correct.
+  code->build_cfg(/* editable */ false);
+  TRACE(REG, 3, "Linear scan: %lu scratch regs, %lu regs, %lu moves\n",
+        scratch_size, frame_size, moves);
+  return moves;
+}
+
+} // namespace linear_scan
+
+} // namespace regalloc
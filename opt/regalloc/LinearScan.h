@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "DexClass.h"
+#include "IRCode.h"
+
+namespace regalloc {
+
+namespace linear_scan {
+
+/*
+ * A single-pass allocator for the methods whose size or spilling behavior
+ * makes graph coloring too slow. It expects the registers of the code to be
+ * live ranges, as produced by live_range::renumber_registers, and the code to
+ * have a non-editable CFG.
+ *
+ * Each live range is given a home register by scanning the hulls of the
+ * positions at which it is live, in order of their start. Nothing is ever
+ * spilled; instead, the bottom of the frame is reserved for scratch
+ * registers. Operands whose home is out of reach of their instruction are
+ * moved through them, as are the arguments of invokes and filled-new-arrays
+ * that would otherwise need a range encoding. The parameters keep dedicated
+ * registers at the top of the frame.
+ *
+ * This produces more moves than graph coloring, but only needs one liveness
+ * analysis and no interference graph.
+ *
+ * Returns the number of moves inserted.
+ */
+size_t allocate(DexMethod* method);
+
+} // namespace linear_scan
+
+} // namespace regalloc
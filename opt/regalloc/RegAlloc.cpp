@@ -7,6 +7,7 @@
 
 #include "RegAlloc.h"
 
+#include <algorithm>
 #include <boost/functional/hash.hpp>
 
 #include "Dataflow.h"
@@ -28,6 +29,12 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
   regalloc::graph_coloring::Allocator::Config allocator_config;
   const auto& jw = mgr.get_current_pass_info()->config;
   jw.get("live_range_splitting", false, allocator_config.use_splitting);
+  jw.get("linear_scan_insn_threshold",
+         allocator_config.linear_scan_insn_threshold,
+         allocator_config.linear_scan_insn_threshold);
+  jw.get("coloring_iteration_budget",
+         allocator_config.coloring_iteration_budget,
+         allocator_config.coloring_iteration_budget);
   allocator_config.no_overwrite_this =
       mgr.get_redex_options().no_overwrite_this();
 
@@ -69,9 +76,8 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
         }
         return stats;
       },
-      [](Output a, Output b) { // reducer
+      [](Output& a, Output&& b) { // reducer
         a.accumulate(b);
-        return a;
       });
 
   TRACE(REG, 1, "Total reiteration count: %lu\n", stats.reiteration_count);
@@ -81,14 +87,30 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
   TRACE(REG, 1, "  Total range spills: %lu\n", stats.range_spill_moves);
   TRACE(REG, 1, "  Total global spills: %lu\n", stats.global_spill_moves);
   TRACE(REG, 1, "  Total splits: %lu\n", stats.split_moves);
+  TRACE(REG, 1, "  Total linear scan moves: %lu\n", stats.linear_scan_moves);
   TRACE(REG, 1, "Total coalesce count: %lu\n", stats.moves_coalesced);
+  TRACE(REG, 1, "Total constants rematerialized: %lu\n",
+        stats.consts_rematerialized);
+  TRACE(REG, 1, "  Total constant loads removed: %lu\n", stats.consts_removed);
   TRACE(REG, 1, "Total net moves: %ld\n", stats.net_moves());
+  auto& linear_scan_methods = stats.linear_scan_methods;
+  std::sort(linear_scan_methods.begin(),
+            linear_scan_methods.end(),
+            dexmethods_comparator());
+  TRACE(REG, 1, "Methods allocated by linear scan: %lu\n",
+        linear_scan_methods.size());
+  for (auto* m : linear_scan_methods) {
+    TRACE(REG, 1, "  %s\n", SHOW(m));
+  }
 
   mgr.incr_metric("param spilled too early", stats.params_spill_early);
   mgr.incr_metric("reiteration_count", stats.reiteration_count);
   mgr.incr_metric("spill_count", stats.moves_inserted());
   mgr.incr_metric("coalesce_count", stats.moves_coalesced);
   mgr.incr_metric("net_moves", stats.net_moves());
+  mgr.incr_metric("consts_rematerialized", stats.consts_rematerialized);
+  mgr.incr_metric("consts_removed", stats.consts_removed);
+  mgr.incr_metric("linear_scan_methods", linear_scan_methods.size());
 
   mgr.record_running_regalloc();
 }
@@ -10,12 +10,14 @@
 #include <boost/regex.hpp>
 #include <tuple>
 
+#include "ConcurrentContainers.h"
 #include "Dataflow.h"
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "RemoveBuildersHelper.h"
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -206,23 +208,6 @@ std::vector<DexType*> RemoveBuildersPass::created_builders(DexMethod* m) {
   return builders;
 }
 
-// checks if any instances of :builder that get created in the method ever get
-// passed to a method (aside from when its own instance methods get invoked),
-// or if they get stored in a field, or if they escape as a return value.
-bool RemoveBuildersPass::escapes_stack(DexType* builder, DexMethod* method) {
-  always_assert(builder != nullptr);
-  always_assert(method != nullptr);
-
-  auto code = method->get_code();
-  code->build_cfg(/* editable */ false);
-  auto blocks = cfg::postorder_sort(code->cfg().blocks());
-  std::reverse(blocks.begin(), blocks.end());
-  auto regs_size = method->get_code()->get_registers_size();
-  auto taint_map = get_tainted_regs(regs_size, blocks, builder);
-  return tainted_reg_escapes(
-      builder, method, *taint_map, m_enable_buildee_constr_change);
-}
-
 void RemoveBuildersPass::run_pass(DexStoresVector& stores,
                                   ConfigFiles& conf,
                                   PassManager& mgr) {
@@ -250,24 +235,27 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
     }
   }
 
-  std::unordered_set<DexType*> escaped_builders;
-  walk::methods(scope, [&](DexMethod* m) {
-    auto builders = created_builders(m);
-    for (DexType* builder : builders) {
-      if (escapes_stack(builder, m)) {
-        TRACE(BUILDERS,
-              3,
-              "%s escapes in %s\n",
-              SHOW(builder),
-              m->get_deobfuscated_name().c_str());
-        escaped_builders.emplace(builder);
-      }
+  // Checks if any instances of the builders that get created in a method ever
+  // get passed to a method (aside from when their own instance methods get
+  // invoked), or if they get stored in a field, or if they escape as a return
+  // value. Each method is analyzed once for all the builders.
+  ConcurrentSet<DexType*> escaped_builders;
+  walk::parallel::code(scope, [&](DexMethod* m, IRCode&) {
+    auto escaped =
+        get_escaped_builders(m, m_builders, m_enable_buildee_constr_change);
+    for (DexType* builder : escaped) {
+      TRACE(BUILDERS,
+            3,
+            "%s escapes in %s\n",
+            SHOW(builder),
+            m->get_deobfuscated_name().c_str());
+      escaped_builders.insert(builder);
     }
   });
 
   std::unordered_set<DexType*> stack_only_builders;
   for (DexType* builder : m_builders) {
-    if (escaped_builders.find(builder) == escaped_builders.end()) {
+    if (!escaped_builders.count(builder)) {
       stack_only_builders.emplace(builder);
     }
   }
@@ -281,14 +269,18 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
     }
   }
 
-  std::unordered_set<DexType*> this_escapes;
-  for (DexType* cls_ty : builders_and_supers) {
+  ConcurrentSet<DexType*> this_escapes;
+  auto wq = workqueue_foreach<DexType*>([&](DexType* cls_ty) {
     DexClass* cls = type_class(cls_ty);
     if (cls->is_external() ||
         this_arg_escapes(cls, m_enable_buildee_constr_change)) {
-      this_escapes.emplace(cls_ty);
+      this_escapes.insert(cls_ty);
     }
+  });
+  for (DexType* cls_ty : builders_and_supers) {
+    wq.add_item(cls_ty);
   }
+  wq.run_all();
 
   // set of builders that neither escape the stack nor pass their 'this' arg
   // to another function
@@ -297,7 +289,7 @@ void RemoveBuildersPass::run_pass(DexStoresVector& stores,
     DexType* cls = builder;
     bool hierarchy_has_escape = false;
     while (cls != nullptr) {
-      if (this_escapes.find(cls) != this_escapes.end()) {
+      if (this_escapes.count(cls)) {
         hierarchy_has_escape = true;
         break;
       }
@@ -25,5 +25,4 @@ class RemoveBuildersPass : public Pass {
   bool m_enable_buildee_constr_change;
 
   std::vector<DexType*> created_builders(DexMethod*);
-  bool escapes_stack(DexType*, DexMethod*);
 };
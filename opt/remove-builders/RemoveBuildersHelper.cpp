@@ -15,6 +15,7 @@
 #include "DexUtil.h"
 #include "IRCode.h"
 #include "IRInstruction.h"
+#include "LocalPointersAnalysis.h"
 
 namespace {
 
@@ -1060,6 +1061,135 @@ bool tainted_reg_escapes(
   return false;
 }
 
+namespace {
+
+/**
+ * How an invoke lets the builders passed to it escape, with the exceptions
+ * that `tainted_reg_escapes` makes.
+ */
+local_pointers::EscapeSummary get_invoke_summary(
+    const IRInstruction* insn,
+    const std::unordered_set<DexType*>& builders,
+    bool enable_buildee_constr_change) {
+  local_pointers::EscapeSummary summary;
+  summary.returned_parameters = local_pointers::ParamSet::top();
+  auto op = insn->opcode();
+  auto invoked = resolve_method(insn->get_method(), opcode_to_search(insn));
+  if (invoked == nullptr) {
+    TRACE(BUILDERS, 5, "Unable to resolve %s\n", SHOW(insn));
+    return summary;
+  }
+
+  // A builder passed as the `this` arg of one of its own methods or of a
+  // ctor doesn't escape, since we also check that those methods don't let
+  // their `this` escape.
+  size_t args_reg_start{0};
+  if (is_init(invoked) ||
+      (builders.count(invoked->get_class()) && !is_invoke_static(op))) {
+    args_reg_start = 1;
+  }
+  for (size_t i = args_reg_start; i < insn->srcs_size(); ++i) {
+    if (enable_buildee_constr_change && i == 1 && is_init(invoked)) {
+      // Don't consider builders that get passed to the buildee's
+      // constructor, unless the 'fields constructor' already exists.
+      // `update_buildee_constructor` will sort this out later.
+      const auto& args = invoked->get_proto()->get_args()->get_type_list();
+      if (args.size() == 1 && builders.count(args[0]) &&
+          get_buildee(args[0]) == invoked->get_class() &&
+          get_fields_constr_if_exists(invoked, type_class(args[0])) ==
+              nullptr) {
+        continue;
+      }
+    }
+    summary.escaping_parameters.emplace(i);
+  }
+  return summary;
+}
+
+} // namespace
+
+std::unordered_set<DexType*> get_escaped_builders(
+    DexMethod* method,
+    const std::unordered_set<DexType*>& builders,
+    bool enable_buildee_constr_change) {
+  std::unordered_set<DexType*> escaped;
+  auto code = method->get_code();
+
+  // The instructions whose results are builders: the new-instances and, as
+  // `transfer_object_reach` has it, the invokes that return a builder type.
+  std::unordered_map<const IRInstruction*, DexType*> builder_ptrs;
+  local_pointers::InvokeToSummaryMap invoke_to_summary_map;
+  for (const auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    auto op = insn->opcode();
+    if (op == OPCODE_NEW_INSTANCE && builders.count(insn->get_type())) {
+      builder_ptrs.emplace(insn, insn->get_type());
+    } else if (is_invoke(op)) {
+      auto summary =
+          get_invoke_summary(insn, builders, enable_buildee_constr_change);
+      DexMethodRef* invoked = insn->get_method();
+      auto def = resolve_method(invoked, MethodSearch::Any);
+      if (def) {
+        invoked = def;
+      }
+      auto rtype = invoked->get_proto()->get_rtype();
+      if (builders.count(rtype)) {
+        summary.returned_parameters =
+            local_pointers::ParamSet(local_pointers::FRESH_RETURN);
+        builder_ptrs.emplace(insn, rtype);
+      }
+      invoke_to_summary_map.emplace(insn, std::move(summary));
+    }
+  }
+  if (builder_ptrs.empty()) {
+    return escaped;
+  }
+
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  local_pointers::FixpointIterator fp_iter(cfg,
+                                           std::move(invoke_to_summary_map));
+  fp_iter.run(local_pointers::Environment());
+  for (auto* block : cfg.blocks()) {
+    auto env = fp_iter.get_entry_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    for (const auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      auto op = insn->opcode();
+      // Returning a builder is fine only from its own methods. Branching on
+      // a builder or locking it is not supported.
+      if (op == OPCODE_RETURN_OBJECT || is_conditional_branch(op) ||
+          is_monitor(op)) {
+        const auto& pointers = env.get_pointers(insn->src(0));
+        if (pointers.is_value()) {
+          for (auto pointer : pointers.elements()) {
+            auto it = builder_ptrs.find(pointer);
+            if (it != builder_ptrs.end() &&
+                !(op == OPCODE_RETURN_OBJECT &&
+                  method->get_class() == it->second)) {
+              TRACE(BUILDERS, 5, "Escaping instruction: %s\n", SHOW(insn));
+              escaped.emplace(it->second);
+            }
+          }
+        }
+      }
+      fp_iter.analyze_instruction(insn, &env);
+      // A later allocation makes the pointer fresh again, so look for
+      // escapes after each instruction.
+      for (const auto& pair : builder_ptrs) {
+        if (!escaped.count(pair.second) && env.may_have_escaped(pair.first)) {
+          TRACE(BUILDERS, 5, "Escaping instruction: %s\n", SHOW(insn));
+          escaped.emplace(pair.second);
+        }
+      }
+    }
+  }
+  code->clear_cfg();
+  return escaped;
+}
+
 /**
  * Keep track, per instruction, what register(s) holds
  * an instance of the `type`.
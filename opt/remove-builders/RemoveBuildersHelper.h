@@ -87,6 +87,17 @@ get_tainted_regs(uint16_t regs_size,
                  const std::vector<cfg::Block*>& blocks,
                  DexType* type);
 
+/**
+ * Returns the builders, out of `builders`, of which an instance that `method`
+ * creates or gets from an invoke may escape the stack the way
+ * `tainted_reg_escapes` defines it. All the builders are checked with a single
+ * run of the local pointers escape analysis.
+ */
+std::unordered_set<DexType*> get_escaped_builders(
+    DexMethod* method,
+    const std::unordered_set<DexType*>& builders,
+    bool enable_buildee_constr_change = false);
+
 class BuilderTransform {
  public:
   BuilderTransform(const inliner::InlinerConfig& inliner_config,
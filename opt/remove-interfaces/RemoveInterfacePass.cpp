@@ -335,10 +335,9 @@ size_t exclude_unremovables(
       walk::parallel::reduce_methods<std::unordered_set<const DexType*>>(
           scope,
           patcher,
-          [](std::unordered_set<const DexType*> left,
-             const std::unordered_set<const DexType*> right) {
+          [](std::unordered_set<const DexType*>& left,
+             std::unordered_set<const DexType*>&& right) {
             left.insert(right.begin(), right.end());
-            return left;
           });
 
   for (const auto type : excluded_by_opcode) {
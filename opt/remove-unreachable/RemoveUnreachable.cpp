@@ -24,9 +24,17 @@ void RemoveUnreachablePass::run_pass(DexStoresVector& stores,
   }
   bool output_unreachable_symbols = pm.get_current_pass_info()->repeat == 0 &&
                                     !m_unreachable_symbols_file_name.empty();
+  if (m_code_refs_cache == nullptr &&
+      conf.get_json_config().get("incremental_reachability", false)) {
+    m_code_refs_cache = std::make_unique<reachability::CodeReferencesCache>();
+  }
+  size_t num_reused_before =
+      m_code_refs_cache ? m_code_refs_cache->num_reused() : 0;
   int num_ignore_check_strings = 0;
   auto reachables = reachability::compute_reachable_objects(
-      stores, m_ignore_sets, &num_ignore_check_strings);
+      stores, m_ignore_sets, &num_ignore_check_strings,
+      /* record_reachability */ false, /* should_mark_all_as_seed */ false,
+      /* out_method_override_graph */ nullptr, m_code_refs_cache.get());
   reachability::ObjectCounts before = reachability::count_objects(stores);
   TRACE(RMU, 1, "before: %lu classes, %lu fields, %lu methods\n",
         before.num_classes, before.num_fields, before.num_methods);
@@ -36,6 +44,10 @@ void RemoveUnreachablePass::run_pass(DexStoresVector& stores,
   TRACE(RMU, 1, "after: %lu classes, %lu fields, %lu methods\n",
         after.num_classes, after.num_fields, after.num_methods);
   pm.incr_metric("num_ignore_check_strings", num_ignore_check_strings);
+  if (m_code_refs_cache) {
+    pm.incr_metric("code_references_reused",
+                   m_code_refs_cache->num_reused() - num_reused_before);
+  }
   pm.incr_metric("classes_removed", before.num_classes - after.num_classes);
   pm.incr_metric("fields_removed", before.num_fields - after.num_fields);
   pm.incr_metric("methods_removed", before.num_methods - after.num_methods);
@@ -28,4 +28,6 @@ class RemoveUnreachablePass : public Pass {
  private:
   reachability::IgnoreSets m_ignore_sets;
   std::string m_unreachable_symbols_file_name;
+  // Kept across the runs of the pass with "incremental_reachability".
+  std::unique_ptr<reachability::CodeReferencesCache> m_code_refs_cache;
 };
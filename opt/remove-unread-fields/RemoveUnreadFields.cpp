@@ -34,11 +34,12 @@ void PassImpl::run_pass(DexStoresVector& stores,
     auto& stats = pair.second;
     TRACE(RMUF,
           3,
-          "%s: %lu %lu %lu %d\n",
+          "%s: %lu %lu %lu %lu %d\n",
           SHOW(field),
           stats.reads,
           stats.reads_outside_init,
           stats.writes,
+          stats.writes_outside_init,
           is_synthetic(field));
     if (stats.reads == 0 && can_remove(field)) {
       ++unread_fields;
@@ -24,10 +24,8 @@ CheckCastAnalysis::collect_redundant_checks_replacement() {
 
   auto* code = m_method->get_code();
   code->build_cfg(/* editable */ false);
-  auto& cfg = code->cfg();
-  type_inference::TypeInference inference(cfg);
-  inference.run(m_method);
-  auto& envs = inference.get_type_environments();
+  auto envs_ptr = type_inference::get_type_environments(m_method);
+  auto& envs = *envs_ptr;
 
   for (auto& mie : InstructionIterable(code)) {
     IRInstruction* insn = mie.insn;
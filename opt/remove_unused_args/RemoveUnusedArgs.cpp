@@ -49,6 +49,25 @@ static LocalDce::Stats add_dce_stats(LocalDce::Stats a, LocalDce::Stats b) {
           a.unreachable_instruction_count + b.unreachable_instruction_count};
 };
 
+/**
+ * Records the callee of the invoke `insn` as having its result used if `next`
+ * moves the result.
+ */
+static void gather_result_used(const IRInstruction* insn,
+                               const IRInstruction* next,
+                               ConcurrentSet<const DexMethod*>* result_used) {
+  if (!is_move_result(next->opcode())) {
+    return;
+  }
+  auto method_ref = insn->get_method();
+  if (!method_ref->is_def()) {
+    // TODO: T31388603 -- Remove unused results for true virtuals.
+    return;
+  }
+  // Since is_def() is true, the following cast is safe and appropriate.
+  result_used->insert(static_cast<const DexMethod*>(method_ref));
+}
+
 /**
  * Returns metrics as listed above from running RemoveArgs:
  * run() removes unused params from method signatures and param loads, then
@@ -56,8 +75,14 @@ static LocalDce::Stats add_dce_stats(LocalDce::Stats a, LocalDce::Stats b) {
  */
 RemoveArgs::PassStats RemoveArgs::run() {
   RemoveArgs::PassStats pass_stats;
-  gather_results_used();
-  auto method_stats = update_meths_with_unused_args_or_results();
+  bool first_iteration = !m_state->initialized;
+  if (first_iteration) {
+    find_devirtualizable_methods();
+    gather_results_used();
+    m_state->initialized = true;
+  }
+  auto method_stats =
+      update_meths_with_unused_args_or_results(!first_iteration);
   pass_stats.method_params_removed_count =
       method_stats.method_params_removed_count;
   pass_stats.methods_updated_count = method_stats.methods_updated_count;
@@ -68,35 +93,45 @@ RemoveArgs::PassStats RemoveArgs::run() {
   return pass_stats;
 }
 
+/**
+ * Finds the virtual methods that can be updated like direct ones, as they are
+ * alone in their virtual scope.
+ */
+void RemoveArgs::find_devirtualizable_methods() {
+  const TypeSystem type_system(m_scope);
+  ConcurrentSet<const DexMethod*> methods;
+  walk::parallel::methods(m_scope, [&](DexMethod* method) {
+    if (!method->is_virtual() || method->get_code() == nullptr) {
+      return;
+    }
+    auto virt_scope = type_system.find_virtual_scope(method);
+    if (virt_scope != nullptr && is_non_virtual_scope(virt_scope)) {
+      methods.insert(method);
+    }
+  });
+  m_state->devirtualizable_methods.insert(methods.begin(), methods.end());
+}
+
 /**
  * Inspects all invoke instructions, and whether they are followed by
  * move-result instructions, and record this information for each method.
+ * Later iterations get this from update_callsites instead.
  */
 void RemoveArgs::gather_results_used() {
-  walk::parallel::code(
-      m_scope, [& result_used = m_result_used](DexMethod*, IRCode& code) {
-        const auto ii = InstructionIterable(code);
-        for (auto it = ii.begin(); it != ii.end(); it++) {
-          auto insn = it->insn;
-          if (!is_invoke(insn->opcode())) {
-            continue;
-          }
-          const auto next = std::next(it);
-          always_assert(next != ii.end());
-          const auto peek = next->insn;
-          if (!is_move_result(peek->opcode())) {
-            continue;
-          }
-          auto method_ref = insn->get_method();
-          if (!method_ref->is_def()) {
-            // TODO: T31388603 -- Remove unused results for true virtuals.
-            continue;
-          }
-          // Since is_def() is true, the following cast is safe and appropriate.
-          DexMethod* method = static_cast<DexMethod*>(method_ref);
-          result_used.insert(method);
-        }
-      });
+  ConcurrentSet<const DexMethod*> result_used;
+  walk::parallel::code(m_scope, [&result_used](DexMethod*, IRCode& code) {
+    const auto ii = InstructionIterable(code);
+    for (auto it = ii.begin(); it != ii.end(); it++) {
+      auto insn = it->insn;
+      if (!is_invoke(insn->opcode())) {
+        continue;
+      }
+      const auto next = std::next(it);
+      always_assert(next != ii.end());
+      gather_result_used(insn, next->insn, &result_used);
+    }
+  });
+  m_state->result_used.insert(result_used.begin(), result_used.end());
 }
 
 /**
@@ -262,8 +297,11 @@ bool RemoveArgs::update_method_signature(
 
 /**
  * For methods that have unused arguments, record live argument registers.
+ * With `only_changed`, only the methods that changed in the last iteration
+ * are looked at.
  */
-RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
+RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results(
+    bool only_changed) {
   // Phase 1: Find (in parallel) all methods that we can potentially update
 
   struct Entry {
@@ -276,8 +314,11 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
     if (method->get_code() == nullptr) {
       return;
     }
+    if (only_changed && !m_state->changed_methods.count(method)) {
+      return;
+    }
     auto proto = method->get_proto();
-    bool result_used = !!m_result_used.count_unsafe(method);
+    bool result_used = !!m_state->result_used.count(method);
     auto num_args = proto->get_args()->size();
     bool remove_result = !proto->is_void() && !result_used;
     // For instance methods, num_args does not count the 'this' argument.
@@ -297,12 +338,10 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
     }
 
     // If a method is devirtualizable, proceed with live arg computation.
-    if (method->is_virtual()) {
-      auto virt_scope = m_type_system.find_virtual_scope(method);
-      if (virt_scope == nullptr || !is_non_virtual_scope(virt_scope)) {
-        // TODO: T31388603 -- Remove unused args for true virtuals.
-        return;
-      }
+    if (method->is_virtual() &&
+        !m_state->devirtualizable_methods.count(method)) {
+      // TODO: T31388603 -- Remove unused args for true virtuals.
+      return;
     }
 
     std::vector<IRInstruction*> dead_insns;
@@ -343,6 +382,7 @@ RemoveArgs::MethodStats RemoveArgs::update_meths_with_unused_args_or_results() {
     // Remember entry for further processing, and log statistics
     DexClass* cls = type_class(method->get_class());
     classes.push_back(cls);
+    m_changed_methods.insert(method);
     class_entries[cls].push_back(p);
     method_stats.methods_updated_count++;
     method_stats.method_params_removed_count += entry.dead_insns.size();
@@ -423,11 +463,13 @@ size_t RemoveArgs::update_callsite(IRInstruction* instr) {
 
 /**
  * Removes unused arguments at callsites and returns the number of arguments
- * removed.
+ * removed. The same walk gathers the results that are used for the next
+ * iteration.
  */
 size_t RemoveArgs::update_callsites() {
   // Walk through all methods to look for and edit callsites.
-  return walk::parallel::reduce_methods<size_t>(
+  ConcurrentSet<const DexMethod*> result_used;
+  auto callsite_args_removed = walk::parallel::reduce_methods<size_t>(
       m_scope,
       [&](DexMethod* method) -> size_t {
         auto code = method->get_code();
@@ -435,19 +477,41 @@ size_t RemoveArgs::update_callsites() {
           return 0;
         }
         size_t callsite_args_removed = 0;
-        for (const auto& mie : InstructionIterable(code)) {
-          auto insn = mie.insn;
-          if (is_invoke(insn->opcode())) {
-            size_t insn_args_removed = update_callsite(insn);
-            if (insn_args_removed > 0) {
-              log_opt(CALLSITE_ARGS_REMOVED, method, insn);
-              callsite_args_removed += insn_args_removed;
-            }
+        const auto ii = InstructionIterable(code);
+        for (auto it = ii.begin(); it != ii.end(); it++) {
+          auto insn = it->insn;
+          if (!is_invoke(insn->opcode())) {
+            continue;
+          }
+          size_t insn_args_removed = update_callsite(insn);
+          if (insn_args_removed > 0) {
+            log_opt(CALLSITE_ARGS_REMOVED, method, insn);
+            callsite_args_removed += insn_args_removed;
           }
+          const auto next = std::next(it);
+          always_assert(next != ii.end());
+          gather_result_used(insn, next->insn, &result_used);
+        }
+        if (callsite_args_removed > 0) {
+          m_changed_methods.insert(method);
         }
         return callsite_args_removed;
       },
       [](size_t a, size_t b) { return a + b; });
+
+  // The local DCE of methods whose results were removed may have removed the
+  // last uses of other results.
+  for (auto method : m_state->result_used) {
+    if (!result_used.count_unsafe(method)) {
+      m_changed_methods.insert(method);
+    }
+  }
+  m_state->result_used.clear();
+  m_state->result_used.insert(result_used.begin(), result_used.end());
+  m_state->changed_methods.clear();
+  m_state->changed_methods.insert(m_changed_methods.begin(),
+                                  m_changed_methods.end());
+  return callsite_args_removed;
 }
 
 void RemoveUnusedArgsPass::configure_pass(const JsonWrapper& jw) {
@@ -465,9 +529,10 @@ void RemoveUnusedArgsPass::run_pass(DexStoresVector& stores,
   size_t num_method_results_removed_count = 0;
   size_t num_iterations = 0;
   LocalDce::Stats local_dce_stats{0, 0};
+  RemoveArgs::IterationState state;
   while (true) {
     num_iterations++;
-    RemoveArgs rm_args(scope, m_black_list, m_total_iterations++);
+    RemoveArgs rm_args(scope, m_black_list, m_total_iterations++, &state);
     auto pass_stats = rm_args.run();
     if (pass_stats.methods_updated_count == 0) {
       break;
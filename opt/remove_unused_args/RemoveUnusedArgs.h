@@ -7,12 +7,13 @@
 
 #pragma once
 
+#include <memory>
 #include <mutex>
+#include <unordered_set>
 
 #include "ConcurrentContainers.h"
 #include "LocalDce.h"
 #include "PassManager.h"
-#include "TypeSystem.h"
 
 namespace remove_unused_args {
 
@@ -32,13 +33,36 @@ class RemoveArgs {
     LocalDce::Stats local_dce_stats{0, 0};
   };
 
+  /**
+   * What an iteration hands on to the next one, so that later iterations
+   * neither rebuild the virtual scopes nor walk the scope to find the used
+   * results, and only look for unused args in methods that changed.
+   */
+  struct IterationState {
+    bool initialized{false};
+    // The virtual methods that are alone in their virtual scope. Renaming
+    // them gives them unique names, so they stay alone.
+    std::unordered_set<const DexMethod*> devirtualizable_methods;
+    // The methods whose results are moved somewhere.
+    std::unordered_set<const DexMethod*> result_used;
+    // The methods whose code or whose results usage changed in the last
+    // iteration. The others can't have any new unused args or results.
+    std::unordered_set<const DexMethod*> changed_methods;
+  };
+
   RemoveArgs(const Scope& scope,
              const std::vector<std::string>& black_list,
              size_t iteration = 0)
+      : RemoveArgs(scope, black_list, iteration, nullptr){};
+  RemoveArgs(const Scope& scope,
+             const std::vector<std::string>& black_list,
+             size_t iteration,
+             IterationState* state)
       : m_scope(scope),
-        m_type_system(scope),
         m_black_list(black_list),
-        m_iteration(iteration){};
+        m_iteration(iteration),
+        m_own_state(state ? nullptr : std::make_unique<IterationState>()),
+        m_state(state ? state : m_own_state.get()){};
   RemoveArgs::PassStats run();
   std::deque<uint16_t> compute_live_args(
       DexMethod* method,
@@ -47,22 +71,25 @@ class RemoveArgs {
 
  private:
   const Scope& m_scope;
-  const TypeSystem m_type_system;
   ConcurrentMap<DexMethod*, std::deque<uint16_t>> m_live_arg_idxs_map;
   std::unordered_map<DexString*, std::unordered_map<DexTypeList*, size_t>>
       m_renamed_indices;
-  ConcurrentSet<DexMethod*> m_result_used;
   const std::vector<std::string>& m_black_list;
   size_t m_iteration;
+  std::unique_ptr<IterationState> m_own_state;
+  IterationState* m_state;
+  // The methods that change in this iteration, for the next one.
+  ConcurrentSet<const DexMethod*> m_changed_methods;
 
   std::deque<DexType*> get_live_arg_type_list(
       DexMethod* method, const std::deque<uint16_t>& live_arg_idxs);
   bool update_method_signature(DexMethod* method,
                                const std::deque<uint16_t>& live_args,
                                bool remove_result);
-  MethodStats update_meths_with_unused_args_or_results();
+  MethodStats update_meths_with_unused_args_or_results(bool only_changed);
   size_t update_callsite(IRInstruction* instr);
   size_t update_callsites();
+  void find_devirtualizable_methods();
   void gather_results_used();
 };
 
@@ -8,6 +8,7 @@
 #include "RenameClassesV2.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/regex.hpp>
 #include <map>
@@ -23,6 +24,7 @@
 #include "RedexResources.h"
 #include "Walkers.h"
 #include "Warning.h"
+#include "WorkQueue.h"
 
 #include <locator.h>
 using facebook::Locator;
@@ -542,6 +544,115 @@ DexString* lookup_signature_annotation(const AliasMap& aliases,
   return nullptr;
 }
 
+static void walk_code(DexClass* cls,
+                      const std::function<void(IRCode&)>& walker) {
+  for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+    for (auto* method : *methods) {
+      auto code = method->get_code();
+      if (code != nullptr) {
+        walker(*code);
+      }
+    }
+  }
+}
+
+/* Calls `walker` on the annotations of `cls` and of its members, like
+ * walk::annotations does for a whole scope.
+ */
+static void walk_annotations(
+    DexClass* cls, const std::function<void(DexAnnotation*)>& walker) {
+  auto walk_set = [&](DexAnnotationSet* anno_set) {
+    if (anno_set == nullptr) return;
+    for (auto* anno : anno_set->get_annotations()) {
+      walker(anno);
+    }
+  };
+  walk_set(cls->get_anno_set());
+  for (auto* fields : {&cls->get_ifields(), &cls->get_sfields()}) {
+    for (auto* field : *fields) {
+      walk_set(field->get_anno_set());
+    }
+  }
+  for (auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+    for (auto* method : *methods) {
+      walk_set(method->get_anno_set());
+      const auto& param_anno = method->get_param_anno();
+      if (!param_anno) continue;
+      for (const auto& it : *param_anno) {
+        walk_set(it.second);
+      }
+    }
+  }
+}
+
+/* Rewrites a const-string holding the name of a force renamed class. Returns
+ * true if `insn` was changed.
+ */
+static bool rewrite_const_string(
+    IRInstruction* insn,
+    const AliasMap& aliases,
+    const std::unordered_set<const DexClass*>& force_rename_classes) {
+  if (insn->opcode() != OPCODE_CONST_STRING) {
+    return false;
+  }
+  DexString* str = insn->get_string();
+  // get_string instead of make_string here because if the string doesn't
+  // already exist, then there's no way it can match a class
+  // that was renamed
+  DexString* internal_str = DexString::get_string(
+      JavaNameUtil::external_to_internal(str->c_str()).c_str());
+  // Look up both str and intternal_str in the map; maybe str was
+  // internal to begin with?
+  DexString* alias_from = nullptr;
+  DexString* alias_to = nullptr;
+  if (aliases.has(internal_str)) {
+    alias_from = internal_str;
+    alias_to = aliases.at(internal_str);
+    // Since we matched on external form, we need to map internal alias
+    // back.
+    // make_string here because the external form of the name may not be
+    // present in the string table
+    alias_to = DexString::make_string(
+        JavaNameUtil::internal_to_external(alias_to->str()));
+  } else if (aliases.has(str)) {
+    alias_from = str;
+    alias_to = aliases.at(str);
+  }
+  if (alias_to == nullptr) {
+    return false;
+  }
+  DexType* alias_from_type = DexType::get_type(alias_from);
+  DexClass* alias_from_cls = type_class(alias_from_type);
+  if (!force_rename_classes.count(alias_from_cls)) {
+    return false;
+  }
+  insn->set_string(alias_to);
+  TRACE(RENAME, 3, "Rewrote const-string \"%s\" to \"%s\"\n",
+        str->c_str(), alias_to->c_str());
+  return true;
+}
+
+static void rewrite_signature_annotation(DexAnnotation* anno,
+                                         const AliasMap& aliases) {
+  for (auto elem : anno->anno_elems()) {
+    auto ev = elem.encoded_value;
+    if (ev->evtype() != DEVT_ARRAY) continue;
+    auto arrayev = static_cast<DexEncodedValueArray*>(ev);
+    auto const& evs = arrayev->evalues();
+    for (auto strev : *evs) {
+      if (strev->evtype() != DEVT_STRING) continue;
+      auto stringev = static_cast<DexEncodedValueString*>(strev);
+      DexString* old_str = stringev->string();
+      DexString* new_str = lookup_signature_annotation(aliases, old_str);
+      if (new_str != nullptr) {
+        TRACE(RENAME, 5, "Rewriting Signature from '%s' to '%s'\n",
+              old_str->c_str(), new_str->c_str());
+        stringev->string(new_str);
+      }
+    }
+  }
+}
+
 void RenameClassesPassV2::eval_classes(Scope& scope,
                                        const ClassHierarchy& class_hierarchy,
                                        ConfigFiles& conf,
@@ -597,7 +708,7 @@ void RenameClassesPassV2::eval_classes(Scope& scope,
     // Don't rename anything mentioned in resources. Two variants of checks here
     // to cover both configuration options (either we're relying on aapt to
     // compute resource reachability, or we're doing it ourselves).
-    if (dont_rename_resources.count(clsname) ||
+    if (dont_rename_resources.count(strname) ||
           (referenced_by_layouts(clazz)
             && !is_allowed_layout_class(clazz, m_allow_layout_rename_packages))) {
       m_dont_rename_reasons[clazz] =
@@ -606,7 +717,7 @@ void RenameClassesPassV2::eval_classes(Scope& scope,
     }
 
     // Don't rename anythings in the direct name blacklist (hierarchy ignored)
-    if (m_dont_rename_specific.count(clsname)) {
+    if (m_dont_rename_specific.count(strname)) {
       m_dont_rename_reasons[clazz] =
           { DontRenameReasonCode::Specific, strname };
       continue;
@@ -625,19 +736,19 @@ void RenameClassesPassV2::eval_classes(Scope& scope,
     }
     if (package_blacklisted) continue;
 
-    if (dont_rename_class_name_literals.count(clsname)) {
+    if (dont_rename_class_name_literals.count(strname)) {
       m_dont_rename_reasons[clazz] =
           { DontRenameReasonCode::ClassNameLiterals, norule };
       continue;
     }
 
-    if (dont_rename_class_for_types_with_reflection.count(clsname)) {
+    if (dont_rename_class_for_types_with_reflection.count(strname)) {
       m_dont_rename_reasons[clazz] =
           { DontRenameReasonCode::ClassForTypesWithReflection, norule };
       continue;
     }
 
-    if (dont_rename_canaries.count(clsname)) {
+    if (dont_rename_canaries.count(strname)) {
       m_dont_rename_reasons[clazz] = { DontRenameReasonCode::Canaries, norule };
       continue;
     }
@@ -690,7 +801,7 @@ void RenameClassesPassV2::eval_classes_post(
     std::string strname = std::string(clsname);
 
     // Don't rename anythings in the direct name blacklist (hierarchy ignored)
-    if (m_dont_rename_specific.count(clsname)) {
+    if (m_dont_rename_specific.count(strname)) {
       m_dont_rename_reasons[clazz] = {DontRenameReasonCode::Specific, strname};
       continue;
     }
@@ -743,6 +854,12 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
 
   AliasMap aliases;
   uint32_t sequence = 0;
+  // New names only differ in their encoded index, so they are all built in
+  // the same buffer behind a fixed "L<prefix>".
+  std::string new_name("L" + m_package_prefix);
+  const size_t new_name_prefix_len = new_name.size();
+  std::string old_array_name;
+  std::string new_array_name;
   for (auto clazz : scope) {
     auto dtype = clazz->get_type();
     auto oldname = dtype->get_name();
@@ -782,28 +899,32 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
 
     sequence++;
 
-    std::string prefixed_descriptor = prepend_package_prefix(descriptor);
+    always_assert_log(*descriptor == 'L',
+                      "Class descriptor \"%s\" did not start with L!\n",
+                      descriptor);
+    new_name.resize(new_name_prefix_len);
+    new_name.append(descriptor + 1);
 
     TRACE(RENAME, 2, "'%s' ->  %s (%u)'\n", oldname->c_str(),
-          prefixed_descriptor.c_str(), sequence);
+          new_name.c_str(), sequence);
 
-    auto exists = DexString::get_string(prefixed_descriptor);
+    // The string table is already hashed, so this is the cheapest way to
+    // check the name against every existing descriptor.
+    auto exists = DexString::get_string(new_name);
     always_assert_log(!exists, "Collision on class %s (%s)", oldname->c_str(),
-                      prefixed_descriptor.c_str());
+                      new_name.c_str());
 
-    auto dstring = DexString::make_string(prefixed_descriptor);
+    auto dstring = DexString::make_string(new_name);
     aliases.add_class_alias(clazz, dstring);
     dtype->set_name(dstring);
-    std::string old_str(oldname->c_str());
-    // std::string new_str(descriptor);
-    // proguard_map.update_class_mapping(old_str, new_str);
-    m_base_strings_size += strlen(oldname->c_str());
-    m_ren_strings_size += strlen(dstring->c_str());
+    m_base_strings_size += oldname->size();
+    m_ren_strings_size += dstring->size();
 
+    old_array_name.assign(oldname->c_str(), oldname->size());
+    new_array_name.assign(dstring->c_str(), dstring->size());
     while (1) {
-      std::string arrayop("[");
-      arrayop += oldname->c_str();
-      oldname = DexString::get_string(arrayop);
+      old_array_name.insert(0, 1, '[');
+      oldname = DexString::get_string(old_array_name);
       if (oldname == nullptr) {
         break;
       }
@@ -811,84 +932,37 @@ void RenameClassesPassV2::rename_classes(Scope& scope,
       if (arraytype == nullptr) {
         break;
       }
-      std::string newarraytype("[");
-      newarraytype += dstring->c_str();
-      dstring = DexString::make_string(newarraytype);
+      new_array_name.insert(0, 1, '[');
+      dstring = DexString::make_string(new_array_name);
 
       aliases.add_alias(oldname, dstring);
       arraytype->set_name(dstring);
     }
   }
 
-  /* Now rewrite all const-string strings for force renamed classes. */
-  auto match = std::make_tuple(m::const_string());
-
-  walk::matching_opcodes(
-      scope, match,
-      [&](const DexMethod*, const std::vector<IRInstruction*>& insns) {
-        IRInstruction* insn = insns[0];
-        DexString* str = insn->get_string();
-        // get_string instead of make_string here because if the string doesn't
-        // already exist, then there's no way it can match a class
-        // that was renamed
-        DexString* internal_str = DexString::get_string(
-            JavaNameUtil::external_to_internal(str->c_str()).c_str());
-        // Look up both str and intternal_str in the map; maybe str was
-        // internal to begin with?
-        DexString* alias_from = nullptr;
-        DexString* alias_to = nullptr;
-        if (aliases.has(internal_str)) {
-          alias_from = internal_str;
-          alias_to = aliases.at(internal_str);
-          // Since we matched on external form, we need to map internal alias
-          // back.
-          // make_string here because the external form of the name may not be
-          // present in the string table
-          alias_to = DexString::make_string(
-              JavaNameUtil::internal_to_external(alias_to->str()));
-        } else if (aliases.has(str)) {
-          alias_from = str;
-          alias_to = aliases.at(str);
-        }
-        if (alias_to) {
-          DexType* alias_from_type = DexType::get_type(alias_from);
-          DexClass* alias_from_cls = type_class(alias_from_type);
-          if (m_force_rename_classes.count(alias_from_cls)) {
-            mgr.incr_metric(METRIC_REWRITTEN_CONST_STRINGS, 1);
-            insn->set_string(alias_to);
-            TRACE(RENAME, 3, "Rewrote const-string \"%s\" to \"%s\"\n",
-                str->c_str(), alias_to->c_str());
-          }
-        }
-      });
-
-  /* Now we need to re-write the Signature annotations.  They use
-   * Strings rather than Type's, so they have to be explicitly
-   * handled.
+  /* Now rewrite all const-string strings for force renamed classes, and
+   * the Signature annotations. The latter use Strings rather than Types, so
+   * they have to be explicitly handled. Both only read the alias map, so
+   * they are done together in a single parallel walk over the classes.
    */
   static DexType *dalviksig =
     DexType::get_type("Ldalvik/annotation/Signature;");
-  walk::annotations(scope, [&](DexAnnotation* anno) {
-    if (anno->type() != dalviksig) return;
-    auto elems = anno->anno_elems();
-    for (auto elem : elems) {
-      auto ev = elem.encoded_value;
-      if (ev->evtype() != DEVT_ARRAY) continue;
-      auto arrayev = static_cast<DexEncodedValueArray*>(ev);
-      auto const& evs = arrayev->evalues();
-      for (auto strev : *evs) {
-        if (strev->evtype() != DEVT_STRING) continue;
-        auto stringev = static_cast<DexEncodedValueString*>(strev);
-        DexString* old_str = stringev->string();
-        DexString* new_str = lookup_signature_annotation(aliases, old_str);
-        if (new_str != nullptr) {
-          TRACE(RENAME, 5, "Rewriting Signature from '%s' to '%s'\n",
-                old_str->c_str(), new_str->c_str());
-          stringev->string(new_str);
+  std::atomic<size_t> num_rewritten_const_strings{0};
+  walk::parallel::classes(scope, [&](DexClass* cls) {
+    walk_code(cls, [&](IRCode& code) {
+      for (const auto& mie : InstructionIterable(code)) {
+        if (rewrite_const_string(mie.insn, aliases, m_force_rename_classes)) {
+          num_rewritten_const_strings++;
         }
       }
-    }
+    });
+    walk_annotations(cls, [&](DexAnnotation* anno) {
+      if (anno->type() == dalviksig) {
+        rewrite_signature_annotation(anno, aliases);
+      }
+    });
   });
+  mgr.incr_metric(METRIC_REWRITTEN_CONST_STRINGS, num_rewritten_const_strings);
 
   rename_classes_in_layouts(aliases, mgr);
 
@@ -906,12 +980,13 @@ void RenameClassesPassV2::rename_classes_in_layouts(
       JavaNameUtil::internal_to_external(apair.first->str()),
       JavaNameUtil::internal_to_external(apair.second->str()));
   }
-  ssize_t layout_bytes_delta = 0;
-  size_t num_layout_renamed = 0;
+  std::atomic<ssize_t> layout_bytes_delta{0};
+  std::atomic<size_t> num_layout_renamed{0};
   auto xml_files = get_xml_files(m_apk_dir + "/res");
-  for (const auto& path : xml_files) {
+  // Every layout is its own file, so they can be rewritten in parallel.
+  auto wq = workqueue_foreach<std::string>([&](const std::string& path) {
     if (is_raw_resource(path)) {
-      continue;
+      return;
     }
     size_t num_renamed = 0;
     ssize_t out_delta = 0;
@@ -925,26 +1000,18 @@ void RenameClassesPassV2::rename_classes_in_layouts(
       path.c_str());
     layout_bytes_delta += out_delta;
     num_layout_renamed += num_renamed;
+  });
+  for (const auto& path : xml_files) {
+    wq.add_item(path);
   }
+  wq.run_all();
   mgr.incr_metric("layout_bytes_delta", layout_bytes_delta);
   TRACE(
     RENAME,
     2,
     "Renamed %zu ResStringPool entries, delta %zi bytes\n",
-    num_layout_renamed,
-    layout_bytes_delta);
-}
-
-std::string RenameClassesPassV2::prepend_package_prefix(
-    const char* descriptor) {
-  always_assert_log(*descriptor == 'L',
-                    "Class descriptor \"%s\" did not start with L!\n",
-                    descriptor);
-  descriptor++; // drop letter 'L'
-
-  std::stringstream ss;
-  ss << "L" << m_package_prefix << descriptor;
-  return ss.str();
+    num_layout_renamed.load(),
+    layout_bytes_delta.load());
 }
 
 void RenameClassesPassV2::run_pass(DexStoresVector& stores,
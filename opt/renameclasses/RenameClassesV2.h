@@ -92,8 +92,6 @@ class RenameClassesPassV2 : public Pass {
                       PassManager& mgr);
   void rename_classes_in_layouts(const AliasMap& aliases, PassManager& mgr);
 
-  std::string prepend_package_prefix(const char* descriptor);
-
   int m_base_strings_size = 0;
   int m_ren_strings_size = 0;
   int m_digits = 0;
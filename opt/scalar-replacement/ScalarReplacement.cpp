@@ -0,0 +1,405 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ScalarReplacement.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ConfigFiles.h"
+#include "DexUtil.h"
+#include "IRCode.h"
+#include "Inliner.h"
+#include "Liveness.h"
+#include "LocalPointersAnalysis.h"
+#include "PassManager.h"
+#include "Resolver.h"
+#include "Walkers.h"
+
+namespace ptrs = local_pointers;
+
+namespace {
+
+constexpr const char* METRIC_ALLOCATIONS_REMOVED = "allocations_removed";
+constexpr const char* METRIC_FIELD_REGISTERS = "field_registers";
+constexpr const char* METRIC_METHODS_CHANGED = "methods_changed";
+constexpr const char* METRIC_INLINE_ROUNDS = "inline_rounds";
+
+struct Stats {
+  size_t allocations_removed{0};
+  size_t field_registers{0};
+  size_t methods_changed{0};
+  size_t inline_rounds{0};
+};
+
+/*
+ * Whether allocating an instance of `cls` has no effect but running its
+ * constructor: no class initialization, and no finalization later.
+ */
+bool is_candidate_class(const DexClass* cls) {
+  if (cls == nullptr || cls->is_external() || is_interface(cls) ||
+      is_abstract(cls) || cls->get_super_class() != get_object_type() ||
+      cls->get_clinit() != nullptr) {
+    return false;
+  }
+  for (const auto* method : cls->get_vmethods()) {
+    if (method->get_name()->str() == "finalize" &&
+        method->get_proto()->get_args()->size() == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool is_object_init(const DexMethodRef* method) {
+  return method->get_class() == get_object_type() && is_init(method);
+}
+
+/*
+ * What becomes of an instruction that uses one of the replaced objects.
+ */
+struct Rewrite {
+  enum Kind { ALLOCATION, GET, PUT, REMOVE };
+  Kind kind;
+  const IRInstruction* site;
+  // The field of a GET or PUT.
+  DexField* field;
+};
+
+struct Site {
+  DexClass* cls;
+  bool rejected{false};
+  // The invokes of methods of the class on the object, still to be inlined.
+  std::unordered_set<IRInstruction*> to_inline;
+};
+
+struct Analysis {
+  // By new-instance instruction.
+  std::unordered_map<const IRInstruction*, Site> sites;
+  std::unordered_map<const IRInstruction*, Rewrite> rewrites;
+};
+
+/*
+ * Whether `pointers` is exactly the object allocated at `site`, rather than
+ * maybe that object.
+ */
+bool is_only(const ptrs::PointerSet& pointers, const IRInstruction* site) {
+  return pointers.is_value() && pointers.size() == 1 &&
+         pointers.contains(site);
+}
+
+/*
+ * Classifies the use of the object allocated at `site`, which may be in
+ * source `src_idx` of `insn`, as `pointers` tells.
+ */
+void analyze_use(IRInstruction* insn,
+                 size_t src_idx,
+                 const ptrs::PointerSet& pointers,
+                 const IRInstruction* site,
+                 const DexMethod* caller,
+                 Site* info,
+                 Analysis* analysis) {
+  auto op = insn->opcode();
+  if (is_move(op)) {
+    // The dest gets the same pointers, and its uses get looked at in turn.
+    return;
+  }
+  if (!is_only(pointers, site)) {
+    info->rejected = true;
+    return;
+  }
+  if ((is_iget(op) || is_iput(op)) && src_idx == insn->srcs_size() - 1) {
+    auto field = resolve_field(insn->get_field(), FieldSearch::Instance);
+    if (field == nullptr || field->get_class() != info->cls->get_type()) {
+      info->rejected = true;
+      return;
+    }
+    analysis->rewrites[insn] = {is_iget(op) ? Rewrite::GET : Rewrite::PUT,
+                                site, field};
+    return;
+  }
+  if ((op == OPCODE_INVOKE_DIRECT || op == OPCODE_INVOKE_VIRTUAL) &&
+      src_idx == 0) {
+    if (op == OPCODE_INVOKE_DIRECT && is_object_init(insn->get_method())) {
+      analysis->rewrites[insn] = {Rewrite::REMOVE, site, nullptr};
+      return;
+    }
+    auto callee = resolve_method(insn->get_method(), opcode_to_search(insn));
+    if (callee != nullptr && callee != caller &&
+        callee->get_class() == info->cls->get_type() &&
+        callee->is_concrete() && callee->get_code() != nullptr) {
+      info->to_inline.insert(insn);
+      return;
+    }
+  }
+  // Stored, passed, returned, compared, thrown, synchronized on...
+  info->rejected = true;
+}
+
+/*
+ * Finds the objects of the candidate classes that `code` allocates, and
+ * what every use of each turns into. An object is rejected when it may
+ * escape, when a register may hold it or something else where it's used,
+ * or when the object that an earlier run of its new-instance allocated may
+ * still be live as it runs again.
+ */
+Analysis analyze(const DexMethod* method,
+                 IRCode* code,
+                 const std::unordered_set<const DexType*>& candidates) {
+  Analysis analysis;
+  for (auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    if (insn->opcode() == OPCODE_NEW_INSTANCE &&
+        candidates.count(insn->get_type())) {
+      analysis.sites.emplace(insn, Site{type_class(insn->get_type())});
+    }
+  }
+  if (analysis.sites.empty()) {
+    return analysis;
+  }
+
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  ptrs::FixpointIterator fp_iter(cfg);
+  fp_iter.run(ptrs::Environment());
+  LivenessFixpointIterator liveness(cfg);
+  liveness.run(LivenessDomain(code->get_registers_size()));
+
+  std::unordered_set<const IRInstruction*> reached;
+  for (auto* block : cfg.blocks()) {
+    auto env = fp_iter.get_entry_state_at(block);
+    if (env.is_bottom()) {
+      continue;
+    }
+    // The registers live right before each allocation of the block.
+    std::unordered_map<const IRInstruction*, LivenessDomain> live_at;
+    auto live = liveness.get_live_out_vars_at(block);
+    for (auto it = block->rbegin(); it != block->rend(); ++it) {
+      if (it->type != MFLOW_OPCODE) {
+        continue;
+      }
+      liveness.analyze_instruction(it->insn, &live);
+      if (analysis.sites.count(it->insn)) {
+        live_at.emplace(it->insn, live);
+      }
+    }
+    for (auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      auto site_it = analysis.sites.find(insn);
+      if (site_it != analysis.sites.end()) {
+        reached.insert(insn);
+        analysis.rewrites[insn] = {Rewrite::ALLOCATION, insn, nullptr};
+        const auto& live_here = live_at.at(insn);
+        for (uint16_t reg = 0; reg < code->get_registers_size(); ++reg) {
+          auto pointers = env.get_pointers(reg);
+          if (live_here.contains(reg) && pointers.is_value() &&
+              pointers.contains(insn)) {
+            site_it->second.rejected = true;
+          }
+        }
+      }
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        auto pointers = env.get_pointers(insn->src(i));
+        if (!pointers.is_value()) {
+          continue;
+        }
+        for (const auto* pointer : pointers.elements()) {
+          auto it = analysis.sites.find(pointer);
+          if (it != analysis.sites.end()) {
+            analyze_use(insn, i, pointers, pointer, method, &it->second,
+                        &analysis);
+          }
+        }
+      }
+      fp_iter.analyze_instruction(insn, &env);
+    }
+  }
+  code->clear_cfg();
+
+  for (auto& pair : analysis.sites) {
+    if (!reached.count(pair.first)) {
+      pair.second.rejected = true;
+    }
+  }
+  return analysis;
+}
+
+IROpcode move_for(const DexType* type) {
+  return is_wide_type(type)
+             ? OPCODE_MOVE_WIDE
+             : is_object(type) ? OPCODE_MOVE_OBJECT : OPCODE_MOVE;
+}
+
+/*
+ * Rewrites the accepted allocations of `analysis` and their uses. The
+ * allocation leaves a null behind, for the moves of the object that remain,
+ * and zeroes the registers of the fields, which hold their default values.
+ */
+void replace_objects(IRCode* code,
+                     const Analysis& analysis,
+                     const std::unordered_set<const IRInstruction*>& accepted,
+                     Stats* stats) {
+  std::unordered_map<const IRInstruction*,
+                     std::unordered_map<const DexField*, uint16_t>>
+      site_fields;
+  for (const auto* site : accepted) {
+    auto& regs = site_fields[site];
+    for (auto* field : analysis.sites.at(site).cls->get_ifields()) {
+      regs[field] = is_wide_type(field->get_type()) ? code->allocate_wide_temp()
+                                                    : code->allocate_temp();
+      ++stats->field_registers;
+    }
+  }
+
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto rewrite_it = analysis.rewrites.find(it->insn);
+    if (rewrite_it == analysis.rewrites.end() ||
+        !accepted.count(rewrite_it->second.site)) {
+      continue;
+    }
+    const auto& rewrite = rewrite_it->second;
+    const auto& regs = site_fields.at(rewrite.site);
+    auto insn = it->insn;
+    switch (rewrite.kind) {
+    case Rewrite::ALLOCATION: {
+      auto dest = ir_list::move_result_pseudo_of(it)->dest();
+      code->insert_before(it, (new IRInstruction(OPCODE_CONST))
+                                  ->set_dest(dest)
+                                  ->set_literal(0));
+      for (const auto& pair : regs) {
+        auto op = is_wide_type(pair.first->get_type()) ? OPCODE_CONST_WIDE
+                                                       : OPCODE_CONST;
+        code->insert_before(
+            it, (new IRInstruction(op))->set_dest(pair.second)->set_literal(0));
+      }
+      break;
+    }
+    case Rewrite::GET: {
+      auto dest = ir_list::move_result_pseudo_of(it)->dest();
+      auto move = new IRInstruction(move_for(rewrite.field->get_type()));
+      code->insert_before(
+          it, move->set_dest(dest)->set_src(0, regs.at(rewrite.field)));
+      break;
+    }
+    case Rewrite::PUT: {
+      auto move = new IRInstruction(move_for(rewrite.field->get_type()));
+      code->insert_before(
+          it, move->set_dest(regs.at(rewrite.field))->set_src(0, insn->src(0)));
+      break;
+    }
+    case Rewrite::REMOVE:
+      break;
+    }
+    code->remove_opcode(it);
+  }
+  stats->allocations_removed += accepted.size();
+}
+
+/*
+ * Inlines the methods invoked on the objects that `method` allocates until
+ * only field accesses are left, and replaces the objects for which that
+ * worked out. The code is left as it was if none could be.
+ */
+void replace_objects_in(DexMethod* method,
+                        const std::unordered_set<const DexType*>& candidates,
+                        MultiMethodInliner& inliner,
+                        size_t max_inline_rounds,
+                        Stats* stats) {
+  auto code = method->get_code();
+  std::unique_ptr<IRCode> original;
+  std::unordered_set<IRInstruction*> inlined;
+  for (size_t round = 0;; ++round) {
+    auto analysis = analyze(method, code, candidates);
+    std::unordered_set<IRInstruction*> to_inline;
+    for (const auto& pair : analysis.sites) {
+      if (!pair.second.rejected) {
+        to_inline.insert(pair.second.to_inline.begin(),
+                         pair.second.to_inline.end());
+      }
+    }
+    // Invokes that were meant to be inlined last round, and weren't, won't
+    // be this round either.
+    bool stuck = !to_inline.empty() &&
+                 std::all_of(to_inline.begin(), to_inline.end(),
+                             [&](IRInstruction* insn) {
+                               return inlined.count(insn) != 0;
+                             });
+    if (to_inline.empty() || stuck || round == max_inline_rounds) {
+      std::unordered_set<const IRInstruction*> accepted;
+      for (const auto& pair : analysis.sites) {
+        if (!pair.second.rejected && pair.second.to_inline.empty()) {
+          accepted.insert(pair.first);
+        }
+      }
+      if (!accepted.empty()) {
+        TRACE(SCALAR_REPL, 3, "Replacing %d objects in %s\n",
+              accepted.size(), SHOW(method));
+        replace_objects(code, analysis, accepted, stats);
+        ++stats->methods_changed;
+      } else if (original != nullptr) {
+        method->set_code(std::move(original));
+      }
+      return;
+    }
+    if (original == nullptr) {
+      original = std::make_unique<IRCode>(*code);
+    }
+    inlined = to_inline;
+    inliner.inline_callees(method, to_inline);
+    ++stats->inline_rounds;
+  }
+}
+
+} // namespace
+
+void ScalarReplacementPass::run_pass(DexStoresVector& stores,
+                                     ConfigFiles& conf,
+                                     PassManager& mgr) {
+  auto scope = build_class_scope(stores);
+  std::unordered_set<const DexType*> candidates;
+  for (auto* cls : scope) {
+    if (is_candidate_class(cls)) {
+      candidates.insert(cls->get_type());
+    }
+  }
+
+  MethodRefCache resolved_refs;
+  auto resolver = [&](DexMethodRef* method, MethodSearch search) {
+    return resolve_method(method, search, resolved_refs);
+  };
+  std::unordered_set<DexMethod*> no_default_inlinables;
+  MultiMethodInliner inliner(scope, stores, no_default_inlinables, resolver,
+                             conf.get_inliner_config());
+
+  // The inliner isn't safe to share between threads.
+  Stats stats;
+  walk::code(scope, [&](DexMethod* method, IRCode& code) {
+    for (auto& mie : InstructionIterable(code)) {
+      if (mie.insn->opcode() == OPCODE_NEW_INSTANCE &&
+          candidates.count(mie.insn->get_type())) {
+        replace_objects_in(method, candidates, inliner, m_max_inline_rounds,
+                           &stats);
+        return;
+      }
+    }
+  });
+
+  mgr.incr_metric(METRIC_ALLOCATIONS_REMOVED, stats.allocations_removed);
+  mgr.incr_metric(METRIC_FIELD_REGISTERS, stats.field_registers);
+  mgr.incr_metric(METRIC_METHODS_CHANGED, stats.methods_changed);
+  mgr.incr_metric(METRIC_INLINE_ROUNDS, stats.inline_rounds);
+  TRACE(SCALAR_REPL, 1,
+        "Removed %d allocations in %d methods, with %d field registers\n",
+        stats.allocations_removed, stats.methods_changed,
+        stats.field_registers);
+}
+
+static ScalarReplacementPass s_pass;
@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "Pass.h"
+
+/*
+ * Replaces the objects that a method allocates and that never escape it by
+ * registers holding their fields, so that they don't get allocated at all:
+ *
+ *   new-instance LPoint;                    const v0 0
+ *   move-result-pseudo-object v0            const v3 0
+ *   invoke-direct {v0, v1} LPoint;.<init>   move v3, v1
+ *   invoke-virtual {v0} LPoint;.getX()I  => move v2, v3
+ *   move-result v2
+ *
+ * The methods invoked on such an object -- its constructor, its accessors --
+ * are inlined first, as long as they are inlinable, so that all that is left
+ * are field accesses. The local pointers escape analysis tells which
+ * registers may hold the object.
+ *
+ * Only classes that extend Object directly and have neither a static
+ * initializer nor a finalizer are candidates, so that allocating one has no
+ * effect but running its constructor.
+ */
+class ScalarReplacementPass : public Pass {
+ public:
+  ScalarReplacementPass() : Pass("ScalarReplacementPass") {}
+
+  void configure_pass(const JsonWrapper& jw) override {
+    // How many rounds of inlining the methods invoked on an object may take,
+    // as the inlined code may invoke more of them.
+    jw.get("max_inline_rounds", 4, m_max_inline_rounds);
+  }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
+
+ private:
+  size_t m_max_inline_rounds{4};
+};
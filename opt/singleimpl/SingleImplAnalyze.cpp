@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -24,6 +25,7 @@
 #include "Resolver.h"
 #include "Trace.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 struct AnalysisImpl : SingleImplAnalysis {
   AnalysisImpl(const Scope& scope,
@@ -34,14 +36,32 @@ struct AnalysisImpl : SingleImplAnalysis {
   void create_single_impl(const TypeMap& single_impl,
                           const TypeSet& intfs,
                           const SingleImplConfig& config);
-  void collect_field_defs();
-  void collect_method_defs();
-  void analyze_opcodes();
+  void collect_uses();
   void escape_cross_stores();
   void remove_escaped();
 
  private:
+  /**
+   * The uses of the single impl interfaces in one class, and the escapes
+   * they cause.
+   */
+  struct ClassUses {
+    std::vector<std::pair<DexType*, DexField*>> fielddefs;
+    std::vector<std::pair<DexType*, DexMethod*>> methoddefs;
+    std::vector<std::pair<DexType*, IRInstruction*>> typerefs;
+    std::vector<std::tuple<DexType*, DexFieldRef*, IRInstruction*>> fieldrefs;
+    std::vector<std::tuple<DexType*, DexMethodRef*, IRInstruction*>>
+        intf_methodrefs;
+    std::vector<std::tuple<DexType*, DexMethodRef*, IRInstruction*>>
+        methodrefs;
+    std::vector<std::pair<DexType*, EscapeReason>> escapes;
+  };
+
   DexType* get_and_check_single_impl(DexType* type);
+  DexType* get_and_check_single_impl(DexType* type, ClassUses* uses) const;
+  void collect_field_defs(DexClass* cls, ClassUses* uses) const;
+  void collect_method_defs(DexClass* cls, ClassUses* uses) const;
+  void analyze_opcodes(DexClass* cls, ClassUses* uses) const;
   void collect_children(const TypeSet& intfs);
   void check_impl_hierarchy();
   void escape_with_clinit();
@@ -77,6 +97,25 @@ DexType* AnalysisImpl::get_and_check_single_impl(DexType* type) {
   return nullptr;
 }
 
+/**
+ * Same as above, but the array escape is recorded in `uses` rather than
+ * applied, so that classes can be analyzed in parallel.
+ */
+DexType* AnalysisImpl::get_and_check_single_impl(DexType* type,
+                                                 ClassUses* uses) const {
+  if (exists(single_impls, type)) return type;
+  if (is_array(type)) {
+    auto array_type = get_array_type(type);
+    redex_assert(array_type);
+    const auto sit = single_impls.find(array_type);
+    if (sit != single_impls.end()) {
+      uses->escapes.emplace_back(sit->first, HAS_ARRAY_TYPE);
+      return sit->first;
+    }
+  }
+  return nullptr;
+}
+
 /**
  * Find all single implemented interfaces.
  */
@@ -287,15 +326,16 @@ void AnalysisImpl::remove_escaped() {
 /**
  * Find all fields typed with the single impl interface.
  */
-void AnalysisImpl::collect_field_defs() {
-  walk::fields(scope,
-              [&](DexField* field) {
-                auto type = field->get_type();
-                auto intf = get_and_check_single_impl(type);
-                if (intf) {
-                  single_impls[intf].fielddefs.push_back(field);
-                }
-              });
+void AnalysisImpl::collect_field_defs(DexClass* cls, ClassUses* uses) const {
+  for (const auto* fields : {&cls->get_ifields(), &cls->get_sfields()}) {
+    for (auto field : *fields) {
+      auto type = field->get_type();
+      auto intf = get_and_check_single_impl(type, uses);
+      if (intf) {
+        uses->fielddefs.emplace_back(intf, field);
+      }
+    }
+  }
 }
 
 /**
@@ -303,19 +343,19 @@ void AnalysisImpl::collect_field_defs() {
  * Also if a method with the interface in the signature is native mark the
  * interface as "escaped".
  */
-void AnalysisImpl::collect_method_defs() {
+void AnalysisImpl::collect_method_defs(DexClass* cls, ClassUses* uses) const {
 
   auto check_method_arg = [&](DexType* type, DexMethod* method, bool native) {
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, uses);
     if (!intf) return;
     if (native) {
-      escape_interface(intf, NATIVE_METHOD);
+      uses->escapes.emplace_back(intf, NATIVE_METHOD);
     }
-    single_impls[intf].methoddefs.insert(method);
+    uses->methoddefs.emplace_back(intf, method);
   };
 
-  walk::methods(scope,
-    [&](DexMethod* method) {
+  for (const auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+    for (auto method : *methods) {
       auto proto = method->get_proto();
       bool native = is_native(method);
       check_method_arg(proto->get_rtype(), method, native);
@@ -323,19 +363,20 @@ void AnalysisImpl::collect_method_defs() {
       for (const auto it : args->get_type_list()) {
         check_method_arg(it, method, native);
       }
-    });
+    }
+  }
 }
 
 /**
  * Find all opcodes that reference a single implemented interface in a typeref,
  * fieldref or methodref.
  */
-void AnalysisImpl::analyze_opcodes() {
+void AnalysisImpl::analyze_opcodes(DexClass* cls, ClassUses* uses) const {
 
   auto check_arg = [&](DexType* type, DexMethodRef* meth, IRInstruction* insn) {
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, uses);
     if (intf) {
-      single_impls[intf].methodrefs[meth].insert(insn);
+      uses->methodrefs.emplace_back(intf, meth, insn);
     }
   };
 
@@ -351,98 +392,152 @@ void AnalysisImpl::analyze_opcodes() {
 
   auto check_field = [&](DexFieldRef* field, IRInstruction* insn) {
     auto cls = field->get_class();
-    cls = get_and_check_single_impl(cls);
+    cls = get_and_check_single_impl(cls, uses);
     if (cls) {
-      escape_interface(cls, HAS_FIELD_REF);
+      uses->escapes.emplace_back(cls, HAS_FIELD_REF);
     }
     const auto type = field->get_type();
-    auto intf = get_and_check_single_impl(type);
+    auto intf = get_and_check_single_impl(type, uses);
     if (intf) {
-      single_impls[intf].fieldrefs[field].push_back(insn);
+      uses->fieldrefs.emplace_back(intf, field, insn);
     }
   };
 
-  walk::opcodes(scope,
-               [](DexMethod* method) { return true; },
-               [&](DexMethod* method, IRInstruction* insn) {
-                 auto op = insn->opcode();
-                 switch (op) {
-                 // type ref
-                 case OPCODE_CONST_CLASS:
-                 case OPCODE_CHECK_CAST:
-                 case OPCODE_INSTANCE_OF:
-                 case OPCODE_NEW_INSTANCE:
-                 case OPCODE_NEW_ARRAY:
-                 case OPCODE_FILLED_NEW_ARRAY: {
-                   auto intf = get_and_check_single_impl(insn->get_type());
-                   if (intf) {
-                     single_impls[intf].typerefs.push_back(insn);
-                   }
-                   return;
-                 }
-                 // field ref
-                 case OPCODE_IGET:
-                 case OPCODE_IGET_WIDE:
-                 case OPCODE_IGET_OBJECT:
-                 case OPCODE_IPUT:
-                 case OPCODE_IPUT_WIDE:
-                 case OPCODE_IPUT_OBJECT: {
-                   DexFieldRef* field =
-                       resolve_field(insn->get_field(), FieldSearch::Instance);
-                   if (field == nullptr) {
-                     field = insn->get_field();
-                   }
-                   check_field(field, insn);
-                   return;
-                 }
-                 case OPCODE_SGET:
-                 case OPCODE_SGET_WIDE:
-                 case OPCODE_SGET_OBJECT:
-                 case OPCODE_SPUT:
-                 case OPCODE_SPUT_WIDE:
-                 case OPCODE_SPUT_OBJECT: {
-                   DexFieldRef* field =
-                       resolve_field(insn->get_field(), FieldSearch::Static);
-                   if (field == nullptr) {
-                     field = insn->get_field();
-                   }
-                   check_field(field, insn);
-                   return;
-                 }
-                 // method ref
-                 case OPCODE_INVOKE_INTERFACE: {
-                   // if it is an invoke on the interface method, collect it as
-                   // such
-                   const auto meth = insn->get_method();
-                   const auto owner = meth->get_class();
-                   const auto intf = get_and_check_single_impl(owner);
-                   if (intf) {
-                     // if the method ref is not defined on the interface itself
-                     // drop the optimization
-                     const auto& meths = type_class(intf)->get_vmethods();
-                     if (std::find(meths.begin(), meths.end(), meth) ==
-                         meths.end()) {
-                       escape_interface(intf, UNKNOWN_MREF);
-                     } else {
-                       single_impls[intf].intf_methodrefs[meth].insert(insn);
-                     }
-                   }
-                   check_sig(meth, insn);
-                   return;
-                 }
-
-                 case OPCODE_INVOKE_DIRECT:
-                 case OPCODE_INVOKE_STATIC:
-                 case OPCODE_INVOKE_VIRTUAL:
-                 case OPCODE_INVOKE_SUPER: {
-                   const auto meth = insn->get_method();
-                   check_sig(meth, insn);
-                   return;
-                 }
-                 default:
-                   return;
-                 }
-               });
+  auto check_insn = [&](IRInstruction* insn) {
+    auto op = insn->opcode();
+    switch (op) {
+    // type ref
+    case OPCODE_CONST_CLASS:
+    case OPCODE_CHECK_CAST:
+    case OPCODE_INSTANCE_OF:
+    case OPCODE_NEW_INSTANCE:
+    case OPCODE_NEW_ARRAY:
+    case OPCODE_FILLED_NEW_ARRAY: {
+      auto intf = get_and_check_single_impl(insn->get_type(), uses);
+      if (intf) {
+        uses->typerefs.emplace_back(intf, insn);
+      }
+      return;
+    }
+    // field ref
+    case OPCODE_IGET:
+    case OPCODE_IGET_WIDE:
+    case OPCODE_IGET_OBJECT:
+    case OPCODE_IPUT:
+    case OPCODE_IPUT_WIDE:
+    case OPCODE_IPUT_OBJECT: {
+      DexFieldRef* field =
+          resolve_field(insn->get_field(), FieldSearch::Instance);
+      if (field == nullptr) {
+        field = insn->get_field();
+      }
+      check_field(field, insn);
+      return;
+    }
+    case OPCODE_SGET:
+    case OPCODE_SGET_WIDE:
+    case OPCODE_SGET_OBJECT:
+    case OPCODE_SPUT:
+    case OPCODE_SPUT_WIDE:
+    case OPCODE_SPUT_OBJECT: {
+      DexFieldRef* field =
+          resolve_field(insn->get_field(), FieldSearch::Static);
+      if (field == nullptr) {
+        field = insn->get_field();
+      }
+      check_field(field, insn);
+      return;
+    }
+    // method ref
+    case OPCODE_INVOKE_INTERFACE: {
+      // if it is an invoke on the interface method, collect it as such
+      const auto meth = insn->get_method();
+      const auto owner = meth->get_class();
+      const auto intf = get_and_check_single_impl(owner, uses);
+      if (intf) {
+        // if the method ref is not defined on the interface itself
+        // drop the optimization
+        const auto& meths = type_class(intf)->get_vmethods();
+        if (std::find(meths.begin(), meths.end(), meth) == meths.end()) {
+          uses->escapes.emplace_back(intf, UNKNOWN_MREF);
+        } else {
+          uses->intf_methodrefs.emplace_back(intf, meth, insn);
+        }
+      }
+      check_sig(meth, insn);
+      return;
+    }
+
+    case OPCODE_INVOKE_DIRECT:
+    case OPCODE_INVOKE_STATIC:
+    case OPCODE_INVOKE_VIRTUAL:
+    case OPCODE_INVOKE_SUPER: {
+      const auto meth = insn->get_method();
+      check_sig(meth, insn);
+      return;
+    }
+    default:
+      return;
+    }
+  };
+
+  for (const auto* methods : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+    for (auto method : *methods) {
+      auto code = method->get_code();
+      if (code == nullptr) continue;
+      for (auto& mie : InstructionIterable(code)) {
+        check_insn(mie.insn);
+      }
+    }
+  }
+}
+
+/**
+ * Build the index of the uses of all the single impl interfaces with one
+ * parallel walk of the scope. Each class is analyzed on its own, and the uses
+ * are merged in scope order so that the index doesn't depend on scheduling.
+ */
+void AnalysisImpl::collect_uses() {
+  std::vector<ClassUses> all_uses(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto cls = scope[i];
+    auto uses = &all_uses[i];
+    collect_field_defs(cls, uses);
+    collect_method_defs(cls, uses);
+    analyze_opcodes(cls, uses);
+  });
+  for (size_t i = 0; i < scope.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  for (auto& uses : all_uses) {
+    for (const auto& escape : uses.escapes) {
+      escape_interface(escape.first, escape.second);
+    }
+    for (const auto& def : uses.fielddefs) {
+      single_impls[def.first].fielddefs.push_back(def.second);
+    }
+    for (const auto& def : uses.methoddefs) {
+      single_impls[def.first].methoddefs.insert(def.second);
+    }
+    for (const auto& ref : uses.typerefs) {
+      single_impls[ref.first].typerefs.push_back(ref.second);
+    }
+    for (const auto& ref : uses.fieldrefs) {
+      single_impls[std::get<0>(ref)].fieldrefs[std::get<1>(ref)].push_back(
+          std::get<2>(ref));
+    }
+    for (const auto& ref : uses.intf_methodrefs) {
+      single_impls[std::get<0>(ref)]
+          .intf_methodrefs[std::get<1>(ref)]
+          .insert(std::get<2>(ref));
+    }
+    for (const auto& ref : uses.methodrefs) {
+      single_impls[std::get<0>(ref)].methodrefs[std::get<1>(ref)].insert(
+          std::get<2>(ref));
+    }
+  }
 }
 
 /**
@@ -456,9 +551,7 @@ std::unique_ptr<SingleImplAnalysis> SingleImplAnalysis::analyze(
   std::unique_ptr<AnalysisImpl> single_impls(
       new AnalysisImpl(scope, pg_map, stores));
   single_impls->create_single_impl(single_impl, intfs, config);
-  single_impls->collect_field_defs();
-  single_impls->collect_method_defs();
-  single_impls->analyze_opcodes();
+  single_impls->collect_uses();
   single_impls->escape_cross_stores();
   single_impls->remove_escaped();
   return std::move(single_impls);
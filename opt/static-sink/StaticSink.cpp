@@ -118,17 +118,15 @@ std::unordered_set<DexMethod*> strings_to_dexmethods(
 
 std::vector<DexClass*> get_coldstart_classes(const DexClassesVector& dexen,
                                              ConfigFiles& conf) {
-  auto interdex_list = conf.get_coldstart_classes();
-  std::unordered_map<std::string, DexClass*> class_string_map;
+  std::unordered_set<const DexClass*> dex_classes;
   std::vector<DexClass*> coldstart_classes;
   for (auto const& dex : dexen) {
-    for (auto const& cls : dex) {
-      class_string_map[cls->get_type()->get_name()->str()] = cls;
-    }
+    dex_classes.insert(dex.begin(), dex.end());
   }
-  for (auto const& class_string : interdex_list) {
-    if (class_string_map.count(class_string)) {
-      coldstart_classes.push_back(class_string_map[class_string]);
+  for (auto type : conf.get_coldstart_types()) {
+    auto cls = type_class(type);
+    if (cls != nullptr && dex_classes.count(cls)) {
+      coldstart_classes.push_back(cls);
     }
   }
   return coldstart_classes;
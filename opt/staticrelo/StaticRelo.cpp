@@ -81,7 +81,7 @@ void visit_opcodes(
     scope,
     [](const DexMethod*) { return true; },
     [&](const DexMethod* m, IRInstruction* insn) {
-      if (p.matches(insn)) {
+      if (p.opcodes.contains(insn->opcode()) && p.matches(insn)) {
         v(m, insn);
       }
     });
@@ -114,18 +114,16 @@ std::unordered_map<const DexClass*, size_t> build_class_to_dex_map(
  */
 std::unordered_map<const DexClass*, size_t> build_class_to_pgo_order_map(
     const DexClassesVector& dexen, ConfigFiles& conf) {
-  auto interdex_list = conf.get_coldstart_classes();
-  std::unordered_map<std::string, DexClass*> class_string_map;
+  std::unordered_set<const DexClass*> dex_classes;
   std::unordered_map<const DexClass*, size_t> coldstart_classes;
   for (auto const& dex : dexen) {
-    for (auto const& cls : dex) {
-      class_string_map[cls->get_type()->get_name()->str()] = cls;
-    }
+    dex_classes.insert(dex.begin(), dex.end());
   }
   int rank = 0;
-  for (auto const& class_string : interdex_list) {
-    if (class_string_map.count(class_string)) {
-      coldstart_classes[class_string_map[class_string]] = rank++;
+  for (auto type : conf.get_coldstart_types()) {
+    auto cls = type_class(type);
+    if (cls != nullptr && dex_classes.count(cls)) {
+      coldstart_classes[cls] = rank++;
     }
   }
   return coldstart_classes;
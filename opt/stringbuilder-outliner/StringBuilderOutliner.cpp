@@ -7,10 +7,12 @@
 
 #include "StringBuilderOutliner.h"
 
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "ConcurrentContainers.h"
+#include "ConfigFiles.h"
 #include "Creators.h"
 #include "DexAsm.h"
 #include "DexClass.h"
@@ -140,16 +142,21 @@ InstructionSet Outliner::find_tostring_instructions(
 
 /*
  * Gather the BuilderStates corresponding to StringBuilders whose state we can
- * accurately model for outlining purposes.
+ * accurately model for outlining purposes. If `constant_args` is given, also
+ * record the operations whose argument is a string constant loaded earlier in
+ * the same block.
  */
 BuilderStateMap Outliner::gather_builder_states(
     const cfg::ControlFlowGraph& cfg,
-    const InstructionSet& tostring_instructions) const {
+    const InstructionSet& tostring_instructions,
+    ConstantArgMap* constant_args) const {
   BuilderStateMap tostring_instruction_to_state;
   FixpointIterator fp_iter(cfg);
   fp_iter.run(Environment());
   for (auto* block : cfg.blocks()) {
     auto env = fp_iter.get_entry_state_at(block);
+    std::unordered_map<reg_t, DexString*> constant_regs;
+    DexString* pending_string{nullptr};
     for (auto& mie : InstructionIterable(block)) {
       auto* insn = mie.insn;
       if (tostring_instructions.count(insn)) {
@@ -167,12 +174,51 @@ BuilderStateMap Outliner::gather_builder_states(
           tostring_instruction_to_state.emplace(insn, *state_opt);
         }
       }
+      if (constant_args != nullptr) {
+        auto op = insn->opcode();
+        if (is_invoke(op) && insn->srcs_size() == 2 &&
+            insn->get_method()->get_class() == m_stringbuilder) {
+          auto it = constant_regs.find(insn->src(1));
+          if (it != constant_regs.end()) {
+            constant_args->emplace(insn, it->second);
+          }
+        }
+        if (insn->dests_size()) {
+          constant_regs.erase(insn->dest());
+          if (insn->dest_is_wide()) {
+            constant_regs.erase(insn->dest() + 1);
+          }
+          if (op == IOPCODE_MOVE_RESULT_PSEUDO_OBJECT &&
+              pending_string != nullptr) {
+            constant_regs[insn->dest()] = pending_string;
+          }
+        }
+        pending_string = op == OPCODE_CONST_STRING ? insn->get_string()
+                                                   : nullptr;
+      }
       fp_iter.analyze_instruction(insn, &env);
     }
   }
   return tostring_instruction_to_state;
 }
 
+/*
+ * The string that a StringBuilder in `state` holds, if each of its operations
+ * takes a string constant.
+ */
+DexString* Outliner::fold_state(const BuilderState& state,
+                                const ConstantArgMap& constant_args) const {
+  std::string result;
+  for (auto* insn : state) {
+    auto it = constant_args.find(insn);
+    if (it == constant_args.end()) {
+      return nullptr;
+    }
+    result += it->second->str();
+  }
+  return DexString::make_string(result);
+}
+
 /*
  * Gather the types of the values that the StringBuilder instance is
  * concatenating.
@@ -198,7 +244,7 @@ void Outliner::gather_outline_candidate_typelists(
   }
 }
 
-void Outliner::analyze(IRCode& code) {
+void Outliner::analyze(IRCode& code, bool is_hot) {
   code.build_cfg(/* editable */ false); // Not editable because of T42743620
   auto& cfg = code.cfg();
   cfg.calculate_exit_block();
@@ -211,8 +257,28 @@ void Outliner::analyze(IRCode& code) {
     return;
   }
 
-  auto tostring_instruction_to_state =
-      gather_builder_states(cfg, tostring_instructions);
+  if (is_hot) {
+    ConstantArgMap constant_args;
+    auto tostring_instruction_to_state =
+        gather_builder_states(cfg, tostring_instructions, &constant_args);
+    ConstantFoldMap folds;
+    for (const auto& p : tostring_instruction_to_state) {
+      auto str = fold_state(p.second, constant_args);
+      if (str != nullptr) {
+        TRACE(STRBUILD, 5, "Folding %s into \"%s\"\n", SHOW(p.first),
+              str->c_str());
+        folds.emplace(p.first, str);
+      }
+    }
+    if (!folds.empty()) {
+      m_num_folded += folds.size();
+      m_constant_folds.emplace(&code, std::move(folds));
+    }
+    return;
+  }
+
+  auto tostring_instruction_to_state = gather_builder_states(
+      cfg, tostring_instructions, /* constant_args */ nullptr);
 
   gather_outline_candidate_typelists(tostring_instruction_to_state);
 
@@ -232,6 +298,8 @@ void Outliner::create_outline_helpers(DexStoresVector* stores) {
   auto concat_str = DexString::make_string("concat");
   auto string_ty = DexType::make_type("Ljava/lang/String;");
 
+  m_stats.stringbuilders_folded = m_num_folded;
+
   ClassCreator cc(outline_helper_cls);
   cc.set_super(get_object_type());
   bool did_create_helper{false};
@@ -362,6 +430,10 @@ static IROpcode invoke_for_method(const DexMethod* method) {
  * during register allocation.
  */
 void Outliner::transform(IRCode* code) {
+  if (m_constant_folds.count(code) != 0) {
+    apply_folds(m_constant_folds.at(code), code);
+    return;
+  }
   if (m_builder_state_maps.count(code) == 0) {
     return;
   }
@@ -447,14 +519,56 @@ void Outliner::apply_changes(
   }
 }
 
+/*
+ * Replace each folded toString() call and the move-result-object that follows
+ * it with a const-string of the folded string.
+ */
+void Outliner::apply_folds(const ConstantFoldMap& folds, IRCode* code) {
+  std::vector<std::tuple<IRList::iterator, IRList::iterator, DexString*>>
+      to_fold;
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE || folds.count(it->insn) == 0) {
+      continue;
+    }
+    auto move_it = std::next(it);
+    while (move_it != code->end() && move_it->type != MFLOW_OPCODE) {
+      ++move_it;
+    }
+    if (move_it == code->end() ||
+        move_it->insn->opcode() != OPCODE_MOVE_RESULT_OBJECT) {
+      // The result is unused, there is nothing to fold into.
+      continue;
+    }
+    to_fold.emplace_back(it, move_it, folds.at(it->insn));
+  }
+
+  for (const auto& t : to_fold) {
+    auto it = std::get<0>(t);
+    auto move_it = std::get<1>(t);
+    auto dest = move_it->insn->dest();
+    code->insert_before(it,
+                        (new IRInstruction(OPCODE_CONST_STRING))
+                            ->set_string(std::get<2>(t)));
+    code->insert_before(
+        it, (new IRInstruction(IOPCODE_MOVE_RESULT_PSEUDO_OBJECT))
+                ->set_dest(dest));
+    code->remove_opcode(move_it);
+    code->remove_opcode(it);
+  }
+}
+
 void StringBuilderOutlinerPass::run_pass(DexStoresVector& stores,
-                                         ConfigFiles&,
+                                         ConfigFiles& conf,
                                          PassManager& mgr) {
   auto scope = build_class_scope(stores);
   Outliner outliner(m_config);
-  // 1) Determine which methods have candidates for outlining.
-  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
-    outliner.analyze(code);
+  const auto& method_to_weight = conf.get_method_to_weight();
+  // 1) Determine which methods have candidates for outlining, and fold the
+  // constant StringBuilders of hot methods instead.
+  walk::parallel::code(scope, [&](DexMethod* method, IRCode& code) {
+    bool is_hot = m_config.fold_constants_in_hot_methods &&
+                  !!get_method_weight_if_available(method, &method_to_weight);
+    outliner.analyze(code, is_hot);
   });
   // 2) Determine which candidates occur frequently enough to be worth
   // outlining. Build the corresponding outline helper functions.
@@ -470,6 +584,8 @@ void StringBuilderOutlinerPass::run_pass(DexStoresVector& stores,
                   outliner.get_stats().operations_removed);
   mgr.incr_metric("helper_methods_created",
                   outliner.get_stats().helper_methods_created);
+  mgr.incr_metric("stringbuilders_folded",
+                  outliner.get_stats().stringbuilders_folded);
 }
 
 static StringBuilderOutlinerPass s_pass;
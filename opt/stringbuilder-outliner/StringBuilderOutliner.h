@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
+
 #include <boost/optional.hpp>
 
 #include "AbstractDomain.h"
@@ -63,6 +65,24 @@
  * the outline helper functions and assume that in most cases the StringBuilder
  * instance and the append operations on them are going to be removable by
  * OSDCE. This is generally true in practice.
+ *
+ * Outlining trades a call for code size, which is the wrong trade in hot code.
+ * In methods that the method profile marks as hot, StringBuilders whose
+ * operations only ever take string constants are folded into a single
+ * const-string instead, and the others are left alone. With v1 and v2 holding
+ * "a" and "b",
+ *
+ *   invoke-direct {v0, v1} StringBuilder;.<init>:(Ljava/lang/String;)V
+ *   invoke-virtual {v0, v2} StringBuilder;.append:(Ljava/lang/String;)...
+ *   invoke-virtual v0 StringBuilder;.toString:()Ljava/lang/String;
+ *   move-result-object v3
+ *
+ * becomes
+ *
+ *   const-string "ab"
+ *   move-result-pseudo-object v3
+ *
+ * The StringBuilder is again left for OSDCE to remove.
  */
 
 namespace stringbuilder_outliner {
@@ -188,15 +208,23 @@ using InstructionSet = std::unordered_set<const IRInstruction*>;
 
 using BuilderStateMap = std::unordered_map<const IRInstruction*, BuilderState>;
 
+// Map StringBuilder operations to the string constant they take, if any.
+using ConstantArgMap = std::unordered_map<const IRInstruction*, DexString*>;
+
+// Map toString() calls to the string they always return.
+using ConstantFoldMap = std::unordered_map<const IRInstruction*, DexString*>;
+
 struct Config {
   size_t max_outline_length{9};
   size_t min_outline_count{10};
+  bool fold_constants_in_hot_methods{true};
 };
 
 struct Stats {
   size_t stringbuilders_removed{0};
   size_t operations_removed{0};
   size_t helper_methods_created{0};
+  size_t stringbuilders_folded{0};
 };
 
 class Outliner {
@@ -207,7 +235,11 @@ class Outliner {
 
   const Stats& get_stats() const { return m_stats; }
 
-  void analyze(IRCode& code);
+  /*
+   * If `is_hot`, fold the StringBuilders of `code` that only take string
+   * constants, and don't outline any of them.
+   */
+  void analyze(IRCode& code, bool is_hot = false);
 
   void create_outline_helpers(DexStoresVector* stores);
 
@@ -219,7 +251,11 @@ class Outliner {
 
   BuilderStateMap gather_builder_states(
       const cfg::ControlFlowGraph& cfg,
-      const InstructionSet& eligible_tostring_instructions) const;
+      const InstructionSet& eligible_tostring_instructions,
+      ConstantArgMap* constant_args) const;
+
+  DexString* fold_state(const BuilderState& state,
+                        const ConstantArgMap& constant_args) const;
 
   const DexTypeList* typelist_from_state(const BuilderState& state) const;
 
@@ -235,6 +271,8 @@ class Outliner {
           insns_to_replace,
       IRCode* code);
 
+  static void apply_folds(const ConstantFoldMap& folds, IRCode* code);
+
   Config m_config;
   Stats m_stats;
 
@@ -252,6 +290,8 @@ class Outliner {
   std::unordered_map<const DexTypeList*, DexMethod*> m_outline_helpers;
 
   ConcurrentMap<const IRCode*, BuilderStateMap> m_builder_state_maps;
+  ConcurrentMap<const IRCode*, ConstantFoldMap> m_constant_folds;
+  std::atomic<size_t> m_num_folded{0};
 };
 
 class StringBuilderOutlinerPass : public Pass {
@@ -263,6 +303,9 @@ class StringBuilderOutlinerPass : public Pass {
            m_config.max_outline_length);
     jw.get("min_outline_count", m_config.min_outline_count,
            m_config.min_outline_count);
+    jw.get("fold_constants_in_hot_methods",
+           m_config.fold_constants_in_hot_methods,
+           m_config.fold_constants_in_hot_methods);
   }
 
   virtual void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
@@ -7,8 +7,10 @@
 
 #include "Synth.h"
 
+#include <algorithm>
 #include <signal.h>
 #include <stdio.h>
+#include <set>
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -288,71 +290,109 @@ void purge_wrapped_wrappers(WrapperMethods& ssms) {
   ssms.next_pass = ssms.next_pass || remove.size() > 0;
 }
 
-WrapperMethods analyze(const ClassHierarchy& ch,
-                       const std::vector<DexClass*>& classes,
-                       const SynthConfig& synthConfig) {
-  WrapperMethods ssms;
-  for (auto cls : classes) {
-    for (auto dmethod : cls->get_dmethods()) {
-      // constructors are special and all we can remove are synthetic ones
-      if (synthConfig.remove_constructors && is_synthetic(dmethod) &&
-          is_constructor(dmethod)) {
-        auto ctor = trivial_ctor_wrapper(dmethod);
-        if (ctor) {
-          TRACE(SYNT, 2, "Trivial constructor wrapper: %s\n", SHOW(dmethod));
-          TRACE(SYNT, 2, "  Calls constructor: %s\n", SHOW(ctor));
-          ssms.ctors.emplace(dmethod, ctor);
-        }
+/*
+ * The getters, wrappers and constructor wrappers that a class defines, in the
+ * order of its methods.
+ */
+struct ClassWrappers {
+  std::vector<std::pair<DexMethod*, DexField*>> getters;
+  std::vector<std::pair<DexMethod*, DexMethod*>> wrappers;
+  std::vector<std::pair<DexMethod*, DexMethod*>> ctors;
+};
+
+ClassWrappers analyze_class(const ClassHierarchy& ch,
+                            const DexClass* cls,
+                            const SynthConfig& synthConfig) {
+  ClassWrappers found;
+  for (auto dmethod : cls->get_dmethods()) {
+    // constructors are special and all we can remove are synthetic ones
+    if (synthConfig.remove_constructors && is_synthetic(dmethod) &&
+        is_constructor(dmethod)) {
+      auto ctor = trivial_ctor_wrapper(dmethod);
+      if (ctor) {
+        TRACE(SYNT, 2, "Trivial constructor wrapper: %s\n", SHOW(dmethod));
+        TRACE(SYNT, 2, "  Calls constructor: %s\n", SHOW(ctor));
+        found.ctors.emplace_back(dmethod, ctor);
+      }
+      continue;
+    }
+    if (is_constructor(dmethod)) continue;
+
+    if (is_static_synthetic(dmethod)) {
+      auto field = trivial_get_field_wrapper(dmethod);
+      if (field) {
+        TRACE(SYNT, 2, "Static trivial getter: %s\n", SHOW(dmethod));
+        TRACE(SYNT, 2, "  Gets field: %s\n", SHOW(field));
+        found.getters.emplace_back(dmethod, field);
         continue;
       }
-      if (is_constructor(dmethod)) continue;
-
-      if (is_static_synthetic(dmethod)) {
-        auto field = trivial_get_field_wrapper(dmethod);
-        if (field) {
-          TRACE(SYNT, 2, "Static trivial getter: %s\n", SHOW(dmethod));
-          TRACE(SYNT, 2, "  Gets field: %s\n", SHOW(field));
-          ssms.getters.emplace(dmethod, field);
-          continue;
-        }
-        auto sfield = trivial_get_static_field_wrapper(dmethod);
-        if (sfield) {
-          TRACE(SYNT, 2, "Static trivial static field getter: %s\n",
-          SHOW(dmethod));
-          TRACE(SYNT, 2, "  Gets static field: %s\n", SHOW(sfield));
-          ssms.getters.emplace(dmethod, sfield);
-          continue;
-        }
+      auto sfield = trivial_get_static_field_wrapper(dmethod);
+      if (sfield) {
+        TRACE(SYNT, 2, "Static trivial static field getter: %s\n",
+        SHOW(dmethod));
+        TRACE(SYNT, 2, "  Gets static field: %s\n", SHOW(sfield));
+        found.getters.emplace_back(dmethod, sfield);
+        continue;
       }
+    }
 
-      if (can_optimize(dmethod, synthConfig)) {
-        auto method = trivial_method_wrapper(dmethod, ch);
-        if (method) {
-          // this is not strictly needed but to avoid changing visibility of
-          // virtuals we are skipping a wrapper to a virtual.
-          // Incidentally we have no single method falling in that bucket
-          // at this time
-          if (method->is_virtual()) continue;
-
-          TRACE(SYNT, 2, "Static trivial method wrapper: %s\n", SHOW(dmethod));
-          TRACE(SYNT, 2, "  Calls method: %s\n", SHOW(method));
-          ssms.wrappers.emplace(dmethod, method);
-          if (!is_static(method)) {
-            auto wrapped = ssms.wrapped.find(method);
-            if (wrapped == ssms.wrapped.end()) {
-              ssms.wrapped.emplace(method, std::make_pair(dmethod, 1));
-            } else {
-              wrapped->second.second++;
-            }
-          }
-        }
+    if (can_optimize(dmethod, synthConfig)) {
+      auto method = trivial_method_wrapper(dmethod, ch);
+      if (method) {
+        // this is not strictly needed but to avoid changing visibility of
+        // virtuals we are skipping a wrapper to a virtual.
+        // Incidentally we have no single method falling in that bucket
+        // at this time
+        if (method->is_virtual()) continue;
+
+        TRACE(SYNT, 2, "Static trivial method wrapper: %s\n", SHOW(dmethod));
+        TRACE(SYNT, 2, "  Calls method: %s\n", SHOW(method));
+        found.wrappers.emplace_back(dmethod, method);
       }
     }
-    if (debug) {
-      // Static synthetics should never be virtual.
-      for (auto vmethod : cls->get_vmethods()) {
-        (void)vmethod;
-        redex_assert(!is_static_synthetic(vmethod));
+  }
+  if (debug) {
+    // Static synthetics should never be virtual.
+    for (auto vmethod : cls->get_vmethods()) {
+      (void)vmethod;
+      redex_assert(!is_static_synthetic(vmethod));
+    }
+  }
+  return found;
+}
+
+WrapperMethods analyze(const ClassHierarchy& ch,
+                       const std::vector<DexClass*>& classes,
+                       const SynthConfig& synthConfig) {
+  // The classes are analyzed in parallel, and what they define is gathered
+  // in class order, so that the first wrapper of a method is the same from
+  // run to run.
+  std::vector<ClassWrappers> found(classes.size());
+  auto wq = workqueue_foreach<size_t>(
+      [&](size_t idx) {
+        found[idx] = analyze_class(ch, classes[idx], synthConfig);
+      });
+  for (size_t idx = 0; idx < classes.size(); ++idx) {
+    wq.add_item(idx);
+  }
+  wq.run_all();
+
+  WrapperMethods ssms;
+  for (const auto& cls_wrappers : found) {
+    ssms.getters.insert(cls_wrappers.getters.begin(),
+                        cls_wrappers.getters.end());
+    ssms.ctors.insert(cls_wrappers.ctors.begin(), cls_wrappers.ctors.end());
+    for (const auto& p : cls_wrappers.wrappers) {
+      auto dmethod = p.first;
+      auto method = p.second;
+      ssms.wrappers.emplace(dmethod, method);
+      if (!is_static(method)) {
+        auto wrapped = ssms.wrapped.find(method);
+        if (wrapped == ssms.wrapped.end()) {
+          ssms.wrapped.emplace(method, std::make_pair(dmethod, 1));
+        } else {
+          wrapped->second.second++;
+        }
       }
     }
   }
@@ -412,9 +452,6 @@ void replace_getter_wrapper(IRCode* transform,
                             IRInstruction* move_result,
                             DexField* field) {
   TRACE(SYNT, 2, "Optimizing getter wrapper call: %s\n", SHOW(insn));
-  redex_assert(field->is_concrete());
-  set_public(field);
-
   auto new_get = is_static(field)
                 ? make_sget(field)
                 : make_iget(field, insn->src(0));
@@ -477,40 +514,21 @@ bool can_update_wrappee(
   return true;
 }
 
-bool replace_method_wrapper(const ClassHierarchy& ch,
-                            IRCode* transform,
+void replace_method_wrapper(IRCode* transform,
                             IRInstruction* insn,
                             DexMethod* wrapper,
-                            DexMethod* wrappee,
-                            WrapperMethods& ssms) {
+                            DexMethod* wrappee) {
   TRACE(SYNT, 2, "Optimizing method wrapper: %s\n", SHOW(insn));
   TRACE(SYNT, 3, "  wrapper:%p wrappee:%p\n", wrapper, wrappee);
   TRACE(SYNT, 3, "  wrapper: %s\n", SHOW(wrapper));
   TRACE(SYNT, 3, "  wrappee: %s\n", SHOW(wrappee));
-  redex_assert(wrappee->is_concrete() && wrapper->is_concrete());
-
-  if (is_static(wrapper) && !is_static(wrappee)) {
-    assert(can_update_wrappee(ch, wrappee, wrapper));
-    mutators::make_static(wrappee);
-    ssms.promoted_to_static.insert(wrappee);
-  }
-  if (!is_private(wrapper)) {
-    set_public(wrappee);
-    if (wrapper->get_class() != wrappee->get_class()) {
-      set_public(type_class(wrappee->get_class()));
-    }
-  }
-
   update_invoke(transform, insn, wrappee);
-  return true;
 }
 
 void replace_ctor_wrapper(IRCode* transform,
                           IRInstruction* ctor_insn,
                           DexMethod* ctor) {
   TRACE(SYNT, 2, "Optimizing static ctor: %s\n", SHOW(ctor_insn));
-  redex_assert(ctor->is_concrete());
-  set_public(ctor);
 
   auto op = ctor_insn->opcode();
   auto new_ctor_call = [&] {
@@ -528,13 +546,56 @@ void replace_ctor_wrapper(IRCode* transform,
   transform->replace_opcode(ctor_insn, new_ctor_call);
 }
 
-void replace_wrappers(const ClassHierarchy& ch,
-                      DexMethod* caller_method,
-                      WrapperMethods& ssms) {
-  std::vector<std::tuple<IRInstruction*, IRInstruction*, DexField*>> getter_calls;
-  std::vector<std::pair<IRInstruction*, DexMethod*>> wrapper_calls;
-  std::vector<std::pair<IRInstruction*, DexMethod*>> wrapped_calls;
-  std::vector<std::pair<IRInstruction*, DexMethod*>> ctor_calls;
+/*
+ * A call to a getter, wrapper or constructor wrapper that can be replaced by
+ * what the callee does. For a Wrapped call, `insn` calls the wrappee directly
+ * and `wrapper` is its wrapper.
+ */
+struct Replacement {
+  enum class Kind { Getter, Wrapper, Wrapped, Ctor };
+
+  Kind kind;
+  IRInstruction* insn;
+  // For a Getter, the move-result of the call and the field.
+  IRInstruction* move_result;
+  DexField* field;
+  // For the other kinds, the wrapper and the wrappee or the constructor.
+  DexMethod* wrapper;
+  DexMethod* method;
+};
+
+/*
+ * The replacements for the calls in each method, and the methods whose calls
+ * are kept.
+ */
+struct Replacements {
+  std::unordered_map<DexMethod*, std::vector<Replacement>> calls;
+  std::unordered_set<DexMethod*> keepers;
+
+  void merge(Replacements&& other) {
+    for (auto& p : other.calls) {
+      calls.emplace(p.first, std::move(p.second));
+    }
+    keepers.insert(other.keepers.begin(), other.keepers.end());
+  }
+};
+
+Replacements find_replacements(DexMethod* caller_method,
+                               const WrapperMethods& ssms) {
+  Replacements found;
+  std::vector<Replacement> replacements;
+  auto getter_call = [&](IRInstruction* insn,
+                         IRInstruction* move_result,
+                         DexField* field) {
+    replacements.push_back({Replacement::Kind::Getter, insn, move_result,
+                            field, nullptr, nullptr});
+  };
+  auto method_call = [&](Replacement::Kind kind,
+                         IRInstruction* insn,
+                         DexMethod* wrapper,
+                         DexMethod* method) {
+    replacements.push_back({kind, insn, nullptr, nullptr, wrapper, method});
+  };
 
   TRACE(SYNT, 4, "Replacing wrappers in %s\n", SHOW(caller_method));
   auto ii = InstructionIterable(caller_method->get_code());
@@ -551,18 +612,17 @@ void replace_wrappers(const ClassHierarchy& ch,
         auto next_it = std::next(it);
         auto const move_result = next_it->insn;
         if (!is_move_result(move_result->opcode())) {
-          ssms.keepers.emplace(callee);
+          found.keepers.emplace(callee);
           continue;
         }
-        auto field = found_get->second;
-        getter_calls.emplace_back(insn, move_result, field);
+        getter_call(insn, move_result, found_get->second);
         continue;
       }
 
       auto const found_wrap = ssms.wrappers.find(callee);
       if (found_wrap != ssms.wrappers.end()) {
-        auto method = found_wrap->second;
-        wrapper_calls.emplace_back(insn, method);
+        method_call(Replacement::Kind::Wrapper, insn, callee,
+                    found_wrap->second);
         continue;
       }
       always_assert_log(
@@ -570,7 +630,7 @@ void replace_wrappers(const ClassHierarchy& ch,
         "caller: %s\ncallee: %s\ninsn: %s\n",
         SHOW(caller_method), SHOW(callee), SHOW(insn));
 
-      ssms.keepers.emplace(callee);
+      found.keepers.emplace(callee);
     } else if (insn->opcode() == OPCODE_INVOKE_DIRECT) {
       auto const callee =
           resolve_method(insn->get_method(), MethodSearch::Direct);
@@ -581,124 +641,140 @@ void replace_wrappers(const ClassHierarchy& ch,
         auto next_it = std::next(it);
         auto const move_result = next_it->insn;
         if (!is_move_result(move_result->opcode())) {
-          ssms.keepers.emplace(callee);
+          found.keepers.emplace(callee);
           continue;
         }
-        auto field = found_get->second;
-        getter_calls.emplace_back(insn, move_result, field);
+        getter_call(insn, move_result, found_get->second);
         continue;
       }
 
       auto const found_wrap = ssms.wrappers.find(callee);
       if (found_wrap != ssms.wrappers.end()) {
-        auto method = found_wrap->second;
-        wrapper_calls.emplace_back(insn, method);
+        method_call(Replacement::Kind::Wrapper, insn, callee,
+                    found_wrap->second);
         continue;
       }
 
       auto const found_wrappee = ssms.wrapped.find(callee);
       if (found_wrappee != ssms.wrapped.end()) {
-        auto wrapper = found_wrappee->second.first;
-        wrapped_calls.emplace_back(insn, wrapper);
+        method_call(Replacement::Kind::Wrapped, insn,
+                    found_wrappee->second.first, callee);
         continue;
       }
 
       auto const found_ctor = ssms.ctors.find(callee);
       if (found_ctor != ssms.ctors.end()) {
-        auto ctor = found_ctor->second;
-        ctor_calls.emplace_back(insn, ctor);
+        method_call(Replacement::Kind::Ctor, insn, nullptr,
+                    found_ctor->second);
         continue;
       }
     }
   }
-  // Prune out wrappers that are invalid due to naming conflicts.
-  std::unordered_set<DexMethod*> bad_wrappees;
-  std::unordered_multimap<DexMethod*, DexMethod*> wrappees_to_wrappers;
-  for (auto wpair : wrapper_calls) {
-    auto call_inst = wpair.first;
-    auto wrapper = static_cast<DexMethod*>(call_inst->get_method());
-    auto wrappee = wpair.second;
-    wrappees_to_wrappers.emplace(wrappee, wrapper);
-    if (!can_update_wrappee(ch, wrappee, wrapper)) {
-      bad_wrappees.emplace(wrappee);
-    }
+  if (!replacements.empty()) {
+    found.calls.emplace(caller_method, std::move(replacements));
   }
-  for (auto wpair : wrapped_calls) {
-    auto call_inst = wpair.first;
-    auto wrapper = wpair.second;
-    auto wrappee = static_cast<DexMethod*>(call_inst->get_method());
-    wrappees_to_wrappers.emplace(wrappee, wrapper);
-    if (!can_update_wrappee(ch, wrappee, wrapper)) {
-      bad_wrappees.emplace(wrappee);
+  return found;
+}
+
+bool is_method_wrapper_call(const Replacement& r) {
+  return r.kind == Replacement::Kind::Wrapper ||
+         r.kind == Replacement::Kind::Wrapped;
+}
+
+/*
+ * Prune out wrappers that are invalid due to naming conflicts. Their wrappees
+ * keep all of their wrappers, and none of their calls are replaced.
+ */
+void prune_bad_wrappees(const ClassHierarchy& ch,
+                        Replacements& replacements) {
+  std::set<std::pair<DexMethod*, DexMethod*>> wrappee_wrappers;
+  for (const auto& p : replacements.calls) {
+    for (const auto& r : p.second) {
+      if (is_method_wrapper_call(r)) {
+        wrappee_wrappers.emplace(r.method, r.wrapper);
+      }
     }
   }
-  for (auto bw : bad_wrappees) {
-    auto range = wrappees_to_wrappers.equal_range(bw);
-    for (auto it = range.first; it != range.second; ++it) {
-      ssms.keepers.emplace(it->second);
+  std::unordered_set<DexMethod*> bad_wrappees;
+  for (const auto& p : wrappee_wrappers) {
+    if (!can_update_wrappee(ch, p.first, p.second)) {
+      bad_wrappees.emplace(p.first);
     }
   }
-  wrapper_calls.erase(
-    std::remove_if(
-      wrapper_calls.begin(), wrapper_calls.end(),
-      [&](const std::pair<IRInstruction*, DexMethod*>& p) {
-        return bad_wrappees.count(p.second);
-      }),
-    wrapper_calls.end()
-  );
-  wrapped_calls.erase(
-    std::remove_if(
-      wrapped_calls.begin(), wrapped_calls.end(),
-      [&](const std::pair<IRInstruction*, DexMethod*>& p) {
-        return bad_wrappees.count(
-            static_cast<DexMethod*>(p.first->get_method()));
-      }),
-    wrapped_calls.end()
-  );
-  // Fix up everything left.
-  if (getter_calls.empty() && wrapper_calls.empty() && ctor_calls.empty() &&
-      wrapped_calls.empty()) {
+  if (bad_wrappees.empty()) {
     return;
   }
-  auto code = caller_method->get_code();
-  for (auto g : getter_calls) {
-    using std::get;
-    replace_getter_wrapper(code, get<0>(g), get<1>(g), get<2>(g));
-  }
-  for (auto wpair : wrapper_calls) {
-    auto call_inst = wpair.first;
-    auto wrapper = static_cast<DexMethod*>(call_inst->get_method());
-    auto wrappee = wpair.second;
-    auto success =
-      replace_method_wrapper(
-        ch,
-        &*code,
-        call_inst,
-        wrapper,
-        wrappee,
-        ssms);
-    if (!success) {
-      ssms.keepers.emplace(static_cast<DexMethod*>(wpair.first->get_method()));
+  for (const auto& p : wrappee_wrappers) {
+    if (bad_wrappees.count(p.first)) {
+      replacements.keepers.emplace(p.second);
     }
   }
-  for (auto wpair : wrapped_calls) {
-    auto call_inst = wpair.first;
-    auto wrapper = wpair.second;
-    auto wrappee = static_cast<DexMethod*>(call_inst->get_method());
-    auto success =
-      replace_method_wrapper(
-        ch,
-        &*code,
-        call_inst,
-        wrapper,
-        wrappee,
-        ssms);
-    if (!success) {
-      ssms.keepers.emplace(static_cast<DexMethod*>(wpair.first->get_method()));
+  for (auto& p : replacements.calls) {
+    auto& calls = p.second;
+    calls.erase(std::remove_if(calls.begin(), calls.end(),
+                               [&](const Replacement& r) {
+                                 return is_method_wrapper_call(r) &&
+                                        bad_wrappees.count(r.method);
+                               }),
+                calls.end());
+  }
+}
+
+/*
+ * Makes what the replacements call accessible to the callers, and makes the
+ * wrappees of static wrappers static. These change the callees rather than
+ * the callers, so they are all done before the callers are rewritten in
+ * parallel.
+ */
+void prepare_callees(const ClassHierarchy& ch,
+                     const Replacements& replacements,
+                     WrapperMethods& ssms) {
+  for (const auto& p : replacements.calls) {
+    for (const auto& r : p.second) {
+      switch (r.kind) {
+      case Replacement::Kind::Getter:
+        redex_assert(r.field->is_concrete());
+        set_public(r.field);
+        break;
+      case Replacement::Kind::Wrapper:
+      case Replacement::Kind::Wrapped: {
+        auto wrapper = r.wrapper;
+        auto wrappee = r.method;
+        redex_assert(wrappee->is_concrete() && wrapper->is_concrete());
+        if (is_static(wrapper) && !is_static(wrappee)) {
+          assert(can_update_wrappee(ch, wrappee, wrapper));
+          mutators::make_static(wrappee);
+          ssms.promoted_to_static.insert(wrappee);
+        }
+        if (!is_private(wrapper)) {
+          set_public(wrappee);
+          if (wrapper->get_class() != wrappee->get_class()) {
+            set_public(type_class(wrappee->get_class()));
+          }
+        }
+        break;
+      }
+      case Replacement::Kind::Ctor:
+        redex_assert(r.method->is_concrete());
+        set_public(r.method);
+        break;
+      }
     }
   }
-  for (auto cpair : ctor_calls) {
-    replace_ctor_wrapper(&*code, cpair.first, cpair.second);
+}
+
+void replace_call(IRCode* code, const Replacement& r) {
+  switch (r.kind) {
+  case Replacement::Kind::Getter:
+    replace_getter_wrapper(code, r.insn, r.move_result, r.field);
+    break;
+  case Replacement::Kind::Wrapper:
+  case Replacement::Kind::Wrapped:
+    replace_method_wrapper(code, r.insn, r.wrapper, r.method);
+    break;
+  case Replacement::Kind::Ctor:
+    replace_ctor_wrapper(code, r.insn, r.method);
+    break;
   }
 }
 
@@ -792,25 +868,31 @@ void do_transform(const ClassHierarchy& ch,
                   WrapperMethods& ssms,
                   const SynthConfig& synthConfig,
                   SynthMetrics& metrics) {
-  // remove wrappers.  build a vector ahead of time to ensure we only visit each
-  // method once, even if we mutate the class method lists such that we'd hit
-  // something a second time.
-  std::vector<DexMethod*> methods;
-  for (auto const& cls : classes) {
-    for (auto const& dm : cls->get_dmethods()) {
-      methods.emplace_back(dm);
-    }
-    for (auto const& vm : cls->get_vmethods()) {
-      methods.emplace_back(vm);
-    }
-  }
-  for (auto const& m : methods) {
-    if (m->get_code()) {
-      replace_wrappers(ch, m, ssms);
-    }
-  }
-  // check that invokes to promoted static method is correct
+  // Find the calls to replace in all methods, then settle which wrappers are
+  // kept and update the callees before any code changes.
+  auto replacements = walk::parallel::reduce_methods<Replacements>(
+      classes,
+      [&ssms](DexMethod* meth) {
+        return meth->get_code() ? find_replacements(meth, ssms)
+                                : Replacements();
+      },
+      [](Replacements& acc, Replacements&& found) {
+        acc.merge(std::move(found));
+      });
+  prune_bad_wrappees(ch, replacements);
+  prepare_callees(ch, replacements, ssms);
+  ssms.keepers.insert(replacements.keepers.begin(),
+                      replacements.keepers.end());
+
+  // remove wrappers, and check that invokes to promoted static method are
+  // correct, in one walk over the code.
   walk::parallel::code(classes, [&](DexMethod* meth, IRCode& code) {
+    auto found = replacements.calls.find(meth);
+    if (found != replacements.calls.end()) {
+      for (const auto& r : found->second) {
+        replace_call(&code, r);
+      }
+    }
     for (auto& mie : InstructionIterable(code)) {
       auto* insn = mie.insn;
       auto opcode = insn->opcode();
@@ -18,6 +18,9 @@ class TrackResourcesPass : public Pass {
     jw.get("tracked_fields_output", "", m_tracked_fields_output);
   }
 
+  uint32_t reads() const override { return CODE | HIERARCHY; }
+  uint32_t writes() const override { return NOTHING; }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
   static void find_accessed_fields(
@@ -236,10 +236,9 @@ void exclude_reference_to_android_sdk(const Json::Value& json_val,
       walk::parallel::reduce_methods<std::unordered_set<const DexType*>>(
           mergeable_classes,
           scanner,
-          [](std::unordered_set<const DexType*> left,
-             const std::unordered_set<const DexType*> right) {
+          [](std::unordered_set<const DexType*>& left,
+             std::unordered_set<const DexType*>&& right) {
             left.insert(right.begin(), right.end());
-            return left;
           });
   for (const auto excluded : excluded_by_android_sdk_ref) {
     non_mergeables.insert(excluded);
@@ -248,6 +247,44 @@ void exclude_reference_to_android_sdk(const Json::Value& json_val,
 
 } // namespace
 
+TypeReferences TypeReferences::gather(const Scope& scope) {
+  Timer t("gather_type_references");
+  auto gatherer = [](DexMethod* meth) {
+    TypeReferences refs;
+    auto code = meth->get_code();
+    if (!code) {
+      return refs;
+    }
+    for (const auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      switch (insn->opcode()) {
+      case OPCODE_CONST_CLASS:
+      case OPCODE_NEW_ARRAY:
+        refs.const_class_or_new_array[get_array_type_or_self(insn->get_type())]
+            .insert(meth->get_class());
+        break;
+      case OPCODE_INSTANCE_OF:
+        refs.instance_of[get_array_type_or_self(insn->get_type())].insert(
+            meth->get_class());
+        break;
+      default:
+        break;
+      }
+    }
+    return refs;
+  };
+  auto merge = [](TypeToTypeSet& left, TypeToTypeSet& right) {
+    for (auto& pair : right) {
+      left[pair.first].insert(pair.second.begin(), pair.second.end());
+    }
+  };
+  return walk::parallel::reduce_methods<TypeReferences>(
+      scope, gatherer, [&](TypeReferences& left, TypeReferences&& right) {
+        merge(left.const_class_or_new_array, right.const_class_or_new_array);
+        merge(left.instance_of, right.instance_of);
+      });
+}
+
 const TypeSet Model::empty_set = TypeSet();
 
 Model::Model(const Scope& scope,
@@ -262,19 +299,21 @@ Model::Model(const Scope& scope,
              const DexStoresVector& stores,
              const ModelSpec& spec,
              const TypeSystem& type_system,
-             ConfigFiles& conf)
+             ConfigFiles& conf,
+             const TypeReferences* refs)
     : m_spec(spec), m_type_system(type_system), m_scope(scope) {
   for (const auto root : spec.roots) {
     m_type_system.get_all_children(root, m_types);
   }
-  init(scope, spec, type_system, &conf);
+  init(scope, spec, type_system, &conf, refs);
   find_non_root_store_mergeables(stores, spec.include_primary_dex);
 }
 
 void Model::init(const Scope& scope,
                  const ModelSpec& spec,
                  const TypeSystem& type_system,
-                 ConfigFiles* conf) {
+                 ConfigFiles* conf,
+                 const TypeReferences* refs) {
   build_hierarchy(spec.roots);
   for (const auto root : spec.roots) {
     build_interface_map(root, {});
@@ -291,7 +330,11 @@ void Model::init(const Scope& scope,
   load_generated_types(spec, scope, type_system, m_types, generated);
   TRACE(TERA, 4, "Generated types %ld\n", generated.size());
   exclude_types(spec.exclude_types);
-  find_non_mergeables(scope, generated);
+  if (refs != nullptr) {
+    find_non_mergeables(generated, *refs);
+  } else {
+    find_non_mergeables(generated, TypeReferences::gather(scope));
+  }
   m_metric.all_types = m_types.size();
 }
 
@@ -549,7 +592,8 @@ bool Model::is_excluded(const DexType* type) const {
  * classes. As a result, we can make those generated classes easier to optimize
  * by Type Erasure.
  */
-void Model::find_non_mergeables(const Scope& scope, const TypeSet& generated) {
+void Model::find_non_mergeables(const TypeSet& generated,
+                                const TypeReferences& refs) {
   for (const auto& type : m_types) {
     const auto& cls = type_class(type);
     if (!can_delete(cls)) {
@@ -559,88 +603,63 @@ void Model::find_non_mergeables(const Scope& scope, const TypeSet& generated) {
   }
   TRACE(TERA, 4, "Non mergeables (no delete) %ld\n", m_non_mergeables.size());
 
-  bool has_type_tag = m_spec.has_type_tag();
-  const auto& const_generated = generated;
-  const auto& const_types = m_types;
-  auto patcher = [has_type_tag, &const_generated,
-                  &const_types](DexMethod* meth) {
-    TypeSet current_non_mergeables;
-    auto code = meth->get_code();
-    if (!code || const_generated.count(meth->get_class())) {
-      return current_non_mergeables;
+  // Java language level enforcement recommended!
+  //
+  // For mergeables with type tags, it is not safe to merge those used with
+  // CONST_CLASS or NEW_ARRAY since we will lose granularity as we can't map to
+  // the old type anymore.
+  //
+  // For mergeables without a type tag, it is not safe to merge those used in
+  // an INSTANCE_OF, since we might lose granularity.
+  //
+  // Example where both <type_0> and <type_1> have the same shape (so end up in
+  // the same merger)
+  //
+  //    INSTANCE_OF <v_result>, <v_obj> <type_0>
+  //    then label:
+  //      CHECK_CAST <type_0>
+  //    else labe:
+  //      CHECK_CAST <type_1>
+  const auto& type_refs = m_spec.has_type_tag() ? refs.const_class_or_new_array
+                                                : refs.instance_of;
+  for (const auto& type : m_types) {
+    auto it = type_refs.find(type);
+    if (it == type_refs.end()) {
+      continue;
     }
-
-    for (const auto& mie : InstructionIterable(code)) {
-      auto insn = mie.insn;
-
-      // Java language level enforcement recommended!
-      //
-      // For mergeables with type tags, it is not safe to merge those used
-      // with CONST_CLASS or NEW_ARRAY since we will lose granularity as we
-      // can't map to the old type anymore.
-      if (has_type_tag && insn->opcode() != OPCODE_CONST_CLASS &&
-          insn->opcode() != OPCODE_NEW_ARRAY) {
-        continue;
-      }
-
-      // Java language level enforcement recommended!
-      //
-      // For mergeables without a type tag, it is not safe to merge
-      // those used in an INSTANCE_OF, since we might lose granularity.
-      //
-      // Example where both <type_0> and <type_1> have the same shape (so end
-      //        up in the same merger)
-      //
-      //    INSTANCE_OF <v_result>, <v_obj> <type_0>
-      //    then label:
-      //      CHECK_CAST <type_0>
-      //    else labe:
-      //      CHECK_CAST <type_1>
-      if (!has_type_tag && insn->opcode() != OPCODE_INSTANCE_OF) {
-        continue;
-      }
-
-      const auto& type = get_array_type_or_self(insn->get_type());
-      if (const_types.count(type) > 0) {
-        current_non_mergeables.insert(type);
+    for (const auto referrer : it->second) {
+      if (generated.count(referrer) == 0) {
+        m_non_mergeables.insert(type);
+        break;
       }
     }
-
-    return current_non_mergeables;
-  };
-
-  TypeSet non_mergeables_opcode = walk::parallel::reduce_methods<TypeSet>(
-      scope, patcher, [](TypeSet left, const TypeSet right) {
-        left.insert(right.begin(), right.end());
-        return left;
-      });
-
-  m_non_mergeables.insert(non_mergeables_opcode.begin(),
-                          non_mergeables_opcode.end());
+  }
 
   TRACE(TERA, 4, "Non mergeables (opcodes) %ld\n", m_non_mergeables.size());
 
   static DexType* string_type = get_string_type();
 
   if (!m_spec.merge_types_with_static_fields) {
-    walk::fields(scope, [&](DexField* field) {
-      if (generated.count(field->get_class()) > 0) {
-        if (is_static(field)) {
-          auto rtype = get_array_type_or_self(field->get_type());
-          if (!is_primitive(rtype) && rtype != string_type) {
-            // If the type is either non-primitive or a list of
-            // non-primitive types (excluding Strings), then exclude it as
-            // we might change the initialization order.
-            TRACE(TERA,
-                  5,
-                  "[non mergeable] %s as it contains a non-primitive "
-                  "static field\n",
-                  SHOW(field->get_class()));
-            m_non_mergeables.emplace(field->get_class());
-          }
+    for (const auto& type : generated) {
+      const auto cls = type_class(type);
+      if (cls == nullptr || cls->is_external()) {
+        continue;
+      }
+      for (const auto field : cls->get_sfields()) {
+        auto rtype = get_array_type_or_self(field->get_type());
+        if (!is_primitive(rtype) && rtype != string_type) {
+          // If the type is either non-primitive or a list of
+          // non-primitive types (excluding Strings), then exclude it as
+          // we might change the initialization order.
+          TRACE(TERA,
+                5,
+                "[non mergeable] %s as it contains a non-primitive "
+                "static field\n",
+                SHOW(type));
+          m_non_mergeables.emplace(type);
         }
       }
-    });
+    }
   }
 
   if (!m_spec.exclude_reference_to_android_sdk.isNull()) {
@@ -1465,11 +1484,12 @@ Model Model::build_model(const Scope& scope,
                          const DexStoresVector& stores,
                          const ModelSpec& spec,
                          const TypeSystem& type_system,
-                         ConfigFiles& conf) {
+                         ConfigFiles& conf,
+                         const TypeReferences* refs) {
   Timer t("build_model");
 
   TRACE(TERA, 3, "Build Model for %s\n", to_string(spec).c_str());
-  Model model(scope, stores, spec, type_system, conf);
+  Model model(scope, stores, spec, type_system, conf, refs);
   TRACE(TERA, 3, "Model:\n%s\nBuild Model done\n", model.print().c_str());
 
   update_model(model);
@@ -162,6 +162,20 @@ struct ModelSpec {
   }
 };
 
+/**
+ * The references to types that some models can't merge, gathered for all the
+ * model specs in a single walk of the scope. Array types are recorded as their
+ * element type.
+ */
+struct TypeReferences {
+  // Type of a CONST_CLASS or NEW_ARRAY to the classes whose code has one.
+  TypeToTypeSet const_class_or_new_array;
+  // Type of an INSTANCE_OF to the classes whose code has one.
+  TypeToTypeSet instance_of;
+
+  static TypeReferences gather(const Scope& scope);
+};
+
 /**
  * A Model is a revised hierarchy for the class set under analysis.
  * The purpose is to define a small number of types that can be used to
@@ -192,7 +206,8 @@ class Model {
                            const DexStoresVector& stores,
                            const ModelSpec& spec,
                            const TypeSystem& type_system,
-                           ConfigFiles& conf);
+                           ConfigFiles& conf,
+                           const TypeReferences* refs = nullptr);
   static Model build_model(const Scope& scope,
                            const ModelSpec& spec,
                            const TypeSet& types,
@@ -351,7 +366,8 @@ class Model {
         const DexStoresVector& stores,
         const ModelSpec& spec,
         const TypeSystem& type_system,
-        ConfigFiles& conf);
+        ConfigFiles& conf,
+        const TypeReferences* refs);
   Model(const Scope& scope,
         const ModelSpec& spec,
         const TypeSystem& type_system,
@@ -359,14 +375,16 @@ class Model {
   void init(const Scope& scope,
             const ModelSpec& spec,
             const TypeSystem& type_system,
-            ConfigFiles* conf = nullptr);
+            ConfigFiles* conf = nullptr,
+            const TypeReferences* refs = nullptr);
 
   void build_hierarchy(const TypeSet& roots);
   void build_interface_map(const DexType* type, TypeSet implemented);
   MergerType* build_mergers(const DexType* root);
   void exclude_types(const std::unordered_set<DexType*>& exclude_types);
   bool is_excluded(const DexType* type) const;
-  void find_non_mergeables(const Scope& scope, const TypeSet& generated);
+  void find_non_mergeables(const TypeSet& generated,
+                           const TypeReferences& refs);
   void find_non_root_store_mergeables(const DexStoresVector& stores,
                                       bool include_primary_dex);
 
@@ -759,6 +759,7 @@ void ModelMethodMerger::merge_ctors() {
 }
 
 void ModelMethodMerger::dedup_non_ctor_non_virt_methods() {
+  method_reference::CallRefsUpdater call_refs_updater;
   for (auto merger : m_mergers) {
     auto merger_type = const_cast<DexType*>(merger->type);
     std::vector<DexMethod*> to_dedup;
@@ -799,7 +800,8 @@ void ModelMethodMerger::dedup_non_ctor_non_virt_methods() {
         boost::optional<std::unordered_map<DexMethod*, MethodOrderedSet>>(
             new_to_old);
     m_stats.m_num_static_non_virt_dedupped += method_dedup::dedup_methods(
-        m_scope, to_dedup, replacements, new_to_old_optional);
+        m_scope, to_dedup, replacements, new_to_old_optional,
+        &call_refs_updater);
 
     // Relocate the remainders.
     std::set<DexMethod*, dexmethods_comparator> to_relocate(
@@ -868,6 +870,8 @@ void ModelMethodMerger::dedup_non_ctor_non_virt_methods() {
           "dedup: clean up static|non_virt remainders %d\n",
           before - non_ctors.size() - non_vmethods.size());
   }
+  // The duplicates of all the mergers are patched in a single walk.
+  call_refs_updater.apply(m_scope);
 }
 
 void ModelMethodMerger::merge_virt_itf_methods() {
@@ -300,12 +300,16 @@ void TypeErasurePass::run_pass(DexStoresVector& stores,
   }
   auto scope = build_class_scope(stores);
   Model::build_interdex_groups(&conf);
+  // Shared by all the models. Merging a model only moves or drops the code
+  // that references the types of the other models, which keeps the gathered
+  // references conservative.
+  auto refs = TypeReferences::gather(scope);
   for (ModelSpec& model_spec : m_model_specs) {
     if (!model_spec.enabled) {
       continue;
     }
     handle_interface_as_root(model_spec, scope, stores);
-    erase_model(model_spec, scope, mgr, stores, conf);
+    erase_model(model_spec, scope, mgr, stores, conf, refs);
   }
   post_dexen_changes(scope, stores);
 }
@@ -316,14 +320,16 @@ void TypeErasurePass::erase_model(const ModelSpec& spec,
                                   Scope& scope,
                                   PassManager& mgr,
                                   DexStoresVector& stores,
-                                  ConfigFiles& conf) {
+                                  ConfigFiles& conf,
+                                  const TypeReferences& refs) {
   TRACE(TERA, 2, "[TERA] erasing %s model\n", spec.name.c_str());
   Timer t("erase_model");
   for (const auto root : spec.roots) {
     always_assert(!is_interface(type_class(root)));
   }
   TypeSystem type_system(scope);
-  auto model = Model::build_model(scope, stores, spec, type_system, conf);
+  auto model =
+      Model::build_model(scope, stores, spec, type_system, conf, &refs);
   model.update_redex_stats(mgr);
 
   auto mm = get_model_merger();
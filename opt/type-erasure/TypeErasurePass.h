@@ -14,6 +14,7 @@
 
 struct ModelSpec;
 class ModelMerger;
+struct TypeReferences;
 
 class TypeErasurePass : public Pass {
  public:
@@ -37,5 +38,6 @@ class TypeErasurePass : public Pass {
                    Scope& scope,
                    PassManager& mgr,
                    DexStoresVector& stores,
-                   ConfigFiles& conf);
+                   ConfigFiles& conf,
+                   const TypeReferences& refs);
 };
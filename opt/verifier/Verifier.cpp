@@ -8,131 +8,102 @@
 #include "Verifier.h"
 
 #include <algorithm>
-#include <map>
+#include <set>
 #include <string>
-#include <vector>
-#include <unordered_set>
 #include <unordered_map>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
 
-#include "Walkers.h"
 #include "DexClass.h"
-#include "IRInstruction.h"
 #include "DexUtil.h"
-#include "ReachableClasses.h"
+#include "EditableCfgAdapter.h"
+#include "IRInstruction.h"
+#include "Walkers.h"
 
 namespace {
 
-using refs_t = std::unordered_map<const DexClass*,
-                                  std::set<DexClass*, dexclasses_comparator>>;
-using class_to_store_map_t = std::unordered_map<const DexClass*, DexStore*>;
-using allowed_store_map_t = std::unordered_map<std::string, std::set<std::string>>;
+using store_bits_t = boost::dynamic_bitset<>;
+using class_set_t = std::set<const DexClass*, dexclasses_comparator>;
 
-/**
- * Helper function that scans all the opcodes in the application and produces a map of references
- * from the class containing the opcode to the class referenced by the opcode.
- *
- * @param scope all classes we're processing
- * @param dmethod_refs [out] all refs to dmethods in the application
- * @param class_refs [out] all refs to classes in the application
- *
+/*
+ * For each store, the stores that its classes may refer to, as a bitset over
+ * store idxs: itself, the root store, and the stores it depends on, directly
+ * or not. The extra last bit stands for classes that are in no store, which
+ * no store may refer to.
  */
-void build_refs(
-    const Scope& scope,
-    refs_t& class_refs) {
-  // TODO: walk through annotations
-  walk::opcodes(
-    scope,
-    [](const DexMethod*) { return true; },
-    [&](const DexMethod* meth, IRInstruction* insn) {
-      if (insn->has_type()) {
-        const auto tref = type_class(insn->get_type());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
-      }
-      if (insn->has_field()) {
-        const auto tref = type_class(insn->get_field()->get_class());
-        if (tref) class_refs[tref].emplace(type_class(meth->get_class()));
-        return;
-      }
-      if (insn->has_method()) {
-        // log methods class type, for virtual methods, this may not actually exist and true
-        // verification would require that the binding refers to a class that is valid.
-        const auto mref = type_class(insn->get_method()->get_class());
-        if (mref) class_refs[mref].emplace(type_class(meth->get_class()));
-
-        // don't log return type or types of parameters for now, but this is how you might do it.
-        //const auto proto = insn->get_method()->get_proto();
-        // const auto rref = type_class(proto->get_rtype());
-        // if (rref) class_refs[rref].emplace(type_class(meth->get_class()));
-        // for (const auto arg : proto->get_args()->get_type_list()) {
-        //   const auto aref = type_class(arg);
-        //   if (aref) class_refs[aref].emplace(type_class(meth->get_class()));
-        // }
-
-        return;
-      }
-    });
-}
-
-DexStore& findStore(std::string& name, DexStoresVector& stores) {
-  for (auto& store : stores) {
-    if (name == store.get_name()) {
-      return store;
-    }
+std::vector<store_bits_t> build_allowed_stores(const DexStoresVector& stores) {
+  size_t num_stores = stores.size();
+  // A dependency on a store that doesn't exist stands for the root store.
+  std::unordered_map<std::string, size_t> store_idxs;
+  for (size_t idx = num_stores; idx-- > 0;) {
+    store_idxs[stores[idx].get_name()] = idx;
   }
-  return stores[0];
-}
-
-const std::set<std::string> getAllowedStores(DexStoresVector& stores, DexStore& store, allowed_store_map_t store_map) {
-  auto search = store_map.find(store.get_name());
-  if (search != store_map.end()) {
-    return search->second;
+  std::vector<std::vector<size_t>> dependencies(num_stores);
+  std::vector<store_bits_t> allowed(num_stores, store_bits_t(num_stores + 1));
+  for (size_t idx = 0; idx < num_stores; ++idx) {
+    allowed[idx].set(idx);
+    allowed[idx].set(0);
+    for (const auto& name : stores[idx].get_dependencies()) {
+      auto it = store_idxs.find(name);
+      auto dependency = it == store_idxs.end() ? 0 : it->second;
+      dependencies[idx].push_back(dependency);
+      allowed[idx].set(dependency);
+    }
   }
-  store_map[store.get_name()].emplace(store.get_name());
-  store_map[store.get_name()].emplace(stores[0].get_name());
-  for (auto parent : store.get_dependencies()) {
-    store_map[store.get_name()].emplace(parent);
-    for (auto grandparent : getAllowedStores(stores, findStore(parent, stores), store_map)) {
-      store_map[store.get_name()].emplace(grandparent);
+  // Close over the dependencies of dependencies until nothing changes.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t idx = 0; idx < num_stores; ++idx) {
+      for (auto dependency : dependencies[idx]) {
+        if (!allowed[dependency].is_subset_of(allowed[idx])) {
+          allowed[idx] |= allowed[dependency];
+          changed = true;
+        }
+      }
     }
   }
-  return store_map[store.get_name()];
+  return allowed;
 }
 
-void verifyStore(DexStoresVector& stores, DexStore& store, class_to_store_map_t map, allowed_store_map_t store_map, FILE* fd) {
-  refs_t class_refs;
-  auto scope = build_class_scope(store.get_dexen());
-  build_refs(scope, class_refs);
-  for (auto& ref : class_refs) {
-    const auto target = ref.first;
-    for (const auto& source : ref.second) {
-      std::string target_store_name;
-      auto find = map.find(target);
-      if (find != map.end()) {
-        target_store_name = find->second->get_name();
-      } else {
-        target_store_name = "external";
-      }
-      std::set<std::string> allowed_stores = getAllowedStores(stores, store, store_map);
-      if (allowed_stores.find(target_store_name) == allowed_stores.end()) {
-        TRACE(
-          VERIFY,
-          5,
-          "BAD REFERENCE from %s %s to %s %s\n",
-          store.get_name().c_str(),
-          source->get_deobfuscated_name().c_str(),
-          target_store_name.c_str(),
-          target->get_deobfuscated_name().c_str());
-      }
-      if (fd != nullptr) {
-        fprintf(fd, "%s:%s->%s:%s\n",
-          store.get_name().c_str(),
-          source->get_deobfuscated_name().c_str(),
-          target_store_name.c_str(),
-          target->get_deobfuscated_name().c_str());
-      }
+/*
+ * The classes that the code of `cls` refers to, through the types, fields and
+ * methods of its instructions.
+ */
+class_set_t build_refs(const DexClass* cls) {
+  // TODO: walk through annotations
+  class_set_t refs;
+  auto add_ref = [&refs](const DexType* type) {
+    const auto ref = type_class(type);
+    if (ref) refs.emplace(ref);
+  };
+  std::vector<DexMethod*> methods(cls->get_dmethods().begin(),
+                                  cls->get_dmethods().end());
+  methods.insert(methods.end(), cls->get_vmethods().begin(),
+                 cls->get_vmethods().end());
+  for (auto* method : methods) {
+    auto* code = method->get_code();
+    if (code == nullptr) {
+      continue;
     }
+    editable_cfg_adapter::iterate(code, [&](MethodItemEntry& mie) {
+      auto* insn = mie.insn;
+      if (insn->has_type()) {
+        add_ref(insn->get_type());
+      } else if (insn->has_field()) {
+        add_ref(insn->get_field()->get_class());
+      } else if (insn->has_method()) {
+        // log methods class type, for virtual methods, this may not actually
+        // exist and true verification would require that the binding refers
+        // to a class that is valid. The return and argument types are not
+        // logged for now.
+        add_ref(insn->get_method()->get_class());
+      }
+      return editable_cfg_adapter::LOOP_CONTINUE;
+    });
   }
+  return refs;
 }
 
 } // namespace
@@ -150,16 +121,54 @@ void VerifierPass::run_pass(DexStoresVector& stores,
     }
   }
 
-  allowed_store_map_t store_map;
-  class_to_store_map_t map;
-  for (auto& store : stores) {
-    auto scope = build_class_scope(store.get_dexen());
-    for (const auto& cls : scope) {
-      map[cls] = &store;
+  // The store of each class, by dense id. A class defined in several stores
+  // belongs to the last one.
+  size_t no_store = stores.size();
+  std::vector<size_t> class_stores(g_redex->num_class_ids(), no_store);
+  for (size_t idx = 0; idx < stores.size(); ++idx) {
+    for (const auto& dex : stores[idx].get_dexen()) {
+      for (const auto* cls : dex) {
+        class_stores[cls->get_dense_id()] = idx;
+      }
     }
   }
-  for (auto& store : stores) {
-    verifyStore(stores, store, map, store_map, fd);
+  auto store_name = [&](size_t idx) {
+    return idx == no_store ? std::string("external") : stores[idx].get_name();
+  };
+  auto allowed_stores = build_allowed_stores(stores);
+
+  // All stores are checked in a single parallel walk. Each class writes its
+  // dependencies to its own slot, and they are written out in scope order.
+  auto scope = build_class_scope(stores);
+  std::vector<std::string> deps(fd != nullptr ? class_stores.size() : 0);
+  walk::parallel::classes(scope, [&](DexClass* cls) {
+    auto store_idx = class_stores[cls->get_dense_id()];
+    const auto& allowed = allowed_stores[store_idx];
+    for (const auto* target : build_refs(cls)) {
+      auto target_idx = target->get_dense_id() < class_stores.size()
+                            ? class_stores[target->get_dense_id()]
+                            : no_store;
+      if (!allowed.test(target_idx)) {
+        TRACE(VERIFY,
+              5,
+              "BAD REFERENCE from %s %s to %s %s\n",
+              store_name(store_idx).c_str(),
+              cls->get_deobfuscated_name().c_str(),
+              store_name(target_idx).c_str(),
+              target->get_deobfuscated_name().c_str());
+      }
+      if (fd != nullptr) {
+        deps[cls->get_dense_id()] +=
+            store_name(store_idx) + ":" + cls->get_deobfuscated_name() +
+            "->" + store_name(target_idx) + ":" +
+            target->get_deobfuscated_name() + "\n";
+      }
+    }
+  });
+  if (fd != nullptr) {
+    for (const auto* cls : scope) {
+      fputs(deps[cls->get_dense_id()].c_str(), fd);
+    }
   }
 
   if (fd != nullptr) {
@@ -17,6 +17,9 @@ class VerifierPass : public Pass {
     jw.get("class_dependencies_output", "", m_class_dependencies_output);
   }
 
+  uint32_t reads() const override { return CODE | HIERARCHY; }
+  uint32_t writes() const override { return NOTHING; }
+
   void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override;
 
  private:
@@ -8,6 +8,8 @@
 #include "MethodDevirtualizationPass.h"
 #include "DexUtil.h"
 #include "MethodDevirtualizer.h"
+#include "MethodOverrideGraph.h"
+#include "VirtualScope.h"
 
 void MethodDevirtualizationPass::run_pass(DexStoresVector& stores,
                                           ConfigFiles&,
@@ -18,7 +20,11 @@ void MethodDevirtualizationPass::run_pass(DexStoresVector& stores,
                              m_staticize_dmethods_using_this,
                              m_ignore_keep);
   const auto scope = build_class_scope(stores);
-  const auto metrics = devirt.devirtualize_methods(scope);
+  // Gives java.lang.Object a class for the graph, see devirtualize_methods().
+  get_vmethods(get_object_type());
+  auto override_graph = manager.method_override_graph_cache().get(scope);
+  const auto metrics =
+      devirt.devirtualize_methods(scope, override_graph.get());
   manager.incr_metric("num_staticized_methods_drop_this",
                       metrics.num_methods_not_using_this);
   manager.incr_metric("num_staticized_methods_keep_this",
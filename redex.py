@@ -187,6 +187,13 @@ def run_redex_binary(state):
         args += ['--stop-pass', str(state.stop_pass_idx),
                  '--output-ir', state.args.output_ir]
 
+    # Stop after a pass and output a checkpoint to resume from.
+    if state.args.checkpoint_after:
+        args += ['--checkpoint-after', state.args.checkpoint_after,
+                 '--output-ir', state.args.output_ir]
+    if state.args.resume_from:
+        args += ['--resume-from', state.args.resume_from]
+
     if state.debugger == 'lldb':
         args = ['lldb', '--'] + args
     elif state.debugger == 'gdb':
@@ -305,7 +312,8 @@ def zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align):
 
 
 def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
-                      key_alias, key_password, ignore_zipalign, page_align):
+                      key_alias, key_password, ignore_zipalign, page_align,
+                      input_apk_path, redex_binary):
 
     # Remove old signature files
     for f in abs_glob(extracted_apk_dir, 'META-INF/*'):
@@ -313,13 +321,70 @@ def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
         if isfile(cert_path):
             os.remove(cert_path)
 
+    try:
+        os.makedirs(dirname(output_apk_path))
+    except OSError as e:
+        if e.errno != errno.EEXIST:
+            raise
+
+    packer = find_apk_packer(redex_binary)
+    if packer is not None and not sign:
+        # The packer aligns the entries itself, so there is nothing left to do
+        # after it.
+        if isfile(output_apk_path):
+            os.remove(output_apk_path)
+        pack_apk(packer, input_apk_path, extracted_apk_dir, output_apk_path,
+                 page_align)
+        return
+
     directory = make_temp_dir('.redex_unaligned', False)
     unaligned_apk_path = join(directory, 'redex-unaligned.apk')
 
     if isfile(unaligned_apk_path):
         os.remove(unaligned_apk_path)
 
-    # Create new zip file
+    if packer is not None:
+        # Signing rewrites the APK, so it still needs zipalign afterwards.
+        pack_apk(packer, input_apk_path, extracted_apk_dir, unaligned_apk_path,
+                 page_align)
+    else:
+        zip_apk_dir(extracted_apk_dir, unaligned_apk_path)
+
+    # Add new signature
+    if sign:
+        sign_apk(keystore, key_password, key_alias, unaligned_apk_path)
+
+    if isfile(output_apk_path):
+        os.remove(output_apk_path)
+
+    zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align)
+
+
+def find_apk_packer(redex_binary):
+    # redex-pack-apk is built and installed along with redex-all.
+    if redex_binary is not None:
+        packer = join(dirname(redex_binary), 'redex-pack-apk')
+        if isfile(packer) and os.access(packer, os.X_OK):
+            return packer
+    try:
+        return subprocess.check_output(['which', 'redex-pack-apk']
+                                       ).rstrip().decode('ascii')
+    except subprocess.CalledProcessError:
+        return None
+
+
+def pack_apk(packer, input_apk_path, extracted_apk_dir, output_apk_path,
+             page_align):
+    # Unchanged entries are copied from the input APK as they are, and the
+    # others are compressed in parallel and aligned as they are written.
+    args = [packer, '--input-apk', input_apk_path]
+    if page_align:
+        args.append('--page-align-libs')
+    args += [extracted_apk_dir, output_apk_path]
+    subprocess.check_call(args)
+
+
+def zip_apk_dir(extracted_apk_dir, unaligned_apk_path):
     with zipfile.ZipFile(unaligned_apk_path, 'w') as unaligned_apk:
         for dirpath, _dirnames, filenames in os.walk(extracted_apk_dir):
             for filename in filenames:
@@ -332,21 +397,6 @@ def create_output_apk(extracted_apk_dir, output_apk_path, sign, keystore,
                 unaligned_apk.write(filepath, archivepath,
                                     compress_type=compress)
 
-    # Add new signature
-    if sign:
-        sign_apk(keystore, key_password, key_alias, unaligned_apk_path)
-
-    if isfile(output_apk_path):
-        os.remove(output_apk_path)
-
-    try:
-        os.makedirs(dirname(output_apk_path))
-    except OSError as e:
-        if e.errno != errno.EEXIST:
-            raise
-
-    zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align)
-
 
 def merge_proguard_maps(
         redex_rename_map_path,
@@ -552,6 +602,10 @@ Given an APK, produce a better APK!
                         help='Stop before a pass and dump intermediate dex and IR meta data to a directory')
     parser.add_argument('--output-ir', default='',
                         help='Stop before stop_pass and dump intermediate dex and IR meta data to output_ir folder')
+    parser.add_argument('--checkpoint-after', default='',
+                        help='Stop after a pass and dump a checkpoint to output_ir folder')
+    parser.add_argument('--resume-from', default='',
+                        help='Run the passes after a checkpoint, instead of all of them')
     return parser
 
 
@@ -659,6 +713,7 @@ def prepare_redex(args):
     if args.stop_pass:
         passes_list = config_dict.get('redex', {}).get('passes', [])
         stop_pass_idx = get_stop_pass_idx(passes_list, args.stop_pass)
+    if args.stop_pass or args.checkpoint_after:
         if not args.output_ir or isfile(args.output_ir):
             print('Error: output_ir should be a directory')
             sys.exit(1)
@@ -820,7 +875,8 @@ def finalize_redex(state):
 
     log('Creating output apk')
     create_output_apk(state.extracted_apk_dir, state.args.out, state.args.sign, state.args.keystore,
-                      state.args.keyalias, state.args.keypass, state.args.ignore_zipalign, state.args.page_align_libs)
+                      state.args.keyalias, state.args.keypass, state.args.ignore_zipalign, state.args.page_align_libs,
+                      state.args.input_apk, state.args.redex_binary)
     log('Creating output APK finished in {:.2f} seconds'.format(
         timer() - repack_start_time))
     copy_file_to_out_dir(state.dex_dir, state.args.out,
@@ -910,7 +966,7 @@ def run_redex(args):
     state = prepare_redex(args)
     run_redex_binary(state)
 
-    if args.stop_pass:
+    if args.stop_pass or args.checkpoint_after:
         # Do not remove temp dirs
         sys.exit()
 
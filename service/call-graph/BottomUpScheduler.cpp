@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BottomUpScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#include "Trace.h"
+#include "WorkQueue.h"
+
+namespace {
+
+using namespace call_graph;
+
+const Edges* callees_of(const Graph& graph, const DexMethod* method) {
+  return graph.has_node(method) ? &graph.node(method).callees() : nullptr;
+}
+
+/*
+ * Tarjan's algorithm, with an explicit stack since call chains can be deeper
+ * than the native stack allows. It emits the components in reverse
+ * topological order, i.e., callees first.
+ */
+class SccBuilder {
+ public:
+  explicit SccBuilder(const Graph& graph) : m_graph(graph) {}
+
+  void visit_from(const DexMethod* root) {
+    if (m_states.count(root) != 0) {
+      return;
+    }
+    push(root);
+    while (!m_frames.empty()) {
+      const DexMethod* method = m_frames.back().first;
+      size_t& next_edge = m_frames.back().second;
+      const Edges* callees = callees_of(m_graph, method);
+      if (callees != nullptr && next_edge < callees->size()) {
+        const DexMethod* callee = (*callees)[next_edge++]->callee();
+        if (callee->get_code() == nullptr) {
+          continue;
+        }
+        auto it = m_states.find(callee);
+        if (it == m_states.end()) {
+          push(callee);
+        } else if (it->second.on_stack) {
+          auto& state = m_states.at(method);
+          state.lowlink = std::min(state.lowlink, it->second.index);
+        }
+        continue;
+      }
+      m_frames.pop_back();
+      auto& state = m_states.at(method);
+      if (!m_frames.empty()) {
+        auto& parent = m_states.at(m_frames.back().first);
+        parent.lowlink = std::min(parent.lowlink, state.lowlink);
+      }
+      if (state.lowlink == state.index) {
+        pop_scc(method);
+      }
+    }
+  }
+
+  std::vector<std::vector<const DexMethod*>> take_sccs() {
+    return std::move(m_sccs);
+  }
+
+ private:
+  struct NodeState {
+    size_t index;
+    size_t lowlink;
+    bool on_stack;
+  };
+
+  void push(const DexMethod* method) {
+    size_t index = m_states.size();
+    m_states.emplace(method, NodeState{index, index, true});
+    m_stack.push_back(method);
+    m_frames.emplace_back(method, 0);
+  }
+
+  void pop_scc(const DexMethod* head) {
+    // The stack holds the component in the order the search entered it; the
+    // callees are entered after their callers, so we reverse it.
+    auto begin = std::find(m_stack.begin(), m_stack.end(), head);
+    std::vector<const DexMethod*> scc(m_stack.rbegin(),
+                                      std::make_reverse_iterator(begin));
+    m_stack.erase(begin, m_stack.end());
+    for (const auto* method : scc) {
+      m_states.at(method).on_stack = false;
+    }
+    m_sccs.push_back(std::move(scc));
+  }
+
+  const Graph& m_graph;
+  std::unordered_map<const DexMethod*, NodeState> m_states;
+  std::vector<const DexMethod*> m_stack;
+  // The methods being searched, with the index of their next callee edge.
+  std::vector<std::pair<const DexMethod*, size_t>> m_frames;
+  std::vector<std::vector<const DexMethod*>> m_sccs;
+};
+
+} // namespace
+
+namespace call_graph {
+
+std::vector<std::vector<const DexMethod*>> bottom_up_sccs(const Scope& scope,
+                                                          const Graph& graph) {
+  SccBuilder builder(graph);
+  walk::code(scope, [&](const DexMethod* method, IRCode&) {
+    builder.visit_from(method);
+  });
+  return builder.take_sccs();
+}
+
+void parallel_bottom_up(const Scope& scope,
+                        const Graph& graph,
+                        const std::function<void(const DexMethod*)>& fn,
+                        size_t num_threads) {
+  auto sccs = bottom_up_sccs(scope, graph);
+  std::unordered_map<const DexMethod*, size_t> scc_of;
+  for (size_t i = 0; i < sccs.size(); ++i) {
+    for (const auto* method : sccs[i]) {
+      scc_of.emplace(method, i);
+    }
+  }
+
+  // The components that each component is called from, and the number of
+  // distinct components it calls into that haven't run yet.
+  std::vector<std::vector<size_t>> callers(sccs.size());
+  std::unique_ptr<std::atomic<size_t>[]> pending(
+      new std::atomic<size_t>[sccs.size()]);
+  std::vector<size_t> last_caller(sccs.size(),
+                                  std::numeric_limits<size_t>::max());
+  size_t largest_scc = 0;
+  for (size_t i = 0; i < sccs.size(); ++i) {
+    size_t num_callees = 0;
+    for (const auto* method : sccs[i]) {
+      const Edges* callees = callees_of(graph, method);
+      if (callees == nullptr) {
+        continue;
+      }
+      for (const auto& edge : *callees) {
+        auto it = scc_of.find(edge->callee());
+        if (it == scc_of.end() || it->second == i ||
+            last_caller[it->second] == i) {
+          continue;
+        }
+        last_caller[it->second] = i;
+        callers[it->second].push_back(i);
+        ++num_callees;
+      }
+    }
+    pending[i].store(num_callees);
+    largest_scc = std::max(largest_scc, sccs[i].size());
+  }
+  TRACE(CALLGRAPH, 2,
+        "Scheduling %lu methods in %lu SCCs bottom-up, the largest has %lu\n",
+        scc_of.size(), sccs.size(), largest_scc);
+
+  using WorkerState = WorkerState<size_t, std::nullptr_t, std::nullptr_t>;
+  auto wq = WorkQueue<size_t, std::nullptr_t, std::nullptr_t>(
+      [&](WorkerState* state, size_t scc) {
+        for (const auto* method : sccs[scc]) {
+          fn(method);
+        }
+        for (size_t caller : callers[scc]) {
+          if (pending[caller].fetch_sub(1) == 1) {
+            state->push_task(caller);
+          }
+        }
+        return nullptr;
+      },
+      [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+      [](unsigned int) { return nullptr; },
+      num_threads);
+  for (size_t i = 0; i < sccs.size(); ++i) {
+    if (pending[i].load() == 0) {
+      wq.add_item(i);
+    }
+  }
+  wq.run_all();
+}
+
+} // namespace call_graph
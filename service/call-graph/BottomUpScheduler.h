@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "CallGraph.h"
+#include "DexClass.h"
+#include "Walkers.h"
+
+namespace call_graph {
+
+/*
+ * The strongly connected components of the call graph that are reachable from
+ * the methods with code in `scope`, callees first: every component comes after
+ * all the components it calls into. Only methods with code are included.
+ *
+ * Within a component, the methods are listed in the order in which the depth-
+ * first search finished them, which puts callees before their callers
+ * whenever the recursion allows it.
+ */
+std::vector<std::vector<const DexMethod*>> bottom_up_sccs(const Scope& scope,
+                                                          const Graph& graph);
+
+/*
+ * Calls `fn` on every method with code in `scope`, and on the methods with code
+ * they transitively call, in parallel but after all their callees, mutually
+ * recursive methods excepted. This is the schedule of an interprocedural
+ * analysis whose summaries are computed from the summaries of the callees.
+ *
+ * The methods of a strongly connected component of the call graph are run one
+ * after the other, in the order given by bottom_up_sccs(), so `fn` sees the
+ * results for the members of its own component that come earlier. Once all the
+ * callees of a component are done, it is pushed onto the queue of the worker
+ * that finished the last of them.
+ */
+void parallel_bottom_up(
+    const Scope& scope,
+    const Graph& graph,
+    const std::function<void(const DexMethod*)>& fn,
+    size_t num_threads = walk::parallel::default_num_threads());
+
+} // namespace call_graph
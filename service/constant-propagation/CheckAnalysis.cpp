@@ -0,0 +1,549 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CheckAnalysis.h"
+
+#include "Debug.h"
+#include "IRInstruction.h"
+#include "Show.h"
+
+using nullness::Nullness;
+
+namespace {
+
+nullness::Domain nullness_of(const ConstantValue& value) {
+  if (value.is_top() || value.is_bottom()) {
+    return value.is_top() ? nullness::Domain::top()
+                          : nullness::Domain::bottom();
+  }
+  auto scd = value.maybe_get<SignedConstantDomain>();
+  if (!scd) {
+    // Strings, singletons and heap pointers all denote actual objects.
+    return nullness::Domain(Nullness::NOT_NULL);
+  }
+  switch (scd->interval()) {
+  case sign_domain::Interval::EQZ:
+    return nullness::Domain(Nullness::IS_NULL);
+  case sign_domain::Interval::LTZ:
+  case sign_domain::Interval::GTZ:
+  case sign_domain::Interval::NEZ:
+    return nullness::Domain(Nullness::NOT_NULL);
+  default:
+    return nullness::Domain::top();
+  }
+}
+
+IntervalDomain interval_of(const ConstantValue& value) {
+  auto scd = value.maybe_get<SignedConstantDomain>();
+  if (!scd || scd->is_top()) {
+    return IntervalDomain::top();
+  }
+  if (scd->is_bottom()) {
+    return IntervalDomain::bottom();
+  }
+  return IntervalDomain(scd->min_element(), scd->max_element());
+}
+
+// The interval of an int operation whose exact result is in [lower, upper].
+// The operation wraps around if that doesn't fit in an int.
+IntervalDomain int_result(int64_t lower, int64_t upper) {
+  IntervalDomain result(lower, upper);
+  return result.is_int32() ? result : IntervalDomain::top();
+}
+
+IntervalDomain add_int(const IntervalDomain& a, const IntervalDomain& b) {
+  if (!a.is_int32() || !b.is_int32()) {
+    return IntervalDomain::top();
+  }
+  return int_result(a.lower_bound() + b.lower_bound(),
+                    a.upper_bound() + b.upper_bound());
+}
+
+IntervalDomain sub_int(const IntervalDomain& a, const IntervalDomain& b) {
+  if (!a.is_int32() || !b.is_int32()) {
+    return IntervalDomain::top();
+  }
+  return int_result(a.lower_bound() - b.upper_bound(),
+                    a.upper_bound() - b.lower_bound());
+}
+
+IntervalDomain and_int_lit(const IntervalDomain& a, int64_t lit) {
+  if (lit < 0) {
+    return IntervalDomain::top();
+  }
+  // Masking a non-negative value can only make it smaller.
+  if (a.lower_bound() >= 0) {
+    return IntervalDomain(0, std::min(lit, a.upper_bound()));
+  }
+  return IntervalDomain(0, lit);
+}
+
+IntervalDomain rem_int_lit(const IntervalDomain& a, int64_t lit) {
+  if (lit == 0) {
+    // It throws.
+    return IntervalDomain::top();
+  }
+  int64_t bound = (lit < 0 ? -lit : lit) - 1;
+  if (a.lower_bound() >= 0) {
+    return IntervalDomain(0, std::min(bound, a.upper_bound()));
+  }
+  return IntervalDomain(-bound, bound);
+}
+
+IntervalDomain shr_int_lit(const IntervalDomain& a, int64_t lit) {
+  auto shift = lit & 0x1f;
+  if (!a.is_int32()) {
+    return IntervalDomain::int32();
+  }
+  return IntervalDomain(a.lower_bound() >> shift, a.upper_bound() >> shift);
+}
+
+IntervalDomain ushr_int_lit(const IntervalDomain& a, int64_t lit) {
+  auto shift = lit & 0x1f;
+  if (shift == 0) {
+    return a;
+  }
+  if (a.is_int32() && a.lower_bound() >= 0) {
+    return IntervalDomain(a.lower_bound() >> shift, a.upper_bound() >> shift);
+  }
+  return IntervalDomain(0, int64_t(0xffffffff) >> shift);
+}
+
+// The length of the array that `reg` references, if the constant
+// environment knows it.
+IntervalDomain array_length(const ConstantEnvironment& constants, reg_t reg) {
+  auto length = IntervalDomain(0, std::numeric_limits<int32_t>::max());
+  auto ptr = constants.get(reg).maybe_get<AbstractHeapPointer>();
+  if (!ptr || !ptr->is_value()) {
+    return length;
+  }
+  auto arr = constants.get_heap()
+                 .get(*ptr->get_constant())
+                 .maybe_get<ConstantPrimitiveArrayDomain>();
+  if (!arr || !arr->is_value()) {
+    return length;
+  }
+  return IntervalDomain(arr->length());
+}
+
+/*
+ * The nullness and the interval of what `insn` writes, as far as the
+ * constants don't tell. `env` is the state before `insn`.
+ */
+void analyze_result(const IRInstruction* insn,
+                    const CheckEnvironment& env,
+                    nullness::Domain* nullness,
+                    IntervalDomain* interval) {
+  auto op = insn->opcode();
+  auto src_interval = [&](size_t i) { return env.get_interval(insn->src(i)); };
+  switch (op) {
+  case OPCODE_MOVE:
+  case OPCODE_MOVE_WIDE:
+  case OPCODE_MOVE_OBJECT:
+    *nullness = env.get_nullness(insn->src(0));
+    *interval = src_interval(0);
+    break;
+  case OPCODE_MOVE_RESULT:
+  case OPCODE_MOVE_RESULT_WIDE:
+  case OPCODE_MOVE_RESULT_OBJECT:
+  case IOPCODE_MOVE_RESULT_PSEUDO:
+  case IOPCODE_MOVE_RESULT_PSEUDO_WIDE:
+  case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
+    *nullness = env.get_nullness(RESULT_REGISTER);
+    *interval = env.get_interval(RESULT_REGISTER);
+    break;
+  case OPCODE_NEW_INSTANCE:
+  case OPCODE_NEW_ARRAY:
+  case OPCODE_FILLED_NEW_ARRAY:
+  case OPCODE_CONST_STRING:
+  case OPCODE_CONST_CLASS:
+  case OPCODE_MOVE_EXCEPTION:
+    *nullness = nullness::Domain(Nullness::NOT_NULL);
+    break;
+  case OPCODE_CHECK_CAST:
+    *nullness = env.get_nullness(insn->src(0));
+    break;
+  case OPCODE_ARRAY_LENGTH:
+    *interval = array_length(env.get_constant_environment(), insn->src(0));
+    break;
+  case OPCODE_INSTANCE_OF:
+  case OPCODE_AGET_BOOLEAN:
+  case OPCODE_IGET_BOOLEAN:
+  case OPCODE_SGET_BOOLEAN:
+    *interval = IntervalDomain(0, 1);
+    break;
+  case OPCODE_CMPL_FLOAT:
+  case OPCODE_CMPG_FLOAT:
+  case OPCODE_CMPL_DOUBLE:
+  case OPCODE_CMPG_DOUBLE:
+  case OPCODE_CMP_LONG:
+    *interval = IntervalDomain(-1, 1);
+    break;
+  case OPCODE_INT_TO_BYTE:
+  case OPCODE_AGET_BYTE:
+  case OPCODE_IGET_BYTE:
+  case OPCODE_SGET_BYTE:
+    *interval = IntervalDomain(std::numeric_limits<int8_t>::min(),
+                               std::numeric_limits<int8_t>::max());
+    break;
+  case OPCODE_INT_TO_CHAR:
+  case OPCODE_AGET_CHAR:
+  case OPCODE_IGET_CHAR:
+  case OPCODE_SGET_CHAR:
+    *interval = IntervalDomain(0, std::numeric_limits<uint16_t>::max());
+    break;
+  case OPCODE_INT_TO_SHORT:
+  case OPCODE_AGET_SHORT:
+  case OPCODE_IGET_SHORT:
+  case OPCODE_SGET_SHORT:
+    *interval = IntervalDomain(std::numeric_limits<int16_t>::min(),
+                               std::numeric_limits<int16_t>::max());
+    break;
+  case OPCODE_ADD_INT:
+    *interval = add_int(src_interval(0), src_interval(1));
+    break;
+  case OPCODE_SUB_INT:
+    *interval = sub_int(src_interval(0), src_interval(1));
+    break;
+  case OPCODE_ADD_INT_LIT8:
+  case OPCODE_ADD_INT_LIT16:
+    *interval = add_int(src_interval(0), IntervalDomain(insn->get_literal()));
+    break;
+  case OPCODE_RSUB_INT:
+  case OPCODE_RSUB_INT_LIT8:
+    *interval = sub_int(IntervalDomain(insn->get_literal()), src_interval(0));
+    break;
+  case OPCODE_AND_INT_LIT8:
+  case OPCODE_AND_INT_LIT16:
+    *interval = and_int_lit(src_interval(0), insn->get_literal());
+    break;
+  case OPCODE_REM_INT_LIT8:
+  case OPCODE_REM_INT_LIT16:
+    *interval = rem_int_lit(src_interval(0), insn->get_literal());
+    break;
+  case OPCODE_SHR_INT_LIT8:
+    *interval = shr_int_lit(src_interval(0), insn->get_literal());
+    break;
+  case OPCODE_USHR_INT_LIT8:
+    *interval = ushr_int_lit(src_interval(0), insn->get_literal());
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * The registers that `insn` dereferences, and the array index it uses, if
+ * any. They are only known to be non-null and in bounds once `insn` has
+ * completed without throwing.
+ */
+struct Dereference {
+  boost::optional<reg_t> object;
+  boost::optional<reg_t> index;
+};
+
+Dereference dereference_of(const IRInstruction* insn) {
+  auto op = insn->opcode();
+  if (is_iget(op)) {
+    return {insn->src(0), boost::none};
+  }
+  if (is_iput(op)) {
+    return {insn->src(1), boost::none};
+  }
+  if (is_aget(op)) {
+    return {insn->src(0), insn->src(1)};
+  }
+  if (is_aput(op)) {
+    return {insn->src(1), insn->src(2)};
+  }
+  switch (op) {
+  case OPCODE_INVOKE_VIRTUAL:
+  case OPCODE_INVOKE_SUPER:
+  case OPCODE_INVOKE_DIRECT:
+  case OPCODE_INVOKE_INTERFACE:
+  case OPCODE_ARRAY_LENGTH:
+  case OPCODE_MONITOR_ENTER:
+  case OPCODE_MONITOR_EXIT:
+  case OPCODE_FILL_ARRAY_DATA:
+    return {insn->src(0), boost::none};
+  default:
+    return {};
+  }
+}
+
+bool may_be_null(const nullness::Domain& value) {
+  return value.element() == Nullness::IS_NULL ||
+         value.element() == Nullness::ALL;
+}
+
+bool may_be_non_null(const nullness::Domain& value) {
+  return value.element() == Nullness::NOT_NULL ||
+         value.element() == Nullness::ALL;
+}
+
+/*
+ * Meets the interval of `reg` with `bound`, returning false if nothing is
+ * left.
+ */
+bool meet_interval(reg_t reg, const IntervalDomain& bound,
+                   CheckEnvironment* env) {
+  auto refined = env->get_interval(reg).meet(bound);
+  if (refined.is_bottom()) {
+    env->set_to_bottom();
+    return false;
+  }
+  env->set_interval(reg, refined);
+  return true;
+}
+
+// Refines `env` for the case where the condition of `op` holds.
+void refine_nullness(IROpcode op, const IRInstruction* insn,
+                     CheckEnvironment* env) {
+  auto left = env->get_nullness(insn->src(0));
+  switch (op) {
+  case OPCODE_IF_EQZ:
+    if (!may_be_null(left)) {
+      env->set_to_bottom();
+      return;
+    }
+    env->set_nullness(insn->src(0), nullness::Domain(Nullness::IS_NULL));
+    break;
+  case OPCODE_IF_NEZ:
+    if (!may_be_non_null(left)) {
+      env->set_to_bottom();
+      return;
+    }
+    env->set_nullness(insn->src(0), nullness::Domain(Nullness::NOT_NULL));
+    break;
+  case OPCODE_IF_EQ: {
+    auto refined = left.meet(env->get_nullness(insn->src(1)));
+    if (refined.is_bottom()) {
+      env->set_to_bottom();
+      return;
+    }
+    env->set_nullness(insn->src(0), refined);
+    env->set_nullness(insn->src(1), refined);
+    break;
+  }
+  case OPCODE_IF_NE: {
+    auto right = env->get_nullness(insn->src(1));
+    if (left.element() == Nullness::IS_NULL &&
+        right.element() == Nullness::IS_NULL) {
+      env->set_to_bottom();
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Refines `env` for the case where the condition of `op` holds.
+void refine_intervals(IROpcode op, const IRInstruction* insn,
+                      CheckEnvironment* env) {
+  auto a = insn->src(0);
+  auto left = env->get_interval(a);
+  auto at_least = [](int64_t bound) {
+    return bound == IntervalDomain::MAX ? IntervalDomain::bottom()
+                                        : IntervalDomain::at_least(bound + 1);
+  };
+  auto at_most = [](int64_t bound) {
+    return bound == IntervalDomain::MIN ? IntervalDomain::bottom()
+                                        : IntervalDomain::at_most(bound - 1);
+  };
+  switch (op) {
+  case OPCODE_IF_EQZ:
+    meet_interval(a, IntervalDomain(0), env);
+    return;
+  case OPCODE_IF_NEZ: {
+    if (left.get_constant() == boost::optional<int64_t>(0)) {
+      env->set_to_bottom();
+    } else if (left.lower_bound() == 0) {
+      meet_interval(a, IntervalDomain::at_least(1), env);
+    } else if (left.upper_bound() == 0) {
+      meet_interval(a, IntervalDomain::at_most(-1), env);
+    }
+    return;
+  }
+  case OPCODE_IF_LTZ:
+    meet_interval(a, IntervalDomain::at_most(-1), env);
+    return;
+  case OPCODE_IF_GEZ:
+    meet_interval(a, IntervalDomain::at_least(0), env);
+    return;
+  case OPCODE_IF_GTZ:
+    meet_interval(a, IntervalDomain::at_least(1), env);
+    return;
+  case OPCODE_IF_LEZ:
+    meet_interval(a, IntervalDomain::at_most(0), env);
+    return;
+  default:
+    break;
+  }
+
+  auto b = insn->src(1);
+  auto right = env->get_interval(b);
+  switch (op) {
+  case OPCODE_IF_EQ: {
+    auto refined = left.meet(right);
+    if (meet_interval(a, refined, env)) {
+      meet_interval(b, refined, env);
+    }
+    return;
+  }
+  case OPCODE_IF_NE: {
+    auto cst = left.get_constant();
+    if (cst && cst == right.get_constant()) {
+      env->set_to_bottom();
+    }
+    return;
+  }
+  case OPCODE_IF_LT:
+    // a < b
+    if (meet_interval(a, at_most(right.upper_bound()), env)) {
+      meet_interval(b, at_least(left.lower_bound()), env);
+    }
+    return;
+  case OPCODE_IF_GT:
+    // b < a
+    if (meet_interval(b, at_most(left.upper_bound()), env)) {
+      meet_interval(a, at_least(right.lower_bound()), env);
+    }
+    return;
+  case OPCODE_IF_LE:
+    // a <= b
+    if (meet_interval(a, IntervalDomain::at_most(right.upper_bound()), env)) {
+      meet_interval(b, IntervalDomain::at_least(left.lower_bound()), env);
+    }
+    return;
+  case OPCODE_IF_GE:
+    // b <= a
+    if (meet_interval(b, IntervalDomain::at_most(left.upper_bound()), env)) {
+      meet_interval(a, IntervalDomain::at_least(right.lower_bound()), env);
+    }
+    return;
+  default:
+    always_assert_log(false, "expected if-* opcode, got %s", SHOW(insn));
+  }
+}
+
+} // namespace
+
+CheckEnvironment& CheckEnvironment::reduce(reg_t reg) {
+  const auto& value = get_constant_environment().get(reg);
+  set_nullness(reg, get_nullness(reg).meet(nullness_of(value)));
+  set_interval(reg, get_interval(reg).meet(interval_of(value)));
+  return *this;
+}
+
+namespace constant_propagation {
+
+namespace intraprocedural {
+
+void CheckFixpointIterator::analyze_instruction(const IRInstruction* insn,
+                                                CheckEnvironment* env) const {
+  auto op = insn->opcode();
+  boost::optional<reg_t> dest;
+  if (opcode::is_load_param(op)) {
+    // The initial state holds what is known of the parameters.
+  } else if (insn->dests_size()) {
+    dest = insn->dest();
+  } else if (insn->has_move_result() || insn->has_move_result_pseudo()) {
+    dest = RESULT_REGISTER;
+  }
+  auto nullness = nullness::Domain::top();
+  auto interval = IntervalDomain::top();
+  if (dest) {
+    analyze_result(insn, *env, &nullness, &interval);
+  }
+
+  env->mutate_constant_environment([&](ConstantEnvironment* constants) {
+    m_insn_analyzer(insn, constants);
+  });
+  if (dest) {
+    env->set_nullness(*dest, nullness);
+    env->set_interval(*dest, interval);
+    env->reduce(*dest);
+  }
+
+  auto deref = dereference_of(insn);
+  if (deref.object) {
+    env->set_nullness(*deref.object, nullness::Domain(Nullness::NOT_NULL));
+  }
+  if (deref.index) {
+    auto length = array_length(env->get_constant_environment(), *deref.object);
+    auto index = env->get_interval(*deref.index)
+                     .meet(IntervalDomain(0, length.upper_bound() - 1));
+    // An access that always throws leaves the state to its handlers alone.
+    if (!index.is_bottom()) {
+      env->set_interval(*deref.index, index);
+    }
+  }
+}
+
+void CheckFixpointIterator::analyze_node(
+    const NodeId& block, CheckEnvironment* state_at_entry) const {
+  for (auto& mie : InstructionIterable(block)) {
+    analyze_instruction(mie.insn, state_at_entry);
+  }
+}
+
+CheckEnvironment CheckFixpointIterator::analyze_edge(
+    const EdgeId& edge, const CheckEnvironment& exit_state_at_source) const {
+  return refine_check_edge(edge, exit_state_at_source, CheckFacts::INTERVALS);
+}
+
+CheckEnvironment refine_check_edge(const cfg::Edge* edge,
+                                   const CheckEnvironment& exit_state_at_source,
+                                   CheckFacts facts) {
+  auto env = exit_state_at_source;
+  auto last_insn_it = edge->src()->get_last_insn();
+  if (env.is_bottom() || last_insn_it == edge->src()->end()) {
+    return env;
+  }
+  auto insn = last_insn_it->insn;
+  if (edge->type() == cfg::EDGE_THROW) {
+    // The instruction that threw didn't dereference anything.
+    auto deref = dereference_of(insn);
+    if (deref.object) {
+      env.set_nullness(*deref.object, nullness::Domain::top());
+    }
+    if (deref.index) {
+      env.set_interval(*deref.index, IntervalDomain::top());
+    }
+    return env;
+  }
+
+  env.mutate_constant_environment([&](ConstantEnvironment* constants) {
+    *constants = refine_on_edge(edge, *constants);
+  });
+  auto op = insn->opcode();
+  if (env.is_bottom() || facts == CheckFacts::CONSTANTS) {
+    return env;
+  }
+  if (is_conditional_branch(op)) {
+    // Inverting the conditional here means that we only need to consider the
+    // "true" case of the if-* opcode
+    if (edge->type() != cfg::EDGE_BRANCH) {
+      op = opcode::invert_conditional_branch(op);
+    }
+    refine_nullness(op, insn, &env);
+    if (!env.is_bottom() && facts == CheckFacts::INTERVALS) {
+      refine_intervals(op, insn, &env);
+    }
+  } else if (is_switch(op) && facts == CheckFacts::INTERVALS) {
+    const auto& case_key = edge->case_key();
+    if (case_key) {
+      meet_interval(insn->src(0), IntervalDomain(*case_key), &env);
+    }
+  }
+  return env;
+}
+
+} // namespace intraprocedural
+
+} // namespace constant_propagation
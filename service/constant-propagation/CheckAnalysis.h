@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "ConstantEnvironment.h"
+#include "ConstantPropagationAnalysis.h"
+#include "IntervalDomain.h"
+#include "NullnessDomain.h"
+
+using NullnessEnvironment =
+    sparta::PatriciaTreeMapAbstractEnvironment<reg_t, nullness::Domain>;
+
+using IntervalEnvironment =
+    sparta::PatriciaTreeMapAbstractEnvironment<reg_t, IntervalDomain>;
+
+/*
+ * The constants of the registers, together with whether they may be null and
+ * the interval of the values they may hold.
+ *
+ * The product isn't reduced as a whole, which would mean going over every
+ * register each time. Instead, reduce(reg) refines the nullness and the
+ * interval of a register with its constant value as it gets written.
+ */
+class CheckEnvironment final
+    : public sparta::ReducedProductAbstractDomain<CheckEnvironment,
+                                                  ConstantEnvironment,
+                                                  NullnessEnvironment,
+                                                  IntervalEnvironment> {
+ public:
+  using ReducedProductAbstractDomain::ReducedProductAbstractDomain;
+
+  // Some older compilers complain that the class is not default constructible.
+  // We intended to use the default constructors of the base class (via the
+  // `using` declaration above), but some compilers fail to catch this. So we
+  // insert a redundant '= default'.
+  CheckEnvironment() = default;
+
+  explicit CheckEnvironment(const ConstantEnvironment& constants)
+      : ReducedProductAbstractDomain(std::make_tuple(
+            constants, NullnessEnvironment(), IntervalEnvironment())) {}
+
+  static void reduce_product(std::tuple<ConstantEnvironment,
+                                        NullnessEnvironment,
+                                        IntervalEnvironment>&) {}
+
+  const ConstantEnvironment& get_constant_environment() const {
+    return get<0>();
+  }
+
+  nullness::Domain get_nullness(reg_t reg) const { return get<1>().get(reg); }
+
+  IntervalDomain get_interval(reg_t reg) const { return get<2>().get(reg); }
+
+  CheckEnvironment& mutate_constant_environment(
+      std::function<void(ConstantEnvironment*)> f) {
+    apply<0>(f);
+    return *this;
+  }
+
+  CheckEnvironment& set_nullness(reg_t reg, const nullness::Domain& value) {
+    apply<1>([&](NullnessEnvironment* env) { env->set(reg, value); });
+    return *this;
+  }
+
+  CheckEnvironment& set_interval(reg_t reg, const IntervalDomain& value) {
+    apply<2>([&](IntervalEnvironment* env) { env->set(reg, value); });
+    return *this;
+  }
+
+  // Meets the nullness and the interval of `reg` with what its constant value
+  // tells about them.
+  CheckEnvironment& reduce(reg_t reg);
+};
+
+namespace constant_propagation {
+
+namespace intraprocedural {
+
+/*
+ * Runs the constant propagation of `insn_analyzer` along with a nullness and
+ * an interval analysis of the registers, which tell when a null check or a
+ * comparison of an index against a bound is decided.
+ *
+ * The nullness comes from allocations, constants, and the registers that an
+ * instruction dereferences: they can't be null once it has completed. The
+ * intervals come from constants, array lengths, the narrow types of fields
+ * and array elements, and a few int operations; an array index is in bounds
+ * once it has been used.
+ */
+class CheckFixpointIterator final
+    : public sparta::MonotonicFixpointIterator<cfg::GraphInterface,
+                                               CheckEnvironment> {
+ public:
+  CheckFixpointIterator(const cfg::ControlFlowGraph& cfg,
+                        InstructionAnalyzer<ConstantEnvironment> insn_analyzer)
+      : MonotonicFixpointIterator(cfg), m_insn_analyzer(insn_analyzer) {}
+
+  CheckEnvironment analyze_edge(
+      const EdgeId&,
+      const CheckEnvironment& exit_state_at_source) const override;
+
+  void analyze_instruction(const IRInstruction* insn,
+                           CheckEnvironment* current_state) const;
+
+  void analyze_node(const NodeId& block,
+                    CheckEnvironment* state_at_entry) const override;
+
+ private:
+  InstructionAnalyzer<ConstantEnvironment> m_insn_analyzer;
+};
+
+/*
+ * The facts that refine_check_edge() uses, each level including the ones
+ * before it.
+ */
+enum class CheckFacts { CONSTANTS, NULLNESS, INTERVALS };
+
+/*
+ * Refines the state at the end of the source of `edge` with the outcome of
+ * the branch or switch that ends it, using the facts up to `facts`. Returns
+ * bottom if those show the edge can't be taken.
+ */
+CheckEnvironment refine_check_edge(const cfg::Edge* edge,
+                                   const CheckEnvironment& exit_state_at_source,
+                                   CheckFacts facts);
+
+} // namespace intraprocedural
+
+} // namespace constant_propagation
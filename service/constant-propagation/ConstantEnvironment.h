@@ -18,6 +18,7 @@
 #include "PatriciaTreeMapAbstractEnvironment.h"
 #include "PatriciaTreeSetAbstractDomain.h"
 #include "ReducedProductAbstractDomain.h"
+#include "RegisterArrayEnvironment.h"
 #include "SignedConstantDomain.h"
 
 /*
@@ -89,43 +90,53 @@ using ConstantHeap = sparta::PatriciaTreeMapAbstractEnvironment<
  * Combined model of the abstract stack and heap.
  *****************************************************************************/
 
-class ConstantEnvironment final
-    : public sparta::ReducedProductAbstractDomain<ConstantEnvironment,
-                                                  ConstantRegisterEnvironment,
-                                                  FieldEnvironment,
-                                                  ConstantHeap> {
+/*
+ * The register environment is a template parameter, so that an analysis can
+ * use ConstantEnvironmentImpl<sparta::RegisterArrayEnvironment<reg_t,
+ * ConstantValue>> instead of the Patricia tree default.
+ */
+template <class RegisterEnvironment>
+class ConstantEnvironmentImpl final
+    : public sparta::ReducedProductAbstractDomain<
+          ConstantEnvironmentImpl<RegisterEnvironment>,
+          RegisterEnvironment,
+          FieldEnvironment,
+          ConstantHeap> {
  public:
-  using ReducedProductAbstractDomain::ReducedProductAbstractDomain;
+  using Base =
+      sparta::ReducedProductAbstractDomain<ConstantEnvironmentImpl,
+                                           RegisterEnvironment,
+                                           FieldEnvironment,
+                                           ConstantHeap>;
+  using typename Base::ReducedProductAbstractDomain;
 
   // Some older compilers complain that the class is not default constructible.
   // We intended to use the default constructors of the base class (via the
   // `using` declaration above), but some compilers fail to catch this. So we
   // insert a redundant '= default'.
-  ConstantEnvironment() = default;
+  ConstantEnvironmentImpl() = default;
 
-  ConstantEnvironment(std::initializer_list<std::pair<reg_t, ConstantValue>> l)
-      : ReducedProductAbstractDomain(
-            std::make_tuple(ConstantRegisterEnvironment(l),
-                            FieldEnvironment(),
-                            ConstantHeap())) {}
+  ConstantEnvironmentImpl(
+      std::initializer_list<std::pair<reg_t, ConstantValue>> l)
+      : Base(std::make_tuple(
+            RegisterEnvironment(l), FieldEnvironment(), ConstantHeap())) {}
 
-  static void reduce_product(std::tuple<ConstantRegisterEnvironment,
-                                        FieldEnvironment,
-                                        ConstantHeap>&) {}
+  static void reduce_product(
+      std::tuple<RegisterEnvironment, FieldEnvironment, ConstantHeap>&) {}
   /*
    * Getters and setters
    */
 
-  const ConstantRegisterEnvironment& get_register_environment() const {
-    return ReducedProductAbstractDomain::get<0>();
+  const RegisterEnvironment& get_register_environment() const {
+    return Base::template get<0>();
   }
 
   const FieldEnvironment& get_field_environment() const {
-    return ReducedProductAbstractDomain::get<1>();
+    return Base::template get<1>();
   }
 
   const ConstantHeap& get_heap() const {
-    return ReducedProductAbstractDomain::get<2>();
+    return Base::template get<2>();
   }
 
   ConstantValue get(reg_t reg) const {
@@ -157,7 +168,7 @@ class ConstantEnvironment final
     if (ptr.is_bottom()) {
       return HeapValue::bottom();
     }
-    return get_heap().get(*ptr.get_constant()).get<HeapValue>();
+    return get_heap().get(*ptr.get_constant()).template get<HeapValue>();
   }
 
   /*
@@ -170,29 +181,31 @@ class ConstantEnvironment final
     return get_pointee<HeapValue>(ptr);
   }
 
-  ConstantEnvironment& mutate_register_environment(
-      std::function<void(ConstantRegisterEnvironment*)> f) {
-    apply<0>(f);
+  ConstantEnvironmentImpl& mutate_register_environment(
+      std::function<void(RegisterEnvironment*)> f) {
+    Base::template apply<0>(f);
     return *this;
   }
 
-  ConstantEnvironment& mutate_field_environment(
+  ConstantEnvironmentImpl& mutate_field_environment(
       std::function<void(FieldEnvironment*)> f) {
-    apply<1>(f);
+    Base::template apply<1>(f);
     return *this;
   }
 
-  ConstantEnvironment& mutate_heap(std::function<void(ConstantHeap*)> f) {
-    apply<2>(f);
+  ConstantEnvironmentImpl& mutate_heap(
+      std::function<void(ConstantHeap*)> f) {
+    Base::template apply<2>(f);
     return *this;
   }
 
-  ConstantEnvironment& set(reg_t reg, const ConstantValue& value) {
+  ConstantEnvironmentImpl& set(reg_t reg, const ConstantValue& value) {
     return mutate_register_environment(
-        [&](ConstantRegisterEnvironment* env) { env->set(reg, value); });
+        [&](RegisterEnvironment* env) { env->set(reg, value); });
   }
 
-  ConstantEnvironment& set(const DexField* field, const ConstantValue& value) {
+  ConstantEnvironmentImpl& set(const DexField* field,
+                               const ConstantValue& value) {
     return mutate_field_environment(
         [&](FieldEnvironment* env) { env->set(field, value); });
   }
@@ -200,7 +213,7 @@ class ConstantEnvironment final
   /*
    * Store :ptr_val in :reg, and make it point to :value.
    */
-  ConstantEnvironment& new_heap_value(
+  ConstantEnvironmentImpl& new_heap_value(
       reg_t reg,
       const AbstractHeapPointer::ConstantType& ptr_val,
       const HeapValue& value) {
@@ -213,9 +226,8 @@ class ConstantEnvironment final
    * Bind :value to arr[:idx], where arr is the array referenced by the pointer
    * in register :reg.
    */
-  ConstantEnvironment& set_array_binding(reg_t reg,
-                                         uint32_t idx,
-                                         const SignedConstantDomain& value) {
+  ConstantEnvironmentImpl& set_array_binding(
+      reg_t reg, uint32_t idx, const SignedConstantDomain& value) {
     return mutate_heap([&](ConstantHeap* heap) {
       auto ptr = get<AbstractHeapPointer>(reg);
       if (!ptr.is_value()) {
@@ -229,9 +241,9 @@ class ConstantEnvironment final
     });
   }
 
-  ConstantEnvironment& set_object_field(reg_t reg,
-                                        const DexField* field,
-                                        const ConstantValue& value) {
+  ConstantEnvironmentImpl& set_object_field(reg_t reg,
+                                            const DexField* field,
+                                            const ConstantValue& value) {
     return mutate_heap([&](ConstantHeap* heap) {
       auto ptr = get<AbstractHeapPointer>(reg);
       if (!ptr.is_value()) {
@@ -245,12 +257,15 @@ class ConstantEnvironment final
     });
   }
 
-  ConstantEnvironment& clear_field_environment() {
+  ConstantEnvironmentImpl& clear_field_environment() {
     return mutate_field_environment(
         [](FieldEnvironment* env) { env->set_to_top(); });
   }
 };
 
+using ConstantEnvironment =
+    ConstantEnvironmentImpl<ConstantRegisterEnvironment>;
+
 /*
  * For modeling the stack + heap at method return statements.
  */
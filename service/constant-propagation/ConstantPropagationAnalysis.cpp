@@ -93,7 +93,12 @@ void analyze_compare(const IRInstruction* insn, ConstantEnvironment* env) {
 namespace constant_propagation {
 
 static void set_escaped(reg_t reg, ConstantEnvironment* env) {
-  auto ptr_opt = env->get<AbstractHeapPointer>(reg).get_constant();
+  // The register may as well hold a primitive, like a null constant.
+  auto ptr = env->get(reg).maybe_get<AbstractHeapPointer>();
+  if (!ptr) {
+    return;
+  }
+  auto ptr_opt = ptr->get_constant();
   if (ptr_opt) {
     env->mutate_heap(
         [&](ConstantHeap* heap) { heap->set(*ptr_opt, HeapValue::top()); });
@@ -182,12 +187,58 @@ bool LocalArrayAnalyzer::analyze_aput(const IRInstruction* insn,
   return true;
 }
 
+bool LocalArrayAnalyzer::analyze_array_length(const IRInstruction* insn,
+                                              ConstantEnvironment* env) {
+  auto ptr = env->get(insn->src(0)).maybe_get<AbstractHeapPointer>();
+  if (!ptr) {
+    return false;
+  }
+  auto arr = env->get_pointee<ConstantPrimitiveArrayDomain>(*ptr);
+  if (!arr.is_value()) {
+    return false;
+  }
+  env->set(RESULT_REGISTER, SignedConstantDomain(arr.length()));
+  return true;
+}
+
 bool LocalArrayAnalyzer::analyze_fill_array_data(const IRInstruction* insn,
                                                  ConstantEnvironment* env) {
-  // We currently don't analyze fill-array-data properly; we simply
-  // mark the array it modifies as unknown.
-  set_escaped(insn->src(0), env);
-  return false;
+  auto ptr = env->get(insn->src(0)).maybe_get<AbstractHeapPointer>();
+  if (!ptr || !ptr->is_value()) {
+    set_escaped(insn->src(0), env);
+    return false;
+  }
+  auto arr = env->get_pointee<ConstantPrimitiveArrayDomain>(*ptr);
+  // The payload: element width, element count, then the elements in
+  // little-endian order.
+  auto data = insn->get_data()->data();
+  auto width = data[0];
+  uint32_t count = data[1] | (data[2] << 16);
+  if (!arr.is_value() || count > arr.length() || width == 0 || width > 8) {
+    set_escaped(insn->src(0), env);
+    return false;
+  }
+  auto bytes = reinterpret_cast<const uint8_t*>(data + 3);
+  auto element_type =
+      get_array_component_type((*ptr->get_constant())->get_type());
+  bool is_unsigned =
+      element_type == get_boolean_type() || element_type == get_char_type();
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t value = 0;
+    for (size_t j = 0; j < width; ++j) {
+      value |= (uint64_t)bytes[i * width + j] << (8 * j);
+    }
+    // Sign-extend the narrow elements, like their const literals are.
+    auto shift = 64 - 8 * width;
+    int64_t element = is_unsigned || shift == 0
+                          ? (int64_t)value
+                          : (int64_t)(value << shift) >> shift;
+    arr.set(i, SignedConstantDomain(element));
+  }
+  env->mutate_heap([&](ConstantHeap* heap) {
+    heap->set(*ptr->get_constant(), HeapValue(arr));
+  });
+  return true;
 }
 
 bool PrimitiveAnalyzer::analyze_default(const IRInstruction* insn,
@@ -389,6 +440,19 @@ bool ClinitFieldAnalyzer::analyze_invoke(const DexType* class_under_init,
   // static method can modify the class' static fields. We would have to
   // inspect the static method to find out. Here we take the conservative
   // approach of marking all static fields as unknown after the invoke.
+  // Any callee may read the static fields of the class under initialization,
+  // and write to the arrays they hold.
+  auto fields = env->get_field_environment();
+  if (fields.is_value()) {
+    for (const auto& pair : fields.bindings()) {
+      auto ptr = pair.second.maybe_get<AbstractHeapPointer>();
+      if (ptr && ptr->is_value()) {
+        env->mutate_heap([&](ConstantHeap* heap) {
+          heap->set(*ptr->get_constant(), HeapValue::top());
+        });
+      }
+    }
+  }
   if (insn->opcode() == OPCODE_INVOKE_STATIC &&
       class_under_init == insn->get_method()->get_class()) {
     env->clear_field_environment();
@@ -707,9 +771,8 @@ static void analyze_if(const IRInstruction* insn,
   }
 }
 
-ConstantEnvironment FixpointIterator::analyze_edge(
-    const EdgeId& edge,
-    const ConstantEnvironment& exit_state_at_source) const {
+ConstantEnvironment refine_on_edge(
+    const cfg::Edge* edge, const ConstantEnvironment& exit_state_at_source) {
   auto env = exit_state_at_source;
   auto last_insn_it = edge->src()->get_last_insn();
   if (last_insn_it == edge->src()->end()) {
@@ -730,6 +793,274 @@ ConstantEnvironment FixpointIterator::analyze_edge(
   return env;
 }
 
+ConstantEnvironment FixpointIterator::analyze_edge(
+    const EdgeId& edge,
+    const ConstantEnvironment& exit_state_at_source) const {
+  return refine_on_edge(edge, exit_state_at_source);
+}
+
+static bool is_move_result_any(IROpcode op) {
+  return is_move_result(op) || opcode::is_move_result_pseudo(op);
+}
+
+static bool is_terminator(IROpcode op) {
+  return is_conditional_branch(op) || is_switch(op);
+}
+
+SparseFixpointIterator::SparseFixpointIterator(
+    const cfg::ControlFlowGraph& cfg,
+    InstructionAnalyzer<ConstantEnvironment> insn_analyzer)
+    : m_cfg(cfg), m_insn_analyzer(insn_analyzer), m_reaching_defs(cfg) {
+  build_def_use_chains();
+}
+
+void SparseFixpointIterator::build_def_use_chains() {
+  m_reaching_defs.run(reaching_defs::Environment());
+  for (cfg::Block* block : m_cfg.blocks()) {
+    auto defs_in = m_reaching_defs.get_entry_state_at(block);
+    IRInstruction* previous = nullptr;
+    for (const auto& mie : InstructionIterable(block)) {
+      auto* insn = mie.insn;
+      auto op = insn->opcode();
+      m_block_of.emplace(insn, block);
+      if (insn->srcs_size() > 0) {
+        std::vector<Defs> src_defs;
+        src_defs.reserve(insn->srcs_size());
+        for (size_t i = 0; i < insn->srcs_size(); ++i) {
+          auto defs = defs_in.get(insn->src(i));
+          // An empty set stands for unknown definitions.
+          src_defs.push_back(defs.is_top() || defs.is_bottom()
+                                 ? Defs()
+                                 : defs.elements());
+          if (insn->dests_size() || is_terminator(op)) {
+            for (auto* def : src_defs.back()) {
+              m_users[def].push_back(insn);
+            }
+          }
+        }
+        m_src_defs.emplace(insn, std::move(src_defs));
+      }
+      if (is_move_result_any(op)) {
+        auto& primaries = m_primaries[insn];
+        if (previous != nullptr) {
+          primaries.push_back(previous);
+        } else {
+          // The primary instruction may end the preceding block.
+          for (auto* edge : block->preds()) {
+            auto last_it = edge->src()->get_last_insn();
+            if (last_it != edge->src()->end() &&
+                (last_it->insn->has_move_result() ||
+                 last_it->insn->has_move_result_pseudo())) {
+              primaries.push_back(last_it->insn);
+            }
+          }
+        }
+      }
+      m_reaching_defs.analyze_instruction(insn, &defs_in);
+      previous = insn;
+    }
+  }
+  // A move-result is evaluated together with its primary instruction, so it
+  // uses the operands of the latter.
+  for (const auto& pair : m_primaries) {
+    for (auto* primary : pair.second) {
+      auto it = m_src_defs.find(primary);
+      if (it == m_src_defs.end()) {
+        continue;
+      }
+      for (const auto& defs : it->second) {
+        for (auto* def : defs) {
+          m_users[def].push_back(pair.first);
+        }
+      }
+    }
+  }
+}
+
+void SparseFixpointIterator::run(const ConstantEnvironment& init) {
+  m_init = init;
+  m_values.clear();
+  m_executable_blocks.clear();
+  m_executable_edges.clear();
+  auto* entry = cfg::GraphInterface::entry(m_cfg);
+  m_executable_blocks.insert(entry);
+  m_block_worklist.push_back(entry);
+  while (!m_block_worklist.empty() || !m_insn_worklist.empty()) {
+    if (!m_block_worklist.empty()) {
+      auto* block = m_block_worklist.back();
+      m_block_worklist.pop_back();
+      TRACE(CONSTP, 5, "Analyzing block: %d\n", block->id());
+      for (const auto& mie : InstructionIterable(block)) {
+        evaluate(mie.insn);
+      }
+      evaluate_terminator(block);
+      continue;
+    }
+    auto* insn = m_insn_worklist.back();
+    m_insn_worklist.pop_back();
+    auto* block = m_block_of.at(insn);
+    if (m_executable_blocks.count(block) == 0) {
+      continue;
+    }
+    if (is_terminator(insn->opcode())) {
+      evaluate_terminator(block);
+    } else {
+      evaluate(insn);
+    }
+  }
+}
+
+bool SparseFixpointIterator::load_srcs(const IRInstruction* insn,
+                                       ConstantEnvironment* env) const {
+  auto it = m_src_defs.find(insn);
+  if (it == m_src_defs.end()) {
+    return true;
+  }
+  for (size_t i = 0; i < insn->srcs_size(); ++i) {
+    const auto& defs = it->second[i];
+    auto value =
+        defs.empty() ? ConstantValue::top() : ConstantValue::bottom();
+    for (auto* def : defs) {
+      value.join_with(get_value(def));
+    }
+    // None of the definitions has been reached yet.
+    if (value.is_bottom()) {
+      return false;
+    }
+    env->set(insn->src(i), value);
+  }
+  return true;
+}
+
+void SparseFixpointIterator::evaluate(const IRInstruction* insn) {
+  if (!insn->dests_size()) {
+    return;
+  }
+  auto value = ConstantValue::bottom();
+  if (is_move_result_any(insn->opcode())) {
+    for (auto* primary : m_primaries.at(insn)) {
+      if (m_executable_blocks.count(m_block_of.at(primary)) == 0) {
+        continue;
+      }
+      auto env = m_init;
+      if (!load_srcs(primary, &env)) {
+        continue;
+      }
+      analyze_instruction(primary, &env);
+      analyze_instruction(insn, &env);
+      value.join_with(env.get(insn->dest()));
+    }
+  } else {
+    auto env = m_init;
+    if (!load_srcs(insn, &env)) {
+      return;
+    }
+    analyze_instruction(insn, &env);
+    value = env.get(insn->dest());
+  }
+  if (value.is_bottom()) {
+    return;
+  }
+  auto it = m_values.find(insn);
+  if (it == m_values.end()) {
+    m_values.emplace(insn, value);
+  } else if (value.leq(it->second)) {
+    return;
+  } else {
+    // All the domains involved have a finite height, so joining is enough to
+    // converge.
+    it->second.join_with(value);
+  }
+  auto users = m_users.find(insn);
+  if (users != m_users.end()) {
+    m_insn_worklist.insert(
+        m_insn_worklist.end(), users->second.begin(), users->second.end());
+  }
+}
+
+void SparseFixpointIterator::evaluate_terminator(cfg::Block* block) {
+  auto last_it = block->get_last_insn();
+  if (last_it != block->end() && is_terminator(last_it->insn->opcode())) {
+    auto env = m_init;
+    if (!load_srcs(last_it->insn, &env)) {
+      return;
+    }
+    for (auto* edge : block->succs()) {
+      if (!refine_on_edge(edge, env).is_bottom()) {
+        mark_executable(edge);
+      }
+    }
+    return;
+  }
+  for (auto* edge : block->succs()) {
+    mark_executable(edge);
+  }
+}
+
+void SparseFixpointIterator::mark_executable(cfg::Edge* edge) {
+  if (!m_executable_edges.insert(edge).second) {
+    return;
+  }
+  auto* target = edge->target();
+  if (m_executable_blocks.insert(target).second) {
+    m_block_worklist.push_back(target);
+    return;
+  }
+  // The target is already being analyzed, but a move-result at its start may
+  // have gained a primary instruction.
+  auto first_it = target->get_first_insn();
+  if (first_it != target->end() &&
+      is_move_result_any(first_it->insn->opcode())) {
+    m_insn_worklist.push_back(first_it->insn);
+  }
+}
+
+ConstantValue SparseFixpointIterator::get_value(
+    const IRInstruction* def) const {
+  auto it = m_values.find(def);
+  return it == m_values.end() ? ConstantValue::bottom() : it->second;
+}
+
+ConstantEnvironment SparseFixpointIterator::get_entry_state_at(
+    cfg::Block* block) const {
+  if (m_executable_blocks.count(block) == 0) {
+    return ConstantEnvironment::bottom();
+  }
+  auto env = m_init;
+  auto defs_in = m_reaching_defs.get_entry_state_at(block);
+  if (defs_in.unwrap().is_value()) {
+    for (const auto& binding : defs_in.unwrap().bindings()) {
+      const auto& defs = binding.second;
+      auto value = ConstantValue::bottom();
+      if (!defs.is_top() && !defs.is_bottom()) {
+        for (auto* def : defs.elements()) {
+          value.join_with(get_value(def));
+        }
+      }
+      env.set(binding.first, value.is_bottom() ? ConstantValue::top() : value);
+    }
+  }
+  auto first_it = block->get_first_insn();
+  if (first_it != block->end() &&
+      is_move_result_any(first_it->insn->opcode())) {
+    auto value = get_value(first_it->insn);
+    env.set(RESULT_REGISTER, value.is_bottom() ? ConstantValue::top() : value);
+  }
+  return env;
+}
+
+ConstantEnvironment SparseFixpointIterator::analyze_edge(
+    cfg::Edge* const& edge,
+    const ConstantEnvironment& exit_state_at_source) const {
+  return refine_on_edge(edge, exit_state_at_source);
+}
+
+void SparseFixpointIterator::analyze_instruction(
+    const IRInstruction* insn, ConstantEnvironment* current_state) const {
+  TRACE(CONSTP, 5, "Analyzing instruction: %s\n", SHOW(insn));
+  m_insn_analyzer(insn, current_state);
+}
+
 } // namespace intraprocedural
 
 } // namespace constant_propagation
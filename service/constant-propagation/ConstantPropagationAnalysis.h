@@ -7,10 +7,14 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include "ConstantEnvironment.h"
 #include "IRCode.h"
 #include "InstructionAnalyzer.h"
 #include "MonotonicFixpointIterator.h"
+#include "ReachingDefinitions.h"
 
 namespace constant_propagation {
 
@@ -43,6 +47,94 @@ class FixpointIterator final
   InstructionAnalyzer<ConstantEnvironment> m_insn_analyzer;
 };
 
+/*
+ * Refines the state at the end of the source of `edge` with the outcome of
+ * the branch or switch that ends it. Returns bottom if the constants show the
+ * edge can't be taken.
+ */
+ConstantEnvironment refine_on_edge(
+    const cfg::Edge* edge, const ConstantEnvironment& exit_state_at_source);
+
+/*
+ * A sparse alternative to FixpointIterator. Instead of computing a whole
+ * environment at every block, it assigns a value to every definition and
+ * propagates changes along the def-use chains derived from reaching
+ * definitions, in the style of Wegman & Zadeck's sparse conditional constant
+ * propagation: a block is only considered once an edge into it has been found
+ * feasible, and an instruction is only re-evaluated when the value of one of
+ * its operands changes. This keeps large straight-line methods (such as
+ * generated <clinit>s) linear in practice.
+ *
+ * It exposes the same queries as FixpointIterator, so that the Transform can
+ * consume either. Since the values only live in registers, this is limited to
+ * analyzers that only read and write registers, like
+ * ConstantPrimitiveAnalyzer; the field and heap parts of the initial
+ * environment are passed through untouched. Also, the refinements that
+ * branches make on their operands (e.g. v0 == 0 in the true branch of an
+ * if-eqz v0) are used to prune edges but not propagated to the successors, so
+ * the results may be less precise than the dense analysis'.
+ */
+class SparseFixpointIterator final {
+ public:
+  SparseFixpointIterator(
+      const cfg::ControlFlowGraph& cfg,
+      InstructionAnalyzer<ConstantEnvironment> insn_analyzer);
+
+  void run(const ConstantEnvironment& init);
+
+  /*
+   * Rebuilds the environment at the entry of the block from the values of
+   * the definitions that reach it. Returns bottom for unreachable blocks.
+   */
+  ConstantEnvironment get_entry_state_at(cfg::Block* block) const;
+
+  ConstantEnvironment analyze_edge(
+      cfg::Edge* const& edge,
+      const ConstantEnvironment& exit_state_at_source) const;
+
+  void analyze_instruction(const IRInstruction* insn,
+                           ConstantEnvironment* current_state) const;
+
+  /*
+   * The value written by a definition, i.e. an instruction with a dest.
+   */
+  ConstantValue get_value(const IRInstruction* def) const;
+
+ private:
+  using Defs = sparta::PatriciaTreeSet<IRInstruction*>;
+
+  void build_def_use_chains();
+
+  // Loads the current values of the operands of `insn` into `env`. Returns
+  // false if one of them has no value yet.
+  bool load_srcs(const IRInstruction* insn, ConstantEnvironment* env) const;
+
+  void evaluate(const IRInstruction* insn);
+
+  void evaluate_terminator(cfg::Block* block);
+
+  void mark_executable(cfg::Edge* edge);
+
+  const cfg::ControlFlowGraph& m_cfg;
+  InstructionAnalyzer<ConstantEnvironment> m_insn_analyzer;
+  reaching_defs::FixpointIterator m_reaching_defs;
+  ConstantEnvironment m_init;
+  std::unordered_map<const IRInstruction*, cfg::Block*> m_block_of;
+  // The reaching definitions of each operand of an instruction.
+  std::unordered_map<const IRInstruction*, std::vector<Defs>> m_src_defs;
+  // The instructions that write RESULT_REGISTER before a move-result.
+  std::unordered_map<const IRInstruction*, std::vector<IRInstruction*>>
+      m_primaries;
+  // The instructions to re-evaluate when a definition changes.
+  std::unordered_map<const IRInstruction*, std::vector<const IRInstruction*>>
+      m_users;
+  std::unordered_map<const IRInstruction*, ConstantValue> m_values;
+  std::unordered_set<const cfg::Block*> m_executable_blocks;
+  std::unordered_set<const cfg::Edge*> m_executable_edges;
+  std::vector<cfg::Block*> m_block_worklist;
+  std::vector<const IRInstruction*> m_insn_worklist;
+};
+
 } // namespace intraprocedural
 
 /*
@@ -113,6 +205,9 @@ class LocalArrayAnalyzer final
 
   static bool analyze_aput(const IRInstruction* insn, ConstantEnvironment* env);
 
+  static bool analyze_array_length(const IRInstruction* insn,
+                                   ConstantEnvironment* env);
+
   static bool analyze_fill_array_data(const IRInstruction* insn,
                                       ConstantEnvironment* env);
 };
@@ -52,25 +52,34 @@ void set_fields_in_partition(const DexClass* cls,
 void analyze_clinits(const Scope& scope,
                      const interprocedural::FixpointIterator& fp_iter,
                      ConstantFieldPartition* field_partition) {
-  for (DexClass* cls : scope) {
-    auto& dmethods = cls->get_dmethods();
-    auto clinit = cls->get_clinit();
-    if (clinit == nullptr) {
-      // If there is no class initializer, then the initial field values are
-      // simply the DexEncodedValues.
-      ConstantEnvironment env;
-      set_encoded_values(cls, &env);
-      set_fields_in_partition(cls, env.get_field_environment(),
-                              FieldType::STATIC, field_partition);
-      continue;
-    }
-    IRCode* code = clinit->get_code();
-    auto& cfg = code->cfg();
-    auto intra_cp = fp_iter.get_intraprocedural_analysis(clinit);
-    auto env = intra_cp->get_exit_state_at(cfg.exit_block());
-    set_fields_in_partition(cls, env.get_field_environment(), FieldType::STATIC,
-                            field_partition);
-  }
+  // Each class only binds its own fields, so joining the partitions of the
+  // classes is the same as binding all the fields in a single partition.
+  field_partition->join_with(
+      walk::parallel::reduce_classes<ConstantFieldPartition>(
+          scope,
+          [&fp_iter](DexClass* cls) {
+            ConstantFieldPartition class_partition;
+            auto clinit = cls->get_clinit();
+            if (clinit == nullptr) {
+              // If there is no class initializer, then the initial field
+              // values are simply the DexEncodedValues.
+              ConstantEnvironment env;
+              set_encoded_values(cls, &env);
+              set_fields_in_partition(cls, env.get_field_environment(),
+                                      FieldType::STATIC, &class_partition);
+              return class_partition;
+            }
+            IRCode* code = clinit->get_code();
+            auto& cfg = code->cfg();
+            auto intra_cp = fp_iter.get_intraprocedural_analysis(clinit);
+            auto env = intra_cp->get_exit_state_at(cfg.exit_block());
+            set_fields_in_partition(cls, env.get_field_environment(),
+                                    FieldType::STATIC, &class_partition);
+            return class_partition;
+          },
+          [](ConstantFieldPartition& acc, ConstantFieldPartition&& other) {
+            acc.join_with(other);
+          }));
 }
 
 bool analyze_gets_helper(const WholeProgramState* whole_program_state,
@@ -144,28 +153,44 @@ WholeProgramState::WholeProgramState(
 /*
  * Walk over the entire program, doing a join over the values written to each
  * field, as well as a join over the values returned by each method.
+ *
+ * The methods are walked in parallel, each thread joining into partitions of
+ * its own, which are joined into ours at the end. Since the partitions start
+ * at Bottom and Join is associative and commutative, this gives the same
+ * result as joining one method at a time.
  */
 void WholeProgramState::collect(
     const Scope& scope, const interprocedural::FixpointIterator& fp_iter) {
   initialize_ifields(scope, &m_field_partition);
-  walk::methods(scope, [&](DexMethod* method) {
-    IRCode* code = method->get_code();
-    if (code == nullptr) {
-      return;
-    }
-    auto& cfg = code->cfg();
-    auto intra_cp = fp_iter.get_intraprocedural_analysis(method);
-    for (cfg::Block* b : cfg.blocks()) {
-      auto env = intra_cp->get_entry_state_at(b);
-      for (auto& mie : InstructionIterable(b)) {
-        auto* insn = mie.insn;
-        intra_cp->analyze_instruction(insn, &env);
-        collect_field_values(insn, env,
-                             is_clinit(method) ? method->get_class() : nullptr);
-        collect_return_values(insn, env, method);
-      }
-    }
-  });
+  using Partitions = std::pair<ConstantFieldPartition, ConstantMethodPartition>;
+  auto partitions = walk::parallel::reduce_methods<Partitions>(
+      scope,
+      [&](DexMethod* method) {
+        Partitions partitions;
+        IRCode* code = method->get_code();
+        if (code == nullptr) {
+          return partitions;
+        }
+        auto& cfg = code->cfg();
+        auto intra_cp = fp_iter.get_intraprocedural_analysis(method);
+        auto clinit_cls = is_clinit(method) ? method->get_class() : nullptr;
+        for (cfg::Block* b : cfg.blocks()) {
+          auto env = intra_cp->get_entry_state_at(b);
+          for (auto& mie : InstructionIterable(b)) {
+            auto* insn = mie.insn;
+            intra_cp->analyze_instruction(insn, &env);
+            collect_field_values(insn, env, clinit_cls, &partitions.first);
+            collect_return_values(insn, env, method, &partitions.second);
+          }
+        }
+        return partitions;
+      },
+      [](Partitions& acc, Partitions&& other) {
+        acc.first.join_with(other.first);
+        acc.second.join_with(other.second);
+      });
+  m_field_partition.join_with(partitions.first);
+  m_method_partition.join_with(partitions.second);
 }
 
 /*
@@ -177,9 +202,11 @@ void WholeProgramState::collect(
  * visible to other methods if it remains unchanged up until the end of the
  * <clinit>. In that case, analyze_clinits() will record it.
  */
-void WholeProgramState::collect_field_values(const IRInstruction* insn,
-                                             const ConstantEnvironment& env,
-                                             const DexType* clinit_cls) {
+void WholeProgramState::collect_field_values(
+    const IRInstruction* insn,
+    const ConstantEnvironment& env,
+    const DexType* clinit_cls,
+    ConstantFieldPartition* field_partition) const {
   if (!is_sput(insn->opcode()) && !is_iput(insn->opcode())) {
     return;
   }
@@ -189,7 +216,7 @@ void WholeProgramState::collect_field_values(const IRInstruction* insn,
       return;
     }
     auto value = env.get(insn->src(0));
-    m_field_partition.update(field, [&value](auto* current_value) {
+    field_partition->update(field, [&value](auto* current_value) {
       current_value->join_with(value);
     });
   }
@@ -201,9 +228,11 @@ void WholeProgramState::collect_field_values(const IRInstruction* insn,
  * If there are no reachable return opcodes in the method, then it never
  * returns. Its return value will be represented by Bottom in our analysis.
  */
-void WholeProgramState::collect_return_values(const IRInstruction* insn,
-                                              const ConstantEnvironment& env,
-                                              const DexMethod* method) {
+void WholeProgramState::collect_return_values(
+    const IRInstruction* insn,
+    const ConstantEnvironment& env,
+    const DexMethod* method,
+    ConstantMethodPartition* method_partition) const {
   auto op = insn->opcode();
   if (!is_return(op)) {
     return;
@@ -213,12 +242,12 @@ void WholeProgramState::collect_return_values(const IRInstruction* insn,
     // does indeed return -- even though `void` is not actually a return value,
     // this tells us that the code following any invoke of this method is
     // reachable.
-    m_method_partition.update(
+    method_partition->update(
         method, [](auto* current_value) { current_value->set_to_top(); });
     return;
   }
   auto value = env.get(insn->src(0));
-  m_method_partition.update(method, [&value](auto* current_value) {
+  method_partition->update(method, [&value](auto* current_value) {
     current_value->join_with(value);
   });
 }
@@ -110,11 +110,13 @@ class WholeProgramState {
 
   void collect_field_values(const IRInstruction* insn,
                             const ConstantEnvironment& env,
-                            const DexType* clinit_cls);
+                            const DexType* clinit_cls,
+                            ConstantFieldPartition* field_partition) const;
 
   void collect_return_values(const IRInstruction* insn,
                              const ConstantEnvironment& env,
-                             const DexMethod* method);
+                             const DexMethod* method,
+                             ConstantMethodPartition* method_partition) const;
 
   // Unknown fields and methods will be treated as containing / returning Top.
   std::unordered_set<const DexField*> m_known_fields;
@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+#include <boost/optional.hpp>
+
+#include "AbstractDomain.h"
+
+/*
+ * The integers in [lower_bound(), upper_bound()]. A side that is unbounded is
+ * represented by the smallest or the largest int64_t, so that Top is the
+ * interval of all the values a register may hold.
+ *
+ * Widening drops the bounds that are still moving, so that loop counters
+ * converge without iterating over their whole range.
+ */
+class IntervalDomain final : public sparta::AbstractDomain<IntervalDomain> {
+ public:
+  static constexpr int64_t MIN = std::numeric_limits<int64_t>::min();
+  static constexpr int64_t MAX = std::numeric_limits<int64_t>::max();
+
+  // Top.
+  IntervalDomain() = default;
+
+  IntervalDomain(int64_t lower, int64_t upper)
+      : m_lower(lower), m_upper(upper) {
+    if (lower > upper) {
+      set_to_bottom();
+    }
+  }
+
+  explicit IntervalDomain(int64_t value) : IntervalDomain(value, value) {}
+
+  static IntervalDomain at_least(int64_t lower) {
+    return IntervalDomain(lower, MAX);
+  }
+
+  static IntervalDomain at_most(int64_t upper) {
+    return IntervalDomain(MIN, upper);
+  }
+
+  // The values of a Java int.
+  static IntervalDomain int32() {
+    return IntervalDomain(std::numeric_limits<int32_t>::min(),
+                          std::numeric_limits<int32_t>::max());
+  }
+
+  int64_t lower_bound() const { return m_lower; }
+
+  int64_t upper_bound() const { return m_upper; }
+
+  boost::optional<int64_t> get_constant() const {
+    if (is_bottom() || m_lower != m_upper) {
+      return boost::none;
+    }
+    return m_lower;
+  }
+
+  bool contains(int64_t value) const {
+    return m_lower <= value && value <= m_upper;
+  }
+
+  // Whether both bounds are those of a Java int, so that the arithmetic on
+  // them can't overflow an int64_t.
+  bool is_int32() const { return !is_bottom() && int32().contains_all(*this); }
+
+  bool is_bottom() const override { return m_lower > m_upper; }
+
+  bool is_top() const override { return m_lower == MIN && m_upper == MAX; }
+
+  bool leq(const IntervalDomain& other) const override {
+    if (is_bottom()) {
+      return true;
+    }
+    return other.contains_all(*this);
+  }
+
+  bool equals(const IntervalDomain& other) const override {
+    if (is_bottom()) {
+      return other.is_bottom();
+    }
+    return m_lower == other.m_lower && m_upper == other.m_upper;
+  }
+
+  void set_to_bottom() override {
+    m_lower = MAX;
+    m_upper = MIN;
+  }
+
+  void set_to_top() override {
+    m_lower = MIN;
+    m_upper = MAX;
+  }
+
+  void join_with(const IntervalDomain& other) override {
+    if (other.is_bottom()) {
+      return;
+    }
+    if (is_bottom()) {
+      *this = other;
+      return;
+    }
+    m_lower = std::min(m_lower, other.m_lower);
+    m_upper = std::max(m_upper, other.m_upper);
+  }
+
+  void widen_with(const IntervalDomain& other) override {
+    if (other.is_bottom()) {
+      return;
+    }
+    if (is_bottom()) {
+      *this = other;
+      return;
+    }
+    if (other.m_lower < m_lower) {
+      m_lower = MIN;
+    }
+    if (other.m_upper > m_upper) {
+      m_upper = MAX;
+    }
+  }
+
+  void meet_with(const IntervalDomain& other) override {
+    if (is_bottom()) {
+      return;
+    }
+    if (other.is_bottom()) {
+      set_to_bottom();
+      return;
+    }
+    m_lower = std::max(m_lower, other.m_lower);
+    m_upper = std::min(m_upper, other.m_upper);
+    if (m_lower > m_upper) {
+      set_to_bottom();
+    }
+  }
+
+  // Only refines the unbounded sides, so that descending chains are finite.
+  void narrow_with(const IntervalDomain& other) override {
+    if (is_bottom()) {
+      return;
+    }
+    if (other.is_bottom()) {
+      set_to_bottom();
+      return;
+    }
+    if (m_lower == MIN) {
+      m_lower = other.m_lower;
+    }
+    if (m_upper == MAX) {
+      m_upper = other.m_upper;
+    }
+    if (m_lower > m_upper) {
+      set_to_bottom();
+    }
+  }
+
+  friend std::ostream& operator<<(std::ostream& o,
+                                  const IntervalDomain& interval) {
+    if (interval.is_bottom()) {
+      return o << "_|_";
+    }
+    o << "[";
+    if (interval.m_lower == MIN) {
+      o << "-oo";
+    } else {
+      o << interval.m_lower;
+    }
+    o << ", ";
+    if (interval.m_upper == MAX) {
+      o << "+oo";
+    } else {
+      o << interval.m_upper;
+    }
+    return o << "]";
+  }
+
+ private:
+  bool contains_all(const IntervalDomain& other) const {
+    return m_lower <= other.m_lower && other.m_upper <= m_upper;
+  }
+
+  int64_t m_lower{MIN};
+  int64_t m_upper{MAX};
+};
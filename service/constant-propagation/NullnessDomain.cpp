@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "NullnessDomain.h"
+
+#include "Debug.h"
+
+namespace nullness {
+
+/*
+ *            ALL
+ *          /     \
+ *     IS_NULL  NOT_NULL
+ *          \     /
+ *           EMPTY
+ */
+
+Lattice lattice({Nullness::EMPTY, Nullness::IS_NULL, Nullness::NOT_NULL,
+                 Nullness::ALL},
+                {{Nullness::EMPTY, Nullness::IS_NULL},
+                 {Nullness::EMPTY, Nullness::NOT_NULL},
+                 {Nullness::IS_NULL, Nullness::ALL},
+                 {Nullness::NOT_NULL, Nullness::ALL}});
+
+std::ostream& operator<<(std::ostream& os, Nullness nullness) {
+  switch (nullness) {
+  case Nullness::EMPTY:
+    os << "EMPTY";
+    return os;
+  case Nullness::IS_NULL:
+    os << "IS_NULL";
+    return os;
+  case Nullness::NOT_NULL:
+    os << "NOT_NULL";
+    return os;
+  case Nullness::ALL:
+    os << "ALL";
+    return os;
+  case Nullness::SIZE:
+    not_reached();
+  }
+}
+
+std::ostream& operator<<(std::ostream& os, Domain domain) {
+  os << domain.element();
+  return os;
+}
+
+} // namespace nullness
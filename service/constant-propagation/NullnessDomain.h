@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/functional/hash.hpp>
+
+#include "FiniteAbstractDomain.h"
+
+/*
+ * This module deals with whether a reference may be null. A primitive value
+ * is null when it is zero, so that the domain also models the operand of an
+ * if-eqz or if-nez, whatever its type.
+ */
+namespace nullness {
+
+enum class Nullness {
+  EMPTY, // Bottom type
+  IS_NULL,
+  NOT_NULL,
+  ALL, // Top type
+
+  SIZE // The number of items in Nullness
+};
+
+using Lattice = sparta::BitVectorLattice<Nullness,
+                                         static_cast<size_t>(Nullness::SIZE),
+                                         boost::hash<Nullness>>;
+
+extern Lattice lattice;
+
+using Domain = sparta::
+    FiniteAbstractDomain<Nullness, Lattice, Lattice::Encoding, &lattice>;
+
+std::ostream& operator<<(std::ostream&, Nullness);
+
+std::ostream& operator<<(std::ostream&, Domain);
+
+} // namespace nullness
@@ -8,10 +8,15 @@
 #pragma once
 
 #include "BaseIRAnalyzer.h"
+#include "BitVectorSetAbstractDomain.h"
 #include "ControlFlow.h"
-#include "PatriciaTreeSetAbstractDomain.h"
 
-using LivenessDomain = sparta::PatriciaTreeSetAbstractDomain<uint16_t>;
+/*
+ * Live registers are a dense set over a small universe, so they are stored as
+ * a bit vector. LivenessDomain(n) is an empty set with room for registers 0 to
+ * n - 1.
+ */
+using LivenessDomain = sparta::BitVectorSetAbstractDomain<uint16_t>;
 
 class LivenessFixpointIterator final
     : public ir_analyzer::BaseBackwardsIRAnalyzer<LivenessDomain> {
@@ -15,6 +15,7 @@
 #include "DexClass.h"
 #include "PatriciaTreeMapAbstractEnvironment.h"
 #include "PatriciaTreeSetAbstractDomain.h"
+#include "RegisterArrayEnvironment.h"
 
 namespace reaching_defs {
 
@@ -39,24 +40,40 @@ class Domain final : public sparta::AbstractDomainReverseAdaptor<
   }
 };
 
-class Environment final
+/*
+ * The register environment is a template parameter so that analyses can trade
+ * the PatriciaTreeMapAbstractEnvironment default for a
+ * sparta::RegisterArrayEnvironment on methods with many live registers.
+ */
+template <class RegisterEnvironment>
+class EnvironmentImpl final
     : public sparta::AbstractDomainReverseAdaptor<
-          sparta::PatriciaTreeMapAbstractEnvironment<reg_t, Domain>,
-          Environment> {
+          RegisterEnvironment,
+          EnvironmentImpl<RegisterEnvironment>> {
  public:
-  using AbstractDomainReverseAdaptor::AbstractDomainReverseAdaptor;
+  using sparta::AbstractDomainReverseAdaptor<
+      RegisterEnvironment,
+      EnvironmentImpl<RegisterEnvironment>>::AbstractDomainReverseAdaptor;
 
-  Domain get(reg_t reg) { return unwrap().get(reg); }
+  Domain get(reg_t reg) { return this->unwrap().get(reg); }
 
-  Environment& set(reg_t reg, const Domain& value) {
-    unwrap().set(reg, value);
+  EnvironmentImpl& set(reg_t reg, const Domain& value) {
+    this->unwrap().set(reg, value);
     return *this;
   }
 };
 
-class FixpointIterator final : public ir_analyzer::BaseIRAnalyzer<Environment> {
+using Environment =
+    EnvironmentImpl<sparta::PatriciaTreeMapAbstractEnvironment<reg_t, Domain>>;
+
+using ArrayEnvironment =
+    EnvironmentImpl<sparta::RegisterArrayEnvironment<reg_t, Domain>>;
+
+template <class Environment>
+class FixpointIteratorImpl final
+    : public ir_analyzer::BaseIRAnalyzer<Environment> {
  public:
-  explicit FixpointIterator(const cfg::ControlFlowGraph& cfg)
+  explicit FixpointIteratorImpl(const cfg::ControlFlowGraph& cfg)
       : ir_analyzer::BaseIRAnalyzer<Environment>(cfg) {}
 
   void analyze_instruction(IRInstruction* insn,
@@ -68,4 +85,6 @@ class FixpointIterator final : public ir_analyzer::BaseIRAnalyzer<Environment> {
   }
 };
 
+using FixpointIterator = FixpointIteratorImpl<Environment>;
+
 } // namespace reaching_defs
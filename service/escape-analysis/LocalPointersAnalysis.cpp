@@ -7,10 +7,9 @@
 
 #include "LocalPointersAnalysis.h"
 
+#include "BottomUpScheduler.h"
 #include "DexUtil.h"
-#include "PatriciaTreeSet.h"
 #include "Resolver.h"
-#include "Walkers.h"
 #include "WorkQueue.h"
 
 using namespace local_pointers;
@@ -381,25 +380,23 @@ void FixpointIteratorMapDeleter::operator()(FixpointIteratorMap* map) {
   wq.run_all();
 }
 
-static void analyze_method_recursive(
-    const DexMethod* method,
-    const call_graph::Graph& call_graph,
-    sparta::PatriciaTreeSet<const DexMethodRef*> visiting,
-    FixpointIteratorMap* fp_iter_map,
-    SummaryCMap* summary_map) {
-  if (summary_map->count(method) != 0 || visiting.contains(method) ||
-      method->get_code() == nullptr) {
+/*
+ * Analyze :method, whose callees have already been analyzed unless they are
+ * part of the same SCC of the call graph.
+ */
+static void analyze_method(const DexMethod* method,
+                           const call_graph::Graph& call_graph,
+                           FixpointIteratorMap* fp_iter_map,
+                           SummaryCMap* summary_map) {
+  if (summary_map->count(method) != 0) {
     return;
   }
-  visiting.insert(method);
 
   std::unordered_map<const IRInstruction*, EscapeSummary> invoke_to_summary_map;
   if (call_graph.has_node(method)) {
     const auto& callee_edges = call_graph.node(method).callees();
     for (const auto& edge : callee_edges) {
       auto* callee = edge->callee();
-      analyze_method_recursive(
-          callee, call_graph, visiting, fp_iter_map, summary_map);
       if (summary_map->count(callee) != 0) {
         invoke_to_summary_map.emplace(edge->invoke_iterator()->insn,
                                       summary_map->at(callee));
@@ -426,11 +423,10 @@ FixpointIteratorMapPtr analyze_scope(const Scope& scope,
   summary_map_ptr->emplace(
       DexMethod::get_method("Ljava/lang/Object;.<init>:()V"), EscapeSummary{});
 
-  walk::parallel::code(scope, [&](const DexMethod* method, IRCode& code) {
-    sparta::PatriciaTreeSet<const DexMethodRef*> visiting;
-    analyze_method_recursive(method, call_graph, visiting, fp_iter_map.get(),
-                             summary_map_ptr);
-  });
+  call_graph::parallel_bottom_up(
+      scope, call_graph, [&](const DexMethod* method) {
+        analyze_method(method, call_graph, fp_iter_map.get(), summary_map_ptr);
+      });
   return fp_iter_map;
 }
 
@@ -7,48 +7,51 @@
 
 #include "MethodDedup.h"
 
+#include <boost/functional/hash.hpp>
+
+#include "CodeFingerprint.h"
+#include "ConcurrentContainers.h"
 #include "IRCode.h"
 #include "MethodReference.h"
+#include "WorkQueue.h"
 
 namespace {
 
-struct CodeAsKey {
-  IRCode* code;
-
-  explicit CodeAsKey(IRCode* c) : code(c) {}
+// Methods with the same signature and the same code fingerprint. Code that is
+// structurally equal always ends up in the same bucket.
+using BucketKey = std::pair<const DexProto*, CodeFingerprint>;
 
-  bool operator==(const CodeAsKey& other) const {
-    return code->structural_equals(*other.code);
+struct BucketKeyHash {
+  size_t operator()(const BucketKey& key) const {
+    size_t seed = 0;
+    boost::hash_combine(seed, key.first);
+    boost::hash_combine(seed, key.second);
+    return seed;
   }
 };
 
-struct CodeHasher {
-  size_t operator()(const CodeAsKey& key) const {
-    size_t result = 0;
-    for (auto& mie : InstructionIterable(key.code)) {
-      result ^= mie.insn->hash();
+using Buckets =
+    ConcurrentMap<BucketKey, std::vector<DexMethod*>, BucketKeyHash>;
+
+// Splits a bucket into the groups of methods whose code is actually equal.
+// Fingerprint collisions are rare, so this usually compares every method
+// against a single representative.
+std::vector<MethodOrderedSet> split_bucket(std::vector<DexMethod*> bucket) {
+  std::sort(bucket.begin(), bucket.end(), dexmethods_comparator());
+  std::vector<MethodOrderedSet> groups;
+  for (auto method : bucket) {
+    auto code = method->get_code();
+    auto it = std::find_if(
+        groups.begin(), groups.end(), [code](const MethodOrderedSet& group) {
+          return code->structural_equals(*(*group.begin())->get_code());
+        });
+    if (it == groups.end()) {
+      groups.emplace_back();
+      it = std::prev(groups.end());
     }
-    return result;
-  }
-};
-
-using DuplicateMethods =
-    std::unordered_map<CodeAsKey, MethodOrderedSet, CodeHasher>;
-
-std::vector<MethodOrderedSet> get_duplicate_methods_simple(
-    const MethodOrderedSet& methods) {
-  DuplicateMethods duplicates;
-  for (DexMethod* method : methods) {
-    always_assert(method->get_code());
-    duplicates[CodeAsKey(method->get_code())].emplace(method);
+    it->emplace(method);
   }
-
-  std::vector<MethodOrderedSet> result;
-  for (auto& duplicate : duplicates) {
-    result.push_back(std::move(duplicate.second));
-  }
-
-  return result;
+  return groups;
 }
 
 } // namespace
@@ -86,17 +89,46 @@ std::vector<MethodOrderedSet> group_similar_methods(
 
 std::vector<MethodOrderedSet> group_identical_methods(
     const std::vector<DexMethod*>& methods) {
-  std::vector<MethodOrderedSet> result;
-  std::vector<MethodOrderedSet> same_protos = group_similar_methods(methods);
-
-  // Find actual duplicates.
-  for (const auto& same_proto : same_protos) {
-    std::vector<MethodOrderedSet> duplicates =
-        get_duplicate_methods_simple(same_proto);
+  Buckets buckets;
+  auto bucket_wq = workqueue_foreach<DexMethod*>([&](DexMethod* method) {
+    always_assert(method->get_code());
+    BucketKey key(method->get_proto(),
+                  code_fingerprint::compute(*method->get_code()));
+    buckets.update(key,
+                   [method](const BucketKey&,
+                            std::vector<DexMethod*>& bucket,
+                            bool /* exists */) { bucket.push_back(method); });
+  });
+  for (auto method : methods) {
+    bucket_wq.add_item(method);
+  }
+  bucket_wq.run_all();
 
-    result.insert(result.end(), duplicates.begin(), duplicates.end());
+  std::vector<std::vector<DexMethod*>> bucket_list;
+  bucket_list.reserve(buckets.size());
+  for (auto& pair : buckets) {
+    bucket_list.push_back(std::move(pair.second));
   }
+  // Each task only writes its own slot.
+  std::vector<std::vector<MethodOrderedSet>> split(bucket_list.size());
+  auto split_wq = workqueue_foreach<size_t>(
+      [&](size_t i) { split[i] = split_bucket(std::move(bucket_list[i])); });
+  for (size_t i = 0; i < split.size(); ++i) {
+    split_wq.add_item(i);
+  }
+  split_wq.run_all();
 
+  std::vector<MethodOrderedSet> result;
+  for (auto& groups : split) {
+    for (auto& group : groups) {
+      result.push_back(std::move(group));
+    }
+  }
+  // Keep the output independent of pointer values and scheduling.
+  std::sort(result.begin(), result.end(),
+            [](const MethodOrderedSet& a, const MethodOrderedSet& b) {
+              return dexmethods_comparator()(*a.begin(), *b.begin());
+            });
   return result;
 }
 
@@ -104,8 +136,13 @@ bool are_methods_identical(const std::vector<DexMethod*>& methods) {
   return group_identical_methods(methods).size() == 1;
 }
 
+/*
+ * Dedups one round of `to_dedup`, queueing every duplicate in `updater`. Only
+ * the calls in the code of the replacements are updated, since that is all the
+ * next round compares; the rest of the scope gets updated once at the end.
+ */
 size_t dedup_methods_helper(
-    const Scope& scope,
+    method_reference::CallRefsUpdater* updater,
     const std::vector<DexMethod*>& to_dedup,
     std::vector<DexMethod*>& replacements,
     boost::optional<std::unordered_map<DexMethod*, MethodOrderedSet>>&
@@ -116,11 +153,13 @@ size_t dedup_methods_helper(
   }
   size_t dedup_count = 0;
   auto grouped_methods = group_identical_methods(to_dedup);
-  std::unordered_map<DexMethod*, DexMethod*> duplicates_to_replacement;
+  std::unordered_map<DexMethod*, DexMethod*> round_duplicates;
   for (auto& group : grouped_methods) {
     auto replacement = *group.begin();
     for (auto m : group) {
-      duplicates_to_replacement[m] = replacement;
+      if (m != replacement) {
+        round_duplicates[m] = replacement;
+      }
       // Update dedup map
       if (new_to_old == boost::none) {
         continue;
@@ -148,7 +187,15 @@ size_t dedup_methods_helper(
             SHOW(replacement));
     }
   }
-  method_reference::update_call_refs_simple(scope, duplicates_to_replacement);
+  if (round_duplicates.empty()) {
+    return 0;
+  }
+  method_reference::CallRefsUpdater round_updater;
+  round_updater.add(round_duplicates);
+  round_updater.apply_to(replacements);
+  // Earlier duplicates whose replacement just got deduped follow the chain to
+  // the new replacement.
+  updater->add(round_duplicates);
   return dedup_count;
 }
 
@@ -157,16 +204,23 @@ size_t dedup_methods(
     const std::vector<DexMethod*>& to_dedup,
     std::vector<DexMethod*>& replacements,
     boost::optional<std::unordered_map<DexMethod*, MethodOrderedSet>>&
-        new_to_old) {
+        new_to_old,
+    method_reference::CallRefsUpdater* deferred) {
   size_t total_dedup_count = 0;
+  if (deferred != nullptr) {
+    // Rewrites queued by earlier calls may make more of `to_dedup` identical.
+    deferred->apply_to(to_dedup);
+  }
+  method_reference::CallRefsUpdater local_updater;
+  auto updater = deferred != nullptr ? deferred : &local_updater;
   auto to_dedup_temp = to_dedup;
   while (true) {
     TRACE(METH_DEDUP,
           8,
           "dedup: static|non_virt input %d\n",
           to_dedup_temp.size());
-    size_t dedup_count =
-        dedup_methods_helper(scope, to_dedup_temp, replacements, new_to_old);
+    size_t dedup_count = dedup_methods_helper(
+        updater, to_dedup_temp, replacements, new_to_old);
     total_dedup_count += dedup_count;
     TRACE(METH_DEDUP, 8, "dedup: static|non_virt dedupped %d\n", dedup_count);
     if (dedup_count == 0) {
@@ -175,6 +229,9 @@ size_t dedup_methods(
     to_dedup_temp = replacements;
     replacements = {};
   }
+  if (deferred == nullptr) {
+    local_updater.apply(scope);
+  }
   return total_dedup_count;
 }
 
@@ -11,6 +11,7 @@
 #include <set>
 
 #include "DexClass.h"
+#include "MethodReference.h"
 
 using MethodOrderedSet = std::set<DexMethod*, dexmethods_comparator>;
 
@@ -46,12 +47,16 @@ bool are_methods_identical(const std::vector<DexMethod*>&);
  * We do so by grouping identical methods, choosing the first one in each group
  * as its canonical replacement and update all call sites to point to their
  * canonical replacement.
+ * If `deferred` is given, the call sites outside of `to_dedup` are not updated;
+ * the duplicates are queued in it instead, so that callers deduping many
+ * batches can update the whole scope once.
  */
 size_t dedup_methods(
     const Scope& scope,
     const std::vector<DexMethod*>& to_dedup,
     std::vector<DexMethod*>& replacements,
     boost::optional<std::unordered_map<DexMethod*, MethodOrderedSet>>&
-        new_to_old);
+        new_to_old,
+    method_reference::CallRefsUpdater* deferred = nullptr);
 
 } // namespace method_dedup
@@ -163,7 +163,11 @@ void run_inliner(DexStoresVector& stores,
 
   // keep a map from refs to defs or nullptr if no method was found
   MethodRefCache resolved_refs;
-  auto resolver = [&resolved_refs](DexMethodRef* method, MethodSearch search) {
+  ConcurrentMethodRefCache concurrent_resolved_refs;
+  auto resolver = [&](DexMethodRef* method, MethodSearch search) {
+    if (inliner_config.parallel) {
+      return resolve_method(method, search, concurrent_resolved_refs);
+    }
     return resolve_method(method, search, resolved_refs);
   };
   if (inliner_config.use_cfg_inliner) {
@@ -187,34 +191,34 @@ void run_inliner(DexStoresVector& stores,
   size_t inlined_count = inlined.size();
   size_t deleted = delete_methods(scope, inlined, resolver);
 
-  TRACE(INLINE, 3, "recursive %ld\n", inliner.get_info().recursive);
-  TRACE(INLINE, 3, "blacklisted meths %ld\n", inliner.get_info().blacklisted);
-  TRACE(INLINE, 3, "virtualizing methods %ld\n",
-        inliner.get_info().need_vmethod);
-  TRACE(INLINE, 3, "invoke super %ld\n", inliner.get_info().invoke_super);
-  TRACE(INLINE, 3, "override inputs %ld\n", inliner.get_info().write_over_ins);
-  TRACE(INLINE, 3, "escaped virtual %ld\n", inliner.get_info().escaped_virtual);
+  const auto& info = inliner.get_info();
+  TRACE(INLINE, 3, "recursive %ld\n", info.recursive.load());
+  TRACE(INLINE, 3, "blacklisted meths %ld\n", info.blacklisted.load());
+  TRACE(INLINE, 3, "virtualizing methods %ld\n", info.need_vmethod.load());
+  TRACE(INLINE, 3, "invoke super %ld\n", info.invoke_super.load());
+  TRACE(INLINE, 3, "override inputs %ld\n", info.write_over_ins.load());
+  TRACE(INLINE, 3, "escaped virtual %ld\n", info.escaped_virtual.load());
   TRACE(INLINE, 3, "known non public virtual %ld\n",
-        inliner.get_info().non_pub_virtual);
-  TRACE(INLINE, 3, "non public ctor %ld\n", inliner.get_info().non_pub_ctor);
-  TRACE(INLINE, 3, "unknown field %ld\n", inliner.get_info().escaped_field);
-  TRACE(INLINE, 3, "non public field %ld\n", inliner.get_info().non_pub_field);
-  TRACE(INLINE, 3, "throws %ld\n", inliner.get_info().throws);
-  TRACE(INLINE, 3, "multiple returns %ld\n", inliner.get_info().multi_ret);
-  TRACE(INLINE, 3, "references cross stores %ld\n",
-        inliner.get_info().cross_store);
-  TRACE(INLINE, 3, "not found %ld\n", inliner.get_info().not_found);
-  TRACE(INLINE, 3, "caller too large %ld\n",
-        inliner.get_info().caller_too_large);
+        info.non_pub_virtual.load());
+  TRACE(INLINE, 3, "non public ctor %ld\n", info.non_pub_ctor.load());
+  TRACE(INLINE, 3, "unknown field %ld\n", info.escaped_field.load());
+  TRACE(INLINE, 3, "non public field %ld\n", info.non_pub_field.load());
+  TRACE(INLINE, 3, "throws %ld\n", info.throws.load());
+  TRACE(INLINE, 3, "multiple returns %ld\n", info.multi_ret.load());
+  TRACE(INLINE, 3, "references cross stores %ld\n", info.cross_store.load());
+  TRACE(INLINE, 3, "not found %ld\n", info.not_found.load());
+  TRACE(INLINE, 3, "caller too large %ld\n", info.caller_too_large.load());
+  TRACE(INLINE, 3, "register pressure %ld\n", info.register_pressure.load());
   TRACE(INLINE, 1,
         "%ld inlined calls over %ld methods and %ld methods removed\n",
-        inliner.get_info().calls_inlined, inlined_count, deleted);
+        info.calls_inlined.load(), inlined_count, deleted);
 
-  mgr.incr_metric("calls_inlined", inliner.get_info().calls_inlined);
+  mgr.incr_metric("calls_inlined", info.calls_inlined);
   mgr.incr_metric("methods_removed", deleted);
-  mgr.incr_metric("escaped_virtual", inliner.get_info().escaped_virtual);
-  mgr.incr_metric("unresolved_methods", inliner.get_info().unresolved_methods);
-  mgr.incr_metric("known_public_methods",
-                  inliner.get_info().known_public_methods);
+  mgr.incr_metric("escaped_virtual", info.escaped_virtual);
+  mgr.incr_metric("unresolved_methods", info.unresolved_methods);
+  mgr.incr_metric("known_public_methods", info.known_public_methods);
+  mgr.incr_metric("calls_blocked_by_register_pressure",
+                  info.register_pressure);
 }
 } // namespace inliner
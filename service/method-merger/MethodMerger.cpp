@@ -69,45 +69,15 @@ class RefCounter {
   std::unordered_map<DexMethod*, uint32_t> m_counter;
 };
 
-void create_one_dispatch(
-    const std::map<SwitchIndices, DexMethod*>& indices_to_callee,
-    uint32_t min_size,
-    std::unordered_map<DexMethod*, method_reference::NewCallee>* old_to_new,
-    method_merger::Stats* stats) {
-  if (indices_to_callee.size() < min_size) {
-    return;
-  }
-  auto first_method = indices_to_callee.begin()->second;
-  auto method = dispatch::create_simple_dispatch(indices_to_callee);
-  always_assert_log(method != nullptr, "Dispatch null for %s\n",
-                    SHOW(first_method));
-  auto cls = type_class(first_method->get_class());
-  cls->add_method(method);
-  for (auto& id_meth : indices_to_callee) {
-    uint32_t tag = *id_meth.first.begin();
-    method_reference::NewCallee new_callee(method, tag);
-    old_to_new->emplace(id_meth.second, std::move(new_callee));
-  }
-  // Record stats: number of merged methods - number of dispatches.
-  uint32_t merged_size = indices_to_callee.size() - 1;
-  if (first_method->is_virtual()) {
-    stats->num_merged_nonvirt_methods += merged_size;
-  } else if (is_static(first_method)) {
-    stats->num_merged_static_methods += merged_size;
-  } else {
-    stats->num_merged_direct_methods += merged_size;
-  }
-}
+using DispatchGroup = std::map<SwitchIndices, DexMethod*>;
 
 /**
- * Generate dispatches for the methods, then update old_to_new mapping and
- * update stats.
+ * Plan the dispatches for the methods: groups of methods with the same proto,
+ * split where their code gets too large for one dispatch.
  */
-void generate_dispatches(
-    const std::vector<DexMethod*>& methods,
-    const RefCounter& ref_counter,
-    std::unordered_map<DexMethod*, method_reference::NewCallee>* old_to_new,
-    method_merger::Stats* stats) {
+void plan_dispatches(const std::vector<DexMethod*>& methods,
+                     const RefCounter& ref_counter,
+                     std::vector<DispatchGroup>* groups) {
   constexpr uint64_t HARD_MAX_INSTRUCTION_SIZE = 1L << 16;
   constexpr uint32_t min_method_group_size = 3;
   std::unordered_map<DexProto*, std::set<DexMethod*, dexmethods_comparator>>
@@ -121,19 +91,23 @@ void generate_dispatches(
       proto_to_methods[method->get_proto()].insert(method);
     }
   }
+  auto add_group = [&](const DispatchGroup& indices_to_callee) {
+    if (indices_to_callee.size() >= min_method_group_size) {
+      groups->push_back(indices_to_callee);
+    }
+  };
   for (auto& p : proto_to_methods) {
     if (p.second.size() < min_method_group_size) {
       continue;
     }
-    std::map<SwitchIndices, DexMethod*> indices_to_callee;
+    DispatchGroup indices_to_callee;
     uint64_t code_size = 0;
     uint32_t id = 0;
     for (auto it = p.second.begin(); it != p.second.end(); ++it) {
       auto cur_meth = *it;
       code_size += cur_meth->get_code()->sum_opcode_sizes();
       if (code_size > HARD_MAX_INSTRUCTION_SIZE) {
-        create_one_dispatch(indices_to_callee, min_method_group_size,
-                            old_to_new, stats);
+        add_group(indices_to_callee);
         indices_to_callee.clear();
         code_size = 0;
         id = 0;
@@ -142,8 +116,37 @@ void generate_dispatches(
       indices_to_callee[indices] = cur_meth;
       ++id;
     }
-    create_one_dispatch(indices_to_callee, min_method_group_size, old_to_new,
-                        stats);
+    add_group(indices_to_callee);
+  }
+}
+
+/**
+ * Add the dispatch to the class of its methods, then update old_to_new
+ * mapping and update stats.
+ */
+void add_dispatch(
+    const DispatchGroup& indices_to_callee,
+    DexMethod* method,
+    std::unordered_map<DexMethod*, method_reference::NewCallee>* old_to_new,
+    method_merger::Stats* stats) {
+  auto first_method = indices_to_callee.begin()->second;
+  always_assert_log(method != nullptr, "Dispatch null for %s\n",
+                    SHOW(first_method));
+  auto cls = type_class(first_method->get_class());
+  cls->add_method(method);
+  for (auto& id_meth : indices_to_callee) {
+    uint32_t tag = *id_meth.first.begin();
+    method_reference::NewCallee new_callee(method, tag);
+    old_to_new->emplace(id_meth.second, std::move(new_callee));
+  }
+  // Record stats: number of merged methods - number of dispatches.
+  uint32_t merged_size = indices_to_callee.size() - 1;
+  if (first_method->is_virtual()) {
+    stats->num_merged_nonvirt_methods += merged_size;
+  } else if (is_static(first_method)) {
+    stats->num_merged_static_methods += merged_size;
+  } else {
+    stats->num_merged_direct_methods += merged_size;
   }
 }
 } // namespace
@@ -160,23 +163,28 @@ Stats merge_methods(const MethodGroups& method_groups,
   method_reference::CallSites callsites =
       method_reference::collect_call_refs(scope, all_methods);
   RefCounter ref_counter(callsites);
-  std::unordered_map<DexMethod*, method_reference::NewCallee> old_to_new;
+  std::vector<DispatchGroup> groups;
   for (auto& methods : method_groups) {
-    generate_dispatches(methods, ref_counter, &old_to_new, &stats);
+    plan_dispatches(methods, ref_counter, &groups);
   }
-  if (old_to_new.empty()) {
+  if (groups.empty()) {
     return stats;
   }
-  for (auto& callsite : callsites) {
-    auto old_callee = callsite.callee;
-    if (!old_to_new.count(old_callee)) {
-      continue;
+  auto dispatches = dispatch::create_simple_dispatches(groups);
+  std::unordered_map<DexMethod*, method_reference::NewCallee> old_to_new;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    add_dispatch(groups[i], dispatches[i], &old_to_new, &stats);
+  }
+  if (traceEnabled(METH_MERGER, 9)) {
+    for (auto& callsite : callsites) {
+      auto it = old_to_new.find(callsite.callee);
+      if (it != old_to_new.end()) {
+        TRACE(METH_MERGER, 9, "\t%s => %d %s\n", SHOW(callsite.callee),
+              it->second.additional_args.get()[0], SHOW(it->second.method));
+      }
     }
-    auto& new_callee = old_to_new.at(old_callee);
-    method_reference::patch_callsite(callsite, new_callee);
-    TRACE(METH_MERGER, 9, "\t%s => %d %s\n", SHOW(old_callee),
-          new_callee.additional_args.get()[0], SHOW(new_callee.method));
   }
+  method_reference::patch_callsites(callsites, old_to_new);
   if (traceEnabled(METH_MERGER, 3)) {
     TRACE(METH_MERGER, 3, "merged static methods : %u\n",
           stats.num_merged_static_methods);
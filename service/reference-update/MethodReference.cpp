@@ -9,6 +9,7 @@
 
 #include "Resolver.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace method_reference {
 
@@ -31,11 +32,18 @@ IRInstruction* make_invoke(DexMethod* callee,
   return invoke;
 }
 
-void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
-  if (is_static(new_callee.method) || is_any_init(new_callee.method) ||
-      new_callee.method->is_virtual()) {
-    set_public(new_callee.method);
+namespace {
+
+void make_accessible(DexMethod* new_callee) {
+  if (is_static(new_callee) || is_any_init(new_callee) ||
+      new_callee->is_virtual()) {
+    set_public(new_callee);
   }
+}
+
+// The part of patch_callsite() that only changes the code of the caller.
+void patch_callsite_code(const CallSite& callsite,
+                         const NewCallee& new_callee) {
   always_assert_log(is_public(new_callee.method) ||
                         new_callee.method->get_class() ==
                             callsite.caller->get_class(),
@@ -63,39 +71,150 @@ void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
   // Assuming the following move-result is there and good.
 }
 
+} // namespace
+
+void patch_callsite(const CallSite& callsite, const NewCallee& new_callee) {
+  make_accessible(new_callee.method);
+  patch_callsite_code(callsite, new_callee);
+}
+
+void patch_callsites(
+    const CallSites& callsites,
+    const std::unordered_map<DexMethod*, NewCallee>& old_to_new) {
+  // The new callees are shared between callers, so they are made accessible
+  // before any of them is patched.
+  std::unordered_map<DexMethod*, std::vector<const CallSite*>> by_caller;
+  std::vector<DexMethod*> callers;
+  for (const auto& callsite : callsites) {
+    auto it = old_to_new.find(callsite.callee);
+    if (it == old_to_new.end()) {
+      continue;
+    }
+    make_accessible(it->second.method);
+    auto& sites = by_caller[callsite.caller];
+    if (sites.empty()) {
+      callers.push_back(callsite.caller);
+    }
+    sites.push_back(&callsite);
+  }
+  auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* caller) {
+    for (auto callsite : by_caller.at(caller)) {
+      patch_callsite_code(*callsite, old_to_new.at(callsite->callee));
+    }
+  });
+  for (auto caller : callers) {
+    wq.add_item(caller);
+  }
+  wq.run_all();
+}
+
+namespace {
+
+void update_call_refs_in_code(
+    IRCode& code, const IdMap<DexMethod*, DexMethod*>& old_to_new_callee) {
+  for (auto& mie : InstructionIterable(code)) {
+    auto insn = mie.insn;
+    if (!insn->has_method()) {
+      continue;
+    }
+    const auto method =
+        resolve_method(insn->get_method(), opcode_to_search(insn));
+    if (method == nullptr) {
+      continue;
+    }
+    auto it = old_to_new_callee.find(method);
+    if (it == old_to_new_callee.end()) {
+      continue;
+    }
+    auto new_callee = it->second;
+    // At this point, a non static private should not exist.
+    always_assert_log(!is_private(new_callee) || is_static(new_callee),
+                      "%s\n",
+                      vshow(new_callee).c_str());
+    TRACE(REFU, 9, " Updated call %s to %s\n", SHOW(insn), SHOW(new_callee));
+    insn->set_method(new_callee);
+    if (new_callee->is_virtual()) {
+      always_assert_log(is_invoke_virtual(insn->opcode()),
+                        "invalid callsite %s\n",
+                        SHOW(insn));
+    } else if (is_static(new_callee)) {
+      always_assert_log(is_invoke_static(insn->opcode()),
+                        "invalid callsite %s\n",
+                        SHOW(insn));
+    }
+  }
+}
+
+} // namespace
+
+void CallRefsUpdater::add(DexMethod* old_callee, DexMethod* new_callee) {
+  if (old_callee == new_callee) {
+    return;
+  }
+  m_old_to_new[old_callee] = new_callee;
+  m_flat = false;
+}
+
+void CallRefsUpdater::add(
+    const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee) {
+  for (const auto& pair : old_to_new_callee) {
+    add(pair.first, pair.second);
+  }
+}
+
+void CallRefsUpdater::flatten() {
+  if (m_flat) {
+    return;
+  }
+  for (auto& pair : m_old_to_new) {
+    auto new_callee = pair.second;
+    size_t steps = 0;
+    for (auto it = m_old_to_new.find(new_callee); it != m_old_to_new.end();
+         it = m_old_to_new.find(new_callee)) {
+      new_callee = it->second;
+      always_assert_log(++steps <= m_old_to_new.size(),
+                        "Cyclic call ref rewrites through %s\n",
+                        SHOW(pair.first));
+    }
+    pair.second = new_callee;
+  }
+  m_flat = true;
+}
+
+void CallRefsUpdater::apply_to(const std::vector<DexMethod*>& callers) {
+  if (empty()) {
+    return;
+  }
+  flatten();
+  auto wq = workqueue_foreach<DexMethod*>([&](DexMethod* caller) {
+    auto code = caller->get_code();
+    if (code != nullptr) {
+      update_call_refs_in_code(*code, m_old_to_new);
+    }
+  });
+  for (auto caller : callers) {
+    wq.add_item(caller);
+  }
+  wq.run_all();
+}
+
+void CallRefsUpdater::apply(const Scope& scope) {
+  if (empty()) {
+    return;
+  }
+  flatten();
+  walk::parallel::code(scope, [&](DexMethod*, IRCode& code) {
+    update_call_refs_in_code(code, m_old_to_new);
+  });
+  m_old_to_new.clear();
+}
+
 void update_call_refs_simple(
     const Scope& scope,
     const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee) {
-  auto patcher = [&](DexMethod* meth, IRCode& code) {
-    for (auto& mie : InstructionIterable(code)) {
-      auto insn = mie.insn;
-      if (!insn->has_method()) {
-        continue;
-      }
-      const auto method =
-          resolve_method(insn->get_method(), opcode_to_search(insn));
-      if (method == nullptr || old_to_new_callee.count(method) == 0) {
-        continue;
-      }
-      auto new_callee = old_to_new_callee.at(method);
-      // At this point, a non static private should not exist.
-      always_assert_log(!is_private(new_callee) || is_static(new_callee),
-                        "%s\n",
-                        vshow(new_callee).c_str());
-      TRACE(REFU, 9, " Updated call %s to %s\n", SHOW(insn), SHOW(new_callee));
-      insn->set_method(new_callee);
-      if (new_callee->is_virtual()) {
-        always_assert_log(is_invoke_virtual(insn->opcode()),
-                          "invalid callsite %s\n",
-                          SHOW(insn));
-      } else if (is_static(new_callee)) {
-        always_assert_log(is_invoke_static(insn->opcode()),
-                          "invalid callsite %s\n",
-                          SHOW(insn));
-      }
-    }
-  };
-  walk::parallel::code(scope, patcher);
+  CallRefsUpdater updater;
+  updater.add(old_to_new_callee);
+  updater.apply(scope);
 }
 
 CallSites collect_call_refs(const Scope& scope,
@@ -132,9 +251,8 @@ CallSites collect_call_refs(const Scope& scope,
   };
 
   CallSites call_sites = walk::parallel::reduce_methods<CallSites>(
-      scope, patcher, [](CallSites left, CallSites right) {
+      scope, patcher, [](CallSites& left, CallSites&& right) {
         left.insert(left.end(), right.begin(), right.end());
-        return left;
       });
   return call_sites;
 }
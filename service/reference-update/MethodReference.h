@@ -10,6 +10,7 @@
 #include <boost/optional.hpp>
 
 #include "DexClass.h"
+#include "IdMap.h"
 
 using MethodOrderedSet = std::set<DexMethod*, dexmethods_comparator>;
 
@@ -59,6 +60,47 @@ IRInstruction* make_invoke(DexMethod* callee,
  */
 void patch_callsite(const CallSite& callsite, const NewCallee& new_callee);
 
+/**
+ * patch_callsite() for all the callsites whose callee is in old_to_new, with
+ * the callers patched in parallel.
+ */
+void patch_callsites(
+    const CallSites& callsites,
+    const std::unordered_map<DexMethod*, NewCallee>& old_to_new);
+
+/**
+ * Queues callee rewrites, typically from many merges, so that they can all be
+ * applied in a single walk over the scope instead of one walk per merge. The
+ * rewrites are kept in a table indexed by the callees' dense ids. Chains are
+ * followed: after add(a, b) and add(b, c), calls to `a` end up calling `c`.
+ */
+class CallRefsUpdater {
+ public:
+  void add(DexMethod* old_callee, DexMethod* new_callee);
+
+  void add(const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee);
+
+  bool empty() const { return m_old_to_new.empty(); }
+
+  /**
+   * Patches the code of `callers` only, and keeps the queued rewrites.
+   */
+  void apply_to(const std::vector<DexMethod*>& callers);
+
+  /**
+   * Patches the code of the whole scope in one parallel walk, and clears the
+   * queued rewrites.
+   */
+  void apply(const Scope& scope);
+
+ private:
+  // Points every queued rewrite at the end of its chain.
+  void flatten();
+
+  IdMap<DexMethod*, DexMethod*> m_old_to_new;
+  bool m_flat{true};
+};
+
 void update_call_refs_simple(
     const Scope& scope,
     const std::unordered_map<DexMethod*, DexMethod*>& old_to_new_callee);
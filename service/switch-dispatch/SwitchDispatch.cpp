@@ -9,6 +9,7 @@
 
 #include "Creators.h"
 #include "TypeReference.h"
+#include "WorkQueue.h"
 
 using namespace type_reference;
 
@@ -32,6 +33,11 @@ constexpr uint64_t MAX_NUM_DISPATCH_TARGET = 500;
  */
 constexpr uint64_t MAX_NUM_DISPATCH_INSTRUCTION = 40000;
 
+/**
+ * Below this many keys, a chain of comparisons is as fast as a search.
+ */
+constexpr size_t MIN_NUM_KEYS_FOR_SWITCH_SEARCH = 8;
+
 MethodCreator* init_method_creator(const dispatch::Spec& spec,
                                    DexMethod* orig_method) {
   return new MethodCreator(spec.owner_type,
@@ -133,6 +139,102 @@ void handle_default_block(
   }
 }
 
+/**
+ * ART compiles a packed-switch into a jump table, but a sparse-switch into a
+ * chain of comparisons, one per key. Instruction lowering picks a sparse-switch
+ * once the keys have more holes than entries, which happens when only some of
+ * the merged types implement a method. In that case we split the keys into
+ * dense runs, pick the run with a balanced binary search on the key, and switch
+ * on it with a packed-switch.
+ */
+std::vector<std::vector<int>> get_dense_key_runs(
+    const std::map<SwitchIndices, MethodBlock*>& cases) {
+  std::set<int> keys;
+  for (const auto& it : cases) {
+    keys.insert(it.first.begin(), it.first.end());
+  }
+  if (keys.size() < MIN_NUM_KEYS_FOR_SWITCH_SEARCH) {
+    return {std::vector<int>(keys.begin(), keys.end())};
+  }
+  std::vector<std::vector<int>> runs;
+  for (int key : keys) {
+    // Same density as a packed-switch that instruction lowering keeps.
+    if (runs.empty() || ((int64_t)key - runs.back().front() + 1) / 2 >
+                            (int64_t)runs.back().size() + 1) {
+      runs.emplace_back();
+    }
+    runs.back().push_back(key);
+  }
+  return runs;
+}
+
+void emit_switch_search(const std::vector<std::vector<int>>& runs,
+                        size_t begin,
+                        size_t end,
+                        Location test,
+                        Location pivot,
+                        MethodBlock* block,
+                        const std::map<SwitchIndices, MethodBlock*>& cases,
+                        std::map<SwitchIndices, std::vector<MethodBlock*>>*
+                            case_blocks,
+                        std::vector<MethodBlock*>* default_blocks) {
+  if (end - begin > 1) {
+    size_t mid = begin + (end - begin) / 2;
+    block->load_const(pivot, static_cast<int32_t>(runs[mid].front()));
+    MethodBlock* upper_block;
+    auto lower_block = block->if_else_test(OPCODE_IF_GE, test, pivot,
+                                           &upper_block);
+    emit_switch_search(runs, begin, mid, test, pivot, lower_block, cases,
+                       case_blocks, default_blocks);
+    emit_switch_search(runs, mid, end, test, pivot, upper_block, cases,
+                       case_blocks, default_blocks);
+    return;
+  }
+  const auto& run = runs[begin];
+  std::map<SwitchIndices, SwitchIndices> run_to_case;
+  std::map<SwitchIndices, MethodBlock*> run_cases;
+  for (const auto& it : cases) {
+    SwitchIndices indices;
+    for (int key : it.first) {
+      if (key >= run.front() && key <= run.back()) {
+        indices.insert(key);
+      }
+    }
+    if (!indices.empty()) {
+      run_to_case.emplace(indices, it.first);
+      run_cases[indices] = nullptr;
+    }
+  }
+  default_blocks->push_back(block->switch_op(test, run_cases));
+  for (const auto& it : run_cases) {
+    (*case_blocks)[run_to_case.at(it.first)].push_back(it.second);
+  }
+}
+
+/**
+ * Emit a switch on `test` over the keys of `cases`, as a single switch or as a
+ * search over dense runs of keys. Each case may get several blocks, one per
+ * run that holds some of its keys, and each of them has to be filled in, as
+ * well as each of the returned default blocks.
+ */
+std::vector<MethodBlock*> emit_switch(
+    MethodCreator* mc,
+    MethodBlock* mb,
+    Location test,
+    const std::map<SwitchIndices, MethodBlock*>& cases,
+    std::map<SwitchIndices, std::vector<MethodBlock*>>* case_blocks) {
+  auto runs = get_dense_key_runs(cases);
+  if (runs.size() > 1) {
+    TRACE(SDIS, 5, "searching %d runs of %d switch cases\n", runs.size(),
+          cases.size());
+  }
+  std::vector<MethodBlock*> default_blocks;
+  auto pivot = runs.size() > 1 ? mc->make_local(get_int_type()) : test;
+  emit_switch_search(runs, 0, runs.size(), test, pivot, mb, cases,
+                     case_blocks, &default_blocks);
+  return default_blocks;
+}
+
 // If there is no need for the switch statement.
 bool is_single_target_case(
     const dispatch::Spec& spec,
@@ -240,21 +342,26 @@ DexMethod* create_simple_switch_dispatch(
   }
 
   mb->iget(spec.type_tag_field, self_loc, type_tag_loc);
-  auto cases = get_switch_cases(indices_to_callee);
+  std::map<SwitchIndices, std::vector<MethodBlock*>> cases;
+  auto def_blocks = emit_switch(mc, mb, type_tag_loc,
+                                get_switch_cases(indices_to_callee), &cases);
 
   // default case and return
-  auto def_block = mb->switch_op(type_tag_loc, cases);
-  handle_default_block(spec, indices_to_callee, args, mc, ret_loc, def_block);
+  for (auto def_block : def_blocks) {
+    handle_default_block(spec, indices_to_callee, args, mc, ret_loc,
+                         def_block);
+  }
   mb->ret(spec.proto->get_rtype(), ret_loc);
 
   for (auto& case_it : cases) {
-    auto case_block = case_it.second;
-    always_assert(case_block != nullptr);
     auto callee = indices_to_callee.at(case_it.first);
     always_assert(is_static(callee));
-    // check-cast and call
-    emit_check_cast(spec, args, callee, case_block);
-    invoke_static(spec, args, ret_loc, callee, case_block);
+    for (auto case_block : case_it.second) {
+      always_assert(case_block != nullptr);
+      // check-cast and call
+      emit_check_cast(spec, args, callee, case_block);
+      invoke_static(spec, args, ret_loc, callee, case_block);
+    }
   }
 
   return materialize_dispatch(orig_method, mc);
@@ -569,18 +676,23 @@ DexMethod* create_ctor_or_static_dispatch(
     return materialize_dispatch(orig_method, mc);
   }
 
-  auto cases = get_switch_cases(indices_to_callee, is_ctor(spec));
-
-  auto def_block = mb->switch_op(type_tag_loc, cases);
-  handle_default_block(spec, indices_to_callee, args, mc, ret_loc, def_block);
+  std::map<SwitchIndices, std::vector<MethodBlock*>> cases;
+  auto def_blocks =
+      emit_switch(mc, mb, type_tag_loc,
+                  get_switch_cases(indices_to_callee, is_ctor(spec)), &cases);
+  for (auto def_block : def_blocks) {
+    handle_default_block(spec, indices_to_callee, args, mc, ret_loc,
+                         def_block);
+  }
   mb->ret(spec.proto->get_rtype(), ret_loc);
 
   for (auto& case_it : cases) {
-    auto case_block = case_it.second;
-    always_assert(case_block != nullptr);
     auto callee = indices_to_callee.at(case_it.first);
     always_assert(is_static(callee));
-    invoke_static(spec, args, ret_loc, callee, case_block);
+    for (auto case_block : case_it.second) {
+      always_assert(case_block != nullptr);
+      invoke_static(spec, args, ret_loc, callee, case_block);
+    }
   }
 
   return materialize_dispatch(orig_method, mc);
@@ -588,14 +700,11 @@ DexMethod* create_ctor_or_static_dispatch(
 
 // TODO(fengliu): There are some redundant logic with other dispatch creating
 // methods, will do some refactor in near future.
-DexMethod* create_simple_dispatch(
-    const std::map<SwitchIndices, DexMethod*>& indices_to_callee,
-    DexAnnotationSet* anno,
-    bool with_debug_item) {
-  auto dispatch_ref = create_dispatch_method_ref(indices_to_callee);
-  if (!dispatch_ref) {
-    return nullptr;
-  }
+namespace {
+
+DexMethod* build_simple_dispatch(
+    DexMethodRef* dispatch_ref,
+    const std::map<SwitchIndices, DexMethod*>& indices_to_callee) {
   auto return_type = dispatch_ref->get_proto()->get_rtype();
   auto first_method = indices_to_callee.begin()->second;
   auto access = get_dispatch_access(first_method);
@@ -607,23 +716,25 @@ DexMethod* create_simple_dispatch(
   args.pop_back();
   auto main_block = mc.get_main_block();
 
-  std::map<SwitchIndices, MethodBlock*> cases;
+  std::map<SwitchIndices, MethodBlock*> switch_cases;
   for (auto& p : indices_to_callee) {
-    cases[p.first] = nullptr;
+    switch_cases[p.first] = nullptr;
   }
-  auto default_block = main_block->switch_op(method_tag_loc, cases);
+  std::map<SwitchIndices, std::vector<MethodBlock*>> cases;
+  emit_switch(&mc, main_block, method_tag_loc, switch_cases, &cases);
   bool has_return_value = (return_type != get_void_type());
   auto res_loc =
       has_return_value ? mc.make_local(return_type) : Location::empty();
   for (auto& p : cases) {
-    auto case_block = p.second;
     auto callee = indices_to_callee.at(p.first);
-    case_block->invoke(callee, args);
-    if (has_return_value) {
-      case_block->move_result(res_loc, return_type);
-      case_block->ret(res_loc);
-    } else {
-      case_block->ret_void();
+    for (auto case_block : p.second) {
+      case_block->invoke(callee, args);
+      if (has_return_value) {
+        case_block->move_result(res_loc, return_type);
+        case_block->ret(res_loc);
+      } else {
+        case_block->ret_void();
+      }
     }
   }
 
@@ -632,6 +743,40 @@ DexMethod* create_simple_dispatch(
   return method;
 }
 
+} // namespace
+
+DexMethod* create_simple_dispatch(
+    const std::map<SwitchIndices, DexMethod*>& indices_to_callee,
+    DexAnnotationSet* anno,
+    bool with_debug_item) {
+  auto dispatch_ref = create_dispatch_method_ref(indices_to_callee);
+  if (!dispatch_ref) {
+    return nullptr;
+  }
+  return build_simple_dispatch(dispatch_ref, indices_to_callee);
+}
+
+std::vector<DexMethod*> create_simple_dispatches(
+    const std::vector<std::map<SwitchIndices, DexMethod*>>& groups) {
+  std::vector<DexMethodRef*> dispatch_refs;
+  dispatch_refs.reserve(groups.size());
+  for (const auto& indices_to_callee : groups) {
+    dispatch_refs.push_back(create_dispatch_method_ref(indices_to_callee));
+  }
+  // Each task only writes its own slot.
+  std::vector<DexMethod*> dispatches(groups.size(), nullptr);
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    if (dispatch_refs[i] != nullptr) {
+      dispatches[i] = build_simple_dispatch(dispatch_refs[i], groups[i]);
+    }
+  });
+  for (size_t i = 0; i < groups.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  return dispatches;
+}
+
 DexString* gen_dispatch_name(DexType* owner,
                              DexProto* proto,
                              std::string orig_name) {
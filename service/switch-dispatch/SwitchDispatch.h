@@ -140,6 +140,15 @@ DexMethod* create_simple_dispatch(
     DexAnnotationSet* anno = nullptr,
     bool with_debug_item = false);
 
+/**
+ * create_simple_dispatch() for many groups of methods at once. The dispatches
+ * are named one after the other, so that their names can't clash, and their
+ * code is built in parallel. The result follows the order of the groups, with
+ * nullptr for the groups that can't be dispatched to.
+ */
+std::vector<DexMethod*> create_simple_dispatches(
+    const std::vector<std::map<SwitchIndices, DexMethod*>>& groups);
+
 /**
  * Generate a new dispatch method name.
  */
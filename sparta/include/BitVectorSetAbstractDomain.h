@@ -0,0 +1,311 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include "PowersetAbstractDomain.h"
+
+namespace sparta {
+
+namespace bvsad_impl {
+
+/*
+ * An abstract value from a powerset of small unsigned integers, implemented
+ * as a vector of 64-bit words. The vector grows on demand, so two sets may
+ * have different numbers of words; the missing words are all zeros.
+ *
+ * The lattice operations are word-wise loops without early exits, which the
+ * compiler turns into vector instructions.
+ */
+template <typename IntegerType>
+class BitVectorSetValue final
+    : public PowersetImplementation<IntegerType,
+                                    const BitVectorSetValue<IntegerType>&,
+                                    BitVectorSetValue<IntegerType>> {
+ public:
+  using Word = uint64_t;
+  static constexpr size_t BITS_PER_WORD = 64;
+
+  // Iterates over the elements of the set in increasing order.
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = IntegerType;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const IntegerType*;
+    using reference = IntegerType;
+
+    const_iterator(const std::vector<Word>& words, size_t index)
+        : m_words(&words), m_index(index), m_bits(0) {
+      if (m_index < m_words->size()) {
+        m_bits = (*m_words)[m_index];
+        skip_empty_words();
+      }
+    }
+
+    IntegerType operator*() const {
+      return static_cast<IntegerType>(m_index * BITS_PER_WORD +
+                                      __builtin_ctzll(m_bits));
+    }
+
+    const_iterator& operator++() {
+      // Clear the lowest set bit.
+      m_bits &= m_bits - 1;
+      skip_empty_words();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator result = *this;
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return m_index == other.m_index && m_bits == other.m_bits;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    void skip_empty_words() {
+      while (m_bits == 0 && ++m_index < m_words->size()) {
+        m_bits = (*m_words)[m_index];
+      }
+      if (m_bits == 0) {
+        m_index = m_words->size();
+      }
+    }
+
+    const std::vector<Word>* m_words;
+    size_t m_index;
+    Word m_bits;
+  };
+
+  using iterator = const_iterator;
+
+  BitVectorSetValue() = default;
+
+  // Returns an empty set with room for the elements 0 to capacity - 1.
+  // Larger elements can still be added, the capacity is only a hint.
+  explicit BitVectorSetValue(size_t capacity)
+      : m_words((capacity + BITS_PER_WORD - 1) / BITS_PER_WORD, 0) {}
+
+  BitVectorSetValue(std::initializer_list<IntegerType> l) {
+    for (IntegerType e : l) {
+      add(e);
+    }
+  }
+
+  const BitVectorSetValue& elements() const override { return *this; }
+
+  const_iterator begin() const { return const_iterator(m_words, 0); }
+
+  const_iterator end() const { return const_iterator(m_words, m_words.size()); }
+
+  bool empty() const {
+    Word any = 0;
+    for (Word w : m_words) {
+      any |= w;
+    }
+    return any == 0;
+  }
+
+  size_t size() const override {
+    size_t n = 0;
+    for (Word w : m_words) {
+      n += __builtin_popcountll(w);
+    }
+    return n;
+  }
+
+  bool contains(const IntegerType& e) const override {
+    size_t i = word_index(e);
+    return i < m_words.size() && (m_words[i] & bit(e)) != 0;
+  }
+
+  void add(const IntegerType& e) override {
+    size_t i = word_index(e);
+    if (i >= m_words.size()) {
+      m_words.resize(i + 1, 0);
+    }
+    m_words[i] |= bit(e);
+  }
+
+  void remove(const IntegerType& e) override {
+    size_t i = word_index(e);
+    if (i < m_words.size()) {
+      m_words[i] &= ~bit(e);
+    }
+  }
+
+  void clear() override { std::fill(m_words.begin(), m_words.end(), 0); }
+
+  AbstractValueKind kind() const override { return AbstractValueKind::Value; }
+
+  bool leq(const BitVectorSetValue& other) const override {
+    size_t n = std::min(m_words.size(), other.m_words.size());
+    const Word* a = m_words.data();
+    const Word* b = other.m_words.data();
+    Word extra = 0;
+    for (size_t i = 0; i < n; ++i) {
+      extra |= a[i] & ~b[i];
+    }
+    for (size_t i = n; i < m_words.size(); ++i) {
+      extra |= a[i];
+    }
+    return extra == 0;
+  }
+
+  bool equals(const BitVectorSetValue& other) const override {
+    size_t n = std::min(m_words.size(), other.m_words.size());
+    const Word* a = m_words.data();
+    const Word* b = other.m_words.data();
+    Word diff = 0;
+    for (size_t i = 0; i < n; ++i) {
+      diff |= a[i] ^ b[i];
+    }
+    const auto& longer =
+        m_words.size() > other.m_words.size() ? m_words : other.m_words;
+    for (size_t i = n; i < longer.size(); ++i) {
+      diff |= longer[i];
+    }
+    return diff == 0;
+  }
+
+  AbstractValueKind join_with(const BitVectorSetValue& other) override {
+    if (other.m_words.size() > m_words.size()) {
+      m_words.resize(other.m_words.size(), 0);
+    }
+    Word* a = m_words.data();
+    const Word* b = other.m_words.data();
+    for (size_t i = 0, n = other.m_words.size(); i < n; ++i) {
+      a[i] |= b[i];
+    }
+    return AbstractValueKind::Value;
+  }
+
+  AbstractValueKind meet_with(const BitVectorSetValue& other) override {
+    if (other.m_words.size() < m_words.size()) {
+      m_words.resize(other.m_words.size());
+    }
+    Word* a = m_words.data();
+    const Word* b = other.m_words.data();
+    for (size_t i = 0, n = m_words.size(); i < n; ++i) {
+      a[i] &= b[i];
+    }
+    return AbstractValueKind::Value;
+  }
+
+  friend std::ostream& operator<<(std::ostream& o,
+                                  const BitVectorSetValue& value) {
+    o << "[#" << value.size() << "]{";
+    for (auto it = value.begin(); it != value.end();) {
+      o << *it++;
+      if (it != value.end()) {
+        o << ", ";
+      }
+    }
+    o << "}";
+    return o;
+  }
+
+ private:
+  static size_t word_index(IntegerType e) {
+    return static_cast<size_t>(e) / BITS_PER_WORD;
+  }
+
+  static Word bit(IntegerType e) {
+    return Word(1) << (static_cast<size_t>(e) % BITS_PER_WORD);
+  }
+
+  std::vector<Word> m_words;
+};
+
+} // namespace bvsad_impl
+
+/*
+ * An implementation of powerset abstract domains over small unsigned
+ * integers, e.g. register numbers, using bit vectors. The cost of the lattice
+ * operations is linear in the largest element rather than in the number of
+ * elements, so this domain is the right choice for dense sets over a small
+ * universe, like the live registers of a method, and a poor one for sparse
+ * sets over a large universe.
+ *
+ * Sample usage:
+ *
+ *  using Registers = BitVectorSetAbstractDomain<uint16_t>;
+ *
+ *  Registers live(code->get_registers_size());
+ *  live.add(3);
+ *  for (uint16_t reg : live.elements()) {
+ *    ...
+ *  }
+ *
+ */
+template <typename IntegerType>
+class BitVectorSetAbstractDomain final
+    : public PowersetAbstractDomain<
+          IntegerType,
+          bvsad_impl::BitVectorSetValue<IntegerType>,
+          const bvsad_impl::BitVectorSetValue<IntegerType>&,
+          BitVectorSetAbstractDomain<IntegerType>> {
+ public:
+  using Value = bvsad_impl::BitVectorSetValue<IntegerType>;
+
+  ~BitVectorSetAbstractDomain() {
+    // The destructor is the only method that is guaranteed to be created when
+    // a class template is instantiated. This is a good place to perform all
+    // the sanity checks on the template parameters.
+    static_assert(std::is_unsigned<IntegerType>::value,
+                  "IntegerType is not an unsigned arihmetic type");
+    static_assert(sizeof(IntegerType) <= sizeof(size_t),
+                  "IntegerType is too large");
+  }
+
+  BitVectorSetAbstractDomain()
+      : PowersetAbstractDomain<IntegerType,
+                               Value,
+                               const Value&,
+                               BitVectorSetAbstractDomain>() {}
+
+  BitVectorSetAbstractDomain(AbstractValueKind kind)
+      : PowersetAbstractDomain<IntegerType,
+                               Value,
+                               const Value&,
+                               BitVectorSetAbstractDomain>(kind) {}
+
+  // Returns an empty set with room for the elements 0 to capacity - 1.
+  explicit BitVectorSetAbstractDomain(size_t capacity) {
+    this->set_to_value(Value(capacity));
+  }
+
+  explicit BitVectorSetAbstractDomain(std::initializer_list<IntegerType> l) {
+    this->set_to_value(Value(l));
+  }
+
+  static BitVectorSetAbstractDomain bottom() {
+    return BitVectorSetAbstractDomain(AbstractValueKind::Bottom);
+  }
+
+  static BitVectorSetAbstractDomain top() {
+    return BitVectorSetAbstractDomain(AbstractValueKind::Top);
+  }
+};
+
+} // namespace sparta
@@ -0,0 +1,260 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace sparta {
+
+/*
+ * A hashtable with open addressing and linear probing, which stores all its
+ * bindings in a single array. It implements the subset of the interface of
+ * std::unordered_map that is used by the abstract domains of this library, so
+ * that it can be passed as the storage of a HashedAbstractEnvironment.
+ *
+ * Compared to std::unordered_map, it doesn't allocate a node per binding, and
+ * iterating over the bindings is a linear scan of contiguous memory. This
+ * works best with small keys, like pointers or registers, and a few hundred
+ * bindings at most.
+ *
+ * Erased bindings leave a tombstone behind, which is only reclaimed when the
+ * table is rehashed. As with std::unordered_map, erasing a binding doesn't
+ * invalidate the iterators to the other bindings, but inserting one
+ * invalidates all iterators. Both Key and Value must be default-constructible.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap final {
+  template <bool IsConst>
+  class Iterator;
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using size_type = size_t;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  FlatHashMap() = default;
+
+  bool empty() const { return m_size == 0; }
+
+  size_t size() const { return m_size; }
+
+  iterator begin() { return iterator(this, first_full(0)); }
+
+  iterator end() { return iterator(this, capacity()); }
+
+  const_iterator begin() const { return const_iterator(this, first_full(0)); }
+
+  const_iterator end() const { return const_iterator(this, capacity()); }
+
+  iterator find(const Key& key) { return iterator(this, lookup(key)); }
+
+  const_iterator find(const Key& key) const {
+    return const_iterator(this, lookup(key));
+  }
+
+  size_t count(const Key& key) const { return lookup(key) != capacity(); }
+
+  Value& operator[](const Key& key) {
+    size_t index = lookup(key);
+    if (index != capacity()) {
+      return m_slots[index].second;
+    }
+    if ((m_used + 1) * MAX_LOAD_DEN > capacity() * MAX_LOAD_NUM) {
+      rehash();
+    }
+    index = insertion_slot(key);
+    if (m_states[index] == EMPTY) {
+      ++m_used;
+    }
+    m_states[index] = FULL;
+    m_slots[index].first = key;
+    ++m_size;
+    return m_slots[index].second;
+  }
+
+  size_t erase(const Key& key) {
+    size_t index = lookup(key);
+    if (index == capacity()) {
+      return 0;
+    }
+    erase_slot(index);
+    return 1;
+  }
+
+  iterator erase(const_iterator it) {
+    erase_slot(it.m_index);
+    return iterator(this, first_full(it.m_index + 1));
+  }
+
+  iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+  void clear() {
+    m_slots.clear();
+    m_states.clear();
+    m_size = 0;
+    m_used = 0;
+  }
+
+ private:
+  enum SlotState : uint8_t { EMPTY, FULL, DELETED };
+
+  static constexpr size_t MIN_CAPACITY = 8;
+  // The table is rehashed once 3/4 of the slots are full or deleted.
+  static constexpr size_t MAX_LOAD_NUM = 3;
+  static constexpr size_t MAX_LOAD_DEN = 4;
+
+  size_t capacity() const { return m_states.size(); }
+
+  // The hash codes of pointers are their addresses, whose low bits are all
+  // zeros. Fibonacci hashing spreads them over the table.
+  size_t home_slot(const Key& key) const {
+    uint64_t h = static_cast<uint64_t>(Hash()(key));
+    h *= 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h >> 32) & (capacity() - 1);
+  }
+
+  // Returns the slot of the binding of `key`, or the capacity if there is
+  // none.
+  size_t lookup(const Key& key) const {
+    if (m_size == 0) {
+      return capacity();
+    }
+    size_t mask = capacity() - 1;
+    for (size_t index = home_slot(key);; index = (index + 1) & mask) {
+      switch (m_states[index]) {
+      case EMPTY:
+        return capacity();
+      case FULL:
+        if (KeyEqual()(m_slots[index].first, key)) {
+          return index;
+        }
+        break;
+      case DELETED:
+        break;
+      }
+    }
+  }
+
+  // Returns the first slot that isn't full along the probe sequence of
+  // `key`, which isn't in the table.
+  size_t insertion_slot(const Key& key) const {
+    size_t mask = capacity() - 1;
+    size_t index = home_slot(key);
+    while (m_states[index] == FULL) {
+      index = (index + 1) & mask;
+    }
+    return index;
+  }
+
+  size_t first_full(size_t index) const {
+    while (index < capacity() && m_states[index] != FULL) {
+      ++index;
+    }
+    return index;
+  }
+
+  void erase_slot(size_t index) {
+    m_states[index] = DELETED;
+    // Release whatever the key and the value hold.
+    m_slots[index] = value_type();
+    --m_size;
+  }
+
+  // Grows the table if it's at least half full, otherwise just clears the
+  // tombstones.
+  void rehash() {
+    size_t new_capacity = capacity() == 0 ? MIN_CAPACITY : capacity();
+    if (m_size * 2 >= new_capacity) {
+      new_capacity *= 2;
+    }
+    std::vector<value_type> slots(new_capacity);
+    std::vector<SlotState> states(new_capacity, EMPTY);
+    std::swap(m_slots, slots);
+    std::swap(m_states, states);
+    m_used = m_size;
+    for (size_t i = 0; i < states.size(); ++i) {
+      if (states[i] == FULL) {
+        size_t index = insertion_slot(slots[i].first);
+        m_states[index] = FULL;
+        m_slots[index] = std::move(slots[i]);
+      }
+    }
+  }
+
+  std::vector<value_type> m_slots;
+  std::vector<SlotState> m_states;
+  size_t m_size{0};
+  // The number of slots that are either full or deleted.
+  size_t m_used{0};
+
+  template <bool IsConst>
+  class Iterator final {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename FlatHashMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer =
+        std::conditional_t<IsConst, const value_type*, value_type*>;
+    using reference =
+        std::conditional_t<IsConst, const value_type&, value_type&>;
+    using Map = std::conditional_t<IsConst, const FlatHashMap, FlatHashMap>;
+
+    Iterator() = default;
+
+    Iterator(Map* map, size_t index) : m_map(map), m_index(index) {}
+
+    // Iterators convert to const iterators.
+    template <bool OtherIsConst,
+              typename = std::enable_if_t<IsConst && !OtherIsConst>>
+    Iterator(const Iterator<OtherIsConst>& other)
+        : m_map(other.m_map), m_index(other.m_index) {}
+
+    reference operator*() const { return m_map->m_slots[m_index]; }
+
+    pointer operator->() const { return &m_map->m_slots[m_index]; }
+
+    Iterator& operator++() {
+      m_index = m_map->first_full(m_index + 1);
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator retval = *this;
+      ++(*this);
+      return retval;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return m_index == other.m_index;
+    }
+
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    Map* m_map{nullptr};
+    size_t m_index{0};
+
+    template <bool>
+    friend class Iterator;
+
+    friend class FlatHashMap;
+  };
+};
+
+} // namespace sparta
@@ -16,6 +16,7 @@
 #include <utility>
 
 #include "AbstractDomain.h"
+#include "FlatHashMap.h"
 
 namespace sparta {
 
@@ -24,7 +25,8 @@ namespace hae_impl {
 template <typename Variable,
           typename Domain,
           typename VariableHash,
-          typename VariableEqual>
+          typename VariableEqual,
+          template <typename...> class Map>
 class MapValue;
 
 } // namespace hae_impl
@@ -60,21 +62,32 @@ class MapValue;
  * environment has a default value of Top. This representation is quite
  * convenient in practice. It also allows us to manipulate large (or possibly
  * infinite) variable sets with sparse assignments of non-Top values.
+ *
+ * The hashtable is a std::unordered_map by default. Passing FlatHashMap as the
+ * last template parameter stores all the bindings in a single array instead,
+ * which saves an allocation per binding and makes the lattice operations scan
+ * contiguous memory. This is usually faster for small keys like pointers and
+ * registers.
  */
 template <typename Variable,
           typename Domain,
           typename VariableHash = std::hash<Variable>,
-          typename VariableEqual = std::equal_to<Variable>>
+          typename VariableEqual = std::equal_to<Variable>,
+          template <typename...> class Map = std::unordered_map>
 class HashedAbstractEnvironment final
     : public AbstractDomainScaffolding<
-          hae_impl::MapValue<Variable, Domain, VariableHash, VariableEqual>,
+          hae_impl::
+              MapValue<Variable, Domain, VariableHash, VariableEqual, Map>,
           HashedAbstractEnvironment<Variable,
                                     Domain,
                                     VariableHash,
-                                    VariableEqual>> {
+                                    VariableEqual,
+                                    Map>> {
  public:
   using Value =
-      hae_impl::MapValue<Variable, Domain, VariableHash, VariableEqual>;
+      hae_impl::MapValue<Variable, Domain, VariableHash, VariableEqual, Map>;
+
+  using Bindings = typename Value::Bindings;
 
   /*
    * The default constructor produces the Top value.
@@ -107,8 +120,7 @@ class HashedAbstractEnvironment final
     return this->get_value()->m_map.size();
   }
 
-  const std::unordered_map<Variable, Domain, VariableHash, VariableEqual>&
-  bindings() const {
+  const Bindings& bindings() const {
     RUNTIME_CHECK(this->kind() == AbstractValueKind::Value,
                   invalid_abstract_value()
                       << expected_kind(AbstractValueKind::Value)
@@ -185,13 +197,15 @@ class HashedAbstractEnvironment final
 template <typename Variable,
           typename Domain,
           typename VariableHash,
-          typename VariableEqual>
+          typename VariableEqual,
+          template <typename...> class Map>
 inline std::ostream& operator<<(
     std::ostream& o,
     const typename sparta::HashedAbstractEnvironment<Variable,
                                                      Domain,
                                                      VariableHash,
-                                                     VariableEqual>& e) {
+                                                     VariableEqual,
+                                                     Map>& e) {
   using namespace sparta;
   switch (e.kind()) {
   case AbstractValueKind::Bottom: {
@@ -237,11 +251,14 @@ namespace hae_impl {
 template <typename Variable,
           typename Domain,
           typename VariableHash,
-          typename VariableEqual>
+          typename VariableEqual,
+          template <typename...> class Map>
 class MapValue final
     : public AbstractValue<
-          MapValue<Variable, Domain, VariableHash, VariableEqual>> {
+          MapValue<Variable, Domain, VariableHash, VariableEqual, Map>> {
  public:
+  using Bindings = Map<Variable, Domain, VariableHash, VariableEqual>;
+
   MapValue() = default;
 
   MapValue(const Variable& variable, const Domain& value) {
@@ -384,9 +401,13 @@ class MapValue final
     return kind();
   }
 
-  std::unordered_map<Variable, Domain, VariableHash, VariableEqual> m_map;
+  Bindings m_map;
 
-  template <typename T1, typename T2, typename T3, typename T4>
+  template <typename T1,
+            typename T2,
+            typename T3,
+            typename T4,
+            template <typename...> class T5>
   friend class sparta::HashedAbstractEnvironment;
 };
 
@@ -8,18 +8,83 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstddef>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <boost/optional.hpp>
+
 #include "AbstractDomain.h"
 #include "FixpointIterator.h"
 #include "WeakTopologicalOrdering.h"
 
 namespace sparta {
 
+namespace mfi_impl {
+
+template <typename... Ts>
+struct make_void {
+  using type = void;
+};
+
+// Returns the WTO cache of a graph, or nullptr if its graph interface doesn't
+// define `wto_cache()`.
+template <typename GraphInterface, typename NodeHash, typename = void>
+struct WtoCacheOf {
+  static WtoCache<typename GraphInterface::NodeId, NodeHash>* get(
+      const typename GraphInterface::Graph&) {
+    return nullptr;
+  }
+};
+
+template <typename GraphInterface, typename NodeHash>
+struct WtoCacheOf<
+    GraphInterface,
+    NodeHash,
+    typename make_void<typename std::enable_if<std::is_same<
+        decltype(GraphInterface::wto_cache(
+            std::declval<const typename GraphInterface::Graph&>(), false)),
+        WtoCache<typename GraphInterface::NodeId, NodeHash>*>::value>::type>::
+        type> {
+  static WtoCache<typename GraphInterface::NodeId, NodeHash>* get(
+      const typename GraphInterface::Graph& graph) {
+    return GraphInterface::wto_cache(graph, /* backwards */ false);
+  }
+};
+
+} // namespace mfi_impl
+
+/*
+ * How much work the last run of a MonotonicFixpointIterator took.
+ */
+struct MonotonicFixpointIteratorStats {
+  // The number of times a node transformer was applied.
+  size_t analyzed_nodes{0};
+  // The largest number of iterations a strongly connected component needed to
+  // stabilize.
+  uint32_t max_iterations{0};
+  // The number of strongly connected components that ran out of iteration
+  // budget and were set to Top.
+  size_t exhausted_sccs{0};
+
+  MonotonicFixpointIteratorStats& operator+=(
+      const MonotonicFixpointIteratorStats& that) {
+    analyzed_nodes += that.analyzed_nodes;
+    max_iterations = std::max(max_iterations, that.max_iterations);
+    exhausted_sccs += that.exhausted_sccs;
+    return *this;
+  }
+};
+
 /*
  * This data structure contains the current state of the fixpoint iteration,
  * which is provided to the user when an extrapolation step is executed, so as
@@ -79,6 +144,7 @@ class MonotonicFixpointIteratorContext final {
   const Domain& m_init;
   std::unordered_map<NodeId, uint32_t, NodeHash> m_global_iterations;
   std::unordered_map<NodeId, uint32_t, NodeHash> m_local_iterations;
+  MonotonicFixpointIteratorStats m_stats;
 
   template <typename T1, typename T2, typename T3>
   friend class MonotonicFixpointIterator;
@@ -104,6 +170,7 @@ class MonotonicFixpointIterator
   using NodeId = typename GraphInterface::NodeId;
   using EdgeId = typename GraphInterface::EdgeId;
   using Context = MonotonicFixpointIteratorContext<NodeId, Domain, NodeHash>;
+  using Wto = WeakTopologicalOrdering<NodeId, NodeHash>;
 
   /*
    * When the number of nodes in the CFG is known, it's better to provide it to
@@ -112,18 +179,7 @@ class MonotonicFixpointIterator
    */
   MonotonicFixpointIterator(const Graph& graph, size_t cfg_size_hint = 4)
       : m_graph(graph),
-        m_wto(GraphInterface::entry(graph),
-              [=, &graph](const NodeId& x) {
-                const auto& succ_edges = GraphInterface::successors(graph, x);
-                std::vector<NodeId> succ_nodes;
-                std::transform(succ_edges.begin(),
-                               succ_edges.end(),
-                               std::back_inserter(succ_nodes),
-                               std::bind(&GraphInterface::target,
-                                         std::ref(graph),
-                                         std::placeholders::_1));
-                return succ_nodes;
-              }),
+        m_wto(make_wto(graph)),
         m_entry_states(cfg_size_hint),
         m_exit_states(cfg_size_hint) {}
 
@@ -157,12 +213,213 @@ class MonotonicFixpointIterator
    */
   void run(const Domain& init) {
     clear();
+    m_init = init;
+    Context context(init);
+    for (const WtoComponent<NodeId>& component : *m_wto) {
+      analyze_component(&context, component);
+    }
+    m_stats = context.m_stats;
+  }
+
+  /*
+   * Same as run(), but analyzes independent toplevel components of the weak
+   * topological ordering concurrently on `num_threads` threads. A component
+   * is analyzed once all the components holding one of its predecessors are
+   * done; the nodes of a strongly connected component are still iterated
+   * sequentially by a single thread. The result is the same as run()'s.
+   *
+   * Node and edge transformers (and extrapolate()) are then invoked from
+   * several threads at once, on distinct nodes, and must be safe to use that
+   * way. They may read the entry and exit states of the nodes they depend on.
+   */
+  void run_parallel(const Domain& init, size_t num_threads) {
+    if (num_threads <= 1) {
+      run(init);
+      return;
+    }
+    clear();
+    m_init = init;
+    m_stats = MonotonicFixpointIteratorStats();
+    std::vector<const WtoComponent<NodeId>*> components;
+    std::unordered_map<NodeId, size_t, NodeHash> component_of;
+    for (const WtoComponent<NodeId>& component : *m_wto) {
+      collect_nodes(component, components.size(), &component_of);
+      components.push_back(&component);
+    }
+    // All the states are allocated upfront, so that the hash tables are never
+    // resized while the threads are running. Setting the state of a reachable
+    // node to _|_ is the same as leaving it out (see `get_exit_state_at`).
+    m_entry_states.reserve(component_of.size());
+    m_exit_states.reserve(component_of.size());
+    for (const auto& pair : component_of) {
+      m_entry_states.emplace(pair.first, Domain::bottom());
+      m_exit_states.emplace(pair.first, Domain::bottom());
+    }
+
+    std::vector<std::vector<size_t>> dependents(components.size());
+    std::vector<size_t> pending(components.size(), 0);
+    for (const auto& pair : component_of) {
+      size_t target = pair.second;
+      for (EdgeId edge : GraphInterface::predecessors(m_graph, pair.first)) {
+        auto it = component_of.find(GraphInterface::source(m_graph, edge));
+        if (it != component_of.end() && it->second != target) {
+          dependents[it->second].push_back(target);
+        }
+      }
+    }
+    for (auto& targets : dependents) {
+      std::sort(targets.begin(), targets.end());
+      targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+      for (size_t target : targets) {
+        ++pending[target];
+      }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready_cv;
+    std::deque<size_t> ready;
+    size_t remaining = components.size();
+    std::exception_ptr error;
+    for (size_t i = 0; i < components.size(); ++i) {
+      if (pending[i] == 0) {
+        ready.push_back(i);
+      }
+    }
+
+    auto worker = [&]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true) {
+        ready_cv.wait(lock, [&] {
+          return !ready.empty() || remaining == 0 || error;
+        });
+        if (remaining == 0 || error) {
+          return;
+        }
+        size_t index = ready.front();
+        ready.pop_front();
+        lock.unlock();
+        MonotonicFixpointIteratorStats stats;
+        try {
+          // Iteration counts are kept per SCC head, and each head belongs to
+          // exactly one toplevel component.
+          Context context(init);
+          analyze_component(&context, *components[index]);
+          stats = context.m_stats;
+        } catch (...) {
+          lock.lock();
+          error = std::current_exception();
+          ready_cv.notify_all();
+          return;
+        }
+        lock.lock();
+        m_stats += stats;
+        --remaining;
+        for (size_t target : dependents[index]) {
+          if (--pending[target] == 0) {
+            ready.push_back(target);
+          }
+        }
+        ready_cv.notify_all();
+      }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  /*
+   * Brings the result of the last run up to date after the node transformers
+   * of `changed_nodes` have changed, e.g. because a pass edited the
+   * corresponding blocks, and/or for a different initial value. Only the
+   * toplevel components of the weak topological ordering that hold a changed
+   * node, or a successor of a node whose exit state has changed, are analyzed
+   * again; the states of all the other nodes are reused. The result is the
+   * same as run(init)'s.
+   *
+   * The graph itself must not have changed since the iterator was created. If
+   * there was no previous run, this is just run(init).
+   */
+  void rerun(const Domain& init, const std::vector<NodeId>& changed_nodes) {
+    if (!m_init) {
+      run(init);
+      return;
+    }
+    std::unordered_set<NodeId, NodeHash> dirty(changed_nodes.begin(),
+                                               changed_nodes.end());
+    if (!init.equals(*m_init)) {
+      dirty.insert(GraphInterface::entry(m_graph));
+      *m_init = init;
+    }
     Context context(init);
-    for (const WtoComponent<NodeId>& component : m_wto) {
+    std::unordered_set<NodeId, NodeHash> changed_exits;
+    auto is_affected = [&](const NodeId& node) {
+      if (dirty.count(node) != 0) {
+        return true;
+      }
+      for (EdgeId edge : GraphInterface::predecessors(m_graph, node)) {
+        if (changed_exits.count(GraphInterface::source(m_graph, edge)) != 0) {
+          return true;
+        }
+      }
+      return false;
+    };
+    std::unordered_map<NodeId, size_t, NodeHash> nodes;
+    for (const WtoComponent<NodeId>& component : *m_wto) {
+      nodes.clear();
+      collect_nodes(component, /* index */ 0, &nodes);
+      if (std::none_of(nodes.begin(), nodes.end(), [&](const auto& pair) {
+            return is_affected(pair.first);
+          })) {
+        continue;
+      }
+      // The nodes of the component start from _|_ again, as in run(). In
+      // particular, the back edges of an SCC must not carry the old states.
+      std::unordered_map<NodeId, Domain, NodeHash> old_exit_states;
+      for (const auto& pair : nodes) {
+        auto it = m_exit_states.find(pair.first);
+        if (it != m_exit_states.end()) {
+          old_exit_states.emplace(pair.first, std::move(it->second));
+          m_exit_states.erase(it);
+        }
+        m_entry_states.erase(pair.first);
+      }
       analyze_component(&context, component);
+      for (const auto& pair : nodes) {
+        auto it = old_exit_states.find(pair.first);
+        bool unchanged = (it == old_exit_states.end())
+                             ? get_exit_state_at(pair.first).is_bottom()
+                             : it->second.equals(get_exit_state_at(pair.first));
+        if (!unchanged) {
+          changed_exits.insert(pair.first);
+        }
+      }
     }
+    m_stats = context.m_stats;
   }
 
+  /*
+   * Bounds the number of iterations of each strongly connected component of
+   * the graph. The head of an SCC that hasn't stabilized after `budget`
+   * iterations is set to Top, which is a post-fixpoint, and the rest of the
+   * SCC is analyzed once more from there. This trades precision for a bounded
+   * running time on pathological inputs; get_stats() tells whether it
+   * happened. Zero, the default, means no limit.
+   */
+  void set_iteration_budget(uint32_t budget) { m_iteration_budget = budget; }
+
+  /*
+   * Returns the statistics of the last run (or rerun).
+   */
+  const MonotonicFixpointIteratorStats& get_stats() const { return m_stats; }
+
   /*
    * Returns the invariant computed by the fixpoint iterator at a node entry.
    */
@@ -199,6 +456,42 @@ class MonotonicFixpointIterator
     m_exit_states.clear();
   }
 
+  // Reuses the WTO cached by the graph interface, if it has a cache (see
+  // WtoCache).
+  static std::shared_ptr<const Wto> make_wto(const Graph& graph) {
+    auto build = [&graph]() {
+      return std::make_shared<const Wto>(
+          GraphInterface::entry(graph), [&graph](const NodeId& x) {
+            const auto& succ_edges = GraphInterface::successors(graph, x);
+            std::vector<NodeId> succ_nodes;
+            std::transform(succ_edges.begin(),
+                           succ_edges.end(),
+                           std::back_inserter(succ_nodes),
+                           std::bind(&GraphInterface::target,
+                                     std::ref(graph),
+                                     std::placeholders::_1));
+            return succ_nodes;
+          });
+    };
+    auto cache = mfi_impl::WtoCacheOf<GraphInterface, NodeHash>::get(graph);
+    if (cache == nullptr) {
+      return build();
+    }
+    return cache->get(GraphInterface::entry(graph), build);
+  }
+
+  static void collect_nodes(
+      const WtoComponent<NodeId>& component,
+      size_t index,
+      std::unordered_map<NodeId, size_t, NodeHash>* component_of) {
+    component_of->emplace(component.head_node(), index);
+    if (component.is_scc()) {
+      for (const auto& subcomponent : component) {
+        collect_nodes(subcomponent, index, component_of);
+      }
+    }
+  }
+
   void compute_entry_state(Context* context,
                            const NodeId& node,
                            Domain* placeholder) {
@@ -235,6 +528,7 @@ class MonotonicFixpointIterator
     Domain& exit_state = m_exit_states[node];
     exit_state = entry_state;
     this->analyze_node(node, &exit_state);
+    ++context->m_stats.analyzed_nodes;
   }
 
   void analyze_scc(Context* context, const WtoComponent<NodeId>& scc) {
@@ -264,14 +558,44 @@ class MonotonicFixpointIterator
         // it's better to use it as the final result of the iteration sequence.
         *current_state = std::move(new_state);
         iterate = false;
+      } else if (m_iteration_budget != 0 &&
+                 context->get_local_iterations_for(head) + 1 >=
+                     m_iteration_budget) {
+        ++context->m_stats.exhausted_sccs;
+        analyze_scc_from_top(context, scc);
+        iterate = false;
       } else {
         extrapolate(*context, head, current_state, new_state);
       }
     }
+    auto& stats = context->m_stats;
+    stats.max_iterations = std::max(stats.max_iterations,
+                                    context->get_local_iterations_for(head));
+  }
+
+  // Sets the entry state of the SCC's head to Top and propagates it through
+  // the SCC. Whatever flows back into the head is below Top, hence the result
+  // is a post-fixpoint.
+  void analyze_scc_from_top(Context* context,
+                            const WtoComponent<NodeId>& scc) {
+    NodeId head = scc.head_node();
+    Domain& entry_state = m_entry_states[head];
+    entry_state.set_to_top();
+    Domain& exit_state = m_exit_states[head];
+    exit_state = entry_state;
+    this->analyze_node(head, &exit_state);
+    ++context->m_stats.analyzed_nodes;
+    for (const auto& component : scc) {
+      analyze_component(context, component);
+    }
   }
 
   const Graph& m_graph;
-  WeakTopologicalOrdering<NodeId, NodeHash> m_wto;
+  std::shared_ptr<const Wto> m_wto;
+  // The initial value of the last run, which rerun() compares against.
+  boost::optional<Domain> m_init;
+  uint32_t m_iteration_budget{0};
+  MonotonicFixpointIteratorStats m_stats;
   std::unordered_map<NodeId, Domain, NodeHash> m_entry_states;
   std::unordered_map<NodeId, Domain, NodeHash> m_exit_states;
 };
@@ -302,12 +626,14 @@ class BackwardsFixpointIterationAdaptor {
   static NodeId exit(const Graph& graph) {
     return GraphInterface::entry(graph);
   }
-  static std::vector<EdgeId> predecessors(const Graph& graph,
-                                          const NodeId& node) {
+  // The edges are returned in whatever iterable the underlying interface
+  // uses, so that graphs exposing ranges over their own storage aren't copied.
+  static auto predecessors(const Graph& graph, const NodeId& node)
+      -> decltype(GraphInterface::successors(graph, node)) {
     return GraphInterface::successors(graph, node);
   }
-  static std::vector<EdgeId> successors(const Graph& graph,
-                                        const NodeId& node) {
+  static auto successors(const Graph& graph, const NodeId& node)
+      -> decltype(GraphInterface::predecessors(graph, node)) {
     return GraphInterface::predecessors(graph, node);
   }
   static NodeId source(const Graph& graph, const EdgeId& edge) {
@@ -316,6 +642,11 @@ class BackwardsFixpointIterationAdaptor {
   static NodeId target(const Graph& graph, const EdgeId& edge) {
     return GraphInterface::source(graph, edge);
   }
+  template <typename GI = GraphInterface>
+  static auto wto_cache(const Graph& graph, bool backwards)
+      -> decltype(GI::wto_cache(graph, backwards)) {
+    return GI::wto_cache(graph, !backwards);
+  }
 };
 
 } // namespace sparta
@@ -39,6 +39,8 @@ namespace sparta {
 // Forward declarations.
 namespace ptmap_impl {
 
+using namespace pt_util;
+
 template <typename IntegerType, typename Value>
 class PatriciaTree;
 
@@ -54,41 +56,41 @@ using CombiningFunction = std::function<T(const T&, const T&)>;
 template <typename IntegerType, typename Value>
 inline const typename Value::type* find_value(
     IntegerType key,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree);
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree);
 
 template <typename IntegerType, typename Value>
-inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1,
-                const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree2);
+inline bool leq(const NodePtr<PatriciaTree<IntegerType, Value>>& tree1,
+                const NodePtr<PatriciaTree<IntegerType, Value>>& tree2);
 
 template <typename IntegerType, typename Value>
 inline bool equals(
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree2);
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree1,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree2);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
+inline NodePtr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
     const CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
+inline NodePtr<PatriciaTree<IntegerType, Value>> update(
     const CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree);
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
+inline NodePtr<PatriciaTree<IntegerType, Value>> merge(
     const CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t);
+    const NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& t);
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
+inline NodePtr<PatriciaTree<IntegerType, Value>> intersect(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t);
+    const NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& t);
 
 template <typename T>
 T snd(const T&, const T& second) {
@@ -350,7 +352,7 @@ class PatriciaTreeMap final {
     return x;
   }
 
-  std::shared_ptr<ptmap_impl::PatriciaTree<IntegerType, Value>> m_tree;
+  pt_util::NodePtr<ptmap_impl::PatriciaTree<IntegerType, Value>> m_tree;
 
   template <typename T, typename VT, typename V>
   friend std::ostream& ::operator<<(std::ostream&,
@@ -383,10 +385,8 @@ namespace sparta {
 
 namespace ptmap_impl {
 
-using namespace pt_util;
-
 template <typename IntegerType, typename Value>
-class PatriciaTree {
+class PatriciaTree : public RefCountedNode {
  public:
   // A Patricia tree is an immutable structure.
   PatriciaTree& operator=(const PatriciaTree& other) = delete;
@@ -410,8 +410,8 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType, Value> {
   PatriciaTreeBranch(
       IntegerType prefix,
       IntegerType branching_bit,
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& left_tree,
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& right_tree)
+      const NodePtr<PatriciaTree<IntegerType, Value>>& left_tree,
+      const NodePtr<PatriciaTree<IntegerType, Value>>& right_tree)
       : m_prefix(prefix),
         m_stacking_bit(branching_bit),
         m_left_tree(left_tree),
@@ -423,19 +423,19 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType, Value> {
 
   IntegerType branching_bit() const { return m_stacking_bit; }
 
-  const std::shared_ptr<PatriciaTree<IntegerType, Value>>& left_tree() const {
+  const NodePtr<PatriciaTree<IntegerType, Value>>& left_tree() const {
     return m_left_tree;
   }
 
-  const std::shared_ptr<PatriciaTree<IntegerType, Value>>& right_tree() const {
+  const NodePtr<PatriciaTree<IntegerType, Value>>& right_tree() const {
     return m_right_tree;
   }
 
  private:
   IntegerType m_prefix;
   IntegerType m_stacking_bit;
-  std::shared_ptr<PatriciaTree<IntegerType, Value>> m_left_tree;
-  std::shared_ptr<PatriciaTree<IntegerType, Value>> m_right_tree;
+  NodePtr<PatriciaTree<IntegerType, Value>> m_left_tree;
+  NodePtr<PatriciaTree<IntegerType, Value>> m_right_tree;
 };
 
 template <typename IntegerType, typename Value>
@@ -460,17 +460,17 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType, Value> {
 };
 
 template <typename IntegerType, typename Value>
-std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
+NodePtr<PatriciaTreeBranch<IntegerType, Value>> join(
     IntegerType prefix0,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree0,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree0,
     IntegerType prefix1,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return make_node<PatriciaTreeBranch<IntegerType, Value>>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return make_node<PatriciaTreeBranch<IntegerType, Value>>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -478,18 +478,18 @@ std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>> join(
 // This function is used to prevent the creation of branch nodes with only one
 // child.
 template <typename IntegerType, typename Value>
-std::shared_ptr<PatriciaTree<IntegerType, Value>> make_branch(
+NodePtr<PatriciaTree<IntegerType, Value>> make_branch(
     IntegerType prefix,
     IntegerType branching_bit,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& left_tree,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& right_tree) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& left_tree,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& right_tree) {
   if (left_tree == nullptr) {
     return right_tree;
   }
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+  return make_node<PatriciaTreeBranch<IntegerType, Value>>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
@@ -498,20 +498,18 @@ std::shared_ptr<PatriciaTree<IntegerType, Value>> make_branch(
 template <typename IntegerType, typename Value>
 inline const typename Value::type* find_value(
     IntegerType key,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
     if (key == leaf->key()) {
       return &leaf->value();
     }
     return nullptr;
   }
-  const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
+  auto branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
   if (is_zero_bit(key, branch->branching_bit())) {
     return find_value(key, branch->left_tree());
   } else {
@@ -520,8 +518,8 @@ inline const typename Value::type* find_value(
 }
 
 template <typename IntegerType, typename Value>
-inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-                const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
+inline bool leq(const NodePtr<PatriciaTree<IntegerType, Value>>& s,
+                const NodePtr<PatriciaTree<IntegerType, Value>>& t) {
   if (s == t) {
     // This condition allows the leq operation to run in sublinear time when
     // comparing Patricia trees that share some structure.
@@ -537,26 +535,21 @@ inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
     if (t->is_branch()) {
       return !Value::default_value().is_top();
     }
-    const auto& s_leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
-    const auto& t_leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+    auto s_leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
+    auto t_leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     return s_leaf->key() == t_leaf->key() &&
            Value::leq(s_leaf->value(), t_leaf->value());
   }
   if (t->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     auto* s_value = find_value(leaf->key(), s);
     if (s_value == nullptr) {
       return Value::leq(Value::default_value(), leaf->value());
     }
     return Value::leq(*s_value, leaf->value());
   }
-  const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
-  const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+  auto s_branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
+  auto t_branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -580,8 +573,8 @@ inline bool leq(const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
 // Hence, set equality is equivalent to structural equality of Patricia trees.
 template <typename IntegerType, typename Value>
 inline bool equals(
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree2) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree1,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree2) {
   if (tree1 == tree2) {
     // This conditions allows the equality test to run in sublinear time when
     // comparing Patricia trees that share some structure.
@@ -597,20 +590,16 @@ inline bool equals(
     if (tree2->is_branch()) {
       return false;
     }
-    const auto& leaf1 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree1);
-    const auto& leaf2 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree2);
+    auto leaf1 = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree1);
+    auto leaf2 = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree2);
     return leaf1->key() == leaf2->key() &&
            Value::equals(leaf1->value(), leaf2->value());
   }
   if (tree2->is_leaf()) {
     return false;
   }
-  const auto& branch1 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree1);
-  const auto& branch2 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree2);
+  auto branch1 = node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree1);
+  auto branch2 = node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree2);
   return branch1->prefix() == branch2->prefix() &&
          branch1->branching_bit() == branch2->branching_bit() &&
          equals(branch1->left_tree(), branch2->left_tree()) &&
@@ -621,17 +610,16 @@ inline bool equals(
 // value with combine(bound_value, :value). Note that the existing value is
 // always the first parameter to :combine and the new value is the second.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
+inline NodePtr<PatriciaTree<IntegerType, Value>> update(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
   if (tree == nullptr) {
     return combine_new_leaf<IntegerType, Value>(combine, key, value);
   }
   if (tree->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(tree);
     if (key == leaf->key()) {
       return combine_leaf(combine, value, leaf);
     }
@@ -641,8 +629,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
     }
     return join<IntegerType, Value>(key, new_leaf, leaf->key(), leaf);
   }
-  const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
+  auto branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(tree);
   if (match_prefix(key, branch->prefix(), branch->branching_bit())) {
     if (is_zero_bit(key, branch->branching_bit())) {
       auto new_left_tree = update(combine, key, value, branch->left_tree());
@@ -674,10 +661,10 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> update(
 // We keep the notations of the paper so as to make the implementation easier
 // to follow.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
+inline NodePtr<PatriciaTree<IntegerType, Value>> merge(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& t) {
   if (s == t) {
     // This conditional is what allows the union operation to complete in
     // sublinear time when the operands share some structure.
@@ -690,19 +677,15 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
     return s;
   }
   if (s->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
     return update(combine, leaf->key(), leaf->value(), t);
   }
   if (t->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     return update(combine, leaf->key(), leaf->value(), s);
   }
-  const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
-  const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+  auto s_branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
+  auto t_branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -721,7 +704,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+    return make_node<PatriciaTreeBranch<IntegerType, Value>>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -731,14 +714,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_node<PatriciaTreeBranch<IntegerType, Value>>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(combine, s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_node<PatriciaTreeBranch<IntegerType, Value>>(
           p, m, s0, new_right);
     }
   }
@@ -749,14 +732,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_node<PatriciaTreeBranch<IntegerType, Value>>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(combine, s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType, Value>>(
+      return make_node<PatriciaTreeBranch<IntegerType, Value>>(
           q, n, t0, new_right);
     }
   }
@@ -766,16 +749,16 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> merge(
 
 // Combine :value with the value in :leaf.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_leaf(
+inline NodePtr<PatriciaTree<IntegerType, Value>> combine_leaf(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     const typename Value::type& value,
-    const std::shared_ptr<PatriciaTreeLeaf<IntegerType, Value>>& leaf) {
+    PatriciaTreeLeaf<IntegerType, Value>* leaf) {
   auto combined_value = combine(leaf->value(), value);
   if (Value::is_default_value(combined_value)) {
     return nullptr;
   }
   if (!Value::equals(combined_value, leaf->value())) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
+    return make_node<PatriciaTreeLeaf<IntegerType, Value>>(
         leaf->key(), combined_value);
   }
   return leaf;
@@ -783,20 +766,20 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_leaf(
 
 // Create a new leaf with a Top value and combine :value into it.
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
+inline NodePtr<PatriciaTree<IntegerType, Value>> combine_new_leaf(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
     IntegerType key,
     const typename Value::type& value) {
-  auto new_leaf = std::make_shared<PatriciaTreeLeaf<IntegerType, Value>>(
+  auto new_leaf = make_node<PatriciaTreeLeaf<IntegerType, Value>>(
       key, Value::default_value());
-  return combine_leaf(combine, value, new_leaf);
+  return combine_leaf(combine, value, new_leaf.get());
 }
 
 template <typename IntegerType, typename Value>
-inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
+inline NodePtr<PatriciaTree<IntegerType, Value>> intersect(
     const ptmap_impl::CombiningFunction<typename Value::type>& combine,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType, Value>>& t) {
+    const NodePtr<PatriciaTree<IntegerType, Value>>& s,
+    const NodePtr<PatriciaTree<IntegerType, Value>>& t) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
@@ -806,8 +789,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
     return nullptr;
   }
   if (s->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(s);
     auto* value = find_value(leaf->key(), t);
     if (value == nullptr) {
       return nullptr;
@@ -815,18 +797,15 @@ inline std::shared_ptr<PatriciaTree<IntegerType, Value>> intersect(
     return combine_leaf(combine, *value, leaf);
   }
   if (t->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
     auto* value = find_value(leaf->key(), s);
     if (value == nullptr) {
       return nullptr;
     }
     return combine_leaf(combine, *value, leaf);
   }
-  const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
-  const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+  auto s_branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(s);
+  auto t_branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -888,7 +867,7 @@ class PatriciaTreeIterator final {
   PatriciaTreeIterator() {}
 
   explicit PatriciaTreeIterator(
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+      const NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
     if (tree == nullptr) {
       return;
     }
@@ -939,24 +918,23 @@ class PatriciaTreeIterator final {
  private:
   // The argument is never null.
   void go_to_next_leaf(
-      const std::shared_ptr<PatriciaTree<IntegerType, Value>>& tree) {
+      const NodePtr<PatriciaTree<IntegerType, Value>>& tree) {
     auto t = tree;
     // We go to the leftmost leaf, storing the branches that we're traversing
     // on the stack. By definition of a Patricia tree, a branch node always
     // has two children, hence the leftmost leaf always exists.
     while (t->is_branch()) {
-      auto branch =
-          std::static_pointer_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
+      auto branch = node_cast<PatriciaTreeBranch<IntegerType, Value>>(t);
       m_stack.push(branch);
       t = branch->left_tree();
       // A branch node always has two children.
       RUNTIME_CHECK(t != nullptr, internal_error());
     }
-    m_leaf = std::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
+    m_leaf = node_cast<PatriciaTreeLeaf<IntegerType, Value>>(t);
   }
 
-  std::stack<std::shared_ptr<PatriciaTreeBranch<IntegerType, Value>>> m_stack;
-  std::shared_ptr<PatriciaTreeLeaf<IntegerType, Value>> m_leaf;
+  std::stack<NodePtr<PatriciaTreeBranch<IntegerType, Value>>> m_stack;
+  NodePtr<PatriciaTreeLeaf<IntegerType, Value>> m_leaf;
 };
 
 } // namespace ptmap_impl
@@ -8,15 +8,19 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <stack>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 
 #include <boost/functional/hash.hpp>
@@ -26,12 +30,47 @@
 
 namespace sparta {
 
+/*
+ * Optional hash-consing of the nodes of PatriciaTreeSets. When it is enabled,
+ * every node is looked up in a global table before it is created, so that two
+ * sets with the same elements are represented by the same tree no matter how
+ * they were built, and comparing them is a pointer comparison. The results of
+ * unions, intersections and differences of large subtrees are also kept in a
+ * bounded cache, which pays off in analyses that keep joining the same sets.
+ *
+ * The lookups take a (sharded) lock, so this is off by default. It can be
+ * switched on and off at any time: nodes created while it is off simply don't
+ * benefit from it.
+ */
+class PatriciaTreeHashConsing final {
+ public:
+  static void enable(bool enabled = true) {
+    flag().store(enabled, std::memory_order_relaxed);
+  }
+
+  static bool is_enabled() { return flag().load(std::memory_order_relaxed); }
+
+ private:
+  static std::atomic<bool>& flag() {
+    static std::atomic<bool> enabled{false};
+    return enabled;
+  }
+};
+
 // Forward declarations.
 namespace pt_impl {
 
+using namespace pt_util;
+
 template <typename IntegerType>
 class PatriciaTree;
 
+template <typename IntegerType>
+class PatriciaTreeBranch;
+
+template <typename IntegerType>
+class HashConsingTable;
+
 template <typename IntegerType>
 class PatriciaTreeLeaf;
 
@@ -40,44 +79,59 @@ class PatriciaTreeIterator;
 
 template <typename IntegerType>
 inline bool contains(IntegerType key,
-                     const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+                     const NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
 inline bool is_subset_of(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree2);
+    const NodePtr<PatriciaTree<IntegerType>>& tree1,
+    const NodePtr<PatriciaTree<IntegerType>>& tree2);
 
 template <typename IntegerType>
-inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-                   const std::shared_ptr<PatriciaTree<IntegerType>>& tree2);
+inline bool equals(const NodePtr<PatriciaTree<IntegerType>>& tree1,
+                   const NodePtr<PatriciaTree<IntegerType>>& tree2);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+inline NodePtr<PatriciaTree<IntegerType>> insert(
+    IntegerType key, const NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> remove(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+inline NodePtr<PatriciaTree<IntegerType>> remove(
+    IntegerType key, const NodePtr<PatriciaTree<IntegerType>>& tree);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
+inline NodePtr<PatriciaTree<IntegerType>> filter(
     const std::function<bool(IntegerType)>& predicate,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree);
+    const NodePtr<PatriciaTree<IntegerType>>& tree);
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTree<IntegerType>> merge(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t);
+inline NodePtr<PatriciaTree<IntegerType>> intersect(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t);
+inline NodePtr<PatriciaTree<IntegerType>> diff(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t);
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t);
+inline NodePtr<PatriciaTree<IntegerType>> merge_nodes(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t);
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTree<IntegerType>> intersect_nodes(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t);
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTree<IntegerType>> diff_nodes(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t);
 
 } // namespace pt_impl
 
@@ -97,10 +151,11 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
  * by the program. This effectively achieves a form of incremental hash-consing.
  * Note that it's not perfect, since identical trees that are independently
  * constructed are not equated, but it's a lot more efficient than regular
- * hash-consing. This data structure doesn't just reduce the memory footprint of
- * sets, it also significantly speeds up certain operations. Whenever two sets
- * represented as Patricia trees share some structure, their union and
- * intersection can often be computed in sublinear time.
+ * hash-consing (which can be enabled with PatriciaTreeHashConsing). This data
+ * structure doesn't just reduce the memory footprint of sets, it also
+ * significantly speeds up certain operations. Whenever two sets represented as
+ * Patricia trees share some structure, their union and intersection can often
+ * be computed in sublinear time.
  *
  * Patricia trees can only handle unsigned integers. Arbitrary objects can be
  * accommodated as long as they are represented as pointers. Our implementation
@@ -309,7 +364,7 @@ class PatriciaTreeSet final {
     return x;
   }
 
-  std::shared_ptr<pt_impl::PatriciaTree<IntegerType>> m_tree;
+  pt_util::NodePtr<pt_impl::PatriciaTree<IntegerType>> m_tree;
 
   template <typename T>
   friend class pt_impl::PatriciaTreeIterator;
@@ -317,10 +372,8 @@ class PatriciaTreeSet final {
 
 namespace pt_impl {
 
-using namespace pt_util;
-
 template <typename IntegerType>
-class PatriciaTree {
+class PatriciaTree : public RefCountedNode {
  public:
   // A Patricia tree is an immutable structure.
   PatriciaTree& operator=(const PatriciaTree& other) = delete;
@@ -341,6 +394,12 @@ class PatriciaTree {
 
   void set_hash(size_t h) { m_hash = h; }
 
+  // Whether the node is the unique representative of its tree in the
+  // hash-consing table, which only holds weak references.
+  bool is_hash_consed() const { return this->is_weakly_referenced(); }
+
+  void set_hash_consed() { this->mark_weakly_referenced(); }
+
  private:
   size_t m_hash;
 };
@@ -358,8 +417,8 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType> {
  public:
   PatriciaTreeBranch(IntegerType prefix,
                      IntegerType branching_bit,
-                     std::shared_ptr<PatriciaTree<IntegerType>> left_tree,
-                     std::shared_ptr<PatriciaTree<IntegerType>> right_tree)
+                     NodePtr<PatriciaTree<IntegerType>> left_tree,
+                     NodePtr<PatriciaTree<IntegerType>> right_tree)
       : m_prefix(prefix),
         m_branching_bit(branching_bit),
         m_left_tree(left_tree),
@@ -372,25 +431,31 @@ class PatriciaTreeBranch final : public PatriciaTree<IntegerType> {
     this->set_hash(seed);
   }
 
+  ~PatriciaTreeBranch() override {
+    if (this->is_hash_consed()) {
+      HashConsingTable<IntegerType>::get().forget(*this);
+    }
+  }
+
   bool is_leaf() const override { return false; }
 
   IntegerType prefix() const { return m_prefix; }
 
   IntegerType branching_bit() const { return m_branching_bit; }
 
-  const std::shared_ptr<PatriciaTree<IntegerType>>& left_tree() const {
+  const NodePtr<PatriciaTree<IntegerType>>& left_tree() const {
     return m_left_tree;
   }
 
-  const std::shared_ptr<PatriciaTree<IntegerType>>& right_tree() const {
+  const NodePtr<PatriciaTree<IntegerType>>& right_tree() const {
     return m_right_tree;
   }
 
  private:
   IntegerType m_prefix;
   IntegerType m_branching_bit;
-  std::shared_ptr<PatriciaTree<IntegerType>> m_left_tree;
-  std::shared_ptr<PatriciaTree<IntegerType>> m_right_tree;
+  NodePtr<PatriciaTree<IntegerType>> m_left_tree;
+  NodePtr<PatriciaTree<IntegerType>> m_right_tree;
 };
 
 template <typename IntegerType>
@@ -401,6 +466,12 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType> {
     this->set_hash(hasher(key));
   }
 
+  ~PatriciaTreeLeaf() override {
+    if (this->is_hash_consed()) {
+      HashConsingTable<IntegerType>::get().forget(*this);
+    }
+  }
+
   bool is_leaf() const override { return true; }
 
   const IntegerType& key() const { return m_key; }
@@ -409,18 +480,251 @@ class PatriciaTreeLeaf final : public PatriciaTree<IntegerType> {
   IntegerType m_key;
 };
 
+/*
+ * Maps the contents of a node (its key, or its prefix, branching bit and
+ * children) to the live node with those contents. Since the children of a
+ * hash-consed branch are hash-consed themselves, they can be compared by
+ * address. The table only holds weak references; nodes remove themselves when
+ * they are destroyed.
+ */
 template <typename IntegerType>
-std::shared_ptr<PatriciaTreeBranch<IntegerType>> join(
+class HashConsingTable final {
+ public:
+  using Leaf = PatriciaTreeLeaf<IntegerType>;
+  using Branch = PatriciaTreeBranch<IntegerType>;
+  using TreePtr = NodePtr<PatriciaTree<IntegerType>>;
+
+  static HashConsingTable& get() {
+    // Leaked on purpose: trees may still be destroyed during static
+    // destruction.
+    static auto* table = new HashConsingTable();
+    return *table;
+  }
+
+  NodePtr<Leaf> leaf(IntegerType key) {
+    return intern(&m_leaves, key, [&]() { return make_node<Leaf>(key); });
+  }
+
+  NodePtr<Branch> branch(IntegerType prefix,
+                                 IntegerType branching_bit,
+                                 const TreePtr& left_tree,
+                                 const TreePtr& right_tree) {
+    return intern(
+        &m_branches,
+        BranchKey{prefix, branching_bit, left_tree.get(), right_tree.get()},
+        [&]() {
+          return make_node<Branch>(
+              prefix, branching_bit, left_tree, right_tree);
+        });
+  }
+
+  void forget(const Leaf& leaf) { forget(&m_leaves, leaf.key(), &leaf); }
+
+  void forget(const Branch& branch) {
+    forget(&m_branches,
+           BranchKey{branch.prefix(), branch.branching_bit(),
+                     branch.left_tree().get(), branch.right_tree().get()},
+           &branch);
+  }
+
+ private:
+  struct BranchKey {
+    IntegerType prefix;
+    IntegerType branching_bit;
+    const PatriciaTree<IntegerType>* left_tree;
+    const PatriciaTree<IntegerType>* right_tree;
+
+    bool operator==(const BranchKey& other) const {
+      return prefix == other.prefix && branching_bit == other.branching_bit &&
+             left_tree == other.left_tree && right_tree == other.right_tree;
+    }
+  };
+
+  struct BranchKeyHash {
+    size_t operator()(const BranchKey& key) const {
+      size_t seed = 0;
+      boost::hash_combine(seed, key.prefix);
+      boost::hash_combine(seed, key.branching_bit);
+      boost::hash_combine(seed, key.left_tree);
+      boost::hash_combine(seed, key.right_tree);
+      return seed;
+    }
+  };
+
+  template <typename Key, typename Node, typename Hash>
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, Node*, Hash> entries;
+  };
+
+  static constexpr size_t NUM_SHARDS = 16;
+
+  template <typename Key, typename Node, typename Hash>
+  using Shards = std::array<Shard<Key, Node, Hash>, NUM_SHARDS>;
+
+  template <typename Key, typename Node, typename Hash, typename MakeNode>
+  static NodePtr<Node> intern(Shards<Key, Node, Hash>* shards,
+                                      const Key& key,
+                                      MakeNode make_node) {
+    auto& shard = (*shards)[Hash()(key) % NUM_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& entry = shard.entries[key];
+    // The node can't be freed while it's in the table, since its destructor
+    // takes the lock to remove it.
+    if (entry != nullptr && entry->try_retain()) {
+      return NodePtr<Node>::adopt(entry);
+    }
+    // Either there is no such node, or it is being destroyed. In the latter
+    // case, its destructor will see that the entry has moved on.
+    auto node = make_node();
+    node->set_hash_consed();
+    entry = node.get();
+    return node;
+  }
+
+  template <typename Key, typename Node, typename Hash>
+  static void forget(Shards<Key, Node, Hash>* shards,
+                     const Key& key,
+                     const Node* node) {
+    auto& shard = (*shards)[Hash()(key) % NUM_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end() && it->second == node) {
+      shard.entries.erase(it);
+    }
+  }
+
+  Shards<IntegerType, Leaf, boost::hash<IntegerType>> m_leaves;
+  Shards<BranchKey, Branch, BranchKeyHash> m_branches;
+};
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTreeLeaf<IntegerType>> new_leaf(
+    IntegerType key) {
+  if (PatriciaTreeHashConsing::is_enabled()) {
+    return HashConsingTable<IntegerType>::get().leaf(key);
+  }
+  return make_node<PatriciaTreeLeaf<IntegerType>>(key);
+}
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTreeBranch<IntegerType>> new_branch(
+    IntegerType prefix,
+    IntegerType branching_bit,
+    const NodePtr<PatriciaTree<IntegerType>>& left_tree,
+    const NodePtr<PatriciaTree<IntegerType>>& right_tree) {
+  if (PatriciaTreeHashConsing::is_enabled() && left_tree->is_hash_consed() &&
+      right_tree->is_hash_consed()) {
+    return HashConsingTable<IntegerType>::get().branch(
+        prefix, branching_bit, left_tree, right_tree);
+  }
+  return make_node<PatriciaTreeBranch<IntegerType>>(
+      prefix, branching_bit, left_tree, right_tree);
+}
+
+enum class SetOperation { Merge, Intersect, Diff };
+
+/*
+ * A direct-mapped cache of the results of set operations on pairs of
+ * subtrees. The entries keep their operands alive, so that the addresses
+ * can't be reused by other trees while they are in the cache.
+ */
+template <typename IntegerType>
+class OperationCache final {
+ public:
+  using TreePtr = NodePtr<PatriciaTree<IntegerType>>;
+
+  static OperationCache& get() {
+    // Leaked on purpose, like the hash-consing table.
+    static auto* cache = new OperationCache();
+    return *cache;
+  }
+
+  bool find(SetOperation op,
+            const TreePtr& s,
+            const TreePtr& t,
+            TreePtr* result) {
+    size_t index = slot_index(op, s, t);
+    std::lock_guard<std::mutex> lock(m_locks[index % NUM_LOCKS]);
+    const auto& slot = m_slots[index];
+    if (slot.op != op || slot.s != s || slot.t != t) {
+      return false;
+    }
+    *result = slot.result;
+    return true;
+  }
+
+  void insert(SetOperation op,
+              const TreePtr& s,
+              const TreePtr& t,
+              const TreePtr& result) {
+    size_t index = slot_index(op, s, t);
+    Slot evicted{op, s, t, result};
+    {
+      std::lock_guard<std::mutex> lock(m_locks[index % NUM_LOCKS]);
+      std::swap(m_slots[index], evicted);
+    }
+    // The evicted trees are released here, outside of the lock, since
+    // destroying hash-consed nodes takes the locks of the table.
+  }
+
+ private:
+  struct Slot {
+    SetOperation op;
+    TreePtr s;
+    TreePtr t;
+    TreePtr result;
+  };
+
+  static constexpr size_t NUM_SLOTS = 4096;
+  static constexpr size_t NUM_LOCKS = 64;
+
+  static size_t slot_index(SetOperation op,
+                           const TreePtr& s,
+                           const TreePtr& t) {
+    size_t seed = static_cast<size_t>(op);
+    boost::hash_combine(seed, s->hash());
+    boost::hash_combine(seed, t->hash());
+    return seed % NUM_SLOTS;
+  }
+
+  std::array<Slot, NUM_SLOTS> m_slots;
+  std::array<std::mutex, NUM_LOCKS> m_locks;
+};
+
+template <typename IntegerType, typename Operation>
+inline NodePtr<PatriciaTree<IntegerType>> memoize(
+    SetOperation op,
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t,
+    Operation operation) {
+  // Leaves are cheap enough to handle directly.
+  if (!PatriciaTreeHashConsing::is_enabled() || s == t || s == nullptr ||
+      t == nullptr || s->is_leaf() || t->is_leaf()) {
+    return operation(s, t);
+  }
+  auto& cache = OperationCache<IntegerType>::get();
+  NodePtr<PatriciaTree<IntegerType>> result;
+  if (cache.find(op, s, t, &result)) {
+    return result;
+  }
+  result = operation(s, t);
+  cache.insert(op, s, t, result);
+  return result;
+}
+
+template <typename IntegerType>
+NodePtr<PatriciaTreeBranch<IntegerType>> join(
     IntegerType prefix0,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree0,
+    const NodePtr<PatriciaTree<IntegerType>>& tree0,
     IntegerType prefix1,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree1) {
+    const NodePtr<PatriciaTree<IntegerType>>& tree1) {
   IntegerType m = get_branching_bit(prefix0, prefix1);
   if (is_zero_bit(prefix0, m)) {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return new_branch<IntegerType>(
         mask(prefix0, m), m, tree0, tree1);
   } else {
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return new_branch<IntegerType>(
         mask(prefix0, m), m, tree1, tree0);
   }
 }
@@ -428,34 +732,32 @@ std::shared_ptr<PatriciaTreeBranch<IntegerType>> join(
 // This function is used by remove() to prevent the creation of branch nodes
 // with only one child.
 template <typename IntegerType>
-std::shared_ptr<PatriciaTree<IntegerType>> make_branch(
+NodePtr<PatriciaTree<IntegerType>> make_branch(
     IntegerType prefix,
     IntegerType branching_bit,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& left_tree,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& right_tree) {
+    const NodePtr<PatriciaTree<IntegerType>>& left_tree,
+    const NodePtr<PatriciaTree<IntegerType>>& right_tree) {
   if (left_tree == nullptr) {
     return right_tree;
   }
   if (right_tree == nullptr) {
     return left_tree;
   }
-  return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+  return new_branch<IntegerType>(
       prefix, branching_bit, left_tree, right_tree);
 }
 
 template <typename IntegerType>
 inline bool contains(IntegerType key,
-                     const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+                     const NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
     return false;
   }
   if (tree->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     return key == leaf->key();
   }
-  const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+  auto branch = node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   if (is_zero_bit(key, branch->branching_bit())) {
     return contains(key, branch->left_tree());
   } else {
@@ -465,8 +767,8 @@ inline bool contains(IntegerType key,
 
 template <typename IntegerType>
 inline bool is_subset_of(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree2) {
+    const NodePtr<PatriciaTree<IntegerType>>& tree1,
+    const NodePtr<PatriciaTree<IntegerType>>& tree2) {
   if (tree1 == tree2) {
     // This conditions allows the inclusion test to run in sublinear time
     // when comparing Patricia trees that share some structure.
@@ -479,17 +781,14 @@ inline bool is_subset_of(
     return false;
   }
   if (tree1->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
     return contains(leaf->key(), tree2);
   }
   if (tree2->is_leaf()) {
     return false;
   }
-  const auto& branch1 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree1);
-  const auto& branch2 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree2);
+  auto branch1 = node_cast<PatriciaTreeBranch<IntegerType>>(tree1);
+  auto branch2 = node_cast<PatriciaTreeBranch<IntegerType>>(tree2);
   if (branch1->prefix() == branch2->prefix() &&
       branch1->branching_bit() == branch2->branching_bit()) {
     return is_subset_of(branch1->left_tree(), branch2->left_tree()) &&
@@ -512,8 +811,8 @@ inline bool is_subset_of(
 // A Patricia tree is a canonical representation of the set of keys it contains.
 // Hence, set equality is equivalent to structural equality of Patricia trees.
 template <typename IntegerType>
-inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
-                   const std::shared_ptr<PatriciaTree<IntegerType>>& tree2) {
+inline bool equals(const NodePtr<PatriciaTree<IntegerType>>& tree1,
+                   const NodePtr<PatriciaTree<IntegerType>>& tree2) {
   if (tree1 == tree2) {
     // This conditions allows the equality test to run in sublinear time
     // when comparing Patricia trees that share some structure.
@@ -525,6 +824,10 @@ inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
   if (tree2 == nullptr) {
     return false;
   }
+  if (tree1->is_hash_consed() && tree2->is_hash_consed()) {
+    // Equal hash-consed trees are the same node.
+    return false;
+  }
   // Since the hash codes are readily available (they're computed when the trees
   // are constructed), we can use them to cut short the equality test.
   if (tree1->hash() != tree2->hash()) {
@@ -534,19 +837,15 @@ inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
     if (tree2->is_branch()) {
       return false;
     }
-    const auto& leaf1 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
-    const auto& leaf2 =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree2);
+    auto leaf1 = node_cast<PatriciaTreeLeaf<IntegerType>>(tree1);
+    auto leaf2 = node_cast<PatriciaTreeLeaf<IntegerType>>(tree2);
     return leaf1->key() == leaf2->key();
   }
   if (tree2->is_leaf()) {
     return false;
   }
-  const auto& branch1 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree1);
-  const auto& branch2 =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree2);
+  auto branch1 = node_cast<PatriciaTreeBranch<IntegerType>>(tree1);
+  auto branch2 = node_cast<PatriciaTreeBranch<IntegerType>>(tree2);
   return branch1->prefix() == branch2->prefix() &&
          branch1->branching_bit() == branch2->branching_bit() &&
          equals(branch1->left_tree(), branch2->left_tree()) &&
@@ -554,32 +853,30 @@ inline bool equals(const std::shared_ptr<PatriciaTree<IntegerType>>& tree1,
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+inline NodePtr<PatriciaTree<IntegerType>> insert(
+    IntegerType key, const NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
-    return std::make_shared<PatriciaTreeLeaf<IntegerType>>(key);
+    return new_leaf<IntegerType>(key);
   }
   if (tree->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     if (key == leaf->key()) {
       return leaf;
     }
     return join<IntegerType>(
         key,
-        std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+        new_leaf<IntegerType>(key),
         leaf->key(),
         leaf);
   }
-  const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+  auto branch = node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   if (match_prefix(key, branch->prefix(), branch->branching_bit())) {
     if (is_zero_bit(key, branch->branching_bit())) {
       auto new_left_tree = insert(key, branch->left_tree());
       if (new_left_tree == branch->left_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           new_left_tree,
@@ -589,7 +886,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
       if (new_right_tree == branch->right_tree()) {
         return branch;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           branch->prefix(),
           branch->branching_bit(),
           branch->left_tree(),
@@ -597,27 +894,25 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> insert(
     }
   }
   return join<IntegerType>(key,
-                           std::make_shared<PatriciaTreeLeaf<IntegerType>>(key),
+                           new_leaf<IntegerType>(key),
                            branch->prefix(),
                            branch);
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> remove(
-    IntegerType key, const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+inline NodePtr<PatriciaTree<IntegerType>> remove(
+    IntegerType key, const NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     if (key == leaf->key()) {
       return nullptr;
     }
     return leaf;
   }
-  const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+  auto branch = node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   if (match_prefix(key, branch->prefix(), branch->branching_bit())) {
     if (is_zero_bit(key, branch->branching_bit())) {
       auto new_left_tree = remove(key, branch->left_tree());
@@ -643,19 +938,17 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> remove(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
+inline NodePtr<PatriciaTree<IntegerType>> filter(
     const std::function<bool(IntegerType key)>& predicate,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+    const NodePtr<PatriciaTree<IntegerType>>& tree) {
   if (tree == nullptr) {
     return nullptr;
   }
   if (tree->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(tree);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(tree);
     return predicate(leaf->key()) ? leaf : nullptr;
   }
-  const auto& branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(tree);
+  auto branch = node_cast<PatriciaTreeBranch<IntegerType>>(tree);
   auto new_left_tree = filter(predicate, branch->left_tree());
   auto new_right_tree = filter(predicate, branch->right_tree());
   if (new_left_tree == branch->left_tree() &&
@@ -672,9 +965,17 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> filter(
 // We keep the notations of the paper so as to make the implementation easier
 // to follow.
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
+inline NodePtr<PatriciaTree<IntegerType>> merge(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t) {
+  return memoize<IntegerType>(
+      SetOperation::Merge, s, t, merge_nodes<IntegerType>);
+}
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTree<IntegerType>> merge_nodes(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s == t) {
     // This conditional is what allows the union operation to complete in
     // sublinear time when the operands share some structure.
@@ -690,19 +991,15 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
   // Otherwise, if s and t are both leaves, we would end up inserting s into t.
   // This would violate the assumptions required by `reference_equals()`.
   if (t->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(t);
     return insert(leaf->key(), s);
   }
   if (s->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(s);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(s);
     return insert(leaf->key(), t);
   }
-  const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(s);
-  const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+  auto s_branch = node_cast<PatriciaTreeBranch<IntegerType>>(s);
+  auto t_branch = node_cast<PatriciaTreeBranch<IntegerType>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -721,7 +1018,7 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
     if (new_left == t0 && new_right == t1) {
       return t;
     }
-    return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+    return new_branch<IntegerType>(
         p, m, new_left, new_right);
   }
   if (m < n && match_prefix(q, p, m)) {
@@ -731,14 +1028,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (s0 == new_left) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           p, m, new_left, s1);
     } else {
       auto new_right = merge(s1, t);
       if (s1 == new_right) {
         return s;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           p, m, s0, new_right);
     }
   }
@@ -749,14 +1046,14 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
       if (t0 == new_left) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           q, n, new_left, t1);
     } else {
       auto new_right = merge(s, t1);
       if (t1 == new_right) {
         return t;
       }
-      return std::make_shared<PatriciaTreeBranch<IntegerType>>(
+      return new_branch<IntegerType>(
           q, n, t0, new_right);
     }
   }
@@ -765,9 +1062,17 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> merge(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
+inline NodePtr<PatriciaTree<IntegerType>> intersect(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t) {
+  return memoize<IntegerType>(
+      SetOperation::Intersect, s, t, intersect_nodes<IntegerType>);
+}
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTree<IntegerType>> intersect_nodes(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
@@ -777,19 +1082,15 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
     return nullptr;
   }
   if (s->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(s);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(s);
     return contains(leaf->key(), t) ? leaf : nullptr;
   }
   if (t->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(t);
     return contains(leaf->key(), s) ? leaf : nullptr;
   }
-  const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(s);
-  const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+  auto s_branch = node_cast<PatriciaTreeBranch<IntegerType>>(s);
+  auto t_branch = node_cast<PatriciaTreeBranch<IntegerType>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -816,9 +1117,17 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> intersect(
 }
 
 template <typename IntegerType>
-inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
-    const std::shared_ptr<PatriciaTree<IntegerType>>& s,
-    const std::shared_ptr<PatriciaTree<IntegerType>>& t) {
+inline NodePtr<PatriciaTree<IntegerType>> diff(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t) {
+  return memoize<IntegerType>(
+      SetOperation::Diff, s, t, diff_nodes<IntegerType>);
+}
+
+template <typename IntegerType>
+inline NodePtr<PatriciaTree<IntegerType>> diff_nodes(
+    const NodePtr<PatriciaTree<IntegerType>>& s,
+    const NodePtr<PatriciaTree<IntegerType>>& t) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
@@ -831,19 +1140,15 @@ inline std::shared_ptr<PatriciaTree<IntegerType>> diff(
     return s;
   }
   if (s->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(s);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(s);
     return contains(leaf->key(), t) ? nullptr : leaf;
   }
   if (t->is_leaf()) {
-    const auto& leaf =
-        std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+    auto leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(t);
     return remove(leaf->key(), s);
   }
-  const auto& s_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(s);
-  const auto& t_branch =
-      std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+  auto s_branch = node_cast<PatriciaTreeBranch<IntegerType>>(s);
+  auto t_branch = node_cast<PatriciaTreeBranch<IntegerType>>(t);
   IntegerType m = s_branch->branching_bit();
   IntegerType n = t_branch->branching_bit();
   IntegerType p = s_branch->prefix();
@@ -894,7 +1199,7 @@ class PatriciaTreeIterator final {
   PatriciaTreeIterator() {}
 
   explicit PatriciaTreeIterator(
-      const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+      const NodePtr<PatriciaTree<IntegerType>>& tree) {
     if (tree == nullptr) {
       return;
     }
@@ -940,24 +1245,23 @@ class PatriciaTreeIterator final {
 
  private:
   // The argument is never null.
-  void go_to_next_leaf(const std::shared_ptr<PatriciaTree<IntegerType>>& tree) {
+  void go_to_next_leaf(const NodePtr<PatriciaTree<IntegerType>>& tree) {
     auto t = tree;
     // We go to the leftmost leaf, storing the branches that we're traversing
     // on the stack. By definition of a Patricia tree, a branch node always
     // has two children, hence the leftmost leaf always exists.
     while (t->is_branch()) {
-      auto branch =
-          std::static_pointer_cast<PatriciaTreeBranch<IntegerType>>(t);
+      auto branch = node_cast<PatriciaTreeBranch<IntegerType>>(t);
       m_stack.push(branch);
       t = branch->left_tree();
       // A branch node always has two children.
       RUNTIME_CHECK(t != nullptr, internal_error());
     }
-    m_leaf = std::static_pointer_cast<PatriciaTreeLeaf<IntegerType>>(t);
+    m_leaf = node_cast<PatriciaTreeLeaf<IntegerType>>(t);
   }
 
-  std::stack<std::shared_ptr<PatriciaTreeBranch<IntegerType>>> m_stack;
-  std::shared_ptr<PatriciaTreeLeaf<IntegerType>> m_leaf;
+  std::stack<NodePtr<PatriciaTreeBranch<IntegerType>>> m_stack;
+  NodePtr<PatriciaTreeLeaf<IntegerType>> m_leaf;
 };
 
 } // namespace pt_impl
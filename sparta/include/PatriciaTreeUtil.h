@@ -7,6 +7,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
 namespace sparta {
 
 namespace pt_util {
@@ -36,6 +46,351 @@ IntegerType match_prefix(IntegerType k, IntegerType p, IntegerType m) {
   return mask(k, m) == p;
 }
 
+/*
+ * The nodes of Patricia trees are small and immutable, and they are created
+ * and destroyed at a high rate by the analyses. They are allocated from
+ * per-thread free lists, one for each multiple of 16 bytes up to 256 bytes.
+ * The free lists are refilled from a global pool, which carves new nodes out
+ * of large chunks. Memory is never given back to the system: the lists of a
+ * thread go back to the global pool when it exits.
+ */
+class NodePool final {
+ public:
+  static void* allocate(size_t size) {
+    if (size > MAX_SIZE) {
+      return ::operator new(size);
+    }
+    auto& cache = thread_cache();
+    size_t size_class = get_size_class(size);
+    auto& head = cache.lists[size_class];
+    if (head == nullptr) {
+      if (cache.exited) {
+        // This thread is going away: don't cache anything anymore.
+        return allocate_from_global(size_class);
+      }
+      register_thread_exit();
+      head = refill(size_class);
+    }
+    auto* node = head;
+    head = node->next;
+    return node;
+  }
+
+  static void deallocate(void* p, size_t size) {
+    if (size > MAX_SIZE) {
+      ::operator delete(p);
+      return;
+    }
+    auto* node = static_cast<FreeNode*>(p);
+    auto& cache = thread_cache();
+    size_t size_class = get_size_class(size);
+    if (cache.exited) {
+      auto& global = global_pool();
+      std::lock_guard<std::mutex> lock(global.mutex);
+      node->next = global.lists[size_class];
+      global.lists[size_class] = node;
+      return;
+    }
+    auto& head = cache.lists[size_class];
+    if (head == nullptr) {
+      register_thread_exit();
+    }
+    node->next = head;
+    head = node;
+  }
+
+ private:
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  static constexpr size_t ALIGNMENT = 16;
+  static constexpr size_t NUM_SIZE_CLASSES = 16;
+  static constexpr size_t MAX_SIZE = ALIGNMENT * NUM_SIZE_CLASSES;
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+  static constexpr size_t REFILL_SIZE = 4 * 1024;
+
+  using FreeLists = std::array<FreeNode*, NUM_SIZE_CLASSES>;
+
+  // Trivially destructible, so that nodes can still be freed while the
+  // thread-local objects are destroyed.
+  struct ThreadCache {
+    FreeLists lists;
+    bool exited;
+  };
+
+  struct ThreadExit {
+    ~ThreadExit() {
+      auto& cache = thread_cache();
+      auto& global = global_pool();
+      std::lock_guard<std::mutex> lock(global.mutex);
+      for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+        auto* head = cache.lists[i];
+        if (head == nullptr) {
+          continue;
+        }
+        auto* tail = head;
+        while (tail->next != nullptr) {
+          tail = tail->next;
+        }
+        tail->next = global.lists[i];
+        global.lists[i] = head;
+        cache.lists[i] = nullptr;
+      }
+      cache.exited = true;
+    }
+  };
+
+  struct GlobalPool {
+    std::mutex mutex;
+    FreeLists lists{};
+    char* chunk{nullptr};
+    size_t chunk_left{0};
+  };
+
+  static size_t get_size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / ALIGNMENT;
+  }
+
+  static ThreadCache& thread_cache() {
+    thread_local ThreadCache cache{};
+    return cache;
+  }
+
+  static void register_thread_exit() { thread_local ThreadExit exit; }
+
+  static GlobalPool& global_pool() {
+    // Leaked on purpose: nodes may still be freed during static destruction.
+    static auto* pool = new GlobalPool();
+    return *pool;
+  }
+
+  // Assumes that the lock of the global pool is held.
+  static char* carve(GlobalPool& global, size_t node_size, size_t* count) {
+    if (global.chunk_left < node_size) {
+      global.chunk = static_cast<char*>(::operator new(CHUNK_SIZE));
+      global.chunk_left = CHUNK_SIZE;
+    }
+    *count = std::min(*count, global.chunk_left / node_size);
+    char* nodes = global.chunk;
+    global.chunk += *count * node_size;
+    global.chunk_left -= *count * node_size;
+    return nodes;
+  }
+
+  // Returns a non-empty list of free nodes of the given size class.
+  static FreeNode* refill(size_t size_class) {
+    auto& global = global_pool();
+    std::lock_guard<std::mutex> lock(global.mutex);
+    auto* head = global.lists[size_class];
+    if (head != nullptr) {
+      global.lists[size_class] = nullptr;
+      return head;
+    }
+    size_t node_size = (size_class + 1) * ALIGNMENT;
+    size_t count = REFILL_SIZE / node_size;
+    char* nodes = carve(global, node_size, &count);
+    for (size_t i = count; i > 0; --i) {
+      auto* node = reinterpret_cast<FreeNode*>(nodes + (i - 1) * node_size);
+      node->next = head;
+      head = node;
+    }
+    return head;
+  }
+
+  static void* allocate_from_global(size_t size_class) {
+    auto& global = global_pool();
+    std::lock_guard<std::mutex> lock(global.mutex);
+    auto* head = global.lists[size_class];
+    if (head != nullptr) {
+      global.lists[size_class] = head->next;
+      return head;
+    }
+    size_t count = 1;
+    return carve(global, (size_class + 1) * ALIGNMENT, &count);
+  }
+};
+
+/*
+ * The base class of all Patricia tree nodes. It holds the reference count of
+ * the node, which is intrusive so that nodes take a single allocation and
+ * pointers to them are a single word, and routes the allocation of nodes to
+ * the NodePool.
+ *
+ * Trees are shared between threads, so the count is atomic. However, a node
+ * that has a single reference can't gain a new one while it is being
+ * released, so dropping the last reference doesn't need a read-modify-write.
+ * This doesn't hold for nodes that can be found in a table of weak references
+ * (such as the hash-consing table of PatriciaTreeSet), which must be marked as
+ * such before they are published.
+ */
+class RefCountedNode {
+ public:
+  RefCountedNode() = default;
+
+  RefCountedNode(const RefCountedNode&) = delete;
+
+  RefCountedNode& operator=(const RefCountedNode&) = delete;
+
+  static void* operator new(size_t size) { return NodePool::allocate(size); }
+
+  // Since the destructors of nodes are virtual, this receives the size of the
+  // most derived class.
+  static void operator delete(void* p, size_t size) {
+    NodePool::deallocate(p, size);
+  }
+
+  void retain() const { m_ref_count.fetch_add(1, std::memory_order_relaxed); }
+
+  // Returns whether this was the last reference to the node, in which case
+  // the caller must destroy it.
+  bool release() const {
+    if (!m_weakly_referenced &&
+        m_ref_count.load(std::memory_order_acquire) == 1) {
+      return true;
+    }
+    return m_ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  // Takes a new reference to a node that is only known through a weak
+  // reference, unless that node is already being destroyed.
+  bool try_retain() const {
+    uint32_t count = m_ref_count.load(std::memory_order_relaxed);
+    while (count != 0) {
+      if (m_ref_count.compare_exchange_weak(
+              count, count + 1, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool is_weakly_referenced() const { return m_weakly_referenced; }
+
+  void mark_weakly_referenced() { m_weakly_referenced = true; }
+
+ private:
+  // A new node starts with the reference returned by make_node().
+  mutable std::atomic<uint32_t> m_ref_count{1};
+  bool m_weakly_referenced{false};
+};
+
+/*
+ * A reference-counting pointer to a node derived from RefCountedNode, with
+ * the subset of the interface of std::shared_ptr used by the Patricia trees.
+ * Since the count lives in the node, a raw pointer to a node that is known to
+ * be alive can be turned back into a NodePtr at any time.
+ */
+template <typename Node>
+class NodePtr final {
+ public:
+  NodePtr() = default;
+
+  NodePtr(std::nullptr_t) {}
+
+  NodePtr(Node* node) : m_node(node) {
+    if (node != nullptr) {
+      node->retain();
+    }
+  }
+
+  NodePtr(const NodePtr& other) : NodePtr(other.m_node) {}
+
+  NodePtr(NodePtr&& other) noexcept : m_node(other.m_node) {
+    other.m_node = nullptr;
+  }
+
+  template <typename Other,
+            typename = typename std::enable_if_t<
+                std::is_convertible<Other*, Node*>::value>>
+  NodePtr(const NodePtr<Other>& other) : NodePtr(other.get()) {}
+
+  template <typename Other,
+            typename = typename std::enable_if_t<
+                std::is_convertible<Other*, Node*>::value>>
+  NodePtr(NodePtr<Other>&& other) noexcept : m_node(other.m_node) {
+    other.m_node = nullptr;
+  }
+
+  ~NodePtr() { reset(); }
+
+  NodePtr& operator=(NodePtr other) noexcept {
+    std::swap(m_node, other.m_node);
+    return *this;
+  }
+
+  // Takes over a reference that the caller already holds.
+  static NodePtr adopt(Node* node) {
+    NodePtr ptr;
+    ptr.m_node = node;
+    return ptr;
+  }
+
+  void reset() {
+    auto* node = m_node;
+    m_node = nullptr;
+    if (node != nullptr && node->release()) {
+      delete node;
+    }
+  }
+
+  Node* get() const { return m_node; }
+
+  Node* operator->() const { return m_node; }
+
+  Node& operator*() const { return *m_node; }
+
+  explicit operator bool() const { return m_node != nullptr; }
+
+ private:
+  Node* m_node{nullptr};
+
+  template <typename Other>
+  friend class NodePtr;
+};
+
+template <typename Node1, typename Node2>
+inline bool operator==(const NodePtr<Node1>& p1, const NodePtr<Node2>& p2) {
+  return p1.get() == p2.get();
+}
+
+template <typename Node1, typename Node2>
+inline bool operator!=(const NodePtr<Node1>& p1, const NodePtr<Node2>& p2) {
+  return p1.get() != p2.get();
+}
+
+template <typename Node>
+inline bool operator==(const NodePtr<Node>& p, std::nullptr_t) {
+  return p.get() == nullptr;
+}
+
+template <typename Node>
+inline bool operator==(std::nullptr_t, const NodePtr<Node>& p) {
+  return p.get() == nullptr;
+}
+
+template <typename Node>
+inline bool operator!=(const NodePtr<Node>& p, std::nullptr_t) {
+  return p.get() != nullptr;
+}
+
+template <typename Node>
+inline bool operator!=(std::nullptr_t, const NodePtr<Node>& p) {
+  return p.get() != nullptr;
+}
+
+template <typename Node, typename... Args>
+inline NodePtr<Node> make_node(Args&&... args) {
+  return NodePtr<Node>::adopt(new Node(std::forward<Args>(args)...));
+}
+
+// Unlike std::static_pointer_cast, this doesn't take a reference: the result
+// is only valid as long as `node` is.
+template <typename To, typename From>
+inline To* node_cast(const NodePtr<From>& node) {
+  return static_cast<To*>(node.get());
+}
+
 } // namespace pt_util
 
 } // namespace sparta
@@ -0,0 +1,526 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "AbstractDomain.h"
+
+namespace sparta {
+
+namespace raae_impl {
+
+template <typename Variable, typename Domain>
+class ArrayValue;
+
+} // namespace raae_impl
+
+/*
+ * An abstract environment over the registers of a method, i.e., a small range
+ * of unsigned integers starting at 0, stored in a flat vector indexed by the
+ * register number.
+ *
+ * The vector is split into fixed-size chunks that are shared between copies
+ * of the environment and only duplicated when written to, so that copying an
+ * environment at a control-flow join, or caching it for every instruction,
+ * costs one pointer copy per chunk. Join, widening, meet and narrowing update
+ * the chunks in place and skip the chunks that both operands share.
+ *
+ * Variables that are too large to be register numbers, like the
+ * pseudo-register holding the result of an invoke, are kept in a short sorted
+ * vector on the side.
+ *
+ * Like PatriciaTreeMapAbstractEnvironment, bindings to Top are implicit: a
+ * chunk in which all the registers are bound to Top is not allocated. The
+ * interface is the same as PatriciaTreeMapAbstractEnvironment's, except that
+ * bindings() materializes a vector, so the two can be used interchangeably as
+ * the register environment of an intraprocedural analysis.
+ *
+ * This domain is the right choice when most registers of the method have a
+ * binding, and a poor one for sparse environments over large variables.
+ */
+template <typename Variable, typename Domain>
+class RegisterArrayEnvironment final
+    : public AbstractDomainScaffolding<
+          raae_impl::ArrayValue<Variable, Domain>,
+          RegisterArrayEnvironment<Variable, Domain>> {
+ public:
+  using Value = raae_impl::ArrayValue<Variable, Domain>;
+
+  ~RegisterArrayEnvironment() {
+    // The destructor is the only method that is guaranteed to be created when
+    // a class template is instantiated. This is a good place to perform all
+    // the sanity checks on the template parameters.
+    static_assert(std::is_unsigned<Variable>::value,
+                  "Variable is not an unsigned arithmetic type");
+    static_assert(std::is_base_of<AbstractDomain<Domain>, Domain>::value,
+                  "Domain does not inherit from AbstractDomain");
+  }
+
+  /*
+   * The default constructor produces the Top value.
+   */
+  RegisterArrayEnvironment()
+      : AbstractDomainScaffolding<Value, RegisterArrayEnvironment>() {}
+
+  RegisterArrayEnvironment(AbstractValueKind kind)
+      : AbstractDomainScaffolding<Value, RegisterArrayEnvironment>(kind) {}
+
+  RegisterArrayEnvironment(
+      std::initializer_list<std::pair<Variable, Domain>> l) {
+    for (const auto& p : l) {
+      if (p.second.is_bottom()) {
+        this->set_to_bottom();
+        return;
+      }
+      this->get_value()->insert_binding(p.first, p.second);
+    }
+    this->normalize();
+  }
+
+  // The number of registers bound to a value other than Top.
+  size_t size() const {
+    RUNTIME_CHECK(this->kind() == AbstractValueKind::Value,
+                  invalid_abstract_value()
+                      << expected_kind(AbstractValueKind::Value)
+                      << actual_kind(this->kind()));
+    return this->get_value()->size();
+  }
+
+  // The bindings to values other than Top, in increasing register order.
+  std::vector<std::pair<Variable, Domain>> bindings() const {
+    RUNTIME_CHECK(this->kind() == AbstractValueKind::Value,
+                  invalid_abstract_value()
+                      << expected_kind(AbstractValueKind::Value)
+                      << actual_kind(this->kind()));
+    return this->get_value()->bindings();
+  }
+
+  Domain get(const Variable& variable) const {
+    if (this->is_bottom()) {
+      return Domain::bottom();
+    }
+    return this->get_value()->get(variable);
+  }
+
+  RegisterArrayEnvironment& set(const Variable& variable,
+                                const Domain& value) {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    if (value.is_bottom()) {
+      this->set_to_bottom();
+      return *this;
+    }
+    this->get_value()->insert_binding(variable, value);
+    this->normalize();
+    return *this;
+  }
+
+  RegisterArrayEnvironment& clear() {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    this->get_value()->clear();
+    this->normalize();
+    return *this;
+  }
+
+  RegisterArrayEnvironment& update(
+      const Variable& variable,
+      std::function<Domain(const Domain&)> operation) {
+    if (this->is_bottom()) {
+      return *this;
+    }
+    return set(variable, operation(this->get_value()->get(variable)));
+  }
+
+  static RegisterArrayEnvironment bottom() {
+    return RegisterArrayEnvironment(AbstractValueKind::Bottom);
+  }
+
+  static RegisterArrayEnvironment top() {
+    return RegisterArrayEnvironment(AbstractValueKind::Top);
+  }
+
+  friend std::ostream& operator<<(std::ostream& o,
+                                  const RegisterArrayEnvironment& e) {
+    switch (e.kind()) {
+    case AbstractValueKind::Bottom: {
+      o << "_|_";
+      break;
+    }
+    case AbstractValueKind::Top: {
+      o << "T";
+      break;
+    }
+    case AbstractValueKind::Value: {
+      o << "[#" << e.size() << "]{";
+      auto bindings = e.bindings();
+      for (auto it = bindings.begin(); it != bindings.end();) {
+        o << it->first << " -> " << it->second;
+        if (++it != bindings.end()) {
+          o << ", ";
+        }
+      }
+      o << "}";
+      break;
+    }
+    }
+    return o;
+  }
+};
+
+namespace raae_impl {
+
+/*
+ * The chunks of the environment, a null pointer standing for a chunk in which
+ * all the registers are bound to Top, followed by the sorted bindings of the
+ * variables from DENSE_LIMIT onwards. We keep the representation canonical: a
+ * chunk is null if and only if all its bindings are Top, the vector has no
+ * trailing null chunks, and there are no bindings to Top on the side. Hence
+ * the environment is Top if and only if both vectors are empty.
+ */
+template <typename Variable, typename Domain>
+class ArrayValue final : public AbstractValue<ArrayValue<Variable, Domain>> {
+ public:
+  static constexpr size_t CHUNK_SIZE = 16;
+
+  // Dex registers are 16-bit wide.
+  static constexpr size_t DENSE_LIMIT = 1 << 16;
+
+  ArrayValue() = default;
+
+  void clear() override {
+    m_chunks.clear();
+    m_overflow.clear();
+  }
+
+  AbstractValueKind kind() const override {
+    return m_chunks.empty() && m_overflow.empty() ? AbstractValueKind::Top
+                                                  : AbstractValueKind::Value;
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (const auto& chunk : m_chunks) {
+      if (chunk != nullptr) {
+        n += chunk->size;
+      }
+    }
+    return n + m_overflow.size();
+  }
+
+  std::vector<std::pair<Variable, Domain>> bindings() const {
+    std::vector<std::pair<Variable, Domain>> result;
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+      if (m_chunks[i] == nullptr) {
+        continue;
+      }
+      const auto& values = m_chunks[i]->values;
+      for (size_t j = 0; j < CHUNK_SIZE; ++j) {
+        if (!values[j].is_top()) {
+          result.emplace_back(static_cast<Variable>(i * CHUNK_SIZE + j),
+                              values[j]);
+        }
+      }
+    }
+    result.insert(result.end(), m_overflow.begin(), m_overflow.end());
+    return result;
+  }
+
+  Domain get(Variable variable) const {
+    if (static_cast<size_t>(variable) >= DENSE_LIMIT) {
+      auto it = find_overflow(variable);
+      return it != m_overflow.end() && it->first == variable ? it->second
+                                                             : Domain::top();
+    }
+    size_t i = static_cast<size_t>(variable) / CHUNK_SIZE;
+    if (i >= m_chunks.size() || m_chunks[i] == nullptr) {
+      return Domain::top();
+    }
+    return m_chunks[i]->values[static_cast<size_t>(variable) % CHUNK_SIZE];
+  }
+
+  bool leq(const ArrayValue& other) const override {
+    // The registers beyond the last chunk of `other` are Top there.
+    for (size_t i = 0; i < other.m_chunks.size(); ++i) {
+      const auto& theirs = other.m_chunks[i];
+      if (theirs == nullptr) {
+        continue;
+      }
+      if (i >= m_chunks.size() || m_chunks[i] == nullptr) {
+        // Top is only below Top, and `theirs` has a binding that isn't.
+        return false;
+      }
+      const auto& ours = m_chunks[i];
+      if (ours == theirs) {
+        continue;
+      }
+      for (size_t j = 0; j < CHUNK_SIZE; ++j) {
+        if (!ours->values[j].leq(theirs->values[j])) {
+          return false;
+        }
+      }
+    }
+    for (const auto& binding : other.m_overflow) {
+      auto it = find_overflow(binding.first);
+      if (it == m_overflow.end() || it->first != binding.first ||
+          !it->second.leq(binding.second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool equals(const ArrayValue& other) const override {
+    if (m_chunks.size() != other.m_chunks.size() ||
+        m_overflow.size() != other.m_overflow.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < m_overflow.size(); ++i) {
+      if (m_overflow[i].first != other.m_overflow[i].first ||
+          !m_overflow[i].second.equals(other.m_overflow[i].second)) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+      const auto& ours = m_chunks[i];
+      const auto& theirs = other.m_chunks[i];
+      if (ours == theirs) {
+        continue;
+      }
+      if (ours == nullptr || theirs == nullptr || ours->size != theirs->size) {
+        return false;
+      }
+      for (size_t j = 0; j < CHUNK_SIZE; ++j) {
+        if (!ours->values[j].equals(theirs->values[j])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  AbstractValueKind join_with(const ArrayValue& other) override {
+    return join_like_operation(
+        other, [](Domain* x, const Domain& y) { x->join_with(y); });
+  }
+
+  AbstractValueKind widen_with(const ArrayValue& other) override {
+    return join_like_operation(
+        other, [](Domain* x, const Domain& y) { x->widen_with(y); });
+  }
+
+  AbstractValueKind meet_with(const ArrayValue& other) override {
+    return meet_like_operation(
+        other, [](Domain* x, const Domain& y) { x->meet_with(y); });
+  }
+
+  AbstractValueKind narrow_with(const ArrayValue& other) override {
+    return meet_like_operation(
+        other, [](Domain* x, const Domain& y) { x->narrow_with(y); });
+  }
+
+ private:
+  struct Chunk {
+    Chunk() { values.fill(Domain::top()); }
+
+    std::array<Domain, CHUNK_SIZE> values;
+    // The number of values that are not Top.
+    size_t size{0};
+  };
+
+  using ChunkPtr = std::shared_ptr<Chunk>;
+
+  using Binding = std::pair<Variable, Domain>;
+
+  typename std::vector<Binding>::const_iterator find_overflow(
+      Variable variable) const {
+    return std::lower_bound(
+        m_overflow.begin(), m_overflow.end(), variable,
+        [](const Binding& b, Variable v) { return b.first < v; });
+  }
+
+  void insert_binding(Variable variable, const Domain& value) {
+    RUNTIME_CHECK(!value.is_bottom(), internal_error());
+    if (static_cast<size_t>(variable) >= DENSE_LIMIT) {
+      auto it = m_overflow.begin() + (find_overflow(variable) -
+                                      m_overflow.cbegin());
+      bool found = it != m_overflow.end() && it->first == variable;
+      if (value.is_top()) {
+        if (found) {
+          m_overflow.erase(it);
+        }
+      } else if (found) {
+        it->second = value;
+      } else {
+        m_overflow.emplace(it, variable, value);
+      }
+      return;
+    }
+    size_t i = static_cast<size_t>(variable) / CHUNK_SIZE;
+    if (value.is_top() && (i >= m_chunks.size() || m_chunks[i] == nullptr)) {
+      return;
+    }
+    Chunk* chunk = get_mutable_chunk(i);
+    Domain& slot = chunk->values[static_cast<size_t>(variable) % CHUNK_SIZE];
+    chunk->size -= slot.is_top() ? 0 : 1;
+    slot = value;
+    chunk->size += slot.is_top() ? 0 : 1;
+    if (chunk->size == 0) {
+      m_chunks[i] = nullptr;
+    }
+    trim();
+  }
+
+  // Returns chunk i for writing, allocating it or copying it if it is shared.
+  Chunk* get_mutable_chunk(size_t i) {
+    if (i >= m_chunks.size()) {
+      m_chunks.resize(i + 1);
+    }
+    auto& chunk = m_chunks[i];
+    if (chunk == nullptr) {
+      chunk = std::make_shared<Chunk>();
+    } else if (chunk.use_count() > 1) {
+      chunk = std::make_shared<Chunk>(*chunk);
+    }
+    return chunk.get();
+  }
+
+  template <typename Operation>
+  AbstractValueKind join_like_operation(const ArrayValue& other,
+                                        Operation operation) {
+    // The registers that are Top in either operand are Top in the result.
+    if (m_chunks.size() > other.m_chunks.size()) {
+      m_chunks.resize(other.m_chunks.size());
+    }
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+      const auto& theirs = other.m_chunks[i];
+      if (m_chunks[i] == nullptr || m_chunks[i] == theirs) {
+        continue;
+      }
+      if (theirs == nullptr) {
+        m_chunks[i] = nullptr;
+        continue;
+      }
+      Chunk* ours = get_mutable_chunk(i);
+      ours->size = 0;
+      for (size_t j = 0; j < CHUNK_SIZE; ++j) {
+        Domain& x = ours->values[j];
+        if (!x.is_top()) {
+          operation(&x, theirs->values[j]);
+          ours->size += x.is_top() ? 0 : 1;
+        }
+      }
+      if (ours->size == 0) {
+        m_chunks[i] = nullptr;
+      }
+    }
+    trim();
+    std::vector<Binding> overflow;
+    auto theirs = other.m_overflow.begin();
+    for (auto& binding : m_overflow) {
+      while (theirs != other.m_overflow.end() &&
+             theirs->first < binding.first) {
+        ++theirs;
+      }
+      if (theirs != other.m_overflow.end() && theirs->first == binding.first) {
+        operation(&binding.second, theirs->second);
+        if (!binding.second.is_top()) {
+          overflow.push_back(std::move(binding));
+        }
+      }
+    }
+    m_overflow = std::move(overflow);
+    return kind();
+  }
+
+  template <typename Operation>
+  AbstractValueKind meet_like_operation(const ArrayValue& other,
+                                        Operation operation) {
+    // The registers that are Top in one operand take the binding of the other.
+    if (m_chunks.size() < other.m_chunks.size()) {
+      m_chunks.resize(other.m_chunks.size());
+    }
+    for (size_t i = 0; i < other.m_chunks.size(); ++i) {
+      const auto& theirs = other.m_chunks[i];
+      if (theirs == nullptr || m_chunks[i] == theirs) {
+        continue;
+      }
+      if (m_chunks[i] == nullptr) {
+        m_chunks[i] = theirs;
+        continue;
+      }
+      Chunk* ours = get_mutable_chunk(i);
+      ours->size = 0;
+      for (size_t j = 0; j < CHUNK_SIZE; ++j) {
+        Domain& x = ours->values[j];
+        operation(&x, theirs->values[j]);
+        if (x.is_bottom()) {
+          clear();
+          return AbstractValueKind::Bottom;
+        }
+        ours->size += x.is_top() ? 0 : 1;
+      }
+      if (ours->size == 0) {
+        m_chunks[i] = nullptr;
+      }
+    }
+    trim();
+    std::vector<Binding> overflow;
+    auto ours = m_overflow.begin();
+    for (const auto& binding : other.m_overflow) {
+      while (ours != m_overflow.end() && ours->first < binding.first) {
+        overflow.push_back(std::move(*ours++));
+      }
+      if (ours != m_overflow.end() && ours->first == binding.first) {
+        operation(&ours->second, binding.second);
+        if (ours->second.is_bottom()) {
+          clear();
+          return AbstractValueKind::Bottom;
+        }
+        if (!ours->second.is_top()) {
+          overflow.push_back(std::move(*ours));
+        }
+        ++ours;
+      } else {
+        overflow.push_back(binding);
+      }
+    }
+    std::move(ours, m_overflow.end(), std::back_inserter(overflow));
+    m_overflow = std::move(overflow);
+    return kind();
+  }
+
+  void trim() {
+    while (!m_chunks.empty() && m_chunks.back() == nullptr) {
+      m_chunks.pop_back();
+    }
+  }
+
+  std::vector<ChunkPtr> m_chunks;
+  std::vector<Binding> m_overflow;
+
+  template <typename T1, typename T2>
+  friend class sparta::RegisterArrayEnvironment;
+};
+
+} // namespace raae_impl
+
+} // namespace sparta
@@ -12,6 +12,8 @@
 #include <future>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <stack>
 #include <unordered_map>
@@ -228,6 +230,59 @@ class WeakTopologicalOrdering final {
   std::vector<WtoComponent<NodeId>> m_components;
 };
 
+/*
+ * Holds on to the WTO of a graph that is analyzed several times without
+ * changing shape, so that Bourdoncle's algorithm only runs once. The owner of
+ * the graph must call `invalidate()` whenever it adds, removes or redirects
+ * an edge. The WTO is also rebuilt if it is requested for a different root.
+ *
+ * A graph interface exposes its cache to the fixpoint iterators by defining
+ *
+ *   static WtoCache<NodeId>* wto_cache(const Graph& graph, bool backwards);
+ *
+ * where `backwards` selects the cache of the reverse graph.
+ *
+ * Copying or moving a cache yields an empty one.
+ */
+template <typename NodeId, typename NodeHash = std::hash<NodeId>>
+class WtoCache final {
+ public:
+  using Wto = WeakTopologicalOrdering<NodeId, NodeHash>;
+
+  WtoCache() = default;
+
+  WtoCache(const WtoCache&) {}
+
+  WtoCache& operator=(const WtoCache&) {
+    invalidate();
+    return *this;
+  }
+
+  /*
+   * Returns the cached WTO rooted at `root`, or the one returned by `build()`
+   * after caching it.
+   */
+  template <typename Builder>
+  std::shared_ptr<const Wto> get(const NodeId& root, Builder build) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_wto == nullptr || !(m_root == root)) {
+      m_wto = build();
+      m_root = root;
+    }
+    return m_wto;
+  }
+
+  void invalidate() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wto = nullptr;
+  }
+
+ private:
+  std::mutex m_mutex;
+  NodeId m_root{};
+  std::shared_ptr<const Wto> m_wto;
+};
+
 namespace wto_impl {
 
 template <typename NodeId, typename NodeHash>
@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BitVectorSetAbstractDomain.h"
+
+#include <cstdint>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <vector>
+
+using namespace sparta;
+
+using Domain = BitVectorSetAbstractDomain<uint16_t>;
+
+namespace {
+
+std::vector<uint16_t> to_vector(const Domain& d) {
+  return std::vector<uint16_t>(d.elements().begin(), d.elements().end());
+}
+
+} // namespace
+
+TEST(BitVectorSetAbstractDomainTest, latticeOperations) {
+  Domain e1({1});
+  Domain e2({1, 2, 3});
+  Domain e3({2, 3, 4});
+  EXPECT_THAT(to_vector(e1), ::testing::ElementsAre(1));
+  EXPECT_THAT(to_vector(e2), ::testing::ElementsAre(1, 2, 3));
+  EXPECT_THAT(to_vector(e3), ::testing::ElementsAre(2, 3, 4));
+  e3.add(4);
+  EXPECT_EQ(3, e3.size());
+
+  std::ostringstream out;
+  out << e2;
+  EXPECT_EQ("[#3]{1, 2, 3}", out.str());
+
+  EXPECT_TRUE(Domain::bottom().leq(Domain::top()));
+  EXPECT_FALSE(Domain::top().leq(Domain::bottom()));
+  EXPECT_FALSE(e2.is_top());
+  EXPECT_FALSE(e2.is_bottom());
+
+  Domain e4({3, 2, 1});
+  EXPECT_TRUE(e1.leq(e2));
+  EXPECT_FALSE(e1.leq(e3));
+  EXPECT_TRUE(e2.equals(e4));
+  EXPECT_FALSE(e2.equals(e3));
+
+  EXPECT_THAT(to_vector(e2.join(e3)), ::testing::ElementsAre(1, 2, 3, 4));
+  EXPECT_TRUE(e1.join(e2).equals(e2));
+  EXPECT_TRUE(e2.join(Domain::bottom()).equals(e2));
+  EXPECT_TRUE(e2.join(Domain::top()).is_top());
+  EXPECT_TRUE(e1.widening(e2).equals(e2));
+
+  EXPECT_THAT(to_vector(e2.meet(e3)), ::testing::ElementsAre(2, 3));
+  EXPECT_TRUE(e1.meet(e2).equals(e1));
+  EXPECT_TRUE(e2.meet(Domain::bottom()).is_bottom());
+  EXPECT_TRUE(e2.meet(Domain::top()).equals(e2));
+  EXPECT_FALSE(e1.meet(e3).is_bottom());
+  EXPECT_TRUE(e1.meet(e3).elements().empty());
+  EXPECT_TRUE(e1.narrowing(e2).equals(e1));
+
+  EXPECT_TRUE(e2.contains(1));
+  EXPECT_FALSE(e3.contains(1));
+  EXPECT_TRUE(Domain::top().contains(1));
+  EXPECT_FALSE(Domain::bottom().contains(1));
+
+  // Making sure no side effect happened.
+  EXPECT_THAT(to_vector(e1), ::testing::ElementsAre(1));
+  EXPECT_THAT(to_vector(e2), ::testing::ElementsAre(1, 2, 3));
+  EXPECT_THAT(to_vector(e3), ::testing::ElementsAre(2, 3, 4));
+}
+
+TEST(BitVectorSetAbstractDomainTest, differentWidths) {
+  // The sets below span one, two and four words respectively.
+  Domain small({1, 63});
+  Domain medium({1, 63, 64, 127});
+  Domain large(256);
+  EXPECT_TRUE(large.elements().empty());
+  large.add(255);
+
+  EXPECT_TRUE(small.leq(medium));
+  EXPECT_FALSE(medium.leq(small));
+  EXPECT_FALSE(large.leq(small));
+  EXPECT_TRUE(Domain(256).leq(small));
+  EXPECT_TRUE(Domain(256).equals(Domain()));
+
+  EXPECT_THAT(to_vector(small.join(large)),
+              ::testing::ElementsAre(1, 63, 255));
+  EXPECT_THAT(to_vector(large.join(medium)),
+              ::testing::ElementsAre(1, 63, 64, 127, 255));
+  EXPECT_THAT(to_vector(large.meet(medium)), ::testing::IsEmpty());
+  EXPECT_THAT(to_vector(medium.meet(small)), ::testing::ElementsAre(1, 63));
+
+  // Removing the elements of the upper words leaves zero words behind, which
+  // must not affect the comparisons.
+  Domain shrunk = medium;
+  shrunk.remove({64, 127});
+  EXPECT_TRUE(shrunk.equals(small));
+  EXPECT_TRUE(small.equals(shrunk));
+  EXPECT_TRUE(shrunk.leq(small));
+  EXPECT_EQ(2, shrunk.size());
+}
+
+TEST(BitVectorSetAbstractDomainTest, destructiveOperations) {
+  Domain e1(16);
+  Domain e2(16);
+  e1.add({1, 2});
+  e2.add({2, 3, 100});
+
+  e1.join_with(e2);
+  EXPECT_THAT(to_vector(e1), ::testing::ElementsAre(1, 2, 3, 100));
+  EXPECT_THAT(to_vector(e2), ::testing::ElementsAre(2, 3, 100));
+
+  e1.remove(100);
+  e1.meet_with(e2);
+  EXPECT_THAT(to_vector(e1), ::testing::ElementsAre(2, 3));
+
+  e1.set_to_bottom();
+  e1.add(1);
+  EXPECT_TRUE(e1.is_bottom());
+
+  e1.set_to_top();
+  e1.remove(1);
+  EXPECT_TRUE(e1.is_top());
+}
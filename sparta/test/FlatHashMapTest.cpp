@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FlatHashMap.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace sparta;
+
+TEST(FlatHashMapTest, basicOperations) {
+  FlatHashMap<uint32_t, std::string> m;
+  EXPECT_TRUE(m.empty());
+  EXPECT_TRUE(m.begin() == m.end());
+  EXPECT_TRUE(m.find(1) == m.end());
+  EXPECT_EQ(0, m.erase(1));
+
+  m[1] = "a";
+  m[2] = "b";
+  m[1] += "c";
+  EXPECT_EQ(2, m.size());
+  EXPECT_EQ("ac", m.find(1)->second);
+  EXPECT_EQ(1, m.count(2));
+  EXPECT_EQ(0, m.count(3));
+
+  std::vector<std::pair<uint32_t, std::string>> bindings(m.begin(), m.end());
+  EXPECT_THAT(bindings,
+              ::testing::UnorderedElementsAre(std::make_pair(1, "ac"),
+                                              std::make_pair(2, "b")));
+
+  EXPECT_EQ(1, m.erase(1));
+  EXPECT_EQ(1, m.size());
+  EXPECT_TRUE(m.find(1) == m.end());
+  EXPECT_EQ("b", m.find(2)->second);
+
+  m.clear();
+  EXPECT_TRUE(m.empty());
+  EXPECT_TRUE(m.find(2) == m.end());
+}
+
+TEST(FlatHashMapTest, eraseWhileIterating) {
+  FlatHashMap<uint32_t, uint32_t> m;
+  for (uint32_t i = 0; i < 100; ++i) {
+    m[i] = i;
+  }
+  for (auto it = m.begin(); it != m.end();) {
+    if (it->first % 3 == 0) {
+      it = m.erase(it);
+    } else {
+      it->second *= 2;
+      ++it;
+    }
+  }
+  EXPECT_EQ(66, m.size());
+  for (uint32_t i = 0; i < 100; ++i) {
+    auto it = m.find(i);
+    if (i % 3 == 0) {
+      EXPECT_TRUE(it == m.end());
+    } else {
+      ASSERT_TRUE(it != m.end());
+      EXPECT_EQ(2 * i, it->second);
+    }
+  }
+}
+
+TEST(FlatHashMapTest, matchesUnorderedMap) {
+  // Pointers hash to their address, which is the worst case for the probing.
+  std::vector<uint64_t> objects(512);
+  FlatHashMap<uint64_t*, uint32_t> m;
+  std::unordered_map<uint64_t*, uint32_t> expected;
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < 20000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    auto* key = &objects[(seed >> 8) % objects.size()];
+    if (seed % 3 == 0) {
+      EXPECT_EQ(expected.erase(key), m.erase(key));
+    } else {
+      m[key] += i;
+      expected[key] += i;
+    }
+  }
+  EXPECT_EQ(expected.size(), m.size());
+  size_t count = 0;
+  for (const auto& binding : m) {
+    EXPECT_EQ(expected.at(binding.first), binding.second);
+    ++count;
+  }
+  EXPECT_EQ(expected.size(), count);
+}
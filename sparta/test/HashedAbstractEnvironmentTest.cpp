@@ -18,9 +18,21 @@ using namespace sparta;
 
 using Domain = HashedSetAbstractDomain<std::string>;
 
-using Environment = HashedAbstractEnvironment<std::string, Domain>;
+template <typename Environment>
+class HashedAbstractEnvironmentTest : public ::testing::Test {};
 
-TEST(HashedAbstractEnvironmentTest, latticeOperations) {
+using Environments = ::testing::Types<
+    HashedAbstractEnvironment<std::string, Domain>,
+    HashedAbstractEnvironment<std::string,
+                              Domain,
+                              std::hash<std::string>,
+                              std::equal_to<std::string>,
+                              FlatHashMap>>;
+
+TYPED_TEST_CASE(HashedAbstractEnvironmentTest, Environments);
+
+TYPED_TEST(HashedAbstractEnvironmentTest, latticeOperations) {
+  using Environment = TypeParam;
   Environment e1({{"v1", Domain({"a", "b"})},
                   {"v2", Domain("c")},
                   {"v3", Domain({"d", "e", "f"})},
@@ -81,7 +93,8 @@ TEST(HashedAbstractEnvironmentTest, latticeOperations) {
   EXPECT_TRUE(e1.meet(Environment::top()).equals(e1));
 }
 
-TEST(HashedAbstractEnvironmentTest, destructiveOperations) {
+TYPED_TEST(HashedAbstractEnvironmentTest, destructiveOperations) {
+  using Environment = TypeParam;
   Environment e1({{"v1", Domain({"a", "b"})}});
   Environment e2({{"v2", Domain({"c", "d"})}, {"v3", Domain({"g", "h"})}});
 
@@ -7,6 +7,7 @@
 
 #include "MonotonicFixpointIterator.h"
 
+#include <atomic>
 #include <functional>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -158,6 +159,7 @@ class FixpointEngine final
 
   void analyze_node(const ControlPoint& node,
                     LivenessDomain* current_state) const override {
+    ++m_analyzed_nodes;
     const Statement& stmt = m_program.statement_at(node);
     // This is the standard semantic definition of liveness.
     current_state->remove(stmt.def.begin(), stmt.def.end());
@@ -184,8 +186,12 @@ class FixpointEngine final
     return get_entry_state_at(ControlPoint(node));
   }
 
+  // The number of times a node transformer has been applied so far.
+  size_t analyzed_nodes() const { return m_analyzed_nodes; }
+
  private:
   const Program& m_program;
+  mutable std::atomic<size_t> m_analyzed_nodes{0};
 };
 
 class MonotonicFixpointIteratorTest : public ::testing::Test {
@@ -360,3 +366,98 @@ TEST_F(MonotonicFixpointIteratorTest, program2) {
   ASSERT_TRUE(fp.get_live_in_vars_at("7").is_bottom());
   ASSERT_TRUE(fp.get_live_out_vars_at("7").is_bottom());
 }
+
+TEST_F(MonotonicFixpointIteratorTest, runParallel) {
+  for (const Program* program : {&this->m_program1, &this->m_program2}) {
+    FixpointEngine sequential(*program);
+    sequential.run(LivenessDomain());
+    FixpointEngine parallel(*program);
+    parallel.run_parallel(LivenessDomain(), /* num_threads */ 4);
+    for (const char* node : {"1", "2", "3", "4", "5", "6", "7"}) {
+      EXPECT_TRUE(parallel.get_live_in_vars_at(node).equals(
+          sequential.get_live_in_vars_at(node)))
+          << "at node " << node;
+      EXPECT_TRUE(parallel.get_live_out_vars_at(node).equals(
+          sequential.get_live_out_vars_at(node)))
+          << "at node " << node;
+    }
+  }
+}
+
+TEST_F(MonotonicFixpointIteratorTest, rerun) {
+  auto expect_same_result = [](FixpointEngine& fp, const Program& program,
+                               const LivenessDomain& init) {
+    FixpointEngine reference(program);
+    reference.run(init);
+    for (const char* node : {"1", "2", "3", "4", "5", "6"}) {
+      EXPECT_TRUE(fp.get_live_in_vars_at(node).equals(
+          reference.get_live_in_vars_at(node)))
+          << "at node " << node;
+      EXPECT_TRUE(fp.get_live_out_vars_at(node).equals(
+          reference.get_live_out_vars_at(node)))
+          << "at node " << node;
+    }
+  };
+
+  Program program = this->m_program1;
+  FixpointEngine fp(program);
+  fp.run(LivenessDomain());
+  size_t full_run = fp.analyzed_nodes();
+
+  // Node 1 is the last component of the reverse graph, so nothing else needs
+  // to be looked at again.
+  program.add("1", Statement(/* use: */ {"b"}, /* def: */ {"a"}));
+  fp.rerun(LivenessDomain(), {ControlPoint("1")});
+  EXPECT_EQ(full_run + 1, fp.analyzed_nodes());
+  expect_same_result(fp, program, LivenessDomain());
+  EXPECT_THAT(fp.get_live_in_vars_at("1").elements(),
+              ::testing::UnorderedElementsAre("b", "c"));
+
+  // Changing the statement at the exit affects the whole loop.
+  program.add("6", Statement(/* use: */ {"c", "d"}, /* def: */ {}));
+  fp.rerun(LivenessDomain(), {ControlPoint("6")});
+  expect_same_result(fp, program, LivenessDomain());
+  EXPECT_THAT(fp.get_live_in_vars_at("1").elements(),
+              ::testing::UnorderedElementsAre("b", "c", "d"));
+
+  // So does a different initial value.
+  LivenessDomain init({"e"});
+  fp.rerun(init, {});
+  expect_same_result(fp, program, init);
+  EXPECT_THAT(fp.get_live_in_vars_at("1").elements(),
+              ::testing::UnorderedElementsAre("b", "c", "d", "e"));
+
+  // Nothing to do if nothing changed.
+  size_t before = fp.analyzed_nodes();
+  fp.rerun(init, {});
+  EXPECT_EQ(before, fp.analyzed_nodes());
+}
+
+TEST_F(MonotonicFixpointIteratorTest, iterationBudget) {
+  FixpointEngine exact(this->m_program1);
+  exact.run(LivenessDomain());
+  const auto& stats = exact.get_stats();
+  EXPECT_EQ(exact.analyzed_nodes(), stats.analyzed_nodes);
+  EXPECT_EQ(2, stats.max_iterations);
+  EXPECT_EQ(0, stats.exhausted_sccs);
+
+  FixpointEngine bounded(this->m_program1);
+  bounded.set_iteration_budget(1);
+  bounded.run(LivenessDomain());
+  EXPECT_EQ(1, bounded.get_stats().exhausted_sccs);
+  bool some_top = false;
+  for (const char* node : {"1", "2", "3", "4", "5", "6"}) {
+    // The result is less precise, but still sound.
+    EXPECT_TRUE(exact.get_live_in_vars_at(node).leq(
+        bounded.get_live_in_vars_at(node)))
+        << "at node " << node;
+    EXPECT_TRUE(exact.get_live_out_vars_at(node).leq(
+        bounded.get_live_out_vars_at(node)))
+        << "at node " << node;
+    some_top |= bounded.get_live_out_vars_at(node).is_top();
+  }
+  EXPECT_TRUE(some_top);
+  // Node 6 is outside of the loop.
+  EXPECT_TRUE(bounded.get_live_in_vars_at("6").equals(
+      exact.get_live_in_vars_at("6")));
+}
@@ -296,3 +296,46 @@ TEST_F(PatriciaTreeSetTest, setsOfPointers) {
   out << t;
   EXPECT_EQ("{a}", out.str());
 }
+
+TEST_F(PatriciaTreeSetTest, hashConsing) {
+  PatriciaTreeHashConsing::enable();
+  for (size_t k = 0; k < 10; ++k) {
+    pt_set s1 = this->generate_random_set();
+    pt_set s2 = this->generate_random_set();
+    auto elems1 = std::vector<uint32_t>(s1.begin(), s1.end());
+    auto elems2 = std::vector<uint32_t>(s2.begin(), s2.end());
+
+    // The same set built in another order is the same tree.
+    pt_set t1;
+    for (auto it = elems1.rbegin(); it != elems1.rend(); ++it) {
+      t1.insert(*it);
+    }
+    EXPECT_TRUE(s1.reference_equals(t1));
+    EXPECT_TRUE(s1.equals(t1));
+
+    // Run each operation twice, so that the second one hits the cache.
+    for (size_t i = 0; i < 2; ++i) {
+      pt_set u12 = s1.get_union_with(s2);
+      pt_set i12 = s1.get_intersection_with(s2);
+      pt_set d12 = s1.get_difference_with(s2);
+      EXPECT_THAT(u12, ::testing::UnorderedElementsAreArray(
+                           get_union(elems1, elems2)));
+      EXPECT_THAT(i12, ::testing::UnorderedElementsAreArray(
+                           get_intersection(elems1, elems2)));
+      EXPECT_TRUE(d12.get_union_with(i12).equals(s1));
+      EXPECT_TRUE(d12.get_intersection_with(s2).empty());
+      EXPECT_TRUE(u12.get_difference_with(s2).get_union_with(s2).equals(u12));
+      EXPECT_EQ(s1.equals(s2), elems1 == elems2);
+    }
+  }
+  PatriciaTreeHashConsing::enable(false);
+
+  // Trees created before hash-consing was switched back off still compare
+  // correctly against the new ones.
+  pt_set a({1, 2, 3});
+  PatriciaTreeHashConsing::enable();
+  pt_set b({3, 2, 1});
+  PatriciaTreeHashConsing::enable(false);
+  EXPECT_TRUE(a.equals(b));
+  EXPECT_FALSE(a.reference_equals(b));
+}
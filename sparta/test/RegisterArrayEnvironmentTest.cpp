@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "RegisterArrayEnvironment.h"
+
+#include <cstdint>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#include "HashedSetAbstractDomain.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+
+using namespace sparta;
+
+using Domain = HashedSetAbstractDomain<std::string>;
+using Environment = RegisterArrayEnvironment<uint32_t, Domain>;
+
+constexpr uint32_t RESULT_REGISTER = std::numeric_limits<uint32_t>::max();
+
+class RegisterArrayEnvironmentTest : public ::testing::Test {
+ protected:
+  RegisterArrayEnvironmentTest()
+      : m_rd_device(),
+        m_generator(m_rd_device()),
+        m_size_dist(0, 50),
+        m_reg_dist(0, 100),
+        m_elem_dist(0, 3) {}
+
+  // Registers are drawn from a small range, so that the two environments
+  // overlap, plus the occasional large pseudo-register.
+  Environment generate_random_environment() {
+    Environment env;
+    size_t size = m_size_dist(m_generator);
+    for (size_t i = 0; i < size; ++i) {
+      auto reg = m_reg_dist(m_generator);
+      if (reg == 100) {
+        reg = RESULT_REGISTER - m_elem_dist(m_generator);
+      }
+      env.set(reg,
+              Domain({std::to_string(m_elem_dist(m_generator)),
+                      std::to_string(m_elem_dist(m_generator))}));
+    }
+    return env;
+  }
+
+  std::random_device m_rd_device;
+  std::mt19937 m_generator;
+  std::uniform_int_distribution<uint32_t> m_size_dist;
+  std::uniform_int_distribution<uint32_t> m_reg_dist;
+  std::uniform_int_distribution<uint32_t> m_elem_dist;
+};
+
+using ReferenceEnvironment =
+    PatriciaTreeMapAbstractEnvironment<uint32_t, Domain>;
+
+ReferenceEnvironment ptmae_from_raae(const Environment& env) {
+  ReferenceEnvironment ref;
+  if (env.is_value()) {
+    for (const auto& pair : env.bindings()) {
+      ref.set(pair.first, pair.second);
+    }
+  } else if (env.is_top()) {
+    ref.set_to_top();
+  } else {
+    ref.set_to_bottom();
+  }
+  return ref;
+}
+
+TEST_F(RegisterArrayEnvironmentTest, latticeOperations) {
+  Environment e1({{1, Domain({"a", "b"})},
+                  {2, Domain("c")},
+                  {3, Domain({"d", "e", "f"})},
+                  {4, Domain({"a", "f"})}});
+  Environment e2({{0, Domain({"c", "f"})},
+                  {2, Domain({"c", "d"})},
+                  {3, Domain({"d", "e", "g", "h"})}});
+
+  EXPECT_EQ(4, e1.size());
+  EXPECT_EQ(3, e2.size());
+
+  EXPECT_TRUE(Environment::bottom().leq(e1));
+  EXPECT_FALSE(e1.leq(Environment::bottom()));
+  EXPECT_FALSE(Environment::top().leq(e1));
+  EXPECT_TRUE(e1.leq(Environment::top()));
+  EXPECT_FALSE(e1.leq(e2));
+  EXPECT_FALSE(e2.leq(e1));
+
+  EXPECT_TRUE(e1.equals(e1));
+  EXPECT_FALSE(e1.equals(e2));
+  EXPECT_TRUE(Environment::bottom().equals(Environment::bottom()));
+  EXPECT_TRUE(Environment::top().equals(Environment::top()));
+  EXPECT_FALSE(Environment::bottom().equals(Environment::top()));
+
+  Environment join = e1.join(e2);
+  EXPECT_TRUE(e1.leq(join));
+  EXPECT_TRUE(e2.leq(join));
+  EXPECT_EQ(2, join.size());
+  EXPECT_THAT(join.get(2).elements(),
+              ::testing::UnorderedElementsAre("c", "d"));
+  EXPECT_THAT(join.get(3).elements(),
+              ::testing::UnorderedElementsAre("d", "e", "f", "g", "h"));
+  EXPECT_TRUE(join.equals(e1.widening(e2)));
+
+  EXPECT_TRUE(e1.join(Environment::top()).is_top());
+  EXPECT_TRUE(e1.join(Environment::bottom()).equals(e1));
+
+  Environment meet = e1.meet(e2);
+  EXPECT_TRUE(meet.leq(e1));
+  EXPECT_TRUE(meet.leq(e2));
+  EXPECT_EQ(5, meet.size());
+  EXPECT_THAT(meet.get(0).elements(),
+              ::testing::UnorderedElementsAre("c", "f"));
+  EXPECT_THAT(meet.get(2).elements(), ::testing::ElementsAre("c"));
+  EXPECT_THAT(meet.get(4).elements(),
+              ::testing::UnorderedElementsAre("a", "f"));
+  EXPECT_TRUE(meet.equals(e1.narrowing(e2)));
+
+  EXPECT_TRUE(e1.meet(Environment::bottom()).is_bottom());
+  EXPECT_TRUE(e1.meet(Environment::top()).equals(e1));
+
+  std::ostringstream out;
+  out << Environment({{3, Domain("c")}, {0, Domain("a")}});
+  EXPECT_EQ("[#2]{0 -> [#1]{a}, 3 -> [#1]{c}}", out.str());
+}
+
+TEST_F(RegisterArrayEnvironmentTest, destructiveOperations) {
+  // Registers in different chunks, and a pseudo-register past the dense part.
+  Environment e1({{1, Domain({"a", "b"})}, {40, Domain("c")}});
+  Environment e2({{40, Domain({"c", "d"})}, {RESULT_REGISTER, Domain("r")}});
+
+  e1.set(RESULT_REGISTER, Domain({"r", "s"}));
+  EXPECT_EQ(3, e1.size());
+  EXPECT_THAT(e1.get(RESULT_REGISTER).elements(),
+              ::testing::UnorderedElementsAre("r", "s"));
+  EXPECT_TRUE(e1.get(17).is_top());
+  EXPECT_TRUE(e1.get(1000).is_top());
+
+  Environment join = e1;
+  join.join_with(e2);
+  EXPECT_EQ(2, join.size()) << join;
+  EXPECT_THAT(join.get(40).elements(),
+              ::testing::UnorderedElementsAre("c", "d"));
+  EXPECT_THAT(join.get(RESULT_REGISTER).elements(),
+              ::testing::UnorderedElementsAre("r", "s"));
+
+  Environment meet = e1;
+  meet.meet_with(e2);
+  EXPECT_EQ(3, meet.size());
+  EXPECT_THAT(meet.get(1).elements(),
+              ::testing::UnorderedElementsAre("a", "b"));
+  EXPECT_THAT(meet.get(40).elements(), ::testing::ElementsAre("c"));
+  EXPECT_THAT(meet.get(RESULT_REGISTER).elements(),
+              ::testing::ElementsAre("r"));
+
+  // Binding all the registers of a chunk to Top releases it.
+  e1.set(1, Domain::top()).set(40, Domain::top());
+  EXPECT_EQ(1, e1.size());
+  e1.set(RESULT_REGISTER, Domain::top());
+  EXPECT_TRUE(e1.is_top());
+  EXPECT_TRUE(e1.equals(Environment()));
+
+  auto add_e = [](const Domain& s) {
+    auto copy = s;
+    copy.add("e");
+    return copy;
+  };
+  e2.update(40, add_e);
+  EXPECT_THAT(e2.get(40).elements(),
+              ::testing::UnorderedElementsAre("c", "d", "e"));
+
+  int counter = 0;
+  auto make_bottom = [&counter](const Domain&) {
+    ++counter;
+    return Domain::bottom();
+  };
+  e2.update(3, make_bottom);
+  EXPECT_TRUE(e2.is_bottom());
+  e2.update(3, make_bottom);
+  EXPECT_EQ(1, counter);
+}
+
+TEST_F(RegisterArrayEnvironmentTest, copyOnWrite) {
+  Environment e1({{1, Domain("a")}, {20, Domain("b")}});
+  Environment e2 = e1;
+  e2.set(1, Domain("c"));
+  e2.join_with(Environment({{1, Domain("d")}, {20, Domain("b")}}));
+  EXPECT_THAT(e1.get(1).elements(), ::testing::ElementsAre("a"));
+  EXPECT_THAT(e2.get(1).elements(), ::testing::UnorderedElementsAre("c", "d"));
+
+  Environment e3 = e1;
+  e3.meet_with(Environment({{20, Domain({"b", "c"})}, {33, Domain("e")}}));
+  EXPECT_EQ(3, e3.size());
+  EXPECT_EQ(2, e1.size());
+  EXPECT_TRUE(e3.leq(e1));
+  EXPECT_FALSE(e1.leq(e3));
+
+  // Joining environments that share all their chunks leaves them unchanged.
+  Environment e4 = e1;
+  e4.join_with(e1);
+  EXPECT_TRUE(e4.equals(e1));
+}
+
+TEST_F(RegisterArrayEnvironmentTest, robustness) {
+  for (size_t k = 0; k < 20; ++k) {
+    Environment e1 = this->generate_random_environment();
+    Environment e2 = this->generate_random_environment();
+    auto ref1 = ptmae_from_raae(e1);
+    auto ref2 = ptmae_from_raae(e2);
+
+    EXPECT_EQ(e1.leq(e2), ref1.leq(ref2));
+    EXPECT_EQ(e1.equals(e2), ref1.equals(ref2));
+
+    auto meet = e1;
+    meet.meet_with(e2);
+    EXPECT_TRUE(ptmae_from_raae(meet).equals(ref1.meet(ref2)));
+    EXPECT_TRUE(meet.leq(e1));
+    EXPECT_TRUE(meet.leq(e2));
+
+    auto join = e1;
+    join.join_with(e2);
+    EXPECT_TRUE(ptmae_from_raae(join).equals(ref1.join(ref2)));
+    EXPECT_TRUE(e1.leq(join));
+    EXPECT_TRUE(e2.leq(join));
+  }
+}
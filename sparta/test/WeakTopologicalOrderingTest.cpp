@@ -8,6 +8,7 @@
 #include "WeakTopologicalOrdering.h"
 
 #include <gtest/gtest.h>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
@@ -251,3 +252,46 @@ TEST(WeakTopologicalOrderingTest, InvalidIteratorDeref) {
   EXPECT_ANY_THROW(wto.end()->head_node());
   EXPECT_ANY_THROW(wto.end()++);
 }
+
+TEST(WeakTopologicalOrderingTest, Cache) {
+  SimpleGraph g;
+  g.add_edge("1", "2");
+  g.add_edge("2", "1");
+  size_t builds = 0;
+  auto builder = [&g, &builds](const std::string& root) {
+    return [&g, &builds, root]() {
+      ++builds;
+      return std::make_shared<const WeakTopologicalOrdering<std::string>>(
+          root, [&g](const std::string& n) { return g.successors(n); });
+    };
+  };
+  auto print = [](const WeakTopologicalOrdering<std::string>& wto) {
+    std::ostringstream s;
+    s << wto;
+    return s.str();
+  };
+
+  WtoCache<std::string> cache;
+  auto wto1 = cache.get("1", builder("1"));
+  auto wto2 = cache.get("1", builder("1"));
+  EXPECT_EQ(1, builds);
+  EXPECT_EQ(wto1, wto2);
+  EXPECT_EQ("(1 2)", print(*wto1));
+
+  // A different root gets a new WTO.
+  EXPECT_EQ("(2 1)", print(*cache.get("2", builder("2"))));
+  EXPECT_EQ(2, builds);
+
+  g.add_edge("2", "3");
+  cache.invalidate();
+  auto wto3 = cache.get("1", builder("1"));
+  EXPECT_EQ(3, builds);
+  EXPECT_EQ("(1 2) 3", print(*wto3));
+  // WTOs handed out earlier stay valid.
+  EXPECT_EQ("(1 2)", print(*wto1));
+
+  // Copies start out empty.
+  WtoCache<std::string> copy(cache);
+  copy.get("1", builder("1"));
+  EXPECT_EQ(4, builds);
+}
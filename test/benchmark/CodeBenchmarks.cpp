@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+
+#include "ConfigFiles.h"
+#include "ControlFlow.h"
+#include "DexOutput.h"
+#include "DexPosition.h"
+#include "GlobalValueNumberingPre.h"
+#include "GraphColoring.h"
+#include "IRCode.h"
+#include "IRTypeChecker.h"
+#include "InstructionLowering.h"
+#include "Match.h"
+#include "SyntheticApp.h"
+#include "Walkers.h"
+
+using namespace redex_bench;
+
+namespace {
+
+std::vector<DexMethod*> all_methods(const Scope& scope) {
+  std::vector<DexMethod*> methods;
+  walk::methods(scope, [&](DexMethod* method) { methods.push_back(method); });
+  return methods;
+}
+
+void BM_ControlFlowGraphBuildAndLinearize(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto methods = all_methods(make_synthetic_app(config_from_env()));
+  for (auto _ : state) {
+    for (auto method : methods) {
+      auto code = method->get_code();
+      code->build_cfg(/* editable */ true);
+      code->clear_cfg();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * methods.size());
+}
+BENCHMARK(BM_ControlFlowGraphBuildAndLinearize)->Unit(benchmark::kMillisecond);
+
+void BM_IRTypeChecker(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto methods = all_methods(make_synthetic_app(config_from_env()));
+  for (auto _ : state) {
+    for (auto method : methods) {
+      IRTypeChecker checker(method);
+      checker.run();
+      benchmark::DoNotOptimize(checker.fail());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * methods.size());
+}
+BENCHMARK(BM_IRTypeChecker)->Unit(benchmark::kMillisecond);
+
+void BM_RegAlloc(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto methods = all_methods(make_synthetic_app(config_from_env()));
+  std::vector<IRCode> originals;
+  for (auto method : methods) {
+    originals.emplace_back(*method->get_code());
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (size_t i = 0; i < methods.size(); ++i) {
+      methods[i]->set_code(std::make_unique<IRCode>(originals[i]));
+    }
+    state.ResumeTiming();
+    for (auto method : methods) {
+      method->get_code()->build_cfg(/* editable */ false);
+      regalloc::graph_coloring::Allocator allocator;
+      allocator.allocate(method);
+      method->get_code()->clear_cfg();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * methods.size());
+}
+BENCHMARK(BM_RegAlloc)->Unit(benchmark::kMillisecond);
+
+// GVN-PRE on a method at a time, with methods of 4, 32 and 256 blocks. Its
+// anticipation and insertion are iterated over all blocks, so this is where
+// its cost on large methods shows.
+void BM_GlobalValueNumberingPre(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto app_config = config_from_env();
+  app_config.blocks_per_method = state.range(0);
+  auto scope = make_synthetic_app(app_config);
+  auto methods = all_methods(scope);
+  std::vector<IRCode> originals;
+  size_t num_insns = 0;
+  for (auto method : methods) {
+    originals.emplace_back(*method->get_code());
+    num_insns += method->get_code()->count_opcodes();
+  }
+  CommonSubexpressionElimination::SharedState shared_state;
+  shared_state.init_scope(scope);
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (size_t i = 0; i < methods.size(); ++i) {
+      methods[i]->set_code(std::make_unique<IRCode>(originals[i]));
+    }
+    state.ResumeTiming();
+    for (auto method : methods) {
+      auto code = method->get_code();
+      code->build_cfg(/* editable */ true);
+      GlobalValueNumberingPre gvn_pre(&shared_state, method, code->cfg());
+      gvn_pre.run();
+      code->clear_cfg();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_insns);
+}
+BENCHMARK(BM_GlobalValueNumberingPre)
+    ->Arg(4)
+    ->Arg(32)
+    ->Arg(256)
+    ->Unit(benchmark::kMillisecond);
+
+// Matching an instruction pattern like ReachableClasses does, with (1) and
+// without (0) testing the opcodes before the predicates.
+void BM_MatchingOpcodes(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto scope = make_synthetic_app(config_from_env());
+  auto pattern = std::make_tuple(
+      m::const_string(),
+      m::move_result_pseudo(),
+      m::invoke_static(m::opcode_method(m::named<DexMethodRef>("forName") &&
+                                        m::on_class<DexMethodRef>(
+                                            "Ljava/lang/Class;")) &&
+                       m::has_n_args(1)));
+  if (state.range(0) == 0) {
+    std::get<0>(pattern).opcodes = m::ANY_OPCODE;
+    std::get<1>(pattern).opcodes = m::ANY_OPCODE;
+    std::get<2>(pattern).opcodes = m::ANY_OPCODE;
+  }
+  size_t num_insns = 0;
+  walk::code(scope, [&](DexMethod*, IRCode& code) {
+    num_insns += code.count_opcodes();
+  });
+  for (auto _ : state) {
+    size_t num_matches = 0;
+    walk::matching_opcodes(
+        scope, pattern,
+        [&](DexMethod*, const std::vector<IRInstruction*>&) { ++num_matches; });
+    benchmark::DoNotOptimize(num_matches);
+  }
+  state.SetItemsProcessed(state.iterations() * num_insns);
+}
+BENCHMARK(BM_MatchingOpcodes)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Writing the dex, once the code is lowered.
+void BM_DexOutput(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto filename =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("redex-bench-%%%%%%%%.dex"))
+          .string();
+  ConfigFiles conf(Json::nullValue);
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+  size_t num_classes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    context.reset();
+    auto scope = make_synthetic_app(config_from_env());
+    allocate_registers(scope);
+    auto stores = make_stores(scope);
+    instruction_lowering::run(stores);
+    num_classes = stores[0].get_dexen()[0].size();
+    state.ResumeTiming();
+    write_classes_to_dex(filename, &stores[0].get_dexen()[0],
+                         nullptr /* locator_index */,
+                         false /* name-based locators */, 0, 0, conf,
+                         pos_mapper.get(), nullptr, nullptr,
+                         nullptr /* IODIMetadata* */,
+                         stores[0].get_dex_magic());
+  }
+  boost::filesystem::remove(filename);
+  state.SetItemsProcessed(state.iterations() * num_classes);
+}
+BENCHMARK(BM_DexOutput)->Unit(benchmark::kMillisecond);
+
+} // namespace
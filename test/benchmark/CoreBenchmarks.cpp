@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "ConcurrentContainers.h"
+#include "PatriciaTreeMap.h"
+#include "WorkQueue.h"
+
+namespace {
+
+// Many tasks that do next to nothing: the cost of the queue itself.
+void BM_WorkQueueForeach(benchmark::State& state) {
+  auto num_items = static_cast<int>(state.range(0));
+  std::atomic<int64_t> sum{0};
+  for (auto _ : state) {
+    auto wq = workqueue_foreach<int>(
+        [&sum](int i) { sum.fetch_add(i, std::memory_order_relaxed); });
+    for (int i = 0; i < num_items; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+  }
+  benchmark::DoNotOptimize(sum.load());
+  state.SetItemsProcessed(state.iterations() * num_items);
+}
+BENCHMARK(BM_WorkQueueForeach)->Arg(64)->Arg(1 << 12)->Arg(1 << 16);
+
+void BM_WorkQueueMapReduce(benchmark::State& state) {
+  auto num_items = static_cast<int>(state.range(0));
+  for (auto _ : state) {
+    auto wq = workqueue_mapreduce<int, int64_t>(
+        [](int i) -> int64_t { return i; },
+        [](int64_t a, int64_t b) { return a + b; });
+    for (int i = 0; i < num_items; ++i) {
+      wq.add_item(i);
+    }
+    benchmark::DoNotOptimize(wq.run_all());
+  }
+  state.SetItemsProcessed(state.iterations() * num_items);
+}
+BENCHMARK(BM_WorkQueueMapReduce)->Arg(1 << 12)->Arg(1 << 16);
+
+// Updates from all workers to a few keys, so that they contend for the
+// slots.
+void BM_ConcurrentMapUpdate(benchmark::State& state) {
+  auto num_keys = static_cast<int>(state.range(0));
+  constexpr int kNumUpdates = 1 << 16;
+  for (auto _ : state) {
+    ConcurrentMap<int, int> map;
+    auto wq = workqueue_foreach<int>([&](int i) {
+      map.update(i % num_keys,
+                 [](int, int& value, bool) { ++value; });
+    });
+    for (int i = 0; i < kNumUpdates; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    benchmark::DoNotOptimize(map.size());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumUpdates);
+}
+BENCHMARK(BM_ConcurrentMapUpdate)->Arg(16)->Arg(1 << 12);
+
+void BM_ConcurrentSetInsert(benchmark::State& state) {
+  auto num_items = static_cast<int>(state.range(0));
+  for (auto _ : state) {
+    ConcurrentSet<int> set;
+    auto wq = workqueue_foreach<int>([&set](int i) { set.insert(i); });
+    for (int i = 0; i < num_items; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    benchmark::DoNotOptimize(set.size());
+  }
+  state.SetItemsProcessed(state.iterations() * num_items);
+}
+BENCHMARK(BM_ConcurrentSetInsert)->Arg(1 << 12)->Arg(1 << 16);
+
+using PTMap = sparta::PatriciaTreeMap<uint32_t, uint32_t>;
+
+PTMap make_map(uint32_t num_keys, uint32_t stride) {
+  PTMap map;
+  for (uint32_t i = 0; i < num_keys; ++i) {
+    map.insert_or_assign(i * stride, i + 1);
+  }
+  return map;
+}
+
+void BM_PatriciaTreeMapInsert(benchmark::State& state) {
+  auto num_keys = static_cast<uint32_t>(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_map(num_keys, 7).size());
+  }
+  state.SetItemsProcessed(state.iterations() * num_keys);
+}
+BENCHMARK(BM_PatriciaTreeMapInsert)->Arg(1 << 8)->Arg(1 << 14);
+
+// Two maps that share half of their keys, as the states of two branches
+// that meet would.
+void BM_PatriciaTreeMapUnion(benchmark::State& state) {
+  auto num_keys = static_cast<uint32_t>(state.range(0));
+  auto a = make_map(num_keys, 2);
+  auto b = make_map(num_keys, 3);
+  for (auto _ : state) {
+    auto u = a.get_union_with(
+        [](const uint32_t& x, const uint32_t& y) { return std::max(x, y); },
+        b);
+    benchmark::DoNotOptimize(u.size());
+  }
+  state.SetItemsProcessed(state.iterations() * num_keys * 2);
+}
+BENCHMARK(BM_PatriciaTreeMapUnion)->Arg(1 << 8)->Arg(1 << 14);
+
+} // namespace
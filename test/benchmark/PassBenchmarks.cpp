@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "ConfigFiles.h"
+#include "DexUtil.h"
+#include "Pass.h"
+#include "PassManager.h"
+#include "PassRegistry.h"
+#include "SyntheticApp.h"
+
+using namespace redex_bench;
+
+namespace {
+
+constexpr const char* kDefaultPasses =
+    "LocalDcePass,CopyPropagationPass,ConstantPropagationPass,PeepholePass,"
+    "RegAllocPass";
+
+/*
+ * The registered passes named in REDEX_BENCH_PASSES, or else a few of the
+ * intra-procedural ones that every build runs.
+ */
+std::vector<Pass*> passes_from_env() {
+  const char* env = getenv("REDEX_BENCH_PASSES");
+  std::vector<std::string> names;
+  boost::split(names, env != nullptr ? env : kDefaultPasses,
+               boost::is_any_of(","));
+  std::vector<Pass*> passes;
+  for (const auto& name : names) {
+    auto const& registered = PassRegistry::get().get_passes();
+    auto it = std::find_if(registered.begin(), registered.end(),
+                           [&](Pass* pass) { return pass->name() == name; });
+    always_assert_log(it != registered.end(), "No pass named %s",
+                      name.c_str());
+    passes.push_back(*it);
+  }
+  return passes;
+}
+
+// The whole pipeline, from a fresh app each time.
+void BM_Passes(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto passes = passes_from_env();
+  auto app_config = config_from_env();
+  app_config.num_classes = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    context.reset();
+    auto stores = make_stores(make_synthetic_app(app_config));
+    ConfigFiles conf(Json::nullValue);
+    PassManager manager(passes);
+    manager.set_testing_mode();
+    state.ResumeTiming();
+    manager.run_passes(stores, conf);
+  }
+  state.SetItemsProcessed(state.iterations() * app_config.num_classes);
+}
+BENCHMARK(BM_Passes)
+    ->Arg(config_from_env().num_classes)
+    ->Arg(config_from_env().num_classes * 4)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
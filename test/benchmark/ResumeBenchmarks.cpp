@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+#include <json/json.h>
+
+#include "ConfigFiles.h"
+#include "DexClass.h"
+#include "SyntheticApp.h"
+#include "ToolsCommon.h"
+
+using namespace redex_bench;
+
+namespace {
+
+/*
+ * Resuming from what `redex-all --stop-pass 0` writes right after the
+ * frontend, as redex-opt does: the dexes, irmeta.bin and entry.json. With
+ * every method ballooned on load (0), and with lazy ballooning (1), which
+ * leaves the methods to the passes that touch them. The dexes load on worker
+ * threads, so this measures the wall time.
+ */
+void BM_ResumeFromIntermediate(benchmark::State& state) {
+  ScopedRedexContext context;
+  auto app_config = config_from_env();
+  auto dir = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("redex-bench-ir-%%%%%%%%"))
+                 .string();
+  boost::filesystem::create_directory(dir);
+  {
+    auto scope = make_synthetic_app(app_config);
+    allocate_registers(scope);
+    // Well below the method refs a dex can hold, with the default methods,
+    // and several dexes to load in parallel for the larger apps.
+    auto stores = make_stores(scope, /* classes_per_dex */ 1000);
+    ConfigFiles conf(Json::nullValue);
+    Json::Value entry_data;
+    redex::write_all_intermediate(conf, dir, RedexOptions(), stores,
+                                  entry_data);
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    context.reset();
+    RedexContext::set_lazy_balloon(state.range(0) == 1);
+    state.ResumeTiming();
+    DexStoresVector stores;
+    Json::Value entry_data;
+    redex::load_all_intermediate(dir, stores, &entry_data);
+    benchmark::DoNotOptimize(stores);
+  }
+  boost::filesystem::remove_all(dir);
+  state.SetItemsProcessed(state.iterations() * app_config.num_classes);
+}
+BENCHMARK(BM_ResumeFromIntermediate)
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
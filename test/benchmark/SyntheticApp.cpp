@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SyntheticApp.h"
+
+#include <cstdlib>
+#include <random>
+#include <sstream>
+
+#include "Creators.h"
+#include "DexAnnotation.h"
+#include "DexDefs.h"
+#include "GraphColoring.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "Walkers.h"
+
+namespace redex_bench {
+
+namespace {
+
+size_t env_or(const char* name, size_t default_value) {
+  const char* value = getenv(name);
+  return value == nullptr ? default_value : std::stoul(value);
+}
+
+std::string class_name(size_t i) {
+  return "Lbench/C" + std::to_string(i) + ";";
+}
+
+std::string method_name(size_t i, size_t j) {
+  return class_name(i) + ".m" + std::to_string(j) + ":(II)I";
+}
+
+/*
+ * The body of a method of class `cls`: blocks that each compute on the two
+ * parameters, branch around a read of the field, and now and then call
+ * another method, write the field or compute something that is never used.
+ */
+std::string method_body(size_t cls,
+                        const SyntheticAppConfig& config,
+                        std::mt19937& rng) {
+  auto field = "\"" + class_name(cls) + ".f:I\"";
+  std::ostringstream body;
+  body << "((load-param v0) (load-param v1)";
+  for (size_t b = 0; b < config.blocks_per_method; ++b) {
+    // rng() % n rather than the std distributions, which differ between
+    // standard libraries.
+    body << " (const v2 " << rng() % 100 << ")"
+         << " (add-int v3 v0 v2)"
+         << " (mul-int v3 v3 v1)"
+         << " (if-lez v3 :b" << b << ")"
+         << " (sget " << field << ")"
+         << " (move-result-pseudo v4)"
+         << " (add-int v0 v3 v4)"
+         << " (:b" << b << ")";
+    if (rng() % 3 == 0) {
+      auto callee = method_name(rng() % config.num_classes,
+                                rng() % config.methods_per_class);
+      body << " (invoke-static (v0 v1) \"" << callee << "\")"
+           << " (move-result v1)";
+    }
+    if (rng() % 4 == 0) {
+      body << " (sput v0 " << field << ")";
+    }
+    if (rng() % 5 == 0) {
+      body << " (const v5 " << rng() % 1000 << ")"
+           << " (add-int v5 v5 v0)";
+    }
+    if (rng() % 2 == 0) {
+      body << " (move v6 v0)"
+           << " (add-int v1 v6 v1)";
+    }
+  }
+  body << " (return v0))";
+  return body.str();
+}
+
+} // namespace
+
+SyntheticAppConfig config_from_env() {
+  SyntheticAppConfig config;
+  config.num_classes = env_or("REDEX_BENCH_CLASSES", config.num_classes);
+  config.methods_per_class =
+      env_or("REDEX_BENCH_METHODS", config.methods_per_class);
+  config.blocks_per_method =
+      env_or("REDEX_BENCH_BLOCKS", config.blocks_per_method);
+  config.seed = env_or("REDEX_BENCH_SEED", config.seed);
+  return config;
+}
+
+Scope make_synthetic_app(const SyntheticAppConfig& config) {
+  std::mt19937 rng(config.seed);
+  Scope scope;
+  for (size_t i = 0; i < config.num_classes; ++i) {
+    auto type = DexType::make_type(class_name(i).c_str());
+    ClassCreator creator(type);
+    creator.set_access(ACC_PUBLIC);
+    creator.set_super(i % 2 == 1 ? scope.back()->get_type()
+                                 : get_object_type());
+    auto field = static_cast<DexField*>(
+        DexField::make_field(class_name(i) + ".f:I"));
+    // As loaded from a dex, where every static field has a value.
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC,
+                         DexEncodedValue::zero_for_type(field->get_type()));
+    creator.add_field(field);
+    for (size_t j = 0; j < config.methods_per_class; ++j) {
+      creator.add_method(assembler::method_from_string(
+          "(method (public static) \"" + method_name(i, j) + "\" " +
+          method_body(i, config, rng) + ")"));
+    }
+    scope.push_back(creator.create());
+  }
+  return scope;
+}
+
+void allocate_registers(const Scope& scope) {
+  walk::code(scope, [](DexMethod* method, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+    regalloc::graph_coloring::Allocator allocator;
+    allocator.allocate(method);
+    code.clear_cfg();
+  });
+}
+
+DexStoresVector make_stores(const Scope& scope, size_t classes_per_dex) {
+  DexStore store("classes");
+  store.set_dex_magic(DEX_HEADER_DEXMAGIC_V35);
+  for (size_t i = 0; i < scope.size(); i += classes_per_dex) {
+    auto end = scope.size() - i > classes_per_dex ? i + classes_per_dex
+                                                  : scope.size();
+    store.add_classes(DexClasses(scope.begin() + i, scope.begin() + end));
+  }
+  DexStoresVector stores;
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+} // namespace redex_bench
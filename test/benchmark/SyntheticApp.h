@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "DexClass.h"
+#include "DexStore.h"
+#include "RedexContext.h"
+
+namespace redex_bench {
+
+struct SyntheticAppConfig {
+  size_t num_classes{200};
+  size_t methods_per_class{10};
+  // Each block of a method is about ten instructions.
+  size_t blocks_per_method{4};
+  uint32_t seed{1};
+};
+
+/*
+ * The defaults, overridden by REDEX_BENCH_CLASSES, REDEX_BENCH_METHODS,
+ * REDEX_BENCH_BLOCKS and REDEX_BENCH_SEED.
+ */
+SyntheticAppConfig config_from_env();
+
+/*
+ * The classes of a made-up app, the same for the same config and seed. Each
+ * class has a static field and static methods whose code mixes arithmetic,
+ * branches, field accesses, calls into other classes and some dead code;
+ * every other class extends the one before it.
+ */
+Scope make_synthetic_app(const SyntheticAppConfig& config);
+
+/*
+ * Allocates the registers of the code of `scope`, which puts the parameters
+ * in the last registers, as they are in code loaded from dexes. Lowering and
+ * writing the code to dexes need that.
+ */
+void allocate_registers(const Scope& scope);
+
+/*
+ * A single store with `scope` in dexes of at most `classes_per_dex` classes,
+ * by default all in one dex.
+ */
+DexStoresVector make_stores(
+    const Scope& scope,
+    size_t classes_per_dex = std::numeric_limits<size_t>::max());
+
+/*
+ * A RedexContext for the benchmark to build the app in, and a way to start
+ * over with a new one -- the IR of an app can only be optimized or lowered
+ * once.
+ */
+class ScopedRedexContext {
+ public:
+  ScopedRedexContext() { g_redex = new RedexContext(); }
+  ~ScopedRedexContext() {
+    delete g_redex;
+    g_redex = nullptr;
+  }
+
+  void reset() {
+    delete g_redex;
+    g_redex = new RedexContext();
+  }
+};
+
+} // namespace redex_bench
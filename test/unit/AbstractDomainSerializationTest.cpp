@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "AbstractDomainSerialization.h"
+#include "HashedSetAbstractDomain.h"
+#include "PatriciaTreeSetAbstractDomain.h"
+#include "RedexTest.h"
+#include "SignedConstantDomain.h"
+
+namespace ds = domain_serialization;
+
+using StringSet = sparta::HashedSetAbstractDomain<std::string>;
+using IntSet = sparta::PatriciaTreeSetAbstractDomain<uint32_t>;
+using TypeEnvironment =
+    sparta::PatriciaTreeMapAbstractEnvironment<const DexType*, ConstantDomain>;
+using SignedPartition =
+    sparta::PatriciaTreeMapAbstractPartition<const DexType*,
+                                             SignedConstantDomain>;
+
+struct AbstractDomainSerializationTest : public RedexTest {};
+
+namespace {
+
+template <typename Domain>
+Domain binary_round_trip(const Domain& domain) {
+  std::stringstream ss;
+  ds::write(ss, domain);
+  Domain result;
+  ds::read(ss, &result);
+  EXPECT_EQ(ss.peek(), EOF);
+  return result;
+}
+
+template <typename Domain>
+Domain text_round_trip(const Domain& domain) {
+  std::istringstream input(ds::to_s_expr(domain).str());
+  sparta::s_expr_istream si(input);
+  sparta::s_expr e;
+  si >> e;
+  EXPECT_FALSE(si.fail()) << si.what();
+  Domain result;
+  ds::from_s_expr(e, &result);
+  return result;
+}
+
+template <typename Domain>
+void expect_round_trips(const Domain& domain) {
+  EXPECT_TRUE(binary_round_trip(domain).equals(domain)) << domain;
+  EXPECT_TRUE(text_round_trip(domain).equals(domain)) << domain;
+}
+
+} // namespace
+
+TEST_F(AbstractDomainSerializationTest, constants) {
+  expect_round_trips(ConstantDomain::top());
+  expect_round_trips(ConstantDomain::bottom());
+  expect_round_trips(ConstantDomain(-3));
+  expect_round_trips(ConstantDomain(std::numeric_limits<int64_t>::min()));
+
+  EXPECT_EQ(ds::to_s_expr(ConstantDomain(42)).str(), "(constant #42)");
+  EXPECT_EQ(ds::to_s_expr(ConstantDomain(1L << 40)).str(),
+            "(constant 1099511627776)");
+  EXPECT_EQ(ds::to_s_expr(ConstantDomain::bottom()).str(), "bottom");
+
+  expect_round_trips(SignedConstantDomain::top());
+  expect_round_trips(SignedConstantDomain::bottom());
+  expect_round_trips(SignedConstantDomain(0));
+  expect_round_trips(SignedConstantDomain(-7));
+  expect_round_trips(SignedConstantDomain(sign_domain::Interval::GEZ));
+}
+
+TEST_F(AbstractDomainSerializationTest, sets) {
+  expect_round_trips(StringSet::top());
+  expect_round_trips(StringSet::bottom());
+  expect_round_trips(StringSet());
+  expect_round_trips(StringSet({"a", "", "a longer string"}));
+
+  expect_round_trips(IntSet({0, 1, std::numeric_limits<uint32_t>::max()}));
+  EXPECT_EQ(ds::to_s_expr(IntSet({3, 1, 2})).str(), "(set #1 #2 #3)");
+}
+
+TEST_F(AbstractDomainSerializationTest, maps) {
+  auto foo = DexType::make_type("LFoo;");
+  auto bar = DexType::make_type("LBar;");
+
+  expect_round_trips(TypeEnvironment::top());
+  expect_round_trips(TypeEnvironment::bottom());
+  TypeEnvironment env({{foo, ConstantDomain(1)}, {bar, ConstantDomain(2)}});
+  expect_round_trips(env);
+  EXPECT_EQ(ds::to_s_expr(env).str(),
+            "(environment (\"LBar;\" (constant #2)) "
+            "(\"LFoo;\" (constant #1)))");
+
+  expect_round_trips(SignedPartition::top());
+  expect_round_trips(SignedPartition::bottom());
+  expect_round_trips(
+      SignedPartition({{foo, SignedConstantDomain(sign_domain::Interval::LTZ)},
+                       {bar, SignedConstantDomain::top()}}));
+
+  // Several values can share a stream.
+  std::stringstream ss;
+  binary_serialization::write_header(ss, 1);
+  ds::write(ss, env);
+  ds::write(ss, IntSet({5}));
+  EXPECT_EQ(binary_serialization::read_header(ss), 1);
+  TypeEnvironment env_copy;
+  IntSet set_copy;
+  ds::read(ss, &env_copy);
+  ds::read(ss, &set_copy);
+  EXPECT_TRUE(env_copy.equals(env));
+  EXPECT_TRUE(set_copy.equals(IntSet({5})));
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "AnnoKill.h"
+#include "Creators.h"
+#include "DexAnnotation.h"
+#include "DexClass.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class AnnoKillTest : public RedexTest {};
+
+namespace {
+
+DexClass* create_annotation_class(const char* name) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  creator.set_access(ACC_PUBLIC | ACC_INTERFACE | ACC_ABSTRACT |
+                     ACC_ANNOTATION);
+  return creator.create();
+}
+
+DexAnnotationSet* make_aset(const std::vector<DexType*>& types) {
+  auto aset = new DexAnnotationSet();
+  for (auto type : types) {
+    aset->add_annotation(new DexAnnotation(type, DAV_BUILD));
+  }
+  return aset;
+}
+
+} // namespace
+
+TEST_F(AnnoKillTest, killsUnreferencedAnnotations) {
+  auto keep = create_annotation_class("LKeep;");
+  auto unused = create_annotation_class("LUnused;");
+  auto used = create_annotation_class("LUsed;");
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto annotated = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;.annotated:()V"));
+  annotated->attach_annotation_set(make_aset({unused->get_type()}));
+  annotated->make_concrete(ACC_PUBLIC | ACC_STATIC, /* is_virtual */ false);
+  creator.add_method(annotated);
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.uses:()V"
+     ((const-class "LUsed;") (move-result-pseudo-object v0) (return-void)))
+  )"));
+  auto foo = creator.create();
+  foo->attach_annotation_set(
+      make_aset({keep->get_type(), unused->get_type(), used->get_type()}));
+
+  Scope scope{keep, unused, used, foo};
+  AnnoKill anno_kill(scope,
+                     /* only_force_kill */ false,
+                     /* kill_bad_signatures */ false,
+                     /* keep */ {"LKeep;"},
+                     /* kill */ {},
+                     /* force_kill */ {},
+                     /* class_hierarchy_keep_annos */ {},
+                     /* annotated_keep_annos */ {});
+  EXPECT_TRUE(anno_kill.kill_annotations());
+
+  std::vector<DexType*> left;
+  for (auto anno : foo->get_anno_set()->get_annotations()) {
+    left.push_back(anno->type());
+  }
+  EXPECT_EQ(std::vector<DexType*>({keep->get_type(), used->get_type()}),
+            left);
+  EXPECT_EQ(nullptr, annotated->get_anno_set());
+  EXPECT_EQ(Scope({keep, used, foo}), scope);
+
+  auto stats = anno_kill.get_stats();
+  EXPECT_EQ(4, stats.annotations);
+  EXPECT_EQ(2, stats.annotations_killed);
+  EXPECT_EQ(1, stats.class_asets);
+  EXPECT_EQ(0, stats.class_asets_cleared);
+  EXPECT_EQ(1, stats.method_asets);
+  EXPECT_EQ(1, stats.method_asets_cleared);
+  EXPECT_EQ(4, stats.visibility_build_count);
+}
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "BasicBlockLayout.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+class BasicBlockLayoutTest : public RedexTest {};
+
+TEST_F(BasicBlockLayoutTest, coldFallthroughMovesToTheEnd) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :hot)
+      (const v1 1)
+      (return v1)
+      (:hot)
+      (const v1 2)
+      (return v1)
+    )
+  )");
+  BasicBlockLayoutPass::MethodProfile profile;
+  profile.num_blocks = 3;
+  profile.block_hits = {{0, 10}, {2, 10}};
+
+  auto stats = BasicBlockLayoutPass::apply_profile(profile, code.get());
+  EXPECT_EQ(stats.methods_laid_out, 1);
+  EXPECT_EQ(stats.cold_blocks, 1);
+  EXPECT_EQ(stats.inverted_branches, 1);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-nez v0 :cold)
+      (const v1 2)
+      (return v1)
+      (:cold)
+      (const v1 1)
+      (return v1)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected.get()));
+}
+
+TEST_F(BasicBlockLayoutTest, mismatchedProfileIsIgnored) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (if-eqz v0 :hot)
+      (const v1 1)
+      (return v1)
+      (:hot)
+      (const v1 2)
+      (return v1)
+    )
+  )");
+  BasicBlockLayoutPass::MethodProfile profile;
+  profile.num_blocks = 4;
+  profile.block_hits = {{0, 10}, {2, 10}};
+
+  auto stats = BasicBlockLayoutPass::apply_profile(profile, code.get());
+  EXPECT_EQ(stats.methods_laid_out, 0);
+  EXPECT_EQ(stats.cold_blocks, 0);
+}
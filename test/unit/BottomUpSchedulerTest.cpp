@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include "BottomUpScheduler.h"
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Resolver.h"
+
+namespace {
+
+// Every method of the scope is a root, and every static call an edge.
+class AllMethodsStrategy final : public call_graph::BuildStrategy {
+ public:
+  explicit AllMethodsStrategy(const Scope& scope) : m_scope(scope) {}
+
+  call_graph::CallSites get_callsites(const DexMethod* method) const override {
+    call_graph::CallSites callsites;
+    auto* code = const_cast<IRCode*>(method->get_code());
+    if (code == nullptr) {
+      return callsites;
+    }
+    for (auto& mie : InstructionIterable(code)) {
+      auto insn = mie.insn;
+      if (insn->opcode() == OPCODE_INVOKE_STATIC) {
+        auto callee = resolve_method(insn->get_method(), MethodSearch::Static);
+        if (callee != nullptr && callee->is_concrete()) {
+          callsites.emplace_back(callee, code->iterator_to(mie));
+        }
+      }
+    }
+    return callsites;
+  }
+
+  std::vector<DexMethod*> get_roots() const override {
+    std::vector<DexMethod*> roots;
+    walk::code(m_scope, [&](DexMethod* method, IRCode&) {
+      roots.emplace_back(method);
+    });
+    return roots;
+  }
+
+ private:
+  const Scope& m_scope;
+};
+
+} // namespace
+
+struct BottomUpSchedulerTest : public RedexTest {
+  BottomUpSchedulerTest() {
+    // a -> b <-> c -> d, and a -> d.
+    auto a = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.a:()V"
+        (
+          (invoke-static () "LFoo;.b:()V")
+          (invoke-static () "LFoo;.d:()V")
+          (return-void)
+        )
+      )
+    )");
+    auto b = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.b:()V"
+        (
+          (invoke-static () "LFoo;.c:()V")
+          (return-void)
+        )
+      )
+    )");
+    auto c = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.c:()V"
+        (
+          (invoke-static () "LFoo;.b:()V")
+          (invoke-static () "LFoo;.d:()V")
+          (return-void)
+        )
+      )
+    )");
+    auto d = assembler::method_from_string(R"(
+      (method (public static) "LFoo;.d:()V"
+        (
+          (return-void)
+        )
+      )
+    )");
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    for (auto* method : {a, b, c, d}) {
+      creator.add_method(method);
+      m_methods.emplace(method->get_name()->str(), method);
+    }
+    m_scope.push_back(creator.create());
+  }
+
+  const DexMethod* method(const std::string& name) {
+    return m_methods.at(name);
+  }
+
+  Scope m_scope;
+  std::unordered_map<std::string, const DexMethod*> m_methods;
+};
+
+TEST_F(BottomUpSchedulerTest, sccsAreOrderedCalleesFirst) {
+  call_graph::Graph graph(AllMethodsStrategy{m_scope});
+  auto sccs = call_graph::bottom_up_sccs(m_scope, graph);
+  ASSERT_EQ(sccs.size(), 3);
+
+  std::unordered_map<const DexMethod*, size_t> position;
+  for (size_t i = 0; i < sccs.size(); ++i) {
+    for (auto* member : sccs[i]) {
+      EXPECT_EQ(position.count(member), 0);
+      position.emplace(member, i);
+    }
+  }
+  EXPECT_EQ(position.size(), 4);
+  EXPECT_EQ(position.at(method("b")), position.at(method("c")));
+  EXPECT_LT(position.at(method("d")), position.at(method("b")));
+  EXPECT_LT(position.at(method("b")), position.at(method("a")));
+}
+
+TEST_F(BottomUpSchedulerTest, parallelRunsCalleesFirst) {
+  call_graph::Graph graph(AllMethodsStrategy{m_scope});
+  std::mutex mutex;
+  std::vector<const DexMethod*> order;
+  call_graph::parallel_bottom_up(
+      m_scope, graph,
+      [&](const DexMethod* method) {
+        std::lock_guard<std::mutex> lock(mutex);
+        order.push_back(method);
+      },
+      /* num_threads */ 4);
+
+  std::unordered_map<const DexMethod*, size_t> position;
+  for (size_t i = 0; i < order.size(); ++i) {
+    EXPECT_EQ(position.count(order[i]), 0);
+    position.emplace(order[i], i);
+  }
+  ASSERT_EQ(position.size(), 4);
+  EXPECT_LT(position.at(method("d")), position.at(method("b")));
+  EXPECT_LT(position.at(method("d")), position.at(method("c")));
+  EXPECT_LT(position.at(method("b")), position.at(method("a")));
+  EXPECT_LT(position.at(method("c")), position.at(method("a")));
+}
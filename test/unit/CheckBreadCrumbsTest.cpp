@@ -230,4 +230,37 @@ TEST(CheckBreadcrumbs, AccessValidityTest) {
   delete g_redex;
 }
 
+TEST(CheckBreadcrumbs, DeletedTypeTest) {
+  g_redex = new RedexContext();
+  // C is deleted: it still has a class, but no store holds it.
+  std::vector<DexMethod*> no_methods;
+  std::vector<DexField*> no_fields;
+  create_class(DexType::make_type("LC;"), get_object_type(), no_methods,
+               no_fields);
+  std::vector<DexClass*> classes;
+  for (const char* name : {"LD;", "LE;"}) {
+    std::vector<DexMethod*> methods{assembler::method_from_string(
+        std::string("(method (public static) \"") + name +
+        ".take_c:(LC;)V\" ((return-void)))")};
+    classes.push_back(create_class(DexType::make_type(name),
+                                   get_object_type(), methods, no_fields));
+  }
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(classes);
+  std::vector<DexStore> stores;
+  stores.emplace_back(std::move(store));
+  auto scope = build_class_scope(stores);
+  Breadcrumbs bc(scope, stores, false);
+  bc.check_breadcrumbs();
+  // The methods of both classes are reported, in order.
+  std::ostringstream expected;
+  expected << "Bad methods in class LC;\n"
+           << "\ttake_c\n"
+           << "\ttake_c\n\n";
+  EXPECT_EQ(expected.str(), bc.get_methods_with_bad_refs());
+  delete g_redex;
+}
+
 } // namespace
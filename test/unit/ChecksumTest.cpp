@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "Adler32.h"
+#include "Sha1.h"
+
+namespace {
+
+std::string sha1_hex(const std::vector<unsigned char>& data,
+                     size_t piece_size) {
+  Sha1Context context;
+  sha1_init(&context);
+  for (size_t off = 0; off < data.size(); off += piece_size) {
+    auto size = std::min(piece_size, data.size() - off);
+    sha1_update(&context, data.data() + off, size);
+  }
+  unsigned char digest[20];
+  sha1_final(digest, &context);
+  std::string hex;
+  for (auto byte : digest) {
+    const char* digits = "0123456789abcdef";
+    hex += digits[byte >> 4];
+    hex += digits[byte & 0xf];
+  }
+  return hex;
+}
+
+std::vector<unsigned char> random_bytes(size_t size) {
+  std::mt19937 rng(size);
+  std::vector<unsigned char> data(size);
+  for (auto& byte : data) {
+    byte = rng();
+  }
+  return data;
+}
+
+} // namespace
+
+TEST(ChecksumTest, sha1KnownDigests) {
+  std::vector<unsigned char> abc{'a', 'b', 'c'};
+  EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d", sha1_hex(abc, 3));
+  std::vector<unsigned char> empty;
+  EXPECT_EQ("da39a3ee5e6b4b0d3255bfef95601890afd80709", sha1_hex(empty, 1));
+  std::vector<unsigned char> a_million(1000000, 'a');
+  EXPECT_EQ("34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+            sha1_hex(a_million, a_million.size()));
+  EXPECT_EQ("34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+            sha1_hex(a_million, 1000));
+}
+
+TEST(ChecksumTest, sha1DoesNotDependOnPieces) {
+  auto data = random_bytes(100003);
+  auto whole = sha1_hex(data, data.size());
+  for (size_t piece_size : {1, 63, 64, 65, 1000, 65536}) {
+    EXPECT_EQ(whole, sha1_hex(data, piece_size)) << piece_size;
+  }
+}
+
+TEST(ChecksumTest, adler32MatchesZlib) {
+  // Includes the sizes where the sums have to be reduced, and all 0xff bytes,
+  // for which they grow the fastest.
+  for (size_t size : {1, 31, 32, 33, 5551, 5552, 5553, 100003}) {
+    auto data = random_bytes(size);
+    for (const auto& bytes : {data, std::vector<unsigned char>(size, 0xff)}) {
+      for (uint32_t start : {1u, 0xfff0fff0u}) {
+        EXPECT_EQ(adler32(start, bytes.data(), bytes.size()),
+                  adler32_update(start, bytes.data(), bytes.size()))
+            << size;
+      }
+    }
+  }
+}
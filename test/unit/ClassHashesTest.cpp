@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "ClassHashes.h"
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class ClassHashesTest : public RedexTest {};
+
+namespace {
+
+DexClass* create_class(const char* name, const std::string& method) {
+  ClassCreator creator(DexType::make_type(name));
+  creator.set_super(get_object_type());
+  creator.add_method(assembler::method_from_string(method));
+  return creator.create();
+}
+
+} // namespace
+
+TEST_F(ClassHashesTest, changedCodeChangesTheHash) {
+  auto foo = create_class("LFoo;", R"(
+    (method (public static) "LFoo;.bar:()I"
+      (
+        (const v0 1)
+        (return v0)
+      )
+    )
+  )");
+  auto baz = create_class("LBaz;", R"(
+    (method (public static) "LBaz;.qux:()V"
+      (
+        (return-void)
+      )
+    )
+  )");
+  auto before = class_hashes::compute(Scope{foo, baz});
+  EXPECT_EQ(2, before.size());
+  EXPECT_EQ(before, class_hashes::compute(Scope{baz, foo}));
+
+  auto bar = foo->get_dmethods().at(0);
+  bar->get_code()->begin()->insn->set_literal(2);
+  auto after = class_hashes::compute(Scope{foo, baz});
+  auto diff = class_hashes::diff(before, after);
+  EXPECT_EQ(std::vector<std::string>{"LFoo;"}, diff.changed);
+  EXPECT_TRUE(diff.added.empty());
+  EXPECT_TRUE(diff.removed.empty());
+  EXPECT_EQ(1, diff.unchanged);
+
+  after.erase("LBaz;");
+  after.emplace("LNew;", 1);
+  diff = class_hashes::diff(before, after);
+  EXPECT_EQ(std::vector<std::string>{"LNew;"}, diff.added);
+  EXPECT_EQ(std::vector<std::string>{"LBaz;"}, diff.removed);
+}
+
+TEST_F(ClassHashesTest, readWhatWasWritten) {
+  auto path = (boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path())
+                  .string();
+  uint64_t config_hash;
+  class_hashes::ClassHashes hashes;
+  EXPECT_FALSE(class_hashes::read(path, &config_hash, &hashes));
+
+  class_hashes::ClassHashes written{{"LFoo;", 1},
+                                    {"LBar;", UINT64_MAX}};
+  class_hashes::write(path, 42, written);
+  EXPECT_TRUE(class_hashes::read(path, &config_hash, &hashes));
+  EXPECT_EQ(42, config_hash);
+  EXPECT_EQ(written, hashes);
+  boost::filesystem::remove(path);
+}
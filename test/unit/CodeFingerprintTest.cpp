@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "CodeFingerprint.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexContext.h"
+
+TEST(CodeFingerprint, ignoresRegisterNamesAndPositions) {
+  g_redex = new RedexContext();
+
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (const v1 1)
+      (if-eqz v0 :true)
+      (add-int v1 v1 v0)
+      (:true)
+      (return v1)
+    )
+  )");
+  auto renamed = assembler::ircode_from_string(R"(
+    (
+      (load-param v5)
+      (.pos "LFoo;.bar:()V" "Foo.java" 1)
+      (const v2 1)
+      (if-eqz v5 :true)
+      (add-int v2 v2 v5)
+      (:true)
+      (return v2)
+    )
+  )");
+  // Same registers, but the operands of the add are swapped.
+  auto swapped = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (const v1 1)
+      (if-eqz v0 :true)
+      (add-int v1 v0 v1)
+      (:true)
+      (return v1)
+    )
+  )");
+  auto other_literal = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (const v1 2)
+      (if-eqz v0 :true)
+      (add-int v1 v1 v0)
+      (:true)
+      (return v1)
+    )
+  )");
+
+  auto fingerprint = code_fingerprint::compute(*code);
+  EXPECT_EQ(fingerprint, code_fingerprint::compute(*renamed));
+  EXPECT_NE(fingerprint, code_fingerprint::compute(*swapped));
+  EXPECT_NE(fingerprint, code_fingerprint::compute(*other_literal));
+
+  CodeFingerprintCache cache;
+  EXPECT_EQ(cache.get(code.get()), fingerprint);
+  EXPECT_EQ(cache.get(code.get()), fingerprint);
+
+  code->build_cfg(/* editable */ true);
+  renamed->build_cfg(/* editable */ true);
+  EXPECT_EQ(code_fingerprint::compute(*code),
+            code_fingerprint::compute(*renamed));
+
+  delete g_redex;
+}
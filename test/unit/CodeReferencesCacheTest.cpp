@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "Reachability.h"
+#include "RedexTest.h"
+
+class CodeReferencesCacheTest : public RedexTest {};
+
+TEST_F(CodeReferencesCacheTest, regathersChangedCode) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+      (
+        (invoke-static () "LFoo;.baz:()V")
+        (return-void)
+      )
+    )
+  )");
+  auto baz = DexMethod::get_method("LFoo;.baz:()V");
+  reachability::CodeReferencesCache cache;
+
+  // Without code epochs, nothing is kept.
+  EXPECT_EQ(std::vector<DexMethodRef*>{baz}, cache.get(method).methods);
+  EXPECT_EQ(std::vector<DexMethodRef*>{baz}, cache.get(method).methods);
+  EXPECT_EQ(0, cache.num_reused());
+
+  RedexContext::set_code_epoch(2);
+  cache.get(method);
+  RedexContext::set_code_epoch(3);
+  EXPECT_EQ(std::vector<DexMethodRef*>{baz}, cache.get(method).methods);
+  EXPECT_EQ(1, cache.num_reused());
+
+  RedexContext::set_code_epoch(4);
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+      (invoke-static () "LFoo;.qux:()V")
+      (return-void)
+    )
+  )"));
+  RedexContext::set_code_epoch(5);
+  auto qux = DexMethod::get_method("LFoo;.qux:()V");
+  EXPECT_EQ(std::vector<DexMethodRef*>{qux}, cache.get(method).methods);
+  EXPECT_EQ(1, cache.num_reused());
+  RedexContext::set_code_epoch(0);
+}
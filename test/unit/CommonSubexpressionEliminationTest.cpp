@@ -9,6 +9,7 @@
 
 #include "CommonSubexpressionElimination.h"
 #include "ControlFlow.h"
+#include "Creators.h"
 #include "IRAssembler.h"
 #include "IRCode.h"
 #include "RedexTest.h"
@@ -17,7 +18,8 @@ class CommonSubexpressionEliminationTest : public RedexTest {};
 
 void test(const std::string& code_str,
           const std::string& expected_str,
-          size_t expected_instructions_eliminated) {
+          size_t expected_instructions_eliminated,
+          const Scope& scope = {}) {
 
   auto field_a = static_cast<DexField*>(DexField::make_field("LFoo;.a:I"));
   field_a->make_concrete(ACC_PUBLIC);
@@ -30,6 +32,7 @@ void test(const std::string& code_str,
 
   code.get()->build_cfg(/* editable */ true);
   CommonSubexpressionElimination::SharedState shared_state;
+  shared_state.init_scope(scope);
   CommonSubexpressionElimination cse(&shared_state, code.get()->cfg());
   bool is_static = true;
   DexType* declaring_type = nullptr;
@@ -275,6 +278,72 @@ TEST_F(CommonSubexpressionEliminationTest, safe_methods_are_not_barriers) {
   test(code_str, expected_str, 1);
 }
 
+TEST_F(CommonSubexpressionEliminationTest, barrier_free_methods) {
+  // Bar.pure and Bar.also_pure only invoke each other, Bar.impure writes a
+  // field.
+  auto pure = assembler::method_from_string(R"(
+    (method (public static) "LBar;.pure:()V"
+      (
+        (invoke-static () "LBar;.also_pure:()V")
+        (return-void)
+      )
+    )
+  )");
+  auto also_pure = assembler::method_from_string(R"(
+    (method (public static) "LBar;.also_pure:()V"
+      (
+        (invoke-static () "LBar;.pure:()V")
+        (return-void)
+      )
+    )
+  )");
+  auto impure = assembler::method_from_string(R"(
+    (method (public static) "LBar;.impure:()V"
+      (
+        (const v0 0)
+        (sput v0 "LFoo;.a:I")
+        (return-void)
+      )
+    )
+  )");
+  ClassCreator creator(DexType::make_type("LBar;"));
+  creator.set_super(get_object_type());
+  for (auto* method : {pure, also_pure, impure}) {
+    creator.add_method(method);
+  }
+  Scope scope{creator.create()};
+
+  auto code_str = R"(
+    (
+      (const v0 0)
+      (iget v0 "LFoo;.a:I")
+      (move-result-pseudo v1)
+      (invoke-static () "LBar;.pure:()V")
+      (iget v0 "LFoo;.a:I")
+      (move-result-pseudo v2)
+      (invoke-static () "LBar;.impure:()V")
+      (iget v0 "LFoo;.a:I")
+      (move-result-pseudo v3)
+    )
+  )";
+  auto expected_str = R"(
+    (
+      (const v0 0)
+      (iget v0 "LFoo;.a:I")
+      (move-result-pseudo v1)
+      (move v4 v1)
+      (invoke-static () "LBar;.pure:()V")
+      (iget v0 "LFoo;.a:I")
+      (move-result-pseudo v2)
+      (move v2 v4)
+      (invoke-static () "LBar;.impure:()V")
+      (iget v0 "LFoo;.a:I")
+      (move-result-pseudo v3)
+    )
+  )";
+  test(code_str, expected_str, 1, scope);
+}
+
 TEST_F(CommonSubexpressionEliminationTest, recovery_after_barrier) {
   // at a barrier, the mappings have been reset, but afterwards cse kicks in as
   // expected
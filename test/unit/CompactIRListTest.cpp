@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "CompactIRList.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+class CompactIRListTest : public RedexTest {};
+
+namespace {
+
+const char* kCode = R"(
+  (
+    (load-param v8)
+    (load-param-object v9)
+    (.pos:dbg_0 "LFoo;.bar:(ILFoo;)V" "Foo.java" 10)
+    (.pos:dbg_1 "LFoo;.baz:()V" "Foo.java" 20 dbg_0)
+    (const-wide v0 -81985529216486896)
+    (const-string "hello")
+    (move-result-pseudo-object v2)
+    (.try_start a)
+    (new-instance "LFoo;")
+    (move-result-pseudo-object v3)
+    (iget v3 "LFoo;.x:I")
+    (move-result-pseudo v4)
+    (invoke-static (v4 v4 v4 v4 v4 v4 v3) "LFoo;.wide:(IIIIIILFoo;)V")
+    (.try_end a)
+    (sparse-switch v8 (:b :c))
+    (if-eqz v4 :e)
+    (return-void)
+    (:e)
+    (return-void)
+    (:b 1)
+    (return-void)
+    (:c -100000)
+    (return-void)
+    (.catch (a d) "LFoo;")
+    (return-void)
+    (.catch (d))
+    (throw v3)
+  )
+)";
+
+} // namespace
+
+TEST_F(CompactIRListTest, roundTrip) {
+  auto code = assembler::ircode_from_string(kCode);
+  auto expected = assembler::to_string(code.get());
+
+  ASSERT_TRUE(code->can_compact());
+  code->compact();
+  EXPECT_TRUE(code->is_compact());
+  EXPECT_EQ(code->begin(), code->end());
+  EXPECT_FALSE(code->can_compact());
+
+  code->expand();
+  EXPECT_FALSE(code->is_compact());
+  EXPECT_EQ(expected, assembler::to_string(code.get()));
+}
+
+TEST_F(CompactIRListTest, serializeRoundTrip) {
+  auto code = assembler::ircode_from_string(kCode);
+  auto expected = assembler::to_string(code.get());
+  code->set_registers_size(10);
+
+  code->compact();
+  std::stringstream ss;
+  code->serialize(ss);
+  auto copy = IRCode::deserialize(ss);
+  EXPECT_TRUE(copy->is_compact());
+  EXPECT_EQ(10, copy->get_registers_size());
+
+  copy->expand();
+  EXPECT_EQ(expected, assembler::to_string(copy.get()));
+}
+
+TEST_F(CompactIRListTest, keepsDebugInstructionsAndData) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (new-array v0 "[I")
+      (move-result-pseudo-object v1)
+      (return-void)
+    )
+  )");
+  auto file = DexString::make_string("Bar.java");
+  code->insert_before(code->begin(), std::unique_ptr<DexDebugInstruction>(
+                                         new DexDebugOpcodeSetFile(file)));
+  const DexDebugInstruction* dbgop = code->begin()->dbgop.get();
+  // The assembler doesn't know about payloads.
+  std::vector<uint16_t> payload{0x0300, 4, 1, 0, 1, 0};
+  auto data = new DexOpcodeData(payload);
+  auto fill = new IRInstruction(OPCODE_FILL_ARRAY_DATA);
+  fill->set_src(0, 1);
+  fill->set_data(data);
+  code->insert_before(std::prev(code->end()), fill);
+
+  code->compact();
+  // Gathering doesn't need the code to be expanded.
+  std::vector<DexString*> strings;
+  code->gather_strings(strings);
+  EXPECT_EQ(std::vector<DexString*>{file}, strings);
+  std::vector<DexType*> types;
+  code->gather_types(types);
+  EXPECT_EQ(std::vector<DexType*>{DexType::make_type("[I")}, types);
+  EXPECT_TRUE(code->is_compact());
+
+  code->expand();
+  size_t found = 0;
+  for (const auto& mie : *code) {
+    if (mie.type == MFLOW_DEBUG) {
+      EXPECT_EQ(dbgop, mie.dbgop.get());
+      ++found;
+    } else if (mie.type == MFLOW_OPCODE &&
+               mie.insn->opcode() == OPCODE_FILL_ARRAY_DATA) {
+      EXPECT_EQ(data, mie.insn->get_data());
+      ++found;
+    }
+  }
+  EXPECT_EQ(2, found);
+  delete data;
+}
+
+TEST_F(CompactIRListTest, methodsExpandOnAccess) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.qux:()V"
+      (
+        (const v0 1)
+        (return-void)
+      )
+    )
+  )");
+  auto expected = assembler::to_string(method->get_code());
+  EXPECT_EQ(0, method->get_code_epoch());
+
+  ASSERT_TRUE(method->compact_code());
+  EXPECT_TRUE(method->is_code_compact());
+  EXPECT_FALSE(method->compact_code());
+  std::vector<DexMethodRef*> methods;
+  method->gather_methods(methods);
+  EXPECT_TRUE(method->is_code_compact());
+
+  RedexContext::set_code_epoch(3);
+  auto code = method->get_code();
+  RedexContext::set_code_epoch(0);
+  EXPECT_FALSE(method->is_code_compact());
+  EXPECT_EQ(3, method->get_code_epoch());
+  EXPECT_EQ(expected, assembler::to_string(code));
+
+  // Code with an editable CFG stays as it is.
+  code->build_cfg();
+  EXPECT_FALSE(method->compact_code());
+  code->clear_cfg();
+  EXPECT_TRUE(method->compact_code());
+}
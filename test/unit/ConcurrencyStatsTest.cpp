@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ConcurrencyStats.h"
+
+#include <gtest/gtest.h>
+
+#include "ConcurrentContainers.h"
+#include "WorkQueue.h"
+
+constexpr size_t NUM_TASKS = 1000;
+
+TEST(ConcurrencyStatsTest, countsTasksAndLocks) {
+  concurrency_stats::reset();
+  ConcurrentSet<size_t> set;
+  auto wq = workqueue_foreach<size_t>([&](size_t i) { set.insert(i); }, 4);
+  for (size_t i = 0; i < NUM_TASKS; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  auto report = concurrency_stats::take_report();
+  if (!concurrency_stats::ENABLED) {
+    EXPECT_TRUE(report.empty());
+    return;
+  }
+
+  EXPECT_EQ(NUM_TASKS, report["tasks_executed"]);
+  EXPECT_EQ(NUM_TASKS, report["container_locks"]);
+  EXPECT_LE(report["tasks_stolen"], NUM_TASKS);
+  EXPECT_LE(report["container_contentions"], NUM_TASKS);
+  uint64_t latencies = 0;
+  for (const auto& pair : report) {
+    if (pair.first.find("task_latency_us_") == 0) {
+      latencies += pair.second;
+    }
+  }
+  EXPECT_EQ(NUM_TASKS, latencies);
+#ifdef REDEX_CONCURRENCY_STATS
+  uint64_t acquisitions = 0;
+  for (size_t slot = 0; slot < set.slot_count(); ++slot) {
+    acquisitions += set.slot_stats(slot).acquisitions;
+  }
+  EXPECT_EQ(NUM_TASKS, acquisitions);
+#endif
+
+  concurrency_stats::reset();
+  EXPECT_TRUE(concurrency_stats::take_report().empty());
+}
@@ -232,3 +232,98 @@ TEST_F(ConcurrentContainersTest, concurrentMapTest) {
   map.clear();
   EXPECT_EQ(0, map.size());
 }
+
+TEST_F(ConcurrentContainersTest, runtimeSlotCountTest) {
+  ConcurrentMap<uint32_t, uint32_t> map(cc_impl::slot_count_for_threads(64));
+  EXPECT_EQ(509, map.slot_count());
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (uint32_t x : sample) {
+      map.emplace(x, 2 * x);
+      EXPECT_EQ(2 * x, map.get(x, 0));
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), map.size());
+  size_t visited = 0;
+  for (const auto& p : map) {
+    EXPECT_EQ(2 * p.first, p.second);
+    ++visited;
+  }
+  EXPECT_EQ(m_data_set.size(), visited);
+
+  auto copy = map;
+  EXPECT_EQ(map.slot_count(), copy.slot_count());
+  EXPECT_EQ(m_data_set.size(), copy.size());
+}
+
+// Every thread asks for every key; each value is made only once.
+TEST_F(ConcurrentContainersTest, getOrCreateTest) {
+  ConcurrentMap<uint32_t, uint32_t> map;
+  std::atomic<size_t> created{0};
+  run_on_samples([&](const std::vector<uint32_t>&) {
+    for (uint32_t x : m_data) {
+      EXPECT_EQ(2 * x, map.get_or_create(x, [&] {
+        ++created;
+        return 2 * x;
+      }));
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), created);
+  EXPECT_EQ(m_data_set.size(), map.size());
+}
+
+TEST_F(ConcurrentContainersTest, insertOnlyConcurrentMapTest) {
+  InsertOnlyConcurrentMap<std::string, uint32_t> map;
+
+  run_on_samples([&map](const std::vector<uint32_t>& sample) {
+    for (uint32_t x : sample) {
+      std::string s = std::to_string(x);
+      map.emplace(s, x);
+      EXPECT_EQ(1, map.count(s));
+      EXPECT_EQ(x, map.at(s));
+    }
+  });
+  EXPECT_EQ(m_data_set.size(), map.size());
+  for (uint32_t x : m_data) {
+    std::string s = std::to_string(x);
+    EXPECT_FALSE(map.insert({s, x + 1}));
+    EXPECT_EQ(x, map.get(s, 0));
+  }
+  EXPECT_EQ(0, map.count("not a number"));
+  EXPECT_EQ(42, map.get("not a number", 42));
+
+  std::unordered_set<uint32_t> visited;
+  for (const auto& p : map) {
+    EXPECT_EQ(std::to_string(p.second), p.first);
+    visited.insert(p.second);
+  }
+  EXPECT_EQ(m_data_set, visited);
+}
+
+TEST_F(ConcurrentContainersTest, concurrentBitmapTest) {
+  // Elements go up to 1000000000; fold them into a smaller range.
+  constexpr size_t kBits = 100003;
+  ConcurrentBitmap bitmap(kBits);
+  std::atomic<size_t> newly_inserted{0};
+
+  run_on_samples([&](const std::vector<uint32_t>& sample) {
+    for (uint32_t x : sample) {
+      if (bitmap.insert(x % kBits)) {
+        newly_inserted++;
+      }
+      EXPECT_TRUE(bitmap.contains(x % kBits));
+    }
+  });
+  std::unordered_set<uint32_t> expected;
+  for (uint32_t x : m_data) {
+    expected.insert(x % kBits);
+  }
+  EXPECT_EQ(expected.size(), newly_inserted.load());
+  size_t count = 0;
+  for (size_t i = 0; i < kBits; ++i) {
+    count += bitmap.contains(i);
+  }
+  EXPECT_EQ(expected.size(), count);
+  for (uint32_t x : m_data) {
+    EXPECT_FALSE(bitmap.insert(x % kBits));
+  }
+}
@@ -247,13 +247,13 @@ TEST(ControlFlow, findImmediateDominator) {
     cfg.add_edge(b4, b3, EDGE_GOTO);
     cfg.add_edge(b4, b5, EDGE_GOTO);
     cfg.add_edge(b2, b5, EDGE_GOTO);
-    auto idom = cfg.immediate_dominators();
-    EXPECT_EQ(idom[b0].dom, b0);
-    EXPECT_EQ(idom[b1].dom, b0);
-    EXPECT_EQ(idom[b3].dom, b0);
-    EXPECT_EQ(idom[b2].dom, b1);
-    EXPECT_EQ(idom[b4].dom, b3);
-    EXPECT_EQ(idom[b5].dom, b0);
+    auto doms = cfg.dominators();
+    EXPECT_EQ(doms->idom(b0), b0);
+    EXPECT_EQ(doms->idom(b1), b0);
+    EXPECT_EQ(doms->idom(b3), b0);
+    EXPECT_EQ(doms->idom(b2), b1);
+    EXPECT_EQ(doms->idom(b4), b3);
+    EXPECT_EQ(doms->idom(b5), b0);
   }
   {
     //                 +---------+
@@ -284,16 +284,94 @@ TEST(ControlFlow, findImmediateDominator) {
     cfg.add_edge(b4, b3, EDGE_GOTO);
     cfg.add_edge(b4, b5, EDGE_GOTO);
     cfg.add_edge(b2, b5, EDGE_GOTO);
-    auto idom = cfg.immediate_dominators();
-    EXPECT_EQ(idom[b0].dom, b0);
-    EXPECT_EQ(idom[b1].dom, b0);
-    EXPECT_EQ(idom[b3].dom, b1);
-    EXPECT_EQ(idom[b2].dom, b1);
-    EXPECT_EQ(idom[b4].dom, b3);
-    EXPECT_EQ(idom[b5].dom, b1);
+    auto doms = cfg.dominators();
+    EXPECT_EQ(doms->idom(b0), b0);
+    EXPECT_EQ(doms->idom(b1), b0);
+    EXPECT_EQ(doms->idom(b3), b1);
+    EXPECT_EQ(doms->idom(b2), b1);
+    EXPECT_EQ(doms->idom(b4), b3);
+    EXPECT_EQ(doms->idom(b5), b1);
   }
 }
 
+TEST(ControlFlow, dominatorQueries) {
+  //                 +---------+
+  //                 v         |
+  //     +---+     +---+     +---+     +---+
+  //     | 0 | --> | 1 | --> | 2 | --> | 5 |
+  //     +---+     +---+     +---+     +---+
+  //                |                    ^
+  //  +-------------+                    |
+  //  |    +---------+                   |
+  //  |    v         |                   |
+  //  |  +---+     +---+                 |
+  //  +> | 3 | --> | 4 | ----------------+
+  //     +---+     +---+
+  ControlFlowGraph cfg;
+  auto b0 = cfg.create_block();
+  auto b1 = cfg.create_block();
+  auto b2 = cfg.create_block();
+  auto b3 = cfg.create_block();
+  auto b4 = cfg.create_block();
+  auto b5 = cfg.create_block();
+  auto unreachable = cfg.create_block();
+  cfg.set_entry_block(b0);
+  cfg.add_edge(b0, b1, EDGE_GOTO);
+  cfg.add_edge(b1, b2, EDGE_GOTO);
+  cfg.add_edge(b2, b1, EDGE_GOTO);
+  cfg.add_edge(b1, b3, EDGE_GOTO);
+  cfg.add_edge(b3, b4, EDGE_GOTO);
+  cfg.add_edge(b4, b3, EDGE_GOTO);
+  cfg.add_edge(b4, b5, EDGE_GOTO);
+  cfg.add_edge(b2, b5, EDGE_GOTO);
+  cfg.add_edge(unreachable, b5, EDGE_GOTO);
+  cfg.set_exit_block(b5);
+
+  auto doms = cfg.dominators();
+  EXPECT_FALSE(doms->is_reachable(unreachable));
+  EXPECT_TRUE(doms->dominates(b1, b4));
+  EXPECT_TRUE(doms->dominates(b4, b4));
+  EXPECT_FALSE(doms->strictly_dominates(b4, b4));
+  EXPECT_FALSE(doms->dominates(b2, b5));
+  EXPECT_FALSE(doms->dominates(b3, b2));
+  EXPECT_EQ(doms->common_dominator(b2, b4), b1);
+  EXPECT_EQ(doms->common_dominator(b4, b3), b3);
+
+  auto frontier = [](const DominatorTree& tree, const Block* b) {
+    std::vector<Block*> blocks(tree.frontier(b).begin(),
+                               tree.frontier(b).end());
+    std::sort(blocks.begin(), blocks.end(),
+              [](Block* x, Block* y) { return x->id() < y->id(); });
+    return blocks;
+  };
+  EXPECT_EQ(frontier(*doms, b0), std::vector<Block*>{});
+  EXPECT_EQ(frontier(*doms, b1), std::vector<Block*>{b1});
+  EXPECT_EQ(frontier(*doms, b2), (std::vector<Block*>{b1, b5}));
+  EXPECT_EQ(frontier(*doms, b3), (std::vector<Block*>{b3, b5}));
+  EXPECT_EQ(frontier(*doms, b4), (std::vector<Block*>{b3, b5}));
+
+  auto post_doms = cfg.post_dominators();
+  EXPECT_EQ(post_doms->root(), b5);
+  EXPECT_EQ(post_doms->idom(b5), b5);
+  EXPECT_EQ(post_doms->idom(b2), b5);
+  EXPECT_EQ(post_doms->idom(b4), b5);
+  EXPECT_EQ(post_doms->idom(b3), b4);
+  EXPECT_EQ(post_doms->idom(b1), b5);
+  EXPECT_EQ(post_doms->idom(b0), b1);
+  EXPECT_EQ(post_doms->idom(unreachable), b5);
+  EXPECT_EQ(frontier(*post_doms, b2), std::vector<Block*>{b1});
+  EXPECT_EQ(frontier(*post_doms, b4), (std::vector<Block*>{b1, b4}));
+
+  // The trees are cached until the edges change.
+  EXPECT_EQ(cfg.dominators(), doms);
+  EXPECT_EQ(cfg.post_dominators(), post_doms);
+  cfg.add_edge(b0, b5, EDGE_BRANCH);
+  auto new_doms = cfg.dominators();
+  EXPECT_NE(new_doms, doms);
+  EXPECT_EQ(new_doms->idom(b5), b0);
+  EXPECT_EQ(doms->idom(b5), b1);
+}
+
 TEST(ControlFlow, iterate1) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -256,6 +256,48 @@ TEST(CopyPropagationTest, loopNoChange) {
             assembler::to_s_expr(expected_code.get()));
 }
 
+TEST(CopyPropagationTest, loopKeepsCopy) {
+  for (bool ssa : {true, false}) {
+    auto code = assembler::ircode_from_string(R"(
+      (
+        (move v1 v0)
+
+        (:loop)
+        (if-eqz v2 :end)
+        (move v1 v0)
+        (add-int/lit8 v2 v2 -1)
+        (goto :loop)
+
+        (:end)
+        (return v1)
+      )
+    )");
+    code->set_registers_size(3);
+
+    CopyPropagationPass::Config config;
+    config.ssa = ssa;
+    CopyPropagation(config).run(code.get());
+
+    auto expected_code = assembler::ircode_from_string(R"(
+      (
+        (move v1 v0)
+
+        (:loop)
+        (if-eqz v2 :end)
+        (add-int/lit8 v2 v2 -1)
+        (goto :loop)
+
+        (:end)
+        (return v0)
+      )
+    )");
+
+    EXPECT_EQ(assembler::to_s_expr(code.get()),
+              assembler::to_s_expr(expected_code.get()))
+        << "ssa: " << ssa;
+  }
+}
+
 TEST(CopyPropagationTest, branchNoChange) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -865,3 +865,49 @@ TEST_F(DedupBlocksTest, dontDedupCatchBlockAndNonCatchBlock) {
   EXPECT_EQ(assembler::to_string(expect_code.get()),
             assembler::to_string(code));
 }
+
+TEST_F(DedupBlocksTest, reportCrossMethodDuplicates) {
+  auto first = get_fresh_method("first");
+  first->set_code(assembler::ircode_from_string(R"(
+    (
+      (const v0 1)
+      (if-eqz v0 :end)
+      (add-int v1 v0 v0)
+      (mul-int v1 v1 v0)
+      (add-int/lit8 v1 v1 2)
+      (:end)
+      (return-void)
+    )
+  )"));
+  // The same block on other registers.
+  auto second = get_fresh_method("second");
+  second->set_code(assembler::ircode_from_string(R"(
+    (
+      (const v2 1)
+      (if-nez v2 :end)
+      (add-int v3 v2 v2)
+      (mul-int v3 v3 v2)
+      (add-int/lit8 v3 v3 2)
+      (:end)
+      (return-void)
+    )
+  )"));
+
+  auto pass = new DedupBlocksPass();
+  pass->m_config.report_cross_method_duplicates = true;
+  std::vector<DexStore> stores;
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes({m_class});
+  stores.emplace_back(std::move(store));
+  PassManager manager({pass});
+  manager.set_testing_mode();
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, dummy_config);
+
+  const auto& metrics = manager.get_pass_info()[0].metrics;
+  EXPECT_EQ(metrics.at("cross_method_duplicate_blocks"), 1);
+  EXPECT_EQ(metrics.at("cross_method_duplicate_insns"), 3);
+}
@@ -6,9 +6,19 @@
  */
 
 #include "DexOutput.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <future>
 #include <gtest/gtest.h>
 #include <json/json.h>
 
+#include "Creators.h"
+#include "DexLoader.h"
+#include "DexPosition.h"
+#include "IRAssembler.h"
+#include "InstructionLowering.h"
+#include "RedexTest.h"
+
 TEST(DexOutput, checkMethodInstructionSizeLimit) {
 
   Json::Value json_cfg;
@@ -24,3 +34,562 @@ TEST(DexOutput, checkMethodInstructionSizeLimit) {
       DexOutput::check_method_instruction_size_limit(conf, 65537, "method"),
       RedexException);
 }
+
+namespace {
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+struct DexOutputEmitTest : public RedexTest {};
+
+TEST_F(DexOutputEmitTest, mappedOutputMatchesBufferedOutput) {
+  Json::Value json_cfg;
+  std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+  temp_json >> json_cfg;
+
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  std::string outputs[2];
+  for (bool mmap_output : {false, true}) {
+    // Emitting converts the code of the methods, so start afresh each time.
+    delete g_redex;
+    g_redex = new RedexContext();
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    creator.add_method(assembler::method_from_string(R"(
+      (method (public static) "LFoo;.bar:(I)I"
+        (
+          (load-param v0)
+          (const-string "hello")
+          (move-result-pseudo-object v1)
+          (return v0)
+        )
+      )
+    )"));
+    DexClasses classes{creator.create()};
+    std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+
+    json_cfg["mmap_dex_output"] = mmap_output;
+    ConfigFiles conf(json_cfg);
+    auto path = (dir / (mmap_output ? "mapped.dex" : "buffered.dex")).string();
+    auto stats = write_classes_to_dex(path, &classes,
+                                      /* locator_index */ nullptr,
+                                      /* emit_name_based_locators */ false,
+                                      /* store_number */ 0,
+                                      /* dex_number */ 0, conf,
+                                      pos_mapper.get(),
+                                      /* method_to_id */ nullptr,
+                                      /* code_debug_lines */ nullptr,
+                                      /* iodi_metadata */ nullptr,
+                                      DEX_HEADER_DEXMAGIC_V35);
+    outputs[mmap_output] = read_file(path);
+    EXPECT_EQ(stats.num_bytes, outputs[mmap_output].size());
+  }
+  boost::filesystem::remove_all(dir);
+
+  EXPECT_GT(outputs[0].size(), sizeof(dex_header));
+  EXPECT_EQ(outputs[0], outputs[1]);
+}
+
+TEST_F(DexOutputEmitTest, identicalDebugInfoIsShared) {
+  Json::Value json_cfg;
+  std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+  temp_json >> json_cfg;
+  ConfigFiles conf(json_cfg);
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  for (const char* name : {"LFoo;.bar:(I)I", "LFoo;.baz:(I)I"}) {
+    auto method = assembler::method_from_string(std::string(R"(
+      (method (public static) ")") + name + R"("
+        (
+          (load-param v0)
+          (return v0)
+        )
+      )
+    )");
+    method->get_code()->set_debug_item(std::make_unique<DexDebugItem>());
+    creator.add_method(method);
+  }
+  DexClasses classes{creator.create()};
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto stats = write_classes_to_dex((dir / "classes.dex").string(), &classes,
+                                    /* locator_index */ nullptr,
+                                    /* emit_name_based_locators */ false,
+                                    /* store_number */ 0,
+                                    /* dex_number */ 0, conf,
+                                    pos_mapper.get(),
+                                    /* method_to_id */ nullptr,
+                                    /* code_debug_lines */ nullptr,
+                                    /* iodi_metadata */ nullptr,
+                                    DEX_HEADER_DEXMAGIC_V35);
+  boost::filesystem::remove_all(dir);
+
+  EXPECT_EQ(stats.num_dbg_items, 1);
+}
+
+namespace {
+
+std::string dump_debug_items(const DexClasses& classes) {
+  std::ostringstream out;
+  for (auto* cls : classes) {
+    for (auto* method : cls->get_dmethods()) {
+      auto* dbg = method->get_dex_code()->get_debug_item();
+      out << show(method) << ":";
+      for (auto& entry : dbg->get_entries()) {
+        out << " " << entry.addr;
+        if (entry.type == DexDebugEntryType::Position) {
+          out << "@" << entry.pos->line << " " << show(entry.pos->method);
+        }
+      }
+      out << "\n";
+    }
+  }
+  return out.str();
+}
+
+} // namespace
+
+TEST_F(DexOutputEmitTest, lazyDebugInfoDecodesTheSameEntries) {
+  Json::Value json_cfg;
+  std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+  temp_json >> json_cfg;
+  ConfigFiles conf(json_cfg);
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)I"
+      (
+        (load-param v0)
+        (.pos "LFoo;.bar:(I)I" "Foo.java" 10)
+        (add-int/lit8 v0 v0 1)
+        (.pos "LFoo;.bar:(I)I" "Foo.java" 12)
+        (return v0)
+      )
+    )
+  )");
+  method->get_code()->set_debug_item(std::make_unique<DexDebugItem>());
+  instruction_lowering::lower(method);
+  creator.add_method(method);
+  DexClasses classes{creator.create()};
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto path = (dir / "classes.dex").string();
+  write_classes_to_dex(path, &classes,
+                       /* locator_index */ nullptr,
+                       /* emit_name_based_locators */ false,
+                       /* store_number */ 0,
+                       /* dex_number */ 0, conf, pos_mapper.get(),
+                       /* method_to_id */ nullptr,
+                       /* code_debug_lines */ nullptr,
+                       /* iodi_metadata */ nullptr, DEX_HEADER_DEXMAGIC_V35);
+
+  std::string dumps[2];
+  for (bool lazy : {false, true}) {
+    delete g_redex;
+    g_redex = new RedexContext();
+    RedexContext::set_lazy_debug_info(lazy);
+    auto loaded = load_classes_from_dex(path.c_str(), /* balloon */ false);
+    ASSERT_EQ(1, loaded.size());
+    auto* dbg = loaded[0]->get_dmethods()[0]->get_dex_code()->get_debug_item();
+    ASSERT_NE(nullptr, dbg);
+    EXPECT_EQ(!lazy, dbg->is_decoded());
+    dumps[lazy] = dump_debug_items(loaded);
+    EXPECT_TRUE(dbg->is_decoded());
+  }
+  boost::filesystem::remove_all(dir);
+
+  EXPECT_NE(std::string::npos, dumps[0].find("@12"));
+  EXPECT_EQ(dumps[0], dumps[1]);
+}
+
+TEST_F(DexOutputEmitTest, loaderDropsTheDebugInfoItIsToldTo) {
+  Json::Value json_cfg;
+  std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+  temp_json >> json_cfg;
+  ConfigFiles conf(json_cfg);
+
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)I"
+      (
+        (load-param v0)
+        (.pos "LFoo;.bar:(I)I" "Foo.java" 10)
+        (add-int/lit8 v0 v0 1)
+        (return v0)
+      )
+    )
+  )");
+  auto code = method->get_code();
+  code->insert_before(code->begin(), std::unique_ptr<DexDebugInstruction>(
+                                         new DexDebugOpcodeStartLocal(
+                                             0, DexString::make_string("x"),
+                                             get_int_type())));
+  code->set_debug_item(std::make_unique<DexDebugItem>());
+  instruction_lowering::lower(method);
+  creator.add_method(method);
+  DexClasses classes{creator.create()};
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto path = (dir / "classes.dex").string();
+  write_classes_to_dex(path, &classes,
+                       /* locator_index */ nullptr,
+                       /* emit_name_based_locators */ false,
+                       /* store_number */ 0,
+                       /* dex_number */ 0, conf, pos_mapper.get(),
+                       /* method_to_id */ nullptr,
+                       /* code_debug_lines */ nullptr,
+                       /* iodi_metadata */ nullptr, DEX_HEADER_DEXMAGIC_V35);
+
+  auto count_entries = [&](const LoadedDebugInfo& loaded, size_t* positions,
+                           size_t* locals) {
+    delete g_redex;
+    g_redex = new RedexContext();
+    RedexContext::set_loaded_debug_info(loaded);
+    auto classes = load_classes_from_dex(path.c_str(), /* balloon */ false);
+    auto* dbg = classes[0]->get_dmethods()[0]->get_dex_code()->get_debug_item();
+    *positions = *locals = 0;
+    if (dbg == nullptr) {
+      return false;
+    }
+    for (auto& entry : dbg->get_entries()) {
+      if (entry.type == DexDebugEntryType::Position) {
+        ++*positions;
+      } else if (entry.insn->opcode() == DBG_START_LOCAL) {
+        ++*locals;
+      }
+    }
+    return true;
+  };
+
+  size_t positions;
+  size_t locals;
+  LoadedDebugInfo loaded;
+  EXPECT_TRUE(count_entries(loaded, &positions, &locals));
+  EXPECT_EQ(1, positions);
+  EXPECT_EQ(1, locals);
+
+  loaded.locals = false;
+  EXPECT_TRUE(count_entries(loaded, &positions, &locals));
+  EXPECT_EQ(1, positions);
+  EXPECT_EQ(0, locals);
+
+  loaded.positions = false;
+  EXPECT_TRUE(count_entries(loaded, &positions, &locals));
+  EXPECT_EQ(0, positions);
+  EXPECT_EQ(0, locals);
+
+  loaded.debug_items = false;
+  EXPECT_FALSE(count_entries(loaded, &positions, &locals));
+  boost::filesystem::remove_all(dir);
+}
+
+TEST_F(DexOutputEmitTest, symbolFilesUseDeobfuscatedNames) {
+  Json::Value json_cfg;
+  std::istringstream temp_json(R"({
+    "redex": {"passes": []},
+    "method_mapping": "method_mapping.txt",
+    "class_mapping": "class_mapping.txt",
+    "proguard_map_output": "pg_mapping.txt"
+  })");
+  temp_json >> json_cfg;
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  ConfigFiles conf(json_cfg, dir.string());
+
+  ClassCreator creator(DexType::make_type("LX;"));
+  creator.set_super(get_object_type());
+  auto field = static_cast<DexField*>(DexField::make_field("LX;.a:[LX;"));
+  field->make_concrete(ACC_PUBLIC);
+  field->set_deobfuscated_name("Lcom/foo/Bar;.items:[Lcom/foo/Bar;");
+  creator.add_field(field);
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LX;.b:([I)LX;"
+      (
+        (const v0 0)
+        (return-object v0)
+      )
+    )
+  )");
+  method->set_deobfuscated_name("Lcom/foo/Bar;.make:([I)Lcom/foo/Bar;");
+  creator.add_method(method);
+  // Methods that Redex created have no deobfuscated name.
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LX;.c:(LX;J)V"
+      (
+        (invoke-static () "LX;.b:([I)LX;")
+        (return-void)
+      )
+    )
+  )"));
+  auto cls = creator.create();
+  cls->set_deobfuscated_name("Lcom/foo/Bar;");
+  DexClasses classes{cls};
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+
+  write_classes_to_dex((dir / "classes.dex").string(), &classes,
+                       /* locator_index */ nullptr,
+                       /* emit_name_based_locators */ false,
+                       /* store_number */ 0,
+                       /* dex_number */ 0, conf, pos_mapper.get(),
+                       /* method_to_id */ nullptr,
+                       /* code_debug_lines */ nullptr,
+                       /* iodi_metadata */ nullptr, DEX_HEADER_DEXMAGIC_V35);
+  auto pg_mapping = read_file((dir / "pg_mapping.txt").string());
+  auto method_mapping = read_file((dir / "method_mapping.txt").string());
+  auto class_mapping = read_file((dir / "class_mapping.txt").string());
+  boost::filesystem::remove_all(dir);
+
+  EXPECT_EQ(
+      "com.foo.Bar -> X:\n"
+      "    com.foo.Bar[] items -> a\n"
+      "    com.foo.Bar make(int[]) -> b\n"
+      "    void c(com.foo.Bar,long) -> c\n",
+      pg_mapping);
+  EXPECT_NE(std::string::npos, method_mapping.find(" make Lcom/foo/Bar;\n"));
+  EXPECT_NE(std::string::npos, method_mapping.find(" c Lcom/foo/Bar;\n"));
+  EXPECT_EQ(0, class_mapping.find("0 "));
+  EXPECT_NE(std::string::npos, class_mapping.find(" Lcom/foo/Bar;\n"));
+}
+
+namespace {
+
+std::vector<std::string> instructions(IRCode* code) {
+  std::vector<std::string> result;
+  for (const auto& mie : InstructionIterable(code)) {
+    result.push_back(show(mie.insn));
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_F(DexOutputEmitTest, loadedCodeBalloonsToTheSameIR) {
+  Json::Value json_cfg;
+  std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+  temp_json >> json_cfg;
+  ConfigFiles conf(json_cfg);
+
+  // Covers each way that the operands of an instruction are decoded.
+  const char* code = R"(
+    (method (public static) "LFoo;.bar:(IJLFoo;)LFoo;"
+      (
+        (load-param v14)
+        (load-param-wide v15)
+        (load-param-object v17)
+        (const v4 1)
+        (const v5 1000)
+        (const v6 100000)
+        (const-wide v7 -1)
+        (const-wide v7 1000000000000)
+        (const-string "hello")
+        (move-result-pseudo-object v9)
+        (new-instance "LFoo;")
+        (move-result-pseudo-object v10)
+        (invoke-direct (v10) "LFoo;.<init>:()V")
+        (check-cast v10 "LFoo;")
+        (move-result-pseudo-object v10)
+        (sget-object "LFoo;.f:LFoo;")
+        (move-result-pseudo-object v11)
+        (iget v10 "LFoo;.i:I")
+        (move-result-pseudo v12)
+        (add-int/lit8 v12 v12 3)
+        (mul-int v12 v12 v14)
+        (filled-new-array (v4 v5) "[I")
+        (move-result-object v13)
+        (aget v13 v4)
+        (move-result-pseudo v12)
+        (invoke-static (v4 v5 v6 v7 v9 v10)
+          "LFoo;.baz:(IIIJLjava/lang/String;LFoo;)V")
+        (packed-switch v14 (:a :b))
+        (if-eqz v12 :a)
+        (return-object v10)
+        (:a 0)
+        (return-object v17)
+        (:b 1)
+        (goto :a)
+      )
+    )
+  )";
+  auto method = assembler::method_from_string(code);
+  auto expected = instructions(method->get_code());
+  instruction_lowering::lower(method);
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(method);
+  DexClasses classes{creator.create()};
+  std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto path = (dir / "classes.dex").string();
+  write_classes_to_dex(path, &classes,
+                       /* locator_index */ nullptr,
+                       /* emit_name_based_locators */ false,
+                       /* store_number */ 0,
+                       /* dex_number */ 0, conf, pos_mapper.get(),
+                       /* method_to_id */ nullptr,
+                       /* code_debug_lines */ nullptr,
+                       /* iodi_metadata */ nullptr, DEX_HEADER_DEXMAGIC_V35);
+
+  delete g_redex;
+  g_redex = new RedexContext();
+  auto loaded = load_classes_from_dex(path.c_str(), /* balloon */ true);
+  boost::filesystem::remove_all(dir);
+  ASSERT_EQ(1, loaded.size());
+  EXPECT_EQ(expected, instructions(loaded[0]->get_dmethods()[0]->get_code()));
+}
+
+namespace {
+
+DexClass* create_class(const std::string& name, size_t num_methods) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(get_object_type());
+  std::string body;
+  for (int i = 0; i < 50; ++i) {
+    body += "(const-wide v0 1000000000000)";
+  }
+  for (size_t i = 0; i < num_methods; ++i) {
+    auto method = assembler::method_from_string(
+        "(method (public static) \"" + name + ".m" + std::to_string(i) +
+        ":()V\" (" + body + "(return-void)))");
+    instruction_lowering::lower(method);
+    creator.add_method(method);
+  }
+  auto clinit = assembler::method_from_string(
+      "(method (public static constructor) \"" + name +
+      ".<clinit>:()V\" ((const-string \"" + name +
+      "\") (move-result-pseudo-object v0) (return-void)))");
+  instruction_lowering::lower(clinit);
+  creator.add_method(clinit);
+  return creator.create();
+}
+
+} // namespace
+
+TEST_F(DexOutputEmitTest, coldstartOrderPacksColdstartPages) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto coldstart_classes = (dir / "coldstart_classes.txt").string();
+  std::ofstream(coldstart_classes) << "A.class\nC.class\nE.class\n";
+
+  int num_pages[2];
+  for (bool coldstart_order : {false, true}) {
+    delete g_redex;
+    g_redex = new RedexContext();
+    // The code of B and D spans a couple of pages each, and coldstart only
+    // runs the <clinit>s of A, C and E, which it would otherwise separate.
+    DexClasses classes;
+    for (const auto& name : {"LA;", "LB;", "LC;", "LD;", "LE;"}) {
+      auto num_methods = name[1] == 'B' || name[1] == 'D' ? 16 : 0;
+      classes.push_back(create_class(name, num_methods));
+    }
+
+    Json::Value json_cfg;
+    std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+    temp_json >> json_cfg;
+    json_cfg["coldstart_classes"] = coldstart_classes;
+    if (coldstart_order) {
+      json_cfg["string_sort_mode"] = "coldstart_order";
+      json_cfg["bytecode_sort_mode"] = "coldstart_order";
+    }
+    ConfigFiles conf(json_cfg);
+    conf.load(classes);
+    std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+    auto path = (dir / "classes.dex").string();
+    auto stats = write_classes_to_dex(path, &classes,
+                                      /* locator_index */ nullptr,
+                                      /* emit_name_based_locators */ false,
+                                      /* store_number */ 0,
+                                      /* dex_number */ 0, conf,
+                                      pos_mapper.get(),
+                                      /* method_to_id */ nullptr,
+                                      /* code_debug_lines */ nullptr,
+                                      /* iodi_metadata */ nullptr,
+                                      DEX_HEADER_DEXMAGIC_V35);
+    num_pages[coldstart_order] = stats.num_coldstart_pages;
+
+    delete g_redex;
+    g_redex = new RedexContext();
+    auto loaded = load_classes_from_dex(path.c_str(), /* balloon */ false);
+    ASSERT_EQ(5, loaded.size());
+    EXPECT_EQ(17, loaded[1]->get_dmethods().size());
+    EXPECT_EQ(1, loaded[4]->get_dmethods().size());
+  }
+  boost::filesystem::remove_all(dir);
+
+  EXPECT_GT(num_pages[0], 0);
+  EXPECT_LT(num_pages[1], num_pages[0]);
+}
+
+TEST_F(DexOutputEmitTest, failedDexDoesNotHoldUpTheNextOne) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  // Dex 0 can't be opened: buffered output gives up before the symbol files,
+  // and mapped output throws before anything.
+  for (bool mmap_output : {false, true}) {
+    delete g_redex;
+    g_redex = new RedexContext();
+    DexClasses classes0{create_class("LA;", 1)};
+    DexClasses classes1{create_class("LB;", 1)};
+
+    Json::Value json_cfg;
+    std::istringstream temp_json("{\"redex\":{\"passes\":[]}}");
+    temp_json >> json_cfg;
+    ConfigFiles conf1(json_cfg);
+    json_cfg["mmap_dex_output"] = mmap_output;
+    ConfigFiles conf0(json_cfg);
+    std::unique_ptr<PositionMapper> pos_mapper(PositionMapper::make(""));
+    DexEmissionOrder emission_order;
+    auto write = [&](const std::string& path, DexClasses* classes,
+                     const ConfigFiles& conf, size_t ticket) {
+      return write_classes_to_dex(path, classes,
+                                  /* locator_index */ nullptr,
+                                  /* emit_name_based_locators */ false,
+                                  /* store_number */ 0,
+                                  /* dex_number */ ticket, conf,
+                                  pos_mapper.get(),
+                                  /* method_to_id */ nullptr,
+                                  /* code_debug_lines */ nullptr,
+                                  /* iodi_metadata */ nullptr,
+                                  DEX_HEADER_DEXMAGIC_V35, &emission_order,
+                                  ticket);
+    };
+
+    auto path1 = (dir / "classes2.dex").string();
+    auto dex1 = std::async(std::launch::async,
+                           [&] { return write(path1, &classes1, conf1, 1); });
+    auto path0 = (dir / "missing" / "classes.dex").string();
+    if (mmap_output) {
+      EXPECT_THROW(write(path0, &classes0, conf0, 0), RedexException);
+    } else {
+      write(path0, &classes0, conf0, 0);
+    }
+    ASSERT_EQ(std::future_status::ready,
+              dex1.wait_for(std::chrono::seconds(60)));
+    EXPECT_GT(dex1.get().num_bytes, sizeof(dex_header));
+  }
+  boost::filesystem::remove_all(dir);
+}
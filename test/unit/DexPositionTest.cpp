@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexPosition.h"
+#include "RedexTest.h"
+
+class DexPositionTest : public RedexTest {};
+
+TEST_F(DexPositionTest, tableSharesEqualEntries) {
+  auto method = DexString::make_string("LFoo;.bar:()V");
+  auto file = DexString::make_string("Foo.java");
+  DexPositionTable table;
+  auto root = table.intern({method, file, 1, DexPositionTable::NO_PARENT});
+  auto child = table.intern({method, file, 2, root});
+  EXPECT_EQ(root, table.intern({method, file, 1, DexPositionTable::NO_PARENT}));
+  EXPECT_EQ(child, table.intern({method, file, 2, root}));
+  EXPECT_NE(child, table.intern({method, file, 2, DexPositionTable::NO_PARENT}));
+  EXPECT_EQ(3, table.size());
+  EXPECT_EQ(root, table.entries()[child].parent);
+}
+
+namespace {
+
+std::string read_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+uint32_t read_u32(const std::string& bytes, size_t offset) {
+  uint32_t value;
+  memcpy(&value, bytes.data() + offset, sizeof(value));
+  return value;
+}
+
+struct TestPositionMapper : public RealPositionMapper {
+  TestPositionMapper() : RealPositionMapper("") {}
+  using RealPositionMapper::get_line;
+};
+
+} // namespace
+
+TEST_F(DexPositionTest, mapperSharesLinesOfEqualPositions) {
+  auto method = DexString::make_string("LFoo;.bar:()V");
+  auto file = DexString::make_string("Foo.java");
+  // The same callee position inlined at two copies of one callsite.
+  DexPosition callsite1(method, file, 10);
+  DexPosition callsite2(method, file, 10);
+  DexPosition inlined1(method, file, 20);
+  inlined1.parent = &callsite1;
+  DexPosition inlined2(method, file, 20);
+  inlined2.parent = &callsite2;
+  DexPosition other(method, file, 30);
+
+  TestPositionMapper mapper;
+  for (auto pos : {&callsite1, &callsite2, &inlined1, &inlined2, &other}) {
+    mapper.register_position(pos);
+  }
+  auto line = mapper.position_to_line(&inlined1);
+  EXPECT_EQ(line, mapper.position_to_line(&inlined2));
+  EXPECT_EQ(mapper.get_line(&callsite1), mapper.get_line(&callsite2));
+  EXPECT_NE(line, mapper.position_to_line(&other));
+}
+
+TEST_F(DexPositionTest, compactMapMatchesMapV2) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto v2_path = (dir / "map_v2").string();
+  auto v3_path = (dir / "map_v3").string();
+
+  auto method = DexString::make_string("LFoo;.bar:()V");
+  auto file = DexString::make_string("Foo.java");
+  DexPosition callsite(method, file, 10);
+  DexPosition inlined(DexString::make_string("LBaz;.qux:()V"), file, 20);
+  inlined.parent = &callsite;
+  {
+    RealPositionMapper mapper(v2_path, v3_path);
+    mapper.register_position(&callsite);
+    mapper.register_position(&inlined);
+    mapper.position_to_line(&inlined);
+    mapper.write_map();
+  }
+  auto v2 = read_file(v2_path);
+  auto v3 = read_file(v3_path);
+  boost::filesystem::remove_all(dir);
+
+  EXPECT_EQ(0xfaceb000, read_u32(v3, 0));
+  EXPECT_EQ(3, read_u32(v3, 4));
+  auto spool_count = read_u32(v3, 8);
+  auto pos_count = read_u32(v3, 12);
+  EXPECT_EQ(spool_count, read_u32(v2, 8));
+  EXPECT_EQ(2, pos_count);
+
+  // The strings are in the same order as in the v2 pool.
+  size_t v2_offset = 12;
+  for (uint32_t i = 0; i < spool_count; ++i) {
+    auto size = read_u32(v2, v2_offset);
+    auto begin = read_u32(v3, 16 + 4 * i);
+    auto end = read_u32(v3, 16 + 4 * (i + 1));
+    EXPECT_EQ(v2.substr(v2_offset + 4, size), v3.substr(begin, end - begin));
+    v2_offset += 4 + size;
+  }
+  EXPECT_EQ(pos_count, read_u32(v2, v2_offset));
+  size_t positions_size = pos_count * sizeof(PositionMapItem);
+  EXPECT_EQ(v2.substr(v2_offset + 4, positions_size),
+            v3.substr(16 + 4 * (spool_count + 1), positions_size));
+  EXPECT_EQ(v3.size(), read_u32(v3, 16 + 4 * spool_count));
+}
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexStore.h"
+#include "DexStoreUtil.h"
+#include "DexUtil.h"
+#include "RedexTest.h"
+#include "ScopeHelper.h"
+
+class DexStoreTest : public RedexTest {};
+
+TEST_F(DexStoreTest, cachedScopeFollowsTheStores) {
+  auto foo = create_class(DexType::make_type("LFoo;"), get_object_type(), {},
+                          ACC_PUBLIC);
+  auto bar = create_class(DexType::make_type("LBar;"), get_object_type(), {},
+                          ACC_PUBLIC);
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStoresVector stores;
+  stores.emplace_back(dm);
+  std::vector<DexClass*> classes{foo};
+  stores[0].add_classes(classes);
+
+  const auto& stores_ref = stores;
+  const Scope& scope = get_class_scope(stores);
+  EXPECT_EQ(Scope{foo}, scope);
+  EXPECT_EQ(build_class_scope(stores), scope);
+
+  // Reading the dexes leaves the version alone.
+  auto version = stores[0].get_version();
+  EXPECT_EQ(1, stores_ref[0].get_dexen().size());
+  EXPECT_EQ(version, stores[0].get_version());
+
+  // Edits through the non-const dexes are seen.
+  stores[0].get_dexen()[0].push_back(bar);
+  EXPECT_NE(version, stores[0].get_version());
+  EXPECT_EQ((Scope{foo, bar}), get_class_scope(stores));
+
+  // As are edits through dexes that were held on to, once marked.
+  auto& dexen = stores[0].get_dexen();
+  get_class_scope(stores);
+  dexen[0].pop_back();
+  stores[0].mark_changed();
+  EXPECT_EQ(Scope{foo}, get_class_scope(stores));
+}
+
+TEST_F(DexStoreTest, parallelForEachStoreVisitsEachStoreOnce) {
+  DexStoresVector stores;
+  for (size_t i = 0; i < 50; ++i) {
+    DexMetadata dm;
+    dm.set_id(i == 0 ? "classes" : "module" + std::to_string(i));
+    stores.emplace_back(dm);
+    auto cls = create_class(
+        DexType::make_type(("LModule" + std::to_string(i) + ";").c_str()),
+        get_object_type(), {}, ACC_PUBLIC);
+    std::vector<DexClass*> classes{cls};
+    stores[i].add_classes(classes);
+  }
+
+  std::vector<size_t> num_classes(stores.size());
+  parallel_for_each_store(stores, [&](size_t store_idx, DexStore& store) {
+    EXPECT_EQ(&stores[store_idx], &store);
+    num_classes[store_idx] += build_class_scope(store.get_dexen()).size();
+  });
+  EXPECT_EQ(std::vector<size_t>(stores.size(), 1), num_classes);
+}
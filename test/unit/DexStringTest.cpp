@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DexClass.h"
+#include "StringHash.h"
+
+TEST(DexStringTest, mappedStringIsNotCopied) {
+  g_redex = new RedexContext();
+  // Stands in for the string data of a mapped dex file.
+  static const char mapped[] = "Lcom/foo/Bar;";
+  DexString* s = g_redex->make_mapped_string(mapped, sizeof(mapped) - 1);
+  EXPECT_EQ(mapped, s->c_str());
+  EXPECT_EQ(sizeof(mapped) - 1, s->size());
+  EXPECT_EQ("Lcom/foo/Bar;", s->str());
+  // str() materializes a copy but leaves c_str() pointing at the mapping.
+  EXPECT_EQ(mapped, s->c_str());
+
+  // Strings are still uniqued across both kinds of storage.
+  EXPECT_EQ(s, DexString::make_string("Lcom/foo/Bar;"));
+  EXPECT_EQ(s, DexString::get_string("Lcom/foo/Bar;"));
+
+  DexString* heap = DexString::make_string("Lcom/foo/Baz;");
+  EXPECT_EQ(heap, DexString::get_string("Lcom/foo/Baz;"));
+  EXPECT_EQ(heap->c_str(), heap->str().c_str());
+  delete g_redex;
+}
+
+TEST(DexStringTest, hashIsXXH64) {
+  EXPECT_EQ(0xEF46DB3751D8E999ULL, hash_bytes64("", 0));
+  EXPECT_EQ(0xD24EC4F1A98C6E5BULL, hash_bytes64("a", 1));
+  // Long strings go through the striped loop.
+  std::string long_string(100, 'x');
+  EXPECT_EQ(hash_bytes64(long_string.c_str(), long_string.size()),
+            hash_bytes64(std::string(100, 'x').c_str(), 100));
+  EXPECT_NE(hash_bytes64(long_string.c_str(), long_string.size()),
+            hash_bytes64(long_string.c_str(), long_string.size() - 1));
+}
+
+TEST(DexStringTest, stringsAreInternedAcrossThreads) {
+  g_redex = new RedexContext();
+  // Enough strings to grow the tables several times.
+  constexpr size_t kNumStrings = 20000;
+  constexpr size_t kNumThreads = 4;
+  std::vector<std::vector<DexString*>> results(kNumThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([t, &results]() {
+      for (size_t i = 0; i < kNumStrings; ++i) {
+        // The threads go through the strings in different orders.
+        size_t n = (i * (2 * t + 1)) % kNumStrings;
+        results[t].push_back(DexString::make_string(
+            "Lcom/facebook/common/Class" + std::to_string(n) + ";"));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0; i < kNumStrings; ++i) {
+    auto name = "Lcom/facebook/common/Class" + std::to_string(i) + ";";
+    auto str = DexString::get_string(name);
+    ASSERT_NE(nullptr, str);
+    EXPECT_EQ(name, str->str());
+    EXPECT_EQ(hash_bytes64(name.c_str(), name.size()), str->hash());
+    // Every thread got the same DexString.
+    EXPECT_EQ(str, results[0][i]);
+  }
+  for (size_t t = 1; t < kNumThreads; ++t) {
+    for (size_t i = 0; i < kNumStrings; ++i) {
+      EXPECT_EQ(results[0][(i * (2 * t + 1)) % kNumStrings], results[t][i]);
+    }
+  }
+  EXPECT_EQ(nullptr, DexString::get_string("Lcom/facebook/common/Class;"));
+  delete g_redex;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <array>
+#include <vector>
+
+#include "DexClass.h"
+#include "RedexTest.h"
+
+class DexTypeListTest : public RedexTest {};
+
+TEST_F(DexTypeListTest, spanAndDequeAgree) {
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+
+  std::vector<DexType*> ab{a, b};
+  EXPECT_EQ(nullptr, DexTypeList::get_type_list(DexTypeSpan(ab)));
+  auto list = DexTypeList::make_type_list(ab);
+  ASSERT_NE(nullptr, list);
+  EXPECT_EQ(std::deque<DexType*>({a, b}), list->get_type_list());
+
+  // Lists made from a span or from a deque are the same.
+  EXPECT_EQ(list, DexTypeList::make_type_list({a, b}));
+  EXPECT_EQ(list, DexTypeList::get_type_list({a, b}));
+  std::array<DexType*, 2> on_stack{{a, b}};
+  EXPECT_EQ(list, DexTypeList::get_type_list(on_stack));
+
+  // Prefixes and permutations are other lists.
+  EXPECT_EQ(nullptr, DexTypeList::get_type_list(DexTypeSpan(ab.data(), 1)));
+  std::vector<DexType*> ba{b, a};
+  EXPECT_NE(list, DexTypeList::make_type_list(ba));
+
+  auto empty = DexTypeList::make_type_list(DexTypeSpan(nullptr, 0));
+  EXPECT_EQ(0, empty->size());
+  EXPECT_EQ(empty, DexTypeList::make_type_list({}));
+}
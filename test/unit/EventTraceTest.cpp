@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <json/json.h>
+#include <map>
+
+#include "EventTrace.h"
+#include "WorkQueue.h"
+
+namespace {
+
+// The names of the spans of each category in the trace at `path`, and how
+// many there are of each.
+std::map<std::string, std::map<std::string, int>> read_spans(
+    const std::string& path) {
+  Json::Value trace;
+  std::ifstream in(path);
+  in >> trace;
+  std::map<std::string, std::map<std::string, int>> spans;
+  for (const auto& event : trace["traceEvents"]) {
+    if (event["ph"].asString() == "X") {
+      ++spans[event["cat"].asString()][event["name"].asString()];
+    }
+  }
+  return spans;
+}
+
+} // namespace
+
+TEST(EventTraceTest, spansOfAllThreads) {
+  {
+    event_trace::Span span("test", "before enable");
+  }
+  event_trace::enable(/* events_per_thread */ 4);
+  {
+    event_trace::Span span("test", "a \"quoted\" name");
+    EXPECT_STREQ("a \"quoted\" name", event_trace::current_span());
+    auto wq = workqueue_foreach<int>([](int) {}, 2);
+    wq.add_item(1);
+    wq.run_all();
+  }
+  EXPECT_EQ(nullptr, event_trace::current_span());
+  // Only the last four spans of the thread are kept.
+  for (int i = 0; i < 10; ++i) {
+    event_trace::Span span("test", "repeated " + std::to_string(i));
+  }
+
+  auto path =
+      (boost::filesystem::temp_directory_path() /
+       boost::filesystem::unique_path("event-trace-%%%%%%%%.json"))
+          .string();
+  ASSERT_TRUE(event_trace::write_chrome_trace(path));
+  auto spans = read_spans(path);
+  boost::filesystem::remove(path);
+
+  EXPECT_EQ(0, spans["test"].count("before enable"));
+  EXPECT_EQ(0, spans["test"].count("a \"quoted\" name"));
+  EXPECT_EQ(4, spans["test"].size());
+  EXPECT_EQ(1, spans["test"].count("repeated 9"));
+  // Each worker records its time under the span that ran the queue.
+  EXPECT_EQ(2, spans["worker"]["a \"quoted\" name"]);
+}
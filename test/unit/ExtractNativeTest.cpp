@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstring>
 #include <string>
 #include <gtest/gtest.h>
 
@@ -18,3 +19,54 @@ TEST(ExtractNativeTest, empty) {
   auto overset = extract_classes_from_native_lib(over);
   EXPECT_EQ(overset.size(), 2);
 }
+
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const char* data, size_t size);
+
+namespace {
+
+template <typename T>
+void put(std::string& data, size_t offset, T value) {
+  memcpy(&data[offset], &value, sizeof(T));
+}
+
+// Appends a section header of an ELF64 file, for a section of `contents`
+// that is placed at the end of the file.
+void add_section(std::string& elf,
+                 std::string& sections,
+                 uint32_t type,
+                 uint64_t flags,
+                 const std::string& contents) {
+  std::string header(0x40, '\0');
+  put<uint32_t>(header, 0x04, type);
+  put<uint64_t>(header, 0x08, flags);
+  put<uint64_t>(header, 0x18, elf.size());
+  put<uint64_t>(header, 0x20, contents.size());
+  elf += contents;
+  sections += header;
+}
+
+} // namespace
+
+TEST(ExtractNativeTest, elf_sections) {
+  std::string elf(0x40, '\0');
+  memcpy(&elf[0], "\177ELF", 4);
+  elf[4] = 2; // ELFCLASS64
+  elf[5] = 1; // ELFDATA2LSB
+  std::string sections(0x40, '\0'); // The null section
+  add_section(elf, sections, /* SHT_PROGBITS */ 1, /* SHF_EXECINSTR */ 0x4,
+              std::string("com/foo/InCode\0", 15));
+  add_section(elf, sections, /* SHT_PROGBITS */ 1, 0,
+              std::string("\x01\x02Lcom/foo/InRodata;\0", 21));
+  add_section(elf, sections, /* SHT_STRTAB */ 3, 0,
+              std::string("\0com/foo/InStrtab\0", 18));
+  put<uint64_t>(elf, 0x28, elf.size());
+  put<uint16_t>(elf, 0x3a, 0x40);
+  put<uint16_t>(elf, 0x3c, 4);
+  elf += sections;
+
+  auto classes = extract_classes_from_native_lib(elf.data(), elf.size());
+  EXPECT_EQ(classes.count("Lcom/foo/InCode;"), 0);
+  EXPECT_EQ(classes.count("Lcom/foo/InRodata;"), 1);
+  EXPECT_EQ(classes.count("Lcom/foo/InStrtab;"), 1);
+}
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "FieldOpTracker.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+struct FieldOpTrackerTest : public RedexTest {};
+
+TEST_F(FieldOpTrackerTest, countsReadsAndWrites) {
+  auto foo_t = DexType::make_type("LFoo;");
+  auto make_field = [](const char* name, DexAccessFlags access) {
+    auto field = static_cast<DexField*>(DexField::make_field(name));
+    field->make_concrete(access);
+    return field;
+  };
+  auto a = make_field("LFoo;.a:I", ACC_PUBLIC);
+  auto b = make_field("LFoo;.b:I", ACC_PUBLIC | ACC_STATIC);
+  auto unused = make_field("LFoo;.unused:I", ACC_PUBLIC);
+
+  ClassCreator creator(foo_t);
+  creator.set_super(get_object_type());
+  creator.add_field(a);
+  creator.add_field(b);
+  creator.add_field(unused);
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public constructor) "LFoo;.<init>:()V"
+      (
+        (load-param-object v0)
+        (const v1 1)
+        (iput v1 v0 "LFoo;.a:I")
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v1)
+        (return-void)
+      )
+    )
+  )"));
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public) "LFoo;.bar:()V"
+      (
+        (load-param-object v0)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v1)
+        (sput v1 "LFoo;.b:I")
+        (sput v1 "LFoo;.b:I")
+        (return-void)
+      )
+    )
+  )"));
+  Scope scope{creator.create()};
+
+  auto field_stats = field_op_tracker::analyze(scope);
+  EXPECT_EQ(field_stats.size(), 2);
+  EXPECT_EQ(field_stats.count(unused), 0);
+
+  const auto& a_stats = field_stats.at(a);
+  EXPECT_EQ(a_stats.reads, 2);
+  EXPECT_EQ(a_stats.reads_outside_init, 1);
+  EXPECT_EQ(a_stats.writes, 1);
+  EXPECT_EQ(a_stats.writes_outside_init, 0);
+
+  const auto& b_stats = field_stats.at(b);
+  EXPECT_EQ(b_stats.reads, 0);
+  EXPECT_EQ(b_stats.writes, 2);
+  EXPECT_EQ(b_stats.writes_outside_init, 2);
+}
@@ -38,3 +38,95 @@ TEST_F(FinalInlineTest, encodeValues) {
   EXPECT_EQ(cls->get_clinit(), nullptr);
   EXPECT_EQ(field_bar->get_static_value()->value(), 1);
 }
+
+namespace {
+
+/*
+ * class Foo {
+ *   static int[] table = {10, -20, 30};
+ *   static int size;
+ *   static int second;
+ * }
+ *
+ * whose <clinit> reads size and second back from table, with `between` in
+ * between.
+ */
+DexClass* create_class_with_table(const std::string& between) {
+  ClassCreator cc(DexType::make_type("LFoo;"));
+  cc.set_super(get_object_type());
+  auto table = static_cast<DexField*>(DexField::make_field("LFoo;.table:[I"));
+  table->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL);
+  cc.add_field(table);
+  for (const auto& name : {"LFoo;.size:I", "LFoo;.second:I"}) {
+    auto field = static_cast<DexField*>(DexField::make_field(name));
+    field->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL,
+                         DexEncodedValue::zero_for_type(get_int_type()));
+    cc.add_field(field);
+  }
+  auto clinit = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.<clinit>:()V"
+     (
+      (const v0 3)
+      (new-array v0 "[I")
+      (move-result-pseudo-object v1)
+      (sput-object v1 "LFoo;.table:[I")
+      )" + between + R"(
+      (sget-object "LFoo;.table:[I")
+      (move-result-pseudo-object v2)
+      (array-length v2)
+      (move-result-pseudo v3)
+      (sput v3 "LFoo;.size:I")
+      (const v4 1)
+      (aget v2 v4)
+      (move-result-pseudo v5)
+      (sput v5 "LFoo;.second:I")
+      (return-void)
+     )
+    )
+  )");
+  // The assembler has no syntax for fill-array-data.
+  auto code = clinit->get_code();
+  for (auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == OPCODE_NEW_ARRAY) {
+      auto fill = new IRInstruction(OPCODE_FILL_ARRAY_DATA);
+      fill->set_src(0, 1);
+      fill->set_data(new DexOpcodeData(std::vector<uint16_t>{
+          FOPCODE_FILLED_ARRAY, 4, 3, 0, 10, 0, (uint16_t)-20, 0xffff, 30,
+          0}));
+      code->insert_after(mie.insn, {fill});
+      break;
+    }
+  }
+  cc.add_method(clinit);
+  return cc.create();
+}
+
+} // namespace
+
+TEST_F(FinalInlineTest, encodeValuesReadFromArrays) {
+  auto cls = create_class_with_table("");
+
+  FinalInlinePassV2::run({cls});
+
+  auto size = static_cast<DexField*>(DexField::get_field("LFoo;.size:I"));
+  auto second = static_cast<DexField*>(DexField::get_field("LFoo;.second:I"));
+  EXPECT_EQ(size->get_static_value()->value(), 3);
+  EXPECT_EQ((int32_t)second->get_static_value()->value(), -20);
+  // The array itself has no encoded_value, so the <clinit> still builds it.
+  ASSERT_NE(cls->get_clinit(), nullptr);
+  for (const auto& mie : InstructionIterable(cls->get_clinit()->get_code())) {
+    EXPECT_NE(mie.insn->opcode(), OPCODE_AGET);
+  }
+}
+
+TEST_F(FinalInlineTest, arraysEscapeThroughInvokes) {
+  // Bar.baz() may read Foo.table and write to it.
+  auto cls = create_class_with_table(R"((invoke-static () "LBar;.baz:()V"))");
+
+  FinalInlinePassV2::run({cls});
+
+  auto size = static_cast<DexField*>(DexField::get_field("LFoo;.size:I"));
+  auto second = static_cast<DexField*>(DexField::get_field("LFoo;.second:I"));
+  EXPECT_EQ(size->get_static_value()->value(), 0);
+  EXPECT_EQ(second->get_static_value()->value(), 0);
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "FixedSizeAllocator.h"
+
+using Allocator = FixedSizeAllocator<24>;
+
+TEST(FixedSizeAllocatorTest, freedNodesAreReused) {
+  void* a = Allocator::allocate();
+  void* b = Allocator::allocate();
+  EXPECT_NE(a, b);
+  Allocator::deallocate(a);
+  EXPECT_EQ(a, Allocator::allocate());
+  Allocator::deallocate(a);
+  Allocator::deallocate(b);
+}
+
+TEST(FixedSizeAllocatorTest, nodesFreedOnExitedThreadsAreShared) {
+  std::vector<void*> nodes;
+  std::thread t([&] {
+    for (size_t i = 0; i < 10000; ++i) {
+      nodes.push_back(Allocator::allocate());
+    }
+    for (auto node : nodes) {
+      Allocator::deallocate(node);
+    }
+  });
+  t.join();
+
+  std::unordered_set<void*> freed(nodes.begin(), nodes.end());
+  EXPECT_EQ(nodes.size(), freed.size());
+  // The exited thread's free list (and the unused tail of its last chunk) is
+  // handed to whoever allocates next, ahead of any new chunk.
+  size_t reused = 0;
+  std::vector<void*> again;
+  for (size_t i = 0; i < 2 * nodes.size(); ++i) {
+    again.push_back(Allocator::allocate());
+    reused += freed.count(again.back());
+  }
+  EXPECT_EQ(nodes.size(), reused);
+  for (auto node : again) {
+    Allocator::deallocate(node);
+  }
+}
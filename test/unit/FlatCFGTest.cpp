@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "FlatCFG.h"
+#include "HashedSetAbstractDomain.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "MonotonicFixpointIterator.h"
+
+using namespace cfg;
+
+namespace {
+
+using InsnSet = sparta::HashedSetAbstractDomain<const IRInstruction*>;
+
+/*
+ * Collects the instructions that may have run before reaching each block, in
+ * either direction, so that the results on the flat and the editable graphs
+ * can be compared.
+ */
+template <typename GI, typename Insns>
+class SeenInstructions final
+    : public sparta::MonotonicFixpointIterator<GI, InsnSet> {
+ public:
+  SeenInstructions(const typename GI::Graph& graph, Insns insns)
+      : sparta::MonotonicFixpointIterator<GI, InsnSet>(graph),
+        m_insns(std::move(insns)) {}
+
+  void analyze_node(const typename GI::NodeId& node,
+                    InsnSet* current_state) const override {
+    for (auto insn : m_insns(node)) {
+      current_state->add(insn);
+    }
+  }
+
+  InsnSet analyze_edge(const typename GI::EdgeId&,
+                       const InsnSet& exit_state_at_source) const override {
+    return exit_state_at_source;
+  }
+
+ private:
+  Insns m_insns;
+};
+
+template <typename GI, typename Insns>
+SeenInstructions<GI, Insns> seen_instructions(const typename GI::Graph& graph,
+                                              Insns insns) {
+  return SeenInstructions<GI, Insns>(graph, std::move(insns));
+}
+
+std::vector<const IRInstruction*> block_insns(const Block* block) {
+  std::vector<const IRInstruction*> insns;
+  for (const auto& mie : *block) {
+    if (mie.type == MFLOW_OPCODE) {
+      insns.push_back(mie.insn);
+    }
+  }
+  return insns;
+}
+
+std::unique_ptr<IRCode> loop_code() {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (:loop)
+      (if-eqz v0 :end)
+      (add-int/lit8 v0 v0 1)
+      (if-gez v0 :loop)
+      (const v1 1)
+      (goto :loop)
+      (:end)
+      (return-void)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  code->cfg().calculate_exit_block();
+  return code;
+}
+
+} // namespace
+
+TEST(FlatCFG, reversePostorderAndEdges) {
+  auto code = loop_code();
+  const auto& cfg = code->cfg();
+  FlatCFG flat(cfg);
+
+  EXPECT_EQ(flat.num_blocks(), cfg.blocks().size());
+  EXPECT_EQ(flat.block(flat.entry()), cfg.entry_block());
+  ASSERT_TRUE(flat.has_exit());
+  EXPECT_EQ(flat.block(flat.exit()), cfg.exit_block());
+
+  size_t num_edges = 0;
+  std::vector<FlatCFG::NodeId> back_edge_targets;
+  for (FlatCFG::NodeId n = 0; n < flat.num_blocks(); ++n) {
+    auto block = flat.block(n);
+    EXPECT_EQ(flat.node(block), n);
+    EXPECT_EQ(std::vector<const IRInstruction*>(flat.instructions(n).begin(),
+                                                flat.instructions(n).end()),
+              block_insns(block));
+
+    auto succs = flat.succs(n);
+    ASSERT_EQ(succs.size(), block->succs().size());
+    for (size_t i = 0; i < succs.size(); ++i) {
+      auto e = succs[i];
+      EXPECT_EQ(flat.edge(e), block->succs()[i]);
+      EXPECT_EQ(flat.src(e), n);
+      EXPECT_EQ(flat.block(flat.target(e)), block->succs()[i]->target());
+      if (flat.target(e) <= n) {
+        back_edge_targets.push_back(flat.target(e));
+      }
+    }
+    num_edges += succs.size();
+
+    auto preds = flat.preds(n);
+    ASSERT_EQ(preds.size(), block->preds().size());
+    for (size_t i = 0; i < preds.size(); ++i) {
+      EXPECT_EQ(flat.target(preds[i]), n);
+      if (i > 0) {
+        EXPECT_LE(flat.src(preds[i - 1]), flat.src(preds[i]));
+      }
+    }
+  }
+  EXPECT_EQ(flat.num_edges(), num_edges);
+  // In reverse postorder, only the two edges back to the loop header go
+  // backwards.
+  EXPECT_EQ(back_edge_targets, std::vector<FlatCFG::NodeId>(2, 1));
+}
+
+TEST(FlatCFG, fixpointMatchesEditableCFG) {
+  auto code = loop_code();
+  const auto& cfg = code->cfg();
+  FlatCFG flat(cfg);
+
+  auto flat_insns = [&flat](FlatCFG::NodeId n) { return flat.instructions(n); };
+  auto cfg_insns = [](const Block* b) { return block_insns(b); };
+
+  auto flat_forwards = seen_instructions<FlatGraphInterface>(flat, flat_insns);
+  flat_forwards.run(InsnSet());
+  auto cfg_forwards = seen_instructions<GraphInterface>(cfg, cfg_insns);
+  cfg_forwards.run(InsnSet());
+
+  using BackwardsFlat = sparta::BackwardsFixpointIterationAdaptor<
+      FlatGraphInterface>;
+  using BackwardsCFG = sparta::BackwardsFixpointIterationAdaptor<
+      GraphInterface>;
+  auto flat_backwards = seen_instructions<BackwardsFlat>(flat, flat_insns);
+  flat_backwards.run(InsnSet());
+  auto cfg_backwards = seen_instructions<BackwardsCFG>(cfg, cfg_insns);
+  cfg_backwards.run(InsnSet());
+
+  for (FlatCFG::NodeId n = 0; n < flat.num_blocks(); ++n) {
+    auto block = flat.block(n);
+    EXPECT_EQ(flat_forwards.get_entry_state_at(n),
+              cfg_forwards.get_entry_state_at(block));
+    EXPECT_EQ(flat_forwards.get_exit_state_at(n),
+              cfg_forwards.get_exit_state_at(block));
+    EXPECT_EQ(flat_backwards.get_entry_state_at(n),
+              cfg_backwards.get_entry_state_at(block));
+    EXPECT_EQ(flat_backwards.get_exit_state_at(n),
+              cfg_backwards.get_exit_state_at(block));
+  }
+  // Nothing runs before the entry block.
+  EXPECT_EQ(flat_forwards.get_entry_state_at(flat.entry()).size(), 0);
+  EXPECT_EQ(flat_forwards.get_exit_state_at(flat.entry()).size(), 1);
+}
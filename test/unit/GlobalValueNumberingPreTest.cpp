@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "GlobalValueNumberingPre.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+
+class GlobalValueNumberingPreTest : public RedexTest {
+ public:
+  GlobalValueNumberingPreTest() {
+    auto field_a = static_cast<DexField*>(DexField::make_field("LFoo;.a:I"));
+    field_a->make_concrete(ACC_PUBLIC);
+    auto field_s = static_cast<DexField*>(DexField::make_field("LFoo;.s:I"));
+    field_s->make_concrete(ACC_PUBLIC | ACC_STATIC);
+    m_creator = std::make_unique<ClassCreator>(DexType::make_type("LFoo;"));
+    m_creator->set_super(get_object_type());
+    m_creator->add_field(field_a);
+    m_creator->add_field(field_s);
+  }
+
+ protected:
+  GlobalValueNumberingPre::Stats run(DexMethod* method) {
+    m_creator->add_method(method);
+    m_creator->create();
+    auto code = method->get_code();
+    code->build_cfg(/* editable */ true);
+    CommonSubexpressionElimination::SharedState shared_state;
+    GlobalValueNumberingPre gvn_pre(&shared_state, method, code->cfg());
+    gvn_pre.run();
+    code->clear_cfg();
+    return gvn_pre.get_stats();
+  }
+
+  std::unique_ptr<ClassCreator> m_creator;
+};
+
+namespace {
+
+size_t count(const IRCode* code, IROpcode op) {
+  size_t count = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == op) {
+      count++;
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+TEST_F(GlobalValueNumberingPreTest, full_redundancy) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.diamond:(IIZ)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (load-param v2)
+        (if-eqz v2 :else)
+        (add-int v3 v0 v1)
+        (goto :join)
+        (:else)
+        (add-int v4 v1 v0)
+        (mul-int v3 v4 v4)
+        (:join)
+        (add-int v5 v0 v1)
+        (add-int v5 v5 v3)
+        (return v5)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // Both branches compute the sum, so the join merges it.
+  EXPECT_EQ(stats.instructions_eliminated, 1);
+  EXPECT_EQ(stats.instructions_inserted, 0);
+  EXPECT_EQ(stats.values_merged, 1);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count(code, OPCODE_ADD_INT), 3) << assembler::to_string(code);
+}
+
+TEST_F(GlobalValueNumberingPreTest, partial_redundancy) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.diamond:(JJZ)J"
+      (
+        (load-param-wide v0)
+        (load-param-wide v2)
+        (load-param v4)
+        (if-eqz v4 :else)
+        (mul-long v5 v0 v2)
+        (goto :join)
+        (:else)
+        (const-wide v5 1)
+        (:join)
+        (mul-long v7 v2 v0)
+        (add-long v5 v5 v7)
+        (return-wide v5)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // The product is computed on the path that didn't, and merged at the join.
+  EXPECT_EQ(stats.instructions_eliminated, 1);
+  EXPECT_EQ(stats.instructions_inserted, 1);
+  EXPECT_EQ(stats.values_merged, 1);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count(code, OPCODE_MUL_LONG), 2) << assembler::to_string(code);
+  code->build_cfg(/* editable */ true);
+  // Both mul-longs are in the branches, before the join.
+  for (auto block : code->cfg().blocks()) {
+    if (block->preds().size() > 1) {
+      for (const auto& mie : InstructionIterable(block)) {
+        EXPECT_NE(mie.insn->opcode(), OPCODE_MUL_LONG)
+            << assembler::to_string(code);
+      }
+    }
+  }
+  code->clear_cfg();
+}
+
+TEST_F(GlobalValueNumberingPreTest, loop_invariant_reads) {
+  auto method = assembler::method_from_string(R"(
+    (method (public) "LFoo;.loop:(I)I"
+      (
+        (load-param-object v0)
+        (load-param v1)
+        (const v2 0)
+        (:loop)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v3)
+        (sget "LFoo;.s:I")
+        (move-result-pseudo v4)
+        (add-int v5 v3 v4)
+        (add-int v2 v2 v5)
+        (add-int/lit8 v1 v1 -1)
+        (if-nez v1 :loop)
+        (return v2)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // The reads and their sum are computed before the loop, and the loop only
+  // ever reuses them.
+  EXPECT_EQ(stats.instructions_eliminated, 3);
+  EXPECT_EQ(stats.instructions_inserted, 3);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count(code, OPCODE_IGET), 1) << assembler::to_string(code);
+  EXPECT_EQ(count(code, OPCODE_SGET), 1) << assembler::to_string(code);
+  size_t before_loop = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    auto op = mie.insn->opcode();
+    if (op == OPCODE_ADD_INT_LIT8) {
+      break;
+    }
+    if (op == OPCODE_IGET || op == OPCODE_SGET) {
+      before_loop++;
+    }
+  }
+  EXPECT_EQ(before_loop, 2) << assembler::to_string(code);
+}
+
+TEST_F(GlobalValueNumberingPreTest, reads_across_barrier) {
+  auto method = assembler::method_from_string(R"(
+    (method (public) "LFoo;.loop:(I)I"
+      (
+        (load-param-object v0)
+        (load-param v1)
+        (const v2 0)
+        (:loop)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v3)
+        (add-int v2 v2 v3)
+        (iput v2 v0 "LFoo;.a:I")
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v3)
+        (add-int v2 v2 v3)
+        (add-int/lit8 v1 v1 -1)
+        (if-nez v1 :loop)
+        (return v2)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // The read after the write can't reuse the one before, but the read at the
+  // start of the next iteration reuses it, and the first iteration reads
+  // before the loop.
+  EXPECT_EQ(stats.instructions_eliminated, 1);
+  EXPECT_EQ(stats.instructions_inserted, 1);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count(code, OPCODE_IGET), 2) << assembler::to_string(code);
+  bool read_before_write = false;
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == OPCODE_IPUT) {
+      break;
+    }
+    read_before_write = read_before_write || mie.insn->opcode() == OPCODE_IGET;
+  }
+  EXPECT_TRUE(read_before_write) << assembler::to_string(code);
+}
+
+TEST_F(GlobalValueNumberingPreTest, throwing_reads) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.diamond:(LFoo;Z)I"
+      (
+        (load-param-object v0)
+        (load-param v1)
+        (if-eqz v1 :else)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v2)
+        (goto :join)
+        (:else)
+        (const v2 0)
+        (:join)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v3)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v4)
+        (add-int v2 v2 v3)
+        (add-int v2 v2 v4)
+        (return v2)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // The read of another object may throw, so it isn't computed where the code
+  // didn't, but the second read after the join is fully redundant.
+  EXPECT_EQ(stats.instructions_inserted, 0);
+  EXPECT_EQ(stats.instructions_eliminated, 1);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count(code, OPCODE_IGET), 2) << assembler::to_string(code);
+}
@@ -95,7 +95,8 @@ TEST(IRInstruction, RoundTrip) {
     }
 
     method->set_dex_code(std::make_unique<DexCode>());
-    method->get_dex_code()->get_instructions().push_back(insn);
+    // Ballooning frees the instructions it translates.
+    method->get_dex_code()->get_instructions().push_back(insn->clone());
     method->get_dex_code()->set_registers_size(0xff);
     method->balloon();
     instruction_lowering::lower(method);
@@ -133,6 +134,35 @@ TEST(IRInstruction, NormalizeInvoke) {
   delete g_redex;
 }
 
+TEST(IRInstruction, SrcsMoveBetweenInlineAndHeapStorage) {
+  auto insn = std::make_unique<IRInstruction>(OPCODE_FILLED_NEW_ARRAY);
+  insn->set_arg_word_count(3);
+  for (size_t i = 0; i < 3; ++i) {
+    insn->set_src(i, i + 10);
+  }
+  insn->set_arg_word_count(IRInstruction::MAX_NUM_INLINE_SRCS + 3);
+  for (size_t i = 3; i < insn->srcs_size(); ++i) {
+    EXPECT_EQ(insn->src(i), 0);
+    insn->set_src(i, i + 10);
+  }
+  IRInstruction copy(*insn);
+  for (size_t i = 0; i < copy.srcs_size(); ++i) {
+    EXPECT_EQ(copy.src(i), i + 10);
+  }
+  EXPECT_EQ(*insn, copy);
+
+  copy.set_arg_word_count(2);
+  EXPECT_EQ(copy.srcs_vec(), std::vector<uint16_t>({10, 11}));
+  EXPECT_FALSE(*insn == copy);
+  *insn = copy;
+  EXPECT_EQ(*insn, copy);
+  EXPECT_EQ(insn->srcs().size(), 2);
+
+  // Shrinking within the inline storage keeps the sources that are left.
+  insn->set_arg_word_count(1);
+  EXPECT_EQ(insn->srcs_vec(), std::vector<uint16_t>({10}));
+}
+
 /*
  * Helper function to run select and then extract the resulting instruction
  * from the instruction list. The only reason it's a list is that const-cast
@@ -719,3 +719,110 @@ TEST_F(IRTypeCheckerTest, checkNoOverwriteThis) {
               "Encountered overwrite of `this` register by CONST v0, 0");
   }
 }
+
+TEST_F(IRTypeCheckerTest, typeEnvironmentsAreSharedUntilCodeChanges) {
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;.cached:(I)I"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, /* is_virtual */ false);
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (add-int v0 v0 v0)
+      (return v0)
+    )
+  )"));
+  auto code = method->get_code();
+  code->build_cfg(/* editable */ false);
+  auto first = type_inference::get_type_environments(method);
+
+  IRTypeChecker checker(method);
+  checker.run();
+  EXPECT_TRUE(checker.good()) << checker.what();
+  // Rebuilding the CFG doesn't invalidate the cached result.
+  EXPECT_EQ(first, type_inference::get_type_environments(method));
+
+  // Editing an instruction in place does.
+  for (auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == OPCODE_ADD_INT) {
+      mie.insn->set_opcode(OPCODE_MUL_INT);
+    }
+  }
+  code->build_cfg(/* editable */ false);
+  auto second = type_inference::get_type_environments(method);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(second, type_inference::get_type_environments(method));
+}
+
+TEST_F(IRTypeCheckerTest, arrayTypeEnvironmentsMatchPatriciaTrees) {
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method("LFoo;.dense:(IJLFoo;)J"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, /* is_virtual */ false);
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (load-param-wide v1)
+      (load-param-object v3)
+      (if-eqz v0 :else)
+      (const v20 1)
+      (int-to-long v4 v20)
+      (goto :end)
+      (:else)
+      (new-array v0 "[I")
+      (move-result-pseudo-object v20)
+      (move-wide v4 v1)
+      (:end)
+      (add-long v4 v4 v1)
+      (return-wide v4)
+    )
+  )"));
+  auto code = method->get_code();
+  code->build_cfg(/* editable */ false);
+  const auto& cfg = code->cfg();
+
+  type_inference::TypeInference patricia_inference(cfg);
+  patricia_inference.run(method);
+  type_inference::TypeInferenceImpl<type_inference::ArrayTypeEnvironment>
+      array_inference(cfg);
+  array_inference.run(method);
+
+  const auto& patricia_envs = patricia_inference.get_type_environments();
+  const auto& array_envs = array_inference.get_type_environments();
+  ASSERT_EQ(patricia_envs.size(), array_envs.size());
+  std::vector<uint32_t> regs = {ir_analyzer::RESULT_REGISTER};
+  for (uint32_t reg = 0; reg < code->get_registers_size(); ++reg) {
+    regs.push_back(reg);
+  }
+  for (const auto& pair : patricia_envs) {
+    const auto& array_env = array_envs.at(pair.first);
+    for (auto reg : regs) {
+      EXPECT_TRUE(pair.second.get_type(reg).equals(array_env.get_type(reg)))
+          << show(pair.first) << " v" << reg;
+      EXPECT_EQ(pair.second.get_dex_type(reg), array_env.get_dex_type(reg))
+          << show(pair.first) << " v" << reg;
+    }
+  }
+}
+
+TEST(TypeDomainTest, latticeOperations) {
+  using type_inference::TypeDomain;
+  auto join = [](IRType x, IRType y) {
+    return TypeDomain(x).join(TypeDomain(y)).element();
+  };
+  auto meet = [](IRType x, IRType y) {
+    return TypeDomain(x).meet(TypeDomain(y)).element();
+  };
+  EXPECT_EQ(SCALAR, join(INT, FLOAT));
+  EXPECT_EQ(CONST, meet(INT, FLOAT));
+  EXPECT_EQ(TOP, join(REFERENCE, INT));
+  EXPECT_EQ(ZERO, meet(REFERENCE, INT));
+  EXPECT_EQ(TOP, join(LONG1, LONG2));
+  EXPECT_EQ(BOTTOM, meet(LONG1, LONG2));
+  EXPECT_EQ(LONG1, join(CONST1, LONG1));
+  EXPECT_EQ(CONST1, meet(CONST1, SCALAR1));
+
+  EXPECT_TRUE(TypeDomain(ZERO).leq(TypeDomain(SCALAR)));
+  EXPECT_FALSE(TypeDomain(CONST1).leq(TypeDomain(SCALAR)));
+  EXPECT_TRUE(TypeDomain().is_top());
+  EXPECT_TRUE(TypeDomain::bottom().leq(TypeDomain(ZERO)));
+  EXPECT_EQ(1, sizeof(IRType));
+}
@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IdMap.h"
+#include "RedexTest.h"
+
+class IdMapTest : public RedexTest {};
+
+TEST_F(IdMapTest, denseIdsAreDistinct) {
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+  EXPECT_NE(a->get_dense_id(), b->get_dense_id());
+  EXPECT_EQ(a, DexType::make_type("LA;"));
+  EXPECT_LT(a->get_dense_id(), g_redex->num_type_ids());
+  EXPECT_LT(b->get_dense_id(), g_redex->num_type_ids());
+}
+
+TEST_F(IdMapTest, behavesLikeAMap) {
+  auto a = DexType::make_type("LA;");
+  auto b = DexType::make_type("LB;");
+  auto c = DexType::make_type("LC;");
+  IdMap<const DexType*, int> map;
+  EXPECT_TRUE(map.empty());
+  map[c] = 3;
+  map[a] = 1;
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(1, map.count(a));
+  EXPECT_EQ(0, map.count(b));
+  EXPECT_EQ(map.end(), map.find(b));
+  EXPECT_EQ(3, map.find(c)->second);
+  EXPECT_EQ(1, map.at(a));
+  EXPECT_THROW(map.at(b), std::out_of_range);
+
+  // Iteration is in id order and skips missing keys.
+  std::vector<const DexType*> keys;
+  for (const auto& pair : map) {
+    keys.push_back(pair.first);
+  }
+  EXPECT_EQ((std::vector<const DexType*>{a, c}), keys);
+
+  ++map[a];
+  EXPECT_EQ(2, map.at(a));
+  EXPECT_EQ(1, map.erase(a));
+  EXPECT_EQ(0, map.erase(a));
+  EXPECT_EQ(1, map.size());
+  EXPECT_EQ(0, map[a]);
+}
@@ -0,0 +1,410 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "InstructionSequenceOutliner.h"
+#include "RedexTest.h"
+
+using namespace instruction_sequence_outliner;
+
+namespace {
+
+std::vector<uint32_t> sort_suffixes(const std::vector<uint32_t>& text) {
+  std::vector<uint32_t> sa(text.size());
+  for (uint32_t i = 0; i < sa.size(); i++) {
+    sa[i] = i;
+  }
+  std::sort(sa.begin(), sa.end(), [&](uint32_t a, uint32_t b) {
+    return std::lexicographical_compare(text.begin() + a, text.end(),
+                                        text.begin() + b, text.end());
+  });
+  return sa;
+}
+
+} // namespace
+
+TEST(InstructionSequenceOutlinerTest, suffix_array) {
+  // banana$
+  std::vector<uint32_t> text{2, 1, 3, 1, 3, 1, 0};
+  auto sa = build_suffix_array(text, 4);
+  EXPECT_EQ(sa, std::vector<uint32_t>({6, 5, 3, 1, 0, 4, 2}));
+  auto lcp = build_lcp_array(text, sa);
+  EXPECT_EQ(lcp, std::vector<uint32_t>({0, 0, 1, 3, 0, 0, 2}));
+}
+
+TEST(InstructionSequenceOutlinerTest, suffix_array_random) {
+  std::mt19937 rng(0);
+  for (size_t iteration = 0; iteration < 1000; iteration++) {
+    // Small alphabets make for long repeats, and deep recursion.
+    size_t n = rng() % 100 + 1;
+    uint32_t alphabet_size = rng() % 4 + 2;
+    std::vector<uint32_t> text(n, 0);
+    for (size_t i = 0; i + 1 < n; i++) {
+      text[i] = rng() % (alphabet_size - 1) + 1;
+    }
+    auto sa = build_suffix_array(text, alphabet_size);
+    ASSERT_EQ(sa, sort_suffixes(text));
+    auto lcp = build_lcp_array(text, sa);
+    for (size_t i = 1; i < n; i++) {
+      auto a = text.begin() + sa[i - 1];
+      auto b = text.begin() + sa[i];
+      auto common = std::mismatch(a, text.end(), b, text.end()).first - a;
+      EXPECT_EQ(lcp[i], common);
+    }
+  }
+}
+
+struct InstructionSequenceOutlinerDexTest : public RedexTest {
+  InstructionSequenceOutlinerDexTest() {
+    ClassCreator creator(DexType::make_type("LFoo;"));
+    creator.set_super(get_object_type());
+    creator.set_access(ACC_PUBLIC);
+    m_foo = creator.create();
+    for (auto access : {ACC_PUBLIC, ACC_PUBLIC | ACC_STATIC}) {
+      auto field = static_cast<DexField*>(DexField::make_field(
+          is_static(access) ? "LFoo;.sink:I" : "LFoo;.f:I"));
+      field->make_concrete(access);
+      m_foo->add_field(field);
+    }
+    for (const auto& callee : {"takeInt:(I)V", "takeByte:(B)V"}) {
+      add_method(std::string("(public static) \"LFoo;.") + callee + "\"",
+                 "((return-void))");
+    }
+    add_method("(private static) \"LFoo;.use:(II)V\"", "((return-void))");
+    m_dex.push_back(m_foo);
+  }
+
+  DexMethod* add_method(const std::string& header, const std::string& body) {
+    auto method =
+        assembler::method_from_string("(method " + header + " " + body + ")");
+    m_foo->add_method(method);
+    return method;
+  }
+
+  // Adds a public static method LFoo;.m<i>:<proto> for each body.
+  std::vector<DexMethod*> add_methods(const std::string& proto,
+                                      const std::vector<std::string>& bodies) {
+    std::vector<DexMethod*> methods;
+    for (const auto& body : bodies) {
+      auto name = "m" + std::to_string(m_num_methods++);
+      methods.push_back(add_method(
+          "(public static) \"LFoo;." + name + ":" + proto + "\"", body));
+    }
+    return methods;
+  }
+
+  // Outlines repeats of exactly `length` instructions.
+  Stats outline(size_t length) {
+    InstructionSequenceOutlinerPass::Config config;
+    config.min_insns_size = length;
+    config.max_insns_size = length;
+    return outline_dex(config, &m_dex, /* dexnr */ 1, {});
+  }
+
+  DexMethod* outlined_method(size_t i) {
+    auto host = type_class(DexType::get_type("Lredex/$Outlined1;"));
+    if (host == nullptr) {
+      return nullptr;
+    }
+    auto name = "$outlined$" + std::to_string(i);
+    for (auto method : host->get_dmethods()) {
+      if (method->get_name()->str() == name) {
+        return method;
+      }
+    }
+    return nullptr;
+  }
+
+  DexClass* m_foo;
+  DexClasses m_dex;
+  size_t m_num_methods{0};
+};
+
+namespace {
+
+std::vector<std::string> repeat(const std::string& body, size_t count) {
+  return std::vector<std::string>(count, body);
+}
+
+// Six instructions that compute v<c> from v<a> and v<b>.
+std::string arith(int a, int b, int c) {
+  auto r = [](int reg) { return " v" + std::to_string(reg); };
+  return "(add-int" + r(c) + r(a) + r(b) + ")" + "(mul-int" + r(c) + r(c) +
+         r(a) + ")" + "(sub-int" + r(c) + r(c) + r(b) + ")" + "(xor-int" +
+         r(c) + r(c) + r(a) + ")" + "(add-int" + r(c) + r(c) + r(b) + ")" +
+         "(mul-int" + r(c) + r(c) + r(b) + ")";
+}
+
+IRInstruction* find_invoke(const IRCode* code) {
+  for (const auto& mie : InstructionIterable(code)) {
+    if (is_invoke(mie.insn->opcode())) {
+      return mie.insn;
+    }
+  }
+  return nullptr;
+}
+
+std::string arith_method(int a, int b, int c) {
+  auto r = [](int reg) { return " v" + std::to_string(reg); };
+  return "((load-param" + r(a) + ")(load-param" + r(b) + ")" + arith(a, b, c) +
+         "(return" + r(c) + "))";
+}
+
+} // namespace
+
+TEST_F(InstructionSequenceOutlinerDexTest, outlinesRepeatedSequence) {
+  auto methods = add_methods("(II)I", repeat(arith_method(0, 1, 2), 5));
+  auto stats = outline(6);
+  EXPECT_EQ(stats.outlined_methods, 1);
+  EXPECT_EQ(stats.outlined_sequences, 5);
+  EXPECT_EQ(stats.outlined_instructions, 30);
+
+  auto outlined = outlined_method(0);
+  ASSERT_NE(outlined, nullptr);
+  EXPECT_EQ(show(outlined), "Lredex/$Outlined1;.$outlined$0:(II)I");
+  EXPECT_TRUE(is_public(outlined) && is_static(outlined));
+  // The result comes first, then the inputs in the order of their first use.
+  auto expected_outlined = assembler::ircode_from_string(R"(
+    (
+      (load-param v1)
+      (load-param v2)
+      (add-int v0 v1 v2)
+      (mul-int v0 v0 v1)
+      (sub-int v0 v0 v2)
+      (xor-int v0 v0 v1)
+      (add-int v0 v0 v2)
+      (mul-int v0 v0 v2)
+      (return v0)
+    )
+  )");
+  EXPECT_EQ(assembler::to_string(expected_outlined.get()),
+            assembler::to_string(outlined->get_code()));
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (invoke-static (v0 v1) "Lredex/$Outlined1;.$outlined$0:(II)I")
+      (move-result v2)
+      (return v2)
+    )
+  )");
+  for (auto method : methods) {
+    EXPECT_EQ(assembler::to_string(expected.get()),
+              assembler::to_string(method->get_code()));
+  }
+  EXPECT_EQ(m_dex.size(), 2);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, unprofitableRepeatIsKept) {
+  // Four call sites don't pay for the new method.
+  add_methods("(II)I", repeat(arith_method(0, 1, 2), 4));
+  auto stats = outline(6);
+  EXPECT_EQ(stats.outlined_methods, 0);
+  EXPECT_EQ(m_dex.size(), 1);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, registersAreKeyedByDistance) {
+  // The same code on other registers is the same sequence.
+  auto methods = add_methods("(II)I",
+                             {arith_method(0, 1, 2), arith_method(2, 0, 1),
+                              arith_method(1, 2, 0), arith_method(3, 4, 5),
+                              arith_method(5, 3, 4)});
+  // Moving values between the registers another way isn't.
+  auto other = arith(0, 1, 2);
+  other.replace(other.find("(mul-int v2 v2 v0)"), 18, "(mul-int v2 v2 v2)");
+  auto others = add_methods(
+      "(II)I",
+      repeat("((load-param v0)(load-param v1)" + other +
+                         "(return v2))",
+                     5));
+  auto stats = outline(6);
+  EXPECT_EQ(stats.outlined_methods, 2);
+  EXPECT_EQ(stats.outlined_sequences, 10);
+
+  std::unordered_set<DexMethodRef*> callees;
+  for (auto method : methods) {
+    auto invoke = find_invoke(method->get_code());
+    ASSERT_NE(invoke, nullptr);
+    callees.insert(invoke->get_method());
+  }
+  EXPECT_EQ(callees.size(), 1);
+  for (auto method : others) {
+    auto invoke = find_invoke(method->get_code());
+    ASSERT_NE(invoke, nullptr);
+    EXPECT_EQ(callees.count(invoke->get_method()), 0);
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, deadResultIsNotReturned) {
+  auto body = arith(0, 1, 2);
+  body.replace(body.rfind('('), std::string::npos,
+               "(sput v2 \"LFoo;.sink:I\")");
+  auto methods = add_methods(
+      "(II)V",
+      repeat("((load-param v0)(load-param v1)" + body + "(return-void))", 5));
+  auto stats = outline(6);
+  ASSERT_EQ(stats.outlined_methods, 1);
+  EXPECT_EQ(show(outlined_method(0)), "Lredex/$Outlined1;.$outlined$0:(II)V");
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (load-param v1)
+      (invoke-static (v0 v1) "Lredex/$Outlined1;.$outlined$0:(II)V")
+      (return-void)
+    )
+  )");
+  for (auto method : methods) {
+    EXPECT_EQ(assembler::to_string(expected.get()),
+              assembler::to_string(method->get_code()));
+  }
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, twoLiveResultsAreRejected) {
+  // v2 and v3 are both used after the sequence, by a call that can't be
+  // outlined.
+  add_methods("(II)V", repeat(R"((
+    (load-param v0)
+    (load-param v1)
+    (add-int v2 v0 v1)
+    (mul-int v3 v2 v0)
+    (sub-int v2 v2 v1)
+    (xor-int v3 v3 v0)
+    (add-int v2 v2 v1)
+    (mul-int v3 v3 v1)
+    (invoke-static (v2 v3) "LFoo;.use:(II)V")
+    (return-void)
+  ))",
+                              5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, narrowResultIsRejected) {
+  // The caller may need the result to be a byte, which an int returned by
+  // the outlined method isn't to the verifier.
+  auto body = arith(0, 1, 2);
+  body.replace(body.rfind('('), std::string::npos, "(int-to-byte v2 v2)");
+  add_methods("(II)B",
+              repeat("((load-param v0)(load-param v1)" + body + "(return v2))",
+                     5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, throwingSequenceInTryIsRejected) {
+  // The sput may throw to the handler, which must see the values written
+  // before it.
+  auto body = arith(0, 1, 2);
+  body.replace(body.rfind('('), std::string::npos,
+               "(sput v2 \"LFoo;.sink:I\")");
+  add_methods("(II)V", repeat(R"((
+    (load-param v0)
+    (load-param v1)
+    (.try_start a)
+    )" + body + R"(
+    (.try_end a)
+    (return-void)
+    (.catch (a))
+    (return-void)
+  ))",
+                              5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, narrowArgumentCallIsKept) {
+  // The outlined method would pass an int where a byte is expected.
+  for (const auto& callee : {"takeInt:(I)V", "takeByte:(B)V"}) {
+    auto body = arith(0, 1, 2);
+    body.replace(body.rfind('('), std::string::npos,
+                 std::string("(invoke-static (v2) \"LFoo;.") + callee +
+                     "\")");
+    add_methods(
+        "(II)V",
+        repeat("((load-param v0)(load-param v1)" + body + "(return-void))",
+               5));
+  }
+  auto stats = outline(6);
+  ASSERT_EQ(stats.outlined_methods, 1);
+  EXPECT_EQ(stats.outlined_sequences, 5);
+  auto invoke = find_invoke(outlined_method(0)->get_code());
+  ASSERT_NE(invoke, nullptr);
+  EXPECT_EQ(show(invoke->get_method()), "LFoo;.takeInt:(I)V");
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, highInputRegistersAreRejected) {
+  // The invoke can't take v16 and up as arguments.
+  add_methods("(II)I", repeat(arith_method(16, 17, 18), 5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, tooManyInputsAreRejected) {
+  add_methods("(IIIIII)I", repeat(R"((
+    (load-param v0)
+    (load-param v1)
+    (load-param v2)
+    (load-param v3)
+    (load-param v4)
+    (load-param v5)
+    (add-int v6 v0 v1)
+    (add-int v6 v6 v2)
+    (add-int v6 v6 v3)
+    (add-int v6 v6 v4)
+    (add-int v6 v6 v5)
+    (mul-int v6 v6 v0)
+    (return v6)
+  ))",
+                                  5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, movedObjectInputIsRejected) {
+  // The object moved from an input might not be initialized yet, and then it
+  // can't be passed to the outlined method.
+  add_methods("(LFoo;I)I", repeat(R"((
+    (load-param-object v0)
+    (load-param v1)
+    (move-object v2 v0)
+    (iget v2 "LFoo;.f:I")
+    (move-result-pseudo v3)
+    (add-int v3 v3 v1)
+    (mul-int v3 v3 v1)
+    (xor-int v3 v3 v1)
+    (sub-int v3 v3 v1)
+    (return v3)
+  ))",
+                                   5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
+
+TEST_F(InstructionSequenceOutlinerDexTest, inaccessibleInputTypeIsRejected) {
+  // The outlined method couldn't name the type of its parameter.
+  ClassCreator creator(DexType::make_type("LBar;"));
+  creator.set_super(get_object_type());
+  m_dex.push_back(creator.create());
+  add_methods("(LBar;I)I", repeat(R"((
+    (load-param-object v0)
+    (load-param v1)
+    (instance-of v0 "LFoo;")
+    (move-result-pseudo v2)
+    (add-int v2 v2 v1)
+    (mul-int v2 v2 v1)
+    (sub-int v2 v2 v1)
+    (xor-int v2 v2 v1)
+    (add-int v2 v2 v1)
+    (return v2)
+  ))",
+                                  5));
+  EXPECT_EQ(outline(6).outlined_methods, 0);
+}
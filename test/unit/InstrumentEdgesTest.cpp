@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ControlFlow.h"
+#include "DexClass.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "Instrument.h"
+#include "RedexTest.h"
+#include "Show.h"
+
+struct InstrumentEdgesTest : public RedexTest {};
+
+namespace {
+
+using EdgeCounts = std::map<std::pair<std::string, std::string>, int64_t>;
+
+/*
+ * Runs the code of the CFG on `arg`, which may only do a little int
+ * arithmetic and bump the edge counters. Counts the edges it takes into
+ * `edges`, with the virtual exit node "x" as in the edge metadata, and the
+ * counters into `counters`.
+ */
+void run(const cfg::ControlFlowGraph& cfg,
+         int64_t arg,
+         EdgeCounts* edges,
+         std::map<int64_t, int64_t>* counters) {
+  std::map<uint32_t, int64_t> regs;
+  std::string prev = "x";
+  auto block = cfg.entry_block();
+  while (true) {
+    auto name = std::to_string(block->id());
+    (*edges)[{prev, name}]++;
+    int64_t result = 0;
+    bool taken = false;
+    bool returned = false;
+    for (const auto& mie : InstructionIterable(block)) {
+      auto insn = mie.insn;
+      switch (insn->opcode()) {
+      case IOPCODE_LOAD_PARAM:
+        regs[insn->dest()] = arg;
+        break;
+      case OPCODE_CONST:
+        regs[insn->dest()] = insn->get_literal();
+        break;
+      case OPCODE_ADD_INT_LIT8:
+        regs[insn->dest()] = regs[insn->src(0)] + insn->get_literal();
+        break;
+      case OPCODE_AND_INT_LIT8:
+        regs[insn->dest()] = regs[insn->src(0)] & insn->get_literal();
+        break;
+      case OPCODE_SGET_OBJECT:
+        result = 0;
+        break;
+      case OPCODE_AGET:
+        result = (*counters)[regs[insn->src(1)]];
+        break;
+      case IOPCODE_MOVE_RESULT_PSEUDO:
+      case IOPCODE_MOVE_RESULT_PSEUDO_OBJECT:
+        regs[insn->dest()] = result;
+        break;
+      case OPCODE_APUT:
+        (*counters)[regs[insn->src(2)]] = regs[insn->src(0)];
+        break;
+      case OPCODE_IF_EQZ:
+        taken = regs[insn->src(0)] == 0;
+        break;
+      case OPCODE_RETURN:
+        returned = true;
+        break;
+      default:
+        ADD_FAILURE() << "Can't run " << show(insn);
+        return;
+      }
+    }
+    if (returned) {
+      (*edges)[{name, "x"}]++;
+      break;
+    }
+    auto edge = cfg.get_succ_edge_of_type(
+        block, taken ? cfg::EDGE_BRANCH : cfg::EDGE_GOTO);
+    ASSERT_NE(edge, nullptr);
+    prev = name;
+    block = edge->target();
+  }
+}
+
+struct Metadata {
+  // Block to its block id of the basic block profile.
+  std::map<std::string, int64_t> blocks;
+  // Edge to its counter index.
+  std::vector<std::pair<std::pair<std::string, std::string>, int64_t>> edges;
+};
+
+Metadata parse(const std::string& text, const std::string& method_id) {
+  Metadata metadata;
+  std::istringstream in(text);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields;
+    std::istringstream line_in(line);
+    std::string field;
+    while (std::getline(line_in, field, ',')) {
+      fields.push_back(field);
+    }
+    EXPECT_EQ(fields.at(1), method_id);
+    if (fields[0] == "B") {
+      metadata.blocks.emplace(fields.at(2), std::stoll(fields.at(3)));
+    } else {
+      EXPECT_EQ(fields[0], "E");
+      metadata.edges.push_back(
+          {{fields.at(2), fields.at(3)}, std::stoll(fields.at(4))});
+    }
+  }
+  return metadata;
+}
+
+} // namespace
+
+TEST_F(InstrumentEdgesTest, countersGoOnTheEdgesOutsideASpanningTree) {
+  // A loop around a diamond.
+  const std::string body = R"(
+     (
+      (load-param v0)
+      (const v1 0)
+      (:loop)
+      (if-eqz v0 :done)
+      (and-int/lit8 v2 v0 1)
+      (if-eqz v2 :even)
+      (add-int/lit8 v1 v1 3)
+      (goto :next)
+      (:even)
+      (add-int/lit8 v1 v1 1)
+      (:next)
+      (add-int/lit8 v0 v0 -1)
+      (goto :loop)
+      (:done)
+      (return v1)
+     )
+  )";
+  auto method = assembler::method_from_string(
+      "(method (public static) \"LFoo;.bar:(I)I\"" + body + ")");
+  auto code = method->get_code();
+  auto original = assembler::ircode_from_string(body);
+  auto counts_field = static_cast<DexField*>(
+      DexField::make_field("LAnalysis;.sEdgeCounts:[I"));
+  counts_field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+  std::ostringstream edge_ofs;
+  size_t next_counter_index = 3;
+  size_t num_profile_blocks = 0;
+  auto stats = instrument::instrument_edges(code, 7, counts_field,
+                                            next_counter_index,
+                                            num_profile_blocks, edge_ofs);
+  auto metadata = parse(edge_ofs.str(), "7");
+  // The same blocks as instrument_edges, which builds the non-editable CFG
+  // first.
+  original->build_cfg(/* editable */ false);
+  EXPECT_EQ(num_profile_blocks, original->cfg().blocks().size());
+  original->build_cfg(/* editable */ true);
+  code->build_cfg(/* editable */ true);
+
+  // The uncounted edges connect the blocks and the exit node without a
+  // cycle, and each counted edge has its own counter.
+  std::map<std::string, std::string> parents;
+  std::function<std::string(const std::string&)> find =
+      [&](const std::string& node) {
+        auto it = parents.find(node);
+        return it == parents.end() ? node : find(it->second);
+      };
+  size_t tree_edges = 0;
+  std::set<int64_t> counter_indices;
+  for (const auto& edge : metadata.edges) {
+    const auto& nodes = edge.first;
+    EXPECT_TRUE(nodes.first == "x" || metadata.blocks.count(nodes.first));
+    EXPECT_TRUE(nodes.second == "x" || metadata.blocks.count(nodes.second));
+    if (edge.second < 0) {
+      auto a = find(nodes.first);
+      auto b = find(nodes.second);
+      EXPECT_NE(a, b);
+      parents[a] = b;
+      tree_edges++;
+    } else {
+      EXPECT_TRUE(counter_indices.insert(edge.second).second);
+    }
+  }
+  EXPECT_EQ(tree_edges, metadata.blocks.size());
+  EXPECT_EQ(stats.edges, metadata.edges.size());
+  EXPECT_EQ(stats.counters, counter_indices.size());
+  EXPECT_EQ(stats.counters, metadata.edges.size() - tree_edges);
+  EXPECT_EQ(next_counter_index, 3 + stats.counters);
+  EXPECT_EQ(*counter_indices.begin(), 3);
+  EXPECT_EQ(*counter_indices.rbegin(), 2 + stats.counters);
+
+  // Each counter counts how often its edge was taken.
+  EdgeCounts taken;
+  std::map<int64_t, int64_t> counters;
+  for (int64_t arg : {0, 5, 2}) {
+    EdgeCounts ignored;
+    run(original->cfg(), arg, &taken, &counters);
+    run(code->cfg(), arg, &ignored, &counters);
+  }
+  for (const auto& edge : metadata.edges) {
+    if (edge.second >= 0) {
+      EXPECT_EQ(counters[edge.second], taken[edge.first])
+          << edge.first.first << "->" << edge.first.second;
+    }
+  }
+  EXPECT_EQ(counters.size(), stats.counters);
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "IRCode.h"
+#include "InstructionLowering.h"
+#include "RedexTest.h"
+
+struct LazyBalloonTest : public RedexTest {};
+
+namespace {
+
+DexMethod* make_method_with_dex_code(const char* name) {
+  auto method = static_cast<DexMethod*>(
+      DexMethod::make_method("Lfoo;", name, "V", {}));
+  auto dex_code = std::make_unique<DexCode>();
+  dex_code->get_instructions().push_back(
+      new DexInstruction(DOPCODE_RETURN_VOID));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, std::move(dex_code), false);
+  method->defer_balloon();
+  return method;
+}
+
+} // namespace
+
+TEST_F(LazyBalloonTest, untouchedMethodKeepsItsDexCode) {
+  auto method = make_method_with_dex_code("untouched");
+  const DexCode* loaded = method->get_dex_code();
+  EXPECT_TRUE(method->is_balloon_deferred());
+
+  std::vector<DexMethodRef*> methods;
+  method->gather_methods(methods);
+  EXPECT_TRUE(methods.empty());
+  EXPECT_TRUE(method->is_balloon_deferred());
+
+  method->sync();
+  EXPECT_FALSE(method->is_balloon_deferred());
+  EXPECT_EQ(loaded, method->get_dex_code());
+  EXPECT_EQ(nullptr, method->get_code());
+}
+
+TEST_F(LazyBalloonTest, firstAccessBalloons) {
+  auto method = make_method_with_dex_code("accessed");
+  IRCode* code = method->get_code();
+  ASSERT_NE(nullptr, code);
+  EXPECT_FALSE(method->is_balloon_deferred());
+  EXPECT_EQ(nullptr, method->get_dex_code());
+  EXPECT_EQ(code, method->get_code());
+  EXPECT_EQ(1, code->count_opcodes());
+
+  instruction_lowering::lower(method);
+  method->sync();
+  ASSERT_NE(nullptr, method->get_dex_code());
+  EXPECT_EQ(1, method->get_dex_code()->get_instructions().size());
+}
@@ -7,11 +7,14 @@
 
 #include <gtest/gtest.h>
 
+#include "Creators.h"
 #include "DexAsm.h"
 #include "DexUtil.h"
 #include "InstructionLowering.h"
+#include "IRAssembler.h"
 #include "IRCode.h"
 #include "LocalDce.h"
+#include "RedexTest.h"
 
 struct LocalDceTryTest : testing::Test {
   DexMethod* m_method;
@@ -189,3 +192,66 @@ TEST_F(LocalDceTryTest, deadIf) {
   // the if should be gone
   EXPECT_FALSE(has_if);
 }
+
+struct LocalDcePureTest : public RedexTest {};
+
+TEST_F(LocalDcePureTest, derivedPureMethods) {
+  auto pure = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.pure:(I)I"
+      (
+        (load-param v0)
+        (add-int/lit8 v0 v0 1)
+        (return v0)
+      )
+    )
+  )");
+  auto impure = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.impure:(I)I"
+      (
+        (load-param v0)
+        (sput v0 "LFoo;.bar:I")
+        (return v0)
+      )
+    )
+  )");
+  auto caller = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.caller:(I)V"
+      (
+        (load-param v0)
+        (:loop)
+        (invoke-static (v0) "LFoo;.pure:(I)I")
+        (move-result v1)
+        (invoke-static (v0) "LFoo;.impure:(I)I")
+        (move-result v1)
+        (add-int/lit8 v0 v0 -1)
+        (if-nez v0 :loop)
+        (return-void)
+      )
+    )
+  )");
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(pure);
+  creator.add_method(impure);
+  creator.add_method(caller);
+  Scope scope{creator.create()};
+
+  auto pure_methods = LocalDcePass::derive_pure_methods(scope);
+  EXPECT_EQ(pure_methods.count(pure), 1);
+  EXPECT_EQ(pure_methods.count(impure), 0);
+  EXPECT_EQ(pure_methods.count(caller), 0);
+
+  LocalDce(pure_methods).dce(caller->get_code());
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (:loop)
+      (invoke-static (v0) "LFoo;.impure:(I)I")
+      (add-int/lit8 v0 v0 -1)
+      (if-nez v0 :loop)
+      (return-void)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(caller->get_code()),
+            assembler::to_s_expr(expected_code.get()));
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "locator.h"
+
+using facebook::Locator;
+
+TEST(LocatorTest, batch_round_trip) {
+  std::vector<Locator> locators;
+  for (uint32_t i = 0; i < 1000; i++) {
+    locators.push_back(Locator::make(i % 3, i % 64, i * 997 % (1 << 20)));
+  }
+  // The byte before the first locator stops its decoding, like the length
+  // prefix in a string table.
+  std::vector<char> buf(1 + locators.size() * Locator::encoded_max);
+  auto size = Locator::encode(locators.data(), locators.size(), &buf[1]);
+
+  std::vector<const char*> endpos;
+  for (size_t i = 1; i < 1 + size; i++) {
+    if (buf[i] == '\0') {
+      endpos.push_back(&buf[i]);
+    }
+  }
+  ASSERT_EQ(endpos.size(), locators.size());
+  size_t decoded = 0;
+  Locator::decodeBackward(
+      endpos.data(), endpos.size(), [&](size_t i, const Locator& locator) {
+        EXPECT_EQ(locator.strnr, locators[i].strnr);
+        EXPECT_EQ(locator.dexnr, locators[i].dexnr);
+        EXPECT_EQ(locator.clsnr, locators[i].clsnr);
+        decoded++;
+      });
+  EXPECT_EQ(decoded, locators.size());
+}
+
+TEST(LocatorTest, global_class_index) {
+  char buf[Locator::encoded_global_class_index_max];
+  for (uint32_t index : {0u, 61u, 62u, 12345u, 916132831u}) {
+    Locator::encodeGlobalClassIndex(index, 6, buf);
+    EXPECT_EQ(Locator::decodeGlobalClassIndex(buf), index) << buf;
+  }
+  EXPECT_EQ(Locator::decodeGlobalClassIndex("[[LX/0A;"), 10);
+  EXPECT_EQ(Locator::decodeGlobalClassIndex("LX/a-b;"),
+            Locator::invalid_global_class_index);
+  EXPECT_EQ(Locator::decodeGlobalClassIndex("LX/;"),
+            Locator::invalid_global_class_index);
+  EXPECT_EQ(Locator::decodeGlobalClassIndex("LFoo;"),
+            Locator::invalid_global_class_index);
+}
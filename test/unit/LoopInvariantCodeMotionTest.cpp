@@ -0,0 +1,228 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ControlFlow.h"
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "LoopInvariantCodeMotion.h"
+#include "RedexTest.h"
+
+class LoopInvariantCodeMotionTest : public RedexTest {
+ public:
+  LoopInvariantCodeMotionTest() {
+    auto field_a = static_cast<DexField*>(DexField::make_field("LFoo;.a:I"));
+    field_a->make_concrete(ACC_PUBLIC);
+    auto field_s = static_cast<DexField*>(DexField::make_field("LFoo;.s:I"));
+    field_s->make_concrete(ACC_PUBLIC | ACC_STATIC);
+    m_creator = std::make_unique<ClassCreator>(DexType::make_type("LFoo;"));
+    m_creator->set_super(get_object_type());
+    m_creator->add_field(field_a);
+    m_creator->add_field(field_s);
+  }
+
+ protected:
+  LoopInvariantCodeMotion::Stats run(DexMethod* method) {
+    m_creator->add_method(method);
+    m_creator->create();
+    auto code = method->get_code();
+    code->build_cfg(/* editable */ true);
+    CommonSubexpressionElimination::SharedState shared_state;
+    LoopInvariantCodeMotion licm(&shared_state, method, code->cfg());
+    licm.run();
+    code->clear_cfg();
+    return licm.get_stats();
+  }
+
+  std::unique_ptr<ClassCreator> m_creator;
+};
+
+namespace {
+
+// The number of instructions with `op` before the first one with `marker`.
+size_t count_before(const IRCode* code, IROpcode op, IROpcode marker) {
+  size_t count = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == marker) {
+      break;
+    }
+    if (mie.insn->opcode() == op) {
+      count++;
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+TEST_F(LoopInvariantCodeMotionTest, arithmetic) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.loop:(II)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (const v2 0)
+        (:loop)
+        (if-ge v2 v0 :end)
+        (mul-int v3 v0 v1)
+        (add-int/lit8 v4 v3 1)
+        (mul-int v5 v1 v0)
+        (add-int v2 v2 v4)
+        (add-int v2 v2 v5)
+        (goto :loop)
+        (:end)
+        (return v2)
+      )
+    )
+  )");
+  auto stats = run(method);
+  EXPECT_EQ(stats.loops_hoisted_from, 1);
+  EXPECT_EQ(stats.instructions_hoisted, 3);
+  // The multiplications compute the same value.
+  EXPECT_EQ(stats.instructions_shared, 1);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count_before(code, OPCODE_MUL_INT, OPCODE_IF_GE), 1)
+      << assembler::to_string(code);
+  EXPECT_EQ(count_before(code, OPCODE_ADD_INT_LIT8, OPCODE_IF_GE), 1)
+      << assembler::to_string(code);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, variant_and_throwing) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.loop:(II)I"
+      (
+        (load-param v0)
+        (load-param v1)
+        (const v2 0)
+        (:loop)
+        (if-ge v2 v0 :end)
+        (mul-int v3 v2 v1)
+        (div-int v4 v0 v1)
+        (add-int v2 v2 v3)
+        (add-int v2 v2 v4)
+        (goto :loop)
+        (:end)
+        (return v2)
+      )
+    )
+  )");
+  auto stats = run(method);
+  EXPECT_EQ(stats.instructions_hoisted, 0);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, field_reads) {
+  auto method = assembler::method_from_string(R"(
+    (method (public) "LFoo;.loop:(LFoo;I)I"
+      (
+        (load-param-object v0)
+        (load-param-object v1)
+        (load-param v2)
+        (const v3 0)
+        (:loop)
+        (if-ge v3 v2 :end)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v4)
+        (sget "LFoo;.s:I")
+        (move-result-pseudo v5)
+        (iget v1 "LFoo;.a:I")
+        (move-result-pseudo v6)
+        (add-int v3 v3 v4)
+        (add-int v3 v3 v5)
+        (add-int v3 v3 v6)
+        (goto :loop)
+        (:end)
+        (return v3)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // The read of the other object's field may throw.
+  EXPECT_EQ(stats.instructions_hoisted, 2);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count_before(code, OPCODE_IGET, OPCODE_IF_GE), 1)
+      << assembler::to_string(code);
+  EXPECT_EQ(count_before(code, OPCODE_SGET, OPCODE_IF_GE), 1)
+      << assembler::to_string(code);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, field_reads_with_barrier) {
+  auto method = assembler::method_from_string(R"(
+    (method (public) "LFoo;.loop:(I)I"
+      (
+        (load-param-object v0)
+        (load-param v1)
+        (const v2 0)
+        (:loop)
+        (if-ge v2 v1 :end)
+        (iget v0 "LFoo;.a:I")
+        (move-result-pseudo v3)
+        (add-int/lit8 v4 v1 1)
+        (iput v4 v0 "LFoo;.a:I")
+        (add-int v2 v2 v3)
+        (goto :loop)
+        (:end)
+        (return v2)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // Only the arithmetic is hoisted past the write.
+  EXPECT_EQ(stats.instructions_hoisted, 1);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count_before(code, OPCODE_IGET, OPCODE_IF_GE), 0)
+      << assembler::to_string(code);
+}
+
+TEST_F(LoopInvariantCodeMotionTest, throwing_reads_in_header) {
+  auto field_f = static_cast<DexField*>(DexField::make_field("LBar;.F:I"));
+  field_f->make_concrete(ACC_PUBLIC | ACC_STATIC | ACC_FINAL);
+  ClassCreator bar_creator(DexType::make_type("LBar;"));
+  bar_creator.set_super(get_object_type());
+  bar_creator.add_field(field_f);
+  bar_creator.create();
+
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.loop:([I)I"
+      (
+        (load-param-object v0)
+        (const v1 0)
+        (const v2 0)
+        (:loop)
+        (array-length v0)
+        (move-result-pseudo v3)
+        (sget "LBar;.F:I")
+        (move-result-pseudo v4)
+        (add-int v6 v3 v4)
+        (if-ge v2 v6 :end)
+        (array-length v0)
+        (move-result-pseudo v5)
+        (add-int v1 v1 v5)
+        (invoke-static () "LBar;.impure:()V")
+        (add-int/lit8 v2 v2 1)
+        (goto :loop)
+        (:end)
+        (return v1)
+      )
+    )
+  )");
+  auto stats = run(method);
+  // The reads in the header run first, and the length and the final field
+  // can't change, even with the barrier. The array-length in the body may
+  // not run, and could throw.
+  EXPECT_EQ(stats.instructions_hoisted, 3);
+
+  auto code = method->get_code();
+  EXPECT_EQ(count_before(code, OPCODE_ARRAY_LENGTH, OPCODE_IF_GE), 1)
+      << assembler::to_string(code);
+  EXPECT_EQ(count_before(code, OPCODE_SGET, OPCODE_IF_GE), 1)
+      << assembler::to_string(code);
+}
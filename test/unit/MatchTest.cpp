@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "Match.h"
+#include "RedexTest.h"
+
+class MatchTest : public RedexTest {};
+
+TEST_F(MatchTest, opcodeSets) {
+  static_assert(m::ANY_OPCODE.contains(IOPCODE_MOVE_RESULT_PSEUDO_WIDE),
+                "ANY_OPCODE holds the internal opcodes");
+  static_assert(!m::OpcodeSet{OPCODE_NOP}.contains(OPCODE_MOVE),
+                "Sets only hold what they are made of");
+
+  EXPECT_EQ(m::OpcodeSet{OPCODE_INVOKE_STATIC},
+            m::invoke_static().opcodes);
+  EXPECT_EQ(m::OpcodeSet{OPCODE_INVOKE_STATIC},
+            m::invoke(m::invoke_static()).opcodes);
+  EXPECT_EQ(m::OpcodeSet(), m::invoke(m::const_string()).opcodes);
+  EXPECT_EQ((m::OpcodeSet{OPCODE_CONST_STRING, OPCODE_THROW}),
+            (m::const_string() || m::throwex()).opcodes);
+  EXPECT_EQ(m::OpcodeSet{OPCODE_CHECK_CAST},
+            (m::is_opcode(OPCODE_CHECK_CAST) && m::has_type()).opcodes);
+  EXPECT_EQ(m::ANY_OPCODE, m::has_type().opcodes);
+  // The negation of a match can match any opcode.
+  EXPECT_EQ(m::ANY_OPCODE, (!m::const_string()).opcodes);
+}
+
+TEST_F(MatchTest, findMatchesChecksOpcodesFirst) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const-string "Foo")
+      (move-result-pseudo-object v0)
+      (invoke-static (v0) "LFoo;.bar:(Ljava/lang/String;)V")
+      (const-string "Baz")
+      (move-result-pseudo-object v0)
+      (invoke-virtual (v0) "Ljava/lang/Object;.hashCode:()I")
+      (return-void)
+    )
+  )");
+  std::vector<IRInstruction*> insns;
+  for (auto& mie : InstructionIterable(code.get())) {
+    insns.push_back(mie.insn);
+  }
+
+  auto pattern = std::make_tuple(m::const_string(), m::move_result_pseudo(),
+                                 m::invoke_static(m::has_n_args(1)));
+  std::vector<std::vector<IRInstruction*>> matches;
+  m::find_matches(insns, pattern, matches);
+  ASSERT_EQ(1, matches.size());
+  EXPECT_EQ(insns[0], matches[0][0]);
+  EXPECT_EQ(insns[2], matches[0][2]);
+
+  // The opcodes are a necessary condition only: the predicates still decide.
+  auto no_args = std::make_tuple(m::invoke_static(m::has_n_args(0)));
+  matches.clear();
+  m::find_matches(insns, no_args, matches);
+  EXPECT_TRUE(matches.empty());
+}
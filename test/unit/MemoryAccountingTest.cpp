@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "DexClass.h"
+#include "DexPosition.h"
+#include "IRInstruction.h"
+#include "MemoryAccounting.h"
+#include "RedexTest.h"
+
+using namespace memory_accounting;
+
+class MemoryAccountingTest : public RedexTest {};
+
+TEST_F(MemoryAccountingTest, countsLiveObjects) {
+  auto before = take_report();
+  auto insn = new IRInstruction(OPCODE_NOP);
+  auto pos = std::make_unique<DexPosition>(42);
+  auto pos_copy = std::make_unique<DexPosition>(*pos);
+  auto during = take_report();
+  EXPECT_EQ(before["IRInstruction"].count + 1, during["IRInstruction"].count);
+  EXPECT_EQ(before["IRInstruction"].bytes + sizeof(IRInstruction),
+            during["IRInstruction"].bytes);
+  EXPECT_EQ(before["DexPosition"].count + 2, during["DexPosition"].count);
+
+  delete insn;
+  pos.reset();
+  pos_copy.reset();
+  auto after = take_report();
+  EXPECT_EQ(before["IRInstruction"].count, after["IRInstruction"].count);
+  EXPECT_EQ(before["DexPosition"].count, after["DexPosition"].count);
+}
+
+TEST_F(MemoryAccountingTest, countsInternedEntities) {
+  auto before = take_report();
+  DexString::make_string("Lfoo;");
+  DexString::make_string("Lfoo;");
+  auto type = DexType::make_type("Lbar;");
+  auto proto = DexProto::make_proto(type, DexTypeList::make_type_list({}));
+  auto ref = DexMethod::make_method(type, DexString::make_string("ref"), proto);
+  static_cast<DexMethod*>(
+      DexMethod::make_method(type, DexString::make_string("def"), proto))
+      ->make_concrete(ACC_PUBLIC, /* is_virtual */ true);
+  auto after = take_report();
+  // "Lfoo;", "Lbar;", "ref", "def" and the shorty.
+  EXPECT_EQ(before["DexString"].count + 5, after["DexString"].count);
+  EXPECT_EQ(before["DexType"].count + 1, after["DexType"].count);
+  EXPECT_EQ(before["DexProto"].count + 1, after["DexProto"].count);
+  EXPECT_EQ(before["DexMethodRef"].count + 1, after["DexMethodRef"].count);
+  EXPECT_EQ(before["DexMethod"].count + 1, after["DexMethod"].count);
+  EXPECT_FALSE(ref->is_def());
+
+  auto json = to_json(after);
+  EXPECT_EQ(after["DexString"].count, json["DexString"]["count"].asUInt64());
+  EXPECT_TRUE(json.isMember("total_bytes"));
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "IRAssembler.h"
+#include "MethodCosts.h"
+#include "RedexTest.h"
+#include "Walkers.h"
+
+using namespace method_costs;
+
+class MethodCostsTest : public RedexTest {
+ public:
+  ~MethodCostsTest() { set_enabled(false); }
+};
+
+namespace {
+
+DexClass* create_class() {
+  ClassCreator creator(DexType::make_type("LFoo;"));
+  creator.set_super(get_object_type());
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.slow:()V"
+     ((const v0 0) (const v1 1) (return-void)))
+  )"));
+  creator.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.fast:()V"
+     ((return-void)))
+  )"));
+  return creator.create();
+}
+
+void sleep_in_slow(DexMethod* method) {
+  if (method->get_name()->str() == "slow") {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
+} // namespace
+
+TEST_F(MethodCostsTest, reportsSlowestMethods) {
+  Scope scope{create_class()};
+  set_enabled(true);
+  walk::parallel::methods(scope, sleep_in_slow);
+  // Timers that start inside another one count towards the outer one.
+  walk::parallel::methods(scope, [&](DexMethod*) {
+    walk::methods(scope, sleep_in_slow);
+  });
+
+  auto report = take_report(1);
+  ASSERT_EQ(1, report.size());
+  EXPECT_EQ("LFoo;.slow:()V", report[0].method);
+  EXPECT_GE(report[0].millis, 20);
+  EXPECT_EQ(3, report[0].instructions);
+  EXPECT_EQ(0, report[0].blocks);
+
+  auto json = to_json(report);
+  EXPECT_EQ("LFoo;.slow:()V", json[0]["method"].asString());
+  EXPECT_EQ(3, json[0]["instructions"].asUInt64());
+
+  // Reports start over.
+  EXPECT_TRUE(take_report(10).empty());
+}
+
+TEST_F(MethodCostsTest, disabledByDefault) {
+  Scope scope{create_class()};
+  walk::parallel::methods(scope, sleep_in_slow);
+  EXPECT_TRUE(take_report(10).empty());
+}
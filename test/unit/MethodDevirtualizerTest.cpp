@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "MethodDevirtualizer.h"
+#include "MethodOverrideGraph.h"
+#include "RedexTest.h"
+#include "Show.h"
+#include "VirtualScope.h"
+
+class MethodDevirtualizerTest : public RedexTest {};
+
+namespace {
+
+DexClass* create_class(const std::string& name,
+                       DexType* super,
+                       const std::vector<std::string>& methods) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(super);
+  for (const auto& method : methods) {
+    creator.add_method(assembler::method_from_string(method));
+  }
+  return creator.create();
+}
+
+/*
+ * class A {
+ *   int get() { return f; }
+ *   int one() { return 1; }
+ *   int two() { return 2; }
+ * }
+ * class B extends A {
+ *   int two() { return 3; }
+ *   static int call(B b) { return b.get() + b.one() + b.two(); }
+ * }
+ */
+Scope create_scope() {
+  auto a = create_class("LA;", get_object_type(),
+                        {R"(
+    (method (public) "LA;.get:()I"
+     ((load-param-object v0) (iget v0 "LA;.f:I") (move-result-pseudo v1)
+      (return v1)))
+  )",
+                         R"(
+    (method (public) "LA;.one:()I"
+     ((load-param-object v0) (const v1 1) (return v1)))
+  )",
+                         R"(
+    (method (public) "LA;.two:()I"
+     ((load-param-object v0) (const v1 2) (return v1)))
+  )"});
+  auto b = create_class("LB;", a->get_type(),
+                        {R"(
+    (method (public) "LB;.two:()I"
+     ((load-param-object v0) (const v1 3) (return v1)))
+  )",
+                         R"(
+    (method (public static) "LB;.call:(LB;)I"
+     ((load-param-object v0)
+      (invoke-virtual (v0) "LB;.get:()I") (move-result v1)
+      (invoke-virtual (v0) "LB;.one:()I") (move-result v2)
+      (invoke-virtual (v0) "LB;.two:()I") (move-result v3)
+      (return v1)))
+  )"});
+  return {a, b};
+}
+
+std::vector<std::string> calls(const DexMethod* method) {
+  std::vector<std::string> result;
+  for (const auto& mie : InstructionIterable(method->get_code())) {
+    if (is_invoke(mie.insn->opcode())) {
+      result.push_back(show(mie.insn));
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_F(MethodDevirtualizerTest, staticizeNonOverriddenVirtuals) {
+  auto scope = create_scope();
+  MethodDevirtualizer devirt(/* vmethods_not_using_this */ true,
+                             /* vmethods_using_this */ true,
+                             /* dmethods_not_using_this */ true,
+                             /* dmethods_using_this */ false,
+                             /* ignore_keep */ false);
+  get_vmethods(get_object_type());
+  auto graph = method_override_graph::build_graph(scope);
+  auto metrics = devirt.devirtualize_methods(scope, graph.get());
+
+  EXPECT_EQ(metrics.num_methods_using_this, 1);
+  EXPECT_EQ(metrics.num_methods_not_using_this, 1);
+  EXPECT_EQ(metrics.num_virtual_calls, 2);
+  auto call =
+      static_cast<DexMethod*>(DexMethod::get_method("LB;.call:(LB;)I"));
+  EXPECT_EQ(calls(call),
+            std::vector<std::string>({"INVOKE_STATIC v0, LA;.get:(LA;)I",
+                                      "INVOKE_STATIC LA;.one:()I",
+                                      "INVOKE_VIRTUAL v0, LB;.two:()I"}));
+}
+
+TEST_F(MethodDevirtualizerTest, keepMethodsUsingThis) {
+  auto scope = create_scope();
+  MethodDevirtualizer devirt(/* vmethods_not_using_this */ true,
+                             /* vmethods_using_this */ false,
+                             /* dmethods_not_using_this */ true,
+                             /* dmethods_using_this */ false,
+                             /* ignore_keep */ false);
+  auto metrics = devirt.devirtualize_methods(scope);
+
+  EXPECT_EQ(metrics.num_methods_using_this, 0);
+  EXPECT_EQ(metrics.num_methods_not_using_this, 1);
+  EXPECT_EQ(metrics.num_virtual_calls, 1);
+  auto get = static_cast<DexMethod*>(DexMethod::get_method("LA;.get:()I"));
+  EXPECT_TRUE(get->is_virtual());
+}
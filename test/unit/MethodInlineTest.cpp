@@ -249,3 +249,110 @@ TEST_F(MethodInlineTest, test_intra_dex_inlining) {
     EXPECT_EQ(inlined.count(method), 1);
   }
 }
+
+TEST_F(MethodInlineTest, test_parallel_inlining_is_bottom_up) {
+  ConcurrentMethodRefCache resolve_cache;
+  auto resolver = [&resolve_cache](DexMethodRef* method, MethodSearch search) {
+    return resolve_method(method, search, resolve_cache);
+  };
+
+  DexStoresVector stores;
+  std::unordered_set<DexMethod*> candidates;
+  auto foo_cls = create_a_class("Lfoo;");
+  {
+    DexStore store("root");
+    store.add_classes({foo_cls});
+    stores.push_back(std::move(store));
+  }
+  // foo_main -> foo_m1 -> foo_m2, and foo_main -> foo_m2 directly.
+  auto foo_m2 = make_a_method(foo_cls, "foo_m2", 2);
+  auto foo_m1 = make_a_method_calls_others(foo_cls, "foo_m1", {foo_m2});
+  auto foo_main =
+      make_a_method_calls_others(foo_cls, "foo_main", {foo_m1, foo_m2});
+  candidates.insert(foo_m1);
+  candidates.insert(foo_m2);
+
+  auto scope = build_class_scope(stores);
+  api::LevelChecker::init(0, scope);
+
+  inliner::InlinerConfig inliner_config;
+  inliner_config.multiple_callers = true;
+  inliner_config.parallel = true;
+  inliner_config.populate(scope);
+  MultiMethodInliner inliner(
+      scope, stores, candidates, resolver, inliner_config);
+  inliner.inline_methods();
+
+  auto inlined = inliner.get_inlined();
+  EXPECT_EQ(inlined.size(), 2);
+  EXPECT_EQ(inlined.count(foo_m1), 1);
+  EXPECT_EQ(inlined.count(foo_m2), 1);
+  EXPECT_EQ(inliner.get_info().calls_inlined, 3);
+
+  // foo_m2 was inlined into foo_m1 before foo_m1 was inlined into foo_main,
+  // so no calls are left.
+  for (auto& mie : InstructionIterable(foo_main->get_code())) {
+    EXPECT_FALSE(is_invoke(mie.insn->opcode()));
+  }
+}
+
+TEST_F(MethodInlineTest, register_pressure_adds_up_over_callees) {
+  ConcurrentMethodRefCache resolve_cache;
+  auto resolver = [&resolve_cache](DexMethodRef* method, MethodSearch search) {
+    return resolve_method(method, search, resolve_cache);
+  };
+
+  ClassCreator cc(DexType::make_type("Lfoo;"));
+  cc.set_super(get_object_type());
+  // Three registers are live at once in each callee.
+  auto make_callee = [&](const std::string& name) {
+    auto method = assembler::method_from_string(R"(
+      (method (public static) "Lfoo;.)" + name + R"(:()I"
+       (
+        (const v0 1)
+        (const v1 2)
+        (const v2 3)
+        (add-int v0 v0 v1)
+        (add-int v0 v0 v2)
+        (return v0)
+       )
+      )
+    )");
+    cc.add_method(method);
+    return method;
+  };
+  auto foo_a = make_callee("foo_a");
+  auto foo_b = make_callee("foo_b");
+  // The caller has more registers than the limit, but none live at once.
+  auto foo_main = assembler::method_from_string(R"(
+    (method (public static) "Lfoo;.foo_main:()V"
+     (
+      (const v4 0)
+      (invoke-static () "Lfoo;.foo_a:()I")
+      (invoke-static () "Lfoo;.foo_b:()I")
+      (return-void)
+     )
+    )
+  )");
+  cc.add_method(foo_main);
+
+  DexStoresVector stores;
+  DexStore store("root");
+  store.add_classes({cc.create()});
+  stores.push_back(std::move(store));
+  auto scope = build_class_scope(stores);
+  api::LevelChecker::init(0, scope);
+
+  // Either callee fits under the limit on its own, but not both.
+  inliner::InlinerConfig inliner_config;
+  inliner_config.max_register_pressure = 3;
+  inliner_config.populate(scope);
+  std::unordered_set<DexMethod*> candidates{foo_a, foo_b};
+  MultiMethodInliner inliner(
+      scope, stores, candidates, resolver, inliner_config);
+  inliner.inline_methods();
+
+  EXPECT_EQ(inliner.get_inlined().size(), 1);
+  EXPECT_EQ(inliner.get_info().calls_inlined, 1);
+  EXPECT_EQ(inliner.get_info().register_pressure, 1);
+}
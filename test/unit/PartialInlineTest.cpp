@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "PartialInline.h"
+#include "RedexTest.h"
+#include "Show.h"
+
+class PartialInlineTest : public RedexTest {};
+
+namespace {
+
+size_t count_calls(const IRCode* code, const std::string& callee) {
+  size_t count = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    if (is_invoke(mie.insn->opcode()) &&
+        show(mie.insn->get_method()) == callee) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+size_t count_opcodes(const IRCode* code, IROpcode op) {
+  size_t count = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == op) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+/*
+ * class Foo {
+ *   static Foo sCache;
+ *
+ *   static Foo get() {
+ *     if (sCache != null) return sCache;
+ *     sCache = new Foo();
+ *     return sCache;
+ *   }
+ * }
+ */
+DexClass* create_foo(DexAccessFlags cache_access) {
+  ClassCreator cc(DexType::make_type("LFoo;"));
+  cc.set_super(get_object_type());
+  cc.set_access(ACC_PUBLIC);
+  auto cache =
+      static_cast<DexField*>(DexField::make_field("LFoo;.sCache:LFoo;"));
+  cache->make_concrete(cache_access | ACC_STATIC);
+  cc.add_field(cache);
+  cc.add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.get:()LFoo;"
+     (
+      (sget-object "LFoo;.sCache:LFoo;")
+      (move-result-pseudo-object v0)
+      (if-eqz v0 :miss)
+      (return-object v0)
+      (:miss)
+      (new-instance "LFoo;")
+      (move-result-pseudo-object v0)
+      (sput-object v0 "LFoo;.sCache:LFoo;")
+      (return-object v0)
+     )
+    )
+  )"));
+  return cc.create();
+}
+
+// Calls Foo.get() `num_calls` times, from a class of its own unless that's
+// Foo.
+DexMethod* create_caller(const std::string& cls_name, size_t num_calls) {
+  std::string body;
+  for (size_t i = 0; i < num_calls; ++i) {
+    body += R"((invoke-static () "LFoo;.get:()LFoo;") (move-result-object v0))";
+  }
+  auto caller = assembler::method_from_string(
+      "(method (public static) \"" + cls_name + ".caller:()LFoo;\" (" + body +
+      "(return-object v0)))");
+  auto cls = type_class(caller->get_class());
+  if (cls != nullptr) {
+    cls->add_method(caller);
+    return caller;
+  }
+  ClassCreator cc(caller->get_class());
+  cc.set_super(get_object_type());
+  cc.add_method(caller);
+  cc.create();
+  return caller;
+}
+
+BasicBlockLayoutPass::MethodProfiles make_profiles(const DexMethod* caller) {
+  // The blocks of get() are the guard, the return of the cache, and the rest.
+  BasicBlockLayoutPass::MethodProfiles profiles;
+  profiles["LFoo;.get:()LFoo;"] = {3, {{0, 100}, {1, 95}, {2, 5}}};
+  profiles[show(caller)] = {1, {{0, 100}}};
+  return profiles;
+}
+
+} // namespace
+
+TEST_F(PartialInlineTest, fastPathIsInlined) {
+  auto foo = create_foo(ACC_PUBLIC);
+  auto caller = create_caller("LFoo;", 1);
+  Scope scope{foo};
+
+  auto stats = PartialInlinePass::partially_inline(
+      scope, make_profiles(caller), PartialInlinePass::Config());
+  EXPECT_EQ(stats.callees_split, 1);
+  EXPECT_EQ(stats.calls_inlined, 1);
+
+  auto code = caller->get_code();
+  EXPECT_EQ(count_calls(code, "LFoo;.get:()LFoo;"), 0);
+  EXPECT_EQ(count_calls(code, "LFoo;.get$cold:()LFoo;"), 1);
+  EXPECT_EQ(count_opcodes(code, OPCODE_SGET_OBJECT), 1);
+  EXPECT_EQ(count_opcodes(code, OPCODE_NEW_INSTANCE), 0);
+
+  // The continuation goes straight to the slow part.
+  auto continuation = static_cast<DexMethod*>(
+      DexMethod::get_method("LFoo;.get$cold:()LFoo;"));
+  ASSERT_NE(continuation, nullptr);
+  EXPECT_TRUE(is_static(continuation));
+  EXPECT_TRUE(is_public(continuation));
+  auto cont_code = continuation->get_code();
+  EXPECT_EQ(count_opcodes(cont_code, OPCODE_IF_EQZ), 0);
+  EXPECT_EQ(count_opcodes(cont_code, OPCODE_NEW_INSTANCE), 1);
+
+  // The callee is left alone for the other calls.
+  auto callee = static_cast<DexMethod*>(
+      DexMethod::get_method("LFoo;.get:()LFoo;"));
+  EXPECT_EQ(count_opcodes(callee->get_code(), OPCODE_IF_EQZ), 1);
+}
+
+TEST_F(PartialInlineTest, callerGrowthIsBounded) {
+  auto foo = create_foo(ACC_PUBLIC);
+  auto caller = create_caller("LFoo;", 2);
+  Scope scope{foo};
+
+  // The fast path is the sget, its move-result and the branch, the return of
+  // the cache, and the call to the continuation: 7 instructions.
+  PartialInlinePass::Config config;
+  config.max_caller_growth = 10;
+  auto stats = PartialInlinePass::partially_inline(scope, make_profiles(caller),
+                                                   config);
+  EXPECT_EQ(stats.calls_inlined, 1);
+  EXPECT_EQ(stats.calls_over_budget, 1);
+  EXPECT_EQ(count_calls(caller->get_code(), "LFoo;.get:()LFoo;"), 1);
+}
+
+TEST_F(PartialInlineTest, privateFieldStaysInItsClass) {
+  auto foo = create_foo(ACC_PRIVATE);
+  auto caller = create_caller("LBar;", 1);
+  Scope scope{foo, type_class(caller->get_class())};
+
+  auto stats = PartialInlinePass::partially_inline(
+      scope, make_profiles(caller), PartialInlinePass::Config());
+  EXPECT_EQ(stats.calls_inlined, 0);
+  EXPECT_EQ(count_calls(caller->get_code(), "LFoo;.get:()LFoo;"), 1);
+}
+
+TEST_F(PartialInlineTest, largeFastPathIsKept) {
+  auto foo = create_foo(ACC_PUBLIC);
+  auto caller = create_caller("LFoo;", 1);
+  Scope scope{foo};
+
+  auto profiles = make_profiles(caller);
+  // Most runs build the cache, and that side doesn't fit the fast path.
+  profiles["LFoo;.get:()LFoo;"].block_hits = {{0, 100}, {1, 5}, {2, 95}};
+  PartialInlinePass::Config config;
+  config.max_fast_path_size = 8;
+  auto stats = PartialInlinePass::partially_inline(scope, profiles, config);
+  EXPECT_EQ(stats.callees_split, 0);
+  EXPECT_EQ(count_calls(caller->get_code(), "LFoo;.get:()LFoo;"), 1);
+}
+
+TEST_F(PartialInlineTest, invokeSuperStaysInAnInstanceMethod) {
+  ClassCreator cc(DexType::make_type("LBaz;"));
+  cc.set_super(get_object_type());
+  cc.set_access(ACC_PUBLIC);
+  auto cache = static_cast<DexField*>(
+      DexField::make_field("LBaz;.mName:Ljava/lang/String;"));
+  cache->make_concrete(ACC_PRIVATE);
+  cc.add_field(cache);
+  // The cold side calls Object.toString() on this, which the static
+  // continuation couldn't.
+  auto callee = assembler::method_from_string(R"(
+    (method (private) "LBaz;.name:()Ljava/lang/String;"
+     (
+      (load-param-object v1)
+      (iget-object v1 "LBaz;.mName:Ljava/lang/String;")
+      (move-result-pseudo-object v0)
+      (if-eqz v0 :miss)
+      (return-object v0)
+      (:miss)
+      (invoke-super (v1) "Ljava/lang/Object;.toString:()Ljava/lang/String;")
+      (move-result-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  cc.add_method(callee);
+  auto caller = assembler::method_from_string(R"(
+    (method (public) "LBaz;.caller:()Ljava/lang/String;"
+     (
+      (load-param-object v1)
+      (invoke-direct (v1) "LBaz;.name:()Ljava/lang/String;")
+      (move-result-object v0)
+      (return-object v0)
+     )
+    )
+  )");
+  cc.add_method(caller);
+  Scope scope{cc.create()};
+
+  BasicBlockLayoutPass::MethodProfiles profiles;
+  profiles[show(callee)] = {3, {{0, 100}, {1, 95}, {2, 5}}};
+  profiles[show(caller)] = {1, {{0, 100}}};
+  auto stats = PartialInlinePass::partially_inline(
+      scope, profiles, PartialInlinePass::Config());
+  EXPECT_EQ(stats.callees_split, 0);
+  EXPECT_EQ(count_calls(caller->get_code(),
+                        "LBaz;.name:()Ljava/lang/String;"),
+            1);
+}
@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include <chrono>
+#include <thread>
+
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+#include "ScopeHelper.h"
+
+namespace {
+
+/*
+ * Only reads, and records in its metrics whether the other instances ran at
+ * the same time as it did.
+ */
+class ReadOnlyPass : public Pass {
+ public:
+  ReadOnlyPass(const std::string& name, std::atomic<int>* arrived)
+      : Pass(name), m_arrived(arrived) {}
+
+  uint32_t reads() const override { return CODE | HIERARCHY; }
+  uint32_t writes() const override { return NOTHING; }
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager& mgr) override {
+    ++*m_arrived;
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (*m_arrived < 2 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+    mgr.set_metric("saw_other", *m_arrived >= 2);
+  }
+
+ private:
+  std::atomic<int>* m_arrived;
+};
+
+// Declares that it doesn't write code, and then does.
+class LyingPass : public Pass {
+ public:
+  LyingPass() : Pass("LyingPass") {}
+
+  uint32_t reads() const override { return CODE; }
+  uint32_t writes() const override { return NOTHING; }
+
+  void run_pass(DexStoresVector& stores, ConfigFiles&, PassManager&) override {
+    for (auto cls : build_class_scope(stores)) {
+      for (auto method : cls->get_dmethods()) {
+        method->get_code()->push_back(
+            (new IRInstruction(OPCODE_CONST))->set_dest(0)->set_literal(1));
+      }
+    }
+  }
+};
+
+class IdlePass : public Pass {
+ public:
+  IdlePass() : Pass("IdlePass") {}
+
+  void run_pass(DexStoresVector&, ConfigFiles&, PassManager&) override {}
+};
+
+// Records whether the code it looks at was compact.
+class ProbePass : public Pass {
+ public:
+  explicit ProbePass(const std::string& name) : Pass(name) {}
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    for (auto cls : build_class_scope(stores)) {
+      for (auto method : cls->get_dmethods()) {
+        mgr.set_metric("compact", method->is_code_compact());
+        mgr.set_metric("opcodes", method->get_code()->count_opcodes());
+      }
+    }
+  }
+};
+
+// Counts the opcodes of the code from many threads at once.
+class CountingPass : public Pass {
+ public:
+  CountingPass() : Pass("CountingPass") {}
+
+  void run_pass(DexStoresVector& stores,
+                ConfigFiles&,
+                PassManager& mgr) override {
+    auto opcodes = mgr.register_metric("opcodes");
+    std::vector<boost::thread> threads;
+    for (size_t i = 0; i < 8; ++i) {
+      threads.emplace_back([&] {
+        for (auto cls : build_class_scope(stores)) {
+          for (auto method : cls->get_dmethods()) {
+            for (size_t j = 0; j < 1000; ++j) {
+              opcodes.incr(method->get_code()->count_opcodes());
+            }
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    mgr.set_metric("seen", mgr.get_metric("opcodes"));
+  }
+};
+
+DexStoresVector make_stores() {
+  auto cls = create_class(DexType::make_type("LFoo;"), get_object_type(), {},
+                          ACC_PUBLIC);
+  cls->add_method(assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:()V"
+      ((const v0 0) (return-void))
+    )
+  )"));
+  DexStoresVector stores;
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  std::vector<DexClass*> classes{cls};
+  store.add_classes(classes);
+  stores.emplace_back(std::move(store));
+  return stores;
+}
+
+} // namespace
+
+class PassManagerTest : public RedexTest {};
+
+TEST_F(PassManagerTest, independentPassesRunAtTheSameTime) {
+  std::atomic<int> arrived{0};
+  ReadOnlyPass first("FirstReadOnlyPass", &arrived);
+  ReadOnlyPass second("SecondReadOnlyPass", &arrived);
+  auto stores = make_stores();
+  PassManager manager({&first, &second});
+  manager.set_testing_mode();
+
+  Json::Value conf_obj;
+  conf_obj["parallel_passes"] = true;
+  ConfigFiles conf(conf_obj);
+  manager.run_passes(stores, conf);
+
+  for (const auto& pass_info : manager.get_pass_info()) {
+    EXPECT_EQ(1, pass_info.metrics.at("saw_other")) << pass_info.name;
+  }
+}
+
+TEST_F(PassManagerTest, strictModeCatchesUndeclaredWrites) {
+  LyingPass pass;
+  auto stores = make_stores();
+  PassManager manager({&pass});
+  manager.set_testing_mode();
+
+  Json::Value conf_obj;
+  conf_obj["check_pass_effects"] = true;
+  ConfigFiles conf(conf_obj);
+  EXPECT_THROW(manager.run_passes(stores, conf), RedexException);
+}
+
+TEST_F(PassManagerTest, untouchedCodeIsCompacted) {
+  IdlePass idle;
+  ProbePass first("FirstProbePass");
+  ProbePass second("SecondProbePass");
+  auto stores = make_stores();
+  PassManager manager({&idle, &first, &second});
+  manager.set_testing_mode();
+
+  Json::Value conf_obj;
+  conf_obj["compact_code_after_passes"] = 1;
+  ConfigFiles conf(conf_obj);
+  manager.run_passes(stores, conf);
+
+  const auto& pass_info = manager.get_pass_info();
+  // Nothing asked for the code during IdlePass.
+  EXPECT_EQ(1, pass_info[1].metrics.at("compact"));
+  EXPECT_EQ(2, pass_info[1].metrics.at("opcodes"));
+  EXPECT_EQ(0, pass_info[2].metrics.at("compact"));
+  EXPECT_EQ(2, pass_info[2].metrics.at("opcodes"));
+}
+
+TEST_F(PassManagerTest, registeredMetricsSumAcrossThreads) {
+  CountingPass counting;
+  auto stores = make_stores();
+  PassManager manager({&counting});
+  manager.set_testing_mode();
+
+  Json::Value conf_obj;
+  ConfigFiles conf(conf_obj);
+  manager.run_passes(stores, conf);
+
+  const auto& metrics = manager.get_pass_info()[0].metrics;
+  EXPECT_EQ(16000, metrics.at("seen"));
+  EXPECT_EQ(16000, metrics.at("opcodes"));
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "PointerIndexMap.h"
+
+TEST(PointerIndexMapTest, empty) {
+  PointerIndexMap<int*, uint32_t> map;
+  int x;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.count(&x), 0);
+  EXPECT_EQ(map.begin(), map.end());
+
+  PointerIndexMap<int*, uint32_t> built(std::vector<int*>{});
+  EXPECT_EQ(built.size(), 0);
+  EXPECT_EQ(built.count(&x), 0);
+}
+
+TEST(PointerIndexMapTest, indexesKeysInOrder) {
+  std::vector<std::unique_ptr<int>> storage;
+  std::vector<int*> keys;
+  for (int i = 0; i < 10000; ++i) {
+    storage.emplace_back(new int(i));
+    keys.push_back(storage.back().get());
+  }
+  // The order of the keys, not their addresses, determines the indices.
+  std::reverse(keys.begin(), keys.end());
+  PointerIndexMap<int*, uint16_t> map(keys);
+  EXPECT_EQ(map.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(map.count(keys[i]), 1);
+    EXPECT_EQ(map.at(keys[i]), i);
+  }
+  int other;
+  EXPECT_EQ(map.count(&other), 0);
+
+  size_t idx = 0;
+  for (const auto& p : map) {
+    EXPECT_EQ(p.first, keys[idx]);
+    EXPECT_EQ(p.second, idx);
+    ++idx;
+  }
+  EXPECT_EQ(idx, keys.size());
+}
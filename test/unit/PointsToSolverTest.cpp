@@ -0,0 +1,278 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "PointsToSemantics.h"
+#include "PointsToSolver.h"
+#include "RedexTest.h"
+
+namespace {
+
+DexClass* make_class(const std::string& name,
+                     DexType* super,
+                     const std::vector<std::string>& methods) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(super);
+  for (const auto& method : methods) {
+    creator.add_method(assembler::method_from_string(method));
+  }
+  return creator.create();
+}
+
+struct PointsToSolverTest : public RedexTest {
+  /*
+   * class Base { Base next; Base get() { return next; } }
+   * class A extends Base { Base get() { return new B(); } }
+   * class B extends Base {}
+   * class Main { static Base s; ... }
+   */
+  PointsToSolverTest() {
+    auto base_t = DexType::make_type("LBase;");
+    auto next = static_cast<DexField*>(
+        DexField::make_field("LBase;.next:LBase;"));
+    next->make_concrete(ACC_PUBLIC);
+    auto static_field =
+        static_cast<DexField*>(DexField::make_field("LMain;.s:LBase;"));
+    static_field->make_concrete(ACC_PUBLIC | ACC_STATIC);
+
+    ClassCreator base_creator(base_t);
+    base_creator.set_super(get_object_type());
+    base_creator.add_field(next);
+    base_creator.add_method(assembler::method_from_string(R"(
+      (method (public) "LBase;.get:()LBase;"
+        (
+          (load-param-object v0)
+          (iget-object v0 "LBase;.next:LBase;")
+          (move-result-pseudo-object v1)
+          (return-object v1)
+        )
+      )
+    )"));
+    scope.push_back(base_creator.create());
+
+    scope.push_back(make_class("LA;", base_t, {R"(
+      (method (public) "LA;.get:()LBase;"
+        (
+          (load-param-object v0)
+          (new-instance "LB;")
+          (move-result-pseudo-object v1)
+          (return-object v1)
+        )
+      )
+    )"}));
+    scope.push_back(make_class("LB;", base_t, {}));
+
+    ClassCreator main_creator(DexType::make_type("LMain;"));
+    main_creator.set_super(get_object_type());
+    main_creator.add_field(static_field);
+    for (const char* method : {
+             R"(
+      (method (public static) "LMain;.devirt:()LBase;"
+        (
+          (new-instance "LA;")
+          (move-result-pseudo-object v0)
+          (invoke-virtual (v0) "LBase;.get:()LBase;")
+          (move-result-object v1)
+          (return-object v1)
+        )
+      )
+    )",
+             R"(
+      (method (public static) "LMain;.fields:()LBase;"
+        (
+          (new-instance "LA;")
+          (move-result-pseudo-object v0)
+          (new-instance "LB;")
+          (move-result-pseudo-object v1)
+          (iput-object v1 v0 "LBase;.next:LBase;")
+          (iget-object v0 "LBase;.next:LBase;")
+          (move-result-pseudo-object v2)
+          (return-object v2)
+        )
+      )
+    )",
+             R"(
+      (method (public static) "LMain;.leak:()V"
+        (
+          (new-instance "LA;")
+          (move-result-pseudo-object v0)
+          (sput-object v0 "LMain;.s:LBase;")
+          (return-void)
+        )
+      )
+    )",
+             R"(
+      (method (public static) "LMain;.opaque:(LBase;)LBase;"
+        (
+          (load-param-object v0)
+          (invoke-virtual (v0) "LBase;.get:()LBase;")
+          (move-result-object v1)
+          (return-object v1)
+        )
+      )
+    )",
+             R"(
+      (method (public static) "LMain;.start:()V"
+        (
+          (new-instance "LB;")
+          (move-result-pseudo-object v0)
+          (invoke-static (v0) "LMain;.ping:(LBase;)LBase;")
+          (return-void)
+        )
+      )
+    )",
+             R"(
+      (method (public static) "LMain;.ping:(LBase;)LBase;"
+        (
+          (load-param-object v0)
+          (invoke-static (v0) "LMain;.pong:(LBase;)LBase;")
+          (move-result-object v1)
+          (return-object v1)
+        )
+      )
+    )",
+             R"(
+      (method (public static) "LMain;.pong:(LBase;)LBase;"
+        (
+          (load-param-object v0)
+          (invoke-static (v0) "LMain;.ping:(LBase;)LBase;")
+          (return-object v0)
+        )
+      )
+    )"}) {
+      main_creator.add_method(assembler::method_from_string(method));
+    }
+    scope.push_back(main_creator.create());
+
+    semantics = std::make_unique<PointsToSemantics>(scope);
+  }
+
+  // The objects that `method` returns.
+  PointsToSolver::ObjectSet returned(const PointsToSolver& solver,
+                                     const std::string& method) {
+    auto ref = DexMethod::get_method(method);
+    auto method_semantics = semantics->get_method_semantics(ref);
+    EXPECT_TRUE(method_semantics);
+    PointsToSolver::ObjectSet result;
+    for (const auto& action :
+         (*method_semantics)->get_points_to_actions()) {
+      if (action.operation().is_return()) {
+        result.union_with(solver.get_points_to_set(ref, action.src()));
+      }
+    }
+    return result;
+  }
+
+  Scope scope;
+  std::unique_ptr<PointsToSemantics> semantics;
+};
+
+TEST_F(PointsToSolverTest, virtualCallsDispatchOnTheReceiver) {
+  PointsToSolver solver(scope, *semantics, {});
+  auto callees =
+      solver.get_callees(DexMethod::get_method("LMain;.devirt:()LBase;"),
+                         DexMethod::get_method("LBase;.get:()LBase;"));
+  ASSERT_TRUE(callees);
+  EXPECT_EQ(*callees,
+            std::unordered_set<const DexMethod*>{static_cast<DexMethod*>(
+                DexMethod::get_method("LA;.get:()LBase;"))});
+
+  auto objects = returned(solver, "LMain;.devirt:()LBase;");
+  ASSERT_EQ(objects.size(), 1);
+  const auto& object = solver.get_object(*objects.begin());
+  EXPECT_EQ(object.kind, PointsToSolver::PTS_ALLOCATION);
+  EXPECT_EQ(object.type, DexType::get_type("LB;"));
+  EXPECT_EQ(object.method, DexMethod::get_method("LA;.get:()LBase;"));
+  // It is returned to devirt().
+  EXPECT_TRUE(solver.may_escape(*objects.begin()));
+}
+
+TEST_F(PointsToSolverTest, fieldsOfEachObjectAreKeptApart) {
+  PointsToSolver solver(scope, *semantics, {});
+  auto objects = returned(solver, "LMain;.fields:()LBase;");
+  ASSERT_EQ(objects.size(), 1);
+  const auto& object = solver.get_object(*objects.begin());
+  EXPECT_EQ(object.type, DexType::get_type("LB;"));
+  EXPECT_EQ(object.method, DexMethod::get_method("LMain;.fields:()LBase;"));
+  // Nobody calls fields(), and the A that holds it stays local.
+  EXPECT_FALSE(solver.may_escape(*objects.begin()));
+
+  // What Base.get() returns is what is stored in the field of the objects
+  // that reach `this`: none, since it is only called on an A.
+  EXPECT_TRUE(returned(solver, "LBase;.get:()LBase;").empty());
+}
+
+TEST_F(PointsToSolverTest, staticFieldsEscape) {
+  PointsToSolver solver(scope, *semantics, {});
+  bool found = false;
+  for (PointsToSolver::ObjectId id = 0; id < solver.get_stats().objects;
+       ++id) {
+    const auto& object = solver.get_object(id);
+    if (object.method == DexMethod::get_method("LMain;.leak:()V")) {
+      found = true;
+      EXPECT_TRUE(solver.may_escape(id));
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST_F(PointsToSolverTest, entryPointsTakeOpaqueObjects) {
+  auto opaque = DexMethod::get_method("LMain;.opaque:(LBase;)LBase;");
+  auto get = DexMethod::get_method("LBase;.get:()LBase;");
+  {
+    // Nothing calls opaque(), so nothing reaches the receiver.
+    PointsToSolver solver(scope, *semantics, {});
+    auto callees = solver.get_callees(opaque, get);
+    ASSERT_TRUE(callees);
+    EXPECT_TRUE(callees->empty());
+  }
+  {
+    PointsToSolver solver(scope, *semantics, {opaque});
+    EXPECT_FALSE(solver.get_callees(opaque, get));
+    // The receiver may be an A, whose get() is then analyzed as well.
+    auto objects = returned(solver, "LA;.get:()LBase;");
+    EXPECT_EQ(objects.size(), 1);
+  }
+}
+
+TEST_F(PointsToSolverTest, cyclesAreCollapsed) {
+  PointsToSolver solver(scope, *semantics, {});
+  EXPECT_GT(solver.get_stats().collapsed_nodes, 0);
+  for (const auto& method : {"LMain;.ping:(LBase;)LBase;",
+                             "LMain;.pong:(LBase;)LBase;"}) {
+    auto objects = returned(solver, method);
+    ASSERT_EQ(objects.size(), 1);
+    EXPECT_EQ(solver.get_object(*objects.begin()).method,
+              DexMethod::get_method("LMain;.start:()V"));
+    EXPECT_TRUE(solver.may_escape(*objects.begin()));
+  }
+}
+
+TEST_F(PointsToSolverTest, defaultEntryPoints) {
+  scope.push_back(make_class("LC;", get_object_type(), {R"(
+    (method (public) "LC;.toString:()Ljava/lang/String;"
+      (
+        (load-param-object v0)
+        (const-string "C")
+        (move-result-pseudo-object v1)
+        (return-object v1)
+      )
+    )
+  )"}));
+  auto entry_points = PointsToSolver::default_entry_points(scope);
+  EXPECT_EQ(entry_points.count(
+                DexMethod::get_method("LC;.toString:()Ljava/lang/String;")),
+            1);
+  EXPECT_EQ(entry_points.count(DexMethod::get_method("LA;.get:()LBase;")), 0);
+  EXPECT_EQ(entry_points.count(DexMethod::get_method("LMain;.leak:()V")), 0);
+}
+
+} // namespace
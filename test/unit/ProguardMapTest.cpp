@@ -333,3 +333,36 @@ TEST(ProguardMapTest, DeobfuscateFramesWithoutLineRange) {
 
   delete g_redex;
 }
+
+TEST(ProguardMapTest, ParsesLargeMapsInChunks) {
+  // Large enough to be parsed in several chunks. The members of the first
+  // class refer to the last one, which another chunk maps.
+  const size_t num_classes = 50000;
+  std::ostringstream map;
+  auto cls = [](size_t i) { return "com.foo.Class" + std::to_string(i); };
+  for (size_t i = 0; i < num_classes; ++i) {
+    map << cls(i) << " -> a" << i << ":\n"
+        << "    " << cls(num_classes - 1 - i) << " field -> f\n"
+        << "    1:1:void method(" << cls(num_classes - 1 - i) << ") -> m\n";
+  }
+  // Like parsing the map line by line, the last mapping of a member wins.
+  map << cls(0) << " -> a0:\n"
+      << "    int field -> g\n"
+      << "    int field -> h\n";
+  std::stringstream ss(map.str());
+  ProguardMap pm(ss);
+
+  auto last = num_classes - 1;
+  EXPECT_EQ("La" + std::to_string(last) + ";",
+            pm.translate_class("Lcom/foo/Class" + std::to_string(last) + ";"));
+  EXPECT_EQ("La0;.f:La" + std::to_string(last) + ";",
+            pm.translate_field("Lcom/foo/Class0;.field:Lcom/foo/Class" +
+                               std::to_string(last) + ";"));
+  EXPECT_EQ("La" + std::to_string(last) + ";.m:(La0;)V",
+            pm.translate_method("Lcom/foo/Class" + std::to_string(last) +
+                                ";.method:(Lcom/foo/Class0;)V"));
+  EXPECT_EQ("Lcom/foo/Class0;.field:I", pm.deobfuscate_field("La0;.h:I"));
+  EXPECT_EQ("La0;.h:I", pm.translate_field("Lcom/foo/Class0;.field:I"));
+  EXPECT_THAT(pm.method_lines("La0;.m:(La" + std::to_string(last) + ";)V"),
+              SizeIs(1));
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "Creators.h"
+#include "ProguardMatcher.h"
+#include "ProguardParser.h"
+#include "RedexTest.h"
+
+class ProguardMatcherTest : public RedexTest {};
+
+namespace {
+
+DexClass* create_class(const std::string& name,
+                       const std::vector<std::string>& fields) {
+  auto type = DexType::make_type(name.c_str());
+  ClassCreator creator(type);
+  creator.set_super(get_object_type());
+  for (const auto& field : fields) {
+    auto f = static_cast<DexField*>(
+        DexField::make_field(name + "." + field + ":I"));
+    f->make_concrete(ACC_PUBLIC);
+    f->set_deobfuscated_name(show(f));
+    creator.add_field(f);
+  }
+  auto cls = creator.create();
+  cls->set_deobfuscated_name(name);
+  return cls;
+}
+
+} // namespace
+
+TEST_F(ProguardMatcherTest, rulesShareClassMatches) {
+  auto a = create_class("Lcom/foo/A;", {"a", "c"});
+  auto b = create_class("Lcom/foo/B;", {});
+  auto other = create_class("Lcom/bar/C;", {});
+  Scope scope{a, b, other};
+
+  std::istringstream config(R"(
+    -keep class com.foo.** { int a; }
+    -keep class com.foo.** { int c; }
+    -keepclassmembers class com.foo.A { int a; int c; }
+    -keepclassmembers class com.foo.A { int c; int a; }
+  )");
+  redex::ProguardConfiguration pg_config;
+  redex::proguard_parser::parse(config, &pg_config);
+  ASSERT_TRUE(pg_config.ok);
+  ASSERT_EQ(4, pg_config.keep_rules.size());
+
+  std::istringstream no_map;
+  ProguardMap pg_map(no_map);
+  auto stats = redex::process_proguard_rules(pg_map, scope, {}, pg_config,
+                                             false);
+  EXPECT_EQ(1, stats.duplicate_rules);
+  EXPECT_EQ(2, stats.class_matches);
+  EXPECT_EQ(1, stats.cached_class_matches);
+  // The second com.foo.** rule didn't test A and B again.
+  EXPECT_EQ(2, stats.classes_not_retested);
+
+  EXPECT_TRUE(a->rstate.has_keep());
+  EXPECT_TRUE(b->rstate.has_keep());
+  EXPECT_FALSE(other->rstate.has_keep());
+  for (auto field : a->get_ifields()) {
+    EXPECT_TRUE(field->rstate.has_keep()) << show(field);
+  }
+
+  const auto& rules = pg_config.keep_rules.elements();
+  EXPECT_EQ(2, rules[0]->count);
+  EXPECT_EQ(2, rules[1]->count);
+  EXPECT_EQ(1, rules[2]->count);
+  // The duplicate rule gets the counts of the rule that was applied.
+  EXPECT_EQ(1, rules[3]->count);
+}
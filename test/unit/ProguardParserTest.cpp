@@ -7,6 +7,8 @@
 
 #include <gtest/gtest.h>
 
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <istream>
 #include <vector>
 
@@ -59,6 +61,36 @@ TEST(ProguardParserTest, include) {
   ASSERT_EQ(config.includes[2], "gamma.txt");
 }
 
+// Included files are parsed breadth first, in the order they are included.
+TEST(ProguardParserTest, includedFilesInOrder) {
+  auto dir = boost::filesystem::temp_directory_path() /
+             boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+  auto write = [&](const std::string& name, const std::string& contents) {
+    std::ofstream((dir / name).string()) << contents;
+  };
+  auto include = [&](const std::string& name) {
+    return "-include " + (dir / name).string() + "\n";
+  };
+  write("root.pro",
+        include("a.pro") + include("b.pro") + "-keep class Root\n");
+  write("a.pro", include("a1.pro") + include("b.pro") + "-keep class A\n");
+  write("b.pro", include("b1.pro") + "-keep class B\n");
+  write("a1.pro", "-keep class A1\n");
+  write("b1.pro", "-keep class B1\n");
+
+  ProguardConfiguration config;
+  proguard_parser::parse_file((dir / "root.pro").string(), &config);
+  ASSERT_TRUE(config.ok);
+  std::vector<std::string> classes;
+  for (const auto& keep : config.keep_rules) {
+    classes.push_back(keep->class_spec.className);
+  }
+  EXPECT_EQ((std::vector<std::string>{"Root", "A", "B", "A1", "B1"}),
+            classes);
+  boost::filesystem::remove_all(dir);
+}
+
 // Parse basedirectory
 TEST(ProguardParserTest, basedirectory) {
   ProguardConfiguration config;
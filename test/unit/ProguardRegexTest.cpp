@@ -270,3 +270,75 @@ TEST(ProguardRegexTest, types) {
     EXPECT_EQ("Lalpha/**/beta;", descriptor);
   }
 }
+
+// The DFA has to agree with the boost::regex we would otherwise build.
+TEST(ProguardRegexTest, wildcardMatcherAgreesWithRegex) {
+  std::vector<std::string> type_patterns = {
+      "",       "L*;",       "L**;",   "Lcom/foo/*;",    "Lcom/**/Bar;",
+      "%",      "***",       "...",    "[I",             "(...)V",
+      "(I...)V", "(***)V",   "L**$*;", "Lcom/*/a?b**c;", "Lfoo.bar;"};
+  std::vector<std::string> types = {"",
+                                    "I",
+                                    "V",
+                                    "[I",
+                                    "[[I",
+                                    "Lcom/foo/Bar;",
+                                    "Lcom/a/b/Bar;",
+                                    "Lcom/foo/Bar$Inner;",
+                                    "[Lcom/foo/Bar;",
+                                    "()V",
+                                    "(I)V",
+                                    "(II)V",
+                                    "(Ljava/lang/String;I)V",
+                                    "([I)V",
+                                    "(J)Lcom/foo/Bar;",
+                                    "Lcom/x/aXbYYc;",
+                                    "Lcom/x/y/aXbc;",
+                                    "Lfooxbar;"};
+  for (const auto& pattern : type_patterns) {
+    auto matcher = proguard_parser::WildcardMatcher::for_type(pattern);
+    ASSERT_NE(nullptr, matcher) << pattern;
+    boost::regex rx(proguard_parser::form_type_regex(pattern));
+    for (const auto& type : types) {
+      EXPECT_EQ(boost::regex_match(type, rx), matcher->matches(type))
+          << pattern << " vs " << type;
+    }
+  }
+
+  std::vector<std::string> names = {"", "*", "get*", "?et", "<init>", "a.b"};
+  std::vector<std::string> descriptors = {"", "()V", "(...)V", "I", "***"};
+  std::vector<std::string> members = {
+      "get:()V",    "set:(I)V",       "<init>:()V", "a.b:I",
+      "axb:I",      "getFoo:(Lx;)V",  "get:I",      "bet:(I)Lfoo;"};
+  for (const auto& name : names) {
+    for (const auto& descriptor : descriptors) {
+      auto matcher =
+          proguard_parser::WildcardMatcher::for_member(name, descriptor);
+      ASSERT_NE(nullptr, matcher) << name << ":" << descriptor;
+      boost::regex rx(proguard_parser::form_member_regex(name) + "\\:" +
+                      proguard_parser::form_type_regex(descriptor));
+      for (const auto& member : members) {
+        EXPECT_EQ(boost::regex_match(member, rx), matcher->matches(member))
+            << name << ":" << descriptor << " vs " << member;
+      }
+    }
+  }
+}
+
+TEST(ProguardRegexTest, wildcardMatcherIsShared) {
+  auto matcher = proguard_parser::WildcardMatcher::for_type("Lcom/**;");
+  EXPECT_EQ(matcher, proguard_parser::WildcardMatcher::for_type("Lcom/**;"));
+  EXPECT_NE(matcher, proguard_parser::WildcardMatcher::for_type("Lcom/*;"));
+  // Only the rest of the string is looked at.
+  const char* name = "Lcom/foo/Bar;.field:I";
+  EXPECT_TRUE(matcher->matches(name, name + strlen("Lcom/foo/Bar;")));
+  EXPECT_FALSE(matcher->matches(name));
+}
+
+TEST(ProguardRegexTest, wildcardMatcherRejectsRegexSyntax) {
+  // form_member_regex passes these through as regex syntax; leave them to
+  // boost.
+  EXPECT_EQ(nullptr, proguard_parser::WildcardMatcher::for_member("a$", ""));
+  EXPECT_EQ(nullptr, proguard_parser::WildcardMatcher::for_member("a|b", ""));
+  EXPECT_EQ(nullptr, proguard_parser::WildcardMatcher::for_type("La|b;"));
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Debug.h"
+#include "MutablePriorityQueue.h"
+#include "RadixPriorityQueue.h"
+
+//==========
+// Replays the queue operations of a cross-dex-ref-minimizing emission on
+// MutablePriorityQueue and RadixPriorityQueue.
+//==========
+
+namespace {
+
+enum class Op { INSERT, ERASE, UPDATE };
+
+struct Event {
+  Op op;
+  uint32_t cls;
+  uint64_t priority;
+};
+
+/*
+ * Record the trace of a simplified emission: every class has a few refs out
+ * of a shared pool, and emitting a class bumps the priority of every
+ * remaining class that shares one of its refs. The low 24 bits of each
+ * priority are the class index, as in CrossDexRefMinimizer.
+ */
+std::vector<Event> record_trace(uint32_t num_classes, uint32_t num_refs) {
+  std::mt19937 gen(0);
+  std::vector<std::vector<uint32_t>> class_refs(num_classes);
+  std::vector<std::unordered_set<uint32_t>> ref_classes(num_refs);
+  std::vector<uint64_t> applied(num_classes, 0);
+  auto priority = [&](uint32_t cls) {
+    return (applied[cls] << 24) | (0xFFFFFF - cls);
+  };
+
+  std::vector<Event> trace;
+  MutablePriorityQueue<uint32_t, uint64_t> queue;
+  for (uint32_t cls = 0; cls < num_classes; ++cls) {
+    for (size_t i = 0; i < 16; ++i) {
+      // Skew towards low ref ids so that some refs are shared widely.
+      auto ref = std::min(gen() % num_refs, gen() % num_refs);
+      class_refs[cls].push_back(ref);
+      ref_classes[ref].insert(cls);
+    }
+    trace.push_back({Op::INSERT, cls, priority(cls)});
+    queue.insert(cls, priority(cls));
+  }
+  std::vector<bool> applied_refs(num_refs, false);
+  while (!queue.empty()) {
+    auto cls = queue.front();
+    trace.push_back({Op::ERASE, cls, 0});
+    queue.erase(cls);
+    std::unordered_set<uint32_t> affected;
+    for (auto ref : class_refs[cls]) {
+      ref_classes[ref].erase(cls);
+      if (applied_refs[ref]) {
+        continue;
+      }
+      applied_refs[ref] = true;
+      for (auto other : ref_classes[ref]) {
+        ++applied[other];
+        affected.insert(other);
+      }
+    }
+    for (auto other : affected) {
+      trace.push_back({Op::UPDATE, other, priority(other)});
+      queue.update_priority(other, priority(other));
+    }
+  }
+  return trace;
+}
+
+template <class Queue>
+double replay(const std::vector<Event>& trace, uint64_t* checksum) {
+  auto start = std::chrono::high_resolution_clock::now();
+  Queue queue;
+  for (const auto& event : trace) {
+    switch (event.op) {
+    case Op::INSERT:
+      queue.insert(event.cls, event.priority);
+      break;
+    case Op::ERASE:
+      *checksum = *checksum * 31 + queue.front();
+      queue.erase(event.cls);
+      break;
+    case Op::UPDATE:
+      queue.update_priority(event.cls, event.priority);
+      break;
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+int main() {
+  auto trace = record_trace(/* num_classes */ 200000, /* num_refs */ 400000);
+  printf("Replaying %zu events\n", trace.size());
+
+  uint64_t map_checksum = 0;
+  double map_ms =
+      replay<MutablePriorityQueue<uint32_t, uint64_t>>(trace, &map_checksum);
+  printf("MutablePriorityQueue: %.1f ms\n", map_ms);
+
+  uint64_t radix_checksum = 0;
+  double radix_ms =
+      replay<RadixPriorityQueue<uint32_t, uint64_t>>(trace, &radix_checksum);
+  printf("RadixPriorityQueue: %.1f ms\n", radix_ms);
+
+  redex_assert(map_checksum == radix_checksum);
+  printf("speedup: %f\n", map_ms / radix_ms);
+}
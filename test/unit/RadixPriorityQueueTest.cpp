@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <unordered_map>
+
+#include "Debug.h"
+#include "MutablePriorityQueue.h"
+#include "RadixPriorityQueue.h"
+
+TEST(RadixPriorityQueueTest, basicOperations) {
+  RadixPriorityQueue<int, uint64_t> queue;
+  EXPECT_TRUE(queue.empty());
+
+  queue.insert(1, 10);
+  queue.insert(2, std::numeric_limits<uint64_t>::max());
+  queue.insert(3, 0);
+  EXPECT_FALSE(queue.empty());
+  EXPECT_EQ(queue.front(), 2);
+
+  queue.update_priority(2, 5);
+  EXPECT_EQ(queue.front(), 1);
+  queue.update_priority(3, 11);
+  EXPECT_EQ(queue.front(), 3);
+
+  queue.erase(3);
+  EXPECT_EQ(queue.front(), 1);
+  queue.erase(1);
+  EXPECT_EQ(queue.front(), 2);
+  queue.erase(2);
+  EXPECT_TRUE(queue.empty());
+
+  queue.insert(4, 1);
+  queue.clear();
+  EXPECT_TRUE(queue.empty());
+  queue.insert(4, 1);
+  EXPECT_EQ(queue.front(), 4);
+}
+
+TEST(RadixPriorityQueueTest, agreesWithMutablePriorityQueue) {
+  RadixPriorityQueue<uint32_t, uint64_t> radix;
+  MutablePriorityQueue<uint32_t, uint64_t> reference;
+  std::unordered_map<uint32_t, uint64_t> present;
+  std::unordered_map<uint64_t, uint32_t> used_priorities;
+
+  std::mt19937_64 gen(0);
+  auto fresh_priority = [&]() {
+    while (true) {
+      // Cluster most priorities so that they share buckets.
+      uint64_t priority = gen() % 2 ? gen() : gen() % 4096;
+      if (!used_priorities.count(priority)) {
+        return priority;
+      }
+    }
+  };
+
+  for (uint32_t step = 0; step < 20000; ++step) {
+    auto op = gen() % 4;
+    if (op == 0 || present.empty()) {
+      auto priority = fresh_priority();
+      radix.insert(step, priority);
+      reference.insert(step, priority);
+      present.emplace(step, priority);
+      used_priorities.emplace(priority, step);
+    } else {
+      auto value = reference.front();
+      if (op == 1) {
+        radix.erase(value);
+        reference.erase(value);
+        used_priorities.erase(present.at(value));
+        present.erase(value);
+      } else {
+        auto priority = fresh_priority();
+        radix.update_priority(value, priority);
+        reference.update_priority(value, priority);
+        used_priorities.erase(present.at(value));
+        present[value] = priority;
+        used_priorities.emplace(priority, value);
+      }
+    }
+    ASSERT_EQ(radix.empty(), reference.empty());
+    if (!reference.empty()) {
+      ASSERT_EQ(radix.front(), reference.front());
+    }
+  }
+}
@@ -336,3 +336,77 @@ TEST_F(ReduceArrayLiteralsTest, conditional_escape) {
   const auto& expected_str = code_str;
   test(code_str, expected_str, 0, 0);
 }
+
+TEST_F(ReduceArrayLiteralsTest, fill_array_data) {
+  // constant primitive arrays of any length are filled from a payload
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 3)
+      (new-array v0 "[S")
+      (move-result-pseudo-object v1)
+      (const v0 0)
+      (const v2 1)
+      (aput-short v2 v1 v0)
+      (const v0 1)
+      (const v2 -2)
+      (aput-short v2 v1 v0)
+      (const v0 2)
+      (const v2 770)
+      (aput-short v2 v1 v0)
+      (return-object v1)
+    )
+  )");
+
+  code->build_cfg(/* editable */ true);
+  ReduceArrayLiterals ral(code->cfg(), /* max_filled_elements */ 222,
+                          /* min_sdk */ 19, Architecture::UNKNOWN,
+                          /* fill_array_data */ true);
+  ral.patch();
+  code->clear_cfg();
+  const auto& stats = ral.get_stats();
+  EXPECT_EQ(stats.filled_array_data_arrays, 1);
+  EXPECT_EQ(stats.filled_array_data_elements, 3);
+  EXPECT_EQ(stats.remaining_unimplemented_arrays, 0);
+
+  IRInstruction* fill_insn = nullptr;
+  for (const auto& mie : InstructionIterable(code.get())) {
+    EXPECT_FALSE(is_aput(mie.insn->opcode()));
+    if (mie.insn->opcode() == OPCODE_FILL_ARRAY_DATA) {
+      fill_insn = mie.insn;
+    }
+  }
+  ASSERT_NE(fill_insn, nullptr);
+  EXPECT_EQ(fill_insn->src(0), 1);
+  auto data = fill_insn->get_data();
+  std::vector<uint16_t> payload(data->data(),
+                                data->data() + data->data_size());
+  // element width, element count, elements
+  EXPECT_EQ(payload, std::vector<uint16_t>({2, 3, 0, 1, 0xfffe, 0x302}));
+}
+
+TEST_F(ReduceArrayLiteralsTest, fill_array_data_non_constant) {
+  // arrays of values that aren't known fall back to filled-new-array
+  auto code_str = R"(
+    (
+      (load-param v3)
+      (const v0 2)
+      (new-array v0 "[I")
+      (move-result-pseudo-object v1)
+      (const v0 0)
+      (const v2 1)
+      (aput v2 v1 v0)
+      (const v0 1)
+      (aput v3 v1 v0)
+      (return-object v1)
+    )
+  )";
+  auto code = assembler::ircode_from_string(code_str);
+  code->build_cfg(/* editable */ true);
+  ReduceArrayLiterals ral(code->cfg(), /* max_filled_elements */ 222,
+                          /* min_sdk */ 19, Architecture::UNKNOWN,
+                          /* fill_array_data */ true);
+  ral.patch();
+  code->clear_cfg();
+  EXPECT_EQ(ral.get_stats().filled_array_data_arrays, 0);
+  EXPECT_EQ(ral.get_stats().filled_arrays, 1);
+}
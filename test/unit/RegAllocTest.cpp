@@ -374,6 +374,39 @@ TEST_F(RegAllocTest, CombineAdjacentNodes) {
   EXPECT_FALSE(ig.get_node(2).is_active());
 }
 
+TEST_F(RegAllocTest, AdjacencyBeyondMatrix) {
+  using namespace interference::impl;
+  // Registers past AdjacencyMatrix::MAX_REGS are only tracked by the
+  // adjacency lists.
+  constexpr reg_t big = AdjacencyMatrix::MAX_REGS;
+  auto ig = GraphBuilder::create_empty();
+  GraphBuilder::make_node(&ig, 0, RegisterType::WIDE, /* max_vreg */ 3);
+  GraphBuilder::make_node(&ig, 1, RegisterType::NORMAL, /* max_vreg */ 3);
+  GraphBuilder::make_node(&ig, big, RegisterType::WIDE, /* max_vreg */ 3);
+  GraphBuilder::make_node(&ig, big + 1, RegisterType::NORMAL, /* max_vreg */ 3);
+  GraphBuilder::add_edge(&ig, big + 1, 1);
+  GraphBuilder::add_edge(&ig, big + 1, 0);
+  ig.add_coalesceable_edge(big, 0);
+  EXPECT_EQ(ig.get_node(big + 1).adjacent(), std::vector<reg_t>({0, 1}));
+  EXPECT_TRUE(ig.is_adjacent(1, big + 1));
+  EXPECT_TRUE(ig.is_adjacent(big + 1, 0));
+  EXPECT_FALSE(ig.is_adjacent(big, big + 1));
+  EXPECT_FALSE(ig.is_adjacent(1, 0));
+  EXPECT_TRUE(ig.is_adjacent(0, big));
+  EXPECT_TRUE(ig.is_coalesceable(0, big));
+  EXPECT_FALSE(ig.is_coalesceable(0, big + 1));
+
+  // Adding a non-coalesceable edge over a coalesceable one makes it
+  // non-coalesceable.
+  GraphBuilder::add_edge(&ig, 0, big);
+  EXPECT_FALSE(ig.is_coalesceable(big, 0));
+
+  ig.combine(big, 1);
+  EXPECT_TRUE(ig.is_adjacent(big, big + 1));
+  EXPECT_EQ(ig.get_node(big).adjacent(), std::vector<reg_t>({0, big + 1}));
+  EXPECT_FALSE(ig.get_node(1).is_active());
+}
+
 TEST_F(RegAllocTest, Coalesce) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -626,7 +659,7 @@ TEST_F(RegAllocTest, SelectAliasedRange) {
   auto expected_code = assembler::ircode_from_string(R"(
     (
      (const v0 0)
-     (move v1 v0)
+     (const v1 0)
      (invoke-static (v0 v1) "Lfoo;.baz:(II)V")
      (return-void)
     )
@@ -763,7 +796,7 @@ TEST_F(RegAllocTest, NoSpillSingleArgInvokes) {
   auto expected_code = assembler::ircode_from_string(R"(
     (
      (const v0 0)
-     (move v2 v0)
+     (const v2 0)
      (neg-int v1 v2)
      (invoke-static (v0) "Lfoo;.baz:(I)V")
      (return-void)
@@ -773,6 +806,53 @@ TEST_F(RegAllocTest, NoSpillSingleArgInvokes) {
             assembler::to_s_expr(expected_code.get()));
 }
 
+TEST_F(RegAllocTest, RematerializeConst) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 1)
+     (const v1 74565) ; too large to load in two code units
+     (neg-int v2 v0)
+     (neg-int v3 v1)
+     (add-int v4 v2 v3)
+     (return v4)
+    )
+)");
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  LivenessFixpointIterator fixpoint_iter(cfg);
+  fixpoint_iter.run(LivenessDomain());
+
+  RangeSet range_set;
+  interference::Graph ig = interference::build_graph(
+      fixpoint_iter, code.get(), code->get_registers_size(), range_set);
+
+  graph_coloring::SpillPlan spill_plan;
+  spill_plan.global_spills = std::unordered_map<reg_t, reg_t>{
+      {0, 16},
+      {1, 16},
+  };
+  graph_coloring::Allocator allocator;
+  allocator.spill(ig, spill_plan, range_set, code.get());
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v1 74565)
+     (const v5 1)
+     (neg-int v2 v5)
+     (move v6 v1)
+     (neg-int v3 v6)
+     (add-int v4 v2 v3)
+     (return v4)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+  EXPECT_EQ(allocator.get_stats().consts_rematerialized, 1);
+  EXPECT_EQ(allocator.get_stats().consts_removed, 1);
+  EXPECT_EQ(allocator.get_stats().global_spill_moves, 1);
+}
+
 TEST_F(RegAllocTest, ContainmentGraph) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -1008,3 +1088,97 @@ TEST_F(RegAllocTest, NoOverwriteThis) {
             assembler::to_s_expr(expected_code.get()))
       << show(code);
 }
+
+TEST_F(RegAllocTest, LinearScanFallback) {
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo;.baz:(I)I"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, /* is_virtual */ false);
+  method->set_code(assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 1)
+     (add-int v2 v0 v1)
+     (return v2)
+    )
+)"));
+  auto code = method->get_code();
+  code->set_registers_size(3);
+  code->build_cfg(/* editable */ false);
+
+  graph_coloring::Allocator::Config config;
+  config.linear_scan_insn_threshold = 0;
+  graph_coloring::Allocator allocator(config);
+  allocator.allocate(method);
+
+  const auto& stats = allocator.get_stats();
+  EXPECT_THAT(stats.linear_scan_methods, ::testing::ElementsAre(method));
+  EXPECT_EQ(stats.linear_scan_moves, 0);
+  // The three scratch registers needed by add-int come first, then v1 and v2
+  // whose live ranges overlap, then the parameter.
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (load-param v5)
+     (const v3 1)
+     (add-int v4 v5 v3)
+     (return v4)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code),
+            assembler::to_s_expr(expected_code.get()))
+      << show(code);
+  EXPECT_EQ(code->get_registers_size(), 6);
+}
+
+TEST_F(RegAllocTest, LinearScanEncodesOperands) {
+  auto method =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo;.qux:(J)V"));
+  method->make_concrete(ACC_PUBLIC | ACC_STATIC, /* is_virtual */ false);
+  // Keep more registers live than a 4-bit operand can address. The last ones
+  // need to go through scratch registers, including for the invoke, which can
+  // only use the non-range form if all its arguments are below v16.
+  const size_t num_consts = 24;
+  std::string body = "(load-param-wide v0)\n";
+  for (size_t i = 1; i <= num_consts; ++i) {
+    body += "(const v" + std::to_string(1 + i) + " " + std::to_string(i) +
+            ")\n";
+  }
+  body += "(invoke-static (v0 v25) \"LFoo;.bar:(JI)V\")\n";
+  for (size_t i = 1; i <= num_consts; ++i) {
+    body += "(add-int/lit8 v" + std::to_string(1 + i) + " v" +
+            std::to_string(1 + i) + " 1)\n";
+    body += "(neg-int v26 v" + std::to_string(1 + i) + ")\n";
+  }
+  body += "(return-void)\n";
+  method->set_code(assembler::ircode_from_string("(" + body + ")"));
+  auto code = method->get_code();
+  code->set_registers_size(27);
+  code->build_cfg(/* editable */ false);
+
+  graph_coloring::Allocator::Config config;
+  config.linear_scan_insn_threshold = 0;
+  graph_coloring::Allocator allocator(config);
+  allocator.allocate(method);
+  EXPECT_EQ(allocator.get_stats().linear_scan_methods.size(), 1);
+  EXPECT_GT(allocator.get_stats().linear_scan_moves, 0);
+
+  for (auto it = code->begin(); it != code->end(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = it->insn;
+    if (insn->dests_size()) {
+      EXPECT_LE(insn->dest(),
+                max_unsigned_value(interference::dest_bit_width(it)))
+          << show(insn);
+    }
+    for (size_t i = 0; i < insn->srcs_size(); ++i) {
+      EXPECT_LE(insn->src(i),
+                interference::max_value_for_src(
+                    insn, i, insn->src_is_wide(i)))
+          << show(insn);
+    }
+  }
+  // The parameter keeps the last registers of the frame.
+  auto param = code->get_param_instructions().begin()->insn;
+  EXPECT_EQ(param->dest() + 2, code->get_registers_size());
+}
@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "RemoveBuildersHelper.h"
+
+class RemoveBuildersHelperTest : public RedexTest {
+ public:
+  void SetUp() override {
+    for (const char* name : {"LFoo$Builder;", "LBar$Builder;"}) {
+      auto type = DexType::make_type(name);
+      ClassCreator creator(type);
+      creator.set_super(get_object_type());
+      creator.add_method(assembler::method_from_string(
+          std::string("(method (public constructor) \"") + name +
+          ".<init>:()V\" ((load-param-object v0) (return-void)))"));
+      creator.add_method(assembler::method_from_string(
+          std::string("(method (public) \"") + name + ".setX:(I)" + name +
+          "\" ((load-param-object v0) (load-param v1) (return-object v0)))"));
+      creator.create();
+      m_builders.emplace(type);
+    }
+  }
+
+  std::unordered_set<DexType*> escaped_builders(const std::string& code) {
+    auto method = assembler::method_from_string(code);
+    return get_escaped_builders(method, m_builders);
+  }
+
+  std::unordered_set<DexType*> m_builders;
+};
+
+TEST_F(RemoveBuildersHelperTest, ownMethodsDontEscape) {
+  auto escaped = escaped_builders(R"(
+    (method (public static) "LUser;.use:()V"
+      (
+        (new-instance "LFoo$Builder;")
+        (move-result-pseudo-object v0)
+        (invoke-direct (v0) "LFoo$Builder;.<init>:()V")
+        (const v1 1)
+        (invoke-virtual (v0 v1) "LFoo$Builder;.setX:(I)LFoo$Builder;")
+        (move-result-object v0)
+        (return-void)
+      )
+    )
+  )");
+  EXPECT_TRUE(escaped.empty());
+}
+
+TEST_F(RemoveBuildersHelperTest, onlyTheEscapingBuilders) {
+  auto bar = DexType::get_type("LBar$Builder;");
+  auto escaped = escaped_builders(R"(
+    (method (public static) "LUser;.use:()V"
+      (
+        (new-instance "LFoo$Builder;")
+        (move-result-pseudo-object v0)
+        (invoke-direct (v0) "LFoo$Builder;.<init>:()V")
+        (new-instance "LBar$Builder;")
+        (move-result-pseudo-object v1)
+        (invoke-direct (v1) "LBar$Builder;.<init>:()V")
+        (const v2 1)
+        (invoke-virtual (v1 v2) "LBar$Builder;.setX:(I)LBar$Builder;")
+        (move-result-object v1)
+        (sput-object v1 "LUser;.bar:LBar$Builder;")
+        (return-void)
+      )
+    )
+  )");
+  EXPECT_EQ(std::unordered_set<DexType*>{bar}, escaped);
+}
+
+TEST_F(RemoveBuildersHelperTest, returnedFromAnotherClass) {
+  auto foo = DexType::get_type("LFoo$Builder;");
+  auto escaped = escaped_builders(R"(
+    (method (public static) "LUser;.make:()LFoo$Builder;"
+      (
+        (new-instance "LFoo$Builder;")
+        (move-result-pseudo-object v0)
+        (invoke-direct (v0) "LFoo$Builder;.<init>:()V")
+        (return-object v0)
+      )
+    )
+  )");
+  EXPECT_EQ(std::unordered_set<DexType*>{foo}, escaped);
+}
+
+TEST_F(RemoveBuildersHelperTest, passedToAnotherMethod) {
+  auto foo = DexType::get_type("LFoo$Builder;");
+  auto escaped = escaped_builders(R"(
+    (method (public static) "LUser;.use:()V"
+      (
+        (new-instance "LFoo$Builder;")
+        (move-result-pseudo-object v0)
+        (invoke-direct (v0) "LFoo$Builder;.<init>:()V")
+        (invoke-static (v0) "LFoo$Builder;.consume:(LFoo$Builder;)V")
+        (return-void)
+      )
+    )
+  )");
+  // Like before, an invoke that can't be resolved doesn't count.
+  EXPECT_TRUE(escaped.empty());
+
+  auto consume = assembler::method_from_string(R"(
+    (method (public static) "LFoo$Builder;.consume:(LFoo$Builder;)V"
+      ((return-void))
+    )
+  )");
+  type_class(foo)->add_method(consume);
+  escaped = escaped_builders(R"(
+    (method (public static) "LUser;.use2:()V"
+      (
+        (new-instance "LFoo$Builder;")
+        (move-result-pseudo-object v0)
+        (invoke-direct (v0) "LFoo$Builder;.<init>:()V")
+        (invoke-static (v0) "LFoo$Builder;.consume:(LFoo$Builder;)V")
+        (return-void)
+      )
+    )
+  )");
+  EXPECT_EQ(std::unordered_set<DexType*>{foo}, escaped);
+}
@@ -210,3 +210,26 @@ TEST(ResolveField, empty) {
 
   delete g_redex;
 }
+
+TEST(ResolveField, cachedResolutionSeesNewMembers) {
+  g_redex = new RedexContext();
+  create_scope();
+
+  auto int_t = DexType::get_type("I");
+  DexFieldRef* fdef = DexField::get_field(DexType::get_type("A"),
+      DexString::get_string("f1"), int_t);
+  DexFieldRef* fref = make_field_ref(DexType::get_type("C"), "f1", int_t);
+  EXPECT_TRUE(resolve_field(fref) == fdef);
+  // Hits the memoized resolution.
+  EXPECT_TRUE(resolve_field(fref) == fdef);
+
+  // A field in B now shadows A.f1.
+  auto shadow = make_field_def(DexType::get_type("B"), "f1", int_t);
+  type_class(DexType::get_type("B"))->add_field(shadow);
+  EXPECT_TRUE(resolve_field(fref) == shadow);
+
+  type_class(DexType::get_type("B"))->remove_field(shadow);
+  EXPECT_TRUE(resolve_field(fref) == fdef);
+
+  delete g_redex;
+}
@@ -6,6 +6,7 @@
  */
 
 #include <array>
+#include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
 
 #include "Debug.h"
@@ -287,3 +288,66 @@ TEST(ResTable, AppendNewType) {
 
   unmap_and_close(file_descriptor, fp, length);
 }
+
+namespace {
+
+bool is_reference(const android::Res_value& value) {
+  return value.dataType == android::Res_value::TYPE_REFERENCE ||
+         value.dataType == android::Res_value::TYPE_ATTRIBUTE;
+}
+
+// The values of all resources, in the order of their ids.
+std::vector<android::Res_value> all_values(const std::string& arsc_path) {
+  size_t length;
+  int file_descriptor;
+  auto fp = map_file(arsc_path.c_str(), &file_descriptor, &length);
+  android::ResTable table;
+  always_assert(table.add(fp, length) == 0);
+  android::SortedVector<uint32_t> res_ids;
+  table.getResourceIds(&res_ids);
+  std::vector<android::Res_value> result;
+  for (size_t i = 0; i < res_ids.size(); i++) {
+    android::Vector<android::Res_value> values;
+    table.getAllValuesForResource(res_ids[i], values);
+    for (size_t j = 0; j < values.size(); j++) {
+      result.push_back(values[j]);
+    }
+  }
+  unmap_and_close(file_descriptor, fp, length);
+  return result;
+}
+
+} // namespace
+
+TEST(ResTable, RemapReferenceValuesInPlace) {
+  // The file gets edited, so work on a copy.
+  auto tmp_path = boost::filesystem::temp_directory_path() /
+                  boost::filesystem::unique_path("%%%%-%%%%.arsc");
+  boost::filesystem::copy_file(std::getenv("test_arsc_path"), tmp_path);
+  auto arsc_path = tmp_path.string();
+  auto original_size = boost::filesystem::file_size(tmp_path);
+
+  auto before = all_values(arsc_path);
+  std::map<uint32_t, uint32_t> kept_to_remapped_ids;
+  for (const auto& value : before) {
+    if (is_reference(value) && value.data > 0x7f000000) {
+      kept_to_remapped_ids[value.data] = value.data + 0x100;
+    }
+  }
+  ASSERT_FALSE(kept_to_remapped_ids.empty());
+  remap_arsc_reference_values(arsc_path, kept_to_remapped_ids);
+
+  EXPECT_EQ(boost::filesystem::file_size(tmp_path), original_size);
+  auto after = all_values(arsc_path);
+  ASSERT_EQ(before.size(), after.size());
+  for (size_t i = 0; i < before.size(); i++) {
+    EXPECT_EQ(before[i].dataType, after[i].dataType);
+    auto it = kept_to_remapped_ids.find(before[i].data);
+    if (is_reference(before[i]) && it != kept_to_remapped_ids.end()) {
+      EXPECT_EQ(after[i].data, it->second);
+    } else {
+      EXPECT_EQ(after[i].data, before[i].data);
+    }
+  }
+  boost::filesystem::remove(tmp_path);
+}
@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+#include "SSA.h"
+
+using namespace ssa;
+
+class SSATest : public RedexTest {};
+
+namespace {
+
+IRInstruction* find_insn(cfg::ControlFlowGraph& cfg, IROpcode op) {
+  for (auto* block : cfg.blocks()) {
+    for (auto& mie : InstructionIterable(block)) {
+      if (mie.insn->opcode() == op) {
+        return mie.insn;
+      }
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST_F(SSATest, diamondMergesDefinitions) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (if-eqz v0 :else)
+      (const v1 1)
+      (goto :join)
+      (:else)
+      (const v1 2)
+      (:join)
+      (return v1)
+    )
+  )");
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  SSAForm form(cfg);
+  EXPECT_EQ(4, form.num_registers());
+  EXPECT_EQ(2, form.result_register());
+
+  auto* ret = find_insn(cfg, OPCODE_RETURN);
+  cfg::Block* join = nullptr;
+  for (auto* block : cfg.blocks()) {
+    if (block->get_last_insn()->insn == ret) {
+      join = block;
+    }
+  }
+  ASSERT_NE(nullptr, join);
+  const auto& phis = form.phis(join);
+  ASSERT_EQ(1, phis.size());
+  EXPECT_EQ(1, phis[0].reg);
+  EXPECT_EQ(&phis[0], &form.phi(phis[0].value));
+  ASSERT_EQ(2, phis[0].operands.size());
+  for (const auto& operand : phis[0].operands) {
+    const auto& def = form.definition(operand.second);
+    EXPECT_EQ(SSAForm::Definition::INSN, def.kind);
+    EXPECT_EQ(OPCODE_CONST, def.insn->opcode());
+    EXPECT_EQ(form.def(def.insn), operand.second);
+  }
+  EXPECT_NE(phis[0].operands[0].second, phis[0].operands[1].second);
+  EXPECT_EQ(std::vector<ValueId>{phis[0].value}, form.uses(ret));
+
+  // v0 is never written, so the branch reads its entry value.
+  auto* branch = find_insn(cfg, OPCODE_IF_EQZ);
+  EXPECT_EQ(std::vector<ValueId>{0}, form.uses(branch));
+  EXPECT_EQ(SSAForm::Definition::ENTRY, form.definition(0).kind);
+}
+
+TEST_F(SSATest, loopAndResultRegister) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (const v0 0)
+      (:loop)
+      (invoke-static (v0) "LFoo;.bar:(I)I")
+      (move-result v1)
+      (if-eqz v1 :end)
+      (add-int/lit8 v0 v0 1)
+      (goto :loop)
+      (:end)
+      (return v0)
+    )
+  )");
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  SSAForm form(cfg);
+
+  auto* invoke = find_insn(cfg, OPCODE_INVOKE_STATIC);
+  auto* move_result = find_insn(cfg, OPCODE_MOVE_RESULT);
+  auto* add = find_insn(cfg, OPCODE_ADD_INT_LIT8);
+  // The invoke reads the phi of the loop header, merging the constant and
+  // the increment.
+  auto phi_value = form.uses(invoke).at(0);
+  const auto& def = form.definition(phi_value);
+  ASSERT_EQ(SSAForm::Definition::PHI, def.kind);
+  EXPECT_EQ(0, def.reg);
+  std::unordered_set<ValueId> operands;
+  for (const auto& operand : form.phi(phi_value).operands) {
+    operands.insert(operand.second);
+  }
+  auto* konst = find_insn(cfg, OPCODE_CONST);
+  EXPECT_EQ((std::unordered_set<ValueId>{form.def(konst), form.def(add)}),
+            operands);
+  EXPECT_EQ(std::vector<ValueId>{phi_value}, form.uses(add));
+
+  // The invoke writes the result pair, which the move-result reads.
+  auto result = form.def(invoke);
+  EXPECT_EQ(form.result_register(), form.definition(result).reg);
+  EXPECT_EQ(std::vector<ValueId>{result}, form.uses(move_result));
+
+  // The walk sees the same values as the form.
+  std::vector<ValueId> held(form.num_registers(), NO_VALUE);
+  size_t insns = 0;
+  form.walk(
+      [&](cfg::Block*, const IRList::iterator& it,
+          const std::vector<ValueId>& values) {
+        ++insns;
+        EXPECT_EQ(held, values);
+        size_t i = 0;
+        for (size_t s = 0; s < it->insn->srcs_size(); ++s) {
+          EXPECT_EQ(form.uses(it->insn).at(i++), values[it->insn->src(s)]);
+        }
+      },
+      [&](Register reg, ValueId old, ValueId value) {
+        EXPECT_EQ(held[reg], old);
+        held[reg] = value;
+      });
+  EXPECT_EQ(7, insns);
+}
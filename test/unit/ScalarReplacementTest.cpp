@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+#include "ScalarReplacement.h"
+
+namespace {
+
+void run_passes(std::vector<Pass*> passes, std::vector<DexClass*> classes) {
+  std::vector<DexStore> stores;
+  DexMetadata dm;
+  dm.set_id("classes");
+  DexStore store(dm);
+  store.add_classes(classes);
+  stores.emplace_back(std::move(store));
+  PassManager manager(passes);
+  manager.set_testing_mode();
+
+  Json::Value conf_obj = Json::nullValue;
+  ConfigFiles dummy_config(conf_obj);
+  manager.run_passes(stores, dummy_config);
+}
+
+size_t count_opcodes(const IRCode* code, IROpcode op) {
+  size_t count = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    if (mie.insn->opcode() == op) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+// The constructors invoke Object.<init>, which the inliner has to resolve.
+void create_object_class() {
+  ClassCreator cc(get_object_type());
+  cc.set_access(ACC_PUBLIC);
+  cc.set_external();
+  auto init = static_cast<DexMethod*>(
+      DexMethod::make_method("Ljava/lang/Object;.<init>:()V"));
+  init->set_access(ACC_PUBLIC | ACC_CONSTRUCTOR);
+  init->set_virtual(false);
+  init->set_external();
+  cc.add_method(init);
+  cc.create();
+}
+
+/*
+ * class Point {
+ *   int x;
+ *   long y;
+ *   Point(int x, long y) { this.x = x; this.y = y; }
+ *   int getX() { return x; }
+ * }
+ */
+DexClass* create_point_class() {
+  create_object_class();
+  ClassCreator cc(DexType::make_type("LPoint;"));
+  cc.set_super(get_object_type());
+  for (const char* name : {"LPoint;.x:I", "LPoint;.y:J"}) {
+    auto field = static_cast<DexField*>(DexField::make_field(name));
+    field->make_concrete(ACC_PUBLIC);
+    cc.add_field(field);
+  }
+  cc.add_method(assembler::method_from_string(R"(
+    (method (public constructor) "LPoint;.<init>:(IJ)V"
+     (
+      (load-param-object v0)
+      (load-param v1)
+      (load-param-wide v2)
+      (invoke-direct (v0) "Ljava/lang/Object;.<init>:()V")
+      (iput v1 v0 "LPoint;.x:I")
+      (iput-wide v2 v0 "LPoint;.y:J")
+      (return-void)
+     )
+    )
+  )"));
+  cc.add_method(assembler::method_from_string(R"(
+    (method (public) "LPoint;.getX:()I"
+     (
+      (load-param-object v0)
+      (iget v0 "LPoint;.x:I")
+      (move-result-pseudo v1)
+      (return v1)
+     )
+    )
+  )"));
+  return cc.create();
+}
+
+DexClass* create_user_class(const std::string& method) {
+  ClassCreator cc(DexType::make_type("LUser;"));
+  cc.set_super(get_object_type());
+  cc.add_method(assembler::method_from_string(method));
+  return cc.create();
+}
+
+} // namespace
+
+struct ScalarReplacementTest : public RedexTest {};
+
+TEST_F(ScalarReplacementTest, localObjectBecomesRegisters) {
+  auto point = create_point_class();
+  auto user = create_user_class(R"(
+    (method (public static) "LUser;.sum:(IJ)J"
+     (
+      (load-param v0)
+      (load-param-wide v1)
+      (new-instance "LPoint;")
+      (move-result-pseudo-object v3)
+      (invoke-direct (v3 v0 v1) "LPoint;.<init>:(IJ)V")
+      (invoke-virtual (v3) "LPoint;.getX:()I")
+      (move-result v4)
+      (int-to-long v5 v4)
+      (iget-wide v3 "LPoint;.y:J")
+      (move-result-pseudo-wide v7)
+      (add-long v5 v5 v7)
+      (return-wide v5)
+     )
+    )
+  )");
+  auto method = user->get_dmethods().at(0);
+
+  ScalarReplacementPass pass;
+  run_passes({&pass}, {point, user});
+
+  auto code = method->get_code();
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_NEW_INSTANCE));
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_INVOKE_DIRECT));
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_INVOKE_VIRTUAL));
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_IGET));
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_IGET_WIDE));
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_IPUT));
+  EXPECT_EQ(0, count_opcodes(code, OPCODE_IPUT_WIDE));
+}
+
+TEST_F(ScalarReplacementTest, escapingObjectIsKept) {
+  auto point = create_point_class();
+  auto user = create_user_class(R"(
+    (method (public static) "LUser;.make:(IJ)LPoint;"
+     (
+      (load-param v0)
+      (load-param-wide v1)
+      (new-instance "LPoint;")
+      (move-result-pseudo-object v3)
+      (invoke-direct (v3 v0 v1) "LPoint;.<init>:(IJ)V")
+      (invoke-virtual (v3) "LPoint;.getX:()I")
+      (move-result v4)
+      (return-object v3)
+     )
+    )
+  )");
+  auto method = user->get_dmethods().at(0);
+  auto expected = assembler::to_string(method->get_code());
+
+  ScalarReplacementPass pass;
+  run_passes({&pass}, {point, user});
+
+  EXPECT_EQ(expected, assembler::to_string(method->get_code()));
+}
@@ -75,9 +75,9 @@ class StringBuilderOutlinerTest : public RedexTest {
   }
 
  protected:
-  void run_outliner(IRCode* code) {
+  void run_outliner(IRCode* code, bool is_hot = false) {
     Outliner outliner(m_config);
-    outliner.analyze(*code);
+    outliner.analyze(*code, is_hot);
     outliner.create_outline_helpers(&m_stores);
     outliner.transform(code);
 
@@ -772,3 +772,53 @@ TEST_F(StringBuilderOutlinerTest, maxLength) {
   EXPECT_EQ(assembler::to_s_expr(expected_code.get()),
             assembler::to_s_expr(code.get()));
 }
+
+/*
+ * In hot methods, StringBuilders that only take string constants are folded
+ * into a constant, and the others are not outlined.
+ */
+TEST_F(StringBuilderOutlinerTest, foldConstantsInHotMethods) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+      (load-param-object v4)
+      (new-instance "Ljava/lang/StringBuilder;")
+      (move-result-pseudo-object v0)
+      (const-string "foo")
+      (move-result-pseudo-object v1)
+      (invoke-direct (v0 v1) "Ljava/lang/StringBuilder;.<init>:(Ljava/lang/String;)V")
+      (const-string "bar")
+      (move-result-pseudo-object v1)
+      (invoke-virtual (v0 v1) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v0) "Ljava/lang/StringBuilder;.toString:()Ljava/lang/String;")
+      (move-result-object v2)
+      (new-instance "Ljava/lang/StringBuilder;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "Ljava/lang/StringBuilder;.<init>:()V")
+      (invoke-virtual (v0 v2) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v0 v4) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v0) "Ljava/lang/StringBuilder;.toString:()Ljava/lang/String;")
+      (move-result-object v3)
+      (return-object v3)
+    )
+  )");
+
+  run_outliner(code.get(), /* is_hot */ true);
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+      (load-param-object v4)
+      (const-string "foobar")
+      (move-result-pseudo-object v2)
+      (new-instance "Ljava/lang/StringBuilder;")
+      (move-result-pseudo-object v0)
+      (invoke-direct (v0) "Ljava/lang/StringBuilder;.<init>:()V")
+      (invoke-virtual (v0 v2) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v0 v4) "Ljava/lang/StringBuilder;.append:(Ljava/lang/String;)Ljava/lang/StringBuilder;")
+      (invoke-virtual (v0) "Ljava/lang/StringBuilder;.toString:()Ljava/lang/String;")
+      (move-result-object v3)
+      (return-object v3)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(expected_code.get()),
+            assembler::to_s_expr(code.get()));
+}
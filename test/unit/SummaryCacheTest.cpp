@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "SummaryCache.h"
+
+struct SummaryCacheTest : public RedexTest {};
+
+TEST_F(SummaryCacheTest, keysDependOnCodeAndInputs) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)I"
+      (
+        (load-param v0)
+        (if-eqz v0 :zero)
+        (return v0)
+        (:zero)
+        (const v0 1)
+        (return v0)
+      )
+    )
+  )");
+  auto key = [&](const std::string& input) {
+    return SummaryCache::KeyBuilder("test")
+        .add_method(method)
+        .add(input)
+        .build();
+  };
+  auto original = key("callee summary");
+  EXPECT_EQ(40, original.size());
+  EXPECT_EQ(original, key("callee summary"));
+  EXPECT_NE(original, key("other callee summary"));
+  EXPECT_NE(original, SummaryCache::KeyBuilder("other").add_method(method).add(
+                          "callee summary").build());
+
+  // Positions don't matter...
+  auto code = method->get_code();
+  code->push_back(std::make_unique<DexPosition>(42));
+  EXPECT_EQ(original, key("callee summary"));
+  // ... but instructions do.
+  code->push_back(new IRInstruction(OPCODE_NOP));
+  EXPECT_NE(original, key("callee summary"));
+}
+
+TEST_F(SummaryCacheTest, saveOnlyKeepsUsedEntries) {
+  auto path = boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path();
+  using sparta::s_expr;
+  {
+    SummaryCache cache;
+    cache.put("ns", "a", s_expr({s_expr("1")}));
+    cache.put("ns", "b", s_expr({s_expr("2")}));
+    cache.save(path.string());
+  }
+  {
+    SummaryCache cache;
+    EXPECT_EQ(2, cache.load(path.string()));
+    EXPECT_EQ(s_expr({s_expr("1")}), *cache.get("ns", "a"));
+    EXPECT_FALSE(cache.get("other", "a"));
+    EXPECT_EQ(1, cache.hits());
+    EXPECT_EQ(1, cache.misses());
+    cache.save(path.string());
+  }
+  {
+    SummaryCache cache;
+    EXPECT_EQ(1, cache.load(path.string()));
+    EXPECT_FALSE(cache.get("ns", "b"));
+  }
+  boost::filesystem::remove(path);
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "IRAssembler.h"
+#include "IRCode.h"
+#include "RedexTest.h"
+#include "SwitchCasePeeling.h"
+
+class SwitchCasePeelingTest : public RedexTest {};
+
+namespace {
+
+std::unique_ptr<IRCode> make_switch() {
+  return assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (sparse-switch v0 (:a :b :c :d))
+      (const v1 0)
+      (return v1)
+      (:a 1)
+      (const v1 1)
+      (return v1)
+      (:b 100)
+      (const v1 2)
+      (return v1)
+      (:c 1000)
+      (const v1 3)
+      (return v1)
+      (:d 10000)
+      (const v1 4)
+      (return v1)
+    )
+  )");
+}
+
+} // namespace
+
+TEST_F(SwitchCasePeelingTest, dominantCaseIsPeeled) {
+  auto code = make_switch();
+  // Blocks: the switch, the default, then the cases in key order.
+  BasicBlockLayoutPass::MethodProfile profile;
+  profile.num_blocks = 6;
+  profile.block_hits = {{0, 100}, {1, 2}, {2, 3}, {3, 1}, {4, 90}, {5, 4}};
+
+  auto stats = SwitchCasePeelingPass::peel_cases(profile, 4, code.get());
+  EXPECT_EQ(stats.switches, 1);
+  EXPECT_EQ(stats.peeled_cases, 1);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+      (load-param v0)
+      (const v2 1000)
+      (if-eq v0 v2 :c)
+      (sparse-switch v0 (:a :b :d))
+      (const v1 0)
+      (return v1)
+      (:d 10000)
+      (const v1 4)
+      (return v1)
+      (:b 100)
+      (const v1 2)
+      (return v1)
+      (:a 1)
+      (const v1 1)
+      (return v1)
+      (:c)
+      (const v1 3)
+      (return v1)
+    )
+  )");
+  code->build_cfg(/* editable */ true);
+  code->clear_cfg();
+  expected->build_cfg(/* editable */ true);
+  expected->clear_cfg();
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected.get()));
+}
+
+TEST_F(SwitchCasePeelingTest, evenlySpreadCasesAreKept) {
+  auto code = make_switch();
+  BasicBlockLayoutPass::MethodProfile profile;
+  profile.num_blocks = 6;
+  profile.block_hits = {{0, 100}, {1, 20}, {2, 20}, {3, 20}, {4, 20}, {5, 20}};
+
+  auto stats = SwitchCasePeelingPass::peel_cases(profile, 4, code.get());
+  EXPECT_EQ(stats.switches, 1);
+  EXPECT_EQ(stats.peeled_cases, 0);
+}
+
+TEST_F(SwitchCasePeelingTest, smallSwitchesAreKept) {
+  auto code = make_switch();
+  BasicBlockLayoutPass::MethodProfile profile;
+  profile.num_blocks = 6;
+  profile.block_hits = {{0, 100}, {4, 90}};
+
+  auto stats = SwitchCasePeelingPass::peel_cases(profile, 5, code.get());
+  EXPECT_EQ(stats.switches, 0);
+  EXPECT_EQ(stats.peeled_cases, 0);
+}
@@ -71,3 +71,66 @@ TEST(SwitchDispatchTest, create_simple_dispatch) {
 
   delete g_redex;
 }
+
+TEST(SwitchDispatchTest, sparse_keys_are_searched) {
+  g_redex = new RedexContext();
+  ClassCreator cc(DexType::make_type("Lfoo;"));
+  cc.set_super(get_object_type());
+  cc.create();
+  // Two dense runs of keys, too far apart for a single packed-switch.
+  std::map<SwitchIndices, DexMethod*> indices_to_callee;
+  for (int key : {0, 1, 2, 3, 1000, 1001, 1002, 1003}) {
+    auto name = "Lfoo;.m" + std::to_string(key) + ":(I)I";
+    indices_to_callee[{key}] = make_a_method(name, ACC_STATIC);
+  }
+  // A method with keys in both runs.
+  indices_to_callee[{4, 1004}] = make_a_method("Lfoo;.both:(I)I", ACC_STATIC);
+  auto method = dispatch::create_simple_dispatch(indices_to_callee);
+  ASSERT_NE(method, nullptr);
+
+  size_t num_switches = 0;
+  size_t num_ifs = 0;
+  size_t num_invokes = 0;
+  for (const auto& mie : InstructionIterable(method->get_code())) {
+    auto op = mie.insn->opcode();
+    num_switches += is_switch(op);
+    num_ifs += op == OPCODE_IF_GE;
+    num_invokes += is_invoke(op);
+  }
+  EXPECT_EQ(num_switches, 2);
+  EXPECT_EQ(num_ifs, 1);
+  // `both` is called from the switch of each run.
+  EXPECT_EQ(num_invokes, 10);
+
+  delete g_redex;
+}
+
+TEST(SwitchDispatchTest, create_simple_dispatches) {
+  g_redex = new RedexContext();
+  ClassCreator cc(DexType::make_type("Lfoo;"));
+  cc.set_super(get_object_type());
+  cc.create();
+  std::vector<std::map<SwitchIndices, DexMethod*>> groups;
+  for (int i = 0; i < 2; ++i) {
+    auto suffix = std::to_string(i) + ":(I)I";
+    groups.push_back({{{0}, make_a_method("Lfoo;.a" + suffix, ACC_STATIC)},
+                      {{1}, make_a_method("Lfoo;.b" + suffix, ACC_STATIC)}});
+  }
+  groups.push_back({{{0}, make_a_method("Lfoo;.a0:()V", ACC_STATIC)},
+                    {{1}, make_a_method("Lfoo;.a1:()V", ACC_PRIVATE)}});
+  auto dispatches = dispatch::create_simple_dispatches(groups);
+  ASSERT_EQ(dispatches.size(), 3);
+  ASSERT_NE(dispatches[0], nullptr);
+  ASSERT_NE(dispatches[1], nullptr);
+  EXPECT_NE(dispatches[0]->get_name(), dispatches[1]->get_name());
+  EXPECT_EQ(dispatches[2], nullptr);
+  for (size_t i = 0; i < 2; ++i) {
+    std::vector<DexMethodRef*> callees;
+    dispatches[i]->gather_methods(callees);
+    std::sort(callees.begin(), callees.end(), compare_dexmethods);
+    std::vector<DexMethodRef*> expected{groups[i].at({0}), groups[i].at({1})};
+    EXPECT_EQ(callees, expected);
+  }
+
+  delete g_redex;
+}
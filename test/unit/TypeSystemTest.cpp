@@ -369,5 +369,20 @@ TEST(TypeSystem, empty) {
       ::testing::UnorderedElementsAre(iout1_t));
   EXPECT_THAT(type_system.get_implemented_interfaces(odd_t).size(), 0);
 
+  EXPECT_TRUE(type_system.is_subtype(obj_t, s_t));
+  EXPECT_TRUE(type_system.is_subtype(a_t, j_t));
+  EXPECT_TRUE(type_system.is_subtype(j_t, j_t));
+  EXPECT_FALSE(type_system.is_subtype(j_t, a_t));
+  EXPECT_FALSE(type_system.is_subtype(c_t, j_t));
+  EXPECT_TRUE(type_system.is_subtype(odd_t, odd12_t));
+  EXPECT_FALSE(type_system.is_subtype(b_t, odd1_t));
+
+  EXPECT_TRUE(type_system.implements(j_t, i1_t));
+  EXPECT_TRUE(type_system.implements(s_t, i2_t));
+  EXPECT_TRUE(type_system.implements(q_t, i3_t));
+  EXPECT_FALSE(type_system.implements(l_t, i1_t));
+  EXPECT_FALSE(type_system.implements(a_t, i1_t));
+  EXPECT_FALSE(type_system.implements(p_t, i4_t));
+
   delete g_redex;
 }
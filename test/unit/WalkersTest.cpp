@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+#include "Walkers.h"
+
+namespace {
+
+// A class with a method of each size up to `num_methods`, and an abstract
+// method.
+DexClass* create_class(const std::string& name, size_t num_methods) {
+  ClassCreator creator(DexType::make_type(name.c_str()));
+  creator.set_super(get_object_type());
+  for (size_t i = 0; i < num_methods; ++i) {
+    std::string body;
+    for (size_t j = 0; j < i; ++j) {
+      body += "(const v0 0)\n";
+    }
+    creator.add_method(assembler::method_from_string(
+        "(method (public static) \"" + name + ".m" + std::to_string(i) +
+        ":()V\" (" + body + "(return-void)))"));
+  }
+  auto abstract_method = static_cast<DexMethod*>(
+      DexMethod::make_method(name + ".abstract:()V"));
+  abstract_method->make_concrete(ACC_PUBLIC | ACC_ABSTRACT, true);
+  creator.add_method(abstract_method);
+  return creator.create();
+}
+
+} // namespace
+
+class WalkersTest : public RedexTest {};
+
+// The per-method walks visit the same methods as the per-class ones.
+TEST_F(WalkersTest, byCostWalksVisitEveryMethod) {
+  Scope scope{create_class("LA;", 40), create_class("LB;", 3),
+              create_class("LC;", 0)};
+
+  auto count_insns = [](DexMethod* method) -> size_t {
+    auto code = method->get_code();
+    return code ? code->count_opcodes() : 0;
+  };
+  auto sum = [](size_t a, size_t b) { return a + b; };
+  EXPECT_EQ(walk::parallel::reduce_methods<size_t>(scope, count_insns, sum),
+            walk::parallel::reduce_methods_by_cost<size_t>(
+                scope, count_insns, sum, 0, 4));
+  EXPECT_EQ(walk::parallel::reduce_methods<size_t>(
+                scope, [](DexMethod*) -> size_t { return 1; }, sum),
+            walk::parallel::reduce_methods_by_cost<size_t>(
+                scope, [](DexMethod*) -> size_t { return 1; }, sum, 0, 4));
+
+  std::atomic<size_t> num_methods{0};
+  walk::parallel::methods_by_cost(
+      scope, [&](DexMethod*) { ++num_methods; }, 3);
+  EXPECT_EQ(46, num_methods);
+
+  // Methods without code are left out, as are the ones the filter rejects.
+  std::atomic<size_t> num_code{0};
+  walk::parallel::code_by_cost(scope,
+                               [](DexMethod* method) {
+                                 return method->get_class() !=
+                                        DexType::get_type("LB;");
+                               },
+                               [&](DexMethod*, IRCode&) { ++num_code; });
+  EXPECT_EQ(40, num_code);
+}
@@ -9,7 +9,9 @@
 
 #include <chrono>
 #include <gtest/gtest.h>
+#include <numeric>
 #include <random>
+#include <thread>
 
 constexpr unsigned int NUM_STRINGS = 100'000;
 constexpr unsigned int NUM_INTS = 1000;
@@ -103,3 +105,148 @@ TEST(WorkQueueTest, checkDynamicallyAddingTasks) {
   // 10 + 9 + ... + 1 + 0 = 55
   EXPECT_EQ(55, result);
 }
+
+// Check that tasks pushed while running can be stolen by the other workers
+// without anyone giving up early or running a task twice.
+TEST(WorkQueueTest, checkStealingDynamicallyAddedTasks) {
+  constexpr int NUM_THREADS = 4;
+  constexpr int DEPTH = 14;
+  using WorkerState = WorkerState<int, std::nullptr_t, int>;
+  WorkQueue<int, std::nullptr_t, int> wq(
+      [](WorkerState* worker_state, int depth) {
+        if (depth > 0) {
+          worker_state->push_task(depth - 1);
+          worker_state->push_task(depth - 1);
+        }
+        return 1;
+      },
+      [](int a, int b) { return a + b; },
+      [](uint) { return nullptr; },
+      NUM_THREADS);
+  wq.add_item(DEPTH);
+  auto result = wq.run_all();
+
+  // A complete binary tree of the given depth.
+  EXPECT_EQ((1 << (DEPTH + 1)) - 1, result);
+}
+
+// WorkQueues share the pool of threads; one that runs from a task of another
+// can't wait for the pool, and brings threads of its own instead.
+TEST(WorkQueueTest, nestedWorkQueues) {
+  auto wq = workqueue_mapreduce<int, int>(
+      [](int n) {
+        auto inner = workqueue_mapreduce<int, int>(
+            [](int m) { return m; }, [](int a, int b) { return a + b; }, 3);
+        for (int i = 1; i <= n; ++i) {
+          inner.add_item(i);
+        }
+        return inner.run_all();
+      },
+      [](int a, int b) { return a + b; },
+      4);
+  for (int i = 0; i < 20; ++i) {
+    wq.add_item(i);
+  }
+  // The sum over n < 20 of n * (n + 1) / 2.
+  EXPECT_EQ(1330, wq.run_all());
+}
+
+// Each run uses as many workers as its queue has, whatever the size of the
+// pool that earlier runs left behind, and hands each its own state.
+TEST(WorkQueueTest, runsOfDifferentSizes) {
+  for (unsigned int num_threads : {8, 1, 3, 16, 2}) {
+    std::vector<unsigned int> seen(num_threads);
+    WorkQueue<unsigned int, unsigned int*, std::nullptr_t> wq(
+        [](WorkerState<unsigned int, unsigned int*, std::nullptr_t>* state,
+           unsigned int) {
+          ++*state->get_data();
+          return nullptr;
+        },
+        [](std::nullptr_t, std::nullptr_t) { return nullptr; },
+        [&](unsigned int i) { return &seen[i]; },
+        num_threads);
+    for (unsigned int i = 0; i < NUM_INTS; ++i) {
+      wq.add_item(i);
+    }
+    wq.run_all();
+    EXPECT_EQ(NUM_INTS, std::accumulate(seen.begin(), seen.end(), 0u));
+  }
+}
+
+// Once a run has started the pool's threads, a job for each thread reaches
+// every one of them exactly once.
+TEST(WorkQueueTest, runOnEachPoolThread) {
+  auto wq = workqueue_foreach<int>([](int) {}, 4);
+  for (unsigned int i = 0; i < NUM_INTS; ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  std::mutex mutex;
+  std::vector<std::thread::id> ids;
+  EXPECT_TRUE(workqueue_impl::ThreadPool::get().try_run_on_each_thread([&] {
+    std::lock_guard<std::mutex> lock(mutex);
+    ids.push_back(std::this_thread::get_id());
+  }));
+  EXPECT_GE(ids.size(), 4u);
+  std::sort(ids.begin(), ids.end());
+  EXPECT_EQ(ids.end(), std::adjacent_find(ids.begin(), ids.end()));
+}
+
+// A reducer may fold the output of each task into the accumulator in place.
+TEST(WorkQueueTest, inPlaceReducer) {
+  using Output = std::vector<int>;
+  auto wq = make_workqueue<int, std::nullptr_t, Output>(
+      [](WorkerState<int, std::nullptr_t, Output>*, int i) {
+        return Output{i};
+      },
+      [](Output& acc, Output&& out) {
+        acc.insert(acc.end(), out.begin(), out.end());
+      },
+      [](unsigned int) { return nullptr; },
+      4);
+  for (unsigned int i = 0; i < NUM_INTS; ++i) {
+    wq.add_item(i);
+  }
+  auto result = wq.run_all();
+  std::sort(result.begin(), result.end());
+  ASSERT_EQ(NUM_INTS, result.size());
+  for (unsigned int i = 0; i < NUM_INTS; ++i) {
+    EXPECT_EQ(int(i), result[i]);
+  }
+}
+
+TEST(WorkQueueTest, parseCpuList) {
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 8, 10, 11}),
+            workqueue_impl::parse_cpu_list("0-3,8,10-11\n"));
+  EXPECT_TRUE(workqueue_impl::parse_cpu_list("").empty());
+}
+
+// Tasks given a NUMA node all run, however many nodes there are.
+TEST(WorkQueueTest, tasksOnNodes) {
+  configure_workqueue_threads(0, false, /* numa_aware */ true);
+  std::atomic<int> sum{0};
+  auto wq = workqueue_foreach<int>([&](int i) { sum += i; }, 3);
+  for (unsigned int i = 0; i < NUM_INTS; ++i) {
+    wq.add_item(i, /* node */ i);
+  }
+  wq.run_all();
+  configure_workqueue_threads(0, false);
+  EXPECT_EQ(NUM_INTS * (NUM_INTS - 1) / 2, sum);
+}
+
+TEST(WorkStealingDequeTest, ownerIsLifoThiefIsFifo) {
+  WorkStealingDeque<int> deque(/* log_initial_capacity */ 1);
+  for (int i = 0; i < 10; ++i) {
+    deque.push(i);
+  }
+  EXPECT_EQ(10, deque.size());
+  EXPECT_EQ(9, *deque.pop());
+  EXPECT_EQ(0, *deque.steal());
+  EXPECT_EQ(8, *deque.pop());
+  EXPECT_EQ(1, *deque.steal());
+  EXPECT_EQ(6, deque.size());
+  while (deque.pop()) {
+  }
+  EXPECT_TRUE(deque.empty());
+  EXPECT_FALSE(deque.steal());
+}
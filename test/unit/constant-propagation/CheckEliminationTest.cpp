@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CheckElimination.h"
+
+#include <gtest/gtest.h>
+
+#include "AbstractDomainPropertyTest.h"
+#include "CheckAnalysis.h"
+#include "Creators.h"
+#include "DexUtil.h"
+#include "IRAssembler.h"
+#include "PassManager.h"
+#include "RedexTest.h"
+
+INSTANTIATE_TYPED_TEST_CASE_P(IntervalDomain,
+                              AbstractDomainPropertyTest,
+                              IntervalDomain);
+
+template <>
+std::vector<IntervalDomain>
+AbstractDomainPropertyTest<IntervalDomain>::non_extremal_values() {
+  return {IntervalDomain(0),
+          IntervalDomain(-1, 1),
+          IntervalDomain(0, 10),
+          IntervalDomain::at_least(0),
+          IntervalDomain::at_most(-1)};
+}
+
+struct CheckEliminationTest : public RedexTest {
+  /*
+   * Runs CheckEliminationPass over `method`, in a class of its own, and
+   * returns the metrics it reported.
+   */
+  std::unordered_map<std::string, int> run_pass(DexMethod* method) {
+    ClassCreator cc(method->get_class());
+    cc.set_super(get_object_type());
+    cc.add_method(method);
+    DexStore store("classes");
+    store.add_classes({cc.create()});
+    std::vector<DexStore> stores;
+    stores.emplace_back(std::move(store));
+
+    CheckEliminationPass pass;
+    PassManager manager({&pass});
+    manager.set_testing_mode();
+    Json::Value conf_obj = Json::nullValue;
+    ConfigFiles dummy_config(conf_obj);
+    manager.run_passes(stores, dummy_config);
+    return manager.get_pass_info().at(0).metrics;
+  }
+};
+
+TEST_F(CheckEliminationTest, intervalArithmetic) {
+  IntervalDomain index(0, 9);
+  EXPECT_TRUE(index.is_int32());
+  EXPECT_EQ(IntervalDomain(0, 10), index.join(IntervalDomain(10)));
+  EXPECT_TRUE(index.meet(IntervalDomain::at_least(10)).is_bottom());
+  // Widening drops the bound that moved.
+  EXPECT_EQ(IntervalDomain::at_least(0), index.widening(IntervalDomain(0, 10)));
+  EXPECT_EQ(IntervalDomain(0, 9),
+            IntervalDomain::at_least(0).narrowing(IntervalDomain(1, 9)));
+  EXPECT_EQ(3, *IntervalDomain(3).get_constant());
+  EXPECT_FALSE(IntervalDomain::at_least(0).is_int32());
+}
+
+TEST_F(CheckEliminationTest, dereferencedValueIsNotNull) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(LFoo;)V"
+     (
+      (load-param-object v0)
+      (invoke-virtual (v0) "LFoo;.baz:()V")
+      (if-nez v0 :ok)
+      (const v1 0)
+      (throw v1)
+      (:ok)
+      (return-void)
+     )
+    )
+  )");
+  auto metrics = run_pass(method);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (invoke-virtual (v0) "LFoo;.baz:()V")
+     (goto :ok)
+     (const v1 0)
+     (throw v1)
+     (:ok)
+     (return-void)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(expected.get()),
+            assembler::to_s_expr(method->get_code()));
+  EXPECT_EQ(1, metrics.at("num_null_checks_removed"));
+  EXPECT_EQ(0, metrics.at("num_range_checks_removed"));
+}
+
+TEST_F(CheckEliminationTest, receiverIsNotNull) {
+  auto method = assembler::method_from_string(R"(
+    (method (public) "LFoo;.bar:()V"
+     (
+      (load-param-object v0)
+      (if-eqz v0 :null)
+      (return-void)
+      (:null)
+      (const v1 0)
+      (throw v1)
+     )
+    )
+  )");
+  auto metrics = run_pass(method);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (return-void)
+     (:null)
+     (const v1 0)
+     (throw v1)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(expected.get()),
+            assembler::to_s_expr(method->get_code()));
+  EXPECT_EQ(1, metrics.at("num_null_checks_removed"));
+}
+
+TEST_F(CheckEliminationTest, maybeNullIsKept) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(LFoo;)V"
+     (
+      (load-param-object v0)
+      (if-nez v0 :ok)
+      (invoke-virtual (v0) "LFoo;.baz:()V")
+      (:ok)
+      (return-void)
+     )
+    )
+  )");
+  auto original = assembler::to_s_expr(method->get_code());
+  auto metrics = run_pass(method);
+
+  EXPECT_EQ(original, assembler::to_s_expr(method->get_code()));
+  EXPECT_EQ(0, metrics.at("num_null_checks_removed"));
+}
+
+TEST_F(CheckEliminationTest, indexWithinKnownLength) {
+  // The index is masked into [0, 7], and the array has 8 elements, so the
+  // explicit bounds check always passes.
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(I)I"
+     (
+      (load-param v0)
+      (and-int/lit8 v1 v0 7)
+      (const v2 8)
+      (new-array v2 "[I")
+      (move-result-pseudo-object v3)
+      (array-length v3)
+      (move-result-pseudo v4)
+      (if-ge v1 v4 :out_of_bounds)
+      (aget v3 v1)
+      (move-result-pseudo v5)
+      (return v5)
+      (:out_of_bounds)
+      (const v5 -1)
+      (return v5)
+     )
+    )
+  )");
+  auto metrics = run_pass(method);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (and-int/lit8 v1 v0 7)
+     (const v2 8)
+     (new-array v2 "[I")
+     (move-result-pseudo-object v3)
+     (array-length v3)
+     (move-result-pseudo v4)
+     (aget v3 v1)
+     (move-result-pseudo v5)
+     (return v5)
+     (:out_of_bounds)
+     (const v5 -1)
+     (return v5)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(expected.get()),
+            assembler::to_s_expr(method->get_code()));
+  EXPECT_EQ(1, metrics.at("num_range_checks_removed"));
+}
+
+TEST_F(CheckEliminationTest, indexIsValidAfterAccess) {
+  // Once arr[i] has been read, i is a valid index, so it is non-negative.
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:([II)I"
+     (
+      (load-param-object v0)
+      (load-param v1)
+      (aget v0 v1)
+      (move-result-pseudo v2)
+      (if-ltz v1 :negative)
+      (return v2)
+      (:negative)
+      (const v2 -1)
+      (return v2)
+     )
+    )
+  )");
+  auto metrics = run_pass(method);
+
+  auto expected = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (load-param v1)
+     (aget v0 v1)
+     (move-result-pseudo v2)
+     (return v2)
+     (:negative)
+     (const v2 -1)
+     (return v2)
+    )
+  )");
+  EXPECT_EQ(assembler::to_s_expr(expected.get()),
+            assembler::to_s_expr(method->get_code()));
+  EXPECT_EQ(1, metrics.at("num_range_checks_removed"));
+}
+
+TEST_F(CheckEliminationTest, handlerDoesNotSeeDereference) {
+  // If the invoke throws, v0 may well have been null.
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(LFoo;)V"
+     (
+      (load-param-object v0)
+      (.try_start a)
+      (invoke-virtual (v0) "LFoo;.baz:()V")
+      (.try_end a)
+      (return-void)
+      (.catch (a))
+      (if-eqz v0 :null)
+      (return-void)
+      (:null)
+      (const v1 0)
+      (throw v1)
+     )
+    )
+  )");
+  auto original = assembler::to_s_expr(method->get_code());
+  auto metrics = run_pass(method);
+
+  EXPECT_EQ(original, assembler::to_s_expr(method->get_code()));
+  EXPECT_EQ(0, metrics.at("num_null_checks_removed"));
+}
@@ -23,3 +23,13 @@ inline void do_const_prop(
   cp::Transform tf(transform_config);
   tf.apply(intra_cp, cp::WholeProgramState(), code);
 }
+
+inline void do_sparse_const_prop(IRCode* code) {
+  code->build_cfg(/* editable */ false);
+  cp::intraprocedural::SparseFixpointIterator intra_cp(
+      code->cfg(), cp::ConstantPrimitiveAnalyzer());
+  intra_cp.run(ConstantEnvironment());
+  cp::Transform::Config transform_config;
+  cp::Transform tf(transform_config);
+  tf.apply(intra_cp, cp::WholeProgramState(), code);
+}
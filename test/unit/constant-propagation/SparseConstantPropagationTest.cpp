@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ConstantPropagation.h"
+
+#include <gtest/gtest.h>
+
+#include "ConstantPropagationTestUtil.h"
+#include "IRAssembler.h"
+
+TEST(SparseConstantPropagation, IfToGoto) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+
+     (if-eqz v0 :if-true-label)
+     (const v0 1)
+
+     (:if-true-label)
+     (const v0 2)
+    )
+)");
+
+  do_sparse_const_prop(code.get());
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+
+     (goto :if-true-label)
+     (const v0 1)
+
+     (:if-true-label)
+     (const v0 2)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+}
+
+TEST(SparseConstantPropagation, FoldArithmeticAddLit) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 2147483646)
+     (add-int/lit8 v0 v0 1) ; this should be converted to a const opcode
+     (const v1 2147483647)
+     (if-eq v0 v1 :end)
+     (const v0 2147483647)
+     (add-int/lit8 v0 v0 1)
+     (:end)
+     (return-void)
+    )
+)");
+
+  do_sparse_const_prop(code.get());
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v0 2147483646)
+     (const v0 2147483647)
+     (const v1 2147483647)
+     (goto :end)
+     (const v0 2147483647)
+     (add-int/lit8 v0 v0 1)
+     (:end)
+     (return-void)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+}
+
+TEST(SparseConstantPropagation, DefinitionInUnreachableBlock) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (const v1 5)
+     (if-eqz v0 :skip)
+     (const v1 6) ; never executed, so it doesn't reach the add below
+     (:skip)
+     (add-int/lit8 v2 v1 1)
+     (return-void)
+    )
+)");
+
+  do_sparse_const_prop(code.get());
+
+  auto expected_code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (const v1 5)
+     (goto :skip)
+     (const v1 6)
+     (:skip)
+     (const v2 6)
+     (return-void)
+    )
+)");
+  EXPECT_EQ(assembler::to_s_expr(code.get()),
+            assembler::to_s_expr(expected_code.get()));
+}
+
+TEST(SparseConstantPropagation, Loop) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (const v0 0)
+     (:loop)
+     (add-int/lit8 v0 v0 1) ; v0 changes on every iteration
+     (if-nez v0 :loop)
+     (return-void)
+    )
+)");
+  auto expected = assembler::to_s_expr(code.get());
+
+  do_sparse_const_prop(code.get());
+
+  EXPECT_EQ(assembler::to_s_expr(code.get()), expected);
+}
+
+TEST(SparseConstantPropagation, EntryStates) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param v0)
+     (const v1 0)
+     (const v2 1)
+     (if-eqz v0 :join)
+     (const v2 1)
+     (const v1 2)
+     (:join)
+     (return-void)
+    )
+)");
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  cp::intraprocedural::SparseFixpointIterator intra_cp(
+      cfg, cp::ConstantPrimitiveAnalyzer());
+  intra_cp.run(ConstantEnvironment());
+
+  auto env = intra_cp.get_entry_state_at(cfg.exit_block());
+  EXPECT_EQ(env.get<SignedConstantDomain>(0u), SignedConstantDomain::top());
+  EXPECT_EQ(env.get<SignedConstantDomain>(1),
+            SignedConstantDomain(sign_domain::Interval::GEZ));
+  EXPECT_EQ(env.get<SignedConstantDomain>(2), SignedConstantDomain(1));
+}
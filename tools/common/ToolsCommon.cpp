@@ -33,10 +33,6 @@ namespace {
  * line arguments.
  */
 const std::string ENTRY_FILE = "/entry.json";
-void load_entry_file(const std::string& input_ir_dir, Json::Value* entry_data) {
-  std::ifstream istrm(input_ir_dir + ENTRY_FILE);
-  istrm >> *entry_data;
-}
 
 void write_entry_file(const std::string& output_ir_dir,
                       const Json::Value& entry_data) {
@@ -145,17 +141,24 @@ void load_intermediate_dex(const std::string& input_ir_dir,
                            const Json::Value& dex_files,
                            DexStoresVector& stores) {
   Timer t("Load intermediate dex");
-  dex_stats_t dex_stats;
+  // Load the dexes of all stores on one work queue.
+  std::vector<std::string> locations;
+  std::vector<size_t> store_indices;
   for (const Json::Value& store_files : dex_files) {
     DexStore store(store_files["name"].asString());
     stores.emplace_back(std::move(store));
     for (const Json::Value& file_name : store_files["list"]) {
       auto location = boost::filesystem::path(input_ir_dir);
       location /= file_name.asString();
-      DexClasses classes = load_classes_from_dex(location.c_str(), &dex_stats);
-      stores.back().add_classes(std::move(classes));
+      locations.push_back(location.string());
+      store_indices.push_back(stores.size() - 1);
     }
   }
+  std::vector<dex_stats_t> dex_stats;
+  auto dex_classes = load_classes_from_dexes(locations, &dex_stats);
+  for (size_t i = 0; i < locations.size(); ++i) {
+    stores[store_indices[i]].add_classes(std::move(dex_classes[i]));
+  }
 }
 
 /**
@@ -180,6 +183,11 @@ bool dir_is_writable(const std::string& dir) {
 #endif
 }
 
+void load_entry_file(const std::string& input_ir_dir, Json::Value* entry_data) {
+  std::ifstream istrm(input_ir_dir + ENTRY_FILE);
+  istrm >> *entry_data;
+}
+
 Json::Value parse_config(const std::string& config_file) {
   std::ifstream config_stream(config_file);
   if (!config_stream) {
@@ -212,6 +220,35 @@ void write_all_intermediate(const ConfigFiles& /* conf */,
   write_entry_file(output_ir_dir, entry_data);
 }
 
+LoadedDebugInfo debug_info_to_load(const Json::Value& config) {
+  LoadedDebugInfo loaded;
+  if (!config.get("strip_debug_info_at_load", false).asBool()) {
+    return loaded;
+  }
+  if (config.get("debug_info_kind", "").asString() == "no_positions") {
+    loaded.locals = false;
+  }
+  bool strips = false;
+  for (const auto& pass : config["redex"]["passes"]) {
+    strips |= pass.asString() == "StripDebugInfoPass";
+  }
+  const auto& strip = config["StripDebugInfoPass"];
+  // With a whitelist, the pass only strips some of the methods.
+  if (!strips || strip.get("use_whitelist", false).asBool()) {
+    return loaded;
+  }
+  if (strip.get("drop_all_dbg_info", false).asBool()) {
+    loaded.debug_items = false;
+  }
+  if (strip.get("drop_line_numbers", false).asBool()) {
+    loaded.positions = false;
+  }
+  if (strip.get("drop_local_variables", false).asBool()) {
+    loaded.locals = false;
+  }
+  return loaded;
+}
+
 /**
  * Loading entry file, dex files and IR meta data
  */
@@ -220,6 +257,18 @@ void load_all_intermediate(const std::string& input_ir_dir,
                            Json::Value* entry_data) {
   Timer t("Loading all");
   load_entry_file(input_ir_dir, entry_data);
+  // Resume with the loading modes of the original run. Mapping the strings
+  // and deferring ballooning means that only what the resumed passes touch
+  // gets paged in and converted to IR.
+  if (entry_data->isMember("config")) {
+    auto config = parse_config((*entry_data)["config"].asString());
+    RedexContext::set_zero_copy_strings(
+        config.get("zero_copy_strings", false).asBool());
+    RedexContext::set_lazy_balloon(config.get("lazy_balloon", false).asBool());
+    RedexContext::set_lazy_debug_info(
+        config.get("lazy_debug_info", false).asBool());
+    RedexContext::set_loaded_debug_info(debug_info_to_load(config));
+  }
   load_intermediate_dex(input_ir_dir, (*entry_data)["dex_list"], stores);
 
   // load external classes
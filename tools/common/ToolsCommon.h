@@ -8,6 +8,7 @@
 #include "ConfigFiles.h"
 #include "DexStore.h"
 #include "PassManager.h"
+#include "RedexContext.h"
 
 namespace redex {
 
@@ -15,12 +16,26 @@ bool dir_is_writable(const std::string& dir);
 
 Json::Value parse_config(const std::string& config_file);
 
+/**
+ * With "strip_debug_info_at_load" set, the debug info that the output won't
+ * contain anyway: what a StripDebugInfoPass in the pass list drops from every
+ * method, and the locals when the debug_info_kind emits no debug programs.
+ * Otherwise, everything.
+ */
+LoadedDebugInfo debug_info_to_load(const Json::Value& config);
+
 void write_all_intermediate(const ConfigFiles& conf,
                             const std::string& output_ir_dir,
                             const RedexOptions& redex_options,
                             DexStoresVector& stores,
                             Json::Value& entry_data);
 
+/**
+ * Only the entry file of what write_all_intermediate() wrote: the dex list,
+ * config file, options and, for checkpoints, what the passes before left.
+ */
+void load_entry_file(const std::string& input_ir_dir, Json::Value* entry_data);
+
 void load_all_intermediate(const std::string& input_ir_dir,
                            DexStoresVector& stores,
                            Json::Value* entry_data);
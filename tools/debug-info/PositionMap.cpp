@@ -6,15 +6,51 @@
  */
 
 #include <boost/scope_exit.hpp>
+#include <cstring>
 #include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "PositionMap.h"
 
+namespace {
+
+bool read_u32(const MappedFile& file, size_t* offset, uint32_t* value) {
+  if (*offset + sizeof(uint32_t) > file.size()) {
+    return false;
+  }
+  memcpy(value, file.begin() + *offset, sizeof(uint32_t));
+  *offset += sizeof(uint32_t);
+  return true;
+}
+
+} // namespace
+
+std::string PositionMap::string(uint32_t id) const {
+  uint32_t begin;
+  uint32_t end;
+  if (m_string_offsets != nullptr) {
+    if (id >= m_string_count) {
+      return "";
+    }
+    begin = m_string_offsets[id];
+    end = m_string_offsets[id + 1];
+  } else {
+    if (id >= m_string_bounds.size()) {
+      return "";
+    }
+    std::tie(begin, end) = m_string_bounds[id];
+  }
+  if (begin > end || end > m_file->size()) {
+    return "";
+  }
+  return std::string((const char*)m_file->begin() + begin, end - begin);
+}
+
 std::unique_ptr<PositionMap> read_map(const char* filename) {
   int fd = open(filename, O_RDONLY);
   if (fd == -1) {
@@ -22,60 +58,80 @@ std::unique_ptr<PositionMap> read_map(const char* filename) {
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
+  // The mapping stays valid once the file is closed.
+  BOOST_SCOPE_EXIT_ALL(=) { close(fd); };
   struct stat buf;
   if (fstat(fd, &buf)) {
     std::cerr << "Cannot fstat file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  uint8_t* mapping = (uint8_t*)mmap(
-      nullptr, buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
-  uint32_t magic = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  if (mapping == MAP_FAILED) {
+  std::string error_msg;
+  std::unique_ptr<MappedFile> file(MappedFile::mmap_file(
+      buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, filename,
+      &error_msg));
+  if (file == nullptr) {
     std::cerr << "mmap failed for file (" << filename
               << ") with error: " << strerror(errno) << std::endl;
     return nullptr;
   }
-  BOOST_SCOPE_EXIT_ALL(=, &buf) {
-    munmap(mapping, buf.st_size);
-  };
-  if (magic != 0xfaceb000) {
+
+  size_t offset = 0;
+  uint32_t magic;
+  uint32_t version;
+  if (!read_u32(*file, &offset, &magic) || magic != 0xfaceb000) {
     std::cerr << "Magic number mismatch\n";
     return nullptr;
   }
-  uint32_t version = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  if (version != 2) {
+  if (!read_u32(*file, &offset, &version) || (version != 2 && version != 3)) {
     std::cerr << "Version mismatch\n";
     return nullptr;
   }
 
   std::unique_ptr<PositionMap> map(new PositionMap());
-  std::vector<std::string> string_pool;
-  uint32_t spool_count = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  for (uint32_t i = 0; i < spool_count; ++i) {
-    uint32_t ssize = *(uint32_t*)mapping;
-    mapping += sizeof(uint32_t);
-    map->string_pool.emplace_back((const char*)mapping, ssize);
-    mapping += ssize;
+  uint32_t spool_count;
+  uint32_t pos_count;
+  bool truncated = !read_u32(*file, &offset, &spool_count);
+  if (version == 3) {
+    // See RealPositionMapper::write_map_v3 for the layout.
+    truncated = truncated || !read_u32(*file, &offset, &pos_count);
+    uint64_t tables_end = offset + sizeof(uint32_t) * (spool_count + 1ull) +
+                          sizeof(PositionItem) * (uint64_t)pos_count;
+    truncated = truncated || tables_end > file->size();
+    if (!truncated) {
+      map->m_string_offsets = (const uint32_t*)(file->begin() + offset);
+      map->m_string_count = spool_count;
+      offset += sizeof(uint32_t) * (spool_count + 1);
+    }
+  } else {
+    for (uint32_t i = 0; i < spool_count && !truncated; ++i) {
+      uint32_t ssize;
+      truncated = !read_u32(*file, &offset, &ssize) ||
+                  offset + ssize > file->size();
+      map->m_string_bounds.emplace_back(offset, offset + ssize);
+      offset += ssize;
+    }
+    truncated = truncated || !read_u32(*file, &offset, &pos_count) ||
+                offset + sizeof(PositionItem) * (uint64_t)pos_count >
+                    file->size();
+  }
+  if (truncated) {
+    std::cerr << "Map file (" << filename << ") is truncated\n";
+    return nullptr;
   }
-  uint32_t pos_count = *(uint32_t*)mapping;
-  mapping += sizeof(uint32_t);
-  map->positions.reset(new PositionItem[pos_count]);
-  map->positions_size = pos_count;
-  memcpy(map->positions.get(), mapping, pos_count * sizeof(PositionItem));
+  map->m_positions = (const PositionItem*)(file->begin() + offset);
+  map->m_positions_size = pos_count;
+  map->m_file = std::move(file);
   return map;
 }
 
 std::vector<Position> get_stack(const PositionMap& map, int64_t idx) {
   std::vector<Position> stack;
-  while (idx >= 0 && (size_t)idx < map.positions_size) {
-    auto pi = map.positions[idx];
-    stack.push_back(Position(map.string_pool[pi.class_id],
-                             map.string_pool[pi.method_id],
-                             map.string_pool[pi.file_id],
+  while (idx >= 0 && (size_t)idx < map.size()) {
+    const auto& pi = map.position(idx);
+    stack.push_back(Position(map.string(pi.class_id),
+                             map.string(pi.method_id),
+                             map.string(pi.file_id),
                              pi.line));
     idx = (int64_t)pi.parent - 1;
   }
@@ -7,8 +7,11 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "mmap.h"
+
 struct __attribute__((packed)) PositionItem {
   uint32_t class_id;
   uint32_t method_id;
@@ -29,11 +32,35 @@ struct Position {
       : cls(cls), method(method), filename(filename), line(line) {}
 };
 
-struct PositionMap {
-  std::vector<std::string> string_pool;
-  std::unique_ptr<PositionItem[]> positions;
-  size_t positions_size;
+/*
+ * A line map, used in place from a read-only mapping of the file. Positions
+ * are looked up at random, and strings are only read when a position that
+ * refers to them is.
+ *
+ * Version 3 maps need no parsing at all. Version 2 maps prefix each string of
+ * their pool with its size, so opening one walks the pool once to index it.
+ */
+class PositionMap {
+ public:
+  size_t size() const { return m_positions_size; }
+
+  const PositionItem& position(size_t idx) const { return m_positions[idx]; }
+
+  std::string string(uint32_t id) const;
+
+ private:
+  friend std::unique_ptr<PositionMap> read_map(const char* filename);
+
+  std::unique_ptr<MappedFile> m_file;
+  const PositionItem* m_positions{nullptr};
+  size_t m_positions_size{0};
+  // For version 3 maps, the string offset table of the file.
+  const uint32_t* m_string_offsets{nullptr};
+  uint32_t m_string_count{0};
+  // For version 2 maps, the bounds of each string of the pool.
+  std::vector<std::pair<uint32_t, uint32_t>> m_string_bounds;
 };
 
+// Returns nullptr, after printing why, if the file can't be used as a map.
 std::unique_ptr<PositionMap> read_map(const char* filename);
 std::vector<Position> get_stack(const PositionMap& map, int64_t idx);
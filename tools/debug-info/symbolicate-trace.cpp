@@ -6,6 +6,7 @@
  */
 
 #include <boost/regex.hpp>
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -13,23 +14,49 @@
 
 boost::regex trace_regex(R"/(((\s+at\s+)[^(]*)\(:(\d+)\)\s?)/");
 
+void symbolicate(const PositionMap& map, std::istream& in, std::ostream& out) {
+  for (std::string line; std::getline(in, line);) {
+    boost::smatch matches;
+    if (boost::regex_match(line, matches, trace_regex)) {
+      auto idx = std::stoll(matches[3]) - 1;
+      auto stack = get_stack(map, idx);
+      for (const auto& pos : stack) {
+        out << matches[2] << pos.cls << "." << pos.method << "("
+            << pos.filename << ":" << pos.line << ")\n";
+      }
+    } else {
+      out << line << "\n";
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   if (argc < 2) {
-    std::cerr << "Usage: cat trace | remap mapping_file\n";
+    std::cerr << "Usage: cat trace | remap mapping_file\n"
+              << "       remap mapping_file trace_file...\n"
+              << "The latter writes each trace_file, symbolicated, to "
+                 "trace_file.symbolicated\n";
     abort();
   }
   auto map = read_map(argv[1]);
-  for (std::string line; std::getline(std::cin, line);) {
-    boost::smatch matches;
-    if (boost::regex_match(line, matches, trace_regex)) {
-      auto idx = std::stoi(matches[3]) - 1;
-      auto stack = get_stack(*map, idx);
-      for (auto pos : stack) {
-        std::cout << matches[2] << pos.cls << "." << pos.method << "("
-                  << pos.filename << ":" << pos.line << ")" << std::endl;
-      }
-    } else {
-      std::cout << line << std::endl;
+  if (map == nullptr) {
+    return 1;
+  }
+  if (argc == 2) {
+    symbolicate(*map, std::cin, std::cout);
+    return 0;
+  }
+  // Symbolicate a batch of traces against the one mapping of the map.
+  int status = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::ifstream in(argv[i]);
+    std::ofstream out(std::string(argv[i]) + ".symbolicated");
+    if (!in || !out) {
+      std::cerr << "Cannot symbolicate " << argv[i] << "\n";
+      status = 1;
+      continue;
     }
+    symbolicate(*map, in, out);
   }
+  return status;
 }
@@ -5,27 +5,126 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
 #include <getopt.h>
 #include <regex>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
 
 #include "DexCommon.h"
 
 void print_usage() {
-  fprintf(stderr, "Usage: dexgrep <classname> <dexfile 1> <dexfile 2> ...\n");
+  fprintf(stderr,
+          "Usage: dexgrep [-l] [-F] [-t] [-j <jobs>] <classname> "
+          "<dexfile 1> <dexfile 2> ...\n"
+          "  -l: only print the names of the dex files that match\n"
+          "  -F: the classname is a full type descriptor, looked up in the\n"
+          "      sorted string table of each dex instead of matched as a\n"
+          "      regex against every class\n"
+          "  -t: match the types that are referenced, not only the classes\n"
+          "      that are defined\n"
+          "  -j: the number of dex files to search at once\n");
 }
 
+namespace {
+
+struct Options {
+  bool files_only{false};
+  bool fixed_string{false};
+  bool type_refs{false};
+};
+
+void print_match(const Options& options,
+                 const char* dexfile,
+                 const char* name,
+                 std::string& out) {
+  out += dexfile;
+  if (!options.files_only) {
+    out += ": ";
+    out += name;
+  }
+  out += '\n';
+}
+
+/*
+ * Finds the classes of the dex that match, straight from the mapped file,
+ * and returns what is to be printed for them.
+ */
+std::string grep_dex(const Options& options,
+                     const char* search_str,
+                     const std::regex& re,
+                     const char* dexfile) {
+  std::string out;
+  ddump_data rd;
+  open_dex_file(dexfile, &rd);
+
+  if (options.fixed_string) {
+    // The string ids are sorted, so the descriptor is found with a binary
+    // search instead of a comparison with every name.
+    uint32_t string_idx;
+    uint16_t type_idx;
+    char* name = find_string_in_dex(&rd, search_str, &string_idx);
+    if (name != nullptr && find_typeid_for_idx(&rd, string_idx, &type_idx)) {
+      bool found = options.type_refs;
+      for (uint32_t j = 0; j < rd.dexh->class_defs_size && !found; j++) {
+        found = rd.dex_class_defs[j].typeidx == type_idx;
+      }
+      if (found) {
+        print_match(options, dexfile, name, out);
+      }
+    }
+  } else {
+    auto size =
+        options.type_refs ? rd.dexh->type_ids_size : rd.dexh->class_defs_size;
+    for (uint32_t j = 0; j < size; j++) {
+      auto type_idx =
+          options.type_refs ? j : (rd.dex_class_defs + j)->typeidx;
+      char* name = dex_string_by_type_idx(&rd, type_idx);
+      if (std::regex_search(name, re)) {
+        print_match(options, dexfile, name, out);
+        if (options.files_only) {
+          break;
+        }
+      }
+    }
+  }
+
+  munmap(rd.dexmmap, rd.dex_size);
+  return out;
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
-  bool files_only = false;
-  char c;
-  static const struct option options[] = {
+  Options options;
+  unsigned int jobs = std::thread::hardware_concurrency();
+  int c;
+  static const struct option long_options[] = {
       {"files-without-match", no_argument, nullptr, 'l'},
+      {"fixed-strings", no_argument, nullptr, 'F'},
+      {"type-refs", no_argument, nullptr, 't'},
+      {"jobs", required_argument, nullptr, 'j'},
+      {nullptr, 0, nullptr, 0},
   };
-  while ((c = getopt_long(argc, argv, "hl", &options[0], nullptr)) != -1) {
+  while ((c = getopt_long(argc, argv, "hlFtj:", &long_options[0], nullptr)) !=
+         -1) {
     switch (c) {
     case 'l':
-      files_only = true;
+      options.files_only = true;
+      break;
+    case 'F':
+      options.fixed_string = true;
+      break;
+    case 't':
+      options.type_refs = true;
+      break;
+    case 'j':
+      jobs = atoi(optarg);
       break;
     case 'h':
       print_usage();
@@ -43,24 +142,27 @@ int main(int argc, char* argv[]) {
   }
 
   const char* search_str = argv[optind];
-  std::regex re(search_str);
-
-  for (int i = optind + 1; i < argc; ++i) {
-    const char* dexfile = argv[i];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
+  std::regex re(options.fixed_string ? "" : search_str);
 
-    auto size = rd.dexh->class_defs_size;
-    for (uint32_t j = 0; j < size; j++) {
-      dex_class_def* cls_def = rd.dex_class_defs + j;
-      char* name = dex_string_by_type_idx(&rd, cls_def->typeidx);
-      if (std::regex_search(name, re)) {
-        if (files_only) {
-          printf("%s\n", dexfile);
-        } else {
-          printf("%s: %s\n", dexfile, name);
-        }
-      }
+  // The dex files are searched in parallel, and what each one matched is
+  // printed in the order of the arguments.
+  std::vector<const char*> dexfiles(argv + optind + 1, argv + argc);
+  std::vector<std::string> outputs(dexfiles.size());
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < dexfiles.size(); i = next++) {
+      outputs[i] = grep_dex(options, search_str, re, dexfiles[i]);
     }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < std::max(jobs, 1u); i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& out : outputs) {
+    fputs(out.c_str(), stdout);
   }
 }
@@ -11,9 +11,11 @@
 #include "DexOpcodeDefs.h"
 #include "file-utils.h"
 
+#include <atomic>
 #include <cstdio>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -54,6 +56,34 @@ static void foreach_pair(const T1& t1, const T2& t2, const L& fn) {
   }
 }
 
+// Returns fn(0), ..., fn(size - 1), computed on up to one thread per core.
+template <typename T, typename L>
+static std::vector<T> parallel_map(size_t size, const L& fn) {
+  std::vector<std::unique_ptr<T>> results(size);
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < size; i = next++) {
+      results[i] = std::unique_ptr<T>(new T(fn(i)));
+    }
+  };
+  std::vector<std::thread> threads;
+  auto num_threads =
+      std::min<size_t>(size, std::max(1u, std::thread::hardware_concurrency()));
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::vector<T> ret;
+  ret.reserve(size);
+  for (auto& result : results) {
+    ret.push_back(std::move(*result));
+  }
+  return ret;
+}
+
 template <uint32_t Width>
 uint32_t align(uint32_t in) {
   return (in + (Width - 1)) & -Width;
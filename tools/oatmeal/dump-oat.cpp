@@ -1563,15 +1563,19 @@ class SamsungLookupTables {
       const std::vector<DexInput>& dex_input_vec,
       const std::vector<DexFileListing_064::DexFile_064>& dex_files,
       FileHandle& cksum_fh) {
+    CHECK(dex_input_vec.size() == dex_files.size());
+    // The tables of all dex files are built at once, and written in order.
+    auto tables = parallel_map<LookupTable>(
+        dex_input_vec.size(), [&](size_t i) {
+          return build_lookup_table(dex_input_vec[i].filename);
+        });
     foreach_pair(
-        dex_input_vec,
+        tables,
         dex_files,
-        [&](const DexInput& dex_input,
+        [&](const LookupTable& table,
             const DexFileListing_064::DexFile_064& dex_file) {
           CHECK(dex_file.lookup_table_offset == cksum_fh.bytes_written());
 
-          auto table = build_lookup_table(dex_input.filename);
-
           auto buf =
               ConstBuffer{reinterpret_cast<const char*>(table.data.get()),
                           table.byte_size()};
@@ -1784,10 +1788,18 @@ class LookupTables {
       const std::vector<DexInput>& dex_input_vec,
       const std::vector<DexFileType>& dex_files,
       FileHandle& cksum_fh) {
+    CHECK(dex_input_vec.size() == dex_files.size());
+    // The tables of all dex files are built at once, and written in order.
+    using TableBuf = std::unique_ptr<LookupTableEntry[]>;
+    auto tables =
+        parallel_map<TableBuf>(dex_input_vec.size(), [&](size_t i) {
+          return build_lookup_table(dex_input_vec[i].filename,
+                                    numEntries(dex_files[i].num_classes));
+        });
     foreach_pair(
-        dex_input_vec,
+        tables,
         dex_files,
-        [&](const DexInput& dex_input,
+        [&](const TableBuf& lookup_table_buf,
             const DexFileListing_079::DexFile_079& dex_file) {
           CHECK(dex_file.lookup_table_offset == cksum_fh.bytes_written());
           const auto num_classes = dex_file.num_classes;
@@ -1796,8 +1808,6 @@ class LookupTables {
           const auto lookup_table_byte_size =
               lookup_table_size * sizeof(LookupTableEntry);
 
-          auto lookup_table_buf =
-              build_lookup_table(dex_input.filename, lookup_table_size);
           auto buf =
               ConstBuffer{reinterpret_cast<const char*>(lookup_table_buf.get()),
                           lookup_table_byte_size};
@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "ApkPacker.h"
+
+static const char usage_string[] =
+    "ReDex, APK packing tool\n"
+    "\nredex-pack-apk writes an aligned APK from the directory an APK was\n"
+    "extracted to, reusing the compressed entries of the original APK for the\n"
+    "files that didn't change\n"
+    "\n"
+    "Usage:\n"
+    "\tredex-pack-apk [-i <original.apk>] [-p] [-a <n>] <dir> <output.apk>\n"
+    "\noptions:\n"
+    "-h, --help: help summary\n"
+    "-i, --input-apk=<apk>: the APK that <dir> was extracted from\n"
+    "-a, --alignment=<n>: align stored entries at <n> bytes (default 4)\n"
+    "-p, --page-align-libs: align stored .so files at the page size\n";
+
+int main(int argc, char* argv[]) {
+  std::string input_apk;
+  ApkPacker::Options options;
+
+  int c;
+  static const struct option long_options[] = {
+    { "input-apk", required_argument, nullptr, 'i' },
+    { "alignment", required_argument, nullptr, 'a' },
+    { "page-align-libs", no_argument, nullptr, 'p' },
+    { "help", no_argument, nullptr, 'h' },
+    { nullptr, 0, nullptr, 0 },
+  };
+
+  while ((c = getopt_long(
+            argc,
+            argv,
+            "i:a:ph",
+            &long_options[0],
+            nullptr)) != -1) {
+    switch (c) {
+      case 'i':
+        input_apk = optarg;
+        break;
+      case 'a':
+        sscanf(optarg, "%zu", &options.alignment);
+        break;
+      case 'p':
+        options.page_align_libs = true;
+        break;
+      case 'h':
+        puts(usage_string);
+        return 0;
+      case '?':
+        return 1; // getopt_long has printed an error
+      default:
+        abort();
+    }
+  }
+
+  if (argc - optind != 2) {
+    fprintf(stderr, "%s: expected a directory and an output apk; "
+                    "use -h for help\n", argv[0]);
+    return 1;
+  }
+
+  ApkPacker::Stats stats;
+  if (!ApkPacker::pack(input_apk, argv[optind], argv[optind + 1], options,
+                       &stats)) {
+    return 1;
+  }
+  printf("Copied %zu entries, compressed %zu, stored %zu\n",
+         stats.copied_entries, stats.compressed_entries,
+         stats.stored_entries);
+  return 0;
+}
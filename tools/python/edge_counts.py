@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""
+Turns the edge counts of InstrumentPass' edge_counting strategy into a basic
+block profile, as BasicBlockLayoutPass and the other profile-guided passes
+read it along with the index file of the instrumented build:
+
+  edge_counts.py <edge metadata file> <counts file> [<profile file>]
+
+The counts file holds the values of the analysis class' sEdgeCounts, in
+order, separated by whitespace or commas. The profile has lines of
+  <method id>,<block id>,<hits>
+for every block that has a block id in the basic block profile.
+"""
+
+import re
+import sys
+from collections import defaultdict
+
+
+EXIT = "x"
+
+
+class MethodGraph(object):
+    def __init__(self):
+        # Block to its block id of the basic block profile, or -1.
+        self.blocks = {}
+        # (source, target, counter index) of each edge, in file order.
+        self.edges = []
+
+
+def read_metadata(lines):
+    methods = defaultdict(MethodGraph)
+    for line in lines:
+        fields = line.strip().split(",")
+        if fields[0] == "B":
+            _, method_id, block, profile_block = fields
+            methods[int(method_id)].blocks[block] = int(profile_block)
+        elif fields[0] == "E":
+            _, method_id, src, target, index = fields
+            methods[int(method_id)].edges.append((src, target, int(index)))
+    return methods
+
+
+def read_counts(text):
+    return [int(count) for count in re.split(r"[\s,]+", text) if count]
+
+
+def solve_edges(graph, counts):
+    """
+    The count of every edge of the method. The uncounted edges form a
+    spanning tree, so there is always a node with a single one of them left,
+    whose count makes the flow into the node equal to the flow out of it.
+    Lost increments may make that negative, which is taken as 0.
+    """
+    values = [None] * len(graph.edges)
+    unknown = defaultdict(set)
+    for i, (src, target, index) in enumerate(graph.edges):
+        if index >= 0:
+            if index >= len(counts):
+                raise Exception("No count for counter %d" % index)
+            values[i] = counts[index]
+        else:
+            unknown[src].add(i)
+            unknown[target].add(i)
+
+    incident = defaultdict(list)
+    for i, (src, target, _) in enumerate(graph.edges):
+        incident[src].append(i)
+        incident[target].append(i)
+
+    worklist = [node for node, edges in unknown.items() if len(edges) == 1]
+    while worklist:
+        node = worklist.pop()
+        if len(unknown[node]) != 1:
+            continue
+        edge = next(iter(unknown[node]))
+        flow = 0
+        for i in incident[node]:
+            if i == edge:
+                continue
+            src, target, _ = graph.edges[i]
+            if target == node:
+                flow += values[i]
+            if src == node:
+                flow -= values[i]
+        # The unknown edge makes up for the difference.
+        src, target, _ = graph.edges[edge]
+        values[edge] = max(0, -flow if target == node else flow)
+        for end in (src, target):
+            unknown[end].discard(edge)
+            if len(unknown[end]) == 1:
+                worklist.append(end)
+
+    if any(value is None for value in values):
+        raise Exception("The uncounted edges are not a spanning tree")
+    return values
+
+
+def block_counts(graph, counts):
+    """How often each block of the method ran: the flow into it."""
+    values = solve_edges(graph, counts)
+    hits = {block: 0 for block in graph.blocks}
+    for (_, target, _), value in zip(graph.edges, values):
+        if target != EXIT:
+            hits[target] += value
+    return hits
+
+
+def profile(methods, counts):
+    """
+    (method id, block id, hits) for each block of the basic block profile.
+    Where several blocks of the instrumented CFG start in the same block of
+    the profile, it ran as often as the busiest of them.
+    """
+    lines = []
+    for method_id in sorted(methods):
+        graph = methods[method_id]
+        profile_hits = {}
+        for block, hits in block_counts(graph, counts).items():
+            profile_block = graph.blocks[block]
+            if profile_block < 0:
+                continue
+            profile_hits[profile_block] = max(
+                hits, profile_hits.get(profile_block, 0)
+            )
+        for profile_block, hits in sorted(profile_hits.items()):
+            lines.append((method_id, profile_block, hits))
+    return lines
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    with open(sys.argv[1]) as f:
+        methods = read_metadata(f)
+    with open(sys.argv[2]) as f:
+        counts = read_counts(f.read())
+    out = open(sys.argv[3], "w") if len(sys.argv) == 4 else sys.stdout
+    for line in profile(methods, counts):
+        out.write("%d,%d,%d\n" % line)
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+import unittest
+
+import edge_counts
+
+
+# What InstrumentPass writes for the loop around a diamond of
+# InstrumentEdgesTest, as method 7 with the counters from 3 on. Block 2
+# branches to 4 on even numbers and falls through to 3 otherwise, and both
+# join in 5, which loops back to 1.
+LOOP_METADATA = """\
+B,7,0,0
+B,7,1,1
+B,7,2,2
+B,7,3,3
+B,7,4,4
+B,7,5,5
+B,7,6,6
+E,7,x,0,-1
+E,7,0,1,-1
+E,7,1,2,-1
+E,7,2,3,-1
+E,7,3,5,-1
+E,7,4,5,-1
+E,7,5,1,3
+E,7,1,6,-1
+E,7,2,4,4
+E,7,6,x,5
+"""
+
+
+class TestEdgeCounts(unittest.TestCase):
+    def test_block_counts_follow_from_the_counted_edges(self):
+        # Running the loop for 0, 5 and 2 goes around it 7 times, 3 of them
+        # on even numbers.
+        methods = edge_counts.read_metadata(LOOP_METADATA.splitlines())
+        counts = edge_counts.read_counts("11, 12, 13, 7, 3, 3\n")
+        self.assertEqual(
+            edge_counts.block_counts(methods[7], counts),
+            {"0": 3, "1": 10, "2": 7, "3": 4, "4": 3, "5": 7, "6": 3},
+        )
+        self.assertEqual(
+            edge_counts.profile(methods, counts),
+            [
+                (7, 0, 3),
+                (7, 1, 10),
+                (7, 2, 7),
+                (7, 3, 4),
+                (7, 4, 3),
+                (7, 5, 7),
+                (7, 6, 3),
+            ],
+        )
+
+    def test_catch_blocks_are_entered_from_the_exit_node(self):
+        # Block 0 branches to 1, which returns, or falls through to 2, which
+        # throws to the catch block 3. That goes on to 4, which returns and
+        # was in the same block as 3 before instrumentation.
+        methods = edge_counts.read_metadata(
+            """\
+B,0,0,0
+B,0,1,1
+B,0,2,2
+B,0,3,3
+B,0,4,3
+E,0,x,0,-1
+E,0,0,2,-1
+E,0,0,1,-1
+E,0,1,x,0
+E,0,2,x,1
+E,0,x,3,-1
+E,0,3,4,-1
+E,0,4,x,2
+""".splitlines()
+        )
+        counts = [4, 2, 2]
+        self.assertEqual(
+            edge_counts.block_counts(methods[0], counts),
+            {"0": 6, "1": 4, "2": 2, "3": 2, "4": 2},
+        )
+        self.assertEqual(
+            edge_counts.profile(methods, counts),
+            [(0, 0, 6), (0, 1, 4), (0, 2, 2), (0, 3, 2)],
+        )
+
+    def test_lost_increments_do_not_make_counts_negative(self):
+        methods = edge_counts.read_metadata(LOOP_METADATA.splitlines())
+        counts = [0, 0, 0, 7, 3, 0]
+        hits = edge_counts.block_counts(methods[7], counts)
+        self.assertTrue(all(count >= 0 for count in hits.values()))
+
+    def test_a_missing_counter_is_an_error(self):
+        methods = edge_counts.read_metadata(LOOP_METADATA.splitlines())
+        with self.assertRaises(Exception):
+            edge_counts.block_counts(methods[7], [1, 2, 3])
+
+
+if __name__ == "__main__":
+    unittest.main()
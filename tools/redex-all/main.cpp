@@ -5,8 +5,11 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
 #include <cinttypes>
+#include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -22,18 +25,22 @@
 #ifdef _MSC_VER
 #include <io.h>
 #else
+#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
 #include <json/json.h>
 
+#include "ClassHashes.h"
 #include "CommentFilter.h"
 #include "Debug.h"
 #include "DexClass.h"
 #include "DexLoader.h"
 #include "DexOutput.h"
+#include "EventTrace.h"
 #include "IODIMetadata.h"
 #include "InstructionLowering.h"
 #include "JarLoader.h"
@@ -50,6 +57,7 @@
 #include "ToolsCommon.h"
 #include "Walkers.h"
 #include "Warning.h"
+#include "WorkQueue.h"
 
 namespace {
 const std::string k_usage_header = "usage: redex-all [options...] dex-files...";
@@ -70,6 +78,7 @@ struct Arguments {
   Json::Value entry_data;
   boost::optional<int> stop_pass_idx;
   std::string output_ir_dir;
+  std::string resume_from_dir;
   RedexOptions redex_options;
 };
 
@@ -211,6 +220,23 @@ Arguments parse_args(int argc, char* argv[]) {
                    po::bool_switch(&args.redex_options.instrument_pass_enabled)
                        ->default_value(false),
                    "If specified, enables InstrumentPass if any.\n");
+  od.add_options()(
+      "num-threads",
+      po::value<unsigned int>(&args.redex_options.num_threads)
+          ->default_value(0),
+      "Number of threads that parallel passes use by default; 0 for one "
+      "per core.\n");
+  od.add_options()(
+      "pin-worker-threads",
+      po::bool_switch(&args.redex_options.pin_worker_threads)
+          ->default_value(false),
+      "If specified, pins each thread of the worker pool to a core.\n");
+  od.add_options()(
+      "numa-aware-threads",
+      po::bool_switch(&args.redex_options.numa_aware_threads)
+          ->default_value(false),
+      "If specified, spreads the threads of the worker pool over the NUMA "
+      "nodes, and gives each class to the threads of one node.\n");
   od.add_options()(",S",
                    po::value<std::vector<std::string>>(), // Accumulation
                    "-Skey=string\n"
@@ -236,14 +262,29 @@ Arguments parse_args(int argc, char* argv[]) {
       "be quoted.");
   od.add_options()("show-passes", "show registered passes");
   od.add_options()("dex-files", po::value<std::vector<std::string>>(),
-                   "dex files");
+                   "dex files, store metadata files, or APKs whose dexes "
+                   "are read without extracting them");
 
   // Development usage only, and Python script will generate the following
   // arguments.
   od.add_options()("stop-pass", po::value<int>(),
-                   "Stop before pass n and output IR to file");
+                   "Stop before pass n and output IR to file. With n = 0 this "
+                   "snapshots the state right after the frontend, which "
+                   "redex-opt can resume from");
   od.add_options()("output-ir", po::value<std::string>(),
-                   "IR output directory, used with --stop-pass");
+                   "IR output directory, used with --stop-pass and "
+                   "--checkpoint-after");
+  od.add_options()(
+      "checkpoint-after", po::value<std::string>(),
+      "Stop after the pass with this name, or after its run #k counting "
+      "from 0 with name#k, and output a checkpoint to the --output-ir "
+      "directory. Like --stop-pass, this runs RegAllocPass before the IR is "
+      "written");
+  od.add_options()(
+      "resume-from", po::value<std::string>(),
+      "Instead of loading the dex files, load a checkpoint written by "
+      "--checkpoint-after or --stop-pass, and run the passes of the config "
+      "that come after the ones it ran");
 
   po::positional_options_description pod;
   pod.add("dex-files", -1);
@@ -277,7 +318,7 @@ Arguments parse_args(int argc, char* argv[]) {
 
   if (vm.count("dex-files")) {
     args.dex_files = vm["dex-files"].as<std::vector<std::string>>();
-  } else {
+  } else if (!vm.count("resume-from")) {
     std::cerr << "error: no input dex files" << std::endl << std::endl;
     print_usage();
     exit(EXIT_SUCCESS);
@@ -382,6 +423,62 @@ Arguments parse_args(int argc, char* argv[]) {
     args.output_ir_dir = vm["output-ir"].as<std::string>();
   }
 
+  if (vm.count("resume-from")) {
+    // The passes that ran before the checkpoint have to be the first ones of
+    // the config; only the rest are run.
+    args.resume_from_dir = vm["resume-from"].as<std::string>();
+    Json::Value checkpoint_entry_data;
+    redex::load_entry_file(args.resume_from_dir, &checkpoint_entry_data);
+    const auto& checkpoint = checkpoint_entry_data["checkpoint"];
+    const auto& done = checkpoint["passes"];
+    auto& passes_list = args.config["redex"]["passes"];
+    if (!done.isArray() || done.size() > passes_list.size()) {
+      std::cerr << "error: " << args.resume_from_dir
+                << " is not a checkpoint of this config" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    for (Json::ArrayIndex i = 0; i < done.size(); ++i) {
+      if (passes_list[i] != done[i]) {
+        std::cerr << "error: the checkpoint ran " << done[i].asString()
+                  << " where the config has " << passes_list[i].asString()
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    Json::Value rest(Json::arrayValue);
+    for (Json::ArrayIndex i = done.size(); i < passes_list.size(); ++i) {
+      rest.append(passes_list[i]);
+    }
+    passes_list = rest;
+    args.entry_data["checkpoint"] = checkpoint;
+  }
+
+  if (vm.count("checkpoint-after")) {
+    if (args.stop_pass_idx != boost::none) {
+      std::cerr << "error: --checkpoint-after can't be used with --stop-pass"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    // The name of a pass, or name#k for its run #k, counting from 0 as
+    // redex.py does.
+    const auto& name = vm["checkpoint-after"].as<std::string>();
+    auto hash = name.find('#');
+    auto pass_name = name.substr(0, hash);
+    int run = hash == std::string::npos ? 0 : atoi(name.c_str() + hash + 1);
+    const auto& passes_list = args.config["redex"]["passes"];
+    for (Json::ArrayIndex i = 0; i < passes_list.size(); ++i) {
+      if (passes_list[i].asString() == pass_name && run-- == 0) {
+        args.stop_pass_idx = i + 1;
+        break;
+      }
+    }
+    if (args.stop_pass_idx == boost::none) {
+      std::cerr << "error: checkpoint-after: " << name
+                << " is not in the passes list" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
   if (args.stop_pass_idx != boost::none) {
     // Resize the passes list and append an additional RegAllocPass if its final
     // pass is not RegAllocPass.
@@ -391,6 +488,15 @@ Arguments parse_args(int argc, char* argv[]) {
       std::cerr << "Invalid stop_pass value\n";
       exit(EXIT_FAILURE);
     }
+    // Record the passes of the config that the output ran, so that it can be
+    // resumed from.
+    auto& done = args.entry_data["checkpoint"]["passes"];
+    if (done.isNull()) {
+      done = Json::arrayValue;
+    }
+    for (int i = 0; i < idx; ++i) {
+      done.append(passes_list[i]);
+    }
     if (passes_list.size() > (size_t)idx) {
       passes_list.resize(idx);
     }
@@ -444,6 +550,8 @@ Json::Value get_stats(const dex_stats_t& stats) {
 
   val["num_dbg_items"] = stats.num_dbg_items;
   val["dbg_total_size"] = stats.dbg_total_size;
+
+  val["num_coldstart_pages"] = stats.num_coldstart_pages;
   return val;
 }
 
@@ -462,6 +570,56 @@ Json::Value get_pass_stats(const PassManager& mgr) {
   return all;
 }
 
+/*
+ * The metrics of each pass that ran, in order, for the checkpoint to keep.
+ * Unlike get_pass_stats(), this keeps apart the runs of the same pass before
+ * and after a checkpoint.
+ */
+Json::Value get_checkpoint_pass_stats(const PassManager& mgr) {
+  Json::Value all(Json::arrayValue);
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    Json::Value pass;
+    pass["name"] = pass_info.name;
+    pass["metrics"] = Json::objectValue;
+    for (const auto& pass_metric : pass_info.metrics) {
+      pass["metrics"][pass_metric.first] = pass_metric.second;
+    }
+    all.append(pass);
+  }
+  return all;
+}
+
+Json::Value get_memory_stats(const PassManager& mgr) {
+  Json::Value all(Json::ValueType::objectValue);
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    if (!pass_info.memory_after) {
+      continue;
+    }
+    all[pass_info.name] = memory_accounting::to_json(*pass_info.memory_after);
+  }
+  return all;
+}
+
+Json::Value get_slowest_methods_stats(const PassManager& mgr) {
+  Json::Value all(Json::ValueType::objectValue);
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    if (!pass_info.slowest_methods.empty()) {
+      all[pass_info.name] = method_costs::to_json(pass_info.slowest_methods);
+    }
+  }
+  return all;
+}
+
+Json::Value get_released_memory_stats(const PassManager& mgr) {
+  Json::Value all(Json::ValueType::objectValue);
+  for (const auto& pass_info : mgr.get_pass_info()) {
+    if (pass_info.released_bytes) {
+      all[pass_info.name] = Json::UInt64(*pass_info.released_bytes);
+    }
+  }
+  return all;
+}
+
 Json::Value get_lowering_stats(const instruction_lowering::Stats& stats) {
   Json::Value obj(Json::ValueType::objectValue);
   obj["num_2addr_instructions"] = Json::UInt(stats.to_2addr);
@@ -505,6 +663,9 @@ Json::Value get_output_stats(
   d["total_stats"] = get_stats(stats);
   d["dexes_stats"] = get_detailed_stats(dexes_stats);
   d["pass_stats"] = get_pass_stats(mgr);
+  d["memory_stats"] = get_memory_stats(mgr);
+  d["released_memory_stats"] = get_released_memory_stats(mgr);
+  d["slowest_methods_stats"] = get_slowest_methods_stats(mgr);
   d["lowering_stats"] = get_lowering_stats(instruction_lowering_stats);
   return d;
 }
@@ -570,54 +731,93 @@ void write_debug_line_mapping(
   size_t bit_32_size = sizeof(uint32_t);
   size_t bit_64_size = sizeof(uint64_t);
   uint32_t num_method = code_debug_lines.size();
-  int offset = num_method + 2;
-  // Start of debug line info information would be after all of
-  // method-id => offset info, so set the start of offset to be after that.
-  int binary_offset =
-      3 * bit_32_size + (bit_64_size + 2 * bit_32_size) * num_method;
-  std::ofstream ofs(debug_line_mapping_filename_v2.c_str(),
-                    std::ofstream::out | std::ofstream::trunc);
-  uint32_t magic = 0xfaceb000; // serves as endianess check
-  ofs.write((const char*)&magic, bit_32_size);
-  uint32_t version = 1;
-  ofs.write((const char*)&version, bit_32_size);
-  ofs.write((const char*)&num_method, bit_32_size);
-  std::ostringstream line_out;
 
+  std::vector<std::pair<uint64_t, const std::vector<DebugLineItem>*>> methods;
+  methods.reserve(num_method);
   auto scope = build_class_scope(stores);
   walk::methods(scope, [&](DexMethod* method) {
     auto dex_code = method->get_dex_code();
-    if (dex_code == nullptr ||
-        code_debug_lines.find(dex_code) == code_debug_lines.end()) {
+    if (dex_code == nullptr) {
       return;
     }
+    auto it = code_debug_lines.find(dex_code);
+    if (it == code_debug_lines.end()) {
+      return;
+    }
+    methods.emplace_back(method_to_id.at(method), &it->second);
+  });
 
-    uint64_t method_id = method_to_id.at(method);
+  // Every section's size is known upfront, so the whole file is laid out
+  // first and the sections are then filled in parallel.
+  size_t header_size = 3 * bit_32_size;
+  size_t index_entry_size = bit_64_size + 2 * bit_32_size;
+  std::vector<uint32_t> section_offsets;
+  section_offsets.reserve(methods.size());
+  // Start of debug line info information would be after all of
+  // method-id => offset info, so set the start of offset to be after that.
+  size_t binary_offset = header_size + index_entry_size * num_method;
+  for (const auto& method : methods) {
+    section_offsets.push_back(binary_offset);
+    binary_offset += bit_64_size + method.second->size() * 2 * bit_32_size;
+  }
+  std::vector<char> out(binary_offset);
+  auto put = [&](size_t offset, const auto& value) {
+    memcpy(out.data() + offset, &value, sizeof(value));
+  };
+  uint32_t magic = 0xfaceb000; // serves as endianess check
+  put(0, magic);
+  uint32_t version = 1;
+  put(bit_32_size, version);
+  put(2 * bit_32_size, num_method);
+
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    uint64_t method_id = methods[i].first;
+    const auto& debug_lines = *methods[i].second;
+    uint32_t section_offset = section_offsets[i];
+    uint32_t info_section_size =
+        bit_64_size + debug_lines.size() * 2 * bit_32_size;
     // write method id => offset info for binary file
-    ofs.write((const char*)&method_id, bit_64_size);
-    ofs.write((const char*)&binary_offset, bit_32_size);
-
-    auto debug_lines = code_debug_lines.at(dex_code);
-    uint32_t num_line_info = debug_lines.size();
-    offset = offset + 1 + num_line_info;
-    uint32_t info_section_size = bit_64_size + num_line_info * 2 * bit_32_size;
-    ofs.write((const char*)&info_section_size, bit_32_size);
-    binary_offset = binary_offset + info_section_size;
+    size_t index_offset = header_size + index_entry_size * i;
+    put(index_offset, method_id);
+    put(index_offset + bit_64_size, section_offset);
+    put(index_offset + bit_64_size + bit_32_size, info_section_size);
 
     // Generate debug line info for binary file.
-    line_out.write((const char*)&method_id, bit_64_size);
-    for (auto it = debug_lines.begin(); it != debug_lines.end(); ++it) {
-      line_out.write((const char*)&it->offset, bit_32_size);
-      line_out.write((const char*)&it->line, bit_32_size);
+    put(section_offset, method_id);
+    size_t offset = section_offset + bit_64_size;
+    for (const auto& item : debug_lines) {
+      put(offset, item.offset);
+      put(offset + bit_32_size, item.line);
+      offset += 2 * bit_32_size;
     }
   });
-  ofs << line_out.str();
+  for (size_t i = 0; i < methods.size(); ++i) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+
+  std::ofstream ofs(debug_line_mapping_filename_v2.c_str(),
+                    std::ofstream::out | std::ofstream::trunc);
+  ofs.write(out.data(), out.size());
+}
+
+static bool is_apk(const std::string& filename) {
+  return filename.size() >= 5 &&
+         filename.compare(filename.size() - 4, 4, ".apk") == 0;
 }
 
 const std::string get_dex_magic(std::vector<std::string>& dex_files) {
   always_assert_log(dex_files.size() > 0, "APK contains no dex file\n");
   // Get dex magic from the first dex file since all dex magic
   // should be consistent within one APK.
+  if (is_apk(dex_files[0])) {
+    auto apk = ApkDexes::open(dex_files[0].c_str());
+    always_assert_log(apk != nullptr && !apk->get_dexes().empty(),
+                      "APK contains no dex file\n");
+    auto dh =
+        reinterpret_cast<const dex_header*>(apk->get_dexes()[0].data);
+    return dh->magic;
+  }
   return load_dex_magic_from_dex(dex_files[0].c_str());
 }
 
@@ -666,38 +866,62 @@ void redex_frontend(ConfigFiles& conf, /* input */
 
   {
     Timer t("Load classes from dexes");
-    dex_stats_t input_totals;
-    std::vector<dex_stats_t> input_dexes_stats;
+    // Gather the dexes of every store first, so that they can all be loaded
+    // on one work queue.
+    std::vector<std::string> dex_paths;
+    std::vector<size_t> dex_store_indices;
+    // The dexes of APKs are read from the APK in place, without extracting
+    // them. They go into the root store, ahead of any loose dex files.
+    std::vector<DexBuffer> apk_dexes;
     for (const auto& filename : args.dex_files) {
-      if (filename.size() >= 5 &&
-          filename.compare(filename.size() - 4, 4, ".dex") == 0) {
+      if (is_apk(filename)) {
+        auto apk = ApkDexes::open(filename.c_str());
+        always_assert_log(apk != nullptr, "Cannot read dexes from %s\n",
+                          filename.c_str());
+        for (const auto& dex : apk->get_dexes()) {
+          assert_dex_magic_consistency(
+              stores[0].get_dex_magic(),
+              reinterpret_cast<const dex_header*>(dex.data)->magic);
+          apk_dexes.push_back(dex);
+        }
+      } else if (filename.size() >= 5 &&
+                 filename.compare(filename.size() - 4, 4, ".dex") == 0) {
         assert_dex_magic_consistency(stores[0].get_dex_magic(),
                                      load_dex_magic_from_dex(filename.c_str()));
-        dex_stats_t dex_stats;
-        DexClasses classes =
-            load_classes_from_dex(filename.c_str(), &dex_stats);
-        input_totals += dex_stats;
-        input_dexes_stats.push_back(dex_stats);
-        stores[0].add_classes(std::move(classes));
+        dex_paths.push_back(filename);
+        dex_store_indices.push_back(0);
       } else {
         DexMetadata store_metadata;
         store_metadata.parse(filename);
-        DexStore store(store_metadata);
+        stores.emplace_back(store_metadata);
         for (const auto& file_path : store_metadata.get_files()) {
           assert_dex_magic_consistency(
               stores[0].get_dex_magic(),
               load_dex_magic_from_dex(file_path.c_str()));
-          dex_stats_t dex_stats;
-          DexClasses classes =
-              load_classes_from_dex(file_path.c_str(), &dex_stats);
-
-          input_totals += dex_stats;
-          input_dexes_stats.push_back(dex_stats);
-          store.add_classes(std::move(classes));
+          dex_paths.push_back(file_path);
+          dex_store_indices.push_back(stores.size() - 1);
         }
-        stores.emplace_back(std::move(store));
       }
     }
+    dex_stats_t input_totals;
+    std::vector<dex_stats_t> input_dexes_stats;
+    if (!apk_dexes.empty()) {
+      auto dex_classes =
+          load_classes_from_dex_buffers(apk_dexes, &input_dexes_stats);
+      for (size_t i = 0; i < apk_dexes.size(); ++i) {
+        input_totals += input_dexes_stats[i];
+        stores[0].add_classes(std::move(dex_classes[i]));
+      }
+    }
+    std::vector<dex_stats_t> file_dexes_stats;
+    auto dex_classes = load_classes_from_dexes(dex_paths, &file_dexes_stats);
+    for (size_t i = 0; i < dex_paths.size(); ++i) {
+      input_totals += file_dexes_stats[i];
+      stores[dex_store_indices[i]].add_classes(std::move(dex_classes[i]));
+    }
+    input_dexes_stats.insert(input_dexes_stats.end(),
+                             file_dexes_stats.begin(),
+                             file_dexes_stats.end());
     stats["input_stats"] = get_input_stats(input_totals, input_dexes_stats);
   }
 
@@ -741,8 +965,16 @@ void redex_frontend(ConfigFiles& conf, /* input */
     bool keep_all_annotation_classes;
     conf.get_json_config().get("keep_all_annotation_classes", true,
                                keep_all_annotation_classes);
-    process_proguard_rules(conf.get_proguard_map(), scope, external_classes,
-                           pg_config, keep_all_annotation_classes);
+    auto keep_stats = process_proguard_rules(
+        conf.get_proguard_map(), scope, external_classes, pg_config,
+        keep_all_annotation_classes);
+    auto& keep_rules = stats["keep_rules"];
+    keep_rules["duplicate_rules"] = Json::UInt64(keep_stats.duplicate_rules);
+    keep_rules["class_matches"] = Json::UInt64(keep_stats.class_matches);
+    keep_rules["cached_class_matches"] =
+        Json::UInt64(keep_stats.cached_class_matches);
+    keep_rules["classes_not_retested"] =
+        Json::UInt64(keep_stats.classes_not_retested);
   }
   {
     Timer t("No Optimizations Rules");
@@ -758,6 +990,36 @@ void redex_frontend(ConfigFiles& conf, /* input */
   }
 }
 
+/**
+ * Instead of the frontend: load the IR of a checkpoint, and what the passes
+ * before it left for the rest of the run.
+ */
+void redex_resume(Arguments& args, /* inout */
+                  redex::ProguardConfiguration& pg_config,
+                  DexStoresVector& stores,
+                  Json::Value& stats) {
+  Timer redex_resume_timer("Redex_resume");
+  // The keep rules are already in the IR meta of the checkpoint. They are
+  // parsed again for the passes that look at the rules themselves.
+  for (const auto& pg_config_path : args.proguard_config_paths) {
+    Timer time_pg_parsing("Parsed ProGuard config file");
+    redex::proguard_parser::parse_file(pg_config_path, &pg_config);
+  }
+
+  Json::Value checkpoint_entry_data;
+  redex::load_all_intermediate(args.resume_from_dir, stores,
+                               &checkpoint_entry_data);
+  // Set input dex magic to the first DexStore from the first dex file
+  if (!stores.empty()) {
+    auto first_dex_path =
+        boost::filesystem::path(args.resume_from_dir) /
+        checkpoint_entry_data["dex_list"][0]["list"][0].asString();
+    stores[0].set_dex_magic(load_dex_magic_from_dex(first_dex_path.c_str()));
+  }
+  args.entry_data["jars"] = checkpoint_entry_data["jars"];
+  stats["input_stats"] = args.entry_data["checkpoint"]["input_stats"];
+}
+
 /**
  * Post processing steps: write dex and collect stats
  */
@@ -796,6 +1058,8 @@ void redex_backend(const PassManager& manager,
 
   auto pos_output_v2 =
       conf.metafile(json_cfg.get("line_number_map_v2", std::string()));
+  auto pos_output_v3 =
+      conf.metafile(json_cfg.get("line_number_map_v3", std::string()));
   auto debug_line_mapping_filename_v2 =
       conf.metafile(json_cfg.get("debug_line_method_map_v2", std::string()));
   auto iodi_metadata_filename =
@@ -815,7 +1079,7 @@ void redex_backend(const PassManager& manager,
   }
 
   std::unique_ptr<PositionMapper> pos_mapper(
-      PositionMapper::make(pos_output_v2));
+      PositionMapper::make(pos_output_v2, pos_output_v3));
   std::unordered_map<DexMethod*, uint64_t> method_to_id;
   std::unordered_map<DexCode*, std::vector<DebugLineItem>> code_debug_lines;
   IODIMetadata iodi_metadata(iodi_enable_overloaded_methods);
@@ -825,9 +1089,14 @@ void redex_backend(const PassManager& manager,
     Timer t("Compute initial IODI metadata");
     iodi_metadata.mark_methods(stores);
   }
+  struct DexJob {
+    size_t store_number;
+    size_t dex_number;
+    std::string filename;
+  };
+  std::vector<DexJob> dex_jobs;
   for (size_t store_number = 0; store_number < stores.size(); ++store_number) {
     auto& store = stores[store_number];
-    Timer t("Writing optimized dexes");
     for (size_t i = 0; i < store.get_dexen().size(); i++) {
       std::ostringstream ss;
       ss << output_dir << "/" << store.get_name();
@@ -843,27 +1112,83 @@ void redex_backend(const PassManager& manager,
         ss << (i + 2);
       }
       ss << ".dex";
-      auto this_dex_stats = write_classes_to_dex(
-          ss.str(),
-          &store.get_dexen()[i],
-          locator_index,
-          emit_name_based_locators,
-          store_number,
-          i,
-          conf,
-          pos_mapper.get(),
-          needs_method_to_id ? &method_to_id : nullptr,
-          debug_line_mapping_filename_v2.empty() ? nullptr : &code_debug_lines,
-          iodi_metadata_filename.empty() ? nullptr : &iodi_metadata,
-          stores[0].get_dex_magic());
-      output_totals += this_dex_stats;
-      output_dexes_stats.push_back(this_dex_stats);
+      dex_jobs.push_back({store_number, i, ss.str()});
     }
   }
 
-  if (!iodi_metadata_filename.empty()) {
-    Timer t("Compute IODI caller metadata");
-    iodi_metadata.mark_callers();
+  auto write_dex = [&](const DexJob& job,
+                       DexEmissionOrder* emission_order,
+                       size_t ticket) {
+    return write_classes_to_dex(
+        job.filename,
+        &stores[job.store_number].get_dexen()[job.dex_number],
+        locator_index,
+        emit_name_based_locators,
+        job.store_number,
+        job.dex_number,
+        conf,
+        pos_mapper.get(),
+        needs_method_to_id ? &method_to_id : nullptr,
+        debug_line_mapping_filename_v2.empty() ? nullptr : &code_debug_lines,
+        iodi_metadata_filename.empty() ? nullptr : &iodi_metadata,
+        stores[0].get_dex_magic(),
+        emission_order,
+        ticket);
+  };
+
+  if (json_cfg.get("parallel_dex_output", false)) {
+    Timer t("Writing optimized dexes (parallel)");
+    // Dexes are claimed strictly in serial order, which DexEmissionOrder
+    // relies on to make progress: the oldest unfinished dex always belongs to
+    // a running thread.
+    output_dexes_stats.resize(dex_jobs.size());
+    DexEmissionOrder emission_order;
+    std::atomic<size_t> next_job{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto worker = [&]() {
+      for (size_t ticket = next_job++; ticket < dex_jobs.size();
+           ticket = next_job++) {
+        try {
+          output_dexes_stats[ticket] =
+              write_dex(dex_jobs[ticket], &emission_order, ticket);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      }
+    };
+    size_t num_threads = std::min<size_t>(
+        dex_jobs.size(),
+        std::max(1u, boost::thread::hardware_concurrency()));
+    std::vector<boost::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    for (const auto& this_dex_stats : output_dexes_stats) {
+      output_totals += this_dex_stats;
+    }
+  } else {
+    size_t job_idx = 0;
+    for (size_t store_number = 0; store_number < stores.size();
+         ++store_number) {
+      Timer t("Writing optimized dexes");
+      for (; job_idx < dex_jobs.size() &&
+             dex_jobs[job_idx].store_number == store_number;
+           ++job_idx) {
+        auto this_dex_stats = write_dex(dex_jobs[job_idx], nullptr, 0);
+        output_totals += this_dex_stats;
+        output_dexes_stats.push_back(this_dex_stats);
+      }
+    }
   }
 
   {
@@ -898,6 +1223,63 @@ void redex_backend(const PassManager& manager,
   }
 }
 
+/*
+ * Compares the content hashes of the input classes with those of the last
+ * build that used the same hashes file, and reports the classes that changed
+ * since. This is a diagnostic: it tells how much of the input a change
+ * touched, and nothing reads the report back.
+ */
+void report_class_hashes(const std::string& hashes_path,
+                         const Arguments& args,
+                         ConfigFiles& conf,
+                         const DexStoresVector& stores,
+                         Json::Value& stats) {
+  Timer t("Reporting class hashes");
+  // A different configuration or set of ProGuard rules counts as a change of
+  // all classes.
+  std::string config = Json::FastWriter().write(args.config);
+  for (const auto& path : args.proguard_config_paths) {
+    std::ifstream in(path);
+    config.append(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+  }
+  auto config_hash = class_hashes::hash_string(config);
+  auto hashes = class_hashes::compute(build_class_scope(stores));
+
+  uint64_t last_config_hash;
+  class_hashes::ClassHashes last_hashes;
+  bool have_last =
+      class_hashes::read(hashes_path, &last_config_hash, &last_hashes) &&
+      last_config_hash == config_hash;
+  auto diff = class_hashes::diff(last_hashes, hashes);
+
+  auto& report = stats["class_hashes"];
+  report["classes"] = Json::UInt64(hashes.size());
+  report["all_changed"] = !have_last;
+  report["added"] = Json::UInt64(diff.added.size());
+  report["changed"] = Json::UInt64(diff.changed.size());
+  report["removed"] = Json::UInt64(diff.removed.size());
+  report["unchanged"] = Json::UInt64(have_last ? diff.unchanged : 0);
+  TRACE(MAIN, 1,
+        "Class hashes: %zu classes, %zu added, %zu changed, %zu removed%s\n",
+        hashes.size(), diff.added.size(), diff.changed.size(),
+        diff.removed.size(), have_last ? "" : " (all changed)");
+
+  std::ofstream changed(conf.metafile("redex-changed-classes.txt"));
+  if (have_last) {
+    for (const auto* names : {&diff.added, &diff.changed, &diff.removed}) {
+      for (const auto& name : *names) {
+        changed << name << "\n";
+      }
+    }
+  } else {
+    for (const auto& p : hashes) {
+      changed << p.first << "\n";
+    }
+  }
+  class_hashes::write(hashes_path, config_hash, hashes);
+}
+
 void dump_class_method_info_map(const std::string file_path,
                                 DexStoresVector& stores) {
   std::ofstream ofs(file_path, std::ofstream::out | std::ofstream::trunc);
@@ -962,6 +1344,109 @@ void dump_class_method_info_map(const std::string file_path,
   });
 }
 
+/*
+ * Sets `args` up for the variant: its keys replace those of the config, but
+ * for "redex_options" and "arch", which override the command line, and it
+ * writes to a directory of its own under the output directory.
+ */
+void apply_variant(const std::string& name,
+                   const Json::Value& variant,
+                   Arguments& args) {
+  args.config.removeMember("variants");
+  args.config.removeMember("variant_jobs");
+  for (const auto& key : variant.getMemberNames()) {
+    if (key == "redex_options") {
+      Json::Value options;
+      args.redex_options.serialize(options);
+      for (const auto& option : variant[key].getMemberNames()) {
+        options["redex_options"][option] = variant[key][option];
+      }
+      args.redex_options.deserialize(options);
+    } else if (key == "arch") {
+      args.redex_options.arch = parse_architecture(variant[key].asString());
+    } else {
+      args.config[key] = variant[key];
+    }
+  }
+  auto out_dir = boost::filesystem::path(args.out_dir) / name;
+  boost::filesystem::create_directories(out_dir);
+  args.out_dir = out_dir.string();
+}
+
+/*
+ * With "variants" in the config -- a non-empty object of variant names to their
+ * overrides, see apply_variant() -- the frontend runs once, and then a
+ * child forks off for each variant to run its passes and write its output.
+ * The children share the loaded input with the parent copy-on-write. At
+ * most "variant_jobs" of them run at a time, all of them by default.
+ *
+ * Returns in the children, with `args` set up for their variant, and
+ * boost::none. The parent waits for them and returns the exit code.
+ */
+boost::optional<int> fork_variants(Arguments& args) {
+  const auto variants = args.config["variants"];
+  if (!variants.isObject() || variants.empty()) {
+    std::cerr << "error: variants must name at least one variant"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+#ifdef _MSC_VER
+  std::cerr << "error: variants need fork()" << std::endl;
+  return EXIT_FAILURE;
+#else
+  if (args.stop_pass_idx != boost::none) {
+    std::cerr << "error: variants can't be used with --stop-pass"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto names = variants.getMemberNames();
+  size_t jobs = args.config.get("variant_jobs", 0).asUInt();
+  if (jobs == 0) {
+    jobs = names.size();
+  }
+  // Whatever is buffered would be written by the children as well.
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(nullptr);
+
+  std::unordered_map<pid_t, std::string> running;
+  int status = EXIT_SUCCESS;
+  auto wait_one = [&] {
+    int child_status;
+    pid_t pid = wait(&child_status);
+    always_assert(pid > 0);
+    if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+      std::cerr << "error: variant " << running.at(pid) << " failed"
+                << std::endl;
+      status = EXIT_FAILURE;
+    }
+    running.erase(pid);
+  };
+  for (const auto& name : names) {
+    if (running.size() == jobs) {
+      wait_one();
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      status = EXIT_FAILURE;
+      break;
+    }
+    if (pid == 0) {
+      workqueue_impl::ThreadPool::reset_after_fork();
+      TRACE(MAIN, 1, "Running variant %s\n", name.c_str());
+      apply_variant(name, variants[name], args);
+      return boost::none;
+    }
+    running.emplace(pid, name);
+  }
+  while (!running.empty()) {
+    wait_one();
+  }
+  return status;
+#endif
+}
+
 } // namespace
 
 int main(int argc, char* argv[]) {
@@ -972,7 +1457,9 @@ int main(int argc, char* argv[]) {
 #endif
 
   std::string stats_output_path;
+  std::string event_trace_path;
   Json::Value stats;
+  bool fast_exit = false;
   {
     Timer redex_all_main_timer("redex-all main()");
 
@@ -989,23 +1476,61 @@ int main(int argc, char* argv[]) {
     // TODO: Make the command line -jarpath option like a colon separated
     //       list of library JARS.
     Arguments args = parse_args(argc, argv);
+    configure_workqueue_threads(args.redex_options.num_threads,
+                                args.redex_options.pin_worker_threads,
+                                args.redex_options.numa_aware_threads);
+    // Spans of the passes, timers and parallel walks, for chrome://tracing
+    // or Perfetto.
+    if (!args.config.get("event_trace_output", "").empty()) {
+      event_trace::enable(
+          args.config.get("event_trace_events_per_thread", 1 << 16).asUInt(),
+          args.config.get("event_trace_min_duration_us", 0).asUInt());
+    }
 
     RedexContext::set_record_keep_reasons(
         args.config.get("record_keep_reasons", false).asBool());
+    RedexContext::set_zero_copy_strings(
+        args.config.get("zero_copy_strings", false).asBool());
+    RedexContext::set_lazy_balloon(
+        args.config.get("lazy_balloon", false).asBool());
+    RedexContext::set_lazy_debug_info(
+        args.config.get("lazy_debug_info", false).asBool());
+    RedexContext::set_loaded_debug_info(redex::debug_info_to_load(args.config));
 
     auto pg_config = std::make_unique<redex::ProguardConfiguration>();
     DexStoresVector stores;
-    ConfigFiles conf(args.config, args.out_dir);
+    ConfigFiles frontend_conf(args.config, args.out_dir);
 
     std::string apk_dir;
-    conf.get_json_config().get("apk_dir", "", apk_dir);
+    frontend_conf.get_json_config().get("apk_dir", "", apk_dir);
     const std::string& manifest_filename = apk_dir + "/AndroidManifest.xml";
     boost::optional<int32_t> maybe_sdk = get_min_sdk(manifest_filename);
     if (maybe_sdk != boost::none) {
       args.redex_options.min_sdk = *maybe_sdk;
     }
 
-    redex_frontend(conf, args, *pg_config, stores, stats);
+    if (args.resume_from_dir.empty()) {
+      redex_frontend(frontend_conf, args, *pg_config, stores, stats);
+    } else {
+      redex_resume(args, *pg_config, stores, stats);
+    }
+
+    const auto& hashes_path =
+        args.config.get("class_hashes_report", "").asString();
+    if (!hashes_path.empty()) {
+      report_class_hashes(hashes_path, args, frontend_conf, stores, stats);
+    }
+
+    // A variant reads its own config files.
+    std::unique_ptr<ConfigFiles> variant_conf;
+    if (args.config.isMember("variants")) {
+      auto variants_status = fork_variants(args);
+      if (variants_status) {
+        return *variants_status;
+      }
+      variant_conf = std::make_unique<ConfigFiles>(args.config, args.out_dir);
+    }
+    ConfigFiles& conf = variant_conf ? *variant_conf : frontend_conf;
 
     auto const& passes = PassRegistry::get().get_passes();
     PassManager manager(passes, std::move(pg_config), args.config,
@@ -1024,7 +1549,19 @@ int main(int argc, char* argv[]) {
                 args.config.get("class_method_info_map", "").asString()),
             stores);
       }
+      if (args.entry_data.isMember("checkpoint")) {
+        stats["output_stats"]["checkpoint_pass_stats"] =
+            args.entry_data["checkpoint"]["pass_stats"];
+      }
     } else {
+      auto& checkpoint = args.entry_data["checkpoint"];
+      checkpoint["input_stats"] = stats["input_stats"];
+      if (!checkpoint.isMember("pass_stats")) {
+        checkpoint["pass_stats"] = Json::arrayValue;
+      }
+      for (const auto& pass : get_checkpoint_pass_stats(manager)) {
+        checkpoint["pass_stats"].append(pass);
+      }
       redex::write_all_intermediate(conf, args.output_ir_dir,
                                     args.redex_options, stores,
                                     args.entry_data);
@@ -1032,7 +1569,15 @@ int main(int argc, char* argv[]) {
 
     stats_output_path =
         conf.metafile(args.config.get("stats_output", "").asString());
-    {
+    if (event_trace::is_enabled()) {
+      event_trace_path =
+          conf.metafile(args.config.get("event_trace_output", "").asString());
+    }
+    // With fast_exit, the process ends right after writing the stats, and
+    // the OS takes the heap back at once. time_teardown still frees it, to
+    // see in the time stats what that costs.
+    fast_exit = args.config.get("fast_exit", false).asBool();
+    if (!fast_exit || args.config.get("time_teardown", false).asBool()) {
       Timer t("Freeing global memory");
       delete g_redex;
     }
@@ -1044,7 +1589,20 @@ int main(int argc, char* argv[]) {
     std::ofstream out(stats_output_path);
     writer.write(out, stats);
   }
+  if (!event_trace_path.empty() &&
+      !event_trace::write_chrome_trace(event_trace_path)) {
+    std::cerr << "warning: cannot write event trace to " << event_trace_path
+              << std::endl;
+  }
 
   TRACE(MAIN, 1, "Done.\n");
+  if (fast_exit) {
+    // Skips the destructors of the statics as well. All that they'd write
+    // out is buffered in the standard streams.
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    std::_Exit(0);
+  }
   return 0;
 }
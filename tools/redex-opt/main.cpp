@@ -7,13 +7,22 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
+#include "BinarySerialization.h"
 #include "DexClass.h"
 #include "DexLoader.h"
+#include "DexUtil.h"
+#include "IRCode.h"
 #include "PassRegistry.h"
+#include "Show.h"
 #include "Timer.h"
 #include "ToolsCommon.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -22,6 +31,25 @@ struct Arguments {
   std::string output_ir_dir;
   std::vector<std::string> pass_names;
   RedexOptions redex_options;
+  // With --shards, the number of shards to split the methods into.
+  uint32_t num_shards{0};
+  std::string shard_launcher;
+  // With --shard, the shard that this process runs, and where it goes.
+  uint32_t shard_index{0};
+  uint32_t shard_count{0};
+  std::string shard_output;
+  std::string argv0;
+};
+
+constexpr uint32_t SHARD_FORMAT_VERSION = 1;
+
+// The passes that only ever look at one method at a time, and so can run on
+// part of the methods.
+const std::unordered_set<std::string> SHARDABLE_PASSES = {
+    "ConstantPropagationPass",
+    "CopyPropagationPass",
+    "LocalDcePass",
+    "RegAllocPass",
 };
 
 Arguments parse_args(int argc, char* argv[]) {
@@ -36,6 +64,21 @@ Arguments parse_args(int argc, char* argv[]) {
                      "output dex and IR meta directory");
   desc.add_options()("pass-name,p", po::value<std::vector<std::string>>(),
                      "pass name");
+  desc.add_options()("shards",
+                     po::value<uint32_t>(),
+                     "split the methods between this many redex-opt "
+                     "processes, for passes that look at one method at a time");
+  desc.add_options()("shard-launcher",
+                     po::value<std::string>(),
+                     "command that a shard's command line is appended to, "
+                     "e.g. to run it on another host; the IR directories "
+                     "must be reachable from there");
+  desc.add_options()("shard",
+                     po::value<std::string>(),
+                     "run shard K of N, given as K/N (used by --shards)");
+  desc.add_options()("shard-output",
+                     po::value<std::string>(),
+                     "file to write the code of the shard's methods to");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -47,6 +90,7 @@ Arguments parse_args(int argc, char* argv[]) {
   }
 
   Arguments args;
+  args.argv0 = argv[0];
 
   if (vm.count("input-ir")) {
     args.input_ir_dir = vm["input-ir"].as<std::string>();
@@ -55,16 +99,40 @@ Arguments parse_args(int argc, char* argv[]) {
   if (vm.count("output-ir")) {
     args.output_ir_dir = vm["output-ir"].as<std::string>();
   }
+
+  if (vm.count("pass-name")) {
+    args.pass_names = vm["pass-name"].as<std::vector<std::string>>();
+  }
+
+  if (vm.count("shards")) {
+    args.num_shards = vm["shards"].as<uint32_t>();
+  }
+  if (vm.count("shard-launcher")) {
+    args.shard_launcher = vm["shard-launcher"].as<std::string>();
+  }
+  if (vm.count("shard")) {
+    auto shard = vm["shard"].as<std::string>();
+    if (sscanf(shard.c_str(), "%u/%u", &args.shard_index, &args.shard_count) !=
+            2 ||
+        args.shard_index >= args.shard_count) {
+      std::cerr << "shard must be K/N with K < N\n";
+      exit(EXIT_FAILURE);
+    }
+    if (!vm.count("shard-output")) {
+      std::cerr << "shard-output is missing\n";
+      exit(EXIT_FAILURE);
+    }
+    args.shard_output = vm["shard-output"].as<std::string>();
+    // A shard doesn't write any IR.
+    return args;
+  }
+
   if (args.output_ir_dir.empty()) {
     std::cerr << "output-dir is empty\n";
     exit(EXIT_FAILURE);
   }
   boost::filesystem::create_directory(args.output_ir_dir);
 
-  if (vm.count("pass-name")) {
-    args.pass_names = vm["pass-name"].as<std::vector<std::string>>();
-  }
-
   return args;
 }
 
@@ -93,6 +161,137 @@ Json::Value process_entry_data(const Json::Value& entry_data,
 
   return config_data;
 }
+
+/*
+ * The methods of shard `index` of `count`. Every process loads the same IR,
+ * so they all agree on which methods go to which shard.
+ */
+std::vector<DexMethod*> shard_methods(const Scope& scope,
+                                      uint32_t index,
+                                      uint32_t count) {
+  std::vector<DexMethod*> methods;
+  size_t i = 0;
+  for (auto cls : scope) {
+    for (auto* vec : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto method : *vec) {
+        if (method->get_code() != nullptr && i++ % count == index) {
+          methods.push_back(method);
+        }
+      }
+    }
+  }
+  return methods;
+}
+
+std::string shell_quote(const std::string& arg) {
+  std::string quoted = "'";
+  for (char c : arg) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "'";
+}
+
+std::string shard_output_path(const Arguments& args, uint32_t index) {
+  return (boost::filesystem::path(args.output_ir_dir) /
+          ("shard-" + std::to_string(index) + ".bin"))
+      .string();
+}
+
+/*
+ * Runs the passes on the methods of this shard only, and writes their code
+ * to the shard output. The other methods are put aside in the meantime so
+ * that the passes don't spend any time on them.
+ */
+void run_shard(const Arguments& args,
+               PassManager& manager,
+               DexStoresVector& stores,
+               ConfigFiles& conf) {
+  auto scope = build_class_scope(stores);
+  auto methods = shard_methods(scope, args.shard_index, args.shard_count);
+  std::unordered_set<DexMethod*> in_shard(methods.begin(), methods.end());
+  std::unordered_map<DexMethod*, std::unique_ptr<IRCode>> put_aside;
+  for (auto cls : scope) {
+    for (auto* vec : {&cls->get_dmethods(), &cls->get_vmethods()}) {
+      for (auto method : *vec) {
+        if (method->get_code() != nullptr && !in_shard.count(method)) {
+          put_aside.emplace(method, method->release_code());
+        }
+      }
+    }
+  }
+
+  manager.run_passes(stores, conf);
+
+  for (auto& pair : put_aside) {
+    pair.first->set_code(std::move(pair.second));
+  }
+
+  std::ofstream os(args.shard_output, std::ios::binary);
+  binary_serialization::write_header(os, SHARD_FORMAT_VERSION);
+  binary_serialization::write<uint32_t>(os, methods.size());
+  for (auto method : methods) {
+    auto code = method->get_code();
+    code->compact();
+    binary_serialization::write(os, show(method));
+    code->serialize(os);
+  }
+  always_assert_log(os.good(), "Couldn't write %s", args.shard_output.c_str());
+}
+
+/*
+ * Starts a redex-opt process for each shard, through the launcher if there
+ * is one, and returns once they are all done.
+ */
+void launch_shards(const Arguments& args) {
+  std::string command = args.shard_launcher.empty()
+                            ? shell_quote(args.argv0)
+                            : args.shard_launcher + " " +
+                                  shell_quote(args.argv0);
+  command += " -i " + shell_quote(args.input_ir_dir);
+  for (const auto& pass_name : args.pass_names) {
+    command += " -p " + shell_quote(pass_name);
+  }
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < args.num_shards; ++i) {
+    auto shard_command =
+        command + " --shard " + std::to_string(i) + "/" +
+        std::to_string(args.num_shards) + " --shard-output " +
+        shell_quote(shard_output_path(args, i));
+    threads.emplace_back([shard_command] {
+      auto status = std::system(shard_command.c_str());
+      always_assert_log(status == 0, "Shard failed (%d): %s", status,
+                        shard_command.c_str());
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Replaces the code of the methods of a shard with what it wrote.
+void merge_shard(const std::string& path) {
+  std::ifstream is(path, std::ios::binary);
+  always_assert_log(is.good(), "Couldn't read %s", path.c_str());
+  always_assert(binary_serialization::read_header(is) ==
+                SHARD_FORMAT_VERSION);
+  auto num_methods = binary_serialization::read<uint32_t>(is);
+  for (uint32_t i = 0; i < num_methods; ++i) {
+    auto name = binary_serialization::read_string(is);
+    auto ref = DexMethod::get_method(name);
+    always_assert_log(ref != nullptr && ref->is_def(), "Unknown method %s",
+                      name.c_str());
+    auto method = static_cast<DexMethod*>(ref);
+    auto code = IRCode::deserialize(is);
+    code->expand();
+    code->set_debug_item(method->get_code()->release_debug_item());
+    method->set_code(std::move(code));
+  }
+  boost::filesystem::remove(path);
+}
 } // namespace
 
 int main(int argc, char* argv[]) {
@@ -115,14 +314,36 @@ int main(int argc, char* argv[]) {
   }
 
   args.redex_options.deserialize(entry_data);
+  configure_workqueue_threads(args.redex_options.num_threads,
+                              args.redex_options.pin_worker_threads,
+                              args.redex_options.numa_aware_threads);
 
   Json::Value config_data = process_entry_data(entry_data, args);
   ConfigFiles conf(std::move(config_data), args.output_ir_dir);
 
-  const auto& passes = PassRegistry::get().get_passes();
-  PassManager manager(passes, config_data, args.redex_options);
-  manager.set_testing_mode();
-  manager.run_passes(stores, conf);
+  if (args.num_shards > 0) {
+    for (const auto& pass : config_data["redex"]["passes"]) {
+      if (!SHARDABLE_PASSES.count(pass.asString())) {
+        std::cerr << pass.asString() << " can't run in shards\n";
+        return EXIT_FAILURE;
+      }
+    }
+    Timer t("Running shards");
+    launch_shards(args);
+    for (uint32_t i = 0; i < args.num_shards; ++i) {
+      merge_shard(shard_output_path(args, i));
+    }
+  } else {
+    const auto& passes = PassRegistry::get().get_passes();
+    PassManager manager(passes, config_data, args.redex_options);
+    manager.set_testing_mode();
+    if (args.shard_count > 0) {
+      run_shard(args, manager, stores, conf);
+      delete g_redex;
+      return 0;
+    }
+    manager.run_passes(stores, conf);
+  }
 
   redex::write_all_intermediate(conf, args.output_ir_dir, args.redex_options,
                                 stores, entry_data);
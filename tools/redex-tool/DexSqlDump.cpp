@@ -15,13 +15,15 @@ $ buck run  //native/redex:redex-tool -- dex-sql-dump  \
       --jars <ANDROID_JAR> --proguard-map <RENAME_MAP> \
       --output dex.sql
 $ sqlite3 dex.db < dex.sql
+(or, much faster to load for large apps, add --csv-dir <CSV_DIR> to write the
+rows as CSV files that dex.sql imports; run sqlite3 from the same directory)
 $ sqlite3 dex.db "SELECT COUNT(*) FROM dex;"   # verify sane-looking value
 $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 <..enter queries..>
 
 */
 
-#include <boost/algorithm/string/replace.hpp>
+#include <map>
 #include <queue>
 #include <vector>
 #include <unordered_map>
@@ -34,6 +36,7 @@ $ ./native/redex/tools/redex-tool/DexSqlQuery.py dex.db
 #include "Show.h"
 #include "Tool.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 namespace {
 
@@ -42,128 +45,236 @@ static std::unordered_map<DexMethod*, int> method_ids;
 static std::unordered_map<DexField*, int> field_ids;
 static std::unordered_map<DexString*, int> string_ids;
 
-void dump_field_refs(FILE* fdout, const char* prefix, DexField* field, int field_id) {
-  static int next_string_ref = 0;
+// The number of rows of each INSERT statement of the SQL format.
+constexpr size_t INSERT_BATCH_SIZE = 500;
+
+enum class Format { SQL, CSV };
+
+// A value of a row, which is quoted if it is text.
+struct Value {
+  Value(int64_t number) : text(std::to_string(number)), quoted(false) {}
+  Value(std::string str) : text(std::move(str)), quoted(true) {}
+  Value(const char* str) : text(str ? str : ""), quoted(true) {}
+
+  std::string text;
+  bool quoted;
+};
+
+/*
+ * Writes the rows of the tables, either into the SQL script as inserts of
+ * many rows each, or into one CSV file per table that the script imports at
+ * the end. The indexes are created after all rows are in, so that loading
+ * the rows doesn't have to maintain them.
+ */
+class TableWriter {
+ public:
+  TableWriter(Format format,
+              FILE* script,
+              std::string csv_dir,
+              std::string prefix)
+      : m_format(format),
+        m_script(script),
+        m_csv_dir(std::move(csv_dir)),
+        m_prefix(std::move(prefix)) {
+    if (m_format == Format::SQL) {
+      fprintf(m_script, "BEGIN TRANSACTION;\n");
+    }
+  }
+
+  void row(const char* table, std::initializer_list<Value> values) {
+    auto& out = m_tables[table];
+    if (m_format == Format::CSV) {
+      if (out.csv == nullptr) {
+        out.csv_path = m_csv_dir + "/" + m_prefix + table + ".csv";
+        out.csv = fopen(out.csv_path.c_str(), "w");
+        if (!out.csv) {
+          fprintf(stderr, "Could not open %s for writing; terminating\n",
+                  out.csv_path.c_str());
+          exit(EXIT_FAILURE);
+        }
+      }
+      append_values(values, '"', out.pending);
+      out.pending += '\n';
+      if (++out.pending_rows == INSERT_BATCH_SIZE) {
+        flush(table, out);
+      }
+      return;
+    }
+    out.pending += out.pending_rows == 0 ? "INSERT INTO " + m_prefix + table +
+                                               " VALUES\n("
+                                         : ",\n(";
+    append_values(values, '\'', out.pending);
+    out.pending += ')';
+    if (++out.pending_rows == INSERT_BATCH_SIZE) {
+      flush(table, out);
+    }
+  }
+
+  void finish(const std::vector<std::string>& indexes) {
+    for (auto& pair : m_tables) {
+      flush(pair.first, pair.second);
+    }
+    if (m_format == Format::SQL) {
+      fprintf(m_script, "END TRANSACTION;\n");
+    } else {
+      fprintf(m_script, ".mode csv\n");
+      for (auto& pair : m_tables) {
+        fclose(pair.second.csv);
+        fprintf(m_script, ".import \"%s\" %s%s\n",
+                pair.second.csv_path.c_str(), m_prefix.c_str(),
+                pair.first.c_str());
+      }
+    }
+    for (const auto& index : indexes) {
+      fprintf(m_script, "%s\n", index.c_str());
+    }
+  }
+
+ private:
+  struct Table {
+    std::string pending;
+    size_t pending_rows{0};
+    FILE* csv{nullptr};
+    std::string csv_path;
+  };
+
+  static void append_values(std::initializer_list<Value> values,
+                            char quote,
+                            std::string& out) {
+    bool first = true;
+    for (const auto& value : values) {
+      if (!first) {
+        out += ',';
+      }
+      first = false;
+      if (!value.quoted) {
+        out += value.text;
+        continue;
+      }
+      // Quotes are escaped by doubling them, in both SQL and CSV.
+      out += quote;
+      for (char c : value.text) {
+        if (c == quote) {
+          out += quote;
+        }
+        out += c;
+      }
+      out += quote;
+    }
+  }
+
+  void flush(const std::string& table, Table& out) {
+    if (out.pending_rows == 0) {
+      return;
+    }
+    if (m_format == Format::SQL) {
+      out.pending += ";\n";
+    }
+    fwrite(out.pending.data(), 1, out.pending.size(),
+           m_format == Format::SQL ? m_script : out.csv);
+    out.pending.clear();
+    out.pending_rows = 0;
+  }
+
+  Format m_format;
+  FILE* m_script;
+  std::string m_csv_dir;
+  std::string m_prefix;
+  std::map<std::string, Table> m_tables;
+};
+
+// A reference of a method or a field to another item, which is written
+// without an id; the rows of each table are numbered in order.
+struct Ref {
+  const char* table;
+  int id;
+  int ref_id;
+  int opcode;
+};
+
+std::vector<Ref> get_field_refs(DexField* field, int field_id) {
   auto* static_value = field->get_static_value();
-  if (!static_value || (static_value->evtype() != DEVT_STRING)) return;
+  if (!static_value || (static_value->evtype() != DEVT_STRING)) return {};
   auto* static_string_value = static_cast<DexEncodedValueString*>(static_value);
-  auto string_id = string_ids[static_string_value->string()];
-  fprintf(
-    fdout,
-    "INSERT INTO %sfield_string_refs VALUES (%d, %d, %d);\n",
-    prefix,
-    next_string_ref++,
-    field_id,
-    string_id);
+  auto it = string_ids.find(static_string_value->string());
+  if (it == string_ids.end()) return {};
+  return {{"field_string_refs", field_id, it->second, -1}};
 }
 
-void dump_method_refs(FILE* fdout, const char* prefix, DexMethod* method, int method_id) {
+std::vector<Ref> get_method_refs(DexMethod* method, int method_id) {
+  std::vector<Ref> refs;
   auto code = method->get_code();
-  if (!code) return;
-
-  static int next_string_ref = 0;
-  static int next_class_ref = 0;
-  static int next_field_ref = 0;
-  static int next_method_ref = 0;
+  if (!code) return refs;
 
   for (auto& mie : InstructionIterable(code)) {
     auto insn = mie.insn;
     if (insn->has_string()) {
-      if (string_ids.count(insn->get_string())) {
-        auto string_id = string_ids[insn->get_string()];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_string_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_string_ref++,
-          method_id,
-          string_id,
-          insn->opcode());
+      auto it = string_ids.find(insn->get_string());
+      if (it != string_ids.end()) {
+        refs.push_back(
+            {"method_string_refs", method_id, it->second, insn->opcode()});
       }
     }
     if (insn->has_type()) {
       auto cls = type_class(insn->get_type());
-      if (cls && class_ids.count(cls)) {
-        auto class_id = class_ids[cls];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_class_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_class_ref++,
-          method_id,
-          class_id,
-          insn->opcode());
+      auto it = class_ids.find(cls);
+      if (cls && it != class_ids.end()) {
+        refs.push_back(
+            {"method_class_refs", method_id, it->second, insn->opcode()});
       }
     }
     if (insn->has_field()) {
       auto field = resolve_field(insn->get_field());
-      if (field != nullptr && field_ids.count(field)) {
-        auto field_id = field_ids[field];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_field_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_field_ref++,
-          method_id,
-          field_id,
-          insn->opcode());
+      auto it = field_ids.find(field);
+      if (field != nullptr && it != field_ids.end()) {
+        refs.push_back(
+            {"method_field_refs", method_id, it->second, insn->opcode()});
       }
     }
     if (insn->has_method()) {
       auto meth = resolve_method(insn->get_method(), opcode_to_search(insn));
-      if (meth != nullptr && method_ids.count(meth)) {
-        auto method_ref_id = method_ids[meth];
-        fprintf(
-          fdout,
-          "INSERT INTO %smethod_method_refs VALUES (%d, %d, %d, %d);\n",
-          prefix,
-          next_method_ref++,
-          method_id,
-          method_ref_id,
-          insn->opcode());
+      auto it = method_ids.find(meth);
+      if (meth != nullptr && it != method_ids.end()) {
+        refs.push_back(
+            {"method_method_refs", method_id, it->second, insn->opcode()});
       }
     }
   }
+  return refs;
 }
 
-void dump_class(FILE* fdout, const char* prefix, const char* dex_id, DexClass* cls, int class_id) {
+void dump_class(TableWriter& writer,
+                const char* dex_id,
+                DexClass* cls,
+                int class_id) {
   // TODO: annotations?
   // TODO: inheritance?
   // TODO: string usage
   // TODO: size estimate
-  auto deobfuscated_name = cls->get_deobfuscated_name();
-  fprintf(
-    fdout,
-    "INSERT INTO %sclasses VALUES (%d,'%s','%s','%s',%u);\n",
-    prefix,
-    class_id,
-    dex_id,
-    deobfuscated_name.c_str(),
-    cls->get_name()->c_str(),
-    cls->get_access()
-  );
+  writer.row("classes",
+             {class_id, dex_id, cls->get_deobfuscated_name(),
+              cls->get_name()->c_str(), cls->get_access()});
 }
 
-void dump_field(FILE* fdout, const char* prefix, int class_id, DexField* field, int field_id) {
+void dump_field(TableWriter& writer,
+                int class_id,
+                DexField* field,
+                int field_id) {
   // TODO: more fixup here on this crapped up name/signature
   // TODO: break down signature
   // TODO: annotations?
   // TODO: string usage (encoded_value for static fields)
   auto deobfuscated_name = field->get_deobfuscated_name();
   auto field_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %sfields VALUES(%d, %d, '%s', '%s', %u);\n",
-    prefix,
-    field_id,
-    class_id,
-    field_name,
-    field->get_name()->c_str(),
-    field->get_access()
-  );
+  writer.row("fields",
+             {field_id, class_id, field_name, field->get_name()->c_str(),
+              field->get_access()});
 }
 
-void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* method, int method_id) {
+void dump_method(TableWriter& writer,
+                 int class_id,
+                 DexMethod* method,
+                 int method_id) {
   // TODO: more fixup here on this crapped up name/signature
   // TODO: break down signature
   // TODO: throws?
@@ -172,21 +283,18 @@ void dump_method(FILE* fdout, const char* prefix, int class_id, DexMethod* metho
   // TODO: size estimate
   auto deobfuscated_name = method->get_deobfuscated_name();
   auto method_name = strchr(deobfuscated_name.c_str(), ';');
-  fprintf(
-    fdout,
-    "INSERT INTO %smethods VALUES (%d,%d,'%s','%s',%d,%lu);\n",
-    prefix,
-    method_id,
-    class_id,
-    method_name,
-    method->get_name()->c_str(),
-    method->get_access(),
-    method->get_code() ? method->get_code()->sum_opcode_sizes() : 0
-  );
+  writer.row("methods",
+             {method_id, class_id, method_name, method->get_name()->c_str(),
+              method->get_access(),
+              static_cast<int64_t>(method->get_code()
+                                       ? method->get_code()->sum_opcode_sizes()
+                                       : 0)});
 }
 
 void dump_sql(
   FILE* fdout,
+  Format format,
+  const std::string& csv_dir,
   DexStoresVector& stores,
   ProguardMap& pg_map,
   const char* prefix) {
@@ -266,13 +374,13 @@ CREATE TABLE %1$smethod_string_refs (
 )___",
     prefix
   );
+  TableWriter writer(format, fdout, csv_dir, prefix);
   int next_class_id = 0;
   int next_method_id = 0;
   int next_field_id = 0;
   int next_string_id = 0;
 
   // Dump all dex items
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
   for (auto& store : stores) {
     auto store_name = store.get_name();
     auto& dexen = store.get_dexen();
@@ -284,93 +392,114 @@ CREATE TABLE %1$smethod_string_refs (
       for (auto dexstr : strings) {
         int id = next_string_id++;
         string_ids[dexstr] = id;
-        // Escape string before inserting. ' -> ''
-        std::string esc(dexstr->c_str());
-        boost::replace_all(esc, "'", "''");
-        fprintf(fdout, "INSERT INTO %sstrings VALUES(%d, '%s');\n", prefix, id, esc.c_str());
+        writer.row("strings", {id, dexstr->c_str()});
       }
       std::string dex_id_str(store_name + "/" + std::to_string(dex_idx));
       const char* dex_id = dex_id_str.c_str();
       for (const auto& cls : dex) {
         int class_id = next_class_id++;
-        dump_class(fdout, prefix, dex_id, cls, class_id);
+        dump_class(writer, dex_id, cls, class_id);
         class_ids[cls] = class_id;
         for (auto field : cls->get_ifields()) {
           int field_id = next_field_id++;
           field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
+          dump_field(writer, class_id, field, field_id);
         }
         for (auto field : cls->get_sfields()) {
           int field_id = next_field_id++;
           field_ids[field] = field_id;
-          dump_field(fdout, prefix, class_id, field, field_id);
+          dump_field(writer, class_id, field, field_id);
         }
         for (const auto& meth : cls->get_dmethods()) {
           int meth_id = next_method_id++;
           method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
+          dump_method(writer, class_id, meth, meth_id);
         }
         for (auto& meth : cls->get_vmethods()) {
           int meth_id = next_method_id++;
           method_ids[meth] = meth_id;
-          dump_method(fdout, prefix, class_id, meth, meth_id);
+          dump_method(writer, class_id, meth, meth_id);
         }
       }
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
 
-  // Dump references
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
-  for (auto& store : stores) {
-    auto& dexen = store.get_dexen();
-    for (size_t dex_idx = 0 ; dex_idx < dexen.size() ; ++dex_idx) {
-      auto& dex = dexen[dex_idx];
-      for (const auto& cls : dex) {
-        for (const auto& meth : cls->get_dmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
-        }
-        for (auto& meth : cls->get_vmethods()) {
-          int meth_id = method_ids[meth];
-          dump_method_refs(fdout, prefix, meth, meth_id);
-        }
-        for (const auto& field : cls->get_sfields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
-        }
-        for (const auto& field : cls->get_ifields()) {
-          int field_id = field_ids[field];
-          dump_field_refs(fdout, prefix, field, field_id);
-        }
+  // Dump references. They are gathered for each class in parallel, which
+  // only reads the id maps, and written in order.
+  auto scope = build_class_scope(stores);
+  std::vector<std::vector<Ref>> class_refs(scope.size());
+  auto wq = workqueue_foreach<size_t>([&](size_t i) {
+    auto cls = scope[i];
+    auto& refs = class_refs[i];
+    auto append = [&refs](std::vector<Ref> more) {
+      refs.insert(refs.end(), more.begin(), more.end());
+    };
+    for (const auto& meth : cls->get_dmethods()) {
+      append(get_method_refs(meth, method_ids.at(meth)));
+    }
+    for (auto& meth : cls->get_vmethods()) {
+      append(get_method_refs(meth, method_ids.at(meth)));
+    }
+    for (const auto& field : cls->get_sfields()) {
+      append(get_field_refs(field, field_ids.at(field)));
+    }
+    for (const auto& field : cls->get_ifields()) {
+      append(get_field_refs(field, field_ids.at(field)));
+    }
+  });
+  for (size_t i = 0; i < scope.size(); i++) {
+    wq.add_item(i);
+  }
+  wq.run_all();
+  std::unordered_map<std::string, int> next_ref_ids;
+  for (const auto& refs : class_refs) {
+    for (const auto& ref : refs) {
+      int ref_row_id = next_ref_ids[ref.table]++;
+      if (ref.opcode < 0) {
+        writer.row(ref.table, {ref_row_id, ref.id, ref.ref_id});
+      } else {
+        writer.row(ref.table, {ref_row_id, ref.id, ref.ref_id, ref.opcode});
       }
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
 
   // Dump hierarchy
-  auto scope = build_class_scope(stores);
   ClassHierarchy ch = build_type_hierarchy(scope);
   int next_is_a_id = 0;
-  fprintf(fdout, "BEGIN TRANSACTION;\n");
   for (auto& cls : scope) {
     TypeSet results;
     get_all_children_or_implementors(ch, scope, cls, results);
     for(auto type : results) {
       auto type_cls = type_class(type);
       if (type_cls) {
-        fprintf(
-          fdout,
-          "INSERT INTO %sis_a VALUES(%d, %d, %d);\n",
-          prefix,
-          next_is_a_id++,
-          class_ids[type_cls],
-          class_ids[cls]
-        );
+        writer.row("is_a",
+                   {next_is_a_id++, class_ids[type_cls], class_ids[cls]});
       }
     }
   }
-  fprintf(fdout, "END TRANSACTION;\n");
+
+  std::vector<std::string> indexes;
+  for (const auto& column : std::vector<std::pair<const char*, const char*>>{
+           {"methods", "class_id"},
+           {"fields", "class_id"},
+           {"is_a", "class_id"},
+           {"is_a", "is_a_class_id"},
+           {"field_string_refs", "field_id"},
+           {"field_string_refs", "ref_string_id"},
+           {"method_class_refs", "method_id"},
+           {"method_class_refs", "ref_class_id"},
+           {"method_method_refs", "method_id"},
+           {"method_method_refs", "ref_method_id"},
+           {"method_field_refs", "method_id"},
+           {"method_field_refs", "ref_field_id"},
+           {"method_string_refs", "method_id"},
+           {"method_string_refs", "ref_string_id"},
+       }) {
+    indexes.push_back(std::string("CREATE INDEX ") + prefix + column.first +
+                      "_" + column.second + " ON " + prefix + column.first +
+                      " (" + column.second + ");");
+  }
+  writer.finish(indexes);
 }
 
 class DexSqlDump : public Tool {
@@ -386,6 +515,10 @@ class DexSqlDump : public Tool {
       ("output,o",
        po::value<std::string>()->value_name("dex.sql"),
        "path to output sql dump file (defaults to stdout)")
+      ("csv-dir,c",
+       po::value<std::string>()->value_name("dex-csv"),
+       "write the rows of each table to a CSV file in this directory, which "
+       "the sql dump imports, instead of into the sql dump")
       ("table-prefix,t",
        po::value<std::string>()->value_name("pre_"),
        "prefix to use on all table names")
@@ -410,8 +543,12 @@ class DexSqlDump : public Tool {
               filename.c_str());
       exit(EXIT_FAILURE);
     }
+    auto format = options.count("csv-dir") ? Format::CSV : Format::SQL;
+    std::string csv_dir = options.count("csv-dir")
+                              ? options["csv-dir"].as<std::string>()
+                              : "";
     auto* pfx_cstr = prefix.c_str();
-    dump_sql(fdout, stores, pgmap, pfx_cstr);
+    dump_sql(fdout, format, csv_dir, stores, pgmap, pfx_cstr);
     fclose(fdout);
   }
 };
@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "RedexTool.h"
 #include "Tool.h"
@@ -19,6 +21,11 @@ static constexpr char usage_header[] =
     "  redex-tool [<options>]\n"
     "  redex-tool <tool> --help\n"
     "  redex-tool <tool> [<tool-options>]\n"
+    "  redex-tool batch\n"
+    "    reads lines of '<tool> [<tool-options>]' from stdin and runs them\n"
+    "    one after the other, printing a line of '---' after each of them.\n"
+    "    The dexes are loaded once, and only loaded again for a query with\n"
+    "    other inputs.\n"
     "\n"
     "Available tools:"
   ;
@@ -42,7 +49,7 @@ void show_help(const po::options_description& od) {
   std::cout << usage_footer << std::endl << od << std::endl;
 }
 
-int main(int argc, char* argv[]) {
+int run_tool(int argc, const char* const argv[]) {
   po::options_description od;
   od.add_options()
     ("help,h", "show this screen and exit")
@@ -80,9 +87,42 @@ int main(int argc, char* argv[]) {
     }
     return 1;
   } else {
-    g_redex = new RedexContext();
     tool->run(vm);
-    delete g_redex;
     return 0;
   }
 }
+
+// Runs the tool invocations on the lines of stdin in the same RedexContext,
+// so that Tool::init only loads the dexes again when their inputs change.
+int run_batch(const char* program) {
+  int ret = 0;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    auto args = po::split_unix(line);
+    if (args.empty()) {
+      continue;
+    }
+    std::vector<const char*> argv{program};
+    for (const auto& arg : args) {
+      argv.push_back(arg.c_str());
+    }
+    try {
+      if (run_tool(argv.size(), argv.data()) != 0) {
+        ret = 1;
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      ret = 1;
+    }
+    std::cout << "---" << std::endl;
+  }
+  return ret;
+}
+
+int main(int argc, char* argv[]) {
+  g_redex = new RedexContext();
+  int ret = argc == 2 && !strcmp(argv[1], "batch") ? run_batch(argv[0])
+                                                   : run_tool(argc, argv);
+  delete g_redex;
+  return ret;
+}
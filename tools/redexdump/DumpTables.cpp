@@ -621,6 +621,17 @@ void dump_clsdata(ddump_data* rd, bool print_headers) {
   }
 }
 
+void dump_clsdata_at(ddump_data* rd, uint32_t offset) {
+  // Only the class defs are looked at to find the class of the data.
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    if (rd->dex_class_defs[i].class_data_offset == offset) {
+      redump(offset, "%s", get_class_data_item(rd, i).c_str());
+      return;
+    }
+  }
+  redump("!!!! No class data at 0x%x\n", offset);
+}
+
 static void dump_code_items(ddump_data* rd,
                             dex_code_item* code_items,
                             uint32_t size) {
@@ -639,6 +650,11 @@ static void dump_debug_items(ddump_data* rd,
   }
 }
 
+void dump_code_item_at(ddump_data* rd, uint32_t offset) {
+  auto code_item = (dex_code_item*)(rd->dexmmap + offset);
+  redump(offset, "%s", get_code_item(&code_item).c_str());
+}
+
 void dump_code(ddump_data* rd) {
   unsigned count;
   dex_map_item* maps;
@@ -13,25 +13,60 @@ bool clean = false;
 bool raw = false;
 bool escape = false;
 
+namespace {
+
+thread_local std::string* s_buffer = nullptr;
+
+void vredump(const char* format, va_list va) {
+  if (s_buffer == nullptr) {
+    vprintf(format, va);
+    return;
+  }
+  va_list size_va;
+  va_copy(size_va, va);
+  auto size = vsnprintf(nullptr, 0, format, size_va);
+  va_end(size_va);
+  if (size <= 0) {
+    return;
+  }
+  auto start = s_buffer->size();
+  s_buffer->resize(start + size + 1);
+  vsnprintf(&(*s_buffer)[start], size + 1, format, va);
+  s_buffer->resize(start + size);
+}
+
+void redump_prefix(const char* format, ...) {
+  va_list va;
+  va_start(va, format);
+  vredump(format, va);
+  va_end(va);
+}
+
+} // namespace
+
+RedumpBuffer::RedumpBuffer() : m_previous(s_buffer) { s_buffer = &m_out; }
+
+RedumpBuffer::~RedumpBuffer() { s_buffer = m_previous; }
+
 void redump(const char* format, ...) {
   va_list va;
   va_start(va, format);
-  vprintf(format, va);
+  vredump(format, va);
   va_end(va);
 }
 
 void redump(uint32_t off, const char* format, ...) {
   va_list va;
   va_start(va, format);
-  if (!clean) printf("[0x%x] ", off);
-  vprintf(format, va);
+  if (!clean) redump_prefix("[0x%x] ", off);
+  vredump(format, va);
   va_end(va);
 }
 
 void redump(uint32_t pos, uint32_t off, const char* format, ...) {
   va_list va;
   va_start(va, format);
-  if (!clean) printf("(0x%x) [0x%x] ", pos, off);
-  vprintf(format, va);
+  if (!clean) redump_prefix("(0x%x) [0x%x] ", pos, off);
+  vredump(format, va);
   va_end(va);
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 
 extern bool clean;
 extern bool raw;
@@ -16,3 +17,20 @@ extern bool escape;
 void redump(const char* format, ...);
 void redump(uint32_t off, const char* format, ...);
 void redump(uint32_t pos, uint32_t off, const char* format, ...);
+
+/*
+ * While alive, collects what redump prints on the current thread instead of
+ * writing it to stdout, so that sections can be dumped on several threads and
+ * printed in order afterwards.
+ */
+class RedumpBuffer {
+ public:
+  RedumpBuffer();
+  ~RedumpBuffer();
+
+  const std::string& str() const { return m_out; }
+
+ private:
+  std::string m_out;
+  std::string* m_previous;
+};
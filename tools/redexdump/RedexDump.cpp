@@ -10,6 +10,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "PrintUtil.h"
 #include "Formatters.h"
@@ -41,13 +46,49 @@ static const char ddump_usage_string[] =
     "-A, --anno: print items in the annotation section\n"
     "-d, --debug: print debug info items in the data section\n"
     "-D, --ddebug=<addr>: disassemble debug info item at <addr>\n"
+    "-X, --code-at=<addr>: print the code item at <addr>\n"
+    "-L, --clsdata-at=<addr>: print the class data item at <addr>\n"
     "\n"
     "printing options:\n"
     "--clean: suppress indices and offsets\n"
     "--no-headers: suppress headers\n"
     "--raw: print all bytes, even control characters\n"
+    "-j, --jobs=<n>: dump the sections on <n> threads, printed in order\n"
   ;
 
+/*
+ * Runs the dumps, on `jobs` threads if there are more than one, and prints
+ * what they dumped in their order.
+ */
+static void run_dumps(const std::vector<std::function<void()>>& dumps,
+                      unsigned int jobs) {
+  if (jobs <= 1) {
+    for (const auto& dump : dumps) {
+      dump();
+    }
+    return;
+  }
+  std::vector<std::string> outputs(dumps.size());
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < dumps.size(); i = next++) {
+      RedumpBuffer buffer;
+      dumps[i]();
+      outputs[i] = buffer.str();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < jobs; i++) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& output : outputs) {
+    fwrite(output.data(), 1, output.size(), stdout);
+  }
+}
+
 int main(int argc, char* argv[]) {
 
   bool all = false;
@@ -64,9 +105,12 @@ int main(int argc, char* argv[]) {
   bool anno = false;
   bool redexdump_debug = false;
   uint32_t ddebug_offset = 0;
+  uint32_t code_offset = 0;
+  uint32_t clsdata_offset = 0;
+  unsigned int jobs = 1;
   int no_headers = 0;
 
-  char c;
+  int c;
   static const struct option options[] = {
     { "all", no_argument, nullptr, 'a' },
     { "string", no_argument, nullptr, 's' },
@@ -82,6 +126,9 @@ int main(int argc, char* argv[]) {
     { "anno", no_argument, nullptr, 'A' },
     { "debug", no_argument, nullptr, 'd' },
     { "ddebug", required_argument, nullptr, 'D' },
+    { "code-at", required_argument, nullptr, 'X' },
+    { "clsdata-at", required_argument, nullptr, 'L' },
+    { "jobs", required_argument, nullptr, 'j' },
     { "clean", no_argument, (int*)&clean, 1 },
     { "raw", no_argument, (int*)&raw, 1 },
     { "escape", no_argument, (int*)&escape, 1 },
@@ -93,7 +140,7 @@ int main(int argc, char* argv[]) {
   while ((c = getopt_long(
             argc,
             argv,
-            "asStpfmcCxeAdDh",
+            "asStpfmcCxeAdD:X:L:j:h",
             &options[0],
             nullptr)) != -1) {
     switch (c) {
@@ -139,6 +186,15 @@ int main(int argc, char* argv[]) {
       case 'D':
         sscanf(optarg, "%x", &ddebug_offset);
         break;
+      case 'X':
+        sscanf(optarg, "%x", &code_offset);
+        break;
+      case 'L':
+        sscanf(optarg, "%x", &clsdata_offset);
+        break;
+      case 'j':
+        sscanf(optarg, "%u", &jobs);
+        break;
       case 'h':
         puts(ddump_usage_string);
         return 0;
@@ -157,52 +213,64 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  // Large dumps are written through a large buffer.
+  setvbuf(stdout, nullptr, _IOFBF, 1 << 20);
+
   while (optind < argc) {
     const char* dexfile = argv[optind++];
     ddump_data rd;
     open_dex_file(dexfile, &rd);
-    if (!no_headers) {
-      redump(format_map(&rd).c_str());
+    bool print_headers = !no_headers;
+    std::vector<std::function<void()>> dumps;
+    if (print_headers) {
+      dumps.emplace_back([&] { redump(format_map(&rd).c_str()); });
     }
     if (string || all) {
-      dump_strings(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_strings(&rd, print_headers); });
     }
     if (stringdata || all) {
-      dump_stringdata(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_stringdata(&rd, print_headers); });
     }
     if (type || all) {
-      dump_types(&rd);
+      dumps.emplace_back([&] { dump_types(&rd); });
     }
     if (proto || all) {
-      dump_protos(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_protos(&rd, print_headers); });
     }
     if (field || all) {
-      dump_fields(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_fields(&rd, print_headers); });
     }
     if (meth || all) {
-      dump_methods(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_methods(&rd, print_headers); });
     }
     if (clsdef || all) {
-      dump_clsdefs(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_clsdefs(&rd, print_headers); });
     }
     if (clsdata || all) {
-      dump_clsdata(&rd, !no_headers);
+      dumps.emplace_back([&] { dump_clsdata(&rd, print_headers); });
     }
     if (code || all) {
-      dump_code(&rd);
+      dumps.emplace_back([&] { dump_code(&rd); });
     }
     if (enarr || all) {
-      dump_enarr(&rd);
+      dumps.emplace_back([&] { dump_enarr(&rd); });
     }
     if (anno || all) {
-      dump_anno(&rd);
+      dumps.emplace_back([&] { dump_anno(&rd); });
     }
     if (redexdump_debug || all) {
-      dump_debug(&rd);
+      dumps.emplace_back([&] { dump_debug(&rd); });
     }
     if (ddebug_offset != 0) {
-      disassemble_debug(&rd, ddebug_offset);
+      dumps.emplace_back([&] { disassemble_debug(&rd, ddebug_offset); });
+    }
+    if (code_offset != 0) {
+      dumps.emplace_back([&] { dump_code_item_at(&rd, code_offset); });
+    }
+    if (clsdata_offset != 0) {
+      dumps.emplace_back([&] { dump_clsdata_at(&rd, clsdata_offset); });
     }
+    run_dumps(dumps, jobs);
     fprintf(stdout, "\n");
     fflush(stdout);
   }
@@ -17,7 +17,9 @@ void dump_fields(ddump_data* rd, bool print_headers);
 void dump_methods(ddump_data* rd, bool print_headers);
 void dump_clsdefs(ddump_data* rd, bool print_headers);
 void dump_clsdata(ddump_data* rd, bool print_headers);
+void dump_clsdata_at(ddump_data* rd, uint32_t offset);
 void dump_code(ddump_data* rd);
+void dump_code_item_at(ddump_data* rd, uint32_t offset);
 void dump_enarr(ddump_data* rd);
 void dump_anno(ddump_data* rd);
 void dump_debug(ddump_data* rd);
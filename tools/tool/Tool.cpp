@@ -12,6 +12,7 @@
 #include "DexLoader.h"
 #include "DexUtil.h"
 #include "JarLoader.h"
+#include "RedexContext.h"
 #include "ReachableClasses.h"
 #include "Tool.h"
 
@@ -112,6 +113,21 @@ DexStoresVector Tool::init(const std::string& system_jar_paths,
                            const std::string& dexen_dir_str,
                            bool balloon,
                            bool support_dex_v37) {
+  // Batch mode runs several tools in one RedexContext. Those with the same
+  // inputs share the stores, and other inputs need a fresh context.
+  static RedexContext* loaded_context = nullptr;
+  static std::string loaded_key;
+  static DexStoresVector loaded_stores;
+  auto key = system_jar_paths + "\n" + apk_dir_str + "\n" + dexen_dir_str +
+             "\n" + std::to_string(balloon) + std::to_string(support_dex_v37);
+  if (loaded_context == g_redex) {
+    if (key == loaded_key) {
+      return loaded_stores;
+    }
+    delete g_redex;
+    g_redex = new RedexContext();
+  }
+
   if (!fs::is_directory(fs::path(apk_dir_str))) {
     throw std::invalid_argument("'" + apk_dir_str + "' is not a directory");
   }
@@ -162,5 +178,8 @@ DexStoresVector Tool::init(const std::string& system_jar_paths,
   std::unordered_set<DexType*> no_optimizations_anno;
   init_reachable_classes(scope, config, no_optimizations_anno);
 
+  loaded_context = g_redex;
+  loaded_key = key;
+  loaded_stores = stores;
   return stores;
 }
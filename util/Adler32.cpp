@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Adler32.h"
+
+#include <algorithm>
+#include <climits>
+#include <zlib.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define ADLER32_X86_SSSE3 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+typedef uint32_t (*adler32_fn)(uint32_t adler,
+                               const unsigned char* buf,
+                               size_t len);
+
+uint32_t adler32_zlib(uint32_t adler, const unsigned char* buf, size_t len) {
+  while (len > 0) {
+    auto n = std::min<size_t>(len, UINT_MAX);
+    adler = adler32(adler, buf, n);
+    buf += n;
+    len -= n;
+  }
+  return adler;
+}
+
+#if defined(ADLER32_X86_SSSE3)
+// The largest prime smaller than 65536.
+constexpr uint32_t kBase = 65521;
+// The most bytes that can be summed before the sums may overflow 32 bits.
+constexpr size_t kNMax = 5552;
+constexpr size_t kBlockSize = 32;
+
+__attribute__((target("ssse3"))) uint32_t add_lanes(__m128i v) {
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+/*
+ * Sums the bytes of a block into s1, and each byte times its distance from
+ * the end of the block into s2. The s1 of the preceding blocks is added to
+ * s2 once per block, as the block size times the sum of those s1s.
+ */
+__attribute__((target("ssse3"))) uint32_t adler32_ssse3(
+    uint32_t adler, const unsigned char* buf, size_t len) {
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  const __m128i taps_hi = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23,
+                                        22, 21, 20, 19, 18, 17);
+  const __m128i taps_lo =
+      _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ones = _mm_set1_epi16(1);
+
+  size_t num_blocks = len / kBlockSize;
+  len -= num_blocks * kBlockSize;
+  while (num_blocks > 0) {
+    auto n = std::min(num_blocks, kNMax / kBlockSize);
+    num_blocks -= n;
+    // The sum of the s1 before each block.
+    __m128i prev_s1 = _mm_set_epi32(0, 0, 0, static_cast<int>(s1 * n));
+    __m128i v_s1 = zero;
+    __m128i v_s2 = _mm_set_epi32(0, 0, 0, static_cast<int>(s2));
+    for (; n > 0; n--, buf += kBlockSize) {
+      __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+      __m128i lo =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 16));
+      prev_s1 = _mm_add_epi32(prev_s1, v_s1);
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(hi, zero));
+      v_s2 = _mm_add_epi32(
+          v_s2, _mm_madd_epi16(_mm_maddubs_epi16(hi, taps_hi), ones));
+      v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(lo, zero));
+      v_s2 = _mm_add_epi32(
+          v_s2, _mm_madd_epi16(_mm_maddubs_epi16(lo, taps_lo), ones));
+    }
+    v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(prev_s1, 5));
+
+    s1 += add_lanes(v_s1);
+    s2 = add_lanes(v_s2);
+    s1 %= kBase;
+    s2 %= kBase;
+  }
+
+  for (; len > 0; len--) {
+    s1 += *buf++;
+    s2 += s1;
+  }
+  return ((s2 % kBase) << 16) | (s1 % kBase);
+}
+#endif
+
+adler32_fn select_adler32() {
+#if defined(ADLER32_X86_SSSE3)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3)) {
+    return adler32_ssse3;
+  }
+#endif
+  return adler32_zlib;
+}
+
+} // namespace
+
+uint32_t adler32_update(uint32_t adler, const unsigned char* buf, size_t len) {
+  static const adler32_fn impl = select_adler32();
+  return impl(adler, buf, len);
+}
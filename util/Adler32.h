@@ -0,0 +1,18 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Continues the Adler-32 checksum `adler` over another `len` bytes, like
+ * zlib's adler32(). The checksum of no bytes is 1. On CPUs with SSSE3, 32
+ * bytes are summed at a time.
+ */
+uint32_t adler32_update(uint32_t adler, const unsigned char* buf, size_t len);
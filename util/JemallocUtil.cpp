@@ -9,6 +9,10 @@
 #include <dlfcn.h>
 #endif
 
+#include "JemallocUtil.h"
+
+#include <string>
+
 #include "Debug.h"
 
 extern "C" {
@@ -28,6 +32,9 @@ MallctlFn mallctl = nullptr;
 
 namespace {
 
+// MALLCTL_ARENAS_ALL, which we can't take from jemalloc's header.
+constexpr unsigned kAllArenas = 4096;
+
 void set_profile_active(bool active) {
   if (mallctl == nullptr) {
     return;
@@ -45,4 +52,52 @@ void enable_profiling() { set_profile_active(true); }
 
 void disable_profiling() { set_profile_active(false); }
 
+boost::optional<uint64_t> get_allocated_bytes() {
+  if (mallctl == nullptr) {
+    return boost::none;
+  }
+  // jemalloc caches its statistics; bumping the epoch refreshes them.
+  uint64_t epoch = 1;
+  size_t len = sizeof(epoch);
+  mallctl("epoch", &epoch, &len, &epoch, len);
+  size_t allocated = 0;
+  len = sizeof(allocated);
+  if (mallctl("stats.allocated", &allocated, &len, nullptr, 0) != 0) {
+    return boost::none;
+  }
+  return allocated;
+}
+
+boost::optional<uint64_t> get_resident_bytes() {
+  if (mallctl == nullptr) {
+    return boost::none;
+  }
+  uint64_t epoch = 1;
+  size_t len = sizeof(epoch);
+  mallctl("epoch", &epoch, &len, &epoch, len);
+  size_t resident = 0;
+  len = sizeof(resident);
+  if (mallctl("stats.resident", &resident, &len, nullptr, 0) != 0) {
+    return boost::none;
+  }
+  return resident;
+}
+
+void flush_thread_cache() {
+  if (mallctl == nullptr) {
+    return;
+  }
+  // Fails when the thread cache is disabled, which leaves nothing to flush.
+  mallctl("thread.tcache.flush", nullptr, nullptr, nullptr, 0);
+}
+
+void purge_arenas() {
+  if (mallctl == nullptr) {
+    return;
+  }
+  auto name = "arena." + std::to_string(kAllArenas) + ".purge";
+  int err = mallctl(name.c_str(), nullptr, nullptr, nullptr, 0);
+  always_assert_log(err == 0, "mallctl failed with: %d", err);
+}
+
 } // namespace jemalloc_util
@@ -5,6 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#pragma once
+
+#include <boost/optional.hpp>
+#include <cstdint>
 #include <cstdio>
 
 namespace jemalloc_util {
@@ -13,6 +17,31 @@ void enable_profiling();
 
 void disable_profiling();
 
+/*
+ * The number of bytes currently allocated by the application, as reported by
+ * jemalloc's "stats.allocated". boost::none if we aren't running on jemalloc.
+ */
+boost::optional<uint64_t> get_allocated_bytes();
+
+/*
+ * The number of bytes in pages that jemalloc has mapped and that are
+ * resident, as reported by "stats.resident". This includes the free pages
+ * that it holds on to. boost::none if we aren't running on jemalloc.
+ */
+boost::optional<uint64_t> get_resident_bytes();
+
+/*
+ * Returns the objects cached by the calling thread to their arenas, so that
+ * the pages they are on can be purged.
+ */
+void flush_thread_cache();
+
+/*
+ * Gives the free pages of all arenas back to the OS right away rather than
+ * once they have decayed.
+ */
+void purge_arenas();
+
 class ScopedProfiling final {
  public:
   ScopedProfiling(bool enable) {
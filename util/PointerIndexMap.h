@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Debug.h"
+
+/*
+ * An immutable map from distinct pointers to their index in the sequence the
+ * map was built from, for lookups on hot paths.
+ *
+ * Since all the keys are known upfront, the table is allocated once with
+ * enough room for a load factor of at most a half, and probed linearly: a
+ * lookup is a multiplicative hash of the pointer and usually a single
+ * comparison. Iteration yields the (key, index) pairs in index order.
+ */
+template <class Key, class Index>
+class PointerIndexMap {
+  static_assert(std::is_pointer<Key>::value, "Key must be a pointer type");
+
+ public:
+  using value_type = std::pair<Key, Index>;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  PointerIndexMap() = default;
+
+  explicit PointerIndexMap(const std::vector<Key>& keys) {
+    always_assert(keys.size() <= std::numeric_limits<Index>::max() + 1ull);
+    m_entries.reserve(keys.size());
+    while ((size_t(1) << m_bits) < 2 * keys.size()) {
+      ++m_bits;
+    }
+    m_slots.assign(size_t(1) << m_bits, EMPTY);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      auto slot = find_slot(keys[i]);
+      always_assert_log(m_slots[slot] == EMPTY, "Duplicate key %p", keys[i]);
+      m_slots[slot] = i;
+      m_entries.emplace_back(keys[i], i);
+    }
+  }
+
+  Index at(Key key) const {
+    auto slot = m_slots[find_slot(key)];
+    always_assert_log(slot != EMPTY, "Key %p is not in the map", key);
+    return m_entries[slot].second;
+  }
+
+  size_t count(Key key) const {
+    return m_slots[find_slot(key)] == EMPTY ? 0 : 1;
+  }
+
+  size_t size() const { return m_entries.size(); }
+
+  bool empty() const { return m_entries.empty(); }
+
+  const_iterator begin() const { return m_entries.begin(); }
+
+  const_iterator end() const { return m_entries.end(); }
+
+ private:
+  static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+  // Returns the slot that holds key, or the empty slot where it would go.
+  size_t find_slot(Key key) const {
+    size_t mask = m_slots.size() - 1;
+    size_t slot =
+        (uint64_t(reinterpret_cast<uintptr_t>(key)) * 0x9e3779b97f4a7c15ull) >>
+        (64 - m_bits);
+    while (m_slots[slot] != EMPTY && m_entries[m_slots[slot]].first != key) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  std::vector<value_type> m_entries;
+  // At least two slots, so that the hash is never shifted by 64.
+  std::vector<uint32_t> m_slots = std::vector<uint32_t>(2, EMPTY);
+  size_t m_bits{1};
+};
+
+template <class Key, class Index>
+constexpr uint32_t PointerIndexMap<Key, Index>::EMPTY;
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+
+#include "Debug.h"
+
+/*
+ * Drop-in alternative to MutablePriorityQueue for unsigned integral
+ * priorities, where inserting, erasing and updating take a time that only
+ * depends on the width of the priority, not on the number of elements.
+ *
+ * The present priorities are kept in a radix tree of 64-way buckets: every
+ * node is a bitmap of which of its children are non-empty, so that the
+ * highest priority is found by following the highest set bit of each level.
+ * Most updates only touch the lowest one or two levels.
+ *
+ * It has the same limitations as MutablePriorityQueue: the same value cannot
+ * be present twice, and no two values can share a priority.
+ */
+template <class Value, class Priority>
+class RadixPriorityQueue {
+  static_assert(std::is_unsigned<Priority>::value,
+                "Priority must be an unsigned integral type");
+
+  static constexpr size_t BITS_PER_LEVEL = 6;
+  static constexpr size_t PRIORITY_BITS = std::numeric_limits<Priority>::digits;
+  static constexpr size_t LEVELS =
+      (PRIORITY_BITS + BITS_PER_LEVEL - 1) / BITS_PER_LEVEL;
+
+  // m_levels[l] maps the digits of a priority above level l to the bitmap of
+  // the level-l digits present below them.
+  std::array<std::unordered_map<Priority, uint64_t>, LEVELS> m_levels;
+  std::unordered_map<Priority, Value> m_values;
+  std::unordered_map<Value, Priority> m_priorities;
+
+  static Priority prefix(Priority priority, size_t level) {
+    auto shift = (level + 1) * BITS_PER_LEVEL;
+    return shift < PRIORITY_BITS ? priority >> shift : 0;
+  }
+
+  static uint64_t digit_bit(Priority priority, size_t level) {
+    return uint64_t(1) << ((priority >> (level * BITS_PER_LEVEL)) &
+                           ((1 << BITS_PER_LEVEL) - 1));
+  }
+
+ public:
+  // Inserts a value with a priority; neither value or priority can already be
+  // present.
+  void insert(const Value& value, const Priority& priority) {
+    auto values_result = m_values.emplace(priority, value);
+    always_assert(values_result.second);
+    auto priorities_result = m_priorities.emplace(value, priority);
+    always_assert(priorities_result.second);
+    for (size_t level = 0; level < LEVELS; ++level) {
+      auto& bucket = m_levels[level][prefix(priority, level)];
+      bool was_empty = bucket == 0;
+      bucket |= digit_bit(priority, level);
+      if (!was_empty) {
+        // The levels above already know about this bucket.
+        break;
+      }
+    }
+  }
+
+  // Erases a value that's currently in the queue.
+  void erase(const Value& value) {
+    auto priority_it = m_priorities.find(value);
+    always_assert(priority_it != m_priorities.end());
+    auto priority = priority_it->second;
+    m_priorities.erase(priority_it);
+    m_values.erase(priority);
+    for (size_t level = 0; level < LEVELS; ++level) {
+      auto bucket_it = m_levels[level].find(prefix(priority, level));
+      bucket_it->second &= ~digit_bit(priority, level);
+      if (bucket_it->second != 0) {
+        break;
+      }
+      m_levels[level].erase(bucket_it);
+    }
+  }
+
+  // Changes the priority of a value. The value must already be in the queue.
+  // No current queue element may already have the new priority.
+  void update_priority(const Value& value, const Priority& priority) {
+    erase(value);
+    insert(value, priority);
+  }
+
+  // Removes all elements.
+  void clear() {
+    for (auto& buckets : m_levels) {
+      buckets.clear();
+    }
+    m_values.clear();
+    m_priorities.clear();
+  }
+
+  // Checks if queue is empty.
+  bool empty() const { return m_values.empty(); }
+
+  // Returns element with highest priority.
+  Value front() const {
+    always_assert(!empty());
+    Priority priority = 0;
+    for (size_t level = LEVELS; level-- > 0;) {
+      uint64_t bucket = m_levels[level].at(priority);
+      Priority digit = 63 - __builtin_clzll(bucket);
+      priority = (priority << BITS_PER_LEVEL) | digit;
+    }
+    return m_values.at(priority);
+  }
+};
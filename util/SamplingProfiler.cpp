@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "SamplingProfiler.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#define SAMPLING_PROFILER_SUPPORTED
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#include "Debug.h"
+
+namespace sampling_profiler {
+
+namespace {
+
+#ifdef SAMPLING_PROFILER_SUPPORTED
+
+constexpr int kMaxFrames = 48;
+constexpr size_t kMaxSamples = 1 << 17;
+// The frames of the signal handler and of the signal trampoline.
+constexpr int kSkippedFrames = 2;
+
+struct Sample {
+  int num_frames;
+  void* frames[kMaxFrames];
+};
+
+std::unique_ptr<Sample[]> s_samples;
+std::atomic<size_t> s_num_samples{0};
+std::atomic<bool> s_active{false};
+// The handlers that are running, so that the samples are only read once
+// they are done.
+std::atomic<int> s_in_handler{0};
+
+void on_sigprof(int) {
+  ++s_in_handler;
+  if (s_active.load()) {
+    auto saved_errno = errno;
+    auto i = s_num_samples.fetch_add(1, std::memory_order_relaxed);
+    if (i < kMaxSamples) {
+      auto& sample = s_samples[i];
+      sample.num_frames = backtrace(sample.frames, kMaxFrames);
+    }
+    errno = saved_errno;
+  }
+  --s_in_handler;
+}
+
+void set_timer(unsigned int hz) {
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = hz == 0 ? 0 : std::max(1u, 1000000 / hz);
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+std::string to_hex(uintptr_t value) {
+  char buf[2 + 2 * sizeof(value) + 1];
+  snprintf(buf, sizeof(buf), "0x%zx", static_cast<size_t>(value));
+  return buf;
+}
+
+/*
+ * The function that `pc` is in, or else the module and the offset of `pc` in
+ * it.
+ */
+std::string symbolize(void* pc) {
+  Dl_info info;
+  if (dladdr(pc, &info) == 0) {
+    return to_hex(reinterpret_cast<uintptr_t>(pc));
+  }
+  if (info.dli_sname != nullptr) {
+    int status;
+    char* demangled =
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name = status == 0 ? demangled : info.dli_sname;
+    free(demangled);
+    return name;
+  }
+  std::string module = info.dli_fname != nullptr ? info.dli_fname : "?";
+  auto slash = module.rfind('/');
+  if (slash != std::string::npos) {
+    module = module.substr(slash + 1);
+  }
+  return module + "+" +
+         to_hex(reinterpret_cast<uintptr_t>(pc) -
+                reinterpret_cast<uintptr_t>(info.dli_fbase));
+}
+
+void write_folded(const std::string& path, size_t num_samples) {
+  std::unordered_map<void*, std::string> names;
+  auto name_of = [&](void* pc) -> const std::string& {
+    auto it = names.find(pc);
+    if (it == names.end()) {
+      it = names.emplace(pc, symbolize(pc)).first;
+    }
+    return it->second;
+  };
+  std::map<std::string, size_t> stacks;
+  for (size_t i = 0; i < num_samples; ++i) {
+    const auto& sample = s_samples[i];
+    std::string stack;
+    for (int j = sample.num_frames - 1; j >= kSkippedFrames; --j) {
+      // Return addresses point past the call; look up the call itself, but
+      // not for the frame that was interrupted.
+      auto pc = static_cast<char*>(sample.frames[j]);
+      if (!stack.empty()) {
+        stack += ';';
+      }
+      stack += name_of(j == kSkippedFrames ? pc : pc - 1);
+    }
+    if (!stack.empty()) {
+      ++stacks[stack];
+    }
+  }
+
+  FILE* out = fopen(path.c_str(), "w");
+  if (out == nullptr) {
+    fprintf(stderr, "Cannot write sampled stacks to %s\n", path.c_str());
+    return;
+  }
+  for (const auto& stack : stacks) {
+    fprintf(out, "%s %zu\n", stack.first.c_str(), stack.second);
+  }
+  fclose(out);
+}
+
+#endif // SAMPLING_PROFILER_SUPPORTED
+
+} // namespace
+
+ScopedSampling::ScopedSampling(boost::optional<std::string> output,
+                               unsigned int hz)
+    : m_output(std::move(output)) {
+  if (!m_output) {
+    return;
+  }
+#ifdef SAMPLING_PROFILER_SUPPORTED
+  always_assert_log(!s_active, "Sampling is already running");
+  fprintf(stderr, "Running sampling profiler...\n");
+  if (!s_samples) {
+    s_samples = std::make_unique<Sample[]>(kMaxSamples);
+    // The first call of backtrace() loads the unwinder, which isn't safe in a
+    // signal handler.
+    void* frame;
+    backtrace(&frame, 1);
+    // The handler stays, doing nothing while inactive: a SIGPROF that is
+    // still pending once the timer is stopped would otherwise terminate the
+    // process.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_sigprof;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+  }
+  s_num_samples = 0;
+  s_active = true;
+  set_timer(hz);
+#else
+  fprintf(stderr, "ScopedSampling is a no-op on this platform\n");
+  m_output = boost::none;
+#endif
+}
+
+ScopedSampling::~ScopedSampling() {
+  if (!m_output) {
+    return;
+  }
+#ifdef SAMPLING_PROFILER_SUPPORTED
+  set_timer(0);
+  s_active = false;
+  while (s_in_handler.load() > 0) {
+    std::this_thread::yield();
+  }
+  auto num_samples = s_num_samples.load();
+  auto kept = std::min(num_samples, kMaxSamples);
+  write_folded(*m_output, kept);
+  fprintf(stderr, "Wrote %zu sampled stacks to %s (%zu dropped)\n", kept,
+          m_output->c_str(), num_samples - kept);
+#endif
+}
+
+} // namespace sampling_profiler
@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <boost/optional.hpp>
+#include <string>
+
+namespace sampling_profiler {
+
+/*
+ * Samples the stacks of the threads of the process that use CPU, `hz` times
+ * per second of CPU time, for as long as it is alive. SIGPROF interrupts a
+ * running thread, and the handler unwinds its stack into a buffer allocated
+ * up front. When the scope ends, the stacks are symbolized and written to
+ * `output` as folded stacks -- one line per distinct stack, root first,
+ * frames separated by ';', followed by the number of samples -- which
+ * flamegraph.pl and speedscope read.
+ *
+ * Symbols come from the dynamic symbol table, so binaries need to be linked
+ * with -rdynamic for frames to be named. Other frames are written as the
+ * module and the offset in it, for addr2line.
+ */
+class ScopedSampling final {
+ public:
+  explicit ScopedSampling(boost::optional<std::string> output,
+                          unsigned int hz = 997);
+
+  ~ScopedSampling();
+
+  ScopedSampling(const ScopedSampling&) = delete;
+  ScopedSampling& operator=(const ScopedSampling&) = delete;
+
+ private:
+  boost::optional<std::string> m_output;
+};
+
+} // namespace sampling_profiler
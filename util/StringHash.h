@@ -0,0 +1,20 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * A fast 64-bit hash of `len` bytes, following the XXH64 algorithm. Long
+ * strings are consumed in 32-byte stripes by four independent lanes, so it
+ * runs at several bytes per cycle, while short strings only take a couple of
+ * multiplications. The result depends on the byte order of the host, so it
+ * must not be persisted.
+ */
+uint64_t hash_bytes64(const char* data, size_t len, uint64_t seed = 0);